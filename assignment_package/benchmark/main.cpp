@@ -0,0 +1,300 @@
+// Headless terrain generation benchmark.
+// Generates a fixed square of zones stage by stage on the calling thread
+// and reports the time and heap allocations spent in each stage, then
+// runs NPC path searches over the result.
+//
+// usage: TerrainBenchmark [zonesPerSide = 3] [worldSeed]
+
+#include "scene/terrain.h"
+#include "scene/noise.h"
+#include "scene/pathfinder.h"
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+//--------------------------
+// Allocation counting
+//--------------------------
+static std::atomic<unsigned long long> allocationCount(0);
+static std::atomic<unsigned long long> allocatedBytes(0);
+
+void *operator new(std::size_t size)
+{
+    allocationCount++;
+    allocatedBytes += size;
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+//--------------------------
+// Stage timing
+//--------------------------
+struct StageStats
+{
+    std::string name;
+    qint64 nanoseconds;
+    unsigned long long allocations;
+    unsigned long long bytes;
+    int items;
+};
+
+// Times f() and records it as one stage
+template <typename F>
+StageStats runStage(const std::string &name, int items, F f)
+{
+    unsigned long long allocationsBefore = allocationCount;
+    unsigned long long bytesBefore = allocatedBytes;
+
+    QElapsedTimer timer;
+    timer.start();
+    f();
+    qint64 elapsed = timer.nsecsElapsed();
+
+    return StageStats{name, elapsed,
+                      allocationCount - allocationsBefore,
+                      allocatedBytes - bytesBefore,
+                      items};
+}
+
+void printStage(const StageStats &stats)
+{
+    double ms = stats.nanoseconds / 1e6;
+    std::printf("%-10s %10.2f ms %12.0f items/s %12llu allocs %12.2f MiB\n",
+                stats.name.c_str(), ms,
+                stats.items / (stats.nanoseconds / 1e9),
+                stats.allocations,
+                stats.bytes / (1024.0 * 1024.0));
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    int zonesPerSide = argc > 1 ? std::atoi(argv[1]) : 3;
+    uint64_t worldSeed = argc > 2 ? std::strtoull(argv[2], nullptr, 0) : 0x476F6C64656E4F72ull;
+
+    // the terrain only stores and links the chunks; nothing is drawn
+    Terrain terrain(nullptr, worldSeed);
+
+    std::vector<glm::ivec2> zones;
+    for (int i = 0; i < zonesPerSide; i++) {
+        for (int k = 0; k < zonesPerSide; k++) {
+            zones.push_back(glm::ivec2(i * 64, k * 64));
+        }
+    }
+
+    std::vector<std::unordered_map<int64_t, Chunk*>> zoneChunks;
+    std::vector<Chunk*> chunks;
+    for (const glm::ivec2 &zone : zones) {
+        std::unordered_map<int64_t, Chunk*> zc;
+        for (int x = zone[0]; x < zone[0] + 64; x += 16) {
+            for (int z = zone[1]; z < zone[1] + 64; z += 16) {
+                Chunk *chunk = terrain.instantiateChunkAt(x, z);
+                zc[toKey(x, z)] = chunk;
+                chunks.push_back(chunk);
+            }
+        }
+        zoneChunks.push_back(zc);
+    }
+
+    int columns = static_cast<int>(zones.size()) * 64 * 64;
+    int chunkCount = static_cast<int>(chunks.size());
+
+    MPSCQueue<Chunk*> completedChunks;
+    std::unordered_map<int64_t, sPtr<const ZoneHeightMap>> zoneHeightMaps;
+    std::unordered_map<int64_t, sPtr<const ZoneFeatureIndex>> zoneFeatures;
+
+    std::vector<StageStats> stages;
+
+    // raw Noise::getHeight, the exact per-column reference
+    volatile int heightSink = 0;
+    stages.push_back(runStage("height", columns, [&]() {
+        Noise noise(worldSeed, terrain.getGradientHash());
+        for (const glm::ivec2 &zone : zones) {
+            for (int z = 0; z < 64; z++) {
+                for (int x = 0; x < 64; x++) {
+                    heightSink = heightSink + noise.getHeight(zone[0] + x, zone[1] + z);
+                }
+            }
+        }
+    }));
+
+    // zone height map tiles + FillBlocksWorker::setBlocks
+    stages.push_back(runStage("shape", chunkCount, [&]() {
+        for (size_t i = 0; i < zones.size(); i++) {
+            sPtr<ZoneHeightMap> zoneHeightMap = mkS<ZoneHeightMap>(zones[i][0], zones[i][1]);
+            zoneHeightMaps[toKey(zones[i][0], zones[i][1])] = zoneHeightMap;
+            zoneFeatures[toKey(zones[i][0], zones[i][1])] = mkS<const ZoneFeatureIndex>(zones[i][0], zones[i][1],
+                                                                                        worldSeed);
+            for (const std::pair<const int64_t, Chunk*> &p : zoneChunks[i]) {
+                FillBlocksWorker worker(p.second, zoneHeightMap, &completedChunks,
+                                        worldSeed, terrain.getGradientHash());
+                worker.run();
+            }
+        }
+    }));
+
+    // the later stages, in dependency order over the whole grid
+    std::vector<std::pair<std::string, GenerationStage>> chunkStages = {
+        {"caves", GenerationStage::carved},
+        {"trees", GenerationStage::featured},
+        {"decorate", GenerationStage::decorated},
+    };
+    for (const std::pair<std::string, GenerationStage> &s : chunkStages) {
+        stages.push_back(runStage(s.first, chunkCount, [&]() {
+            for (Chunk *chunk : chunks) {
+                glm::ivec2 corner = chunk->getCorner();
+                int zoneKeyX = static_cast<int>(glm::floor(corner[0] / 64.f)) * 64;
+                int zoneKeyZ = static_cast<int>(glm::floor(corner[1] / 64.f)) * 64;
+                ChunkStageWorker worker(chunk, s.second, worldSeed, terrain.getGradientHash(),
+                                        zoneHeightMaps.at(toKey(zoneKeyX, zoneKeyZ)),
+                                        zoneFeatures.at(toKey(zoneKeyX, zoneKeyZ)),
+                                        &completedChunks);
+                worker.run();
+            }
+        }));
+    }
+
+    // A* searches of the lamas' radius between surface blocks of each zone;
+    // the checksum only changes if the paths do
+    std::vector<std::pair<glm::vec3, glm::vec3>> searches;
+    for (const glm::ivec2 &zone : zones) {
+        const ZoneHeightMap &heights = *zoneHeightMaps.at(toKey(zone[0], zone[1]));
+        for (int i = 0; i < 16; i++) {
+            glm::ivec2 start(zone[0] + 8 + (i * 13) % 48, zone[1] + 8 + (i * 29) % 48);
+            glm::ivec2 goal = glm::clamp(start + glm::ivec2((i % 5) * 5 - 10, (i % 3) * 6 - 6),
+                                         zone, zone + glm::ivec2(63));
+            searches.push_back(std::make_pair(
+                glm::vec3(start[0] + 0.5f, heights.getHeight(start[0], start[1]) + 1.5f, start[1] + 0.5f),
+                glm::vec3(goal[0] + 0.5f, heights.getHeight(goal[0], goal[1]) + 1.5f, goal[1] + 0.5f)));
+        }
+    }
+    size_t pathActions = 0;
+    unsigned long long pathChecksum = 14695981039346656037ull;
+    stages.push_back(runStage("path", static_cast<int>(searches.size()), [&]() {
+        PathFinder pathFinder(7, terrain);
+        for (const std::pair<glm::vec3, glm::vec3> &search : searches) {
+            std::queue<NPCAction> path = pathFinder.searchPathToward(search.first, search.second);
+            pathActions += path.size();
+            for (; !path.empty(); path.pop()) {
+                const NPCAction &action = path.front();
+                for (int value : {static_cast<int>(action.action), static_cast<int>(action.dest.x),
+                                  static_cast<int>(action.dest.y), static_cast<int>(action.dest.z)}) {
+                    pathChecksum = (pathChecksum ^ static_cast<unsigned int>(value)) * 1099511628211ull;
+                }
+            }
+        }
+    }));
+
+    // CPU side of the VBOWorker
+    size_t plainFaces = 0;
+    stages.push_back(runStage("mesh", chunkCount, [&]() {
+        for (Chunk *chunk : chunks) {
+            ChunkVBOdata vbo = chunk->generateVBOdata();
+            plainFaces += vbo.quadCount() + vbo.transparentQuadCount();
+        }
+    }));
+    // the same chunks remeshed with merged quads
+    size_t greedyFaces = 0;
+    Chunk::setGreedyMeshing(true);
+    for (Chunk *chunk : chunks) {
+        chunk->markAllSectionsDirty();
+    }
+    stages.push_back(runStage("greedy", chunkCount, [&]() {
+        for (Chunk *chunk : chunks) {
+            ChunkVBOdata vbo = chunk->generateVBOdata();
+            greedyFaces += vbo.quadCount() + vbo.transparentQuadCount();
+        }
+    }));
+    Chunk::setGreedyMeshing(false);
+
+    // the region store's codec: reloading a stored chunk replaces shape to decorate
+    std::vector<QByteArray> storedChunks(chunks.size());
+    stages.push_back(runStage("store", chunkCount, [&]() {
+        for (size_t i = 0; i < chunks.size(); i++) {
+            std::vector<uint8_t> blocks;
+            chunks[i]->serializeBlocks(blocks);
+            storedChunks[i] = qCompress(reinterpret_cast<const uchar*>(blocks.data()),
+                                        static_cast<int>(blocks.size()));
+        }
+    }));
+    Chunk reloaded(0, 0);
+    stages.push_back(runStage("reload", chunkCount, [&]() {
+        for (const QByteArray &stored : storedChunks) {
+            QByteArray bytes = qUncompress(stored);
+            reloaded.deserializeBlocks(reinterpret_cast<const uint8_t*>(bytes.constData()), bytes.size());
+            reloaded.reclaimRetiredSections();
+        }
+    }));
+
+    std::printf("%d zones, %d chunks, seed 0x%llx\n", static_cast<int>(zones.size()), chunkCount,
+                static_cast<unsigned long long>(worldSeed));
+    std::printf("%-10s %13s %20s %19s %16s\n", "stage", "time", "throughput", "allocations", "allocated");
+
+    qint64 generationTotal = 0;
+    for (const StageStats &stats : stages) {
+        printStage(stats);
+        if (stats.name != "height" && stats.name != "path" && stats.name != "greedy"
+                && stats.name != "store" && stats.name != "reload") {
+            generationTotal += stats.nanoseconds;
+        }
+    }
+    std::printf("total %.2f ms, %.1f chunks/s (shape to mesh)\n",
+                generationTotal / 1e6, chunkCount / (generationTotal / 1e9));
+    std::printf("faces %zu plain, %zu greedy (%.1f%%)\n", plainFaces, greedyFaces,
+                plainFaces > 0 ? 100.0 * greedyFaces / plainFaces : 0.0);
+    std::printf("paths %zu searches, %zu actions, checksum 0x%016llx\n", searches.size(), pathActions,
+                pathChecksum);
+
+    size_t blockBytes = 0;
+    for (Chunk *chunk : chunks) {
+        chunk->reclaimRetiredSections();
+        blockBytes += chunk->blockMemoryUsage();
+    }
+    std::printf("block storage %.2f MiB (%.1f KiB per chunk)\n",
+                blockBytes / (1024.0 * 1024.0), blockBytes / 1024.0 / chunkCount);
+
+    size_t storedBytes = 0;
+    for (const QByteArray &stored : storedChunks) {
+        storedBytes += stored.size();
+    }
+    std::printf("region payload %.2f MiB (%.1f KiB per chunk)\n",
+                storedBytes / (1024.0 * 1024.0), storedBytes / 1024.0 / chunkCount);
+
+    return 0;
+}
@@ -0,0 +1,43 @@
+# Headless fly-through benchmark: the game's renderer with no window.
+# MyGL is never shown and draws into its own frame buffer object on an
+# offscreen surface; the JSON it prints is meant for comparing builds.
+# Build it next to miniMinecraft.pro, e.g.
+#   qmake flythrough/flythrough.pro && make && ./FlyThroughBenchmark --output result.json
+# On a machine with no display, run it with QT_QPA_PLATFORM=offscreen
+# (or under a virtual X server) and a GL 4.0 driver such as Mesa's.
+
+QT += core gui widgets openglwidgets multimedia network
+
+TARGET = FlyThroughBenchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++1z
+CONFIG += release
+win32 {
+    LIBS += -lopengl32
+}
+
+INCLUDEPATH += $$PWD/../include
+
+include($$PWD/../src/src.pri)
+
+# everything but the game's main() and its windows
+SRC_DIR = $$clean_path($$PWD/../src)
+SOURCES -= \
+    $$SRC_DIR/main.cpp \
+    $$SRC_DIR/mainwindow.cpp \
+    $$SRC_DIR/cameracontrolshelp.cpp \
+    $$SRC_DIR/playerinfo.cpp
+HEADERS -= \
+    $$SRC_DIR/mainwindow.h \
+    $$SRC_DIR/cameracontrolshelp.h \
+    $$SRC_DIR/playerinfo.h
+
+SOURCES += \
+    $$PWD/main.cpp
+
+RESOURCES += \
+    $$PWD/../glsl.qrc \
+    $$PWD/../sounds.qrc \
+    $$PWD/../texture.qrc
@@ -0,0 +1,316 @@
+// Headless fly-through benchmark.
+// Renders the game with no window: MyGL draws into its own frame buffer
+// object on an offscreen surface (see MyGL::runHeadlessFrame) on the
+// default world seed, while the player flies a recorded spline at a fixed
+// speed, and the frames run back to back. Prints the frame times, the
+// chunks' request-to-visible latency and the peak memory as JSON.
+//
+// usage: FlyThroughBenchmark [--frames 3000] [--warmup 300] [--speed 20]
+//                            [--path points.txt] [--output result.json]
+//                            [--mesh-cache]
+
+#include "mygl.h"
+#include "memorystats.h"
+#include "threadconfig.h"
+
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSurfaceFormat>
+#include <QTextStream>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+//--------------------------
+// The recorded path
+//--------------------------
+
+// A loop out of the zones loaded at the start and back, over the hills
+// around the spawn, so the flight streams terrain in all the way
+static const std::vector<glm::vec3> recordedPath = {
+    glm::vec3(48.f, 165.f, 48.f),
+    glm::vec3(180.f, 170.f, 70.f),
+    glm::vec3(360.f, 175.f, 180.f),
+    glm::vec3(430.f, 168.f, 400.f),
+    glm::vec3(260.f, 180.f, 540.f),
+    glm::vec3(20.f, 172.f, 470.f),
+    glm::vec3(-140.f, 166.f, 260.f),
+    glm::vec3(-110.f, 170.f, 90.f),
+};
+
+// the camera looks along the path, this far down per block ahead
+static const float lookDown = 0.25f;
+
+/**
+ * @brief The Spline struct
+ *  A closed Catmull-Rom spline through the points, walked by distance
+ *  along it rather than by its parameter, so the player flies it at one
+ *  speed however far apart the points are.
+ */
+struct Spline
+{
+    std::vector<glm::vec3> points;
+    // the distance at every sample, samplesPerSegment per segment
+    std::vector<float> distances;
+    static const int samplesPerSegment = 64;
+
+    explicit Spline(const std::vector<glm::vec3> &points)
+        : points(points), distances()
+    {
+        distances.push_back(0.f);
+        glm::vec3 previous = at(0.f);
+        int samples = static_cast<int>(points.size()) * samplesPerSegment;
+        for (int i = 1; i <= samples; i++) {
+            glm::vec3 p = at(static_cast<float>(i) / samplesPerSegment);
+            distances.push_back(distances.back() + glm::distance(previous, p));
+            previous = p;
+        }
+    }
+
+    float length() const {
+        return distances.back();
+    }
+
+    // the point at parameter t: segment floor(t), wrapping around
+    glm::vec3 at(float t) const {
+        int n = static_cast<int>(points.size());
+        int i = static_cast<int>(glm::floor(t));
+        float f = t - i;
+        auto point = [&](int k) { return points[((k % n) + n) % n]; };
+        glm::vec3 p0 = point(i - 1), p1 = point(i), p2 = point(i + 1), p3 = point(i + 2);
+        return 0.5f * (2.f * p1 + (p2 - p0) * f + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * f * f
+                       + (3.f * p1 - p0 - 3.f * p2 + p3) * f * f * f);
+    }
+
+    // the parameter distance along the loop reaches
+    float parameterAt(float distance) const {
+        distance = std::fmod(distance, length());
+        size_t i = std::upper_bound(distances.begin(), distances.end(), distance) - distances.begin();
+        i = std::min(std::max<size_t>(i, 1), distances.size() - 1);
+        float span = distances[i] - distances[i - 1];
+        float f = span > 0.f ? (distance - distances[i - 1]) / span : 0.f;
+        return (i - 1 + f) / samplesPerSegment;
+    }
+};
+
+// "x y z" per line; # starts a comment
+static bool readPath(const QString &fileName, std::vector<glm::vec3> &points)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream in(&file);
+    while (!in.atEnd()) {
+        QString line = in.readLine().section('#', 0, 0).trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+        QStringList values = line.split(' ', Qt::SkipEmptyParts);
+        bool okX = false, okY = false, okZ = false;
+        if (values.size() != 3) {
+            return false;
+        }
+        points.push_back(glm::vec3(values[0].toFloat(&okX), values[1].toFloat(&okY), values[2].toFloat(&okZ)));
+        if (!okX || !okY || !okZ) {
+            return false;
+        }
+    }
+    return points.size() >= 2;
+}
+
+//--------------------------
+// The report
+//--------------------------
+
+// the nearest-rank percentile of the sorted times
+static double percentile(const std::vector<float> &sorted, double p)
+{
+    size_t rank = static_cast<size_t>(std::ceil(p / 100.0 * sorted.size()));
+    return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// the process's peak resident set since it started, or -1
+static qint64 peakResidentBytes()
+{
+#ifdef Q_OS_UNIX
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#ifdef Q_OS_MACOS
+        return usage.ru_maxrss;
+#else
+        return static_cast<qint64>(usage.ru_maxrss) * 1024;
+#endif
+    }
+#endif
+    return -1;
+}
+
+int main(int argc, char *argv[])
+{
+    QApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    ThreadConfig::addOptions(parser);
+    parser.addOption(QCommandLineOption("frames", "Frames to record.", "frames", "3000"));
+    parser.addOption(QCommandLineOption("warmup", "Frames run at the start of the path before recording, "
+                                        "while the first zones load.", "frames", "300"));
+    parser.addOption(QCommandLineOption("speed", "Blocks the player flies per second of 60 frames; each frame "
+                                        "moves it 1/60 of that, however long it takes.", "blocks", "20"));
+    parser.addOption(QCommandLineOption("width", "The frame's width in pixels.", "pixels", "1280"));
+    parser.addOption(QCommandLineOption("height", "The frame's height in pixels.", "pixels", "720"));
+    parser.addOption(QCommandLineOption("path", "A file of the spline's points, \"x y z\" per line, in place "
+                                        "of the recorded loop.", "file"));
+    parser.addOption(QCommandLineOption("output", "Write the JSON here rather than to stdout.", "file"));
+    parser.addOption(QCommandLineOption("mesh-cache", "Cache the chunk meshes as the game does, reading back "
+                                        "those an earlier run with it cached rather than meshing every chunk."));
+    parser.process(app);
+    QString configError;
+    if (!ThreadConfig::global().load(parser, configError)) {
+        fprintf(stderr, "%s\n", qPrintable(configError));
+        return 1;
+    }
+    bool okFrames = false, okWarmup = false, okSpeed = false, okWidth = false, okHeight = false;
+    int frames = parser.value("frames").toInt(&okFrames);
+    int warmup = parser.value("warmup").toInt(&okWarmup);
+    float speed = parser.value("speed").toFloat(&okSpeed);
+    int width = parser.value("width").toInt(&okWidth);
+    int height = parser.value("height").toInt(&okHeight);
+    if (!okFrames || frames <= 0 || !okWarmup || warmup < 0 || !okSpeed || speed < 0.f
+            || !okWidth || width <= 0 || !okHeight || height <= 0) {
+        fprintf(stderr, "The frames, size and speed must be positive\n");
+        return 1;
+    }
+    std::vector<glm::vec3> points = recordedPath;
+    if (parser.isSet("path")) {
+        points.clear();
+        if (!readPath(parser.value("path"), points)) {
+            fprintf(stderr, "Could not read two or more points from %s\n", qPrintable(parser.value("path")));
+            return 1;
+        }
+    }
+    Spline spline(points);
+
+    // as the game asks for, with no vsync to wait on
+    QSurfaceFormat format;
+    format.setVersion(4, 0);
+    format.setOption(QSurfaceFormat::DeprecatedFunctions, false);
+    format.setProfile(QSurfaceFormat::CoreProfile);
+    format.setSwapInterval(0);
+    QSurfaceFormat::setDefaultFormat(format);
+
+    // every run meshes from scratch unless asked, so runs compare
+    MyGL::setMeshCache(parser.isSet("mesh-cache"));
+
+    // never shown: no window, no MainWindow
+    MyGL gl;
+    gl.resize(width, height);
+
+    auto flyTo = [&](float distance) {
+        float t = spline.parameterAt(distance);
+        glm::vec3 position = spline.at(t);
+        glm::vec3 ahead = spline.at(spline.parameterAt(distance + 1.f)) - position;
+        glm::vec3 look = glm::length(ahead) > 0.f ? glm::normalize(ahead) : glm::vec3(0.f, 0.f, -1.f);
+        gl.placePlayer(position, glm::normalize(look - glm::vec3(0.f, lookDown, 0.f)));
+    };
+
+    for (int i = 0; i < warmup; i++) {
+        flyTo(0.f);
+        gl.runHeadlessFrame();
+    }
+
+    TerrainPipelineStats before = gl.getTerrain().getPipelineStats();
+    std::vector<float> frameMs;
+    frameMs.reserve(frames);
+    int64_t peakTrackedBytes = MemoryStats::getTotalBytes();
+    QElapsedTimer timer;
+    for (int i = 0; i < frames; i++) {
+        flyTo(i * speed * MyGL::simulationStep);
+        timer.start();
+        gl.runHeadlessFrame();
+        frameMs.push_back(timer.nsecsElapsed() / 1e6f);
+        peakTrackedBytes = std::max(peakTrackedBytes, MemoryStats::getTotalBytes());
+    }
+    TerrainPipelineStats after = gl.getTerrain().getPipelineStats();
+
+    std::vector<float> sorted(frameMs);
+    std::sort(sorted.begin(), sorted.end());
+    // the "1% low": the mean of the slowest 1%, as NPCBenchmark reports it
+    size_t slowest = std::max<size_t>(1, sorted.size() / 100);
+    QJsonObject frameTimes{
+        {"mean", std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size()},
+        {"min", sorted.front()},
+        {"p50", percentile(sorted, 50.0)},
+        {"p90", percentile(sorted, 90.0)},
+        {"p95", percentile(sorted, 95.0)},
+        {"p99", percentile(sorted, 99.0)},
+        {"max", sorted.back()},
+        {"low1", std::accumulate(sorted.end() - slowest, sorted.end(), 0.0) / slowest},
+    };
+
+    QJsonObject phases;
+    for (int i = 0; i < FrameProfile::phaseCount; i++) {
+        FramePhase phase = static_cast<FramePhase>(i);
+        phases[FrameProfile::getName(phase)] = gl.getFrameProfile().getAverageMs(phase);
+    }
+
+    // the max is over the warmup's first zones too
+    uint64_t shown = after.chunksShown - before.chunksShown;
+    QJsonObject chunkLatency{
+        {"chunks", static_cast<qint64>(shown)},
+        {"meanMs", shown > 0 ? (after.showLatencyNs - before.showLatencyNs) / 1e6 / shown : 0.0},
+        {"maxSinceStartMs", after.maxShowLatencyNs / 1e6},
+    };
+
+    QJsonObject categories;
+    for (int i = 0; i < MemoryStats::categoryCount; i++) {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        categories[MemoryStats::getName(category)] = QJsonObject{
+            {"bytes", static_cast<qint64>(MemoryStats::getBytes(category))},
+            {"peakBytes", static_cast<qint64>(MemoryStats::getPeakBytes(category))},
+        };
+    }
+    QJsonObject memory{
+        {"peakTrackedBytes", static_cast<qint64>(peakTrackedBytes)},
+        {"peakResidentBytes", peakResidentBytes()},
+        {"categories", categories},
+    };
+
+    QJsonObject report{
+        {"seed", QString("0x%1").arg(gl.getTerrain().getWorldSeed(), 0, 16)},
+        {"width", width},
+        {"height", height},
+        {"warmupFrames", warmup},
+        {"frames", frames},
+        {"speed", speed},
+        {"pathLength", spline.length()},
+        {"frameMs", frameTimes},
+        {"phaseMs", phases},
+        {"chunkVisibleLatency", chunkLatency},
+        {"memory", memory},
+    };
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+
+    if (parser.isSet("output")) {
+        QFile file(parser.value("output"));
+        if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(json) != json.size()) {
+            fprintf(stderr, "Could not write %s\n", qPrintable(parser.value("output")));
+            return 1;
+        }
+    } else {
+        fwrite(json.constData(), 1, json.size(), stdout);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,136 @@
+#version 430
+// GPU port of the plain (one quad per face) chunk mesher in scene/chunk.cpp,
+// for the compute meshing backend (see ChunkComputeMesher). One invocation
+// per block of the chunk. The host prepends "#define CHUNKMESH_COUNT" after
+// the version line to build the counting pass, which only counts each
+// section's visible faces per pass; the emit pass then writes the faces,
+// as packed vertices (see packVertex in scene/chunk.cpp), from each
+// section's start in the pass' buffer on.
+// The shading is an approximation of Chunk::shadeFace: full sky light in
+// front of a face open to the sky, none below the column's top, the
+// block's own emission, and ambient occlusion from the blocks around
+// each corner. Water tops are not merged into planes.
+
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 8) in;
+
+// the chunk's blocks and a one-block border, (x + 1, z + 1, y)
+// (see Chunk::copyBlockVolume)
+uniform usampler3D u_Blocks;
+// 1 + the highest opaque block of each column, [(x + 1) + 18 * (z + 1)]
+uniform int u_OpaqueTops[324];
+
+// per block type: opaque (bit 0), animatable (bit 1), emission (bits 2 to 5);
+// the texture layer of each face, [type * 6 + face]; and the four
+// corners of each face, [face * 4 + vertex], x | y << 1 | z << 2 | uv u << 3 | uv v << 4
+layout(std430, binding = 0) readonly buffer BlockTable {
+    uint blockFlags[256];
+    uint faceLayers[256 * 6];
+    uint faceCorners[6 * 4];
+};
+
+// [pass * 16 + section]: the count pass' face counts; the emit pass'
+// cursors, starting at each section's first quad. [32 + pass]: the
+// faces of animatable blocks in each pass
+layout(std430, binding = 1) buffer Counters {
+    uint counters[34];
+};
+
+#ifndef CHUNKMESH_COUNT
+layout(std430, binding = 2) writeonly buffer OpaqueVertices {
+    uvec2 opaqueVertices[];
+};
+layout(std430, binding = 3) writeonly buffer TransparentVertices {
+    uvec2 transparentVertices[];
+};
+#endif
+
+// per face index, in Direction order: XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
+const ivec3 normals[6] = ivec3[6](ivec3( 1,  0,  0), ivec3(-1,  0,  0),
+                                  ivec3( 0,  1,  0), ivec3( 0, -1,  0),
+                                  ivec3( 0,  0,  1), ivec3( 0,  0, -1));
+// the axes along which each face's uv grows (see faceAxes in scene/chunk.cpp)
+const ivec2 tangents[6] = ivec2[6](ivec2(2, 1), ivec2(2, 1), ivec2(0, 2),
+                                   ivec2(0, 2), ivec2(0, 1), ivec2(0, 1));
+
+// EMPTY past the world's top and bottom
+uint blockAt(ivec3 p)
+{
+    if (p.y < 0 || p.y > 255) {
+        return 0u;
+    }
+    return texelFetch(u_Blocks, ivec3(p.x + 1, p.z + 1, p.y), 0).r;
+}
+
+bool isOpaque(uint type)
+{
+    return (blockFlags[type] & 1u) != 0u;
+}
+
+void main()
+{
+    ivec3 p = ivec3(gl_GlobalInvocationID);
+    uint type = blockAt(p);
+    if (type == 0u) {
+        return;
+    }
+    uint flags = blockFlags[type];
+    bool opaque = (flags & 1u) != 0u;
+    uint animatable = (flags >> 1) & 1u;
+    uint pass = opaque ? 0u : 1u;
+    uint counter = pass * 16u + uint(p.y >> 4);
+
+    for (int f = 0; f < 6; f++) {
+        ivec3 front = p + normals[f];
+        uint facing = blockAt(front);
+        // an opaque block shows the faces not against opaque ones, the
+        // others only those against nothing
+        if (opaque ? isOpaque(facing) : facing != 0u) {
+            continue;
+        }
+#ifdef CHUNKMESH_COUNT
+        atomicAdd(counters[counter], 1u);
+        atomicAdd(counters[32u + pass], animatable);
+#else
+        uint quad = atomicAdd(counters[counter], 1u);
+
+        uint layer = faceLayers[type * 6u + uint(f)];
+        int skyLight = front.y >= u_OpaqueTops[(front.x + 1) + 18 * (front.z + 1)] ? 15 : 0;
+        int blockLight = int((flags >> 2) & 15u);
+
+        uint occlusion[4];
+        int brightness[4];
+        for (int k = 0; k < 4; k++) {
+            uint corner = faceCorners[f * 4 + k];
+            ivec3 cornerPos = ivec3(corner & 1u, (corner >> 1) & 1u, (corner >> 2) & 1u);
+            ivec3 side1 = ivec3(0);
+            ivec3 side2 = ivec3(0);
+            side1[tangents[f].x] = cornerPos[tangents[f].x] * 2 - 1;
+            side2[tangents[f].y] = cornerPos[tangents[f].y] * 2 - 1;
+            bool s1 = isOpaque(blockAt(front + side1));
+            bool s2 = isOpaque(blockAt(front + side2));
+            bool c = isOpaque(blockAt(front + side1 + side2));
+            int occluders = (s1 && s2) ? 3 : int(s1) + int(s2) + int(c);
+            occlusion[k] = uint(3 - occluders);
+            brightness[k] = int(occlusion[k]) + max(skyLight, blockLight);
+        }
+        // split along the brighter diagonal, as Chunk::appendFaces does
+        int first = brightness[0] + brightness[2] < brightness[1] + brightness[3] ? 1 : 0;
+
+        for (int i = 0; i < 4; i++) {
+            int k = (first + i) & 3;
+            uint corner = faceCorners[f * 4 + k];
+            uvec3 pos = uvec3(p) + uvec3(corner & 1u, (corner >> 1) & 1u, (corner >> 2) & 1u);
+            uvec2 vertex;
+            vertex.x = pos.x | (pos.y << 5) | (pos.z << 14) | (uint(f) << 19)
+                    | (animatable << 22) | (occlusion[k] << 23);
+            vertex.y = layer | (((corner >> 3) & 1u) << 8) | (((corner >> 4) & 1u) << 13)
+                    | (uint(skyLight) << 18) | (uint(blockLight) << 22);
+            if (opaque) {
+                opaqueVertices[quad * 4u + uint(i)] = vertex;
+            } else {
+                transparentVertices[quad * 4u + uint(i)] = vertex;
+            }
+        }
+#endif
+    }
+}
@@ -0,0 +1,29 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// The depth pre-pass of the opaque chunks: the packed chunk vertex of
+// terrain.vert.glsl, of which only the position is decoded, seen from the
+// camera. The color pass then tests for equal depth, so the position must
+// come out bit for bit as terrain.vert.glsl computes it: the same
+// arithmetic, and gl_Position invariant in both.
+
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
+in uvec2 vs_Packed;         // The packed vertex
+in ivec2 vs_ChunkOrigin;    // The chunk's (x, z), as in terrain.vert.glsl
+
+invariant gl_Position;
+
+void main()
+{
+    uint w0 = vs_Packed.x;
+    vec4 pos = vec4(float(w0 & 31u), float((w0 >> 5) & 511u), float((w0 >> 14) & 31u), 1);
+    vec4 worldPos = pos + vec4(float(vs_ChunkOrigin.x), 0, float(vs_ChunkOrigin.y), 0);
+    gl_Position = u_ViewProj * worldPos;
+}
@@ -4,7 +4,13 @@
 // Refer to the lambert shader files for useful comments
 
 uniform mat4 u_Model;
-uniform mat4 u_ViewProj;
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
 
 in vec4 vs_Pos;
 in vec4 vs_Col;
@@ -7,9 +7,13 @@
 //This simultaneous transformation allows your program to run much faster, especially when rendering
 //geometry with millions of vertices.
 
-uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformation.
-                            // We've written a static matrix for you to use for HW2,
-                            // but in HW3 you'll have to generate one yourself
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
 
 in vec4 vs_Pos;             // The array of vertex positions passed to the shader
 in vec4 vs_Nor;             // The array of vertex normals passed to the shader
@@ -10,10 +10,39 @@
 // data passed into the fragment shader by the vertex shader, the fragment shader
 // can compute what color to apply to its pixel based on things like vertex
 // position, light position, and vertex color.
+//
+// Permutations (see ShaderProgram::create):
+//   ANIMATED: faces may slide along their tile row (see terrain.vert.glsl);
+//     without it the tile is read as is
+//   ORDER_INDEPENDENT: the transparent pass, written for weighted blended
+//     order-independent transparency (see TransparencyBuffer) rather than
+//     blended over the scene: the fragments of any order resolve to the
+//     same result, so the transparent chunks are drawn unsorted
+
+#ifdef ORDER_INDEPENDENT
+#extension GL_ARB_explicit_attrib_location : require
+#endif
 
 uniform vec4 u_Color; // The color with which to render this instance of geometry.
-uniform sampler2D u_Texture;
-uniform int u_Time;
+uniform sampler2DArray u_Texture; // The block tiles, a layer each
+uniform sampler2DArrayShadow u_ShadowMap; // The sun's depth, a layer per cascade (see ShadowMap)
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+// The emissive blocks' lights in view, sorted into clusters (see ClusteredLights)
+layout(std140) uniform PointLights
+{
+    vec4 u_LightPositions[256]; // xyz in the world, the radius in w
+    vec4 u_LightColors[256];
+    ivec4 u_ClusterGrid;        // The tiles across and up, the slices, the lights
+    vec4 u_ClusterDepth;        // The target's pixels, the first slice's depth, slices per log of depth
+};
+uniform usampler3D u_Clusters;     // Per cluster, its first index and its count
+uniform usampler2D u_LightIndices; // The clusters' lists of lights, 1024 a row
 
 // These are the interpolated values out of the rasterizer, so you can't know
 // their specific values without knowing the vertices that contributed to them
@@ -21,11 +50,24 @@ in vec4 fs_Pos;
 in vec4 fs_Nor;
 in vec4 fs_LightVec;
 //in vec4 fs_Col;
-in vec2 fs_UV;
-in vec2 fs_AnimatableFlag;
-
+in vec2 fs_TileUV;
+flat in float fs_TileLayer;
+#ifdef ANIMATED
+flat in float fs_TileShift;
+#endif
+in vec2 fs_Light;
+in float fs_Occlusion;
+in vec3 fs_ShadowCoord[3];
+in vec3 fs_WorldPos;
+in float fs_ViewDepth;
+
+#ifdef ORDER_INDEPENDENT
+layout(location = 0) out vec4 out_Accum;     // the color times alpha, and alpha, weighted
+layout(location = 1) out float out_Revealage; // alpha, which the blending turns into 1 - alpha
+#else
 out vec4 out_Col; // This is the final output color that you will see on your
                   // screen for the pixel that is currently being processed.
+#endif
 
 float random1(vec3 p) {
     return fract(sin(dot(p,vec3(127.1, 311.7, 191.999)))
@@ -72,17 +114,80 @@ float fbm(vec3 p) {
     return sum;
 }
 
+// Whether the cascade's map holds the point
+bool inCascade(vec3 coord) {
+    return all(greaterThan(coord, vec3(0.0))) && all(lessThan(coord, vec3(1.0)));
+}
+
+// How much of the sun reaches the fragment, from the finest cascade that
+// holds it; beyond them all, or without them, the sun is unblocked
+float sunVisibility() {
+    if (inCascade(fs_ShadowCoord[0])) {
+        return texture(u_ShadowMap, vec4(fs_ShadowCoord[0].xy, 0.0, fs_ShadowCoord[0].z));
+    }
+    if (inCascade(fs_ShadowCoord[1])) {
+        return texture(u_ShadowMap, vec4(fs_ShadowCoord[1].xy, 1.0, fs_ShadowCoord[1].z));
+    }
+    if (inCascade(fs_ShadowCoord[2])) {
+        return texture(u_ShadowMap, vec4(fs_ShadowCoord[2].xy, 2.0, fs_ShadowCoord[2].z));
+    }
+    return 1.0;
+}
+
+// The light the point lights of the fragment's cluster give it, each
+// fading out toward its radius
+vec3 pointLights(vec3 normal) {
+    if (u_ClusterGrid.w == 0) {
+        return vec3(0.0);
+    }
+    ivec2 tile = clamp(ivec2(gl_FragCoord.xy / u_ClusterDepth.xy * vec2(u_ClusterGrid.xy)),
+                       ivec2(0), u_ClusterGrid.xy - 1);
+    int slice = int(log(max(fs_ViewDepth, u_ClusterDepth.z) / u_ClusterDepth.z) * u_ClusterDepth.w);
+    slice = clamp(slice, 0, u_ClusterGrid.z - 1);
+    uvec2 cluster = texelFetch(u_Clusters, ivec3(tile, slice), 0).xy;
+
+    vec3 sum = vec3(0.0);
+    for (uint i = 0u; i < cluster.y; i++) {
+        uint index = cluster.x + i;
+        int light = int(texelFetch(u_LightIndices, ivec2(int(index % 1024u), int(index / 1024u)), 0).r);
+        vec4 position = u_LightPositions[light];
+        vec3 toLight = position.xyz - fs_WorldPos;
+        float dist = length(toLight);
+        float falloff = clamp(1.0 - dist / position.w, 0.0, 1.0);
+        // the faces turned away still catch some of it, as block light does
+        float facing = clamp(dot(normal, toLight / max(dist, 1e-3)), 0.0, 1.0);
+        sum += u_LightColors[light].rgb * falloff * falloff * (0.3 + 0.7 * facing);
+    }
+    return sum;
+}
+
 void main()
 {
     // Material base color (before shading)
 
-        vec4 diffuseColor = texture(u_Texture, fs_UV);
+        // a merged quad repeats its tile: wrap the uv back into it. An
+        // animatable face slides into the next tile, which it reaches
+        // as the uv runs past 1.
+        vec2 uv = fract(fs_TileUV);
+#ifdef ANIMATED
+        uv.x += fs_TileShift;
+        float layer = fs_TileLayer + floor(uv.x);
+        uv.x = fract(uv.x);
+#else
+        float layer = fs_TileLayer;
+#endif
+        // the mip level from the uv before it wraps, which has no seams
+        vec4 diffuseColor = textureGrad(u_Texture, vec3(uv, layer), dFdx(fs_TileUV), dFdy(fs_TileUV));
         diffuseColor = diffuseColor * (0.5 * fbm(fs_Pos.xyz) + 0.5);
 
         // Calculate the diffuse term for Lambert shading
         float diffuseTerm = dot(normalize(fs_Nor), normalize(fs_LightVec));
         // Avoid negative lighting values
         diffuseTerm = clamp(diffuseTerm, 0, 1);
+        // only the faces turned to the sun can be in its shadow
+        if (diffuseTerm > 0.0) {
+            diffuseTerm *= sunVisibility();
+        }
 
         float ambientTerm = 0.2;
 
@@ -90,6 +195,34 @@ void main()
                                                             //to simulate ambient lighting. This ensures that faces that are not
                                                             //lit by our point light are not completely black.
 
+        // The sun only reaches as far as the sky light does, and each
+        // level of light is a fifth dimmer than the one above it; block
+        // light is warm and ignores the sun's direction
+        vec2 levels = pow(vec2(0.8), 15.0 - fs_Light);
+        vec3 light = max(vec3(lightIntensity * levels.x), vec3(1.0, 0.85, 0.7) * levels.y);
+        // the emissive blocks near it, per pixel; the same blocks flood
+        // the block light above, so the two do not add up
+        light = max(light, pointLights(normalize(fs_Nor.xyz)));
+        // corners closed in by blocks are darker
+        light *= mix(0.5, 1.0, fs_Occlusion);
+
         // Compute final shaded color
-        out_Col = vec4(diffuseColor.rgb * lightIntensity, diffuseColor.a);
+        vec4 color = vec4(diffuseColor.rgb * light, diffuseColor.a);
+#ifdef ORDER_INDEPENDENT
+        // near and opaque fragments weigh the most (McGuire and Bavoil's
+        // depth weight), kept within what half floats sum safely
+        float alphaWeight = min(1.0, color.a * 10.0) + 0.01;
+#ifdef REVERSE_Z
+        // near / distance: 1 - it is about the usual depth
+        float depthWeight = 1.0 - (1.0 - gl_FragCoord.z) * 0.9;
+#else
+        float depthWeight = 1.0 - gl_FragCoord.z * 0.9;
+#endif
+        float weight = clamp(alphaWeight * alphaWeight * alphaWeight * 1e8
+                             * depthWeight * depthWeight * depthWeight, 1e-2, 3e3);
+        out_Accum = vec4(color.rgb * color.a, color.a) * weight;
+        out_Revealage = color.a;
+#else
+        out_Col = color;
+#endif
 }
@@ -7,6 +7,9 @@
 //If it were run on your CPU, each vertex would have to be processed in a FOR loop, one at a time.
 //This simultaneous transformation allows your program to run much faster, especially when rendering
 //geometry with millions of vertices.
+//With ANIMATED defined (see ShaderProgram::create), the vertices flagged
+//animatable slide along their tile; the NPCs, which have none, leave it
+//out and skip the flag altogether.
 
 uniform mat4 u_Model;       // The matrix that defines the transformation of the
                             // object we're rendering. In this assignment,
@@ -16,14 +19,16 @@ uniform mat4 u_ModelInvTr;  // The inverse transpose of the model matrix.
                             // This allows us to transform the object's normals properly
                             // if the object has been non-uniformly scaled.
 
-uniform mat4 u_ViewProj;    // The matrix that defines the camera's transformation.
-                            // We've written a static matrix for you to use for HW2,
-                            // but in HW3 you'll have to generate one yourself
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
 
 uniform vec4 u_Color;       // When drawing the cube instance, we'll set our uniform color to represent different block types.
 
-uniform int u_Time;
-
 in vec4 vs_Pos;             // The array of vertex positions passed to the shader
 
 in vec4 vs_Nor;             // The array of vertex normals passed to the shader
@@ -32,14 +37,15 @@ in vec4 vs_Nor;             // The array of vertex normals passed to the shader
 
 in vec2 vs_UV;              // The array of vertex uv passed to the shader
 
+#ifdef ANIMATED
 in vec2 vs_AnimatableFlag;  // The array of vertex animatableFlag passed to the shader
+#endif
 
 out vec4 fs_Pos;
 out vec4 fs_Nor;            // The array of normals that has been transformed by u_ModelInvTr. This is implicitly passed to the fragment shader.
 out vec4 fs_LightVec;       // The direction in which our virtual light lies, relative to each vertex. This is implicitly passed to the fragment shader.
 //out vec4 fs_Col;            // The color of each vertex. This is implicitly passed to the fragment shader.
 out vec2 fs_UV;             // The uv of each vertex. This is implicitly passed to the fragment shader.
-out vec2 fs_AnimatableFlag; // The animatable flag of each vertex. This is implicitly passed to the fragment shader.
 
 const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));  // The direction of our virtual light, which is used to compute the shading of
                                         // the geometry in the fragment shader.
@@ -47,16 +53,19 @@ const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));  // The direction of our
 void main()
 {
 
+#ifdef ANIMATED
     if (vs_AnimatableFlag.x > 0.f) {
         // apply uv offset to animatable block (move to right)
         fs_UV = vec2(vs_UV.x + float(mod(u_Time, 100.f) / 100.f) * 0.0625f, vs_UV.y);
     } else {
         fs_UV = vs_UV;
     }
+#else
+    fs_UV = vs_UV;
+#endif
 
     fs_Pos = vs_Pos;
 //    fs_Col = vs_Col;                         // Pass the vertex colors to the fragment shader for interpolation
-    fs_AnimatableFlag = vs_AnimatableFlag;
 
     mat3 invTranspose = mat3(u_ModelInvTr);
     fs_Nor = vec4(invTranspose * vec3(vs_Nor), 0);          // Pass the vertex normals to the fragment shader for interpolation.
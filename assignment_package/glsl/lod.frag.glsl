@@ -0,0 +1,28 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// Lambert shading of the distant terrain's vertex colors, fading into the
+// clear color towards the far edge of the rings to hide where they end.
+
+uniform vec2 u_MorphCenter; // The (x, z) the lod rings are centered on
+uniform vec2 u_FogRange;    // The distances over which the terrain fades out
+
+in vec4 fs_Pos;
+in vec4 fs_Nor;
+in vec4 fs_LightVec;
+in vec4 fs_Col;
+
+out vec4 out_Col;
+
+const vec3 skyColor = vec3(0.37, 0.74, 1.0);
+
+void main()
+{
+    float diffuseTerm = clamp(dot(normalize(fs_Nor), normalize(fs_LightVec)), 0, 1);
+    float ambientTerm = 0.2;
+    vec3 color = fs_Col.rgb * (diffuseTerm + ambientTerm);
+
+    float dist = length(fs_Pos.xz - u_MorphCenter);
+    float fog = smoothstep(u_FogRange.x, u_FogRange.y, dist);
+    out_Col = vec4(mix(color, skyColor, fog), 1);
+}
@@ -0,0 +1,42 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// The distant terrain vertex shader (see scene/distantterrain.h).
+// Vertices are in world space; vs_Pos.w is the height the vertex morphs to
+// as its Chebyshev distance from u_MorphCenter runs over u_MorphRange, so a
+// level meets the next coarser one without a step at the seam.
+
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+uniform vec2 u_MorphCenter; // The (x, z) the lod rings are centered on
+uniform vec2 u_MorphRange;  // The distances at which the morph starts and ends
+
+in vec4 vs_Pos;             // (x, y, z, morphed y)
+in vec4 vs_Nor;
+in vec4 vs_Col;
+
+out vec4 fs_Pos;
+out vec4 fs_Nor;
+out vec4 fs_LightVec;
+out vec4 fs_Col;
+
+const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));
+
+void main()
+{
+    vec2 d = abs(vs_Pos.xz - u_MorphCenter);
+    float t = clamp((max(d.x, d.y) - u_MorphRange.x) / (u_MorphRange.y - u_MorphRange.x), 0, 1);
+    vec4 pos = vec4(vs_Pos.x, mix(vs_Pos.y, vs_Pos.w, t), vs_Pos.z, 1);
+
+    fs_Pos = pos;
+    fs_Nor = vs_Nor;
+    fs_LightVec = lightDir;
+    fs_Col = vs_Col;
+
+    gl_Position = u_ViewProj * pos;
+}
@@ -12,8 +12,18 @@
 // position, light position, and vertex color.
 
 uniform vec4 u_Color; // The color with which to render this instance of geometry.
+#ifdef SKIN_ARRAY
+uniform sampler2DArray u_Texture; // every NPC skin, a layer each (see NPCPartBatch)
+#else
 uniform sampler2D u_Texture;
-uniform int u_Time;
+#endif
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
 
 // These are the interpolated values out of the rasterizer, so you can't know
 // their specific values without knowing the vertices that contributed to them
@@ -22,7 +32,9 @@ in vec4 fs_Nor;
 in vec4 fs_LightVec;
 //in vec4 fs_Col;
 in vec2 fs_UV;
-in vec2 fs_AnimatableFlag;
+#ifdef SKIN_ARRAY
+in float fs_Layer;
+#endif
 
 out vec4 out_Col; // This is the final output color that you will see on your
                   // screen for the pixel that is currently being processed.
@@ -30,6 +42,10 @@ out vec4 out_Col; // This is the final output color that you will see on your
 void main()
 {
     // Material base color (before shading)
+#ifdef SKIN_ARRAY
+    vec4 diffuseColor = texture(u_Texture, vec3(fs_UV, fs_Layer));
+#else
     vec4 diffuseColor = texture(u_Texture, fs_UV);
+#endif
     out_Col = vec4(diffuseColor);
 }
@@ -0,0 +1,20 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// The sprite atlas' texel of a far NPC; the cleared texels around the
+// baked parts are cut out, so the quad is drawn with the opaque NPCs.
+
+uniform sampler2D u_Texture; // The sprite atlas (see NPCImpostors)
+
+in vec2 fs_UV;
+
+out vec4 out_Col;
+
+void main()
+{
+    vec4 color = texture(u_Texture, fs_UV);
+    if (color.a < 0.5) {
+        discard;
+    }
+    out_Col = vec4(color.rgb, 1.0);
+}
@@ -0,0 +1,30 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// A far NPC as a quad of the sprite atlas (see NPCImpostors): the
+// instance's matrix places and turns the unit quad, and its second
+// attribute is the view's cell in the atlas.
+
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
+in vec4 vs_Pos;             // The quad's corner, xy in [-1, 1]
+
+in vec2 vs_UV;              // The quad's corner, in [0, 1]
+
+in mat4 vs_ModelInstanced;  // The quad's half extents, facing and center
+
+in vec4 vs_AnimationInstanced; // The cell: uv of its corner, then its size
+
+out vec2 fs_UV;
+
+void main()
+{
+    fs_UV = vs_AnimationInstanced.xy + vs_UV * vs_AnimationInstanced.zw;
+    gl_Position = u_ViewProj * (vs_ModelInstanced * vs_Pos);
+}
@@ -0,0 +1,102 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// lambert.vert.glsl for NPC body parts drawn instanced: each instance
+// brings its NPC's root matrix instead of the u_Model uniform, so every
+// part sharing a block type and texture is one draw call. The part's
+// transform below the root is its rig in u_Rigs, posed here with the
+// instance's limb angle (see FlatSceneGraph::buildRig), and its skin is
+// the layer of npc.frag.glsl's texture array it names (SKIN_ARRAY).
+// ANIMATED as in lambert.vert.glsl.
+
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
+uniform sampler2D u_Rigs;   // RIG_TEXELS per rig, RIG_WIDTH per row (see NPCPartBatch)
+
+in vec4 vs_Pos;             // The array of vertex positions passed to the shader
+
+in vec4 vs_Nor;             // The array of vertex normals passed to the shader
+
+in vec2 vs_UV;              // The array of vertex uv passed to the shader
+
+#ifdef ANIMATED
+in vec2 vs_AnimatableFlag;  // The array of vertex animatableFlag passed to the shader
+#endif
+
+in mat4 vs_ModelInstanced;  // The model matrix of the instance's NPC root
+
+in vec4 vs_AnimationInstanced; // x: the limb angle in degrees, y: the part's rig, z: its skin
+
+out vec4 fs_Pos;
+out vec4 fs_Nor;            // The normal, transformed by the inverse transpose of the model matrix.
+out vec4 fs_LightVec;       // The direction in which our virtual light lies, relative to each vertex.
+out vec2 fs_UV;             // The uv of each vertex.
+out float fs_Layer;         // The skin's layer in the texture array.
+
+const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));
+
+const int RIG_TEXELS = 14;
+const int RIG_WIDTH = 1022;
+
+vec4 rigTexel(int rig, int texel)
+{
+    int i = rig * RIG_TEXELS + texel;
+    return texelFetch(u_Rigs, ivec2(i % RIG_WIDTH, i / RIG_WIDTH), 0);
+}
+
+mat4 rigSegment(int rig, int segment)
+{
+    return mat4(rigTexel(rig, segment * 4), rigTexel(rig, segment * 4 + 1),
+                rigTexel(rig, segment * 4 + 2), rigTexel(rig, segment * 4 + 3));
+}
+
+// as glm::rotate about the unit axis.xyz, by nothing when axis.w is 0
+mat4 jointRotation(vec4 axis, float angle)
+{
+    float c = cos(angle * axis.w);
+    float s = sin(angle * axis.w);
+    vec3 a = axis.xyz;
+    mat3 skew = mat3(0.0, a.z, -a.y,
+                     -a.z, 0.0, a.x,
+                     a.y, -a.x, 0.0);
+    return mat4(c * mat3(1.0) + (1.0 - c) * outerProduct(a, a) + s * skew);
+}
+
+void main()
+{
+#ifdef ANIMATED
+    if (vs_AnimatableFlag.x > 0.f) {
+        // apply uv offset to animatable block (move to right)
+        fs_UV = vec2(vs_UV.x + float(mod(u_Time, 100.f) / 100.f) * 0.0625f, vs_UV.y);
+    } else {
+        fs_UV = vs_UV;
+    }
+#else
+    fs_UV = vs_UV;
+#endif
+
+    fs_Pos = vs_Pos;
+    fs_Layer = vs_AnimationInstanced.z;
+
+    int rig = int(vs_AnimationInstanced.y);
+    float angle = radians(vs_AnimationInstanced.x);
+    mat4 model = vs_ModelInstanced * rigSegment(rig, 0)
+               * jointRotation(rigTexel(rig, 12), angle) * rigSegment(rig, 1)
+               * jointRotation(rigTexel(rig, 13), angle) * rigSegment(rig, 2);
+
+    // the parts are scaled non-uniformly
+    mat3 invTranspose = transpose(inverse(mat3(model)));
+    fs_Nor = vec4(invTranspose * vec3(vs_Nor), 0);
+
+    vec4 modelposition = model * vs_Pos;
+
+    fs_LightVec = (lightDir);
+
+    gl_Position = u_ViewProj * modelposition;
+}
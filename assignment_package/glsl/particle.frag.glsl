@@ -0,0 +1,30 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// A crumb shows a quarter of its block's tile, a flake is a white disc;
+// neither is blended, what is not drawn is discarded.
+
+uniform sampler2DArray u_Texture; // The block tiles, a layer each
+
+in vec2 fs_UV;
+flat in vec4 fs_Appearance;
+
+out vec4 out_Col;
+
+void main()
+{
+    if (fs_Appearance.x < 0.0) {
+        vec2 fromCenter = fs_UV - 0.5;
+        if (dot(fromCenter, fromCenter) > 0.25) {
+            discard;
+        }
+        out_Col = vec4(0.95, 0.97, 1.0, 1.0);
+        return;
+    }
+    vec4 color = texture(u_Texture, vec3(fs_Appearance.zw + fs_UV * 0.25, fs_Appearance.x));
+    if (color.a < 0.5) {
+        discard;
+    }
+    // a little darker than the faces, as the shade of the air around them
+    out_Col = vec4(color.rgb * 0.8, 1.0);
+}
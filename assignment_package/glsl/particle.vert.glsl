@@ -0,0 +1,43 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+#extension GL_ARB_explicit_attrib_location : require
+
+// A particle (see ParticleSystem) as a quad facing the eye, one instance
+// each, its corner from gl_VertexID (a triangle strip of 4). A dead one
+// collapses to a point outside the view.
+
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
+uniform vec3 u_Eye;
+
+// as particleupdate.vert.glsl writes them
+layout(location = 0) in vec4 vs_PositionLife;
+layout(location = 1) in vec4 vs_VelocitySize;
+layout(location = 2) in vec4 vs_Appearance;
+
+out vec2 fs_UV;             // Across the quad, 0 to 1
+flat out vec4 fs_Appearance;
+
+void main()
+{
+    if (vs_PositionLife.w <= 0.0) {
+        gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+        fs_UV = vec2(0.0);
+        fs_Appearance = vec4(0.0);
+        return;
+    }
+    vec2 corner = vec2(float(gl_VertexID & 1), float(gl_VertexID >> 1));
+    vec3 toEye = normalize(u_Eye - vs_PositionLife.xyz);
+    vec3 right = normalize(cross(vec3(0.0, 1.0, 0.0), toEye) + vec3(1e-4, 0.0, 0.0));
+    vec3 up = cross(toEye, right);
+    vec3 position = vs_PositionLife.xyz + (right * (corner.x - 0.5) + up * (corner.y - 0.5)) * vs_VelocitySize.w;
+    fs_UV = corner;
+    fs_Appearance = vs_Appearance;
+    gl_Position = u_ViewProj * vec4(position, 1.0);
+}
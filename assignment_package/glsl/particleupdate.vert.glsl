@@ -0,0 +1,117 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+#extension GL_ARB_explicit_attrib_location : require
+
+// Steps one particle (see ParticleSystem) by u_DeltaTime; transform
+// feedback captures the tf_ outputs into the other buffer, and nothing is
+// rasterized (it is linked with shadow.frag.glsl, which writes nothing).
+// Drawn as a point per instance: gl_InstanceID is the particle's slot.
+// The first u_Slots.x slots are the weather's, the next u_Slots.y the
+// debris ring's. A slot a burst covers this frame respawns as the burst's
+// crumb whether it was alive or not; a dead weather slot respawns as a
+// flake at the weather's rate.
+
+// at the locations ParticleSystem's vertex inputs read them to
+layout(location = 0) in vec4 vs_PositionLife;  // xyz, and the seconds of life left
+layout(location = 1) in vec4 vs_VelocitySize;  // xyz in blocks a second, and the size
+layout(location = 2) in vec4 vs_Appearance;    // the block tile layer (-1: a flake), the kind, the corner of its piece of the tile
+
+uniform float u_DeltaTime;
+uniform uint u_Seed;                // new every update
+uniform int u_BurstCount;
+uniform vec4 u_BurstCenters[16];    // the broken block's center, and its tile layer
+uniform vec4 u_BurstRanges[16];     // the first ring slot, and how many
+uniform ivec2 u_Slots;              // the weather's slots, the debris ring's
+uniform vec4 u_Weather;             // the top center of the column flakes spawn in, and its radius
+uniform vec2 u_WeatherSpawn;        // the fraction of the dead flakes respawning a second, the floor they melt at
+
+out vec4 tf_PositionLife;
+out vec4 tf_VelocitySize;
+out vec4 tf_Appearance;
+
+const float debrisKind = 0.0;
+const float snowKind = 1.0;
+const float gravity = 20.0;
+
+// a well-mixed 32-bit hash (PCG's output permutation)
+uint hash(uint v) {
+    uint state = v * 747796405u + 2891336453u;
+    uint word = ((state >> ((state >> 28u) + 4u)) ^ state) * 277803737u;
+    return (word >> 22u) ^ word;
+}
+
+// the n-th of this slot's random numbers this update, in [0, 1)
+float random(uint n) {
+    return float(hash(uint(gl_InstanceID) * 16u + n + hash(u_Seed))) / 4294967296.0;
+}
+
+void spawnDebris(vec4 center) {
+    vec3 offset = vec3(random(1u), random(2u), random(3u)) - 0.5;
+    tf_PositionLife = vec4(center.xyz + offset * 0.8, 0.6 + 0.6 * random(4u));
+    // out of the block and up, more the farther from its center
+    vec3 velocity = vec3(offset.x * 5.0, 2.0 + 3.0 * random(5u), offset.z * 5.0);
+    tf_VelocitySize = vec4(velocity, 0.08 + 0.08 * random(6u));
+    tf_Appearance = vec4(center.w, debrisKind, floor(vec2(random(7u), random(8u)) * 4.0) / 4.0);
+}
+
+void spawnFlake() {
+    float angle = 6.2831853 * random(1u);
+    float radius = u_Weather.w * sqrt(random(2u));
+    // through the whole column, so a snowfall starting fills it at once
+    float depth = (u_Weather.y - u_WeatherSpawn.y) * random(3u);
+    vec3 position = vec3(u_Weather.x + cos(angle) * radius, u_Weather.y - depth, u_Weather.z + sin(angle) * radius);
+    tf_PositionLife = vec4(position, 60.0);
+    tf_VelocitySize = vec4(0.3 * (random(4u) - 0.5), -1.5 - random(5u), 0.3 * (random(6u) - 0.5),
+                           0.05 + 0.04 * random(7u));
+    tf_Appearance = vec4(-1.0, snowKind, vec2(0.0));
+}
+
+void main()
+{
+    int slot = gl_InstanceID;
+    if (slot >= u_Slots.x) {
+        int ringSlot = slot - u_Slots.x;
+        for (int i = 0; i < u_BurstCount; i++) {
+            int offset = ringSlot - int(u_BurstRanges[i].x);
+            if (offset < 0) {
+                offset += u_Slots.y;
+            }
+            if (offset < int(u_BurstRanges[i].y)) {
+                spawnDebris(u_BurstCenters[i]);
+                return;
+            }
+        }
+    }
+
+    vec4 positionLife = vs_PositionLife;
+    vec4 velocitySize = vs_VelocitySize;
+    bool alive = positionLife.w > 0.0;
+    if (slot < u_Slots.x) {
+        // off the column the eye has left, or through the ground
+        vec2 fromCenter = positionLife.xz - u_Weather.xz;
+        if (positionLife.y < u_WeatherSpawn.y || dot(fromCenter, fromCenter) > 2.25 * u_Weather.w * u_Weather.w) {
+            alive = false;
+        }
+        if (!alive) {
+            if (random(0u) < u_WeatherSpawn.x * u_DeltaTime) {
+                spawnFlake();
+                return;
+            }
+            tf_PositionLife = vec4(positionLife.xyz, 0.0);
+            tf_VelocitySize = velocitySize;
+            tf_Appearance = vs_Appearance;
+            return;
+        }
+        // drifting from side to side as it falls
+        float sway = sin(positionLife.y * 0.7 + float(slot)) * 0.6;
+        positionLife.xyz += (velocitySize.xyz + vec3(sway, 0.0, -sway * 0.5)) * u_DeltaTime;
+    } else if (alive) {
+        velocitySize.y -= gravity * u_DeltaTime;
+        velocitySize.xz *= 1.0 - min(1.0, 2.0 * u_DeltaTime);
+        positionLife.xyz += velocitySize.xyz * u_DeltaTime;
+    }
+    positionLife.w -= u_DeltaTime;
+    tf_PositionLife = positionLife;
+    tf_VelocitySize = velocitySize;
+    tf_Appearance = vs_Appearance;
+}
@@ -0,0 +1,167 @@
+#version 150
+
+// Raymarches the far field's brickmap (see FarField) behind the rasterized
+// chunks: a walk through the window's 16-block bricks, and through the
+// blocks of each atlas brick on the way, to the first block that is not
+// EMPTY. The bricks of the drawn grid are skipped, since the chunks are
+// drawn there. The hit face is shaded like the distant terrain, with the
+// average color of its tile, and its depth written so the depth test
+// sorts it against the rest of the scene.
+
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
+uniform mat4 u_InvViewProj;    // From clip space back to the world
+uniform vec3 u_Eye;            // The camera's position
+uniform vec2 u_MorphCenter;    // The player's (x, z), which the fog is centered on
+uniform vec2 u_FogRange;       // The distances over which it fades out, as the distant terrain
+
+uniform sampler2DArray u_Texture; // The block tiles, a layer each
+// per section and window column, (sy, column x, column z): 0 for nothing,
+// 0x80000000 | type for one type throughout, otherwise 1 + its atlas brick
+uniform usampler3D u_Grid;
+// the atlas bricks, (y, x, z) within each (see BlockSection::localIndex)
+uniform usampler3D u_Atlas;
+// the texture layer of each face, (face, type)
+uniform usampler2D u_Tiles;
+
+uniform int u_WindowChunks;    // Chunks along each side of the window
+uniform ivec2 u_WindowMin;     // The window's lowest chunk, in chunks
+uniform ivec2 u_WindowOffset;  // The grid texel of u_WindowMin's column
+uniform ivec2 u_NearMin;       // The chunks drawn by rasterization, in chunks,
+uniform ivec2 u_NearMax;       // from u_NearMin to u_NearMax excluded
+uniform ivec3 u_AtlasBricks;   // Bricks along each axis of the atlas
+
+in vec4 fs_Pos;
+
+out vec4 out_Col;
+
+const vec3 lightDir = normalize(vec3(0.5, 1, 0.75));
+const vec3 skyColor = vec3(0.37, 0.74, 1.0);
+// enough to cross the window diagonally, and any one brick
+const int maxBrickSteps = 160;
+const int maxBlockSteps = 48;
+
+uint gridEntry(ivec3 brick)
+{
+    ivec2 column = (brick.xz - u_WindowMin + u_WindowOffset) % u_WindowChunks;
+    return texelFetch(u_Grid, ivec3(brick.y, column.x, column.y), 0).r;
+}
+
+bool inNearField(ivec3 brick)
+{
+    return all(greaterThanEqual(brick.xz, u_NearMin)) && all(lessThan(brick.xz, u_NearMax));
+}
+
+// The first block that is not EMPTY along the ray from t on, inside atlas
+// brick `index` at `brick`; its type, 0 if none, and t and the axis the
+// ray entered it along
+uint marchBrick(int index, ivec3 brick, vec3 ro, vec3 rd, inout float t, inout int axis)
+{
+    ivec3 atlasBrick = ivec3(index % u_AtlasBricks.x, (index / u_AtlasBricks.x) % u_AtlasBricks.y,
+                             index / (u_AtlasBricks.x * u_AtlasBricks.y));
+    ivec3 low = brick * 16;
+    ivec3 block = clamp(ivec3(floor(ro + rd * (t + 1e-3))), low, low + 15);
+    ivec3 stepDir = ivec3(sign(rd));
+    vec3 tDelta = abs(1.0 / rd);
+    vec3 tMax = (vec3(block) + max(vec3(stepDir), 0.0) - ro) / rd;
+
+    for (int i = 0; i < maxBlockSteps; i++) {
+        ivec3 local = block - low;
+        if (any(lessThan(local, ivec3(0))) || any(greaterThan(local, ivec3(15)))) {
+            break;
+        }
+        uint type = texelFetch(u_Atlas, atlasBrick * 16 + local.yxz, 0).r;
+        if (type != 0u) {
+            return type;
+        }
+        axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+        t = tMax[axis];
+        tMax[axis] += tDelta[axis];
+        block[axis] += stepDir[axis];
+    }
+    return 0u;
+}
+
+void main()
+{
+    // a point along the pixel's ray, in front of the eye whichever way the
+    // depth runs (the far plane of REVERSE_Z is at infinity)
+    vec4 rayPoint = u_InvViewProj * vec4(fs_Pos.xy, 0.5, 1);
+    vec3 ro = u_Eye;
+    vec3 rd = normalize(rayPoint.xyz / rayPoint.w - ro);
+    // no axis quite parallel to the ray, so every division below is finite
+    rd = mix(rd, vec3(1e-6), lessThan(abs(rd), vec3(1e-6)));
+
+    // where the ray enters and leaves the window
+    vec3 boxMin = vec3(u_WindowMin.x * 16, 0, u_WindowMin.y * 16);
+    vec3 boxMax = boxMin + vec3(u_WindowChunks * 16, 256, u_WindowChunks * 16);
+    vec3 t0s = (boxMin - ro) / rd;
+    vec3 t1s = (boxMax - ro) / rd;
+    vec3 tNear = min(t0s, t1s);
+    vec3 tFar = max(t0s, t1s);
+    float tEnter = max(max(tNear.x, tNear.y), tNear.z);
+    float tExit = min(min(tFar.x, tFar.y), tFar.z);
+    if (tExit <= max(tEnter, 0.0)) {
+        discard;
+    }
+    float t = max(tEnter, 0.0);
+    int axis = tNear.x > tNear.y ? (tNear.x > tNear.z ? 0 : 2) : (tNear.y > tNear.z ? 1 : 2);
+
+    ivec3 windowLow = ivec3(u_WindowMin.x, 0, u_WindowMin.y);
+    ivec3 windowHigh = windowLow + ivec3(u_WindowChunks, 16, u_WindowChunks);
+    ivec3 brick = clamp(ivec3(floor((ro + rd * (t + 1e-3)) / 16.0)), windowLow, windowHigh - 1);
+    ivec3 stepDir = ivec3(sign(rd));
+    vec3 tDelta = abs(16.0 / rd);
+    vec3 tMax = (vec3(brick * 16) + max(vec3(stepDir), 0.0) * 16.0 - ro) / rd;
+
+    uint type = 0u;
+    for (int i = 0; i < maxBrickSteps && type == 0u; i++) {
+        if (any(lessThan(brick, windowLow)) || any(greaterThanEqual(brick, windowHigh))) {
+            break;
+        }
+        uint entry = inNearField(brick) ? 0u : gridEntry(brick);
+        if ((entry & 0x80000000u) != 0u) {
+            type = entry & 255u;
+        } else if (entry != 0u) {
+            type = marchBrick(int(entry) - 1, brick, ro, rd, t, axis);
+        }
+        if (type != 0u) {
+            break;
+        }
+        axis = tMax.x < tMax.y ? (tMax.x < tMax.z ? 0 : 2) : (tMax.y < tMax.z ? 1 : 2);
+        t = tMax[axis];
+        tMax[axis] += tDelta[axis];
+        brick[axis] += stepDir[axis];
+    }
+    if (type == 0u) {
+        discard;
+    }
+
+    // the face the ray entered the block through, in Direction order
+    vec3 normal = vec3(0);
+    normal[axis] = -float(stepDir[axis]);
+    int face = axis * 2 + (stepDir[axis] > 0 ? 1 : 0);
+    float layer = float(texelFetch(u_Tiles, ivec2(face, int(type)), 0).r);
+    // the tile's smallest mip: its average color
+    vec3 color = textureLod(u_Texture, vec3(0.5, 0.5, layer), 4.0).rgb;
+
+    float diffuseTerm = clamp(dot(normal, lightDir), 0, 1);
+    float ambientTerm = 0.2;
+    color *= diffuseTerm + ambientTerm;
+
+    vec3 hit = ro + rd * t;
+    float fog = smoothstep(u_FogRange.x, u_FogRange.y, length(hit.xz - u_MorphCenter));
+    out_Col = vec4(mix(color, skyColor, fog), 1);
+
+    vec4 clip = u_ViewProj * vec4(hit, 1);
+#ifdef REVERSE_Z
+    gl_FragDepth = clip.z / clip.w;
+#else
+    gl_FragDepth = 0.5 * clip.z / clip.w + 0.5;
+#endif
+}
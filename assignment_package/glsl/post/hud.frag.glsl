@@ -0,0 +1,41 @@
+#version 150
+
+uniform sampler2DArray u_Texture;
+in vec4 fs_UV;
+out vec4 out_Col; // This is the final output color that you will see on your
+                  // screen for the pixel that is currently being processed.
+
+// HudBatch::font: a signed distance field (see Text::bakeDistanceField)
+const float fontLayer = 3.0;
+
+// the array samples nearest, the distance field wants its texels blended
+vec4 textureBilinear(vec3 uvw)
+{
+    ivec2 size = textureSize(u_Texture, 0).xy;
+    vec2 texel = uvw.xy * vec2(size) - 0.5;
+    ivec2 base = ivec2(floor(texel));
+    vec2 f = texel - vec2(base);
+    int layer = int(uvw.z + 0.5);
+    ivec2 lo = clamp(base, ivec2(0), size - 1);
+    ivec2 hi = clamp(base + 1, ivec2(0), size - 1);
+    vec4 c00 = texelFetch(u_Texture, ivec3(lo.x, lo.y, layer), 0);
+    vec4 c10 = texelFetch(u_Texture, ivec3(hi.x, lo.y, layer), 0);
+    vec4 c01 = texelFetch(u_Texture, ivec3(lo.x, hi.y, layer), 0);
+    vec4 c11 = texelFetch(u_Texture, ivec3(hi.x, hi.y, layer), 0);
+    return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);
+}
+
+void main()
+{
+    if (fs_UV.z == fontLayer) {
+        // the outline at 0.5, antialiased over about a screen pixel
+        vec4 glyph = textureBilinear(fs_UV.xyz);
+        float edge = max(fwidth(glyph.a), 0.001) * 0.75;
+        out_Col = vec4(glyph.rgb, smoothstep(0.5 - edge, 0.5 + edge, glyph.a));
+        return;
+    }
+    vec4 texture_color = texture(u_Texture, fs_UV.xyz);
+    // blending is on for the whole HUD: the quads that do not blend
+    // cover what is behind them, as if it were off
+    out_Col = vec4(texture_color.rgb, mix(1.0, texture_color.a, fs_UV.w));
+}
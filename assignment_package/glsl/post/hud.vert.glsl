@@ -0,0 +1,17 @@
+#version 150
+
+// The HUD in one draw (see HudBatch): every quad reads its own layer of
+// the HUD's texture array
+
+in vec4 vs_Pos;
+in vec4 vs_UV;              // u, v, the layer, and 1 if the quad blends
+
+out vec4 fs_Pos;
+out vec4 fs_UV;
+
+void main()
+{
+    fs_UV       = vs_UV;
+    fs_Pos      = vs_Pos;
+    gl_Position = vs_Pos;
+}
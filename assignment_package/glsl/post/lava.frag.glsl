@@ -1,7 +1,12 @@
 #version 150
 
-uniform ivec2 u_Dimensions;
-uniform int u_Time;
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
 uniform sampler2D u_Texture;
 
 in vec2 fs_UV;
@@ -11,6 +16,15 @@ out vec4 color;
 float hash21(in vec2 n){ return fract(sin(dot(n, vec2(12.9898, 4.1414))) * 43758.5453); }
 mat2 makem2(in float theta){float c = cos(theta);float s = sin(theta);return mat2(c,-s,s,c);}
 
+#ifdef BAKED_NOISE
+// noise below baked over a tile of PostNoise::worleyCells cells (green,
+// stored as (v + 1) / 2)
+uniform sampler2D u_Noise;
+
+float noise(vec2 uv){
+    return texture(u_Noise, uv / 8.0).g * 2.0 - 1.0;
+}
+#else
 vec2 random2(vec2 p){
     return fract(sin(vec2(dot(p, vec2(127.1, 311.7)), dot(p, vec2(269.5, 183.3)))) * 43758.5453);
 }
@@ -48,6 +62,7 @@ float noise(vec2 uv){
 
     return cos(minDist * 3.14159265 * 0.7);
 }
+#endif
 
 vec2 gradn(vec2 p)
 {
@@ -0,0 +1,27 @@
+#version 150
+
+// Resolves the transparent pass of lambert.frag.glsl (ORDER_INDEPENDENT) over the scene
+// (see TransparencyBuffer): the average of the weighted colors, blended
+// with GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA so the scene shows through as
+// much as the revealage says.
+
+uniform sampler2D u_Texture;   // the accumulated colors and weights
+uniform sampler2D u_Revealage; // the product of the 1 - alphas
+
+out vec4 out_Col;
+
+void main()
+{
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    float revealage = texelFetch(u_Revealage, texel, 0).r;
+    // nothing transparent here
+    if (revealage == 1.0) {
+        discard;
+    }
+    vec4 accum = texelFetch(u_Texture, texel, 0);
+    // the weights may have overflowed the half floats
+    if (isinf(max(max(abs(accum.r), abs(accum.g)), abs(accum.b)))) {
+        accum.rgb = vec3(accum.a);
+    }
+    out_Col = vec4(accum.rgb / max(accum.a, 1e-5), revealage);
+}
@@ -1,13 +1,58 @@
 #version 150
 
 uniform sampler2D u_Texture;
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
 in vec2 fs_UV;
 out vec4 out_Col; // This is the final output color that you will see on your
                   // screen for the pixel that is currently being processed.
 
+// Catmull-Rom filtering of a texture drawn larger than it is: the 4x4
+// texels around uv, in 9 taps by letting the bilinear filter blend the
+// two middle rows and columns (the texture must be filtered linearly)
+vec4 textureCatmullRom(sampler2D tex, vec2 uv)
+{
+    vec2 texSize = vec2(textureSize(tex, 0));
+    vec2 samplePos = uv * texSize;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 texPos0 = (texPos1 - 1.0) / texSize;
+    vec2 texPos3 = (texPos1 + 2.0) / texSize;
+    vec2 texPos12 = (texPos1 + w2 / w12) / texSize;
+
+    vec4 result = vec4(0.0);
+    result += texture(tex, vec2(texPos0.x,  texPos0.y))  * w0.x  * w0.y;
+    result += texture(tex, vec2(texPos12.x, texPos0.y))  * w12.x * w0.y;
+    result += texture(tex, vec2(texPos3.x,  texPos0.y))  * w3.x  * w0.y;
+    result += texture(tex, vec2(texPos0.x,  texPos12.y)) * w0.x  * w12.y;
+    result += texture(tex, vec2(texPos12.x, texPos12.y)) * w12.x * w12.y;
+    result += texture(tex, vec2(texPos3.x,  texPos12.y)) * w3.x  * w12.y;
+    result += texture(tex, vec2(texPos0.x,  texPos3.y))  * w0.x  * w3.y;
+    result += texture(tex, vec2(texPos12.x, texPos3.y))  * w12.x * w3.y;
+    result += texture(tex, vec2(texPos3.x,  texPos3.y))  * w3.x  * w3.y;
+    // the negative lobes may overshoot
+    return clamp(result, 0.0, 1.0);
+}
+
 void main()
 {
-    //background texture
-    vec4 texture_color  = texture(u_Texture, fs_UV);
-    out_Col = texture_color;
+    //background texture, upscaled if it was rendered at a lower resolution
+    if (textureSize(u_Texture, 0) == u_Dimensions) {
+        out_Col = texelFetch(u_Texture, ivec2(gl_FragCoord.xy), 0);
+    } else {
+        out_Col = textureCatmullRom(u_Texture, fs_UV);
+    }
 }
@@ -0,0 +1,98 @@
+#version 150
+
+// Temporal upsampling of the scene to the screen (see TemporalUpsampler):
+// the last output, reprojected and clamped to the new samples around the
+// pixel, with the nearest new sample blended in by how close it fell to
+// the pixel's center.
+
+uniform sampler2D u_Texture;  // the scene, at the render scale, jittered
+uniform sampler2D u_Depth;    // its depth
+uniform sampler2D u_History;  // the last output, at the screen's size
+uniform mat4 u_Reproject;     // this frame's clip space, unjittered, to the last one's
+uniform vec2 u_Jitter;        // this frame's offset, in the scene's pixels
+uniform int u_HistoryValid;   // 0 on the first frame or after a cut
+
+in vec2 fs_UV;
+out vec4 out_Col;
+
+// Catmull-Rom filtering as in overlay.frag.glsl, so the history does not
+// blur a little more each frame it is resampled
+vec3 textureCatmullRom(sampler2D tex, vec2 uv)
+{
+    vec2 texSize = vec2(textureSize(tex, 0));
+    vec2 samplePos = uv * texSize;
+    vec2 texPos1 = floor(samplePos - 0.5) + 0.5;
+    vec2 f = samplePos - texPos1;
+
+    vec2 w0 = f * (-0.5 + f * (1.0 - 0.5 * f));
+    vec2 w1 = 1.0 + f * f * (-2.5 + 1.5 * f);
+    vec2 w2 = f * (0.5 + f * (2.0 - 1.5 * f));
+    vec2 w3 = f * f * (-0.5 + 0.5 * f);
+
+    vec2 w12 = w1 + w2;
+    vec2 texPos0 = (texPos1 - 1.0) / texSize;
+    vec2 texPos3 = (texPos1 + 2.0) / texSize;
+    vec2 texPos12 = (texPos1 + w2 / w12) / texSize;
+
+    vec3 result = vec3(0.0);
+    result += texture(tex, vec2(texPos0.x,  texPos0.y)).rgb  * w0.x  * w0.y;
+    result += texture(tex, vec2(texPos12.x, texPos0.y)).rgb  * w12.x * w0.y;
+    result += texture(tex, vec2(texPos3.x,  texPos0.y)).rgb  * w3.x  * w0.y;
+    result += texture(tex, vec2(texPos0.x,  texPos12.y)).rgb * w0.x  * w12.y;
+    result += texture(tex, vec2(texPos12.x, texPos12.y)).rgb * w12.x * w12.y;
+    result += texture(tex, vec2(texPos3.x,  texPos12.y)).rgb * w3.x  * w12.y;
+    result += texture(tex, vec2(texPos0.x,  texPos3.y)).rgb  * w0.x  * w3.y;
+    result += texture(tex, vec2(texPos12.x, texPos3.y)).rgb  * w12.x * w3.y;
+    result += texture(tex, vec2(texPos3.x,  texPos3.y)).rgb  * w3.x  * w3.y;
+    return result;
+}
+
+void main()
+{
+    vec2 sceneSize = vec2(textureSize(u_Texture, 0));
+    vec2 outputSize = vec2(textureSize(u_History, 0));
+    ivec2 maxTexel = ivec2(sceneSize) - 1;
+
+    // the scene's texel i was sampled at i + 0.5 + u_Jitter
+    vec2 samplePos = fs_UV * sceneSize - 0.5 - u_Jitter;
+    ivec2 texel = clamp(ivec2(floor(samplePos + 0.5)), ivec2(0), maxTexel);
+    vec3 current = texelFetch(u_Texture, texel, 0).rgb;
+
+    if (u_HistoryValid == 0) {
+        out_Col = vec4(texture(u_Texture, fs_UV - u_Jitter / sceneSize).rgb, 1.0);
+        return;
+    }
+
+    // where this pixel was in the last output
+    float depth = texelFetch(u_Depth, texel, 0).r;
+#ifdef REVERSE_Z
+    // clip space depth 0 to 1; the sky's 0 is a point at infinity, which
+    // reprojects by the camera's turn alone
+    vec4 lastClip = u_Reproject * vec4(fs_UV * 2.0 - 1.0, depth, 1.0);
+#else
+    vec4 lastClip = u_Reproject * vec4(fs_UV * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+#endif
+    vec2 lastUV = lastClip.xy / lastClip.w * 0.5 + 0.5;
+    if (lastClip.w <= 0.0 || any(lessThan(lastUV, vec2(0.0))) || any(greaterThan(lastUV, vec2(1.0)))) {
+        out_Col = vec4(texture(u_Texture, fs_UV - u_Jitter / sceneSize).rgb, 1.0);
+        return;
+    }
+
+    // what the pixel may hold now: the box of the new samples around it
+    vec3 low = current;
+    vec3 high = current;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            vec3 neighbor = texelFetch(u_Texture, clamp(texel + ivec2(x, y), ivec2(0), maxTexel), 0).rgb;
+            low = min(low, neighbor);
+            high = max(high, neighbor);
+        }
+    }
+    vec3 history = clamp(textureCatmullRom(u_History, lastUV), low, high);
+
+    // the new sample's distance from the pixel's center, in screen pixels,
+    // weighted by a Gaussian fit of Blackman-Harris
+    vec2 offset = (samplePos - vec2(texel)) * outputSize / sceneSize;
+    float weight = exp(-2.29 * dot(offset, offset));
+    out_Col = vec4(mix(history, current, max(0.2 * weight, 0.02)), 1.0);
+}
@@ -2,7 +2,13 @@
 
 uniform vec4 u_Color; // The color with which to render this instance of geometry.
 uniform sampler2D u_Texture;
-uniform int u_Time;
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
 
 // These are the interpolated values out of the rasterizer, so you can't know
 // their specific values without knowing the vertices that contributed to them
@@ -16,6 +22,10 @@ in vec2 fs_AnimatableFlag;
 out vec4 out_Col; // This is the final output color that you will see on your
                   // screen for the pixel that is currently being processed.
 
+#ifdef BAKED_NOISE
+// fbm below baked over a tile the size of the screen (red; see PostNoise)
+uniform sampler2D u_Noise;
+#else
 float random1(vec3 p) {
     return fract(sin(dot(p,vec3(127.1, 311.7, 191.999)))
                  *43758.5453);
@@ -60,12 +70,19 @@ float fbm(vec3 p) {
     }
     return sum;
 }
+#endif
 
 void main()
 {
     //background texture
     vec4 texture_color  = texture(u_Texture, fs_UV);
-    texture_color       = texture_color * (0.5 * fbm(fs_Pos.xyz) + 0.5);
+#ifdef BAKED_NOISE
+    // drifting slowly across the screen
+    float noise         = texture(u_Noise, fs_UV + vec2(u_Time) * vec2(0.0004, 0.00025)).r;
+#else
+    float noise         = fbm(fs_Pos.xyz);
+#endif
+    texture_color       = texture_color * (0.5 * noise + 0.5);
 
     vec4 water_color = vec4(0.192156862745098, 0.6627450980392157, 0.9333333333333333, 1.0);
 
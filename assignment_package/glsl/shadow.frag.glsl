@@ -0,0 +1,9 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// The depth-only passes, of the shadow maps and the camera's depth
+// pre-pass, write no color: only the depth of the fragment remains.
+
+void main()
+{
+}
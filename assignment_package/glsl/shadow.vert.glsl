@@ -0,0 +1,19 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// The depth-only chunk pass of the shadow maps (see ShadowMap): the packed
+// chunk vertex of terrain.vert.glsl, of which only the position is decoded,
+// seen from the sun.
+
+uniform mat4 u_LightViewProj;   // The cascade's view-projection, from the sun
+
+in uvec2 vs_Packed;         // The packed vertex
+in ivec2 vs_ChunkOrigin;    // The chunk's (x, z), as in terrain.vert.glsl
+
+void main()
+{
+    uint w0 = vs_Packed.x;
+    vec4 pos = vec4(float(w0 & 31u) + float(vs_ChunkOrigin.x), float((w0 >> 5) & 511u),
+                    float((w0 >> 14) & 31u) + float(vs_ChunkOrigin.y), 1);
+    gl_Position = u_LightViewProj * pos;
+}
@@ -0,0 +1,93 @@
+#version 150
+// ^ Change this to version 130 if you have compatibility issues
+
+// The chunk vertex shader: the same job as lambert.vert.glsl, but each vertex
+// arrives as two packed 32-bit words (see packVertex in scene/chunk.cpp)
+// instead of 14 floats, and is decoded here.
+//   word 0: x (5 bits) | y (9 bits) | z (5 bits) | face index (3 bits) | animatable (1 bit) | occlusion (2 bits)
+//   word 1: layer (8 bits) | uv u (5 bits) | uv v (5 bits) | sky light (4 bits) | block light (4 bits)
+// Positions are in chunk space. The layer is the face's tile in the block
+// texture array (see Block::getFaceLayer); the uv counts tiles across the face.
+// The light levels (0 to 15) and occlusion (0: three opaque blocks around the
+// vertex, 3: none) were worked out by the mesher (see Chunk::shadeFace).
+// The chunk's origin is the only per-chunk data: no model matrix.
+// Each vertex is also placed in the sun's shadow cascades (see ShadowMap),
+// pushed off its face along the normal by the cascade's bias.
+// With ANIMATED defined (see ShaderProgram::create), the animatable faces
+// slide along their tile row; without it, for the chunks that have none
+// (see ChunkDrawable::hasAnimatedFaces), the bit is not even read.
+
+// Shared by every program and uploaded once a frame (see FrameUniforms)
+layout(std140) uniform FrameUniforms
+{
+    mat4 u_ViewProj;        // The matrix that defines the camera's transformation.
+    ivec2 u_Dimensions;     // The size of the screen in pixels
+    int u_Time;             // The simulation steps so far
+};
+
+uniform int u_ShadowCascades;       // How many of the cascades below are drawn; 0: no shadows
+uniform mat4 u_ShadowViewProj[3];   // Each cascade's view-projection, from the sun
+uniform vec3 u_ShadowNormalOffset;  // Each cascade's bias along the normal, in blocks
+
+in uvec2 vs_Packed;         // The packed vertex
+in ivec2 vs_ChunkOrigin;    // The chunk's (x, z): per instance when all chunks are drawn at once
+                            // (fetched at the command's base instance), constant in the per-chunk draws
+
+out vec4 fs_Pos;
+out vec4 fs_Nor;            // The vertex normal; chunks are only translated, so it is the world normal too
+out vec4 fs_LightVec;       // The direction in which our virtual light lies
+out vec2 fs_TileUV;         // The uv within the tile; it runs past 1 over a merged (greedy) quad
+flat out float fs_TileLayer; // The face's texture tile, the same at every vertex of a face.
+#ifdef ANIMATED
+flat out float fs_TileShift; // How far, in tiles, an animatable face has slid toward the next tile
+#endif
+out vec2 fs_Light;          // The sky and block light levels, 0 to 15
+out float fs_Occlusion;     // 0 to 1: how open the vertex's corner is
+out vec3 fs_ShadowCoord[3]; // The vertex in each cascade's map: uv and depth, 0 to 1
+out vec3 fs_WorldPos;       // For the point lights (see ClusteredLights)
+out float fs_ViewDepth;     // The distance along the view direction, which picks the cluster slice
+
+// the depth pre-pass (depth.vert.glsl) must land on the same depth
+invariant gl_Position;
+
+const vec4 lightDir = normalize(vec4(0.5, 1, 0.75, 0));
+
+// per face index, in Direction order: XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
+const vec4 normals[6] = vec4[6](vec4( 1,  0,  0, 0), vec4(-1,  0,  0, 0),
+                                vec4( 0,  1,  0, 0), vec4( 0, -1,  0, 0),
+                                vec4( 0,  0,  1, 0), vec4( 0,  0, -1, 0));
+
+void main()
+{
+    uint w0 = vs_Packed.x;
+    uint w1 = vs_Packed.y;
+
+    vec4 pos = vec4(float(w0 & 31u), float((w0 >> 5) & 511u), float((w0 >> 14) & 31u), 1);
+    vec4 nor = normals[int((w0 >> 19) & 7u)];
+
+    fs_TileUV = vec2(float((w1 >> 8) & 31u), float((w1 >> 13) & 31u));
+    fs_TileLayer = float(w1 & 255u);
+#ifdef ANIMATED
+    // apply uv offset to animatable block (move to right)
+    bool animatable = ((w0 >> 22) & 1u) != 0u;
+    fs_TileShift = animatable ? float(mod(u_Time, 100.f) / 100.f) : 0.f;
+#endif
+    fs_Light = vec2(float((w1 >> 18) & 15u), float((w1 >> 22) & 15u));
+    fs_Occlusion = float((w0 >> 23) & 3u) / 3.0;
+
+    fs_Pos = pos;
+
+    fs_Nor = vec4(vec3(nor), 0);
+
+    fs_LightVec = lightDir;
+
+    vec4 worldPos = pos + vec4(float(vs_ChunkOrigin.x), 0, float(vs_ChunkOrigin.y), 0);
+    for (int i = 0; i < 3; i++) {
+        vec4 shadowPos = u_ShadowViewProj[i] * (worldPos + nor * u_ShadowNormalOffset[i]);
+        fs_ShadowCoord[i] = i < u_ShadowCascades ? shadowPos.xyz * 0.5 + 0.5 : vec3(-1);
+    }
+
+    gl_Position = u_ViewProj * worldPos;
+    fs_WorldPos = worldPos.xyz;
+    fs_ViewDepth = gl_Position.w;
+}
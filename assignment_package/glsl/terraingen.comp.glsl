@@ -0,0 +1,229 @@
+#version 430
+// GPU port of the height map and cave density noise in scene/noise.cpp.
+// The host prepends "#define TERRAINGEN_CAVES" after the version line to
+// build the cave density pass; otherwise this is the surface height pass.
+// Both passes cover one 64 x 64 terrain generation zone per dispatch.
+
+layout(local_size_x = 8, local_size_y = 4, local_size_z = 8) in;
+
+uniform ivec2 u_ZoneCorner; // (xCorner, zCorner) of the zone
+uniform int u_GradientHash;  // 0: legacy sin hash, 1: permutation table (see GradientHash)
+uniform int u_Permutation[512]; // Noise::getPermutation()
+
+// heights, [x + 64 * z] relative to the zone's corner
+layout(std430, binding = 0) writeonly buffer Heights {
+    int heights[];
+};
+
+// cave densities for y in [1, 125), [x + 64 * (y - 1) + 64 * 124 * z]
+layout(std430, binding = 1) writeonly buffer CaveDensities {
+    float caveDensities[];
+};
+
+const int ZONE_SIZE = 64;
+const int CAVE_MIN_Y = 1;
+const int CAVE_MAX_Y = 125;
+
+//////////////////// 2D Perlin ////////////////////
+
+vec2 noise2DNormalVector(vec2 v, int primeSet) {
+    v += 0.1;
+
+    mat2 primes;
+    float xMult;
+    float yMult;
+
+    if (primeSet == 1) {
+        primes = mat2(vec2(126.1, 311.7), vec2(420.2, 1337.1));
+        xMult = 43758.5453;
+        yMult = 789221.5453;
+    } else if (primeSet == 2) {
+        primes = mat2(vec2(593.32, 931.85), vec2(719.31, 1029.44));
+        xMult = 354234.5048;
+        yMult = 250986.2095;
+    } else {
+        primes = mat2(vec2(958.11, 347.77), vec2(139.44, 9559.43));
+        xMult = 485048.09604;
+        yMult = 9450.234234;
+    }
+
+    vec2 noise = sin(v * primes);
+    noise.x *= xMult;
+    noise.y *= yMult;
+
+    return normalize(abs(fract(noise)));
+}
+
+// the static gradient table of GradientHash::permutation
+vec2 permutationNormalVector(vec2 gridPoint, int primeSet) {
+    int ix = int(gridPoint.x) + 59 * primeSet;
+    int iz = int(gridPoint.y);
+    int i = u_Permutation[u_Permutation[ix & 255] + (iz & 255)];
+
+    float angle = (float(i) + 0.5) / 256.0 * 3.14159265 * 0.5;
+    return vec2(cos(angle), sin(angle));
+}
+
+float surflet(vec2 p, vec2 gridPoint, int primeSet) {
+    vec2 t2 = abs(p - gridPoint);
+    vec2 t = vec2(1.0) - 6.0 * t2 * t2 * t2 * t2 * t2
+                       + 15.0 * t2 * t2 * t2 * t2
+                       - 10.0 * t2 * t2 * t2;
+
+    vec2 normal = u_GradientHash == 1 ? permutationNormalVector(gridPoint, primeSet)
+                                      : noise2DNormalVector(gridPoint, primeSet);
+    vec2 gradient = normal * 2.0 - vec2(1.0);
+    vec2 diff = p - gridPoint;
+
+    return dot(diff, gradient) * t.x * t.y;
+}
+
+float perlinNoise2D(vec2 p, int primeSet) {
+    float surfletSum = 0.0;
+    for (int dx = 0; dx <= 1; ++dx) {
+        for (int dy = 0; dy <= 1; ++dy) {
+            surfletSum += surflet(p, floor(p) + vec2(dx, dy), primeSet);
+        }
+    }
+    return surfletSum;
+}
+
+float fbm2D(float x, float z, float persistence, int primeSet) {
+    float total = 0.0;
+    for (int i = 0; i < 8; i++) {
+        float frequency = pow(2.0, float(i));
+        float amplitude = pow(persistence, float(i));
+        total += perlinNoise2D(vec2(x * frequency, z * frequency), primeSet) * amplitude;
+    }
+    return total;
+}
+
+//////////////////// Worley ////////////////////
+
+vec2 getVoronoiCenter(vec2 corner) {
+    float x = fract(sin(dot(corner, vec2(127.1, 311.7))) * 43758.5453);
+    float z = fract(sin(dot(corner, vec2(420.2, 1337.1))) * 789221.1234);
+    return vec2(x, z);
+}
+
+float worleyNoise2D(float x, float z) {
+    // modf in noise.cpp truncates toward zero
+    vec2 intP = trunc(vec2(x, z));
+    vec2 fractP = vec2(x, z) - intP;
+
+    float minDist1 = 1.0;
+    float minDist2 = 1.0;
+
+    for (int i = -1; i < 2; i++) {
+        for (int j = -1; j < 2; j++) {
+            vec2 neighborDirection = vec2(j, i);
+            vec2 diff = neighborDirection + getVoronoiCenter(intP + neighborDirection) - fractP;
+            float dist = length(diff);
+
+            if (dist < minDist1) {
+                minDist2 = minDist1;
+                minDist1 = dist;
+            } else if (dist < minDist2) {
+                minDist2 = dist;
+            }
+        }
+    }
+
+    return minDist2 - minDist1;
+}
+
+//////////////////// Height map ////////////////////
+
+float getGrassHeight(float x, float z) {
+    x /= 512.0;
+    z /= 512.0;
+    return 135.0 + 7.0 * worleyNoise2D(fbm2D(x, z, 0.5, 1), fbm2D(z, x, 0.5, 1));
+}
+
+float getMountainousRockHeight(float x, float z) {
+    x /= 2048.0;
+    z /= 2048.0;
+    return 142.0 + 108.0 * abs(fbm2D(x, z, 0.92, 1));
+}
+
+float getWaterHeight(float x, float z) {
+    x /= 1024.0;
+    z /= 1024.0;
+    return 128.0 + 4.0 * (fbm2D(x, z, 0.5, 3) + 1.0) / 2.0;
+}
+
+int getHeight(int x, int z) {
+    float fx = float(x);
+    float fz = float(z);
+
+    float perlin      = (fbm2D(fx / 2048.0, fz / 2048.0, 0.2, 1) + 1.0) / 2.0;
+    float waterPerlin = (fbm2D(fx / 4096.0, fz / 4096.0, 0.9, 3) + 1.0) / 2.0;
+
+    float smoothPerlin      = smoothstep(0.5, 0.6, perlin);
+    float waterSmoothPerlin = smoothstep(0.8, 0.85, waterPerlin);
+
+    float grass    = getGrassHeight(fx, fz);
+    float mtn_rock = getMountainousRockHeight(fx, fz);
+    float water    = getWaterHeight(fx, fz);
+
+    return int(clamp(mix(mix(grass, water, waterSmoothPerlin), mtn_rock, smoothPerlin), 128.0, 255.0));
+}
+
+//////////////////// 3D Perlin ////////////////////
+
+vec3 random3(vec3 c) {
+    float j = 4096.0 * sin(dot(c, vec3(17.0, 59.4, 15.0)));
+    vec3 r;
+    r.z = fract(512.0 * j);
+    j *= .125;
+    r.x = fract(512.0 * j);
+    j *= .125;
+    r.y = fract(512.0 * j);
+    return r - vec3(0.5);
+}
+
+float surflet3D(vec3 p, vec3 gridPoint) {
+    vec3 t2 = abs(p - gridPoint);
+    vec3 t = vec3(1.0) - 6.0 * pow(t2, vec3(5.0)) + 15.0 * pow(t2, vec3(4.0)) - 10.0 * pow(t2, vec3(3.0));
+
+    vec3 gradient = normalize(random3(gridPoint) * 2.0 - vec3(1.0));
+    vec3 diff = p - gridPoint;
+
+    return dot(diff, gradient) * t.x * t.y * t.z;
+}
+
+float perlinNoise3D(vec3 p) {
+    float surfletSum = 0.0;
+    for (int dx = 0; dx <= 1; ++dx) {
+        for (int dy = 0; dy <= 1; ++dy) {
+            for (int dz = 0; dz <= 1; ++dz) {
+                surfletSum += surflet3D(p, floor(p) + vec3(dx, dy, dz));
+            }
+        }
+    }
+    return surfletSum;
+}
+
+float getCaveHeight(int x, int y, int z) {
+    return perlinNoise3D(vec3(x, y, z) / 25.0);
+}
+
+void main() {
+    ivec3 id = ivec3(gl_GlobalInvocationID);
+
+#ifdef TERRAINGEN_CAVES
+    // dispatched as (8, 31, 8) groups: one invocation per voxel
+    int y = CAVE_MIN_Y + id.y;
+    if (id.x >= ZONE_SIZE || id.z >= ZONE_SIZE || y >= CAVE_MAX_Y) {
+        return;
+    }
+    caveDensities[id.x + ZONE_SIZE * id.y + ZONE_SIZE * (CAVE_MAX_Y - CAVE_MIN_Y) * id.z]
+            = getCaveHeight(u_ZoneCorner.x + id.x, y, u_ZoneCorner.y + id.z);
+#else
+    // dispatched as (8, 1, 8) groups: only the first row of each group works
+    if (id.y != 0 || id.x >= ZONE_SIZE || id.z >= ZONE_SIZE) {
+        return;
+    }
+    heights[id.x + ZONE_SIZE * id.z] = getHeight(u_ZoneCorner.x + id.x, u_ZoneCorner.y + id.z);
+#endif
+}
@@ -0,0 +1,660 @@
+// Micro-benchmarks of the hot kernels.
+// Each benchmark runs a batch of one kernel over fixed, seeded inputs until
+// enough time has passed, and reports the median and fastest time per item
+// of its batches and the heap allocations per item. The terrain they read
+// is built block by block, so it does not change with the generator:
+// flat plain, mountains, caves and water, 3 x 3 chunks of each, and a maze.
+//
+// usage: MicroBenchmark [filter] [--min-ms 300] [--seed 0x476F6C64656E4F72]
+//   filter: run only the benchmarks whose name contains it
+//
+// Last, the overdraw of the opaque meshes with and without the mesher's
+// ordering of their faces (see Chunk::setOverdrawOrdering).
+//
+// The sections' block layout is chosen at build time (see microbench.pro);
+// the layout is printed with the results, so the meshing, path search and
+// lookup kernels of two builds can be compared.
+
+#include "scene/terrain.h"
+#include "scene/noise.h"
+#include "scene/pathfinder.h"
+#include "scene/random.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <string>
+#include <vector>
+
+//--------------------------
+// Allocation counting
+//--------------------------
+static std::atomic<unsigned long long> allocationCount(0);
+
+void *operator new(std::size_t size)
+{
+    allocationCount++;
+    void *p = std::malloc(size == 0 ? 1 : size);
+    if (p == nullptr) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void *operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+//--------------------------
+// The harness
+//--------------------------
+
+// One kernel: batch() runs it over its inputs and returns the items done
+struct MicroBenchmark
+{
+    std::string name;
+    std::function<int()> batch;
+};
+
+struct MicroResult
+{
+    double medianNs;
+    double minNs;
+    double allocations;
+    int batches;
+};
+
+// the fewest batches a result is taken from, however long they take
+static const int minBatches = 5;
+
+// The results feed this, so the compiler cannot drop the kernels
+static volatile unsigned long long sink = 0;
+
+/**
+ * @brief runBenchmark
+ *  One batch to warm the caches up, untimed, then batches until minNs
+ *  have passed. The times are per item, so batches of different sizes
+ *  compare.
+ */
+MicroResult runBenchmark(const MicroBenchmark &benchmark, qint64 minNs)
+{
+    benchmark.batch();
+
+    std::vector<double> perItemNs;
+    unsigned long long allocations = 0;
+    long long items = 0;
+    qint64 total = 0;
+    while (total < minNs || static_cast<int>(perItemNs.size()) < minBatches) {
+        unsigned long long allocationsBefore = allocationCount;
+        QElapsedTimer timer;
+        timer.start();
+        int batchItems = benchmark.batch();
+        qint64 elapsed = timer.nsecsElapsed();
+        allocations += allocationCount - allocationsBefore;
+        items += batchItems;
+        total += elapsed;
+        perItemNs.push_back(static_cast<double>(elapsed) / std::max(batchItems, 1));
+    }
+    std::sort(perItemNs.begin(), perItemNs.end());
+    return MicroResult{perItemNs[perItemNs.size() / 2], perItemNs.front(),
+                       static_cast<double>(allocations) / std::max(items, 1ll),
+                       static_cast<int>(perItemNs.size())};
+}
+
+void printResult(const std::string &name, const MicroResult &result)
+{
+    std::printf("%-28s %12.1f ns %12.1f ns %14.0f items/s %10.2f allocs %8d\n",
+                name.c_str(), result.medianNs, result.minNs, 1e9 / result.medianNs,
+                result.allocations, result.batches);
+}
+
+//--------------------------
+// The terrain
+//--------------------------
+
+// the scenes' corners; each is 3 x 3 chunks, 64 blocks apart so they
+// are not each other's neighbors
+static const glm::ivec2 plainCorner(0, 0);
+static const glm::ivec2 mountainCorner(64, 0);
+static const glm::ivec2 caveCorner(128, 0);
+static const glm::ivec2 waterCorner(192, 0);
+static const glm::ivec2 mazeCorner(256, 0);
+static const int sceneSize = 48;
+
+// the ground the plain, the caves and the maze stand on, as the
+// generator's lowlands do
+static const int groundHeight = 128;
+
+BlockType plainBlock(int y)
+{
+    if (y == 0) {
+        return BEDROCK;
+    }
+    if (y < groundHeight - 3) {
+        return STONE;
+    }
+    if (y < groundHeight) {
+        return DIRT;
+    }
+    return y == groundHeight ? GRASS : EMPTY;
+}
+
+/**
+ * @brief buildScene
+ *  Instantiate the scene's chunks and set every block of them to
+ *  block(x, y, z), in world coordinates.
+ * @return the chunk in the middle
+ */
+Chunk *buildScene(Terrain &terrain, glm::ivec2 corner,
+                  const std::function<BlockType(int, int, int)> &block)
+{
+    std::vector<Chunk*> chunks;
+    for (int x = corner[0]; x < corner[0] + sceneSize; x += 16) {
+        for (int z = corner[1]; z < corner[1] + sceneSize; z += 16) {
+            chunks.push_back(terrain.instantiateChunkAt(x, z));
+        }
+    }
+    for (Chunk *chunk : chunks) {
+        glm::ivec2 chunkCorner = chunk->getCorner();
+        for (int z = 0; z < 16; z++) {
+            for (int x = 0; x < 16; x++) {
+                for (int y = 0; y < 256; y++) {
+                    BlockType t = block(chunkCorner[0] + x, y, chunkCorner[1] + z);
+                    if (t != EMPTY) {
+                        chunk->setBlockAt(x, y, z, t);
+                    }
+                }
+            }
+        }
+        chunk->setGenerationStage(GenerationStage::decorated);
+    }
+    return chunks[chunks.size() / 2];
+}
+
+int mountainHeight(int x, int z)
+{
+    return 165 + static_cast<int>(30.f * (std::sin(x * 0.15f) + std::cos(z * 0.11f))
+                                  + 8.f * std::sin((x + z) * 0.4f));
+}
+
+/**
+ * @brief mazeWalls
+ *  A maze of 1-block paths between walls too tall to jump, carved by a
+ *  depth-first walk from its corner cell. Cells are at the odd (x, z).
+ * @return [x + sceneSize * z]: there is a wall
+ */
+std::vector<bool> mazeWalls(uint64_t seed)
+{
+    const int cells = (sceneSize - 1) / 2;
+    std::vector<bool> walls(sceneSize * sceneSize, true);
+    std::vector<bool> visited(cells * cells, false);
+    std::vector<glm::ivec2> stack = {glm::ivec2(0, 0)};
+    visited[0] = true;
+    walls[1 + sceneSize] = false;
+    Random random(seed);
+    const glm::ivec2 steps[4] = {glm::ivec2(1, 0), glm::ivec2(-1, 0), glm::ivec2(0, 1), glm::ivec2(0, -1)};
+    while (!stack.empty()) {
+        glm::ivec2 cell = stack.back();
+        std::vector<glm::ivec2> next;
+        for (const glm::ivec2 &step : steps) {
+            glm::ivec2 n = cell + step;
+            if (n[0] >= 0 && n[0] < cells && n[1] >= 0 && n[1] < cells && !visited[n[0] + cells * n[1]]) {
+                next.push_back(n);
+            }
+        }
+        if (next.empty()) {
+            stack.pop_back();
+            continue;
+        }
+        glm::ivec2 n = next[random.nextUInt() % next.size()];
+        visited[n[0] + cells * n[1]] = true;
+        // the wall between the cells, and the cell
+        walls[(cell[0] + n[0] + 1) + sceneSize * (cell[1] + n[1] + 1)] = false;
+        walls[(2 * n[0] + 1) + sceneSize * (2 * n[1] + 1)] = false;
+        stack.push_back(n);
+    }
+    return walls;
+}
+
+// Where an NPC stands on the ground at (x, z)
+glm::vec3 standingAt(glm::ivec2 corner, int x, int z)
+{
+    return glm::vec3(corner[0] + x + 0.5f, groundHeight + 1.5f, corner[1] + z + 0.5f);
+}
+
+/**
+ * @brief opaqueOverdraw
+ *  The fragments the opaque pass of a chunk mesh shades per visible one,
+ *  rasterized in software with a depth test, as the sections are drawn
+ *  (nearest first) and their quads within. Orthographic views from 30 and
+ *  60 degrees above the horizon all around, at 4 pixels per block.
+ * @return shaded / visible fragments over the views
+ */
+double opaqueOverdraw(const ChunkVBOdata &vbo)
+{
+    static const glm::vec3 normals[6] = {glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0),
+                                         glm::vec3(0, -1, 0), glm::vec3(0, 0, 1), glm::vec3(0, 0, -1)};
+    const float pixelsPerBlock = 4.f;
+    long long shaded = 0, visible = 0;
+    for (float elevation : {30.f, 60.f}) {
+        for (int azimuth = 0; azimuth < 360; azimuth += 45) {
+            float e = glm::radians(elevation), a = glm::radians(azimuth + 10.f);
+            // from the camera into the scene
+            glm::vec3 view(std::cos(e) * std::sin(a), -std::sin(e), std::cos(e) * std::cos(a));
+            glm::vec3 right = glm::normalize(glm::cross(view, glm::vec3(0, 1, 0)));
+            glm::vec3 up = glm::cross(right, view);
+            // the chunk's bounds on the screen
+            glm::vec2 lo(1e9f), hi(-1e9f);
+            for (int corner = 0; corner < 8; corner++) {
+                glm::vec3 p((corner & 1) * 16.f, ((corner >> 1) & 1) * 256.f, ((corner >> 2) & 1) * 16.f);
+                glm::vec2 s(glm::dot(p, right), glm::dot(p, up));
+                lo = glm::min(lo, s);
+                hi = glm::max(hi, s);
+            }
+            int width = static_cast<int>((hi.x - lo.x) * pixelsPerBlock) + 2;
+            int height = static_cast<int>((hi.y - lo.y) * pixelsPerBlock) + 2;
+            std::vector<float> depth(width * height, 1e9f);
+
+            std::vector<int> sections(16);
+            for (int sy = 0; sy < 16; sy++) {
+                sections[sy] = sy;
+            }
+            std::sort(sections.begin(), sections.end(), [&](int a, int b) {
+                return glm::dot(glm::vec3(8.f, 16.f * a + 8.f, 8.f), view)
+                        < glm::dot(glm::vec3(8.f, 16.f * b + 8.f, 8.f), view);
+            });
+            for (int sy : sections) {
+                for (uint32_t q = vbo.sectionQuadStarts[sy]; q < vbo.sectionQuadStarts[sy + 1]; q++) {
+                    const uint32_t *words = vbo.buffer.data() + 8 * q;
+                    if (glm::dot(normals[(words[0] >> 19) & 7], view) >= 0.f) {
+                        continue;
+                    }
+                    glm::vec3 s[4];
+                    for (int v = 0; v < 4; v++) {
+                        uint32_t w = words[2 * v];
+                        glm::vec3 p(w & 31, (w >> 5) & 511, (w >> 14) & 31);
+                        s[v] = glm::vec3((glm::dot(p, right) - lo.x) * pixelsPerBlock,
+                                         (glm::dot(p, up) - lo.y) * pixelsPerBlock, glm::dot(p, view));
+                    }
+                    for (const glm::ivec3 &tri : {glm::ivec3(0, 1, 2), glm::ivec3(0, 2, 3)}) {
+                        glm::vec3 p0 = s[tri[0]], p1 = s[tri[1]], p2 = s[tri[2]];
+                        float area = (p1.x - p0.x) * (p2.y - p0.y) - (p2.x - p0.x) * (p1.y - p0.y);
+                        if (area == 0.f) {
+                            continue;
+                        }
+                        int x0 = static_cast<int>(std::min({p0.x, p1.x, p2.x}));
+                        int x1 = static_cast<int>(std::max({p0.x, p1.x, p2.x}));
+                        int y0 = static_cast<int>(std::min({p0.y, p1.y, p2.y}));
+                        int y1 = static_cast<int>(std::max({p0.y, p1.y, p2.y}));
+                        for (int y = y0; y <= y1; y++) {
+                            for (int x = x0; x <= x1; x++) {
+                                float px = x + 0.5f, py = y + 0.5f;
+                                float w0 = ((p1.x - px) * (p2.y - py) - (p2.x - px) * (p1.y - py)) / area;
+                                float w1 = ((p2.x - px) * (p0.y - py) - (p0.x - px) * (p2.y - py)) / area;
+                                float w2 = 1.f - w0 - w1;
+                                if (w0 < 0.f || w1 < 0.f || w2 < 0.f) {
+                                    continue;
+                                }
+                                float z = w0 * p0.z + w1 * p1.z + w2 * p2.z;
+                                float &stored = depth[x + width * y];
+                                if (z < stored) {
+                                    stored = z;
+                                    shaded++;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+            visible += std::count_if(depth.begin(), depth.end(), [](float z) {
+                return z < 1e9f;
+            });
+        }
+    }
+    return static_cast<double>(shaded) / std::max(visible, 1ll);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addPositionalArgument("filter", "Run only the benchmarks whose name contains this.", "[filter]");
+    parser.addOption(QCommandLineOption("min-ms", "The least time each benchmark is run for.", "ms", "300"));
+    parser.addOption(QCommandLineOption("seed", "The world seed of the noise and the FillBlocksWorker.",
+                                        "seed", "0x476F6C64656E4F72"));
+    parser.process(app);
+    bool okMinMs = false, okSeed = false;
+    int minMs = parser.value("min-ms").toInt(&okMinMs);
+    uint64_t worldSeed = parser.value("seed").toULongLong(&okSeed, 0);
+    if (!okMinMs || minMs <= 0 || !okSeed) {
+        std::fprintf(stderr, "The time must be positive and the seed a number\n");
+        return 1;
+    }
+    QString filter = parser.positionalArguments().value(0);
+
+    // the terrain only stores and links the chunks; nothing is drawn
+    Terrain terrain(nullptr, worldSeed);
+    Noise caveNoise(worldSeed, terrain.getGradientHash());
+
+    std::vector<std::pair<std::string, Chunk*>> meshed = {
+        {"plain", buildScene(terrain, plainCorner, [](int, int y, int) {
+            return plainBlock(y);
+        })},
+        {"mountain", buildScene(terrain, mountainCorner, [](int x, int y, int z) {
+            int height = mountainHeight(x, z);
+            if (y == 0) {
+                return BEDROCK;
+            }
+            if (y < height) {
+                return STONE;
+            }
+            if (y == height) {
+                return height > 190 ? SNOW : GRASS;
+            }
+            return EMPTY;
+        })},
+        // the generator's carving: open where the cave density is positive
+        {"caves", buildScene(terrain, caveCorner, [&](int x, int y, int z) {
+            if (y >= 1 && y < groundHeight - 3 && caveNoise.getCaveHeight(x, y, z) > 0.f) {
+                return y <= 30 ? LAVA : EMPTY;
+            }
+            return plainBlock(y);
+        })},
+        {"water", buildScene(terrain, waterCorner, [](int x, int y, int z) {
+            int floor = 110 + static_cast<int>(3.f * std::sin(x * 0.3f) * std::cos(z * 0.2f));
+            if (y == 0) {
+                return BEDROCK;
+            }
+            if (y < floor) {
+                return STONE;
+            }
+            if (y <= floor + 2) {
+                return SAND;
+            }
+            return y <= 138 ? WATER : EMPTY;
+        })},
+    };
+    std::vector<bool> walls = mazeWalls(worldSeed);
+    buildScene(terrain, mazeCorner, [&](int x, int y, int z) {
+        int mx = x - mazeCorner[0];
+        int mz = z - mazeCorner[1];
+        if (y > groundHeight && y <= groundHeight + 3 && walls[mx + sceneSize * mz]) {
+            return STONE;
+        }
+        return plainBlock(y);
+    });
+
+    std::vector<MicroBenchmark> benchmarks;
+
+    //--------------------------
+    // Noise
+    //--------------------------
+    Noise noise(worldSeed, terrain.getGradientHash());
+    // a zone of columns away from the origin's symmetries, and the scenes
+    const int noiseX = 1024, noiseZ = -3008;
+    benchmarks.push_back({"noise/getHeight", [&]() {
+        int sum = 0;
+        for (int z = 0; z < 64; z++) {
+            for (int x = 0; x < 64; x++) {
+                sum += noise.getHeight(noiseX + x, noiseZ + z);
+            }
+        }
+        sink = sink + sum;
+        return 64 * 64;
+    }});
+    // FBM2D and PerlinNoise3D are private: timed through the public
+    // samplers that are one FBM, and one Perlin sample, each
+    benchmarks.push_back({"noise/FBM2D", [&]() {
+        float sum = 0.f;
+        for (int z = 0; z < 64; z++) {
+            for (int x = 0; x < 64; x++) {
+                sum += noise.getMountainousRockHeight(noiseX + x, noiseZ + z);
+            }
+        }
+        sink = sink + static_cast<unsigned long long>(sum);
+        return 64 * 64;
+    }});
+    benchmarks.push_back({"noise/PerlinNoise3D", [&]() {
+        float sum = 0.f;
+        for (int z = 0; z < 16; z++) {
+            for (int y = 1; y < 125; y++) {
+                for (int x = 0; x < 16; x++) {
+                    sum += noise.getCaveHeight(noiseX + x, y, noiseZ + z);
+                }
+            }
+        }
+        sink = sink + static_cast<unsigned long long>(sum * 1000.f);
+        return 16 * 124 * 16;
+    }});
+
+    //--------------------------
+    // FillBlocksWorker::setBlocks
+    //--------------------------
+    // setBlocks is private: timed through run() with the zone's heights
+    // precomputed, which leaves setBlocks, the biome lattice and the tree
+    // probabilities of the chunk's tile
+    const glm::ivec2 shapeZone(noiseX, noiseZ);
+    auto zoneHeights = mkS<std::vector<int>>(ZoneHeightMap::zoneSize * ZoneHeightMap::zoneSize);
+    for (int z = 0; z < ZoneHeightMap::zoneSize; z++) {
+        for (int x = 0; x < ZoneHeightMap::zoneSize; x++) {
+            (*zoneHeights)[x + ZoneHeightMap::zoneSize * z] = noise.getHeight(shapeZone[0] + x, shapeZone[1] + z);
+        }
+    }
+    sPtr<ZoneHeightMap> shapeHeightMap = mkS<ZoneHeightMap>(shapeZone[0], shapeZone[1]);
+    Chunk *shaped = terrain.instantiateChunkAt(shapeZone[0], shapeZone[1]);
+    MPSCQueue<Chunk*> completedChunks;
+    std::vector<Chunk*> done;
+    benchmarks.push_back({"fill/setBlocks", [&]() {
+        shaped->pin();
+        FillBlocksWorker worker(shaped, shapeHeightMap, &completedChunks,
+                                worldSeed, terrain.getGradientHash(), zoneHeights);
+        worker.run();
+        done.clear();
+        completedChunks.takeAll(done);
+        return 1;
+    }});
+
+    //--------------------------
+    // Chunk::generateVBOdata
+    //--------------------------
+    for (const std::pair<std::string, Chunk*> &scene : meshed) {
+        Chunk *chunk = scene.second;
+        benchmarks.push_back({"mesh/" + scene.first, [chunk]() {
+            chunk->markAllSectionsDirty();
+            ChunkVBOdata vbo = chunk->generateVBOdata();
+            sink = sink + vbo.quadCount() + vbo.transparentQuadCount();
+            return 1;
+        }});
+    }
+    // the same without the overdraw ordering of the faces, for its cost
+    benchmarks.push_back({"mesh/mountain/unordered", [&]() {
+        Chunk *chunk = meshed[1].second;
+        Chunk::setOverdrawOrdering(false);
+        chunk->markAllSectionsDirty();
+        ChunkVBOdata vbo = chunk->generateVBOdata();
+        Chunk::setOverdrawOrdering(true);
+        sink = sink + vbo.quadCount() + vbo.transparentQuadCount();
+        return 1;
+    }});
+
+    //--------------------------
+    // PathFinder::searchPathToward
+    //--------------------------
+    // the same pairs of maze cells on both: up to 12 blocks apart, within
+    // the search radius
+    std::vector<std::pair<glm::ivec2, glm::ivec2>> searchCells;
+    Random searchRandom(Random::mix(worldSeed));
+    while (searchCells.size() < 32) {
+        glm::ivec2 from(8 + 2 * (searchRandom.nextUInt() % 16) + 1, 8 + 2 * (searchRandom.nextUInt() % 16) + 1);
+        glm::ivec2 to = from + glm::ivec2(2 * static_cast<int>(searchRandom.nextUInt() % 13) - 12,
+                                          2 * static_cast<int>(searchRandom.nextUInt() % 13) - 12);
+        to = glm::clamp(to, glm::ivec2(1), glm::ivec2(sceneSize - 3));
+        if (to != from) {
+            searchCells.push_back(std::make_pair(from, to));
+        }
+    }
+    PathFinder pathFinder(15, terrain);
+    for (const std::pair<std::string, glm::ivec2> &scene : {std::make_pair(std::string("open"), plainCorner),
+                                                            std::make_pair(std::string("maze"), mazeCorner)}) {
+        glm::ivec2 corner = scene.second;
+        benchmarks.push_back({"path/" + scene.first, [&, corner]() {
+            for (const std::pair<glm::ivec2, glm::ivec2> &cells : searchCells) {
+                std::queue<NPCAction> path = pathFinder.searchPathToward(
+                            standingAt(corner, cells.first[0], cells.first[1]),
+                            standingAt(corner, cells.second[0], cells.second[1]));
+                sink = sink + path.size();
+            }
+            return static_cast<int>(searchCells.size());
+        }});
+    }
+
+    //--------------------------
+    // Terrain::raycast and Terrain::getBlockAt
+    //--------------------------
+    // the player's picking ray: the player's old gridMarch is now
+    // Terrain::raycast. From above the mountains, down onto them.
+    std::vector<TerrainRay> rays;
+    Random rayRandom(Random::mix(worldSeed + 1));
+    for (int i = 0; i < 4096; i++) {
+        glm::vec3 origin(mountainCorner[0] + 8.f + 32.f * rayRandom.nextFloat(), 220.f,
+                         mountainCorner[1] + 8.f + 32.f * rayRandom.nextFloat());
+        glm::vec3 direction(rayRandom.nextFloat() - 0.5f, -1.f, rayRandom.nextFloat() - 0.5f);
+        rays.push_back(TerrainRay(origin, glm::normalize(direction) * 96.f));
+    }
+    benchmarks.push_back({"raycast/mountain", [&]() {
+        for (const TerrainRay &ray : rays) {
+            TerrainRayHit hit = terrain.raycast(ray.origin, ray.direction);
+            sink = sink + hit.block.y;
+        }
+        return static_cast<int>(rays.size());
+    }});
+    // and level, through the open air over the plain, where the empty
+    // sections and bricks are skipped whole
+    std::vector<TerrainRay> skyRays;
+    for (int i = 0; i < 4096; i++) {
+        glm::vec3 origin(plainCorner[0] + 0.5f + 2.f * rayRandom.nextFloat(),
+                         groundHeight + 2.f + 120.f * rayRandom.nextFloat(),
+                         plainCorner[1] + 0.5f + 2.f * rayRandom.nextFloat());
+        glm::vec3 direction(1.f, 0.2f * (rayRandom.nextFloat() - 0.5f), rayRandom.nextFloat());
+        skyRays.push_back(TerrainRay(origin, glm::normalize(direction) * 44.f));
+    }
+    benchmarks.push_back({"raycast/sky", [&]() {
+        for (const TerrainRay &ray : skyRays) {
+            TerrainRayHit hit = terrain.raycast(ray.origin, ray.direction);
+            sink = sink + hit.block.y;
+        }
+        return static_cast<int>(skyRays.size());
+    }});
+
+    // the middle chunk of the mountains in memory order, x innermost, and
+    // as many blocks anywhere in the scene
+    benchmarks.push_back({"getBlockAt/sequential", [&]() {
+        int sum = 0;
+        for (int y = 0; y < 256; y++) {
+            for (int z = 16; z < 32; z++) {
+                for (int x = 16; x < 32; x++) {
+                    sum += terrain.getBlockAt(mountainCorner[0] + x, y, mountainCorner[1] + z);
+                }
+            }
+        }
+        sink = sink + sum;
+        return 16 * 16 * 256;
+    }});
+    // the six neighbors of every block of the same chunk, as the
+    // lighting and the navigation read them
+    benchmarks.push_back({"getBlockAt/neighbors", [&]() {
+        static const glm::ivec3 faces[6] = {glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 1, 0),
+                                            glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)};
+        int sum = 0;
+        for (int y = 1; y < 255; y++) {
+            for (int z = 16; z < 32; z++) {
+                for (int x = 16; x < 32; x++) {
+                    for (const glm::ivec3 &face : faces) {
+                        sum += terrain.getBlockAt(mountainCorner[0] + x + face.x, y + face.y,
+                                                  mountainCorner[1] + z + face.z);
+                    }
+                }
+            }
+        }
+        sink = sink + sum;
+        return 16 * 16 * 254 * 6;
+    }});
+    std::vector<glm::ivec3> randomBlocks;
+    Random blockRandom(Random::mix(worldSeed + 2));
+    for (int i = 0; i < 16 * 16 * 256; i++) {
+        randomBlocks.push_back(glm::ivec3(mountainCorner[0] + blockRandom.nextUInt() % sceneSize,
+                                          blockRandom.nextUInt() % 256,
+                                          mountainCorner[1] + blockRandom.nextUInt() % sceneSize));
+    }
+    benchmarks.push_back({"getBlockAt/random", [&]() {
+        int sum = 0;
+        for (const glm::ivec3 &p : randomBlocks) {
+            sum += terrain.getBlockAt(p.x, p.y, p.z);
+        }
+        sink = sink + sum;
+        return static_cast<int>(randomBlocks.size());
+    }});
+
+    std::printf("seed 0x%llx, at least %d ms each, %s sections\n", static_cast<unsigned long long>(worldSeed),
+                minMs, BlockSection::mortonOrder ? "Z-order" : "linear");
+    std::printf("%-28s %15s %15s %22s %17s %8s\n", "benchmark", "median/item", "min/item",
+                "throughput", "allocs/item", "batches");
+    for (const MicroBenchmark &benchmark : benchmarks) {
+        if (!filter.isEmpty() && !QString::fromStdString(benchmark.name).contains(filter)) {
+            continue;
+        }
+        printResult(benchmark.name, runBenchmark(benchmark, minMs * 1000000ll));
+    }
+
+    // what the ordering is for: the opaque fragments shaded per visible one
+    bool overdrawHeader = false;
+    for (const std::pair<std::string, Chunk*> &scene : meshed) {
+        std::string name = "overdraw/" + scene.first;
+        if (!filter.isEmpty() && !QString::fromStdString(name).contains(filter)) {
+            continue;
+        }
+        if (!overdrawHeader) {
+            std::printf("\n%-28s %15s %15s\n", "overdraw", "ordered", "unordered");
+            overdrawHeader = true;
+        }
+        double overdraw[2];
+        for (int ordered = 1; ordered >= 0; ordered--) {
+            Chunk::setOverdrawOrdering(ordered != 0);
+            scene.second->markAllSectionsDirty();
+            overdraw[1 - ordered] = opaqueOverdraw(scene.second->generateVBOdata());
+        }
+        Chunk::setOverdrawOrdering(true);
+        std::printf("%-28s %15.3f %15.3f\n", name.c_str(), overdraw[0], overdraw[1]);
+    }
+    return 0;
+}
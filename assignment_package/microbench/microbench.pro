@@ -0,0 +1,73 @@
+# Micro-benchmarks of the hot kernels: noise, shaping, meshing, path
+# search and block lookups, each timed on its own. Headless like the
+# terrain benchmark; the GL-facing classes are only linked for the scene code.
+# Build it next to miniMinecraft.pro, e.g.
+#   qmake microbench/microbench.pro && make && ./MicroBenchmark mesh/
+# CONFIG += morton_sections builds MicroBenchmarkMorton, with the sections'
+# blocks in Z order, to run against this one, e.g.
+#   qmake "CONFIG += morton_sections" microbench/microbench.pro
+
+QT += core gui widgets openglwidgets
+
+TARGET = MicroBenchmark
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++1z
+CONFIG += release
+win32 {
+    LIBS += -lopengl32
+}
+morton_sections {
+    TARGET = MicroBenchmarkMorton
+    DEFINES += MINIMINECRAFT_MORTON_SECTIONS
+}
+
+INCLUDEPATH += $$PWD/../include
+INCLUDEPATH += $$PWD/../src
+DEPENDPATH += $$PWD/../src
+
+SOURCES += \
+    $$PWD/main.cpp \
+    $$PWD/../src/chunkbufferpool.cpp \
+    $$PWD/../src/chunkcomputemesher.cpp \
+    $$PWD/../src/chunkmesharena.cpp \
+    $$PWD/../src/chunkmultidraw.cpp \
+    $$PWD/../src/drawable.cpp \
+    $$PWD/../src/lineararena.cpp \
+    $$PWD/../src/memorystats.cpp \
+    $$PWD/../src/openglcontext.cpp \
+    $$PWD/../src/profiler.cpp \
+    $$PWD/../src/renderbackend.cpp \
+    $$PWD/../src/shaderprogram.cpp \
+    $$PWD/../src/terraincompute.cpp \
+    $$PWD/../src/terrainjobs.cpp \
+    $$PWD/../src/threadaffinity.cpp \
+    $$PWD/../src/scene/block.cpp \
+    $$PWD/../src/scene/blockcursor.cpp \
+    $$PWD/../src/scene/blocksection.cpp \
+    $$PWD/../src/scene/blockticks.cpp \
+    $$PWD/../src/scene/chunk.cpp \
+    $$PWD/../src/scene/chunkdrawable.cpp \
+    $$PWD/../src/scene/chunkmap.cpp \
+    $$PWD/../src/scene/chunkpool.cpp \
+    $$PWD/../src/scene/chunknavigation.cpp \
+    $$PWD/../src/scene/editjournal.cpp \
+    $$PWD/../src/scene/entitygrid.cpp \
+    $$PWD/../src/scene/frustum.cpp \
+    $$PWD/../src/scene/lightvolume.cpp \
+    $$PWD/../src/scene/liquidsimulation.cpp \
+    $$PWD/../src/scene/lsystems.cpp \
+    $$PWD/../src/scene/meshcache.cpp \
+    $$PWD/../src/scene/navigationgraph.cpp \
+    $$PWD/../src/scene/noise.cpp \
+    $$PWD/../src/scene/pathfinder.cpp \
+    $$PWD/../src/scene/random.cpp \
+    $$PWD/../src/scene/regionstore.cpp \
+    $$PWD/../src/scene/terrain.cpp \
+    $$PWD/../src/scene/terrainraycast.cpp \
+    $$PWD/../src/scene/treetemplate.cpp \
+    $$PWD/../src/scene/zoneheightmap.cpp \
+    $$PWD/../src/scene/zonefeatures.cpp
+
+RESOURCES += $$PWD/../glsl.qrc
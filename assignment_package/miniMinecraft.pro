@@ -2,7 +2,7 @@ greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 QT += multimedia
 QT += core gui
 QT += widgets
-QT += core widgets openglwidgets
+QT += core widgets openglwidgets network
 
 TARGET = MiniMinecraft
 TEMPLATE = app
@@ -48,6 +48,20 @@ linux-clang*|linux-g++*|macx-clang*|macx-g++* {
 # check the hidden `.build.sh` file for info. But be aware: ASAN may
 # trigger a lot of false-positive leak warnings for the Qt libraries.
 # (See `.run.sh` for how to disable leak checking.)
+# CONFIG += gl_window draws the game to a QOpenGLWindow instead of a
+# QOpenGLWidget, skipping the widget's composition (see openglcontext.h)
+gl_window {
+    message("Drawing to a QOpenGLWindow")
+    DEFINES += MINIMINECRAFT_GL_WINDOW
+}
+
+# CONFIG += morton_sections stores the blocks of a chunk section in Z order
+# (see blocksection.h); the saved worlds are the same either way
+morton_sections {
+    message("Storing the sections' blocks in Z order")
+    DEFINES += MINIMINECRAFT_MORTON_SECTIONS
+}
+
 address_sanitizer {
     message("Enabling Address Sanitizer")
     QMAKE_CXXFLAGS += -fsanitize=address
@@ -0,0 +1,155 @@
+// Offline world pre-generation.
+// Generates a square of zones around a column on every core, with no GPU
+// and no window (see Terrain::isHeadless), and stores each chunk in the
+// region files, so a game started there loads the world from disk instead
+// of waiting on loadInitialTerrain to generate it.
+//
+// The square is generated a tile of zones at a time, each in one go, so
+// the job system always has a whole tile of work queued; the tiles are
+// walked row by row, back and forth, so each starts next to the last and
+// the zones behind it are evicted once stored.
+//
+// usage: WorldPregen [--seed s] [--zones 8] [--center x,z]
+//                    [--tile-radius 2] [--region-dir dir]
+//                    [--terrain-threads n] ...
+
+#include "scene/terrain.h"
+#include "threadconfig.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QStringList>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+
+// Of the chunks in the zones of the tile, how many are decorated
+static int countDecorated(const Terrain &terrain, int zoneX, int zoneZ, int tileZones)
+{
+    int decorated = 0;
+    for (int x = zoneX * 64; x < (zoneX + tileZones) * 64; x += 16) {
+        for (int z = zoneZ * 64; z < (zoneZ + tileZones) * 64; z += 16) {
+            const Chunk *chunk = terrain.findChunk(x, z);
+            if (chunk != nullptr && chunk->getGenerationStage() == GenerationStage::decorated) {
+                decorated++;
+            }
+        }
+    }
+    return decorated;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("seed", "The world seed.", "seed", "0x476F6C64656E4F72"));
+    parser.addOption(QCommandLineOption("zones", "Zones per side of the square generated.", "zones", "8"));
+    parser.addOption(QCommandLineOption("center", "The column the square is centered on.", "x,z", "48,48"));
+    parser.addOption(QCommandLineOption("tile-radius", "Zones on each side of a tile's center zone: the work "
+                                        "queued at once.", "zones", "2"));
+    parser.addOption(QCommandLineOption("region-dir", "Store the chunks here rather than in the "
+                                        "game's folder for the seed.", "dir"));
+    ThreadConfig::addOptions(parser);
+    parser.process(app);
+
+    bool okSeed = false, okZones = false, okTile = false, okX = false, okZ = false;
+    uint64_t worldSeed = parser.value("seed").toULongLong(&okSeed, 0);
+    int zones = parser.value("zones").toInt(&okZones);
+    int tileRadius = parser.value("tile-radius").toInt(&okTile);
+    QStringList center = parser.value("center").split(',');
+    float centerX = center.size() == 2 ? center[0].toFloat(&okX) : 0.f;
+    float centerZ = center.size() == 2 ? center[1].toFloat(&okZ) : 0.f;
+    if (!okSeed || !okZones || zones < 1 || !okTile || tileRadius < 0 || !okX || !okZ) {
+        fprintf(stderr, "The seed must be a number, the zones positive, the tile radius not negative "
+                        "and the center x,z\n");
+        return 1;
+    }
+    QString configError;
+    if (!ThreadConfig::global().load(parser, configError)) {
+        fprintf(stderr, "%s\n", qPrintable(configError));
+        return 1;
+    }
+
+    // no context: nothing is ever meshed, and nothing else needs the cores
+    uPtr<Terrain> terrain = mkU<Terrain>(nullptr, worldSeed);
+    const ThreadConfig &config = ThreadConfig::global();
+    TerrainJobSystem &jobs = terrain->getJobSystem();
+    jobs.setThreadCount(config.terrainThreads > 0 ? config.terrainThreads : QThread::idealThreadCount());
+    jobs.setThreadLimit(TerrainJobQueue::generation, config.generationThreads);
+    if (!config.terrainCores.empty()) {
+        jobs.setCores(config.terrainCores);
+    }
+    if (parser.isSet("region-dir")) {
+        terrain->setRegionDirectory(parser.value("region-dir"));
+    }
+
+    // whole tiles: the square is rounded up to them
+    int tileZones = 1 + 2 * tileRadius;
+    int tilesPerSide = (zones + tileZones - 1) / tileZones;
+    int firstZoneX = static_cast<int>(glm::floor(centerX / 64.f)) - (tilesPerSide * tileZones) / 2;
+    int firstZoneZ = static_cast<int>(glm::floor(centerZ / 64.f)) - (tilesPerSide * tileZones) / 2;
+    int chunksPerTile = tileZones * tileZones * 16;
+    int totalChunks = tilesPerSide * tilesPerSide * chunksPerTile;
+    // the tile generating and the one before it, with the ring of zones
+    // the expansion keeps around them
+    terrain->setResidency(tileRadius + 1, 2 * (tileZones + 2) * (tileZones + 2));
+    printf("generating %d x %d zones (%d chunks) around %.0f, %.0f in %d tiles on %d threads\n",
+           tilesPerSide * tileZones, tilesPerSide * tileZones, totalChunks, centerX, centerZ,
+           tilesPerSide * tilesPerSide, jobs.threadCount());
+    fflush(stdout);
+
+    QElapsedTimer timer, progressTimer;
+    timer.start();
+    progressTimer.start();
+    int chunksDone = 0;
+    for (int row = 0; row < tilesPerSide; row++) {
+        for (int column = 0; column < tilesPerSide; column++) {
+            // back and forth
+            int tileColumn = row % 2 == 0 ? column : tilesPerSide - 1 - column;
+            int zoneX = firstZoneX + tileColumn * tileZones;
+            int zoneZ = firstZoneZ + row * tileZones;
+            float tileX = (zoneX + tileRadius) * 64.f + 32.f;
+            float tileZ = (zoneZ + tileRadius) * 64.f + 32.f;
+
+            terrain->expand(tileX, tileZ, tileRadius);
+            int decorated = 0;
+            qint64 lastExpand = timer.nsecsElapsed();
+            while ((decorated = countDecorated(*terrain, zoneX, zoneZ, tileZones)) < chunksPerTile) {
+                terrain->checkThreadResults();
+                // the zones left behind are evicted a few per call
+                if (timer.nsecsElapsed() - lastExpand > 100000000) {
+                    terrain->expand(tileX, tileZ, tileRadius);
+                    lastExpand = timer.nsecsElapsed();
+                }
+                if (progressTimer.nsecsElapsed() > 1000000000) {
+                    progressTimer.restart();
+                    int done = chunksDone + decorated;
+                    printf("%5.1f%%  %d / %d chunks, %.0f chunks/s\n", 100.0 * done / totalChunks, done,
+                           totalChunks, done / (timer.nsecsElapsed() / 1e9));
+                    fflush(stdout);
+                }
+                QThread::msleep(1);
+            }
+            chunksDone += chunksPerTile;
+
+            // stored, the chunks load as they are instead of being generated
+            for (int x = zoneX * 64; x < (zoneX + tileZones) * 64; x += 16) {
+                for (int z = zoneZ * 64; z < (zoneZ + tileZones) * 64; z += 16) {
+                    terrain->getChunkAt(x, z)->setModified(true);
+                }
+            }
+            terrain->saveModifiedChunks();
+        }
+    }
+    double generated = timer.nsecsElapsed() / 1e9;
+    printf("generated %d chunks in %.2f s, %.0f chunks/s\n", totalChunks, generated, totalChunks / generated);
+
+    // written by the time the terrain goes
+    terrain = nullptr;
+    double stored = timer.nsecsElapsed() / 1e9;
+    printf("stored in %.2f s more, %.0f chunks/s in all\n", stored - generated, totalChunks / stored);
+    return 0;
+}
@@ -0,0 +1,44 @@
+# Offline world pre-generation: fills the region files of a square of
+# zones, so the game loads them from disk instead of generating them.
+# The terrain is made without a context, so no GL call is ever made; the
+# GL-facing classes are only linked for the scene code that uses them.
+# Build it next to miniMinecraft.pro, e.g.
+#   qmake pregen/pregen.pro && make && ./WorldPregen --zones 16
+
+QT += core gui widgets openglwidgets network
+
+TARGET = WorldPregen
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++1z
+CONFIG += release
+win32 {
+    LIBS += -lopengl32
+}
+
+INCLUDEPATH += $$PWD/../include
+
+include($$PWD/../src/src.pri)
+
+# everything but the game's main(), its windows, renderer and audio
+SRC_DIR = $$clean_path($$PWD/../src)
+SOURCES -= \
+    $$SRC_DIR/main.cpp \
+    $$SRC_DIR/mainwindow.cpp \
+    $$SRC_DIR/cameracontrolshelp.cpp \
+    $$SRC_DIR/playerinfo.cpp \
+    $$SRC_DIR/mygl.cpp \
+    $$SRC_DIR/audiomanager.cpp
+HEADERS -= \
+    $$SRC_DIR/mainwindow.h \
+    $$SRC_DIR/cameracontrolshelp.h \
+    $$SRC_DIR/playerinfo.h \
+    $$SRC_DIR/mygl.h \
+    $$SRC_DIR/audiomanager.h
+
+SOURCES += \
+    $$PWD/main.cpp
+
+RESOURCES += \
+    $$PWD/../glsl.qrc
@@ -0,0 +1,370 @@
+// Headless world server.
+// Generates the zones around the spawn with no GPU and no window: the
+// terrain is made without a context (see Terrain::isHeadless), so its
+// chunks are shaped, carved and decorated but never meshed. Then ticks
+// a herd of NPCs over the result at the game's fixed step, and stores
+// every generated chunk in the region directory, so the world loads from
+// disk instead of being generated again.
+//
+// Given --seed more than once, hosts a world per seed side by side: their
+// terrains share one TerrainJobPool, which hands its threads to the
+// worlds in turn, and each gets its own herd and region directory.
+//
+// With --listen, serves the world to games started with --connect instead
+// (see NetServer): the NPCs run in real time, the terrain follows the
+// first client and the chunks, edits and NPCs stream to every client,
+// until --seconds if given. One world only. With --metrics-port too, its
+// tick times, queues, NPCs and memory are served to Prometheus (see
+// ServerMetrics).
+//
+// usage: WorldServer [--seed s]... [--radius 2] [--region-dir dir]
+//                    [--seconds 10] [--npcs 12]
+//                    [--listen port] [--stream-radius 10] [--chunk-rate KB/s]
+//                    [--metrics-port port]
+
+#include "scene/terrain.h"
+#include "scene/player.h"
+#include "scene/npcsimulation.h"
+#include "scene/npcs/sheep.h"
+#include "scene/npcs/lama.h"
+#include "scene/npcs/zombiedragon.h"
+#include "netserver.h"
+#include "servermetrics.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+
+// where the player spawns in the game, on top of the ground
+static const glm::vec2 spawnColumn(48.f, 48.f);
+
+// wandering between these, relative to the spawn
+static const std::vector<glm::vec2> herdGoals = {
+    glm::vec2(-24.f, -24.f), glm::vec2(24.f, -16.f), glm::vec2(16.f, 24.f), glm::vec2(-20.f, 20.f),
+};
+
+// Whether every chunk of the zones within radius of (x, z) is decorated
+static bool isGenerated(const Terrain &terrain, float x, float z, int radius)
+{
+    int zoneX = static_cast<int>(glm::floor(x / 64.f)) * 64;
+    int zoneZ = static_cast<int>(glm::floor(z / 64.f)) * 64;
+    for (int cx = zoneX - radius * 64; cx < zoneX + (radius + 1) * 64; cx += 16) {
+        for (int cz = zoneZ - radius * 64; cz < zoneZ + (radius + 1) * 64; cz += 16) {
+            const Chunk *chunk = terrain.findChunk(cx, cz);
+            if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// One of the worlds the server hosts
+struct HostedWorld
+{
+    uPtr<Terrain> terrain;
+    uPtr<Player> player;
+    std::vector<uPtr<NPC>> npcs;
+    uPtr<NPCSimulation> simulation;
+};
+
+// Put a herd of npcCount NPCs around the spawn of the world's player,
+// wandering between herdGoals
+static void spawnHerd(HostedWorld &world, int npcCount)
+{
+    Terrain &terrain = *world.terrain;
+    int spawnX = static_cast<int>(spawnColumn.x), spawnZ = static_cast<int>(spawnColumn.y);
+    // the NPCs' parts are never uploaded: no createVBOdata
+    std::vector<glm::vec3> goals;
+    for (const glm::vec2 &goal : herdGoals) {
+        int x = spawnX + static_cast<int>(goal.x), z = spawnZ + static_cast<int>(goal.y);
+        goals.push_back(glm::vec3(x + 0.5f, terrain.getSurfaceHeight(x, z) + 1.f, z + 0.5f));
+    }
+    for (int i = 0; i < npcCount; i++) {
+        int x = spawnX + (i % 6) * 2 - 6, z = spawnZ + (i / 6) * 2 - 6;
+        std::rotate(goals.begin(), goals.begin() + 1, goals.end());
+        world.npcs.push_back(mkU<Sheep>(nullptr, glm::vec3(x + 0.5f, terrain.getSurfaceHeight(x, z) + 2.f, z + 0.5f),
+                                        terrain, *world.player, i % 2 == 0 ? SHEEP : BEAR,
+                                        goals,
+                                        glm::vec3(1.f, 0.f, 1.f),
+                                        2.f, 2.f,
+                                        5));
+        world.npcs.back()->initSceneGraph();
+    }
+    world.simulation = mkU<NPCSimulation>();
+    world.simulation->setNPCs(world.npcs, terrain);
+}
+
+// Mark the chunks of the zones within radius of the spawn modified, so
+// they are stored; returns how many
+static int markSpawnZonesModified(Terrain &terrain, int radius)
+{
+    int zoneX = static_cast<int>(glm::floor(spawnColumn.x / 64.f)) * 64;
+    int zoneZ = static_cast<int>(glm::floor(spawnColumn.y / 64.f)) * 64;
+    int stored = 0;
+    for (int x = zoneX - radius * 64; x < zoneX + (radius + 1) * 64; x += 16) {
+        for (int z = zoneZ - radius * 64; z < zoneZ + (radius + 1) * 64; z += 16) {
+            terrain.getChunkAt(x, z)->setModified(true);
+            stored++;
+        }
+    }
+    return stored;
+}
+
+// what a client needs to draw NPC i
+static NetNPCState npcState(const NPC &npc, const NPCPose &pose, size_t i)
+{
+    NetNPCKind kind = NetNPCKind::sheep;
+    if (dynamic_cast<const Lama*>(&npc) != nullptr) {
+        kind = NetNPCKind::lama;
+    } else if (dynamic_cast<const ZombieDragon*>(&npc) != nullptr) {
+        kind = NetNPCKind::zombieDragon;
+    }
+    return NetNPCState{static_cast<uint16_t>(i), kind, static_cast<uint8_t>(npc.npcTexture),
+                       pose.position, std::atan2(pose.forward.x, pose.forward.z)};
+}
+
+// what ServerMetrics shows of the world, as of now
+static ServerGauges serverGauges(const Terrain &terrain, const NetServer &server, size_t npcCount)
+{
+    ServerGauges gauges;
+    const TerrainJobSystem &jobs = terrain.getJobSystem();
+    for (TerrainJobQueue queue : {TerrainJobQueue::generation, TerrainJobQueue::meshing, TerrainJobQueue::io}) {
+        TerrainJobStats stats = jobs.getStats(queue);
+        gauges.queuedJobs[static_cast<int>(queue)] = stats.queued;
+        gauges.runningJobs[static_cast<int>(queue)] = stats.running;
+        if (queue == TerrainJobQueue::generation) {
+            gauges.generationJobs = stats.completed;
+        }
+    }
+    TerrainFrameActivity activity = terrain.getFrameActivity();
+    gauges.chunksAwaitingStage = activity.chunksAwaitingStage;
+    gauges.chunksAwaitingMesh = activity.chunksAwaitingMesh;
+    gauges.pendingUploads = activity.pendingUploads;
+    gauges.npcs = static_cast<int>(npcCount);
+    gauges.clients = static_cast<int>(server.getConnectionCount());
+    return gauges;
+}
+
+/**
+ * Serve the world until `seconds` pass (never if negative), in the
+ * game's order: the NPCs step between two ticks, and the terrain only
+ * changes while they do not. metrics, if given, gets every tick and,
+ * once a second, the gauges: those take the job system's lock.
+ */
+static void serve(QCoreApplication &app, Terrain &terrain, std::vector<uPtr<NPC>> &npcs,
+                  NPCSimulation &simulation, NetServer &server, ServerMetrics *metrics, int radius,
+                  float seconds)
+{
+    terrain.setEditTracking(true);
+    std::vector<NetNPCState> states;
+    QElapsedTimer clock;
+    clock.start();
+    qint64 prevTime = 0;
+    double simulatedSeconds = 0.0;
+    float expandAccumulator = 0.f, statsAccumulator = 0.f, gaugeAccumulator = 1.f;
+    glm::vec3 focus(spawnColumn.x, 0.f, spawnColumn.y);
+    while (seconds < 0.f || clock.nsecsElapsed() / 1e9 < seconds) {
+        qint64 now = clock.nsecsElapsed();
+        float dT = (now - prevTime) / 1e9f;
+        prevTime = now;
+
+        simulation.finish();
+        if (metrics != nullptr) {
+            metrics->addPathfinding(simulation.takeTimes().pathfind);
+        }
+        states.clear();
+        for (size_t i = 0; i < npcs.size(); i++) {
+            states.push_back(npcState(*npcs[i], simulation.getDrawPose(i), i));
+        }
+
+        app.processEvents();
+        // one viewer: the zones follow the first client (see Terrain::setViewer)
+        if (server.getFirstView(focus) && (expandAccumulator += dT) >= 0.1f) {
+            terrain.setViewer(focus, glm::vec3(0.f, 0.f, 1.f), glm::vec3(0.f));
+            terrain.expand(focus.x, focus.z, radius);
+            expandAccumulator = 0.f;
+        }
+        terrain.checkThreadResults();
+        // before the tick, which sends their edits
+        terrain.updateBlockTicks(dT, focus);
+        uint32_t step = static_cast<uint32_t>(simulatedSeconds / NPCSimulation::stepSeconds);
+        server.tick(terrain, states, step, dT);
+
+        simulation.begin(dT, focus);
+        simulatedSeconds += dT;
+
+        if ((statsAccumulator += dT) >= 5.f) {
+            statsAccumulator = 0.f;
+            printf("%s", server.statsText().toStdString().c_str());
+            fflush(stdout);
+        }
+        if (metrics != nullptr) {
+            if ((gaugeAccumulator += dT) >= 1.f) {
+                gaugeAccumulator = 0.f;
+                metrics->publish(serverGauges(terrain, server, npcs.size()));
+            }
+            // the sleep is not the tick's
+            metrics->addTick(clock.nsecsElapsed() - now);
+        }
+        QThread::msleep(2);
+    }
+    simulation.stop();
+    terrain.saveModifiedChunks();
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("seed", "The world seed; once per world to host several.", "seed",
+                                        "0x476F6C64656E4F72"));
+    parser.addOption(QCommandLineOption("radius", "Zones generated around the spawn's, on each side.",
+                                        "zones", "2"));
+    parser.addOption(QCommandLineOption("region-dir", "Store the chunks here rather than in the "
+                                        "game's folder for the seed.", "dir"));
+    parser.addOption(QCommandLineOption("seconds", "Seconds of NPC simulation to run.", "seconds", "10"));
+    parser.addOption(QCommandLineOption("npcs", "NPCs to simulate.", "npcs", "12"));
+    parser.addOption(QCommandLineOption("listen", "Serve the world to games on this TCP port.", "port"));
+    parser.addOption(QCommandLineOption("stream-radius", "Chunks streamed around each client, on each side.",
+                                        "chunks", "10"));
+    parser.addOption(QCommandLineOption("chunk-rate", "The most KB/s of chunks each client is sent "
+                                        "(0: as fast as it takes them).", "KB/s", "0"));
+    parser.addOption(QCommandLineOption("metrics-port", "With --listen, serve Prometheus metrics at "
+                                        "http://host:port/metrics.", "port"));
+    parser.process(app);
+    bool okSeed = true, okRadius = false, okSeconds = false, okNpcs = false;
+    std::vector<uint64_t> worldSeeds;
+    for (const QString &seed : parser.values("seed")) {
+        bool ok = false;
+        worldSeeds.push_back(seed.toULongLong(&ok, 0));
+        okSeed = okSeed && ok;
+    }
+    int radius = parser.value("radius").toInt(&okRadius);
+    float seconds = parser.value("seconds").toFloat(&okSeconds);
+    int npcCount = parser.value("npcs").toInt(&okNpcs);
+    if (!okSeed || !okRadius || radius < 0 || !okSeconds || seconds < 0.f || !okNpcs || npcCount < 0) {
+        fprintf(stderr, "The seed must be a number, and the radius, seconds and NPCs not negative\n");
+        return 1;
+    }
+    bool okPort = true, okStream = false, okRate = false;
+    quint16 port = parser.isSet("listen") ? parser.value("listen").toUShort(&okPort) : 0;
+    int streamRadius = parser.value("stream-radius").toInt(&okStream);
+    float chunkRate = parser.value("chunk-rate").toFloat(&okRate);
+    if (!okPort || !okStream || streamRadius < 1 || !okRate || chunkRate < 0.f) {
+        fprintf(stderr, "The port must be a number, the stream radius positive and the chunk rate not negative\n");
+        return 1;
+    }
+    if (parser.isSet("listen") && worldSeeds.size() > 1) {
+        fprintf(stderr, "Only one world can be served\n");
+        return 1;
+    }
+    bool okMetricsPort = true;
+    quint16 metricsPort = parser.isSet("metrics-port") ? parser.value("metrics-port").toUShort(&okMetricsPort) : 0;
+    if (!okMetricsPort || (parser.isSet("metrics-port") && !parser.isSet("listen"))) {
+        fprintf(stderr, "The metrics port must be a number, and is only served with --listen\n");
+        return 1;
+    }
+
+    // no context: nothing is ever meshed or drawn. One pool of threads
+    // for every world, rather than a pool each.
+    sPtr<TerrainJobPool> jobPool = mkS<TerrainJobPool>();
+    std::vector<HostedWorld> worlds(worldSeeds.size());
+    for (size_t i = 0; i < worlds.size(); i++) {
+        worlds[i].terrain = mkU<Terrain>(nullptr, worldSeeds[i], GradientHash::permutation, jobPool);
+        if (parser.isSet("region-dir")) {
+            QString directory = parser.value("region-dir");
+            if (worlds.size() > 1) {
+                directory = QDir(directory).filePath("world-" + QString::number(worldSeeds[i], 16));
+            }
+            worlds[i].terrain->setRegionDirectory(directory);
+        }
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    for (HostedWorld &world : worlds) {
+        world.terrain->loadInitialTerrain(spawnColumn.x, spawnColumn.y, radius);
+    }
+    bool generated = false;
+    while (!generated) {
+        generated = true;
+        for (HostedWorld &world : worlds) {
+            world.terrain->checkThreadResults();
+            generated = generated && isGenerated(*world.terrain, spawnColumn.x, spawnColumn.y, radius);
+        }
+        QThread::msleep(1);
+    }
+    int zonesPerSide = 1 + 2 * radius;
+    printf("generated %d zones in %d worlds in %.2f s\n", zonesPerSide * zonesPerSide, static_cast<int>(worlds.size()),
+           timer.nsecsElapsed() / 1e9);
+
+    int spawnX = static_cast<int>(spawnColumn.x), spawnZ = static_cast<int>(spawnColumn.y);
+    for (HostedWorld &world : worlds) {
+        world.player = mkU<Player>(glm::vec3(spawnColumn.x, world.terrain->getSurfaceHeight(spawnX, spawnZ) + 2.f,
+                                             spawnColumn.y), *world.terrain);
+        spawnHerd(world, npcCount);
+    }
+
+    if (parser.isSet("listen")) {
+        HostedWorld &world = worlds.front();
+        glm::vec3 spawn = world.player->mcr_position;
+        NetServer server(*world.terrain, spawn, streamRadius);
+        server.setChunkRate(chunkRate * 1024.f);
+        if (!server.listen(port)) {
+            fprintf(stderr, "Could not listen on port %d: %s\n", port, server.getError().toStdString().c_str());
+            return 1;
+        }
+        printf("serving on port %d\n", port);
+        ServerMetrics metrics;
+        if (parser.isSet("metrics-port")) {
+            if (!metrics.start(metricsPort)) {
+                fprintf(stderr, "Could not serve the metrics on port %d\n", metricsPort);
+                return 1;
+            }
+            printf("metrics on port %d\n", metricsPort);
+        }
+        fflush(stdout);
+        serve(app, *world.terrain, world.npcs, *world.simulation, server,
+              parser.isSet("metrics-port") ? &metrics : nullptr, radius, parser.isSet("seconds") ? seconds : -1.f);
+        return 0;
+    }
+
+    int steps = static_cast<int>(seconds / NPCSimulation::stepSeconds);
+    timer.restart();
+    for (int i = 0; i < steps; i++) {
+        // the worlds' herds step at once, each on its own threads
+        for (HostedWorld &world : worlds) {
+            world.simulation->begin(NPCSimulation::stepSeconds, world.player->mcr_position);
+        }
+        for (HostedWorld &world : worlds) {
+            world.simulation->finish();
+            world.terrain->checkThreadResults();
+        }
+    }
+    for (HostedWorld &world : worlds) {
+        world.simulation->stop();
+    }
+    if (steps > 0) {
+        printf("simulated %d NPCs in %d worlds for %d steps in %.2f s\n", npcCount, static_cast<int>(worlds.size()),
+               steps, timer.nsecsElapsed() / 1e9);
+    }
+
+    // stored, the chunks load as they were instead of being generated
+    int stored = 0;
+    for (HostedWorld &world : worlds) {
+        stored += markSpawnZonesModified(*world.terrain, radius);
+        // written by the time the terrain goes
+        world.terrain->saveModifiedChunks();
+    }
+    printf("stored %d chunks\n", stored);
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "audiomanager.h"
+#include <QUrl>
+
+namespace {
+// a stream, so a compressed file plays as well as this one
+const char *const musicPath = "qrc:/sounds/elden.wav";
+const float musicVolume = 0.25f;
+const float effectVolume = 0.5f;
+// in the enums' order, none excluded
+const char *const ambientPaths[] = {":/sounds/under_water.wav", ":/sounds/lava.wav"};
+const char *const stepPaths[] = {":/sounds/grass.wav", ":/sounds/rock.wav", ":/sounds/glass.wav"};
+}
+
+AudioManager::AudioManager()
+    : m_musicOutput(), m_music(), m_ambient(), m_steps(),
+      m_ambientPlaying(AmbientSound::none), m_stepsPlaying(StepSound::none)
+{
+    m_music.setAudioOutput(&m_musicOutput);
+    m_musicOutput.setVolume(musicVolume);
+    for (QSoundEffect &effect : m_ambient) {
+        effect.setLoopCount(QSoundEffect::Infinite);
+        effect.setVolume(effectVolume);
+    }
+    for (QSoundEffect &effect : m_steps) {
+        effect.setLoopCount(QSoundEffect::Infinite);
+        effect.setVolume(effectVolume);
+    }
+}
+
+void AudioManager::startMusic()
+{
+    m_music.setSource(QUrl(musicPath));
+    m_music.setLoops(QMediaPlayer::Infinite);
+    m_music.play();
+}
+
+/**
+ * @brief AudioManager::play
+ *  An effect asked to play while it loads starts once it has loaded.
+ * @param effect
+ * @param path
+ */
+void AudioManager::play(QSoundEffect &effect, const char *path)
+{
+    if (effect.source().isEmpty()) {
+        effect.setSource(QUrl::fromLocalFile(path));
+    }
+    effect.play();
+}
+
+void AudioManager::setAmbient(AmbientSound sound)
+{
+    if (sound == m_ambientPlaying) {
+        return;
+    }
+    if (m_ambientPlaying != AmbientSound::none) {
+        m_ambient[static_cast<int>(m_ambientPlaying) - 1].stop();
+    }
+    if (sound != AmbientSound::none) {
+        int i = static_cast<int>(sound) - 1;
+        play(m_ambient[i], ambientPaths[i]);
+    }
+    m_ambientPlaying = sound;
+}
+
+void AudioManager::setSteps(StepSound sound)
+{
+    if (sound == m_stepsPlaying) {
+        return;
+    }
+    if (m_stepsPlaying != StepSound::none) {
+        m_steps[static_cast<int>(m_stepsPlaying) - 1].stop();
+    }
+    if (sound != StepSound::none) {
+        int i = static_cast<int>(sound) - 1;
+        play(m_steps[i], stepPaths[i]);
+    }
+    m_stepsPlaying = sound;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QAudioOutput>
+#include <QMediaPlayer>
+#include <QSoundEffect>
+#include <array>
+
+// The loop of where the player is
+enum class AmbientSound : unsigned char
+{
+    none, water, lava
+};
+
+// The loop of the player's steps, by what they walk on
+enum class StepSound : unsigned char
+{
+    none, grass, rock, glass
+};
+
+/**
+ * @brief The AudioManager class
+ *  The main theme, streamed by a QMediaPlayer rather than decoded whole
+ *  into memory, and the ambient and step loops, QSoundEffects that only
+ *  load their file (on Qt's loader thread) the first time they are asked
+ *  to play. Driven by state: setAmbient and setSteps may be called every
+ *  frame, and only touch the sounds when what should play changes.
+ *  Main thread only.
+ */
+class AudioManager
+{
+private:
+    QAudioOutput m_musicOutput;
+    QMediaPlayer m_music;
+
+    // indexed by the enums, none excluded
+    std::array<QSoundEffect, 2> m_ambient;
+    std::array<QSoundEffect, 3> m_steps;
+    AmbientSound m_ambientPlaying;
+    StepSound m_stepsPlaying;
+
+    // load the effect the first time, then play it, or stop it
+    static void play(QSoundEffect &effect, const char *path);
+
+public:
+    AudioManager();
+
+    // Start streaming the main theme, looping
+    void startMusic();
+    // Play the given loops, stopping the ones playing before
+    void setAmbient(AmbientSound sound);
+    void setSteps(StepSound sound);
+};
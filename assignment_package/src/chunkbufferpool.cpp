@@ -0,0 +1,135 @@
+#include "chunkbufferpool.h"
+#include "renderbackend.h"
+#include <algorithm>
+
+ChunkBufferPool::ChunkBufferPool(OpenGLContext *context)
+    : mp_context(context), m_freeBuffers(), m_freeVertexArrays(),
+      m_pooledBytes(0), m_maxPooledBytes(32u << 20), m_doomedBuffers(), m_doomedVertexArrays()
+{}
+
+int ChunkBufferPool::bucketOf(size_t bytes)
+{
+    size_t classBytes = minBucketBytes;
+    for (int bucket = 0; bucket < bucketCount; bucket++, classBytes *= 2) {
+        if (bytes <= classBytes) {
+            return bucket;
+        }
+    }
+    return -1;
+}
+
+size_t ChunkBufferPool::bucketBytes(size_t bytes)
+{
+    int bucket = bucketOf(bytes);
+    return bucket < 0 ? bytes : minBucketBytes << bucket;
+}
+
+GLuint ChunkBufferPool::acquireBuffer(size_t bytes)
+{
+    int bucket = bucketOf(bytes);
+    if (bucket >= 0 && !m_freeBuffers[bucket].empty()) {
+        GLuint buffer = m_freeBuffers[bucket].back();
+        m_freeBuffers[bucket].pop_back();
+        m_pooledBytes -= minBucketBytes << bucket;
+        return buffer;
+    }
+    GLuint buffer;
+    mp_context->glGenBuffers(1, &buffer);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, bucketBytes(bytes), nullptr, GL_STATIC_DRAW);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return buffer;
+}
+
+void ChunkBufferPool::releaseBuffer(GLuint buffer, size_t bytes)
+{
+    int bucket = bucketOf(bytes);
+    if (bucket >= 0 && bytes == bucketBytes(bytes) && m_pooledBytes + bytes <= m_maxPooledBytes) {
+        m_freeBuffers[bucket].push_back(buffer);
+        m_pooledBytes += bytes;
+    } else {
+        m_doomedBuffers.push_back(buffer);
+    }
+}
+
+GLuint ChunkBufferPool::acquireVertexArray()
+{
+    if (!m_freeVertexArrays.empty()) {
+        GLuint vertexArray = m_freeVertexArrays.back();
+        m_freeVertexArrays.pop_back();
+        return vertexArray;
+    }
+    return mp_context->renderBackend().createVertexInput();
+}
+
+void ChunkBufferPool::releaseVertexArray(GLuint vertexArray)
+{
+    if (m_freeVertexArrays.size() < maxPooledVertexArrays) {
+        m_freeVertexArrays.push_back(vertexArray);
+    } else {
+        m_doomedVertexArrays.push_back(vertexArray);
+    }
+}
+
+/**
+ * @brief ChunkBufferPool::recycle
+ *  The vertex arrays go first: they are the cheaper ones to delete, and
+ *  they may still name buffers deleted below.
+ */
+void ChunkBufferPool::recycle()
+{
+    int deletions = deletionsPerRecycle;
+    GLsizei vertexArrays = static_cast<GLsizei>(std::min<size_t>(deletions, m_doomedVertexArrays.size()));
+    if (vertexArrays > 0) {
+        mp_context->glDeleteVertexArrays(vertexArrays, m_doomedVertexArrays.data() + m_doomedVertexArrays.size()
+                                         - vertexArrays);
+        m_doomedVertexArrays.resize(m_doomedVertexArrays.size() - vertexArrays);
+        deletions -= vertexArrays;
+    }
+    GLsizei buffers = static_cast<GLsizei>(std::min<size_t>(deletions, m_doomedBuffers.size()));
+    if (buffers > 0) {
+        mp_context->glDeleteBuffers(buffers, m_doomedBuffers.data() + m_doomedBuffers.size() - buffers);
+        m_doomedBuffers.resize(m_doomedBuffers.size() - buffers);
+    }
+}
+
+void ChunkBufferPool::destroy()
+{
+    for (std::vector<GLuint> &buffers : m_freeBuffers) {
+        m_doomedBuffers.insert(m_doomedBuffers.end(), buffers.begin(), buffers.end());
+        buffers.clear();
+    }
+    m_doomedVertexArrays.insert(m_doomedVertexArrays.end(), m_freeVertexArrays.begin(), m_freeVertexArrays.end());
+    m_freeVertexArrays.clear();
+    m_pooledBytes = 0;
+
+    if (!m_doomedVertexArrays.empty()) {
+        mp_context->glDeleteVertexArrays(static_cast<GLsizei>(m_doomedVertexArrays.size()),
+                                         m_doomedVertexArrays.data());
+    }
+    if (!m_doomedBuffers.empty()) {
+        mp_context->glDeleteBuffers(static_cast<GLsizei>(m_doomedBuffers.size()), m_doomedBuffers.data());
+    }
+    m_doomedVertexArrays.clear();
+    m_doomedBuffers.clear();
+}
+
+/**
+ * @brief ChunkBufferPool::setMaxPooledBytes
+ *  Lowering it frees nothing now; the releases past it are deleted.
+ * @param bytes
+ */
+void ChunkBufferPool::setMaxPooledBytes(size_t bytes)
+{
+    m_maxPooledBytes = bytes;
+}
+
+size_t ChunkBufferPool::getPooledBytes() const
+{
+    return m_pooledBytes;
+}
+
+size_t ChunkBufferPool::getPendingDeletions() const
+{
+    return m_doomedBuffers.size() + m_doomedVertexArrays.size();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "openglcontext.h"
+#include <array>
+#include <cstddef>
+#include <vector>
+
+// The vertex buffers and vertex array objects of the chunk meshes kept
+// out of the arena (see ChunkDrawable), recycled instead of deleted, so a
+// zone leaving the grid hands its buffers to the zone coming in rather
+// than the driver freeing them and allocating new ones in the same frame.
+// The buffers come in power-of-two size classes, allocated once to the
+// class's size and only ever copied into after that: glBufferSubData is
+// ordered after the draws in flight, so a released buffer is reused at
+// once. What the pool does not keep is deleted a few objects per tick.
+// Main thread only, with the context current.
+class ChunkBufferPool {
+public:
+    // the smallest size class, and the number of classes, doubling from it;
+    // a larger buffer is never pooled
+    static const size_t minBucketBytes = 1024;
+    static const int bucketCount = 16;
+    // two per chunk mesh
+    static const size_t maxPooledVertexArrays = 512;
+    // the buffers and vertex arrays recycle() deletes at most
+    static const int deletionsPerRecycle = 8;
+
+private:
+    OpenGLContext *mp_context;
+    // the free buffers of each size class
+    std::array<std::vector<GLuint>, bucketCount> m_freeBuffers;
+    std::vector<GLuint> m_freeVertexArrays;
+    // the bytes of m_freeBuffers, kept under m_maxPooledBytes
+    size_t m_pooledBytes;
+    size_t m_maxPooledBytes;
+    // released past the pool's room, waiting for recycle()
+    std::vector<GLuint> m_doomedBuffers;
+    std::vector<GLuint> m_doomedVertexArrays;
+
+    // the size class of a buffer of `bytes`, or -1 if it has none
+    static int bucketOf(size_t bytes);
+
+public:
+    explicit ChunkBufferPool(OpenGLContext *context);
+
+    ChunkBufferPool(const ChunkBufferPool&) = delete;
+    ChunkBufferPool &operator=(const ChunkBufferPool&) = delete;
+
+    // The bytes a buffer acquired for `bytes` has: its size class, or
+    // `bytes` itself past the largest one
+    static size_t bucketBytes(size_t bytes);
+
+    // A buffer of bucketBytes(bytes), its contents undefined: a free one
+    // of that class, else a new one
+    GLuint acquireBuffer(size_t bytes);
+    // `bytes` is what acquireBuffer gave it
+    void releaseBuffer(GLuint buffer, size_t bytes);
+    GLuint acquireVertexArray();
+    void releaseVertexArray(GLuint vertexArray);
+
+    // once per tick: delete some of the objects the pool had no room for
+    void recycle();
+    // delete every object the pool holds or is to delete
+    void destroy();
+
+    // the free buffers kept for reuse at most, in bytes
+    void setMaxPooledBytes(size_t bytes);
+    size_t getPooledBytes() const;
+    // the buffers and vertex arrays recycle() has yet to delete
+    size_t getPendingDeletions() const;
+};
@@ -0,0 +1,372 @@
+#include "chunkcomputemesher.h"
+#include "scene/block.h"
+#include <QFile>
+#include <QTextStream>
+#include <QOpenGLContext>
+#include <array>
+#include <cstring>
+#include <iostream>
+
+// 4 vertices of 2 words per quad
+static const size_t quadBytes = 8 * sizeof(uint32_t);
+// the counters of glsl/chunkmesh.comp.glsl: 16 sections per pass, then
+// the animatable faces of each pass
+static const int counterCount = 34;
+
+ChunkComputeMesher::ChunkComputeMesher(OpenGLContext *context)
+    : mp_context(context), mp_arena(nullptr),
+      m_countProgram(0), m_emitProgram(0), m_blockTable(0),
+      m_created(false), m_pendingChunks(), m_volume()
+{}
+
+ChunkComputeMesher::~ChunkComputeMesher()
+{}
+
+/**
+ * @brief ChunkComputeMesher::create
+ *  The block table holds what the mesher reads of Block: the flags of
+ *  each type, the texture layer of each of its faces, and the corners of
+ *  the unit faces, the same for every type.
+ * @param arena : created
+ * @return whether the backend can be used
+ */
+bool ChunkComputeMesher::create(ChunkMeshArena *arena)
+{
+    QSurfaceFormat format = mp_context->context()->format();
+    if (format.version() < qMakePair(4, 3)) {
+        std::cout << "Compute meshing backend needs GL 4.3, context is "
+                  << format.majorVersion() << "." << format.minorVersion() << std::endl;
+        return false;
+    }
+    if (arena == nullptr || !arena->isCreated()) {
+        return false;
+    }
+
+    QString source;
+    QFile file(":/glsl/chunkmesh.comp.glsl");
+    if (file.open(QFile::ReadOnly)) {
+        QTextStream in(&file);
+        source = in.readAll();
+    }
+    if (source.isEmpty()) {
+        return false;
+    }
+
+    m_countProgram = compileProgram(source, "#define CHUNKMESH_COUNT\n");
+    m_emitProgram  = compileProgram(source, "");
+    if (m_countProgram == 0 || m_emitProgram == 0) {
+        destroy();
+        return false;
+    }
+
+    std::vector<GLuint> table(256 + 256 * 6 + 6 * 4, 0);
+    for (int type = 0; type < 256; type++) {
+        BlockType blockType = static_cast<BlockType>(type);
+        table[type] = (Block::isOpaque(blockType) ? 1u : 0u) | (Block::isAnimatable(blockType) ? 2u : 0u)
+                | (static_cast<GLuint>(Block::getEmission(blockType) & 15) << 2);
+        for (int f = 0; f < 6; f++) {
+            table[256 + type * 6 + f] = static_cast<GLuint>(Block::getFaceLayer(blockType, f));
+        }
+    }
+    const std::array<BlockFace, 6> &unitFaces = Block::getFaces(STONE);
+    for (int f = 0; f < 6; f++) {
+        for (int k = 0; k < 4; k++) {
+            const VertexData &vert = unitFaces[f].vertices[k];
+            glm::ivec3 corner = glm::ivec3(vert.pos);
+            glm::ivec2 uv = glm::ivec2(glm::round((vert.uv - unitFaces[f].vertices[0].uv) * 16.f));
+            table[256 + 256 * 6 + f * 4 + k] = static_cast<GLuint>(corner.x) | (static_cast<GLuint>(corner.y) << 1)
+                    | (static_cast<GLuint>(corner.z) << 2) | (static_cast<GLuint>(uv.x) << 3)
+                    | (static_cast<GLuint>(uv.y) << 4);
+        }
+    }
+    mp_context->glGenBuffers(1, &m_blockTable);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_blockTable);
+    mp_context->glBufferData(GL_SHADER_STORAGE_BUFFER, table.size() * sizeof(GLuint), table.data(), GL_STATIC_DRAW);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    for (GLuint program : {m_countProgram, m_emitProgram}) {
+        mp_context->useProgram(program);
+        mp_context->glUniform1i(mp_context->glGetUniformLocation(program, "u_Blocks"), blockTextureSlot);
+    }
+    mp_context->useProgram(0);
+
+    mp_arena = arena;
+    m_created = true;
+    return true;
+}
+
+/**
+ * @brief ChunkComputeMesher::compileProgram
+ * @param source  : the shader text, starting with its #version line
+ * @param defines : inserted right after the #version line
+ * @return the linked program, or 0 on failure
+ */
+GLuint ChunkComputeMesher::compileProgram(const QString &source, const char *defines)
+{
+    int versionEnd = source.indexOf('\n') + 1;
+    std::string text = (source.left(versionEnd) + defines + source.mid(versionEnd)).toStdString();
+    const char *textPtr = text.c_str();
+
+    GLuint shader = mp_context->glCreateShader(GL_COMPUTE_SHADER);
+    mp_context->glShaderSource(shader, 1, &textPtr, 0);
+    mp_context->glCompileShader(shader);
+
+    GLint compiled;
+    mp_context->glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        mp_context->printShaderInfoLog(shader);
+        mp_context->glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint prog = mp_context->glCreateProgram();
+    mp_context->glAttachShader(prog, shader);
+    mp_context->glLinkProgram(prog);
+    // the program keeps the compiled code
+    mp_context->glDeleteShader(shader);
+
+    GLint linked;
+    mp_context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        mp_context->printLinkInfoLog(prog);
+        mp_context->glDeleteProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+void ChunkComputeMesher::destroy()
+{
+    for (uPtr<PendingChunk> &pending : m_pendingChunks) {
+        release(*pending);
+    }
+    m_pendingChunks.clear();
+
+    if (m_countProgram != 0) {
+        mp_context->glDeleteProgram(m_countProgram);
+        m_countProgram = 0;
+    }
+    if (m_emitProgram != 0) {
+        mp_context->glDeleteProgram(m_emitProgram);
+        m_emitProgram = 0;
+    }
+    if (m_blockTable != 0) {
+        mp_context->glDeleteBuffers(1, &m_blockTable);
+        m_blockTable = 0;
+    }
+    mp_arena = nullptr;
+    m_created = false;
+}
+
+bool ChunkComputeMesher::isCreated() const
+{
+    return m_created;
+}
+
+bool ChunkComputeMesher::hasPendingChunks() const
+{
+    return !m_pendingChunks.empty();
+}
+
+/**
+ * @brief ChunkComputeMesher::release
+ *  Free the pending chunk's GPU objects and the arena ranges it was given
+ *  but never published.
+ * @param pending
+ */
+void ChunkComputeMesher::release(PendingChunk &pending)
+{
+    if (pending.fence != nullptr) {
+        mp_context->glDeleteSync(pending.fence);
+        pending.fence = nullptr;
+    }
+    mp_context->glDeleteTextures(1, &pending.blockTexture);
+    mp_context->glDeleteBuffers(1, &pending.counterBuffer);
+    pending.vbo.discardStaged();
+}
+
+/**
+ * @brief ChunkComputeMesher::submitChunk
+ * @param chunk
+ * @param edit
+ */
+void ChunkComputeMesher::submitChunk(Chunk *chunk, bool edit)
+{
+    cancelChunk(chunk);
+
+    uPtr<PendingChunk> pending = mkU<PendingChunk>(chunk, edit);
+    const int w = Chunk::blockVolumeWidth;
+    m_volume.resize(w * w * 256);
+    pending->opaqueTops.resize(w * w);
+    chunk->copyBlockVolume(m_volume.data(), pending->opaqueTops.data());
+
+    // texel fetches only: no filtering
+    mp_context->glGenTextures(1, &pending->blockTexture);
+    mp_context->glActiveTexture(GL_TEXTURE0 + blockTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, pending->blockTexture);
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    mp_context->glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, w, w, 256, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, m_volume.data());
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, 0);
+
+    std::array<GLuint, counterCount> zeros = {};
+    mp_context->glGenBuffers(1, &pending->counterBuffer);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, pending->counterBuffer);
+    mp_context->glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), zeros.data(), GL_DYNAMIC_READ);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    dispatch(m_countProgram, *pending);
+    mp_context->glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    pending->fence = mp_context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_pendingChunks.push_back(std::move(pending));
+}
+
+/**
+ * @brief ChunkComputeMesher::dispatch
+ *  Work groups are 8 x 8 x 8 blocks; the program is unbound after.
+ * @param program
+ * @param pending
+ */
+void ChunkComputeMesher::dispatch(GLuint program, const PendingChunk &pending)
+{
+    mp_context->glActiveTexture(GL_TEXTURE0 + blockTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, pending.blockTexture);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_blockTable);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, pending.counterBuffer);
+
+    mp_context->useProgram(program);
+    mp_context->glUniform1iv(mp_context->glGetUniformLocation(program, "u_OpaqueTops"),
+                             static_cast<GLsizei>(pending.opaqueTops.size()), pending.opaqueTops.data());
+    mp_context->glDispatchCompute(16 / 8, 256 / 8, 16 / 8);
+    mp_context->useProgram(0);
+
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    mp_context->glBindTexture(GL_TEXTURE_3D, 0);
+    mp_context->glActiveTexture(GL_TEXTURE0);
+}
+
+/**
+ * @brief ChunkComputeMesher::emit
+ *  The counts become each section's first quad, written back as the
+ *  emit pass' cursors; each pass' vertices go into an arena range of
+ *  ChunkVBOdata::slotBytes, bound as that pass' output.
+ * @param pending : its counting pass is done
+ * @return false (nothing allocated) if the arena has no room
+ */
+bool ChunkComputeMesher::emit(PendingChunk &pending)
+{
+    std::array<GLuint, counterCount> counts = {};
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, pending.counterBuffer);
+    void *data = mp_context->glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counts), GL_MAP_READ_BIT);
+    if (data != nullptr) {
+        std::memcpy(counts.data(), data, sizeof(counts));
+        mp_context->glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+
+    ChunkVBOdata &vbo = pending.vbo;
+    std::array<GLuint, counterCount> cursors = {};
+    for (int pass = 0; pass < 2; pass++) {
+        std::array<uint32_t, 17> &starts = pass == 0 ? vbo.sectionQuadStarts : vbo.transparentSectionQuadStarts;
+        uint32_t start = 0;
+        for (int sy = 0; sy < 16; sy++) {
+            starts[sy] = start;
+            cursors[pass * 16 + sy] = start;
+            start += counts[pass * 16 + sy];
+        }
+        starts[16] = start;
+    }
+    vbo.quads = vbo.sectionQuadStarts[16];
+    vbo.transparentQuads = vbo.transparentSectionQuadStarts[16];
+    vbo.animated = counts[32] != 0;
+    vbo.transparentAnimated = counts[33] != 0;
+    // no flood fill here: every section may be seen through
+    vbo.sectionConnectivity.fill(0xFFFFFFFFu);
+    vbo.remeshedSections = 0xFFFF;
+
+    ChunkMeshArena::Range range, transparentRange;
+    if (!mp_arena->allocate(ChunkVBOdata::slotBytes(vbo.quads * quadBytes), range)) {
+        mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return false;
+    }
+    if (!mp_arena->allocate(ChunkVBOdata::slotBytes(vbo.transparentQuads * quadBytes), transparentRange)) {
+        mp_arena->discard(range);
+        mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        return false;
+    }
+    vbo.mp_arena = mp_arena;
+    vbo.range = range;
+    vbo.transparentRange = transparentRange;
+
+    mp_context->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(cursors), cursors.data());
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    // a pass without faces writes nothing: its binding is left empty
+    if (range.size != 0) {
+        mp_context->glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 2, mp_arena->getBuffer(), range.offset, range.size);
+    }
+    if (transparentRange.size != 0) {
+        mp_context->glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, mp_arena->getBuffer(),
+                                      transparentRange.offset, transparentRange.size);
+    }
+    dispatch(m_emitProgram, pending);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, 0);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, 0);
+
+    // the draws read the vertices as attributes
+    mp_context->glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+    mp_context->glDeleteSync(pending.fence);
+    pending.fence = mp_context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    pending.counted = true;
+    return true;
+}
+
+/**
+ * @brief ChunkComputeMesher::cancelChunk
+ * @param chunk
+ * @return
+ */
+bool ChunkComputeMesher::cancelChunk(const Chunk *chunk)
+{
+    for (auto it = m_pendingChunks.begin(); it != m_pendingChunks.end(); ++it) {
+        if ((*it)->chunk == chunk) {
+            release(**it);
+            m_pendingChunks.erase(it);
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief ChunkComputeMesher::collectFinishedChunks
+ *  A chunk whose counting pass is done is emitted, and collected once
+ *  that pass is done too, a tick or two later.
+ * @param out : the finished meshes are appended here
+ */
+void ChunkComputeMesher::collectFinishedChunks(std::vector<ComputedChunkMesh> &out)
+{
+    for (auto it = m_pendingChunks.begin(); it != m_pendingChunks.end();) {
+        PendingChunk &pending = **it;
+        GLenum status = mp_context->glClientWaitSync(pending.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            ++it;
+            continue;
+        }
+        if (!pending.counted && emit(pending)) {
+            ++it;
+            continue;
+        }
+
+        // emitted, or the arena was full: an unstaged, empty mesh
+        if (!pending.counted) {
+            pending.vbo = ChunkVBOdata(pending.chunk);
+        }
+        out.emplace_back(std::move(pending.vbo), pending.edit);
+        release(pending);
+        it = m_pendingChunks.erase(it);
+    }
+}
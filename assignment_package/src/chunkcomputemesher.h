@@ -0,0 +1,95 @@
+#pragma once
+#include "openglcontext.h"
+#include "chunkmesharena.h"
+#include "smartpointerhelp.h"
+#include "scene/chunk.h"
+#include <vector>
+
+// A chunk mesh built by the compute meshing backend
+struct ComputedChunkMesh
+{
+    // staged in the arena, like a VBOWorker's result; empty and unstaged
+    // if the arena had no room, for the CPU to mesh vbo.mp_chunk instead
+    ChunkVBOdata vbo;
+    // submitted for an edit (the fast lane of Terrain::spawnVBOWorker)
+    bool edit;
+
+    ComputedChunkMesh(ChunkVBOdata &&vbo, bool edit)
+        : vbo(std::move(vbo)), edit(edit) {}
+};
+
+// An optional meshing backend that builds chunk meshes in a compute
+// shader (glsl/chunkmesh.comp.glsl) instead of the VBO workers: the main
+// thread only copies a chunk's blocks into a 3D texture, the GPU counts
+// each section's faces, and, once those few counters are read back, writes
+// the faces straight into ranges of the mesh arena. Both passes are fenced
+// and collected by collectFinishedChunks(), so the frame never stalls on
+// the GPU. It needs a GL 4.3 context and the arena, so it lives on the
+// main thread.
+// The meshes are the plain mesher's, with an approximate shading (see
+// the shader), and open sections throughout (no occlusion culling).
+class ChunkComputeMesher {
+private:
+    // a submitted chunk: counting, then emitting once `counted`
+    struct PendingChunk
+    {
+        Chunk *chunk;
+        bool edit;
+        GLuint blockTexture;
+        GLuint counterBuffer;
+        std::vector<GLint> opaqueTops;
+        GLsync fence;
+        bool counted;
+        // the section starts and the arena ranges, once counted
+        ChunkVBOdata vbo;
+
+        PendingChunk(Chunk *chunk, bool edit)
+            : chunk(chunk), edit(edit), blockTexture(0), counterBuffer(0), opaqueTops(),
+              fence(nullptr), counted(false), vbo(chunk) {}
+    };
+
+    OpenGLContext *mp_context;
+    ChunkMeshArena *mp_arena;
+    GLuint m_countProgram;
+    GLuint m_emitProgram;
+    GLuint m_blockTable;
+    bool m_created;
+
+    std::vector<uPtr<PendingChunk>> m_pendingChunks;
+    // the block volume of the chunk being submitted, kept for its memory
+    std::vector<uint8_t> m_volume;
+
+    GLuint compileProgram(const QString &source, const char *defines);
+    // bind the chunk's blocks and tables and dispatch one program over it
+    void dispatch(GLuint program, const PendingChunk &pending);
+    // read the counters, allocate the ranges and emit; false if the arena is full
+    bool emit(PendingChunk &pending);
+    void release(PendingChunk &pending);
+
+public:
+    // the texture unit u_Blocks is read from during a dispatch
+    static const int blockTextureSlot = 11;
+
+    ChunkComputeMesher(OpenGLContext *context);
+    ~ChunkComputeMesher();
+
+    // Compile the programs and upload the block tables; the meshes go
+    // into `arena`. Returns false (and stays unusable) when the context is
+    // older than GL 4.3 or compilation fails.
+    bool create(ChunkMeshArena *arena);
+    // discards the meshes still pending
+    void destroy();
+    bool isCreated() const;
+
+    // Copy the chunk's blocks and dispatch its counting pass; a pending
+    // mesh of the same chunk is superseded. The chunk and its neighbors
+    // must be decorated.
+    void submitChunk(Chunk *chunk, bool edit);
+    // Drop the chunk's pending mesh, if any (it is about to be evicted);
+    // true if there was one
+    bool cancelChunk(const Chunk *chunk);
+    // Append the finished meshes, and the chunks that did not fit in the
+    // arena (see ComputedChunkMesh); never blocks
+    void collectFinishedChunks(std::vector<ComputedChunkMesh> &out);
+    bool hasPendingChunks() const;
+};
@@ -0,0 +1,250 @@
+#include "chunkmesharena.h"
+#include <QOpenGLContext>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+
+// GL 4.4 (ARB_buffer_storage), not in the ES 3 headers Qt wraps
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+typedef void (QOPENGLF_APIENTRYP BufferStorageFunc)(GLenum target, GLsizeiptr size,
+                                                    const void *data, GLbitfield flags);
+
+ChunkMeshArena::ChunkMeshArena(OpenGLContext *context)
+    : mp_context(context), m_buffer(0), m_capacity(0), mp_mapped(nullptr),
+      m_lock(), m_free(), m_used(0), m_released(), m_pending()
+{}
+
+ChunkMeshArena::~ChunkMeshArena()
+{}
+
+/**
+ * @brief ChunkMeshArena::create
+ * @param capacity : bytes, rounded down to the alignment
+ * @return whether the arena can be used
+ */
+bool ChunkMeshArena::create(size_t capacity)
+{
+    capacity -= capacity % alignment;
+    if (capacity == 0) {
+        return false;
+    }
+
+    // only report the errors of the allocation below
+    while (mp_context->glGetError() != GL_NO_ERROR) {}
+
+    mp_context->glGenBuffers(1, &m_buffer);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+
+    // immutable storage that stays mapped while the GPU reads it
+    QSurfaceFormat format = mp_context->context()->format();
+    BufferStorageFunc bufferStorage = nullptr;
+    if (format.version() >= qMakePair(4, 4)) {
+        bufferStorage = reinterpret_cast<BufferStorageFunc>(
+                    mp_context->context()->getProcAddress("glBufferStorage"));
+    }
+    if (bufferStorage != nullptr) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        bufferStorage(GL_ARRAY_BUFFER, capacity, nullptr, flags);
+        mp_mapped = static_cast<char*>(mp_context->glMapBufferRange(GL_ARRAY_BUFFER, 0, capacity, flags));
+    } else {
+        mp_context->glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_DYNAMIC_DRAW);
+    }
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    if (mp_context->glGetError() != GL_NO_ERROR || (bufferStorage != nullptr && mp_mapped == nullptr)) {
+        std::cout << "Chunk mesh arena of " << capacity << " bytes could not be allocated" << std::endl;
+        destroy();
+        return false;
+    }
+
+    m_capacity = capacity;
+    m_free.clear();
+    m_free[0] = capacity;
+    m_used = 0;
+    return true;
+}
+
+void ChunkMeshArena::destroy()
+{
+    for (PendingRelease &pending : m_pending) {
+        mp_context->glDeleteSync(pending.fence);
+    }
+    m_pending.clear();
+    m_released.clear();
+
+    if (m_buffer != 0) {
+        if (mp_mapped != nullptr) {
+            mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+            mp_context->glUnmapBuffer(GL_ARRAY_BUFFER);
+            mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        mp_context->glDeleteBuffers(1, &m_buffer);
+    }
+    m_buffer = 0;
+    mp_mapped = nullptr;
+
+    m_lock.lock();
+    m_free.clear();
+    m_used = 0;
+    m_capacity = 0;
+    m_lock.unlock();
+}
+
+bool ChunkMeshArena::isCreated() const
+{
+    return m_capacity != 0;
+}
+
+bool ChunkMeshArena::isMapped() const
+{
+    return mp_mapped != nullptr;
+}
+
+GLuint ChunkMeshArena::getBuffer() const
+{
+    return m_buffer;
+}
+
+/**
+ * @brief ChunkMeshArena::allocate
+ *  First fit: chunk meshes are similar in size, so the lowest free range
+ *  that fits keeps the arena packed towards its start.
+ * @param bytes
+ * @param range : set on success
+ * @return
+ */
+bool ChunkMeshArena::allocate(size_t bytes, Range &range)
+{
+    if (bytes == 0) {
+        range = Range{0, 0};
+        return true;
+    }
+    size_t size = (bytes + alignment - 1) / alignment * alignment;
+
+    m_lock.lock();
+    for (auto it = m_free.begin(); it != m_free.end(); ++it) {
+        if (it->second < size) {
+            continue;
+        }
+        size_t offset = it->first;
+        size_t remaining = it->second - size;
+        m_free.erase(it);
+        if (remaining > 0) {
+            m_free[offset + size] = remaining;
+        }
+        m_used += size;
+        m_lock.unlock();
+
+        range = Range{offset, size};
+        return true;
+    }
+    m_lock.unlock();
+    return false;
+}
+
+/**
+ * @brief ChunkMeshArena::write
+ * @param range : as allocated
+ * @param data
+ * @param bytes : at most range.size
+ */
+void ChunkMeshArena::write(const Range &range, const void *data, size_t bytes)
+{
+    if (bytes == 0) {
+        return;
+    }
+    if (mp_mapped != nullptr) {
+        std::memcpy(mp_mapped + range.offset, data, bytes);
+        return;
+    }
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_buffer);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, range.offset, bytes, data);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void ChunkMeshArena::discard(const Range &range)
+{
+    if (range.size == 0) {
+        return;
+    }
+    m_lock.lock();
+    freeRange(range);
+    m_lock.unlock();
+}
+
+void ChunkMeshArena::release(const Range &range)
+{
+    if (range.size != 0) {
+        m_released.push_back(range);
+    }
+}
+
+void ChunkMeshArena::recycle()
+{
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        GLenum status = mp_context->glClientWaitSync(it->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            ++it;
+            continue;
+        }
+        mp_context->glDeleteSync(it->fence);
+        m_lock.lock();
+        for (const Range &range : it->ranges) {
+            freeRange(range);
+        }
+        m_lock.unlock();
+        it = m_pending.erase(it);
+    }
+
+    if (!m_released.empty()) {
+        PendingRelease pending;
+        pending.fence = mp_context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        pending.ranges.swap(m_released);
+        m_pending.push_back(std::move(pending));
+    }
+}
+
+/**
+ * @brief ChunkMeshArena::freeRange
+ *  Merges the range with the free ranges right before and after it.
+ * @param range
+ */
+void ChunkMeshArena::freeRange(const Range &range)
+{
+    size_t offset = range.offset;
+    size_t size = range.size;
+    m_used -= size;
+
+    auto next = m_free.lower_bound(offset);
+    if (next != m_free.end() && next->first == offset + size) {
+        size += next->second;
+        next = m_free.erase(next);
+    }
+    if (next != m_free.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            prev->second += size;
+            return;
+        }
+    }
+    m_free[offset] = size;
+}
+
+size_t ChunkMeshArena::bytesUsed() const
+{
+    m_lock.lock();
+    size_t used = m_used;
+    m_lock.unlock();
+    return used;
+}
+
+size_t ChunkMeshArena::capacity() const
+{
+    return m_capacity;
+}
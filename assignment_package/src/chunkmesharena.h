@@ -0,0 +1,82 @@
+#pragma once
+#include "openglcontext.h"
+#include <QMutex>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// One large vertex buffer that every chunk mesh is sub-allocated from, so
+// uploading a mesh is a copy into a free range instead of a buffer
+// allocation. With GL 4.4 the buffer is persistently mapped and the VBO
+// workers copy their meshes in themselves; the main thread only publishes
+// the ranges. Otherwise the main thread copies with glBufferSubData.
+// A released range may still be read by draws in flight, so it is only
+// reused after a fence issued past those draws has signaled.
+class ChunkMeshArena {
+public:
+    // a byte range of the buffer; size 0 holds nothing
+    struct Range
+    {
+        size_t offset;
+        size_t size;
+    };
+
+private:
+    // ranges released since the last recycle() and the ones waiting on a fence
+    struct PendingRelease
+    {
+        GLsync fence;
+        std::vector<Range> ranges;
+    };
+
+    OpenGLContext *mp_context;
+    GLuint m_buffer;
+    size_t m_capacity;
+    // the persistent mapping, or null
+    char *mp_mapped;
+
+    // guards m_free and m_used; allocate() may be called by workers
+    mutable QMutex m_lock;
+    // free ranges by offset, never adjacent (they are merged)
+    std::map<size_t, size_t> m_free;
+    size_t m_used;
+
+    std::vector<Range> m_released;
+    std::vector<PendingRelease> m_pending;
+
+    // return the range to m_free; m_lock held
+    void freeRange(const Range &range);
+
+public:
+    // the allocation granularity
+    static const size_t alignment = 256;
+
+    ChunkMeshArena(OpenGLContext *context);
+    ~ChunkMeshArena();
+
+    // Allocate the buffer, mapped persistently when GL 4.4 is available.
+    // Returns false (and stays unusable) if the buffer cannot be allocated.
+    bool create(size_t capacity);
+    // no worker may still be writing to the mapping
+    void destroy();
+    bool isCreated() const;
+    bool isMapped() const;
+    GLuint getBuffer() const;
+
+    // A free range of at least `bytes`, or false if there is none.
+    // Thread-safe.
+    bool allocate(size_t bytes, Range &range);
+    // return a range that was never published to a draw; thread-safe
+    void discard(const Range &range);
+    // copy `bytes` (at most range.size) of data to the start of the range:
+    // from any thread when mapped, otherwise on the main thread only
+    void write(const Range &range, const void *data, size_t bytes);
+    // main thread: the range is reused once the draws issued so far are done
+    void release(const Range &range);
+    // main thread, once per tick: free the ranges whose fence has
+    // signaled, then fence the ones released since the last call
+    void recycle();
+
+    size_t bytesUsed() const;
+    size_t capacity() const;
+};
@@ -0,0 +1,112 @@
+#include "chunkmultidraw.h"
+#include "shaderprogram.h"
+#include <QOpenGLContext>
+#include <iostream>
+
+// GL 4.3 / ES 3.1, in case the headers Qt wraps predate them
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+ChunkMultiDraw::ChunkMultiDraw(OpenGLContext *context)
+    : mp_context(context), m_multiDrawElementsIndirect(nullptr),
+      m_vao(0), m_commandBuffer(0), m_originBuffer(0)
+{}
+
+ChunkMultiDraw::~ChunkMultiDraw()
+{}
+
+/**
+ * @brief ChunkMultiDraw::create
+ * @param vertexBuffer : the ChunkMeshArena's buffer
+ * @return whether draw() can be used
+ */
+bool ChunkMultiDraw::create(GLuint vertexBuffer)
+{
+    QSurfaceFormat format = mp_context->context()->format();
+    if (format.version() < qMakePair(4, 3)) {
+        return false;
+    }
+    m_multiDrawElementsIndirect = reinterpret_cast<MultiDrawElementsIndirectFunc>(
+                mp_context->context()->getProcAddress("glMultiDrawElementsIndirect"));
+    if (m_multiDrawElementsIndirect == nullptr) {
+        std::cout << "glMultiDrawElementsIndirect is missing from the GL 4.3 context" << std::endl;
+        return false;
+    }
+
+    mp_context->glGenBuffers(1, &m_commandBuffer);
+    mp_context->glGenBuffers(1, &m_originBuffer);
+    mp_context->glGenVertexArrays(1, &m_vao);
+
+    GLint previous = 0;
+    mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+    mp_context->glBindVertexArray(m_vao);
+
+    // the packed vertices, from the start of the arena (see Chunk::setUpVAOs)
+    GLuint packed = ShaderProgram::packedAttribLocation;
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    mp_context->glEnableVertexAttribArray(packed);
+    mp_context->glVertexAttribIPointer(packed, 2, GL_UNSIGNED_INT, 2 * sizeof(GLuint), (void*)0);
+
+    // one origin per command
+    GLuint origin = ShaderProgram::chunkOriginAttribLocation;
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_originBuffer);
+    mp_context->glEnableVertexAttribArray(origin);
+    mp_context->glVertexAttribIPointer(origin, 2, GL_INT, sizeof(glm::ivec2), (void*)0);
+    mp_context->glVertexAttribDivisor(origin, 1);
+
+    mp_context->glBindVertexArray(previous);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    return true;
+}
+
+void ChunkMultiDraw::destroy()
+{
+    if (m_vao != 0) {
+        mp_context->glDeleteVertexArrays(1, &m_vao);
+        mp_context->glDeleteBuffers(1, &m_commandBuffer);
+        mp_context->glDeleteBuffers(1, &m_originBuffer);
+    }
+    m_vao = 0;
+    m_commandBuffer = 0;
+    m_originBuffer = 0;
+    m_multiDrawElementsIndirect = nullptr;
+}
+
+bool ChunkMultiDraw::isCreated() const
+{
+    return m_vao != 0;
+}
+
+/**
+ * @brief ChunkMultiDraw::draw
+ *  Both buffers are respecified (orphaned) each call, so a pass never
+ *  waits on the previous one still reading them.
+ * @param commands
+ * @param origins
+ * @param indexBuffer : the shared quad element buffer
+ */
+void ChunkMultiDraw::draw(const std::vector<Command> &commands, const std::vector<glm::ivec2> &origins,
+                          GLuint indexBuffer)
+{
+    if (commands.empty()) {
+        return;
+    }
+
+    GLint previous = 0;
+    mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+    mp_context->glBindVertexArray(m_vao);
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_originBuffer);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, origins.size() * sizeof(glm::ivec2), origins.data(), GL_STREAM_DRAW);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mp_context->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer);
+    mp_context->glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(Command), commands.data(), GL_STREAM_DRAW);
+    m_multiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr,
+                                static_cast<GLsizei>(commands.size()), sizeof(Command));
+    mp_context->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    mp_context->glBindVertexArray(previous);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "openglcontext.h"
+#include "glm_includes.h"
+#include <vector>
+
+// Submits every chunk mesh of a pass that lives in the ChunkMeshArena with
+// one glMultiDrawElementsIndirect (GL 4.3). Each chunk is one command:
+// its quads start baseVertex vertices into the arena, and its origin is
+// the instanced attribute vs_ChunkOrigin, fetched at baseInstance.
+class ChunkMultiDraw {
+public:
+    // the layout glMultiDrawElementsIndirect reads
+    struct Command
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+private:
+    typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirectFunc)(GLenum mode, GLenum type,
+                                                                   const void *indirect,
+                                                                   GLsizei drawcount, GLsizei stride);
+
+    OpenGLContext *mp_context;
+    MultiDrawElementsIndirectFunc m_multiDrawElementsIndirect;
+    // reads the arena's buffer and m_originBuffer
+    GLuint m_vao;
+    GLuint m_commandBuffer;
+    GLuint m_originBuffer;
+
+public:
+    ChunkMultiDraw(OpenGLContext *context);
+    ~ChunkMultiDraw();
+
+    // Set up the VAO over the arena's vertex buffer. Needs a current
+    // GL 4.3 context; returns false (and stays unusable) otherwise.
+    bool create(GLuint vertexBuffer);
+    void destroy();
+    bool isCreated() const;
+
+    // One command and origin (x, z) per chunk, in the same order. The
+    // terrain program must be in use; the VAO bound before is bound again.
+    void draw(const std::vector<Command> &commands, const std::vector<glm::ivec2> &origins,
+              GLuint indexBuffer);
+};
@@ -0,0 +1,240 @@
+#include "clusteredlights.h"
+#include <algorithm>
+#include <cmath>
+
+ClusteredLights::ClusteredLights(OpenGLContext *context)
+    : mp_context(context), m_buffer(0), m_clusterTexture(0), m_indexTexture(0), m_indexRows(0),
+      m_created(false), m_block(), m_clusters(tilesX * tilesY * slices), m_indices(), m_extents(),
+      m_droppedIndices(0)
+{
+    m_block.grid = glm::ivec4(tilesX, tilesY, slices, 0);
+    m_block.depth = glm::vec4(1.f, 1.f, clusterNear, slices / std::log(clusterFar / clusterNear));
+}
+
+void ClusteredLights::create() {
+    mp_context->glGenBuffers(1, &m_buffer);
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    mp_context->glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &m_block, GL_DYNAMIC_DRAW);
+    mp_context->glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, m_buffer);
+
+    // integer textures are fetched, never filtered
+    mp_context->glActiveTexture(GL_TEXTURE0 + clusterTextureSlot);
+    mp_context->glGenTextures(1, &m_clusterTexture);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_clusterTexture);
+    mp_context->glTexImage3D(GL_TEXTURE_3D, 0, GL_RG32UI, tilesX, tilesY, slices, 0, GL_RG_INTEGER,
+                             GL_UNSIGNED_INT, nullptr);
+    mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    mp_context->glActiveTexture(GL_TEXTURE0 + indexTextureSlot);
+    mp_context->glGenTextures(1, &m_indexTexture);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_indexTexture);
+    m_indexRows = 1;
+    mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, indexWidth, m_indexRows, 0, GL_RED_INTEGER,
+                             GL_UNSIGNED_SHORT, nullptr);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    m_created = true;
+}
+
+void ClusteredLights::destroy() {
+    if (m_created) {
+        mp_context->glDeleteBuffers(1, &m_buffer);
+        mp_context->glDeleteTextures(1, &m_clusterTexture);
+        mp_context->glDeleteTextures(1, &m_indexTexture);
+        m_buffer = m_clusterTexture = m_indexTexture = 0;
+        m_indexRows = 0;
+        m_created = false;
+    }
+}
+
+bool ClusteredLights::isCreated() const {
+    return m_created;
+}
+
+// the slice holding the view depth
+static int sliceOf(float depth, float slicesPerLog)
+{
+    if (depth <= ClusteredLights::clusterNear) {
+        return 0;
+    }
+    int slice = static_cast<int>(std::log(depth / ClusteredLights::clusterNear) * slicesPerLog);
+    return std::min(slice, ClusteredLights::slices - 1);
+}
+
+/**
+ * @brief ClusteredLights::findExtent
+ *  The tiles are those the sphere's box covers on the screen; where the
+ *  box reaches behind the eye its projection is unbounded, so a light that
+ *  close covers every tile, which only costs the slices it spans.
+ * @param light
+ * @param viewProj
+ * @param extent : out
+ * @return
+ */
+bool ClusteredLights::findExtent(const PointLight &light, const glm::mat4 &viewProj, Extent &extent)
+{
+    // a perspective projection's w is the view depth
+    float depth = (viewProj * glm::vec4(light.position, 1.f)).w;
+    if (depth + light.radius <= 0.f) {
+        return false;
+    }
+    float slicesPerLog = slices / std::log(clusterFar / clusterNear);
+    extent.minSlice = sliceOf(depth - light.radius, slicesPerLog);
+    extent.maxSlice = sliceOf(depth + light.radius, slicesPerLog);
+
+    glm::vec2 ndcMin(1.f), ndcMax(-1.f);
+    bool behind = false;
+    for (int corner = 0; corner < 8 && !behind; corner++) {
+        glm::vec3 offset((corner & 1) ? light.radius : -light.radius,
+                         (corner & 2) ? light.radius : -light.radius,
+                         (corner & 4) ? light.radius : -light.radius);
+        glm::vec4 clip = viewProj * glm::vec4(light.position + offset, 1.f);
+        if (clip.w <= 0.01f) {
+            behind = true;
+            break;
+        }
+        glm::vec2 ndc = glm::vec2(clip) / clip.w;
+        ndcMin = glm::min(ndcMin, ndc);
+        ndcMax = glm::max(ndcMax, ndc);
+    }
+    if (behind) {
+        extent.minTile = glm::ivec2(0);
+        extent.maxTile = glm::ivec2(tilesX - 1, tilesY - 1);
+        return true;
+    }
+    if (ndcMax.x < -1.f || ndcMax.y < -1.f || ndcMin.x > 1.f || ndcMin.y > 1.f) {
+        return false;
+    }
+    glm::vec2 tiles(tilesX, tilesY);
+    extent.minTile = glm::clamp(glm::ivec2(glm::floor((ndcMin * 0.5f + 0.5f) * tiles)), glm::ivec2(0),
+                                glm::ivec2(tilesX - 1, tilesY - 1));
+    extent.maxTile = glm::clamp(glm::ivec2(glm::floor((ndcMax * 0.5f + 0.5f) * tiles)), glm::ivec2(0),
+                                glm::ivec2(tilesX - 1, tilesY - 1));
+    return true;
+}
+
+/**
+ * @brief ClusteredLights::update
+ *  Two passes over the lights: the first counts each cluster's, whose sums
+ *  give every cluster its range of the index list, the second fills it.
+ *  The lists past the index texture's largest size are cut short, the
+ *  farthest clusters first.
+ */
+void ClusteredLights::update(const std::vector<PointLight> &lights, const glm::mat4 &viewProj, int width,
+                             int height)
+{
+    if (!m_created) {
+        return;
+    }
+    // past maxLights, the nearest
+    std::vector<const PointLight*> kept;
+    kept.reserve(lights.size());
+    for (const PointLight &light : lights) {
+        kept.push_back(&light);
+    }
+    if (kept.size() > static_cast<size_t>(maxLights)) {
+        auto depthOf = [&viewProj](const PointLight *light) {
+            return (viewProj * glm::vec4(light->position, 1.f)).w;
+        };
+        std::nth_element(kept.begin(), kept.begin() + maxLights, kept.end(),
+                         [&depthOf](const PointLight *a, const PointLight *b) {
+            return std::abs(depthOf(a)) < std::abs(depthOf(b));
+        });
+        kept.resize(maxLights);
+    }
+
+    std::fill(m_clusters.begin(), m_clusters.end(), glm::uvec2(0));
+    m_extents.clear();
+    int count = 0;
+    for (const PointLight *light : kept) {
+        Extent extent;
+        if (!findExtent(*light, viewProj, extent)) {
+            continue;
+        }
+        m_block.positions[count] = glm::vec4(light->position, light->radius);
+        m_block.colors[count] = glm::vec4(light->color, 0.f);
+        m_extents.push_back(extent);
+        count++;
+        for (int s = extent.minSlice; s <= extent.maxSlice; s++) {
+            for (int y = extent.minTile.y; y <= extent.maxTile.y; y++) {
+                for (int x = extent.minTile.x; x <= extent.maxTile.x; x++) {
+                    m_clusters[x + tilesX * (y + tilesY * s)].y++;
+                }
+            }
+        }
+    }
+
+    // the slices are the outer index: the near clusters come first
+    size_t capacity = static_cast<size_t>(indexWidth) * maxIndexRows;
+    size_t total = 0;
+    m_droppedIndices = 0;
+    for (glm::uvec2 &cluster : m_clusters) {
+        size_t fits = std::min<size_t>(cluster.y, capacity - total);
+        m_droppedIndices += cluster.y - fits;
+        cluster = glm::uvec2(static_cast<unsigned int>(total), static_cast<unsigned int>(fits));
+        total += fits;
+    }
+    m_indices.assign(std::max<size_t>(total, 1), 0);
+    std::vector<unsigned int> filled(m_clusters.size(), 0);
+    for (int i = 0; i < count; i++) {
+        const Extent &extent = m_extents[i];
+        for (int s = extent.minSlice; s <= extent.maxSlice; s++) {
+            for (int y = extent.minTile.y; y <= extent.maxTile.y; y++) {
+                for (int x = extent.minTile.x; x <= extent.maxTile.x; x++) {
+                    size_t c = x + tilesX * (y + tilesY * s);
+                    if (filled[c] < m_clusters[c].y) {
+                        m_indices[m_clusters[c].x + filled[c]++] = static_cast<uint16_t>(i);
+                    }
+                }
+            }
+        }
+    }
+
+    m_block.grid.w = count;
+    m_block.depth.x = static_cast<float>(width);
+    m_block.depth.y = static_cast<float>(height);
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    // the lights past count are never read
+    mp_context->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &m_block);
+
+    // through their own slots, to leave the others' bindings alone
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+    mp_context->glActiveTexture(GL_TEXTURE0 + clusterTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_clusterTexture);
+    mp_context->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, tilesX, tilesY, slices, GL_RG_INTEGER, GL_UNSIGNED_INT,
+                                m_clusters.data());
+    int rows = static_cast<int>((m_indices.size() + indexWidth - 1) / indexWidth);
+    m_indices.resize(static_cast<size_t>(rows) * indexWidth, 0);
+    mp_context->glActiveTexture(GL_TEXTURE0 + indexTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_indexTexture);
+    if (rows > m_indexRows) {
+        m_indexRows = rows;
+        mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, indexWidth, m_indexRows, 0, GL_RED_INTEGER,
+                                 GL_UNSIGNED_SHORT, nullptr);
+    }
+    mp_context->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, indexWidth, rows, GL_RED_INTEGER, GL_UNSIGNED_SHORT,
+                                m_indices.data());
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+void ClusteredLights::bindToTextureSlots() {
+    mp_context->glActiveTexture(GL_TEXTURE0 + clusterTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_clusterTexture);
+    mp_context->glActiveTexture(GL_TEXTURE0 + indexTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_indexTexture);
+}
+
+void ClusteredLights::setSamplers(ShaderProgram &program) {
+    program.useMe();
+    mp_context->glUniform1i(program.uniformLocation("u_Clusters"), clusterTextureSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_LightIndices"), indexTextureSlot);
+}
+
+int ClusteredLights::getLightCount() const {
+    return m_block.grid.w;
+}
+
+size_t ClusteredLights::getDroppedIndices() const {
+    return m_droppedIndices;
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "glm_includes.h"
+#include "openglcontext.h"
+#include "scene/pointlight.h"
+#include "shaderprogram.h"
+#include <array>
+#include <vector>
+
+// The point lights of the terrain (see Terrain::collectLights), sorted once
+// a frame into a grid of clusters over the view: tilesX x tilesY tiles of
+// the screen, each cut into slices along the view depth, exponentially
+// thicker away from the eye. A terrain fragment (lambert.frag.glsl) reads
+// its cluster and loops only over the lights that reach into it, so a lava
+// lake's dozens of lights cost each pixel the few near it.
+// The lights go in a uniform buffer tied to bindingPoint, each cluster's
+// (first index, count) in a 3D texture and the index lists in a 2D one,
+// indexWidth indices a row.
+// Main thread only, with the context current.
+class ClusteredLights {
+public:
+    // The block's name in the shaders, and its binding point
+    static constexpr const char *blockName = "PointLights";
+    static const GLuint bindingPoint = 1;
+    // the lights drawn, at most: the nearest are kept
+    static const int maxLights = 256;
+    // the grid
+    static const int tilesX = 16;
+    static const int tilesY = 9;
+    static const int slices = 24;
+    // the view depths the slices cover; nearer is the first slice, farther the last
+    static constexpr float clusterNear = 1.f;
+    static constexpr float clusterFar = 160.f;
+    // the indices a row of the index texture holds, and the rows at most
+    static const int indexWidth = 1024;
+    static const int maxIndexRows = 64;
+    // the texture units the clusters and their index lists are read from
+    static const int clusterTextureSlot = 17;
+    static const int indexTextureSlot = 18;
+
+private:
+    // The block's std140 layout
+    struct Block {
+        // xyz, and the radius in w
+        std::array<glm::vec4, maxLights> positions;
+        std::array<glm::vec4, maxLights> colors;
+        // tilesX, tilesY, slices, the lights
+        glm::ivec4 grid;
+        // the target's pixels, clusterNear, and slices per log of depth
+        glm::vec4 depth;
+    };
+    static_assert(sizeof(Block) == maxLights * 32 + 32,
+                  "ClusteredLights::Block must match the std140 layout of the GLSL block");
+
+    OpenGLContext *mp_context;
+    GLuint m_buffer;
+    GLuint m_clusterTexture;
+    GLuint m_indexTexture;
+    // the rows the index texture has room for
+    int m_indexRows;
+    bool m_created;
+
+    Block m_block;
+    // per cluster, (first index, count)
+    std::vector<glm::uvec2> m_clusters;
+    std::vector<uint16_t> m_indices;
+    // the lights' cluster ranges, for the two passes over them
+    struct Extent
+    {
+        glm::ivec2 minTile;
+        glm::ivec2 maxTile;
+        int minSlice;
+        int maxSlice;
+    };
+    std::vector<Extent> m_extents;
+    // the indices that did not fit in the index texture last frame
+    size_t m_droppedIndices;
+
+    // the clusters the light's sphere touches; false if none
+    static bool findExtent(const PointLight &light, const glm::mat4 &viewProj, Extent &extent);
+
+public:
+    explicit ClusteredLights(OpenGLContext *context);
+
+    ClusteredLights(const ClusteredLights&) = delete;
+    ClusteredLights &operator=(const ClusteredLights&) = delete;
+
+    // Initialize the buffer and the textures, and bind the buffer to bindingPoint
+    void create();
+    void destroy();
+    bool isCreated() const;
+
+    // Sort the lights into the clusters of the view seen through viewProj,
+    // drawn to a target of width x height pixels, and upload them
+    void update(const std::vector<PointLight> &lights, const glm::mat4 &viewProj, int width, int height);
+    // Bind the textures to their slots, and point the program's samplers at them
+    void bindToTextureSlots();
+    void setSamplers(ShaderProgram &program);
+
+    // the lights of the last update
+    int getLightCount() const;
+    size_t getDroppedIndices() const;
+};
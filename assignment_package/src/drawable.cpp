@@ -97,6 +97,16 @@ void Drawable::generateUV()
     mp_context->glGenBuffers(1, &m_bufUV);
 }
 
+void Drawable::fillBuffer(GLuint &buffer, bool &generated, GLenum target, size_t bytes, const void *data,
+                          BufferUsage usage)
+{
+    if (!generated) {
+        buffer = 0;
+    }
+    mp_context->renderBackend().fillBuffer(buffer, target, bytes, data, usage);
+    generated = true;
+}
+
 bool Drawable::bindIdx()
 {
     if(m_idxGenerated) {
@@ -129,6 +139,16 @@ bool Drawable::bindTransparentData()
     return m_transparentDataGenerated;
 }
 
+size_t Drawable::posOffset()
+{
+    return 0;
+}
+
+size_t Drawable::transparentDataOffset()
+{
+    return 0;
+}
+
 bool Drawable::bindNor()
 {
     if(m_norGenerated){
@@ -217,3 +237,13 @@ void Drawable::pushVec2ToBuffer(std::vector<float> &buf, const glm::vec2 &vec)
         buf.push_back(vec[i]);
     }
 }
+
+void Drawable::pushVec4ToBuffer(ArenaVector<float> &buf, const glm::vec4 &vec)
+{
+    buf.insert(buf.end(), &vec[0], &vec[0] + 4);
+}
+
+void Drawable::pushVec2ToBuffer(ArenaVector<float> &buf, const glm::vec2 &vec)
+{
+    buf.insert(buf.end(), &vec[0], &vec[0] + 2);
+}
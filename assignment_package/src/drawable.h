@@ -1,6 +1,8 @@
 #pragma once
 #include <openglcontext.h>
 #include <glm_includes.h>
+#include "lineararena.h"
+#include "renderbackend.h"
 
 //This defines a class which can be rendered by our shader program.
 //Make any geometry a subclass of ShaderProgram::Drawable in order to render it with the ShaderProgram class.
@@ -56,17 +58,29 @@ public:
     void generateTransparentData();
     void generateTransparentIdx();
 
-    bool bindIdx();
-    bool bindPos();
+    // Generate (if not generated yet) and fill one of the buffers above
+    // through the render backend, e.g. fillBuffer(m_bufPos, m_posGenerated, ...)
+    void fillBuffer(GLuint &buffer, bool &generated, GLenum target, size_t bytes, const void *data,
+                    BufferUsage usage = BufferUsage::immutable);
+
+    virtual bool bindIdx();
+    virtual bool bindPos();
     bool bindNor();
     bool bindCol();
     bool bindUV();
 
-    bool bindTransparentIdx();
-    bool bindTransparentData();
+    virtual bool bindTransparentIdx();
+    virtual bool bindTransparentData();
+
+    // byte offset of the vertices in the buffer bindPos() / bindTransparentData() binds
+    virtual size_t posOffset();
+    virtual size_t transparentDataOffset();
 
     void pushVec4ToBuffer(std::vector<float> &buf, const glm::vec4 &vec);
     void pushVec2ToBuffer(std::vector<float> &buf, const glm::vec2 &vec);
+    // the same, for the buffers rebuilt every frame in its arena
+    void pushVec4ToBuffer(ArenaVector<float> &buf, const glm::vec4 &vec);
+    void pushVec2ToBuffer(ArenaVector<float> &buf, const glm::vec2 &vec);
 };
 
 // A subclass of Drawable that enables the base code to render duplicates of
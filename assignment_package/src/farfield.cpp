@@ -0,0 +1,316 @@
+#include "farfield.h"
+#include "scene/block.h"
+#include "scene/blocksection.h"
+#include "scene/terrain.h"
+#include <algorithm>
+#include <iostream>
+
+// A grid entry: 0 is a brick of nothing, uniformBit | type one type
+// throughout, any other value 1 + the index of its atlas brick
+static const uint32_t uniformBit = 0x80000000u;
+
+static const int atlasBrickCount = FarField::atlasBricksX * FarField::atlasBricksY * FarField::atlasBricksZ;
+
+// a / b rounded down, for the chunks and zones at negative coordinates
+static int floorDiv(int a, int b)
+{
+    return a >= 0 ? a / b : -((-a + b - 1) / b);
+}
+
+static int floorMod(int a, int b)
+{
+    return a - b * floorDiv(a, b);
+}
+
+static int64_t zoneKeyOf(glm::ivec2 corner)
+{
+    return toKey(floorDiv(corner.x, 64) * 64, floorDiv(corner.y, 64) * 64);
+}
+
+FarField::FarField(OpenGLContext *context)
+    : mp_context(context), m_gridTexture(0), m_atlasTexture(0), m_tileTexture(0), m_created(false),
+      m_centerChunk(0), m_windowMin(0), m_centered(false), m_columns(), m_freeBricks(), m_sectionBlocks(),
+      m_queue(), m_queued(), m_zoneColumns(), m_coveredZones()
+{}
+
+bool FarField::create() {
+    // nothing set anywhere (see printGLErrorLog) before the allocations checked below
+    while (mp_context->glGetError() != GL_NO_ERROR) {}
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    // every brick empty until its column is built
+    std::vector<GLuint> emptyGrid(16 * windowChunks * windowChunks, 0);
+    mp_context->glActiveTexture(GL_TEXTURE0 + gridTextureSlot);
+    mp_context->glGenTextures(1, &m_gridTexture);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_gridTexture);
+    mp_context->glTexImage3D(GL_TEXTURE_3D, 0, GL_R32UI, 16, windowChunks, windowChunks,
+                             0, GL_RED_INTEGER, GL_UNSIGNED_INT, emptyGrid.data());
+
+    mp_context->glActiveTexture(GL_TEXTURE0 + atlasTextureSlot);
+    mp_context->glGenTextures(1, &m_atlasTexture);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_atlasTexture);
+    mp_context->glTexImage3D(GL_TEXTURE_3D, 0, GL_R8UI, 16 * atlasBricksX, 16 * atlasBricksY, 16 * atlasBricksZ,
+                             0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, nullptr);
+
+    // the layer of the tile each face of each type shows (see Block::getFaceLayer)
+    std::vector<uint8_t> tiles(6 * 256);
+    for (int type = 0; type < 256; type++) {
+        for (int f = 0; f < 6; f++) {
+            tiles[f + 6 * type] = static_cast<uint8_t>(Block::getFaceLayer(static_cast<BlockType>(type), f));
+        }
+    }
+    mp_context->glActiveTexture(GL_TEXTURE0 + tileTextureSlot);
+    mp_context->glGenTextures(1, &m_tileTexture);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_tileTexture);
+    mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 6, 256, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, tiles.data());
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // integer textures are only ever fetched
+    for (int slot : {gridTextureSlot, atlasTextureSlot}) {
+        mp_context->glActiveTexture(GL_TEXTURE0 + slot);
+        mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        mp_context->glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    mp_context->glActiveTexture(GL_TEXTURE0);
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    m_created = true;
+    if (mp_context->glGetError() != GL_NO_ERROR) {
+        std::cout << "Far field textures could not be allocated" << std::endl;
+        destroy();
+        return false;
+    }
+
+    m_columns.assign(windowChunks * windowChunks, Column{glm::ivec2(0), false, {}});
+    m_freeBricks.resize(atlasBrickCount);
+    // the lowest indices first
+    for (int i = 0; i < atlasBrickCount; i++) {
+        m_freeBricks[i] = atlasBrickCount - 1 - i;
+    }
+    m_sectionBlocks.resize(16 * BlockSection::volume);
+    m_centered = false;
+    return true;
+}
+
+void FarField::destroy() {
+    if (m_created) {
+        m_created = false;
+        mp_context->glDeleteTextures(1, &m_gridTexture);
+        mp_context->glDeleteTextures(1, &m_atlasTexture);
+        mp_context->glDeleteTextures(1, &m_tileTexture);
+    }
+    m_columns.clear();
+    m_freeBricks.clear();
+    std::vector<uint8_t>().swap(m_sectionBlocks);
+    m_queue.clear();
+    m_queued.clear();
+    m_zoneColumns.clear();
+    m_coveredZones.clear();
+    m_centered = false;
+}
+
+bool FarField::isCreated() const {
+    return m_created;
+}
+
+bool FarField::inWindow(glm::ivec2 corner) const {
+    glm::ivec2 chunk = corner / 16;
+    return m_centered && chunk.x >= m_windowMin.x && chunk.x < m_windowMin.x + windowChunks
+            && chunk.y >= m_windowMin.y && chunk.y < m_windowMin.y + windowChunks;
+}
+
+FarField::Column &FarField::columnAt(glm::ivec2 corner) {
+    return m_columns[floorMod(corner.x / 16, windowChunks) + windowChunks * floorMod(corner.y / 16, windowChunks)];
+}
+
+void FarField::update(const Terrain &terrain, const std::vector<glm::ivec2> &corners, float playerX, float playerZ) {
+    if (!m_created) {
+        return;
+    }
+    // the window follows the player's chunk: the columns it leaves are
+    // freed, the slots they held wait for the chunks it enters
+    glm::ivec2 center(floorDiv(static_cast<int>(glm::floor(playerX)), 16),
+                      floorDiv(static_cast<int>(glm::floor(playerZ)), 16));
+    if (!m_centered || center != m_centerChunk) {
+        m_centerChunk = center;
+        m_windowMin = center - windowChunks / 2;
+        m_centered = true;
+        for (Column &column : m_columns) {
+            if (column.built && !inWindow(column.corner)) {
+                releaseColumn(column);
+            }
+        }
+    }
+
+    for (const glm::ivec2 &corner : corners) {
+        if (inWindow(corner) && m_queued.insert(toKey(corner.x, corner.y)).second) {
+            m_queue.push_back(corner);
+        }
+    }
+
+    int built = 0;
+    while (!m_queue.empty() && built < chunksPerUpdate) {
+        glm::ivec2 corner = m_queue.front();
+        m_queue.pop_front();
+        m_queued.erase(toKey(corner.x, corner.y));
+        if (!inWindow(corner)) {
+            continue;
+        }
+        if (!buildColumn(terrain, corner)) {
+            break;
+        }
+        built++;
+    }
+}
+
+/**
+ * @brief FarField::buildColumn
+ *  The chunk's sections as grid entries, the ones holding several types
+ *  copied into atlas bricks. A chunk the terrain no longer holds, or holds
+ *  before it is decorated, keeps the column as it was.
+ * @param terrain
+ * @param corner
+ * @return false if the atlas had too few bricks left for the chunk (its
+ *  column is left empty)
+ */
+bool FarField::buildColumn(const Terrain &terrain, glm::ivec2 corner) {
+    const Chunk *chunk = terrain.findChunk(corner.x, corner.y);
+    if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+        return true;
+    }
+    Column &column = columnAt(corner);
+    releaseColumn(column);
+    column.corner = corner;
+
+    // below every column's sky, no face shows past the near field
+    int buried = 256;
+    for (unsigned int z = 0; z < 16; z++) {
+        for (unsigned int x = 0; x < 16; x++) {
+            buried = std::min(buried, chunk->getOpaqueTop(x, z));
+        }
+    }
+
+    BlockType *blocks = reinterpret_cast<BlockType*>(m_sectionBlocks.data());
+    uint32_t bricked = 0;
+    size_t brickCount = 0;
+    for (int sy = 0; sy < 16; sy++) {
+        if ((sy + 1) * 16 <= buried) {
+            column.entries[sy] = uniformBit | STONE;
+            continue;
+        }
+        BlockType *section = blocks + sy * BlockSection::volume;
+        if (!chunk->copySectionBlocks(sy, section)) {
+            column.entries[sy] = section[0] == EMPTY ? 0u : uniformBit | section[0];
+            continue;
+        }
+        bricked |= 1u << sy;
+        brickCount++;
+    }
+    if (brickCount > m_freeBricks.size()) {
+        column.entries.fill(0);
+        uploadEntries(column);
+        return false;
+    }
+
+    mp_context->glActiveTexture(GL_TEXTURE0 + atlasTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_atlasTexture);
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (int sy = 0; sy < 16; sy++) {
+        if (!(bricked & (1u << sy))) {
+            continue;
+        }
+        uint32_t brick = m_freeBricks.back();
+        m_freeBricks.pop_back();
+        column.entries[sy] = brick + 1;
+        // (y, x, z) in the brick, as BlockSection::localIndex lays it out
+        glm::ivec3 origin(brick % atlasBricksX, (brick / atlasBricksX) % atlasBricksY,
+                          brick / (atlasBricksX * atlasBricksY));
+        origin *= 16;
+        mp_context->glTexSubImage3D(GL_TEXTURE_3D, 0, origin.x, origin.y, origin.z, 16, 16, 16,
+                                    GL_RED_INTEGER, GL_UNSIGNED_BYTE, blocks + sy * BlockSection::volume);
+    }
+    mp_context->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    mp_context->glActiveTexture(GL_TEXTURE0);
+
+    column.built = true;
+    uploadEntries(column);
+    int64_t zoneKey = zoneKeyOf(corner);
+    if (++m_zoneColumns[zoneKey] == 16) {
+        m_coveredZones.insert(zoneKey);
+    }
+    return true;
+}
+
+void FarField::releaseColumn(Column &column) {
+    if (!column.built) {
+        return;
+    }
+    for (uint32_t entry : column.entries) {
+        if (entry != 0 && !(entry & uniformBit)) {
+            m_freeBricks.push_back(entry - 1);
+        }
+    }
+    column.entries.fill(0);
+    column.built = false;
+    uploadEntries(column);
+
+    int64_t zoneKey = zoneKeyOf(column.corner);
+    m_coveredZones.erase(zoneKey);
+    if (--m_zoneColumns[zoneKey] == 0) {
+        m_zoneColumns.erase(zoneKey);
+    }
+}
+
+void FarField::uploadEntries(const Column &column) {
+    mp_context->glActiveTexture(GL_TEXTURE0 + gridTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_gridTexture);
+    mp_context->glTexSubImage3D(GL_TEXTURE_3D, 0, 0, floorMod(column.corner.x / 16, windowChunks),
+                                floorMod(column.corner.y / 16, windowChunks), 16, 1, 1,
+                                GL_RED_INTEGER, GL_UNSIGNED_INT, column.entries.data());
+    mp_context->glActiveTexture(GL_TEXTURE0);
+}
+
+void FarField::draw(ShaderProgram &program, Drawable &quad, const glm::mat4 &viewProj, glm::vec3 eye,
+                    float playerX, float playerZ, int halfGridSize) {
+    if (!m_created || !m_centered) {
+        return;
+    }
+    mp_context->glActiveTexture(GL_TEXTURE0 + gridTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_gridTexture);
+    mp_context->glActiveTexture(GL_TEXTURE0 + atlasTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_3D, m_atlasTexture);
+    mp_context->glActiveTexture(GL_TEXTURE0 + tileTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_tileTexture);
+    mp_context->glActiveTexture(GL_TEXTURE0);
+
+    // the zones Terrain::draw(playerX, ...) draws, in chunks
+    glm::ivec2 zone(floorDiv(static_cast<int>(glm::floor(playerX)), 64),
+                    floorDiv(static_cast<int>(glm::floor(playerZ)), 64));
+    glm::ivec2 nearMin = (zone - halfGridSize) * 4;
+    glm::ivec2 nearMax = (zone + halfGridSize + 1) * 4;
+    glm::ivec2 windowOffset(floorMod(m_windowMin.x, windowChunks), floorMod(m_windowMin.y, windowChunks));
+    glm::mat4 invViewProj = glm::inverse(viewProj);
+
+    program.setMorph(glm::vec2(playerX, playerZ), glm::vec2(0.f));
+    mp_context->glUniformMatrix4fv(program.uniformLocation("u_InvViewProj"), 1, GL_FALSE, &invViewProj[0][0]);
+    mp_context->glUniform3f(program.uniformLocation("u_Eye"), eye.x, eye.y, eye.z);
+    mp_context->glUniform1i(program.uniformLocation("u_Grid"), gridTextureSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_Atlas"), atlasTextureSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_Tiles"), tileTextureSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_WindowChunks"), windowChunks);
+    mp_context->glUniform2i(program.uniformLocation("u_WindowMin"), m_windowMin.x, m_windowMin.y);
+    mp_context->glUniform2i(program.uniformLocation("u_WindowOffset"), windowOffset.x, windowOffset.y);
+    mp_context->glUniform2i(program.uniformLocation("u_NearMin"), nearMin.x, nearMin.y);
+    mp_context->glUniform2i(program.uniformLocation("u_NearMax"), nearMax.x, nearMax.y);
+    mp_context->glUniform3i(program.uniformLocation("u_AtlasBricks"), atlasBricksX, atlasBricksY, atlasBricksZ);
+    program.drawOverlay(quad);
+}
+
+const std::unordered_set<int64_t> &FarField::getCoveredZones() const {
+    return m_coveredZones;
+}
+
+size_t FarField::getBrickCount() const {
+    return m_created ? atlasBrickCount - m_freeBricks.size() : 0;
+}
@@ -0,0 +1,110 @@
+#pragma once
+#include "openglcontext.h"
+#include "glm_includes.h"
+#include "shaderprogram.h"
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Terrain;
+
+// An experimental far field: the generated chunks around the player kept
+// as a brickmap and raymarched in a fragment pass (see
+// glsl/post/farfield.frag.glsl) behind the rasterized chunks, so what is
+// drawn past them costs per pixel rather than per triangle.
+// The map is a toroidal window of windowChunks x windowChunks chunk
+// columns around the player, one 16-block brick per chunk section. A grid
+// texture holds what each brick is: nothing, one block type throughout,
+// or a brick of the atlas texture, which only the sections holding
+// several types take. The sections below a column's lowest surface are
+// never seen past the near field, so they count as solid stone and take
+// no atlas brick.
+// A chunk is (re)built once its mesh is uploaded (see
+// Terrain::takeMeshChanges), and kept after the terrain evicts it for as
+// long as it stays in the window: the far field shows the world as far as
+// it was generated. Chunks are only read on the main thread, a few per
+// update.
+class FarField {
+public:
+    // chunks along each side of the window
+    static const int windowChunks = 48;
+    // bricks along each side of the atlas
+    static const int atlasBricksX = 16;
+    static const int atlasBricksY = 16;
+    static const int atlasBricksZ = 32;
+    // chunks built per update at most
+    static const int chunksPerUpdate = 16;
+
+    // the texture units the pass reads the grid, atlas and face tiles from
+    static const int gridTextureSlot = 8;
+    static const int atlasTextureSlot = 9;
+    static const int tileTextureSlot = 10;
+
+private:
+    // what a window column holds: the chunk it was built from, and its
+    // grid entries (see farfield.cpp) to free its atlas bricks with
+    struct Column
+    {
+        glm::ivec2 corner;
+        bool built;
+        std::array<uint32_t, 16> entries;
+    };
+
+    OpenGLContext *mp_context;
+    GLuint m_gridTexture;
+    GLuint m_atlasTexture;
+    GLuint m_tileTexture;
+    bool m_created;
+
+    // the chunk the window is centered on and its lowest chunk, in
+    // chunks, once an update has placed it
+    glm::ivec2 m_centerChunk;
+    glm::ivec2 m_windowMin;
+    bool m_centered;
+    std::vector<Column> m_columns;
+    std::vector<uint32_t> m_freeBricks;
+    // the blocks of a column's sections while it is built
+    std::vector<uint8_t> m_sectionBlocks;
+    // corners of the chunks to (re)build, oldest first, without repeats
+    std::deque<glm::ivec2> m_queue;
+    std::unordered_set<int64_t> m_queued;
+    // built columns per zone, and the zones all of whose 16 are built
+    std::unordered_map<int64_t, int> m_zoneColumns;
+    std::unordered_set<int64_t> m_coveredZones;
+
+    bool inWindow(glm::ivec2 corner) const;
+    Column &columnAt(glm::ivec2 corner);
+    // rebuild the column from the chunk at corner; false if the atlas is full
+    bool buildColumn(const Terrain &terrain, glm::ivec2 corner);
+    // free the column's bricks and clear its grid entries
+    void releaseColumn(Column &column);
+    void uploadEntries(const Column &column);
+
+public:
+    FarField(OpenGLContext *context);
+
+    // Allocate the textures, empty, and the face tiles from Block's uvs
+    // (loaded by now); false if the driver lacks integer 3D textures
+    bool create();
+    // Deallocate all GPU-side data and forget every brick
+    void destroy();
+    bool isCreated() const;
+
+    // Queue the chunks at these corners (see Terrain::takeMeshChanges) to
+    // be built, recenter the window on the player, dropping the columns
+    // it leaves, and build the oldest queued chunks
+    void update(const Terrain &terrain, const std::vector<glm::ivec2> &corners, float playerX, float playerZ);
+
+    // Raymarch the bricks outside the drawn grid of zones with the far
+    // field program, against the depth of what is drawn already
+    void draw(ShaderProgram &program, Drawable &quad, const glm::mat4 &viewProj, glm::vec3 eye,
+              float playerX, float playerZ, int halfGridSize);
+
+    // the keys (see toKey) of the zones whose 16 chunks are all built,
+    // which the distant terrain may leave out
+    const std::unordered_set<int64_t> &getCoveredZones() const;
+    size_t getBrickCount() const;
+};
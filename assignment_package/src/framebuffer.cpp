@@ -1,11 +1,13 @@
 #include "framebuffer.h"
+#include <algorithm>
 #include <iostream>
 
 FrameBuffer::FrameBuffer(OpenGLContext *context,
                          unsigned int width, unsigned int height, unsigned int devicePixelRatio)
     : mp_context(context), m_frameBuffer(-1),
-      m_outputTexture(-1), m_depthRenderBuffer(-1),
-      m_width(width), m_height(height), m_devicePixelRatio(devicePixelRatio), m_created(false)
+      m_outputTexture(-1), m_depthTexture(-1),
+      m_width(width), m_height(height), m_devicePixelRatio(devicePixelRatio), m_scale(1.f), m_hasDepth(true),
+      m_created(false)
 {}
 
 void FrameBuffer::resize(unsigned int width, unsigned int height, unsigned int devicePixelRatio) {
@@ -14,30 +16,55 @@ void FrameBuffer::resize(unsigned int width, unsigned int height, unsigned int d
     m_devicePixelRatio = devicePixelRatio;
 }
 
+void FrameBuffer::setScale(float scale) {
+    m_scale = scale;
+}
+
+void FrameBuffer::setDepth(bool depth) {
+    m_hasDepth = depth;
+}
+
+unsigned int FrameBuffer::pixelWidth() const {
+    return std::max(1u, static_cast<unsigned int>(m_width * m_devicePixelRatio * m_scale + 0.5f));
+}
+
+unsigned int FrameBuffer::pixelHeight() const {
+    return std::max(1u, static_cast<unsigned int>(m_height * m_devicePixelRatio * m_scale + 0.5f));
+}
+
 void FrameBuffer::create() {
     // Initialize the frame buffers and render textures
     mp_context->glGenFramebuffers(1, &m_frameBuffer);
     mp_context->glGenTextures(1, &m_outputTexture);
-    mp_context->glGenRenderbuffers(1, &m_depthRenderBuffer);
 
     mp_context->glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
     // Bind our texture so that all functions that deal with textures will interact with this one
     mp_context->glBindTexture(GL_TEXTURE_2D, m_outputTexture);
     // Give an empty image to OpenGL ( the last "0" )
-    mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_width * m_devicePixelRatio, m_height * m_devicePixelRatio, 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
+    mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, pixelWidth(), pixelHeight(), 0, GL_RGB, GL_UNSIGNED_BYTE, (void*)0);
 
     // Set the render settings for the texture we've just created.
-    // Essentially zero filtering on the "texture" so it appears exactly as rendered
-    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    // Linear filtering: read at its own size it appears exactly as rendered,
+    // and a scaled buffer is averaged rather than skipped over
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     // Clamp the colors at the edge of our texture
     mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-    // Initialize our depth buffer
-    mp_context->glBindRenderbuffer(GL_RENDERBUFFER, m_depthRenderBuffer);
-    mp_context->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, m_width, m_height);
-    mp_context->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderBuffer);
+    // Initialize our depth buffer, a texture so a later pass can read it;
+    // in floats, which the reversed depth needs (see Camera::setReverseZ)
+    if (m_hasDepth) {
+        mp_context->glGenTextures(1, &m_depthTexture);
+        mp_context->glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+        mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, pixelWidth(), pixelHeight(), 0,
+                                 GL_DEPTH_COMPONENT, GL_FLOAT, (void*)0);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mp_context->glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0);
+    }
 
     // Set m_renderedTexture as the color output of our frame buffer
     mp_context->glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, m_outputTexture, 0);
@@ -61,7 +88,9 @@ void FrameBuffer::destroy() {
         m_created = false;
         mp_context->glDeleteFramebuffers(1, &m_frameBuffer);
         mp_context->glDeleteTextures(1, &m_outputTexture);
-        mp_context->glDeleteRenderbuffers(1, &m_depthRenderBuffer);
+        if (m_hasDepth) {
+            mp_context->glDeleteTextures(1, &m_depthTexture);
+        }
     }
 }
 
@@ -78,3 +107,16 @@ void FrameBuffer::bindToTextureSlot(unsigned int slot) {
 unsigned int FrameBuffer::getTextureSlot() const {
     return m_textureSlot;
 }
+
+void FrameBuffer::bindDepthToTextureSlot(unsigned int slot) {
+    mp_context->glActiveTexture(GL_TEXTURE0 + slot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+}
+
+GLuint FrameBuffer::getDepthTexture() const {
+    return m_depthTexture;
+}
+
+bool FrameBuffer::isCreated() const {
+    return m_created;
+}
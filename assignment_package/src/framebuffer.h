@@ -5,21 +5,26 @@
 // A class representing a frame buffer in the OpenGL pipeline.
 // Stores three GPU handles: one to a frame buffer object, one to
 // a texture object that will store the frame buffer's contents,
-// and one to a depth buffer needed to properly render to the frame
-// buffer.
+// and one to a float depth texture needed to properly render to the
+// frame buffer, which can also be sampled (see TemporalUpsampler).
 // Redirect your render output to a FrameBuffer by invoking
 // bindFrameBuffer() before ShaderProgram::draw, and read
 // from the frame buffer's output texture by invoking
 // bindToTextureSlot() and then associating a ShaderProgram's
 // sampler2d with the appropriate texture slot.
+// A scale other than 1 renders at that fraction of the screen's pixels;
+// the output texture is filtered linearly, so it can be drawn to a
+// target of another size.
 class FrameBuffer {
 private:
     OpenGLContext *mp_context;
     GLuint m_frameBuffer;
     GLuint m_outputTexture;
-    GLuint m_depthRenderBuffer;
+    GLuint m_depthTexture;
 
     unsigned int m_width, m_height, m_devicePixelRatio;
+    float m_scale;
+    bool m_hasDepth;
     bool m_created;
 
     unsigned int m_textureSlot;
@@ -29,6 +34,13 @@ public:
     // Make sure to call resize from MyGL::resizeGL to keep your frame buffer up to date with
     // your screen dimensions
     void resize(unsigned int width, unsigned int height, unsigned int devicePixelRatio);
+    // The fraction of the screen's pixels to render; applies from the next create()
+    void setScale(float scale);
+    // Whether to give the buffer a depth texture, on by default; applies from the next create()
+    void setDepth(bool depth);
+    // The size in pixels of the buffer, to pass to glViewport
+    unsigned int pixelWidth() const;
+    unsigned int pixelHeight() const;
     // Initialize all GPU-side data required
     void create();
     // Deallocate all GPU-side data
@@ -37,4 +49,9 @@ public:
     // Associate our output texture with the indicated texture slot
     void bindToTextureSlot(unsigned int slot);
     unsigned int getTextureSlot() const;
+    // Associate the depth texture with the indicated texture slot; it is read nearest
+    void bindDepthToTextureSlot(unsigned int slot);
+    // The depth texture, for another frame buffer to test against (see TransparencyBuffer)
+    GLuint getDepthTexture() const;
+    bool isCreated() const;
 };
@@ -0,0 +1,230 @@
+#include "framecapture.h"
+#include <QDateTime>
+#include <QDir>
+#include <QImage>
+#include <QStandardPaths>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+FrameCapture::FrameCapture(OpenGLContext *context)
+    : mp_context(context), m_slots(), m_encodes(),
+      m_directory(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)),
+      m_recording(false), m_screenshotPending(false), m_recordingName(), m_recordedFrames(0),
+      m_droppedFrames(0), m_failedWrites(0)
+{
+    for (Slot &slot : m_slots) {
+        slot.buffer = 0;
+        slot.bytes = 0;
+        slot.state = SlotState::free;
+        slot.fence = nullptr;
+        slot.width = 0;
+        slot.height = 0;
+        slot.copied = false;
+    }
+}
+
+/**
+ * @brief encode
+ *  Runs on a worker. The rows come bottom first, as glReadPixels gives
+ *  them, and the alpha of the frame buffer is whatever blending left in
+ *  it, so the image is flipped and made opaque on the way out.
+ * @param pixels : the mapped buffer, width x height BGRA
+ * @param copied : set once pixels is no longer read
+ * @return whether the PNG was written
+ */
+static bool encode(const uchar *pixels, int width, int height, QString path, std::atomic<bool> *copied)
+{
+    QImage image(width, height, QImage::Format_RGB32);
+    for (int y = 0; y < height; y++) {
+        const uint32_t *source = reinterpret_cast<const uint32_t*>(pixels) + static_cast<size_t>(height - 1 - y) * width;
+        QRgb *row = reinterpret_cast<QRgb*>(image.scanLine(y));
+        for (int x = 0; x < width; x++) {
+            row[x] = source[x] | 0xFF000000u;
+        }
+    }
+    copied->store(true, std::memory_order_release);
+    return image.save(path, "PNG");
+}
+
+void FrameCapture::poll()
+{
+    for (size_t i = 0; i < m_encodes.size();) {
+        if (m_encodes[i].wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            i++;
+            continue;
+        }
+        if (!m_encodes[i].get()) {
+            m_failedWrites++;
+        }
+        m_encodes[i] = std::move(m_encodes.back());
+        m_encodes.pop_back();
+    }
+
+    for (Slot &slot : m_slots) {
+        if (slot.state == SlotState::reading) {
+            GLenum status = mp_context->glClientWaitSync(slot.fence, 0, 0);
+            if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+                continue;
+            }
+            mp_context->glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+            mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            const uchar *mapped = static_cast<const uchar*>(mp_context->glMapBufferRange(
+                GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT));
+            mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            if (mapped == nullptr) {
+                m_failedWrites++;
+                slot.state = SlotState::free;
+                continue;
+            }
+            slot.copied = false;
+            slot.state = SlotState::copying;
+            m_encodes.push_back(std::async(std::launch::async, encode, mapped, slot.width, slot.height,
+                                           slot.path, &slot.copied));
+        } else if (slot.state == SlotState::copying && slot.copied.load(std::memory_order_acquire)) {
+            mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            mp_context->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            slot.state = SlotState::free;
+        }
+    }
+}
+
+/**
+ * @brief FrameCapture::read
+ *  The frames waiting on their fences count against the workers too: each
+ *  becomes one.
+ */
+void FrameCapture::read(int width, int height, const QString &path)
+{
+    int pending = static_cast<int>(m_encodes.size());
+    Slot *freeSlot = nullptr;
+    for (Slot &slot : m_slots) {
+        if (slot.state == SlotState::reading) {
+            pending++;
+        } else if (slot.state == SlotState::free && freeSlot == nullptr) {
+            freeSlot = &slot;
+        }
+    }
+    if (freeSlot == nullptr || pending >= maxEncodes) {
+        m_droppedFrames++;
+        return;
+    }
+
+    size_t bytes = static_cast<size_t>(width) * height * 4;
+    if (freeSlot->buffer == 0) {
+        mp_context->glGenBuffers(1, &freeSlot->buffer);
+    }
+    mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, freeSlot->buffer);
+    if (freeSlot->bytes != bytes) {
+        mp_context->glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        freeSlot->bytes = bytes;
+    }
+    mp_context->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    // into the buffer: the call returns before the GPU gets to it
+    mp_context->glReadPixels(0, 0, width, height, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, nullptr);
+    mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    freeSlot->fence = mp_context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    freeSlot->width = width;
+    freeSlot->height = height;
+    freeSlot->path = path;
+    freeSlot->state = SlotState::reading;
+}
+
+void FrameCapture::takeScreenshot()
+{
+    m_screenshotPending = true;
+}
+
+void FrameCapture::toggleRecording()
+{
+    if (m_recording) {
+        m_recording = false;
+        std::cout << "Recorded " << m_recordedFrames << " frames to "
+                  << QDir(m_directory).filePath(m_recordingName).toStdString() << ", dropped "
+                  << m_droppedFrames << std::endl;
+        return;
+    }
+    m_recordingName = QString("recording-%1").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss"));
+    QDir dir(m_directory);
+    if (!dir.mkpath(m_recordingName)) {
+        std::cout << "Could not record to " << dir.filePath(m_recordingName).toStdString() << std::endl;
+        return;
+    }
+    m_recording = true;
+    m_recordedFrames = 0;
+    m_droppedFrames = 0;
+    std::cout << "Recording to " << dir.filePath(m_recordingName).toStdString() << std::endl;
+}
+
+bool FrameCapture::isRecording() const
+{
+    return m_recording;
+}
+
+void FrameCapture::capture(int width, int height)
+{
+    poll();
+    QDir dir(m_directory);
+    if (m_screenshotPending) {
+        m_screenshotPending = false;
+        QString path = dir.filePath(QString("screenshot-%1.png")
+                                    .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz")));
+        if (dir.mkpath(".")) {
+            int dropped = m_droppedFrames;
+            read(width, height, path);
+            if (m_droppedFrames == dropped) {
+                std::cout << "Saving a screenshot to " << path.toStdString() << std::endl;
+            } else {
+                std::cout << "Could not take a screenshot: still saving the last ones" << std::endl;
+            }
+        } else {
+            std::cout << "Could not save a screenshot to " << path.toStdString() << std::endl;
+        }
+    }
+    if (m_recording) {
+        read(width, height, dir.filePath(QString("%1/frame-%2.png").arg(m_recordingName)
+                                         .arg(m_recordedFrames, 6, 10, QChar('0'))));
+        m_recordedFrames++;
+    }
+    if (m_failedWrites > 0) {
+        std::cout << "Could not save " << m_failedWrites << " captured frames" << std::endl;
+        m_failedWrites = 0;
+    }
+}
+
+/**
+ * @brief FrameCapture::destroy
+ *  The frames still on their fences are never saved.
+ */
+void FrameCapture::destroy()
+{
+    for (std::future<bool> &encoded : m_encodes) {
+        encoded.wait();
+    }
+    m_encodes.clear();
+    for (Slot &slot : m_slots) {
+        if (slot.fence != nullptr) {
+            mp_context->glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        if (slot.state == SlotState::copying) {
+            mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer);
+            mp_context->glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            mp_context->glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        }
+        if (slot.buffer != 0) {
+            mp_context->glDeleteBuffers(1, &slot.buffer);
+            slot.buffer = 0;
+        }
+        slot.bytes = 0;
+        slot.state = SlotState::free;
+    }
+    m_recording = false;
+}
+
+int FrameCapture::getDroppedFrames() const
+{
+    return m_droppedFrames;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include "openglcontext.h"
+#include <QString>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <future>
+#include <vector>
+
+// Screenshots and recordings of the frames as shown, read back without
+// stalling: capture() only queues a glReadPixels into a pixel pack buffer
+// of a ring, with a fence after it. A later frame maps the buffer once the
+// fence has passed and hands it to a worker, which copies the pixels out
+// and saves them as a PNG; the buffer goes back to the ring as soon as
+// they are copied. A recording is a numbered PNG sequence, for a video
+// encoder to take. A frame that finds the ring or the workers all busy is
+// dropped rather than waited for.
+// Main thread only, with the context current.
+class FrameCapture {
+public:
+    // the frames read back and not yet copied out, at most
+    static const int ringSize = 4;
+    // the PNGs being written at once, at most
+    static const int maxEncodes = 4;
+
+private:
+    enum class SlotState {
+        free, reading, copying
+    };
+    struct Slot
+    {
+        GLuint buffer;
+        size_t bytes;
+        SlotState state;
+        GLsync fence;
+        int width;
+        int height;
+        QString path;
+        // set by the worker once the pixels are out of the mapped buffer
+        std::atomic<bool> copied;
+    };
+
+    OpenGLContext *mp_context;
+    std::array<Slot, ringSize> m_slots;
+    // the workers; each returns whether its PNG was written
+    std::vector<std::future<bool>> m_encodes;
+    QString m_directory;
+    bool m_recording;
+    // the screenshot asked for, taken with the next frame
+    bool m_screenshotPending;
+    // the recording's name and frames so far
+    QString m_recordingName;
+    int m_recordedFrames;
+    int m_droppedFrames;
+    int m_failedWrites;
+
+    // move the slots whose fences passed to the workers, and those the
+    // workers copied back to the ring
+    void poll();
+    // read the bound framebuffer into a free slot, to be saved at path
+    void read(int width, int height, const QString &path);
+
+public:
+    explicit FrameCapture(OpenGLContext *context);
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture &operator=(const FrameCapture&) = delete;
+
+    // Capture the next frame
+    void takeScreenshot();
+    // Start or stop capturing every frame
+    void toggleRecording();
+    bool isRecording() const;
+    // Once a frame, after it is drawn, with the framebuffer it was drawn
+    // to bound for reading; width x height in pixels
+    void capture(int width, int height);
+    // wait for the workers and free the buffers
+    void destroy();
+
+    int getDroppedFrames() const;
+};
@@ -0,0 +1,77 @@
+#include "frameprofile.h"
+
+// the weight of the newest frame in the averages
+static const float averageWeight = 0.05f;
+
+FrameProfile::FrameProfile()
+    : m_timer(), m_phase(FramePhase::input), m_running(false), m_phaseStart(0),
+      m_frameNs(), m_averageMs(), m_lastBusyMs(0.f)
+{
+    m_frameNs.fill(0);
+    m_averageMs.fill(0.f);
+    m_timer.start();
+}
+
+void FrameProfile::begin(FramePhase phase)
+{
+    end();
+    m_phase = phase;
+    m_running = true;
+    m_phaseStart = m_timer.nsecsElapsed();
+}
+
+void FrameProfile::end()
+{
+    if (m_running) {
+        m_frameNs[static_cast<int>(m_phase)] += m_timer.nsecsElapsed() - m_phaseStart;
+        m_running = false;
+    }
+}
+
+/**
+ * @brief FrameProfile::endFrame
+ *  A phase the frame did not run, e.g. submit when Qt skipped painting,
+ *  counts as 0.
+ */
+void FrameProfile::endFrame()
+{
+    end();
+    m_lastBusyMs = 0.f;
+    for (int i = 0; i < phaseCount; i++) {
+        float ms = m_frameNs[i] / 1e6f;
+        m_averageMs[i] += (ms - m_averageMs[i]) * averageWeight;
+        m_frameNs[i] = 0;
+        if (static_cast<FramePhase>(i) != FramePhase::submit) {
+            m_lastBusyMs += ms;
+        }
+    }
+}
+
+float FrameProfile::getAverageMs(FramePhase phase) const
+{
+    return m_averageMs[static_cast<int>(phase)];
+}
+
+float FrameProfile::getLastBusyMs() const
+{
+    return m_lastBusyMs;
+}
+
+const char *FrameProfile::getName(FramePhase phase)
+{
+    static const char *const names[phaseCount] = {
+        "input", "stream", "simulate", "cull", "shadow", "record", "post", "submit"
+    };
+    return names[static_cast<int>(phase)];
+}
+
+QString FrameProfile::toQString() const
+{
+    QString text;
+    for (int i = 0; i < phaseCount; i++) {
+        FramePhase phase = static_cast<FramePhase>(i);
+        text += QString("%1%2 %3").arg(i == 0 ? "" : ", ").arg(getName(phase))
+                .arg(getAverageMs(phase), 0, 'f', 2);
+    }
+    return text + " ms";
+}
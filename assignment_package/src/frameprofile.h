@@ -0,0 +1,62 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QString>
+#include <array>
+
+/**
+ * The phases of a frame, in the order they run on the main thread:
+ *  input    - the frame time and the inventory's cursor item
+ *  stream   - terrain expansion, finished jobs and GPU uploads
+ *  simulate - the player, then the NPC batch for the next frame
+ *  cull     - the terrain sections in view, once for both draw passes
+ *  shadow   - the sun's shadow cascades that need redrawing (see ShadowMap)
+ *  record   - the draw calls of the scene into the overlay framebuffer
+ *  post     - the post-process pass, HUD, sounds and the debug panel
+ *  submit   - from the end of paintGL until Qt swapped the frame
+ * The NPC threads step through cull, shadow, record, post and submit; stream
+ * waits for them since it adds and drops chunks (see NPCSimulation).
+ */
+enum class FramePhase : unsigned char {
+    input, stream, simulate, cull, shadow, record, post, submit
+};
+
+/**
+ * @brief The FrameProfile class
+ *  The time each phase takes, averaged over the last frames, so a phase
+ *  that grows shows up before the frame rate drops. Main thread only.
+ */
+class FrameProfile
+{
+public:
+    static const int phaseCount = 8;
+
+private:
+    QElapsedTimer m_timer;
+    // the running phase, if any, and its start in ns of m_timer
+    FramePhase m_phase;
+    bool m_running;
+    qint64 m_phaseStart;
+    // this frame's times so far, in ns
+    std::array<qint64, phaseCount> m_frameNs;
+    // exponential moving averages, in ms
+    std::array<float, phaseCount> m_averageMs;
+    // the last frame's phases but submit, in ms
+    float m_lastBusyMs;
+
+public:
+    FrameProfile();
+
+    // end the running phase and start this one
+    void begin(FramePhase phase);
+    void end();
+    // end the running phase and fold the frame into the averages
+    void endFrame();
+
+    float getAverageMs(FramePhase phase) const;
+    // the main thread's own work in the last frame: every phase but
+    // submit, which mostly waits on the GPU and the display
+    float getLastBusyMs() const;
+    static const char *getName(FramePhase phase);
+    // every phase's average, for the debug panel
+    QString toQString() const;
+};
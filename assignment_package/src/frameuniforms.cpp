@@ -0,0 +1,54 @@
+#include "frameuniforms.h"
+
+FrameUniforms::FrameUniforms(OpenGLContext *context)
+    : mp_context(context), m_buffer(0), m_created(false),
+      m_block{glm::mat4(1.f), glm::ivec2(0), 0, 0}, m_dirty(true)
+{}
+
+void FrameUniforms::create() {
+    mp_context->glGenBuffers(1, &m_buffer);
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    mp_context->glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), &m_block, GL_DYNAMIC_DRAW);
+    mp_context->glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, m_buffer);
+    m_created = true;
+    m_dirty = false;
+}
+
+void FrameUniforms::destroy() {
+    if (m_created) {
+        mp_context->glDeleteBuffers(1, &m_buffer);
+        m_buffer = 0;
+        m_created = false;
+    }
+    m_dirty = true;
+}
+
+void FrameUniforms::setViewProj(const glm::mat4 &viewProj) {
+    if (m_block.viewProj != viewProj) {
+        m_block.viewProj = viewProj;
+        m_dirty = true;
+    }
+}
+
+void FrameUniforms::setDimensions(glm::ivec2 dimensions) {
+    if (m_block.dimensions != dimensions) {
+        m_block.dimensions = dimensions;
+        m_dirty = true;
+    }
+}
+
+void FrameUniforms::setTime(int time) {
+    if (m_block.time != time) {
+        m_block.time = time;
+        m_dirty = true;
+    }
+}
+
+void FrameUniforms::upload() {
+    if (!m_created || !m_dirty) {
+        return;
+    }
+    mp_context->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    mp_context->glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &m_block);
+    m_dirty = false;
+}
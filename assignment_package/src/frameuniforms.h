@@ -0,0 +1,50 @@
+#pragma once
+#include "openglcontext.h"
+#include "glm_includes.h"
+
+// The uniforms every ShaderProgram shares within a frame (the camera's
+// view-projection, the screen's dimensions and the time), kept in one
+// uniform buffer object bound to bindingPoint. Each program's
+// FrameUniforms block is tied to that binding point when it is created,
+// so the values are uploaded once a frame rather than once per program.
+// Set the values, then upload() before drawing; unchanged values are not
+// uploaded again.
+class FrameUniforms {
+public:
+    // The block's name in the shaders, and its binding point
+    static constexpr const char *blockName = "FrameUniforms";
+    static const GLuint bindingPoint = 0;
+
+private:
+    // The block's std140 layout
+    struct Block {
+        glm::mat4 viewProj;
+        glm::ivec2 dimensions;
+        int time;
+        int padding;
+    };
+    static_assert(sizeof(Block) == 80, "FrameUniforms::Block must match the std140 layout of the GLSL block");
+
+    OpenGLContext *mp_context;
+    GLuint m_buffer;
+    bool m_created;
+
+    Block m_block;
+    // m_block differs from the buffer's contents
+    bool m_dirty;
+
+public:
+    FrameUniforms(OpenGLContext *context);
+
+    // Initialize the buffer and bind it to bindingPoint
+    void create();
+    // Deallocate the buffer
+    void destroy();
+
+    void setViewProj(const glm::mat4 &viewProj);
+    void setDimensions(glm::ivec2 dimensions);
+    void setTime(int time);
+
+    // Send the values set since the last upload to the buffer
+    void upload();
+};
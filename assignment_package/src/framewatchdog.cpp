@@ -0,0 +1,113 @@
+#include "framewatchdog.h"
+#include "gputimers.h"
+#include <QDateTime>
+#include <QDir>
+#include <QStandardPaths>
+#include <chrono>
+#include <iostream>
+
+FrameWatchdog::FrameWatchdog()
+    : m_thresholdMs(0.f),
+      m_directory(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation)),
+      m_framesToWait(-1), m_longFrameMs(0.f), m_longFrameEnd(0), m_context(), m_lastTrace(-1),
+      m_writing(), m_writingPath(), m_traces(0)
+{}
+
+void FrameWatchdog::setThreshold(float ms)
+{
+    m_thresholdMs = ms;
+    Profiler::global().setTracing(ms > 0.f);
+    if (ms <= 0.f) {
+        m_framesToWait = -1;
+        m_context.clear();
+    }
+}
+
+bool FrameWatchdog::isEnabled() const
+{
+    return m_thresholdMs > 0.f;
+}
+
+/**
+ * @brief FrameWatchdog::endFrame
+ *  A long frame found while another waits to be written, or within the
+ *  cooldown of the last trace, is left out: the trace it would make
+ *  overlaps that one.
+ */
+bool FrameWatchdog::endFrame(float frameMs)
+{
+    if (m_writing.valid()) {
+        finishWrite(false);
+    }
+    if (m_framesToWait >= 0 && m_framesToWait-- == 0) {
+        write();
+    }
+    if (frameMs <= m_thresholdMs || m_thresholdMs <= 0.f || m_framesToWait >= 0) {
+        return false;
+    }
+    qint64 now = Profiler::global().now();
+    if (m_writing.valid() || (m_lastTrace >= 0 && now - m_lastTrace < cooldownMs * 1000000ll)) {
+        return false;
+    }
+    m_longFrameMs = frameMs;
+    m_longFrameEnd = now;
+    m_lastTrace = now;
+    return true;
+}
+
+void FrameWatchdog::capture(std::vector<std::pair<QString, QString>> context)
+{
+    m_context = std::move(context);
+    m_context.insert(m_context.begin(), {QString("long frame"),
+                                         QString("%1 ms, over %2 ms").arg(m_longFrameMs, 0, 'f', 1)
+                                         .arg(m_thresholdMs, 0, 'f', 1)});
+    m_framesToWait = GpuTimers::latency;
+}
+
+/**
+ * @brief FrameWatchdog::write
+ *  The events past the long frame's end come along too, up to now: the
+ *  GPU's passes of it are stamped when they were issued, the frames after
+ *  it show what it held up.
+ */
+void FrameWatchdog::write()
+{
+    QDir dir(m_directory);
+    if (!dir.mkpath(".")) {
+        std::cout << "Could not write a long frame's trace to " << m_directory.toStdString() << std::endl;
+        m_context.clear();
+        return;
+    }
+    std::vector<ProfileEvent> events = Profiler::global().copyHistory(m_longFrameEnd - windowMs * 1000000ll);
+    m_writingPath = dir.filePath(QString("long-frame-%1.json")
+                                 .arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss-zzz")));
+    m_writing = std::async(std::launch::async, Profiler::writeChromeTrace, m_writingPath, std::move(events),
+                           std::move(m_context));
+    m_context.clear();
+}
+
+void FrameWatchdog::finishWrite(bool wait)
+{
+    if (!m_writing.valid()
+            || (!wait && m_writing.wait_for(std::chrono::seconds(0)) != std::future_status::ready)) {
+        return;
+    }
+    if (m_writing.get()) {
+        m_traces++;
+        std::cout << "Wrote a long frame's trace to " << m_writingPath.toStdString() << std::endl;
+    } else {
+        std::cout << "Could not write a long frame's trace to " << m_writingPath.toStdString() << std::endl;
+    }
+}
+
+void FrameWatchdog::destroy()
+{
+    finishWrite(true);
+    m_framesToWait = -1;
+    m_context.clear();
+}
+
+int FrameWatchdog::getTraceCount() const
+{
+    return m_traces;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include "profiler.h"
+#include <QString>
+#include <future>
+#include <utility>
+#include <vector>
+
+// Traces of the frames that run long, for the hitches no one can make
+// happen on demand. While on, the Profiler keeps its history (see
+// Profiler::setTracing); a frame whose main thread work passes the
+// threshold has the last windowMs of it written as a Chrome trace, with
+// the context its caller gives (the job queues, what the terrain did),
+// to the app's data directory. The write waits GpuTimers::latency frames
+// for the long frame's GPU passes to come back, and goes to a worker. A
+// frame under the threshold costs a comparison.
+// Main thread only.
+class FrameWatchdog {
+public:
+    // the history a trace covers, before the long frame's end
+    static const int windowMs = 4000;
+    // the least time between two traces, so a stretch of long frames
+    // (and the frames the writes slow) makes one
+    static const int cooldownMs = 30000;
+
+private:
+    // 0: off
+    float m_thresholdMs;
+    QString m_directory;
+    // the long frame waiting to be written: the frames still to wait, -1
+    // if none; its time, end and context
+    int m_framesToWait;
+    float m_longFrameMs;
+    qint64 m_longFrameEnd;
+    std::vector<std::pair<QString, QString>> m_context;
+    // the Profiler's ns at the last trace; -1: none yet
+    qint64 m_lastTrace;
+    std::future<bool> m_writing;
+    QString m_writingPath;
+    int m_traces;
+
+    // start writing the pending trace
+    void write();
+    // report the finished write, if any; wait says whether to wait for it
+    void finishWrite(bool wait);
+
+public:
+    FrameWatchdog();
+
+    FrameWatchdog(const FrameWatchdog&) = delete;
+    FrameWatchdog &operator=(const FrameWatchdog&) = delete;
+
+    // Trace the frames whose main thread work passes ms; 0 turns the
+    // watchdog (and the Profiler's history, unless enabled) off
+    void setThreshold(float ms);
+    bool isEnabled() const;
+
+    // Once a frame, as it ends, with its main thread time. True if it ran
+    // long and is to be traced: the caller then gives capture() what to
+    // write with it, as of now
+    bool endFrame(float frameMs);
+    void capture(std::vector<std::pair<QString, QString>> context);
+    // wait for the trace being written
+    void destroy();
+
+    int getTraceCount() const;
+};
@@ -0,0 +1,130 @@
+#include "gputimers.h"
+#include "profiler.h"
+#include <QOpenGLContext>
+
+// GL 3.3 / GL_ARB_timer_query, in case the headers Qt wraps are ES's
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+GpuTimers::GpuTimers(OpenGLContext *context)
+    : mp_context(context), m_created(false), m_queries(), m_issued(),
+      m_frame(0), m_running(false), m_alwaysTimed(false), m_lastFrameNs(-1)
+{
+    for (auto &issued : m_issued) {
+        issued.fill(-1);
+    }
+}
+
+bool GpuTimers::create()
+{
+    QOpenGLContext *context = mp_context->context();
+    if (context->isOpenGLES()
+            || (context->format().version() < qMakePair(3, 3) && !context->hasExtension("GL_ARB_timer_query"))) {
+        return false;
+    }
+    for (auto &queries : m_queries) {
+        mp_context->glGenQueries(passCount, queries.data());
+    }
+    m_created = true;
+    return true;
+}
+
+void GpuTimers::destroy()
+{
+    if (m_created) {
+        for (auto &queries : m_queries) {
+            mp_context->glDeleteQueries(passCount, queries.data());
+        }
+        m_created = false;
+    }
+}
+
+bool GpuTimers::isCreated() const
+{
+    return m_created;
+}
+
+/**
+ * @brief GpuTimers::beginFrame
+ *  A 32-bit result holds passes of up to 4 s, far more than one takes.
+ *  The frame's total only counts once every pass it issued is back.
+ */
+void GpuTimers::beginFrame()
+{
+    end();
+    if (!m_created) {
+        return;
+    }
+    m_frame = (m_frame + 1) % latency;
+    Profiler &profiler = Profiler::global();
+    qint64 frameNs = 0;
+    bool whole = true;
+    bool issuedAny = false;
+    for (int i = 0; i < passCount; i++) {
+        qint64 issued = m_issued[m_frame][i];
+        if (issued < 0) {
+            continue;
+        }
+        m_issued[m_frame][i] = -1;
+        issuedAny = true;
+        GLuint available = 0;
+        mp_context->glGetQueryObjectuiv(m_queries[m_frame][i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            whole = false;
+            continue;
+        }
+        GLuint ns = 0;
+        mp_context->glGetQueryObjectuiv(m_queries[m_frame][i], GL_QUERY_RESULT, &ns);
+        frameNs += ns;
+        if (profiler.isRecording()) {
+            profiler.record(getName(static_cast<GpuPass>(i)), Profiler::gpuThread, issued, ns);
+        }
+    }
+    if (issuedAny && whole) {
+        m_lastFrameNs = frameNs;
+    }
+}
+
+void GpuTimers::begin(GpuPass pass)
+{
+    end();
+    Profiler &profiler = Profiler::global();
+    if (!m_created || !(profiler.isRecording() || m_alwaysTimed)) {
+        return;
+    }
+    int i = static_cast<int>(pass);
+    // a pass timed twice in a frame keeps its first query
+    if (m_issued[m_frame][i] >= 0) {
+        return;
+    }
+    m_issued[m_frame][i] = profiler.now();
+    mp_context->glBeginQuery(GL_TIME_ELAPSED, m_queries[m_frame][i]);
+    m_running = true;
+}
+
+void GpuTimers::end()
+{
+    if (m_running) {
+        mp_context->glEndQuery(GL_TIME_ELAPSED);
+        m_running = false;
+    }
+}
+
+const char *GpuTimers::getName(GpuPass pass)
+{
+    static const char *const names[passCount] = {
+        "shadow pass", "depth pre-pass", "opaque pass", "transparent pass", "NPC pass", "post pass", "HUD pass"
+    };
+    return names[static_cast<int>(pass)];
+}
+
+void GpuTimers::setAlwaysTimed(bool always)
+{
+    m_alwaysTimed = always;
+}
+
+qint64 GpuTimers::getLastFrameNs() const
+{
+    return m_lastFrameNs;
+}
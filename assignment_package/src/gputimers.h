@@ -0,0 +1,60 @@
+#pragma once
+#include "openglcontext.h"
+#include <array>
+
+// The passes of paintGL the GPU is timed on, in the order they are drawn
+enum class GpuPass : unsigned char {
+    shadow, depth, opaque, transparent, npcs, post, hud
+};
+
+/**
+ * @brief The GpuTimers class
+ *  The GPU time of each GpuPass, from GL_TIME_ELAPSED queries read
+ *  latency frames after they were issued, so reading them never waits on
+ *  the GPU; a query not done by then is dropped. The times go to
+ *  Profiler::global() on its GPU track, at when the pass was issued.
+ *  Timed only while the profiler is recording or setAlwaysTimed asked for
+ *  it, and only on desktop GL 3.3 or GL_ARB_timer_query.
+ */
+class GpuTimers
+{
+public:
+    static const int passCount = 7;
+    static const int latency = 3;
+
+private:
+    OpenGLContext *mp_context;
+    bool m_created;
+    // per frame in flight, per pass
+    std::array<std::array<GLuint, passCount>, latency> m_queries;
+    // the Profiler's ns when each query began; -1: not issued
+    std::array<std::array<qint64, passCount>, latency> m_issued;
+    int m_frame;
+    // a pass is being timed
+    bool m_running;
+    bool m_alwaysTimed;
+    // the sum of the passes of the last frame read back; -1: none yet
+    qint64 m_lastFrameNs;
+
+public:
+    GpuTimers(OpenGLContext *context);
+
+    // whether the context can time the passes
+    bool create();
+    void destroy();
+    bool isCreated() const;
+
+    // read the queries of latency frames ago, and reuse them for this one
+    void beginFrame();
+    // end the running pass's query and begin this one's
+    void begin(GpuPass pass);
+    void end();
+
+    static const char *getName(GpuPass pass);
+
+    // Time the passes with the profiler off too (see QualityController)
+    void setAlwaysTimed(bool always);
+    // the GPU time of every pass of the frame read back last, in ns; -1
+    // until one is read back whole
+    qint64 getLastFrameNs() const;
+};
@@ -0,0 +1,67 @@
+#include "imagedecoder.h"
+#include <chrono>
+
+namespace {
+
+QImage decode(std::string path)
+{
+    QImage img(QString::fromStdString(path));
+    if (img.isNull()) {
+        qWarning("Could not decode %s", path.c_str());
+        return img;
+    }
+    return img.convertToFormat(QImage::Format_ARGB32).mirrored();
+}
+
+}
+
+ImageDecoder::ImageDecoder()
+    : m_decoding(), m_decoded()
+{}
+
+void ImageDecoder::start(const std::vector<const char*> &paths)
+{
+    for (const char *path : paths) {
+        std::string key(path);
+        if (m_decoding.count(key) == 0 && m_decoded.count(key) == 0) {
+            m_decoding.emplace(key, std::async(std::launch::async, decode, key));
+        }
+    }
+}
+
+void ImageDecoder::collect(const std::vector<const char*> &paths, bool wait)
+{
+    for (const char *path : paths) {
+        auto it = m_decoding.find(path);
+        if (it == m_decoding.end()) {
+            continue;
+        }
+        if (wait || it->second.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            m_decoded[it->first] = it->second.get();
+            m_decoding.erase(it);
+        }
+    }
+}
+
+bool ImageDecoder::isReady(const std::vector<const char*> &paths)
+{
+    collect(paths, false);
+    for (const char *path : paths) {
+        if (m_decoding.count(path) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QImage ImageDecoder::image(const char *path)
+{
+    collect({path}, true);
+    auto it = m_decoded.find(path);
+    return it == m_decoded.end() ? QImage() : it->second;
+}
+
+void ImageDecoder::clear()
+{
+    m_decoded.clear();
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QImage>
+#include <future>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The ImageDecoder class
+ *  Decodes images (the PNGs of the resources) each on a thread of its
+ *  own, ready for GL as Texture and TextureArray want them: ARGB32, bottom
+ *  row first. MyGL starts them all at construction and uploads each
+ *  texture once its images are in (see MyGL::uploadDecodedTextures), so
+ *  the window shows while they decode.
+ *  Main thread only; the destructor waits for the decodes still running.
+ */
+class ImageDecoder
+{
+private:
+    std::unordered_map<std::string, std::future<QImage>> m_decoding;
+    std::unordered_map<std::string, QImage> m_decoded;
+
+    // move the finished decodes of paths to m_decoded, waiting if asked to
+    void collect(const std::vector<const char*> &paths, bool wait);
+
+public:
+    ImageDecoder();
+
+    // Start decoding each path not started yet
+    void start(const std::vector<const char*> &paths);
+    // Whether every one of paths has been decoded
+    bool isReady(const std::vector<const char*> &paths);
+    // The decoded image of path, waiting for it if need be; a null image
+    // if it was never started or could not be read
+    QImage image(const char *path);
+    // Drop the decoded images, once every texture has been uploaded
+    void clear();
+};
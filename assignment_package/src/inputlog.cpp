@@ -0,0 +1,206 @@
+#include "inputlog.h"
+#include <QKeyEvent>
+#include <QMouseEvent>
+#include <QWidget>
+
+// "MMIR", then the version
+static const quint32 logMagic = 0x4D4D4952;
+static const quint32 logVersion = 1;
+
+bool InputEvent::fromQEvent(const QEvent *event, InputEvent &out)
+{
+    switch (event->type()) {
+    case QEvent::KeyPress:
+    case QEvent::KeyRelease: {
+        const QKeyEvent *key = static_cast<const QKeyEvent*>(event);
+        out = InputEvent{static_cast<quint16>(event->type()), key->key(),
+                         static_cast<quint32>(key->modifiers()), 0.f, 0.f};
+        return true;
+    }
+    case QEvent::MouseMove:
+    case QEvent::MouseButtonPress:
+    case QEvent::MouseButtonRelease: {
+        const QMouseEvent *mouse = static_cast<const QMouseEvent*>(event);
+        out = InputEvent{static_cast<quint16>(event->type()), static_cast<qint32>(mouse->button()),
+                         static_cast<quint32>(mouse->modifiers()),
+                         static_cast<float>(mouse->position().x()), static_cast<float>(mouse->position().y())};
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+uPtr<QInputEvent> InputEvent::toQEvent(const QWidget *widget) const
+{
+    QEvent::Type eventType = static_cast<QEvent::Type>(type);
+    Qt::KeyboardModifiers keyModifiers(QFlag(static_cast<int>(modifiers)));
+    if (eventType == QEvent::KeyPress || eventType == QEvent::KeyRelease) {
+        return mkU<QKeyEvent>(eventType, code, keyModifiers);
+    }
+    QPointF position(x, y);
+    Qt::MouseButton button = static_cast<Qt::MouseButton>(code);
+    return mkU<QMouseEvent>(eventType, position, widget->mapToGlobal(position), button,
+                            eventType == QEvent::MouseButtonRelease ? Qt::NoButton : Qt::MouseButtons(button),
+                            keyModifiers);
+}
+
+// every field but the terrain checks, which Player keeps for itself
+// (see Player::getEnvironment)
+static void writeInputs(QDataStream &out, const InputBundle &inputs)
+{
+    out << inputs.wPressed << inputs.aPressed << inputs.sPressed << inputs.dPressed
+        << inputs.qPressed << inputs.ePressed << inputs.spacePressed
+        << inputs.leftMouseButtonPressed << inputs.rightMouseButtonPressed
+        << inputs.pPressed << inputs.nPressed << inputs.iPressed
+        << inputs.mouseX << inputs.mouseY;
+    for (bool pressed : inputs.numberPressed) {
+        out << pressed;
+    }
+}
+
+static void readInputs(QDataStream &in, InputBundle &inputs)
+{
+    in >> inputs.wPressed >> inputs.aPressed >> inputs.sPressed >> inputs.dPressed
+       >> inputs.qPressed >> inputs.ePressed >> inputs.spacePressed
+       >> inputs.leftMouseButtonPressed >> inputs.rightMouseButtonPressed
+       >> inputs.pPressed >> inputs.nPressed >> inputs.iPressed
+       >> inputs.mouseX >> inputs.mouseY;
+    for (bool &pressed : inputs.numberPressed) {
+        in >> pressed;
+    }
+}
+
+InputRecorder::InputRecorder()
+    : m_file(), m_out(), m_header{0, 0, 0, 0}, m_headerWritten(false), m_events()
+{}
+
+InputRecorder::~InputRecorder()
+{
+    close();
+}
+
+bool InputRecorder::open(const QString &path, uint64_t worldSeed, quint32 sessionSeed)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        return false;
+    }
+    m_out.setDevice(&m_file);
+    m_out.setVersion(QDataStream::Qt_5_15);
+    // the floats go as written, so they read back bit for bit
+    m_out.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    m_header.worldSeed = worldSeed;
+    m_header.sessionSeed = sessionSeed;
+    return true;
+}
+
+bool InputRecorder::isActive() const
+{
+    return m_file.isOpen();
+}
+
+void InputRecorder::setViewSize(int width, int height)
+{
+    m_header.width = width;
+    m_header.height = height;
+}
+
+void InputRecorder::addEvent(const QEvent *event)
+{
+    InputEvent input;
+    if (isActive() && InputEvent::fromQEvent(event, input)) {
+        m_events.push_back(input);
+    }
+}
+
+void InputRecorder::recordTick(float deltaTime, const InputBundle &inputs)
+{
+    if (!isActive()) {
+        return;
+    }
+    if (!m_headerWritten) {
+        m_out << logMagic << logVersion << static_cast<quint64>(m_header.worldSeed) << m_header.sessionSeed
+              << m_header.width << m_header.height;
+        m_headerWritten = true;
+    }
+    m_out << deltaTime << static_cast<quint32>(m_events.size());
+    for (const InputEvent &event : m_events) {
+        m_out << event.type << event.code << event.modifiers << event.x << event.y;
+    }
+    writeInputs(m_out, inputs);
+    m_events.clear();
+}
+
+void InputRecorder::close()
+{
+    if (isActive()) {
+        m_out.setDevice(nullptr);
+        m_file.close();
+    }
+}
+
+InputReplay::InputReplay()
+    : m_file(), m_in(), m_header{0, 0, 0, 0}, m_ticks(0)
+{}
+
+bool InputReplay::open(const QString &path, QString &error)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        error = QString("Could not open the input log %1").arg(path);
+        return false;
+    }
+    m_in.setDevice(&m_file);
+    m_in.setVersion(QDataStream::Qt_5_15);
+    m_in.setFloatingPointPrecision(QDataStream::SinglePrecision);
+    quint32 magic = 0, version = 0;
+    quint64 worldSeed = 0;
+    m_in >> magic >> version >> worldSeed >> m_header.sessionSeed >> m_header.width >> m_header.height;
+    if (m_in.status() != QDataStream::Ok || magic != logMagic || version != logVersion) {
+        error = QString("%1 is not an input log of version %2").arg(path).arg(logVersion);
+        m_file.close();
+        return false;
+    }
+    m_header.worldSeed = worldSeed;
+    return true;
+}
+
+bool InputReplay::isActive() const
+{
+    return m_file.isOpen();
+}
+
+const InputLogHeader &InputReplay::getHeader() const
+{
+    return m_header;
+}
+
+bool InputReplay::readTick(InputTick &tick)
+{
+    if (!isActive() || m_in.atEnd()) {
+        m_file.close();
+        return false;
+    }
+    quint32 eventCount = 0;
+    m_in >> tick.deltaTime >> eventCount;
+    tick.events.clear();
+    for (quint32 i = 0; i < eventCount && m_in.status() == QDataStream::Ok; i++) {
+        InputEvent event;
+        m_in >> event.type >> event.code >> event.modifiers >> event.x >> event.y;
+        tick.events.push_back(event);
+    }
+    readInputs(m_in, tick.inputs);
+    // a log cut short ends at its last whole tick
+    if (m_in.status() != QDataStream::Ok) {
+        m_file.close();
+        return false;
+    }
+    m_ticks++;
+    return true;
+}
+
+uint64_t InputReplay::getTicksRead() const
+{
+    return m_ticks;
+}
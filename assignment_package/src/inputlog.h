@@ -0,0 +1,101 @@
+#pragma once
+#include "scene/entity.h"
+#include "smartpointerhelp.h"
+#include <QDataStream>
+#include <QEvent>
+#include <QFile>
+#include <QInputEvent>
+#include <QString>
+#include <cstdint>
+#include <vector>
+
+// A key or mouse event as MyGL's handlers received it
+struct InputEvent
+{
+    // QEvent::KeyPress, KeyRelease, MouseMove, MouseButtonPress or
+    // MouseButtonRelease
+    quint16 type;
+    // the Qt::Key, or the Qt::MouseButton
+    qint32 code;
+    quint32 modifiers;
+    // the mouse, in the widget's pixels
+    float x, y;
+
+    // Of a key or mouse event; false for any other
+    static bool fromQEvent(const QEvent *event, InputEvent &out);
+    // The event again, the mouse's global position through widget
+    uPtr<QInputEvent> toQEvent(const QWidget *widget) const;
+};
+
+// One tick of a session: the events that came in since the last one,
+// the inputs they left, and the frame time the tick stepped by
+struct InputTick
+{
+    float deltaTime;
+    std::vector<InputEvent> events;
+    InputBundle inputs;
+};
+
+// What a session started from, for its replay to start from the same
+struct InputLogHeader
+{
+    uint64_t worldSeed;
+    // seeds the NPCs' random choices (see MyGL::setupNPCs)
+    quint32 sessionSeed;
+    // the widget's size, which the mouse look is relative to
+    qint32 width, height;
+};
+
+/**
+ * @brief The InputRecorder class
+ *  Writes a session's ticks (see InputTick) to a file, after its
+ *  header, for InputReplay to play back. The events are added as they
+ *  come and written with the tick that follows them. Main thread only.
+ */
+class InputRecorder
+{
+private:
+    QFile m_file;
+    QDataStream m_out;
+    InputLogHeader m_header;
+    bool m_headerWritten;
+    std::vector<InputEvent> m_events;
+
+public:
+    InputRecorder();
+    ~InputRecorder();
+
+    bool open(const QString &path, uint64_t worldSeed, quint32 sessionSeed);
+    bool isActive() const;
+    // the widget's size as of now; the header takes the one of the first tick
+    void setViewSize(int width, int height);
+
+    void addEvent(const QEvent *event);
+    void recordTick(float deltaTime, const InputBundle &inputs);
+    void close();
+};
+
+/**
+ * @brief The InputReplay class
+ *  Reads back what InputRecorder wrote, a tick at a time.
+ */
+class InputReplay
+{
+private:
+    QFile m_file;
+    QDataStream m_in;
+    InputLogHeader m_header;
+    uint64_t m_ticks;
+
+public:
+    InputReplay();
+
+    // false, with the reason in error, if it is no log of this version
+    bool open(const QString &path, QString &error);
+    bool isActive() const;
+    const InputLogHeader &getHeader() const;
+
+    // the next tick; false once they are all read, which closes it
+    bool readTick(InputTick &tick);
+    uint64_t getTicksRead() const;
+};
@@ -0,0 +1,111 @@
+#include "lineararena.h"
+#include "memorystats.h"
+#include <algorithm>
+
+LinearArena::Scope::Scope(LinearArena &arena)
+    : m_arena(arena), m_mark(arena.mark())
+{}
+
+LinearArena::Scope::~Scope()
+{
+    m_arena.rewind(m_mark);
+}
+
+LinearArena::LinearArena(size_t blockBytes)
+    : m_blocks(), m_block(0), m_offset(0), m_usedBefore(0), m_highWater(0), m_blockBytes(blockBytes)
+{}
+
+LinearArena::~LinearArena()
+{
+    MemoryStats::sub(MemoryCategory::arenas, static_cast<int64_t>(getReservedBytes()));
+}
+
+LinearArena &LinearArena::local()
+{
+    static thread_local LinearArena arena;
+    return arena;
+}
+
+void LinearArena::addBlock(size_t bytes)
+{
+    m_blocks.push_back(Block{std::unique_ptr<unsigned char[]>(new unsigned char[bytes]), bytes});
+    MemoryStats::add(MemoryCategory::arenas, static_cast<int64_t>(bytes));
+}
+
+/**
+ * @brief LinearArena::allocate
+ *  Past the end of the current block, the next one is taken, or a new one
+ *  twice as large (at least the request) is added.
+ * @param bytes
+ * @param alignment : a power of two
+ * @return
+ */
+void *LinearArena::allocate(size_t bytes, size_t alignment)
+{
+    while (true) {
+        if (m_block < m_blocks.size()) {
+            Block &block = m_blocks[m_block];
+            uintptr_t base = reinterpret_cast<uintptr_t>(block.data.get());
+            size_t offset = ((base + m_offset + alignment - 1) & ~(alignment - 1)) - base;
+            if (offset + bytes <= block.size) {
+                m_offset = offset + bytes;
+                m_highWater = std::max(m_highWater, getUsedBytes());
+                return block.data.get() + offset;
+            }
+            // the rest of the block is skipped, and counted as used
+            m_usedBefore += block.size;
+            m_block++;
+            m_offset = 0;
+            if (m_block < m_blocks.size()) {
+                continue;
+            }
+        }
+        size_t last = m_blocks.empty() ? m_blockBytes / 2 : m_blocks.back().size;
+        addBlock(std::max(2 * last, bytes + alignment));
+    }
+}
+
+LinearArena::Mark LinearArena::mark() const
+{
+    return Mark{m_block, m_offset};
+}
+
+/**
+ * @brief LinearArena::rewind
+ *  Back at the start with more than one block, the blocks are replaced by
+ *  one as large as the high water mark, so the next frame or job fits.
+ * @param mark
+ */
+void LinearArena::rewind(Mark mark)
+{
+    m_block = mark.block;
+    m_offset = mark.offset;
+    m_usedBefore = 0;
+    for (size_t i = 0; i < m_block && i < m_blocks.size(); i++) {
+        m_usedBefore += m_blocks[i].size;
+    }
+    if (m_block == 0 && m_offset == 0 && m_blocks.size() > 1) {
+        MemoryStats::sub(MemoryCategory::arenas, static_cast<int64_t>(getReservedBytes()));
+        m_blocks.clear();
+        addBlock(std::max(m_highWater, m_blockBytes));
+    }
+}
+
+size_t LinearArena::getUsedBytes() const
+{
+    return m_usedBefore + m_offset;
+}
+
+size_t LinearArena::getHighWaterBytes() const
+{
+    return m_highWater;
+}
+
+size_t LinearArena::getReservedBytes() const
+{
+    size_t reserved = 0;
+    for (const Block &block : m_blocks) {
+        reserved += block.size;
+    }
+    return reserved;
+}
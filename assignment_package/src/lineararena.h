@@ -0,0 +1,129 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief The LinearArena class
+ *  Scratch memory handed out by bumping a pointer, and taken back all at
+ *  once by a Scope. Each thread has its own (see local()); a frame opens a
+ *  Scope on the GUI thread, each job on its worker, so the temporaries of
+ *  either cost no heap allocation once the arena has grown to their high
+ *  water mark: rewinding to the start folds the blocks it grew into one.
+ *  The blocks are counted in MemoryCategory::arenas.
+ */
+class LinearArena
+{
+public:
+    // where the arena is at; rewinding to it frees what came after
+    struct Mark
+    {
+        size_t block;
+        size_t offset;
+    };
+
+    /**
+     * @brief The Scope class
+     *  Rewinds the arena to where it was at construction. Declared before
+     *  the containers it backs, so they are gone before it rewinds.
+     */
+    class Scope
+    {
+    private:
+        LinearArena &m_arena;
+        Mark m_mark;
+
+    public:
+        explicit Scope(LinearArena &arena);
+        ~Scope();
+        Scope(const Scope &) = delete;
+        Scope &operator=(const Scope &) = delete;
+    };
+
+    explicit LinearArena(size_t blockBytes = 64 * 1024);
+    ~LinearArena();
+    LinearArena(const LinearArena &) = delete;
+    LinearArena &operator=(const LinearArena &) = delete;
+
+    // the calling thread's arena
+    static LinearArena &local();
+
+    void *allocate(size_t bytes, size_t alignment);
+    Mark mark() const;
+    void rewind(Mark mark);
+
+    // the bytes handed out since the start (the skipped ends of blocks
+    // included), the most ever at once, and the blocks' total
+    size_t getUsedBytes() const;
+    size_t getHighWaterBytes() const;
+    size_t getReservedBytes() const;
+
+private:
+    struct Block
+    {
+        std::unique_ptr<unsigned char[]> data;
+        size_t size;
+    };
+    std::vector<Block> m_blocks;
+    size_t m_block;
+    size_t m_offset;
+    // the bytes of the blocks before m_block, for getUsedBytes
+    size_t m_usedBefore;
+    size_t m_highWater;
+    size_t m_blockBytes;
+
+    void addBlock(size_t bytes);
+};
+
+/**
+ * @brief The ArenaAllocator class
+ *  Allocates from a LinearArena, local() by default; deallocating is
+ *  free, the memory comes back when the Scope ends. For containers that
+ *  live within one Scope only.
+ */
+template <typename T>
+class ArenaAllocator
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = ArenaAllocator<U>;
+    };
+
+    ArenaAllocator() noexcept : mp_arena(&LinearArena::local()) {}
+    explicit ArenaAllocator(LinearArena &arena) noexcept : mp_arena(&arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept : mp_arena(other.getArena()) {}
+
+    T *allocate(size_t n) {
+        return static_cast<T*>(mp_arena->allocate(n * sizeof(T), alignof(T)));
+    }
+    void deallocate(T*, size_t) noexcept {}
+
+    LinearArena *getArena() const noexcept {
+        return mp_arena;
+    }
+
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const noexcept {
+        return mp_arena == other.getArena();
+    }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const noexcept {
+        return mp_arena != other.getArena();
+    }
+
+private:
+    LinearArena *mp_arena;
+};
+
+// containers in the calling thread's arena
+template <typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+template <typename T>
+using ArenaSet = std::unordered_set<T, std::hash<T>, std::equal_to<T>, ArenaAllocator<T>>;
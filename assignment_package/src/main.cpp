@@ -1,6 +1,10 @@
 #include <mainwindow.h>
+#include "mygl.h"
+#include "profiler.h"
+#include "threadconfig.h"
 
 #include <QApplication>
+#include <QCommandLineParser>
 #include <QSurfaceFormat>
 #include <QDebug>
 
@@ -23,11 +27,213 @@ int main(int argc, char *argv[])
 {
     QApplication a(argc, argv);
 
+    // thread counts and core pinning per subsystem
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    ThreadConfig::addOptions(parser);
+    parser.addOption(QCommandLineOption("frame-loop", "What starts each frame: vsync (the default), "
+                                        "uncapped, to measure render throughput, or timer (every 16 ms).",
+                                        "mode", "vsync"));
+    parser.addOption(QCommandLineOption("render-backend", "What the renderer creates and draws through: legacy "
+                                        "(the default, GL 3.3) or dsa (GL 4.5 direct state access, where the "
+                                        "context has it).", "backend", "legacy"));
+    parser.addOption(QCommandLineOption("low-latency", "Read the mouse look just before each frame is drawn and let "
+                                        "the GPU queue one frame at most, for less input latency at some frame rate."));
+    parser.addOption(QCommandLineOption("no-idle-throttle", "Keep ticking and drawing at the full rate, and "
+                                        "generating ahead of the player, while another application has the focus."));
+    parser.addOption(QCommandLineOption("npc-benchmark", "Spawn count NPCs of each kind on a fixed seed, fly the camera "
+                                        "along a fixed path and print the frame times and NPC phases, then quit.",
+                                        "count"));
+    parser.addOption(QCommandLineOption("benchmark-frames", "Frames the NPC benchmark records once the NPCs start.",
+                                        "frames", QString::number(NPCBenchmark::defaultFrames)));
+    parser.addOption(QCommandLineOption("render-scale", "The fraction (0.25 to 1) of the screen's pixels the scene is "
+                                        "rendered at before it is upscaled, to trade sharpness for fill rate.",
+                                        "scale", "1"));
+    parser.addOption(QCommandLineOption("no-temporal-upsample", "Upscale a scene rendered below --render-scale 1 "
+                                        "from each frame alone, rather than gathering jittered frames over time."));
+    parser.addOption(QCommandLineOption("effect-scale", "The fraction (0.25 to 1) of the screen's pixels the underwater "
+                                        "and lava distortions run at.",
+                                        "scale", "0.5"));
+    parser.addOption(QCommandLineOption("procedural-effects", "Hash the underwater and lava distortions' noise per "
+                                        "pixel, as originally, instead of reading it from a texture baked at startup."));
+    parser.addOption(QCommandLineOption("anisotropy", "The most samples (1 to 16) anisotropic filtering takes of the block "
+                                        "textures; 1 turns it off.",
+                                        "samples", "8"));
+    parser.addOption(QCommandLineOption("compressed-textures", "Keep the block textures S3TC-compressed on the GPU, "
+                                        "for less texture bandwidth at some loss of detail."));
+    parser.addOption(QCommandLineOption("shadow-resolution", "The texels (256 to 4096) across each of the sun's three "
+                                        "shadow cascades; 0 turns the shadows off.",
+                                        "texels", "2048"));
+    parser.addOption(QCommandLineOption("no-point-lights", "Light the terrain around lava from the block light alone, "
+                                        "without the per-pixel point lights of its emissive blocks."));
+    parser.addOption(QCommandLineOption("no-particles", "Show no crumbs of broken blocks and no snowfall."));
+    parser.addOption(QCommandLineOption("deferred-caves", "Leave the underground solid until the player nears "
+                                        "cave depth or digs toward it, and only then carve the caves there."));
+    parser.addOption(QCommandLineOption("no-mesh-cache", "Mesh every chunk at each launch rather than read the "
+                                        "meshes of unchanged chunks back from the last session."));
+    parser.addOption(QCommandLineOption("view-radius", "Stream and draw the terrain within this many chunks of the "
+                                        "player rather than in a square of 5 x 5 zones; 0 keeps the square.",
+                                        "chunks", "0"));
+    parser.addOption(QCommandLineOption("oit", "Blend the water, ice and glass order-independently (weighted "
+                                        "blended), so the transparent terrain is drawn unsorted."));
+    parser.addOption(QCommandLineOption("depth-prepass", "Draw the depth of the opaque terrain first, so only "
+                                        "the nearest fragment of each pixel is shaded."));
+    parser.addOption(QCommandLineOption("no-reverse-z", "Keep the usual depth and far plane even where the driver "
+                                        "has glClipControl, rather than reversed float depth without a far plane."));
+    parser.addOption(QCommandLineOption("target-frame-ms", "Hold the frames to this time (in ms) by lowering the "
+                                        "render scale, distant terrain, NPC detail and upload budget as needed; "
+                                        "0 turns it off.", "ms", "0"));
+    parser.addOption(QCommandLineOption("gpu-memory-budget", "The GPU memory (in MB) the textures and chunk meshes "
+                                        "may take, the farthest meshes going past it; 0 takes a share of what the "
+                                        "driver reports, if it does.", "mb", "0"));
+    parser.addOption(QCommandLineOption("long-frame-ms", "Write a trace of the last seconds whenever a frame's work "
+                                        "takes over this time (in ms); 0 turns the watchdog off.", "ms", "50"));
+    parser.addOption(QCommandLineOption("profile", "Start with the profiler on (F3 toggles it, F4 writes its trace)."));
+    parser.addOption(QCommandLineOption("info-rate", "Update the player info window this many times (0 to 60) a "
+                                        "second; 0 leaves it blank.",
+                                        "rate", "10"));
+    parser.addOption(QCommandLineOption("record-input", "Log every tick's inputs and frame time to file, for "
+                                        "--replay-input.", "file"));
+    parser.addOption(QCommandLineOption("replay-input", "Play the session logged in file back in place of the "
+                                        "inputs and frame times, then quit.", "file"));
+    parser.addOption(QCommandLineOption("connect", "Play on the WorldServer at host[:port] (the port defaults "
+                                        "to 27015), whose world seed must be the game's.", "host"));
+    parser.process(a);
+    QString configError;
+    if (!ThreadConfig::global().load(parser, configError)) {
+        fprintf(stderr, "%s\n", qPrintable(configError));
+        return 1;
+    }
+    QString frameLoop = parser.value("frame-loop");
+    if (frameLoop != "vsync" && frameLoop != "uncapped" && frameLoop != "timer") {
+        fprintf(stderr, "Unknown frame loop %s\n", qPrintable(frameLoop));
+        return 1;
+    }
+    MyGL::setFrameLoop(frameLoop == "uncapped" ? FrameLoop::uncapped :
+                       frameLoop == "timer" ? FrameLoop::timer : FrameLoop::vsync);
+    RenderBackendKind renderBackend;
+    if (!RenderBackend::parseKind(parser.value("render-backend"), &renderBackend)) {
+        fprintf(stderr, "Unknown render backend %s\n", qPrintable(parser.value("render-backend")));
+        return 1;
+    }
+    MyGL::setRenderBackend(renderBackend);
+    bool okRenderScale = false, okEffectScale = false;
+    float renderScale = parser.value("render-scale").toFloat(&okRenderScale);
+    float effectScale = parser.value("effect-scale").toFloat(&okEffectScale);
+    if (!okRenderScale || renderScale < 0.25f || renderScale > 1.f
+            || !okEffectScale || effectScale < 0.25f || effectScale > 1.f) {
+        fprintf(stderr, "The render and effect scales must be between 0.25 and 1\n");
+        return 1;
+    }
+    MyGL::setRenderScale(renderScale, effectScale);
+    MyGL::setTemporalUpsample(!parser.isSet("no-temporal-upsample"));
+    MyGL::setProceduralEffects(parser.isSet("procedural-effects"));
+    bool okAnisotropy = false;
+    float anisotropy = parser.value("anisotropy").toFloat(&okAnisotropy);
+    if (!okAnisotropy || anisotropy < 1.f || anisotropy > 16.f) {
+        fprintf(stderr, "The anisotropy must be between 1 and 16\n");
+        return 1;
+    }
+    MyGL::setTextureQuality(anisotropy, parser.isSet("compressed-textures"));
+    bool okShadows = false;
+    int shadowResolution = parser.value("shadow-resolution").toInt(&okShadows);
+    if (!okShadows || (shadowResolution != 0 && (shadowResolution < 256 || shadowResolution > 4096))) {
+        fprintf(stderr, "The shadow resolution must be 0 or between 256 and 4096\n");
+        return 1;
+    }
+    MyGL::setShadowResolution(shadowResolution);
+    MyGL::setPointLights(!parser.isSet("no-point-lights"));
+    MyGL::setParticles(!parser.isSet("no-particles"));
+    MyGL::setDeferredCaves(parser.isSet("deferred-caves"));
+    MyGL::setMeshCache(!parser.isSet("no-mesh-cache"));
+    bool okViewRadius = false;
+    int viewRadius = parser.value("view-radius").toInt(&okViewRadius);
+    if (!okViewRadius || viewRadius < 0) {
+        fprintf(stderr, "The view radius must be 0 or positive\n");
+        return 1;
+    }
+    MyGL::setViewRadius(viewRadius);
+    MyGL::setOrderIndependentTransparency(parser.isSet("oit"));
+    MyGL::setDepthPrePass(parser.isSet("depth-prepass"));
+    MyGL::setReverseZ(!parser.isSet("no-reverse-z"));
+    bool okTarget = false;
+    float targetFrameMs = parser.value("target-frame-ms").toFloat(&okTarget);
+    if (!okTarget || targetFrameMs < 0.f) {
+        fprintf(stderr, "The target frame time must be 0 or positive\n");
+        return 1;
+    }
+    MyGL::setTargetFrameTime(targetFrameMs);
+    bool okLongFrame = false;
+    float longFrameMs = parser.value("long-frame-ms").toFloat(&okLongFrame);
+    if (!okLongFrame || longFrameMs < 0.f) {
+        fprintf(stderr, "The long frame time must be 0 or positive\n");
+        return 1;
+    }
+    MyGL::setLongFrameTime(longFrameMs);
+    bool okGpuBudget = false;
+    int gpuMemoryBudget = parser.value("gpu-memory-budget").toInt(&okGpuBudget);
+    if (!okGpuBudget || gpuMemoryBudget < 0) {
+        fprintf(stderr, "The GPU memory budget must be 0 or positive\n");
+        return 1;
+    }
+    MyGL::setGpuMemoryBudget(gpuMemoryBudget);
+    Profiler::global().setEnabled(parser.isSet("profile"));
+    bool okInfoRate = false;
+    int infoRate = parser.value("info-rate").toInt(&okInfoRate);
+    if (!okInfoRate || infoRate < 0 || infoRate > 60) {
+        fprintf(stderr, "The info rate must be between 0 and 60\n");
+        return 1;
+    }
+    MyGL::setInfoRate(infoRate);
+    if (parser.isSet("record-input") && parser.isSet("replay-input")) {
+        fprintf(stderr, "A session can't be recorded while one is replayed\n");
+        return 1;
+    }
+    if (parser.isSet("low-latency") && (parser.isSet("record-input") || parser.isSet("replay-input"))) {
+        fprintf(stderr, "The low-latency mouse look is not logged by the input log\n");
+        return 1;
+    }
+    MyGL::setLowLatency(parser.isSet("low-latency"));
+    MyGL::setIdleThrottle(!parser.isSet("no-idle-throttle"));
+    MyGL::setInputLog(parser.value("record-input"), parser.value("replay-input"));
+    if (parser.isSet("npc-benchmark")) {
+        bool okCount = false, okFrames = false;
+        int count = parser.value("npc-benchmark").toInt(&okCount);
+        int frames = parser.value("benchmark-frames").toInt(&okFrames);
+        if (!okCount || count <= 0 || !okFrames || frames <= 0) {
+            fprintf(stderr, "The NPC benchmark needs a positive count and frames\n");
+            return 1;
+        }
+        MyGL::setNPCBenchmark(count, frames);
+    }
+    if (parser.isSet("connect")) {
+        QString host = parser.value("connect");
+        quint16 port = netDefaultPort;
+        int colon = host.lastIndexOf(':');
+        if (colon >= 0) {
+            bool okPort = false;
+            port = host.mid(colon + 1).toUShort(&okPort);
+            host.truncate(colon);
+            if (!okPort || host.isEmpty()) {
+                fprintf(stderr, "The server must be given as host or host:port\n");
+                return 1;
+            }
+        }
+        if (parser.isSet("npc-benchmark") || parser.isSet("replay-input")) {
+            fprintf(stderr, "The NPC benchmark and replays run on the game's own world\n");
+            return 1;
+        }
+        MyGL::setServer(host, port);
+    }
+
     // Set OpenGL 4.0 and, optionally, 4-sample multisampling
     QSurfaceFormat format;
     format.setVersion(4, 0);
     format.setOption(QSurfaceFormat::DeprecatedFunctions, false);
     format.setProfile(QSurfaceFormat::CoreProfile);
+    // uncapped frames do not wait for vsync (only a QOpenGLWindow, see
+    // CONFIG += gl_window, swaps at this interval whatever the compositor does)
+    format.setSwapInterval(frameLoop == "uncapped" ? 0 : 1);
     //format.setSamples(4);  // Uncomment for nice antialiasing. Not always supported.
 
     /*** AUTOMATIC TESTING: DO NOT MODIFY ***/
@@ -1,23 +1,49 @@
 #include "mainwindow.h"
 #include <ui_mainwindow.h>
 #include "cameracontrolshelp.h"
+#include "mygl.h"
 #include <QResizeEvent>
 
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
-    ui(new Ui::MainWindow), cHelp()
+    ui(new Ui::MainWindow), mygl(nullptr), cHelp()
 {
     ui->setupUi(this);
-    ui->mygl->setFocus();
+#ifdef MINIMINECRAFT_GL_WINDOW
+    // the window draws to the screen itself; its container lays it out and
+    // takes the keyboard focus for it
+    mygl = new MyGL();
+    QWidget *container = QWidget::createWindowContainer(mygl, ui->centralWidget);
+    container->setFocusPolicy(Qt::ClickFocus);
+    ui->gridLayout->addWidget(container, 0, 0);
+    container->setFocus();
+#else
+    mygl = new MyGL(ui->centralWidget);
+    ui->gridLayout->addWidget(mygl, 0, 0);
+    mygl->setFocus();
+#endif
     this->playerInfoWindow.show();
     playerInfoWindow.move(QGuiApplication::primaryScreen()->availableGeometry().center() - this->rect().center() + QPoint(this->width() * 0.75, 0));
 
-    connect(ui->mygl, SIGNAL(sig_sendPlayerPos(QString)), &playerInfoWindow, SLOT(slot_setPosText(QString)));
-    connect(ui->mygl, SIGNAL(sig_sendPlayerVel(QString)), &playerInfoWindow, SLOT(slot_setVelText(QString)));
-    connect(ui->mygl, SIGNAL(sig_sendPlayerAcc(QString)), &playerInfoWindow, SLOT(slot_setAccText(QString)));
-    connect(ui->mygl, SIGNAL(sig_sendPlayerLook(QString)), &playerInfoWindow, SLOT(slot_setLookText(QString)));
-    connect(ui->mygl, SIGNAL(sig_sendPlayerChunk(QString)), &playerInfoWindow, SLOT(slot_setChunkText(QString)));
-    connect(ui->mygl, SIGNAL(sig_sendPlayerTerrainZone(QString)), &playerInfoWindow, SLOT(slot_setZoneText(QString)));
+    connect(mygl, SIGNAL(sig_sendPlayerPos(QString)), &playerInfoWindow, SLOT(slot_setPosText(QString)));
+    connect(mygl, SIGNAL(sig_sendPlayerVel(QString)), &playerInfoWindow, SLOT(slot_setVelText(QString)));
+    connect(mygl, SIGNAL(sig_sendPlayerAcc(QString)), &playerInfoWindow, SLOT(slot_setAccText(QString)));
+    connect(mygl, SIGNAL(sig_sendPlayerLook(QString)), &playerInfoWindow, SLOT(slot_setLookText(QString)));
+    connect(mygl, SIGNAL(sig_sendPlayerChunk(QString)), &playerInfoWindow, SLOT(slot_setChunkText(QString)));
+    connect(mygl, SIGNAL(sig_sendPlayerTerrainZone(QString)), &playerInfoWindow, SLOT(slot_setZoneText(QString)));
+    connect(mygl, SIGNAL(sig_sendTerrainUploadQueue(QString)), &playerInfoWindow, SLOT(slot_setUploadQueueText(QString)));
+    connect(mygl, SIGNAL(sig_sendTerrainCulling(QString)), &playerInfoWindow, SLOT(slot_setCullingText(QString)));
+    connect(mygl, SIGNAL(sig_sendFramePhases(QString)), &playerInfoWindow, SLOT(slot_setFramePhasesText(QString)));
+    connect(mygl, SIGNAL(sig_sendTerrainPipeline(QString)), &playerInfoWindow, SLOT(slot_setTerrainPipelineText(QString)));
+    connect(mygl, SIGNAL(sig_sendMemory(QString)), &playerInfoWindow, SLOT(slot_setMemoryText(QString)));
+    connect(mygl, SIGNAL(sig_sendPerformance(QString)), &playerInfoWindow, SLOT(slot_setPerformanceText(QString)));
+    connect(mygl, SIGNAL(sig_sendThreadSettings(int,int,int,int,int)), &playerInfoWindow, SLOT(slot_setThreadSettings(int,int,int,int,int)));
+
+    connect(&playerInfoWindow, SIGNAL(sig_setTerrainThreads(int)), mygl, SLOT(slot_setTerrainThreads(int)));
+    connect(&playerInfoWindow, SIGNAL(sig_setGenerationThreads(int)), mygl, SLOT(slot_setGenerationThreads(int)));
+    connect(&playerInfoWindow, SIGNAL(sig_setMeshingThreads(int)), mygl, SLOT(slot_setMeshingThreads(int)));
+    connect(&playerInfoWindow, SIGNAL(sig_setNPCThreads(int)), mygl, SLOT(slot_setNPCThreads(int)));
+    connect(&playerInfoWindow, SIGNAL(sig_setPathSearches(int)), mygl, SLOT(slot_setPathSearches(int)));
 }
 
 MainWindow::~MainWindow()
@@ -5,6 +5,8 @@
 #include "cameracontrolshelp.h"
 #include "playerinfo.h"
 
+class MyGL;
+
 
 namespace Ui {
 class MainWindow;
@@ -26,6 +28,8 @@ private slots:
 
 private:
     Ui::MainWindow *ui;
+    // the game, in the layout itself or in a window container (see OpenGLContext)
+    MyGL *mygl;
     CameraControlsHelp cHelp;
     PlayerInfo playerInfoWindow;
 };
@@ -0,0 +1,64 @@
+#include "memorystats.h"
+
+std::array<std::atomic<int64_t>, MemoryStats::categoryCount> MemoryStats::s_bytes{};
+std::array<std::atomic<int64_t>, MemoryStats::categoryCount> MemoryStats::s_peakBytes{};
+std::array<std::atomic<int64_t>, MemoryStats::categoryCount> MemoryStats::s_budgets{};
+
+/**
+ * @brief MemoryStats::add
+ *  Relaxed: the counts are only ever read for reports and budgets, which
+ *  do not need them in step with anything else.
+ * @param category
+ * @param bytes : negative to take them off
+ */
+void MemoryStats::add(MemoryCategory category, int64_t bytes)
+{
+    int i = static_cast<int>(category);
+    int64_t now = s_bytes[i].fetch_add(bytes, std::memory_order_relaxed) + bytes;
+    int64_t peak = s_peakBytes[i].load(std::memory_order_relaxed);
+    while (now > peak && !s_peakBytes[i].compare_exchange_weak(peak, now, std::memory_order_relaxed)) {
+    }
+}
+
+int64_t MemoryStats::getBytes(MemoryCategory category)
+{
+    return s_bytes[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+int64_t MemoryStats::getPeakBytes(MemoryCategory category)
+{
+    return s_peakBytes[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+int64_t MemoryStats::getTotalBytes()
+{
+    int64_t total = 0;
+    for (const std::atomic<int64_t> &bytes : s_bytes) {
+        total += bytes.load(std::memory_order_relaxed);
+    }
+    return total;
+}
+
+void MemoryStats::setBudget(MemoryCategory category, int64_t bytes)
+{
+    s_budgets[static_cast<int>(category)].store(bytes, std::memory_order_relaxed);
+}
+
+int64_t MemoryStats::getBudget(MemoryCategory category)
+{
+    return s_budgets[static_cast<int>(category)].load(std::memory_order_relaxed);
+}
+
+bool MemoryStats::isOverBudget(MemoryCategory category)
+{
+    int64_t budget = getBudget(category);
+    return budget > 0 && getBytes(category) > budget;
+}
+
+const char *MemoryStats::getName(MemoryCategory category)
+{
+    static const char *const names[categoryCount] = {
+        "blocks", "mesh data", "GPU meshes", "textures", "NPC graphs", "arenas", "cold chunks"
+    };
+    return names[static_cast<int>(category)];
+}
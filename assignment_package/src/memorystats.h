@@ -0,0 +1,100 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// What the tracked memory is for, one counter each
+enum class MemoryCategory : unsigned char {
+    blocks,         // the block sections' palettes and packed indices
+    meshData,       // ChunkVBOdata's buffers, from meshing to upload
+    gpuMeshes,      // the chunks' uploaded meshes, in arenas or own buffers
+    textures,       // the texels uploaded to textures
+    npcGraphs,      // the NPCs' scene graph nodes and flattened graphs
+    arenas,         // the threads' LinearArenas: frame and job scratch, the pathfinder's included
+    coldChunks      // the evicted chunks kept compressed in memory (see RegionStore)
+};
+
+/**
+ * @brief The MemoryStats class
+ *  The bytes held by each MemoryCategory right now, counted by the code
+ *  that allocates them (or by TrackedAllocator), from any thread. Counts
+ *  the payloads, not the allocator's overhead, so the sum is below what
+ *  the process holds; the difference is what nothing here accounts for.
+ *  A budget per category (0: none) lets eviction and LOD ask whether
+ *  one is over it.
+ */
+class MemoryStats
+{
+public:
+    static const int categoryCount = 7;
+
+private:
+    static std::array<std::atomic<int64_t>, categoryCount> s_bytes;
+    static std::array<std::atomic<int64_t>, categoryCount> s_peakBytes;
+    static std::array<std::atomic<int64_t>, categoryCount> s_budgets;
+
+public:
+    static void add(MemoryCategory category, int64_t bytes);
+    static void sub(MemoryCategory category, int64_t bytes) {
+        add(category, -bytes);
+    }
+
+    static int64_t getBytes(MemoryCategory category);
+    // the most it held since the start
+    static int64_t getPeakBytes(MemoryCategory category);
+    // every category's bytes, the GPU's included
+    static int64_t getTotalBytes();
+
+    static void setBudget(MemoryCategory category, int64_t bytes);
+    static int64_t getBudget(MemoryCategory category);
+    static bool isOverBudget(MemoryCategory category);
+
+    static const char *getName(MemoryCategory category);
+};
+
+/**
+ * @brief The TrackedAllocator class
+ *  std::allocator, counting what it holds in its category. Stateless, so
+ *  containers of the same category swap and move as with std::allocator.
+ */
+template <typename T, MemoryCategory category>
+class TrackedAllocator
+{
+public:
+    using value_type = T;
+
+    template <typename U>
+    struct rebind {
+        using other = TrackedAllocator<U, category>;
+    };
+
+    TrackedAllocator() noexcept {}
+    template <typename U>
+    TrackedAllocator(const TrackedAllocator<U, category>&) noexcept {}
+
+    T *allocate(size_t n) {
+        T *p = std::allocator<T>().allocate(n);
+        MemoryStats::add(category, static_cast<int64_t>(n * sizeof(T)));
+        return p;
+    }
+    void deallocate(T *p, size_t n) noexcept {
+        MemoryStats::sub(category, static_cast<int64_t>(n * sizeof(T)));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator==(const TrackedAllocator<U, category>&) const noexcept {
+        return true;
+    }
+    template <typename U>
+    bool operator!=(const TrackedAllocator<U, category>&) const noexcept {
+        return false;
+    }
+};
+
+// a std::vector counted in the category
+template <typename T, MemoryCategory category>
+using TrackedVector = std::vector<T, TrackedAllocator<T, category>>;
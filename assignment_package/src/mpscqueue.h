@@ -0,0 +1,81 @@
+#pragma once
+#include <atomic>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief The MPSCQueue class
+ *  A lock-free queue many threads push to and one thread drains, for
+ *  handing worker results to the main thread. A push is one allocation
+ *  and a compare-and-swap on the head of a list, so producers never wait
+ *  on the consumer; takeAll() detaches the whole list with one exchange,
+ *  which rules out the ABA problem of popping nodes one by one.
+ *  push may be called from any thread, takeAll and isEmpty from the
+ *  consumer only.
+ */
+template <typename T>
+class MPSCQueue
+{
+private:
+    struct Node
+    {
+        T value;
+        Node *next;
+    };
+
+    // the newest node; each links to the one pushed before it
+    std::atomic<Node*> m_head;
+
+public:
+    MPSCQueue()
+        : m_head(nullptr)
+    {}
+
+    ~MPSCQueue()
+    {
+        Node *node = m_head.load(std::memory_order_acquire);
+        while (node != nullptr) {
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue &operator=(const MPSCQueue&) = delete;
+
+    void push(T value)
+    {
+        Node *node = new Node{std::move(value), m_head.load(std::memory_order_relaxed)};
+        while (!m_head.compare_exchange_weak(node->next, node,
+                                             std::memory_order_release,
+                                             std::memory_order_relaxed)) {}
+    }
+
+    // Append everything pushed so far to out, oldest first
+    void takeAll(std::vector<T> &out)
+    {
+        Node *node = m_head.exchange(nullptr, std::memory_order_acquire);
+
+        // the list runs newest first
+        Node *reversed = nullptr;
+        while (node != nullptr) {
+            Node *next = node->next;
+            node->next = reversed;
+            reversed = node;
+            node = next;
+        }
+
+        while (reversed != nullptr) {
+            Node *next = reversed->next;
+            out.push_back(std::move(reversed->value));
+            delete reversed;
+            reversed = next;
+        }
+    }
+
+    bool isEmpty() const
+    {
+        return m_head.load(std::memory_order_acquire) == nullptr;
+    }
+};
@@ -1,74 +1,232 @@
 #include "mygl.h"
+#include "lineararena.h"
+#include "threadconfig.h"
 #include "scene/npcs/sheep.h"
 
 #include "scene/npcs/zombiedragon.h"
 #include "scene/npcs/lama.h"
+#include "scene/npcmeshcache.h"
+#include "scene/blockicons.h"
 #include <glm_includes.h>
 #include <iostream>
 #include <QApplication>
 #include <QKeyEvent>
 #include <QDateTime>
+#include <QDir>
 #include <QFile>
-#include <QSoundEffect>
+#include <QStandardPaths>
+#include <QWindow>
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <limits>
 #include <random>
 
 // Library effective with Linux
 #include <unistd.h>
 
+// NVX_gpu_memory_info and ATI_meminfo, in case the headers Qt wraps lack them
+#ifndef GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX 0x9047
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+// ARB_clip_control, core in 4.5
+#ifndef GL_LOWER_LEFT
+#define GL_LOWER_LEFT 0x8CA1
+#endif
+#ifndef GL_NEGATIVE_ONE_TO_ONE
+#define GL_NEGATIVE_ONE_TO_ONE 0x935E
+#endif
+#ifndef GL_ZERO_TO_ONE
+#define GL_ZERO_TO_ONE 0x935F
+#endif
+
+// the share of the memory the driver reports the game budgets for: of
+// all the dedicated memory (NVX), or of what is free at start (ATI)
+static const float dedicatedMemoryShare = 0.5f;
+static const float freeMemoryShare = 0.75f;
+
+// the vertex buffer all chunk meshes share: 32 bytes per quad, so some
+// four million quads, or over a thousand typical chunks
+static const size_t meshArenaBytes = 128u << 20;
+
+// the block atlas: the terrain's tiles (slot 0) and the HUD's first layer
+static const char *const blockAtlasPath = ":/textures/minecraft_textures_all.png";
+// the HUD's texture maps, one texture array (slot = 2): the block icons,
+// baked from the main texture map (see BlockIcons), then the widgets, the
+// container and the font, its distance field baked from the bitmap (see
+// Text::bakeDistanceField), in HudBatch::Layer order
+static const std::vector<const char*> hudTexturePaths = {
+    blockAtlasPath,
+    ":/textures/minecraft_textures_widgets.png",
+    ":/textures/inventory.png",
+    ":/textures/ascii.png"
+};
+// the NPC texture maps, each the layer of npcSkins its NPCTexture names
+struct NPCTextureFile
+{
+    NPCTexture texture;
+    const char *path;
+};
+static const NPCTextureFile npcTextureFiles[] = {
+    {STEVE, ":/textures/steve.png"},
+    {SHEEP, ":/textures/sheep.png"},
+    {ZDRAGON, ":/textures/zdragon.png"},
+    {ZDRAGON1, ":/textures/zdragonV1.png"},
+    {ZDRAGON2, ":/textures/zdragonV2.png"},
+    {ZDRAGON3, ":/textures/zdragonV3.png"},
+    {ZDRAGON4, ":/textures/zdragonV4.png"},
+    {GLAMA, ":/textures/graylama.png"},
+    {WLAMA, ":/textures/whitelama.png"},
+    {BLAMA, ":/textures/brownlama.png"},
+    {BEAR, ":/textures/bear.png"}
+};
+static const int npcSkinsTextureSlot = 3;
+// the player's model is drawn on its own, from a texture of its own
+static const int playerTextureSlot = 4;
+// what the terrain and the NPCs are drawn with until their texture maps
+// are in: an opaque mid grey
+static const QRgb placeholderBlockColor = 0xFF808080u;
+
+FrameLoop MyGL::s_frameLoop = FrameLoop::vsync;
+RenderBackendKind MyGL::s_renderBackend = RenderBackendKind::legacy;
+bool MyGL::s_lowLatency = false;
+bool MyGL::s_idleThrottle = true;
+int MyGL::s_benchmarkNPCsPerType = 0;
+int MyGL::s_benchmarkFrames = 0;
+float MyGL::s_renderScale = 1.f;
+bool MyGL::s_temporalUpsample = true;
+float MyGL::s_targetFrameMs = 0.f;
+float MyGL::s_longFrameMs = 50.f;
+int MyGL::s_gpuMemoryBudgetMB = 0;
+float MyGL::s_effectScale = 0.5f;
+bool MyGL::s_proceduralEffects = false;
+float MyGL::s_anisotropy = 8.f;
+bool MyGL::s_compressTextures = false;
+int MyGL::s_shadowResolution = 2048;
+bool MyGL::s_pointLights = true;
+bool MyGL::s_particles = true;
+int MyGL::s_infoRate = 10;
+bool MyGL::s_deferredCaves = false;
+bool MyGL::s_meshCache = true;
+int MyGL::s_viewRadius = 0;
+bool MyGL::s_orderIndependentTransparency = false;
+bool MyGL::s_depthPrePass = false;
+bool MyGL::s_reverseZ = true;
+QString MyGL::s_inputRecordPath;
+QString MyGL::s_inputReplayPath;
+QString MyGL::s_serverHost;
+quint16 MyGL::s_serverPort = netDefaultPort;
+
+// the sun's shadow cascades, past the NPC rigs
+static const int shadowTextureSlot = 15;
+// the blocks from the eye the point lights are gathered within
+static const float pointLightRange = 96.f;
+// the surface heights FillBlocksWorker::setSurfaceTerrain caps with SNOW,
+// and the radius around the player it snows in there
+static const int snowLine = 180;
+static const float snowRadius = 24.f;
+// the transparency buffer's targets, before them
+static const int oitAccumTextureSlot = 12;
+static const int oitRevealageTextureSlot = 13;
+// how long a low-latency frame waits for the last one, in ns, before
+// drawing anyway
+static const GLuint64 frameFenceTimeout = 100000000;
+
 
 MyGL::MyGL(QWidget *parent)
     : OpenGLContext(parent),
-      m_worldAxes(this),
-      m_progLambert(this), m_progFlat(this),
-      m_progUnderwater(this), m_progLava(this), m_progNoOp(this), m_progInventoryWidgetOnHand(this), m_progInventoryItemOnHand(this), m_progInventoryWidgetInContainer(this),
-      m_progInventoryItemInContainer(this), m_progGrabbedItem(this), m_progText(this),
-      m_quad(this), m_progNPC(this), m_frameBuffer(this, this->width(), this->height(), this->devicePixelRatio()),
-      m_terrain(this), m_player(glm::vec3(48.f, 200.f, 48.f), m_terrain),
-      m_player_model(this, glm::vec3(60.f, 145.f, 35.f), m_terrain, m_player, STEVE), frameCount(0),
-      prevFrameTime(QDateTime::currentMSecsSinceEpoch()), mouseCursorMode(false), textureAll(this), inventoryWidgetOnHandTexture(this), inventoryWidgetInContainerTexture(this),
-      textureFont(this), prevExpandTime(QDateTime::currentMSecsSinceEpoch())
+      m_worldAxes(this), m_chunkHeatmap(this),
+      m_progLambert(this), m_progLambertAnimated(this), m_progLambertOit(this), m_progFlat(this),
+      m_progUnderwater(this), m_progLava(this), m_progNoOp(this), m_progOitComposite(this), m_progHud(this),
+      m_quad(this), m_hudBatch(this), m_progNPC(this), m_progNPCInstanced(this), m_progNPCImpostor(this), m_progLod(this), m_progShadow(this), m_progDepth(this), m_clipControl(nullptr), m_frameBuffer(this, this->width(), this->height(), this->devicePixelRatio()),
+      m_effectBuffer(this, this->width(), this->height(), this->devicePixelRatio()),
+      m_postNoise(this),
+      m_renderScale(s_renderScale), m_renderTargetsStale(false), m_temporalUpsampler(this), m_progTemporal(this),
+      m_gpuMemoryBudget(0),
+      m_transparencyBuffer(this), m_frameUniforms(this),
+      m_shadowMap(this), m_clusteredLights(this), m_pointLights(),
+      m_particles(this), m_progParticleUpdate(this), m_progParticle(this), m_brokenBlocks(), m_particleDeltaTime(0.f),
+      m_meshChanges(), m_farField(this), m_progFarField(this),
+      m_terrain(this), m_distantTerrain(this, m_terrain.getJobSystem(), m_terrain.getWorldSeed(), m_terrain.getGradientHash()), m_player(glm::vec3(48.f, 200.f, 48.f), m_terrain),
+      m_inputs(), m_inputRecorder(), m_inputReplay(), m_replayingInput(false), m_sessionSeed(0),
+      m_player_model(this, glm::vec3(60.f, 145.f, 35.f), m_terrain, m_player, STEVE),
+      m_npcs(), m_npcSpawner(this, m_terrain, m_player), m_npcSimulation(), m_npcParts(this), m_npcImpostors(this), m_visibleEntities(), m_frameProfile(), m_gpuTimers(this), m_quality(),
+      m_npcBenchmark(s_benchmarkNPCsPerType, s_benchmarkFrames), m_idle(false), m_frameFence(nullptr), m_frameCapture(this), m_frameWatchdog(), m_frameClock(), frameCount(0),
+      prevFrameTime(0), m_simulationAccumulator(0.f), m_simulationSteps(0), m_prevPlayerPosition(m_player.mcr_position),
+      m_playerHeld(true), mouseCursorMode(false), m_scriptedCamera(false), m_scriptedPosition(0.f), m_scriptedLook(0.f, 0.f, -1.f),
+      m_headless(false), m_headlessSized(false), m_imageDecoder(), m_texturesPending(true), textureAll(this), hudTextures(this),
+      npcSkins(this), playerTexture(this), m_sentInfo(), m_sentChunk(std::numeric_limits<int>::min()),
+      m_sentZone(std::numeric_limits<int>::min()), m_lastInfoTime(0), m_infoFrames(0),
+      m_expandAccumulator(0.f), m_netClient(), m_remoteNPCs(), m_remoteNPCStates()
 {
+    // every texture map decodes while the rest of the start up runs
+    std::vector<const char*> imagePaths = hudTexturePaths;
+    for (const NPCTextureFile &file : npcTextureFiles) {
+        imagePaths.push_back(file.path);
+    }
+    m_imageDecoder.start(imagePaths);
 
     // Connect the timer to a function so that when the timer ticks the function is executed
     connect(&m_timer, SIGNAL(timeout()), this, SLOT(tick()));
-    // Tell the timer to redraw 60 times per second
-    m_timer.start(16);
-    setFocusPolicy(Qt::ClickFocus);
+    connect(this, SIGNAL(frameSwapped()), this, SLOT(slot_frameSwapped()));
+    connect(qApp, SIGNAL(applicationStateChanged(Qt::ApplicationState)),
+            this, SLOT(slot_applicationStateChanged(Qt::ApplicationState)));
+    m_frameClock.start();
+    m_frameWatchdog.setThreshold(s_longFrameMs);
+    if (s_frameLoop == FrameLoop::timer) {
+        // Tell the timer to redraw 60 times per second
+        m_timer.start(16);
+    }
+    // otherwise each swapped frame starts the next; showing the widget
+    // paints the first
     m_inputs = InputBundle();
+#ifndef MINIMINECRAFT_GL_WINDOW
+    // a window takes the focus through its container, and always gets the mouse's moves
+    setFocusPolicy(Qt::ClickFocus);
     setMouseTracking(true); // MyGL will track the mouse's movements even if a mouse button is not pressed
+#endif
 //    setCursor(Qt::BlankCursor); // Make the cursor invisible
     setCursor(Qt::CrossCursor);
     prevMouseX = width() / 2;
     prevMouseY = height() / 2;
 
-    setupNPCs();
-
-    // Setup Sounds
-    mainTheme.setSource(QUrl::fromLocalFile(":/sounds/elden.wav"));
-    mainTheme.setLoopCount(QSoundEffect::Infinite);
-    mainTheme.setVolume(0.25f);
-    mainTheme.play();
-
-    waterEffect.setSource(QUrl::fromLocalFile(":/sounds/under_water.wav"));
-    waterEffect.setLoopCount(QSoundEffect::Infinite);
-    waterEffect.setVolume(0.5f);
-
-    lavaEffect.setSource(QUrl::fromLocalFile(":/sounds/lava.wav"));
-    lavaEffect.setLoopCount(QSoundEffect::Infinite);
-    lavaEffect.setVolume(0.5f);
-
-    grassWalkingEffect.setSource(QUrl::fromLocalFile(":/sounds/grass.wav"));
-    grassWalkingEffect.setLoopCount(QSoundEffect::Infinite);
-    grassWalkingEffect.setVolume(0.5f);
+    // a replay starts where its session did; a new session from the clock
+    m_sessionSeed = static_cast<quint32>(std::chrono::system_clock::now().time_since_epoch().count());
+    if (!s_inputReplayPath.isEmpty()) {
+        QString error;
+        if (!m_inputReplay.open(s_inputReplayPath, error)) {
+            std::cout << error.toStdString() << std::endl;
+        } else {
+            m_sessionSeed = m_inputReplay.getHeader().sessionSeed;
+            if (m_inputReplay.getHeader().worldSeed != m_terrain.getWorldSeed()) {
+                std::cout << "The input log is of another world seed; the replay will differ" << std::endl;
+            }
+        }
+    } else if (!s_inputRecordPath.isEmpty()
+               && !m_inputRecorder.open(s_inputRecordPath, m_terrain.getWorldSeed(), m_sessionSeed)) {
+        std::cout << "Could not write the input log " << s_inputRecordPath.toStdString() << std::endl;
+    }
 
-    rockWalkingEffect.setSource(QUrl::fromLocalFile(":/sounds/rock.wav"));
-    rockWalkingEffect.setLoopCount(QSoundEffect::Infinite);
-    rockWalkingEffect.setVolume(0.5f);
+    m_terrain.setMeshCaching(s_meshCache);
+    if (!s_serverHost.isEmpty()) {
+        // the server's chunks are kept apart from this world's, and its
+        // NPCs stand in for ours
+        m_terrain.setRegionDirectory(QDir(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation))
+                                     .filePath(QString("servers/%1-%2").arg(s_serverHost).arg(s_serverPort)));
+        m_terrain.setEditTracking(true);
+        m_netClient.connectTo(s_serverHost, s_serverPort);
+    } else {
+        m_terrain.setDeferredCaves(s_deferredCaves);
+        setupNPCs();
+    }
+    m_terrain.setViewRadius(s_viewRadius);
+    m_npcSimulation.setNPCs(m_npcs, m_terrain);
+    applyThreadConfig();
 
-    glassWalkingEffect.setSource(QUrl::fromLocalFile(":/sounds/glass.wav"));
-    glassWalkingEffect.setLoopCount(QSoundEffect::Infinite);
-    glassWalkingEffect.setVolume(0.5f);
+    m_audio.startMusic();
 
     initWidget();
     initText();
@@ -76,14 +234,45 @@ MyGL::MyGL(QWidget *parent)
 }
 
 MyGL::~MyGL() {
+    std::cout << "Terrain pipeline:\n" << terrainPipelineText().toStdString() << std::endl;
+    std::cout << "Memory:\n" << memoryText().toStdString() << std::endl;
     makeCurrent();
     glDeleteVertexArrays(1, &vao);
     m_quad.destroyVBOdata();
-    inventoryWidgetOnHand->destroyVBOdata();
-    inventoryItemsOnHand->destroyVBOdata();
-    textOnScreen->destroyVBOdata();
+    m_hudBatch.destroyVBOdata();
+    hudTextures.destroy();
+    npcSkins.destroy();
+    textureAll.destroy();
     m_frameBuffer.destroy();
+    m_effectBuffer.destroy();
+    m_temporalUpsampler.destroy();
+    m_postNoise.destroy();
+    m_transparencyBuffer.destroy();
+    m_frameUniforms.destroy();
+    m_shadowMap.destroy();
+    m_clusteredLights.destroy();
+    m_particles.destroy();
+    m_farField.destroy();
+    m_gpuTimers.destroy();
     m_worldAxes.destroyVBOdata();
+    m_chunkHeatmap.destroyVBOdata();
+    m_npcParts.destroy();
+    m_npcImpostors.destroy();
+    NPCMeshCache::destroy();
+    m_terrain.destroyComputeBackend();
+    // the NPCs read the terrain
+    m_npcSimulation.stop();
+    // workers may be copying into the mapped arena
+    m_terrain.stopWorkers();
+    m_distantTerrain.destroy();
+    m_terrain.destroyMeshArena();
+    m_terrain.destroyBufferPool();
+    ChunkDrawable::destroyQuadIndices(this);
+    m_frameCapture.destroy();
+    m_frameWatchdog.destroy();
+    if (m_frameFence != nullptr) {
+        glDeleteSync(m_frameFence);
+    }
 }
 
 
@@ -91,6 +280,32 @@ void MyGL::moveMouseToCenter() {
     QCursor::setPos(this->mapToGlobal(QPoint(width() / 2, height() / 2)));
 }
 
+/**
+ * @brief MyGL::sampleMouseLook
+ *  Qt has no raw mouse input, so the cursor is read as it is now rather
+ *  than as the queued moves left it: the moves the warp back to the
+ *  center makes, and those queued before it, are then no turn at all
+ *  (see mouseMoveEvent). The cursor is warped once a frame at most.
+ */
+void MyGL::sampleMouseLook() {
+#ifdef MINIMINECRAFT_GL_WINDOW
+    bool active = isActive();
+#else
+    bool active = isActiveWindow();
+#endif
+    if (!active || mouseCursorMode || m_scriptedCamera || m_npcBenchmark.isActive()) {
+        return;
+    }
+    QPoint cursor = mapFromGlobal(QCursor::pos());
+    if (cursor == QPoint(width() / 2, height() / 2)) {
+        return;
+    }
+    m_inputs.mouseX = cursor.x();
+    m_inputs.mouseY = cursor.y();
+    m_player.rotateCameraView(m_inputs);
+    moveMouseToCenter();
+}
+
 void MyGL::initializeGL()
 {
     // Create an OpenGL context using Qt's QOpenGLFunctions_3_2_Core class
@@ -98,6 +313,19 @@ void MyGL::initializeGL()
     initializeOpenGLFunctions();
     // Print out some information about the current OpenGL context
     debugContextVersion();
+    forgetProgramInUse();
+    createRenderBackend(s_renderBackend);
+    std::cout << "Render backend: " << renderBackend().getName() << std::endl;
+    // reversed depth needs the clip space depth of 0 to 1, or the float
+    // depth would get no more precision than the usual
+    if (s_reverseZ && (context()->format().version() >= qMakePair(4, 5)
+                       || context()->hasExtension(QByteArrayLiteral("GL_ARB_clip_control")))) {
+        m_clipControl = reinterpret_cast<ClipControlFunc>(context()->getProcAddress("glClipControl"));
+    }
+    Camera::setReverseZ(m_clipControl != nullptr);
+    if (s_reverseZ && m_clipControl == nullptr) {
+        std::cout << "No glClipControl, the depth is not reversed" << std::endl;
+    }
 
     // Set a few settings/modes in OpenGL rendering
     glEnable(GL_DEPTH_TEST);
@@ -121,26 +349,103 @@ void MyGL::initializeGL()
     m_worldAxes.createVBOdata();
 
     // Initiailize frame buffer
+    m_frameBuffer.setScale(m_renderScale);
     m_frameBuffer.create();
+    m_effectBuffer.setScale(s_effectScale);
+    m_effectBuffer.create();
+    // and the transparent pass' targets, at the scene's size and depth
+    if (s_orderIndependentTransparency
+            && !m_transparencyBuffer.create(m_frameBuffer.pixelWidth(), m_frameBuffer.pixelHeight(),
+                                            m_frameBuffer.getDepthTexture())) {
+        std::cout << "No order-independent transparency, the transparent terrain is sorted" << std::endl;
+    }
+    m_terrain.setUnsortedTransparency(m_transparencyBuffer.isCreated());
+    // and the far NPCs' sprite atlas
+    if (!m_npcImpostors.create()) {
+        std::cout << "No NPC sprite atlas, the far NPCs are drawn whole" << std::endl;
+    }
+    // and the uniform buffer the programs below read the per-frame uniforms from
+    m_frameUniforms.create();
 
+    // Compile every program at once, from the cache of linked programs
+    // where it has them
+    ShaderProgram::setUpCompilation(this, QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation))
+                                              .filePath("shaders"));
     // Create and set up the diffuse shader
-    m_progLambert.create(":/glsl/lambert.vert.glsl", ":/glsl/lambert.frag.glsl");
+    // the permutations of lambert.frag.glsl: the chunks without animated
+    // faces skip the uv shift, the transparent pass may blend unsorted
+    m_progLambert.startCreate(":/glsl/terrain.vert.glsl", ":/glsl/lambert.frag.glsl");
+    m_progLambertAnimated.startCreate(":/glsl/terrain.vert.glsl", ":/glsl/lambert.frag.glsl", {"ANIMATED"});
+    // the programs that read or write the depth themselves follow its convention
+    QStringList depthDefines;
+    if (m_clipControl != nullptr) {
+        depthDefines << "REVERSE_Z";
+    }
+    m_progLambertOit.startCreate(":/glsl/terrain.vert.glsl", ":/glsl/lambert.frag.glsl",
+                                 QStringList({"ANIMATED", "ORDER_INDEPENDENT"}) + depthDefines);
     // Create and set up the flat lighting shader
-    m_progFlat.create(":/glsl/flat.vert.glsl", ":/glsl/flat.frag.glsl");
+    m_progFlat.startCreate(":/glsl/flat.vert.glsl", ":/glsl/flat.frag.glsl");
 //    m_progInstanced.create(":/glsl/instanced.vert.glsl", ":/glsl/lambert.frag.glsl");
 
-    m_progUnderwater.create(":/glsl/post/overlay.vert.glsl", ":/glsl/post/underwater.frag.glsl");
-    m_progLava.create(":/glsl/post/overlay.vert.glsl", ":/glsl/post/lava.frag.glsl");
-    m_progNoOp.create(":/glsl/post/overlay.vert.glsl", ":/glsl/post/overlay.frag.glsl");
-    m_progInventoryWidgetOnHand.create(":/glsl/post/texture.vert.glsl", ":/glsl/post/texture.frag.glsl");
-    m_progInventoryItemOnHand.create(":/glsl/post/texture.vert.glsl", ":/glsl/post/texture.frag.glsl");
-    m_progInventoryWidgetInContainer.create(":/glsl/post/texture.vert.glsl", ":/glsl/post/texture.frag.glsl");
-    m_progInventoryItemInContainer.create(":/glsl/post/texture.vert.glsl", ":/glsl/post/texture.frag.glsl");
-    m_progGrabbedItem.create(":/glsl/post/texture.vert.glsl", ":/glsl/post/texture.frag.glsl");
-    m_progText.create(":/glsl/post/texture.vert.glsl", ":/glsl/post/texture.frag.glsl");
-
+    // the distortions' noise from a texture baked here, unless asked to hash it per pixel
+    QStringList effectDefines;
+    if (!s_proceduralEffects && m_postNoise.create()) {
+        effectDefines << "BAKED_NOISE";
+    }
+    m_progUnderwater.startCreate(":/glsl/post/overlay.vert.glsl", ":/glsl/post/underwater.frag.glsl", effectDefines);
+    m_progLava.startCreate(":/glsl/post/overlay.vert.glsl", ":/glsl/post/lava.frag.glsl", effectDefines);
+    m_progNoOp.startCreate(":/glsl/post/overlay.vert.glsl", ":/glsl/post/overlay.frag.glsl");
+    m_progOitComposite.startCreate(":/glsl/post/overlay.vert.glsl", ":/glsl/post/oitcomposite.frag.glsl");
+    m_progTemporal.startCreate(":/glsl/post/overlay.vert.glsl", ":/glsl/post/temporal.frag.glsl", depthDefines);
+    m_progHud.startCreate(":/glsl/post/hud.vert.glsl", ":/glsl/post/hud.frag.glsl");
+
+
+    m_progNPC.startCreate(":/glsl/lambert.vert.glsl", ":/glsl/npc.frag.glsl");
+    m_progNPCInstanced.startCreate(":/glsl/npcinstanced.vert.glsl", ":/glsl/npc.frag.glsl", {"SKIN_ARRAY"});
+    m_progNPCImpostor.startCreate(":/glsl/npcimpostor.vert.glsl", ":/glsl/npcimpostor.frag.glsl");
+    m_progLod.startCreate(":/glsl/lod.vert.glsl", ":/glsl/lod.frag.glsl");
+    m_progShadow.startCreate(":/glsl/shadow.vert.glsl", ":/glsl/shadow.frag.glsl");
+    m_progDepth.startCreate(":/glsl/depth.vert.glsl", ":/glsl/shadow.frag.glsl");
+    m_progFarField.startCreate(":/glsl/post/overlay.vert.glsl", ":/glsl/post/farfield.frag.glsl", depthDefines);
+    // the particles' step rasterizes nothing: any fragment shader links
+    m_progParticleUpdate.setFeedbackVaryings({"tf_PositionLife", "tf_VelocitySize", "tf_Appearance"});
+    m_progParticleUpdate.startCreate(":/glsl/particleupdate.vert.glsl", ":/glsl/shadow.frag.glsl");
+    m_progParticle.startCreate(":/glsl/particle.vert.glsl", ":/glsl/particle.frag.glsl");
+
+    for (ShaderProgram *program : {&m_progLambert, &m_progLambertAnimated, &m_progLambertOit, &m_progFlat, &m_progUnderwater, &m_progLava,
+                                   &m_progNoOp, &m_progOitComposite, &m_progTemporal, &m_progHud, &m_progNPC, &m_progNPCInstanced,
+                                   &m_progNPCImpostor, &m_progLod, &m_progShadow, &m_progDepth, &m_progFarField,
+                                   &m_progParticleUpdate, &m_progParticle}) {
+        program->finishCreate();
+    }
 
-    m_progNPC.create(":/glsl/lambert.vert.glsl", ":/glsl/npc.frag.glsl");
+    // The sun's shadows, redrawn as the chunks around the player change
+    if (s_shadowResolution > 0) {
+        m_shadowMap.setResolution(s_shadowResolution);
+        m_shadowMap.create();
+        m_terrain.setMeshChangeTracking(m_shadowMap.isCreated());
+    }
+    // The point lights' buffer, bound for the terrain programs to read even
+    // with none in it
+    m_clusteredLights.create();
+    if (s_particles) {
+        m_particles.create();
+    }
+    // The profiler's GPU track
+    if (!m_gpuTimers.create()) {
+        std::cout << "No GL timer queries, the profiler times the CPU only" << std::endl;
+    }
+    // and the frame time to hold, which needs the GPU's side of it every frame
+    if (s_targetFrameMs > 0.f) {
+        m_quality.setTarget(s_targetFrameMs);
+        m_gpuTimers.setAlwaysTimed(true);
+    }
+    // and the GPU memory the chunk meshes may take of (see updateGpuMeshBudget)
+    m_gpuMemoryBudget = s_gpuMemoryBudgetMB > 0 ? static_cast<int64_t>(s_gpuMemoryBudgetMB) << 20
+                                                : detectGpuMemoryBudget();
+    if (m_gpuMemoryBudget > 0) {
+        std::cout << "GPU memory budget: " << (m_gpuMemoryBudget >> 20) << " MB" << std::endl;
+    }
 
     m_quad.createVBOdata();
 
@@ -150,37 +455,46 @@ void MyGL::initializeGL()
     m_player_model.createVBOdata();
     m_player_model.initSceneGraph();
 
-    // create NPC's VBO and initialize NPC scene graph
+    // create the benchmark NPCs' VBO and scene graph; m_npcSpawner
+    // builds the ones it spawns
     for (const uPtr<NPC> &npc : m_npcs)
     {
         npc->createVBOdata();
         npc->initSceneGraph();
     }
 
+    // the debug panel is connected by now
+    sendThreadSettingsToGUI();
+
     ////////////////////////////////////////////////////////////////////////////////////
     /// loading texture map from png
     ////////////////////////////////////////////////////////////////////////////////////
-    // main texture map (slot = 0)
-    createTexture(textureAll, ":/textures/minecraft_textures_all.png", 0);
-    // loading uv coordinate of main texture map from text file
+    // loading uv coordinate of main texture map from text file, first:
+    // the HUD's block icons are baked from them
     Block::loadUVCoordFromText(":/textures/uv_coord_texture_all.txt");
-
-    // widget texture map (slot = 2)
-    createTexture(inventoryWidgetOnHandTexture, ":/textures/minecraft_textures_widgets.png", 2);
+    // the texture maps decoded by now; the others follow in paintGL, read
+    // as a texel of placeholder until then
+    textureAll.loadPlaceholder(0, placeholderBlockColor);
+    hudTextures.loadPlaceholder(2, 0);
+    npcSkins.loadPlaceholder(npcSkinsTextureSlot, placeholderBlockColor);
+    uploadDecodedTextures();
+    // the NPC uvs were loaded by createNPCTextures: no more block uvs from here,
+    // so the mesh workers may read them without locking
+    Block::freezeRegistry();
+
+    // widget
     inventoryWidgetOnHand->loadCoordFromText(":/textures/widget_on_hand_info.txt");
 
     // block in widget (on hand)
     inventoryItemsOnHand->loadCoordFromText(":/textures/widget_item_on_hand_info.txt");
 
-    // container widget texture map (slot = 4)
-    createTexture(inventoryWidgetInContainerTexture, ":/textures/inventory.png", 4);
+    // container widget
     inventoryWidgetInContainer->loadCoordFromText(":/textures/widget_in_container_info.txt");
 
     // item in widget in container
     inventoryItemsInContainer->loadCoordFromText(":/textures/widget_item_in_container_info.txt");
 
-    // text on the screen (slot = 3)
-    createTexture(textureFont, ":/textures/ascii.png", 3);
+    // text on the screen
     textOnScreen->loadUVCoordFromText(":/textures/text_info.txt");
 
     ////////////////////////////////////////////////////////////////////////////////////
@@ -190,6 +504,7 @@ void MyGL::initializeGL()
     // your program to render Chunks with vertex colors
     // and UV coordinates
     m_progLambert.setGeometryColor(glm::vec4(0,1,0,1));
+    m_progLambertAnimated.setGeometryColor(glm::vec4(0,1,0,1));
     m_progNPC.setGeometryColor(glm::vec4(0,1,0,1));
 
     // We have to have a VAO bound in OpenGL 3.2 Core. But if we're not
@@ -198,6 +513,42 @@ void MyGL::initializeGL()
 
     // m_terrain.CreateTestScene();
     // m_terrain.CreateTestGrassScene();
+
+    // Golden Tree (s): generated once, stamped when its chunks are filled
+    m_terrain.addErdtree(glm::ivec2(32, 48));
+
+    // Optional GPU height map / cave generation (needs GL 4.3)
+    if (qgetenv("MINIMINECRAFT_GPU_TERRAIN") != nullptr && !m_terrain.enableComputeBackend()) {
+        std::cout << "MINIMINECRAFT_GPU_TERRAIN is set but unsupported, generating on the CPU" << std::endl;
+    }
+
+    // One sub-allocated vertex buffer for all chunk meshes, drawn with one
+    // indirect draw per pass where GL 4.3 allows it
+    if (!m_terrain.enableMeshArena(meshArenaBytes)) {
+        std::cout << "No chunk mesh arena, chunks keep their own vertex buffers" << std::endl;
+    } else if (!m_terrain.enableMultiDraw()) {
+        std::cout << "No multi-draw indirect, each chunk is drawn on its own" << std::endl;
+    }
+
+    // Optional GPU chunk meshing into the arena (needs GL 4.3)
+    if (qgetenv("MINIMINECRAFT_GPU_MESHING") != nullptr && !m_terrain.enableComputeMeshing()) {
+        std::cout << "MINIMINECRAFT_GPU_MESHING is set but unsupported, meshing on the CPU" << std::endl;
+    }
+
+    // Greedy meshing from the start (G toggles it at runtime)
+    if (qgetenv("MINIMINECRAFT_GREEDY_MESHING") != nullptr) {
+        m_terrain.setGreedyMeshing(true);
+    }
+
+    // Experimental raymarched far field past the drawn chunks, built from
+    // the meshed ones (needs the block uvs, loaded above)
+    if (qgetenv("MINIMINECRAFT_FAR_FIELD") != nullptr) {
+        if (m_farField.create()) {
+            m_terrain.setMeshChangeTracking(true);
+        } else {
+            std::cout << "MINIMINECRAFT_FAR_FIELD is set but unsupported, the distant terrain is heightmaps only" << std::endl;
+        }
+    }
 }
 
 void MyGL::resizeGL(int w, int h) {
@@ -206,29 +557,97 @@ void MyGL::resizeGL(int w, int h) {
     m_player.setCameraWidthHeight(static_cast<unsigned int>(w), static_cast<unsigned int>(h));
     glm::mat4 viewproj = m_player.getCameraViewProj();
 
-    // Upload the view-projection matrix to our shaders (i.e. onto the graphics card)
+    // Upload the view-projection matrix and the screen's dimensions, shared
+    // by all our shaders (i.e. onto the graphics card)
+    m_frameUniforms.setViewProj(viewproj);
+    m_frameUniforms.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
+    m_inputRecorder.setViewSize(w, h);
+    if (m_inputReplay.isActive() && (w != m_inputReplay.getHeader().width || h != m_inputReplay.getHeader().height)) {
+        std::cout << "The input log was recorded at " << m_inputReplay.getHeader().width << " x "
+                  << m_inputReplay.getHeader().height << "; the mouse look will differ" << std::endl;
+    }
+    m_frameUniforms.upload();
 
-    m_progLambert.setViewProjMatrix(viewproj);
-    m_progFlat.setViewProjMatrix(viewproj);
-    m_progUnderwater.setViewProjMatrix(viewproj);
+    createRenderTargets();
 
-    m_frameBuffer.resize(this->width(), this->height(), this->devicePixelRatio());
-    m_frameBuffer.destroy();
-    m_frameBuffer.create();
-    m_progNPC.setViewProjMatrix(viewproj);
+    textOnScreen->resizeDimension(this->width(), this->height());
+
+    printGLErrorLog();
+}
 
-    m_progNoOp.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
-    m_progUnderwater.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
-    m_progLava.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
-    m_progInventoryWidgetOnHand.setDimensions(glm::ivec2(w * this->devicePixelRatio(), h * this->devicePixelRatio()));
+/**
+ * @brief MyGL::detectGpuMemoryBudget
+ *  Drivers without either extension, integrated GPUs among them, report
+ *  nothing; those need --gpu-memory-budget.
+ * @return the bytes the game budgets for, 0 if the driver does not say
+ */
+int64_t MyGL::detectGpuMemoryBudget() {
+    GLint kilobytes[4] = {0, 0, 0, 0};
+    float share = 0.f;
+    if (context()->hasExtension(QByteArrayLiteral("GL_NVX_gpu_memory_info"))) {
+        glGetIntegerv(GL_GPU_MEMORY_INFO_DEDICATED_VIDMEM_NVX, kilobytes);
+        share = dedicatedMemoryShare;
+    } else if (context()->hasExtension(QByteArrayLiteral("GL_ATI_meminfo"))) {
+        // the free memory of the pool, then its largest block, then the same for shared memory
+        glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, kilobytes);
+        share = freeMemoryShare;
+    }
+    return static_cast<int64_t>(static_cast<int64_t>(kilobytes[0]) * 1024 * share);
+}
+
+/**
+ * @brief MyGL::updateGpuMeshBudget
+ *  The chunk meshes get what the textures leave of the budget; the
+ *  render targets and the NPCs' buffers are small beside either and not
+ *  counted.
+ */
+void MyGL::updateGpuMeshBudget() {
+    if (m_gpuMemoryBudget <= 0) {
+        return;
+    }
+    int64_t meshBudget = m_gpuMemoryBudget - MemoryStats::getBytes(MemoryCategory::textures);
+    MemoryStats::setBudget(MemoryCategory::gpuMeshes, std::max<int64_t>(meshBudget, 1));
+}
 
+void MyGL::createRenderTargets() {
     m_frameBuffer.resize(this->width(), this->height(), this->devicePixelRatio());
+    m_frameBuffer.setScale(m_renderScale);
     m_frameBuffer.destroy();
     m_frameBuffer.create();
+    m_effectBuffer.resize(this->width(), this->height(), this->devicePixelRatio());
+    m_effectBuffer.destroy();
+    m_effectBuffer.create();
+    if (m_transparencyBuffer.isCreated()) {
+        m_transparencyBuffer.destroy();
+        m_transparencyBuffer.create(m_frameBuffer.pixelWidth(), m_frameBuffer.pixelHeight(),
+                                    m_frameBuffer.getDepthTexture());
+        m_terrain.setUnsortedTransparency(m_transparencyBuffer.isCreated());
+    }
+    // the history at the screen's size; what it held was of the old size or scale
+    if (s_temporalUpsample && m_renderScale < 1.f) {
+        m_temporalUpsampler.create(this->width(), this->height(), this->devicePixelRatio());
+    } else {
+        m_temporalUpsampler.destroy();
+    }
+    m_renderTargetsStale = false;
+}
 
-    textOnScreen->resizeDimension(this->width(), this->height());
-
-    printGLErrorLog();
+/**
+ * @brief MyGL::applyQualityLevel
+ *  The render scale never goes over the one main() asked for; the render
+ *  targets are only recreated in the next paintGL, where the context is
+ *  current.
+ */
+void MyGL::applyQualityLevel() {
+    const QualityLevel &level = m_quality.getLevel();
+    float renderScale = std::min(s_renderScale, level.renderScale);
+    if (renderScale != m_renderScale) {
+        m_renderScale = renderScale;
+        m_renderTargetsStale = true;
+    }
+    m_distantTerrain.setRingRadius(level.lodRadius);
+    m_npcSimulation.setLodScale(level.npcLodScale);
+    m_terrain.setUploadBudget(level.uploadBytes, level.uploadMicros);
 }
 
 
@@ -236,100 +655,594 @@ void MyGL::resizeGL(int w, int h) {
 // We're treating MyGL as our game engine class, so we're going to perform
 // all per-frame actions here, such as performing physics updates on all
 // entities in the scene.
+// tick() runs the input, stream and simulate phases of a frame, paintGL()
+// the rest (see FramePhase).
 void MyGL::tick() {
-    update(); // Calls paintGL() as part of a larger QOpenGLWidget pipeline
-    sendPlayerDataToGUI(); // Updates the info in the secondary window displaying player data
+    m_frameProfile.endFrame();
+    Profiler::global().endFrame();
+    // the frames loading the textures are long by design
+    if (!m_texturesPending && m_frameWatchdog.endFrame(m_frameProfile.getLastBusyMs())) {
+        m_frameWatchdog.capture(longFrameContext());
+    }
+    if (m_quality.isEnabled()) {
+        // the frame's cost: the main thread's work or the GPU's, whichever
+        // bounds it (the GPU's is a few frames old)
+        float costMs = std::max(m_frameProfile.getLastBusyMs(), m_gpuTimers.getLastFrameNs() / 1e6f);
+        if (m_quality.addFrame(costMs)) {
+            applyQualityLevel();
+        }
+    }
+    ProfileZone zone("MyGL::tick");
+    // the frame's temporaries, given back as it ends
+    LinearArena::Scope frameScratch(LinearArena::local());
+
+    m_frameProfile.begin(FramePhase::input);
+    // compute the delta-time
+    qint64 currFrameTime = m_frameClock.nsecsElapsed();
+    float deltaTime = (currFrameTime - prevFrameTime) / 1e9f;
+
+    prevFrameTime = currFrameTime;
+
+    // a replay stands in for the inputs and the frame time; a recording
+    // logs them, with the events that set them
+    if (m_inputReplay.isActive()) {
+        InputTick logged;
+        if (!m_inputReplay.readTick(logged)) {
+            std::cout << "Replayed " << m_inputReplay.getTicksRead() << " ticks\n"
+                      << m_frameProfile.toQString().toStdString() << std::endl;
+            QApplication::quit();
+            return;
+        }
+        replayInput(logged);
+        deltaTime = logged.deltaTime;
+    } else if (m_inputRecorder.isActive()) {
+        m_inputRecorder.recordTick(deltaTime, m_inputs);
+    }
+
+    drawGrabbedItem();
+
+    // the NPCs step until here: the terrain may add and drop chunks now
+    m_frameProfile.begin(FramePhase::stream);
+    {
+        ProfileZone wait("NPCSimulation::finish");
+        m_npcSimulation.finish();
+    }
+    NPCSimulationTimes npcTimes = m_npcSimulation.takeTimes();
+    if (m_npcBenchmark.isActive() && m_simulationSteps > npcWarmupSteps) {
+        m_npcBenchmark.recordFrame(deltaTime * 1000.f, npcTimes);
+    }
+
+    // the server's chunks and edits land with the terrain's own
+    if (m_netClient.isActive()) {
+        m_netClient.poll(m_terrain);
+        m_netClient.sendView(m_player.mcr_position, m_player.getCurrForward());
+        m_netClient.sendEdits(m_terrain);
+        if (!m_netClient.isActive()) {
+            // on our own from here
+            m_terrain.setEditTracking(false);
+        }
+    }
+
+    // where the player is headed ranks the terrain work and the uploads
+    m_terrain.setViewer(m_player.mcr_position, m_player.getCurrForward(), m_player.getVelocity());
 
     // call terrain expansion
     // TODO: use 5 x 5 zones
+    // every 100 ms of frame time, so a replay expands on the same ticks
     if (!m_terrain.m_initialTerrainLoaded) {
-        m_terrain.loadInitialTerrain(m_player.mcr_position[0], m_player.mcr_position[2], 2);
-        prevExpandTime = QDateTime::currentMSecsSinceEpoch();
+        m_terrain.loadInitialTerrain(m_player.mcr_position[0], m_player.mcr_position[2], halfGridSize());
+        m_expandAccumulator = 0.f;
     }
-    else if ((QDateTime::currentMSecsSinceEpoch() - prevExpandTime) >= 100)
+    else if ((m_expandAccumulator += deltaTime) >= 0.1f)
     {
-        m_terrain.expand(m_player.mcr_position[0], m_player.mcr_position[2], 2);
-        prevExpandTime = QDateTime::currentMSecsSinceEpoch();
+        updateGpuMeshBudget();
+        m_terrain.expand(m_player.mcr_position[0], m_player.mcr_position[2], halfGridSize());
+        m_expandAccumulator = 0.f;
     }
-    // check & (draw) send to gpu
+    // check & (draw) send to gpu, the chunks in view first
     m_terrain.checkThreadResults();
+    // the low-detail ring beyond the 5 x 5 zones
+    m_distantTerrain.update(m_player.mcr_position[0], m_player.mcr_position[2], halfGridSize(), s_viewRadius);
+    // the NPCs come with the chunks they are in and go with them; the
+    // benchmark's and the server's stay as they are
+    if (!m_npcBenchmark.isActive() && s_serverHost.isEmpty()
+            && m_npcSpawner.update(m_npcs, deltaTime, m_player.mcr_position)) {
+        m_npcSimulation.setNPCs(m_npcs, m_terrain);
+    }
 
-    // compute the delta-time
-    long long currFrameTime = QDateTime::currentMSecsSinceEpoch();
-    float deltaTime = (currFrameTime - prevFrameTime) / 1000.f;
+    m_frameProfile.begin(FramePhase::simulate);
+    // a logged session starts as it did without the hold, whose release
+    // depends on the terrain threads; the scripted runs place the player
+    if (m_playerHeld) {
+        if (m_inputRecorder.isActive() || m_inputReplay.isActive() || m_npcBenchmark.isActive() || m_scriptedCamera) {
+            m_playerHeld = false;
+        } else {
+            landHeldPlayer();
+        }
+    }
+    m_simulationAccumulator += deltaTime;
+    for (int steps = 0; steps < maxStepsPerTick && m_simulationAccumulator >= simulationStep; steps++) {
+        m_prevPlayerPosition = m_player.mcr_position;
+        // pass the step to Player::tick
+        if (!m_playerHeld) {
+            m_player.tick(simulationStep, m_inputs);
+        }
+        if (m_npcBenchmark.isActive()) {
+            followBenchmarkPath(m_simulationSteps * simulationStep);
+        } else if (m_scriptedCamera) {
+            posePlayer(m_scriptedPosition, m_scriptedLook);
+            m_prevPlayerPosition = m_scriptedPosition;
+        }
+        // steve model
+        m_player_model.tick(simulationStep, m_inputs);
+        m_simulationAccumulator -= simulationStep;
+        m_simulationSteps++;
+    }
+    // drop what the step cap left over
+    m_simulationAccumulator = std::min(m_simulationAccumulator, simulationStep);
+    float alpha = m_simulationAccumulator / simulationStep;
+    m_player.setRenderOffset((m_prevPlayerPosition - m_player.mcr_position) * (1.f - alpha));
+
+    // lit TNT whose fuse burnt out blasts, before the liquids it opens flow
+    m_terrain.updateExplosions(deltaTime);
+    // the crumbs of the blocks broken this tick, and the weather where
+    // the player is; paintGL steps them
+    m_player.takeBrokenBlocks(m_brokenBlocks);
+    for (const BlockEdit &broken : m_brokenBlocks) {
+        m_particles.emitBlockBreak(broken.pos, broken.type);
+    }
+    updateWeather();
+    m_particleDeltaTime += deltaTime;
+    // the liquids the edits woke flow a step, before the NPCs read the blocks
+    m_terrain.updateLiquids(deltaTime);
+    // the server runs the block ticks of a connected game and sends their edits
+    if (s_serverHost.isEmpty()) {
+        m_terrain.updateBlockTicks(deltaTime, m_player.mcr_position);
+    }
+    // the NPCs step in fixed steps on their own threads until the next tick
+    if (m_simulationSteps > npcWarmupSteps)
+    {
+        m_npcSimulation.begin(deltaTime, m_player.mcr_position);
+    }
+    m_frameProfile.end();
 
-    prevFrameTime = currFrameTime;
+    if (m_npcBenchmark.isActive() && m_npcBenchmark.isDone()) {
+        m_npcSimulation.finish();
+        m_npcBenchmark.printReport(m_npcs.size());
+        QApplication::quit();
+        return;
+    }
 
-    drawGrabbedItem();
+    // nothing is drawn for a window nobody sees
+    if (!m_idle || isOnScreen()) {
+        update(); // Calls paintGL() as part of a larger QOpenGLWidget pipeline
+    }
+}
 
-    // pass delta-time to Player::tick
-    m_player.tick(deltaTime, m_inputs);
-    // steve model
-    m_player_model.tick(deltaTime, m_inputs);
+void MyGL::slot_frameSwapped() {
+    m_frameProfile.end();
+    // m_timer ticks while idle
+    if (s_frameLoop != FrameLoop::timer && !m_idle) {
+        tick();
+    }
+}
 
-    // TODO: pass delta-time to NPC's tick as well
-    if (frameCount > 15.f * 60.f)
-    {
-        for (const uPtr<NPC> &npc : m_npcs)
-        {
-            npc->tick(deltaTime);
-        }
+/**
+ * @brief MyGL::slot_applicationStateChanged
+ *  The logged and benchmarked runs keep their pace: their frame times are
+ *  what they measure or replay.
+ * @param state
+ */
+void MyGL::slot_applicationStateChanged(Qt::ApplicationState state) {
+    bool idle = s_idleThrottle && state != Qt::ApplicationActive && !m_headless
+            && !m_inputRecorder.isActive() && !m_inputReplay.isActive() && !m_npcBenchmark.isActive();
+    if (idle == m_idle) {
+        return;
+    }
+    m_idle = idle;
+    m_terrain.setSpeculativeGeneration(!idle);
+    if (idle) {
+        m_timer.start(idleTickMs);
+        return;
+    }
+    if (s_frameLoop == FrameLoop::timer) {
+        m_timer.start(16);
+    } else {
+        m_timer.stop();
     }
+    // the next frame now rather than at the next idle tick; its swap
+    // starts the frame loop again
+    update();
+}
+
+bool MyGL::isOnScreen() const {
+#ifdef MINIMINECRAFT_GL_WINDOW
+    return isExposed() && visibility() != QWindow::Minimized;
+#else
+    const QWindow *handle = window()->windowHandle();
+    return !window()->isMinimized() && (handle == nullptr || handle->isExposed());
+#endif
+}
+
+void MyGL::setIdleThrottle(bool throttle) {
+    s_idleThrottle = throttle;
+}
+
+void MyGL::setFrameLoop(FrameLoop loop) {
+    s_frameLoop = loop;
+}
+
+void MyGL::setLowLatency(bool lowLatency) {
+    s_lowLatency = lowLatency;
+}
+
+void MyGL::setRenderBackend(RenderBackendKind kind) {
+    s_renderBackend = kind;
+}
+
+void MyGL::setNPCBenchmark(int npcsPerType, int frames) {
+    s_benchmarkNPCsPerType = npcsPerType;
+    s_benchmarkFrames = frames;
+}
+
+void MyGL::setRenderScale(float renderScale, float effectScale) {
+    s_renderScale = renderScale;
+    s_effectScale = effectScale;
+}
+
+void MyGL::setTemporalUpsample(bool temporal) {
+    s_temporalUpsample = temporal;
+}
+
+void MyGL::setProceduralEffects(bool procedural) {
+    s_proceduralEffects = procedural;
+}
+
+void MyGL::setTextureQuality(float anisotropy, bool compressed) {
+    s_anisotropy = anisotropy;
+    s_compressTextures = compressed;
+}
+
+void MyGL::setShadowResolution(int resolution) {
+    s_shadowResolution = resolution;
+}
+
+void MyGL::setPointLights(bool enabled) {
+    s_pointLights = enabled;
+}
+
+void MyGL::setParticles(bool enabled) {
+    s_particles = enabled;
+}
+
+void MyGL::setInfoRate(int updatesPerSecond) {
+    s_infoRate = updatesPerSecond;
+}
+
+void MyGL::setDeferredCaves(bool deferred) {
+    s_deferredCaves = deferred;
+}
+
+void MyGL::setMeshCache(bool enabled) {
+    s_meshCache = enabled;
+}
+
+void MyGL::setViewRadius(int chunks) {
+    s_viewRadius = chunks;
+}
+
+int MyGL::halfGridSize() const {
+    // the square of 5 x 5 zones, or the one around the view radius
+    return s_viewRadius > 0 ? Terrain::halfGridForRadius(s_viewRadius) : 2;
+}
 
+void MyGL::setOrderIndependentTransparency(bool enabled) {
+    s_orderIndependentTransparency = enabled;
 }
 
-void MyGL::sendPlayerDataToGUI() const {
-    emit sig_sendPlayerPos(m_player.posAsQString());
-    emit sig_sendPlayerVel(m_player.velAsQString());
-    emit sig_sendPlayerAcc(m_player.accAsQString());
-    emit sig_sendPlayerLook(m_player.lookAsQString());
+void MyGL::setDepthPrePass(bool enabled) {
+    s_depthPrePass = enabled;
+}
+
+void MyGL::setReverseZ(bool enabled) {
+    s_reverseZ = enabled;
+}
+
+void MyGL::setTargetFrameTime(float ms) {
+    s_targetFrameMs = ms;
+}
+
+void MyGL::setLongFrameTime(float ms) {
+    s_longFrameMs = ms;
+}
+
+void MyGL::setGpuMemoryBudget(int megabytes) {
+    s_gpuMemoryBudgetMB = megabytes;
+}
+
+void MyGL::setInputLog(const QString &recordPath, const QString &replayPath) {
+    s_inputRecordPath = recordPath;
+    s_inputReplayPath = replayPath;
+}
+
+void MyGL::setServer(const QString &host, quint16 port) {
+    s_serverHost = host;
+    s_serverPort = port;
+}
+
+/**
+ * @brief MyGL::sendPlayerDataToGUI
+ *  Each field the window shows costs it a layout and a repaint, which at
+ *  the frame rate took as long as a frame's worth of its own drawing; so
+ *  the fields are sent s_infoRate times a second at most, and only those
+ *  whose text differs from what the window already shows.
+ */
+void MyGL::sendPlayerDataToGUI() {
+    m_infoFrames++;
+    qint64 now = m_frameClock.nsecsElapsed();
+    if (s_infoRate <= 0 || now - m_lastInfoTime < 1000000000 / s_infoRate) {
+        return;
+    }
+    float seconds = (now - m_lastInfoTime) / 1e9f;
+
+    sendInfo(InfoField::pos, m_player.posAsQString(), &MyGL::sig_sendPlayerPos);
+    sendInfo(InfoField::vel, m_player.velAsQString(), &MyGL::sig_sendPlayerVel);
+    sendInfo(InfoField::acc, m_player.accAsQString(), &MyGL::sig_sendPlayerAcc);
+    sendInfo(InfoField::look, m_player.lookAsQString(), &MyGL::sig_sendPlayerLook);
     glm::vec2 pPos(m_player.mcr_position.x, m_player.mcr_position.z);
     glm::ivec2 chunk(16 * glm::ivec2(glm::floor(pPos / 16.f)));
     glm::ivec2 zone(64 * glm::ivec2(glm::floor(pPos / 64.f)));
-    emit sig_sendPlayerChunk(QString::fromStdString("( " + std::to_string(chunk.x) + ", " + std::to_string(chunk.y) + " )"));
-    emit sig_sendPlayerTerrainZone(QString::fromStdString("( " + std::to_string(zone.x) + ", " + std::to_string(zone.y) + " )"));
+    if (chunk != m_sentChunk) {
+        m_sentChunk = chunk;
+        sendInfo(InfoField::chunk, QString("( %1, %2 )").arg(chunk.x).arg(chunk.y), &MyGL::sig_sendPlayerChunk);
+    }
+    if (zone != m_sentZone) {
+        m_sentZone = zone;
+        sendInfo(InfoField::zone, QString("( %1, %2 )").arg(zone.x).arg(zone.y), &MyGL::sig_sendPlayerTerrainZone);
+    }
+    sendInfo(InfoField::uploadQueue, QString("%1 chunks").arg(m_terrain.getPendingUploadCount()),
+             &MyGL::sig_sendTerrainUploadQueue);
+    TerrainCullStats cull = m_terrain.getCullStats(TerrainDrawType::opaque);
+    sendInfo(InfoField::culling, QString("%1 / %2 chunks, %3 / %4 sections (%5 occluded)")
+             .arg(cull.visibleChunks).arg(cull.visibleChunks + cull.culledChunks)
+             .arg(cull.visibleSections)
+             .arg(cull.visibleSections + cull.culledSections + cull.occludedSections)
+             .arg(cull.occludedSections), &MyGL::sig_sendTerrainCulling);
+    sendInfo(InfoField::framePhases, m_frameProfile.toQString(), &MyGL::sig_sendFramePhases);
+    sendInfo(InfoField::terrainPipeline, terrainPipelineText(), &MyGL::sig_sendTerrainPipeline);
+    sendInfo(InfoField::memory, memoryText(), &MyGL::sig_sendMemory);
+    sendInfo(InfoField::performance, performanceText(seconds), &MyGL::sig_sendPerformance);
+
+    m_lastInfoTime = now;
+    m_infoFrames = 0;
 }
 
-void MyGL::stopWalkingSounds(){
-    if(grassWalkingEffect.isPlaying()) grassWalkingEffect.stop();
-    if(rockWalkingEffect.isPlaying()) rockWalkingEffect.stop();
-    if(glassWalkingEffect.isPlaying()) glassWalkingEffect.stop();
+void MyGL::sendInfo(InfoField field, const QString &text, void (MyGL::*signal)(QString) const) {
+    QString &sent = m_sentInfo[static_cast<size_t>(field)];
+    if (text != sent) {
+        sent = text;
+        emit (this->*signal)(text);
+    }
+}
 
+/**
+ * @brief MyGL::performanceText
+ *  The frame rate is over the frames since the last send; the frame times
+ *  are the last frame's, the GPU's a few frames old.
+ */
+QString MyGL::performanceText(float seconds) const {
+    const TerrainJobSystem &jobs = m_terrain.getJobSystem();
+    return QString("%1 fps, %2 ms CPU, %3 ms GPU\n"
+                   "queued: %4 uploads, %5 explosions, %6 generation, %7 meshing jobs")
+            .arg(m_infoFrames / std::max(seconds, 1e-3f), 0, 'f', 0)
+            .arg(m_frameProfile.getLastBusyMs(), 0, 'f', 1)
+            .arg(m_gpuTimers.getLastFrameNs() / 1e6, 0, 'f', 1)
+            .arg(m_terrain.getPendingUploadCount()).arg(m_terrain.getPendingExplosionCount())
+            .arg(jobs.getStats(TerrainJobQueue::generation).queued)
+            .arg(jobs.getStats(TerrainJobQueue::meshing).queued);
 }
 
-void MyGL::playWalkingSounds(){
-    if(m_player.blockTouchingPlayer == GRASS){
-        if(rockWalkingEffect.isPlaying()) rockWalkingEffect.stop();
-        if(glassWalkingEffect.isPlaying()) glassWalkingEffect.stop();
-        if(m_player.isWalking()){
-            if(!grassWalkingEffect.isPlaying()) grassWalkingEffect.play();
-        }
-        else {
-            grassWalkingEffect.stop();
-        }
+/**
+ * @brief MyGL::terrainPipelineText
+ *  The job times are averages over the jobs completed so far; the jobs
+ *  include the distant terrain's, which shares the queues.
+ */
+QString MyGL::terrainPipelineText() const {
+    QString text;
+    const TerrainJobSystem &jobs = m_terrain.getJobSystem();
+    for (TerrainJobQueue queue : {TerrainJobQueue::generation, TerrainJobQueue::meshing, TerrainJobQueue::io}) {
+        TerrainJobStats stats = jobs.getStats(queue);
+        double done = std::max<double>(1.0, stats.completed);
+        text += QString("%1: %2 queued, %3 running, %4 done, %5 dropped; %6 ms wait, %7 ms CPU (max %8)\n")
+                .arg(TerrainJobSystem::getName(queue)).arg(stats.queued).arg(stats.running)
+                .arg(stats.completed).arg(stats.cancelled)
+                .arg(stats.waitNs / done / 1e6, 0, 'f', 2).arg(stats.cpuNs / done / 1e6, 0, 'f', 2)
+                .arg(stats.maxCpuNs / 1e6, 0, 'f', 2);
     }
-    else if(m_player.blockTouchingPlayer == STONE || m_player.blockTouchingPlayer == DIRT){
-        if(glassWalkingEffect.isPlaying()) glassWalkingEffect.stop();
-        if(grassWalkingEffect.isPlaying()) grassWalkingEffect.stop();
-        if(m_player.isWalking()){
-            if(!rockWalkingEffect.isPlaying()) rockWalkingEffect.play();
-        }
-        else {
-            rockWalkingEffect.stop();
+    TerrainPipelineStats pipeline = m_terrain.getPipelineStats();
+    double shown = std::max<double>(1.0, pipeline.chunksShown);
+    text += QString("shown: %1 chunks, %2 ms after their request (max %3); the first after %4 ms\n")
+            .arg(pipeline.chunksShown).arg(pipeline.showLatencyNs / shown / 1e6, 0, 'f', 1)
+            .arg(pipeline.maxShowLatencyNs / 1e6, 0, 'f', 1)
+            .arg(pipeline.firstShownNs < 0 ? QString("-") : QString::number(pipeline.firstShownNs / 1e6, 'f', 1));
+    text += QString("uploaded: %1 KB/frame (last %2 KB), %3 meshes, %4 MB in all")
+            .arg(pipeline.averageUploadBytes / 1024.0, 0, 'f', 1).arg(pipeline.lastUploadBytes / 1024.0, 0, 'f', 1)
+            .arg(pipeline.uploads).arg(pipeline.uploadBytes / 1048576.0, 0, 'f', 1);
+    text += QString("\nmesh pool: %1 zones, %2 MB; %3 zones drawn again from it")
+            .arg(pipeline.pooledZones).arg(pipeline.pooledMeshBytes / 1048576.0, 0, 'f', 1)
+            .arg(pipeline.pooledZonesRestored);
+    text += QString("\nmesh cache: %1 chunks read back, %2 meshed")
+            .arg(pipeline.meshCacheHits).arg(pipeline.meshCacheMisses);
+    const LiquidSimulation &liquids = m_terrain.getLiquids();
+    text += QString("\nliquids: %1 cells queued, %2 flowing, %3 updated last step")
+            .arg(liquids.getQueuedCellCount()).arg(liquids.getFlowingCellCount()).arg(liquids.getLastStepCellCount());
+    const BlockTicks &ticks = m_terrain.getBlockTicks();
+    text += QString("\nblock ticks: %1 scheduled; last update ran %2 and %3 random, dropped %4 columns%5")
+            .arg(ticks.getScheduledCount()).arg(ticks.getLastScheduledRunCount()).arg(ticks.getLastRandomTickCount())
+            .arg(ticks.getLastFallenColumnCount()).arg(ticks.wasLastOverBudget() ? ", over budget" : "");
+    text += QString("\nNPCs: %1 spawned, %2 being built, %3 kept in unloaded chunks")
+            .arg(m_npcSpawner.getSpawnedCount()).arg(m_npcSpawner.getBuildingCount())
+            .arg(m_npcSpawner.getRecordCount());
+    text += QString("\nNPC sprites: %1 baked, %2 drawn last frame")
+            .arg(m_npcImpostors.getSpriteCount()).arg(m_npcImpostors.getInstanceCount());
+    text += QString("\nGPU budget: %1 zones without meshes; %2 evictions")
+            .arg(pipeline.budgetEvictedZones).arg(pipeline.budgetEvictions);
+    text += QString("\nchunk pool: %1 chunks; %2 instantiated from it, %3 constructed")
+            .arg(pipeline.pooledChunks).arg(pipeline.chunksReused).arg(pipeline.chunksCreated);
+    if (m_farField.isCreated()) {
+        text += QString("\nfar field: %1 bricks, %2 zones in place of heightmaps")
+                .arg(m_farField.getBrickCount()).arg(m_farField.getCoveredZones().size());
+    }
+    if (!s_serverHost.isEmpty()) {
+        text += QString("\nserver %1: %2").arg(s_serverHost)
+                .arg(m_netClient.isActive() ? m_netClient.getStats().toQString() : m_netClient.getError());
+    }
+    return text;
+}
+
+/**
+ * @brief MyGL::memoryText
+ *  Each category's bytes now, its peak, and its budget if it has one.
+ */
+QString MyGL::memoryText() const {
+    QString text;
+    for (int i = 0; i < MemoryStats::categoryCount; i++) {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        text += QString("%1: %2 MB (peak %3)").arg(MemoryStats::getName(category))
+                .arg(MemoryStats::getBytes(category) / 1048576.0, 0, 'f', 1)
+                .arg(MemoryStats::getPeakBytes(category) / 1048576.0, 0, 'f', 1);
+        if (MemoryStats::getBudget(category) > 0) {
+            text += QString(", budget %1").arg(MemoryStats::getBudget(category) / 1048576.0, 0, 'f', 1);
         }
+        text += "\n";
     }
-    else if(m_player.blockTouchingPlayer == DIAMOND){
-        if(grassWalkingEffect.isPlaying()) grassWalkingEffect.stop();
-        if(rockWalkingEffect.isPlaying()) rockWalkingEffect.stop();
-        if(m_player.isWalking()){
-            if(!glassWalkingEffect.isPlaying()) glassWalkingEffect.play();
+    text += QString("total: %1 MB").arg(MemoryStats::getTotalBytes() / 1048576.0, 0, 'f', 1);
+    text += QString("\ninterned sections: %1 (%2 shared)").arg(BlockSection::getInternedCount())
+            .arg(BlockSection::getInternHitCount());
+    text += QString("\nhot chunks: %1, cold chunks: %2").arg(m_terrain.getHotChunkCount())
+            .arg(m_terrain.getColdChunkCount());
+    return text;
+}
+
+/**
+ * @brief MyGL::addHeatmapText
+ *  The heatmap's metric and the value red stands for, at the bottom left.
+ */
+void MyGL::addHeatmapText() {
+    ChunkHeatmapMetric metric = m_chunkHeatmap.getMetric();
+    const char *unit = metric == ChunkHeatmapMetric::meshTime ? " MS" : "";
+    char line[64];
+    std::snprintf(line, sizeof(line), "HEATMAP %s  RED %.*f%s", ChunkHeatmap::getMetricName(metric),
+                  metric == ChunkHeatmapMetric::meshTime ? 2 : 0, m_chunkHeatmap.getMaxValue(), unit);
+    textOnScreen->addText(line, glm::vec2(-0.98f, -0.9f), 0.04f);
+}
+
+/**
+ * @brief MyGL::addProfilerText
+ *  The frame time, then a line per zone, with the times it ran last frame
+ *  if more than once: the CPU's, then the GPU's passes; then the memory
+ *  of each MemoryCategory. The font has capitals only, hence the upper
+ *  case.
+ */
+void MyGL::addProfilerText() {
+    const float height = 0.04f;
+    glm::vec2 pos(-0.98f, 0.97f);
+    auto addLine = [&](const std::string &name, float value, const char *unit) {
+        char line[64];
+        std::snprintf(line, sizeof(line), "%-28.28s%7.2f %s", name.c_str(), value, unit);
+        for (char *c = line; *c != '\0'; c++) {
+            *c = static_cast<char>(std::toupper(static_cast<unsigned char>(*c)));
         }
-        else {
-            glassWalkingEffect.stop();
+        textOnScreen->addText(line, pos, height);
+        pos.y -= height * 1.25f;
+    };
+    Profiler &profiler = Profiler::global();
+    addLine("frame", profiler.getFrameAverageMs(), "MS");
+    for (const ProfileZoneAverage &zone : profiler.getAverages()) {
+        std::string calls = zone.lastCalls > 1 ? " X" + std::to_string(zone.lastCalls) : "";
+        addLine((zone.gpu ? "GPU " : "") + zone.name + calls, zone.averageMs, "MS");
+    }
+    for (int i = 0; i < MemoryStats::categoryCount; i++) {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        addLine(std::string("memory ") + MemoryStats::getName(category),
+                MemoryStats::getBytes(category) / 1048576.f, "MB");
+    }
+    if (m_quality.isEnabled()) {
+        addLine("quality level", static_cast<float>(m_quality.getLevelIndex()), "");
+        addLine("quality average", m_quality.getAverageMs(), "MS");
+        addLine("quality target", m_quality.getTarget(), "MS");
+        if (!m_quality.getLastDecision().isEmpty()) {
+            std::string decision = "quality " + m_quality.getLastDecision().toStdString();
+            for (char &c : decision) {
+                c = static_cast<char>(std::toupper(static_cast<unsigned char>(c)));
+            }
+            textOnScreen->addText(decision.c_str(), pos, height);
+            pos.y -= height * 1.25f;
         }
     }
-    else {
-        stopWalkingSounds();
+    if (m_netClient.isActive()) {
+        const NetStats &net = m_netClient.getStats();
+        addLine("net in", net.getReceivedPerSecond() / 1024.f, "KB/S");
+        addLine("net out", net.getSentPerSecond() / 1024.f, "KB/S");
+        addLine("net round trip", net.getRoundTripMs(), "MS");
+    }
+}
+
+void MyGL::exportProfilerTrace() const {
+    QDir dir(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation));
+    QString path = dir.filePath(QString("trace-%1.json").arg(QDateTime::currentDateTime().toString("yyyyMMdd-hhmmss")));
+    if (dir.mkpath(".") && Profiler::global().exportChromeTrace(path)) {
+        std::cout << "Wrote the profiler's trace to " << path.toStdString() << std::endl;
+    } else {
+        std::cout << "Could not write the profiler's trace to " << path.toStdString() << std::endl;
+    }
+}
+
+/**
+ * @brief MyGL::longFrameContext
+ *  As of the long frame's end: the terrain's activity is that of the
+ *  frame's own expand and checkThreadResults.
+ */
+std::vector<std::pair<QString, QString>> MyGL::longFrameContext() const {
+    TerrainFrameActivity activity = m_terrain.getFrameActivity();
+    return {
+        {"frame phases", m_frameProfile.toQString()},
+        {"terrain jobs", terrainPipelineText()},
+        {"terrain activity", QString("expand %1 the zone sets; checkThreadResults uploaded %2 meshes "
+                                     "(%3 KB); %4 chunks await a stage, %5 a mesh, %6 meshes an upload")
+         .arg(activity.zoneSetsUpdated ? "rebuilt" : "kept").arg(activity.uploads)
+         .arg(activity.uploadBytes / 1024).arg(activity.chunksAwaitingStage)
+         .arg(activity.chunksAwaitingMesh).arg(activity.pendingUploads)},
+        {"explosions pending", QString::number(m_terrain.getPendingExplosionCount())},
+        {"memory", memoryText()}
+    };
+}
+
+void MyGL::updateWeather() {
+    glm::vec3 pos = m_player.mcr_position;
+    int surface = m_terrain.getSurfaceHeight(static_cast<int>(glm::floor(pos.x)), static_cast<int>(glm::floor(pos.z)));
+    // not in a cave under the cap either
+    if (surface > snowLine && pos.y > surface - 8.f) {
+        m_particles.setSnowfall(glm::vec3(pos.x, static_cast<float>(surface), pos.z), surface - 4.f, snowRadius);
+    } else {
+        m_particles.stopWeather();
+    }
+}
+
+StepSound MyGL::walkingSound() const {
+    if(!m_player.isWalking()){
+        return StepSound::none;
+    }
+    switch(m_player.getEnvironment().ground){
+    case GRASS:
+        return StepSound::grass;
+    case STONE:
+    case DIRT:
+        return StepSound::rock;
+    case DIAMOND:
+        return StepSound::glass;
+    default:
+        return StepSound::none;
     }
 }
 
@@ -337,30 +1250,104 @@ void MyGL::playWalkingSounds(){
 // MyGL's constructor links update() to a timer that fires 60 times per second,
 // so paintGL() called at a rate of 60 frames per second.
 void MyGL::paintGL() {
+    if (m_headless && !m_headlessSized) {
+        return;
+    }
+    ProfileZone zone("MyGL::paintGL");
+    LinearArena::Scope frameScratch(LinearArena::local());
+    m_gpuTimers.beginFrame();
+    // Qt may have drawn with a program of its own since the last frame
+    forgetProgramInUse();
+    if (m_renderTargetsStale) {
+        createRenderTargets();
+    }
+    if (m_texturesPending) {
+        uploadDecodedTextures();
+    }
+    if (s_lowLatency) {
+        // the GPU done with the last frame, so this one is not queued
+        // behind it with a look older still
+        if (m_frameFence != nullptr) {
+            glClientWaitSync(m_frameFence, GL_SYNC_FLUSH_COMMANDS_BIT, frameFenceTimeout);
+            glDeleteSync(m_frameFence);
+            m_frameFence = nullptr;
+        }
+        sampleMouseLook();
+    }
+    // a new spot of each pixel every frame, for the upsampler to gather
+    bool temporal = m_temporalUpsampler.isCreated() && m_renderScale < 1.f;
+    m_player.setCameraJitter(temporal ? m_temporalUpsampler.beginFrame(m_frameBuffer.pixelWidth(),
+                                                                       m_frameBuffer.pixelHeight())
+                                      : glm::vec2(0.f));
+    // the sections in view, for both terrain passes
+    m_frameProfile.begin(FramePhase::cull);
+    m_terrain.setCullingView(m_player.getCameraViewProj(), m_player.getCameraPosition());
+    m_terrain.cull(m_player.mcr_position[0], m_player.mcr_position[2], halfGridSize());
+    if (s_pointLights) {
+        m_terrain.collectLights(pointLightRange, m_pointLights);
+    }
 
-    // Clear the screen so that we only see newly drawn images
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // the shadow cascades the new meshes or the player's moves made stale
+    m_frameProfile.begin(FramePhase::shadow);
+    m_terrain.takeMeshChanges(m_meshChanges);
+    if (m_shadowMap.isCreated()) {
+        m_gpuTimers.begin(GpuPass::shadow);
+        m_shadowMap.invalidateChunks(m_meshChanges);
+        m_shadowMap.update(m_terrain, m_progShadow, m_player.getCameraPosition(),
+                           m_player.mcr_position[0], m_player.mcr_position[2], halfGridSize());
+    }
 
-    // Bind FrameBuffer for Overlay
-    m_frameBuffer.bindFrameBuffer();
-    glViewport(0,0,this->width() * this->devicePixelRatio(), this->height() * this->devicePixelRatio());
+    m_frameProfile.begin(FramePhase::record);
+    // the far field's bricks of the new meshes, around the player
+    m_farField.update(m_terrain, m_meshChanges, m_player.mcr_position[0], m_player.mcr_position[2]);
+    // The scene goes through m_frameBuffer only for a post effect, an
+    // upscale, the transparency buffer or the reversed depth, which needs
+    // its float depth; otherwise it is drawn to the screen directly
+    ShaderProgram *effect = updatePostEffect();
+    bool offscreen = effect != nullptr || m_renderScale < 1.f || m_transparencyBuffer.isCreated()
+            || m_clipControl != nullptr;
+    setSceneDepth(true);
+    if (offscreen) {
+        // Bind FrameBuffer for Overlay
+        m_frameBuffer.bindFrameBuffer();
+        glViewport(0, 0, m_frameBuffer.pixelWidth(), m_frameBuffer.pixelHeight());
+    } else {
+        glBindFramebuffer(GL_FRAMEBUFFER, this->defaultFramebufferObject());
+        glViewport(0,0,this->width() * this->devicePixelRatio(), this->height() * this->devicePixelRatio());
+    }
+    // Clear the screen so that we only see newly drawn images
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    m_progFlat.setViewProjMatrix(m_player.getCameraViewProj());
-    m_progLambert.setViewProjMatrix(m_player.getCameraViewProj());
-    m_progNPC.setViewProjMatrix(m_player.getCameraViewProj());
+    // the lights sorted into the clusters of the target's pixels
+    if (offscreen) {
+        m_clusteredLights.update(m_pointLights, m_player.getCameraViewProj(),
+                                 m_frameBuffer.pixelWidth(), m_frameBuffer.pixelHeight());
+    } else {
+        m_clusteredLights.update(m_pointLights, m_player.getCameraViewProj(), this->width() * this->devicePixelRatio(),
+                                 this->height() * this->devicePixelRatio());
+    }
 
-    m_progLambert.setTime(frameCount);
-    m_progLava.setTime(frameCount);
-    m_progUnderwater.setTime(frameCount);
-    m_progNPC.setTime(frameCount);
+    // one upload for every program this frame
+    m_frameUniforms.setViewProj(m_player.getCameraViewProj());
+    m_frameUniforms.setTime(m_simulationSteps);
+    m_frameUniforms.upload();
 
+    if (s_depthPrePass) {
+        m_gpuTimers.begin(GpuPass::depth);
+        renderDepthPrePass();
+    }
+    m_gpuTimers.begin(GpuPass::opaque);
     renderTerrain(TerrainDrawType::opaque);
+    // stepped and drawn with the opaque pass: they are cut out, not blended
+    if (m_particles.isCreated()) {
+        m_particles.update(m_progParticleUpdate, m_particleDeltaTime);
+        m_particleDeltaTime = 0.f;
+        m_particles.draw(m_progParticle, 0, m_player.getCameraPosition());
+    }
 
     glDisable(GL_DEPTH_TEST);
 
     m_progFlat.setModelMatrix(glm::mat4());
-    m_progFlat.setViewProjMatrix(m_player.getCameraViewProj());
 
     //m_progFlat.draw(m_worldAxes);
 
@@ -368,87 +1355,223 @@ void MyGL::paintGL() {
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    renderTerrain(TerrainDrawType::transparent);
+    m_gpuTimers.begin(GpuPass::transparent);
+    if (m_transparencyBuffer.isCreated()) {
+        renderTransparencyBuffer();
+    } else {
+        renderTerrain(TerrainDrawType::transparent);
+    }
+    m_gpuTimers.begin(GpuPass::npcs);
     // render steve
     renderPlayerModel();
     // render NPCs
     renderNPCs();
+    // the debug view, over the scene as the last draw culled it
+    if (m_chunkHeatmap.getMetric() != ChunkHeatmapMetric::off) {
+        m_chunkHeatmap.update(m_terrain);
+        m_progFlat.setModelMatrix(glm::mat4());
+        m_progFlat.draw(m_chunkHeatmap);
+    }
     glDisable(GL_BLEND);
+    setSceneDepth(false);
+
+    m_frameProfile.begin(FramePhase::post);
+    m_gpuTimers.begin(GpuPass::post);
+    if (offscreen) {
+        if (temporal) {
+            m_temporalUpsampler.resolve(m_frameBuffer, m_progTemporal, m_quad, m_player.getCameraViewProj(), 1);
+        } else {
+            m_frameBuffer.bindToTextureSlot(1);
+        }
+        if (effect != nullptr && m_postNoise.isCreated()) {
+            m_postNoise.bindToTextureSlot();
+        }
 
-    // Draw Golden Tree (s)
-    m_terrain.drawErdtree(glm::ivec2(32, 48));
-
-    glBindFramebuffer(GL_FRAMEBUFFER, this->defaultFramebufferObject());
-    glViewport(0,0,this->width() * this->devicePixelRatio(), this->height() * this->devicePixelRatio());
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    m_frameBuffer.bindToTextureSlot(1);
-
-    // Post-process Shaders
-    if(m_player.isUnderWater(m_terrain, m_inputs)){
-        stopWalkingSounds();
-        if(!waterEffect.isPlaying()) waterEffect.play();
-        m_progUnderwater.setTexture(m_frameBuffer.getTextureSlot());
-        m_progUnderwater.drawOverlay(m_quad);
-    }
-    else if(m_player.isUnderLava(m_terrain, m_inputs)){
-        stopWalkingSounds();
-        if(!lavaEffect.isPlaying()) lavaEffect.play();
-        m_progLava.setTexture(m_frameBuffer.getTextureSlot());
-        m_progLava.drawOverlay(m_quad);
-    }
-    else{
-        if(waterEffect.isPlaying()) waterEffect.stop();
-        if(lavaEffect.isPlaying()) lavaEffect.stop();
+        // the distortions are smooth enough to run on fewer pixels: into
+        // m_effectBuffer, then upscaled like the scene
+        if (effect != nullptr && s_effectScale < 1.f) {
+            m_effectBuffer.bindFrameBuffer();
+            glViewport(0, 0, m_effectBuffer.pixelWidth(), m_effectBuffer.pixelHeight());
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            effect->setTexture(m_frameBuffer.getTextureSlot());
+            glUniform1i(effect->uniformLocation("u_Noise"), PostNoise::textureSlot);
+            effect->drawOverlay(m_quad);
+            m_effectBuffer.bindToTextureSlot(1);
+            effect = nullptr;
+        }
 
-        playWalkingSounds();
+        glBindFramebuffer(GL_FRAMEBUFFER, this->defaultFramebufferObject());
+        glViewport(0,0,this->width() * this->devicePixelRatio(), this->height() * this->devicePixelRatio());
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        m_progNoOp.setTexture(m_frameBuffer.getTextureSlot());
-        m_progNoOp.drawOverlay(m_quad);
+        // the effect at full resolution, or the upscaled scene or effect
+        ShaderProgram *toScreen = effect != nullptr ? effect : &m_progNoOp;
+        toScreen->setTexture(1);
+        if (effect != nullptr) {
+            glUniform1i(effect->uniformLocation("u_Noise"), PostNoise::textureSlot);
+        }
+        toScreen->drawOverlay(m_quad);
     }
 
     // draw the widget at last
     glDisable(GL_DEPTH_TEST);
-    // On hand
-    // widget and selected frame
-    renderTexture(inventoryWidgetOnHandTexture, m_progInventoryWidgetOnHand, 2, inventoryWidgetOnHand);
-    // blocks
-    renderTexture(textureAll, m_progInventoryItemOnHand, 0, inventoryItemsOnHand);
-    // In container
-    // TODO: draw the container widget and items in container if the player opens it
-    if (m_player.isOpenContainer()) {
-        renderTexture(inventoryWidgetInContainerTexture, m_progInventoryWidgetInContainer, 4, inventoryWidgetInContainer);
-        renderTexture(textureAll, m_progInventoryItemInContainer, 0, inventoryItemsInContainer);
-        if (m_player.isGrabbing()) {
-            renderTexture(textureAll, m_progGrabbedItem, 0, grabbedItem);
-        }
-    }
-
-    glEnable(GL_BLEND);
-    renderTexture(textureFont, m_progText, 3, textOnScreen.get());
-    glDisable(GL_BLEND);
-
+    m_gpuTimers.begin(GpuPass::hud);
+    renderHud();
+    m_gpuTimers.end();
     glEnable(GL_DEPTH_TEST);
 
+    sendPlayerDataToGUI(); // Updates the info in the secondary window displaying player data
+
+    // the frame as shown, HUD and all, from the frame buffer Qt presents
+    m_frameCapture.capture(this->width() * this->devicePixelRatio(), this->height() * this->devicePixelRatio());
 
+    if (s_lowLatency) {
+        m_frameFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
     frameCount++;
+    // until Qt swapped the frame (slot_frameSwapped)
+    m_frameProfile.begin(FramePhase::submit);
+}
+
+/**
+ * @brief MyGL::updatePostEffect
+ *  Play the loops of where the player is (see AudioManager).
+ * @return the post-process program for the player's surroundings, or
+ *  nullptr when the scene needs none
+ */
+ShaderProgram *MyGL::updatePostEffect() {
+    if(m_player.getEnvironment().underWater){
+        m_audio.setSteps(StepSound::none);
+        m_audio.setAmbient(AmbientSound::water);
+        return &m_progUnderwater;
+    }
+    if(m_player.getEnvironment().underLava){
+        m_audio.setSteps(StepSound::none);
+        m_audio.setAmbient(AmbientSound::lava);
+        return &m_progLava;
+    }
+    m_audio.setAmbient(AmbientSound::none);
+    m_audio.setSteps(walkingSound());
+    return nullptr;
 }
 
 // TODO: Change this so it renders the nine zones of generated
 // terrain that surround the player (refer to Terrain::m_generatedTerrain
 // for more info)
 void MyGL::renderTerrain(TerrainDrawType drawType) {
+    // opaque: the static chunks, then those with lava; transparent: the
+    // water and the like are nearly all animated, so one program draws all
+    ShaderProgram *prog = &m_progLambertAnimated;
+    ShaderProgram *animatedProg = nullptr;
+    if (drawType == TerrainDrawType::opaque) {
+        prog = &m_progLambert;
+        animatedProg = &m_progLambertAnimated;
+    } else if (m_transparencyBuffer.isCreated()) {
+        prog = &m_progLambertOit;
+    }
 
-    // bind the texture
-    bindTexture(textureAll, m_progLambert, 0);
+    // bind the texture and the sun's shadows
+    textureAll.bind(0);
+    if (m_shadowMap.isCreated()) {
+        m_shadowMap.bindToTextureSlot(shadowTextureSlot);
+    }
+    m_clusteredLights.bindToTextureSlots();
+    for (ShaderProgram *program : {prog, animatedProg}) {
+        if (program != nullptr) {
+            program->setTexture(0);
+            m_shadowMap.setCascades(*program, shadowTextureSlot);
+            m_clusteredLights.setSamplers(*program);
+        }
+    }
 
-    // only draw the 3 x 3 chunks around the player
+    // only draw the 3 x 3 chunks around the player, and of those only
+    // the sections in view and not hidden behind terrain (paintGL culls)
     glm::vec3 pos = m_player.mcr_position;
-    m_terrain.draw(pos[0], pos[2], 2, &m_progLambert, drawType);
+    bool prePassed = drawType == TerrainDrawType::opaque && s_depthPrePass;
+    if (prePassed) {
+        // the depth is there already: shade the nearest fragment only
+        glDepthFunc(GL_EQUAL);
+        glDepthMask(GL_FALSE);
+    }
+    m_terrain.draw(pos[0], pos[2], halfGridSize(), prog, drawType, animatedProg);
+    if (prePassed) {
+        glDepthFunc(m_clipControl != nullptr ? GL_GREATER : GL_LESS);
+        glDepthMask(GL_TRUE);
+    }
+    if (drawType == TerrainDrawType::opaque) {
+        // the far field where it has the chunks, the heightmaps elsewhere
+        const std::unordered_set<int64_t> *farZones = nullptr;
+        if (m_farField.isCreated()) {
+            m_progFarField.setTexture(0);
+            glm::vec2 fogRange = m_distantTerrain.getFogRange();
+            glUniform2f(m_progFarField.uniformLocation("u_FogRange"), fogRange.x, fogRange.y);
+            m_farField.draw(m_progFarField, m_quad, m_player.getCameraViewProj(), m_player.getCameraPosition(),
+                            pos[0], pos[2], halfGridSize());
+            farZones = &m_farField.getCoveredZones();
+        }
+        m_distantTerrain.draw(&m_progLod, m_player.getCameraViewProj(), farZones);
+    }
+}
+
+/**
+ * @brief MyGL::renderDepthPrePass
+ *  The opaque chunks in view, position only and no color, so the opaque
+ *  pass that follows shades each pixel once, however many mountains stand
+ *  behind it. The distant terrain is left out: it is cheap to shade, and
+ *  drawn after the chunks with the usual depth test.
+ */
+void MyGL::renderDepthPrePass() {
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glm::vec3 pos = m_player.mcr_position;
+    m_terrain.draw(pos[0], pos[2], halfGridSize(), &m_progDepth, TerrainDrawType::opaque);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+/**
+ * @brief MyGL::setSceneDepth
+ *  Reversed, the depth runs from 1 at the near plane to 0 at infinity
+ *  (see Camera::setReverseZ): the nearer fragment is the greater, and the
+ *  clear is to 0. The other passes (the shadow cascades, the NPC sprites'
+ *  bakes, the post passes) project as ever, so they get the usual back.
+ *  Without m_clipControl there is only the usual, and this does nothing.
+ */
+void MyGL::setSceneDepth(bool reversed) {
+    if (m_clipControl == nullptr) {
+        return;
+    }
+    m_clipControl(GL_LOWER_LEFT, reversed ? GL_ZERO_TO_ONE : GL_NEGATIVE_ONE_TO_ONE);
+    glDepthFunc(reversed ? GL_GREATER : GL_LESS);
+    glClearDepthf(reversed ? 0.f : 1.f);
+}
+
+/**
+ * @brief MyGL::renderTransparencyBuffer
+ *  The transparent terrain is tested against the scene's depth but writes
+ *  none, so every layer of it reaches the buffer, in whatever order the
+ *  chunks come. Leaves m_frameBuffer bound, with the usual blending.
+ */
+void MyGL::renderTransparencyBuffer() {
+    m_transparencyBuffer.begin();
+    glDepthMask(GL_FALSE);
+    renderTerrain(TerrainDrawType::transparent);
+    glDepthMask(GL_TRUE);
+
+    m_frameBuffer.bindFrameBuffer();
+    glDisable(GL_DEPTH_TEST);
+    glBlendFunc(GL_ONE_MINUS_SRC_ALPHA, GL_SRC_ALPHA);
+    m_transparencyBuffer.bindToTextureSlots(oitAccumTextureSlot, oitRevealageTextureSlot);
+    m_progOitComposite.setTexture(oitAccumTextureSlot);
+    glUniform1i(m_progOitComposite.uniformLocation("u_Revealage"), oitRevealageTextureSlot);
+    m_progOitComposite.drawOverlay(m_quad);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
 }
 
 
 void MyGL::keyPressEvent(QKeyEvent *e) {
+    if (!acceptInput(e)) {
+        return;
+    }
     float amount = 2.0f;
     if(e->modifiers() & Qt::ShiftModifier){
         amount = 10.0f;
@@ -461,9 +1584,9 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
     // m_inputs = InputBundle();
 
     if (e->key() == Qt::Key_Escape) {
-        // clear the thread pool and join the running threads
-        QThreadPool::globalInstance()->clear();
-        QThreadPool::globalInstance()->waitForDone(-1);
+        // drop the queued terrain work; the destructor waits for the
+        // running jobs once the event loop is left
+        m_terrain.cancelWorkers();
         QApplication::quit();
     } else if (e->key() == Qt::Key_Right) {
         m_player.rotateOnUpGlobal(-amount);
@@ -495,6 +1618,8 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
         m_inputs.spacePressed = true;
     } else if (e->key() == Qt::Key_F) {
         m_player.toggleFlightMode();
+    } else if (e->key() == Qt::Key_G) {
+        m_terrain.setGreedyMeshing(!Chunk::isGreedyMeshing());
     } else if (e->key() == Qt::Key_0) {
         m_inputs.numberPressed[0] = true;
     } else if (e->key() == Qt::Key_1) {
@@ -519,6 +1644,16 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
         m_inputs.iPressed = true;
     } else if (e->key() == Qt::Key_C) {
         m_player.switchCameraView();
+    } else if (e->key() == Qt::Key_F3) {
+        Profiler::global().setEnabled(!Profiler::global().isEnabled());
+    } else if (e->key() == Qt::Key_F4) {
+        exportProfilerTrace();
+    } else if (e->key() == Qt::Key_F2) {
+        m_frameCapture.takeScreenshot();
+    } else if (e->key() == Qt::Key_F9) {
+        m_frameCapture.toggleRecording();
+    } else if (e->key() == Qt::Key_F6) {
+        m_chunkHeatmap.cycleMetric();
     } else if (e->key() == Qt::Key_U) {
         m_player.setPos(glm::vec3(62.f, 33.f, 270.f));
     }
@@ -526,6 +1661,9 @@ void MyGL::keyPressEvent(QKeyEvent *e) {
 
 void MyGL::keyReleaseEvent(QKeyEvent *e)
 {
+    if (!acceptInput(e)) {
+        return;
+    }
     if (e->key() == Qt::Key_W) {
         m_inputs.wPressed = false;
     } else if (e->key() == Qt::Key_S) {
@@ -572,6 +1710,9 @@ void MyGL::keyReleaseEvent(QKeyEvent *e)
 }
 
 void MyGL::mouseMoveEvent(QMouseEvent *e) {
+    if (!acceptInput(e)) {
+        return;
+    }
     // TODO
     m_inputs.mouseX = e->pos().x();
     m_inputs.mouseY = e->pos().y();
@@ -587,14 +1728,21 @@ void MyGL::mouseMoveEvent(QMouseEvent *e) {
 
 //    #endif
 
-    if (mouseCursorMode) {
+    // the next frame turns by where the cursor is then
+    if (mouseCursorMode || s_lowLatency) {
         return;
     }
     m_player.rotateCameraView(m_inputs);
-    moveMouseToCenter();
+    // the replayed moves include the ones this made
+    if (!m_replayingInput) {
+        moveMouseToCenter();
+    }
 }
 
 void MyGL::mousePressEvent(QMouseEvent *e) {
+    if (!acceptInput(e)) {
+        return;
+    }
 
     switch (e->button()) {
     case (Qt::LeftButton):
@@ -604,7 +1752,7 @@ void MyGL::mousePressEvent(QMouseEvent *e) {
             glm::vec2 pos = convertPosToNormalizedPos(e);
             if (m_player.setGrabItemPos(pos.x, pos.y)){
                 grabbedItemType = m_player.getGrabbedItemType();
-                Block::getUVCoords(grabbedItemType, &grabbedItemUVCoords);
+                BlockIcons::getUVCoords(grabbedItemType, &grabbedItemUVCoords);
             }
         }
         break;
@@ -617,6 +1765,9 @@ void MyGL::mousePressEvent(QMouseEvent *e) {
 }
 
 void MyGL::mouseReleaseEvent(QMouseEvent *e) {
+    if (!acceptInput(e)) {
+        return;
+    }
 
     switch (e->button()) {
     case (Qt::LeftButton):
@@ -636,6 +1787,50 @@ void MyGL::mouseReleaseEvent(QMouseEvent *e) {
     }
 }
 
+bool MyGL::acceptInput(const QEvent *e) {
+    // Escape still quits a replay
+    if (m_inputReplay.isActive() && !m_replayingInput) {
+        return e->type() == QEvent::KeyPress && static_cast<const QKeyEvent*>(e)->key() == Qt::Key_Escape;
+    }
+    m_inputRecorder.addEvent(e);
+    return true;
+}
+
+/**
+ * @brief MyGL::replayInput
+ *  The events do what they did in the session, keys that act at once
+ *  (turning, flight mode, the inventory) included; the inputs they leave
+ *  are then set to the logged ones, which they should match.
+ * @param tick
+ */
+void MyGL::replayInput(const InputTick &tick) {
+    m_replayingInput = true;
+    for (const InputEvent &event : tick.events) {
+        uPtr<QInputEvent> e = event.toQEvent(this);
+        switch (e->type()) {
+        case QEvent::KeyPress:
+            keyPressEvent(static_cast<QKeyEvent*>(e.get()));
+            break;
+        case QEvent::KeyRelease:
+            keyReleaseEvent(static_cast<QKeyEvent*>(e.get()));
+            break;
+        case QEvent::MouseMove:
+            mouseMoveEvent(static_cast<QMouseEvent*>(e.get()));
+            break;
+        case QEvent::MouseButtonPress:
+            mousePressEvent(static_cast<QMouseEvent*>(e.get()));
+            break;
+        case QEvent::MouseButtonRelease:
+            mouseReleaseEvent(static_cast<QMouseEvent*>(e.get()));
+            break;
+        default:
+            break;
+        }
+    }
+    m_replayingInput = false;
+    m_inputs = tick.inputs;
+}
+
 /**
  * @brief MyGL::createTexture
  *   assign texture image to the texture object
@@ -652,55 +1847,104 @@ void MyGL::createTexture(Texture& texture, const char* img_path, int slot) {
 
 /**
  * @brief MyGL::createNPCTextures
- *  Register the NPC textures
+ *  Register the NPC textures' uvs; the texture maps themselves follow as
+ *  they are decoded (see uploadDecodedTextures)
  */
 void MyGL::createNPCTextures()
 {
     loadNPCTextureUVCoord();
-    // Steve
-    npcTextures[STEVE] = Texture(this);
-    npcTextures[STEVE].create(":/textures/steve.png");
-    npcTextures[STEVE].load(3);
-
-    // Sheep
-    npcTextures[SHEEP] = Texture(this);
-    npcTextures[SHEEP].create(":/textures/sheep.png");
-    npcTextures[SHEEP].load(4);
-
-    // ZombieDragon
-    npcTextures[ZDRAGON] = Texture(this);
-    npcTextures[ZDRAGON].create(":/textures/zdragon.png");
-    npcTextures[ZDRAGON].load(5);
-    npcTextures[ZDRAGON1] = Texture(this);
-    npcTextures[ZDRAGON1].create(":/textures/zdragonV1.png");
-    npcTextures[ZDRAGON1].load(6);
-    npcTextures[ZDRAGON2] = Texture(this);
-    npcTextures[ZDRAGON2].create(":/textures/zdragonV2.png");
-    npcTextures[ZDRAGON2].load(7);
-
-    npcTextures[ZDRAGON3] = Texture(this);
-    npcTextures[ZDRAGON3].create(":/textures/zdragonV3.png");
-    npcTextures[ZDRAGON3].load(8);
-    npcTextures[ZDRAGON4] = Texture(this);
-    npcTextures[ZDRAGON4].create(":/textures/zdragonV4.png");
-    npcTextures[ZDRAGON4].load(9);
-
-    // Lama
-    npcTextures[GLAMA] = Texture(this);
-    npcTextures[GLAMA].create(":/textures/graylama.png");
-    npcTextures[GLAMA].load(10);
-    npcTextures[WLAMA] = Texture(this);
-    npcTextures[WLAMA].create(":/textures/whitelama.png");
-    npcTextures[WLAMA].load(11);
-    npcTextures[BLAMA] = Texture(this);
-    npcTextures[BLAMA].create(":/textures/brownlama.png");
-    npcTextures[BLAMA].load(12);
-
-    // Bear
-    npcTextures[BEAR] = Texture(this);
-    npcTextures[BEAR].create(":/textures/bear.png");
-    npcTextures[BEAR].load(13);
-    // TODO: others
+}
+
+/**
+ * @brief MyGL::uploadDecodedTextures
+ *  Start uploading each texture whose images m_imageDecoder has
+ *  finished, leaving the others for a later frame, and move the uploads
+ *  in flight along (see TextureArray::loadAsync). Until a texture is in,
+ *  its placeholder texel is drawn; the NPC skins go up at once, when
+ *  every map is decoded.
+ *  Needs the context current.
+ */
+void MyGL::uploadDecodedTextures()
+{
+    bool pending = false;
+
+    // main texture map (slot = 0)
+    if (!textureAll.isLoadStarted()) {
+        if (m_imageDecoder.isReady({blockAtlasPath})) {
+            textureAll.createFromTiles(m_imageDecoder.image(blockAtlasPath), 16);
+            textureAll.setSampling(true, s_anisotropy, s_compressTextures);
+            textureAll.loadAsync(0);
+        } else {
+            pending = true;
+        }
+    }
+
+    if (!hudTextures.isLoadStarted()) {
+        if (m_imageDecoder.isReady(hudTexturePaths)) {
+            std::vector<QImage> images;
+            for (const char *path : hudTexturePaths) {
+                images.push_back(m_imageDecoder.image(path));
+            }
+            images[HudBatch::icons] = BlockIcons::bake(images[HudBatch::icons]);
+            images[HudBatch::font] = Text::bakeDistanceField(images[HudBatch::font]);
+            hudTextures.create(images);
+            hudTextures.loadAsync(2);
+        } else {
+            pending = true;
+        }
+    }
+
+    if (!npcSkins.isLoadStarted()) {
+        std::vector<const char*> paths;
+        for (const NPCTextureFile &file : npcTextureFiles) {
+            paths.push_back(file.path);
+        }
+        if (m_imageDecoder.isReady(paths)) {
+            createNPCSkins();
+        } else {
+            pending = true;
+        }
+    }
+
+    // each is done once its pixel buffer is freed
+    for (TextureArray *texture : {&textureAll, &hudTextures, &npcSkins}) {
+        if (!texture->pollUpload()) {
+            pending = true;
+        }
+    }
+
+    m_texturesPending = pending;
+    if (!pending) {
+        m_imageDecoder.clear();
+    }
+}
+
+/**
+ * @brief MyGL::createNPCSkins
+ *  The layers of a texture array are of one size: each skin is scaled to
+ *  the widest and tallest of them, without filtering. The NPC uvs are
+ *  fractions of their map, so they read the same texels; the maps that
+ *  are 2 : 1 and 1 : 1 multiples of each other (all of ours) are
+ *  scaled exactly.
+ */
+void MyGL::createNPCSkins()
+{
+    int width = 1, height = 1;
+    for (const NPCTextureFile &file : npcTextureFiles) {
+        width = std::max(width, m_imageDecoder.image(file.path).width());
+        height = std::max(height, m_imageDecoder.image(file.path).height());
+    }
+    std::vector<QImage> layers(sizeof(npcTextureFiles) / sizeof(npcTextureFiles[0]));
+    for (const NPCTextureFile &file : npcTextureFiles) {
+        const QImage &image = m_imageDecoder.image(file.path);
+        layers[file.texture] = image.scaled(width, height, Qt::IgnoreAspectRatio, Qt::FastTransformation);
+        if (file.texture == m_player_model.npcTexture) {
+            playerTexture.create(image);
+            playerTexture.load(playerTextureSlot);
+        }
+    }
+    npcSkins.create(layers);
+    npcSkins.loadAsync(npcSkinsTextureSlot);
 }
 
 
@@ -718,18 +1962,40 @@ void MyGL::bindTexture(Texture& texture, ShaderProgram& shaderProgram, int slot)
 
 
 /**
- * @brief MyGL::renderTexture
- *   render the object only requires the texture map
+ * @brief MyGL::renderHud
+ *   collect the widgets and the text into m_hudBatch, in drawing order,
+ *   and draw them with one program and one texture array
  *   called from paintGL
- * @param texture : texture object used in this drawable object
- * @param shaderProgram : shaderProgram of the drawable object
- * @param slot: texture slot
- * @param drawable : pointer to drawable object (for inherited class)
  */
-void MyGL::renderTexture(Texture& texture, ShaderProgram& shaderProgram, int slot, Drawable* d) {
-    d->createVBOdata();
-    bindTexture(texture, shaderProgram, slot);
-    shaderProgram.drawTexture(*d);
+void MyGL::renderHud() {
+    m_hudBatch.clear();
+    // On hand
+    // widget and selected frame, then the blocks
+    inventoryWidgetOnHand->createVBOdata();
+    inventoryItemsOnHand->createVBOdata();
+    // In container, if the player opens it
+    if (m_player.isOpenContainer()) {
+        inventoryWidgetInContainer->createVBOdata();
+        inventoryItemsInContainer->createVBOdata();
+        if (m_player.isGrabbing()) {
+            grabbedItem->createVBOdata();
+        }
+    }
+    if (Profiler::global().isEnabled()) {
+        addProfilerText();
+    }
+    if (m_chunkHeatmap.getMetric() != ChunkHeatmapMetric::off) {
+        addHeatmapText();
+    }
+    textOnScreen->createVBOdata();
+    // only uploaded if they changed
+    m_hudBatch.createVBOdata();
+
+    glEnable(GL_BLEND);
+    hudTextures.bind(2);
+    m_progHud.setTexture(2);
+    m_progHud.drawHud(m_hudBatch);
+    glDisable(GL_BLEND);
 }
 
 void MyGL::initWidget() {
@@ -767,12 +2033,20 @@ void MyGL::initWidget() {
     widgets_raw.push_back(grabbedItem);
     widgets.push_back(std::move(blockInWidget3));
 
+    inventoryWidgetOnHand->setBatch(&m_hudBatch, HudBatch::widgets, false);
+    // the icons blend, so the widget shows around their cubes
+    inventoryItemsOnHand->setBatch(&m_hudBatch, HudBatch::icons, true);
+    inventoryWidgetInContainer->setBatch(&m_hudBatch, HudBatch::container, false);
+    inventoryItemsInContainer->setBatch(&m_hudBatch, HudBatch::icons, true);
+    grabbedItem->setBatch(&m_hudBatch, HudBatch::icons, true);
+
     // pass widget raw pointers to player
     m_player.setupWidget(widgets_raw);
 }
 
 void MyGL::initText() {
     textOnScreen = mkU<Text>(this, width(), height());
+    textOnScreen->setBatch(&m_hudBatch, HudBatch::font, true);
     m_player.setupText(textOnScreen.get());
 
 }
@@ -815,7 +2089,7 @@ void MyGL::drawGrabbedItem() {
     if (!m_player.isGrabbing() || !m_player.isOpenContainer()) {
         return;
     }
-    QPoint point = QWidget::mapFromGlobal(QCursor::pos());
+    QPoint point = mapFromGlobal(QCursor::pos());
     glm::vec2 mousePos(point.x(), point.y());
 
     glm::vec2 pos = convertPosToNormalizedPos(mousePos);
@@ -869,24 +2143,138 @@ void MyGL::loadNPCTextureUVCoord()
  *  The main logics to draw all the NPCs in paintGL().
  *  This helper is called in MyGL::paintGL().
  *  Basically, loop through the m_npcs.
- *  For each npc, traverse the scene graph,
- *  set the model matrix based on the node's transformation,
- *  draw the corresponding block.
+ *  For each npc in view (see EntityGrid) and within the draw distance,
+ *  collect the blocks with the node's transformation, then draw them
+ *  all, instanced per texture and block type (see NPCPartBatch). Past
+ *  the impostor distance an NPC is one sprite instead (see
+ *  NPCImpostors), once its kind has one.
  *  Note: the scene graph / the blocks of every NPC must be created.
  */
 void MyGL::renderNPCs()
 {
-    for (const uPtr<NPC> &npc : m_npcs)
+    QElapsedTimer timer;
+    timer.start();
+    m_npcParts.clear();
+    m_npcImpostors.clear();
+    // the boxes are as the NPCs last placed them, at most a batch ahead
+    // of the poses drawn
+    m_visibleEntities.clear();
+    m_terrain.getEntityGrid().gatherVisible(Frustum(m_player.getCameraViewProj()), m_visibleEntities);
+    std::sort(m_visibleEntities.begin(), m_visibleEntities.end());
+    glm::vec3 camera = m_player.getCameraPosition();
+    bakeNPCImpostors(camera);
+    for (size_t i = 0; i < m_npcs.size(); i++)
     {
-        // Retrieve the texture map
-        if (npcTextures.find(npc->npcTexture) == npcTextures.end())
+        const Entity *npc = m_npcs[i].get();
+        if (!std::binary_search(m_visibleEntities.begin(), m_visibleEntities.end(), npc))
         {
             continue;
         }
-        // bind the texture map
-        npcTextures[npc->npcTexture].bind(npcTextures[npc->npcTexture].getSlot());
-        m_progNPC.setTexture(npcTextures[npc->npcTexture].getSlot());
-        npc->draw(&m_progNPC);
+        // as of the last finished step; the NPC itself may be mid-step
+        NPCPose pose = m_npcSimulation.getDrawPose(i);
+        float distance = glm::distance(pose.position, camera);
+        if (distance > NPCImpostors::drawDistance)
+        {
+            continue;
+        }
+        if (distance > NPCImpostors::impostorDistance && m_npcImpostors.add(*m_npcs[i], pose, camera))
+        {
+            continue;
+        }
+        m_npcs[i]->collectParts(pose, m_npcParts);
+    }
+    renderRemoteNPCs();
+    qint64 collected = timer.nsecsElapsed();
+    // none before their skins are loaded
+    m_npcParts.draw(m_progNPCInstanced, npcSkins);
+    m_npcImpostors.draw(m_progNPCImpostor);
+    m_npcBenchmark.addRenderTimes(collected, timer.nsecsElapsed() - collected);
+}
+
+/**
+ * @brief MyGL::bakeNPCImpostors
+ *  The sprites of the far NPCs in view that lack one, baked before any
+ *  part of the frame is collected, as they go through m_npcParts too.
+ *  The bakes draw in the sprites' own space, so the view-projection is
+ *  the identity while they run, and the depth the usual.
+ */
+void MyGL::bakeNPCImpostors(glm::vec3 camera)
+{
+    bool baking = false;
+    for (size_t i = 0; i < m_npcs.size(); i++)
+    {
+        if (!m_npcImpostors.needsBake(*m_npcs[i])
+                || !std::binary_search(m_visibleEntities.begin(), m_visibleEntities.end(),
+                                       static_cast<const Entity*>(m_npcs[i].get())))
+        {
+            continue;
+        }
+        float distance = glm::distance(m_npcSimulation.getDrawPose(i).position, camera);
+        if (distance <= NPCImpostors::impostorDistance || distance > NPCImpostors::drawDistance)
+        {
+            continue;
+        }
+        if (!baking)
+        {
+            m_frameUniforms.setViewProj(glm::mat4());
+            m_frameUniforms.upload();
+            setSceneDepth(false);
+            baking = true;
+        }
+        m_npcImpostors.bake(*m_npcs[i], m_npcParts, m_progNPCInstanced, npcSkins);
+    }
+    if (baking)
+    {
+        m_frameUniforms.setViewProj(m_player.getCameraViewProj());
+        m_frameUniforms.upload();
+        setSceneDepth(true);
+    }
+}
+
+/**
+ * @brief MyGL::renderRemoteNPCs
+ *  Adds the server's NPCs in view to m_npcParts. They are never ticked
+ *  here: only their models are used, at the pose the snapshots give.
+ */
+void MyGL::renderRemoteNPCs()
+{
+    m_netClient.getNPCs(m_remoteNPCStates);
+    Frustum frustum(m_player.getCameraViewProj());
+    for (const NetNPCState &state : m_remoteNPCStates) {
+        if (state.texture > BEAR) {
+            continue;
+        }
+        uPtr<NPC> &npc = m_remoteNPCs[state.id];
+        NPCTexture texture = static_cast<NPCTexture>(state.texture);
+        if (npc == nullptr || npc->npcTexture != texture) {
+            switch (state.kind) {
+            case NetNPCKind::lama:
+                npc = mkU<Lama>(this, state.position, m_terrain, m_player, texture);
+                break;
+            case NetNPCKind::zombieDragon:
+                npc = mkU<ZombieDragon>(this, state.position, m_terrain, m_player, texture);
+                break;
+            default:
+                npc = mkU<Sheep>(this, state.position, m_terrain, m_player, texture);
+                break;
+            }
+            npc->createVBOdata();
+            npc->initSceneGraph();
+        }
+        if (glm::distance(state.position, m_player.getCameraPosition()) > NPCImpostors::drawDistance) {
+            continue;
+        }
+        glm::vec3 halfExtents = npc->getHalfExtents();
+        if (!frustum.intersectsBox(state.position - halfExtents, state.position + halfExtents)) {
+            continue;
+        }
+        NPCPose pose;
+        pose.position = state.position;
+        pose.forward = glm::vec3(std::sin(state.yaw), 0.f, std::cos(state.yaw));
+        pose.up = glm::vec3(0.f, 1.f, 0.f);
+        pose.right = glm::cross(pose.forward, pose.up);
+        pose.limbDeg = 0.f;
+        npc->collectParts(pose, m_npcParts);
     }
 }
 
@@ -896,59 +2284,116 @@ void MyGL::renderNPCs()
  */
 void MyGL::renderPlayerModel()
 {
-    if (npcTextures.find(m_player_model.npcTexture) != npcTextures.end())
+    if (playerTexture.getSlot() >= 0)
     {
-        npcTextures[m_player_model.npcTexture].bind(npcTextures[m_player_model.npcTexture].getSlot());
-        m_progNPC.setTexture(npcTextures[m_player_model.npcTexture].getSlot());
+        playerTexture.bind(playerTextureSlot);
+        m_progNPC.setTexture(playerTextureSlot);
         m_player_model.draw(&m_progNPC);
     }
 }
 
+/**
+ * @brief MyGL::applyThreadConfig
+ *  Counts of 0 keep the defaults the subsystems started with.
+ */
+void MyGL::applyThreadConfig()
+{
+    const ThreadConfig &config = ThreadConfig::global();
+    TerrainJobSystem &jobs = m_terrain.getJobSystem();
+    if (config.terrainThreads > 0) {
+        jobs.setThreadCount(config.terrainThreads);
+    }
+    jobs.setThreadLimit(TerrainJobQueue::generation, config.generationThreads);
+    jobs.setThreadLimit(TerrainJobQueue::meshing, config.meshingThreads);
+    if (!config.terrainCores.empty()) {
+        jobs.setCores(config.terrainCores);
+    }
+
+    m_npcSimulation.setSearchesPerTick(config.pathSearchesPerTick);
+    if (config.npcThreads > 0) {
+        m_npcSimulation.setThreadCount(config.npcThreads);
+    }
+    if (!config.npcCores.empty()) {
+        m_npcSimulation.setCores(config.npcCores);
+    }
+}
+
+void MyGL::sendThreadSettingsToGUI()
+{
+    TerrainJobSystem &jobs = m_terrain.getJobSystem();
+    emit sig_sendThreadSettings(jobs.threadCount(),
+                                jobs.threadLimit(TerrainJobQueue::generation),
+                                jobs.threadLimit(TerrainJobQueue::meshing),
+                                m_npcSimulation.getThreadCount(),
+                                m_npcSimulation.getSearchesPerTick());
+}
+
+void MyGL::slot_setTerrainThreads(int threads)
+{
+    // shrinking waits for the surplus threads' current jobs
+    m_terrain.getJobSystem().setThreadCount(std::max(1, threads));
+}
+
+void MyGL::slot_setGenerationThreads(int threads)
+{
+    m_terrain.getJobSystem().setThreadLimit(TerrainJobQueue::generation, threads);
+}
+
+void MyGL::slot_setMeshingThreads(int threads)
+{
+    m_terrain.getJobSystem().setThreadLimit(TerrainJobQueue::meshing, threads);
+}
+
+void MyGL::slot_setNPCThreads(int threads)
+{
+    m_npcSimulation.setThreadCount(std::max(1, threads));
+}
+
+void MyGL::slot_setPathSearches(int searches)
+{
+    m_npcSimulation.setSearchesPerTick(searches);
+}
+
 /**
  * @brief MyGL::setupNPCs
- *  This helper contains the initial setup of all NPCs in this world.
+ *  This helper contains the initial setup of the NPCs placed by hand in
+ *  this world; the rest are rolled by the chunks (see NPCSpawner).
  *  -------------
  *  General Steps to setup a NPC:
- *  0. (Before instantiate a NPC here)
+ *  0. (Before placing a NPC here)
  *      - add NPCTexture in texture.h if it's a new NPC
  *      - create the corresponding NPC's texture in MyGL::createNPCTextures()
- *  1. Instantiate an NPC entity (set up parameters)
+ *      - add its NPCKind, made in NPCSpawner::create, if it's a new kind
+ *  1. Describe the NPC (see NPCRecord)
  *      - params
+ *          - kind & texture
  *          - initial position
  *          - (a series of) goals to achieve
- *          - initial movement speed (in x & z)
- *          - tolerance of distance to determine the achievement of a goal
- *          - tolerance of distance to determine the completion of a step
- *          - the search grid (halfGridSize) of the path finder (A* search)
- *      - other needed params (m_terrain, m_player)
- *  2. Push into the m_npcs list
+ *  2. Hand it to m_npcSpawner, which spawns it once its chunk loads
+ *  The NPC benchmark spawns its own instead.
  */
 void MyGL::setupNPCs()
 {
+    if (m_npcBenchmark.isActive())
+    {
+        setupBenchmarkNPCs(m_npcBenchmark.getNPCsPerType());
+        return;
+    }
+
     // two fornite lamas on the jump training stadium
     // moving back & forth between two targets
     std::vector<glm::vec3> jump1To2 = {glm::vec3(34.f, 146.f, 78.f),
                                        glm::vec3(76.f, 152.f, 40.f)};
     std::vector<glm::vec3> jump2To1 = {glm::vec3(76.f, 152.f, 40.f),
                                        glm::vec3(34.f, 146.f, 78.f)};
-    m_npcs.push_back(mkU<Lama>(this, glm::vec3(33.f, 148.f, 77.f),
-                               m_terrain, m_player, GLAMA,
-                               jump1To2,
-                               glm::vec3(3.f, 0.f, 3.f),
-                               2.f, 1.f,
-                               7));
-    m_npcs.push_back(mkU<Lama>(this, glm::vec3(76.f, 155.f, 41.f),
-                               m_terrain, m_player, WLAMA,
-                               jump2To1,
-                               glm::vec3(3.f, 0.f, 3.f),
-                               2.f, 1.f,
-                               7));
+    m_npcSpawner.addRecord({NPCKind::lama, GLAMA, glm::vec3(33.f, 148.f, 77.f), jump1To2});
+    m_npcSpawner.addRecord({NPCKind::lama, WLAMA, glm::vec3(76.f, 155.f, 41.f), jump2To1});
 
     // one zombie dragon flying around the player
-    m_npcs.push_back(mkU<ZombieDragon>(this, glm::vec3(260.f, 218.f, -180.f), m_terrain, m_player, ZDRAGON4, glm::vec3(274, 218, -193)));
-    m_npcs.push_back(mkU<ZombieDragon>(this, glm::vec3(373, 256, -337), m_terrain, m_player, ZDRAGON4, glm::vec3(383, 256, -347)));
-    m_npcs.push_back(mkU<ZombieDragon>(this, glm::vec3(253, 245, 636), m_terrain, m_player, ZDRAGON2, glm::vec3(263, 245, 626)));
-    m_npcs.push_back(mkU<ZombieDragon>(this, glm::vec3(72, 33, 250), m_terrain, m_player, ZDRAGON3, glm::vec3(62, 33, 270)));
+    m_npcSpawner.addRecord({NPCKind::zombieDragon, ZDRAGON4, glm::vec3(260.f, 218.f, -180.f), {glm::vec3(274, 218, -193)}});
+    m_npcSpawner.addRecord({NPCKind::zombieDragon, ZDRAGON4, glm::vec3(373, 256, -337), {glm::vec3(383, 256, -347)}});
+    m_npcSpawner.addRecord({NPCKind::zombieDragon, ZDRAGON2, glm::vec3(253, 245, 636), {glm::vec3(263, 245, 626)}});
+    m_npcSpawner.addRecord({NPCKind::zombieDragon, ZDRAGON3, glm::vec3(72, 33, 250), {glm::vec3(62, 33, 270)}});
 
     // sheep on the grounds
     // moving around
@@ -958,30 +2403,175 @@ void MyGL::setupNPCs()
                                          glm::vec3(0, 139, -48),
                                          glm::vec3(32, 138, 32)};
 
-    unsigned seed = std::chrono::system_clock::now().time_since_epoch().count();
-    auto rng = std::default_random_engine(seed);
+    auto rng = std::default_random_engine(m_sessionSeed);
 
     for (int i = 0; i < nSheeps; i++)
     {
         std::shuffle(sheepGoals.begin(), sheepGoals.end(), rng);
-        m_npcs.push_back(mkU<Sheep>(this, glm::vec3(50.f + ((float) i) * 1.5f, 145.f, 32.f),
-                                    m_terrain, m_player, SHEEP,
-                                    sheepGoals,
-                                    glm::vec3(1.f, 0.f, 1.f),
-                                    2.f, 2.f,
-                                    5));
+        m_npcSpawner.addRecord({NPCKind::sheep, SHEEP, glm::vec3(50.f + ((float) i) * 1.5f, 145.f, 32.f), sheepGoals});
     }
 
     for (int i = 0; i < nSheeps; i++)
     {
         std::shuffle(sheepGoals.begin(), sheepGoals.end(), rng);
-        m_npcs.push_back(mkU<Sheep>(this, glm::vec3(50.f + ((float) i) * 1.5f, 144.f, 45.f),
-                                    m_terrain, m_player, BEAR,
-                                    sheepGoals,
-                                    glm::vec3(1.f, 0.f, 1.f),
-                                    2.f, 2.f,
-                                    5));
+        m_npcSpawner.addRecord({NPCKind::sheep, BEAR, glm::vec3(50.f + ((float) i) * 1.5f, 144.f, 45.f), sheepGoals});
     }
+}
 
+/**
+ * @brief MyGL::setupBenchmarkNPCs
+ *  Lamas, zombie dragons and sheep at random in the benchmark's square,
+ *  on its seed, so every run spawns the same. The lamas jump between
+ *  the stadium's targets and every other sheep roams the sheep's goals,
+ *  far enough for long path searches; the rest chase the player.
+ * @param npcsPerType
+ */
+void MyGL::setupBenchmarkNPCs(int npcsPerType)
+{
+    std::default_random_engine rng(NPCBenchmark::seed);
+    std::uniform_real_distribution<float> offset(-NPCBenchmark::spawnHalfSize, NPCBenchmark::spawnHalfSize);
+    auto spawnPoint = [&rng, &offset](float y) {
+        float x = NPCBenchmark::spawnCenterX + offset(rng);
+        float z = NPCBenchmark::spawnCenterZ + offset(rng);
+        return glm::vec3(x, y, z);
+    };
+
+    const NPCTexture lamaTextures[] = {GLAMA, WLAMA, BLAMA};
+    const NPCTexture dragonTextures[] = {ZDRAGON1, ZDRAGON2, ZDRAGON3, ZDRAGON4};
+    const NPCTexture sheepTextures[] = {SHEEP, BEAR};
+    std::vector<glm::vec3> jumpGoals = {glm::vec3(34.f, 146.f, 78.f),
+                                        glm::vec3(76.f, 152.f, 40.f)};
+    std::vector<glm::vec3> sheepGoals = {glm::vec3(-145, 137, -227),
+                                         glm::vec3(-72, 148, -294),
+                                         glm::vec3(0, 139, -48),
+                                         glm::vec3(32, 138, 32)};
 
+    // NPCs spawn above the ground and fall onto it
+    for (int i = 0; i < npcsPerType; i++)
+    {
+        std::reverse(jumpGoals.begin(), jumpGoals.end());
+        m_npcs.push_back(mkU<Lama>(this, spawnPoint(170.f),
+                                   m_terrain, m_player, lamaTextures[i % 3],
+                                   jumpGoals,
+                                   glm::vec3(3.f, 0.f, 3.f),
+                                   2.f, 1.f,
+                                   7));
+
+        glm::vec3 dragon = spawnPoint(190.f);
+        m_npcs.push_back(mkU<ZombieDragon>(this, dragon, m_terrain, m_player, dragonTextures[i % 4],
+                                           dragon + glm::vec3(10.f, 0.f, -10.f)));
+
+        glm::vec3 sheep = spawnPoint(170.f);
+        if (i % 2 == 0)
+        {
+            std::shuffle(sheepGoals.begin(), sheepGoals.end(), rng);
+            m_npcs.push_back(mkU<Sheep>(this, sheep, m_terrain, m_player, sheepTextures[i / 2 % 2],
+                                        sheepGoals,
+                                        glm::vec3(1.f, 0.f, 1.f),
+                                        2.f, 2.f,
+                                        5));
+        } else {
+            m_npcs.push_back(mkU<Sheep>(this, sheep, m_terrain, m_player, sheepTextures[i / 2 % 2]));
+        }
+    }
+}
+
+/**
+ * @brief MyGL::followBenchmarkPath
+ *  Put the player on the path, facing its target, in place of the
+ *  inputs; the camera moves and turns with it.
+ * @param seconds
+ */
+void MyGL::followBenchmarkPath(float seconds)
+{
+    glm::vec3 position = m_npcBenchmark.getCameraPosition(seconds);
+    posePlayer(position, glm::normalize(m_npcBenchmark.getCameraTarget() - position));
+}
+
+void MyGL::posePlayer(glm::vec3 position, glm::vec3 look)
+{
+    m_player.moveAlongVector(position - m_player.mcr_position);
+
+    glm::vec3 forward = m_player.getCurrForward();
+    // the turn about +y from forward to look, then the tilt
+    float yaw = glm::atan(forward.z * look.x - forward.x * look.z, forward.x * look.x + forward.z * look.z);
+    m_player.rotateOnUpGlobal(glm::degrees(yaw));
+    float pitch = glm::asin(glm::clamp(look.y, -1.f, 1.f))
+                - glm::asin(glm::clamp(m_player.getCurrForward().y, -1.f, 1.f));
+    m_player.rotateOnRightLocal(glm::degrees(pitch));
+}
+
+/**
+ * @brief MyGL::landHeldPlayer
+ *  The player starts high above its column and would fall through it
+ *  while the spawn zone generates; it is dropped onto the top block
+ *  instead, if it is above it.
+ */
+void MyGL::landHeldPlayer()
+{
+    int x = static_cast<int>(glm::floor(m_player.mcr_position.x));
+    int z = static_cast<int>(glm::floor(m_player.mcr_position.z));
+    const Chunk *chunk = m_terrain.findChunk(x, z);
+    if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+        return;
+    }
+    int top = chunk->getColumnTop(x & 15, z & 15);
+    float groundY = top + 1.f;
+    if (top > 0 && m_player.mcr_position.y > groundY) {
+        m_player.moveAlongVector(glm::vec3(0.f, groundY - m_player.mcr_position.y, 0.f));
+    }
+    m_prevPlayerPosition = m_player.mcr_position;
+    m_playerHeld = false;
+}
+
+/**
+ * @brief MyGL::placePlayer
+ *  The steps of the next frames pose the player here again after their
+ *  physics, and the frame draws it here rather than between two steps.
+ * @param position
+ * @param look : normalized
+ */
+void MyGL::placePlayer(glm::vec3 position, glm::vec3 look)
+{
+    m_scriptedCamera = true;
+    m_scriptedPosition = position;
+    m_scriptedLook = look;
+    posePlayer(position, look);
+    m_prevPlayerPosition = position;
+}
+
+/**
+ * @brief MyGL::runHeadlessFrame
+ *  QOpenGLWidget renders a widget with no window into its frame buffer
+ *  object, with its context current on a QOffscreenSurface of its own;
+ *  grabbing that frame buffer the first time creates both and calls
+ *  initializeGL, then paints, before any resizeGL: that paint is
+ *  skipped. Nothing is swapped, so the frame ends at glFinish instead.
+ */
+void MyGL::runHeadlessFrame()
+{
+    if (!m_headless) {
+        m_headless = true;
+        grabFramebuffer();
+        makeCurrent();
+        resizeGL(width(), height());
+        m_headlessSized = true;
+        doneCurrent();
+    }
+    makeCurrent();
+    tick();
+    paintGL();
+    glFinish();
+    m_frameProfile.end();
+    doneCurrent();
+}
+
+const Terrain &MyGL::getTerrain() const
+{
+    return m_terrain;
+}
+
+const FrameProfile &MyGL::getFrameProfile() const
+{
+    return m_frameProfile;
 }
@@ -1,47 +1,84 @@
 #ifndef MYGL_H
 #define MYGL_H
 
+#include "audiomanager.h"
+#include "clusteredlights.h"
+#include "farfield.h"
 #include "framebuffer.h"
+#include "framecapture.h"
+#include "framewatchdog.h"
+#include "frameprofile.h"
+#include "frameuniforms.h"
+#include "gputimers.h"
+#include "imagedecoder.h"
+#include "inputlog.h"
+#include "memorystats.h"
+#include "netclient.h"
+#include "npcbenchmark.h"
 #include "openglcontext.h"
-#include "qsoundeffect.h"
+#include "particlesystem.h"
+#include "profiler.h"
+#include "qualitycontroller.h"
+#include "postnoise.h"
+#include "renderbackend.h"
+#include "shadowmap.h"
+#include "temporalupsampler.h"
+#include "transparencybuffer.h"
 #include "scene/quad.h"
 #include "scene/worldaxes.h"
+#include "scene/chunkheatmap.h"
 #include "scene/camera.h"
 #include "scene/terrain.h"
+#include "scene/distantterrain.h"
 #include "scene/player.h"
 #include "scene/block.h"
 #include "scene/npc.h"
+#include "scene/npcimpostors.h"
+#include "scene/npcsimulation.h"
+#include "scene/npcspawner.h"
+#include "scene/npcpartbatch.h"
 #include "scene/widget.h"
 #include "scene/blockinwidget.h"
 #include "scene/text.h"
+#include "scene/hudbatch.h"
 #include "scene/npcs/steve.h"
 #include "texture.h"
 
 #include <QOpenGLVertexArrayObject>
 #include <QOpenGLShaderProgram>
 #include <QApplication>
+#include <QElapsedTimer>
 #include <smartpointerhelp.h>
+#include <array>
 
+// What starts each frame (see MyGL::setFrameLoop)
+enum class FrameLoop : unsigned char {
+    vsync,    // the swap of the last one, at the display's rate
+    uncapped, // the same, with main() turning the swap interval off
+    timer     // m_timer, every 16 ms whatever the display does
+};
 
 class MyGL : public OpenGLContext
 {
     Q_OBJECT
 private:
     WorldAxes m_worldAxes; // A wireframe representation of the world axes. It is hard-coded to sit centered at (32, 128, 32).
+    ChunkHeatmap m_chunkHeatmap; // The chunks' states and mesh costs as tiles over them (F6 cycles the metric)
     ShaderProgram m_progLambert;// A shader program that uses lambertian reflection
+    ShaderProgram m_progLambertAnimated; // The same, with the uv shift of animatable blocks
+    ShaderProgram m_progLambertOit; // The same, for the transparent pass into m_transparencyBuffer
     ShaderProgram m_progFlat;// A shader program that uses "flat" reflection (no shadowing at all)
 
     // Post-process Shaders
     ShaderProgram m_progUnderwater;
     ShaderProgram m_progLava;
     ShaderProgram m_progNoOp;
-    ShaderProgram m_progInventoryWidgetOnHand;
-    ShaderProgram m_progInventoryItemOnHand;
-    ShaderProgram m_progInventoryWidgetInContainer;
-    ShaderProgram m_progInventoryItemInContainer;
-    ShaderProgram m_progGrabbedItem;
-    ShaderProgram m_progText;
+    // resolves m_transparencyBuffer over the scene
+    ShaderProgram m_progOitComposite;
+    // the whole HUD, in one draw (see HudBatch)
+    ShaderProgram m_progHud;
     Quad m_quad;
+    HudBatch m_hudBatch;
     Widget* inventoryWidgetOnHand;
     Widget* inventoryWidgetInContainer;
     BlockInWidget* inventoryItemsOnHand;
@@ -52,44 +89,225 @@ private:
 
     // NPC
     ShaderProgram m_progNPC;
-
-    FrameBuffer m_frameBuffer;
+    // the NPCs' parts, instanced (see NPCPartBatch)
+    ShaderProgram m_progNPCInstanced;
+    // the far NPCs' sprites (see NPCImpostors)
+    ShaderProgram m_progNPCImpostor;
+    // the distant terrain's heightmap tiles
+    ShaderProgram m_progLod;
+    // the chunks' depth, into m_shadowMap
+    ShaderProgram m_progShadow;
+    // the opaque chunks' depth from the camera, before their color, if s_depthPrePass
+    ShaderProgram m_progDepth;
+    static bool s_depthPrePass;
+    // glClipControl, if the context has it and s_reverseZ is on: the
+    // camera's passes then test reversed float depth (see setSceneDepth)
+    typedef void (QOPENGLF_APIENTRYP ClipControlFunc)(GLenum origin, GLenum depth);
+    ClipControlFunc m_clipControl;
+    static bool s_reverseZ;
+
+    FrameBuffer m_frameBuffer; // The 3D pass, at m_renderScale of the screen's pixels.
+    FrameBuffer m_effectBuffer; // The underwater and lava passes, at s_effectScale of them.
+    static float s_renderScale;
+    float m_renderScale; // s_renderScale, or less while m_quality asks for it.
+    bool m_renderTargetsStale; // m_renderScale changed; paintGL recreates the targets.
+    // Upsamples m_frameBuffer to the screen over several jittered frames,
+    // while m_renderScale < 1 and unless s_temporalUpsample is off
+    TemporalUpsampler m_temporalUpsampler;
+    ShaderProgram m_progTemporal;
+    static bool s_temporalUpsample;
+    static float s_effectScale;
+    // the noise of the underwater and lava passes, baked unless s_proceduralEffects
+    PostNoise m_postNoise;
+    static bool s_proceduralEffects;
+    // The transparent pass without sorting, if s_orderIndependentTransparency
+    // (the scene then always goes through m_frameBuffer, whose depth it shares)
+    TransparencyBuffer m_transparencyBuffer;
+    static bool s_orderIndependentTransparency;
+    // the view-projection, screen dimensions and time every program reads
+    FrameUniforms m_frameUniforms;
+    // the sun's shadows over the terrain, if s_shadowResolution > 0
+    ShadowMap m_shadowMap;
+    static int s_shadowResolution;
+    // the emissive blocks' lights in view, per pixel, unless s_pointLights is off
+    ClusteredLights m_clusteredLights;
+    std::vector<PointLight> m_pointLights;
+    static bool s_pointLights;
+    // the crumbs of broken blocks and the snow, unless s_particles is off;
+    // stepped by paintGL for the time ticked since the last frame
+    ParticleSystem m_particles;
+    ShaderProgram m_progParticleUpdate;
+    ShaderProgram m_progParticle;
+    std::vector<BlockEdit> m_brokenBlocks;
+    float m_particleDeltaTime;
+    static bool s_particles;
+    // snow over the player standing on a snow cap, none elsewhere
+    void updateWeather();
+    // the chunks whose meshes changed this frame, for m_shadowMap and m_farField
+    std::vector<glm::ivec2> m_meshChanges;
+    // the chunks raymarched past the drawn ones, if MINIMINECRAFT_FAR_FIELD is set
+    FarField m_farField;
+    ShaderProgram m_progFarField;
 
     GLuint vao; // A handle for our vertex array object. This will store the VBOs created in our geometry classes.
                 // Don't worry to o much about this. Just know it is necessary in order to render geometry.
 
     Terrain m_terrain; // All of the Chunks that currently comprise the world.
+    static bool s_deferredCaves;
+    // whether the terrain caches its chunk meshes across sessions
+    static bool s_meshCache;
+    // the view radius in chunks (see Terrain::setViewRadius), 0 for the
+    // square grid
+    static int s_viewRadius;
+    // the halfGridSize the terrain is streamed and drawn with
+    int halfGridSize() const;
+    DistantTerrain m_distantTerrain; // Low-detail tiles out to the horizon, around the zones of m_terrain.
     Player m_player; // The entity controlled by the user. Contains a camera to display what it sees as well.
     InputBundle m_inputs; // A collection of variables to be updated in keyPressEvent, mouseMoveEvent, mousePressEvent, etc.
+    InputRecorder m_inputRecorder; // Logs every tick's inputs and frame time, if main() asked for it.
+    InputReplay m_inputReplay; // Stands in for the inputs and frame times of a logged session, if main() asked for it.
+    bool m_replayingInput; // The handlers are running a replayed event.
+    quint32 m_sessionSeed; // Seeds the NPCs' random choices; a replay's is the logged session's.
+    static QString s_inputRecordPath;
+    static QString s_inputReplayPath;
     Steve m_player_model;
 
     std::vector<uPtr<NPC>> m_npcs; // A collection of npcs
-
-    QTimer m_timer; // Timer linked to tick(). Fires approximately 60 times per second.
-
-    int frameCount; // the number of processing frame, treated as time in shader
-    long long prevFrameTime; // time in previous frame, for calculating delta-time in player tick funciton
+    NPCSpawner m_npcSpawner; // Spawns m_npcs in the chunks that load and despawns them from the ones dropped.
+    NPCSimulation m_npcSimulation; // Ticks m_npcs off the main thread, between two of our ticks.
+    NPCPartBatch m_npcParts; // The parts of m_npcs a frame draws, a draw call per texture and block type.
+    NPCImpostors m_npcImpostors; // The far ones of m_npcs a frame draws, as sprites in one draw call.
+    std::vector<const Entity*> m_visibleEntities; // The entities in view this frame, sorted.
+    FrameProfile m_frameProfile; // How long each FramePhase of tick() and paintGL() takes.
+    GpuTimers m_gpuTimers; // The GPU's time per pass of paintGL(), while the Profiler or m_quality needs it.
+    QualityController m_quality; // Trades detail for frame time, if main() set a target frame time.
+    static float s_targetFrameMs;
+    int64_t m_gpuMemoryBudget; // The bytes of GPU memory the game keeps to; 0: no budget.
+    static int s_gpuMemoryBudgetMB;
+    NPCBenchmark m_npcBenchmark; // The NPC stress test main() asked for, if any.
+    static int s_benchmarkNPCsPerType;
+    static int s_benchmarkFrames;
+
+    QTimer m_timer; // Timer linked to tick() in FrameLoop::timer. Fires approximately 60 times per second.
+    static FrameLoop s_frameLoop;
+    static RenderBackendKind s_renderBackend; // What initializeGL creates the drawables through.
+    // Unless s_idleThrottle is off, the game idles while another
+    // application has the focus: m_timer ticks every idleTickMs, the
+    // frames are only drawn while the window is on screen, and the terrain
+    // generates nothing ahead of the player. Focus ends it at once
+    static bool s_idleThrottle;
+    static const int idleTickMs = 80;
+    bool m_idle;
+    // the window neither minimized nor covered, as far as the platform tells
+    bool isOnScreen() const;
+    // the mouse look read in paintGL, and one frame queued at most
+    static bool s_lowLatency;
+    GLsync m_frameFence; // The last frame's commands, waited for before the next, if s_lowLatency.
+    FrameCapture m_frameCapture; // Screenshots (F2) and recordings (F9) of the frames drawn.
+    // traces of the frames whose tick and paintGL take over s_longFrameMs
+    FrameWatchdog m_frameWatchdog;
+    static float s_longFrameMs;
+    // what a long frame's trace holds besides the zones: the job queues
+    // and what the terrain did, a (name, text) pair each
+    std::vector<std::pair<QString, QString>> longFrameContext() const;
+    // Turn the camera by the cursor's move since the last frame and put
+    // the cursor back to the center; paintGL's view then has the newest look
+    void sampleMouseLook();
+    QElapsedTimer m_frameClock; // Times the frames, whatever drives them.
+
+    int frameCount; // the number of processing frame
+    qint64 prevFrameTime; // m_frameClock's ns at the previous tick, for calculating delta-time
+
+    // The player steps at a fixed rate, however fast frames come; each
+    // frame draws it between its last two steps
+    float m_simulationAccumulator; // seconds not yet stepped
+    int m_simulationSteps; // steps so far, treated as time in shader
+    glm::vec3 m_prevPlayerPosition; // before the last step
+    bool m_playerHeld; // not stepped until the ground under it is generated (see landHeldPlayer)
 
     int prevMouseX;
     int prevMouseY;
 
     bool mouseCursorMode; // Mouse cursor can move or not
 
-    Texture textureAll;
-    Texture inventoryWidgetOnHandTexture;
-    Texture inventoryWidgetInContainerTexture;
-    Texture textureFont;
-
-    std::unordered_map<NPCTexture, Texture> npcTextures;
+    // where placePlayer put the player, in place of the inputs
+    bool m_scriptedCamera;
+    glm::vec3 m_scriptedPosition;
+    glm::vec3 m_scriptedLook;
+    // driven by runHeadlessFrame, and sized for it
+    bool m_headless;
+    bool m_headlessSized;
+
+    // decodes the texture maps off the main thread, from construction on
+    ImageDecoder m_imageDecoder;
+    // some texture is still waiting on its images
+    bool m_texturesPending;
+    // the block tiles, one layer each (see TextureArray::createFromTiles)
+    TextureArray textureAll;
+    static float s_anisotropy;
+    static bool s_compressTextures;
+    // the HUD's textures, a layer per HudBatch::Layer
+    TextureArray hudTextures;
+
+    // every NPC skin, the layer of each its NPCTexture (see NPCPartBatch)
+    TextureArray npcSkins;
+    // the player model's skin, as m_progNPC reads it
+    Texture playerTexture;
 
     void moveMouseToCenter(); // Forces the mouse position to the screen's center. You should call this
                               // from within a mouse move event after reading the mouse movement so that
                               // your mouse stays within the screen bounds and is always read.
 
-    void sendPlayerDataToGUI() const;
+    // The fields of the player info window, each sent by its own signal
+    enum class InfoField {
+        pos, vel, acc, look, chunk, zone, uploadQueue, culling, framePhases, terrainPipeline, memory,
+        performance, count
+    };
+    // what the window last got of each field; the chunk and zone as
+    // numbers too, so they are formatted only when they change
+    std::array<QString, static_cast<size_t>(InfoField::count)> m_sentInfo;
+    glm::ivec2 m_sentChunk;
+    glm::ivec2 m_sentZone;
+    // m_frameClock's ns at the last send, and the frames drawn since
+    qint64 m_lastInfoTime;
+    int m_infoFrames;
+    static int s_infoRate;
+    // At most s_infoRate times a second, the fields whose text changed;
+    // the window lays out and repaints for each one sent
+    void sendPlayerDataToGUI();
+    void sendInfo(InfoField field, const QString &text, void (MyGL::*signal)(QString) const);
+    // frame rate, CPU and GPU frame times and queue depths over seconds
+    QString performanceText(float seconds) const;
+    // the render scale, LOD ring, NPC radii and upload budget of m_quality's level
+    void applyQualityLevel();
+    // m_frameBuffer, m_effectBuffer and m_transparencyBuffer at the widget's size
+    void createRenderTargets();
+    // a share of the GPU memory the driver reports, if it does
+    int64_t detectGpuMemoryBudget();
+    // MemoryStats' budget for the chunk meshes, which Terrain evicts to
+    void updateGpuMeshBudget();
+    // the terrain's job queues, chunk latency and uploads, a line each
+    QString terrainPipelineText() const;
+    // the MemoryStats of each category, then their total, a line each
+    QString memoryText() const;
+    // the Profiler's averages over the HUD, while it is enabled (F3)
+    void addProfilerText();
+    // the chunk heatmap's legend, while it is on (F6)
+    void addHeatmapText();
+    // its history as a Chrome trace, to the app's data directory (F4)
+    void exportProfilerTrace() const;
+    // whether the event goes on to its handler: not a live one, but for
+    // Escape, while a replay stands in for them. Logs the ones that do,
+    // when recording.
+    bool acceptInput(const QEvent *e);
+    // the logged tick's events through the handlers, then its inputs
+    void replayInput(const InputTick &tick);
 
 
     void createNPCTextures();
+    void uploadDecodedTextures();
+    // npcSkins and playerTexture, from the decoded NPC texture maps
+    void createNPCSkins();
     void loadNPCTextureUVCoord();
 
     void createTexture(Texture& texture, const char* img_path, int slot);
@@ -100,31 +318,140 @@ private:
     void toggleMouseCursorMode();
 
     void setupNPCs();
+    // npcsPerType of each kind of NPC for m_npcBenchmark
+    void setupBenchmarkNPCs(int npcsPerType);
+    // move the player along m_npcBenchmark's path, after seconds of it
+    void followBenchmarkPath(float seconds);
+    // move the player to position and turn it to look along look
+    void posePlayer(glm::vec3 position, glm::vec3 look);
+    // once the chunk under the held player is decorated, put it on the
+    // ground there and let it go
+    void landHeldPlayer();
+    // the thread counts and cores main() read (see ThreadConfig)
+    void applyThreadConfig();
+    void sendThreadSettingsToGUI();
     void renderNPCs();
+    // bake the sprites the far NPCs in view need, within the bakes' budget
+    void bakeNPCImpostors(glm::vec3 camera);
+    // the server's NPCs, in place of m_npcs while connected
+    void renderRemoteNPCs();
     void renderPlayerModel();
 
 
-    long long prevExpandTime;
+    // seconds since the terrain last expanded, in the ticks' frame times
+    float m_expandAccumulator;
+
+    // the world server main() connected to, if any (see NetClient)
+    static QString s_serverHost;
+    static quint16 s_serverPort;
+    NetClient m_netClient;
+    // a model per NPC of the server, by its id, made as first drawn
+    std::unordered_map<uint16_t, uPtr<NPC>> m_remoteNPCs;
+    std::vector<NetNPCState> m_remoteNPCStates;
 
     glm::vec2 convertPosToNormalizedPos(glm::vec2 pixelPos);
     glm::vec2 convertPosToNormalizedPos(QMouseEvent *e);
 
     BlockType grabbedItemType;
-    std::array<std::array<glm::vec2, 4>, 3> grabbedItemUVCoords;
+    // of its icon (see BlockIcons)
+    std::array<glm::vec2, 4> grabbedItemUVCoords;
     void drawGrabbedItem();
 
-    QSoundEffect mainTheme;
-    QSoundEffect waterEffect;
-    QSoundEffect lavaEffect;
-    QSoundEffect rockWalkingEffect;
-    QSoundEffect grassWalkingEffect;
-    QSoundEffect sandWalkingEffect;
-    QSoundEffect glassWalkingEffect;
+    AudioManager m_audio; // The music, and the loops of where the player is and walks.
 
 public:
+    static constexpr float simulationStep = 1.f / 60.f;
+    // the steps a tick may run at most; a longer frame slows the game down
+    static const int maxStepsPerTick = 5;
+    // the player's steps before the NPCs start, while the terrain loads
+    static const int npcWarmupSteps = 15 * 60;
+
     explicit MyGL(QWidget *parent = nullptr);
     ~MyGL();
 
+    // how the MyGL created next paces its frames; FrameLoop::uncapped
+    // also needs a swap interval of 0 in the default surface format
+    static void setFrameLoop(FrameLoop loop);
+    // the MyGL created next reads the mouse look at the start of each
+    // frame rather than per mouse event, and keeps the GPU one frame
+    // behind at most, for less input latency (see sampleMouseLook)
+    static void setLowLatency(bool lowLatency);
+    // the render backend the MyGL created next draws through; where the
+    // context lacks it, the legacy one
+    static void setRenderBackend(RenderBackendKind kind);
+    // whether the MyGL created next idles in the background (see
+    // s_idleThrottle); on by default
+    static void setIdleThrottle(bool throttle);
+    // the MyGL created next runs the NPC stress test (see NPCBenchmark)
+    // with npcsPerType of each kind; 0: none. frames <= 0: the default
+    static void setNPCBenchmark(int npcsPerType, int frames);
+    // the fraction of the screen's pixels the MyGL created next renders
+    // the scene at, and runs the underwater and lava distortions at; both
+    // are upscaled to the screen by the overlay shader (the scene by
+    // m_temporalUpsampler, unless setTemporalUpsample(false)). In (0, 1].
+    static void setRenderScale(float renderScale, float effectScale);
+    // whether the MyGL created next upscales a scaled scene temporally
+    // (see TemporalUpsampler) rather than with the overlay shader's
+    // filter alone; on by default
+    static void setTemporalUpsample(bool temporal);
+    // whether the underwater and lava passes of the MyGL created next hash
+    // their noise per pixel, rather than read it from PostNoise's texture
+    static void setProceduralEffects(bool procedural);
+    // the block textures' anisotropic filtering (1: none) and compression
+    // (see TextureArray::setSampling), for the MyGL created next
+    static void setTextureQuality(float anisotropy, bool compressed);
+    // the texels across each of the sun's shadow cascades (see ShadowMap)
+    // for the MyGL created next; 0: no shadows
+    static void setShadowResolution(int resolution);
+    // whether the MyGL created next lights the terrain per pixel from its
+    // emissive blocks (see ClusteredLights) on top of the block light; on
+    // by default
+    static void setPointLights(bool enabled);
+    // whether the MyGL created next shows particles (see ParticleSystem);
+    // on by default
+    static void setParticles(bool enabled);
+    // how many times a second the MyGL created next sends the player info
+    // window what changed; 0 sends nothing, 10 by default
+    static void setInfoRate(int updatesPerSecond);
+    // whether the MyGL created next carves the caves of its world only
+    // near the player (see Terrain::setDeferredCaves)
+    static void setDeferredCaves(bool deferred);
+    // whether the MyGL created next keeps its chunk meshes on disk for
+    // the next session (see Terrain::setMeshCaching); on by default
+    static void setMeshCache(bool enabled);
+    // whether the MyGL created next streams and draws a circle of this
+    // many chunks around the player instead of 5 x 5 zones; 0: the zones
+    static void setViewRadius(int chunks);
+    // whether the MyGL created next blends its water, ice and glass with
+    // weighted blended order-independent transparency (see
+    // TransparencyBuffer) rather than back to front
+    static void setOrderIndependentTransparency(bool enabled);
+    // whether the MyGL created next lays down the opaque chunks' depth
+    // before shading them, so each pixel is shaded once (see renderTerrain)
+    static void setDepthPrePass(bool enabled);
+    // whether the MyGL created next draws with reversed depth and no far
+    // plane where the context has glClipControl (see Camera::setReverseZ)
+    static void setReverseZ(bool enabled);
+    // the frame time, in ms, the MyGL created next holds its frames to by
+    // lowering its render scale, distant terrain, NPC detail and upload
+    // budget (see QualityController); 0: none
+    static void setTargetFrameTime(float ms);
+    // the main thread time, in ms, past which the MyGL created next writes
+    // a trace of its last seconds (see FrameWatchdog); 0: none, 50 by
+    // default
+    static void setLongFrameTime(float ms);
+    // the GPU memory, in MB, the MyGL created next keeps its textures and
+    // chunk meshes to by evicting the farthest meshes; 0: a share of what
+    // the driver reports, if it does
+    static void setGpuMemoryBudget(int megabytes);
+    // the file the MyGL created next logs its session's inputs to, and
+    // the one it replays in place of the inputs (see InputRecorder);
+    // empty: none
+    static void setInputLog(const QString &recordPath, const QString &replayPath);
+    // the world server (see NetServer) the MyGL created next plays on,
+    // rather than on its own world; an empty host: none
+    static void setServer(const QString &host, quint16 port);
+
     // Called once when MyGL is initialized.
     // Once this is called, all OpenGL function
     // invocations are valid (before this, they
@@ -139,13 +466,37 @@ public:
     // Called from paintGL().
     // Calls Terrain::draw().
     void renderTerrain(TerrainDrawType drawType);
+    // Called from paintGL(), with m_transparencyBuffer created.
+    // The transparent terrain into it, then resolved over m_frameBuffer.
+    void renderTransparencyBuffer();
+    // Called from paintGL(), if s_depthPrePass.
+    // The depth of the opaque chunks, for renderTerrain to shade against.
+    void renderDepthPrePass();
+    // The depth convention of the camera's passes (reversed, with
+    // m_clipControl) or of the rest: clip control, depth test and clear
+    void setSceneDepth(bool reversed);
 
     // Called from paintGL()
-    // Render the shader program with simple texture map
-    void renderTexture(Texture& texture, ShaderProgram& shaderProgram, int slot, Drawable* d);
+    // Render the widgets and the text over the frame
+    void renderHud();
 
-    void stopWalkingSounds();
-    void playWalkingSounds();
+    // Called from paintGL()
+    // The underwater or lava program, or nullptr (see mygl.cpp)
+    ShaderProgram *updatePostEffect();
+
+    // The steps' loop for the player's ground, while they walk
+    StepSound walkingSound() const;
+
+    // Put the player at position, looking along look, until the next
+    // call; the camera of a scripted benchmark (see flythrough/main.cpp)
+    void placePlayer(glm::vec3 position, glm::vec3 look);
+    // Run a frame of a MyGL that is never shown: tick() and paintGL()
+    // into the widget's frame buffer object, waiting for the GPU to
+    // finish it. The first call creates the context, on an offscreen
+    // surface, and initializes it at the widget's size.
+    void runHeadlessFrame();
+    const Terrain &getTerrain() const;
+    const FrameProfile &getFrameProfile() const;
 
 protected:
     // Automatically invoked when the user
@@ -164,8 +515,18 @@ protected:
     // releases a mouse button
     void mouseReleaseEvent(QMouseEvent *e);
 
+public slots:
+    // from the debug panel
+    void slot_setTerrainThreads(int);
+    void slot_setGenerationThreads(int);
+    void slot_setMeshingThreads(int);
+    void slot_setNPCThreads(int);
+    void slot_setPathSearches(int);
+
 private slots:
     void tick(); // Slot that gets called ~60 times per second by m_timer firing.
+    void slot_frameSwapped(); // Ends FramePhase::submit; starts the next frame unless m_timer does.
+    void slot_applicationStateChanged(Qt::ApplicationState state); // Starts or ends the idling.
 
 signals:
     void sig_sendPlayerPos(QString) const;
@@ -174,6 +535,14 @@ signals:
     void sig_sendPlayerLook(QString) const;
     void sig_sendPlayerChunk(QString) const;
     void sig_sendPlayerTerrainZone(QString) const;
+    void sig_sendTerrainUploadQueue(QString) const;
+    void sig_sendTerrainCulling(QString) const;
+    void sig_sendFramePhases(QString) const;
+    void sig_sendTerrainPipeline(QString) const;
+    void sig_sendMemory(QString) const;
+    void sig_sendPerformance(QString) const;
+    // terrain, generation, meshing and NPC threads, then path searches per tick
+    void sig_sendThreadSettings(int, int, int, int, int) const;
 };
 
 
@@ -0,0 +1,233 @@
+#include "netclient.h"
+#include "scene/npcsimulation.h"
+#include <iostream>
+#include <unordered_map>
+
+NetClient::NetClient()
+    : m_socket(), m_reader(), m_stats(), m_helloReceived(false), m_hello(), m_error(),
+      m_sentView(), m_viewSent(false), m_lastPingMs(0),
+      m_snapshots(), m_snapshotClock(), m_edits()
+{}
+
+void NetClient::connectTo(const QString &host, quint16 port)
+{
+    m_error.clear();
+    m_socket.connectToHost(host, port);
+    m_socket.setSocketOption(QAbstractSocket::LowDelayOption, 1);
+}
+
+void NetClient::disconnect()
+{
+    m_socket.abort();
+}
+
+bool NetClient::isActive() const
+{
+    return m_error.isEmpty() && (m_socket.state() == QAbstractSocket::ConnectingState
+                                 || m_socket.state() == QAbstractSocket::HostLookupState
+                                 || m_socket.state() == QAbstractSocket::ConnectedState);
+}
+
+QString NetClient::getError() const
+{
+    return m_error;
+}
+
+void NetClient::send(NetMessageType type, const QByteArray &payload)
+{
+    QByteArray frame = NetProtocol::frame(type, payload);
+    m_socket.write(frame);
+    m_stats.noteSent(type, frame.size());
+}
+
+void NetClient::fail(const QString &error)
+{
+    if (m_error.isEmpty()) {
+        m_error = error;
+        std::cout << "Disconnected: " << error.toStdString() << std::endl;
+    }
+    m_socket.abort();
+}
+
+/**
+ * @brief NetClient::receiveSnapshot
+ *  Half a second of snapshots is plenty for the delay.
+ * @param step
+ * @param npcs : taken
+ */
+void NetClient::receiveSnapshot(uint32_t step, std::vector<NetNPCState> &npcs)
+{
+    double time = step * static_cast<double>(NPCSimulation::stepSeconds);
+    if (!m_snapshots.empty() && time <= m_snapshots.back().time) {
+        return;
+    }
+    m_snapshots.push_back(Snapshot{time, std::move(npcs)});
+    m_snapshotClock.start();
+    while (m_snapshots.size() > 2 && m_snapshots[1].time < time - 0.5) {
+        m_snapshots.pop_front();
+    }
+}
+
+void NetClient::poll(Terrain &terrain)
+{
+    if (m_socket.state() != QAbstractSocket::ConnectedState) {
+        if (m_error.isEmpty() && m_socket.state() == QAbstractSocket::UnconnectedState) {
+            fail(m_socket.errorString());
+        }
+        return;
+    }
+    m_reader.append(m_socket.readAll());
+    NetMessageType type;
+    QByteArray payload;
+    bool ok = true;
+    while (ok && m_reader.next(type, payload)) {
+        m_stats.noteReceived(type, 5 + payload.size());
+        if (!m_helloReceived && type != NetMessageType::hello) {
+            ok = false;
+            break;
+        }
+        switch (type) {
+        case NetMessageType::hello:
+            ok = NetProtocol::decodeHello(payload, m_hello);
+            if (ok && m_hello.version != netProtocolVersion) {
+                fail(QString("the server speaks protocol %1, not %2").arg(m_hello.version).arg(netProtocolVersion));
+                return;
+            }
+            if (ok && (m_hello.worldSeed != terrain.getWorldSeed() || m_hello.gradientHash != terrain.getGradientHash())) {
+                fail(QString("the server's world seed is 0x%1, not 0x%2")
+                     .arg(m_hello.worldSeed, 0, 16).arg(terrain.getWorldSeed(), 0, 16));
+                return;
+            }
+            m_helloReceived = ok;
+            break;
+        case NetMessageType::chunk: {
+            glm::ivec2 corner;
+            QByteArray blocks;
+            ok = NetProtocol::decodeChunk(payload, corner, blocks);
+            if (ok) {
+                terrain.receiveChunk(corner[0], corner[1], mkS<const QByteArray>(std::move(blocks)));
+            }
+            break;
+        }
+        case NetMessageType::blockEdits:
+            ok = NetProtocol::decodeBlockEdits(payload, m_edits);
+            if (ok) {
+                terrain.applyRemoteEdits(m_edits);
+            }
+            break;
+        case NetMessageType::npcSnapshot: {
+            uint32_t step;
+            std::vector<NetNPCState> npcs;
+            ok = NetProtocol::decodeNPCSnapshot(payload, step, npcs);
+            if (ok) {
+                receiveSnapshot(step, npcs);
+            }
+            break;
+        }
+        case NetMessageType::ping: {
+            uint32_t ms;
+            ok = NetProtocol::decodePing(payload, ms);
+            if (ok) {
+                send(NetMessageType::pong, payload);
+            }
+            break;
+        }
+        case NetMessageType::pong: {
+            uint32_t ms;
+            ok = NetProtocol::decodePing(payload, ms);
+            if (ok) {
+                m_stats.noteRoundTrip(static_cast<float>(m_stats.now() - ms));
+            }
+            break;
+        }
+        default:
+            // view only goes to the server
+            ok = false;
+            break;
+        }
+    }
+    if (!ok || m_reader.failed()) {
+        fail("the server sent a malformed message");
+        return;
+    }
+
+    // the round trip as seen from this side, once a second
+    if (m_helloReceived && m_stats.now() - m_lastPingMs >= 1000) {
+        m_lastPingMs = m_stats.now();
+        send(NetMessageType::ping, NetProtocol::encodePing(m_lastPingMs));
+    }
+}
+
+void NetClient::sendView(glm::vec3 pos, glm::vec3 forward)
+{
+    if (!m_helloReceived) {
+        return;
+    }
+    // a block's move or a few degrees' turn
+    if (m_viewSent && glm::distance(pos, m_sentView.position) < 1.f
+            && glm::dot(forward, m_sentView.forward) > 0.995f) {
+        return;
+    }
+    m_sentView = NetView{pos, forward};
+    m_viewSent = true;
+    send(NetMessageType::view, NetProtocol::encodeView(m_sentView));
+}
+
+void NetClient::sendEdits(Terrain &terrain)
+{
+    terrain.takeBlockEdits(m_edits);
+    if (m_helloReceived && !m_edits.empty()) {
+        send(NetMessageType::blockEdits, NetProtocol::encodeBlockEdits(m_edits));
+    }
+    m_socket.flush();
+}
+
+/**
+ * @brief NetClient::getNPCs
+ *  An NPC in only one of the two snapshots is drawn as that one has it;
+ *  past the newest snapshot they hold still rather than guess ahead.
+ * @param npcs : cleared first
+ */
+void NetClient::getNPCs(std::vector<NetNPCState> &npcs) const
+{
+    npcs.clear();
+    if (m_snapshots.empty()) {
+        return;
+    }
+    double renderTime = m_snapshots.back().time + m_snapshotClock.nsecsElapsed() / 1e9 - interpolationDelay;
+    size_t b = 0;
+    while (b < m_snapshots.size() && m_snapshots[b].time < renderTime) {
+        b++;
+    }
+    if (b == 0 || b == m_snapshots.size()) {
+        npcs = b == 0 ? m_snapshots.front().npcs : m_snapshots.back().npcs;
+        return;
+    }
+    const Snapshot &from = m_snapshots[b - 1];
+    const Snapshot &to = m_snapshots[b];
+    float t = static_cast<float>((renderTime - from.time) / (to.time - from.time));
+
+    std::unordered_map<uint16_t, const NetNPCState*> before;
+    for (const NetNPCState &npc : from.npcs) {
+        before[npc.id] = &npc;
+    }
+    npcs = to.npcs;
+    for (NetNPCState &npc : npcs) {
+        auto found = before.find(npc.id);
+        if (found == before.end()) {
+            continue;
+        }
+        const NetNPCState &a = *found->second;
+        npc.position = glm::mix(a.position, npc.position, t);
+        // the short way around
+        float turn = npc.yaw - a.yaw;
+        float turnSpan = 2.f * glm::pi<float>();
+        turn -= turnSpan * glm::floor((turn + glm::pi<float>()) / turnSpan);
+        npc.yaw = a.yaw + turn * t;
+    }
+}
+
+const NetStats &NetClient::getStats() const
+{
+    return m_stats;
+}
@@ -0,0 +1,79 @@
+#pragma once
+#include "netprotocol.h"
+#include <QElapsedTimer>
+#include <QTcpSocket>
+#include <deque>
+#include <vector>
+
+/**
+ * @brief The NetClient class
+ *  The game's side of the streaming protocol (see netprotocol.h): the
+ *  chunks a WorldServer sends replace the generated ones, the edits it
+ *  sends are placed, and its NPCs are drawn a little in the past,
+ *  between the two snapshots around that time. Polled once a tick; main
+ *  thread only.
+ */
+class NetClient
+{
+private:
+    QTcpSocket m_socket;
+    NetFrameReader m_reader;
+    NetStats m_stats;
+    bool m_helloReceived;
+    NetHello m_hello;
+    QString m_error;
+
+    // the last view sent, to send again only once it changed
+    NetView m_sentView;
+    bool m_viewSent;
+    // when the last ping went, in NetStats::now() ms
+    uint32_t m_lastPingMs;
+
+    struct Snapshot
+    {
+        // server time, in seconds
+        double time;
+        std::vector<NetNPCState> npcs;
+    };
+    // the latest few, oldest first
+    std::deque<Snapshot> m_snapshots;
+    // the server time of the newest and when it arrived, to tell the
+    // server's time in between
+    QElapsedTimer m_snapshotClock;
+
+    std::vector<BlockEdit> m_edits;
+
+    void send(NetMessageType type, const QByteArray &payload);
+    void fail(const QString &error);
+    void receiveSnapshot(uint32_t step, std::vector<NetNPCState> &npcs);
+
+public:
+    // how far behind the server's latest snapshot the NPCs are drawn:
+    // two snapshots' worth, so one late snapshot does not stall them
+    static constexpr float interpolationDelay = 0.1f;
+
+    NetClient();
+
+    // start connecting; poll() tells how it went
+    void connectTo(const QString &host, quint16 port);
+    void disconnect();
+    // connecting or connected, and nothing went wrong
+    bool isActive() const;
+    // why the connection ended, if it did
+    QString getError() const;
+
+    // Read what the server sent: chunks go to terrain.receiveChunk, edits
+    // to applyRemoteEdits, pings are answered. A server of another world
+    // seed is disconnected.
+    void poll(Terrain &terrain);
+    // send where the player is, if it moved or turned enough to matter
+    void sendView(glm::vec3 pos, glm::vec3 forward);
+    // send the edits the terrain tracked (see Terrain::setEditTracking)
+    void sendEdits(Terrain &terrain);
+
+    // the server's NPCs as of interpolationDelay before its latest
+    // snapshot, between the two snapshots around that time
+    void getNPCs(std::vector<NetNPCState> &npcs) const;
+
+    const NetStats &getStats() const;
+};
@@ -0,0 +1,499 @@
+#include "netprotocol.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+
+//--------------------------
+// Little endian fields
+//--------------------------
+namespace {
+
+void putU8(QByteArray &out, uint8_t v)
+{
+    out.append(static_cast<char>(v));
+}
+
+void putU16(QByteArray &out, uint16_t v)
+{
+    putU8(out, static_cast<uint8_t>(v));
+    putU8(out, static_cast<uint8_t>(v >> 8));
+}
+
+void putU32(QByteArray &out, uint32_t v)
+{
+    putU16(out, static_cast<uint16_t>(v));
+    putU16(out, static_cast<uint16_t>(v >> 16));
+}
+
+void putU64(QByteArray &out, uint64_t v)
+{
+    putU32(out, static_cast<uint32_t>(v));
+    putU32(out, static_cast<uint32_t>(v >> 32));
+}
+
+void putF32(QByteArray &out, float v)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    putU32(out, bits);
+}
+
+void putVec3(QByteArray &out, glm::vec3 v)
+{
+    putF32(out, v.x);
+    putF32(out, v.y);
+    putF32(out, v.z);
+}
+
+// Reads the fields in order; once a read runs past the end, every later
+// one reads 0 and ok() is false
+class FieldReader
+{
+private:
+    const QByteArray &m_data;
+    int m_pos;
+    bool m_ok;
+
+public:
+    explicit FieldReader(const QByteArray &data)
+        : m_data(data), m_pos(0), m_ok(true)
+    {}
+
+    bool ok() const {
+        return m_ok;
+    }
+    // every byte was read, and no more
+    bool done() const {
+        return m_ok && m_pos == m_data.size();
+    }
+    int remaining() const {
+        return m_data.size() - m_pos;
+    }
+
+    uint8_t u8() {
+        if (m_pos + 1 > m_data.size()) {
+            m_ok = false;
+            return 0;
+        }
+        return static_cast<uint8_t>(m_data[m_pos++]);
+    }
+    uint16_t u16() {
+        uint16_t lo = u8();
+        return static_cast<uint16_t>(lo | (u8() << 8));
+    }
+    uint32_t u32() {
+        uint32_t lo = u16();
+        return lo | (static_cast<uint32_t>(u16()) << 16);
+    }
+    uint64_t u64() {
+        uint64_t lo = u32();
+        return lo | (static_cast<uint64_t>(u32()) << 32);
+    }
+    float f32() {
+        uint32_t bits = u32();
+        float v;
+        std::memcpy(&v, &bits, sizeof(v));
+        return v;
+    }
+    glm::vec3 vec3() {
+        float x = f32();
+        float y = f32();
+        return glm::vec3(x, y, f32());
+    }
+    QByteArray rest() {
+        QByteArray bytes = m_data.mid(m_pos);
+        m_pos = m_data.size();
+        return bytes;
+    }
+};
+
+}
+
+//--------------------------
+// Messages
+//--------------------------
+QByteArray NetProtocol::frame(NetMessageType type, const QByteArray &payload)
+{
+    QByteArray out;
+    out.reserve(5 + payload.size());
+    putU32(out, static_cast<uint32_t>(payload.size() + 1));
+    putU8(out, static_cast<uint8_t>(type));
+    out.append(payload);
+    return out;
+}
+
+QByteArray NetProtocol::encodeHello(const NetHello &hello)
+{
+    QByteArray out;
+    putU32(out, hello.version);
+    putU64(out, hello.worldSeed);
+    putU8(out, static_cast<uint8_t>(hello.gradientHash));
+    putVec3(out, hello.spawn);
+    return out;
+}
+
+QByteArray NetProtocol::encodeView(const NetView &view)
+{
+    QByteArray out;
+    putVec3(out, view.position);
+    putVec3(out, view.forward);
+    return out;
+}
+
+QByteArray NetProtocol::encodeChunk(glm::ivec2 corner, const std::vector<uint8_t> &blocks)
+{
+    QByteArray out;
+    putU32(out, static_cast<uint32_t>(corner[0]));
+    putU32(out, static_cast<uint32_t>(corner[1]));
+    out.append(qCompress(reinterpret_cast<const uchar*>(blocks.data()), static_cast<int>(blocks.size())));
+    return out;
+}
+
+/**
+ * @brief NetProtocol::encodeBlockEdits
+ *  An edit costs 3 bytes, plus 10 per chunk edited: a player's edits
+ *  cluster, so most share the corner.
+ * @param edits : at most 65535 per chunk and 65535 chunks
+ * @return
+ */
+QByteArray NetProtocol::encodeBlockEdits(const std::vector<BlockEdit> &edits)
+{
+    // by chunk corner, in order of first edit within each
+    std::map<std::pair<int, int>, std::vector<const BlockEdit*>> byChunk;
+    for (const BlockEdit &edit : edits) {
+        byChunk[{edit.pos.x & ~15, edit.pos.z & ~15}].push_back(&edit);
+    }
+
+    QByteArray out;
+    putU16(out, static_cast<uint16_t>(byChunk.size()));
+    for (const auto &chunk : byChunk) {
+        putU32(out, static_cast<uint32_t>(chunk.first.first));
+        putU32(out, static_cast<uint32_t>(chunk.first.second));
+        putU16(out, static_cast<uint16_t>(chunk.second.size()));
+        for (const BlockEdit *edit : chunk.second) {
+            putU8(out, static_cast<uint8_t>(((edit->pos.x & 15) << 4) | (edit->pos.z & 15)));
+            putU8(out, static_cast<uint8_t>(edit->pos.y));
+            putU8(out, static_cast<uint8_t>(edit->type));
+        }
+    }
+    return out;
+}
+
+/**
+ * @brief NetProtocol::encodeNPCSnapshot
+ *  Positions are rounded to 1/64 block and the yaw to 1/65536 turn: far
+ *  below what is seen, at 14 bytes an NPC rather than 30.
+ * @param step
+ * @param npcs : at most 65535
+ * @return
+ */
+QByteArray NetProtocol::encodeNPCSnapshot(uint32_t step, const std::vector<NetNPCState> &npcs)
+{
+    QByteArray out;
+    out.reserve(6 + 14 * static_cast<int>(npcs.size()));
+    putU32(out, step);
+    putU16(out, static_cast<uint16_t>(npcs.size()));
+    for (const NetNPCState &npc : npcs) {
+        putU16(out, npc.id);
+        putU8(out, static_cast<uint8_t>(npc.kind));
+        putU8(out, npc.texture);
+        putU32(out, static_cast<uint32_t>(static_cast<int32_t>(std::lround(npc.position.x * netPositionScale))));
+        putU32(out, static_cast<uint32_t>(static_cast<int32_t>(std::lround(npc.position.z * netPositionScale))));
+        float y = glm::clamp(npc.position.y * netPositionScale, 0.f, 65535.f);
+        putU16(out, static_cast<uint16_t>(std::lround(y)));
+        float turns = npc.yaw / (2.f * glm::pi<float>());
+        turns -= std::floor(turns);
+        putU16(out, static_cast<uint16_t>(std::lround(turns * 65536.f) & 0xFFFF));
+    }
+    return out;
+}
+
+QByteArray NetProtocol::encodePing(uint32_t ms)
+{
+    QByteArray out;
+    putU32(out, ms);
+    return out;
+}
+
+bool NetProtocol::decodeHello(const QByteArray &payload, NetHello &hello)
+{
+    FieldReader in(payload);
+    hello.version = in.u32();
+    hello.worldSeed = in.u64();
+    hello.gradientHash = static_cast<GradientHash>(in.u8());
+    hello.spawn = in.vec3();
+    return in.done();
+}
+
+bool NetProtocol::decodeView(const QByteArray &payload, NetView &view)
+{
+    FieldReader in(payload);
+    view.position = in.vec3();
+    view.forward = in.vec3();
+    return in.done();
+}
+
+bool NetProtocol::decodeChunk(const QByteArray &payload, glm::ivec2 &corner, QByteArray &blocks)
+{
+    FieldReader in(payload);
+    corner[0] = static_cast<int32_t>(in.u32());
+    corner[1] = static_cast<int32_t>(in.u32());
+    if (!in.ok() || (corner[0] & 15) != 0 || (corner[1] & 15) != 0) {
+        return false;
+    }
+    // qUncompress gives an empty array for a malformed stream
+    blocks = qUncompress(in.rest());
+    return !blocks.isEmpty();
+}
+
+bool NetProtocol::decodeBlockEdits(const QByteArray &payload, std::vector<BlockEdit> &edits)
+{
+    edits.clear();
+    FieldReader in(payload);
+    int chunks = in.u16();
+    for (int c = 0; c < chunks && in.ok(); c++) {
+        int x = static_cast<int32_t>(in.u32());
+        int z = static_cast<int32_t>(in.u32());
+        int count = in.u16();
+        if ((x & 15) != 0 || (z & 15) != 0 || in.remaining() < 3 * count) {
+            return false;
+        }
+        for (int i = 0; i < count; i++) {
+            uint8_t xz = in.u8();
+            int y = in.u8();
+            BlockType type = static_cast<BlockType>(in.u8());
+            edits.push_back(BlockEdit{glm::ivec3(x + (xz >> 4), y, z + (xz & 15)), type});
+        }
+    }
+    return in.done();
+}
+
+bool NetProtocol::decodeNPCSnapshot(const QByteArray &payload, uint32_t &step, std::vector<NetNPCState> &npcs)
+{
+    npcs.clear();
+    FieldReader in(payload);
+    step = in.u32();
+    int count = in.u16();
+    if (!in.ok() || in.remaining() != 14 * count) {
+        return false;
+    }
+    npcs.reserve(count);
+    for (int i = 0; i < count; i++) {
+        NetNPCState npc;
+        npc.id = in.u16();
+        npc.kind = static_cast<NetNPCKind>(in.u8());
+        npc.texture = in.u8();
+        float x = static_cast<int32_t>(in.u32()) / netPositionScale;
+        float z = static_cast<int32_t>(in.u32()) / netPositionScale;
+        float y = in.u16() / netPositionScale;
+        npc.position = glm::vec3(x, y, z);
+        npc.yaw = in.u16() / 65536.f * 2.f * glm::pi<float>();
+        npcs.push_back(npc);
+    }
+    return in.done();
+}
+
+bool NetProtocol::decodePing(const QByteArray &payload, uint32_t &ms)
+{
+    FieldReader in(payload);
+    ms = in.u32();
+    return in.done();
+}
+
+const char *NetProtocol::getName(NetMessageType type)
+{
+    switch (type) {
+    case NetMessageType::hello:
+        return "hello";
+    case NetMessageType::view:
+        return "view";
+    case NetMessageType::chunk:
+        return "chunks";
+    case NetMessageType::blockEdits:
+        return "edits";
+    case NetMessageType::npcSnapshot:
+        return "NPCs";
+    case NetMessageType::ping:
+        return "ping";
+    case NetMessageType::pong:
+        return "pong";
+    default:
+        return "?";
+    }
+}
+
+//--------------------------
+// NetFrameReader
+//--------------------------
+NetFrameReader::NetFrameReader()
+    : m_buffer(), m_failed(false)
+{}
+
+void NetFrameReader::append(const QByteArray &bytes)
+{
+    m_buffer.append(bytes);
+}
+
+bool NetFrameReader::next(NetMessageType &type, QByteArray &payload)
+{
+    if (m_failed || m_buffer.size() < 4) {
+        return false;
+    }
+    FieldReader header(m_buffer);
+    uint32_t length = header.u32();
+    if (length == 0 || length > static_cast<uint32_t>(maxFrameBytes)) {
+        m_failed = true;
+        return false;
+    }
+    if (static_cast<uint32_t>(m_buffer.size() - 4) < length) {
+        return false;
+    }
+    uint8_t t = static_cast<uint8_t>(m_buffer[4]);
+    if (t >= static_cast<uint8_t>(NetMessageType::count)) {
+        m_failed = true;
+        return false;
+    }
+    type = static_cast<NetMessageType>(t);
+    payload = m_buffer.mid(5, static_cast<int>(length) - 1);
+    m_buffer.remove(0, 4 + static_cast<int>(length));
+    return true;
+}
+
+bool NetFrameReader::failed() const
+{
+    return m_failed;
+}
+
+//--------------------------
+// NetStats
+//--------------------------
+NetStats::NetStats()
+    : m_clock(), m_sentBytes(), m_sentMessages(), m_receivedBytes(), m_receivedMessages(),
+      m_windowStart(0), m_windowSent(0), m_windowReceived(0),
+      m_sentPerSecond(0.f), m_receivedPerSecond(0.f), m_roundTripMs(-1.f)
+{
+    m_sentBytes.fill(0);
+    m_sentMessages.fill(0);
+    m_receivedBytes.fill(0);
+    m_receivedMessages.fill(0);
+    m_clock.start();
+}
+
+// the window the rates are counted over, in ns
+static const qint64 rateWindowNs = 1000000000;
+
+/**
+ * @brief NetStats::roll
+ *  Close the window once a second has passed; a longer gap counts as idle
+ *  seconds.
+ */
+void NetStats::roll() const
+{
+    qint64 now = m_clock.nsecsElapsed();
+    if (now - m_windowStart < rateWindowNs) {
+        return;
+    }
+    float seconds = (now - m_windowStart) / 1e9f;
+    m_sentPerSecond = m_windowSent / seconds;
+    m_receivedPerSecond = m_windowReceived / seconds;
+    m_windowSent = 0;
+    m_windowReceived = 0;
+    m_windowStart = now;
+}
+
+void NetStats::noteSent(NetMessageType type, size_t frameBytes)
+{
+    roll();
+    m_sentBytes[static_cast<int>(type)] += frameBytes;
+    m_sentMessages[static_cast<int>(type)]++;
+    m_windowSent += frameBytes;
+}
+
+void NetStats::noteReceived(NetMessageType type, size_t frameBytes)
+{
+    roll();
+    m_receivedBytes[static_cast<int>(type)] += frameBytes;
+    m_receivedMessages[static_cast<int>(type)]++;
+    m_windowReceived += frameBytes;
+}
+
+void NetStats::noteRoundTrip(float ms)
+{
+    m_roundTripMs = ms;
+}
+
+uint32_t NetStats::now() const
+{
+    return static_cast<uint32_t>(m_clock.nsecsElapsed() / 1000000);
+}
+
+uint64_t NetStats::getSentBytes() const
+{
+    uint64_t total = 0;
+    for (uint64_t bytes : m_sentBytes) {
+        total += bytes;
+    }
+    return total;
+}
+
+uint64_t NetStats::getReceivedBytes() const
+{
+    uint64_t total = 0;
+    for (uint64_t bytes : m_receivedBytes) {
+        total += bytes;
+    }
+    return total;
+}
+
+uint64_t NetStats::getSentBytes(NetMessageType type) const
+{
+    return m_sentBytes[static_cast<int>(type)];
+}
+
+uint64_t NetStats::getSentMessages(NetMessageType type) const
+{
+    return m_sentMessages[static_cast<int>(type)];
+}
+
+uint64_t NetStats::getReceivedBytes(NetMessageType type) const
+{
+    return m_receivedBytes[static_cast<int>(type)];
+}
+
+float NetStats::getSentPerSecond() const
+{
+    roll();
+    return m_sentPerSecond;
+}
+
+float NetStats::getReceivedPerSecond() const
+{
+    roll();
+    return m_receivedPerSecond;
+}
+
+float NetStats::getRoundTripMs() const
+{
+    return m_roundTripMs;
+}
+
+QString NetStats::toQString() const
+{
+    QString text = QString("out %1 KB/s, in %2 KB/s, rtt %3 ms;")
+            .arg(getSentPerSecond() / 1024.0, 0, 'f', 1).arg(getReceivedPerSecond() / 1024.0, 0, 'f', 1)
+            .arg(m_roundTripMs, 0, 'f', 1);
+    auto addTypes = [&](const char *direction, const std::array<uint64_t, typeCount> &messages,
+                        const std::array<uint64_t, typeCount> &bytes) {
+        text += QString(" %1:").arg(direction);
+        for (int i = 0; i < typeCount; i++) {
+            if (messages[i] > 0) {
+                text += QString(" %1 %2 (%3 KB)").arg(NetProtocol::getName(static_cast<NetMessageType>(i)))
+                        .arg(messages[i]).arg(bytes[i] / 1024.0, 0, 'f', 1);
+            }
+        }
+    };
+    addTypes("out", m_sentMessages, m_sentBytes);
+    addTypes(" in", m_receivedMessages, m_receivedBytes);
+    return text;
+}
@@ -0,0 +1,190 @@
+#pragma once
+#include "scene/block.h"
+#include "scene/terrain.h"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QString>
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/**
+ * The messages of the chunk streaming protocol between a WorldServer
+ * (see NetServer) and the game (see NetClient), over TCP. Each is framed
+ * as
+ *
+ *   [0, 4)   the length of what follows
+ *   [4, 5)   its NetMessageType
+ *   [5, ...) its payload
+ *
+ * All integers are little endian. The payloads:
+ *
+ *   hello        u32 protocol version, u64 world seed, u8 gradient hash,
+ *                3 x f32 spawn position
+ *   view         3 x f32 position, 3 x f32 forward
+ *   chunk        i32 x, i32 z corner, then the chunk's
+ *                Chunk::serializeBlocks encoding (palette-compressed
+ *                sections), zlib-compressed (qCompress)
+ *   blockEdits   u16 chunks, then per chunk i32 x, i32 z corner, u16
+ *                edits and 3 bytes per edit: x << 4 | z within the
+ *                chunk, y, BlockType
+ *   npcSnapshot  u32 server step, u16 NPCs, then 14 bytes per NPC:
+ *                u16 id, u8 NetNPCKind, u8 NPCTexture, i32 x, i32 z and
+ *                u16 y in 1/64 blocks, u16 yaw in 1/65536 turns
+ *   ping, pong   u32 the sender's clock in ms, echoed back by pong
+ *
+ * The server sends hello first; the client sends view whenever it moves,
+ * and blockEdits for the blocks its player placed.
+ */
+static const uint32_t netProtocolVersion = 1;
+static const quint16 netDefaultPort = 27015;
+
+enum class NetMessageType : uint8_t
+{
+    hello = 0,
+    view,
+    chunk,
+    blockEdits,
+    npcSnapshot,
+    ping,
+    pong,
+    count
+};
+
+// the model a snapshot's NPC is drawn with
+enum class NetNPCKind : uint8_t
+{
+    sheep = 0,
+    lama,
+    zombieDragon
+};
+
+struct NetHello
+{
+    uint32_t version;
+    uint64_t worldSeed;
+    GradientHash gradientHash;
+    glm::vec3 spawn;
+};
+
+struct NetView
+{
+    glm::vec3 position;
+    glm::vec3 forward;
+};
+
+struct NetNPCState
+{
+    uint16_t id;
+    NetNPCKind kind;
+    uint8_t texture;
+    glm::vec3 position;
+    // radians about +y, 0 facing +z
+    float yaw;
+};
+
+// units per block of a snapshot's positions
+static const float netPositionScale = 64.f;
+
+namespace NetProtocol {
+    // A whole frame: the length, the type and the payload
+    QByteArray frame(NetMessageType type, const QByteArray &payload);
+
+    QByteArray encodeHello(const NetHello &hello);
+    QByteArray encodeView(const NetView &view);
+    // blocks: a Chunk::serializeBlocks encoding
+    QByteArray encodeChunk(glm::ivec2 corner, const std::vector<uint8_t> &blocks);
+    // grouped by chunk; the order within a chunk is kept
+    QByteArray encodeBlockEdits(const std::vector<BlockEdit> &edits);
+    QByteArray encodeNPCSnapshot(uint32_t step, const std::vector<NetNPCState> &npcs);
+    QByteArray encodePing(uint32_t ms);
+
+    // false if the payload is malformed
+    bool decodeHello(const QByteArray &payload, NetHello &hello);
+    bool decodeView(const QByteArray &payload, NetView &view);
+    bool decodeChunk(const QByteArray &payload, glm::ivec2 &corner, QByteArray &blocks);
+    bool decodeBlockEdits(const QByteArray &payload, std::vector<BlockEdit> &edits);
+    bool decodeNPCSnapshot(const QByteArray &payload, uint32_t &step, std::vector<NetNPCState> &npcs);
+    bool decodePing(const QByteArray &payload, uint32_t &ms);
+
+    const char *getName(NetMessageType type);
+}
+
+/**
+ * @brief The NetFrameReader class
+ *  Splits the bytes read from a connection back into messages, however
+ *  the stream cut them up.
+ */
+class NetFrameReader
+{
+public:
+    // a frame longer than this ends the connection
+    static const int maxFrameBytes = 1 << 20;
+
+private:
+    QByteArray m_buffer;
+    bool m_failed;
+
+public:
+    NetFrameReader();
+
+    void append(const QByteArray &bytes);
+    // the next whole message, if any; false too once failed()
+    bool next(NetMessageType &type, QByteArray &payload);
+    // a frame was too long or of no known type
+    bool failed() const;
+};
+
+/**
+ * @brief The NetStats class
+ *  One connection's traffic: the bytes each way in all and per message
+ *  type, their rates over the last second, and the round trip time of
+ *  the last ping.
+ */
+class NetStats
+{
+private:
+    static const int typeCount = static_cast<int>(NetMessageType::count);
+
+    QElapsedTimer m_clock;
+    std::array<uint64_t, typeCount> m_sentBytes;
+    std::array<uint64_t, typeCount> m_sentMessages;
+    std::array<uint64_t, typeCount> m_receivedBytes;
+    std::array<uint64_t, typeCount> m_receivedMessages;
+
+    // the rates over the last whole second, brought up to date by
+    // whatever reads or adds to them
+    mutable qint64 m_windowStart;
+    mutable uint64_t m_windowSent;
+    mutable uint64_t m_windowReceived;
+    mutable float m_sentPerSecond;
+    mutable float m_receivedPerSecond;
+
+    float m_roundTripMs;
+
+    void roll() const;
+
+public:
+    NetStats();
+
+    // frameBytes: the whole frame's
+    void noteSent(NetMessageType type, size_t frameBytes);
+    void noteReceived(NetMessageType type, size_t frameBytes);
+    void noteRoundTrip(float ms);
+    // ms since the connection started, for pings
+    uint32_t now() const;
+
+    uint64_t getSentBytes() const;
+    uint64_t getSentBytes(NetMessageType type) const;
+    uint64_t getSentMessages(NetMessageType type) const;
+    uint64_t getReceivedBytes() const;
+    uint64_t getReceivedBytes(NetMessageType type) const;
+    float getSentPerSecond() const;
+    float getReceivedPerSecond() const;
+    // -1 before the first pong
+    float getRoundTripMs() const;
+
+    // one line: the rates, the round trip and the messages and bytes of
+    // each type either way
+    QString toQString() const;
+};
@@ -0,0 +1,241 @@
+#include "netserver.h"
+#include <algorithm>
+#include <iostream>
+
+NetConnection::NetConnection(uPtr<QTcpSocket> socket, int streamRadius)
+    : socket(std::move(socket)), reader(), streamer(streamRadius), stats(), chunkBudget(0.f)
+{}
+
+NetServer::NetServer(const Terrain &terrain, glm::vec3 spawn, int streamRadius)
+    : m_server(), m_connections(),
+      m_hello{netProtocolVersion, terrain.getWorldSeed(), terrain.getGradientHash(), spawn},
+      m_streamRadius(streamRadius), m_chunkRate(0.f),
+      m_snapshotAccumulator(0.f), m_pingAccumulator(0.f),
+      m_edits(), m_connectionEdits(), m_corners(), m_blocks(), m_nearNPCs()
+{}
+
+NetServer::~NetServer()
+{
+    // the sockets are the server's children: gone before it
+    m_connections.clear();
+}
+
+bool NetServer::listen(quint16 port)
+{
+    return m_server.listen(QHostAddress::Any, port);
+}
+
+QString NetServer::getError() const
+{
+    return m_server.errorString();
+}
+
+void NetServer::setChunkRate(float bytesPerSecond)
+{
+    m_chunkRate = bytesPerSecond;
+}
+
+void NetServer::send(NetConnection &connection, NetMessageType type, const QByteArray &payload)
+{
+    QByteArray frame = NetProtocol::frame(type, payload);
+    connection.socket->write(frame);
+    connection.stats.noteSent(type, frame.size());
+}
+
+void NetServer::accept()
+{
+    while (m_server.hasPendingConnections()) {
+        uPtr<QTcpSocket> socket(m_server.nextPendingConnection());
+        // snapshots and edits are small: never hold them back
+        socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+        std::cout << "client " << socket->peerAddress().toString().toStdString()
+                  << " connected" << std::endl;
+        m_connections.push_back(mkU<NetConnection>(std::move(socket), m_streamRadius));
+        send(*m_connections.back(), NetMessageType::hello, NetProtocol::encodeHello(m_hello));
+    }
+}
+
+/**
+ * @brief NetServer::receive
+ *  A client that sends what cannot be read is dropped (its socket is
+ *  aborted, and tick() removes it).
+ * @param connection
+ * @param terrain
+ */
+void NetServer::receive(NetConnection &connection, Terrain &terrain)
+{
+    connection.reader.append(connection.socket->readAll());
+    NetMessageType type;
+    QByteArray payload;
+    bool ok = true;
+    while (ok && connection.reader.next(type, payload)) {
+        connection.stats.noteReceived(type, 5 + payload.size());
+        switch (type) {
+        case NetMessageType::view: {
+            NetView view;
+            ok = NetProtocol::decodeView(payload, view);
+            if (ok) {
+                connection.streamer.setView(view.position, view.forward);
+            }
+            break;
+        }
+        case NetMessageType::blockEdits: {
+            std::vector<BlockEdit> edits;
+            ok = NetProtocol::decodeBlockEdits(payload, edits);
+            if (ok) {
+                // tracked: every client gets them, the sender too (placing
+                // a block twice changes nothing)
+                terrain.beginEdit();
+                for (const BlockEdit &edit : edits) {
+                    terrain.placeBlockAt(edit.pos.x, edit.pos.y, edit.pos.z, edit.type);
+                }
+                terrain.commitEdit();
+            }
+            break;
+        }
+        case NetMessageType::ping: {
+            uint32_t ms;
+            ok = NetProtocol::decodePing(payload, ms);
+            if (ok) {
+                send(connection, NetMessageType::pong, payload);
+            }
+            break;
+        }
+        case NetMessageType::pong: {
+            uint32_t ms;
+            ok = NetProtocol::decodePing(payload, ms);
+            if (ok) {
+                connection.stats.noteRoundTrip(static_cast<float>(connection.stats.now() - ms));
+            }
+            break;
+        }
+        default:
+            // hello, chunk and npcSnapshot only go to clients
+            ok = false;
+            break;
+        }
+    }
+    if (!ok || connection.reader.failed()) {
+        std::cout << "client " << connection.socket->peerAddress().toString().toStdString()
+                  << " sent a malformed message" << std::endl;
+        connection.socket->abort();
+    }
+}
+
+/**
+ * @brief NetServer::streamChunks
+ *  Sends the best chunks the client lacks while the rate allows and the
+ *  socket keeps up: a slow client falls behind on chunks, never on edits.
+ * @param connection
+ * @param terrain
+ * @param dT
+ */
+void NetServer::streamChunks(NetConnection &connection, const Terrain &terrain, float dT)
+{
+    if (m_chunkRate > 0.f) {
+        // at most a second's worth saved up
+        connection.chunkBudget = std::min(connection.chunkBudget + m_chunkRate * dT, m_chunkRate);
+    }
+    // a few per call keeps the ranking cheap; the next tick ranks again
+    const int chunksPerRanking = 8;
+    while (connection.socket->bytesToWrite() < maxChunkBacklog
+           && (m_chunkRate <= 0.f || connection.chunkBudget > 0.f)) {
+        connection.streamer.nextChunks(terrain, chunksPerRanking, m_corners);
+        if (m_corners.empty()) {
+            return;
+        }
+        for (const glm::ivec2 &corner : m_corners) {
+            terrain.findChunk(corner[0], corner[1])->serializeBlocks(m_blocks);
+            QByteArray payload = NetProtocol::encodeChunk(corner, m_blocks);
+            send(connection, NetMessageType::chunk, payload);
+            connection.streamer.markSent(corner);
+            connection.chunkBudget -= 5 + payload.size();
+            if (connection.socket->bytesToWrite() >= maxChunkBacklog
+                    || (m_chunkRate > 0.f && connection.chunkBudget <= 0.f)) {
+                return;
+            }
+        }
+    }
+}
+
+void NetServer::tick(Terrain &terrain, const std::vector<NetNPCState> &npcs, uint32_t step, float dT)
+{
+    accept();
+    for (uPtr<NetConnection> &connection : m_connections) {
+        receive(*connection, terrain);
+    }
+    m_connections.erase(std::remove_if(m_connections.begin(), m_connections.end(),
+                                       [](const uPtr<NetConnection> &connection) {
+        if (connection->socket->state() != QAbstractSocket::ConnectedState) {
+            std::cout << "client " << connection->socket->peerAddress().toString().toStdString()
+                      << " left: " << connection->stats.toQString().toStdString() << std::endl;
+            return true;
+        }
+        return false;
+    }), m_connections.end());
+
+    // edits first: a chunk streamed below already has them
+    terrain.takeBlockEdits(m_edits);
+    if (!m_edits.empty()) {
+        for (uPtr<NetConnection> &connection : m_connections) {
+            connection->streamer.filterEdits(m_edits, m_connectionEdits);
+            if (!m_connectionEdits.empty()) {
+                send(*connection, NetMessageType::blockEdits, NetProtocol::encodeBlockEdits(m_connectionEdits));
+            }
+        }
+    }
+
+    bool snapshot = (m_snapshotAccumulator += dT) >= 1.f / snapshotRate;
+    bool ping = (m_pingAccumulator += dT) >= 1.f;
+    if (snapshot) {
+        m_snapshotAccumulator = 0.f;
+    }
+    if (ping) {
+        m_pingAccumulator = 0.f;
+    }
+    for (uPtr<NetConnection> &connection : m_connections) {
+        streamChunks(*connection, terrain, dT);
+        if (snapshot && connection->streamer.hasView()) {
+            // the NPCs within the streamed chunks
+            glm::vec3 view = connection->streamer.getViewPos();
+            float radius = m_streamRadius * 16.f;
+            m_nearNPCs.clear();
+            for (const NetNPCState &npc : npcs) {
+                if (std::abs(npc.position.x - view.x) <= radius && std::abs(npc.position.z - view.z) <= radius) {
+                    m_nearNPCs.push_back(npc);
+                }
+            }
+            send(*connection, NetMessageType::npcSnapshot, NetProtocol::encodeNPCSnapshot(step, m_nearNPCs));
+        }
+        if (ping) {
+            send(*connection, NetMessageType::ping, NetProtocol::encodePing(connection->stats.now()));
+        }
+        connection->socket->flush();
+    }
+}
+
+size_t NetServer::getConnectionCount() const
+{
+    return m_connections.size();
+}
+
+bool NetServer::getFirstView(glm::vec3 &pos) const
+{
+    for (const uPtr<NetConnection> &connection : m_connections) {
+        if (connection->streamer.hasView()) {
+            pos = connection->streamer.getViewPos();
+            return true;
+        }
+    }
+    return false;
+}
+
+QString NetServer::statsText() const
+{
+    QString text;
+    for (const uPtr<NetConnection> &connection : m_connections) {
+        text += QString("%1: %2 chunks sent; %3\n").arg(connection->socket->peerAddress().toString())
+                .arg(connection->streamer.getSentCount()).arg(connection->stats.toQString());
+    }
+    return text;
+}
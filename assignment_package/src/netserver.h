@@ -0,0 +1,82 @@
+#pragma once
+#include "netprotocol.h"
+#include "scene/chunkstreamer.h"
+#include "smartpointerhelp.h"
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <vector>
+
+// One client of a NetServer
+struct NetConnection
+{
+    uPtr<QTcpSocket> socket;
+    NetFrameReader reader;
+    ChunkStreamer streamer;
+    NetStats stats;
+    // the bytes of chunks it may still be sent (see NetServer::setChunkRate)
+    float chunkBudget;
+
+    NetConnection(uPtr<QTcpSocket> socket, int streamRadius);
+};
+
+/**
+ * @brief The NetServer class
+ *  The world server's side of the streaming protocol (see netprotocol.h):
+ *  sends each client the chunks around its view, the block edits made to
+ *  the chunks it has, and the NPCs near it. Polled from the server loop,
+ *  with the Qt events processed in between; main thread only.
+ */
+class NetServer
+{
+private:
+    QTcpServer m_server;
+    std::vector<uPtr<NetConnection>> m_connections;
+    NetHello m_hello;
+    // in chunks around each client's view
+    int m_streamRadius;
+    // chunk bytes per second per client; <= 0: as fast as the socket takes them
+    float m_chunkRate;
+    // seconds since the last NPC snapshot and ping
+    float m_snapshotAccumulator;
+    float m_pingAccumulator;
+
+    // scratch, kept to reuse their storage
+    std::vector<BlockEdit> m_edits;
+    std::vector<BlockEdit> m_connectionEdits;
+    std::vector<glm::ivec2> m_corners;
+    std::vector<uint8_t> m_blocks;
+    std::vector<NetNPCState> m_nearNPCs;
+
+    void send(NetConnection &connection, NetMessageType type, const QByteArray &payload);
+    void accept();
+    void receive(NetConnection &connection, Terrain &terrain);
+    void streamChunks(NetConnection &connection, const Terrain &terrain, float dT);
+
+public:
+    // the snapshots sent per second
+    static constexpr float snapshotRate = 20.f;
+    // past this many unsent bytes a client gets no more chunks this tick,
+    // so its edits and snapshots never queue behind them
+    static const qint64 maxChunkBacklog = 64 * 1024;
+
+    NetServer(const Terrain &terrain, glm::vec3 spawn, int streamRadius);
+    ~NetServer();
+
+    bool listen(quint16 port);
+    QString getError() const;
+    // Limit each client to this many bytes of chunks a second
+    void setChunkRate(float bytesPerSecond);
+
+    // Accept and read the clients, applying their edits to the terrain
+    // (remembered, to go out to every client), then send what each is
+    // due; npcs: every NPC as of server step `step`. The terrain must
+    // track its edits (see Terrain::setEditTracking).
+    void tick(Terrain &terrain, const std::vector<NetNPCState> &npcs, uint32_t step, float dT);
+
+    size_t getConnectionCount() const;
+    // the view of the first client to send one, for the terrain to
+    // generate around; false if none has
+    bool getFirstView(glm::vec3 &pos) const;
+    // one line per client
+    QString statsText() const;
+};
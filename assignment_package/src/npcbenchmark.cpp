@@ -0,0 +1,100 @@
+#include "npcbenchmark.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <numeric>
+
+NPCBenchmark::NPCBenchmark(int npcsPerType, int frames)
+    : m_npcsPerType(std::max(npcsPerType, 0)), m_frames(frames > 0 ? frames : defaultFrames),
+      m_frameMs(), m_simulationNs{0, 0, 0}, m_animationNs(0), m_drawNs(0)
+{}
+
+bool NPCBenchmark::isActive() const
+{
+    return m_npcsPerType > 0;
+}
+
+int NPCBenchmark::getNPCsPerType() const
+{
+    return m_npcsPerType;
+}
+
+glm::vec3 NPCBenchmark::getCameraPosition(float seconds) const
+{
+    float angle = seconds / pathSeconds * 2.f * glm::pi<float>();
+    return glm::vec3(spawnCenterX + pathRadius * glm::cos(angle),
+                     pathHeight,
+                     spawnCenterZ + pathRadius * glm::sin(angle));
+}
+
+glm::vec3 NPCBenchmark::getCameraTarget() const
+{
+    return glm::vec3(spawnCenterX, targetHeight, spawnCenterZ);
+}
+
+void NPCBenchmark::recordFrame(float frameMs, const NPCSimulationTimes &times)
+{
+    m_frameMs.push_back(frameMs);
+    m_simulationNs.pathfind += times.pathfind;
+    m_simulationNs.behaviour += times.behaviour;
+    m_simulationNs.physics += times.physics;
+}
+
+void NPCBenchmark::addRenderTimes(qint64 animationNs, qint64 drawNs)
+{
+    if (m_frameMs.empty()) {
+        return;
+    }
+    m_animationNs += animationNs;
+    m_drawNs += drawNs;
+}
+
+bool NPCBenchmark::isDone() const
+{
+    return static_cast<int>(m_frameMs.size()) >= m_frames;
+}
+
+/**
+ * @brief NPCBenchmark::slowestMs
+ *  The "1% low" of fraction 0.01: the frames a player notices as
+ *  stutter, which the mean hides.
+ * @param fraction
+ */
+float NPCBenchmark::slowestMs(float fraction) const
+{
+    if (m_frameMs.empty()) {
+        return 0.f;
+    }
+    std::vector<float> sorted(m_frameMs);
+    std::sort(sorted.begin(), sorted.end(), std::greater<float>());
+    size_t count = std::max<size_t>(1, static_cast<size_t>(sorted.size() * fraction));
+    return std::accumulate(sorted.begin(), sorted.begin() + count, 0.f) / count;
+}
+
+/**
+ * @brief NPCBenchmark::printReport
+ *  The thread phases are summed over the NPC threads, so they may add up
+ *  to more than a frame; draw is the CPU's side of the batch's draw only.
+ * @param npcCount
+ */
+void NPCBenchmark::printReport(size_t npcCount) const
+{
+    size_t frames = std::max<size_t>(1, m_frameMs.size());
+    float meanMs = std::accumulate(m_frameMs.begin(), m_frameMs.end(), 0.f) / frames;
+    float low1 = slowestMs(0.01f);
+    float low01 = slowestMs(0.001f);
+    auto perFrame = [frames](qint64 ns) { return ns / 1e6 / frames; };
+
+    printf("NPC benchmark: %zu NPCs (%d per type), %zu frames\n", npcCount, m_npcsPerType, m_frameMs.size());
+    printf("  frame time   mean %.2f ms (%.1f fps)\n", meanMs, meanMs > 0.f ? 1000.f / meanMs : 0.f);
+    printf("               1%% low %.2f ms (%.1f fps)\n", low1, low1 > 0.f ? 1000.f / low1 : 0.f);
+    printf("               0.1%% low %.2f ms (%.1f fps)\n", low01, low01 > 0.f ? 1000.f / low01 : 0.f);
+    printf("  per frame, NPC threads\n");
+    printf("    pathfind   %.3f ms\n", perFrame(m_simulationNs.pathfind));
+    printf("    behaviour  %.3f ms\n", perFrame(m_simulationNs.behaviour));
+    printf("    physics    %.3f ms\n", perFrame(m_simulationNs.physics));
+    printf("  per frame, main thread\n");
+    printf("    animation  %.3f ms\n", perFrame(m_animationNs));
+    printf("    draw       %.3f ms\n", perFrame(m_drawNs));
+    fflush(stdout);
+}
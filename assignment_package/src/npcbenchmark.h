@@ -0,0 +1,62 @@
+#pragma once
+#include "scene/npcsimulation.h"
+#include <glm_includes.h>
+#include <vector>
+
+/**
+ * @brief The NPCBenchmark class
+ *  The NPC stress test of --npc-benchmark: MyGL spawns npcsPerType NPCs
+ *  of each kind around the start on a fixed seed (see MyGL::setupNPCs)
+ *  and the camera flies a fixed circle over them. Once the NPCs start
+ *  stepping, each frame's time and the NPCs' share of it by phase are
+ *  recorded; after frames of them the report goes to stdout and the
+ *  application quits.
+ *  Main thread only.
+ */
+class NPCBenchmark
+{
+public:
+    static const unsigned seed = 277;
+    static const int defaultFrames = 3600;
+    // the square the NPCs spawn in, around the player's start
+    static constexpr float spawnCenterX = 48.f;
+    static constexpr float spawnCenterZ = 48.f;
+    static constexpr float spawnHalfSize = 64.f;
+    // the camera's circle around the square's center, looking down at it
+    static constexpr float pathRadius = 40.f;
+    static constexpr float pathHeight = 170.f;
+    static constexpr float pathSeconds = 30.f;
+    static constexpr float targetHeight = 140.f;
+
+private:
+    // 0: no benchmark
+    int m_npcsPerType;
+    int m_frames;
+    std::vector<float> m_frameMs;
+    // summed over the recorded frames, in ns
+    NPCSimulationTimes m_simulationNs;
+    // MyGL::renderNPCs' collecting of the parts and the batch's draw
+    qint64 m_animationNs;
+    qint64 m_drawNs;
+
+    // the mean of the slowest fraction of the frames, in ms
+    float slowestMs(float fraction) const;
+
+public:
+    NPCBenchmark(int npcsPerType, int frames);
+
+    bool isActive() const;
+    int getNPCsPerType() const;
+
+    // where the camera is after seconds on the path, and what it looks at
+    glm::vec3 getCameraPosition(float seconds) const;
+    glm::vec3 getCameraTarget() const;
+
+    // a frame of the NPCs stepping, with the simulation's times since the last
+    void recordFrame(float frameMs, const NPCSimulationTimes &times);
+    // the NPCs' render times of the frame; ignored before the first recordFrame
+    void addRenderTimes(qint64 animationNs, qint64 drawNs);
+    bool isDone() const;
+    // print the frame times and the phases per frame to stdout
+    void printReport(size_t npcCount) const;
+};
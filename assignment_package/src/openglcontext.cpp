@@ -1,4 +1,5 @@
 #include "openglcontext.h"
+#include "renderbackend.h"
 
 #include <iostream>
 #include <QApplication>
@@ -7,9 +8,17 @@
 #include <QDebug>
 
 
+#ifdef MINIMINECRAFT_GL_WINDOW
+OpenGLContext::OpenGLContext(QWidget *)
+    : QOpenGLWindow(QOpenGLWindow::NoPartialUpdate), m_programInUse(0), m_programInUseKnown(false),
+      m_renderBackend(nullptr)
+{}
+#else
 OpenGLContext::OpenGLContext(QWidget *parent)
-    : QOpenGLWidget(parent)
+    : QOpenGLWidget(parent), m_programInUse(0), m_programInUseKnown(false),
+      m_renderBackend(nullptr)
 {}
+#endif
 
 OpenGLContext::~OpenGLContext()
 {}
@@ -142,3 +151,31 @@ void OpenGLContext::printShaderInfoLog(int shader)
     // Throwing here allows us to use the debugger to track down the error.
     throw;
 }
+
+void OpenGLContext::useProgram(GLuint prog)
+{
+    if (m_programInUseKnown && m_programInUse == prog) {
+        return;
+    }
+    glUseProgram(prog);
+    m_programInUse = prog;
+    m_programInUseKnown = true;
+}
+
+void OpenGLContext::forgetProgramInUse()
+{
+    m_programInUseKnown = false;
+}
+
+void OpenGLContext::createRenderBackend(RenderBackendKind kind)
+{
+    m_renderBackend = RenderBackend::create(this, kind);
+}
+
+RenderBackend &OpenGLContext::renderBackend()
+{
+    if (m_renderBackend == nullptr) {
+        m_renderBackend = RenderBackend::create(this, RenderBackendKind::legacy);
+    }
+    return *m_renderBackend;
+}
@@ -1,16 +1,38 @@
 #pragma once
 
+#ifdef MINIMINECRAFT_GL_WINDOW
+#include <QOpenGLWindow>
+#else
 #include <QOpenGLWidget>
+#endif
 #include <QTimer>
 #include <QOpenGLExtraFunctions>
+#include "smartpointerhelp.h"
 
+class RenderBackend;
+enum class RenderBackendKind : unsigned char;
+
+// The surface MyGL draws to. By default a QOpenGLWidget, which renders
+// into a frame buffer of its own that Qt then composites into the main
+// window: one more full-screen copy every frame. Built with
+// CONFIG += gl_window (MINIMINECRAFT_GL_WINDOW), a QOpenGLWindow drawn
+// straight to its back buffer instead, swapped at the swap interval of
+// the default format (see main), and hosted in the main window by
+// QWidget::createWindowContainer (see MainWindow). The headless
+// fly-through needs the widget.
+#ifdef MINIMINECRAFT_GL_WINDOW
+typedef QOpenGLWindow OpenGLSurface;
+#else
+typedef QOpenGLWidget OpenGLSurface;
+#endif
 
 class OpenGLContext
-    : public QOpenGLWidget,
+    : public OpenGLSurface,
       public QOpenGLExtraFunctions
 {
 
 public:
+    // a window ignores the parent: its container owns it
     OpenGLContext(QWidget *parent);
     ~OpenGLContext();
 
@@ -18,4 +40,20 @@ public:
     void printGLErrorLog();
     void printLinkInfoLog(int prog);
     void printShaderInfoLog(int shader);
+
+    // glUseProgram, skipped when prog is already in use
+    void useProgram(GLuint prog);
+    // Next useProgram binds whatever it is given: call where the
+    // program in use may have changed behind useProgram's back
+    void forgetProgramInUse();
+
+    // Pick the backend the drawables create and draw through, once the
+    // context is initialized; the legacy one until then
+    void createRenderBackend(RenderBackendKind kind);
+    RenderBackend &renderBackend();
+
+private:
+    GLuint m_programInUse;
+    bool m_programInUseKnown;
+    uPtr<RenderBackend> m_renderBackend;
 };
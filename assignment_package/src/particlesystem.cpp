@@ -0,0 +1,148 @@
+#include "particlesystem.h"
+#include "renderbackend.h"
+#include <algorithm>
+#include <vector>
+
+// the flakes fall from this far above the weather's center
+static const float weatherHeight = 24.f;
+// the dead flake slots that respawn a second, as a fraction of them
+static const float snowRate = 0.15f;
+
+ParticleSystem::ParticleSystem(OpenGLContext *context)
+    : mp_context(context), m_buffers{{0, 0}}, m_vertexInputs{{0, 0}}, m_current(0), m_created(false),
+      m_pendingBursts(), m_debrisCursor(0), m_weatherActive(false), m_weatherCenter(0.f), m_weatherFloor(0.f),
+      m_weatherRadius(0.f), m_weatherRate(0.f), m_frame(0)
+{}
+
+void ParticleSystem::create() {
+    RenderBackend &backend = mp_context->renderBackend();
+    // zeroed: no life left, every particle dead
+    std::vector<unsigned char> dead(static_cast<size_t>(maxParticles) * particleBytes, 0);
+    for (int i = 0; i < 2; i++) {
+        // rewritten by the GPU every frame, never by the CPU
+        backend.fillBuffer(m_buffers[i], GL_ARRAY_BUFFER, dead.size(), dead.data(), BufferUsage::dynamic);
+        m_vertexInputs[i] = backend.createVertexInput();
+        // locations fixed in both shaders; a particle per instance
+        backend.setVertexInput(m_vertexInputs[i], {
+            VertexStream{m_buffers[i], 0, 4, GL_FLOAT, false, particleBytes, 0, 1},
+            VertexStream{m_buffers[i], 1, 4, GL_FLOAT, false, particleBytes, 16, 1},
+            VertexStream{m_buffers[i], 2, 4, GL_FLOAT, false, particleBytes, 32, 1}
+        }, 0);
+    }
+    m_current = 0;
+    m_debrisCursor = 0;
+    m_created = true;
+}
+
+void ParticleSystem::destroy() {
+    if (m_created) {
+        RenderBackend &backend = mp_context->renderBackend();
+        for (int i = 0; i < 2; i++) {
+            backend.deleteVertexInput(m_vertexInputs[i]);
+            backend.deleteBuffer(m_buffers[i]);
+        }
+        m_created = false;
+    }
+    m_pendingBursts.clear();
+}
+
+bool ParticleSystem::isCreated() const {
+    return m_created;
+}
+
+/**
+ * @brief ParticleSystem::emitBlockBreak
+ *  The crumbs show bits of the block's side tile, as the mesher lays it
+ *  out (see Chunk::meshSectionGreedy).
+ */
+void ParticleSystem::emitBlockBreak(glm::ivec3 pos, BlockType type) {
+    if (!m_created) {
+        return;
+    }
+    m_pendingBursts.push_back(Burst{glm::vec3(pos) + 0.5f, static_cast<float>(Block::getFaceLayer(type, XPOS))});
+}
+
+void ParticleSystem::setSnowfall(glm::vec3 center, float floorY, float radius) {
+    m_weatherActive = true;
+    m_weatherCenter = center + glm::vec3(0.f, weatherHeight, 0.f);
+    m_weatherFloor = floorY;
+    m_weatherRadius = radius;
+    m_weatherRate = snowRate;
+}
+
+void ParticleSystem::stopWeather() {
+    m_weatherActive = false;
+    m_weatherRate = 0.f;
+}
+
+/**
+ * @brief ParticleSystem::update
+ *  One point per particle, drawn as instances like the quads of draw(),
+ *  so one vertex input per buffer serves both; nothing is rasterized.
+ */
+void ParticleSystem::update(ShaderProgram &program, float dT) {
+    if (!m_created) {
+        return;
+    }
+    m_frame++;
+    // the time piled up while nothing was drawn passes as one short step
+    dT = std::min(dT, 0.1f);
+    // the bursts of this update, each a run of the ring past the last
+    int bursts = std::min(static_cast<int>(m_pendingBursts.size()), maxBurstsPerUpdate);
+    std::array<glm::vec4, maxBurstsPerUpdate> burstCenters;
+    std::array<glm::vec4, maxBurstsPerUpdate> burstRanges;
+    for (int i = 0; i < bursts; i++) {
+        const Burst &burst = m_pendingBursts[i];
+        burstCenters[i] = glm::vec4(burst.center, burst.tileLayer);
+        burstRanges[i] = glm::vec4(static_cast<float>(m_debrisCursor), static_cast<float>(particlesPerBurst), 0.f, 0.f);
+        m_debrisCursor = (m_debrisCursor + particlesPerBurst) % debrisSlots;
+    }
+    m_pendingBursts.erase(m_pendingBursts.begin(), m_pendingBursts.begin() + bursts);
+
+    program.useMe();
+    mp_context->glUniform1f(program.uniformLocation("u_DeltaTime"), dT);
+    mp_context->glUniform1ui(program.uniformLocation("u_Seed"), m_frame);
+    mp_context->glUniform1i(program.uniformLocation("u_BurstCount"), bursts);
+    if (bursts > 0) {
+        mp_context->glUniform4fv(program.uniformLocation("u_BurstCenters[0]"), bursts, &burstCenters[0][0]);
+        mp_context->glUniform4fv(program.uniformLocation("u_BurstRanges[0]"), bursts, &burstRanges[0][0]);
+    }
+    mp_context->glUniform2i(program.uniformLocation("u_Slots"), weatherSlots, debrisSlots);
+    mp_context->glUniform4f(program.uniformLocation("u_Weather"), m_weatherCenter.x, m_weatherCenter.y,
+                            m_weatherCenter.z, m_weatherRadius);
+    mp_context->glUniform2f(program.uniformLocation("u_WeatherSpawn"), m_weatherActive ? m_weatherRate : 0.f,
+                            m_weatherFloor);
+
+    GLint previous = 0;
+    mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+    int next = 1 - m_current;
+    mp_context->renderBackend().bindVertexInput(m_vertexInputs[m_current]);
+    mp_context->glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, m_buffers[next]);
+    mp_context->glEnable(GL_RASTERIZER_DISCARD);
+    mp_context->glBeginTransformFeedback(GL_POINTS);
+    mp_context->glDrawArraysInstanced(GL_POINTS, 0, 1, maxParticles);
+    mp_context->glEndTransformFeedback();
+    mp_context->glDisable(GL_RASTERIZER_DISCARD);
+    mp_context->glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+    mp_context->glBindVertexArray(previous);
+    m_current = next;
+}
+
+/**
+ * @brief ParticleSystem::draw
+ *  Every slot is drawn; the dead ones collapse outside the view in the
+ *  vertex shader, which costs less than finding the live ones.
+ */
+void ParticleSystem::draw(ShaderProgram &program, int blockTextureSlot, glm::vec3 eye) {
+    if (!m_created) {
+        return;
+    }
+    program.setTexture(blockTextureSlot);
+    mp_context->glUniform3f(program.uniformLocation("u_Eye"), eye.x, eye.y, eye.z);
+
+    GLint previous = 0;
+    mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+    mp_context->renderBackend().bindVertexInput(m_vertexInputs[m_current]);
+    mp_context->glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, maxParticles);
+    mp_context->glBindVertexArray(previous);
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include "glm_includes.h"
+#include "openglcontext.h"
+#include "shaderprogram.h"
+#include "scene/block.h"
+#include <array>
+#include <vector>
+
+// Particles simulated and drawn on the GPU, for the crumbs of broken
+// blocks and the snow of the high mountains. Every particle lives in a
+// buffer the CPU never reads or writes one by one: once a frame the
+// update program (glsl/particleupdate.vert.glsl) steps each one into the
+// other buffer of a pair by transform feedback, and the draw reads the
+// result as instances of a camera-facing quad (glsl/particle.vert.glsl).
+// What the CPU hands over per frame is a few emitters:
+//  - the bursts of the blocks broken, each a run of the debris ring,
+//    whose slots respawn as the block's crumbs, the oldest reused first;
+//  - the weather, a column over the eye the first weatherSlots slots
+//    respawn in while they are dead, at weatherRate a second.
+// Main thread only, with the context current.
+class ParticleSystem {
+public:
+    // the snow flakes, at most, then the crumbs
+    static const int weatherSlots = 24576;
+    static const int debrisSlots = 8192;
+    static const int maxParticles = weatherSlots + debrisSlots;
+    // the crumbs of one broken block
+    static const int particlesPerBurst = 48;
+    // the bursts spawned in one update, at most; the rest wait for the next
+    static const int maxBurstsPerUpdate = 16;
+
+private:
+    // The layout the shaders capture and read: vec4 position and life
+    // left (dead at 0 or below), vec4 velocity and size, vec4 appearance
+    // (the block tile layer, or -1 for a flake; the kind; the corner of
+    // its piece of the tile)
+    static const int particleBytes = 3 * 16;
+
+    struct Burst
+    {
+        glm::vec3 center;
+        float tileLayer;
+    };
+
+    OpenGLContext *mp_context;
+    // the particles, the one the last update wrote is m_current
+    std::array<GLuint, 2> m_buffers;
+    // per buffer: the vertex input reading it, a particle per instance
+    std::array<GLuint, 2> m_vertexInputs;
+    int m_current;
+    bool m_created;
+
+    std::vector<Burst> m_pendingBursts;
+    // where the next burst starts in the debris ring
+    int m_debrisCursor;
+    // the weather's column: its center's (x, z), top and floor, and radius
+    bool m_weatherActive;
+    glm::vec3 m_weatherCenter;
+    float m_weatherFloor;
+    float m_weatherRadius;
+    float m_weatherRate;
+    // seeds the update's hash
+    unsigned int m_frame;
+
+public:
+    explicit ParticleSystem(OpenGLContext *context);
+
+    ParticleSystem(const ParticleSystem&) = delete;
+    ParticleSystem &operator=(const ParticleSystem&) = delete;
+
+    // Allocate the buffers, every particle dead
+    void create();
+    void destroy();
+    bool isCreated() const;
+
+    // The crumbs of the block of type broken at pos, from the next update
+    void emitBlockBreak(glm::ivec3 pos, BlockType type);
+    // Snow over the column of radius around center, from height blocks
+    // above it down to floorY; until stopped, the flakes already falling
+    // finish their fall
+    void setSnowfall(glm::vec3 center, float floorY, float radius);
+    void stopWeather();
+
+    // Step every particle dT seconds with program (particleupdate.vert.glsl)
+    void update(ShaderProgram &program, float dT);
+    // Draw them with program (particle.vert.glsl), the block tiles at
+    // blockTextureSlot, the eye at eye
+    void draw(ShaderProgram &program, int blockTextureSlot, glm::vec3 eye);
+};
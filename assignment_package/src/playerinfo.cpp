@@ -1,5 +1,6 @@
 #include "playerinfo.h"
 #include "ui_playerinfo.h"
+#include <QSignalBlocker>
 
 PlayerInfo::PlayerInfo(QWidget *parent) :
     QWidget(parent),
@@ -35,4 +36,53 @@ void PlayerInfo::slot_setChunkText(QString s) {
 void PlayerInfo::slot_setZoneText(QString s) {
     ui->zoneLabel->setText(s);
 }
+void PlayerInfo::slot_setUploadQueueText(QString s) {
+    ui->uploadQueueLabel->setText(s);
+}
+void PlayerInfo::slot_setCullingText(QString s) {
+    ui->cullingLabel->setText(s);
+}
+void PlayerInfo::slot_setFramePhasesText(QString s) {
+    ui->framePhasesLabel->setText(s);
+}
+void PlayerInfo::slot_setTerrainPipelineText(QString s) {
+    ui->terrainPipelineLabel->setText(s);
+}
+void PlayerInfo::slot_setMemoryText(QString s) {
+    ui->memoryLabel->setText(s);
+}
+void PlayerInfo::slot_setPerformanceText(QString s) {
+    ui->performanceLabel->setText(s);
+}
+
+void PlayerInfo::slot_setThreadSettings(int terrainThreads, int generationThreads, int meshingThreads,
+                                        int npcThreads, int pathSearches) {
+    // showing the settings should not apply them again
+    const QSignalBlocker terrainBlocker(ui->terrainThreadsSpinBox);
+    const QSignalBlocker generationBlocker(ui->generationThreadsSpinBox);
+    const QSignalBlocker meshingBlocker(ui->meshingThreadsSpinBox);
+    const QSignalBlocker npcBlocker(ui->npcThreadsSpinBox);
+    const QSignalBlocker searchBlocker(ui->pathSearchesSpinBox);
+    ui->terrainThreadsSpinBox->setValue(terrainThreads);
+    ui->generationThreadsSpinBox->setValue(generationThreads);
+    ui->meshingThreadsSpinBox->setValue(meshingThreads);
+    ui->npcThreadsSpinBox->setValue(npcThreads);
+    ui->pathSearchesSpinBox->setValue(pathSearches);
+}
+
+void PlayerInfo::on_terrainThreadsSpinBox_valueChanged(int n) {
+    emit sig_setTerrainThreads(n);
+}
+void PlayerInfo::on_generationThreadsSpinBox_valueChanged(int n) {
+    emit sig_setGenerationThreads(n);
+}
+void PlayerInfo::on_meshingThreadsSpinBox_valueChanged(int n) {
+    emit sig_setMeshingThreads(n);
+}
+void PlayerInfo::on_npcThreadsSpinBox_valueChanged(int n) {
+    emit sig_setNPCThreads(n);
+}
+void PlayerInfo::on_pathSearchesSpinBox_valueChanged(int n) {
+    emit sig_setPathSearches(n);
+}
 
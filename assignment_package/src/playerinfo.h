@@ -20,6 +20,28 @@ public slots:
     void slot_setLookText(QString);
     void slot_setChunkText(QString);
     void slot_setZoneText(QString);
+    void slot_setUploadQueueText(QString);
+    void slot_setCullingText(QString);
+    void slot_setFramePhasesText(QString);
+    void slot_setTerrainPipelineText(QString);
+    void slot_setMemoryText(QString);
+    void slot_setPerformanceText(QString);
+    // terrain, generation, meshing and NPC threads, path searches per tick
+    void slot_setThreadSettings(int, int, int, int, int);
+
+signals:
+    void sig_setTerrainThreads(int);
+    void sig_setGenerationThreads(int);
+    void sig_setMeshingThreads(int);
+    void sig_setNPCThreads(int);
+    void sig_setPathSearches(int);
+
+private slots:
+    void on_terrainThreadsSpinBox_valueChanged(int);
+    void on_generationThreadsSpinBox_valueChanged(int);
+    void on_meshingThreadsSpinBox_valueChanged(int);
+    void on_npcThreadsSpinBox_valueChanged(int);
+    void on_pathSearchesSpinBox_valueChanged(int);
 
 private:
     Ui::PlayerInfo *ui;
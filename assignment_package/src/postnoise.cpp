@@ -0,0 +1,128 @@
+#include "postnoise.h"
+#include "memorystats.h"
+#include "scene/random.h"
+#include "glm_includes.h"
+#include <algorithm>
+#include <iostream>
+
+// the shader's fbm octaves; those finer than a texel only add their mean
+static const int fbmOctaves = 8;
+static const uint64_t fbmSalt = 0x706f73746662ull;
+static const uint64_t worleySalt = 0x706f7374776cull;
+
+// a hash in [0, 1) of the lattice point (x, y) of a grid period cells wide
+static float latticeValue(uint64_t salt, int period, int x, int y)
+{
+    x = ((x % period) + period) % period;
+    y = ((y % period) + period) % period;
+    uint64_t h = Random::mix(salt ^ (static_cast<uint64_t>(period) << 40)
+                             ^ (static_cast<uint64_t>(y) << 20) ^ static_cast<uint64_t>(x));
+    return static_cast<float>(h >> 40) / static_cast<float>(1ull << 24);
+}
+
+// one octave of the shader's cubicTriMix, in 2D: smoothstep blends of the
+// lattice values around p
+static float valueNoise(glm::vec2 p, int period)
+{
+    glm::vec2 cell = glm::floor(p);
+    glm::vec2 t = glm::smoothstep(glm::vec2(0.f), glm::vec2(1.f), p - cell);
+    int x = static_cast<int>(cell.x);
+    int y = static_cast<int>(cell.y);
+    float lo = glm::mix(latticeValue(fbmSalt, period, x, y), latticeValue(fbmSalt, period, x + 1, y), t.x);
+    float hi = glm::mix(latticeValue(fbmSalt, period, x, y + 1), latticeValue(fbmSalt, period, x + 1, y + 1), t.x);
+    return glm::mix(lo, hi, t.y);
+}
+
+static float worleyNoise(glm::vec2 p)
+{
+    glm::vec2 cell = glm::floor(p);
+    glm::vec2 offset = p - cell;
+    float minDist = 1.f;
+    for (int y = -1; y <= 1; y++) {
+        for (int x = -1; x <= 1; x++) {
+            int cx = static_cast<int>(cell.x) + x;
+            int cy = static_cast<int>(cell.y) + y;
+            glm::vec2 point(latticeValue(worleySalt, PostNoise::worleyCells, cx, cy),
+                            latticeValue(worleySalt ^ 1, PostNoise::worleyCells, cx, cy));
+            minDist = std::min(minDist, glm::length(glm::vec2(x, y) + point - offset));
+        }
+    }
+    return glm::cos(minDist * glm::pi<float>() * 0.7f);
+}
+
+PostNoise::PostNoise(OpenGLContext *context)
+    : mp_context(context), m_texture(0), m_created(false), m_gpuBytes(0)
+{}
+
+/**
+ * @brief PostNoise::bake
+ *  The fbm's amplitudes halve from 0.5 as in the shader; its octaves
+ *  finer than a texel only add their mean, half their amplitude.
+ * @return
+ */
+std::vector<uint16_t> PostNoise::bake() {
+    std::vector<uint16_t> texels(2 * size * size);
+    for (int ty = 0; ty < size; ty++) {
+        for (int tx = 0; tx < size; tx++) {
+            glm::vec2 uv((tx + 0.5f) / size, (ty + 0.5f) / size);
+
+            float fbm = 0.f;
+            float amplitude = 0.5f;
+            for (int octave = 0, cells = fbmCells; octave < fbmOctaves; octave++, cells *= 2) {
+                fbm += amplitude * (cells <= size ? valueNoise(uv * static_cast<float>(cells), cells) : 0.5f);
+                amplitude *= 0.5f;
+            }
+            float worley = (worleyNoise(uv * static_cast<float>(worleyCells)) + 1.f) * 0.5f;
+
+            texels[2 * (tx + size * ty)] = static_cast<uint16_t>(glm::clamp(fbm, 0.f, 1.f) * 65535.f + 0.5f);
+            texels[2 * (tx + size * ty) + 1] = static_cast<uint16_t>(glm::clamp(worley, 0.f, 1.f) * 65535.f + 0.5f);
+        }
+    }
+    return texels;
+}
+
+bool PostNoise::create() {
+    std::vector<uint16_t> texels = bake();
+
+    // nothing set anywhere (see printGLErrorLog) before the allocation checked below
+    while (mp_context->glGetError() != GL_NO_ERROR) {}
+    mp_context->glActiveTexture(GL_TEXTURE0 + textureSlot);
+    mp_context->glGenTextures(1, &m_texture);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_texture);
+    mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, size, size, 0, GL_RG, GL_UNSIGNED_SHORT, texels.data());
+    mp_context->glGenerateMipmap(GL_TEXTURE_2D);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    mp_context->glActiveTexture(GL_TEXTURE0);
+
+    if (mp_context->glGetError() != GL_NO_ERROR) {
+        std::cout << "Post-process noise texture could not be allocated" << std::endl;
+        mp_context->glDeleteTextures(1, &m_texture);
+        return false;
+    }
+    m_created = true;
+    // and a third more for the mipmaps
+    m_gpuBytes = texels.size() * sizeof(uint16_t) * 4 / 3;
+    MemoryStats::add(MemoryCategory::textures, m_gpuBytes);
+    return true;
+}
+
+void PostNoise::destroy() {
+    if (m_created) {
+        m_created = false;
+        mp_context->glDeleteTextures(1, &m_texture);
+        MemoryStats::sub(MemoryCategory::textures, m_gpuBytes);
+        m_gpuBytes = 0;
+    }
+}
+
+bool PostNoise::isCreated() const {
+    return m_created;
+}
+
+void PostNoise::bindToTextureSlot() {
+    mp_context->glActiveTexture(GL_TEXTURE0 + textureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_texture);
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include "openglcontext.h"
+#include <cstdint>
+#include <vector>
+
+// The noise the underwater and lava passes read, baked once into a tiling
+// texture instead of hashed per pixel every frame (see
+// glsl/post/underwater.frag.glsl and lava.frag.glsl, built with
+// BAKED_NOISE). Red is the underwater pass' value noise fbm, its lattice
+// periodic over the tile, which spans the screen; green is the lava's
+// Worley noise, cos(0.7 pi F1), over worleyCells x worleyCells cells,
+// stored as (v + 1) / 2. Both repeat and are mipmapped.
+class PostNoise {
+public:
+    // texels along each side of the tile
+    static const int size = 256;
+    // the coarsest fbm octave's cells along each side, as the shader's
+    // fbm at frequency 4 over the [-1, 1] screen
+    static const int fbmCells = 8;
+    static const int worleyCells = 8;
+    // the texture unit the passes read it from
+    static const int textureSlot = 6;
+
+private:
+    OpenGLContext *mp_context;
+    GLuint m_texture;
+    bool m_created;
+    // the bytes counted in MemoryCategory::textures
+    size_t m_gpuBytes;
+
+public:
+    explicit PostNoise(OpenGLContext *context);
+
+    PostNoise(const PostNoise&) = delete;
+    PostNoise &operator=(const PostNoise&) = delete;
+
+    // The size x size texels, red and green interleaved, row by row
+    static std::vector<uint16_t> bake();
+
+    // bake and upload; false if the texture could not be allocated
+    bool create();
+    void destroy();
+    bool isCreated() const;
+    void bindToTextureSlot();
+};
@@ -0,0 +1,228 @@
+#include "profiler.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QTextStream>
+#include <algorithm>
+
+// the weight of the newest frame in the averages, as in FrameProfile
+static const float averageWeight = 0.05f;
+
+Profiler::Profiler()
+    : m_clock(), m_enabled(false), m_tracing(false), m_nextThread(1), m_lock(), m_history(historySize),
+      m_recorded(0), m_zones(), m_frameStart(0), m_frameAverageMs(0.f)
+{
+    m_clock.start();
+}
+
+Profiler &Profiler::global()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+/**
+ * @brief Profiler::setEnabled
+ *  Turning it on starts the averages over, as the frames it missed would
+ *  count as empty.
+ */
+void Profiler::setEnabled(bool enabled)
+{
+    QMutexLocker locker(&m_lock);
+    if (enabled && !m_enabled.load()) {
+        m_zones.clear();
+        m_frameStart = now();
+        m_frameAverageMs = 0.f;
+    }
+    m_enabled.store(enabled);
+}
+
+void Profiler::setTracing(bool tracing)
+{
+    m_tracing.store(tracing);
+}
+
+qint64 Profiler::now() const
+{
+    return m_clock.nsecsElapsed();
+}
+
+int Profiler::currentThread()
+{
+    thread_local int id = m_nextThread.fetch_add(1);
+    return id;
+}
+
+void Profiler::record(const char *name, int thread, qint64 start, qint64 duration)
+{
+    QMutexLocker locker(&m_lock);
+    m_history[m_recorded % historySize] = ProfileEvent{name, thread, start, duration};
+    m_recorded++;
+    if (!isEnabled()) {
+        return;
+    }
+
+    auto found = m_zones.find(name);
+    if (found == m_zones.end()) {
+        found = m_zones.emplace(name, ZoneTotals{thread == gpuThread, 0, 0, 0, 0.f}).first;
+    }
+    found->second.frameNs += duration;
+    found->second.frameCalls++;
+}
+
+/**
+ * @brief Profiler::endFrame
+ *  A zone the frame did not run counts as 0, like a skipped FramePhase.
+ *  The NPC threads' zones count in the frame they end in.
+ */
+void Profiler::endFrame()
+{
+    if (!isEnabled()) {
+        return;
+    }
+    QMutexLocker locker(&m_lock);
+    qint64 end = now();
+    m_frameAverageMs += ((end - m_frameStart) / 1e6f - m_frameAverageMs) * averageWeight;
+    m_frameStart = end;
+    for (auto &zone : m_zones) {
+        ZoneTotals &totals = zone.second;
+        totals.averageMs += (totals.frameNs / 1e6f - totals.averageMs) * averageWeight;
+        totals.lastCalls = totals.frameCalls;
+        totals.frameNs = 0;
+        totals.frameCalls = 0;
+    }
+}
+
+float Profiler::getFrameAverageMs() const
+{
+    QMutexLocker locker(&m_lock);
+    return m_frameAverageMs;
+}
+
+std::vector<ProfileZoneAverage> Profiler::getAverages() const
+{
+    std::vector<ProfileZoneAverage> averages;
+    {
+        QMutexLocker locker(&m_lock);
+        for (const auto &zone : m_zones) {
+            averages.push_back(ProfileZoneAverage{zone.first, zone.second.gpu, zone.second.averageMs,
+                                                  zone.second.lastCalls});
+        }
+    }
+    std::sort(averages.begin(), averages.end(), [](const ProfileZoneAverage &a, const ProfileZoneAverage &b) {
+        if (a.gpu != b.gpu) {
+            return b.gpu;
+        }
+        return a.averageMs > b.averageMs;
+    });
+    return averages;
+}
+
+std::vector<ProfileEvent> Profiler::copyHistory(qint64 since) const
+{
+    std::vector<ProfileEvent> events;
+    QMutexLocker locker(&m_lock);
+    uint64_t count = std::min<uint64_t>(m_recorded, historySize);
+    events.reserve(count);
+    for (uint64_t i = m_recorded - count; i < m_recorded; i++) {
+        const ProfileEvent &event = m_history[i % historySize];
+        if (event.start + event.duration >= since) {
+            events.push_back(event);
+        }
+    }
+    return events;
+}
+
+/**
+ * @brief Profiler::exportChromeTrace
+ *  The history is copied out first, so the threads recording are not held
+ *  up by the file.
+ * @param path
+ * @return whether the file was written
+ */
+bool Profiler::exportChromeTrace(const QString &path) const
+{
+    return writeChromeTrace(path, copyHistory());
+}
+
+// text as a JSON string's contents
+static QString escapeJson(const QString &text)
+{
+    QString escaped;
+    escaped.reserve(text.size());
+    for (QChar c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else if (c.unicode() < 0x20) {
+            escaped += QString("\\u%1").arg(c.unicode(), 4, 16, QChar('0'));
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+/**
+ * @brief Profiler::writeChromeTrace
+ *  Every event as a complete ("X") event, in the order given, with the
+ *  GPU's passes on a thread of their own.
+ * @param path
+ * @param events
+ * @param context
+ * @return whether the file was written
+ */
+bool Profiler::writeChromeTrace(const QString &path, const std::vector<ProfileEvent> &events,
+                                const std::vector<std::pair<QString, QString>> &context)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+        return false;
+    }
+    QTextStream out(&file);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpuThread
+        << ",\"args\":{\"name\":\"GPU\"}}";
+    for (const ProfileEvent &event : events) {
+        // the names are identifiers and literals: nothing to escape
+        out << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+            << ",\"ts\":" << QString::number(event.start / 1e3, 'f', 3)
+            << ",\"dur\":" << QString::number(event.duration / 1e3, 'f', 3) << "}";
+    }
+    out << "\n]";
+    if (!context.empty()) {
+        out << ",\"otherData\":{";
+        for (size_t i = 0; i < context.size(); i++) {
+            out << (i == 0 ? "\n" : ",\n") << "\"" << escapeJson(context[i].first) << "\":\""
+                << escapeJson(context[i].second) << "\"";
+        }
+        out << "\n}";
+    }
+    out << "}\n";
+    out.flush();
+    return file.error() == QFileDevice::NoError;
+}
+
+ProfileZone::ProfileZone(const char *name)
+    : m_name(name), m_start(-1)
+{
+    Profiler &profiler = Profiler::global();
+    if (profiler.isRecording()) {
+        m_start = profiler.now();
+    }
+}
+
+ProfileZone::~ProfileZone()
+{
+    end();
+}
+
+void ProfileZone::end()
+{
+    if (m_start >= 0) {
+        Profiler &profiler = Profiler::global();
+        profiler.record(m_name, profiler.currentThread(), m_start, profiler.now() - m_start);
+        m_start = -1;
+    }
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+// One timed zone: a ProfileZone's scope on a thread, or a GPU pass (see
+// GpuTimers) on the GPU's track
+struct ProfileEvent
+{
+    // a string literal, never freed
+    const char *name;
+    // Profiler::gpuThread, or the recording thread's id from 1 up
+    int thread;
+    // in ns of Profiler::now()
+    qint64 start;
+    qint64 duration;
+};
+
+// a zone's time per frame, averaged over the last frames
+struct ProfileZoneAverage
+{
+    std::string name;
+    bool gpu;
+    float averageMs;
+    // the times the zone ran in the last frame
+    int lastCalls;
+};
+
+/**
+ * @brief The Profiler class
+ *  The zones of the last historySize events, from every thread, kept for
+ *  exporting as a Chrome trace (chrome://tracing, or Perfetto), and each
+ *  zone's time per frame, averaged like FrameProfile's phases for the
+ *  overlay. Off until setEnabled: a ProfileZone then costs one atomic load.
+ *  setTracing keeps the history without the averages, for FrameWatchdog
+ *  to dump once a frame runs long.
+ */
+class Profiler
+{
+public:
+    static const int historySize = 1 << 16;
+    static const int gpuThread = 0;
+
+private:
+    struct ZoneTotals
+    {
+        bool gpu;
+        qint64 frameNs;
+        int frameCalls;
+        int lastCalls;
+        float averageMs;
+    };
+
+    QElapsedTimer m_clock;
+    std::atomic<bool> m_enabled;
+    std::atomic<bool> m_tracing;
+    std::atomic<int> m_nextThread;
+
+    mutable QMutex m_lock;
+    // a ring of the newest events; m_recorded ever recorded
+    std::vector<ProfileEvent> m_history;
+    uint64_t m_recorded;
+    // by name, so a zone's literals in different files add up
+    std::map<std::string, ZoneTotals> m_zones;
+    // the frame time, from endFrame to endFrame
+    qint64 m_frameStart;
+    float m_frameAverageMs;
+
+    Profiler();
+
+public:
+    static Profiler &global();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const {
+        return m_enabled.load(std::memory_order_relaxed);
+    }
+    // record the history, enabled or not
+    void setTracing(bool tracing);
+    // whether the zones are recorded, for the averages or the history
+    bool isRecording() const {
+        return isEnabled() || m_tracing.load(std::memory_order_relaxed);
+    }
+
+    // ns since the profiler started, on every thread
+    qint64 now() const;
+    // the calling thread's id in the trace, from 1 up
+    int currentThread();
+
+    // thread: currentThread() or gpuThread
+    void record(const char *name, int thread, qint64 start, qint64 duration);
+    // fold the frame's zones into the averages; on the main thread, once
+    // a frame
+    void endFrame();
+
+    float getFrameAverageMs() const;
+    // the CPU zones, then the GPU's, each slowest first
+    std::vector<ProfileZoneAverage> getAverages() const;
+
+    // the events of the history that ended at or after since (ns of
+    // now()), oldest first
+    std::vector<ProfileEvent> copyHistory(qint64 since = 0) const;
+    // the history as a Chrome trace's JSON, times in us
+    bool exportChromeTrace(const QString &path) const;
+    // events as a Chrome trace, with context (name, text) pairs under its
+    // otherData; any thread, as it reads nothing of the profiler's
+    static bool writeChromeTrace(const QString &path, const std::vector<ProfileEvent> &events,
+                                 const std::vector<std::pair<QString, QString>> &context = {});
+};
+
+/**
+ * @brief The ProfileZone class
+ *  Times its scope, or up to end(), into Profiler::global(), if it is
+ *  recording when the scope starts.
+ */
+class ProfileZone
+{
+private:
+    const char *m_name;
+    // -1: not timed
+    qint64 m_start;
+
+public:
+    // name: a string literal
+    explicit ProfileZone(const char *name);
+    ~ProfileZone();
+    // end the zone before the scope does
+    void end();
+
+    ProfileZone(const ProfileZone&) = delete;
+    ProfileZone &operator=(const ProfileZone&) = delete;
+};
@@ -0,0 +1,109 @@
+#include "qualitycontroller.h"
+
+// the weight of the newest frame in the average
+static const float averageWeight = 0.1f;
+// the average is over the target past this, and well under it below that
+static const float overFactor = 1.05f;
+static const float underFactor = 0.7f;
+
+// The top level is what the game runs at without the controller
+static const QualityLevel levels[QualityController::levelCount] = {
+    {0.5f, 7, 0.4f, 512u << 10, 500},
+    {0.6f, 7, 0.55f, 1u << 20, 1000},
+    {0.75f, 8, 0.7f, 2u << 20, 2000},
+    {0.85f, 10, 0.85f, 3u << 20, 3000},
+    {1.f, 12, 1.f, 4u << 20, 4000},
+};
+
+QualityController::QualityController()
+    : m_targetMs(0.f), m_level(levelCount - 1), m_averageMs(0.f), m_averaged(false),
+      m_framesOver(0), m_framesUnder(0), m_cooldown(0), m_decision()
+{}
+
+void QualityController::setTarget(float ms)
+{
+    m_targetMs = ms > 0.f ? ms : 0.f;
+    if (!isEnabled()) {
+        m_level = levelCount - 1;
+    }
+    m_averaged = false;
+    m_framesOver = 0;
+    m_framesUnder = 0;
+    m_cooldown = 0;
+}
+
+float QualityController::getTarget() const
+{
+    return m_targetMs;
+}
+
+bool QualityController::isEnabled() const
+{
+    return m_targetMs > 0.f;
+}
+
+/**
+ * @brief QualityController::addFrame
+ *  The frames of the cooldown still feed the average, but count towards
+ *  neither threshold, so what the last change did is measured before
+ *  the next one.
+ */
+bool QualityController::addFrame(float ms)
+{
+    if (!isEnabled()) {
+        return false;
+    }
+    m_averageMs = m_averaged ? m_averageMs + (ms - m_averageMs) * averageWeight : ms;
+    m_averaged = true;
+    if (m_cooldown > 0) {
+        m_cooldown--;
+        return false;
+    }
+
+    m_framesOver = m_averageMs > m_targetMs * overFactor ? m_framesOver + 1 : 0;
+    m_framesUnder = m_averageMs < m_targetMs * underFactor ? m_framesUnder + 1 : 0;
+    if (m_framesOver >= downFrames && m_level > 0) {
+        changeLevel(m_level - 1, "over");
+        return true;
+    }
+    if (m_framesUnder >= upFrames && m_level < levelCount - 1) {
+        changeLevel(m_level + 1, "under");
+        return true;
+    }
+    return false;
+}
+
+void QualityController::changeLevel(int level, const char *reason)
+{
+    m_decision = QString("%1 to %2: %3 ms %4 %5 ms").arg(level < m_level ? "down" : "up")
+                 .arg(level).arg(m_averageMs, 0, 'f', 1).arg(reason).arg(m_targetMs, 0, 'f', 1);
+    m_level = level;
+    m_framesOver = 0;
+    m_framesUnder = 0;
+    m_cooldown = cooldownFrames;
+}
+
+int QualityController::getLevelIndex() const
+{
+    return m_level;
+}
+
+const QualityLevel &QualityController::getLevel() const
+{
+    return levels[m_level];
+}
+
+float QualityController::getAverageMs() const
+{
+    return m_averageMs;
+}
+
+const QString &QualityController::getLastDecision() const
+{
+    return m_decision;
+}
+
+const QualityLevel &QualityController::getLevel(int index)
+{
+    return levels[index];
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <QString>
+#include <cstddef>
+
+// What one step of the QualityController trades for frame time
+struct QualityLevel
+{
+    // the fraction of the screen's pixels the scene is rendered at
+    float renderScale;
+    // the zones the distant terrain reaches (see DistantTerrain::setRingRadius)
+    int lodRadius;
+    // what the NPCs' reduced and sleep radii are scaled by (see NPCSimulation)
+    float npcLodScale;
+    // the terrain's per-tick upload budget (see Terrain::setUploadBudget)
+    size_t uploadBytes;
+    int uploadMicros;
+};
+
+/**
+ * @brief The QualityController class
+ *  Steps through a fixed ladder of QualityLevels to hold the frames to a
+ *  target time: down one level as soon as the averaged frame cost stays
+ *  over the target for a few frames, up one only after it stayed well
+ *  under it for a few seconds. The gap between the two thresholds, and a
+ *  cooldown after every change while the new level settles, keep it from
+ *  oscillating. A frame's cost is what MyGL measures of it, the larger of
+ *  the main thread's work and the GPU's, so a vsync wait never counts.
+ *  Pure logic; MyGL applies the levels. Main thread only.
+ */
+class QualityController
+{
+public:
+    static const int levelCount = 5;
+    // frames over the target before stepping down, under it before stepping up
+    static const int downFrames = 15;
+    static const int upFrames = 180;
+    // frames after a change before the next may happen
+    static const int cooldownFrames = 60;
+
+private:
+    // 0: off
+    float m_targetMs;
+    int m_level;
+    // exponential moving average of the frame costs, in ms
+    float m_averageMs;
+    bool m_averaged;
+    int m_framesOver;
+    int m_framesUnder;
+    int m_cooldown;
+    QString m_decision;
+
+    void changeLevel(int level, const char *reason);
+
+public:
+    QualityController();
+
+    // the frame time to hold, in ms; 0 turns the controller off, at the top level
+    void setTarget(float ms);
+    float getTarget() const;
+    bool isEnabled() const;
+
+    // Account one frame that cost `ms`; true if the level changed
+    bool addFrame(float ms);
+
+    int getLevelIndex() const;
+    const QualityLevel &getLevel() const;
+    float getAverageMs() const;
+    // why the level last changed, for the debug overlay; empty if it never did
+    const QString &getLastDecision() const;
+
+    // lowest quality first
+    static const QualityLevel &getLevel(int index);
+};
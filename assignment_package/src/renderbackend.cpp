@@ -0,0 +1,338 @@
+#include "renderbackend.h"
+#include <QOpenGLContext>
+#include <iostream>
+
+// GL 4.4 (ARB_buffer_storage), not in the ES 3 headers Qt wraps
+#ifndef GL_DYNAMIC_STORAGE_BIT
+#define GL_DYNAMIC_STORAGE_BIT 0x0100
+#endif
+
+RenderBackend::RenderBackend(OpenGLContext *context)
+    : mp_context(context)
+{}
+
+RenderBackend::~RenderBackend()
+{}
+
+const char *RenderBackend::getName() const
+{
+    return getKind() == RenderBackendKind::legacy ? "legacy" : "dsa";
+}
+
+bool RenderBackend::parseKind(const QString &name, RenderBackendKind *kind)
+{
+    if (name == "legacy") {
+        *kind = RenderBackendKind::legacy;
+    } else if (name == "dsa") {
+        *kind = RenderBackendKind::directStateAccess;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void RenderBackend::deleteBuffer(GLuint &buffer)
+{
+    if (buffer != 0) {
+        mp_context->glDeleteBuffers(1, &buffer);
+        buffer = 0;
+    }
+}
+
+void RenderBackend::deleteVertexInput(GLuint &vertexInput)
+{
+    if (vertexInput != 0) {
+        mp_context->glDeleteVertexArrays(1, &vertexInput);
+        vertexInput = 0;
+    }
+}
+
+void RenderBackend::bindVertexInput(GLuint vertexInput)
+{
+    mp_context->glBindVertexArray(vertexInput);
+}
+
+void RenderBackend::drawIndexed(GLenum mode, GLsizei count, size_t firstIndex, GLsizei instances)
+{
+    const void *offset = reinterpret_cast<const void*>(firstIndex * sizeof(GLuint));
+    if (instances == 1) {
+        mp_context->glDrawElements(mode, count, GL_UNSIGNED_INT, offset);
+    } else {
+        mp_context->glDrawElementsInstanced(mode, count, GL_UNSIGNED_INT, offset, instances);
+    }
+}
+
+bool RenderBackend::hasBindlessTextures() const
+{
+    return false;
+}
+
+uint64_t RenderBackend::acquireTextureHandle(GLuint)
+{
+    return 0;
+}
+
+void RenderBackend::releaseTextureHandle(uint64_t)
+{}
+
+static GLenum usageHint(BufferUsage usage)
+{
+    switch (usage) {
+    case BufferUsage::immutable:
+        return GL_STATIC_DRAW;
+    case BufferUsage::dynamic:
+        return GL_DYNAMIC_DRAW;
+    default:
+        return GL_STREAM_DRAW;
+    }
+}
+
+/**
+ * @brief The LegacyRenderBackend class
+ *  Binds every object to edit it, restoring the bindings the draws rely
+ *  on: the vertex array bound, and GL_ARRAY_BUFFER left at 0.
+ */
+class LegacyRenderBackend : public RenderBackend
+{
+public:
+    explicit LegacyRenderBackend(OpenGLContext *context)
+        : RenderBackend(context)
+    {}
+
+    RenderBackendKind getKind() const override
+    {
+        return RenderBackendKind::legacy;
+    }
+
+    void fillBuffer(GLuint &buffer, GLenum target, size_t bytes, const void *data, BufferUsage usage) override
+    {
+        if (buffer == 0) {
+            mp_context->glGenBuffers(1, &buffer);
+        }
+        mp_context->glBindBuffer(target, buffer);
+        mp_context->glBufferData(target, bytes, data, usageHint(usage));
+    }
+
+    void updateBuffer(GLuint buffer, GLenum target, size_t offset, size_t bytes, const void *data) override
+    {
+        mp_context->glBindBuffer(target, buffer);
+        mp_context->glBufferSubData(target, offset, bytes, data);
+    }
+
+    GLuint createVertexInput() override
+    {
+        GLuint vertexInput = 0;
+        mp_context->glGenVertexArrays(1, &vertexInput);
+        return vertexInput;
+    }
+
+    void setVertexInput(GLuint vertexInput, std::initializer_list<VertexStream> streams, GLuint indexBuffer) override
+    {
+        GLint previous = 0;
+        mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous);
+        mp_context->glBindVertexArray(vertexInput);
+        for (const VertexStream &stream : streams) {
+            const void *offset = reinterpret_cast<const void*>(stream.offset);
+            mp_context->glBindBuffer(GL_ARRAY_BUFFER, stream.buffer);
+            mp_context->glEnableVertexAttribArray(stream.location);
+            if (stream.integer) {
+                mp_context->glVertexAttribIPointer(stream.location, stream.components, stream.type, stream.stride, offset);
+            } else {
+                mp_context->glVertexAttribPointer(stream.location, stream.components, stream.type, GL_FALSE,
+                                                  stream.stride, offset);
+            }
+            mp_context->glVertexAttribDivisor(stream.location, stream.divisor);
+        }
+        if (indexBuffer != 0) {
+            mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+        }
+        mp_context->glBindVertexArray(previous);
+        mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+};
+
+/**
+ * @brief The DSARenderBackend class
+ *  The GL 4.5 entry points are not in the functions Qt wraps, so they are
+ *  looked up once; any missing one falls back to legacy (see create).
+ *  Each vertex stream takes the binding point of its attribute's
+ *  location, so a vertex input's buffers are set apart from its formats.
+ */
+class DSARenderBackend : public RenderBackend
+{
+private:
+    typedef void (QOPENGLF_APIENTRYP CreateObjectsFunc)(GLsizei n, GLuint *names);
+    typedef void (QOPENGLF_APIENTRYP NamedBufferStorageFunc)(GLuint buffer, GLsizeiptr size, const void *data,
+                                                            GLbitfield flags);
+    typedef void (QOPENGLF_APIENTRYP NamedBufferDataFunc)(GLuint buffer, GLsizeiptr size, const void *data,
+                                                         GLenum usage);
+    typedef void (QOPENGLF_APIENTRYP NamedBufferSubDataFunc)(GLuint buffer, GLintptr offset, GLsizeiptr size,
+                                                            const void *data);
+    typedef void (QOPENGLF_APIENTRYP VertexArrayVertexBufferFunc)(GLuint vaobj, GLuint bindingindex, GLuint buffer,
+                                                                 GLintptr offset, GLsizei stride);
+    typedef void (QOPENGLF_APIENTRYP VertexArrayAttribFormatFunc)(GLuint vaobj, GLuint attribindex, GLint size,
+                                                                 GLenum type, GLboolean normalized,
+                                                                 GLuint relativeoffset);
+    typedef void (QOPENGLF_APIENTRYP VertexArrayAttribIFormatFunc)(GLuint vaobj, GLuint attribindex, GLint size,
+                                                                  GLenum type, GLuint relativeoffset);
+    typedef void (QOPENGLF_APIENTRYP VertexArrayPairFunc)(GLuint vaobj, GLuint first, GLuint second);
+    typedef void (QOPENGLF_APIENTRYP VertexArrayNameFunc)(GLuint vaobj, GLuint name);
+    typedef GLuint64 (QOPENGLF_APIENTRYP GetTextureHandleFunc)(GLuint texture);
+    typedef void (QOPENGLF_APIENTRYP TextureHandleFunc)(GLuint64 handle);
+
+    CreateObjectsFunc m_createBuffers;
+    NamedBufferStorageFunc m_namedBufferStorage;
+    NamedBufferDataFunc m_namedBufferData;
+    NamedBufferSubDataFunc m_namedBufferSubData;
+    CreateObjectsFunc m_createVertexArrays;
+    VertexArrayVertexBufferFunc m_vertexArrayVertexBuffer;
+    VertexArrayAttribFormatFunc m_vertexArrayAttribFormat;
+    VertexArrayAttribIFormatFunc m_vertexArrayAttribIFormat;
+    VertexArrayPairFunc m_vertexArrayAttribBinding;
+    VertexArrayPairFunc m_vertexArrayBindingDivisor;
+    VertexArrayNameFunc m_enableVertexArrayAttrib;
+    VertexArrayNameFunc m_vertexArrayElementBuffer;
+    // null without ARB_bindless_texture
+    GetTextureHandleFunc m_getTextureHandle;
+    TextureHandleFunc m_makeTextureHandleResident;
+    TextureHandleFunc m_makeTextureHandleNonResident;
+
+    template <typename F>
+    F resolve(const char *name) const
+    {
+        return reinterpret_cast<F>(mp_context->context()->getProcAddress(name));
+    }
+
+public:
+    explicit DSARenderBackend(OpenGLContext *context)
+        : RenderBackend(context),
+          m_createBuffers(resolve<CreateObjectsFunc>("glCreateBuffers")),
+          m_namedBufferStorage(resolve<NamedBufferStorageFunc>("glNamedBufferStorage")),
+          m_namedBufferData(resolve<NamedBufferDataFunc>("glNamedBufferData")),
+          m_namedBufferSubData(resolve<NamedBufferSubDataFunc>("glNamedBufferSubData")),
+          m_createVertexArrays(resolve<CreateObjectsFunc>("glCreateVertexArrays")),
+          m_vertexArrayVertexBuffer(resolve<VertexArrayVertexBufferFunc>("glVertexArrayVertexBuffer")),
+          m_vertexArrayAttribFormat(resolve<VertexArrayAttribFormatFunc>("glVertexArrayAttribFormat")),
+          m_vertexArrayAttribIFormat(resolve<VertexArrayAttribIFormatFunc>("glVertexArrayAttribIFormat")),
+          m_vertexArrayAttribBinding(resolve<VertexArrayPairFunc>("glVertexArrayAttribBinding")),
+          m_vertexArrayBindingDivisor(resolve<VertexArrayPairFunc>("glVertexArrayBindingDivisor")),
+          m_enableVertexArrayAttrib(resolve<VertexArrayNameFunc>("glEnableVertexArrayAttrib")),
+          m_vertexArrayElementBuffer(resolve<VertexArrayNameFunc>("glVertexArrayElementBuffer")),
+          m_getTextureHandle(nullptr), m_makeTextureHandleResident(nullptr), m_makeTextureHandleNonResident(nullptr)
+    {
+        if (mp_context->context()->hasExtension(QByteArrayLiteral("GL_ARB_bindless_texture"))) {
+            m_getTextureHandle = resolve<GetTextureHandleFunc>("glGetTextureHandleARB");
+            m_makeTextureHandleResident = resolve<TextureHandleFunc>("glMakeTextureHandleResidentARB");
+            m_makeTextureHandleNonResident = resolve<TextureHandleFunc>("glMakeTextureHandleNonResidentARB");
+        }
+    }
+
+    bool isComplete() const
+    {
+        return m_createBuffers != nullptr && m_namedBufferStorage != nullptr && m_namedBufferData != nullptr
+                && m_namedBufferSubData != nullptr && m_createVertexArrays != nullptr
+                && m_vertexArrayVertexBuffer != nullptr && m_vertexArrayAttribFormat != nullptr
+                && m_vertexArrayAttribIFormat != nullptr && m_vertexArrayAttribBinding != nullptr
+                && m_vertexArrayBindingDivisor != nullptr && m_enableVertexArrayAttrib != nullptr
+                && m_vertexArrayElementBuffer != nullptr;
+    }
+
+    RenderBackendKind getKind() const override
+    {
+        return RenderBackendKind::directStateAccess;
+    }
+
+    /**
+     * Immutable storage cannot be respecified: an immutable buffer is
+     * replaced. The others stay mutable, so a stream buffer can still be
+     * orphaned by filling it again.
+     */
+    void fillBuffer(GLuint &buffer, GLenum, size_t bytes, const void *data, BufferUsage usage) override
+    {
+        if (usage == BufferUsage::immutable) {
+            deleteBuffer(buffer);
+            m_createBuffers(1, &buffer);
+            m_namedBufferStorage(buffer, bytes, data, 0);
+            return;
+        }
+        if (buffer == 0) {
+            m_createBuffers(1, &buffer);
+        }
+        m_namedBufferData(buffer, bytes, data, usageHint(usage));
+    }
+
+    void updateBuffer(GLuint buffer, GLenum, size_t offset, size_t bytes, const void *data) override
+    {
+        m_namedBufferSubData(buffer, offset, bytes, data);
+    }
+
+    GLuint createVertexInput() override
+    {
+        GLuint vertexInput = 0;
+        m_createVertexArrays(1, &vertexInput);
+        return vertexInput;
+    }
+
+    void setVertexInput(GLuint vertexInput, std::initializer_list<VertexStream> streams, GLuint indexBuffer) override
+    {
+        for (const VertexStream &stream : streams) {
+            m_vertexArrayVertexBuffer(vertexInput, stream.location, stream.buffer, stream.offset, stream.stride);
+            if (stream.integer) {
+                m_vertexArrayAttribIFormat(vertexInput, stream.location, stream.components, stream.type, 0);
+            } else {
+                m_vertexArrayAttribFormat(vertexInput, stream.location, stream.components, stream.type, GL_FALSE, 0);
+            }
+            m_vertexArrayAttribBinding(vertexInput, stream.location, stream.location);
+            m_vertexArrayBindingDivisor(vertexInput, stream.location, stream.divisor);
+            m_enableVertexArrayAttrib(vertexInput, stream.location);
+        }
+        if (indexBuffer != 0) {
+            m_vertexArrayElementBuffer(vertexInput, indexBuffer);
+        }
+    }
+
+    bool hasBindlessTextures() const override
+    {
+        return m_getTextureHandle != nullptr && m_makeTextureHandleResident != nullptr
+                && m_makeTextureHandleNonResident != nullptr;
+    }
+
+    uint64_t acquireTextureHandle(GLuint texture) override
+    {
+        if (!hasBindlessTextures()) {
+            return 0;
+        }
+        GLuint64 handle = m_getTextureHandle(texture);
+        if (handle != 0) {
+            m_makeTextureHandleResident(handle);
+        }
+        return handle;
+    }
+
+    void releaseTextureHandle(uint64_t handle) override
+    {
+        if (handle != 0 && hasBindlessTextures()) {
+            m_makeTextureHandleNonResident(handle);
+        }
+    }
+};
+
+/**
+ * @brief RenderBackend::create
+ *  Direct state access wants a GL 4.5 context whose entry points all
+ *  resolve; ES never has them.
+ */
+uPtr<RenderBackend> RenderBackend::create(OpenGLContext *context, RenderBackendKind kind)
+{
+    if (kind == RenderBackendKind::directStateAccess) {
+        QOpenGLContext *glContext = context->context();
+        if (!glContext->isOpenGLES() && glContext->format().version() >= qMakePair(4, 5)) {
+            uPtr<DSARenderBackend> backend = mkU<DSARenderBackend>(context);
+            if (backend->isComplete()) {
+                return backend;
+            }
+        }
+        std::cout << "No GL 4.5 direct state access, rendering through the legacy backend" << std::endl;
+    }
+    return mkU<LegacyRenderBackend>(context);
+}
@@ -0,0 +1,115 @@
+#pragma once
+#include "openglcontext.h"
+#include "smartpointerhelp.h"
+#include <QString>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+// The APIs a RenderBackend can speak
+enum class RenderBackendKind : unsigned char {
+    // GL 3.3 / ES 3: objects are bound to be edited
+    legacy,
+    // GL 4.5: direct state access and immutable buffer storage, with
+    // bindless textures where ARB_bindless_texture is
+    directStateAccess
+};
+
+// How a buffer's contents change after it is filled
+enum class BufferUsage : unsigned char {
+    // never, e.g. a mesh built once
+    immutable,
+    // now and then, through RenderBackend::updateBuffer
+    dynamic,
+    // every frame
+    stream
+};
+
+// One vertex attribute of a vertex input, read from its own buffer
+struct VertexStream
+{
+    GLuint buffer;
+    GLuint location;
+    GLint components;
+    GLenum type;
+    // read as integers (vs_Packed), else converted to floats
+    bool integer;
+    GLsizei stride;
+    // of the first vertex, in bytes
+    size_t offset;
+    // 0: a value per vertex, else per this many instances
+    GLuint divisor;
+};
+
+/**
+ * @brief The RenderBackend class
+ *  The layer between the renderer and the graphics API, for what it
+ *  creates and submits: buffers, vertex inputs (the pipeline's vertex
+ *  state, a vertex array object in GL) and indexed draws, and bindless
+ *  texture handles. The handles are GL names for now; a Vulkan backend
+ *  would map them to its own objects.
+ *  The legacy backend is the GL 3.3 path the renderer always took, and
+ *  the default. The direct state access one edits objects by name,
+ *  without disturbing the bindings the draws rely on, and gives buffers
+ *  immutable storage the driver can place once; MyGL picks it with
+ *  --render-backend dsa, falling back to legacy where GL 4.5 is missing.
+ *  Main thread only, with the context current.
+ */
+class RenderBackend
+{
+protected:
+    OpenGLContext *mp_context;
+
+    explicit RenderBackend(OpenGLContext *context);
+
+public:
+    virtual ~RenderBackend();
+
+    RenderBackend(const RenderBackend&) = delete;
+    RenderBackend &operator=(const RenderBackend&) = delete;
+
+    // The backend of that kind, or the legacy one where the context
+    // lacks what it needs
+    static uPtr<RenderBackend> create(OpenGLContext *context, RenderBackendKind kind);
+    // "legacy" or "dsa"; false if name is neither
+    static bool parseKind(const QString &name, RenderBackendKind *kind);
+
+    virtual RenderBackendKind getKind() const = 0;
+    const char *getName() const;
+
+    // Buffers.
+    // (Re)fill the buffer with bytes of data, or undefined contents if
+    // data is null. buffer 0 is created; an immutable buffer is replaced
+    // by a new one, so the name may change. target is what the buffer
+    // is bound to by those who bind it (e.g. GL_ELEMENT_ARRAY_BUFFER).
+    virtual void fillBuffer(GLuint &buffer, GLenum target, size_t bytes, const void *data, BufferUsage usage) = 0;
+    // write bytes of data at offset; the buffer was not filled immutable
+    virtual void updateBuffer(GLuint buffer, GLenum target, size_t offset, size_t bytes, const void *data) = 0;
+    void deleteBuffer(GLuint &buffer);
+
+    // Vertex inputs.
+    virtual GLuint createVertexInput() = 0;
+    // Read the streams' attributes from their buffers and the indices from
+    // indexBuffer (0: none); what the vertex input read before is
+    // replaced only where the streams say otherwise. The vertex input
+    // bound stays bound.
+    virtual void setVertexInput(GLuint vertexInput, std::initializer_list<VertexStream> streams,
+                                GLuint indexBuffer) = 0;
+    void deleteVertexInput(GLuint &vertexInput);
+
+    // Draw submission.
+    // the vertex input the draws read from, until another is bound
+    void bindVertexInput(GLuint vertexInput);
+    // count indices of the bound vertex input's index buffer from
+    // firstIndex on, 32-bit, instances times
+    void drawIndexed(GLenum mode, GLsizei count, size_t firstIndex = 0, GLsizei instances = 1);
+
+    // Textures.
+    // whether acquireTextureHandle gives handles
+    virtual bool hasBindlessTextures() const;
+    // A handle the shaders can sample the texture by, resident until
+    // released, after which the texture's parameters are fixed; 0 without
+    // bindless textures
+    virtual uint64_t acquireTextureHandle(GLuint texture);
+    virtual void releaseTextureHandle(uint64_t handle);
+};
@@ -1,4 +1,5 @@
 #include "block.h"
+#include <stdexcept>
 
 /**
  * @brief createBlockFaces
@@ -107,76 +108,6 @@ std::array<BlockFace, 6> Block::createBlockFaces()
 };
 
 
-/**
- * @brief Block::isOpaque
- *  The helper function to determine whether a given block type is
- *  treated as opaque or not.
- * @return
- */
-bool Block::isOpaque(BlockType type)
-{
-    return (transparentBlockTypes.find(type) == transparentBlockTypes.end());
-}
-
-
-/**
- * @brief Block::isTransparent
- *  The helper function to determine whether a given block type
- *  is treated as transparent or not
- * @param type
- * @return
- */
-bool Block::isTransparent(BlockType type)
-{
-    return (transparentBlockTypes.find(type) != transparentBlockTypes.end());
-}
-
-bool Block::isLiquid(BlockType type)
-{
-    return (liquidBlockTypes.find(type) != liquidBlockTypes.end());
-}
-
-/**
- * @brief Block::isAnimatable
- *  The helper function to determine whether a given block type
- *  is animatable or not
- * @param type
- * @return
- */
-bool Block::isAnimatable(BlockType type)
-{
-    return (animatableBlockTypes.find(type) != animatableBlockTypes.end());
-}
-
-/**
- * @brief Block::getAnimatableFlag
- *  Get the predefined animatable flag depending on the block type
- *  Use vector for convenience in passing data to GPU
- * @return float, vec2(1) is animatable block, vec2(-1) is non-animatable block
- */
-glm::vec2 Block::getAnimatableFlag(BlockType type)
-{
-    if (isAnimatable(type)) {
-        return glm::vec2(1.f);
-    }
-
-    return glm::vec2(-1.f);
-}
-
-/**
- * @brief Block::isEmpty
- *  The helper function to determine whether a given block type
- *  is treated as empty or not.
- *  It is used for drawing faces of transparent block
- * @param type
- * @return
- */
-bool Block::isEmpty(BlockType type)
-{
-    return (type == EMPTY);
-}
-
-
 /**
  * @brief Block::getColors
  *  Get the predefined color depending on the block type
@@ -218,12 +149,41 @@ glm::vec4 Block::getColors(BlockType type)
 }
 
 void Block::insertNewUVCoord(BlockType blockType, std::array<glm::vec2, 6> uv) {
+    if (registryFrozen) {
+        throw std::logic_error("Block uvs inserted after freezeRegistry!");
+    }
     BlockCollection[blockType] = Block::createBlockFaces(uv);
+    updateFaceLayers(blockType);
 }
 
 
 void Block::insertNewUVCoord(BlockType blockType, std::array<glm::vec4, 6> uv) {
+    if (registryFrozen) {
+        throw std::logic_error("Block uvs inserted after freezeRegistry!");
+    }
     BlockCollection[blockType] = Block::createBlockFaces(uv);
+    updateFaceLayers(blockType);
+}
+
+/**
+ * @brief Block::updateFaceLayers
+ *  A face's first vertex sits at its tile's origin in the 16 x 16 atlas;
+ *  the atlas' rows are counted from the bottom, as the array's layers are.
+ * @param blockType
+ */
+void Block::updateFaceLayers(BlockType blockType) {
+    for (int f = 0; f < 6; f++) {
+        glm::ivec2 tile = glm::ivec2(glm::round(BlockCollection[blockType][f].vertices[0].uv * 16.f));
+        faceLayers[blockType][f] = static_cast<uint8_t>(glm::clamp(tile.y, 0, 15) * 16 + glm::clamp(tile.x, 0, 15));
+    }
+}
+
+void Block::freezeRegistry() {
+    registryFrozen = true;
+}
+
+bool Block::isRegistryFrozen() {
+    return registryFrozen;
 }
 
 /**
@@ -279,14 +239,8 @@ void Block::loadUVCoordFromText(const char* text_path) {
  *          (order: bottom-left, bottom-right, top-right, top-left
  */
 void Block::getUVCoords(BlockType blockType, std::array<glm::vec2, 4>* uvCoords, Direction dir) {
-    std::array<BlockFace, 6> faces = BlockCollection[blockType];
-    BlockFace targetFace;
-    for (auto& face : faces) {
-        if (face.dir == dir) {
-            targetFace = face;
-            break;
-        }
-    }
+    // the faces are stored in Direction order
+    const BlockFace &targetFace = BlockCollection[blockType][dir];
     for (int i=0; i<4; ++i) {
         (*uvCoords)[i] = targetFace.vertices[i].uv;
     }
@@ -309,12 +263,21 @@ BlockType Block::getDestroyedBlockType(BlockType blockType) {
 
 /**
  * Instantiate various kinds of blocks here.
- * TODO: Update uvs for each block.
+ * Every type starts with the default faces; loadUVCoordFromText fills in the uvs.
  * Access to this static variable with Block::BlockCollection
  **/
-std::unordered_map<BlockType, std::array<BlockFace, 6>> Block::BlockCollection = {
-    {}
-};
+std::array<std::array<BlockFace, 6>, 256> Block::createDefaultBlockCollection()
+{
+    std::array<std::array<BlockFace, 6>, 256> collection;
+    collection.fill(createBlockFaces());
+    return collection;
+}
+
+std::array<std::array<BlockFace, 6>, 256> Block::BlockCollection = Block::createDefaultBlockCollection();
+
+std::array<std::array<uint8_t, 6>, 256> Block::faceLayers = {};
+
+bool Block::registryFrozen = false;
 
 std::unordered_map<std::string, BlockType> Block::blockTypeMap = {
     {{"GRASS", GRASS},
@@ -377,3 +340,41 @@ std::unordered_set<BlockType> Block::animatableBlockTypes = {
 std::unordered_set<BlockType> Block::liquidBlockTypes = {
     WATER, LAVA, ROT, ACID
 };
+
+std::unordered_map<BlockType, unsigned char> Block::blockEmissions = {
+    {LAVA, 15}
+};
+
+std::unordered_set<BlockType> Block::randomTickBlockTypes = {
+    GRASS, ICE, SNOW
+};
+
+std::unordered_set<BlockType> Block::fallingBlockTypes = {
+    SAND
+};
+
+/**
+ * @brief createBlockProps
+ *  Compile the type sets above into the per-type table. Defined after
+ *  them in this file, so they are initialized first.
+ * @return
+ */
+static std::array<BlockProps, 256> createBlockProps()
+{
+    std::array<BlockProps, 256> props;
+    for (int i = 0; i < 256; i++) {
+        BlockType type = static_cast<BlockType>(i);
+        bool animatable = Block::animatableBlockTypes.count(type) > 0;
+        auto emission = Block::blockEmissions.find(type);
+        props[i] = BlockProps{Block::transparentBlockTypes.count(type) == 0,
+                              Block::liquidBlockTypes.count(type) > 0,
+                              animatable,
+                              glm::vec2(animatable ? 1.f : -1.f),
+                              emission != Block::blockEmissions.end() ? emission->second : static_cast<unsigned char>(0),
+                              Block::randomTickBlockTypes.count(type) > 0,
+                              Block::fallingBlockTypes.count(type) > 0};
+    }
+    return props;
+}
+
+const std::array<BlockProps, 256> Block::blockProps = createBlockProps();
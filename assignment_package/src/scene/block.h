@@ -3,6 +3,7 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <array>
+#include <cstdint>
 #include <QApplication>
 #include <QFile>
 
@@ -74,6 +75,22 @@ struct BlockFace
 };
 
 
+// What the mesher and the physics ask about a block type,
+// compiled once from Block's type sets (see Block::blockProps)
+struct BlockProps
+{
+    // not in transparentBlockTypes
+    bool opaque;
+    bool liquid;
+    bool animatable;
+    // the animatable vertex attribute: vec2(1) or vec2(-1)
+    glm::vec2 animatableFlag;
+    // the block light it gives off (see LightVolume)
+    unsigned char emission;
+    bool randomTicks;
+    bool falls;
+};
+
 /**
  * @brief The Block class
  *  Define a class that handles all blocks
@@ -89,13 +106,33 @@ private:
     // default func to create the 6 faces of a given block (uv offset is set to (0, 0))
     static std::array<BlockFace, 6> createBlockFaces();
 
+    // every block type with the default faces
+    static std::array<std::array<BlockFace, 6>, 256> createDefaultBlockCollection();
+
     // for NPC blocks
     static std::array<BlockFace, 6> createBlockFaces(std::array<glm::vec4, 6> uvs);
 
+    // faceLayers[type] from BlockCollection[type]
+    static void updateFaceLayers(BlockType blockType);
+
 public:
 
-    // a collection of all the pos, nor, col, uvs of all types of blocks
-    static std::unordered_map<BlockType, std::array<BlockFace, 6>> BlockCollection;
+    // the pos, nor, uvs of the 6 faces (in Direction order) of every block type,
+    // indexed by BlockType; a type without loaded uvs has all-zero uvs.
+    // Written only until freezeRegistry(), read lock-free by any thread after.
+    static std::array<std::array<BlockFace, 6>, 256> BlockCollection;
+
+    // the block texture array's layer of each face (see getFaceLayer),
+    // kept with BlockCollection
+    static std::array<std::array<uint8_t, 6>, 256> faceLayers;
+
+    // set by freezeRegistry(); main thread only
+    static bool registryFrozen;
+
+    // the properties of every block type, indexed by BlockType.
+    // Kept apart from BlockCollection so the flags of all types share a
+    // few cache lines.
+    static const std::array<BlockProps, 256> blockProps;
 
     // static std::unordered_map<BlockType, std::array<BlockFace, 6>> NPCBlockCollection;
 
@@ -118,23 +155,75 @@ public:
     // all blocktypes not in this set in solid
     static std::unordered_set<BlockType> liquidBlockTypes;
 
+    // the block light level (1 to 15) of each light-emitting block type
+    // all blocktypes not in this map give off no light
+    static std::unordered_map<BlockType, unsigned char> blockEmissions;
+
+    // a collection of block types that change on their own (see BlockTicks)
+    // all blocktypes not in this set get no random ticks
+    static std::unordered_set<BlockType> randomTickBlockTypes;
+
+    // a collection of block types that fall when nothing holds them up
+    // (see BlockTicks); all blocktypes not in this set stay where they are
+    static std::unordered_set<BlockType> fallingBlockTypes;
+
     // the rule to determine whether a given block is opaque or not
-    static bool isOpaque(BlockType type);
+    static bool isOpaque(BlockType type) {
+        return blockProps[type].opaque;
+    }
 
     // the rule to determine whether a given block is transparent or not
-    static bool isTransparent(BlockType type);
+    static bool isTransparent(BlockType type) {
+        return !blockProps[type].opaque;
+    }
 
     // the rule to determine whether a given block is empty or not
-    static bool isEmpty(BlockType type);
+    static bool isEmpty(BlockType type) {
+        return type == EMPTY;
+    }
 
     // the rule to determine whether a given block is animatable or not
-    static bool isAnimatable(BlockType type);
+    static bool isAnimatable(BlockType type) {
+        return blockProps[type].animatable;
+    }
 
     // the rule to determine whether a given block is liquid or not
-    static bool isLiquid(BlockType Type);
+    static bool isLiquid(BlockType type) {
+        return blockProps[type].liquid;
+    }
+
+    // the block light a block of this type gives off, 0 to 15
+    static int getEmission(BlockType type) {
+        return blockProps[type].emission;
+    }
+
+    // the rule to determine whether a given block gets random ticks or not
+    static bool hasRandomTicks(BlockType type) {
+        return blockProps[type].randomTicks;
+    }
+
+    // the rule to determine whether a given block falls or not
+    static bool falls(BlockType type) {
+        return blockProps[type].falls;
+    }
 
     // the function that defines the animatable flag of each block type
-    static glm::vec2 getAnimatableFlag(BlockType type);
+    // vec2(1) is animatable block, vec2(-1) is non-animatable block
+    static glm::vec2 getAnimatableFlag(BlockType type) {
+        return blockProps[type].animatableFlag;
+    }
+
+    // the 6 faces of a block type, in Direction order
+    static const std::array<BlockFace, 6> &getFaces(BlockType type) {
+        return BlockCollection[type];
+    }
+
+    // the layer of the block texture array (see TextureArray::createFromTiles)
+    // the face of a block type shows, in Direction order: its atlas tile's
+    // row * 16 + column, which the meshers pack into each vertex
+    static int getFaceLayer(BlockType type, int face) {
+        return faceLayers[type][face];
+    }
 
     // the function that defines the color of each block type
     static glm::vec4 getColors(BlockType type);
@@ -150,6 +239,13 @@ public:
     // load uv coordinate of all blocktypes from text file
     static void loadUVCoordFromText(const char* text_path);
 
+    // Publish BlockCollection: from now on it is immutable, and inserting
+    // uvs throws std::logic_error. Call on the main thread once every uv
+    // file is loaded and before the first worker meshes a chunk (starting
+    // a worker then orders its reads after the writes).
+    static void freezeRegistry();
+    static bool isRegistryFrozen();
+
     // get the uv coordinates of given blocktype and direction
     // order (bottom-left, bottom-right, top-right, top-left)
     static void getUVCoords(BlockType blockType, std::array<glm::vec2, 4>* uvCoords, Direction dir=XPOS);
@@ -0,0 +1,124 @@
+#include "blockcursor.h"
+#include "chunkmap.h"
+#include "terrain.h"
+
+BlockCursor::BlockCursor(const Terrain &terrain)
+    : mcr_terrain(&terrain), mp_chunk(nullptr), m_cx(0), m_cz(0)
+{}
+
+/**
+ * @brief BlockCursor::resolve
+ *  Hop from the remembered chunk when (cx, cz) is one of its eight
+ *  surrounding chunks, otherwise look it up in the Terrain.
+ *  A null link only means this path is broken, so it falls back to the
+ *  lookup too.
+ * @param cx
+ * @param cz
+ * @return
+ */
+const Chunk *BlockCursor::resolve(int cx, int cz)
+{
+    if (mp_chunk != nullptr) {
+        int dx = cx - m_cx;
+        int dz = cz - m_cz;
+        if (dx == 0 && dz == 0) {
+            return mp_chunk;
+        }
+        if (dx >= -1 && dx <= 1 && dz >= -1 && dz <= 1) {
+            const Chunk *c = mp_chunk;
+            if (dx != 0) {
+                c = c->getNeighbor(dx > 0 ? XPOS : XNEG);
+            }
+            if (c != nullptr && dz != 0) {
+                c = c->getNeighbor(dz > 0 ? ZPOS : ZNEG);
+            }
+            if (c != nullptr) {
+                mp_chunk = c;
+                m_cx = cx;
+                m_cz = cz;
+                return c;
+            }
+        }
+    }
+
+    const Chunk *c = mcr_terrain->findChunk(cx * 16, cz * 16);
+    if (c != nullptr) {
+        mp_chunk = c;
+        m_cx = cx;
+        m_cz = cz;
+    }
+    return c;
+}
+
+std::optional<BlockType> BlockCursor::tryGetBlockAt(int x, int y, int z)
+{
+    const Chunk *c = resolve(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (c == nullptr) {
+        return std::nullopt;
+    }
+    if (y < 0 || y >= 256) {
+        return EMPTY;
+    }
+    return c->getBlockAtUnchecked(static_cast<unsigned int>(x & 15),
+                                  static_cast<unsigned int>(y),
+                                  static_cast<unsigned int>(z & 15));
+}
+
+std::optional<BlockType> BlockCursor::tryGetBlockAt(glm::vec3 p)
+{
+    return tryGetBlockAt(p.x, p.y, p.z);
+}
+
+int BlockCursor::getEmptySpan(int x, int y, int z)
+{
+    const Chunk *c = resolve(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (c == nullptr) {
+        return 0;
+    }
+    if (y < 0 || y >= 256) {
+        return BlockSection::size;
+    }
+    uint64_t bricks = c->getOccupiedBricks(y >> 4);
+    if (bricks == 0) {
+        return BlockSection::size;
+    }
+    unsigned int i = BlockSection::localIndex(static_cast<unsigned int>(x & 15), static_cast<unsigned int>(y & 15),
+                                              static_cast<unsigned int>(z & 15));
+    if (!(bricks & (1ull << BlockSection::brickIndex(i)))) {
+        return BlockSection::brickSize;
+    }
+    return c->getBlockAtUnchecked(static_cast<unsigned int>(x & 15), static_cast<unsigned int>(y),
+                                  static_cast<unsigned int>(z & 15)) == EMPTY ? 1 : 0;
+}
+
+/**
+ * @brief BlockCursor::getNeighborhood
+ *  Column by column, so each of the (at most four) chunks the cube
+ *  touches is resolved once per column instead of once per block.
+ * @param x
+ * @param y
+ * @param z
+ * @param out
+ * @param missing : the type read where there is no chunk
+ */
+void BlockCursor::getNeighborhood(int x, int y, int z, std::array<BlockType, 27> &out, BlockType missing)
+{
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            int wx = x + dx;
+            int wz = z + dz;
+            const Chunk *c = resolve(ChunkMap::toChunkCoord(wx), ChunkMap::toChunkCoord(wz));
+            for (int dy = -1; dy <= 1; dy++) {
+                int wy = y + dy;
+                BlockType t = missing;
+                if (c != nullptr) {
+                    t = (wy < 0 || wy >= 256) ? EMPTY
+                                              : c->getBlockAtUnchecked(static_cast<unsigned int>(wx & 15),
+                                                                       static_cast<unsigned int>(wy),
+                                                                       static_cast<unsigned int>(wz & 15));
+                }
+                out[(dy + 1) * 9 + (dz + 1) * 3 + (dx + 1)] = t;
+            }
+        }
+    }
+}
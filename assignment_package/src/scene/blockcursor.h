@@ -0,0 +1,51 @@
+#pragma once
+
+#include "block.h"
+#include "chunk.h"
+#include "glm_includes.h"
+#include <array>
+#include <optional>
+
+class Terrain;
+
+/**
+ * @brief The BlockCursor class
+ *  Reads blocks at world-space coordinates like Terrain::tryGetBlockAt,
+ *  but remembers the last chunk it resolved: a query in that chunk costs
+ *  no lookup, and one in a chunk next to it (diagonals included) is one or
+ *  two hops along the chunks' neighbor links. Only a farther jump goes
+ *  back to the Terrain's chunk map.
+ *  Meant for the short query bursts of ray marches and path searches:
+ *  keep one on the stack for the burst, on the main thread, and never
+ *  across a Terrain::expand, which may delete the remembered chunk.
+ */
+class BlockCursor
+{
+private:
+    const Terrain *mcr_terrain;
+    // the last resolved chunk (never a missing one) and its chunk coordinates
+    const Chunk *mp_chunk;
+    int m_cx;
+    int m_cz;
+
+    // the chunk at chunk coordinates (cx, cz), or null
+    const Chunk *resolve(int cx, int cz);
+
+public:
+    BlockCursor(const Terrain &terrain);
+
+    // the block at (x, y, z), std::nullopt if no Chunk holds it;
+    // heights outside [0, 256) read as EMPTY
+    std::optional<BlockType> tryGetBlockAt(int x, int y, int z);
+    std::optional<BlockType> tryGetBlockAt(glm::vec3 p);
+
+    // The side of the largest empty cube around (x, y, z) the sections
+    // vouch for: 16 for an empty section (or beyond the world's heights),
+    // 4 for an empty brick, 1 for an EMPTY block, 0 for any other block or
+    // a missing chunk. The cube is aligned to its side.
+    int getEmptySpan(int x, int y, int z);
+
+    // The 27 blocks of the 3 x 3 x 3 cube centered on (x, y, z) at
+    // out[(dy + 1) * 9 + (dz + 1) * 3 + (dx + 1)]; missing chunks read as `missing`
+    void getNeighborhood(int x, int y, int z, std::array<BlockType, 27> &out, BlockType missing = EMPTY);
+};
@@ -0,0 +1,118 @@
+#include "blockicons.h"
+#include <iostream>
+
+// The faces in the unit square of an icon, y up, as BlockInWidget laid
+// them out: the corners of each (bottom-left, bottom-right, top-right,
+// top-left), in the order drawn, a later face over an earlier one
+struct IconFace
+{
+    Direction dir;
+    std::array<glm::vec2, 4> corners;
+};
+static const std::array<IconFace, 3> iconFaces = {{
+    {XPOS, {{glm::vec2(0.5f, 0.f), glm::vec2(1.f, 0.25f), glm::vec2(1.f, 0.75f), glm::vec2(0.5f, 0.5f)}}},
+    {YPOS, {{glm::vec2(0.f, 0.75f), glm::vec2(0.5f, 0.5f), glm::vec2(1.f, 0.75f), glm::vec2(0.5f, 1.f)}}},
+    {ZPOS, {{glm::vec2(0.f, 0.25f), glm::vec2(0.5f, 0.f), glm::vec2(0.5f, 0.5f), glm::vec2(0.f, 0.75f)}}}
+}};
+
+static bool hasUVs(BlockType blockType)
+{
+    for (const IconFace &face : iconFaces) {
+        for (const VertexData &vertex : Block::BlockCollection[blockType][face.dir].vertices) {
+            if (vertex.uv != glm::vec2(0.f)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief sampleFace
+ *  The uv at p of the face, as the two triangles (0, 1, 2) and (0, 2, 3)
+ *  of its quad interpolated it.
+ * @param face
+ * @param uvs : of the face's corners
+ * @param p   : in the icon's unit square
+ * @param uv  : out
+ * @return false if p is not on the face
+ */
+static bool sampleFace(const IconFace &face, const std::array<glm::vec2, 4> &uvs, glm::vec2 p, glm::vec2 *uv)
+{
+    // every face is a parallelogram: p = c0 + s (c1 - c0) + t (c3 - c0)
+    glm::mat2 edges(face.corners[1] - face.corners[0], face.corners[3] - face.corners[0]);
+    glm::vec2 st = glm::inverse(edges) * (p - face.corners[0]);
+    if (st.x < 0.f || st.x >= 1.f || st.y < 0.f || st.y >= 1.f) {
+        return false;
+    }
+    if (st.x >= st.y) {
+        *uv = uvs[0] + st.x * (uvs[1] - uvs[0]) + st.y * (uvs[2] - uvs[1]);
+    } else {
+        *uv = uvs[0] + st.x * (uvs[2] - uvs[3]) + st.y * (uvs[3] - uvs[0]);
+    }
+    return true;
+}
+
+/**
+ * @brief BlockIcons::bake
+ *  Sampled nearest, as the HUD reads its layers, each icon pixel at its
+ *  center.
+ * @param blockAtlas
+ * @return
+ */
+QImage BlockIcons::bake(const QImage &blockAtlas)
+{
+    QImage atlas = blockAtlas.convertToFormat(QImage::Format_ARGB32);
+    QImage icons(atlas.width(), atlas.height(), QImage::Format_ARGB32);
+    icons.fill(Qt::transparent);
+    int iconWidth = atlas.width() / iconsPerRow;
+    int iconHeight = atlas.height() / iconsPerRow;
+
+    for (int type = 1; type < 256; type++) {
+        BlockType blockType = static_cast<BlockType>(type);
+        if (!hasUVs(blockType)) {
+            continue;
+        }
+        if (type >= iconCount) {
+            std::cout << "Block type " << type << " has no inventory icon" << std::endl;
+            continue;
+        }
+        std::array<std::array<glm::vec2, 4>, 3> faceUVs;
+        for (size_t f = 0; f < iconFaces.size(); f++) {
+            Block::getUVCoords(blockType, &faceUVs[f], iconFaces[f].dir);
+        }
+
+        int x0 = (type % iconsPerRow) * iconWidth;
+        int y0 = (type / iconsPerRow) * iconHeight;
+        for (int y = 0; y < iconHeight; y++) {
+            QRgb *row = reinterpret_cast<QRgb*>(icons.scanLine(y0 + y)) + x0;
+            for (int x = 0; x < iconWidth; x++) {
+                glm::vec2 p((x + 0.5f) / iconWidth, (y + 0.5f) / iconHeight);
+                glm::vec2 uv;
+                bool covered = false;
+                for (int f = static_cast<int>(iconFaces.size()) - 1; f >= 0 && !covered; f--) {
+                    covered = sampleFace(iconFaces[f], faceUVs[f], p, &uv);
+                }
+                if (!covered) {
+                    continue;
+                }
+                int u = glm::clamp(static_cast<int>(uv.x * atlas.width()), 0, atlas.width() - 1);
+                int v = glm::clamp(static_cast<int>(uv.y * atlas.height()), 0, atlas.height() - 1);
+                // the faces were drawn without blending
+                row[x] = reinterpret_cast<const QRgb*>(atlas.constScanLine(v))[u] | 0xFF000000u;
+            }
+        }
+    }
+    return icons;
+}
+
+void BlockIcons::getUVCoords(BlockType blockType, std::array<glm::vec2, 4>* uvCoords)
+{
+    glm::vec2 bottomLeft(blockType % iconsPerRow, blockType / iconsPerRow);
+    bottomLeft /= static_cast<float>(iconsPerRow);
+    float side = 1.f / iconsPerRow;
+    (*uvCoords)[0] = bottomLeft;
+    (*uvCoords)[1] = bottomLeft + glm::vec2(side, 0.f);
+    (*uvCoords)[2] = bottomLeft + glm::vec2(side, side);
+    (*uvCoords)[3] = bottomLeft + glm::vec2(0.f, side);
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "block.h"
+#include <QImage>
+#include <array>
+
+/**
+ * @brief The BlockIcons class
+ *  The isometric cube the inventory shows for each block type, baked
+ *  once into a layer of the HUD's texture array (HudBatch::icons), so an
+ *  item is one textured quad rather than three faces with their own uvs
+ *  rebuilt every frame. The icon of type t is the cell t % iconsPerRow,
+ *  t / iconsPerRow of the layer, counted from the bottom left; the types
+ *  past the last cell have none.
+ *  Each icon holds the faces BlockInWidget used to draw: the top (YPOS)
+ *  over the bottom-right (XPOS) and bottom-left (ZPOS) ones, opaque,
+ *  around them transparent.
+ */
+class BlockIcons
+{
+public:
+    static const int iconsPerRow = 8;
+    static const int iconCount = iconsPerRow * iconsPerRow;
+
+    // The icons of every type with uvs (see Block::loadUVCoordFromText),
+    // from the block atlas, bottom row first as ImageDecoder gives it; as
+    // large as the atlas, so it fits the HUD's other layers
+    static QImage bake(const QImage &blockAtlas);
+
+    // the uvs of its icon in the layer, bottom-left, bottom-right,
+    // top-right, top-left
+    static void getUVCoords(BlockType blockType, std::array<glm::vec2, 4>* uvCoords);
+};
@@ -0,0 +1,671 @@
+#include "blocksection.h"
+#include <QMutex>
+#include <algorithm>
+#include <array>
+#include <unordered_map>
+
+/**
+ * @brief The BlockSection::InternTable class
+ *  The interned data by hash, held weakly: data no section holds any more
+ *  is freed as usual, and its entry dropped on the next lookup of its
+ *  hash or sweep.
+ */
+class BlockSection::InternTable
+{
+private:
+    // between two sweeps of the expired entries
+    static const size_t sweepInterval = 4096;
+
+    std::unordered_multimap<uint64_t, std::weak_ptr<PackedData>> m_entries;
+    size_t m_internsSinceSweep;
+    size_t m_hits;
+    QMutex m_lock;
+
+    void sweep()
+    {
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            it = it->second.expired() ? m_entries.erase(it) : std::next(it);
+        }
+        m_internsSinceSweep = 0;
+    }
+
+public:
+    InternTable()
+        : m_entries(), m_internsSinceSweep(0), m_hits(0), m_lock()
+    {}
+
+    // the interned data with data's blocks; data itself if it is the first
+    sPtr<PackedData> intern(const sPtr<PackedData> &data)
+    {
+        uint64_t hash = data->hash();
+        m_lock.lock();
+        auto range = m_entries.equal_range(hash);
+        for (auto it = range.first; it != range.second;) {
+            sPtr<PackedData> candidate = it->second.lock();
+            if (candidate == nullptr) {
+                it = m_entries.erase(it);
+                continue;
+            }
+            if (candidate->sameBlocks(*data)) {
+                m_hits++;
+                m_lock.unlock();
+                return candidate;
+            }
+            ++it;
+        }
+        data->interned = true;
+        m_entries.emplace(hash, data);
+        if (++m_internsSinceSweep >= sweepInterval) {
+            sweep();
+        }
+        m_lock.unlock();
+        return data;
+    }
+
+    size_t getCount()
+    {
+        m_lock.lock();
+        sweep();
+        size_t count = m_entries.size();
+        m_lock.unlock();
+        return count;
+    }
+
+    size_t getHitCount()
+    {
+        m_lock.lock();
+        size_t hits = m_hits;
+        m_lock.unlock();
+        return hits;
+    }
+};
+
+BlockSection::InternTable &BlockSection::internTable()
+{
+    static BlockSection::InternTable table;
+    return table;
+}
+
+BlockSection::PackedData::PackedData(unsigned int bits)
+    : bits(bits), paletteSize(0),
+      palette(1u << bits, EMPTY),
+      words(volume * bits / 64), occupied(0), interned(false)
+{
+    for (std::atomic<uint64_t> &word : words) {
+        word.store(0, std::memory_order_relaxed);
+    }
+}
+
+BlockSection::PackedData::PackedData(const PackedData &other)
+    : bits(other.bits), paletteSize(other.paletteSize),
+      palette(other.palette),
+      words(other.words.size()),
+      occupied(other.occupied.load(std::memory_order_relaxed)), interned(false)
+{
+    for (size_t w = 0; w < words.size(); w++) {
+        words[w].store(other.words[w].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+}
+
+void BlockSection::PackedData::setIndex(unsigned int i, unsigned int paletteIndex)
+{
+    if (palette[paletteIndex] != EMPTY) {
+        uint64_t brick = 1ull << brickIndex(i);
+        // plain load first: most writes land in bricks already marked
+        if (!(occupied.load(std::memory_order_relaxed) & brick)) {
+            occupied.fetch_or(brick, std::memory_order_relaxed);
+        }
+    }
+    unsigned int bit = storageIndex(i) * bits;
+    uint64_t mask = ((1ull << bits) - 1) << (bit & 63);
+    std::atomic<uint64_t> &word = words[bit >> 6];
+    uint64_t value = word.load(std::memory_order_relaxed);
+    // release: publishes the palette entry the index may name
+    word.store((value & ~mask) | (static_cast<uint64_t>(paletteIndex) << (bit & 63)),
+               std::memory_order_release);
+}
+
+void BlockSection::PackedData::recountOccupied()
+{
+    uint64_t mask = 0;
+    for (unsigned int i = 0; i < volume; i++) {
+        if (palette[index(i)] != EMPTY) {
+            mask |= 1ull << brickIndex(i);
+        }
+    }
+    occupied.store(mask, std::memory_order_relaxed);
+}
+
+int BlockSection::PackedData::find(BlockType t) const
+{
+    for (unsigned int p = 0; p < paletteSize; p++) {
+        if (palette[p] == t) {
+            return p;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief BlockSection::PackedData::hash
+ *  FNV-1a over the words; the unused palette entries are left out, so
+ *  equal blocks in equal palettes hash the same whatever a palette held.
+ * @return
+ */
+uint64_t BlockSection::PackedData::hash() const
+{
+    uint64_t h = 14695981039346656037ull;
+    auto mix = [&h](uint64_t v) {
+        h = (h ^ v) * 1099511628211ull;
+    };
+    mix(bits);
+    mix(paletteSize);
+    for (unsigned int p = 0; p < paletteSize; p++) {
+        mix(palette[p]);
+    }
+    for (const std::atomic<uint64_t> &word : words) {
+        mix(word.load(std::memory_order_relaxed));
+    }
+    return h;
+}
+
+bool BlockSection::PackedData::sameBlocks(const PackedData &other) const
+{
+    if (bits != other.bits || paletteSize != other.paletteSize
+            || !std::equal(palette.begin(), palette.begin() + paletteSize, other.palette.begin())) {
+        return false;
+    }
+    for (size_t w = 0; w < words.size(); w++) {
+        if (words[w].load(std::memory_order_relaxed) != other.words[w].load(std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BlockSection::BlockSection()
+    : BlockSection(EMPTY)
+{}
+
+BlockSection::BlockSection(BlockType fill)
+    : m_data(nullptr), m_uniform(fill), m_retired(), m_current()
+{}
+
+BlockSection::Snapshot::Snapshot()
+    : m_data(), m_uniform(EMPTY)
+{}
+
+void BlockSection::Snapshot::copyTo(BlockType *out) const
+{
+    if (m_data == nullptr) {
+        std::fill(out, out + volume, m_uniform);
+        return;
+    }
+    for (unsigned int i = 0; i < volume; i++) {
+        out[i] = m_data->get(i);
+    }
+}
+
+bool BlockSection::Snapshot::isUniform() const
+{
+    return m_data == nullptr;
+}
+
+/**
+ * @brief BlockSection::publish
+ *  Make `data` the section's storage (null: uniform), retiring the old one.
+ * @param data
+ */
+void BlockSection::publish(sPtr<PackedData> data)
+{
+    m_data.store(data.get(), std::memory_order_release);
+    if (m_current) {
+        m_retired.push_back(m_current);
+    }
+    std::atomic_store(&m_current, std::move(data));
+}
+
+/**
+ * @brief BlockSection::writableData
+ *  The snapshots count as references: a count of one is this section's
+ *  alone, unless the data is interned and so may be read by intern(). The copy is published like a repack, so readers of the raw
+ *  pointer keep the shared data until reclaimRetired().
+ * @return null for a uniform section
+ */
+BlockSection::PackedData *BlockSection::writableData()
+{
+    if (m_current != nullptr && (m_current->interned || m_current.use_count() > 1)) {
+        publish(mkS<PackedData>(*m_current));
+    }
+    return m_current.get();
+}
+
+/**
+ * @brief BlockSection::repack
+ * @param bits : must leave room for every type currently in the section
+ * @return
+ */
+sPtr<BlockSection::PackedData> BlockSection::repack(unsigned int bits) const
+{
+    sPtr<PackedData> data = mkS<PackedData>(bits);
+    for (unsigned int i = 0; i < volume; i++) {
+        BlockType t = get(i);
+        int p = data->find(t);
+        if (p < 0) {
+            p = data->paletteSize;
+            data->palette[data->paletteSize++] = t;
+        }
+        data->setIndex(i, p);
+    }
+    return data;
+}
+
+/**
+ * @brief BlockSection::set
+ * @param i : localIndex of the block
+ * @param t
+ */
+void BlockSection::set(unsigned int i, BlockType t)
+{
+    PackedData *data = writableData();
+
+    if (data == nullptr) {
+        BlockType uniform = m_uniform.load(std::memory_order_relaxed);
+        if (uniform == t) {
+            return;
+        }
+        // every index is 0, i.e. the old uniform type
+        sPtr<PackedData> packed = mkS<PackedData>(1);
+        packed->palette[0] = uniform;
+        packed->palette[1] = t;
+        packed->paletteSize = 2;
+        if (uniform != EMPTY) {
+            packed->occupied.store(~0ull, std::memory_order_relaxed);
+        }
+        packed->setIndex(i, 1);
+        publish(std::move(packed));
+        return;
+    }
+
+    int p = data->find(t);
+    if (p < 0) {
+        if (data->paletteSize == data->palette.size()) {
+            // palette full: double the index width
+            publish(repack(data->bits * 2));
+            data = m_current.get();
+        }
+        p = data->paletteSize;
+        data->palette[p] = t;
+        data->paletteSize++;
+    }
+    data->setIndex(i, p);
+}
+
+void BlockSection::fill(BlockType t)
+{
+    m_uniform.store(t, std::memory_order_relaxed);
+    if (m_current) {
+        publish(nullptr);
+    }
+}
+
+/**
+ * @brief BlockSection::copyTo
+ *  Decodes word by word: an index never straddles two words, since the
+ *  index width is a power of two. In Z order, the blocks are scattered to
+ *  their localIndex.
+ * @param out : room for volume blocks
+ */
+void BlockSection::copyTo(BlockType *out) const
+{
+    const PackedData *data = m_data.load(std::memory_order_acquire);
+    if (data == nullptr) {
+        std::fill(out, out + volume, m_uniform.load(std::memory_order_relaxed));
+        return;
+    }
+    const unsigned int perWord = 64 / data->bits;
+    const uint64_t mask = (1ull << data->bits) - 1;
+    unsigned int s = 0;
+    for (const std::atomic<uint64_t> &w : data->words) {
+        uint64_t word = w.load(std::memory_order_acquire);
+        for (unsigned int k = 0; k < perWord; k++) {
+            out[storedLocalIndex(s++)] = data->palette[word & mask];
+            word >>= data->bits;
+        }
+    }
+}
+
+void BlockSection::copyRun(unsigned int begin, unsigned int count, BlockType *out) const
+{
+    const PackedData *data = m_data.load(std::memory_order_acquire);
+    if (data == nullptr) {
+        std::fill(out, out + count, m_uniform.load(std::memory_order_relaxed));
+        return;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        out[i] = data->get(begin + i);
+    }
+}
+
+/**
+ * @brief BlockSection::getOccupiedBricks
+ *  Off the writer's thread, a brick written meanwhile may read either way.
+ * @return
+ */
+uint64_t BlockSection::getOccupiedBricks() const
+{
+    const PackedData *data = m_data.load(std::memory_order_acquire);
+    if (data == nullptr) {
+        return m_uniform.load(std::memory_order_relaxed) == EMPTY ? 0 : ~0ull;
+    }
+    return data->occupied.load(std::memory_order_relaxed);
+}
+
+bool BlockSection::isUniform() const
+{
+    return m_data.load(std::memory_order_acquire) == nullptr;
+}
+
+BlockType BlockSection::getUniformType() const
+{
+    return m_uniform.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief BlockSection::compact
+ *  Generation writes types in and out of a section (e.g. stone carved to
+ *  caves), so its palette only ever grows; compact() drops what is unused.
+ */
+void BlockSection::compact()
+{
+    const PackedData *data = m_current.get();
+    if (data == nullptr) {
+        return;
+    }
+
+    std::array<bool, 256> used;
+    used.fill(false);
+    for (unsigned int i = 0; i < volume; i++) {
+        used[data->get(i)] = true;
+    }
+
+    unsigned int count = 0;
+    BlockType last = EMPTY;
+    for (unsigned int p = 0; p < data->paletteSize; p++) {
+        if (used[data->palette[p]]) {
+            count++;
+            last = data->palette[p];
+        }
+    }
+
+    if (count == 1) {
+        fill(last);
+        return;
+    }
+
+    unsigned int bits = 1;
+    while ((1u << bits) < count) {
+        bits *= 2;
+    }
+    if (bits < data->bits || count < data->paletteSize) {
+        publish(repack(bits));
+    }
+}
+
+void BlockSection::reclaimRetired()
+{
+    m_retired.clear();
+}
+
+bool BlockSection::hasRetired() const
+{
+    return !m_retired.empty();
+}
+
+/**
+ * @brief BlockSection::snapshot
+ *  The uniform type is read after the data, so a snapshot of a uniform
+ *  section taken between writes holds the type it was published with.
+ * @return
+ */
+BlockSection::Snapshot BlockSection::snapshot() const
+{
+    Snapshot snap;
+    snap.m_data = std::atomic_load(&m_current);
+    snap.m_uniform = m_uniform.load(std::memory_order_acquire);
+    return snap;
+}
+
+void BlockSection::restore(const Snapshot &snap)
+{
+    if (snap.m_data == nullptr) {
+        fill(snap.m_uniform);
+        return;
+    }
+    if (snap.m_data == m_current) {
+        return;
+    }
+    // the next write copies it (see writableData)
+    publish(std::const_pointer_cast<PackedData>(snap.m_data));
+}
+
+bool BlockSection::isShared() const
+{
+    return m_current != nullptr && m_current.use_count() > 1;
+}
+
+/**
+ * @brief BlockSection::relayout
+ *  The flat layout keeps the palette's order, so its indices are the old
+ *  ones widened.
+ * @param snap
+ * @param flat
+ * @return
+ */
+BlockSection::Snapshot BlockSection::relayout(const Snapshot &snap, bool flat)
+{
+    const PackedData *from = snap.m_data.get();
+    if (from == nullptr || (flat && from->bits == 8)) {
+        return snap;
+    }
+
+    std::array<int, 256> index;
+    index.fill(-1);
+    unsigned int used = 0;
+    if (flat) {
+        for (unsigned int p = 0; p < from->paletteSize; p++) {
+            index[from->palette[p]] = static_cast<int>(p);
+        }
+        used = from->paletteSize;
+    } else {
+        for (unsigned int i = 0; i < volume; i++) {
+            BlockType t = from->get(i);
+            if (index[t] < 0) {
+                index[t] = static_cast<int>(used++);
+            }
+        }
+    }
+
+    Snapshot relaid;
+    if (!flat && used == 1) {
+        // one type left: the section is uniform
+        relaid.m_uniform = from->get(0);
+        return relaid;
+    }
+
+    unsigned int bits = 8;
+    if (!flat) {
+        bits = 1;
+        while ((1u << bits) < used) {
+            bits *= 2;
+        }
+    }
+    sPtr<PackedData> data = mkS<PackedData>(bits);
+    for (unsigned int t = 0; t < 256; t++) {
+        if (index[t] >= 0) {
+            data->palette[index[t]] = static_cast<BlockType>(t);
+        }
+    }
+    data->paletteSize = used;
+    for (unsigned int i = 0; i < volume; i++) {
+        data->setIndex(i, static_cast<unsigned int>(index[from->get(i)]));
+    }
+
+    relaid.m_uniform = snap.m_uniform;
+    relaid.m_data = flat ? data : internTable().intern(data);
+    return relaid;
+}
+
+bool BlockSection::replace(const Snapshot &from, const Snapshot &to)
+{
+    if (from.m_data == nullptr || from.m_data != m_current || to.m_data == m_current) {
+        return false;
+    }
+    if (to.m_data == nullptr) {
+        fill(to.m_uniform);
+    } else {
+        publish(std::const_pointer_cast<PackedData>(to.m_data));
+    }
+    return true;
+}
+
+bool BlockSection::isFlat() const
+{
+    return m_current != nullptr && m_current->bits == 8;
+}
+
+/**
+ * @brief BlockSection::intern
+ *  Sections are interned once their blocks settle (see
+ *  Chunk::compactSections and Chunk::deserializeBlocks), so the generated
+ *  and stored world costs about its distinct sections; the first write
+ *  to one copies it out again.
+ */
+void BlockSection::intern()
+{
+    if (m_current == nullptr || m_current->interned) {
+        return;
+    }
+    sPtr<PackedData> shared = internTable().intern(m_current);
+    if (shared != m_current) {
+        publish(std::move(shared));
+    }
+}
+
+size_t BlockSection::getInternedCount()
+{
+    return internTable().getCount();
+}
+
+size_t BlockSection::getInternHitCount()
+{
+    return internTable().getHitCount();
+}
+
+/**
+ * @brief BlockSection::serialize
+ *  The indices are written in localIndex order, whichever order they are
+ *  stored in, so the encoding is the same in every build.
+ * @param out : the encoding is appended here
+ */
+void BlockSection::serialize(std::vector<uint8_t> &out) const
+{
+    const PackedData *data = m_current.get();
+    if (data == nullptr) {
+        out.push_back(0);
+        out.push_back(m_uniform.load(std::memory_order_relaxed));
+        return;
+    }
+
+    out.push_back(data->bits);
+    out.push_back(data->paletteSize - 1);
+    for (unsigned int p = 0; p < data->paletteSize; p++) {
+        out.push_back(data->palette[p]);
+    }
+    const unsigned int perWord = 64 / data->bits;
+    for (size_t w = 0; w < data->words.size(); w++) {
+        uint64_t value = 0;
+        if (mortonOrder) {
+            for (unsigned int k = 0; k < perWord; k++) {
+                value |= static_cast<uint64_t>(data->index(w * perWord + k)) << (k * data->bits);
+            }
+        } else {
+            value = data->words[w].load(std::memory_order_relaxed);
+        }
+        for (int b = 0; b < 8; b++) {
+            out.push_back(static_cast<uint8_t>(value >> (8 * b)));
+        }
+    }
+}
+
+/**
+ * @brief BlockSection::deserialize
+ * @param data : start of a serialize() encoding, advanced past it on success
+ * @param end
+ * @return
+ */
+bool BlockSection::deserialize(const uint8_t *&data, const uint8_t *end)
+{
+    if (end - data < 2) {
+        return false;
+    }
+    unsigned int bits = data[0];
+    if (bits == 0) {
+        fill(static_cast<BlockType>(data[1]));
+        data += 2;
+        return true;
+    }
+    if (bits != 1 && bits != 2 && bits != 4 && bits != 8) {
+        return false;
+    }
+
+    unsigned int paletteSize = data[1] + 1u;
+    sPtr<PackedData> packed = mkS<PackedData>(bits);
+    size_t wordCount = packed->words.size();
+    if (paletteSize > packed->palette.size()
+            || static_cast<size_t>(end - data) < 2 + paletteSize + 8 * wordCount) {
+        return false;
+    }
+
+    const uint8_t *p = data + 2;
+    for (unsigned int i = 0; i < paletteSize; i++) {
+        packed->palette[i] = static_cast<BlockType>(*p++);
+    }
+    packed->paletteSize = paletteSize;
+    // in localIndex order (see serialize)
+    const unsigned int perWord = 64 / bits;
+    for (size_t w = 0; w < wordCount; w++) {
+        uint64_t value = 0;
+        for (int b = 0; b < 8; b++) {
+            value |= static_cast<uint64_t>(*p++) << (8 * b);
+        }
+        if (mortonOrder) {
+            for (unsigned int k = 0; k < perWord; k++) {
+                packed->setIndex(w * perWord + k, (value >> (k * bits)) & ((1ull << bits) - 1));
+            }
+        } else {
+            packed->words[w].store(value, std::memory_order_relaxed);
+        }
+    }
+    // an index past the palette would read garbage
+    for (unsigned int i = 0; i < volume; i++) {
+        if (packed->index(i) >= paletteSize) {
+            return false;
+        }
+    }
+    packed->recountOccupied();
+
+    publish(std::move(packed));
+    data = p;
+    return true;
+}
+
+size_t BlockSection::memoryUsage() const
+{
+    const PackedData *data = m_current.get();
+    if (data == nullptr) {
+        return 0;
+    }
+    return sizeof(PackedData) + data->palette.size() * sizeof(BlockType)
+            + data->words.size() * sizeof(uint64_t);
+}
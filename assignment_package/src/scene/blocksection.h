@@ -0,0 +1,268 @@
+#pragma once
+
+#include "block.h"
+#include "memorystats.h"
+#include "smartpointerhelp.h"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The BlockSection class
+ *  Palette-compressed storage of one 16 x 16 x 16 cube of a Chunk.
+ *  A uniform section is a single BlockType; otherwise every block is a
+ *  bits-wide index (1, 2, 4 or 8 bits, so no index straddles a word)
+ *  into a palette of the types the section holds.
+ *
+ *  Reads are lock-free and may run concurrently with one writer: the
+ *  packed data is replaced, never resized, when the palette outgrows it,
+ *  and the replaced data is kept until reclaimRetired(), which the owner
+ *  must only call when no reader can still hold it. A palette entry is
+ *  written before the first index naming it is stored (release), so a
+ *  reader that loads the index (acquire) sees the entry.
+ *  Each read sees every block as it was before or after a write, never a
+ *  mix; a consistent view of many blocks is the owner's job (see Chunk).
+ *  Writes must not race each other.
+ *
+ *  The packed data is reference counted and copied on write: a Snapshot
+ *  shares it, and the section's next write to data a snapshot still holds
+ *  goes to a copy. A snapshot is one pointer copy, and only the sections
+ *  written after it cost their data twice.
+ *
+ *  Packed data can be interned (intern()): sections with bit-identical
+ *  blocks, wherever in the world, then share one instance. Interned data
+ *  is never written in place, even when only one section holds it, since
+ *  another thread may be comparing it. (Uniform sections, all stone or
+ *  all air, hold no data to share.)
+ *
+ *  The blocks are addressed by localIndex everywhere outside the class,
+ *  whatever order the packed data keeps them in: built with
+ *  MINIMINECRAFT_MORTON_SECTIONS (CONFIG += morton_sections), the indices
+ *  are stored in Z order, so the blocks near one another in any direction
+ *  share a word or a cache line. copyTo, copyRun and serialize still
+ *  produce localIndex order.
+ *
+ *  Each section keeps an occupancy mask of its 4 x 4 x 4 bricks (see
+ *  getOccupiedBricks), so ray marches can step over empty space a brick
+ *  or a section at a time. A brick's bit is set before a block other than
+ *  EMPTY is stored in it, and only cleared when the data is rebuilt
+ *  (compact(), relayout(), deserialize()): a set bit means the brick may
+ *  hold a block, a clear one that it holds none.
+ */
+class BlockSection
+{
+public:
+    static const int size   = 16;
+    static const int volume = size * size * size;
+
+    // index of the local (x, y, z) in the section, y fastest
+    static unsigned int localIndex(unsigned int x, unsigned int y, unsigned int z) {
+        return y + size * (x + size * z);
+    }
+
+    // the side of a brick, and the bricks of a section
+    static const int brickSize = 4;
+    static const int brickCount = (size / brickSize) * (size / brickSize) * (size / brickSize);
+
+    // bit of the brick holding the block at localIndex i in the occupancy
+    // mask, y fastest like localIndex
+    static unsigned int brickIndex(unsigned int i) {
+        return ((i >> 2) & 3) | (((i >> 6) & 3) << 2) | (((i >> 10) & 3) << 4);
+    }
+
+#ifdef MINIMINECRAFT_MORTON_SECTIONS
+    static const bool mortonOrder = true;
+#else
+    static const bool mortonOrder = false;
+#endif
+
+private:
+    // bit b of a 4 bit coordinate to bit 3b
+    static unsigned int spreadBits(unsigned int v) {
+        return (v & 1) | ((v & 2) << 2) | ((v & 4) << 4) | ((v & 8) << 6);
+    }
+    static unsigned int compactBits(unsigned int v) {
+        return (v & 1) | ((v >> 2) & 2) | ((v >> 4) & 4) | ((v >> 6) & 8);
+    }
+    // where the packed data keeps the block at localIndex i, y in the
+    // lowest bit of each Morton triple
+    static unsigned int storageIndex(unsigned int i) {
+        if (!mortonOrder) {
+            return i;
+        }
+        return spreadBits(i & 15) | (spreadBits((i >> 4) & 15) << 1) | (spreadBits(i >> 8) << 2);
+    }
+    // the inverse: localIndex of the block stored at s
+    static unsigned int storedLocalIndex(unsigned int s) {
+        if (!mortonOrder) {
+            return s;
+        }
+        return compactBits(s) | (compactBits(s >> 1) << 4) | (compactBits(s >> 2) << 8);
+    }
+
+    struct PackedData
+    {
+        unsigned int bits;
+        // the palette holds (1 << bits) entries, paletteSize of them used
+        unsigned int paletteSize;
+        TrackedVector<BlockType, MemoryCategory::blocks> palette;
+        TrackedVector<std::atomic<uint64_t>, MemoryCategory::blocks> words;
+        // bit brickIndex: the brick may hold a block other than EMPTY
+        std::atomic<uint64_t> occupied;
+        // in the intern table: immutable from then on
+        bool interned;
+
+        explicit PackedData(unsigned int bits);
+        PackedData(const PackedData &other);
+
+        // i is a localIndex; the index is at storageIndex(i)
+        BlockType get(unsigned int i) const {
+            unsigned int bit = storageIndex(i) * bits;
+            // acquire: pairs with setIndex, so a new palette entry is visible
+            uint64_t word = words[bit >> 6].load(std::memory_order_acquire);
+            return palette[(word >> (bit & 63)) & ((1ull << bits) - 1)];
+        }
+        void setIndex(unsigned int i, unsigned int paletteIndex);
+        // set the occupancy from the indices alone
+        void recountOccupied();
+        // the palette index of the block at localIndex i
+        unsigned int index(unsigned int i) const {
+            unsigned int bit = storageIndex(i) * bits;
+            return (words[bit >> 6].load(std::memory_order_relaxed) >> (bit & 63)) & ((1ull << bits) - 1);
+        }
+        // palette index of t, or -1
+        int find(BlockType t) const;
+        // of the used palette entries and the indices
+        uint64_t hash() const;
+        bool sameBlocks(const PackedData &other) const;
+    };
+    class InternTable;
+    static InternTable &internTable();
+
+    // null while the section is uniform
+    std::atomic<PackedData*> m_data;
+    std::atomic<BlockType> m_uniform;
+
+    // data replaced while readers may hold it
+    std::vector<sPtr<PackedData>> m_retired;
+    // the current data, shared with the snapshots taken since it was
+    // published; replaced with std::atomic_store, so snapshot() can load
+    // it off the writer's thread
+    sPtr<PackedData> m_current;
+
+    void publish(sPtr<PackedData> data);
+    // copy of the section's blocks in a palette of the given width
+    sPtr<PackedData> repack(unsigned int bits) const;
+    // the current data, copied first if a snapshot shares it or it is interned
+    PackedData *writableData();
+
+public:
+    /**
+     * @brief The Snapshot class
+     *  The blocks of a section as they were when it was taken; never
+     *  changes, whatever is written to the section after.
+     */
+    class Snapshot
+    {
+    private:
+        friend class BlockSection;
+        // null for a uniform section
+        sPtr<const PackedData> m_data;
+        BlockType m_uniform;
+
+    public:
+        Snapshot();
+
+        BlockType get(unsigned int i) const {
+            return m_data == nullptr ? m_uniform : m_data->get(i);
+        }
+        // write all volume blocks, in localIndex order, to out
+        void copyTo(BlockType *out) const;
+        bool isUniform() const;
+    };
+
+    BlockSection();
+    explicit BlockSection(BlockType fill);
+
+    BlockSection(const BlockSection&) = delete;
+    BlockSection &operator=(const BlockSection&) = delete;
+
+    BlockType get(unsigned int i) const {
+        const PackedData *data = m_data.load(std::memory_order_acquire);
+        return data == nullptr ? m_uniform.load(std::memory_order_relaxed) : data->get(i);
+    }
+    void set(unsigned int i, BlockType t);
+    // set every block of the section to t
+    void fill(BlockType t);
+
+    // call f(t) for every type the palette holds (a superset of the
+    // types in use until the section is compacted)
+    template <typename F>
+    void forEachType(F f) const {
+        const PackedData *data = m_data.load(std::memory_order_acquire);
+        if (data == nullptr) {
+            f(m_uniform.load(std::memory_order_relaxed));
+            return;
+        }
+        for (unsigned int p = 0; p < data->paletteSize; p++) {
+            f(data->palette[p]);
+        }
+    }
+
+    // write all volume blocks, in localIndex order, to out
+    void copyTo(BlockType *out) const;
+    // write the count blocks from localIndex begin on to out
+    void copyRun(unsigned int begin, unsigned int count, BlockType *out) const;
+
+    bool isUniform() const;
+    // the single type of a uniform section
+    BlockType getUniformType() const;
+
+    // bit brickIndex(i): the brick of block i may hold a block other
+    // than EMPTY; 0 for a section of EMPTY only
+    uint64_t getOccupiedBricks() const;
+
+    // Shrink the palette to the types still in use and collapse the
+    // section to one value if it holds only one type
+    void compact();
+    // free the data replaced by set() / compact(); no reader may be active
+    void reclaimRetired();
+    bool hasRetired() const;
+
+    // Share the current blocks. Off the writer's thread, the snapshot is
+    // only whole if no write ran meanwhile (see Chunk::snapshotBlocks)
+    Snapshot snapshot() const;
+    // Make the section hold the snapshot's blocks again, sharing its data
+    void restore(const Snapshot &snap);
+    // whether a snapshot or another section shares the current data
+    bool isShared() const;
+
+    // The snapshot's blocks laid out flat, one byte per index (no palette
+    // growth, and reads of whole bytes), or packed in the fewest bits and
+    // interned; built from the snapshot alone, so on any thread. A
+    // uniform snapshot stays as it is
+    static Snapshot relayout(const Snapshot &snap, bool flat);
+    // Hold `to`'s data (the same blocks) if the section still holds
+    // `from`'s, i.e. nothing was written since `from` was taken; a write,
+    // as set() is
+    bool replace(const Snapshot &from, const Snapshot &to);
+    // whether the data is laid out flat
+    bool isFlat() const;
+
+    // Share the current data with the sections holding the same blocks,
+    // through a table of every interned data alive; a write, as set() is
+    void intern();
+    // the interned data alive, and the intern() calls that found a match
+    static size_t getInternedCount();
+    static size_t getInternHitCount();
+
+    // heap bytes used by the current data, shared or not
+    size_t memoryUsage() const;
+
+    // Append the section in its palette encoding:
+    // uniform: [0, type]; packed: [bits, paletteSize - 1, palette..., words (little endian)]
+    void serialize(std::vector<uint8_t> &out) const;
+    // Replace the section by one read at `data`, which is advanced past it.
+    // Returns false, leaving the section unchanged, if the encoding is malformed.
+    bool deserialize(const uint8_t *&data, const uint8_t *end);
+};
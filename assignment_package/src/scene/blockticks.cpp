@@ -0,0 +1,266 @@
+#include "blockticks.h"
+#include "terrain.h"
+#include <algorithm>
+
+static const float tickSeconds = 1.f / BlockTicks::ticksPerSecond;
+
+static const glm::ivec3 neighborOffsets[6] = {
+    glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1),
+    glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0)
+};
+
+BlockTicks::BlockTicks(uint64_t seed)
+    : m_scheduled(), m_random(seed), m_accumulator(0.f), m_tick(0), m_randomCursor(0),
+      m_lastScheduledRun(0), m_lastRandomTicks(0), m_lastFallenColumns(0), m_lastOverBudget(false)
+{}
+
+uint16_t BlockTicks::toLocalIndex(glm::ivec3 pos)
+{
+    return static_cast<uint16_t>((pos.y << 8) | ((pos.z & 15) << 4) | (pos.x & 15));
+}
+
+void BlockTicks::schedule(glm::ivec3 pos, int delayTicks)
+{
+    if (pos.y < 0 || pos.y >= 256) {
+        return;
+    }
+    m_scheduled[toKey(pos.x & ~15, pos.z & ~15)].push(
+                ScheduledUpdate{m_tick + static_cast<uint64_t>(std::max(delayTicks, 1)), toLocalIndex(pos)});
+}
+
+void BlockTicks::noteEdit(glm::ivec3 pos)
+{
+    schedule(pos, editDelay);
+    schedule(pos + glm::ivec3(0, 1, 0), editDelay);
+}
+
+void BlockTicks::dropChunk(int xCorner, int zCorner)
+{
+    m_scheduled.erase(toKey(xCorner, zCorner));
+}
+
+/**
+ * @brief BlockTicks::update
+ *  Scheduled updates go first in every tick: they follow the player's
+ *  edits, where the random ticks only keep the world slowly changing.
+ * @param terrain
+ * @param dT
+ * @param viewer
+ */
+void BlockTicks::update(Terrain &terrain, float dT, glm::vec3 viewer)
+{
+    m_accumulator = std::min(m_accumulator + dT, maxTicksPerUpdate * tickSeconds);
+    if (m_accumulator < tickSeconds) {
+        return;
+    }
+    QElapsedTimer timer;
+    timer.start();
+    qint64 budgetNs = budgetMicros * 1000;
+    m_lastScheduledRun = 0;
+    m_lastRandomTicks = 0;
+    m_lastFallenColumns = 0;
+    m_lastOverBudget = false;
+
+    terrain.beginEdit();
+    while (m_accumulator >= tickSeconds) {
+        m_accumulator -= tickSeconds;
+        m_tick++;
+        if (!runScheduled(terrain, budgetNs, timer)
+                || !runRandomTicks(terrain, viewer, budgetNs, timer)) {
+            m_lastOverBudget = true;
+            break;
+        }
+    }
+    terrain.commitEdit();
+}
+
+/**
+ * @brief BlockTicks::runScheduled
+ *  The queues are looked up again after every update, since the edits it
+ *  makes schedule more (never for this tick) and may add queues.
+ */
+bool BlockTicks::runScheduled(Terrain &terrain, qint64 budgetNs, const QElapsedTimer &timer)
+{
+    std::vector<int64_t> keys;
+    keys.reserve(m_scheduled.size());
+    for (const std::pair<const int64_t, UpdateQueue> &queue : m_scheduled) {
+        keys.push_back(queue.first);
+    }
+    for (int64_t key : keys) {
+        glm::ivec2 corner = toCoords(key);
+        while (true) {
+            auto queue = m_scheduled.find(key);
+            if (queue == m_scheduled.end()) {
+                break;
+            }
+            if (queue->second.empty()) {
+                m_scheduled.erase(queue);
+                break;
+            }
+            if (queue->second.top().due > m_tick) {
+                break;
+            }
+            if (timer.nsecsElapsed() >= budgetNs) {
+                return false;
+            }
+            uint16_t index = queue->second.top().index;
+            queue->second.pop();
+            updateScheduled(terrain, glm::ivec3(corner[0] + (index & 15), index >> 8, corner[1] + ((index >> 4) & 15)));
+            m_lastScheduledRun++;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief BlockTicks::runRandomTicks
+ *  Goes through the decorated chunks of the square around the viewer's,
+ *  from m_randomCursor on, so the chunks a spent budget leaves out are the
+ *  first ones next time.
+ */
+bool BlockTicks::runRandomTicks(Terrain &terrain, glm::vec3 viewer, qint64 budgetNs, const QElapsedTimer &timer)
+{
+    int side = 2 * randomTickRadius + 1;
+    int count = side * side;
+    int viewerX = static_cast<int>(glm::floor(viewer.x / 16.f)) - randomTickRadius;
+    int viewerZ = static_cast<int>(glm::floor(viewer.z / 16.f)) - randomTickRadius;
+    for (int i = 0; i < count; i++) {
+        int square = (m_randomCursor + i) % count;
+        if (timer.nsecsElapsed() >= budgetNs) {
+            m_randomCursor = square;
+            return false;
+        }
+        int x = 16 * (viewerX + square % side);
+        int z = 16 * (viewerZ + square / side);
+        const Chunk *chunk = terrain.findChunk(x, z);
+        if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+            continue;
+        }
+        for (int sy = 0; sy < 16; sy++) {
+            if (!chunk->anySectionType(sy, Block::hasRandomTicks)) {
+                continue;
+            }
+            for (int k = 0; k < randomTicksPerSection; k++) {
+                uint64_t r = m_random.nextUInt();
+                int localX = r & 15, localY = (r >> 4) & 15, localZ = (r >> 8) & 15;
+                BlockType type = chunk->getBlockAt(localX, sy * 16 + localY, localZ);
+                m_lastRandomTicks++;
+                if (Block::hasRandomTicks(type)) {
+                    randomTick(terrain, glm::ivec3(x + localX, sy * 16 + localY, z + localZ), type);
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// what a falling block drops through; blocks of missing chunks hold it
+static bool isGap(std::optional<BlockType> type)
+{
+    return type && (*type == EMPTY || Block::isLiquid(*type));
+}
+
+/**
+ * @brief BlockTicks::updateScheduled
+ *  Only the bottom of a column has the gap under it; the blocks above it
+ *  are scheduled too (by the edit that opened the gap and by the drop)
+ *  but find a falling block below and do nothing.
+ */
+void BlockTicks::updateScheduled(Terrain &terrain, glm::ivec3 pos)
+{
+    std::optional<BlockType> type = terrain.tryGetBlockAt(pos.x, pos.y, pos.z);
+    if (type && Block::falls(*type) && pos.y > 0 && isGap(terrain.tryGetBlockAt(pos.x, pos.y - 1, pos.z))) {
+        dropColumn(terrain, pos);
+    }
+}
+
+/**
+ * @brief BlockTicks::dropColumn
+ *  The blocks from the landing place up to the column's top are written as
+ *  one region: the column at the bottom, EMPTY above it. The liquid the
+ *  column falls through is displaced, as a block placed in it would be.
+ *  The writes schedule the column's blocks again, which then stand.
+ */
+void BlockTicks::dropColumn(Terrain &terrain, glm::ivec3 pos)
+{
+    int landing = pos.y - 1;
+    while (landing > 0 && isGap(terrain.tryGetBlockAt(pos.x, landing - 1, pos.z))) {
+        landing--;
+    }
+    std::vector<BlockType> column;
+    for (int y = pos.y; y < 256; y++) {
+        std::optional<BlockType> type = terrain.tryGetBlockAt(pos.x, y, pos.z);
+        if (!type || !Block::falls(*type)) {
+            break;
+        }
+        column.push_back(*type);
+    }
+    int top = pos.y + static_cast<int>(column.size()) - 1;
+
+    BlockRegion region{glm::ivec3(pos.x, landing, pos.z), glm::ivec3(pos.x, top, pos.z)};
+    std::vector<BlockType> blocks(region.volume(), EMPTY);
+    std::copy(column.begin(), column.end(), blocks.begin());
+    terrain.writeRegion(region, blocks.data());
+    m_lastFallenColumns++;
+}
+
+/**
+ * @brief BlockTicks::randomTick
+ *  Blocks in missing chunks count as unknown: nothing changes next to them.
+ */
+void BlockTicks::randomTick(Terrain &terrain, glm::ivec3 pos, BlockType type)
+{
+    if (type == GRASS) {
+        std::optional<BlockType> above = terrain.tryGetBlockAt(pos.x, pos.y + 1, pos.z);
+        if (above && Block::isOpaque(*above)) {
+            terrain.placeBlockAt(pos.x, pos.y, pos.z, DIRT);
+            return;
+        }
+        // spread to a dirt block around it, one up or down, with air above
+        uint64_t r = m_random.nextUInt();
+        glm::ivec3 target = pos + glm::ivec3(static_cast<int>(r % 3) - 1, static_cast<int>(r / 3 % 3) - 1,
+                                             static_cast<int>(r / 9 % 3) - 1);
+        if (terrain.tryGetBlockAt(target.x, target.y, target.z) == std::optional<BlockType>(DIRT)
+                && terrain.tryGetBlockAt(target.x, target.y + 1, target.z) == std::optional<BlockType>(EMPTY)) {
+            terrain.placeBlockAt(target.x, target.y, target.z, GRASS);
+        }
+        return;
+    }
+    // ICE and SNOW
+    for (const glm::ivec3 &offset : neighborOffsets) {
+        glm::ivec3 neighbor = pos + offset;
+        if (terrain.tryGetBlockAt(neighbor.x, neighbor.y, neighbor.z) == std::optional<BlockType>(LAVA)) {
+            terrain.placeBlockAt(pos.x, pos.y, pos.z, type == ICE ? WATER : EMPTY);
+            return;
+        }
+    }
+}
+
+size_t BlockTicks::getScheduledCount() const
+{
+    size_t count = 0;
+    for (const std::pair<const int64_t, UpdateQueue> &queue : m_scheduled) {
+        count += queue.second.size();
+    }
+    return count;
+}
+
+size_t BlockTicks::getLastScheduledRunCount() const
+{
+    return m_lastScheduledRun;
+}
+
+size_t BlockTicks::getLastRandomTickCount() const
+{
+    return m_lastRandomTicks;
+}
+
+size_t BlockTicks::getLastFallenColumnCount() const
+{
+    return m_lastFallenColumns;
+}
+
+bool BlockTicks::wasLastOverBudget() const
+{
+    return m_lastOverBudget;
+}
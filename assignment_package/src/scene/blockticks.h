@@ -0,0 +1,108 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include "random.h"
+#include <QElapsedTimer>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <unordered_map>
+#include <vector>
+
+class Terrain;
+
+/**
+ * @brief The BlockTicks class
+ *  The blocks that change on their own, in game ticks of a fixed rate.
+ *  Scheduled updates are due at a given tick, in a priority queue per
+ *  chunk: every edit schedules its block and the one above it a few ticks
+ *  later, which is how a block that lost its support finds out. Falling
+ *  blocks (Block::falls) drop as whole columns: the run of them over the
+ *  gap moves down to where it lands in one write of the column, so a
+ *  column costs one remesh of the sections it spans rather than one per
+ *  block and tick of the fall. Random ticks sample a
+ *  few blocks of every section near the viewer each tick, skipping the
+ *  sections whose palette holds no randomTickBlockTypes: GRASS spreads to
+ *  dirt in the open and dies under opaque blocks, ICE and SNOW melt next
+ *  to LAVA.
+ *  An update's ticks are one Terrain edit batch, so the sections they
+ *  change are only marked dirty and each chunk is remeshed once. The
+ *  ticks stop for the update once its CPU budget is spent: the due
+ *  scheduled updates wait in their queues, and the random ticks resume at
+ *  the chunk they stopped at. Main thread only; Terrain owns it and
+ *  reports its edits.
+ */
+class BlockTicks
+{
+public:
+    static const int ticksPerSecond = 20;
+    // ticks run per update at most: a longer frame loses the rest
+    static const int maxTicksPerUpdate = 4;
+    // the CPU time an update may take, in microseconds
+    static const int budgetMicros = 1000;
+    // blocks sampled per section per tick
+    static const int randomTicksPerSection = 3;
+    // chunks around the viewer's whose sections get random ticks, per side
+    static const int randomTickRadius = 4;
+    // the ticks an edit waits before the blocks it touches update
+    static const int editDelay = 2;
+
+private:
+    struct ScheduledUpdate
+    {
+        uint64_t due;
+        // the block's local index (see toLocalIndex)
+        uint16_t index;
+
+        bool operator>(const ScheduledUpdate &other) const {
+            return due > other.due;
+        }
+    };
+    // soonest first
+    using UpdateQueue = std::priority_queue<ScheduledUpdate, std::vector<ScheduledUpdate>,
+                                            std::greater<ScheduledUpdate>>;
+    // by toKey of the chunk's corner
+    std::unordered_map<int64_t, UpdateQueue> m_scheduled;
+    Random m_random;
+    float m_accumulator;
+    uint64_t m_tick;
+    // the chunk of the viewer's square the next random ticks start at
+    int m_randomCursor;
+    size_t m_lastScheduledRun;
+    size_t m_lastRandomTicks;
+    size_t m_lastFallenColumns;
+    bool m_lastOverBudget;
+
+    static uint16_t toLocalIndex(glm::ivec3 pos);
+    // run the scheduled updates due by m_tick; false if the budget ran out
+    bool runScheduled(Terrain &terrain, qint64 budgetNs, const QElapsedTimer &timer);
+    bool runRandomTicks(Terrain &terrain, glm::vec3 viewer, qint64 budgetNs, const QElapsedTimer &timer);
+    void updateScheduled(Terrain &terrain, glm::ivec3 pos);
+    // drop the column of falling blocks whose bottom is pos onto what is
+    // below the gap under it
+    void dropColumn(Terrain &terrain, glm::ivec3 pos);
+    void randomTick(Terrain &terrain, glm::ivec3 pos, BlockType type);
+
+public:
+    explicit BlockTicks(uint64_t seed);
+
+    // update the block at pos delayTicks ticks from now
+    void schedule(glm::ivec3 pos, int delayTicks);
+    // A block was set at pos: it and the block above it update soon
+    void noteEdit(glm::ivec3 pos);
+    // forget the chunk's scheduled updates (it is evicted)
+    void dropChunk(int xCorner, int zCorner);
+
+    // Run the ticks due after dT seconds, writing through terrain's
+    // placeBlockAt in one batch; the random ticks go around viewer
+    void update(Terrain &terrain, float dT, glm::vec3 viewer);
+
+    size_t getScheduledCount() const;
+    // what the last update that ran a tick did
+    size_t getLastScheduledRunCount() const;
+    size_t getLastRandomTickCount() const;
+    size_t getLastFallenColumnCount() const;
+    bool wasLastOverBudget() const;
+};
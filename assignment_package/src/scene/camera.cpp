@@ -1,13 +1,15 @@
 #include "camera.h"
 #include "glm_includes.h"
 
+bool Camera::s_reverseZ = false;
+
 Camera::Camera(glm::vec3 pos)
     : Camera(400, 400, pos)
 {}
 
 Camera::Camera(unsigned int w, unsigned int h, glm::vec3 pos)
     : Entity(pos), m_fovy(45), m_width(w), m_height(h),
-      m_near_clip(0.1f), m_far_clip(1000.f), m_aspect(w / static_cast<float>(h))
+      m_near_clip(0.1f), m_far_clip(1000.f), m_aspect(w / static_cast<float>(h)), m_jitter(0.f)
 {}
 
 Camera::Camera(const Camera &c)
@@ -17,7 +19,8 @@ Camera::Camera(const Camera &c)
       m_height(c.m_height),
       m_near_clip(c.m_near_clip),
       m_far_clip(c.m_far_clip),
-      m_aspect(c.m_aspect)
+      m_aspect(c.m_aspect),
+      m_jitter(c.m_jitter)
 {}
 
 
@@ -32,8 +35,38 @@ void Camera::tick(float dT, InputBundle &input) {
     // Do nothing
 }
 
+void Camera::setJitter(glm::vec2 offset) {
+    m_jitter = offset;
+}
+
+void Camera::setReverseZ(bool reversed) {
+    s_reverseZ = reversed;
+}
+
+/**
+ * @brief Camera::getViewProj
+ *  Reversed, the depth is near / distance with no far plane: a float depth
+ *  buffer keeps about the same relative precision all the way out, where
+ *  the usual one spends it on the first few blocks.
+ * @return
+ */
 glm::mat4 Camera::getViewProj() const {
-    return glm::perspective(glm::radians(m_fovy), m_aspect, m_near_clip, m_far_clip) * glm::lookAt(m_position, m_position + m_forward, m_up);
+    // x += offset.x * w, so the shift is the same on screen at any depth
+    glm::mat4 jitter(1.f);
+    jitter[3][0] = m_jitter.x;
+    jitter[3][1] = m_jitter.y;
+    glm::mat4 proj;
+    if (s_reverseZ) {
+        float focal = 1.f / glm::tan(glm::radians(m_fovy) * 0.5f);
+        proj = glm::mat4(0.f);
+        proj[0][0] = focal / m_aspect;
+        proj[1][1] = focal;
+        proj[2][3] = -1.f;
+        proj[3][2] = m_near_clip;
+    } else {
+        proj = glm::perspective(glm::radians(m_fovy), m_aspect, m_near_clip, m_far_clip);
+    }
+    return jitter * proj * glm::lookAt(m_position, m_position + m_forward, m_up);
 }
 
 glm::vec3 Camera::getForward() {
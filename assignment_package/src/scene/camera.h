@@ -11,6 +11,8 @@ private:
     float m_near_clip;  // Near clip plane distance
     float m_far_clip;  // Far clip plane distance
     float m_aspect;    // Aspect ratio
+    glm::vec2 m_jitter; // Shifts the projection this far in clip space (see setJitter)
+    static bool s_reverseZ; // getViewProj projects to reversed depth (see setReverseZ)
 
 public:
     Camera(glm::vec3 pos);
@@ -20,7 +22,15 @@ public:
 
     void tick(float dT, InputBundle &input) override;
 
+    // Shift what getViewProj projects by offset in clip space (2 / the
+    // target's pixels is one pixel), for TemporalUpsampler to sample
+    // another spot of each pixel every frame; 0 for none
+    void setJitter(glm::vec2 offset);
     glm::mat4 getViewProj() const;
+    // Whether every camera projects to reversed depth, 1 at the near plane
+    // to 0 at infinity, for a clip space depth of 0 to 1 (glClipControl);
+    // otherwise -1 to 1 from the near to the far plane
+    static void setReverseZ(bool reversed);
 
     // get current camera orientation
     glm::vec3 getForward();
@@ -1,235 +1,1787 @@
 #include "chunk.h"
+#include "meshcache.h"
+#include "random.h"
+#include <QThread>
+#include <QtAlgorithms>
+#include <algorithm>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
 
 
 
-Chunk::Chunk(OpenGLContext *context)
-    : Drawable(context),
-      m_blocks(),
-      m_neighbors{{XPOS, nullptr}, {XNEG, nullptr}, {ZPOS, nullptr}, {ZNEG, nullptr}},
-      vboLoaded(false)
+Chunk::Chunk(int xCorner, int zCorner)
+    : m_sections(), m_pinCount(0), m_writeSequence(0),
+      m_sectionMeshes(), m_dirtySections(0xFFFF), m_changedSections(0),
+      m_skyTops(), m_lightValid(false), m_meshVersion(0), m_meshLock(),
+      m_columnTops(), m_opaqueTops(), m_occupiedTop(0), m_occupiedBottom(256),
+      m_neighbors{nullptr, nullptr, nullptr, nullptr},
+      m_xCorner(xCorner), m_zCorner(zCorner),
+      m_generationStage(GenerationStage::none),
+      m_modified(false), m_navigation()
+{}
+
+/**
+ * @brief Chunk::reset
+ *  Only what the last corner left behind is cleared: the sections holding
+ *  blocks are emptied, the cached faces keep their capacity, and the
+ *  navigation layer is marked unbuilt rather than zeroed (the rebuild on
+ *  decoration overwrites all of it).
+ * @param xCorner
+ * @param zCorner
+ */
+void Chunk::reset(int xCorner, int zCorner)
+{
+    for (BlockSection &section : m_sections) {
+        if (!section.isUniform() || section.getUniformType() != EMPTY) {
+            section.fill(EMPTY);
+        }
+        section.reclaimRetired();
+    }
+    for (SectionMesh &mesh : m_sectionMeshes) {
+        mesh.opaqueFaces.clear();
+        mesh.transparentFaces.clear();
+        mesh.connectivity = 0;
+        mesh.lights.clear();
+    }
+    m_dirtySections.store(0xFFFF);
+    m_changedSections.store(0);
+    m_lightValid = false;
+    for (int column = 0; column < 256; column++) {
+        m_columnTops[column].store(0, std::memory_order_relaxed);
+        m_opaqueTops[column].store(0, std::memory_order_relaxed);
+    }
+    m_occupiedTop.store(0);
+    m_occupiedBottom.store(256);
+    m_xCorner = xCorner;
+    m_zCorner = zCorner;
+    m_navigation.clear();
+    m_generationStage.store(GenerationStage::none);
+    m_modified = false;
+}
+
+glm::ivec2 Chunk::getCorner() const
+{
+    return glm::ivec2(m_xCorner, m_zCorner);
+}
+
+GenerationStage Chunk::getGenerationStage() const
+{
+    return m_generationStage.load();
+}
+
+/**
+ * @brief Chunk::setGenerationStage
+ *  Reaching decorated, the blocks are settled enough to navigate.
+ * @param stage
+ */
+void Chunk::setGenerationStage(GenerationStage stage)
+{
+    if (stage == GenerationStage::decorated) {
+        m_navigation.rebuild(*this);
+    } else {
+        m_navigation.clear();
+    }
+    m_generationStage.store(stage);
+}
+
+
+// Does bounds checking
+BlockType Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
+    if (x >= 16 || y >= 256 || z >= 16) {
+        throw std::out_of_range("Chunk::getBlockAt (" + std::to_string(x) + ", " + std::to_string(y)
+                                + ", " + std::to_string(z) + ") is out of the chunk");
+    }
+    return getBlockAtUnchecked(x, y, z);
+}
+
+// Exists to get rid of compiler warnings about int -> unsigned int implicit conversion
+BlockType Chunk::getBlockAt(int x, int y, int z) const {
+    return getBlockAt(static_cast<unsigned int>(x), static_cast<unsigned int>(y), static_cast<unsigned int>(z));
+}
+
+// Does bounds checking
+void Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
+    if (x >= 16 || y >= 256 || z >= 16) {
+        throw std::out_of_range("Chunk::setBlockAt (" + std::to_string(x) + ", " + std::to_string(y)
+                                + ", " + std::to_string(z) + ") is out of the chunk");
+    }
+    setBlockAtUnchecked(x, y, z, t);
+    m_navigation.update(x, y, z, t);
+}
+
+/**
+ * @brief Chunk::lowerColumnTops
+ *  Only down from the old top, so clearing a column from the top costs a
+ *  block per write.
+ * @param x
+ * @param z
+ */
+void Chunk::lowerColumnTops(unsigned int x, unsigned int z) {
+    unsigned int column = x + 16 * z;
+    int oldTop = m_columnTops[column].load(std::memory_order_relaxed);
+    int top = 0, opaqueTop = 0;
+    for (int y = oldTop - 1; y >= 0 && opaqueTop == 0; y--) {
+        BlockType t = getBlockAtUnchecked(x, static_cast<unsigned int>(y), z);
+        if (top == 0 && !Block::isEmpty(t)) {
+            top = y + 1;
+        }
+        if (Block::isOpaque(t)) {
+            opaqueTop = y + 1;
+        }
+    }
+    m_columnTops[column].store(static_cast<uint16_t>(top), std::memory_order_relaxed);
+    m_opaqueTops[column].store(static_cast<uint16_t>(opaqueTop), std::memory_order_relaxed);
+    if (top < oldTop && oldTop == m_occupiedTop.load(std::memory_order_relaxed)) {
+        int occupiedTop = 0;
+        for (const std::atomic<uint16_t> &columnTop : m_columnTops) {
+            occupiedTop = std::max<int>(occupiedTop, columnTop.load(std::memory_order_relaxed));
+        }
+        m_occupiedTop.store(occupiedTop, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief Chunk::recomputeHeights
+ *  Empty sections are skipped whole, from the top down.
+ */
+void Chunk::recomputeHeights() {
+    std::array<bool, 16> allEmpty, hasOpaque;
+    int bottom = 256;
+    for (int sy = 0; sy < 16; sy++) {
+        SectionFlags flags = getSectionFlags(sy);
+        allEmpty[sy] = flags.allEmpty;
+        hasOpaque[sy] = flags.hasOpaque;
+        if (!flags.allEmpty && bottom == 256) {
+            bottom = sy * 16;
+        }
+    }
+    int occupiedTop = 0;
+    for (unsigned int z = 0; z < 16; z++) {
+        for (unsigned int x = 0; x < 16; x++) {
+            int top = 0, opaqueTop = 0;
+            for (int sy = 15; sy >= 0 && opaqueTop == 0; sy--) {
+                if (allEmpty[sy] || (top != 0 && !hasOpaque[sy])) {
+                    continue;
+                }
+                for (int y = sy * 16 + 15; y >= sy * 16 && opaqueTop == 0; y--) {
+                    BlockType t = getBlockAtUnchecked(x, static_cast<unsigned int>(y), z);
+                    if (top == 0 && !Block::isEmpty(t)) {
+                        top = y + 1;
+                    }
+                    if (Block::isOpaque(t)) {
+                        opaqueTop = y + 1;
+                    }
+                }
+            }
+            m_columnTops[x + 16 * z].store(static_cast<uint16_t>(top), std::memory_order_relaxed);
+            m_opaqueTops[x + 16 * z].store(static_cast<uint16_t>(opaqueTop), std::memory_order_relaxed);
+            occupiedTop = std::max(occupiedTop, top);
+        }
+    }
+    m_occupiedTop.store(occupiedTop);
+    m_occupiedBottom.store(bottom);
+}
+
+/**
+ * @brief Chunk::fillColumn
+ *  Bulk version of setBlockAt for a vertical span, bounds checked once.
+ * @param x
+ * @param z
+ * @param yBegin : first y (inclusive)
+ * @param yEnd   : last y (exclusive)
+ * @param t
+ */
+void Chunk::fillColumn(unsigned int x, unsigned int z, unsigned int yBegin, unsigned int yEnd, BlockType t) {
+    if (yBegin >= yEnd) {
+        return;
+    }
+    if (x >= 16 || z >= 16 || yEnd > 256) {
+        throw std::out_of_range("Chunk::fillColumn span (" + std::to_string(x) + ", ["
+                                + std::to_string(yBegin) + ", " + std::to_string(yEnd) + "), "
+                                + std::to_string(z) + ") is out of the chunk");
+    }
+    for (unsigned int y = yBegin; y < yEnd; y++) {
+        setBlockAtUnchecked(x, y, z, t);
+    }
+}
+
+void Chunk::copyColumn(unsigned int x, unsigned int z, unsigned int yBegin, unsigned int yEnd, BlockType *out) const {
+    if (yBegin >= yEnd) {
+        return;
+    }
+    if (x >= 16 || z >= 16 || yEnd > 256) {
+        throw std::out_of_range("Chunk::copyColumn span (" + std::to_string(x) + ", ["
+                                + std::to_string(yBegin) + ", " + std::to_string(yEnd) + "), "
+                                + std::to_string(z) + ") is out of the chunk");
+    }
+    // a run per section: its column is contiguous, y being fastest
+    for (unsigned int y = yBegin; y < yEnd;) {
+        unsigned int runEnd = std::min(yEnd, (y & ~15u) + 16);
+        m_sections[y >> 4].copyRun(BlockSection::localIndex(x, y & 15, z), runEnd - y, out);
+        out += runEnd - y;
+        y = runEnd;
+    }
+}
+
+void Chunk::pin() {
+    m_pinCount.fetch_add(1);
+}
+
+void Chunk::unpin() {
+    m_pinCount.fetch_sub(1);
+}
+
+bool Chunk::isPinned() const {
+    return m_pinCount.load() > 0;
+}
+
+/**
+ * @brief Chunk::beginWrite
+ *  Main thread. The fence keeps the writes that follow from being seen
+ *  before the now odd sequence.
+ */
+void Chunk::beginWrite() {
+    uint32_t sequence = m_writeSequence.load(std::memory_order_relaxed);
+    if (sequence & 1) {
+        throw std::logic_error("Chunk::beginWrite inside a write batch!");
+    }
+    m_writeSequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+void Chunk::endWrite() {
+    uint32_t sequence = m_writeSequence.load(std::memory_order_relaxed);
+    if (!(sequence & 1)) {
+        throw std::logic_error("Chunk::endWrite without beginWrite!");
+    }
+    m_writeSequence.store(sequence + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Chunk::readBegin
+ *  Batches are a few main-thread writes, so a reader yields rather than
+ *  sleeps until one closes.
+ * @return
+ */
+uint32_t Chunk::readBegin() const {
+    uint32_t sequence = m_writeSequence.load(std::memory_order_acquire);
+    while (sequence & 1) {
+        QThread::yieldCurrentThread();
+        sequence = m_writeSequence.load(std::memory_order_acquire);
+    }
+    return sequence;
+}
+
+/**
+ * @brief Chunk::readRetry
+ *  The fence orders the reads made since readBegin() before the check.
+ * @param sequence : from readBegin()
+ * @return
+ */
+bool Chunk::readRetry(uint32_t sequence) const {
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return m_writeSequence.load(std::memory_order_relaxed) != sequence;
+}
+
+void Chunk::compactSections() {
+    for (BlockSection &section : m_sections) {
+        section.compact();
+        section.intern();
+    }
+}
+
+bool Chunk::hasRetiredSections() const {
+    for (const BlockSection &section : m_sections) {
+        if (section.hasRetired()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Chunk::reclaimRetiredSections() {
+    for (BlockSection &section : m_sections) {
+        section.reclaimRetired();
+    }
+}
+
+size_t Chunk::blockMemoryUsage() const {
+    size_t bytes = 0;
+    for (const BlockSection &section : m_sections) {
+        bytes += section.memoryUsage();
+    }
+    return bytes;
+}
+
+
+const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirection {
+    {XPOS, XNEG},
+    {XNEG, XPOS},
+    {YPOS, YNEG},
+    {YNEG, YPOS},
+    {ZPOS, ZNEG},
+    {ZNEG, ZPOS}
+};
+
+void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
+    if(neighbor != nullptr) {
+        this->m_neighbors[neighborIndex(dir)].store(neighbor.get(), std::memory_order_release);
+        neighbor->m_neighbors[neighborIndex(oppositeDirection.at(dir))].store(this, std::memory_order_release);
+    }
+}
+
+
+/**
+ * @brief Chunk::unlinkNeighbors
+ *  The neighbors lose this chunk's border blocks, so their faces there
+ *  are remeshed on their next generateVBOdata; the diagonal ones only
+ *  lose the light it gave them, relit then too.
+ */
+void Chunk::unlinkNeighbors() {
+    std::array<Chunk*, 8> neighborhood = getNeighborhood();
+    for (int i = 4; i < 8; i++) {
+        if (neighborhood[i] != nullptr) {
+            neighborhood[i]->markAllSectionsDirty();
+        }
+    }
+    for (Direction dir : {XPOS, XNEG, ZPOS, ZNEG}) {
+        Chunk *neighbor = m_neighbors[neighborIndex(dir)].exchange(nullptr);
+        if (neighbor != nullptr) {
+            neighbor->m_neighbors[neighborIndex(oppositeDirection.at(dir))].store(nullptr);
+            neighbor->markAllSectionsDirty();
+        }
+    }
+}
+
+Chunk *Chunk::getDiagonalNeighbor(Direction xDir, Direction zDir) const {
+    const Chunk *x = getNeighbor(xDir);
+    Chunk *diagonal = x != nullptr ? x->getNeighbor(zDir) : nullptr;
+    if (diagonal == nullptr) {
+        const Chunk *z = getNeighbor(zDir);
+        diagonal = z != nullptr ? z->getNeighbor(xDir) : nullptr;
+    }
+    return diagonal;
+}
+
+std::array<Chunk*, 8> Chunk::getNeighborhood() const {
+    return {getNeighbor(XPOS), getNeighbor(XNEG), getNeighbor(ZPOS), getNeighbor(ZNEG),
+            getDiagonalNeighbor(XPOS, ZPOS), getDiagonalNeighbor(XPOS, ZNEG),
+            getDiagonalNeighbor(XNEG, ZPOS), getDiagonalNeighbor(XNEG, ZNEG)};
+}
+
+std::array<std::array<Chunk*, 3>, 3> Chunk::getNeighborhoodGrid() {
+    return {{{getDiagonalNeighbor(XNEG, ZNEG), getNeighbor(ZNEG), getDiagonalNeighbor(XPOS, ZNEG)},
+             {getNeighbor(XNEG), this, getNeighbor(XPOS)},
+             {getDiagonalNeighbor(XNEG, ZPOS), getNeighbor(ZPOS), getDiagonalNeighbor(XPOS, ZPOS)}}};
+}
+
+bool Chunk::isModified() const {
+    return m_modified;
+}
+
+void Chunk::setModified(bool modified) {
+    m_modified = modified;
+}
+
+const ChunkNavigation &Chunk::getNavigation() const {
+    return m_navigation;
+}
+
+void Chunk::serializeBlocks(std::vector<uint8_t> &out) const {
+    for (const BlockSection &section : m_sections) {
+        section.serialize(out);
+    }
+}
+
+bool Chunk::copySectionBlocks(int sy, BlockType *blocks) const
+{
+    if (m_sections[sy].isUniform()) {
+        blocks[0] = m_sections[sy].getUniformType();
+        return false;
+    }
+    m_sections[sy].copyTo(blocks);
+    return true;
+}
+
+/**
+ * @brief Chunk::copyBlockVolume
+ *  The sections are copied whole; the neighbors' border columns one
+ *  block at a time.
+ * @param blocks     : blockVolumeWidth^2 * 256 bytes
+ * @param opaqueTops : blockVolumeWidth^2
+ */
+void Chunk::copyBlockVolume(uint8_t *blocks, int *opaqueTops) const
+{
+    const int w = blockVolumeWidth;
+    std::fill_n(blocks, w * w * 256, static_cast<uint8_t>(EMPTY));
+    std::fill_n(opaqueTops, w * w, 0);
+
+    std::array<BlockType, BlockSection::volume> section;
+    for (int sy = 0; sy < 16; sy++) {
+        m_sections[sy].copyTo(section.data());
+        for (int y = 0; y < 16; y++) {
+            for (int z = 0; z < 16; z++) {
+                for (int x = 0; x < 16; x++) {
+                    blocks[(x + 1) + w * ((z + 1) + w * (sy * 16 + y))] = section[BlockSection::localIndex(x, y, z)];
+                }
+            }
+        }
+    }
+
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const Chunk *chunk = this;
+            if (dx != 0 && dz != 0) {
+                chunk = getDiagonalNeighbor(dx < 0 ? XNEG : XPOS, dz < 0 ? ZNEG : ZPOS);
+            } else if (dx != 0) {
+                chunk = getNeighbor(dx < 0 ? XNEG : XPOS);
+            } else if (dz != 0) {
+                chunk = getNeighbor(dz < 0 ? ZNEG : ZPOS);
+            }
+            if (chunk == nullptr) {
+                continue;
+            }
+            // the one column or row of this side, the whole chunk for itself
+            int xBegin = dx < 0 ? -1 : (dx > 0 ? 16 : 0);
+            int xEnd = dx == 0 ? 16 : xBegin + 1;
+            int zBegin = dz < 0 ? -1 : (dz > 0 ? 16 : 0);
+            int zEnd = dz == 0 ? 16 : zBegin + 1;
+            for (int z = zBegin; z < zEnd; z++) {
+                for (int x = xBegin; x < xEnd; x++) {
+                    unsigned int nx = x - 16 * dx;
+                    unsigned int nz = z - 16 * dz;
+                    opaqueTops[(x + 1) + w * (z + 1)] = chunk->getOpaqueTop(nx, nz);
+                    if (chunk == this) {
+                        continue;
+                    }
+                    for (int y = 0; y < 256; y++) {
+                        blocks[(x + 1) + w * ((z + 1) + w * y)] = chunk->getBlockAtUnchecked(nx, y, nz);
+                    }
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Chunk::deserializeBlocks
+ *  A malformed encoding leaves every section EMPTY.
+ * @param data : a serializeBlocks() encoding
+ * @param size : its length in bytes
+ * @return
+ */
+bool Chunk::deserializeBlocks(const uint8_t *data, size_t size) {
+    const uint8_t *p = data;
+    const uint8_t *end = data + size;
+    bool valid = true;
+    for (BlockSection &section : m_sections) {
+        valid = valid && section.deserialize(p, end);
+    }
+    valid = valid && p == end;
+    if (!valid) {
+        for (BlockSection &section : m_sections) {
+            section.fill(EMPTY);
+        }
+    }
+    for (BlockSection &section : m_sections) {
+        section.intern();
+    }
+    recomputeHeights();
+    markAllSectionsDirty();
+    return valid;
+}
+
+/**
+ * @brief Chunk::snapshotBlocks
+ *  A write batch that overlaps the snapshot may have written in place to
+ *  data it already shared, so it is taken again.
+ * @return
+ */
+ChunkBlocks Chunk::snapshotBlocks() const
+{
+    ChunkBlocks blocks;
+    uint32_t sequence;
+    do {
+        sequence = readBegin();
+        for (int sy = 0; sy < 16; sy++) {
+            blocks.sections[sy] = m_sections[sy].snapshot();
+        }
+    } while (readRetry(sequence));
+    return blocks;
+}
+
+void Chunk::restoreBlocks(const ChunkBlocks &blocks)
+{
+    for (int sy = 0; sy < 16; sy++) {
+        m_sections[sy].restore(blocks.sections[sy]);
+    }
+    recomputeHeights();
+    markAllSectionsDirty();
+}
+
+/**
+ * @brief Chunk::replaceSections
+ *  The blocks are the same, so nothing is remeshed; the replaced data is
+ *  retired like a write's.
+ * @param from
+ * @param to
+ * @return
+ */
+int Chunk::replaceSections(const ChunkBlocks &from, const ChunkBlocks &to)
+{
+    int replaced = 0;
+    for (int sy = 0; sy < 16; sy++) {
+        if (m_sections[sy].replace(from.sections[sy], to.sections[sy])) {
+            replaced++;
+        }
+    }
+    return replaced;
+}
+
+/**
+ * @brief Chunk::snapshotSection
+ *  The section itself is decoded in one go; the border is read block by
+ *  block from the section below / above and the neighbors' facing columns.
+ *  Retried while a write batch on this chunk or a neighbor overlaps it.
+ * @param sy   : section index
+ * @param snap
+ */
+void Chunk::snapshotSection(int sy, SectionSnapshot &snap) const
+{
+    // the neighbors' facing columns: (border x, z) here, (x, z) there
+    const Chunk *xneg = getNeighbor(XNEG);
+    const Chunk *xpos = getNeighbor(XPOS);
+    const Chunk *zneg = getNeighbor(ZNEG);
+    const Chunk *zpos = getNeighbor(ZPOS);
+    const std::array<const Chunk*, 5> sources = {this, xneg, xpos, zneg, zpos};
+
+    std::array<uint32_t, 5> sequences;
+    bool overlapped = true;
+    while (overlapped) {
+        for (size_t i = 0; i < sources.size(); i++) {
+            sequences[i] = sources[i] != nullptr ? sources[i]->readBegin() : 0;
+        }
+        copySection(sy, snap, xneg, xpos, zneg, zpos);
+        overlapped = false;
+        for (size_t i = 0; i < sources.size(); i++) {
+            overlapped = overlapped || (sources[i] != nullptr && sources[i]->readRetry(sequences[i]));
+        }
+    }
+}
+
+void Chunk::copySection(int sy, SectionSnapshot &snap, const Chunk *xneg, const Chunk *xpos,
+                        const Chunk *zneg, const Chunk *zpos) const
+{
+    snap.blocks.fill(EMPTY);
+
+    // the section, one 16-block column (y fastest) at a time
+    std::array<BlockType, BlockSection::volume> section;
+    m_sections[sy].copyTo(section.data());
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            std::copy_n(&section[BlockSection::localIndex(x, 0, z)], 16,
+                        &snap.blocks[SectionSnapshot::index(x, 0, z)]);
+        }
+    }
+
+    // below and above, EMPTY past the world
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            if (sy > 0) {
+                snap.blocks[SectionSnapshot::index(x, -1, z)] = m_sections[sy - 1].get(BlockSection::localIndex(x, 15, z));
+            }
+            if (sy < 15) {
+                snap.blocks[SectionSnapshot::index(x, 16, z)] = m_sections[sy + 1].get(BlockSection::localIndex(x, 0, z));
+            }
+        }
+    }
+
+    // the neighbors' facing columns
+    for (int i = 0; i < 16; i++) {
+        for (int y = 0; y < 16; y++) {
+            unsigned int wy = sy * 16 + y;
+            if (xneg != nullptr) {
+                snap.blocks[SectionSnapshot::index(-1, y, i)] = xneg->getBlockAtUnchecked(15, wy, i);
+            }
+            if (xpos != nullptr) {
+                snap.blocks[SectionSnapshot::index(16, y, i)] = xpos->getBlockAtUnchecked(0, wy, i);
+            }
+            if (zneg != nullptr) {
+                snap.blocks[SectionSnapshot::index(i, y, -1)] = zneg->getBlockAtUnchecked(i, wy, 15);
+            }
+            if (zpos != nullptr) {
+                snap.blocks[SectionSnapshot::index(i, y, 16)] = zpos->getBlockAtUnchecked(i, wy, 0);
+            }
+        }
+    }
+}
+
+/**
+ * @brief pushVec4ToBuffer
+ *  The helper func to push 4 elements into buffer array
+ * @param buf
+ * @param vec
+ */
+void pushVec4ToBuffer(std::vector<float> &buf, const glm::vec4 &vec)
+{
+    buf.insert(buf.end(), &vec[0], &vec[0] + 4);
+}
+
+
+/**
+ * @brief pushVec2ToBuffer
+ *   *  The helper func to push 2 elements into buffer array
+ * @param buf
+ * @param vec
+ */
+void pushVec2ToBuffer(std::vector<float> &buf, const glm::vec2 &vec)
+{
+    buf.insert(buf.end(), &vec[0], &vec[0] + 2);
+}
+
+/**
+ * @brief packVertex
+ *  A chunk vertex as terrain.vert.glsl decodes it, two words:
+ *  x (5 bits) | y (9 bits) | z (5 bits) | face index (3 bits) | animatable (1 bit) | occlusion (2 bits)
+ *  layer (8 bits) | uv u (5 bits) | uv v (5 bits) | sky light (4 bits) | block light (4 bits)
+ *  The layer is the face's tile in the block texture array (see
+ *  Block::getFaceLayer) and uv counts tiles across the face (up to 16 over
+ *  a greedy quad). The shading is the vertex's (see Chunk::shadeFace).
+ * @param out : advanced past the two words written
+ */
+static void packVertex(uint32_t *&out, glm::ivec3 pos, int faceIndex, bool animatable,
+                       int layer, glm::ivec2 uv, int occlusion, int skyLight, int blockLight)
+{
+    *out++ = static_cast<uint32_t>(pos.x) | (static_cast<uint32_t>(pos.y) << 5)
+            | (static_cast<uint32_t>(pos.z) << 14) | (static_cast<uint32_t>(faceIndex) << 19)
+            | (static_cast<uint32_t>(animatable) << 22) | (static_cast<uint32_t>(occlusion) << 23);
+    *out++ = static_cast<uint32_t>(layer) | (static_cast<uint32_t>(uv.x) << 8) | (static_cast<uint32_t>(uv.y) << 13)
+            | (static_cast<uint32_t>(skyLight) << 18) | (static_cast<uint32_t>(blockLight) << 22);
+}
+
+/**
+ * @brief packFace
+ *  A face as the mesher caches it, in its section:
+ *  x (4 bits) | z (4 bits) | y - 16 * sy (4 bits) | face index (3 bits) | block type (8 bits)
+ *  | width - 1 (4 bits) | height - 1 (4 bits)
+ *  A greedy quad covers width x height blocks along the face's (u, v) axes
+ *  (see faceAxes); a plain face is 1 x 1.
+ */
+static uint32_t packFace(int x, int localY, int z, int faceIndex, BlockType type, int width = 1, int height = 1)
+{
+    return static_cast<uint32_t>(x) | (static_cast<uint32_t>(z) << 4) | (static_cast<uint32_t>(localY) << 8)
+            | (static_cast<uint32_t>(faceIndex) << 12) | (static_cast<uint32_t>(type) << 15)
+            | (static_cast<uint32_t>(width - 1) << 23) | (static_cast<uint32_t>(height - 1) << 27);
+}
+
+// Per face index (Direction order): the normal axis, then the axes along
+// which the face's uv.x and uv.y grow in Block::createBlockFaces.
+// A greedy quad's width runs along u and its height along v.
+static const int faceAxes[6][3] = {
+    {0, 2, 1},  // XPOS
+    {0, 2, 1},  // XNEG
+    {1, 0, 2},  // YPOS
+    {1, 0, 2},  // YNEG
+    {2, 0, 1},  // ZPOS
+    {2, 0, 1}   // ZNEG
+};
+
+// Light changes reach no farther than this from the block that changed
+static const int lightReach = LightVolume::maxLight - 1;
+// How far past the chunk the mesher's light extends: the border block the
+// faces sample, and the blocks that light it (see LightVolume)
+static const int lightMargin = LightVolume::maxLight;
+static const int footprintWidth = 16 + 2 * lightMargin;
+
+// the column (x, z), local to the chunk, of the light's footprint
+static int footprintColumn(int x, int z)
+{
+    return (x + lightMargin) + footprintWidth * (z + lightMargin);
+}
+
+// the sections next to those of the bit set, and those
+static uint32_t spreadSections(uint32_t sections)
+{
+    return (sections | (sections << 1) | (sections >> 1)) & 0xFFFF;
+}
+
+// the sections holding any y in [yLow, yHigh], clamped to the world
+static uint32_t sectionsBetween(int yLow, int yHigh)
+{
+    yLow = std::max(yLow, 0);
+    yHigh = std::min(yHigh, 255);
+    uint32_t sections = 0;
+    for (int sy = yLow >> 4; yLow <= yHigh && sy <= yHigh >> 4; sy++) {
+        sections |= 1u << sy;
+    }
+    return sections;
+}
+
+std::atomic<bool> Chunk::s_greedyMeshing(false);
+
+void Chunk::setGreedyMeshing(bool enabled)
+{
+    s_greedyMeshing = enabled;
+}
+
+bool Chunk::isGreedyMeshing()
+{
+    return s_greedyMeshing;
+}
+
+std::atomic<bool> Chunk::s_overdrawOrdering(true);
+
+void Chunk::setOverdrawOrdering(bool enabled)
+{
+    s_overdrawOrdering = enabled;
+}
+
+bool Chunk::isOverdrawOrdering()
+{
+    return s_overdrawOrdering;
+}
+
+/**
+ * @brief Chunk::orderFacesForOverdraw
+ *  The view-independent order of a mesh optimizer's overdraw pass, with
+ *  every face its own cluster: by how far the face's plane lies from the
+ *  section's center along the face's normal, farthest first. Of two faces
+ *  seen from one side, the one farther out usually hides the other. The
+ *  16 planes per axis make it a counting sort, stable within a plane.
+ *  The faces share no vertices (4 per quad, see ChunkDrawable's shared
+ *  indices), so there is no vertex cache order to find, and the vertices
+ *  are fetched in the order they are drawn whatever it is.
+ * @param faces : of one section
+ */
+void Chunk::orderFacesForOverdraw(std::vector<MeshFace> &faces)
+{
+    if (faces.size() < 2) {
+        return;
+    }
+    // in [0, 16), the lower the farther out along the normal
+    auto bucket = [](uint32_t face) {
+        int f = (face >> 12) & 7;
+        int axis = faceAxes[f][0];
+        int c = axis == 0 ? (face & 15) : axis == 1 ? ((face >> 8) & 15) : ((face >> 4) & 15);
+        return f % 2 == 0 ? 15 - c : c;
+    };
+    std::array<size_t, 17> starts = {};
+    for (const MeshFace &face : faces) {
+        starts[bucket(face.face) + 1]++;
+    }
+    for (int b = 0; b < 16; b++) {
+        starts[b + 1] += starts[b];
+    }
+    std::vector<MeshFace> ordered(faces.size());
+    for (const MeshFace &face : faces) {
+        ordered[starts[bucket(face.face)]++] = face;
+    }
+    faces.swap(ordered);
+}
+
+/**
+ * @brief Chunk::generateVBOdata
+ *  This method generates the needed vertex buffer & index data for this chunk.
+ *  Only the sections changed since the last call are remeshed, with the
+ *  ones whose light the written blocks changed; the others reuse their
+ *  cached faces. Once the chunk has been lit, the light its writes changed
+ *  is also remeshed around it (see ChunkVBOdata::relightsNeighbors).
+ *  Note: the order of the vertex buffer is (pos, normal, uv, animatable flag).
+ *  All of them are put in a vector<float>.
+ * @return
+ */
+ChunkVBOdata Chunk::generateVBOdata(MeshCache *meshCache)
+{
+    // init
+    QElapsedTimer timer;
+    timer.start();
+    ChunkVBOdata vbo = ChunkVBOdata((Chunk*)(this));
+
+    m_meshLock.lock();
+
+    // clear first: a write landing during meshing marks its section again
+    uint32_t dirty = m_dirtySections.exchange(0);
+    // light changes within lightReach < 16 blocks: the next sections at most
+    uint32_t lightChanged = spreadSections(m_changedSections.exchange(0));
+    uint32_t remesh = dirty | lightChanged;
+    uint32_t neighborsToRelight = 0;
+    if (remesh != 0) {
+        std::array<std::array<Chunk*, 3>, 3> grid = getNeighborhoodGrid();
+        std::vector<int> skyTops = computeSkyTops(grid);
+
+        // a column covered or opened changes the sky light all along the
+        // way its top moved
+        for (int z = 0; z < 16; z++) {
+            for (int x = 0; x < 16; x++) {
+                int top = skyTops[footprintColumn(x, z)];
+                int lastTop = m_skyTops[x + 16 * z];
+                if (m_lightValid && top != lastTop) {
+                    lightChanged |= sectionsBetween(std::min(top, lastTop) - lightReach,
+                                                    std::max(top, lastTop) - 1 + lightReach);
+                }
+                m_skyTops[x + 16 * z] = static_cast<int16_t>(top);
+            }
+        }
+        remesh |= lightChanged;
+        // the neighbors lit themselves from these blocks when first meshed
+        neighborsToRelight = m_lightValid ? lightChanged : 0;
+        m_lightValid = true;
+
+        // every section's faces only depend on the neighborhood's blocks,
+        // so a meshing of all of them can be the one cached for the same blocks
+        bool cacheable = meshCache != nullptr && (remesh & 0xFFFFu) == 0xFFFFu;
+        uint64_t cacheKey = cacheable ? meshCacheKey(grid) : 0;
+        if (!cacheable || !deserializeSectionMeshes(meshCache->load(m_xCorner, m_zCorner, cacheKey))) {
+            LightVolume light;
+            lightSections(remesh, grid, skyTops, light);
+            for (int sy = 0; sy < 16; sy++) {
+                if (!(remesh & (1u << sy))) {
+                    continue;
+                }
+                SectionMesh &mesh = m_sectionMeshes[sy];
+                mesh.opaqueFaces.clear();
+                mesh.transparentFaces.clear();
+                mesh.lights.clear();
+                if (dirty & (1u << sy)) {
+                    mesh.connectivity = computeConnectivity(sy);
+                }
+                meshSection(sy, light, mesh);
+                if (isOverdrawOrdering()) {
+                    orderFacesForOverdraw(mesh.opaqueFaces);
+                }
+                mesh.opaqueFaces.shrink_to_fit();
+                mesh.transparentFaces.shrink_to_fit();
+            }
+            if (cacheable) {
+                QByteArray encoded;
+                serializeSectionMeshes(encoded);
+                meshCache->store(m_xCorner, m_zCorner, cacheKey, std::move(encoded));
+            }
+        }
+    }
+
+    size_t opaqueFaces = 0;
+    size_t transparentFaces = 0;
+    for (const SectionMesh &mesh : m_sectionMeshes) {
+        opaqueFaces += mesh.opaqueFaces.size();
+        transparentFaces += mesh.transparentFaces.size();
+    }
+
+    // The face counts are exact, so size the buffers once (4 vertices *
+    // 2 words per face) and write them through a pointer.
+    vbo.buffer.resize(opaqueFaces * 8);
+    vbo.transparentBuffer.resize(transparentFaces * 8);
+    vbo.quads = opaqueFaces;
+    vbo.transparentQuads = transparentFaces;
+
+    uint32_t *vertexOut = vbo.buffer.data();
+    uint32_t start = 0;
+    for (int sy = 0; sy < 16; sy++) {
+        vbo.sectionQuadStarts[sy] = start;
+        start += m_sectionMeshes[sy].opaqueFaces.size();
+        appendFaces(m_sectionMeshes[sy].opaqueFaces, sy, vertexOut);
+        vbo.animated = vbo.animated || hasAnimatedFaces(m_sectionMeshes[sy].opaqueFaces);
+    }
+    vbo.sectionQuadStarts[16] = start;
+    vertexOut = vbo.transparentBuffer.data();
+    start = 0;
+    for (int sy = 0; sy < 16; sy++) {
+        vbo.transparentSectionQuadStarts[sy] = start;
+        start += m_sectionMeshes[sy].transparentFaces.size();
+        appendFaces(m_sectionMeshes[sy].transparentFaces, sy, vertexOut);
+        vbo.transparentAnimated = vbo.transparentAnimated || hasAnimatedFaces(m_sectionMeshes[sy].transparentFaces);
+    }
+    vbo.transparentSectionQuadStarts[16] = start;
+    for (int sy = 0; sy < 16; sy++) {
+        vbo.sectionConnectivity[sy] = m_sectionMeshes[sy].connectivity;
+        vbo.lights.insert(vbo.lights.end(), m_sectionMeshes[sy].lights.begin(), m_sectionMeshes[sy].lights.end());
+    }
+    vbo.meshVersion = ++m_meshVersion;
+    vbo.remeshedSections = remesh;
+
+    m_meshLock.unlock();
+
+    if (neighborsToRelight != 0) {
+        for (Chunk *neighbor : getNeighborhood()) {
+            if (neighbor != nullptr) {
+                neighbor->markSectionsDirty(neighborsToRelight);
+            }
+        }
+        vbo.relightsNeighbors = true;
+    }
+
+    vbo.meshNs = timer.nsecsElapsed();
+    return vbo;
+}
+
+/**
+ * @brief Chunk::meshCacheKey
+ *  Each word is mixed in with splitmix64: a 64-bit key with no check
+ *  behind it has to spread every bit of the blocks. A uniform section
+ *  takes one word, and a missing neighbor one.
+ * @param grid : see getNeighborhoodGrid
+ * @return
+ */
+uint64_t Chunk::meshCacheKey(const std::array<std::array<Chunk*, 3>, 3> &grid)
 {
-    std::fill_n(m_blocks.begin(), 65536, EMPTY);
+    uint64_t key = 0;
+    auto add = [&key](uint64_t word) {
+        key = Random::mix(key ^ word);
+    };
+    add(mesherVersion);
+    add((isGreedyMeshing() ? 1 : 0) | (isOverdrawOrdering() ? 2 : 0));
+    std::array<BlockType, 4096> blocks;
+    for (const std::array<Chunk*, 3> &row : grid) {
+        for (const Chunk *chunk : row) {
+            if (chunk == nullptr) {
+                add(~0ull);
+                continue;
+            }
+            for (int sy = 0; sy < 16; sy++) {
+                if (!chunk->copySectionBlocks(sy, blocks.data())) {
+                    add(0x100u | blocks[0]);
+                    continue;
+                }
+                add(0x200u);
+                for (size_t i = 0; i < blocks.size(); i += 8) {
+                    uint64_t word;
+                    std::memcpy(&word, blocks.data() + i, 8);
+                    add(word);
+                }
+            }
+        }
+    }
+    return key;
 }
 
+static void appendWord(QByteArray &out, uint32_t v)
+{
+    for (int b = 0; b < 4; b++) {
+        out.append(static_cast<char>((v >> (8 * b)) & 0xFF));
+    }
+}
 
-// Does bounds checking with at()
-BlockType Chunk::getBlockAt(unsigned int x, unsigned int y, unsigned int z) const {
-    return m_blocks.at(x + 16 * y + 16 * 256 * z);
+static uint32_t readWord(const char *&in)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < 4; b++) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(in[b])) << (8 * b);
+    }
+    in += 4;
+    return v;
 }
 
-// Exists to get rid of compiler warnings about int -> unsigned int implicit conversion
-BlockType Chunk::getBlockAt(int x, int y, int z) const {
-    return getBlockAt(static_cast<unsigned int>(x), static_cast<unsigned int>(y), static_cast<unsigned int>(z));
+static void appendFloat(QByteArray &out, float f)
+{
+    uint32_t v;
+    std::memcpy(&v, &f, 4);
+    appendWord(out, v);
 }
 
-// Does bounds checking with at()
-void Chunk::setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
-    m_blocks.at(x + 16 * y + 16 * 256 * z) = t;
+static float readFloat(const char *&in)
+{
+    uint32_t v = readWord(in);
+    float f;
+    std::memcpy(&f, &v, 4);
+    return f;
 }
 
+/**
+ * @brief Chunk::serializeSectionMeshes
+ *  Per section, little endian: the opaque and transparent face counts,
+ *  the connectivity and the light count, then the faces (face and light
+ *  words, occlusion byte) and the lights (position, radius, color).
+ * @param out
+ */
+void Chunk::serializeSectionMeshes(QByteArray &out) const
+{
+    for (const SectionMesh &mesh : m_sectionMeshes) {
+        appendWord(out, static_cast<uint32_t>(mesh.opaqueFaces.size()));
+        appendWord(out, static_cast<uint32_t>(mesh.transparentFaces.size()));
+        appendWord(out, mesh.connectivity);
+        appendWord(out, static_cast<uint32_t>(mesh.lights.size()));
+        for (const std::vector<MeshFace> *faces : {&mesh.opaqueFaces, &mesh.transparentFaces}) {
+            for (const MeshFace &face : *faces) {
+                appendWord(out, face.face);
+                appendWord(out, face.light);
+                out.append(static_cast<char>(face.occlusion));
+            }
+        }
+        for (const PointLight &light : mesh.lights) {
+            appendFloat(out, light.position.x);
+            appendFloat(out, light.position.y);
+            appendFloat(out, light.position.z);
+            appendFloat(out, light.radius);
+            appendFloat(out, light.color.r);
+            appendFloat(out, light.color.g);
+            appendFloat(out, light.color.b);
+        }
+    }
+}
 
-const static std::unordered_map<Direction, Direction, EnumHash> oppositeDirection {
-    {XPOS, XNEG},
-    {XNEG, XPOS},
-    {YPOS, YNEG},
-    {YNEG, YPOS},
-    {ZPOS, ZNEG},
-    {ZNEG, ZPOS}
-};
+bool Chunk::deserializeSectionMeshes(const QByteArray &in)
+{
+    static const size_t faceBytes = 9;
+    static const size_t lightBytes = 28;
+    std::array<SectionMesh, 16> meshes;
+    const char *read = in.constData();
+    const char *end = read + in.size();
+    for (SectionMesh &mesh : meshes) {
+        if (end - read < 16) {
+            return false;
+        }
+        size_t opaqueFaces = readWord(read);
+        size_t transparentFaces = readWord(read);
+        mesh.connectivity = readWord(read);
+        size_t lights = readWord(read);
+        if (static_cast<size_t>(end - read) < (opaqueFaces + transparentFaces) * faceBytes + lights * lightBytes) {
+            return false;
+        }
+        mesh.opaqueFaces.resize(opaqueFaces);
+        mesh.transparentFaces.resize(transparentFaces);
+        for (std::vector<MeshFace> *faces : {&mesh.opaqueFaces, &mesh.transparentFaces}) {
+            for (MeshFace &face : *faces) {
+                face.face = readWord(read);
+                face.light = readWord(read);
+                face.occlusion = static_cast<uint8_t>(*read++);
+            }
+        }
+        mesh.lights.resize(lights);
+        for (PointLight &light : mesh.lights) {
+            light.position.x = readFloat(read);
+            light.position.y = readFloat(read);
+            light.position.z = readFloat(read);
+            light.radius = readFloat(read);
+            light.color.r = readFloat(read);
+            light.color.g = readFloat(read);
+            light.color.b = readFloat(read);
+        }
+    }
+    if (read != end) {
+        return false;
+    }
+    m_sectionMeshes = std::move(meshes);
+    return true;
+}
 
-void Chunk::linkNeighbor(uPtr<Chunk> &neighbor, Direction dir) {
-    if(neighbor != nullptr) {
-        this->m_neighbors[dir] = neighbor.get();
-        neighbor->m_neighbors[oppositeDirection.at(dir)] = this;
+/**
+ * @brief Chunk::computeSkyTops
+ *  Whole sections without an opaque block are skipped. A neighbor's
+ *  blocks are read as they are; a write racing this marks its section
+ *  dirty and relights it (see generateVBOdata).
+ * @param grid : see getNeighborhoodGrid
+ * @return footprintWidth^2 columns; 0 where there is no chunk (its blocks
+ *  count as opaque, see lightSections)
+ */
+std::vector<int> Chunk::computeSkyTops(const std::array<std::array<Chunk*, 3>, 3> &grid)
+{
+    std::vector<int> tops(footprintWidth * footprintWidth, 0);
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const Chunk *chunk = grid[dz + 1][dx + 1];
+            if (chunk == nullptr) {
+                continue;
+            }
+            // the footprint's part of the chunk, local to the center one
+            int xBegin = std::max(16 * dx, -lightMargin);
+            int xEnd = std::min(16 * dx + 16, 16 + lightMargin);
+            int zBegin = std::max(16 * dz, -lightMargin);
+            int zEnd = std::min(16 * dz + 16, 16 + lightMargin);
+            for (int z = zBegin; z < zEnd; z++) {
+                for (int x = xBegin; x < xEnd; x++) {
+                    tops[footprintColumn(x, z)] = chunk->getOpaqueTop(x - 16 * dx, z - 16 * dz);
+                }
+            }
+        }
     }
+    return tops;
 }
 
+/**
+ * @brief Chunk::lightSections
+ *  The light box spans the sections, lightMargin blocks around them and
+ *  the neighborhood's blocks within; lightMargin blocks above the
+ *  footprint's highest non-empty block, it is all open sky with no block
+ *  light left, and the box ends. Missing chunks stay opaque and dark.
+ * @param sections : not 0
+ * @param grid     : see getNeighborhoodGrid
+ * @param skyTops  : see computeSkyTops
+ * @param light    : reset and solved
+ */
+void Chunk::lightSections(uint32_t sections, const std::array<std::array<Chunk*, 3>, 3> &grid,
+                          const std::vector<int> &skyTops, LightVolume &light)
+{
+    int lowest = 0;
+    while (!(sections & (1u << lowest))) {
+        lowest++;
+    }
+    int highest = 15;
+    while (!(sections & (1u << highest))) {
+        highest--;
+    }
+    int filledTop = 0;
+    for (const auto &row : grid) {
+        for (const Chunk *chunk : row) {
+            if (chunk != nullptr) {
+                filledTop = std::max(filledTop, chunk->getOccupiedTop());
+            }
+        }
+    }
+    int yBegin = std::max(0, lowest * 16 - lightMargin);
+    int yEnd = std::min({256, highest * 16 + 16 + lightMargin, filledTop + lightMargin});
+    yEnd = std::max(yEnd, yBegin);
+    light.reset(glm::ivec3(-lightMargin, yBegin, -lightMargin),
+                glm::ivec3(footprintWidth, yEnd - yBegin, footprintWidth));
+
+    std::array<BlockType, BlockSection::volume> blocks;
+    for (int dz = -1; dz <= 1; dz++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            const Chunk *chunk = grid[dz + 1][dx + 1];
+            if (chunk == nullptr) {
+                continue;
+            }
+            int xBegin = std::max(16 * dx, -lightMargin);
+            int xEnd = std::min(16 * dx + 16, 16 + lightMargin);
+            int zBegin = std::max(16 * dz, -lightMargin);
+            int zEnd = std::min(16 * dz + 16, 16 + lightMargin);
+            for (int sy = yBegin >> 4; sy < 16 && sy * 16 < yEnd; sy++) {
+                chunk->m_sections[sy].copyTo(blocks.data());
+                int yLow = std::max(yBegin, sy * 16);
+                int yHigh = std::min(yEnd, sy * 16 + 16);
+                for (int z = zBegin; z < zEnd; z++) {
+                    for (int x = xBegin; x < xEnd; x++) {
+                        for (int y = yLow; y < yHigh; y++) {
+                            BlockType t = blocks[BlockSection::localIndex(x - 16 * dx, y & 15, z - 16 * dz)];
+                            light.setBlock(light.index(x, y, z), Block::isOpaque(t), Block::getEmission(t));
+                        }
+                    }
+                }
+            }
+            for (int z = zBegin; z < zEnd; z++) {
+                for (int x = xBegin; x < xEnd; x++) {
+                    light.setSkyTop(x, z, skyTops[footprintColumn(x, z)]);
+                }
+            }
+        }
+    }
+    light.solve();
+}
 
 /**
- * @brief Chunk::getNeighborBlock
- *  Retrieve the neighboring block (along the dirVec)
- *  of the current block location at (x, y, z).
- * @param x
- * @param y
- * @param z
- * @param dirVec
+ * @brief Chunk::getSectionFlags
+ *  Derived from the section's palette, so a stale (not yet compacted)
+ *  palette only makes the flags more conservative.
+ * @param sy : section index, y / 16
  * @return
  */
-BlockType Chunk::getNeighborBlock(int x, int y, int z, glm::vec4 dirVec) const
+SectionFlags Chunk::getSectionFlags(int sy) const
+{
+    SectionFlags flags = {true, true, false, false};
+    m_sections[sy].forEachType([&flags](BlockType t) {
+        bool empty = Block::isEmpty(t);
+        bool opaque = Block::isOpaque(t);
+        flags.allEmpty = flags.allEmpty && empty;
+        flags.allOpaque = flags.allOpaque && opaque;
+        flags.hasOpaque = flags.hasOpaque || opaque;
+        flags.hasTransparent = flags.hasTransparent || (!empty && !opaque);
+    });
+    return flags;
+}
+
+// bit of the face pair (a, b) in a section's connectivity
+static uint32_t connectivityBit(int a, int b)
 {
-    // init to empty
-    BlockType block = EMPTY;
+    return 1u << (std::min(a, b) * 6 + std::max(a, b));
+}
+
+// every face pair connected: a section without opaque blocks
+static uint32_t fullConnectivity()
+{
+    uint32_t bits = 0;
+    for (int a = 0; a < 6; a++) {
+        for (int b = a + 1; b < 6; b++) {
+            bits |= connectivityBit(a, b);
+        }
+    }
+    return bits;
+}
 
-    // get neighboring block coordiante
-    int nx = x + (int) dirVec[0];
-    int ny = y + (int) dirVec[1];
-    int nz = z + (int) dirVec[2];
+/**
+ * @brief Chunk::computeConnectivity
+ *  Minecraft-style cave culling: two faces of a section see each other
+ *  if one region of connected non-opaque blocks touches both. Only this
+ *  section's blocks are read.
+ * @param sy : section index
+ * @return one connectivityBit per connected face pair
+ */
+uint32_t Chunk::computeConnectivity(int sy) const
+{
+    SectionFlags flags = getSectionFlags(sy);
+    if (!flags.hasOpaque) {
+        return fullConnectivity();
+    }
+    if (flags.allOpaque) {
+        return 0;
+    }
 
-    // check boundary at first
-    // y = -1 or 256 => ignore, treat as empty (OUT OF THE WORLD)
-    // either x = (-1 or 16) or z = (-1 or 16) => check neighboring chunk
-    if (ny == -1 || ny == 256) {
-        // treat it as EMPTY
-        return block;
+    const int volume = BlockSection::volume;
+    std::array<BlockType, BlockSection::volume> blocks;
+    m_sections[sy].copyTo(blocks.data());
+    // opaque blocks are never entered
+    std::array<bool, BlockSection::volume> visited;
+    for (int i = 0; i < volume; i++) {
+        visited[i] = Block::isOpaque(blocks[i]);
     }
 
-    // <neighbor x coord, Direction, neighbor's x block at>
-    std::tuple<int, Direction, int> xBoundaryInfo[2] = {std::make_tuple(-1, XNEG, 15),
-                                                        std::make_tuple(16, XPOS, 0)};
-    for (int i = 0; i < 2; i++) {
-        if (nx == std::get<0>(xBoundaryInfo[i])) {
-            Direction dir = std::get<1>(xBoundaryInfo[i]);
-            // note: each dir is already instantiated in m_neighbors (to nullptr)
-            Chunk *neighborChunk = m_neighbors.at(dir);
-            return neighborChunk != nullptr ? neighborChunk->getBlockAt(std::get<2>(xBoundaryInfo[i]), y, z)
-                                            : block;
+    uint32_t connectivity = 0;
+    std::vector<int> stack;
+    stack.reserve(volume);
+    for (int seed = 0; seed < volume; seed++) {
+        if (visited[seed]) {
+            continue;
         }
-    }
+        visited[seed] = true;
+        stack.push_back(seed);
+        // the faces (in Direction order) this region touches
+        unsigned int faces = 0;
+        while (!stack.empty()) {
+            int i = stack.back();
+            stack.pop_back();
+            // localIndex = y + 16 * (x + 16 * z)
+            int y = i & 15;
+            int x = (i >> 4) & 15;
+            int z = i >> 8;
+            faces |= (x == 15 ? 1u << XPOS : 0) | (x == 0 ? 1u << XNEG : 0)
+                   | (y == 15 ? 1u << YPOS : 0) | (y == 0 ? 1u << YNEG : 0)
+                   | (z == 15 ? 1u << ZPOS : 0) | (z == 0 ? 1u << ZNEG : 0);
 
-    // <neighbor z coord, Direction, neighbor's z block at>
-    std::tuple<int, Direction, int> zBoundaryInfo[2] = {std::make_tuple(-1, ZNEG, 15),
-                                                        std::make_tuple(16, ZPOS, 0)};
-    for (int i = 0; i < 2; i++) {
-        if (nz == std::get<0>(zBoundaryInfo[i])) {
-            Direction dir = std::get<1>(zBoundaryInfo[i]);
-            // note: each dir is already instantiated in m_neighbors (to nullptr)
-            Chunk *neighborChunk = m_neighbors.at(dir);
-            return neighborChunk != nullptr ? neighborChunk->getBlockAt(x, y, std::get<2>(zBoundaryInfo[i]))
-                                            : block;
+            int neighbors[6] = {x < 15 ? i + 16 : -1, x > 0 ? i - 16 : -1,
+                                y < 15 ? i + 1 : -1, y > 0 ? i - 1 : -1,
+                                z < 15 ? i + 256 : -1, z > 0 ? i - 256 : -1};
+            for (int n : neighbors) {
+                if (n >= 0 && !visited[n]) {
+                    visited[n] = true;
+                    stack.push_back(n);
+                }
+            }
+        }
+        for (int a = 0; a < 6; a++) {
+            for (int b = a + 1; b < 6; b++) {
+                if ((faces & (1u << a)) && (faces & (1u << b))) {
+                    connectivity |= connectivityBit(a, b);
+                }
+            }
         }
     }
+    return connectivity;
+}
+
+bool Chunk::connectsFaces(uint32_t connectivity, Direction from, Direction to)
+{
+    return (connectivity & connectivityBit(from, to)) != 0;
+}
+
+void Chunk::markSectionDirty(unsigned int y)
+{
+    markSectionDirtyIndex(y >> 4);
+}
 
-    // within the range => check the chunk itself
-    return getBlockAt(nx, ny, nz);
+void Chunk::markAllSectionsDirty()
+{
+    m_dirtySections.store(0xFFFF);
+}
+
+void Chunk::markSectionsDirty(uint32_t sections)
+{
+    m_dirtySections.fetch_or(sections);
+}
+
+bool Chunk::isMeshCurrent() const
+{
+    return m_dirtySections.load() == 0 && m_changedSections.load() == 0;
 }
 
 /**
- * @brief Chunk::getNeighbors
+ * @brief Chunk::canSkipSection
+ *  A section without blocks of the pass has nothing to draw, and a fully
+ *  opaque section enclosed by fully opaque sections has no visible face.
+ *  The world's top and bottom and missing neighbor chunks count as EMPTY.
+ * @param sy : section index
+ * @param drawType
  * @return
  */
-std::unordered_map<Direction, Chunk*, EnumHash> Chunk::getNeighbors() const
+bool Chunk::canSkipSection(int sy, TerrainDrawType drawType) const
 {
-    return m_neighbors;
+    // out of the occupied range: no block, no face
+    if (sy * 16 >= getOccupiedTop() || sy * 16 + 16 <= getOccupiedBottom()) {
+        return true;
+    }
+    SectionFlags flags = getSectionFlags(sy);
+
+    if (drawType == TerrainDrawType::transparent) {
+        return !flags.hasTransparent;
+    }
+    if (!flags.hasOpaque) {
+        return true;
+    }
+    if (!flags.allOpaque || sy == 0 || sy == 15) {
+        return false;
+    }
+    if (!getSectionFlags(sy - 1).allOpaque || !getSectionFlags(sy + 1).allOpaque) {
+        return false;
+    }
+    for (Direction dir : {XPOS, XNEG, ZPOS, ZNEG}) {
+        const Chunk *neighbor = getNeighbor(dir);
+        if (neighbor == nullptr || !neighbor->getSectionFlags(sy).allOpaque) {
+            return false;
+        }
+    }
+    return true;
 }
 
 /**
- * @brief pushVec4ToBuffer
- *  The helper func to push 4 elements into buffer array
- * @param buf
- * @param vec
+ * @brief Chunk::computeVisibleFaces
+ *  Binary face culling: each column of the snapshot, border included,
+ *  becomes two 18-bit masks (bit y + 1: opaque, non-empty), so a face
+ *  test is one AND-NOT of the block's column against its neighbor's,
+ *  shifted by a bit for the faces along y. An opaque block's face shows
+ *  past any non-opaque block, a transparent one's only past EMPTY.
+ * @param snap
+ * @param skipOpaque      : canSkipSection for the opaque pass
+ * @param skipTransparent : canSkipSection for the transparent pass
+ * @param masks
  */
-void pushVec4ToBuffer(std::vector<float> &buf, const glm::vec4 &vec)
+void Chunk::computeVisibleFaces(const SectionSnapshot &snap, bool skipOpaque, bool skipTransparent,
+                                SectionFaceMasks &masks)
+{
+    const int size = SectionSnapshot::size;
+    uint32_t opaque[size * size];
+    uint32_t solid[size * size];
+    for (int c = 0; c < size * size; c++) {
+        const BlockType *column = &snap.blocks[c * size];
+        uint32_t o = 0, s = 0;
+        for (int y = 0; y < size; y++) {
+            o |= static_cast<uint32_t>(Block::isOpaque(column[y])) << y;
+            s |= static_cast<uint32_t>(!Block::isEmpty(column[y])) << y;
+        }
+        opaque[c] = o;
+        solid[c] = s;
+    }
+
+    // the section's own blocks, not the border's
+    const uint32_t inner = 0xFFFFu << 1;
+    // per face index: the facing column's step (0: this column, shifted)
+    const int columnSteps[6] = {1, -1, 0, 0, size, -size};
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int c = (x + 1) + size * (z + 1);
+            uint32_t drawOpaque = skipOpaque ? 0 : opaque[c] & inner;
+            uint32_t drawTransparent = skipTransparent ? 0 : solid[c] & ~opaque[c] & inner;
+            for (int f = 0; f < 6; f++) {
+                uint32_t facingOpaque, facingSolid;
+                if (f == YPOS) {
+                    facingOpaque = opaque[c] >> 1;
+                    facingSolid = solid[c] >> 1;
+                } else if (f == YNEG) {
+                    facingOpaque = opaque[c] << 1;
+                    facingSolid = solid[c] << 1;
+                } else {
+                    facingOpaque = opaque[c + columnSteps[f]];
+                    facingSolid = solid[c + columnSteps[f]];
+                }
+                uint32_t visible = (drawOpaque & ~facingOpaque) | (drawTransparent & ~facingSolid);
+                masks.faces[f][x + 16 * z] = static_cast<uint16_t>(visible >> 1);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Chunk::meshSection
+ *  Every non-empty block belongs to exactly one pass (opaque or
+ *  transparent), so one walk over the section meshes both. The walk only
+ *  visits the blocks with a visible face (see computeVisibleFaces). The
+ *  top faces of water are merged into planes, shores keep their own faces.
+ * @param sy    : section index
+ * @param light : lit around the section (see lightSections)
+ * @param mesh  : the visible faces are appended to its pass' list, see MeshFace
+ */
+void Chunk::meshSection(int sy, const LightVolume &light, SectionMesh &mesh) const
 {
-    for (int i = 0; i < 4; i++) {
-        buf.push_back(vec[i]);
+    bool skipOpaque = canSkipSection(sy, TerrainDrawType::opaque);
+    bool skipTransparent = canSkipSection(sy, TerrainDrawType::transparent);
+    if (skipOpaque && skipTransparent) {
+        return;
+    }
+
+    SectionSnapshot snap;
+    snapshotSection(sy, snap);
+    SectionFaceMasks masks;
+    computeVisibleFaces(snap, skipOpaque, skipTransparent, masks);
+    collectSectionLights(snap, masks, sy, mesh.lights);
+    if (isGreedyMeshing()) {
+        meshSectionGreedy(snap, masks, sy, light, mesh);
+        return;
+    }
+
+    // the slices with a water surface, merged into planes below
+    uint32_t waterSlices = 0;
+    // walk in storage order (y fastest)
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int column = x + 16 * z;
+            unsigned int any = 0;
+            for (int f = 0; f < 6; f++) {
+                any |= masks.faces[f][column];
+            }
+            for (; any != 0; any &= any - 1) {
+                int y = static_cast<int>(qCountTrailingZeroBits(any));
+                BlockType blockType = snap.blocks[SectionSnapshot::index(x, y, z)];
+                std::vector<MeshFace> &faces = Block::isOpaque(blockType) ? mesh.opaqueFaces : mesh.transparentFaces;
+                for (int f = 0; f < 6; f++) {
+                    if (!((masks.faces[f][column] >> y) & 1)) {
+                        continue;
+                    }
+                    if (f == YPOS && blockType == WATER) {
+                        waterSlices |= 1u << y;
+                        continue;
+                    }
+                    MeshFace face = shadeFace(light, blockType, x, sy * 16 + y, z, f);
+                    face.face = packFace(x, y, z, f, blockType);
+                    faces.push_back(face);
+                }
+            }
+        }
+    }
+    // open water is the bulk of the transparent pass: its top faces go
+    // as a few large quads (the shader's wave slide runs across them)
+    for (; waterSlices != 0; waterSlices &= waterSlices - 1) {
+        int y = static_cast<int>(qCountTrailingZeroBits(waterSlices));
+        mergeSlice(snap, masks, sy, light, YPOS, y, WATER, mesh);
     }
 }
 
+// the color of the light of an emissive block type
+static glm::vec3 emissionColor(BlockType type)
+{
+    switch (type) {
+    case LAVA:
+        return glm::vec3(1.f, 0.45f, 0.12f);
+    default:
+        // the tint of the block light in lambert.frag.glsl
+        return glm::vec3(1.f, 0.85f, 0.7f);
+    }
+}
 
 /**
- * @brief pushVec2ToBuffer
- *   *  The helper func to push 2 elements into buffer array
- * @param buf
- * @param vec
+ * @brief Chunk::collectSectionLights
+ *  A lava lake is hundreds of emissive blocks: grouping them by cell keeps
+ *  it to a few lights a section, each a little stronger the more blocks
+ *  it stands for. Only blocks with a face drawn count, so the lava deep
+ *  under a lake's surface adds nothing.
+ * @param snap
+ * @param masks : of the section's faces drawn
+ * @param sy
+ * @param lights : out
  */
-void pushVec2ToBuffer(std::vector<float> &buf, const glm::vec2 &vec)
+void Chunk::collectSectionLights(const SectionSnapshot &snap, const SectionFaceMasks &masks, int sy,
+                                 std::vector<PointLight> &lights) const
 {
-    for (int i = 0; i < 2; i++) {
-        buf.push_back(vec[i]);
+    static const int cellsPerSide = 16 / lightCellSize;
+    struct Cell
+    {
+        glm::ivec3 sum;
+        int count;
+        int emission;
+        BlockType type;
+    };
+    std::array<Cell, cellsPerSide * cellsPerSide * cellsPerSide> cells = {};
+    bool any = false;
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            int column = x + 16 * z;
+            unsigned int drawn = 0;
+            for (int f = 0; f < 6; f++) {
+                drawn |= masks.faces[f][column];
+            }
+            for (; drawn != 0; drawn &= drawn - 1) {
+                int y = static_cast<int>(qCountTrailingZeroBits(drawn));
+                BlockType type = snap.blocks[SectionSnapshot::index(x, y, z)];
+                int emission = Block::getEmission(type);
+                if (emission == 0) {
+                    continue;
+                }
+                Cell &cell = cells[x / lightCellSize
+                                   + cellsPerSide * (y / lightCellSize + cellsPerSide * (z / lightCellSize))];
+                cell.sum += glm::ivec3(x, y, z);
+                cell.count++;
+                if (emission > cell.emission) {
+                    cell.emission = emission;
+                    cell.type = type;
+                }
+                any = true;
+            }
+        }
+    }
+    if (!any) {
+        return;
+    }
+    glm::vec3 origin(m_xCorner, sy * 16, m_zCorner);
+    for (const Cell &cell : cells) {
+        if (cell.count == 0) {
+            continue;
+        }
+        glm::vec3 center = origin + glm::vec3(cell.sum) / static_cast<float>(cell.count) + 0.5f;
+        // as far as the block light of that level floods
+        float radius = static_cast<float>(cell.emission);
+        float strength = std::min(1.f, 0.4f + cell.count / 32.f);
+        lights.push_back(PointLight{center, radius, emissionColor(cell.type) * strength});
     }
 }
 
 /**
- * @brief Chunk::generateVBOdata
- *  This method generates the needed vertex buffer & index data for this chunk.
- *  Note: the order of the vertex buffer is (pos, normal, uv, animatable flag).
- *  All of them are put in a vector<float>.
- * @return
+ * @brief Chunk::meshSectionGreedy
+ *  Every face direction and each of the section's 16 slices across it is
+ *  merged by mergeSlice.
+ * @param snap  : the section to mesh
+ * @param masks : its visible faces (see computeVisibleFaces)
+ * @param sy    : its index
+ * @param light : lit around it (see lightSections)
+ * @param mesh  : the merged quads are appended to their pass' list, see MeshFace
  */
-ChunkVBOdata Chunk::generateVBOdata()
+void Chunk::meshSectionGreedy(const SectionSnapshot &snap, const SectionFaceMasks &masks, int sy,
+                              const LightVolume &light, SectionMesh &mesh) const
 {
-    // init
-    ChunkVBOdata vbo = ChunkVBOdata((Chunk*)(this));
+    for (int f = 0; f < 6; f++) {
+        for (int slice = 0; slice < 16; slice++) {
+            mergeSlice(snap, masks, sy, light, f, slice, EMPTY, mesh);
+        }
+    }
+}
+
+/**
+ * @brief Chunk::mergeSlice
+ *  Mark the visible faces of the slice in a 16 x 16 (u, v) mask by block
+ *  type and shading, then cover the mask with maximal rectangles of one
+ *  type and shading: grow along u first, then along v while the whole row
+ *  matches. A rectangle has a single type, hence a single pass, so one mask
+ *  serves both passes; its faces shade their vertices alike, so its
+ *  corners do too.
+ * @param snap  : the section to mesh
+ * @param masks : its visible faces (see computeVisibleFaces)
+ * @param sy    : its index
+ * @param light : lit around it (see lightSections)
+ * @param f     : the face direction
+ * @param slice : the slice across f, in [0, 16)
+ * @param only  : the type of the faces merged, EMPTY for all
+ * @param mesh  : the merged quads are appended to their pass' list, see MeshFace
+ */
+void Chunk::mergeSlice(const SectionSnapshot &snap, const SectionFaceMasks &masks, int sy,
+                       const LightVolume &light, int f, int slice, BlockType only, SectionMesh &mesh) const
+{
+    const int n = faceAxes[f][0];
+    const int u = faceAxes[f][1];
+    const int v = faceAxes[f][2];
 
-    generateVBOdataDrawType(vbo, TerrainDrawType::opaque);
-    generateVBOdataDrawType(vbo, TerrainDrawType::transparent);
+    // EMPTY: no visible face
+    BlockType mask[16][16];
+    // the shading of each visible face
+    MeshFace shades[16][16];
+    auto matches = [&](int j, int i, BlockType blockType, const MeshFace &shade) {
+        return mask[j][i] == blockType && shades[j][i].light == shade.light
+                && shades[j][i].occlusion == shade.occlusion;
+    };
 
-    return vbo;
+    for (int j = 0; j < 16; j++) {
+        for (int i = 0; i < 16; i++) {
+            // local (x, y - 16 * sy, z)
+            int p[3];
+            p[n] = slice;
+            p[u] = i;
+            p[v] = j;
+
+            mask[j][i] = EMPTY;
+            if (!((masks.faces[f][p[0] + 16 * p[2]] >> p[1]) & 1)) {
+                continue;
+            }
+            BlockType blockType = snap.blocks[SectionSnapshot::index(p[0], p[1], p[2])];
+            if (only != EMPTY && blockType != only) {
+                continue;
+            }
+            mask[j][i] = blockType;
+            shades[j][i] = shadeFace(light, blockType, p[0], sy * 16 + p[1], p[2], f);
+        }
+    }
+
+    for (int j = 0; j < 16; j++) {
+        for (int i = 0; i < 16; ) {
+            BlockType blockType = mask[j][i];
+            if (blockType == EMPTY) {
+                i++;
+                continue;
+            }
+            MeshFace face = shades[j][i];
+
+            int width = 1;
+            while (i + width < 16 && matches(j, i + width, blockType, face)) {
+                width++;
+            }
+            int height = 1;
+            for (; j + height < 16; height++) {
+                bool rowMatches = true;
+                for (int k = i; k < i + width && rowMatches; k++) {
+                    rowMatches = matches(j + height, k, blockType, face);
+                }
+                if (!rowMatches) {
+                    break;
+                }
+            }
+            for (int dj = 0; dj < height; dj++) {
+                for (int k = i; k < i + width; k++) {
+                    mask[j + dj][k] = EMPTY;
+                }
+            }
+
+            int p[3];
+            p[n] = slice;
+            p[u] = i;
+            p[v] = j;
+            std::vector<MeshFace> &faces = Block::isOpaque(blockType) ? mesh.opaqueFaces : mesh.transparentFaces;
+            face.face = packFace(p[0], p[1], p[2], f, blockType, width, height);
+            faces.push_back(face);
+            i += width;
+        }
+    }
 }
 
 /**
- * @brief Chunk::generateVBOdata
- *  This method generates the needed vertex buffer & index data for this chunk.
- *  Note: the order of the vertex buffer is (pos, normal, uv, animatable flag).
- *  All of them are put in a vector<float>.
- * @param vbo, ChunkVBOdata
- * @param drawType, TerrainDrawType
+ * @brief Chunk::shadeFace
+ *  Smooth lighting and ambient occlusion: each vertex averages the light
+ *  of the non-opaque blocks among the four in front of the face around its
+ *  corner, and is occluded by the opaque ones. A corner block hidden
+ *  behind both side blocks counts as opaque. An emissive block's faces are
+ *  at least as bright as its emission.
+ * @param light : holds the blocks in front of the face and around them
+ * @param type
+ * @param x
+ * @param y
+ * @param z
+ * @param f     : face index
  * @return
  */
-void Chunk::generateVBOdataDrawType(ChunkVBOdata &vbo, TerrainDrawType drawType) {
+Chunk::MeshFace Chunk::shadeFace(const LightVolume &light, BlockType type, int x, int y, int z, int f)
+{
+    MeshFace shaded = {0, 0, 0};
+    const int n = faceAxes[f][0];
+    const int u = faceAxes[f][1];
+    const int v = faceAxes[f][2];
+    glm::ivec3 front(x, y, z);
+    front[n] += (f & 1) ? -1 : 1;
+    const std::array<VertexData, 4> &vertices = Block::getFaces(type)[f].vertices;
 
-    // basically, iterate through all the blocks contained in a chunk
-    // each chunk : 16 x 256 x 16
-    // each chunk contains the whole y axis [0-256)
-    int nVert = 0;
+    for (int k = 0; k < 4; k++) {
+        glm::ivec3 corner = glm::ivec3(vertices[k].pos);
+        glm::ivec3 du(0);
+        glm::ivec3 dv(0);
+        du[u] = corner[u] ? 1 : -1;
+        dv[v] = corner[v] ? 1 : -1;
+        // in front, beside it toward the corner along u and v, and across
+        const glm::ivec3 cells[4] = {front, front + du, front + dv, front + du + dv};
+        bool opaque[4];
+        for (int c = 0; c < 4; c++) {
+            opaque[c] = light.isOpaque(cells[c].x, cells[c].y, cells[c].z);
+        }
+        opaque[3] = opaque[3] || (opaque[1] && opaque[2]);
+        int occlusion = 3 - opaque[1] - opaque[2] - opaque[3];
 
-    // Used as the indices for triangulation
-    std::vector<GLuint> faceIndices = {0, 1, 2, 0, 2, 3};
-    glm::vec4 out = glm::vec4();
-    std::vector<float>* processingBuffer;
-    std::vector<GLuint>* processingIndices;
+        int skyLight = 0;
+        int blockLight = 0;
+        int count = 0;
+        for (int c = 0; c < 4; c++) {
+            if (!opaque[c]) {
+                skyLight += light.getSkyLight(cells[c].x, cells[c].y, cells[c].z);
+                blockLight += light.getBlockLight(cells[c].x, cells[c].y, cells[c].z);
+                count++;
+            }
+        }
+        if (count > 0) {
+            skyLight = (skyLight + count / 2) / count;
+            blockLight = (blockLight + count / 2) / count;
+        }
+        blockLight = std::max(blockLight, Block::getEmission(type));
 
-    switch (drawType) {
-    case (TerrainDrawType::opaque):
-        processingBuffer = &vbo.buffer;
-        processingIndices = &vbo.indices;
-        break;
-    case (TerrainDrawType::transparent):
-        processingBuffer = &vbo.transparentBuffer;
-        processingIndices = &vbo.transparentIndices;
-        break;
+        shaded.light |= static_cast<uint32_t>(skyLight << 4 | blockLight) << (8 * k);
+        shaded.occlusion |= static_cast<uint8_t>(occlusion << (2 * k));
     }
+    return shaded;
+}
 
-    for (int x = 0; x < 16; x++) {
-        for (int y = 0; y < 256; y++) {
-            for (int z = 0; z < 16; z++) {
+bool Chunk::hasAnimatedFaces(const std::vector<MeshFace> &faces)
+{
+    for (const MeshFace &face : faces) {
+        // the block type of packFace
+        if (Block::isAnimatable(static_cast<BlockType>((face.face >> 15) & 255))) {
+            return true;
+        }
+    }
+    return false;
+}
 
-                // get each block at (x, y, z) in this chunk
-                // remember, there are 6 faces for a block
-                BlockType blockType = getBlockAt(x, y, z);
+/**
+ * @brief Chunk::appendFaces
+ *  A quad of width x height blocks stretches the face's unit vertices along
+ *  its (u, v) axes and repeats the texture tile as often: uv grows past the
+ *  tile and the fragment shader wraps it back into the tile.
+ *  The shared element buffer splits a quad along its first and third
+ *  vertices; a quad brighter across the other diagonal starts at its second
+ *  vertex instead, so the shading interpolates along the brighter diagonal.
+ * @param faces   : the faces of one section
+ * @param sy      : the section's index
+ * @param vertexOut : packed vertices (see packVertex) are written here, 8 words per face
+ */
+void Chunk::appendFaces(const std::vector<MeshFace> &faces, int sy, uint32_t *&vertexOut) const
+{
 
-                if (!checkBlockDrawing(drawType, blockType)) {
-                    continue;
-                }
+    for (const MeshFace &meshFace : faces) {
+        uint32_t packed = meshFace.face;
+        int x = packed & 15;
+        int z = (packed >> 4) & 15;
+        int y = sy * 16 + ((packed >> 8) & 15);
+        int f = (packed >> 12) & 7;
+        BlockType blockType = static_cast<BlockType>((packed >> 15) & 255);
+        int width = ((packed >> 23) & 15) + 1;
+        int height = ((packed >> 27) & 15) + 1;
 
-                // iterate through each face and see if it has an opague neighbor
-                // Block::BlockCollection contains the faces of various kinds of blocks
-                for (const BlockFace &face : Block::BlockCollection[blockType]) {
+        const BlockFace &face = Block::getFaces(blockType)[f];
+        bool animatable = Block::isAnimatable(blockType);
 
-                    // the neighboring block might be in the neighboring chunk
-                    BlockType neighborBlockType = getNeighborBlock(x, y, z, face.normal);
+        glm::ivec3 scale(1);
+        scale[faceAxes[f][1]] = width;
+        scale[faceAxes[f][2]] = height;
+        // the first vertex sits at the tile's origin
+        glm::vec2 uvTile = face.vertices[0].uv;
+        int layer = Block::getFaceLayer(blockType, f);
+        glm::ivec2 uvScale(width, height);
 
-                    if (!checkBlockFaceDrawing(drawType, neighborBlockType)) {
-                        continue;
-                    }
+        int brightness[4];
+        for (int k = 0; k < 4; k++) {
+            int light = (meshFace.light >> (8 * k)) & 255;
+            brightness[k] = ((meshFace.occlusion >> (2 * k)) & 3) + std::max(light >> 4, light & 15);
+        }
+        int first = brightness[0] + brightness[2] < brightness[1] + brightness[3] ? 1 : 0;
 
-                    // add this face
-                    for (const VertexData &vert : face.vertices) {
-                        // buffer: pos0nor0col0uv0
-                        pushVec4ToBuffer(*processingBuffer, vert.pos + glm::vec4(x, y, z, 0));
-                        pushVec4ToBuffer(*processingBuffer, face.normal);
-                        pushVec2ToBuffer(*processingBuffer, vert.uv);
-                        pushVec2ToBuffer(*processingBuffer, Block::getAnimatableFlag(blockType));
-                    }
-                    // add indices for each face (4 vertices)
-                    for (int index : faceIndices) {
-                        (*processingIndices).push_back(nVert + index);
-                    }
-                    // move the offset for indices
-                    nVert += 4;
-                }
-            }
+        // add this face
+        for (int i = 0; i < 4; i++) {
+            int k = (first + i) & 3;
+            const VertexData &vert = face.vertices[k];
+            glm::ivec3 corner = glm::ivec3(vert.pos);
+            glm::ivec2 uvCorner = glm::ivec2(glm::round((vert.uv - uvTile) * 16.f));
+            int light = (meshFace.light >> (8 * k)) & 255;
+            packVertex(vertexOut, corner * scale + glm::ivec3(x, y, z), f, animatable, layer, uvCorner * uvScale,
+                       (meshFace.occlusion >> (2 * k)) & 3, light >> 4, light & 15);
         }
     }
 }
@@ -285,76 +1837,97 @@ bool Chunk::checkBlockFaceDrawing(TerrainDrawType drawType, BlockType neighborBl
 }
 
 
-/**
- * @brief Chunk::createVBOdata
- * @param vbo : ChunkVBOdata, contains the loaded interleaved vertex data and index data
- */
-void Chunk::createVBOdata(ChunkVBOdata &vbo)
+ChunkVBOdata::ChunkVBOdata(ChunkVBOdata &&other) noexcept
+    : mp_chunk(other.mp_chunk), buffer(std::move(other.buffer)),
+      transparentBuffer(std::move(other.transparentBuffer)),
+      quads(other.quads), transparentQuads(other.transparentQuads),
+      sectionQuadStarts(other.sectionQuadStarts),
+      transparentSectionQuadStarts(other.transparentSectionQuadStarts),
+      sectionConnectivity(other.sectionConnectivity),
+      animated(other.animated), transparentAnimated(other.transparentAnimated),
+      lights(std::move(other.lights)), relightsNeighbors(other.relightsNeighbors),
+      meshVersion(other.meshVersion), remeshedSections(other.remeshedSections), meshNs(other.meshNs),
+      mp_arena(other.mp_arena), range(other.range), transparentRange(other.transparentRange)
 {
-    // remember to set m_count
-    m_count = vbo.indices.size();
-    m_transparentCount = vbo.transparentIndices.size();
-
-    int bufferSize = vbo.buffer.size();
-    int transparentBufferSize = vbo.transparentBuffer.size();
-
-    generateIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), vbo.indices.data(), GL_STATIC_DRAW);
-
-    generatePos();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufPos);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, bufferSize * sizeof(float), vbo.buffer.data(), GL_STATIC_DRAW);
-
-    generateTransparentIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufTransparentIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_transparentCount * sizeof(GLuint), vbo.transparentIndices.data(), GL_STATIC_DRAW);
-
-    generateTransparentData();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufTransparentData);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, transparentBufferSize * sizeof(float), vbo.transparentBuffer.data(), GL_STATIC_DRAW);
-
-    // set to vboLoaded to true
-    vboLoaded = true;
-
-    return;
-
+    other.buffer.clear();
+    other.transparentBuffer.clear();
+    other.mp_arena = nullptr;
 }
 
 /**
- * @brief Chunk::createVBOdata
- * Generate the buffer for chunk rendering.
- * Note: each block & each block face are already created in block.h
- * Note: this is used only for MS1. In MS2 & MS3, vbo of each chunk
- * is hold by the terrain. Won't be generated on the fly here.
+ * @brief ChunkVBOdata::operator =
+ *  Any ranges this handle still had staged must have been discarded.
+ * @param other
+ * @return
  */
-void Chunk::createVBOdata()
+ChunkVBOdata &ChunkVBOdata::operator=(ChunkVBOdata &&other) noexcept
 {
-    ChunkVBOdata vbo = generateVBOdata();
-    createVBOdata(vbo);
+    if (this != &other) {
+        mp_chunk = other.mp_chunk;
+        buffer = std::move(other.buffer);
+        transparentBuffer = std::move(other.transparentBuffer);
+        quads = other.quads;
+        transparentQuads = other.transparentQuads;
+        sectionQuadStarts = other.sectionQuadStarts;
+        transparentSectionQuadStarts = other.transparentSectionQuadStarts;
+        sectionConnectivity = other.sectionConnectivity;
+        animated = other.animated;
+        transparentAnimated = other.transparentAnimated;
+        lights = std::move(other.lights);
+        relightsNeighbors = other.relightsNeighbors;
+        meshVersion = other.meshVersion;
+        remeshedSections = other.remeshedSections;
+        meshNs = other.meshNs;
+        mp_arena = other.mp_arena;
+        range = other.range;
+        transparentRange = other.transparentRange;
+        other.buffer.clear();
+        other.transparentBuffer.clear();
+        other.mp_arena = nullptr;
+    }
+    return *this;
 }
 
-
 /**
- * @brief Chunk::isVBOLoaded
- * @return
+ * @brief ChunkVBOdata::stage
+ * @param arena
+ * @return whether the buffers are in the arena now
  */
-bool Chunk::isVBOLoaded() const
+bool ChunkVBOdata::stage(ChunkMeshArena &arena)
 {
-    return vboLoaded;
-}
+    size_t bytes = buffer.size() * sizeof(uint32_t);
+    size_t transparentBytes = transparentBuffer.size() * sizeof(uint32_t);
+
+    ChunkMeshArena::Range r, tr;
+    if (!arena.allocate(slotBytes(bytes), r)) {
+        return false;
+    }
+    if (!arena.allocate(slotBytes(transparentBytes), tr)) {
+        arena.discard(r);
+        return false;
+    }
+    arena.write(r, buffer.data(), bytes);
+    arena.write(tr, transparentBuffer.data(), transparentBytes);
 
+    mp_arena = &arena;
+    range = r;
+    transparentRange = tr;
+    decltype(buffer)().swap(buffer);
+    decltype(transparentBuffer)().swap(transparentBuffer);
+    return true;
+}
 
-/**
- * @brief Chunk::destroyVBOdata
- */
-void Chunk::destroyVBOdata()
+void ChunkVBOdata::discardStaged()
 {
-    Drawable::destroyVBOdata();
-    vboLoaded = false;
+    if (mp_arena != nullptr) {
+        mp_arena->discard(range);
+        mp_arena->discard(transparentRange);
+        mp_arena = nullptr;
+    }
 }
 
 
 
-Chunk::~Chunk(){}
+Chunk::~Chunk()
+{}
 
@@ -1,15 +1,26 @@
 #pragma once
-#include "drawable.h"
 #include "smartpointerhelp.h"
 #include "glm_includes.h"
 #include "block.h"
 #include "utils.h"
+#include "blocksection.h"
+#include "chunkmesharena.h"
+#include "chunknavigation.h"
+#include "lightvolume.h"
+#include "memorystats.h"
+#include "pointlight.h"
 #include <array>
+#include <atomic>
 #include <unordered_map>
 #include <cstddef>
-#include <openglcontext.h>
+#include <cstdint>
+#include <vector>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QMutex>
 
 class Chunk;
+class MeshCache;
 
 // this struct is used to hold the VBO data of a given chunk
 // identified by (x, z) coord
@@ -18,23 +29,129 @@ struct ChunkVBOdata
     // keep a pointer of the chunk
     Chunk* mp_chunk;
 
+    // No indices: every chunk draws its quads (4 vertices each, in order)
+    // with the shared element buffer of ChunkDrawable::reserveQuadIndices.
+
     // MS1 - opaque
-    std::vector<GLuint> indices;
-    // order: pos (vec4) + normal (vec4) + color (vec4) + uv (vec2)
-    std::vector<float> buffer;
+    // two packed words per vertex (see packVertex in chunk.cpp)
+    TrackedVector<uint32_t, MemoryCategory::meshData> buffer;
 
     // MS2: add transparent part
-    std::vector<GLuint> transparentIndices;
-    // order: pos (vec4) + normal (vec4) + color (vec4) + uv (vec2)
-    std::vector<float> transparentBuffer;
+    // two packed words per vertex (see packVertex in chunk.cpp)
+    TrackedVector<uint32_t, MemoryCategory::meshData> transparentBuffer;
+
+    size_t quads;
+    size_t transparentQuads;
+
+    // the first quad of each section in each buffer, then the total:
+    // section sy holds quads [starts[sy], starts[sy + 1])
+    std::array<uint32_t, 17> sectionQuadStarts;
+    std::array<uint32_t, 17> transparentSectionQuadStarts;
+    // per section, which of its faces see each other through non-opaque
+    // blocks, one bit per pair (see Chunk::connectsFaces)
+    std::array<uint32_t, 16> sectionConnectivity;
+    // each buffer has faces of animatable blocks (see Block::isAnimatable),
+    // so its pass needs the animated shader permutation
+    bool animated;
+    bool transparentAnimated;
+
+    // the lights of the chunk's emissive blocks, every section's
+    std::vector<PointLight> lights;
+
+    // the chunk's edits changed the light of the chunks around it, whose
+    // sections are marked dirty; the main thread remeshes them
+    bool relightsNeighbors;
+
+    // which meshing of the chunk this is, and the sections it remeshed: the
+    // others are as the meshing before left them, so uploading over that
+    // one's mesh only needs what changed (see ChunkDrawable::updateInPlace)
+    uint32_t meshVersion;
+    uint32_t remeshedSections;
+    // how long generateVBOdata took to make it, waiting on the chunk included
+    qint64 meshNs;
+
+    // Once stage()d, the buffers are in these ranges of mp_arena and the
+    // vectors are empty; the ChunkDrawable uploading it takes the ranges over
+    ChunkMeshArena *mp_arena;
+    ChunkMeshArena::Range range;
+    ChunkMeshArena::Range transparentRange;
 
     // constructors
     ChunkVBOdata(Chunk* chunk)
-        : mp_chunk(chunk), indices(), buffer(),
-          transparentIndices(), transparentBuffer() {}
+        : mp_chunk(chunk), buffer(), transparentBuffer(),
+          quads(0), transparentQuads(0),
+          sectionQuadStarts(), transparentSectionQuadStarts(), sectionConnectivity(),
+          animated(false), transparentAnimated(false), lights(), relightsNeighbors(false),
+          meshVersion(0), remeshedSections(0), meshNs(0),
+          mp_arena(nullptr), range{0, 0}, transparentRange{0, 0} {}
+
+    // Move-only, so a mesh is never duplicated on its way from the worker
+    // to the upload; a moved-from handle holds no buffers and no ranges
+    ChunkVBOdata(const ChunkVBOdata &) = delete;
+    ChunkVBOdata &operator=(const ChunkVBOdata &) = delete;
+    ChunkVBOdata(ChunkVBOdata &&other) noexcept;
+    ChunkVBOdata &operator=(ChunkVBOdata &&other) noexcept;
+
+    // the number of quads in each buffer
+    size_t quadCount() const {
+        return quads;
+    }
+    size_t transparentQuadCount() const {
+        return transparentQuads;
+    }
+
+    // Copy both buffers into the arena and free them; false (nothing
+    // changed) if the arena has no room. Any thread if the arena is mapped.
+    bool stage(ChunkMeshArena &arena);
+    // free the staged ranges of a result that will never be uploaded
+    void discardStaged();
+
+    // The bytes a buffer of `bytes` is given, in the arena or its own:
+    // room for a few more quads, so the remesh of an edit usually fits
+    // where the mesh was (see ChunkDrawable::updateInPlace)
+    static size_t slotBytes(size_t bytes) {
+        return bytes == 0 ? 0 : bytes + bytes / 16 + 256;
+    }
+
+    // the bytes the main thread still copies to upload it (none once staged)
+    size_t uploadBytes() const {
+        return (buffer.size() + transparentBuffer.size()) * sizeof(uint32_t);
+    }
+    // the bytes of the mesh on the GPU once uploaded, staged or not
+    size_t meshBytes() const {
+        return mp_arena != nullptr ? range.size + transparentRange.size : uploadBytes();
+    }
 
 };
 
+// The generation stages a chunk goes through, in order.
+// A chunk is only meshed once it is decorated.
+enum class GenerationStage : unsigned char
+{
+    none,       // instantiated, all EMPTY
+    shaped,     // surface columns, dirt band & bedrock (zone task)
+    carved,     // caves & lava
+    featured,   // trees
+    decorated   // floating islands, NPC jump stages
+};
+
+// What the block types of one 16 x 16 x 16 section let the mesher assume
+struct SectionFlags
+{
+    bool allEmpty;
+    bool allOpaque;
+    // holds a block of the opaque / transparent pass
+    bool hasOpaque;
+    bool hasTransparent;
+};
+
+// The blocks of a chunk at one moment, sharing the sections' data (see
+// BlockSection::Snapshot): taking one costs 16 pointer copies
+struct ChunkBlocks
+{
+    std::array<BlockSection::Snapshot, 16> sections;
+};
+
 // One Chunk is a 16 x 256 x 16 section of the world,
 // containing all the Minecraft blocks in that area.
 // We divide the world into Chunks in order to make
@@ -42,25 +159,235 @@ struct ChunkVBOdata
 // render all the world at once, while also not having
 // to render the world block by block.
 
-// have Chunk inherit from Drawable
-class Chunk : public Drawable {
+// Threads and block data:
+//  - One writer at a time per chunk. Until the chunk is decorated that is
+//    the worker of its current stage (stages of one chunk never overlap,
+//    and a stage only writes its own chunk); afterwards only the main
+//    thread writes it (edits, structures), each batch of writes bracketed
+//    by beginWrite() / endWrite().
+//  - Readers (workers meshing this chunk or a neighbor) take no lock: every
+//    block read is atomic (see BlockSection), the chunk is pinned while
+//    they run so replaced section data outlives them, and a snapshot that
+//    overlapped a write batch is taken again (see readBegin()).
+//  - A chunk is meshed only once it and its neighbors are decorated, so
+//    generation writes never race a mesh that is kept; one landing mid-mesh
+//    re-dirties its section and the chunk is meshed again.
+//  - Neighbor links change on the main thread only and are published with
+//    release, so a worker following one sees the whole neighbor.
+//  - The navigation layer is built as the chunk becomes decorated and
+//    follows every setBlockAt after; path searches read it the same way.
+
+// The world's side of a chunk only: its mesh is uploaded into a
+// ChunkDrawable (see Terrain), so a Chunk needs no GL context.
+class Chunk {
 private:
-    // All of the blocks contained within this Chunk
-    std::array<BlockType, 65536> m_blocks;
-    // This Chunk's four neighbors to the north, south, east, and west
-    // The third input to this map just lets us use a Direction as
-    // a key for this map.
-    // These allow us to properly determine
-    std::unordered_map<Direction, Chunk*, EnumHash> m_neighbors;
+    // All of the blocks contained within this Chunk, as 16 palette-compressed
+    // 16 x 16 x 16 sections stacked bottom to top.
+    std::array<BlockSection, 16> m_sections;
+
+    // workers currently reading this chunk (see pin())
+    std::atomic<int> m_pinCount;
+    // seqlock over main-thread write batches: odd while one is open
+    std::atomic<uint32_t> m_writeSequence;
+
+    // A face as the mesher caches it: where and what (see packFace), and
+    // its four vertices' shading, in the order of BlockFace::vertices
+    struct MeshFace
+    {
+        uint32_t face;
+        // 8 bits per vertex: sky light << 4 | block light
+        uint32_t light;
+        // 2 bits per vertex: 3 - the opaque blocks around its corner
+        uint8_t occlusion;
+    };
+    // Faces of each section from the last meshing, so an edit only
+    // remeshes the sections it touched
+    struct SectionMesh
+    {
+        std::vector<MeshFace> opaqueFaces;
+        std::vector<MeshFace> transparentFaces;
+        // which of the section's faces see each other (see connectsFaces)
+        uint32_t connectivity;
+        // of its emissive blocks with a face drawn
+        std::vector<PointLight> lights;
+    };
+    std::array<SectionMesh, 16> m_sectionMeshes;
+    // bit sy: section sy changed since it was last meshed
+    std::atomic<uint32_t> m_dirtySections;
+    // bit sy: a block of section sy was written since the last meshing, so
+    // the light around it may have changed, here and in the neighborhood
+    std::atomic<uint32_t> m_changedSections;
+    // 1 + the highest opaque block of each column (x + 16 * z) as of the
+    // last meshing, which lit the chunk if m_lightValid; under m_meshLock
+    std::array<int16_t, 256> m_skyTops;
+    bool m_lightValid;
+    // how many times generateVBOdata ran, under m_meshLock; kept by reset()
+    // so a mesh of the chunk's last corner never passes for a successor
+    uint32_t m_meshVersion;
+    // generateVBOdata may be called from several threads for one chunk
+    QMutex m_meshLock;
 
-    // get neighboring block
-    BlockType getNeighborBlock(int x, int y, int z, glm::vec4 dirVec) const;
+    // 1 + the highest non-empty block of each column (x + 16 * z), and
+    // 1 + the highest opaque one; 0 where there is none. Kept by every
+    // write, by the chunk's one writer at a time (see above)
+    std::array<std::atomic<uint16_t>, 256> m_columnTops;
+    std::array<std::atomic<uint16_t>, 256> m_opaqueTops;
+    // the highest column top, and a y at or below every non-empty block
+    // (exact as of the last recomputeHeights, lowered by writes since)
+    std::atomic<int> m_occupiedTop;
+    std::atomic<int> m_occupiedBottom;
+    // after a write of t at (x, y, z)
+    void updateHeights(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
+        unsigned int column = x + 16 * z;
+        uint16_t above = static_cast<uint16_t>(y + 1);
+        uint16_t top = m_columnTops[column].load(std::memory_order_relaxed);
+        uint16_t opaqueTop = m_opaqueTops[column].load(std::memory_order_relaxed);
+        if (Block::isEmpty(t)) {
+            if (top == above || opaqueTop == above) {
+                lowerColumnTops(x, z);
+            }
+            return;
+        }
+        if (top < above) {
+            m_columnTops[column].store(above, std::memory_order_relaxed);
+            if (m_occupiedTop.load(std::memory_order_relaxed) < above) {
+                m_occupiedTop.store(above, std::memory_order_relaxed);
+            }
+        }
+        if (Block::isOpaque(t)) {
+            if (opaqueTop < above) {
+                m_opaqueTops[column].store(above, std::memory_order_relaxed);
+            }
+        } else if (opaqueTop == above) {
+            lowerColumnTops(x, z);
+        }
+        if (static_cast<int>(y) < m_occupiedBottom.load(std::memory_order_relaxed)) {
+            m_occupiedBottom.store(static_cast<int>(y), std::memory_order_relaxed);
+        }
+    }
+    // the column's top block went: scan down for the new tops
+    void lowerColumnTops(unsigned int x, unsigned int z);
+    // every height from the blocks, once they were replaced wholesale
+    void recomputeHeights();
+    // This Chunk's four neighbors to the north, south, east, and west,
+    // at neighborIndex(dir); null where there is none.
+    // These allow us to properly determine the faces on our borders
+    std::array<std::atomic<Chunk*>, 4> m_neighbors;
 
-    // TODO: a member variable to mark vboLoaded
-    bool vboLoaded;
+    // One section and a one-block border around it, from the sections
+    // above and below and the four neighbor chunks, copied once so the
+    // mesher reads neither live data nor across chunks. Border blocks past
+    // the world or a missing neighbor are EMPTY; the edges and corners of
+    // the border are never read and stay EMPTY. Taken again until no write
+    // batch on the chunk or a neighbor overlapped it.
+    struct SectionSnapshot
+    {
+        static const int size = BlockSection::size + 2;
+        // y fastest, like BlockSection::localIndex
+        std::array<BlockType, size * size * size> blocks;
 
-    // generate the vbo data associate with the block type, called by generateVBOdata()
-    void generateVBOdataDrawType(ChunkVBOdata &vbo, TerrainDrawType drawType);
+        // (x, y, z) local to the section, each in [-1, 16]
+        static int index(int x, int y, int z) {
+            return (y + 1) + size * ((x + 1) + size * (z + 1));
+        }
+    };
+    void snapshotSection(int sy, SectionSnapshot &snap) const;
+
+    // Bit y of faces[f][x + 16 * z]: face f of the section's block at
+    // (x, y, z) is drawn, in its block's pass
+    struct SectionFaceMasks
+    {
+        std::array<std::array<uint16_t, 256>, 6> faces;
+    };
+    // every visible face of a snapshot at once, a column of bits at a time
+    static void computeVisibleFaces(const SectionSnapshot &snap, bool skipOpaque, bool skipTransparent,
+                                    SectionFaceMasks &masks);
+    // one attempt at it, reading the given neighbors
+    void copySection(int sy, SectionSnapshot &snap, const Chunk *xneg, const Chunk *xpos,
+                     const Chunk *zneg, const Chunk *zpos) const;
+
+    // flood fill the non-opaque blocks of a section, pairing the faces
+    // each connected region touches
+    uint32_t computeConnectivity(int sy) const;
+
+    // world-space corner of this chunk
+    int m_xCorner;
+    int m_zCorner;
+
+    // set by the generation workers, read by the scheduler on the main thread
+    std::atomic<GenerationStage> m_generationStage;
+
+    // edited since it was generated or loaded, so it cannot just be
+    // regenerated from the seed (main thread only)
+    bool m_modified;
+
+    // where NPCs may walk, for the path searches
+    ChunkNavigation m_navigation;
+
+    // the faces of section sy for both passes in one walk, shaded by light, appended to mesh
+    void meshSection(int sy, const LightVolume &light, SectionMesh &mesh) const;
+    // the same faces merged into maximal rectangles of one type and shading per slice
+    void meshSectionGreedy(const SectionSnapshot &snap, const SectionFaceMasks &masks, int sy,
+                           const LightVolume &light, SectionMesh &mesh) const;
+    // merge the visible faces of direction f in one slice, of one type
+    // (EMPTY: of any), into rectangles
+    void mergeSlice(const SectionSnapshot &snap, const SectionFaceMasks &masks, int sy,
+                    const LightVolume &light, int f, int slice, BlockType only, SectionMesh &mesh) const;
+    // the shading of face f of a block of the given type at (x, y, z),
+    // chunk-local with world y; face left 0
+    static MeshFace shadeFace(const LightVolume &light, BlockType type, int x, int y, int z, int f);
+    // The lights of section sy's emissive blocks that have a face drawn:
+    // one per lightCellSize^3 cell holding any, at their center, as far
+    // reaching as the brightest; appended to lights
+    static const int lightCellSize = 4;
+    void collectSectionLights(const SectionSnapshot &snap, const SectionFaceMasks &masks, int sy,
+                              std::vector<PointLight> &lights) const;
+    // does any of the faces belong to an animatable block?
+    static bool hasAnimatedFaces(const std::vector<MeshFace> &faces);
+
+    // the chunk and its neighborhood, [dz + 1][dx + 1] ([1][1]: this one),
+    // null where there is none
+    std::array<std::array<Chunk*, 3>, 3> getNeighborhoodGrid();
+    // 1 + the highest opaque block of each column of the light's footprint
+    // (see lightSections), x fastest; 256 (no sky) where there is no chunk
+    static std::vector<int> computeSkyTops(const std::array<std::array<Chunk*, 3>, 3> &grid);
+    // Light the sections of the bit set and the border around them from the
+    // blocks of the neighborhood, as the mesher reads it
+    static void lightSections(uint32_t sections, const std::array<std::array<Chunk*, 3>, 3> &grid,
+                              const std::vector<int> &skyTops, LightVolume &light);
+    // can section sy produce no face in the given pass?
+    bool canSkipSection(int sy, TerrainDrawType drawType) const;
+    // expand the packed faces of section sy into packed vertices,
+    // written through (and advancing) the output pointer
+    void appendFaces(const std::vector<MeshFace> &faces, int sy, uint32_t *&vertexOut) const;
+
+    // mesh with meshSectionGreedy (see setGreedyMeshing)
+    static std::atomic<bool> s_greedyMeshing;
+    // order the opaque faces for overdraw (see setOverdrawOrdering)
+    static std::atomic<bool> s_overdrawOrdering;
+    static void orderFacesForOverdraw(std::vector<MeshFace> &faces);
+
+    // Bump whenever the mesher's output for the same blocks changes, so
+    // the meshes cached by older builds are misses (see MeshCache)
+    static const uint32_t mesherVersion = 1;
+    // what a full meshing of the chunk depends on: the neighborhood's
+    // blocks (and which neighbors exist), the mesher's version and settings
+    static uint64_t meshCacheKey(const std::array<std::array<Chunk*, 3>, 3> &grid);
+    // every section's faces, connectivity and lights, for the MeshCache;
+    // deserializing replaces them only if the whole encoding is well formed
+    void serializeSectionMeshes(QByteArray &out) const;
+    bool deserializeSectionMeshes(const QByteArray &in);
+
+    static void setSectionBit(std::atomic<uint32_t> &sections, unsigned int sy) {
+        uint32_t bit = 1u << sy;
+        // plain load first: generation writes mostly hit sections already marked
+        if (!(sections.load(std::memory_order_relaxed) & bit)) {
+            sections.fetch_or(bit);
+        }
+    }
+    void markSectionDirtyIndex(unsigned int sy) {
+        setSectionBit(m_dirtySections, sy);
+    }
 
     // check if current block needs to be drawn
     bool checkBlockDrawing(TerrainDrawType drawType, BlockType blockType) const ;
@@ -69,33 +396,183 @@ private:
     bool checkBlockFaceDrawing(TerrainDrawType drawType, BlockType neighborBlockType) const ;
 
 public:
-    // constructor as a subclass of Drawable
-    Chunk(OpenGLContext *context);
+    Chunk(int xCorner, int zCorner);
+    // Make an evicted chunk a new one at another corner, as if just
+    // constructed (see ChunkPool); main thread, unlinked and unpinned
+    void reset(int xCorner, int zCorner);
+
+    glm::ivec2 getCorner() const;
+
+    GenerationStage getGenerationStage() const;
+    void setGenerationStage(GenerationStage stage);
     BlockType getBlockAt(unsigned int x, unsigned int y, unsigned int z) const;
     BlockType getBlockAt(int x, int y, int z) const;
     void setBlockAt(unsigned int x, unsigned int y, unsigned int z, BlockType t);
+
+    // No bounds checking: only for callers already iterating within 16 x 256 x 16
+    BlockType getBlockAtUnchecked(unsigned int x, unsigned int y, unsigned int z) const {
+        return m_sections[y >> 4].get(BlockSection::localIndex(x, y & 15, z));
+    }
+    void setBlockAtUnchecked(unsigned int x, unsigned int y, unsigned int z, BlockType t) {
+        m_sections[y >> 4].set(BlockSection::localIndex(x, y & 15, z), t);
+        updateHeights(x, y, z, t);
+        markSectionDirtyIndex(y >> 4);
+        setSectionBit(m_changedSections, y >> 4);
+        // the faces across a section boundary belong to the section beyond it
+        if ((y & 15) == 0 && y > 0) {
+            markSectionDirtyIndex((y >> 4) - 1);
+        } else if ((y & 15) == 15 && y < 255) {
+            markSectionDirtyIndex((y >> 4) + 1);
+        }
+    }
+
+    // the occupancy of section sy's bricks (see BlockSection::getOccupiedBricks)
+    uint64_t getOccupiedBricks(int sy) const {
+        return m_sections[sy].getOccupiedBricks();
+    }
+
+    SectionFlags getSectionFlags(int sy) const;
+    // whether a block type of section sy's palette satisfies f; like the
+    // flags, a stale palette may name types no block has any more
+    template<typename F>
+    bool anySectionType(int sy, F f) const {
+        bool found = false;
+        m_sections[sy].forEachType([&found, &f](BlockType t) {
+            found = found || f(t);
+        });
+        return found;
+    }
+
+    // 1 + the highest non-empty block of the column (x, z), 0 if none
+    int getColumnTop(unsigned int x, unsigned int z) const {
+        return m_columnTops[x + 16 * z].load(std::memory_order_relaxed);
+    }
+    // 1 + the highest opaque block of the column: where its sky light starts
+    int getOpaqueTop(unsigned int x, unsigned int z) const {
+        return m_opaqueTops[x + 16 * z].load(std::memory_order_relaxed);
+    }
+    // every non-empty block has a y in [getOccupiedBottom(), getOccupiedTop())
+    int getOccupiedBottom() const {
+        return m_occupiedBottom.load(std::memory_order_relaxed);
+    }
+    int getOccupiedTop() const {
+        return m_occupiedTop.load(std::memory_order_relaxed);
+    }
+    // remesh the section holding y (e.g. a neighbor chunk's border block changed)
+    void markSectionDirty(unsigned int y);
+    // remesh every section (e.g. a neighbor chunk appeared or was rebuilt)
+    void markAllSectionsDirty();
+    // remesh the sections of the bit set (e.g. a neighbor's edit changed their light)
+    void markSectionsDirty(uint32_t sections);
+    // Nothing changed since generateVBOdata() last ran, so running it again
+    // only expands the cached section faces
+    bool isMeshCurrent() const;
+
+    // set the blocks at y in [yBegin, yEnd) of the column (x, z) to t
+    void fillColumn(unsigned int x, unsigned int z, unsigned int yBegin, unsigned int yEnd, BlockType t);
+    // write the blocks at y in [yBegin, yEnd) of the column (x, z) to out, lowest first
+    void copyColumn(unsigned int x, unsigned int z, unsigned int yBegin, unsigned int yEnd, BlockType *out) const;
+
     void linkNeighbor(uPtr<Chunk>& neighbor, Direction dir);
+    // detach from every neighbor before this chunk is deleted;
+    // main thread, with neither this chunk nor its neighbors pinned
+    void unlinkNeighbors();
+
+    bool isModified() const;
+    void setModified(bool modified);
+
+    // only navigable once decorated (see ChunkNavigation)
+    const ChunkNavigation &getNavigation() const;
+
+    // the blocks of every section in their palette encoding (see BlockSection::serialize)
+    void serializeBlocks(std::vector<uint8_t> &out) const;
+
+    // The chunk's blocks with the columns of the eight neighbors along its
+    // sides and corners (EMPTY where there is none), for the compute
+    // mesher: blocks[(x + 1) + w * ((z + 1) + w * y)] with w = blockVolumeWidth
+    // and x, z in [-1, 16], and each column's getOpaqueTop at [(x + 1) + w * (z + 1)]
+    static const int blockVolumeWidth = 18;
+    void copyBlockVolume(uint8_t *blocks, int *opaqueTops) const;
+    // The blocks of section sy in BlockSection::localIndex order, for the
+    // far field (see FarField); false, with only blocks[0] written, if the
+    // section holds a single type
+    bool copySectionBlocks(int sy, BlockType *blocks) const;
+    // replace the blocks by a serializeBlocks() encoding; false (and all EMPTY) if it is malformed
+    bool deserializeBlocks(const uint8_t *data, size_t size);
+    // The blocks as they are, e.g. for undo or a backup; on a worker
+    // thread, retried while a write batch overlaps it
+    ChunkBlocks snapshotBlocks() const;
+    // replace the blocks by a snapshot's; the main thread inside a write
+    // batch, or the chunk's writer before it is decorated
+    void restoreBlocks(const ChunkBlocks &blocks);
+    // Give each section still holding `from`'s data `to`'s (the same
+    // blocks in another layout, see BlockSection::relayout); the same
+    // threads as restoreBlocks. Returns the sections replaced
+    int replaceSections(const ChunkBlocks &from, const ChunkBlocks &to);
+
+    // Bracket a batch of main-thread writes to a decorated chunk, so
+    // snapshots see all of it or none of it; batches do not nest
+    void beginWrite();
+    void endWrite();
+    // The write sequence once no batch is open (waits one out), and
+    // whether a batch opened since a readBegin() of `sequence`
+    uint32_t readBegin() const;
+    bool readRetry(uint32_t sequence) const;
 
-    // createVBOData needs to be implemented as a subclass of Drawable
-    // since chunk's drawMode is still GL_TRIANGLES, no need to implement drawMode() here.
-    virtual void createVBOdata() override;
+    // Workers pin the chunks they read for the length of their run, so
+    // the main thread knows when the sections' retired data can be freed
+    void pin();
+    void unpin();
+    bool isPinned() const;
 
-    // this generates the vbo data for further rendering
-    ChunkVBOdata generateVBOdata();
+    // shrink every section's palette once generation has settled, and
+    // share the sections identical to others (see BlockSection::intern)
+    void compactSections();
+    // free the section data replaced by writes; main thread, only when !isPinned()
+    bool hasRetiredSections() const;
+    void reclaimRetiredSections();
+    // heap bytes of the block storage
+    size_t blockMemoryUsage() const;
 
-    // this takes ChunkVBOdata in and buffers them into this Chunk (Drawable)
-    void createVBOdata(ChunkVBOdata &vbo);
+    // this generates the vbo data for further rendering; a meshing of
+    // every section first looks for its faces in meshCache (if any), and
+    // stores them there when it had to make them
+    ChunkVBOdata generateVBOdata(MeshCache *meshCache = nullptr);
 
-    // return the map of the neighbors
-    std::unordered_map<Direction, Chunk*, EnumHash> getNeighbors() const;
+    // Can a line of sight entering a section through face `from` leave it
+    // through face `to`, given the section's connectivity bits (see
+    // ChunkVBOdata::sectionConnectivity)?
+    static bool connectsFaces(uint32_t connectivity, Direction from, Direction to);
 
-    // check whether the VBO of a chunk is loaded or not
-    bool isVBOLoaded() const;
+    // Merge coplanar faces of one block type into larger quads from the
+    // next remeshed section on (Terrain::setGreedyMeshing remeshes all)
+    static void setGreedyMeshing(bool enabled);
+    static bool isGreedyMeshing();
+    // Order each remeshed section's opaque faces outside in, so the faces
+    // that hide others are mostly drawn first (on by default)
+    static void setOverdrawOrdering(bool enabled);
+    static bool isOverdrawOrdering();
 
-    // helper method to destroy vbo and set isVBOLoaded to false
-    void destroyVBOdata();
+    // slot of a horizontal direction (XPOS, XNEG, ZPOS, ZNEG) in getNeighbors()
+    static unsigned int neighborIndex(Direction dir) {
+        return dir < ZPOS ? dir : dir - 2;
+    }
+    // the four neighbors, null where there is none
+    std::array<Chunk*, 4> getNeighbors() const {
+        return {getNeighbor(XPOS), getNeighbor(XNEG), getNeighbor(ZPOS), getNeighbor(ZNEG)};
+    }
+    // the neighbor in one of XPOS, XNEG, ZPOS, ZNEG, or null
+    Chunk *getNeighbor(Direction dir) const {
+        return m_neighbors[neighborIndex(dir)].load(std::memory_order_acquire);
+    }
+    // the chunk across the corner between xDir (XPOS or XNEG) and zDir
+    // (ZPOS or ZNEG), found through either neighbor; null if neither links it
+    Chunk *getDiagonalNeighbor(Direction xDir, Direction zDir) const;
+    // the four neighbors, then the four diagonal ones, null where there is
+    // none: every chunk whose blocks light this one (see LightVolume)
+    std::array<Chunk*, 8> getNeighborhood() const;
 
-    virtual ~Chunk();
+    ~Chunk();
 };
 
 
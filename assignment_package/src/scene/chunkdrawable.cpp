@@ -0,0 +1,450 @@
+#include "chunkdrawable.h"
+#include "memorystats.h"
+#include "renderbackend.h"
+#include "shaderprogram.h"
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+ChunkDrawable::ChunkDrawable(OpenGLContext *context, Chunk *chunk, ChunkBufferPool *pool)
+    : Drawable(context), mp_chunk(chunk),
+      mp_arena(nullptr), m_arenaRange{0, 0}, m_transparentArenaRange{0, 0}, m_gpuBytes(0),
+      m_capacity(0), m_transparentCapacity(0), mp_pool(pool), m_meshVersion(0),
+      m_sectionQuadStarts(), m_transparentSectionQuadStarts(), m_sectionConnectivity(),
+      m_animated(false), m_transparentAnimated(false), m_lights(), m_meshNs(0), m_uploadCount(0),
+      m_vao(0), m_transparentVao(0), m_vaoGenerated(false), m_renderIndex(0)
+{}
+
+/**
+ * @brief ChunkDrawable::createVBOdata
+ * @param vbo : ChunkVBOdata, contains the loaded interleaved vertex data and index data
+ * @param arena
+ * @return the bytes copied to the GPU
+ */
+size_t ChunkDrawable::createVBOdata(ChunkVBOdata &vbo, ChunkMeshArena *arena)
+{
+    reserveQuadIndices(mp_context, std::max(vbo.quadCount(), vbo.transparentQuadCount()));
+
+    // before the section starts are replaced: it compares them
+    size_t copied = 0;
+    bool inPlace = updateInPlace(vbo, copied);
+
+    // remember to set m_count: 6 indices per quad
+    m_count = vbo.quadCount() * 6;
+    m_transparentCount = vbo.transparentQuadCount() * 6;
+
+    m_sectionQuadStarts = vbo.sectionQuadStarts;
+    m_transparentSectionQuadStarts = vbo.transparentSectionQuadStarts;
+    m_sectionConnectivity = vbo.sectionConnectivity;
+    m_animated = vbo.animated;
+    m_transparentAnimated = vbo.transparentAnimated;
+    m_lights = std::move(vbo.lights);
+    m_meshVersion = vbo.meshVersion;
+    m_meshNs = vbo.meshNs;
+    m_uploadCount++;
+
+    if (inPlace) {
+        // same buffers, same offsets: the VAOs stand
+        return copied;
+    }
+
+    // the previous mesh may still be drawn by frames in flight
+    releaseArenaRanges();
+
+    // a worker may have staged it already (mapped arenas)
+    if (vbo.mp_arena == nullptr && arena != nullptr && arena->isCreated()) {
+        vbo.stage(*arena);
+    }
+
+    copied = vbo.meshBytes();
+    MemoryStats::sub(MemoryCategory::gpuMeshes, m_gpuBytes);
+
+    if (vbo.mp_arena != nullptr) {
+        m_gpuBytes = vbo.meshBytes();
+        mp_arena = vbo.mp_arena;
+        m_arenaRange = vbo.range;
+        m_transparentArenaRange = vbo.transparentRange;
+        vbo.mp_arena = nullptr;
+    } else {
+        // the arena is full (or off): this chunk's own buffers, reused across
+        // uploads, with the room to take later edits in place
+        fillOwnBuffer(m_bufPos, m_posGenerated, m_capacity, vbo.buffer.data(),
+                      vbo.buffer.size() * sizeof(uint32_t));
+        fillOwnBuffer(m_bufTransparentData, m_transparentDataGenerated, m_transparentCapacity,
+                      vbo.transparentBuffer.data(), vbo.transparentBuffer.size() * sizeof(uint32_t));
+        m_gpuBytes = m_capacity + m_transparentCapacity;
+    }
+    MemoryStats::add(MemoryCategory::gpuMeshes, m_gpuBytes);
+
+    setUpVAOs();
+    return copied;
+}
+
+/**
+ * @brief ChunkDrawable::fillOwnBuffer
+ *  A pooled buffer is kept while the mesh stays in its size class and
+ *  traded for one of the new class otherwise; either way it is only
+ *  copied into. An own one is reallocated on every upload.
+ * @param buffer
+ * @param generated
+ * @param capacity : set to the buffer's new size
+ * @param data
+ * @param bytes
+ */
+void ChunkDrawable::fillOwnBuffer(GLuint &buffer, bool &generated, size_t &capacity, const uint32_t *data,
+                                  size_t bytes)
+{
+    if (mp_pool != nullptr) {
+        size_t wanted = ChunkBufferPool::bucketBytes(ChunkVBOdata::slotBytes(bytes));
+        if (generated && capacity != wanted) {
+            mp_pool->releaseBuffer(buffer, capacity);
+            generated = false;
+        }
+        if (!generated) {
+            buffer = mp_pool->acquireBuffer(wanted);
+            generated = true;
+        }
+        capacity = wanted;
+        mp_context->glBindBuffer(GL_ARRAY_BUFFER, buffer);
+    } else {
+        capacity = ChunkVBOdata::slotBytes(bytes);
+        if (!generated) {
+            mp_context->glGenBuffers(1, &buffer);
+            generated = true;
+        }
+        mp_context->glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        mp_context->glBufferData(GL_ARRAY_BUFFER, capacity, nullptr, GL_STATIC_DRAW);
+    }
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, data);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/**
+ * @brief changedQuads
+ *  The sections below the lowest remeshed one are where they were; the
+ *  ones above the highest too, unless the remeshed ones changed size.
+ * @param uploaded : the section starts of the uploaded mesh
+ * @param starts   : and of its successor
+ * @param remeshed : the sections the successor remeshed
+ * @return the quads [x, y) of the successor to copy over the uploaded mesh
+ */
+static glm::uvec2 changedQuads(const std::array<uint32_t, 17> &uploaded, const std::array<uint32_t, 17> &starts,
+                               uint32_t remeshed)
+{
+    int lowest = 0;
+    while (lowest < 16 && !(remeshed & (1u << lowest))) {
+        lowest++;
+    }
+    if (lowest == 16) {
+        return glm::uvec2(0, 0);
+    }
+    int highest = 15;
+    while (!(remeshed & (1u << highest))) {
+        highest--;
+    }
+    uint32_t end = starts[highest + 1] == uploaded[highest + 1] ? starts[highest + 1] : starts[16];
+    return glm::uvec2(starts[lowest], end);
+}
+
+/**
+ * @brief ChunkDrawable::updateInPlace
+ *  The successor differs from the uploaded mesh in the remeshed sections
+ *  only, so a block edit copies a few KB instead of the whole chunk. The
+ *  copies go through glBufferSubData, which the driver orders after the
+ *  draws in flight.
+ * @param vbo    : not staged
+ * @param copied
+ * @return
+ */
+bool ChunkDrawable::updateInPlace(const ChunkVBOdata &vbo, size_t &copied)
+{
+    if (m_meshVersion == 0 || vbo.meshVersion != m_meshVersion + 1 || vbo.mp_arena != nullptr) {
+        return false;
+    }
+    bool inArena = mp_arena != nullptr;
+    if (inArena ? mp_arena->isMapped() : !(m_posGenerated && m_transparentDataGenerated)) {
+        return false;
+    }
+    size_t bytes = vbo.buffer.size() * sizeof(uint32_t);
+    size_t transparentBytes = vbo.transparentBuffer.size() * sizeof(uint32_t);
+    if (bytes > (inArena ? m_arenaRange.size : m_capacity)
+            || transparentBytes > (inArena ? m_transparentArenaRange.size : m_transparentCapacity)) {
+        return false;
+    }
+
+    // 4 vertices of 2 words per quad
+    const size_t quadBytes = 8 * sizeof(uint32_t);
+    glm::uvec2 quads = changedQuads(m_sectionQuadStarts, vbo.sectionQuadStarts, vbo.remeshedSections);
+    glm::uvec2 transparentQuads = changedQuads(m_transparentSectionQuadStarts, vbo.transparentSectionQuadStarts,
+                                               vbo.remeshedSections);
+    auto copy = [&](GLuint buffer, const ChunkMeshArena::Range &range, const uint32_t *data, glm::uvec2 span) {
+        size_t offset = span[0] * quadBytes;
+        size_t size = (span[1] - span[0]) * quadBytes;
+        if (size == 0) {
+            return;
+        }
+        if (inArena) {
+            mp_arena->write(ChunkMeshArena::Range{range.offset + offset, size}, data + offset / sizeof(uint32_t), size);
+        } else {
+            mp_context->glBindBuffer(GL_ARRAY_BUFFER, buffer);
+            mp_context->glBufferSubData(GL_ARRAY_BUFFER, offset, size, data + offset / sizeof(uint32_t));
+            mp_context->glBindBuffer(GL_ARRAY_BUFFER, 0);
+        }
+        copied += size;
+    };
+    copy(m_bufPos, m_arenaRange, vbo.buffer.data(), quads);
+    copy(m_bufTransparentData, m_transparentArenaRange, vbo.transparentBuffer.data(), transparentQuads);
+    return true;
+}
+
+/**
+ * @brief ChunkDrawable::createVBOdata
+ * Generate the buffer for chunk rendering.
+ * Note: this is used only for MS1. In MS2 & MS3, the chunks are meshed
+ * by the terrain's workers. Won't be generated on the fly here.
+ */
+void ChunkDrawable::createVBOdata()
+{
+    ChunkVBOdata vbo = mp_chunk->generateVBOdata();
+    createVBOdata(vbo);
+}
+
+GLuint ChunkDrawable::s_quadIndexBuffer = 0;
+size_t ChunkDrawable::s_quadIndexCapacity = 0;
+
+/**
+ * @brief ChunkDrawable::reserveQuadIndices
+ *  The buffer only ever grows, by doubling, and every prefix of it is
+ *  a valid index list, so chunks uploaded earlier keep drawing from it.
+ * @param context
+ * @param quads : the most quads one draw needs
+ */
+void ChunkDrawable::reserveQuadIndices(OpenGLContext *context, size_t quads)
+{
+    if (quads <= s_quadIndexCapacity) {
+        return;
+    }
+    // a plain surface chunk needs a few thousand
+    size_t capacity = std::max(s_quadIndexCapacity, static_cast<size_t>(4096));
+    while (capacity < quads) {
+        capacity *= 2;
+    }
+
+    std::vector<GLuint> indices(capacity * 6);
+    for (size_t q = 0; q < capacity; q++) {
+        GLuint v = static_cast<GLuint>(q * 4);
+        GLuint *out = &indices[q * 6];
+        out[0] = v;
+        out[1] = v + 1;
+        out[2] = v + 2;
+        out[3] = v;
+        out[4] = v + 2;
+        out[5] = v + 3;
+    }
+
+    if (s_quadIndexBuffer == 0) {
+        context->glGenBuffers(1, &s_quadIndexBuffer);
+    }
+    context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_quadIndexBuffer);
+    context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    s_quadIndexCapacity = capacity;
+}
+
+/**
+ * @brief ChunkDrawable::destroyQuadIndices
+ * @param context
+ */
+void ChunkDrawable::destroyQuadIndices(OpenGLContext *context)
+{
+    if (s_quadIndexBuffer != 0) {
+        context->glDeleteBuffers(1, &s_quadIndexBuffer);
+    }
+    s_quadIndexBuffer = 0;
+    s_quadIndexCapacity = 0;
+}
+
+GLuint ChunkDrawable::getQuadIndexBuffer()
+{
+    return s_quadIndexBuffer;
+}
+
+bool ChunkDrawable::bindIdx()
+{
+    if (s_quadIndexBuffer != 0) {
+        mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, s_quadIndexBuffer);
+    }
+    return s_quadIndexBuffer != 0;
+}
+
+bool ChunkDrawable::bindTransparentIdx()
+{
+    return bindIdx();
+}
+
+const std::vector<PointLight> &ChunkDrawable::getLights() const
+{
+    return m_lights;
+}
+
+size_t ChunkDrawable::getGpuBytes() const
+{
+    return m_gpuBytes;
+}
+
+qint64 ChunkDrawable::getMeshNs() const
+{
+    return m_meshNs;
+}
+
+uint32_t ChunkDrawable::getUploadCount() const
+{
+    return m_uploadCount;
+}
+
+size_t ChunkDrawable::getRenderIndex() const
+{
+    return m_renderIndex;
+}
+
+void ChunkDrawable::setRenderIndex(size_t index)
+{
+    m_renderIndex = index;
+}
+
+/**
+ * @brief ChunkDrawable::destroyVBOdata
+ */
+void ChunkDrawable::destroyVBOdata()
+{
+    releaseArenaRanges();
+    if (mp_pool != nullptr) {
+        // back to the pool, or to its queue of deletions
+        if (m_posGenerated) {
+            mp_pool->releaseBuffer(m_bufPos, m_capacity);
+            m_posGenerated = false;
+        }
+        if (m_transparentDataGenerated) {
+            mp_pool->releaseBuffer(m_bufTransparentData, m_transparentCapacity);
+            m_transparentDataGenerated = false;
+        }
+        if (m_vaoGenerated) {
+            mp_pool->releaseVertexArray(m_vao);
+            mp_pool->releaseVertexArray(m_transparentVao);
+            m_vaoGenerated = false;
+        }
+        m_bufPos = m_bufTransparentData = 0;
+    }
+    if (m_vaoGenerated) {
+        mp_context->renderBackend().deleteVertexInput(m_vao);
+        mp_context->renderBackend().deleteVertexInput(m_transparentVao);
+        m_vaoGenerated = false;
+    }
+    Drawable::destroyVBOdata();
+    MemoryStats::sub(MemoryCategory::gpuMeshes, m_gpuBytes);
+    m_gpuBytes = 0;
+    m_capacity = m_transparentCapacity = 0;
+    m_meshVersion = 0;
+    m_lights.clear();
+}
+
+void ChunkDrawable::releaseArenaRanges()
+{
+    if (mp_arena != nullptr) {
+        mp_arena->release(m_arenaRange);
+        mp_arena->release(m_transparentArenaRange);
+        mp_arena = nullptr;
+    }
+}
+
+/**
+ * @brief ChunkDrawable::setUpVAOs
+ *  The mesh may have moved to another buffer or offset, so both VAOs are
+ *  respecified on every upload, through the render backend. The VAO
+ *  bound before stays bound.
+ */
+void ChunkDrawable::setUpVAOs()
+{
+    RenderBackend &backend = mp_context->renderBackend();
+    if (!m_vaoGenerated) {
+        if (mp_pool != nullptr) {
+            m_vao = mp_pool->acquireVertexArray();
+            m_transparentVao = mp_pool->acquireVertexArray();
+        } else {
+            m_vao = backend.createVertexInput();
+            m_transparentVao = backend.createVertexInput();
+        }
+        m_vaoGenerated = true;
+    }
+
+    GLuint attr = ShaderProgram::packedAttribLocation;
+    GLuint opaqueBuffer = mp_arena != nullptr ? mp_arena->getBuffer() : m_bufPos;
+    GLuint transparentBuffer = mp_arena != nullptr ? mp_arena->getBuffer() : m_bufTransparentData;
+    // two 32-bit words per vertex, see packVertex
+    backend.setVertexInput(m_vao, {{opaqueBuffer, attr, 2, GL_UNSIGNED_INT, true, 2 * sizeof(GLuint), posOffset(), 0}},
+                           s_quadIndexBuffer);
+    backend.setVertexInput(m_transparentVao, {{transparentBuffer, attr, 2, GL_UNSIGNED_INT, true, 2 * sizeof(GLuint),
+                                               transparentDataOffset(), 0}}, s_quadIndexBuffer);
+}
+
+bool ChunkDrawable::bindVAO(TerrainDrawType drawType)
+{
+    if (!m_vaoGenerated) {
+        return false;
+    }
+    mp_context->renderBackend().bindVertexInput(drawType == TerrainDrawType::opaque ? m_vao : m_transparentVao);
+    return true;
+}
+
+bool ChunkDrawable::isInArena() const
+{
+    return mp_arena != nullptr;
+}
+
+const std::array<uint32_t, 17> &ChunkDrawable::getSectionQuadStarts(TerrainDrawType drawType) const
+{
+    return drawType == TerrainDrawType::opaque ? m_sectionQuadStarts : m_transparentSectionQuadStarts;
+}
+
+bool ChunkDrawable::hasAnimatedFaces(TerrainDrawType drawType) const
+{
+    return drawType == TerrainDrawType::opaque ? m_animated : m_transparentAnimated;
+}
+
+bool ChunkDrawable::canSeeThrough(int sy, Direction from, Direction to) const
+{
+    return Chunk::connectsFaces(m_sectionConnectivity[sy], from, to);
+}
+
+bool ChunkDrawable::bindPos()
+{
+    if (mp_arena != nullptr) {
+        mp_context->glBindBuffer(GL_ARRAY_BUFFER, mp_arena->getBuffer());
+        return true;
+    }
+    return Drawable::bindPos();
+}
+
+bool ChunkDrawable::bindTransparentData()
+{
+    if (mp_arena != nullptr) {
+        mp_context->glBindBuffer(GL_ARRAY_BUFFER, mp_arena->getBuffer());
+        return true;
+    }
+    return Drawable::bindTransparentData();
+}
+
+size_t ChunkDrawable::posOffset()
+{
+    return mp_arena != nullptr ? m_arenaRange.offset : 0;
+}
+
+size_t ChunkDrawable::transparentDataOffset()
+{
+    return mp_arena != nullptr ? m_transparentArenaRange.offset : 0;
+}
+
+ChunkDrawable::~ChunkDrawable()
+{
+    // the buffers themselves go with the context, if never destroyed
+    MemoryStats::sub(MemoryCategory::gpuMeshes, m_gpuBytes);
+}
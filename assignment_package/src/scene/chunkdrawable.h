@@ -0,0 +1,129 @@
+#pragma once
+#include "drawable.h"
+#include "chunk.h"
+#include "chunkbufferpool.h"
+#include "chunkmesharena.h"
+#include "utils.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// The uploaded mesh of one Chunk: the GL side the Chunk itself does not
+// have, so the world's blocks, generation and NPCs run without a context
+// (see Terrain's headless mode). The Terrain creates one per chunk on its
+// first upload and drops it with the mesh; main thread only, with the
+// context current.
+class ChunkDrawable : public Drawable {
+private:
+    // the chunk meshed, for the MS1 createVBOdata()
+    Chunk *mp_chunk;
+
+    // the arena holding the uploaded mesh, or null when it is in this
+    // Drawable's own buffers, and its ranges there
+    ChunkMeshArena *mp_arena;
+    ChunkMeshArena::Range m_arenaRange;
+    ChunkMeshArena::Range m_transparentArenaRange;
+    // hand the ranges back to the arena (deferred past the draws in flight)
+    void releaseArenaRanges();
+    // the bytes of the uploaded mesh on the GPU, counted in
+    // MemoryCategory::gpuMeshes
+    size_t m_gpuBytes;
+    // the bytes allocated to the own buffers (see ChunkVBOdata::slotBytes,
+    // rounded up to the pool's size class when there is a pool)
+    size_t m_capacity;
+    size_t m_transparentCapacity;
+    // where the own buffers and the VAOs come from and go back to, or null
+    // to generate and delete them here
+    ChunkBufferPool *mp_pool;
+    // copy `bytes` of data to the start of an own buffer, first given
+    // room for them
+    void fillOwnBuffer(GLuint &buffer, bool &generated, size_t &capacity, const uint32_t *data, size_t bytes);
+    // the ChunkVBOdata::meshVersion uploaded, 0 for none
+    uint32_t m_meshVersion;
+    // Copy only the quads of the sections that changed (and of those they
+    // moved) over the uploaded mesh, where it is, adding the bytes to
+    // `copied`; false (nothing done) unless the mesh is its successor and
+    // fits. Not into a mapped arena: a memcpy could land under a draw in flight
+    bool updateInPlace(const ChunkVBOdata &vbo, size_t &copied);
+
+    // the section quad ranges of the uploaded mesh (see ChunkVBOdata)
+    std::array<uint32_t, 17> m_sectionQuadStarts;
+    std::array<uint32_t, 17> m_transparentSectionQuadStarts;
+    // and the section connectivity it was meshed with
+    std::array<uint32_t, 16> m_sectionConnectivity;
+    // which passes of it have animatable faces (see ChunkVBOdata)
+    bool m_animated;
+    bool m_transparentAnimated;
+    // the lights of its emissive blocks, as of the uploaded mesh
+    std::vector<PointLight> m_lights;
+    // how long the uploaded mesh took to make, and the meshes uploaded
+    // into this drawable so far (see Terrain::getChunkDebugInfo)
+    qint64 m_meshNs;
+    uint32_t m_uploadCount;
+
+    // one vertex array object per draw type, holding the packed vertex
+    // attribute and the shared element buffer, set up by each upload
+    GLuint m_vao;
+    GLuint m_transparentVao;
+    bool m_vaoGenerated;
+    void setUpVAOs();
+
+    // its place in the Terrain's render list
+    size_t m_renderIndex;
+
+    // the element buffer shared by every chunk and the quads it covers
+    static GLuint s_quadIndexBuffer;
+    static size_t s_quadIndexCapacity;
+
+public:
+    ChunkDrawable(OpenGLContext *context, Chunk *chunk, ChunkBufferPool *pool = nullptr);
+    virtual ~ChunkDrawable();
+
+    // mesh the chunk and upload it on the spot
+    virtual void createVBOdata() override;
+    // this takes ChunkVBOdata in and buffers it: over the uploaded mesh
+    // when only some sections changed, else into the arena when it is
+    // given and has room, else into own buffers. Returns the bytes copied
+    // to the GPU for it, by a worker or here
+    size_t createVBOdata(ChunkVBOdata &vbo, ChunkMeshArena *arena = nullptr);
+    void destroyVBOdata();
+
+    // both bind the shared quad element buffer
+    bool bindIdx() override;
+    bool bindTransparentIdx() override;
+    // the arena's buffer while the mesh is in one, else the own buffers
+    bool bindPos() override;
+    bool bindTransparentData() override;
+    size_t posOffset() override;
+    size_t transparentDataOffset() override;
+    // Bind the VAO of the draw type (the caller restores its own VAO);
+    // false if nothing was uploaded
+    bool bindVAO(TerrainDrawType drawType);
+    // the mesh is in an arena, at posOffset() / transparentDataOffset()
+    bool isInArena() const;
+    // where each section's quads start in the uploaded mesh of the draw
+    // type, so a draw can skip sections; [16] is the quad count
+    const std::array<uint32_t, 17> &getSectionQuadStarts(TerrainDrawType drawType) const;
+    // Has the uploaded mesh of the draw type faces of animatable blocks,
+    // for the shader permutation that animates them?
+    bool hasAnimatedFaces(TerrainDrawType drawType) const;
+    // Can a line of sight entering section sy through face `from` leave it
+    // through face `to`? As of the uploaded mesh.
+    bool canSeeThrough(int sy, Direction from, Direction to) const;
+    // the lights of the uploaded mesh (see ChunkVBOdata::lights)
+    const std::vector<PointLight> &getLights() const;
+    // the bytes the uploaded mesh takes on the GPU
+    size_t getGpuBytes() const;
+    qint64 getMeshNs() const;
+    uint32_t getUploadCount() const;
+    // where the Terrain's render list holds it (see Terrain::m_renderList)
+    size_t getRenderIndex() const;
+    void setRenderIndex(size_t index);
+
+    // Grow the shared element buffer (0 1 2 0 2 3, then + 4 per quad) to
+    // cover at least `quads` quads; main thread, with the context current
+    static void reserveQuadIndices(OpenGLContext *context, size_t quads);
+    static void destroyQuadIndices(OpenGLContext *context);
+    static GLuint getQuadIndexBuffer();
+};
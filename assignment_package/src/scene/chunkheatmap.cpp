@@ -0,0 +1,171 @@
+#include "chunkheatmap.h"
+#include <algorithm>
+
+// the tiles float this far over the chunk's highest block; the chunks
+// with no block yet get theirs over this height
+static const float tileLift = 2.f;
+static const int emptyChunkTop = 64;
+// the width of a tile's frame, and how far it stays from the chunk's edge
+static const float frameWidth = 1.5f;
+static const float tileMargin = 0.25f;
+static const float tileAlpha = 0.6f;
+
+ChunkHeatmap::ChunkHeatmap(OpenGLContext *context)
+    : Drawable(context), m_metric(ChunkHeatmapMetric::off), m_chunks(), m_maxValue(0.f)
+{}
+
+ChunkHeatmap::~ChunkHeatmap()
+{}
+
+ChunkHeatmapMetric ChunkHeatmap::getMetric() const
+{
+    return m_metric;
+}
+
+void ChunkHeatmap::setMetric(ChunkHeatmapMetric metric)
+{
+    m_metric = metric;
+}
+
+void ChunkHeatmap::cycleMetric()
+{
+    switch (m_metric) {
+    case ChunkHeatmapMetric::off:
+        m_metric = ChunkHeatmapMetric::triangles;
+        break;
+    case ChunkHeatmapMetric::triangles:
+        m_metric = ChunkHeatmapMetric::meshTime;
+        break;
+    case ChunkHeatmapMetric::meshTime:
+        m_metric = ChunkHeatmapMetric::meshings;
+        break;
+    case ChunkHeatmapMetric::meshings:
+        m_metric = ChunkHeatmapMetric::off;
+        break;
+    }
+}
+
+const char *ChunkHeatmap::getMetricName(ChunkHeatmapMetric metric)
+{
+    switch (metric) {
+    case ChunkHeatmapMetric::triangles:
+        return "TRIANGLES";
+    case ChunkHeatmapMetric::meshTime:
+        return "MESH TIME";
+    case ChunkHeatmapMetric::meshings:
+        return "MESHINGS";
+    default:
+        return "OFF";
+    }
+}
+
+float ChunkHeatmap::getMaxValue() const
+{
+    return m_maxValue;
+}
+
+float ChunkHeatmap::metricValue(const ChunkDebugInfo &chunk) const
+{
+    switch (m_metric) {
+    case ChunkHeatmapMetric::triangles: {
+        uint32_t triangles = 0;
+        for (uint32_t t : chunk.sectionTriangles) {
+            triangles += t;
+        }
+        return static_cast<float>(triangles);
+    }
+    case ChunkHeatmapMetric::meshTime:
+        return chunk.meshNs / 1e6f;
+    case ChunkHeatmapMetric::meshings:
+        return static_cast<float>(chunk.meshings);
+    default:
+        return 0.f;
+    }
+}
+
+glm::vec4 ChunkHeatmap::heatColor(float t)
+{
+    static const glm::vec3 ramp[5] = {glm::vec3(0, 0, 1), glm::vec3(0, 1, 1), glm::vec3(0, 1, 0),
+                                      glm::vec3(1, 1, 0), glm::vec3(1, 0, 0)};
+    float x = glm::clamp(t, 0.f, 1.f) * 4.f;
+    int i = std::min(static_cast<int>(x), 3);
+    return glm::vec4(glm::mix(ramp[i], ramp[i + 1], x - i), tileAlpha);
+}
+
+glm::vec4 ChunkHeatmap::stateColor(ChunkDebugState state)
+{
+    switch (state) {
+    case ChunkDebugState::queued:
+        return glm::vec4(0.6f, 0.6f, 0.6f, 0.9f);
+    case ChunkDebugState::generating:
+        return glm::vec4(1.f, 0.55f, 0.f, 0.9f);
+    case ChunkDebugState::meshing:
+        return glm::vec4(1.f, 0.f, 1.f, 0.9f);
+    case ChunkDebugState::uploaded:
+        return glm::vec4(0.f, 0.8f, 0.f, 0.9f);
+    default:
+        return glm::vec4(0.f, 0.f, 0.5f, 0.9f);
+    }
+}
+
+void ChunkHeatmap::update(const Terrain &terrain)
+{
+    terrain.getChunkDebugInfo(m_chunks);
+    m_maxValue = 0.f;
+    for (const ChunkDebugInfo &chunk : m_chunks) {
+        m_maxValue = std::max(m_maxValue, metricValue(chunk));
+    }
+    createVBOdata();
+}
+
+/**
+ * @brief ChunkHeatmap::createVBOdata
+ *  Per chunk, the frame as four strips around the center, so no two
+ *  quads overlap; the center only once the chunk has a mesh.
+ */
+void ChunkHeatmap::createVBOdata()
+{
+    std::vector<glm::vec4> pos;
+    std::vector<glm::vec4> col;
+    std::vector<GLuint> idx;
+    auto addQuad = [&](glm::vec2 min, glm::vec2 max, float y, glm::vec4 color) {
+        GLuint first = static_cast<GLuint>(pos.size());
+        pos.push_back(glm::vec4(min.x, y, min.y, 1.f));
+        pos.push_back(glm::vec4(max.x, y, min.y, 1.f));
+        pos.push_back(glm::vec4(max.x, y, max.y, 1.f));
+        pos.push_back(glm::vec4(min.x, y, max.y, 1.f));
+        for (int i = 0; i < 4; i++) {
+            col.push_back(color);
+        }
+        for (GLuint i : {0u, 1u, 2u, 0u, 2u, 3u}) {
+            idx.push_back(first + i);
+        }
+    };
+
+    for (const ChunkDebugInfo &chunk : m_chunks) {
+        float y = (chunk.top > 0 ? chunk.top : emptyChunkTop) + tileLift;
+        glm::vec2 outerMin = glm::vec2(chunk.corner) + tileMargin;
+        glm::vec2 outerMax = glm::vec2(chunk.corner) + 16.f - tileMargin;
+        glm::vec2 innerMin = outerMin + frameWidth;
+        glm::vec2 innerMax = outerMax - frameWidth;
+
+        glm::vec4 frame = stateColor(chunk.state);
+        addQuad(outerMin, glm::vec2(outerMax.x, innerMin.y), y, frame);
+        addQuad(glm::vec2(outerMin.x, innerMax.y), outerMax, y, frame);
+        addQuad(glm::vec2(outerMin.x, innerMin.y), glm::vec2(innerMin.x, innerMax.y), y, frame);
+        addQuad(glm::vec2(innerMax.x, innerMin.y), glm::vec2(outerMax.x, innerMax.y), y, frame);
+
+        if (chunk.meshings != 0) {
+            float t = m_maxValue > 0.f ? metricValue(chunk) / m_maxValue : 0.f;
+            addQuad(innerMin, innerMax, y, heatColor(t));
+        }
+    }
+
+    m_count = static_cast<int>(idx.size());
+    fillBuffer(m_bufIdx, m_idxGenerated, GL_ELEMENT_ARRAY_BUFFER, idx.size() * sizeof(GLuint), idx.data(),
+               BufferUsage::stream);
+    fillBuffer(m_bufPos, m_posGenerated, GL_ARRAY_BUFFER, pos.size() * sizeof(glm::vec4), pos.data(),
+               BufferUsage::stream);
+    fillBuffer(m_bufCol, m_colGenerated, GL_ARRAY_BUFFER, col.size() * sizeof(glm::vec4), col.data(),
+               BufferUsage::stream);
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "drawable.h"
+#include "terrain.h"
+#include <glm_includes.h>
+#include <vector>
+
+// What the ChunkHeatmap colors the chunks by
+enum class ChunkHeatmapMetric : unsigned char
+{
+    off,
+    triangles,  // of the uploaded mesh, both passes
+    meshTime,   // the time the uploaded mesh took to make
+    meshings    // the meshes uploaded since the chunk was first drawn
+};
+
+/**
+ * @brief The ChunkHeatmap class
+ *  A debug view of where the terrain's cost comes from: a tile over each
+ *  resident chunk, its center colored by the metric from blue (none) to
+ *  red (the largest of any chunk), its frame by the chunk's state in the
+ *  streaming pipeline (see ChunkDebugState): queued grey, generating
+ *  orange, meshing magenta, uploaded green, culled dark blue. The chunks
+ *  with no mesh yet only have their frame. Drawn with the flat program,
+ *  blended and depth tested, two blocks over the chunk's highest block.
+ */
+class ChunkHeatmap : public Drawable
+{
+private:
+    ChunkHeatmapMetric m_metric;
+    // as of the last update, and the metric's largest value over them
+    std::vector<ChunkDebugInfo> m_chunks;
+    float m_maxValue;
+
+    float metricValue(const ChunkDebugInfo &chunk) const;
+    // blue, cyan, green, yellow, red along t in [0, 1]
+    static glm::vec4 heatColor(float t);
+    static glm::vec4 stateColor(ChunkDebugState state);
+
+public:
+    ChunkHeatmap(OpenGLContext* context);
+    virtual ~ChunkHeatmap() override;
+
+    ChunkHeatmapMetric getMetric() const;
+    void setMetric(ChunkHeatmapMetric metric);
+    // the next metric, off after the last
+    void cycleMetric();
+    // e.g. "TRIANGLES", in capitals for the HUD's font
+    static const char *getMetricName(ChunkHeatmapMetric metric);
+    // the top of the color ramp, in the metric's unit (ms for meshTime)
+    float getMaxValue() const;
+
+    // read the terrain's chunks (culled as its last draw was) and rebuild
+    // the tiles; main thread, with the context current
+    void update(const Terrain &terrain);
+    void createVBOdata() override;
+};
@@ -0,0 +1,113 @@
+#include "chunkmap.h"
+
+// 16 zones' worth of chunks before the first rehash
+static const size_t initialCapacity = 512;
+
+ChunkMap::ChunkMap()
+    : m_slots(), m_mask(0), m_shift(64), m_size(0)
+{
+    rehash(initialCapacity);
+}
+
+/**
+ * @brief ChunkMap::rehash
+ * @param capacity : a power of two
+ */
+void ChunkMap::rehash(size_t capacity)
+{
+    std::vector<Slot> old = std::move(m_slots);
+
+    m_slots = std::vector<Slot>(capacity);
+    m_mask = capacity - 1;
+    m_shift = 64;
+    for (size_t c = capacity; c > 1; c >>= 1) {
+        m_shift--;
+    }
+
+    for (Slot &slot : old) {
+        if (slot.chunk != nullptr) {
+            Slot &target = m_slots[probe(slot.cx, slot.cz)];
+            target.cx = slot.cx;
+            target.cz = slot.cz;
+            target.chunk = std::move(slot.chunk);
+        }
+    }
+}
+
+uPtr<Chunk> *ChunkMap::findOwner(int cx, int cz)
+{
+    Slot &slot = m_slots[probe(cx, cz)];
+    return slot.chunk != nullptr ? &slot.chunk : nullptr;
+}
+
+const uPtr<Chunk> *ChunkMap::findOwner(int cx, int cz) const
+{
+    const Slot &slot = m_slots[probe(cx, cz)];
+    return slot.chunk != nullptr ? &slot.chunk : nullptr;
+}
+
+/**
+ * @brief ChunkMap::insert
+ * @param cx
+ * @param cz
+ * @param chunk : must not be null
+ * @return the owning pointer now held by the map
+ */
+uPtr<Chunk> &ChunkMap::insert(int cx, int cz, uPtr<Chunk> chunk)
+{
+    if (2 * (m_size + 1) > m_slots.size()) {
+        rehash(2 * m_slots.size());
+    }
+
+    Slot &slot = m_slots[probe(cx, cz)];
+    if (slot.chunk == nullptr) {
+        m_size++;
+    }
+    slot.cx = cx;
+    slot.cz = cz;
+    slot.chunk = std::move(chunk);
+    return slot.chunk;
+}
+
+bool ChunkMap::erase(int cx, int cz)
+{
+    return take(cx, cz) != nullptr;
+}
+
+/**
+ * @brief ChunkMap::take
+ *  Backward-shift deletion: the entries after the freed slot move back
+ *  over it unless their home lies past it, so no probe chain is broken
+ *  and no tombstones pile up.
+ * @param cx
+ * @param cz
+ * @return
+ */
+uPtr<Chunk> ChunkMap::take(int cx, int cz)
+{
+    size_t i = probe(cx, cz);
+    if (m_slots[i].chunk == nullptr) {
+        return nullptr;
+    }
+    uPtr<Chunk> taken = std::move(m_slots[i].chunk);
+    m_size--;
+
+    for (size_t j = (i + 1) & m_mask; m_slots[j].chunk != nullptr; j = (j + 1) & m_mask) {
+        size_t k = home(m_slots[j].cx, m_slots[j].cz);
+        // does the entry's home lie cyclically in (i, j]? then it stays
+        bool stays = (i <= j) ? (i < k && k <= j) : (i < k || k <= j);
+        if (stays) {
+            continue;
+        }
+        m_slots[i].cx = m_slots[j].cx;
+        m_slots[i].cz = m_slots[j].cz;
+        m_slots[i].chunk = std::move(m_slots[j].chunk);
+        i = j;
+    }
+    return taken;
+}
+
+size_t ChunkMap::size() const
+{
+    return m_size;
+}
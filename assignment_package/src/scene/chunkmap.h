@@ -0,0 +1,87 @@
+#pragma once
+
+#include "chunk.h"
+#include "smartpointerhelp.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The ChunkMap class
+ *  Owner of the Terrain's chunks: a flat open-addressing hash table
+ *  (linear probing, backward-shift deletion, load factor <= 1/2) keyed by
+ *  chunk coordinates, i.e. a chunk's corner divided by 16.
+ *  The keys sit inline in the slot array, so a lookup is a multiply, a
+ *  shift and (almost always) one cache line, with no node to chase.
+ *  Not synchronized: main thread only, like the map it replaces.
+ */
+class ChunkMap
+{
+private:
+    struct Slot
+    {
+        int cx;
+        int cz;
+        // null: the slot is free
+        uPtr<Chunk> chunk;
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    // 64 - log2(capacity)
+    int m_shift;
+    size_t m_size;
+
+    size_t home(int cx, int cz) const {
+        uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cz);
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> m_shift);
+    }
+    // index of the key's slot, or of the free slot ending its probe
+    size_t probe(int cx, int cz) const {
+        size_t i = home(cx, cz);
+        while (m_slots[i].chunk != nullptr && (m_slots[i].cx != cx || m_slots[i].cz != cz)) {
+            i = (i + 1) & m_mask;
+        }
+        return i;
+    }
+    void rehash(size_t capacity);
+
+public:
+    // world (block) coordinate to chunk coordinate: floor(c / 16) as a shift
+    static int toChunkCoord(int c) {
+        return c >> 4;
+    }
+
+    ChunkMap();
+
+    ChunkMap(const ChunkMap&) = delete;
+    ChunkMap &operator=(const ChunkMap&) = delete;
+
+    // the chunk at chunk coordinates (cx, cz), or null
+    Chunk *find(int cx, int cz) const {
+        return m_slots[probe(cx, cz)].chunk.get();
+    }
+    // the owning pointer of the chunk, or null if there is none
+    uPtr<Chunk> *findOwner(int cx, int cz);
+    const uPtr<Chunk> *findOwner(int cx, int cz) const;
+
+    // store the chunk at (cx, cz), deleting the one it replaces
+    uPtr<Chunk> &insert(int cx, int cz, uPtr<Chunk> chunk);
+    // delete the chunk at (cx, cz); false if there was none
+    bool erase(int cx, int cz);
+    // remove the chunk at (cx, cz) and hand it over, or null if there is none
+    uPtr<Chunk> take(int cx, int cz);
+
+    size_t size() const;
+
+    // call f(Chunk*) for every chunk, in no particular order; f must not
+    // insert or erase
+    template <typename F>
+    void forEach(F f) const {
+        for (const Slot &slot : m_slots) {
+            if (slot.chunk != nullptr) {
+                f(slot.chunk.get());
+            }
+        }
+    }
+};
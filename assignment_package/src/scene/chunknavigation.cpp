@@ -0,0 +1,229 @@
+#include "chunknavigation.h"
+#include "chunk.h"
+#include "chunkmap.h"
+#include "terrain.h"
+#include <algorithm>
+
+/**
+ * @brief highestBit
+ * @param bits : not 0
+ * @return the index of the highest set bit
+ */
+static int highestBit(uint64_t bits)
+{
+    int bit = 0;
+    for (int shift = 32; shift > 0; shift >>= 1) {
+        if (bits >> shift) {
+            bits >>= shift;
+            bit += shift;
+        }
+    }
+    return bit;
+}
+
+ChunkNavigation::ChunkNavigation()
+    : m_occupied(), m_standable(), m_built(false), m_stamp(nextStamp())
+{
+    for (int i = 0; i < wordCount; i++) {
+        m_occupied[i].store(0, std::memory_order_relaxed);
+        m_standable[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// the next stamp to hand out
+static std::atomic<uint64_t> s_stamps(1);
+
+uint64_t ChunkNavigation::nextStamp()
+{
+    return s_stamps.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t ChunkNavigation::getLatestStamp()
+{
+    return s_stamps.load(std::memory_order_relaxed) - 1;
+}
+
+bool ChunkNavigation::isStandable(BlockType t)
+{
+    switch (t) {
+    case GRASS:
+    case DIRT:
+    case STONE:
+    case SNOW:
+    case GWOOD:
+    case WOOD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void ChunkNavigation::setBit(std::atomic<uint64_t> &word, int y, bool value)
+{
+    uint64_t bit = uint64_t(1) << (y & 63);
+    if (value) {
+        word.fetch_or(bit, std::memory_order_relaxed);
+    } else {
+        word.fetch_and(~bit, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @brief ChunkNavigation::rebuild
+ *  Empty sections are skipped. The bits are published before the chunk
+ *  reads as built.
+ * @param chunk
+ */
+void ChunkNavigation::rebuild(const Chunk &chunk)
+{
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            for (int w = 0; w < 4; w++) {
+                uint64_t occupied = 0;
+                uint64_t standable = 0;
+                for (int sy = w * 4; sy < w * 4 + 4; sy++) {
+                    if (chunk.getSectionFlags(sy).allEmpty) {
+                        continue;
+                    }
+                    for (int y = sy * 16; y < sy * 16 + 16; y++) {
+                        BlockType t = chunk.getBlockAtUnchecked(x, y, z);
+                        uint64_t bit = uint64_t(1) << (y & 63);
+                        if (t != EMPTY) {
+                            occupied |= bit;
+                        }
+                        if (isStandable(t)) {
+                            standable |= bit;
+                        }
+                    }
+                }
+                int i = wordIndex(x, w * 64, z);
+                m_occupied[i].store(occupied, std::memory_order_relaxed);
+                m_standable[i].store(standable, std::memory_order_relaxed);
+            }
+        }
+    }
+    m_built.store(true, std::memory_order_release);
+    m_stamp.store(nextStamp(), std::memory_order_release);
+}
+
+void ChunkNavigation::clear()
+{
+    m_built.store(false, std::memory_order_release);
+    m_stamp.store(nextStamp(), std::memory_order_release);
+}
+
+void ChunkNavigation::update(int x, int y, int z, BlockType t)
+{
+    if (!m_built.load(std::memory_order_relaxed)) {
+        return;
+    }
+    int i = wordIndex(x, y, z);
+    setBit(m_occupied[i], y, t != EMPTY);
+    setBit(m_standable[i], y, isStandable(t));
+    m_stamp.store(nextStamp(), std::memory_order_release);
+}
+
+bool ChunkNavigation::isBuilt() const
+{
+    return m_built.load(std::memory_order_acquire);
+}
+
+uint64_t ChunkNavigation::getStamp() const
+{
+    return m_stamp.load(std::memory_order_acquire);
+}
+
+bool ChunkNavigation::isOccupied(int x, int y, int z) const
+{
+    if (y < 0 || y >= 256) {
+        return false;
+    }
+    return testBit(m_occupied[wordIndex(x, y, z)], y);
+}
+
+bool ChunkNavigation::isWalkable(int x, int y, int z) const
+{
+    if (y < 0 || y >= 256) {
+        return false;
+    }
+    return testBit(m_standable[wordIndex(x, y, z)], y) && !isOccupied(x, y + 1, z);
+}
+
+int ChunkNavigation::highestOccupiedAtOrBelow(int x, int y, int z) const
+{
+    if (y < 0) {
+        return -1;
+    }
+    y = std::min(y, 255);
+    int column = wordIndex(x, 0, z);
+    int w = y >> 6;
+    uint64_t bits = m_occupied[column + w].load(std::memory_order_relaxed);
+    if ((y & 63) != 63) {
+        bits &= (uint64_t(1) << ((y & 63) + 1)) - 1;
+    }
+    while (bits == 0) {
+        if (--w < 0) {
+            return -1;
+        }
+        bits = m_occupied[column + w].load(std::memory_order_relaxed);
+    }
+    return w * 64 + highestBit(bits);
+}
+
+NavigationView::NavigationView(const Terrain &terrain, glm::vec3 center, int reach)
+    : m_cx(0), m_cz(0), m_side(0), m_chunks()
+{
+    glm::ivec3 c = glm::ivec3(glm::floor(center));
+    m_cx = ChunkMap::toChunkCoord(c.x - reach);
+    m_cz = ChunkMap::toChunkCoord(c.z - reach);
+    m_side = std::max(ChunkMap::toChunkCoord(c.x + reach) - m_cx,
+                      ChunkMap::toChunkCoord(c.z + reach) - m_cz) + 1;
+    m_chunks.resize(m_side * m_side, nullptr);
+    for (int dz = 0; dz < m_side; dz++) {
+        for (int dx = 0; dx < m_side; dx++) {
+            const Chunk *chunk = terrain.findChunk((m_cx + dx) * 16, (m_cz + dz) * 16);
+            if (chunk != nullptr && chunk->getNavigation().isBuilt()) {
+                m_chunks[dx + m_side * dz] = &chunk->getNavigation();
+            }
+        }
+    }
+}
+
+const ChunkNavigation *NavigationView::resolve(int x, int z, int &lx, int &lz) const
+{
+    int dx = ChunkMap::toChunkCoord(x) - m_cx;
+    int dz = ChunkMap::toChunkCoord(z) - m_cz;
+    if (dx < 0 || dx >= m_side || dz < 0 || dz >= m_side) {
+        return nullptr;
+    }
+    lx = x & 15;
+    lz = z & 15;
+    return m_chunks[dx + m_side * dz];
+}
+
+bool NavigationView::hasColumn(int x, int z) const
+{
+    int lx, lz;
+    return resolve(x, z, lx, lz) != nullptr;
+}
+
+bool NavigationView::isOccupied(int x, int y, int z) const
+{
+    int lx, lz;
+    const ChunkNavigation *navigation = resolve(x, z, lx, lz);
+    return navigation != nullptr && navigation->isOccupied(lx, y, lz);
+}
+
+bool NavigationView::isWalkable(int x, int y, int z) const
+{
+    int lx, lz;
+    const ChunkNavigation *navigation = resolve(x, z, lx, lz);
+    return navigation != nullptr && navigation->isWalkable(lx, y, lz);
+}
+
+int NavigationView::highestOccupiedAtOrBelow(int x, int y, int z) const
+{
+    int lx, lz;
+    const ChunkNavigation *navigation = resolve(x, z, lx, lz);
+    return navigation != nullptr ? navigation->highestOccupiedAtOrBelow(lx, y, lz) : -1;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+class Chunk;
+class Terrain;
+
+/**
+ * @brief The ChunkNavigation class
+ *  What NPC path searches need of a chunk's blocks, as two bits per
+ *  block: occupied (not EMPTY) and standable (a block an NPC may stand
+ *  on). A block is walkable when it is standable with nothing above it.
+ *  Every column is four 64-bit words of heights, so its surface below a
+ *  height is one scan over at most four words.
+ *  Built when the chunk is decorated, by the thread that decorated or
+ *  loaded it; after that each setBlockAt updates its block's bits. Until
+ *  then the chunk is not navigable and searches treat it as missing.
+ *  Every bit is read and written atomically, so searches read it while
+ *  the main thread edits, like the blocks themselves (see Chunk).
+ *  Every change takes a new stamp, unique over all chunks, so what is
+ *  derived from the bits (see NavigationGraph) knows when it is stale.
+ */
+class ChunkNavigation
+{
+private:
+    static const int wordCount = 16 * 16 * 256 / 64;
+
+    std::array<std::atomic<uint64_t>, wordCount> m_occupied;
+    std::array<std::atomic<uint64_t>, wordCount> m_standable;
+    std::atomic<bool> m_built;
+    std::atomic<uint64_t> m_stamp;
+
+    // a stamp no chunk has had
+    static uint64_t nextStamp();
+
+    // the word of (x, y, z) local to the chunk, y in [0, 256)
+    static int wordIndex(int x, int y, int z) {
+        return ((x + 16 * z) << 2) | (y >> 6);
+    }
+    static bool testBit(const std::atomic<uint64_t> &word, int y) {
+        return (word.load(std::memory_order_relaxed) >> (y & 63)) & 1;
+    }
+    static void setBit(std::atomic<uint64_t> &word, int y, bool value);
+
+public:
+    ChunkNavigation();
+
+    // the block types an NPC may stand on
+    static bool isStandable(BlockType t);
+
+    // read every block of the chunk; its writer only
+    void rebuild(const Chunk &chunk);
+    // not navigable until the next rebuild (e.g. the chunk is regenerated)
+    void clear();
+    // the block at (x, y, z) local to the chunk became t; no-op until built
+    void update(int x, int y, int z, BlockType t);
+
+    bool isBuilt() const;
+    // changes whenever the bits or isBuilt do; read it before the bits
+    uint64_t getStamp() const;
+    // the last stamp any chunk took: a chunk whose stamp is past one read
+    // before some work changed since
+    static uint64_t getLatestStamp();
+    // for (x, z) local to the chunk; heights outside [0, 256) are EMPTY
+    bool isOccupied(int x, int y, int z) const;
+    bool isWalkable(int x, int y, int z) const;
+    // the highest occupied block at or below y in the column, or -1
+    int highestOccupiedAtOrBelow(int x, int y, int z) const;
+};
+
+/**
+ * @brief The NavigationView class
+ *  The navigation of the chunks around one point, resolved once so a
+ *  path search reads them by index and never looks a chunk up again.
+ *  Chunks that are missing or not navigable read as missing. Valid while
+ *  the chunks are, i.e. where NPC ticks may run (see NPCSimulation).
+ */
+class NavigationView
+{
+private:
+    // chunk coordinates of the first chunk, and the chunks per side
+    int m_cx;
+    int m_cz;
+    int m_side;
+    // x fastest; null where missing
+    std::vector<const ChunkNavigation*> m_chunks;
+
+    // the chunk holding the column, or null; (lx, lz) local to it
+    const ChunkNavigation *resolve(int x, int z, int &lx, int &lz) const;
+
+public:
+    // the chunks within reach blocks of center, horizontally
+    NavigationView(const Terrain &terrain, glm::vec3 center, int reach);
+
+    // is there a navigable chunk holding the column?
+    bool hasColumn(int x, int z) const;
+    // the same as ChunkNavigation's, in world coordinates; false where missing
+    bool isOccupied(int x, int y, int z) const;
+    bool isWalkable(int x, int y, int z) const;
+    // -1 where missing too
+    int highestOccupiedAtOrBelow(int x, int y, int z) const;
+};
@@ -0,0 +1,55 @@
+#include "chunkpool.h"
+
+ChunkPool::ChunkPool(size_t capacity)
+    : m_free(), m_capacity(capacity), m_created(0), m_reused(0)
+{
+    m_free.reserve(capacity);
+}
+
+uPtr<Chunk> ChunkPool::acquire(int xCorner, int zCorner)
+{
+    if (m_free.empty()) {
+        m_created++;
+        return mkU<Chunk>(xCorner, zCorner);
+    }
+    uPtr<Chunk> chunk = std::move(m_free.back());
+    m_free.pop_back();
+    chunk->reset(xCorner, zCorner);
+    m_reused++;
+    return chunk;
+}
+
+void ChunkPool::release(uPtr<Chunk> chunk)
+{
+    if (chunk != nullptr && m_free.size() < m_capacity) {
+        m_free.push_back(std::move(chunk));
+    }
+}
+
+/**
+ * @brief ChunkPool::setCapacity
+ *  The chunks kept past a smaller capacity are deleted now.
+ * @param capacity
+ */
+void ChunkPool::setCapacity(size_t capacity)
+{
+    m_capacity = capacity;
+    if (m_free.size() > capacity) {
+        m_free.resize(capacity);
+    }
+}
+
+size_t ChunkPool::getFreeCount() const
+{
+    return m_free.size();
+}
+
+uint64_t ChunkPool::getCreatedCount() const
+{
+    return m_created;
+}
+
+uint64_t ChunkPool::getReusedCount() const
+{
+    return m_reused;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "chunk.h"
+#include "smartpointerhelp.h"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The ChunkPool class
+ *  A free list of evicted chunks, so the zones generated as the player
+ *  moves take the chunks of the zones left behind instead of the heap.
+ *  A chunk is cleared as it is taken (see Chunk::reset), not as it is
+ *  returned: the chunks nobody takes again are just deleted.
+ *  Main thread only, like the ChunkMap it feeds.
+ */
+class ChunkPool
+{
+private:
+    std::vector<uPtr<Chunk>> m_free;
+    // chunks kept at most; the ones returned past it are deleted
+    size_t m_capacity;
+    uint64_t m_created;
+    uint64_t m_reused;
+
+public:
+    explicit ChunkPool(size_t capacity);
+
+    ChunkPool(const ChunkPool&) = delete;
+    ChunkPool &operator=(const ChunkPool&) = delete;
+
+    // a chunk at the corner, as if just constructed
+    uPtr<Chunk> acquire(int xCorner, int zCorner);
+    // an evicted chunk: unlinked, and pinned by no worker
+    void release(uPtr<Chunk> chunk);
+
+    void setCapacity(size_t capacity);
+    size_t getFreeCount() const;
+    // chunks constructed, and chunks taken from the free list
+    uint64_t getCreatedCount() const;
+    uint64_t getReusedCount() const;
+};
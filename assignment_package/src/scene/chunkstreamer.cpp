@@ -0,0 +1,99 @@
+#include "chunkstreamer.h"
+#include <algorithm>
+
+ChunkStreamer::ChunkStreamer(int radius)
+    : m_radius(radius), m_viewPos(0.f), m_viewForward(0.f, 1.f), m_hasView(false), m_sent()
+{}
+
+void ChunkStreamer::setView(glm::vec3 pos, glm::vec3 forward)
+{
+    m_viewPos = glm::vec2(pos.x, pos.z);
+    glm::vec2 flat(forward.x, forward.z);
+    // looking straight up or down: any direction is as good
+    m_viewForward = glm::length(flat) > 1e-4f ? glm::normalize(flat) : glm::vec2(0.f, 1.f);
+    m_hasView = true;
+}
+
+bool ChunkStreamer::hasView() const
+{
+    return m_hasView;
+}
+
+glm::vec3 ChunkStreamer::getViewPos() const
+{
+    return glm::vec3(m_viewPos.x, 0.f, m_viewPos.y);
+}
+
+/**
+ * @brief ChunkStreamer::nextChunks
+ *  Scans the square of chunks around the view: a few hundred lookups, far
+ *  cheaper than the chunks it sends.
+ * @param terrain
+ * @param count
+ * @param corners : cleared first
+ */
+void ChunkStreamer::nextChunks(const Terrain &terrain, int count, std::vector<glm::ivec2> &corners)
+{
+    corners.clear();
+    if (!m_hasView) {
+        return;
+    }
+    int viewX = static_cast<int>(glm::floor(m_viewPos.x / 16.f)) * 16;
+    int viewZ = static_cast<int>(glm::floor(m_viewPos.y / 16.f)) * 16;
+
+    int forget = (m_radius + forgetMargin) * 16;
+    for (auto it = m_sent.begin(); it != m_sent.end();) {
+        glm::ivec2 corner = toCoords(*it);
+        if (std::abs(corner[0] - viewX) > forget || std::abs(corner[1] - viewZ) > forget) {
+            it = m_sent.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::vector<std::pair<float, glm::ivec2>> ranked;
+    for (int x = viewX - m_radius * 16; x <= viewX + m_radius * 16; x += 16) {
+        for (int z = viewZ - m_radius * 16; z <= viewZ + m_radius * 16; z += 16) {
+            const Chunk *chunk = terrain.findChunk(x, z);
+            if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated
+                    || m_sent.count(toKey(x, z)) != 0) {
+                continue;
+            }
+            glm::vec2 center(x + 8.f, z + 8.f);
+            ranked.push_back({viewerCost(center, m_viewPos, m_viewForward), glm::ivec2(x, z)});
+        }
+    }
+    size_t n = std::min(ranked.size(), static_cast<size_t>(std::max(count, 0)));
+    std::partial_sort(ranked.begin(), ranked.begin() + n, ranked.end(),
+                      [](const std::pair<float, glm::ivec2> &a, const std::pair<float, glm::ivec2> &b) {
+        return a.first < b.first;
+    });
+    for (size_t i = 0; i < n; i++) {
+        corners.push_back(ranked[i].second);
+    }
+}
+
+void ChunkStreamer::markSent(glm::ivec2 corner)
+{
+    m_sent.insert(toKey(corner[0], corner[1]));
+}
+
+bool ChunkStreamer::wasSent(int x, int z) const
+{
+    return m_sent.count(toKey(x & ~15, z & ~15)) != 0;
+}
+
+size_t ChunkStreamer::getSentCount() const
+{
+    return m_sent.size();
+}
+
+void ChunkStreamer::filterEdits(const std::vector<BlockEdit> &edits, std::vector<BlockEdit> &out) const
+{
+    out.clear();
+    for (const BlockEdit &edit : edits) {
+        if (wasSent(edit.pos.x, edit.pos.z)) {
+            out.push_back(edit);
+        }
+    }
+}
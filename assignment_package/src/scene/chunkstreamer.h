@@ -0,0 +1,40 @@
+#pragma once
+#include "terrain.h"
+#include <cstdint>
+#include <unordered_set>
+#include <vector>
+
+// Which chunks one client has been sent and which to send it next: the
+// decorated chunks within the stream radius of its view, nearest first
+// and those ahead before those behind (see viewerCost). Main thread only.
+class ChunkStreamer
+{
+private:
+    // in chunks around the view
+    int m_radius;
+    glm::vec2 m_viewPos;
+    glm::vec2 m_viewForward;
+    bool m_hasView;
+    // the corners sent, by toKey
+    std::unordered_set<int64_t> m_sent;
+
+public:
+    // chunks beyond the radius by more than this are forgotten, to be
+    // sent again when the view comes back
+    static const int forgetMargin = 2;
+
+    explicit ChunkStreamer(int radius);
+
+    void setView(glm::vec3 pos, glm::vec3 forward);
+    bool hasView() const;
+    glm::vec3 getViewPos() const;
+
+    // Up to `count` corners of the resident decorated chunks not sent yet,
+    // best first; also forgets the sent chunks now too far
+    void nextChunks(const Terrain &terrain, int count, std::vector<glm::ivec2> &corners);
+    void markSent(glm::ivec2 corner);
+    bool wasSent(int x, int z) const;
+    size_t getSentCount() const;
+    // the edits of chunks already sent: the others go out whole
+    void filterEdits(const std::vector<BlockEdit> &edits, std::vector<BlockEdit> &out) const;
+};
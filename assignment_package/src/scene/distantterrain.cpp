@@ -0,0 +1,433 @@
+#include "distantterrain.h"
+#include "frustum.h"
+#include "terrain.h"
+#include <algorithm>
+#include <cstdlib>
+#include <utility>
+
+const int DistantTerrain::levelSteps[DistantTerrain::levelCount] = {4, 16};
+
+// below every generation stage: the ring only fills in once the zones
+// around the player have been queued
+static const int lodTilePriority = -1;
+
+// how far the skirts hang below the tile edges
+static const float skirtDepth = 24.f;
+
+/**
+ * @brief surfaceHeight
+ *  The top of the surface FillBlocksWorker::setSurfaceTerrain builds over
+ *  the column: the water plane over low ground, otherwise the top face of
+ *  the surface block.
+ * @param height : Noise::getHeight of the column
+ * @return
+ */
+static float surfaceHeight(int height)
+{
+    return height < 136 ? 136.f : height + 1.f;
+}
+
+/**
+ * @brief surfaceColor
+ *  Roughly the average color of the surface block's texture.
+ * @param height : Noise::getHeight of the column
+ * @return
+ */
+static glm::vec4 surfaceColor(int height)
+{
+    if (height < 136) {
+        return glm::vec4(0.2f, 0.35f, 0.75f, 1.f);
+    }
+    if (height < 142) {
+        return glm::vec4(0.36f, 0.55f, 0.25f, 1.f);
+    }
+    if (height > 180) {
+        return glm::vec4(0.92f, 0.94f, 0.98f, 1.f);
+    }
+    return glm::vec4(0.5f, 0.5f, 0.5f, 1.f);
+}
+
+LodTile::LodTile(OpenGLContext *context, LodTileData &&data)
+    : Drawable(context), m_data(std::move(data))
+{}
+
+void LodTile::createVBOdata()
+{
+    m_count = static_cast<int>(m_data.idx.size());
+
+    generateIdx();
+    bindIdx();
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_data.idx.size() * sizeof(GLuint), m_data.idx.data(), GL_STATIC_DRAW);
+
+    generatePos();
+    bindPos();
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_data.pos.size() * sizeof(glm::vec4), m_data.pos.data(), GL_STATIC_DRAW);
+
+    generateNor();
+    bindNor();
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_data.nor.size() * sizeof(glm::vec4), m_data.nor.data(), GL_STATIC_DRAW);
+
+    generateCol();
+    bindCol();
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_data.col.size() * sizeof(glm::vec4), m_data.col.data(), GL_STATIC_DRAW);
+
+    // only the bounds are needed from now on
+    std::vector<glm::vec4>().swap(m_data.pos);
+    std::vector<glm::vec4>().swap(m_data.nor);
+    std::vector<glm::vec4>().swap(m_data.col);
+    std::vector<GLuint>().swap(m_data.idx);
+}
+
+int LodTile::getLevel() const
+{
+    return m_data.level;
+}
+
+glm::vec3 LodTile::getMin() const
+{
+    glm::ivec2 corner = toCoords(m_data.key);
+    return glm::vec3(corner.x, m_data.minY - skirtDepth, corner.y);
+}
+
+glm::vec3 LodTile::getMax() const
+{
+    glm::ivec2 corner = toCoords(m_data.key);
+    return glm::vec3(corner.x + DistantTerrain::zoneSize, m_data.maxY, corner.y + DistantTerrain::zoneSize);
+}
+
+DistantTerrain::DistantTerrain(OpenGLContext *context, TerrainJobSystem &jobs,
+                               uint64_t worldSeed, GradientHash gradientHash)
+    : mp_context(context), mp_jobs(&jobs), m_worldSeed(worldSeed), m_gradientHash(gradientHash),
+      m_centerZone(0), m_halfGridSize(0), m_viewRadius(0), m_viewCenter(0.f), m_planned(false), m_ringRadius(farRadius),
+      m_tiles(), m_desiredLevels(), m_inFlight(), m_completedTiles(), m_completedTilesLock()
+{}
+
+DistantTerrain::~DistantTerrain()
+{}
+
+/**
+ * @brief DistantTerrain::update
+ *  Re-plan the ring when the player enters another zone, then upload the
+ *  tiles the workers have finished.
+ * @param playerX
+ * @param playerZ
+ * @param halfGridSize : of the full-detail zones, which the ring surrounds
+ * @param viewRadius   : chunks; the full-detail zones are those of the
+ *  grid in this circle (see isZoneInCircle), or all of them if 0
+ */
+void DistantTerrain::update(float playerX, float playerZ, int halfGridSize, int viewRadius)
+{
+    glm::ivec2 zone(static_cast<int>(glm::floor(playerX / zoneSize)),
+                    static_cast<int>(glm::floor(playerZ / zoneSize)));
+    glm::vec2 center = viewRadius > 0 ? viewCircleCenter(playerX, playerZ) : glm::vec2(0.f);
+    if (!m_planned || zone != m_centerZone || halfGridSize != m_halfGridSize
+            || viewRadius != m_viewRadius || center != m_viewCenter) {
+        m_centerZone = zone;
+        m_halfGridSize = halfGridSize;
+        m_viewRadius = viewRadius;
+        m_viewCenter = center;
+        m_planned = true;
+        plan();
+    }
+    uploadCompleted();
+}
+
+/**
+ * @brief DistantTerrain::plan
+ *  Zones whose level changed keep their old tile until the new one is
+ *  uploaded; zones that left the ring, or are now drawn in full detail,
+ *  are dropped at once.
+ */
+void DistantTerrain::plan()
+{
+    m_desiredLevels.clear();
+    for (int dz = -m_ringRadius; dz <= m_ringRadius; dz++) {
+        for (int dx = -m_ringRadius; dx <= m_ringRadius; dx++) {
+            int r = std::max(std::abs(dx), std::abs(dz));
+            int xCorner = (m_centerZone.x + dx) * zoneSize, zCorner = (m_centerZone.y + dz) * zoneSize;
+            if (r <= m_halfGridSize
+                    && (m_viewRadius == 0 || isZoneInCircle(xCorner, zCorner, m_viewCenter, m_viewRadius * 16.f))) {
+                continue;
+            }
+            int64_t key = toKey(xCorner, zCorner);
+            m_desiredLevels[key] = r <= nearRadius ? 0 : 1;
+        }
+    }
+
+    for (auto it = m_tiles.begin(); it != m_tiles.end();) {
+        if (m_desiredLevels.find(it->first) == m_desiredLevels.end()) {
+            it->second->destroyVBOdata();
+            it = m_tiles.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    // a worker that already started is left to finish; its result is
+    // dropped on arrival
+    for (auto it = m_inFlight.begin(); it != m_inFlight.end();) {
+        auto desired = m_desiredLevels.find(it->first);
+        if ((desired == m_desiredLevels.end() || desired->second != it->second.level)
+                && mp_jobs->cancel(it->second.job)) {
+            it = m_inFlight.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (const std::pair<const int64_t, int> &desired : m_desiredLevels) {
+        auto tile = m_tiles.find(desired.first);
+        if (tile != m_tiles.end() && tile->second->getLevel() == desired.second) {
+            continue;
+        }
+        auto inFlight = m_inFlight.find(desired.first);
+        if (inFlight != m_inFlight.end() && inFlight->second.level == desired.second) {
+            continue;
+        }
+        glm::ivec2 corner = toCoords(desired.first);
+        TerrainJobId job = mp_jobs->submit<LodTileWorker>(TerrainJobQueue::generation, lodTilePriority,
+                                                          corner.x, corner.y, desired.second,
+                                                          m_worldSeed, m_gradientHash,
+                                                          &m_completedTiles, &m_completedTilesLock);
+        m_inFlight[desired.first] = InFlightTile{desired.second, job};
+    }
+}
+
+void DistantTerrain::uploadCompleted()
+{
+    std::vector<LodTileData> completed;
+    m_completedTilesLock.lock();
+    completed.swap(m_completedTiles);
+    m_completedTilesLock.unlock();
+
+    for (LodTileData &data : completed) {
+        auto inFlight = m_inFlight.find(data.key);
+        if (inFlight != m_inFlight.end() && inFlight->second.level == data.level) {
+            m_inFlight.erase(inFlight);
+        }
+        auto desired = m_desiredLevels.find(data.key);
+        if (desired == m_desiredLevels.end() || desired->second != data.level) {
+            continue;
+        }
+
+        auto existing = m_tiles.find(data.key);
+        if (existing != m_tiles.end()) {
+            existing->second->destroyVBOdata();
+        }
+        int64_t key = data.key;
+        uPtr<LodTile> tile = mkU<LodTile>(mp_context, std::move(data));
+        tile->createVBOdata();
+        m_tiles[key] = std::move(tile);
+    }
+}
+
+/**
+ * @brief DistantTerrain::draw
+ *  Level by level, so the morph uniforms are set once per level.
+ *  Level 0 morphs over its last zone ring; level 1 does not morph.
+ * @param shaderProgram : the lod shader, its view projection already set
+ * @param viewProj : for frustum culling the tiles
+ */
+void DistantTerrain::draw(ShaderProgram *shaderProgram, const glm::mat4 &viewProj,
+                          const std::unordered_set<int64_t> *skippedZones)
+{
+    Frustum frustum(viewProj);
+    glm::vec2 center = (glm::vec2(m_centerZone) + 0.5f) * static_cast<float>(zoneSize);
+    glm::vec2 fogRange = getFogRange();
+    shaderProgram->useMe();
+    mp_context->glUniform2f(shaderProgram->uniformLocation("u_FogRange"), fogRange.x, fogRange.y);
+
+    for (int level = 0; level < levelCount; level++) {
+        glm::vec2 range = level == 0 ? glm::vec2(nearRadius - 0.5f, nearRadius + 0.5f) * static_cast<float>(zoneSize)
+                                     : glm::vec2(1e8f, 1e9f);
+        shaderProgram->setMorph(center, range);
+        for (const std::pair<const int64_t, uPtr<LodTile>> &tile : m_tiles) {
+            if (tile.second->getLevel() != level
+                    || (skippedZones != nullptr && skippedZones->count(tile.first) > 0)
+                    || !frustum.intersectsBox(tile.second->getMin(), tile.second->getMax())) {
+                continue;
+            }
+            shaderProgram->draw(*tile.second);
+        }
+    }
+}
+
+void DistantTerrain::destroy()
+{
+    for (const std::pair<const int64_t, InFlightTile> &inFlight : m_inFlight) {
+        mp_jobs->cancel(inFlight.second.job);
+    }
+    for (std::pair<const int64_t, uPtr<LodTile>> &tile : m_tiles) {
+        tile.second->destroyVBOdata();
+    }
+    m_tiles.clear();
+    m_desiredLevels.clear();
+    m_inFlight.clear();
+    m_completedTilesLock.lock();
+    m_completedTiles.clear();
+    m_completedTilesLock.unlock();
+    m_planned = false;
+}
+
+void DistantTerrain::setRingRadius(int zones)
+{
+    zones = glm::clamp(zones, nearRadius + 1, farRadius);
+    if (zones != m_ringRadius) {
+        m_ringRadius = zones;
+        m_planned = false;
+    }
+}
+
+int DistantTerrain::getRingRadius() const
+{
+    return m_ringRadius;
+}
+
+/**
+ * @brief DistantTerrain::getFogRange
+ *  The fog ends a little short of the ring's edge, measured from the
+ *  center of the player's zone, and starts at the same fraction of that
+ *  for any radius (448 to 780 blocks for the full ring).
+ */
+glm::vec2 DistantTerrain::getFogRange() const
+{
+    float end = (m_ringRadius + 0.5f) * zoneSize - 20.f;
+    return glm::vec2(end * 0.575f, end);
+}
+
+size_t DistantTerrain::getTileCount() const
+{
+    return m_tiles.size();
+}
+
+LodTileWorker::LodTileWorker(int xCorner, int zCorner, int level,
+                             uint64_t worldSeed, GradientHash gradientHash,
+                             std::vector<LodTileData> *completedTiles,
+                             QMutex *completedTilesLock)
+    : xCorner(xCorner), zCorner(zCorner), level(level),
+      worldSeed(worldSeed), gradientHash(gradientHash),
+      completedTiles(completedTiles), completedTilesLock(completedTilesLock)
+{}
+
+bool LodTileWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(xCorner, zCorner) + glm::vec2(DistantTerrain::zoneSize / 2);
+    return true;
+}
+
+/**
+ * @brief LodTileWorker::run
+ *  Samples the heights on a grid one sample wider than the tile on every
+ *  side, for the normals. Each cell is split along the same diagonal at
+ *  both levels, so a level-0 vertex morphs to the exact level-1 surface:
+ *  the level-1 heights interpolated over that vertex's triangle.
+ *  A skirt of four quads hangs from the tile edges.
+ */
+void LodTileWorker::run()
+{
+    Noise noise(worldSeed, gradientHash);
+
+    const int size = DistantTerrain::zoneSize;
+    const int step = DistantTerrain::levelSteps[level];
+    const int n = size / step;
+    // samples from -1 to n + 1 along each axis
+    const int w = n + 3;
+
+    std::vector<int> heights(w * w);
+    for (int k = 0; k < w; k++) {
+        for (int i = 0; i < w; i++) {
+            heights[i + w * k] = noise.getHeight(xCorner + (i - 1) * step, zCorner + (k - 1) * step);
+        }
+    }
+    auto heightAt = [&](int i, int k) {
+        return surfaceHeight(heights[(i + 1) + w * (k + 1)]);
+    };
+
+    // the level-1 lattice over the tile, the morph target of level 0
+    const int coarseStep = DistantTerrain::levelSteps[DistantTerrain::levelCount - 1];
+    const int coarseN = size / coarseStep;
+    std::vector<float> coarse;
+    if (level + 1 < DistantTerrain::levelCount) {
+        coarse.resize((coarseN + 1) * (coarseN + 1));
+        for (int k = 0; k <= coarseN; k++) {
+            for (int i = 0; i <= coarseN; i++) {
+                coarse[i + (coarseN + 1) * k] =
+                        surfaceHeight(noise.getHeight(xCorner + i * coarseStep, zCorner + k * coarseStep));
+            }
+        }
+    }
+    auto morphTarget = [&](int x, int z, float y) {
+        if (coarse.empty()) {
+            return y;
+        }
+        int ci = std::min(x / coarseStep, coarseN - 1);
+        int ck = std::min(z / coarseStep, coarseN - 1);
+        float fx = (x - ci * coarseStep) / static_cast<float>(coarseStep);
+        float fz = (z - ck * coarseStep) / static_cast<float>(coarseStep);
+        float h00 = coarse[ci + (coarseN + 1) * ck];
+        float h10 = coarse[ci + 1 + (coarseN + 1) * ck];
+        float h01 = coarse[ci + (coarseN + 1) * (ck + 1)];
+        float h11 = coarse[ci + 1 + (coarseN + 1) * (ck + 1)];
+        if (fx >= fz) {
+            return h00 + fx * (h10 - h00) + fz * (h11 - h10);
+        }
+        return h00 + fz * (h01 - h00) + fx * (h11 - h01);
+    };
+
+    LodTileData data;
+    data.key = toKey(xCorner, zCorner);
+    data.level = level;
+    data.minY = 256.f;
+    data.maxY = 0.f;
+
+    for (int k = 0; k <= n; k++) {
+        for (int i = 0; i <= n; i++) {
+            float y = heightAt(i, k);
+            float target = morphTarget(i * step, k * step, y);
+            data.pos.push_back(glm::vec4(xCorner + i * step, y, zCorner + k * step, target));
+            glm::vec3 nor(heightAt(i - 1, k) - heightAt(i + 1, k), 2.f * step,
+                          heightAt(i, k - 1) - heightAt(i, k + 1));
+            data.nor.push_back(glm::vec4(glm::normalize(nor), 0.f));
+            data.col.push_back(surfaceColor(heights[(i + 1) + w * (k + 1)]));
+            data.minY = std::min(data.minY, std::min(y, target));
+            data.maxY = std::max(data.maxY, std::max(y, target));
+        }
+    }
+    for (int k = 0; k < n; k++) {
+        for (int i = 0; i < n; i++) {
+            GLuint v00 = i + (n + 1) * k;
+            GLuint v10 = v00 + 1;
+            GLuint v01 = v00 + (n + 1);
+            GLuint v11 = v01 + 1;
+            data.idx.insert(data.idx.end(), {v00, v10, v11, v00, v11, v01});
+        }
+    }
+
+    // the edge vertices in order along each side, each skirt vertex right
+    // below (and morphing with) its edge vertex
+    std::vector<GLuint> edges[4];
+    for (int j = 0; j <= n; j++) {
+        edges[0].push_back(j);
+        edges[1].push_back(j + (n + 1) * n);
+        edges[2].push_back((n + 1) * j);
+        edges[3].push_back(n + (n + 1) * j);
+    }
+    for (const std::vector<GLuint> &edge : edges) {
+        GLuint base = static_cast<GLuint>(data.pos.size());
+        for (GLuint v : edge) {
+            data.pos.push_back(data.pos[v] - glm::vec4(0.f, skirtDepth, 0.f, skirtDepth));
+            data.nor.push_back(data.nor[v]);
+            data.col.push_back(data.col[v]);
+        }
+        for (int j = 0; j < n; j++) {
+            GLuint a = edge[j];
+            GLuint b = edge[j + 1];
+            GLuint c = base + j + 1;
+            GLuint d = base + j;
+            data.idx.insert(data.idx.end(), {a, b, c, a, c, d});
+        }
+    }
+
+    completedTilesLock->lock();
+    completedTiles->push_back(std::move(data));
+    completedTilesLock->unlock();
+}
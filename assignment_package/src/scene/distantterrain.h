@@ -0,0 +1,155 @@
+#pragma once
+
+#include "drawable.h"
+#include "glm_includes.h"
+#include "noise.h"
+#include "shaderprogram.h"
+#include "smartpointerhelp.h"
+#include "terrainjobs.h"
+#include <QMutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/**
+ * @brief The LodTileData struct
+ *  The low-detail mesh of one 64 x 64 zone, built by a LodTileWorker.
+ *  pos.xyz is the world position and pos.w the height the vertex morphs
+ *  to near the outer edge of its level (the next coarser level's surface).
+ */
+struct LodTileData
+{
+    int64_t key;
+    int level;
+    float minY;
+    float maxY;
+
+    std::vector<glm::vec4> pos;
+    std::vector<glm::vec4> nor;
+    std::vector<glm::vec4> col;
+    std::vector<GLuint> idx;
+};
+
+/**
+ * @brief The LodTile class
+ *  A heightmap tile of the distant terrain, drawn with ShaderProgram::draw.
+ */
+class LodTile : public Drawable
+{
+private:
+    // the mesh until it is uploaded
+    LodTileData m_data;
+
+public:
+    LodTile(OpenGLContext *context, LodTileData &&data);
+
+    void createVBOdata() override;
+
+    int getLevel() const;
+    // the world-space bounds of the tile
+    glm::vec3 getMin() const;
+    glm::vec3 getMax() const;
+};
+
+/**
+ * @brief The DistantTerrain class
+ *  A ring of heightmap tiles around the full-detail zone grid, sampled
+ *  straight from Noise::getHeight without generating any blocks.
+ *  Level 0 (a sample every 4 blocks) covers the zones up to nearRadius
+ *  from the player's zone, level 1 (every 16 blocks) those up to
+ *  farRadius. Over the last zone ring of level 0 the vertices morph to
+ *  the level-1 surface, so the two meet without a seam; skirts hang from
+ *  every tile edge to hide the cracks against the chunks and between
+ *  tiles of different levels.
+ */
+class DistantTerrain
+{
+public:
+    static const int zoneSize = 64;
+    // zones, in Chebyshev distance from the player's zone
+    static const int nearRadius = 6;
+    static const int farRadius = 12;
+    static const int levelCount = 2;
+    // blocks between two samples of each level
+    static const int levelSteps[levelCount];
+
+private:
+    OpenGLContext *mp_context;
+    // the terrain's, so the tiles queue with (and behind) its generation work
+    TerrainJobSystem *mp_jobs;
+    uint64_t m_worldSeed;
+    GradientHash m_gradientHash;
+
+    // the player's zone and the full-detail half grid of the last plan,
+    // and its view radius in chunks (see Terrain::setViewRadius) around
+    // the player's chunk
+    glm::ivec2 m_centerZone;
+    int m_halfGridSize;
+    int m_viewRadius;
+    glm::vec2 m_viewCenter;
+    bool m_planned;
+    // the zones the ring reaches, at most farRadius (see setRingRadius)
+    int m_ringRadius;
+
+    // keyed by toKey of the zone corner
+    std::unordered_map<int64_t, uPtr<LodTile>> m_tiles;
+    // the level each zone of the ring should be drawn at
+    std::unordered_map<int64_t, int> m_desiredLevels;
+    // zones with a worker queued or running, and the level it builds
+    struct InFlightTile
+    {
+        int level;
+        TerrainJobId job;
+    };
+    std::unordered_map<int64_t, InFlightTile> m_inFlight;
+
+    std::vector<LodTileData> m_completedTiles;
+    QMutex m_completedTilesLock;
+
+    void plan();
+    void uploadCompleted();
+
+public:
+    DistantTerrain(OpenGLContext *context, TerrainJobSystem &jobs, uint64_t worldSeed, GradientHash gradientHash);
+    ~DistantTerrain();
+
+    // main thread, once per tick; viewRadius: the terrain's, 0 for none
+    void update(float playerX, float playerZ, int halfGridSize, int viewRadius = 0);
+    // leaving out the tiles of the zones in skippedZones (by toKey of the
+    // zone corner), drawn by something else (see FarField)
+    void draw(ShaderProgram *shaderProgram, const glm::mat4 &viewProj,
+              const std::unordered_set<int64_t> *skippedZones = nullptr);
+    // cancels the queued workers; none may still be running
+    void destroy();
+
+    // Shrink the ring to `zones` (clamped to nearRadius + 1 .. farRadius);
+    // the next update re-plans it
+    void setRingRadius(int zones);
+    int getRingRadius() const;
+    // the distances over which the ring fades into the sky, for u_FogRange
+    glm::vec2 getFogRange() const;
+
+    size_t getTileCount() const;
+};
+
+// Worker to build the mesh of one LodTile
+class LodTileWorker : public TerrainJob
+{
+private:
+    int xCorner;
+    int zCorner;
+    int level;
+    uint64_t worldSeed;
+    GradientHash gradientHash;
+    std::vector<LodTileData> *completedTiles;
+    QMutex *completedTilesLock;
+
+public:
+    LodTileWorker(int xCorner, int zCorner, int level,
+                  uint64_t worldSeed, GradientHash gradientHash,
+                  std::vector<LodTileData> *completedTiles,
+                  QMutex *completedTilesLock);
+
+    void run() override;
+    bool getFocus(glm::vec2 &xz) const override;
+};
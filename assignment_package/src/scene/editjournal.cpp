@@ -0,0 +1,332 @@
+#include "editjournal.h"
+#include "terrain.h"
+#include <QDir>
+#include <QSaveFile>
+#include <iostream>
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#endif
+
+static const char journalMagic[4] = {'M', 'M', 'E', 'J'};
+static const int journalHeaderSize = 8;
+static const int commitHeaderSize = 8;
+
+static void putUInt32(char *out, uint32_t v)
+{
+    for (int b = 0; b < 4; b++) {
+        out[b] = static_cast<char>((v >> (8 * b)) & 0xFF);
+    }
+}
+
+static uint32_t getUInt32(const char *in)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < 4; b++) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(in[b])) << (8 * b);
+    }
+    return v;
+}
+
+// FNV-1a, enough to tell a torn commit from a whole one
+static uint32_t checksum(const char *data, int size)
+{
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < size; i++) {
+        hash = (hash ^ static_cast<unsigned char>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+//--------------------------
+// I/O tasks
+//--------------------------
+class EditJournal::CommitTask : public TerrainJob
+{
+private:
+    EditJournal *journal;
+    QByteArray records;
+
+public:
+    CommitTask(EditJournal *journal, QByteArray records)
+        : journal(journal), records(std::move(records))
+    {}
+
+    void run() override
+    {
+        if (!journal->appendCommit(records)) {
+            std::cout << "Failed to journal " << records.size() / recordSize << " edits in "
+                      << journal->m_path.toStdString() << std::endl;
+        }
+        journal->m_committing.store(false, std::memory_order_release);
+    }
+};
+
+class EditJournal::RewriteTask : public TerrainJob
+{
+private:
+    EditJournal *journal;
+    QByteArray records;
+
+public:
+    RewriteTask(EditJournal *journal, QByteArray records)
+        : journal(journal), records(std::move(records))
+    {}
+
+    void run() override
+    {
+        if (!journal->rewrite(records)) {
+            std::cout << "Failed to rewrite " << journal->m_path.toStdString() << std::endl;
+        }
+    }
+};
+
+//--------------------------
+// EditJournal
+//--------------------------
+EditJournal::EditJournal(const QString &directory, TerrainJobSystem &jobs)
+    : m_directory(directory), m_path(QDir(directory).filePath("edits.mmj")), m_file(),
+      m_pending(), m_committedRecords(0), m_committing(false),
+      m_replayed(), m_replayedCount(0), mp_jobs(&jobs)
+{
+    if (!replayFile()) {
+        // later commits must not land after the torn one
+        std::cout << "Dropping a torn commit of " << m_path.toStdString() << std::endl;
+        rewrite(encodeReplayed());
+    }
+    m_committedRecords = m_replayedCount;
+}
+
+EditJournal::~EditJournal()
+{
+    sync();
+    mp_jobs->waitForDone(TerrainJobQueue::io);
+}
+
+void EditJournal::encode(QByteArray &out, const JournalEdit &edit)
+{
+    char raw[recordSize];
+    putUInt32(raw, static_cast<uint32_t>(edit.pos.x));
+    putUInt32(raw + 4, static_cast<uint32_t>(edit.pos.z));
+    raw[8] = static_cast<char>(edit.pos.y & 0xFF);
+    raw[9] = static_cast<char>((edit.pos.y >> 8) & 0xFF);
+    raw[10] = static_cast<char>(edit.before);
+    raw[11] = static_cast<char>(edit.after);
+    out.append(raw, recordSize);
+}
+
+/**
+ * @brief EditJournal::replayFile
+ *  A file with a bad header holds nothing to replay and is rewritten.
+ * @return
+ */
+bool EditJournal::replayFile()
+{
+    QFile file(m_path);
+    if (!file.exists()) {
+        return true;
+    }
+    if (!file.open(QFile::ReadOnly)) {
+        return true;
+    }
+    QByteArray data = file.readAll();
+    if (data.size() < journalHeaderSize || !data.startsWith(QByteArray(journalMagic, 4))
+            || getUInt32(data.constData() + 4) != formatVersion) {
+        return false;
+    }
+
+    int offset = journalHeaderSize;
+    while (offset < data.size()) {
+        if (data.size() - offset < commitHeaderSize) {
+            return false;
+        }
+        uint32_t count = getUInt32(data.constData() + offset);
+        uint32_t sum = getUInt32(data.constData() + offset + 4);
+        offset += commitHeaderSize;
+        if (count > static_cast<uint32_t>((data.size() - offset) / recordSize)) {
+            return false;
+        }
+        int bytes = static_cast<int>(count) * recordSize;
+        const char *records = data.constData() + offset;
+        if (checksum(records, bytes) != sum) {
+            return false;
+        }
+        for (int i = 0; i < bytes; i += recordSize) {
+            const char *record = records + i;
+            JournalEdit edit;
+            edit.pos.x = static_cast<int32_t>(getUInt32(record));
+            edit.pos.z = static_cast<int32_t>(getUInt32(record + 4));
+            edit.pos.y = static_cast<unsigned char>(record[8]) | (static_cast<unsigned char>(record[9]) << 8);
+            edit.before = static_cast<BlockType>(record[10]);
+            edit.after = static_cast<BlockType>(record[11]);
+            m_replayed[toKey(edit.pos.x & ~15, edit.pos.z & ~15)].push_back(edit);
+            m_replayedCount++;
+        }
+        offset += bytes;
+    }
+    return true;
+}
+
+QByteArray EditJournal::encodeReplayed() const
+{
+    QByteArray records;
+    records.reserve(static_cast<int>(m_replayedCount) * recordSize);
+    for (const std::pair<const int64_t, std::vector<JournalEdit>> &chunk : m_replayed) {
+        for (const JournalEdit &edit : chunk.second) {
+            encode(records, edit);
+        }
+    }
+    return records;
+}
+
+void EditJournal::append(glm::ivec3 pos, BlockType before, BlockType after)
+{
+    encode(m_pending, JournalEdit{pos, before, after});
+}
+
+void EditJournal::submitPending()
+{
+    m_committedRecords += m_pending.size() / recordSize;
+    m_committing.store(true, std::memory_order_relaxed);
+    mp_jobs->submit<CommitTask>(TerrainJobQueue::io, 0, this, std::move(m_pending));
+    m_pending = QByteArray();
+}
+
+/**
+ * @brief EditJournal::commit
+ *  The group commit: while a commit syncs the file, the edits pile up in
+ *  the buffer and go in the next one together.
+ */
+void EditJournal::commit()
+{
+    if (!m_pending.isEmpty() && !m_committing.load(std::memory_order_acquire)) {
+        submitPending();
+    }
+}
+
+/**
+ * @brief EditJournal::sync
+ *  For the region writes about to be queued: an edit they hold must not
+ *  be left out of the journal while older ones for the same block are in
+ *  it, or a replay would roll the block back.
+ */
+void EditJournal::sync()
+{
+    if (!m_pending.isEmpty()) {
+        submitPending();
+    }
+}
+
+void EditJournal::checkpoint()
+{
+    m_pending = QByteArray();
+    if (m_committedRecords == m_replayedCount) {
+        // nothing was journaled since the file last held just these
+        return;
+    }
+    m_committedRecords = m_replayedCount;
+    mp_jobs->submit<RewriteTask>(TerrainJobQueue::io, 0, this, encodeReplayed());
+}
+
+/**
+ * @brief EditJournal::takeReplayedEdits
+ * @param x   : corner of the chunk
+ * @param z
+ * @param out
+ * @return false if it has none
+ */
+bool EditJournal::takeReplayedEdits(int x, int z, std::vector<JournalEdit> &out)
+{
+    auto replayed = m_replayed.find(toKey(x, z));
+    if (replayed == m_replayed.end()) {
+        return false;
+    }
+    m_replayedCount -= replayed->second.size();
+    out.insert(out.end(), replayed->second.begin(), replayed->second.end());
+    m_replayed.erase(replayed);
+    return true;
+}
+
+size_t EditJournal::getRecordCount() const
+{
+    return m_committedRecords + m_pending.size() / recordSize;
+}
+
+size_t EditJournal::getReplayedCount() const
+{
+    return m_replayedCount;
+}
+
+/**
+ * @brief EditJournal::appendCommit
+ *  The commit's header and records go in one write, then to the disk.
+ * @param records
+ * @return
+ */
+bool EditJournal::appendCommit(const QByteArray &records)
+{
+    if (!m_file.isOpen()) {
+        if (!QDir().mkpath(m_directory)) {
+            return false;
+        }
+        m_file.setFileName(m_path);
+        if (!m_file.open(QFile::WriteOnly | QFile::Append)) {
+            return false;
+        }
+        if (m_file.size() < journalHeaderSize) {
+            char header[journalHeaderSize];
+            std::copy(journalMagic, journalMagic + 4, header);
+            putUInt32(header + 4, formatVersion);
+            if (!m_file.resize(0) || m_file.write(header, journalHeaderSize) != journalHeaderSize) {
+                m_file.close();
+                return false;
+            }
+        }
+    }
+
+    QByteArray commit(commitHeaderSize, '\0');
+    putUInt32(commit.data(), static_cast<uint32_t>(records.size() / recordSize));
+    putUInt32(commit.data() + 4, checksum(records.constData(), records.size()));
+    commit.append(records);
+    if (m_file.write(commit) != commit.size() || !m_file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_UNIX
+    return fsync(m_file.handle()) == 0;
+#else
+    return true;
+#endif
+}
+
+/**
+ * @brief EditJournal::rewrite
+ *  Replaced whole through a save file, so a crash midway leaves the old
+ *  journal, whose edits are still safe to replay.
+ * @param records : the edits the new journal starts with
+ * @return
+ */
+bool EditJournal::rewrite(const QByteArray &records)
+{
+    m_file.close();
+    if (!QDir().mkpath(m_directory)) {
+        return false;
+    }
+    QSaveFile file(m_path);
+    if (!file.open(QFile::WriteOnly)) {
+        return false;
+    }
+    QByteArray data(journalHeaderSize, '\0');
+    std::copy(journalMagic, journalMagic + 4, data.data());
+    putUInt32(data.data() + 4, formatVersion);
+    if (!records.isEmpty()) {
+        char commit[commitHeaderSize];
+        putUInt32(commit, static_cast<uint32_t>(records.size() / recordSize));
+        putUInt32(commit + 4, checksum(records.constData(), records.size()));
+        data.append(commit, commitHeaderSize);
+        data.append(records);
+    }
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
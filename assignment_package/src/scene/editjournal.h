@@ -0,0 +1,116 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include "terrainjobs.h"
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// One block edit as the journal records it
+struct JournalEdit
+{
+    glm::ivec3 pos;
+    BlockType before;
+    BlockType after;
+};
+
+/**
+ * @brief The EditJournal class
+ *  Write-ahead log of the block edits, next to the region files of a
+ *  RegionStore (edits.mmj):
+ *
+ *   [0, 4)        magic "MMEJ"
+ *   [4, 8)        format version
+ *   [8, ...)      commits: a uint32 record count, a uint32 checksum of the
+ *                 records (FNV-1a), then the records, 12 bytes each:
+ *                 int32 x, int32 z, uint16 y, uint8 old, uint8 new
+ *
+ *  All integers are little endian. An edit costs one append to a memory
+ *  buffer; commit() hands the buffer to one job of the terrain's I/O queue,
+ *  which appends it and syncs the file. Only one commit is in flight at a
+ *  time, so the edits made meanwhile are grouped into the next one.
+ *
+ *  The journal holds the edits since the last checkpoint(): once their
+ *  chunks are queued for the region store, it is rewritten empty. The
+ *  I/O queue runs in submission order, so the rewrite follows the chunks'
+ *  writes, and a crash leaves either the chunks or the edits on disk.
+ *  The edits found when the journal is opened are replayed: a chunk takes
+ *  its own (takeReplayedEdits) once it is decorated. They are absolute
+ *  values in order, so replaying them over chunks that already hold some
+ *  of them is harmless. A torn last commit is dropped.
+ *
+ *  The public interface is main thread only.
+ */
+class EditJournal
+{
+public:
+    static const uint32_t formatVersion = 1;
+    static const int recordSize = 12;
+
+private:
+    class CommitTask;
+    class RewriteTask;
+
+    QString m_directory;
+    QString m_path;
+    // appended to by the commits; closed by a rewrite (I/O jobs only)
+    QFile m_file;
+
+    // records not handed to a commit yet
+    QByteArray m_pending;
+    // records in the file or on their way to it since the last checkpoint
+    size_t m_committedRecords;
+    // a commit job is queued or running
+    std::atomic<bool> m_committing;
+
+    // the replayed edits not taken yet, keyed by toKey of the chunk's corner
+    std::unordered_map<int64_t, std::vector<JournalEdit>> m_replayed;
+    size_t m_replayedCount;
+
+    // runs the tasks on its I/O queue, one at a time in order
+    TerrainJobSystem *mp_jobs;
+
+    static void encode(QByteArray &out, const JournalEdit &edit);
+    // read the file into m_replayed; false if it ends in a torn commit
+    bool replayFile();
+    QByteArray encodeReplayed() const;
+    void submitPending();
+
+    // I/O jobs
+    bool appendCommit(const QByteArray &records);
+    bool rewrite(const QByteArray &records);
+
+public:
+    // Open (or create) the journal in `directory`, reading back the edits
+    // it holds; the file accesses run on the I/O queue of `jobs`
+    EditJournal(const QString &directory, TerrainJobSystem &jobs);
+    // commits the pending edits and waits for them
+    ~EditJournal();
+
+    EditJournal(const EditJournal&) = delete;
+    EditJournal &operator=(const EditJournal&) = delete;
+
+    // buffer one edit
+    void append(glm::ivec3 pos, BlockType before, BlockType after);
+    // queue a commit of the buffered edits, unless one is in flight
+    void commit();
+    // queue a commit of the buffered edits now, ahead of the I/O jobs
+    // submitted next
+    void sync();
+    // the modified chunks were just queued for the region store: drop the
+    // edits they hold and queue the journal's rewrite with the replayed
+    // edits still untaken
+    void checkpoint();
+
+    // move the replayed edits of the chunk with this corner to out, in order
+    bool takeReplayedEdits(int x, int z, std::vector<JournalEdit> &out);
+
+    // edits since the last checkpoint, buffered ones included
+    size_t getRecordCount() const;
+    size_t getReplayedCount() const;
+};
@@ -0,0 +1,129 @@
+#include "entitygrid.h"
+#include "terrain.h"
+#include <algorithm>
+
+EntityGrid::EntityGrid()
+    : m_cells(), m_entries(), m_maxReach(0.f), m_lock()
+{}
+
+int64_t EntityGrid::cellAt(float x, float z)
+{
+    return toKey(16 * static_cast<int>(glm::floor(x / 16.f)), 16 * static_cast<int>(glm::floor(z / 16.f)));
+}
+
+/**
+ * @brief EntityGrid::place
+ *  Only moving to another column touches the cells.
+ * @param entity
+ * @param position
+ * @param halfExtents
+ */
+void EntityGrid::place(const Entity *entity, glm::vec3 position, glm::vec3 halfExtents)
+{
+    int64_t cell = cellAt(position.x, position.z);
+    m_lock.lock();
+    m_maxReach = glm::max(m_maxReach, glm::max(halfExtents.x, glm::max(halfExtents.y, halfExtents.z)));
+    auto it = m_entries.find(entity);
+    if (it == m_entries.end()) {
+        m_entries.emplace(entity, Entry{position, halfExtents, cell});
+        m_cells[cell].push_back(entity);
+    } else {
+        Entry &entry = it->second;
+        if (entry.cell != cell) {
+            std::vector<const Entity*> &old = m_cells[entry.cell];
+            old.erase(std::find(old.begin(), old.end(), entity));
+            if (old.empty()) {
+                m_cells.erase(entry.cell);
+            }
+            m_cells[cell].push_back(entity);
+        }
+        entry = Entry{position, halfExtents, cell};
+    }
+    m_lock.unlock();
+}
+
+void EntityGrid::remove(const Entity *entity)
+{
+    m_lock.lock();
+    auto it = m_entries.find(entity);
+    if (it != m_entries.end()) {
+        std::vector<const Entity*> &cell = m_cells[it->second.cell];
+        cell.erase(std::find(cell.begin(), cell.end(), entity));
+        if (cell.empty()) {
+            m_cells.erase(it->second.cell);
+        }
+        m_entries.erase(it);
+    }
+    m_lock.unlock();
+}
+
+/**
+ * @brief EntityGrid::queryRadius
+ *  The columns the square around center overlaps, widened by the widest
+ *  box so a big entity in the next column is not missed.
+ * @param center
+ * @param radius
+ * @param hits
+ */
+void EntityGrid::queryRadius(glm::vec3 center, float radius, std::vector<Hit> &hits)
+{
+    m_lock.lock();
+    float reach = radius + m_maxReach;
+    int minX = static_cast<int>(glm::floor((center.x - reach) / 16.f));
+    int maxX = static_cast<int>(glm::floor((center.x + reach) / 16.f));
+    int minZ = static_cast<int>(glm::floor((center.z - reach) / 16.f));
+    int maxZ = static_cast<int>(glm::floor((center.z + reach) / 16.f));
+    for (int x = minX; x <= maxX; x++) {
+        for (int z = minZ; z <= maxZ; z++) {
+            auto cell = m_cells.find(toKey(16 * x, 16 * z));
+            if (cell == m_cells.end()) {
+                continue;
+            }
+            for (const Entity *entity : cell->second) {
+                const Entry &entry = m_entries[entity];
+                // from center to the nearest point of the box
+                glm::vec3 d = glm::max(glm::abs(entry.position - center) - entry.halfExtents, glm::vec3(0.f));
+                if (glm::dot(d, d) <= radius * radius) {
+                    hits.push_back(Hit{entity, entry.position, entry.halfExtents});
+                }
+            }
+        }
+    }
+    m_lock.unlock();
+}
+
+/**
+ * @brief EntityGrid::gatherVisible
+ *  The columns are tested whole first, over the world's height, then the
+ *  boxes in the columns that may be seen.
+ * @param frustum
+ * @param entities
+ */
+void EntityGrid::gatherVisible(const Frustum &frustum, std::vector<const Entity*> &entities)
+{
+    m_lock.lock();
+    glm::vec3 pad(m_maxReach);
+    for (const auto &cell : m_cells) {
+        glm::ivec2 corner = toCoords(cell.first);
+        glm::vec3 min = glm::vec3(corner.x, 0.f, corner.y) - pad;
+        glm::vec3 max = glm::vec3(corner.x + 16.f, 256.f, corner.y + 16.f) + pad;
+        if (!frustum.intersectsBox(min, max)) {
+            continue;
+        }
+        for (const Entity *entity : cell.second) {
+            const Entry &entry = m_entries[entity];
+            if (frustum.intersectsBox(entry.position - entry.halfExtents, entry.position + entry.halfExtents)) {
+                entities.push_back(entity);
+            }
+        }
+    }
+    m_lock.unlock();
+}
+
+size_t EntityGrid::size()
+{
+    m_lock.lock();
+    size_t count = m_entries.size();
+    m_lock.unlock();
+    return count;
+}
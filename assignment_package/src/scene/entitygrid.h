@@ -0,0 +1,62 @@
+#pragma once
+
+#include "entity.h"
+#include "frustum.h"
+#include "glm_includes.h"
+#include <QMutex>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The EntityGrid class
+ *  The entities of the world by the chunk column they are in, each as an
+ *  axis-aligned box around its center, so finding the ones near a point or in
+ *  view looks at a few columns rather than at every entity. The entities
+ *  place themselves as they move (see NPC::react, Player::tick).
+ *  Any thread may place entities and query at once: the NPCs place
+ *  themselves from the simulation's threads while the renderer gathers
+ *  the visible ones.
+ */
+class EntityGrid
+{
+public:
+    // an entity as last placed
+    struct Hit
+    {
+        const Entity *entity;
+        glm::vec3 position;
+        glm::vec3 halfExtents;
+    };
+
+private:
+    struct Entry
+    {
+        glm::vec3 position;
+        glm::vec3 halfExtents;
+        int64_t cell;
+    };
+
+    // the entities in each chunk column, by toKey of its corner
+    std::unordered_map<int64_t, std::vector<const Entity*>> m_cells;
+    std::unordered_map<const Entity*, Entry> m_entries;
+    // the widest box placed, reaching into the columns around a query
+    float m_maxReach;
+    QMutex m_lock;
+
+    static int64_t cellAt(float x, float z);
+
+public:
+    EntityGrid();
+
+    // insert entity, or move it, centered at position
+    void place(const Entity *entity, glm::vec3 position, glm::vec3 halfExtents);
+    void remove(const Entity *entity);
+
+    // append the entities whose boxes reach within radius of center
+    void queryRadius(glm::vec3 center, float radius, std::vector<Hit> &hits);
+    // append the entities whose boxes may be in frustum
+    void gatherVisible(const Frustum &frustum, std::vector<const Entity*> &entities);
+
+    size_t size();
+};
@@ -0,0 +1,140 @@
+#include "flatscenegraph.h"
+#include "node.h"
+#include <algorithm>
+
+FlatSceneGraph::FlatSceneGraph()
+    : mcr_root(nullptr), m_nodes(), m_palette(), m_parts()
+{}
+
+/**
+ * @brief FlatSceneGraph::flatten
+ *  Depth first, so a subtree is the node and the ones right after it.
+ * @param node
+ * @param parent
+ */
+void FlatSceneGraph::flatten(Node *node, int parent)
+{
+    int index = static_cast<int>(m_nodes.size());
+    int part = -1;
+    if (node->block != nullptr) {
+        part = static_cast<int>(m_parts.size());
+        m_parts.push_back(node->block);
+        m_palette.push_back(glm::mat4(1.f));
+    }
+    m_nodes.push_back(FlatNode{node, parent, index + 1, glm::mat4(1.f), glm::mat4(1.f), part});
+    for (const uPtr<Node> &child : node->getChildren()) {
+        flatten(child.get(), index);
+    }
+    m_nodes[index].subtreeEnd = static_cast<int>(m_nodes.size());
+}
+
+void FlatSceneGraph::build(Node *root)
+{
+    mcr_root = root;
+    m_nodes.clear();
+    m_palette.clear();
+    m_parts.clear();
+    if (root == nullptr) {
+        return;
+    }
+    flatten(root, -1);
+    // every node reads as changed once
+    for (FlatNode &n : m_nodes) {
+        n.node->takeChanged();
+        n.local = n.node->computeTransform(glm::mat4(1.f));
+        n.model = n.parent >= 0 ? m_nodes[n.parent].model * n.local : n.local;
+        if (n.part >= 0) {
+            m_palette[n.part] = n.model;
+        }
+    }
+}
+
+/**
+ * @brief FlatSceneGraph::update
+ *  A changed node's subtree is redone whole, picking up any changed
+ *  nodes in it on the way, then skipped.
+ * @param root
+ */
+void FlatSceneGraph::update(Node *root)
+{
+    if (root != mcr_root) {
+        build(root);
+        return;
+    }
+    int i = 0;
+    int count = static_cast<int>(m_nodes.size());
+    while (i < count) {
+        if (!m_nodes[i].node->takeChanged()) {
+            i++;
+            continue;
+        }
+        int end = m_nodes[i].subtreeEnd;
+        for (int j = i; j < end; j++) {
+            FlatNode &n = m_nodes[j];
+            if (j == i || n.node->takeChanged()) {
+                n.local = n.node->computeTransform(glm::mat4(1.f));
+            }
+            n.model = n.parent >= 0 ? m_nodes[n.parent].model * n.local : n.local;
+            if (n.part >= 0) {
+                m_palette[n.part] = n.model;
+            }
+        }
+        i = end;
+    }
+}
+
+const FlatSceneGraph::Palette &FlatSceneGraph::getPalette() const
+{
+    return m_palette;
+}
+
+const FlatSceneGraph::Parts &FlatSceneGraph::getParts() const
+{
+    return m_parts;
+}
+
+/**
+ * @brief FlatSceneGraph::buildRig
+ *  Any joint past the second is baked in at its current angle, as are
+ *  the nodes between the joints. The joints' own angles are left out:
+ *  the shader sets them all to the limb angle, as
+ *  NPC::applyLimbRotations does.
+ * @param joints
+ * @param texels
+ */
+void FlatSceneGraph::buildRig(const std::vector<Node*> &joints, std::vector<glm::vec4> &texels) const
+{
+    std::vector<int> path;
+    for (const FlatNode &n : m_nodes) {
+        if (n.part < 0) {
+            continue;
+        }
+        path.clear();
+        for (int k = static_cast<int>(&n - m_nodes.data()); k >= 0; k = m_nodes[k].parent) {
+            path.push_back(k);
+        }
+        std::reverse(path.begin(), path.end());
+
+        glm::mat4 segments[3] = {glm::mat4(1.f), glm::mat4(1.f), glm::mat4(1.f)};
+        glm::vec4 axes[2] = {glm::vec4(0.f, 0.f, 1.f, 0.f), glm::vec4(0.f, 0.f, 1.f, 0.f)};
+        int segment = 0;
+        for (int k : path) {
+            Node *node = m_nodes[k].node;
+            RotateNode *joint = dynamic_cast<RotateNode*>(node);
+            if (segment < 2 && joint != nullptr
+                && std::find(joints.begin(), joints.end(), node) != joints.end()) {
+                axes[segment] = glm::vec4(glm::normalize(joint->getAxis()), 1.f);
+                segment++;
+                continue;
+            }
+            segments[segment] = segments[segment] * m_nodes[k].local;
+        }
+        for (const glm::mat4 &m : segments) {
+            for (int column = 0; column < 4; column++) {
+                texels.push_back(m[column]);
+            }
+        }
+        texels.push_back(axes[0]);
+        texels.push_back(axes[1]);
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "glm_includes.h"
+#include "memorystats.h"
+#include <vector>
+
+class Node;
+class NPCBlock;
+
+/**
+ * @brief The FlatSceneGraph class
+ *  An NPC's scene graph laid out in one array, parents before children,
+ *  with each node's transform relative to the root cached. Only a node
+ *  whose own transform changed (see Node::takeChanged), e.g. a swinging
+ *  limb, and the nodes below it are recomputed; the rest keep last
+ *  frame's. The transforms of the nodes with a block make a contiguous
+ *  palette, one matrix per part, for instancing.
+ *  The tree must not change shape once built.
+ */
+class FlatSceneGraph
+{
+public:
+    // counted in MemoryCategory::npcGraphs, as is the layout
+    using Palette = TrackedVector<glm::mat4, MemoryCategory::npcGraphs>;
+    using Parts = TrackedVector<NPCBlock*, MemoryCategory::npcGraphs>;
+
+private:
+    struct FlatNode
+    {
+        Node *node;
+        // index of the parent, -1 at the root
+        int parent;
+        // one past the last node of the subtree
+        int subtreeEnd;
+        // the node's own transform, and the product down from the root
+        glm::mat4 local;
+        glm::mat4 model;
+        // index in the palette, -1 without a block
+        int part;
+    };
+
+    const Node *mcr_root;
+    TrackedVector<FlatNode, MemoryCategory::npcGraphs> m_nodes;
+    Palette m_palette;
+    Parts m_parts;
+
+    void flatten(Node *node, int parent);
+
+public:
+    FlatSceneGraph();
+
+    // lay out the tree under root, computing every transform
+    void build(Node *root);
+
+    // Recompute the changed nodes and their subtrees, building from root
+    // first if the graph was laid out from another tree or none
+    void update(Node *root);
+
+    // relative to the root: the world transform is the root's times these
+    const Palette &getPalette() const;
+    // the block drawn with each matrix of the palette
+    const Parts &getParts() const;
+
+    // texels per part of a rig (see buildRig)
+    static const int rigTexels = 14;
+
+    // Lay each part's transform out as the vertex shader poses it: split
+    // at the first two of joints (RotateNodes) on the way down from the
+    // root, three segment matrices (12 texels), then each joint's axis
+    // with w = 1, or w = 0 if there are fewer. Appends rigTexels per
+    // part, in palette order; must be built
+    void buildRig(const std::vector<Node*> &joints, std::vector<glm::vec4> &texels) const;
+};
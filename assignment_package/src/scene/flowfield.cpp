@@ -0,0 +1,166 @@
+#include "flowfield.h"
+#include "chunknavigation.h"
+#include "terrain.h"
+#include <algorithm>
+
+/**
+ * @brief The FieldMove struct
+ *  A move an NPC can make from a walkable block to another
+ */
+struct FieldMove
+{
+    glm::ivec3 offset;
+    uint16_t cost;
+    Action action;
+};
+
+/**
+ * @brief fieldMoves
+ * @return the walks to each of the 8 columns around, level or one or two
+ * down, and the jumps to them one up
+ */
+static const std::vector<FieldMove> &fieldMoves()
+{
+    static const std::vector<FieldMove> moves = []() {
+        std::vector<FieldMove> all;
+        for (int dx : {-1, 0, 1}) {
+            for (int dz : {-1, 0, 1}) {
+                if (dx == 0 && dz == 0) {
+                    continue;
+                }
+                for (int dy : {-2, -1, 0}) {
+                    all.push_back(FieldMove{glm::ivec3(dx, dy, dz), 1, WALK});
+                }
+                all.push_back(FieldMove{glm::ivec3(dx, 1, dz), 2, JUMP});
+            }
+        }
+        return all;
+    }();
+    return moves;
+}
+
+FlowField::FlowField()
+    : m_goal(0), m_valid(false),
+      m_steps(static_cast<size_t>(side) * side * height, unreachable),
+      m_moves(static_cast<size_t>(side) * side * height, -1)
+{}
+
+int FlowField::cellIndex(glm::ivec3 block) const
+{
+    glm::ivec3 d = block - m_goal + glm::ivec3(radius, halfHeight, radius);
+    if (d.x < 0 || d.x >= side || d.z < 0 || d.z >= side || d.y < 0 || d.y >= height) {
+        return -1;
+    }
+    return d.x + side * (d.z + side * d.y);
+}
+
+glm::ivec3 FlowField::blockAt(int cell) const
+{
+    return m_goal + glm::ivec3(cell % side - radius, cell / (side * side) - halfHeight,
+                               (cell / side) % side - radius);
+}
+
+/**
+ * @brief FlowField::compute
+ *  Dijkstra from the goal backward, over the blocks a move leads from;
+ *  with costs of one and two, a bucket per distance is the queue.
+ * @param terrain : only read where NPC ticks may run (see NPCSimulation)
+ * @param position
+ * @return
+ */
+bool FlowField::compute(const Terrain &terrain, glm::vec3 position)
+{
+    m_valid = false;
+    NavigationView view(terrain, position, radius + 1);
+    glm::ivec3 feet = glm::ivec3(glm::floor(position));
+    int ground = view.highestOccupiedAtOrBelow(feet.x, feet.y, feet.z);
+    if (ground < 0 || feet.y - ground > 4 || !view.isWalkable(feet.x, ground, feet.z)) {
+        return false;
+    }
+    m_goal = glm::ivec3(feet.x, ground, feet.z);
+    std::fill(m_steps.begin(), m_steps.end(), unreachable);
+    std::fill(m_moves.begin(), m_moves.end(), -1);
+
+    const std::vector<FieldMove> &moves = fieldMoves();
+    int goalCell = cellIndex(m_goal);
+    m_steps[goalCell] = 0;
+    std::vector<std::vector<int>> buckets(1, std::vector<int>(1, goalCell));
+    for (size_t d = 0; d < buckets.size(); d++) {
+        // indexed: pushing farther buckets may move this one
+        for (size_t i = 0; i < buckets[d].size(); i++) {
+            int cell = buckets[d][i];
+            if (m_steps[cell] != d) {
+                continue;
+            }
+            glm::ivec3 block = blockAt(cell);
+            for (size_t m = 0; m < moves.size(); m++) {
+                glm::ivec3 from = block - moves[m].offset;
+                int fromCell = cellIndex(from);
+                size_t steps = d + moves[m].cost;
+                if (fromCell < 0 || steps >= m_steps[fromCell] || !view.isWalkable(from.x, from.y, from.z)) {
+                    continue;
+                }
+                m_steps[fromCell] = static_cast<uint16_t>(steps);
+                m_moves[fromCell] = static_cast<int8_t>(m);
+                if (buckets.size() <= steps) {
+                    buckets.resize(steps + 1);
+                }
+                buckets[steps].push_back(fromCell);
+            }
+        }
+        std::vector<int>().swap(buckets[d]);
+    }
+    m_valid = true;
+    return true;
+}
+
+bool FlowField::isValid() const
+{
+    return m_valid;
+}
+
+glm::ivec3 FlowField::getGoal() const
+{
+    return m_goal;
+}
+
+/**
+ * @brief FlowField::follow
+ *  The block stood on is taken to be under the feet, or at them or two
+ *  down while stepping, whichever the field reaches first.
+ * @param position : an NPC's bottom
+ * @param maxSteps
+ * @param actions : replaced on success
+ * @return
+ */
+bool FlowField::follow(glm::vec3 position, int maxSteps, std::queue<NPCAction> &actions) const
+{
+    if (!m_valid) {
+        return false;
+    }
+    glm::ivec3 feet = glm::ivec3(glm::floor(position));
+    int cell = -1;
+    for (int dy : {-1, 0, -2}) {
+        int c = cellIndex(feet + glm::ivec3(0, dy, 0));
+        if (c >= 0 && m_steps[c] != unreachable) {
+            cell = c;
+            break;
+        }
+    }
+    // at the goal there is nowhere to go
+    if (cell < 0 || m_steps[cell] == 0) {
+        return false;
+    }
+
+    const std::vector<FieldMove> &moves = fieldMoves();
+    glm::ivec3 block = blockAt(cell);
+    actions = std::queue<NPCAction>();
+    for (int i = 0; i < maxSteps && m_steps[cell] > 0; i++) {
+        const FieldMove &move = moves[m_moves[cell]];
+        block += move.offset;
+        // to the top of the block, like the A* search's paths
+        actions.push(NPCAction(glm::vec3(block + glm::ivec3(0, 1, 0)), move.action));
+        cell = cellIndex(block);
+    }
+    return true;
+}
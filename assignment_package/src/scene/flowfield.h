@@ -0,0 +1,58 @@
+#pragma once
+
+#include "glm_includes.h"
+#include "pathfinder.h"
+#include <cstdint>
+#include <queue>
+#include <vector>
+
+class Terrain;
+
+/**
+ * @brief The FlowField class
+ *  A Dijkstra map toward one goal block: for every walkable block around
+ *  it, the steps an NPC needs to get there and its first move, so any
+ *  number of NPCs chasing the same goal read their next moves instead of
+ *  searching. The moves are the A* search's walks (one block over, level
+ *  or down to two) and jumps one block up, costing two.
+ *  The field covers radius blocks around the goal horizontally and
+ *  halfHeight up and down; it is a snapshot of the terrain when it was
+ *  computed, refreshed by its owner (see NPCSimulation).
+ */
+class FlowField
+{
+public:
+    static const int radius = 32;
+    static const int halfHeight = 24;
+
+private:
+    static const int side = 2 * radius + 1;
+    static const int height = 2 * halfHeight;
+    static const uint16_t unreachable = 0xFFFF;
+
+    // the block stood on at the goal; the grid is centered there
+    glm::ivec3 m_goal;
+    bool m_valid;
+    // per block, x fastest then z then y
+    std::vector<uint16_t> m_steps;
+    std::vector<int8_t> m_moves;
+
+    // the block's index in the grid, or -1 outside it
+    int cellIndex(glm::ivec3 block) const;
+    glm::ivec3 blockAt(int cell) const;
+
+public:
+    FlowField();
+
+    // Replace the field by one toward the block stood on at position;
+    // false, leaving the field invalid, if there is none to stand on
+    bool compute(const Terrain &terrain, glm::vec3 position);
+
+    bool isValid() const;
+    glm::ivec3 getGoal() const;
+
+    // Put the moves from the block stood on at position into actions, at
+    // most maxSteps of them; false if the field does not reach position.
+    // Only reads the field, so any number of threads may at once
+    bool follow(glm::vec3 position, int maxSteps, std::queue<NPCAction> &actions) const;
+};
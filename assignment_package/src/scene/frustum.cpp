@@ -0,0 +1,42 @@
+#include "frustum.h"
+
+/**
+ * @brief Frustum::Frustum
+ *  Each plane is the fourth row of the matrix plus or minus one of the
+ *  first three (clip-space -w <= x, y, z <= w). Of a reversed camera's
+ *  (0 <= z <= w, no far plane; see Camera::setReverseZ) the z planes
+ *  come out as the near plane and its mirror behind the eye: looser,
+ *  never wrong.
+ * @param viewProj
+ */
+Frustum::Frustum(const glm::mat4 &viewProj)
+{
+    // glm is column-major: row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+    glm::mat4 t = glm::transpose(viewProj);
+    planes[0] = t[3] + t[0];
+    planes[1] = t[3] - t[0];
+    planes[2] = t[3] + t[1];
+    planes[3] = t[3] - t[1];
+    planes[4] = t[3] + t[2];
+    planes[5] = t[3] - t[2];
+}
+
+/**
+ * @brief Frustum::intersectsBox
+ *  Tests the corner farthest along each plane's normal.
+ * @param min
+ * @param max
+ * @return false only if the box is certainly outside
+ */
+bool Frustum::intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const
+{
+    for (const glm::vec4 &plane : planes) {
+        glm::vec3 corner(plane.x >= 0.f ? max.x : min.x,
+                         plane.y >= 0.f ? max.y : min.y,
+                         plane.z >= 0.f ? max.z : min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.f) {
+            return false;
+        }
+    }
+    return true;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "glm_includes.h"
+#include <array>
+
+/**
+ * @brief The Frustum class
+ *  The six clip planes of a view projection matrix, in world space,
+ *  for conservative culling of axis-aligned boxes: a box is only
+ *  rejected if it lies fully outside one plane.
+ */
+class Frustum
+{
+private:
+    // (n, d) with n . p + d >= 0 inside; not normalized, only signs are used
+    std::array<glm::vec4, 6> planes;
+
+public:
+    explicit Frustum(const glm::mat4 &viewProj);
+
+    // may the box [min, max] be visible?
+    bool intersectsBox(const glm::vec3 &min, const glm::vec3 &max) const;
+};
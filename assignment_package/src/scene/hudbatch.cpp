@@ -0,0 +1,71 @@
+#include "hudbatch.h"
+#include <algorithm>
+
+HudBatch::HudBatch(OpenGLContext *context)
+    : Drawable(context), m_pos(), m_uv(), m_uploadedPos(), m_uploadedUV(), m_quadCapacity(0)
+{}
+
+HudBatch::~HudBatch() {}
+
+void HudBatch::clear()
+{
+    m_pos.clear();
+    m_uv.clear();
+}
+
+void HudBatch::addQuads(const ArenaVector<float> &pos, const ArenaVector<float> &uv, Layer layer, bool translucent)
+{
+    m_pos.insert(m_pos.end(), pos.begin(), pos.end());
+    for (size_t i = 0; i + 1 < uv.size(); i += 2) {
+        pushVec4ToBuffer(m_uv, glm::vec4(uv[i], uv[i + 1], layer, translucent ? 1.f : 0.f));
+    }
+}
+
+/**
+ * @brief HudBatch::createVBOdata
+ *  The buffers grow to twice what is needed, so a line of text getting
+ *  a digit longer does not reallocate every time it does.
+ */
+void HudBatch::createVBOdata()
+{
+    // destroyVBOdata() drops the buffers and with them what was uploaded
+    if (m_posGenerated && m_pos == m_uploadedPos && m_uv == m_uploadedUV) {
+        return;
+    }
+    if (!m_posGenerated) {
+        m_quadCapacity = 0;
+        // generated once; each generate*() makes a new buffer
+        generateIdx();
+        generatePos();
+        generateUV();
+    }
+
+    int quads = static_cast<int>(m_pos.size() / 16);
+    m_count = quads * 6;
+
+    if (quads > m_quadCapacity) {
+        m_quadCapacity = std::max(2 * quads, 64);
+
+        std::vector<GLuint> indices;
+        std::vector<GLuint> faceIndices = {0, 1, 2, 0, 2, 3};
+        for (int i = 0; i < m_quadCapacity; ++i) {
+            for (GLuint index : faceIndices) {
+                indices.push_back(4 * i + index);
+            }
+        }
+        bindIdx();
+        mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    }
+
+    // orphaned: the frame in flight keeps drawing the last quads
+    bindPos();
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_quadCapacity * 16 * sizeof(float), nullptr, GL_STREAM_DRAW);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, 0, m_pos.size() * sizeof(float), m_pos.data());
+
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufUV);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, m_quadCapacity * 16 * sizeof(float), nullptr, GL_STREAM_DRAW);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, 0, m_uv.size() * sizeof(float), m_uv.data());
+
+    m_uploadedPos = m_pos;
+    m_uploadedUV = m_uv;
+}
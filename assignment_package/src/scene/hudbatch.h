@@ -0,0 +1,51 @@
+#pragma once
+#include "drawable.h"
+#include <vector>
+
+/**
+ * @brief The HudBatch class
+ *  Every quad of the HUD in one buffer, drawn in one call with one
+ *  program: each vertex carries the layer of the HUD's texture array it
+ *  reads (see TextureArray) and whether it blends, so one blended draw
+ *  looks as the draws per texture did. The HudDrawables add their quads
+ *  in drawing order each frame.
+ *  The HUD comes out the same most frames, so createVBOdata compares
+ *  with what it sent last and only uploads on a change: the inventory,
+ *  the HP or the grabbed item moving. A change that fits the buffers
+ *  orphans and refills them rather than reallocating; the quads'
+ *  indices never change, so they only go up when the quads outgrow them.
+ */
+class HudBatch : public Drawable
+{
+public:
+    // the layers of the HUD's texture array
+    enum Layer : int {
+        icons = 0, widgets = 1, container = 2, font = 3
+    };
+    static const int layerCount = 4;
+
+private:
+    // this frame's: 4 vec4 positions and 4 vec4 (u, v, layer, blends)
+    // per quad
+    std::vector<float> m_pos;
+    std::vector<float> m_uv;
+    // as last uploaded
+    std::vector<float> m_uploadedPos;
+    std::vector<float> m_uploadedUV;
+    // the quads the buffers have room for
+    int m_quadCapacity;
+
+public:
+    HudBatch(OpenGLContext *context);
+    virtual ~HudBatch();
+
+    // start the frame's quads
+    void clear();
+    // Quads drawn from layer: 4 vec4 positions and 4 vec2 uvs each,
+    // bottom-left, bottom-right, top-right, top-left. Drawn over the
+    // quads added before; translucent ones blend, the others cover
+    void addQuads(const ArenaVector<float> &pos, const ArenaVector<float> &uv, Layer layer, bool translucent);
+
+    // upload the frame's quads, if they changed
+    void createVBOdata() override;
+};
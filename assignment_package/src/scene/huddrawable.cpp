@@ -0,0 +1,21 @@
+#include "huddrawable.h"
+
+HudDrawable::HudDrawable(OpenGLContext *context)
+    : Drawable(context), mp_batch(nullptr), m_layer(HudBatch::icons), m_translucent(false)
+{}
+
+HudDrawable::~HudDrawable() {}
+
+void HudDrawable::addQuads(const ArenaVector<float> &pos, const ArenaVector<float> &uv)
+{
+    if (mp_batch != nullptr) {
+        mp_batch->addQuads(pos, uv, m_layer, m_translucent);
+    }
+}
+
+void HudDrawable::setBatch(HudBatch *batch, HudBatch::Layer layer, bool translucent)
+{
+    mp_batch = batch;
+    m_layer = layer;
+    m_translucent = translucent;
+}
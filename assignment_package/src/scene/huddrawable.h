@@ -0,0 +1,31 @@
+#pragma once
+#include "drawable.h"
+#include "hudbatch.h"
+#include <vector>
+
+/**
+ * @brief The HudDrawable class
+ *  A part of the HUD, rebuilt on the CPU every tick: createVBOdata adds
+ *  its quads to the frame's HudBatch, which draws the whole HUD at once,
+ *  rather than uploading buffers of its own.
+ */
+class HudDrawable : public Drawable
+{
+private:
+    // null: not drawn
+    HudBatch *mp_batch;
+    HudBatch::Layer m_layer;
+    bool m_translucent;
+
+protected:
+    // Add these quads to the batch: 4 vec4 positions and 4 vec2 uvs per
+    // quad, bottom-left, bottom-right, top-right, top-left
+    void addQuads(const ArenaVector<float> &pos, const ArenaVector<float> &uv);
+
+public:
+    HudDrawable(OpenGLContext *context);
+    virtual ~HudDrawable();
+
+    // draw into batch from layer, blending if translucent
+    void setBatch(HudBatch *batch, HudBatch::Layer layer, bool translucent);
+};
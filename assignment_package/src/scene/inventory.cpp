@@ -1,4 +1,5 @@
 #include "inventory.h"
+#include <algorithm>
 
 Inventory::Inventory()
     : selectedBlockPtr(0), max_blocks(64), blocksOnHandSize(9), blocksInInventorySize(blocksOnHandSize+27)
@@ -31,6 +32,10 @@ void Inventory::getItemInfo(std::vector<std::pair<BlockType, int>>* itemsInfo) {
     *itemsInfo = blocksInInventory;
 }
 
+const std::vector<std::pair<BlockType, int>> &Inventory::getItems() const {
+    return blocksInInventory;
+}
+
 /**
  * @brief Inventory::setBlock
  *  set the block at the specific location
@@ -105,6 +110,28 @@ bool Inventory::storeBlock(BlockType blockType) {
     return false;
 }
 
+int Inventory::storeBlocks(BlockType blockType, int count) {
+    int stored = 0;
+
+    // top up the stacks of this type first, then fill empty slots
+    for (int i = 0; i < blocksInInventorySize && stored < count; ++i) {
+        if (blocksInInventory[i].first == blockType && blocksInInventory[i].second < max_blocks) {
+            int added = std::min(count - stored, max_blocks - blocksInInventory[i].second);
+            blocksInInventory[i].second += added;
+            stored += added;
+        }
+    }
+    for (int i = 0; i < blocksInInventorySize && stored < count; ++i) {
+        if (Block::isEmpty(blocksInInventory[i].first)) {
+            int added = std::min(count - stored, max_blocks);
+            blocksInInventory[i].first = blockType;
+            blocksInInventory[i].second = added;
+            stored += added;
+        }
+    }
+    return stored;
+}
+
 BlockType Inventory::placeBlock() {
     if (Block::isEmpty(blocksInInventory[selectedBlockPtr].first)) {
         return EMPTY;
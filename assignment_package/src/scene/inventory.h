@@ -37,6 +37,8 @@ public:
 
     void getItemInfo(float overallIdx, BlockType* itemType, int* count);
     void getItemInfo(std::vector<std::pair<BlockType, int>>* itemsInfo);
+    // every item, without the copy getItemInfo makes
+    const std::vector<std::pair<BlockType, int>> &getItems() const;
 
     // Assign blocks to the player
     // mainly used for debug or creative mode
@@ -47,6 +49,8 @@ public:
     // add destroyed block to inventory
     // Add to onhand first. Add to the inventory if onHand is full
     bool storeBlock(BlockType blockType);
+    // storeBlock count blocks at once; returns how many found room
+    int storeBlocks(BlockType blockType, int count);
 
     // return the selected block and subtract the block by 1
     BlockType placeBlock();
@@ -0,0 +1,126 @@
+#include "lightvolume.h"
+#include <algorithm>
+
+LightVolume::LightVolume()
+    : m_origin(0), m_size(0), m_light(), m_blocks(), m_skyTops()
+{}
+
+void LightVolume::reset(glm::ivec3 origin, glm::ivec3 size)
+{
+    m_origin = origin;
+    m_size = size;
+    m_light.assign(static_cast<size_t>(size.x) * size.y * size.z, 0);
+    m_blocks.assign(m_light.size(), static_cast<uint8_t>(opaqueFlag));
+    m_skyTops.assign(static_cast<size_t>(size.x) * size.z, origin.y + size.y);
+}
+
+/**
+ * @brief LightVolume::solve
+ *  A column's open sky is at full light all the way down, so the sky only
+ *  floods from where a column beside it is covered lower down; the block
+ *  light floods from every emissive block.
+ */
+void LightVolume::solve()
+{
+    std::fill(m_light.begin(), m_light.end(), 0);
+    std::vector<int> queue;
+
+    for (int z = 0; z < m_size.z; z++) {
+        for (int x = 0; x < m_size.x; x++) {
+            int column = x + m_size.x * z;
+            int base = m_size.y * column;
+            int top = glm::clamp(m_skyTops[column] - m_origin.y, 0, m_size.y);
+            // the open cells facing a covered one beside them
+            int seedEnd = top;
+            const int sides[4][2] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+            for (const int *side : sides) {
+                int nx = x + side[0];
+                int nz = z + side[1];
+                if (nx < 0 || nz < 0 || nx >= m_size.x || nz >= m_size.z) {
+                    continue;
+                }
+                int sideTop = glm::clamp(m_skyTops[nx + m_size.x * nz] - m_origin.y, 0, m_size.y);
+                seedEnd = std::max(seedEnd, sideTop);
+            }
+            for (int y = top; y < m_size.y; y++) {
+                if (m_blocks[base + y] & opaqueFlag) {
+                    continue;
+                }
+                m_light[base + y] = maxLight << 4;
+                if (y < seedEnd) {
+                    queue.push_back(base + y);
+                }
+            }
+        }
+    }
+    flood(queue, 4);
+
+    for (size_t i = 0; i < m_blocks.size(); i++) {
+        int emission = m_blocks[i] & 15;
+        if (emission > 0) {
+            m_light[i] |= static_cast<uint8_t>(emission);
+            queue.push_back(static_cast<int>(i));
+        }
+    }
+    flood(queue, 0);
+}
+
+/**
+ * @brief LightVolume::flood
+ *  A cell is queued again if a brighter path reaches it later; the copy
+ *  already queued then spreads the new level too, which is harmless.
+ * @param queue : the lit cells to spread from; emptied
+ * @param shift
+ */
+void LightVolume::flood(std::vector<int> &queue, int shift)
+{
+    const int steps[3] = {1, m_size.y, m_size.y * m_size.x};
+    const int sizes[3] = {m_size.y, m_size.x, m_size.z};
+
+    for (size_t head = 0; head < queue.size(); head++) {
+        int i = queue[head];
+        int level = (m_light[i] >> shift) & 15;
+        if (level <= 1) {
+            continue;
+        }
+        int column = i / m_size.y;
+        const int coords[3] = {i % m_size.y, column % m_size.x, column / m_size.x};
+
+        for (int axis = 0; axis < 3; axis++) {
+            for (int sign = -1; sign <= 1; sign += 2) {
+                int c = coords[axis] + sign;
+                if (c < 0 || c >= sizes[axis]) {
+                    continue;
+                }
+                int n = i + sign * steps[axis];
+                if ((m_blocks[n] & opaqueFlag) || ((m_light[n] >> shift) & 15) >= level - 1) {
+                    continue;
+                }
+                m_light[n] = static_cast<uint8_t>((m_light[n] & ~(15 << shift)) | ((level - 1) << shift));
+                queue.push_back(n);
+            }
+        }
+    }
+    queue.clear();
+}
+
+bool LightVolume::isOpaque(int x, int y, int z) const
+{
+    if (y >= m_origin.y + m_size.y) {
+        return false;
+    }
+    return !contains(x, y, z) || (m_blocks[index(x, y, z)] & opaqueFlag);
+}
+
+int LightVolume::getSkyLight(int x, int y, int z) const
+{
+    if (y >= m_origin.y + m_size.y) {
+        return maxLight;
+    }
+    return contains(x, y, z) ? m_light[index(x, y, z)] >> 4 : 0;
+}
+
+int LightVolume::getBlockLight(int x, int y, int z) const
+{
+    return contains(x, y, z) ? m_light[index(x, y, z)] & 15 : 0;
+}
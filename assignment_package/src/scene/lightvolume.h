@@ -0,0 +1,81 @@
+#pragma once
+
+#include "glm_includes.h"
+#include <cstdint>
+#include <vector>
+
+/**
+ * @brief The LightVolume class
+ *  The sky and block light, 0 to maxLight each, of a box of blocks. A
+ *  column is at full sky light down to its highest opaque block, an
+ *  emissive block is at its emission, and from there light floods into
+ *  non-opaque blocks, a level less per block.
+ *  Light reaches maxLight - 1 blocks at most, so the light the box holds
+ *  is exact wherever the box extends at least maxLight - 1 blocks past it.
+ *  Past the box: open sky above it (the caller ends the box above every
+ *  opaque block or after the blocks it needs), dark opaque blocks anywhere
+ *  else.
+ *  Cells are addressed by the caller's coordinates; (x, y, z) in the box
+ *  is y fastest, like BlockSection::localIndex.
+ */
+class LightVolume
+{
+public:
+    static const int maxLight = 15;
+
+private:
+    static const uint8_t opaqueFlag = 0x10;
+
+    glm::ivec3 m_origin;
+    glm::ivec3 m_size;
+    // per cell: sky << 4 | block
+    std::vector<uint8_t> m_light;
+    // per cell: opaqueFlag | emission
+    std::vector<uint8_t> m_blocks;
+    // per column (x + size.x * z): the lowest y, in the caller's
+    // coordinates, from which the column is open sky
+    std::vector<int> m_skyTops;
+
+    // flood the channel (shift 4: sky, 0: block) from the cells queued
+    void flood(std::vector<int> &queue, int shift);
+
+public:
+    LightVolume();
+
+    // The box of `size` cells from `origin`, every one opaque, dark and
+    // not emissive, under no sky
+    void reset(glm::ivec3 origin, glm::ivec3 size);
+
+    glm::ivec3 getOrigin() const {
+        return m_origin;
+    }
+    glm::ivec3 getSize() const {
+        return m_size;
+    }
+    bool contains(int x, int y, int z) const {
+        return x >= m_origin.x && y >= m_origin.y && z >= m_origin.z
+                && x < m_origin.x + m_size.x && y < m_origin.y + m_size.y && z < m_origin.z + m_size.z;
+    }
+    // No bounds checking: the caller's (x, y, z) must be in the box
+    int index(int x, int y, int z) const {
+        return (y - m_origin.y) + m_size.y * ((x - m_origin.x) + m_size.x * (z - m_origin.z));
+    }
+
+    // the block at index i; emission in [0, maxLight]
+    void setBlock(int i, bool opaque, int emission) {
+        m_blocks[i] = static_cast<uint8_t>((opaque ? opaqueFlag : 0) | emission);
+    }
+    // column (x, z) is open sky from y up, y being 1 + its highest opaque
+    // block; may lie past the box either way
+    void setSkyTop(int x, int z, int y) {
+        m_skyTops[(x - m_origin.x) + m_size.x * (z - m_origin.z)] = y;
+    }
+
+    // Light the box from its blocks and sky tops
+    void solve();
+
+    // anywhere, past the box as the class describes
+    bool isOpaque(int x, int y, int z) const;
+    int getSkyLight(int x, int y, int z) const;
+    int getBlockLight(int x, int y, int z) const;
+};
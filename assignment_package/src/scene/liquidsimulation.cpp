@@ -0,0 +1,235 @@
+#include "liquidsimulation.h"
+#include "terrain.h"
+#include <algorithm>
+
+// seconds between two steps: the flow's speed, a block per step
+static const float stepSeconds = 0.25f;
+
+static const glm::ivec3 horizontalOffsets[4] = {
+    glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1)
+};
+static const glm::ivec3 neighborOffsets[6] = {
+    glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1),
+    glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0)
+};
+
+LiquidSimulation::LiquidSimulation()
+    : m_chunks(), m_accumulator(0.f), m_step(0), m_lastStepCells(0)
+{}
+
+uint16_t LiquidSimulation::toLocalIndex(glm::ivec3 pos)
+{
+    return static_cast<uint16_t>((pos.y << 8) | ((pos.z & 15) << 4) | (pos.x & 15));
+}
+
+int LiquidSimulation::getLevel(glm::ivec3 pos) const
+{
+    auto chunk = m_chunks.find(toKey(pos.x & ~15, pos.z & ~15));
+    if (chunk == m_chunks.end()) {
+        return 0;
+    }
+    auto level = chunk->second.levels.find(toLocalIndex(pos));
+    return level != chunk->second.levels.end() ? level->second : 0;
+}
+
+void LiquidSimulation::setLevel(glm::ivec3 pos, int level)
+{
+    m_chunks[toKey(pos.x & ~15, pos.z & ~15)].levels[toLocalIndex(pos)] = static_cast<uint8_t>(level);
+}
+
+void LiquidSimulation::placeFlowing(Terrain &terrain, glm::ivec3 pos, BlockType liquid, int level)
+{
+    terrain.placeBlockAt(pos.x, pos.y, pos.z, liquid);
+    if (terrain.tryGetBlockAt(pos.x, pos.y, pos.z) == std::optional<BlockType>(liquid)) {
+        setLevel(pos, level);
+    }
+}
+
+void LiquidSimulation::wake(glm::ivec3 pos)
+{
+    if (pos.y < 0 || pos.y >= 256) {
+        return;
+    }
+    ChunkLiquids &chunk = m_chunks[toKey(pos.x & ~15, pos.z & ~15)];
+    uint16_t index = toLocalIndex(pos);
+    if (chunk.queued.insert(index).second) {
+        chunk.queue.push_back(index);
+    }
+}
+
+void LiquidSimulation::wakeAround(glm::ivec3 pos)
+{
+    wake(pos);
+    for (const glm::ivec3 &offset : neighborOffsets) {
+        wake(pos + offset);
+    }
+}
+
+void LiquidSimulation::noteEdit(glm::ivec3 pos)
+{
+    auto chunk = m_chunks.find(toKey(pos.x & ~15, pos.z & ~15));
+    if (chunk != m_chunks.end()) {
+        chunk->second.levels.erase(toLocalIndex(pos));
+    }
+    wakeAround(pos);
+}
+
+void LiquidSimulation::dropChunk(int xCorner, int zCorner)
+{
+    m_chunks.erase(toKey(xCorner, zCorner));
+}
+
+/**
+ * @brief LiquidSimulation::update
+ *  The cells queued when the step starts are taken out first, so the
+ *  ones it wakes wait for the next step: the liquid moves a block per step.
+ * @param terrain
+ * @param dT
+ */
+void LiquidSimulation::update(Terrain &terrain, float dT)
+{
+    m_accumulator = std::min(m_accumulator + dT, stepSeconds);
+    if (m_accumulator < stepSeconds) {
+        return;
+    }
+    m_accumulator -= stepSeconds;
+    m_step++;
+
+    std::vector<glm::ivec3> cells;
+    for (auto it = m_chunks.begin(); it != m_chunks.end();) {
+        ChunkLiquids &chunk = it->second;
+        glm::ivec2 corner = toCoords(it->first);
+        size_t taken = std::min(chunk.queue.size(), maxCellsPerStep - cells.size());
+        for (size_t i = 0; i < taken; i++) {
+            uint16_t index = chunk.queue[i];
+            chunk.queued.erase(index);
+            cells.push_back(glm::ivec3(corner[0] + (index & 15), index >> 8, corner[1] + ((index >> 4) & 15)));
+        }
+        chunk.queue.erase(chunk.queue.begin(), chunk.queue.begin() + taken);
+        if (chunk.queue.empty() && chunk.levels.empty()) {
+            it = m_chunks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    m_lastStepCells = cells.size();
+    if (cells.empty()) {
+        return;
+    }
+    terrain.beginEdit();
+    for (const glm::ivec3 &cell : cells) {
+        updateCell(terrain, cell);
+    }
+    terrain.commitEdit();
+}
+
+/**
+ * @brief LiquidSimulation::updateCell
+ *  A cell that is no liquid of ours has nothing to do: an emptied one is
+ *  filled by its liquid neighbors, which its edit woke too. A liquid one
+ *  hardens lava it touches, then, if flowing, takes the level its
+ *  neighbors feed it, drying up past the reach; a cell whose level held
+ *  falls into the empty block below it, or spreads to the empty ones
+ *  around it if it rests on something else than liquid.
+ *  Blocks in missing chunks count as solid.
+ * @param terrain
+ * @param pos
+ */
+void LiquidSimulation::updateCell(Terrain &terrain, glm::ivec3 pos)
+{
+    std::optional<BlockType> block = terrain.tryGetBlockAt(pos.x, pos.y, pos.z);
+    if (!block || (*block != WATER && *block != LAVA)) {
+        return;
+    }
+    BlockType liquid = *block;
+    if (liquid == LAVA && m_step % lavaStepInterval != 0) {
+        wake(pos);
+        return;
+    }
+
+    BlockType other = liquid == WATER ? LAVA : WATER;
+    for (const glm::ivec3 &offset : neighborOffsets) {
+        glm::ivec3 neighbor = pos + offset;
+        if (terrain.tryGetBlockAt(neighbor.x, neighbor.y, neighbor.z) == std::optional<BlockType>(other)) {
+            glm::ivec3 lava = liquid == LAVA ? pos : neighbor;
+            terrain.placeBlockAt(lava.x, lava.y, lava.z, COBBLESTONE);
+            return;
+        }
+    }
+
+    int reach = getReach(liquid);
+    int level = getLevel(pos);
+    if (level > 0) {
+        int fed = reach + 1;
+        if (terrain.tryGetBlockAt(pos.x, pos.y + 1, pos.z) == std::optional<BlockType>(liquid)) {
+            fed = 1;
+        } else {
+            for (const glm::ivec3 &offset : horizontalOffsets) {
+                glm::ivec3 neighbor = pos + offset;
+                if (terrain.tryGetBlockAt(neighbor.x, neighbor.y, neighbor.z) == std::optional<BlockType>(liquid)) {
+                    fed = std::min(fed, getLevel(neighbor) + 1);
+                }
+            }
+        }
+        if (fed != level) {
+            if (fed > reach) {
+                terrain.placeBlockAt(pos.x, pos.y, pos.z, EMPTY);
+            } else {
+                setLevel(pos, fed);
+                wakeAround(pos);
+            }
+            return;
+        }
+    }
+
+    std::optional<BlockType> below = terrain.tryGetBlockAt(pos.x, pos.y - 1, pos.z);
+    if (!below || *below == liquid) {
+        return;
+    }
+    if (*below == EMPTY) {
+        placeFlowing(terrain, pos - glm::ivec3(0, 1, 0), liquid, 1);
+        return;
+    }
+    int spread = level + 1;
+    if (spread > reach) {
+        return;
+    }
+    for (const glm::ivec3 &offset : horizontalOffsets) {
+        glm::ivec3 neighbor = pos + offset;
+        std::optional<BlockType> next = terrain.tryGetBlockAt(neighbor.x, neighbor.y, neighbor.z);
+        if (next == std::optional<BlockType>(EMPTY)) {
+            placeFlowing(terrain, neighbor, liquid, spread);
+        } else if (next == std::optional<BlockType>(liquid) && getLevel(neighbor) > spread) {
+            wake(neighbor);
+        }
+    }
+}
+
+size_t LiquidSimulation::getQueuedCellCount() const
+{
+    size_t count = 0;
+    for (const std::pair<const int64_t, ChunkLiquids> &chunk : m_chunks) {
+        count += chunk.second.queue.size();
+    }
+    return count;
+}
+
+size_t LiquidSimulation::getFlowingCellCount() const
+{
+    size_t count = 0;
+    for (const std::pair<const int64_t, ChunkLiquids> &chunk : m_chunks) {
+        count += chunk.second.levels.size();
+    }
+    return count;
+}
+
+size_t LiquidSimulation::getLastStepCellCount() const
+{
+    return m_lastStepCells;
+}
+
+int LiquidSimulation::getReach(BlockType liquid)
+{
+    return liquid == LAVA ? lavaReach : waterReach;
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Terrain;
+
+/**
+ * @brief The LiquidSimulation class
+ *  WATER and LAVA flowing as a cellular automaton over the cells that
+ *  changed, never the whole world: every edit wakes its block and the six
+ *  around it into its chunk's queue, and a step updates the queued cells
+ *  only, waking in turn the ones it changes. Chunks with no queued cell
+ *  cost nothing.
+ *  Liquid blocks are sources unless the simulation made them, in which
+ *  case they have a level, the blocks from their source (1 falling):
+ *  a flowing cell that loses what feeds it dries up, and the level a cell
+ *  spreads at is one more than its own, up to a reach per liquid. Lava
+ *  steps less often and reaches less far, and hardens to COBBLESTONE
+ *  where water touches it.
+ *  A step's writes are one Terrain edit batch, so each chunk they touch is
+ *  remeshed once. The levels live here, not in the blocks: a chunk
+ *  evicted or replaced forgets them, and its flowing cells come back as
+ *  sources. Main thread only; Terrain owns it and reports its edits.
+ */
+class LiquidSimulation
+{
+public:
+    // cells updated per step at most; the rest wait for the next
+    static const int maxCellsPerStep = 2048;
+    // steps between two lava updates
+    static const int lavaStepInterval = 6;
+    // the most blocks a liquid flows from its source on flat ground
+    static const int waterReach = 7;
+    static const int lavaReach = 3;
+
+private:
+    // per chunk, by local index (see toLocalIndex)
+    struct ChunkLiquids
+    {
+        // the flowing cells' levels; a liquid block without one is a source
+        std::unordered_map<uint16_t, uint8_t> levels;
+        // the cells to update next step, once each
+        std::vector<uint16_t> queue;
+        std::unordered_set<uint16_t> queued;
+    };
+    // by toKey of the chunk's corner
+    std::unordered_map<int64_t, ChunkLiquids> m_chunks;
+    float m_accumulator;
+    uint64_t m_step;
+    size_t m_lastStepCells;
+
+    static uint16_t toLocalIndex(glm::ivec3 pos);
+    // 0 for a source, or any block without a level
+    int getLevel(glm::ivec3 pos) const;
+    void setLevel(glm::ivec3 pos, int level);
+    // place flowing liquid at pos, unless its chunk takes no edits yet
+    void placeFlowing(Terrain &terrain, glm::ivec3 pos, BlockType liquid, int level);
+    void wakeAround(glm::ivec3 pos);
+    void updateCell(Terrain &terrain, glm::ivec3 pos);
+
+public:
+    LiquidSimulation();
+
+    // A block was set at pos: it is a source if liquid, and it and its
+    // neighbors are updated next step
+    void noteEdit(glm::ivec3 pos);
+    void wake(glm::ivec3 pos);
+    // forget the chunk's levels and queue (it is evicted or replaced)
+    void dropChunk(int xCorner, int zCorner);
+
+    // Run the steps due after dT seconds, at most one per call, writing
+    // through terrain's placeBlockAt in one batch
+    void update(Terrain &terrain, float dT);
+
+    size_t getQueuedCellCount() const;
+    size_t getFlowingCellCount() const;
+    // the cells the last step updated
+    size_t getLastStepCellCount() const;
+
+    static int getReach(BlockType liquid);
+};
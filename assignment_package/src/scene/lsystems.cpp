@@ -8,8 +8,8 @@
 // **********************************************************************************************
 // LSYSTEM START
 
-LSystem::LSystem(glm::vec2 pos, glm::vec2 heading, float fDistance) :
-    path(""), activeTurtle(Turtle(pos, heading, fDistance)), turtleStack(), ruleSet(), charToDrawingOperation(), branchProb(1.0f) {}
+LSystem::LSystem(glm::vec2 pos, glm::vec2 heading, float fDistance, uint64_t seed) :
+    path(""), activeTurtle(Turtle(pos, heading, fDistance)), turtleStack(), ruleSet(), charToDrawingOperation(), branchProb(1.0f), rng(seed) {}
 
 LSystem::~LSystem(){}
 
@@ -69,11 +69,11 @@ void LSystem::F(){
 }
 
 void LSystem::minusSign(){
-    activeTurtle.turnLeft();
+    activeTurtle.turnLeft(rand01());
 }
 
 void LSystem::plusSign(){
-    activeTurtle.turnRight();
+    activeTurtle.turnRight(rand01());
 }
 
 void LSystem::X(){}
@@ -83,8 +83,7 @@ void LSystem::printPath(){
 }
 
 float LSystem::rand01(){
-    float n = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-    return n;
+    return rng.nextFloat();
 }
 
 // LSYSTEM END
@@ -104,14 +103,14 @@ Turtle::Turtle(const Turtle& t) :
 
 Turtle::~Turtle(){}
 
-void Turtle::turnLeft(){
-    float angle = PI_4 - randAngle();
+void Turtle::turnLeft(float r){
+    float angle = PI_4 - randAngle(r);
     orientation = glm::vec2(orientation[0] * cosf(angle) - orientation[1] * sinf(angle),
                             orientation[0] * sinf(angle) + orientation[1] * cosf(angle));
 }
 
-void Turtle::turnRight(){
-    float angle = -PI_4 + randAngle();
+void Turtle::turnRight(float r){
+    float angle = -PI_4 + randAngle(r);
     orientation = glm::vec2(orientation[0] * cosf(angle) - orientation[1] * sinf(angle),
                             orientation[0] * sinf(angle) + orientation[1] * cosf(angle));
 }
@@ -137,17 +136,16 @@ void Turtle::printOrientation() const{
     std::cout << "(" << orientation[0] << ", " << orientation[1] << ")" << std::endl;
 }
 
-float Turtle::randAngle() const{
-    float n = static_cast <float> (rand()) / static_cast <float> (RAND_MAX);
-    return n * PI_4;
+float Turtle::randAngle(float r) const{
+    return r * PI_4;
 }
 
 // TURTLE END
 // **********************************************************************************************
 // TREE START
 
-Tree::Tree(glm::vec2 pos, float fDistance) :
-    LSystem(pos, glm::vec2(0.0f, 1.0f), fDistance){
+Tree::Tree(glm::vec2 pos, float fDistance, uint64_t seed) :
+    LSystem(pos, glm::vec2(0.0f, 1.0f), fDistance, seed){
     this->branchProb = 0.7f;
 }
 
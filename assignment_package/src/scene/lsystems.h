@@ -7,6 +7,7 @@
 #include <QStack>
 #include <QRegularExpression>
 #include <time.h>
+#include "random.h"
 
 using namespace glm;
 using namespace std;
@@ -32,8 +33,9 @@ public:
     Turtle(const Turtle& t);
     ~Turtle();
 
-    void turnLeft();
-    void turnRight();
+    // r in [0, 1) picks the jitter of the turn
+    void turnLeft(float r);
+    void turnRight(float r);
     void moveForward();
     void increaseDepth();
     void decreaseDepth();
@@ -41,7 +43,7 @@ public:
     void printCoordinates() const;  // prints turtle's position
     void printOrientation() const;  // prints turtle's orientation vector
 private:
-    float randAngle() const;        // returns an angle between 0 and PI/4 radians
+    float randAngle(float r) const; // maps r in [0, 1) to an angle between 0 and PI/4 radians
 };
 
 class LSystem
@@ -53,8 +55,9 @@ public:
     QHash<QChar, QString> ruleSet;              // char -> string map replacement rules for generating turtle path instructions
     QHash<QChar, Rule> charToDrawingOperation;  // maps characters to LSystem functions controlling this turtle
     float branchProb;                           // probability of branch generation
+    Random rng;                                 // per-system stream, so trees are reproducible from their seed
 
-    LSystem(glm::vec2 pos, glm::vec2 heading, float fDistance);
+    LSystem(glm::vec2 pos, glm::vec2 heading, float fDistance, uint64_t seed);
     virtual ~LSystem();
 
     virtual void generatePath(int n, QString seed, int type); // generates path to be traversed by turtle (n branching events)
@@ -75,7 +78,7 @@ protected:
 
 class Tree : public LSystem{                        // An LSystem Tree
 public:
-    Tree(glm::vec2 pos, float fDistance);
+    Tree(glm::vec2 pos, float fDistance, uint64_t seed);
     virtual ~Tree();
 };
 
@@ -0,0 +1,257 @@
+#include "meshcache.h"
+#include "terrain.h"
+#include <QDir>
+#include <QFile>
+#include <algorithm>
+#include <iostream>
+
+static const char cacheMagic[4] = {'M', 'M', 'M', 'C'};
+static const qint64 tableOffset = 8;
+static const qint64 entrySize = 16;
+static const qint64 headerSize = tableOffset + entrySize * MeshCache::regionChunks * MeshCache::regionChunks;
+
+// floor(a / b) for b > 0
+static int floorDiv(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// region of the chunk with corner (x, z), and the chunk's index in it
+static void regionLocation(int x, int z, int &rx, int &rz, int &local)
+{
+    int cx = floorDiv(x, 16);
+    int cz = floorDiv(z, 16);
+    rx = floorDiv(cx, MeshCache::regionChunks);
+    rz = floorDiv(cz, MeshCache::regionChunks);
+    local = (cx - rx * MeshCache::regionChunks) + MeshCache::regionChunks * (cz - rz * MeshCache::regionChunks);
+}
+
+static void putUInt32(char *out, uint32_t v)
+{
+    for (int b = 0; b < 4; b++) {
+        out[b] = static_cast<char>((v >> (8 * b)) & 0xFF);
+    }
+}
+
+static uint32_t getUInt32(const char *in)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < 4; b++) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(in[b])) << (8 * b);
+    }
+    return v;
+}
+
+class MeshCache::WriteTask : public TerrainJob
+{
+private:
+    MeshCache *cache;
+    PendingMesh mesh;
+
+public:
+    WriteTask(MeshCache *cache, PendingMesh mesh)
+        : cache(cache), mesh(std::move(mesh))
+    {}
+
+    void run() override
+    {
+        if (!cache->writeCacheEntry(mesh.x, mesh.z, mesh.key, mesh.mesh)) {
+            std::cout << "Failed to cache the mesh of chunk " << mesh.x << ", " << mesh.z
+                      << " in " << cache->m_directory.toStdString() << std::endl;
+        }
+    }
+};
+
+MeshCache::MeshCache(const QString &directory, TerrainJobSystem &jobs)
+    : m_directory(directory), m_tables(), m_fileLock(), m_pending(), m_pendingLock(),
+      m_hits(0), m_misses(0), mp_jobs(&jobs)
+{
+    QDir dir(m_directory);
+    for (const QString &name : dir.entryList(QStringList("m.*.*.mmc"), QDir::Files)) {
+        QStringList parts = name.split('.');
+        bool xOk = false;
+        bool zOk = false;
+        int rx = parts.size() == 4 ? parts[1].toInt(&xOk) : 0;
+        int rz = parts.size() == 4 ? parts[2].toInt(&zOk) : 0;
+        if (xOk && zOk) {
+            readTable(rx, rz);
+        }
+    }
+}
+
+MeshCache::~MeshCache()
+{
+    flush();
+}
+
+QString MeshCache::cacheFilePath(int rx, int rz) const
+{
+    return QDir(m_directory).filePath(QString("m.%1.%2.mmc").arg(rx).arg(rz));
+}
+
+/**
+ * @brief MeshCache::readTable
+ *  A file with a bad header or of another version is ignored, and
+ *  overwritten by the next mesh cached in its region.
+ * @param rx
+ * @param rz
+ */
+void MeshCache::readTable(int rx, int rz)
+{
+    QFile file(cacheFilePath(rx, rz));
+    if (!file.open(QFile::ReadOnly)) {
+        return;
+    }
+    QByteArray header = file.read(headerSize);
+    if (header.size() != headerSize || !header.startsWith(QByteArray(cacheMagic, 4))
+            || getUInt32(header.constData() + 4) != formatVersion) {
+        return;
+    }
+
+    std::vector<CacheEntry> table(regionChunks * regionChunks);
+    for (int i = 0; i < regionChunks * regionChunks; i++) {
+        const char *entry = header.constData() + tableOffset + entrySize * i;
+        table[i] = {getUInt32(entry), getUInt32(entry + 4),
+                    getUInt32(entry + 8) | static_cast<uint64_t>(getUInt32(entry + 12)) << 32};
+    }
+    m_tables[toKey(rx, rz)] = table;
+}
+
+/**
+ * @brief MeshCache::load
+ *  The key is checked against the table before the file is touched, so a
+ *  miss costs no read.
+ * @param x   : corner of the chunk
+ * @param z
+ * @param key
+ * @return the mesh as it was stored, or empty
+ */
+QByteArray MeshCache::load(int x, int z, uint64_t key)
+{
+    int rx, rz, local;
+    regionLocation(x, z, rx, rz, local);
+
+    QByteArray mesh;
+    m_fileLock.lock();
+    auto table = m_tables.find(toKey(rx, rz));
+    if (table != m_tables.end() && table->second[local].size != 0 && table->second[local].key == key) {
+        CacheEntry entry = table->second[local];
+        QFile file(cacheFilePath(rx, rz));
+        if (file.open(QFile::ReadOnly) && file.seek(entry.offset)) {
+            QByteArray payload = file.read(entry.size);
+            if (payload.size() == static_cast<int>(entry.size)) {
+                mesh = qUncompress(payload);
+            }
+        }
+    }
+    m_fileLock.unlock();
+
+    if (mesh.isEmpty()) {
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        m_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    return mesh;
+}
+
+void MeshCache::store(int x, int z, uint64_t key, QByteArray mesh)
+{
+    m_pendingLock.lock();
+    m_pending.push_back(PendingMesh{x, z, key, std::move(mesh)});
+    m_pendingLock.unlock();
+}
+
+uint64_t MeshCache::getHitCount() const
+{
+    return m_hits.load(std::memory_order_relaxed);
+}
+
+uint64_t MeshCache::getMissCount() const
+{
+    return m_misses.load(std::memory_order_relaxed);
+}
+
+void MeshCache::submitWrites()
+{
+    std::vector<PendingMesh> pending;
+    m_pendingLock.lock();
+    pending.swap(m_pending);
+    m_pendingLock.unlock();
+    for (PendingMesh &mesh : pending) {
+        mp_jobs->submit<WriteTask>(TerrainJobQueue::io, 0, this, std::move(mesh));
+    }
+}
+
+void MeshCache::flush()
+{
+    submitWrites();
+    mp_jobs->waitForDone(TerrainJobQueue::io);
+}
+
+/**
+ * @brief MeshCache::writeCacheEntry
+ *  Compressed at the fastest level, outside the lock: the meshes are
+ *  regenerated if lost, and the meshing jobs wait on the lock to load.
+ * @param x
+ * @param z
+ * @param key
+ * @param mesh
+ * @return
+ */
+bool MeshCache::writeCacheEntry(int x, int z, uint64_t key, const QByteArray &mesh)
+{
+    int rx, rz, local;
+    regionLocation(x, z, rx, rz, local);
+    QByteArray payload = qCompress(mesh, 1);
+
+    if (!QDir().mkpath(m_directory)) {
+        return false;
+    }
+    QMutexLocker locker(&m_fileLock);
+    QFile file(cacheFilePath(rx, rz));
+    if (!file.open(QFile::ReadWrite)) {
+        return false;
+    }
+
+    std::vector<CacheEntry> &table = m_tables[toKey(rx, rz)];
+    if (table.empty() || file.size() < headerSize) {
+        // new (or unreadable) file: start from an empty table
+        table.assign(regionChunks * regionChunks, {0, 0, 0});
+        QByteArray header(headerSize, '\0');
+        std::copy(cacheMagic, cacheMagic + 4, header.data());
+        putUInt32(header.data() + 4, formatVersion);
+        if (!file.resize(0) || file.write(header) != headerSize) {
+            return false;
+        }
+    }
+
+    CacheEntry entry = table[local];
+    if (entry.size == 0 || static_cast<uint32_t>(payload.size()) > entry.size) {
+        entry.offset = static_cast<uint32_t>(file.size());
+    }
+    entry.size = static_cast<uint32_t>(payload.size());
+    entry.key = key;
+
+    // the old entry stays valid until the table says otherwise, but an
+    // overwritten slot does not: take it out of the table first
+    char raw[entrySize];
+    std::fill(raw, raw + entrySize, '\0');
+    if (!file.seek(tableOffset + entrySize * local) || file.write(raw, entrySize) != entrySize) {
+        return false;
+    }
+    table[local].size = 0;
+
+    if (!file.seek(entry.offset) || file.write(payload) != payload.size() || !file.flush()) {
+        return false;
+    }
+
+    putUInt32(raw, entry.offset);
+    putUInt32(raw + 4, entry.size);
+    putUInt32(raw + 8, static_cast<uint32_t>(key));
+    putUInt32(raw + 12, static_cast<uint32_t>(key >> 32));
+    if (!file.seek(tableOffset + entrySize * local) || file.write(raw, entrySize) != entrySize) {
+        return false;
+    }
+    table[local] = entry;
+    return true;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "terrainjobs.h"
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @brief The MeshCache class
+ *  On-disk cache of the chunks' meshes across sessions, next to the region
+ *  files, so a chunk whose neighborhood is as it was last time skips
+ *  lighting and meshing. One file per region of 32 x 32 chunks
+ *  (m.<rx>.<rz>.mmc):
+ *
+ *   [0, 4)         magic "MMMC"
+ *   [4, 8)         format version
+ *   [8, 16392)     table: per chunk (cx + 32 * cz in the region) a uint32
+ *                  offset, a uint32 size (0 if absent) and the uint64 key
+ *                  the mesh was made for
+ *   [16392, ...)   the meshes, zlib-compressed (qCompress)
+ *
+ *  All integers are little endian; slots are reused and appended as in
+ *  RegionStore. A chunk keeps one mesh: storing another key replaces it.
+ *  The key (see Chunk::meshCacheKey) hashes the blocks the mesh depends
+ *  on and the mesher's version and settings, so a stale mesh is a miss
+ *  and never loaded. What a mesh holds is up to Chunk, which encodes its
+ *  section faces (see Chunk::serializeSectionMeshes).
+ *
+ *  load() runs on the meshing jobs; store() only queues the mesh, and
+ *  submitWrites() hands the queue to the terrain's I/O queue. The file
+ *  accesses take one lock, so a read never sees half a write.
+ */
+class MeshCache
+{
+public:
+    static const int regionChunks = 32;
+    static const uint32_t formatVersion = 1;
+
+private:
+    struct CacheEntry
+    {
+        uint32_t offset;
+        uint32_t size;
+        uint64_t key;
+    };
+
+    struct PendingMesh
+    {
+        int x;
+        int z;
+        uint64_t key;
+        QByteArray mesh;
+    };
+
+    class WriteTask;
+
+    QString m_directory;
+
+    // tables of the cache files, keyed by toKey(rx, rz), and every access
+    // to the files, under m_fileLock
+    std::unordered_map<int64_t, std::vector<CacheEntry>> m_tables;
+    QMutex m_fileLock;
+
+    // meshes stored since the last submitWrites, under m_pendingLock
+    std::vector<PendingMesh> m_pending;
+    QMutex m_pendingLock;
+
+    std::atomic<uint64_t> m_hits;
+    std::atomic<uint64_t> m_misses;
+
+    // runs the writes on its I/O queue
+    TerrainJobSystem *mp_jobs;
+
+    QString cacheFilePath(int rx, int rz) const;
+    void readTable(int rx, int rz);
+    // I/O jobs
+    bool writeCacheEntry(int x, int z, uint64_t key, const QByteArray &mesh);
+
+public:
+    // Open (or create) the cache in `directory`, reading every file's table
+    MeshCache(const QString &directory, TerrainJobSystem &jobs);
+    // waits for the queued writes
+    ~MeshCache();
+
+    MeshCache(const MeshCache&) = delete;
+    MeshCache &operator=(const MeshCache&) = delete;
+
+    // Any thread.
+    // the mesh stored for the chunk with this corner under `key`; empty if
+    // there is none, or only one of another key
+    QByteArray load(int x, int z, uint64_t key);
+    // queue the chunk's mesh for writing under `key`
+    void store(int x, int z, uint64_t key, QByteArray mesh);
+    // the loads that found a mesh, and those that did not
+    uint64_t getHitCount() const;
+    uint64_t getMissCount() const;
+
+    // Main thread.
+    // submit the meshes stored since the last call to the I/O queue
+    void submitWrites();
+    // submitWrites(), then block until every queued I/O job is done
+    void flush();
+};
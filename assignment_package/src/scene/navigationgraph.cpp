@@ -0,0 +1,459 @@
+#include "navigationgraph.h"
+#include "chunk.h"
+#include "chunkmap.h"
+#include "terrain.h"
+#include <algorithm>
+#include <queue>
+
+/**
+ * @brief The ChunkCells struct
+ *  The walkable blocks of one chunk from NavigationGraph::minHeight up,
+ *  for breadth-first searches within the chunk
+ */
+struct ChunkCells
+{
+    static const int span = 256 - NavigationGraph::minHeight;
+
+    // local to the chunk
+    std::vector<glm::ivec3> cells;
+    // the cell of each block, or -1
+    std::vector<int> index;
+
+    explicit ChunkCells(const ChunkNavigation &navigation);
+
+    // the cell of the block local to the chunk, or -1
+    int find(glm::ivec3 block) const;
+    // the steps from cell from to every cell, -1 where out of reach, and
+    // the cell each was reached from
+    void search(int from, std::vector<int> &steps, std::vector<int> *parents) const;
+};
+
+ChunkCells::ChunkCells(const ChunkNavigation &navigation)
+    : cells(), index(16 * 16 * span, -1)
+{
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            for (int y = NavigationGraph::minHeight; y < 256; y++) {
+                if (navigation.isWalkable(x, y, z)) {
+                    index[(x + 16 * z) * span + y - NavigationGraph::minHeight] = static_cast<int>(cells.size());
+                    cells.push_back(glm::ivec3(x, y, z));
+                }
+            }
+        }
+    }
+}
+
+int ChunkCells::find(glm::ivec3 block) const
+{
+    if (block.x < 0 || block.x >= 16 || block.z < 0 || block.z >= 16
+            || block.y < NavigationGraph::minHeight || block.y >= 256) {
+        return -1;
+    }
+    return index[(block.x + 16 * block.z) * span + block.y - NavigationGraph::minHeight];
+}
+
+/**
+ * @brief ChunkCells::search
+ *  A step goes to any of the 8 columns around, one block up, down or
+ *  level, so the steps between two cells are the same either way.
+ * @param from
+ * @param steps
+ * @param parents : may be null
+ */
+void ChunkCells::search(int from, std::vector<int> &steps, std::vector<int> *parents) const
+{
+    steps.assign(cells.size(), -1);
+    if (parents != nullptr) {
+        parents->assign(cells.size(), -1);
+    }
+    std::vector<int> frontier;
+    frontier.reserve(cells.size());
+    frontier.push_back(from);
+    steps[from] = 0;
+    for (size_t head = 0; head < frontier.size(); head++) {
+        int cell = frontier[head];
+        for (int dx : {-1, 0, 1}) {
+            for (int dz : {-1, 0, 1}) {
+                if (dx == 0 && dz == 0) {
+                    continue;
+                }
+                for (int dy : {-1, 0, 1}) {
+                    int next = find(cells[cell] + glm::ivec3(dx, dy, dz));
+                    if (next < 0 || steps[next] >= 0) {
+                        continue;
+                    }
+                    steps[next] = steps[cell] + 1;
+                    if (parents != nullptr) {
+                        (*parents)[next] = cell;
+                    }
+                    frontier.push_back(next);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief navigationAt
+ * @param terrain
+ * @param chunk : in chunk coordinates
+ * @return the chunk's navigation, or null if it is missing or not navigable
+ */
+static const ChunkNavigation *navigationAt(const Terrain &terrain, glm::ivec2 chunk)
+{
+    const Chunk *c = terrain.findChunk(chunk.x * 16, chunk.y * 16);
+    return c != nullptr && c->getNavigation().isBuilt() ? &c->getNavigation() : nullptr;
+}
+
+/**
+ * @brief findEntrances
+ *  Each border column connects by its highest pair of walkable blocks at
+ *  most one apart in height; a run of columns whose pairs are at most one
+ *  apart from the last gets one entrance, in its middle. Either chunk's
+ *  graph calls it with the same arguments, so they agree on the pairs.
+ * @param low : the neighbor at the smaller x, or z if acrossZ
+ * @param high
+ * @param acrossZ
+ * @param entrances : (block of low, block of high), local to each
+ */
+static void findEntrances(const ChunkNavigation &low, const ChunkNavigation &high, bool acrossZ,
+                          std::vector<std::pair<glm::ivec3, glm::ivec3>> &entrances)
+{
+    std::array<glm::ivec2, 16> heights;
+    std::array<bool, 16> connected;
+    for (int i = 0; i < 16; i++) {
+        connected[i] = false;
+        glm::ivec2 lowColumn = acrossZ ? glm::ivec2(i, 15) : glm::ivec2(15, i);
+        glm::ivec2 highColumn = acrossZ ? glm::ivec2(i, 0) : glm::ivec2(0, i);
+        // the first connecting height from the top has the highest pair
+        for (int y = 255; y >= NavigationGraph::minHeight && !connected[i]; y--) {
+            if (!low.isWalkable(lowColumn.x, y, lowColumn.y)) {
+                continue;
+            }
+            for (int dy : {1, 0, -1}) {
+                if (y + dy >= NavigationGraph::minHeight && high.isWalkable(highColumn.x, y + dy, highColumn.y)) {
+                    heights[i] = glm::ivec2(y, y + dy);
+                    connected[i] = true;
+                    break;
+                }
+            }
+        }
+    }
+
+    int first = -1;
+    for (int i = 0; i <= 16; i++) {
+        bool continues = i < 16 && connected[i] && first >= 0
+                && glm::abs(heights[i].x - heights[i - 1].x) <= 1
+                && glm::abs(heights[i].y - heights[i - 1].y) <= 1;
+        if (first >= 0 && !continues) {
+            int mid = (first + i - 1) / 2;
+            glm::ivec2 h = heights[mid];
+            entrances.push_back(acrossZ
+                                ? std::make_pair(glm::ivec3(mid, h.x, 15), glm::ivec3(mid, h.y, 0))
+                                : std::make_pair(glm::ivec3(15, h.x, mid), glm::ivec3(0, h.y, mid)));
+            first = -1;
+        }
+        if (i < 16 && connected[i] && first < 0) {
+            first = i;
+        }
+    }
+}
+
+int NavigationGraph::ChunkGraph::findNode(glm::ivec3 block) const
+{
+    for (size_t i = 0; i < nodes.size(); i++) {
+        if (nodes[i] == block) {
+            return static_cast<int>(i);
+        }
+    }
+    return -1;
+}
+
+NavigationGraph::NavigationGraph()
+    : m_lock(), m_chunks()
+{}
+
+/**
+ * @brief NavigationGraph::build
+ * @param navigations : of the chunk, then of its XPOS, XNEG, ZPOS, ZNEG
+ * neighbors; the neighbors may be null
+ * @param chunk : in chunk coordinates
+ * @param graph
+ */
+void NavigationGraph::build(const ChunkNavigation *const navigations[5], glm::ivec2 chunk, ChunkGraph &graph) const
+{
+    graph.nodes.clear();
+    graph.partners.clear();
+    graph.edges.clear();
+
+    glm::ivec3 corner(chunk.x * 16, 0, chunk.y * 16);
+    const glm::ivec3 offsets[4] = {glm::ivec3(16, 0, 0), glm::ivec3(-16, 0, 0),
+                                   glm::ivec3(0, 0, 16), glm::ivec3(0, 0, -16)};
+    std::vector<std::pair<glm::ivec3, glm::ivec3>> entrances;
+    for (int d = 0; d < 4; d++) {
+        const ChunkNavigation *neighbor = navigations[d + 1];
+        if (neighbor == nullptr) {
+            continue;
+        }
+        // toward XPOS or ZPOS the chunk is the low one
+        bool isLow = d % 2 == 0;
+        entrances.clear();
+        if (isLow) {
+            findEntrances(*navigations[0], *neighbor, d >= 2, entrances);
+        } else {
+            findEntrances(*neighbor, *navigations[0], d >= 2, entrances);
+        }
+        for (const auto &entrance : entrances) {
+            graph.nodes.push_back(corner + (isLow ? entrance.first : entrance.second));
+            graph.partners.push_back(corner + offsets[d] + (isLow ? entrance.second : entrance.first));
+        }
+    }
+
+    ChunkCells cells(*navigations[0]);
+    std::vector<int> nodeCells(graph.nodes.size());
+    for (size_t i = 0; i < graph.nodes.size(); i++) {
+        nodeCells[i] = cells.find(graph.nodes[i] - corner);
+    }
+    graph.edges.resize(graph.nodes.size());
+    std::vector<int> steps;
+    for (size_t i = 0; i < graph.nodes.size(); i++) {
+        cells.search(nodeCells[i], steps, nullptr);
+        for (size_t j = 0; j < graph.nodes.size(); j++) {
+            if (j != i && steps[nodeCells[j]] >= 0) {
+                graph.edges[i].push_back(std::make_pair(static_cast<int>(j), steps[nodeCells[j]]));
+            }
+        }
+    }
+}
+
+/**
+ * @brief NavigationGraph::graphAt
+ *  The stamps are read before the bits, so a change while the graph is
+ *  built makes it stale. Call with m_lock held.
+ * @param terrain
+ * @param chunk : in chunk coordinates
+ * @return
+ */
+const NavigationGraph::ChunkGraph *NavigationGraph::graphAt(const Terrain &terrain, glm::ivec2 chunk)
+{
+    const glm::ivec2 around[5] = {glm::ivec2(0, 0), glm::ivec2(1, 0), glm::ivec2(-1, 0),
+                                  glm::ivec2(0, 1), glm::ivec2(0, -1)};
+    const ChunkNavigation *navigations[5];
+    std::array<uint64_t, 5> stamps;
+    for (int i = 0; i < 5; i++) {
+        navigations[i] = navigationAt(terrain, chunk + around[i]);
+        stamps[i] = navigations[i] != nullptr ? navigations[i]->getStamp() : 0;
+    }
+
+    int64_t key = toKey(chunk.x, chunk.y);
+    if (navigations[0] == nullptr) {
+        m_chunks.erase(key);
+        return nullptr;
+    }
+    uPtr<ChunkGraph> &graph = m_chunks[key];
+    if (graph == nullptr) {
+        graph = mkU<ChunkGraph>();
+    } else if (graph->stamps == stamps) {
+        return graph.get();
+    }
+    graph->stamps = stamps;
+    build(navigations, chunk, *graph);
+    return graph.get();
+}
+
+/**
+ * @brief NavigationGraph::planFirstLeg
+ *  A* over the entrances, with the start and goal joined to their
+ *  chunks' entrances by a breadth-first search each. A step costs one,
+ *  diagonal or not, so the largest of the distances along the axes never
+ *  overestimates.
+ * @param terrain
+ * @param start
+ * @param goal
+ * @param leg
+ * @return
+ */
+bool NavigationGraph::planFirstLeg(const Terrain &terrain, glm::ivec3 start, glm::ivec3 goal,
+                                   std::vector<glm::ivec3> &leg)
+{
+    leg.clear();
+    if (std::min(start.y, goal.y) < minHeight || std::max(start.y, goal.y) >= 256) {
+        return false;
+    }
+    glm::ivec2 startChunk(ChunkMap::toChunkCoord(start.x), ChunkMap::toChunkCoord(start.z));
+    glm::ivec2 goalChunk(ChunkMap::toChunkCoord(goal.x), ChunkMap::toChunkCoord(goal.z));
+    auto inReach = [&](glm::ivec2 chunk) {
+        return std::max(glm::abs(chunk.x - startChunk.x), glm::abs(chunk.y - startChunk.y)) <= maxReach;
+    };
+    if (!inReach(goalChunk)) {
+        return false;
+    }
+    const ChunkNavigation *startNavigation = navigationAt(terrain, startChunk);
+    const ChunkNavigation *goalNavigation = navigationAt(terrain, goalChunk);
+    if (startNavigation == nullptr || goalNavigation == nullptr) {
+        return false;
+    }
+
+    glm::ivec3 startCorner(startChunk.x * 16, 0, startChunk.y * 16);
+    glm::ivec3 goalCorner(goalChunk.x * 16, 0, goalChunk.y * 16);
+    ChunkCells startCells(*startNavigation);
+    ChunkCells goalCells(*goalNavigation);
+    int startCell = startCells.find(start - startCorner);
+    int goalCell = goalCells.find(goal - goalCorner);
+    if (startCell < 0 || goalCell < 0) {
+        return false;
+    }
+    std::vector<int> startSteps, startParents, goalSteps;
+    startCells.search(startCell, startSteps, &startParents);
+    goalCells.search(goalCell, goalSteps, nullptr);
+
+    // the start and goal are no entrance
+    const int startNode = -1;
+    const int goalNode = -2;
+    struct State
+    {
+        glm::ivec2 chunk;
+        int node;
+        glm::ivec3 block;
+        int steps;
+        int parent;
+    };
+    struct Entry
+    {
+        int estimate;
+        int steps;
+        int state;
+
+        bool operator<(const Entry &other) const {
+            return estimate > other.estimate;
+        }
+    };
+    auto heuristic = [&](glm::ivec3 block) {
+        glm::ivec3 d = glm::abs(goal - block);
+        return std::max(d.x, std::max(d.y, d.z));
+    };
+
+    m_lock.lock();
+    if (m_chunks.size() > maxCachedChunks) {
+        m_chunks.clear();
+    }
+    // each chunk's graph is looked up once, so it stays the same all plan
+    std::unordered_map<int64_t, const ChunkGraph*> graphs;
+    auto graphOf = [&](glm::ivec2 chunk) {
+        int64_t key = toKey(chunk.x, chunk.y);
+        auto it = graphs.find(key);
+        if (it == graphs.end()) {
+            it = graphs.emplace(key, graphAt(terrain, chunk)).first;
+        }
+        return it->second;
+    };
+
+    std::vector<State> states;
+    states.push_back(State{startChunk, startNode, start, 0, -1});
+    // the state of each chunk's entrances, -1 where not reached
+    std::unordered_map<int64_t, std::vector<int>> nodeStates;
+    int goalState = -1;
+    std::priority_queue<Entry> open;
+    open.push(Entry{heuristic(start), 0, 0});
+
+    auto reach = [&](glm::ivec2 chunk, int node, glm::ivec3 block, int steps, int parent) {
+        int *state = &goalState;
+        if (node != goalNode) {
+            std::vector<int> &chunkStates = nodeStates[toKey(chunk.x, chunk.y)];
+            if (chunkStates.empty()) {
+                chunkStates.assign(graphOf(chunk)->nodes.size(), -1);
+            }
+            state = &chunkStates[node];
+        }
+        if (*state >= 0 && states[*state].steps <= steps) {
+            return;
+        }
+        if (*state < 0) {
+            *state = static_cast<int>(states.size());
+            states.push_back(State{chunk, node, block, steps, parent});
+        } else {
+            states[*state].steps = steps;
+            states[*state].parent = parent;
+        }
+        open.push(Entry{steps + heuristic(block), steps, *state});
+    };
+
+    bool found = false;
+    int expansions = 0;
+    while (!open.empty() && expansions < maxExpansions) {
+        Entry entry = open.top();
+        open.pop();
+        // a copy: reaching states may move them
+        State state = states[entry.state];
+        if (entry.steps > state.steps) {
+            continue;
+        }
+        if (state.node == goalNode) {
+            found = true;
+            break;
+        }
+        expansions++;
+
+        if (state.node == startNode) {
+            const ChunkGraph *graph = graphOf(startChunk);
+            for (size_t i = 0; graph != nullptr && i < graph->nodes.size(); i++) {
+                int cell = startCells.find(graph->nodes[i] - startCorner);
+                if (cell >= 0 && startSteps[cell] >= 0) {
+                    reach(startChunk, static_cast<int>(i), graph->nodes[i], startSteps[cell], entry.state);
+                }
+            }
+            if (startChunk == goalChunk && startSteps[goalCell] >= 0) {
+                reach(goalChunk, goalNode, goal, startSteps[goalCell], entry.state);
+            }
+            continue;
+        }
+
+        const ChunkGraph *graph = graphOf(state.chunk);
+        for (const auto &edge : graph->edges[state.node]) {
+            reach(state.chunk, edge.first, graph->nodes[edge.first], state.steps + edge.second, entry.state);
+        }
+        if (state.chunk == goalChunk) {
+            int cell = goalCells.find(state.block - goalCorner);
+            if (cell >= 0 && goalSteps[cell] >= 0) {
+                reach(goalChunk, goalNode, goal, state.steps + goalSteps[cell], entry.state);
+            }
+        }
+        glm::ivec3 partner = graph->partners[state.node];
+        glm::ivec2 next(ChunkMap::toChunkCoord(partner.x), ChunkMap::toChunkCoord(partner.z));
+        const ChunkGraph *nextGraph = inReach(next) ? graphOf(next) : nullptr;
+        int nextNode = nextGraph != nullptr ? nextGraph->findNode(partner) : -1;
+        if (nextNode >= 0) {
+            reach(next, nextNode, partner, state.steps + 1, entry.state);
+        }
+    }
+    m_lock.unlock();
+
+    if (!found) {
+        return false;
+    }
+
+    // the route, start first
+    std::vector<int> route;
+    for (int s = goalState; s >= 0; s = states[s].parent) {
+        route.push_back(s);
+    }
+    std::reverse(route.begin(), route.end());
+    // the last state of the route in the start chunk, where the leg leaves it
+    size_t last = 1;
+    while (last + 1 < route.size() && states[route[last + 1]].chunk == startChunk) {
+        last++;
+    }
+
+    int cell = startCells.find(states[route[last]].block - startCorner);
+    if (cell < 0 || startSteps[cell] < 0) {
+        return false;
+    }
+    for (; cell != startCell; cell = startParents[cell]) {
+        leg.push_back(startCorner + startCells.cells[cell]);
+    }
+    std::reverse(leg.begin(), leg.end());
+    if (last + 1 < route.size()) {
+        leg.push_back(states[route[last + 1]].block);
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "chunknavigation.h"
+#include "glm_includes.h"
+#include "smartpointerhelp.h"
+#include <QMutex>
+#include <array>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class Terrain;
+
+/**
+ * @brief The NavigationGraph class
+ *  The coarse layer of hierarchical path searches (HPA*). Each chunk's
+ *  walkable surface gets entrances where it meets a neighbor's: one per
+ *  run of border columns that connect, in the middle of the run. The
+ *  steps between the entrances of one chunk are found once and cached,
+ *  so a route across many chunks is an A* over a few nodes per chunk.
+ *  The route's first leg is then refined into blocks, for the local
+ *  search (see PathFinder) to walk.
+ *  The layer is conservative: it walks to the 8 columns around with at
+ *  most one block up or down and only sees heights from minHeight up,
+ *  where the surface is. No route just means a local search as before.
+ *  A chunk's cache is rebuilt when the stamps it was built from, its own
+ *  and its four neighbors' (see ChunkNavigation), change.
+ *  planFirstLeg may only run where NPC ticks may (see NPCSimulation),
+ *  from any number of threads.
+ */
+class NavigationGraph
+{
+public:
+    // the lowest height the graph walks on
+    static const int minHeight = 128;
+    // how far from the start chunk a route may go, in chunks
+    static const int maxReach = 16;
+    // the nodes a plan may expand before it gives up
+    static const int maxExpansions = 8192;
+    // caches past this are all dropped before the next plan
+    static const size_t maxCachedChunks = 1024;
+
+private:
+    struct ChunkGraph
+    {
+        // of the chunk, then of its XPOS, XNEG, ZPOS, ZNEG neighbors; 0: missing
+        std::array<uint64_t, 5> stamps;
+        // the entrance blocks, stood on, in world coordinates
+        std::vector<glm::ivec3> nodes;
+        // where each entrance leads into the neighbor
+        std::vector<glm::ivec3> partners;
+        // (node, steps) reachable from each entrance within the chunk
+        std::vector<std::vector<std::pair<int, int>>> edges;
+
+        int findNode(glm::ivec3 block) const;
+    };
+
+    QMutex m_lock;
+    std::unordered_map<int64_t, uPtr<ChunkGraph>> m_chunks;
+
+    // the chunk's graph, rebuilt if stale; null if it is not navigable
+    const ChunkGraph *graphAt(const Terrain &terrain, glm::ivec2 chunk);
+    void build(const ChunkNavigation *const navigations[5], glm::ivec2 chunk, ChunkGraph &graph) const;
+
+public:
+    NavigationGraph();
+
+    NavigationGraph(const NavigationGraph&) = delete;
+    NavigationGraph &operator=(const NavigationGraph&) = delete;
+
+    // Plan a route between the blocks stood on and put its first leg in
+    // leg: the blocks from start, excluded, to the first entrance and
+    // over it, or to goal if it is that close. False if there is no route
+    // within maxReach.
+    bool planFirstLeg(const Terrain &terrain, glm::ivec3 start, glm::ivec3 goal,
+                      std::vector<glm::ivec3> &leg);
+};
@@ -1,6 +1,7 @@
 #include <QTreeWidgetItem>
 #include "smartpointerhelp.h"
 #include "node.h"
+#include "memorystats.h"
 
 
 #define PI 3.14159265
@@ -16,10 +17,12 @@
  * @param block
  */
 Node::Node(NPCBlock *block)
-    : block(block)
+    : changed(true), block(block)
 {
     // init
     children = std::vector<uPtr<Node>>();
+    // the base of every node; a derived one's own fields are not counted
+    MemoryStats::add(MemoryCategory::npcGraphs, sizeof(Node));
 }
 
 /**
@@ -70,6 +73,7 @@ Node& Node::operator=(const Node &node)
 {
 
     block = node.block;
+    changed = true;
 
     // copy children
     for (const uPtr<Node> &child : node.children) {
@@ -124,8 +128,16 @@ const std::vector<uPtr<Node>>& Node::getChildren()
     return children;
 }
 
+bool Node::takeChanged()
+{
+    bool was = changed;
+    changed = false;
+    return was;
+}
+
 Node::~Node()
 {
+    MemoryStats::sub(MemoryCategory::npcGraphs, sizeof(Node));
 }
 
 ///----------------------------------------------------------------------
@@ -179,6 +191,7 @@ TranslateNode& TranslateNode::operator=(const TranslateNode &node)
  */
 void TranslateNode::setTranslate(glm::vec3 t)
 {
+    changed = changed || t != translate;
     translate = t;
 }
 
@@ -262,6 +275,8 @@ RotateNode& RotateNode::operator=(const RotateNode &node)
  */
 void RotateNode::setDeg(float degree)
 {
+    // the limbs are set every frame, mostly to what they were
+    changed = changed || degree != deg;
     deg = degree;
 }
 
@@ -277,6 +292,7 @@ float RotateNode::getDeg() const
 
 void RotateNode::setAxis(glm::vec3 axis)
 {
+    changed = changed || axis != rotAxis;
     rotAxis = axis;
 }
 
@@ -12,6 +12,9 @@ protected:
     // children
     std::vector<uPtr<Node>> children;
 
+    // the node's own transform changed since takeChanged (see FlatSceneGraph)
+    bool changed;
+
 public:
 
     // constructors
@@ -38,6 +41,9 @@ public:
 
     NPCBlock *block;
 
+    // has computeTransform's own part changed since the last call? clears it
+    bool takeChanged();
+
     // virtual destructor
     virtual ~Node();
 
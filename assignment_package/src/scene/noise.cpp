@@ -1,4 +1,5 @@
 #include "noise.h"
+#include "random.h"
 #include <algorithm>
 #include <numeric>
 #include <random>
@@ -8,10 +9,78 @@
 
 using namespace std;
 
-Noise::Noise(){}
+// Octave tables for every persistence used by the height maps
+static const OctaveTable octavesP02(0.2f);
+static const OctaveTable octavesP05(0.5f);
+static const OctaveTable octavesP09(0.9f);
+static const OctaveTable octavesP092(0.92f);
+
+OctaveTable::OctaveTable(float persistence) {
+    // same float/double promotion as the former per-sample pow() calls
+    for (int i = 0; i < octaves; i++) {
+        frequency[i] = pow(2, i);
+        amplitude[i] = pow(persistence, i);
+    }
+}
+
+/**
+ * @brief The GradientTable struct
+ *  The 256 gradients of GradientHash::permutation: unit vectors spread
+ *  evenly over the first quadrant, the range of the legacy
+ *  normalize(abs(fract(...))) gradients, so both hashes look alike.
+ */
+struct GradientTable {
+    std::array<glm::vec2, 256> gradients;
+
+    GradientTable() {
+        for (int i = 0; i < 256; i++) {
+            float angle = (i + 0.5f) / 256.f * static_cast<float>(PI) * 0.5f;
+            gradients[i] = glm::vec2(glm::cos(angle), glm::sin(angle));
+        }
+    }
+};
+
+static const GradientTable gradientTable;
+
+Noise::Noise()
+    : Noise(0, GradientHash::legacy)
+{}
+
+/**
+ * @brief Noise::Noise
+ * @param seed         : shuffles the permutation table
+ * @param gradientHash
+ */
+Noise::Noise(uint64_t seed, GradientHash gradientHash)
+    : gradientHash(gradientHash)
+{
+    for (GradientCacheEntry &entry : gradientCache) {
+        entry.primeSet = 0;
+    }
+    worleyCells.valid = false;
+
+    // Fisher-Yates shuffle of 0..255
+    std::array<uint8_t, 256> shuffled;
+    std::iota(shuffled.begin(), shuffled.end(), 0);
+    Random rng(seed);
+    for (int i = 255; i > 0; i--) {
+        std::swap(shuffled[i], shuffled[rng.nextUInt() % (i + 1)]);
+    }
+    for (int i = 0; i < 512; i++) {
+        permutation[i] = shuffled[i & 255];
+    }
+}
 
 Noise::~Noise(){}
 
+GradientHash Noise::getGradientHash() const {
+    return gradientHash;
+}
+
+const std::array<uint8_t, 512> &Noise::getPermutation() const {
+    return permutation;
+}
+
 /**
  * @brief Noise::getHeight
  *
@@ -20,25 +89,143 @@ Noise::~Noise(){}
  * @param z
  */
 int Noise::getHeight(int x, int z) {
+    return getHeight(x, z, getBiomeNoise(x, z));
+}
+
+/**
+ * @brief Noise::getBiomeNoise
+ *
+ * The 2048 / 4096-scale masks that pick mountains and water bodies.
+ * They vary slowly enough to be sampled coarsely and interpolated.
+ * @param x
+ * @param z
+ * @return (mountain noise, water noise), both in [0, 1]
+ */
+glm::vec2 Noise::getBiomeNoise(int x, int z) {
+    float perlin                = (FBM2D<NoiseBasis::perlin, 1>(x/2048.f, z/2048.f, octavesP02) + 1) / 2;
+    float waterPerlin           = (FBM2D<NoiseBasis::perlin, 3>(x/4096.f, z/4096.f, octavesP09) + 1) / 2;
+    return glm::vec2(perlin, waterPerlin);
+}
+
+/**
+ * @brief Noise::getHeight
+ *
+ * Get y coordinate with mixed terrain, given the biome noise at (x, z)
+ * @param x
+ * @param z
+ * @param biomeNoise : see getBiomeNoise
+ */
+int Noise::getHeight(int x, int z, glm::vec2 biomeNoise) {
     float grass                 = getGrassHeight(x, z);
     float mtn_rock              = getMountainousRockHeight(x, z);
     float water                 = getWaterHeight(x, z);
 
-    float perlin                = (FBM2D(x/2048.f, z/2048.f, 0.2, "perlin", 1) + 1) / 2;
-    float smoothPerlin          = glm::smoothstep(0.5, 0.6, (double) perlin);
-
-    float waterPerlin           = (FBM2D(x/4096.f, z/4096.f, 0.9, "perlin", 3) + 1) / 2;
-    float waterSmoothPerlin     = glm::smoothstep(0.8, 0.85, (double) waterPerlin);
+    float smoothPerlin          = glm::smoothstep(0.5, 0.6, (double) biomeNoise[0]);
+    float waterSmoothPerlin     = glm::smoothstep(0.8, 0.85, (double) biomeNoise[1]);
 
     return glm::clamp(glm::mix(glm::mix(grass, water, waterSmoothPerlin), mtn_rock, smoothPerlin), 128.f, 255.f);
 }
 
+/**
+ * @brief Noise::getHeights
+ *
+ * Batch version of getHeight over the whole column grid of a chunk.
+ * Columns are visited row by row so consecutive samples hit the same
+ * lattice gradients in the cache.
+ * @param chunkX : x of the chunk's corner
+ * @param chunkZ : z of the chunk's corner
+ * @param out    : heights, indexed [x + 16 * z]
+ */
+void Noise::getHeights(int chunkX, int chunkZ, std::array<int, 256> &out) {
+    for (int z = 0; z < 16; z++) {
+        for (int x = 0; x < 16; x++) {
+            out[x + 16 * z] = getHeight(chunkX + x, chunkZ + z);
+        }
+    }
+}
+
 float Noise::getCaveHeight(int x, int y, int z){
     float factor = 25.f;
     return PerlinNoise3D(glm::vec3(float(x/factor),float(y/factor),float(z/factor)));
 
 }
 
+/**
+ * @brief Noise::getCaveDensities
+ *
+ * Coarse-lattice version of getCaveHeight over a chunk's column range.
+ * @param chunkX   : x of the chunk's corner
+ * @param chunkZ   : z of the chunk's corner
+ * @param minY     : first y (inclusive)
+ * @param maxY     : last y (exclusive)
+ * @param out      : densities, indexed [x + 16 * (y - minY) + 16 * (maxY - minY) * z]
+ * @param sampling : lattice step and error bound
+ */
+void Noise::getCaveDensities(int chunkX, int chunkZ, int minY, int maxY,
+                             std::vector<float> &out,
+                             const CaveSampling &sampling) {
+    int sizeY = maxY - minY;
+    out.resize(16 * sizeY * 16);
+
+    int step = glm::max(1, sampling.step);
+
+    // lattice covers [0, 16] x [minY, maxY - 1] x [0, 16]
+    int nx = (15 + step - 1) / step + 1;
+    int ny = (sizeY - 1 + step - 1) / step + 1;
+    int nz = nx;
+
+    std::vector<float> lattice(nx * ny * nz);
+    for (int k = 0; k < nz; k++) {
+        for (int j = 0; j < ny; j++) {
+            for (int i = 0; i < nx; i++) {
+                lattice[i + nx * j + nx * ny * k] = getCaveHeight(chunkX + i * step,
+                                                                  minY + j * step,
+                                                                  chunkZ + k * step);
+            }
+        }
+    }
+
+    float invStep = 1.f / step;
+
+    for (int z = 0; z < 16; z++) {
+        int k  = z / step;
+        float tz = (z - k * step) * invStep;
+
+        for (int y = 0; y < sizeY; y++) {
+            int j  = y / step;
+            float ty = (y - j * step) * invStep;
+
+            const float *c00 = &lattice[nx * j       + nx * ny * k];
+            const float *c10 = &lattice[nx * (j + 1 < ny ? j + 1 : j) + nx * ny * k];
+            const float *c01 = &lattice[nx * j       + nx * ny * (k + 1 < nz ? k + 1 : k)];
+            const float *c11 = &lattice[nx * (j + 1 < ny ? j + 1 : j) + nx * ny * (k + 1 < nz ? k + 1 : k)];
+
+            float *row = &out[16 * y + 16 * sizeY * z];
+
+            // flat float loop over the row, left for the compiler to vectorize
+            for (int x = 0; x < 16; x++) {
+                int i  = x / step;
+                int i1 = i + 1 < nx ? i + 1 : i;
+                float tx = (x - i * step) * invStep;
+
+                float v00 = glm::mix(c00[i], c00[i1], tx);
+                float v10 = glm::mix(c10[i], c10[i1], tx);
+                float v01 = glm::mix(c01[i], c01[i1], tx);
+                float v11 = glm::mix(c11[i], c11[i1], tx);
+
+                row[x] = glm::mix(glm::mix(v00, v10, ty), glm::mix(v01, v11, ty), tz);
+            }
+
+            // refine the voxels whose side of the threshold is uncertain
+            for (int x = 0; x < 16; x++) {
+                if (glm::abs(row[x]) < sampling.errorBound) {
+                    row[x] = getCaveHeight(chunkX + x, minY + y, chunkZ + z);
+                }
+            }
+        }
+    }
+}
+
 float Noise::getGrassHeight(float x, float z){
     x /= 512;
     z /= 512;
@@ -46,7 +233,7 @@ float Noise::getGrassHeight(float x, float z){
     int grassMin = 135;
     int grassMax = 142;
 
-    return grassMin + (grassMax - grassMin) * worleyNoise2D(FBM2D(x, z, 0.5, "perlin", 1), FBM2D(z, x, 0.5, "perlin", 1));
+    return grassMin + (grassMax - grassMin) * worleyNoise2D(FBM2D<NoiseBasis::perlin, 1>(x, z, octavesP05), FBM2D<NoiseBasis::perlin, 1>(z, x, octavesP05));
 }
 
 float Noise::getMountainousRockHeight(float x, float z) {
@@ -56,7 +243,7 @@ float Noise::getMountainousRockHeight(float x, float z) {
     int mountainMin = 142;
     int mountainMax = 250;
 
-    return mountainMin + (mountainMax - mountainMin) * glm::abs(FBM2D(x, z, 0.92, "perlin", 1));
+    return mountainMin + (mountainMax - mountainMin) * glm::abs(FBM2D<NoiseBasis::perlin, 1>(x, z, octavesP092));
 }
 
 float Noise::getSnowyRockHeight(float x, float z) {
@@ -66,7 +253,7 @@ float Noise::getSnowyRockHeight(float x, float z) {
     int mountainMin = 142;
     int mountainMax = 250;
 
-    return mountainMin + (mountainMax - mountainMin) * glm::abs(FBM2D(x, z, 0.92, "perlin", 1));
+    return mountainMin + (mountainMax - mountainMin) * glm::abs(FBM2D<NoiseBasis::perlin, 1>(x, z, octavesP092));
 }
 
 float Noise::getFloatingRockHeight(float x, float z) {
@@ -76,7 +263,7 @@ float Noise::getFloatingRockHeight(float x, float z) {
     int floatIslandMin = 200;
     int floatIslandMax = 235;
 
-    return floatIslandMin + (floatIslandMax - floatIslandMin) * (1 - glm::abs(FBM2D(x, z, 0.92, "perlin", 1)));
+    return floatIslandMin + (floatIslandMax - floatIslandMin) * (1 - glm::abs(FBM2D<NoiseBasis::perlin, 1>(x, z, octavesP092)));
 }
 
 float Noise::getWaterHeight(float x, float z){
@@ -86,7 +273,7 @@ float Noise::getWaterHeight(float x, float z){
     int waterMin = 128;
     int waterMax = 132;
 
-    return waterMin + (waterMax - waterMin) * (FBM2D(x, z, 0.5, "perlin", 3) + 1) / 2;
+    return waterMin + (waterMax - waterMin) * (FBM2D<NoiseBasis::perlin, 3>(x, z, octavesP05) + 1) / 2;
 }
 
 
@@ -97,7 +284,7 @@ float Noise::getSandHeight(float x, float z){
     int sandMin = 135;
     int sandMax = 137;
 
-    return sandMin + (sandMax - sandMin) * (FBM2D(x, z, 0.5, "perlin", 3) + 1) / 2;
+    return sandMin + (sandMax - sandMin) * (FBM2D<NoiseBasis::perlin, 3>(x, z, octavesP05) + 1) / 2;
 }
 
 
@@ -105,7 +292,7 @@ float Noise::getTreeProbability(float x, float z){
     x /= 512;
     z /= 512;
 
-    return 1.f -  2.f * (FBM2D(x, z, 0.5, "perlin", 3));
+    return 1.f -  2.f * (FBM2D<NoiseBasis::perlin, 3>(x, z, octavesP05));
 }
 
 
@@ -120,6 +307,14 @@ glm::vec2 Noise::getVoronoiCenter(glm::vec2 corner) {
     return glm::vec2(x, z);
 }
 
+/**
+ * @brief Noise::worleyNoise2D
+ *
+ * The nine centers around the sample's cell are only hashed when the
+ * cell differs from the last sample's (see WorleyNeighborhood).
+ * @param x
+ * @param z
+ */
 float Noise::worleyNoise2D(float x, float z) {
     float intX, fractX;
     fractX = modf(x, &intX);
@@ -127,13 +322,24 @@ float Noise::worleyNoise2D(float x, float z) {
     float intZ, fractZ;
     fractZ = modf(z, &intZ);
 
+    if (!worleyCells.valid || worleyCells.intX != intX || worleyCells.intZ != intZ) {
+        for (int i = -1; i < 2; i++) {
+            for (int j = -1; j < 2; j++) {
+                worleyCells.centers[(i + 1) * 3 + (j + 1)] = getVoronoiCenter(glm::vec2(intX, intZ) + glm::vec2(j, i));
+            }
+        }
+        worleyCells.intX    = intX;
+        worleyCells.intZ    = intZ;
+        worleyCells.valid   = true;
+    }
+
     float minDist1 = 1;
     float minDist2 = 1;
 
     for (int i = -1; i < 2; i++) {
         for (int j = -1; j < 2; j++) {
             glm::vec2 neighborDirection         = glm::vec2(j, i);
-            glm::vec2 neighborVoronoiCenter     = getVoronoiCenter(glm::vec2(intX, intZ) + neighborDirection);
+            glm::vec2 neighborVoronoiCenter     = worleyCells.centers[(i + 1) * 3 + (j + 1)];
             glm::vec2 diff                      = neighborDirection + neighborVoronoiCenter - glm::vec2(fractX, fractZ);
 
             float dist = glm::length(diff);
@@ -154,18 +360,27 @@ float Noise::worleyNoise2D(float x, float z) {
 ///////////////// Fractal Brownian Motion ////////////////////
 /////////////////////////////////////////////////////////////
 
-float Noise::FBM2D(float x, float z, float persistence, std::string noiseFn, int primeSet) {
+/**
+ * @brief Noise::FBM2D
+ *
+ * Sum 8 octaves of the given basis. The basis and prime set are
+ * template arguments so the per-octave dispatch folds away.
+ * @param x
+ * @param z
+ * @param table : frequency / amplitude per octave
+ */
+template <NoiseBasis basis, int primeSet>
+float Noise::FBM2D(float x, float z, const OctaveTable& table) {
     float total = 0;
-    int octaves = 8;
 
-    for (int i = 0; i < octaves; i++) {
-        float frequency = pow(2, i);
-        float amplitude = pow(persistence, i);
+    for (int i = 0; i < OctaveTable::octaves; i++) {
+        float frequency = table.frequency[i];
+        float amplitude = table.amplitude[i];
 
-        if (noiseFn == "perlin") {
+        if (basis == NoiseBasis::perlin) {
             total += PerlinNoise2D(glm::vec2(x * frequency, z * frequency), primeSet) * amplitude;
         }
-        if (noiseFn == "regular") {
+        if (basis == NoiseBasis::regular) {
             total += interpolationNoise2D(x * frequency, z * frequency) * amplitude;
         }
     }
@@ -173,18 +388,18 @@ float Noise::FBM2D(float x, float z, float persistence, std::string noiseFn, int
     return total;
 }
 
-float Noise::FBM3D(float x, float y, float z, float persistence, std::string noiseFn) {
+template <NoiseBasis basis>
+float Noise::FBM3D(float x, float y, float z, const OctaveTable& table) {
     float total = 0;
-    int octaves = 8;
 
-    for (int i = 0; i < octaves; i++) {
-        float frequency = pow(2, i);
-        float amplitude = pow(persistence, i);
+    for (int i = 0; i < OctaveTable::octaves; i++) {
+        float frequency = table.frequency[i];
+        float amplitude = table.amplitude[i];
 
-        if (noiseFn == "perlin") {
+        if (basis == NoiseBasis::perlin) {
             total += PerlinNoise3D(glm::vec3(x * frequency, y * frequency, z * frequency)) * amplitude;
         }
-//        if (noiseFn == "regular") {
+//        if (basis == NoiseBasis::regular) {
 //            total += interpolationNoise3D(x * frequency, y * frequency, z * frequency) * amplitude;
 //        }
     }
@@ -225,7 +440,7 @@ float Noise::surflet(glm::vec2 p, glm::vec2 gridPoint, int primeSet) {
     glm::vec2 t2 = glm::abs(p - gridPoint);
     glm::vec2 t = glm::vec2(1.f) - 6.f * pow(t2, 5) + 15.f * pow(t2, 4) - 10.f * pow(t2, 3);
 
-    glm::vec2 gradient = noise2DNormalVector(gridPoint, primeSet) * 2.f - glm::vec2(1,1);
+    glm::vec2 gradient = latticeGradient(gridPoint, primeSet) * 2.f - glm::vec2(1,1);
     glm::vec2 diff = p - gridPoint;
 
     float height = glm::dot(diff, gradient);
@@ -288,6 +503,61 @@ float Noise::PerlinNoise3D(glm::vec3 p){
 ///////////////// Misc. Helpers /////////////////////////////
 /////////////////////////////////////////////////////////////
 
+/**
+ * @brief Noise::latticeGradient
+ *
+ * The gradient of a lattice point under this Noise's GradientHash.
+ * @param gridPoint : integral lattice point
+ * @param primeSet
+ */
+glm::vec2 Noise::latticeGradient(glm::vec2 gridPoint, int primeSet) {
+    if (gradientHash == GradientHash::permutation) {
+        return permutationNormalVector(gridPoint, primeSet);
+    }
+    return cachedNormalVector(gridPoint, primeSet);
+}
+
+/**
+ * @brief Noise::permutationNormalVector
+ *
+ * Two permutation lookups pick one of the static gradients. The prime
+ * set offsets x so the sets stay independent layers of noise.
+ * @param gridPoint : integral lattice point
+ * @param primeSet
+ */
+glm::vec2 Noise::permutationNormalVector(glm::vec2 gridPoint, int primeSet) {
+    int ix = static_cast<int>(gridPoint.x) + 59 * primeSet;
+    int iz = static_cast<int>(gridPoint.y);
+
+    return gradientTable.gradients[permutation[permutation[ix & 255] + (iz & 255)]];
+}
+
+/**
+ * @brief Noise::cachedNormalVector
+ *
+ * noise2DNormalVector through the per-instance gradient cache.
+ * @param gridPoint : integral lattice point
+ * @param primeSet
+ */
+glm::vec2 Noise::cachedNormalVector(glm::vec2 gridPoint, int primeSet) {
+    int ix = static_cast<int>(gridPoint.x);
+    int iz = static_cast<int>(gridPoint.y);
+
+    unsigned int hash = (static_cast<unsigned int>(ix) * 73856093u)
+                      ^ (static_cast<unsigned int>(iz) * 19349663u)
+                      ^ (static_cast<unsigned int>(primeSet) * 83492791u);
+    GradientCacheEntry &entry = gradientCache[hash % gradientCacheSize];
+
+    if (entry.primeSet != primeSet || entry.ix != ix || entry.iz != iz) {
+        entry.ix        = ix;
+        entry.iz        = iz;
+        entry.primeSet  = primeSet;
+        entry.gradient  = noise2DNormalVector(gridPoint, primeSet);
+    }
+
+    return entry.gradient;
+}
+
 glm::vec2 Noise::noise2DNormalVector(glm::vec2 v, int primeSet) {
     v += 0.1;
 
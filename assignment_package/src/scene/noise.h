@@ -1,22 +1,110 @@
 #pragma once
 
+#include <array>
 #include <cmath>
+#include <cstdint>
 #include <glm/glm.hpp>
 #include <string>
 #include <vector>
 
 #define PI 3.14159265
 
+// Basis function sampled by each octave of the FBM
+enum class NoiseBasis : unsigned char {
+    perlin, regular
+};
+
+// How PerlinNoise2D picks the gradient of a lattice point
+enum class GradientHash : unsigned char {
+    // sin-based hash of the lattice point and prime set (the original look)
+    legacy,
+    // seeded permutation table indexing a static gradient table
+    permutation
+};
+
+/**
+ * @brief The OctaveTable struct
+ *  Per-octave frequency (2^i) and amplitude (persistence^i) of an FBM,
+ *  computed once per persistence value instead of once per sample.
+ */
+struct OctaveTable {
+    static const int octaves = 8;
+
+    std::array<float, octaves> frequency;
+    std::array<float, octaves> amplitude;
+
+    explicit OctaveTable(float persistence);
+};
+
+/**
+ * @brief The GradientCacheEntry struct
+ *  One slot of Noise's direct-mapped lattice gradient cache.
+ *  primeSet == 0 marks an empty slot (valid prime sets are 1..3).
+ */
+struct GradientCacheEntry {
+    int ix;
+    int iz;
+    int primeSet;
+    glm::vec2 gradient;
+};
+
+/**
+ * @brief The WorleyNeighborhood struct
+ *  The Voronoi centers of the 3 x 3 cells around the cell of Noise's last
+ *  worleyNoise2D sample. Its inputs are FBM values, which drift slowly
+ *  from one column to the next, so most samples reuse all nine.
+ */
+struct WorleyNeighborhood {
+    // the middle cell, as modf splits the sample; valid once a sample set it
+    float intX;
+    float intZ;
+    bool valid;
+    // the center of the cell at (intX + j, intZ + i) at [(i + 1) * 3 + (j + 1)]
+    std::array<glm::vec2, 9> centers;
+};
+
+/**
+ * @brief The CaveSampling struct
+ *  Controls Noise::getCaveDensities. Densities are sampled exactly every
+ *  `step` blocks and trilinearly interpolated in between. Interpolated
+ *  values within `errorBound` of the cave threshold (0) are re-evaluated
+ *  exactly, so only voxels whose sign is in doubt pay for a full sample.
+ *  step = 1 or a large errorBound reproduces the exact per-voxel path.
+ */
+struct CaveSampling {
+    int step            = 4;
+    // measured max interpolation error at step 4 is ~0.039
+    float errorBound    = 0.04f;
+};
+
+// Not thread-safe (the gradient cache is per instance): use one Noise per worker
 class Noise{
 public:
+    // legacy gradients
     Noise();
+    // permutation gradients are shuffled by the seed; legacy ignores it
+    Noise(uint64_t seed, GradientHash gradientHash);
     virtual ~Noise();
 
     // General Function for Grass x Mountain x Waterbody
     int getHeight(int, int);
 
+    // Low-frequency biome noise at (x, z): (mountain mask, water mask) before smoothstep
+    glm::vec2 getBiomeNoise(int, int);
+    // getHeight with the biome noise supplied by the caller (e.g. interpolated from a ZoneHeightMap)
+    int getHeight(int, int, glm::vec2 biomeNoise);
+
+    // Heights of the 16 x 16 columns of the chunk at (chunkX, chunkZ), stored at [x + 16 * z]
+    void getHeights(int chunkX, int chunkZ, std::array<int, 256> &out);
+
     float getCaveHeight(int, int, int);
 
+    // Cave densities of the chunk at (chunkX, chunkZ) for minY <= y < maxY,
+    // stored at [x + 16 * (y - minY) + 16 * (maxY - minY) * z]
+    void getCaveDensities(int chunkX, int chunkZ, int minY, int maxY,
+                          std::vector<float> &out,
+                          const CaveSampling &sampling = CaveSampling());
+
     // Individual Terrain Height Maps
     float getGrassHeight(float, float);
     float getDirtHeight(float, float);
@@ -33,6 +121,10 @@ public:
 
     float getTreeProbability(float x, float z);
 
+    GradientHash getGradientHash() const;
+    // the permutation table of GradientHash::permutation, 0..255 repeated twice
+    const std::array<uint8_t, 512> &getPermutation() const;
+
 private:
 
     // Helper Functions
@@ -45,9 +137,25 @@ private:
     glm::vec2 getVoronoiCenter(glm::vec2);
     float worleyNoise2D(float,float);
 
-    float FBM2D(float,float,float,std::string, int);
-    float FBM3D(float,float,float,float,std::string);
-
+    template <NoiseBasis basis, int primeSet>
+    float FBM2D(float, float, const OctaveTable&);
+    template <NoiseBasis basis>
+    float FBM3D(float, float, float, const OctaveTable&);
+
+    GradientHash gradientHash;
+    // permutation of 0..255, repeated twice so two lookups need no wrap
+    std::array<uint8_t, 512> permutation;
+
+    // Neighbouring columns share most lattice points at every octave,
+    // so the sin-hashed gradients are memoized by (lattice point, prime set)
+    static const int gradientCacheSize = 1024;
+    std::array<GradientCacheEntry, gradientCacheSize> gradientCache;
+    // the Voronoi centers worleyNoise2D read last
+    WorleyNeighborhood worleyCells;
+
+    glm::vec2 latticeGradient(glm::vec2, int);
+    glm::vec2 permutationNormalVector(glm::vec2, int);
+    glm::vec2 cachedNormalVector(glm::vec2, int);
     glm::vec2 noise2DNormalVector(glm::vec2, int);
     float surflet(glm::vec2, glm::vec2, int);
     float PerlinNoise2D(glm::vec2, int);
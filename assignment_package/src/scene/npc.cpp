@@ -1,4 +1,15 @@
 #include "npc.h"
+#include "blockcursor.h"
+#include "flowfield.h"
+#include "npcmeshcache.h"
+#include "npcpartbatch.h"
+
+// the moves an NPC takes from the flow field before it reads it again
+static const int flowFieldSteps = 8;
+// how fast NPCs overlapping others move apart, in blocks per second
+static const float separationSpeed = 2.f;
+// the blocks a goal may move by before a path to it is searched anew
+static const int repairGoalDistance = 4;
 
 extern void pushVec4ToBuffer(std::vector<float> &buf, const glm::vec4 &vec);
 extern void pushVec2ToBuffer(std::vector<float> &buf, const glm::vec2 &vec);
@@ -12,15 +23,22 @@ NPC::NPC(OpenGLContext *context, glm::vec3 pos, Terrain &terrain, Player &player
     Drawable(context),
     Entity(pos),
     initPos(pos),
+    rigIndex(-1),
     mcr_terrain(&terrain),
     goals(goals),
     goalPtr(0),
     goalDir(1),
     pathFinder(halfGridSize, terrain),
+    pathfinding(nullptr),
+    flowField(nullptr),
+    pathRequest(0),
     actions(),
     actionTimer(0.f),
     actionTimeout(3.f),
     nToDoActions(0),
+    pathChangeCount(terrain.getBlockChangeCount()),
+    pathGoal(0),
+    pathTailRequest(false),
     stuckPos(pos),
     stuckTimer(0.f),
     toleranceOfGoal(toleranceOfGoal),
@@ -32,8 +50,14 @@ NPC::NPC(OpenGLContext *context, glm::vec3 pos, Terrain &terrain, Player &player
     prev_m_position(pos),
     maxFallingSpeed(-10.f),
     onGround(false),
+    motion(NPCMotion::none),
+    motionTarget(0.f),
+    thinkGoal(pos),
+    thoughtOnGround(false),
     walkingDistCycle(0),
+    limbsAnimated(true),
     limbRotNodes(),
+    limbDeg(0.f),
     limbRotationSpeedOnGround(4.f),
     limbRotationSpeedOffGround(2.f),
     maxLimbDegOnGround(25.f),
@@ -45,6 +69,7 @@ NPC::NPC(OpenGLContext *context, glm::vec3 pos, Terrain &terrain, Player &player
     rootToLeft(0.5f),
     rootToRight(0.5f),
     player(&player),
+    playerPosition(player.mcr_position),
     npcTexture(npcTexture)
 {}
 
@@ -78,6 +103,26 @@ NPC::NPC(OpenGLContext *context, glm::vec3 pos, Terrain &terrain, Player &player
 {}
 
 
+/**
+ * @brief NPCPose::interpolate
+ *  The axes are blended and renormalized: two poses are one fixed step
+ *  apart, which turns an NPC by a few degrees at most.
+ * @param a
+ * @param b
+ * @param t : in [0, 1]
+ * @return
+ */
+NPCPose NPCPose::interpolate(const NPCPose &a, const NPCPose &b, float t)
+{
+    NPCPose pose;
+    pose.position = glm::mix(a.position, b.position, t);
+    pose.forward = glm::normalize(glm::mix(a.forward, b.forward, t));
+    pose.right = glm::normalize(glm::mix(a.right, b.right, t));
+    pose.up = glm::normalize(glm::mix(a.up, b.up, t));
+    pose.limbDeg = glm::mix(a.limbDeg, b.limbDeg, t);
+    return pose;
+}
+
 /**
  * @brief NPC::draw
  *  Draw this npc with the specified shader program
@@ -85,34 +130,153 @@ NPC::NPC(OpenGLContext *context, glm::vec3 pos, Terrain &terrain, Player &player
  */
 void NPC::draw(ShaderProgram *shader)
 {
-    // traverse the scene graph to get all overall transforms
-    glm::mat4 transform = glm::mat4(glm::vec4(m_right, 0.f),
-                                    glm::vec4(m_up, 0.f),
-                                    glm::vec4(m_forward, 0.f),
-                                    glm::vec4(this->mcr_position, 1));
-    traverseSceneGraph(shader, root, transform);
+    draw(shader, getPose());
+}
+
+/**
+ * @brief NPC::draw
+ * @param shader
+ * @param pose
+ */
+void NPC::draw(ShaderProgram *shader, const NPCPose &pose)
+{
+    applyLimbRotations(pose.limbDeg);
+
+    glm::mat4 transform = glm::mat4(glm::vec4(pose.right, 0.f),
+                                    glm::vec4(pose.up, 0.f),
+                                    glm::vec4(pose.forward, 0.f),
+                                    glm::vec4(pose.position, 1));
+    drawParts(shader, transform);
+}
+
+NPCPose NPC::getPose() const
+{
+    return {m_position, m_forward, m_right, m_up, limbDeg};
+}
+
+void NPC::setPlayerPosition(glm::vec3 position)
+{
+    playerPosition = position;
+}
+
+void NPC::setPathfindingService(PathfindingService *service)
+{
+    if (pathfinding != nullptr && pathRequest != 0)
+    {
+        pathfinding->cancel(pathRequest);
+    }
+    pathRequest = 0;
+    pathTailRequest = false;
+    pathfinding = service;
+}
+
+void NPC::setFlowField(const FlowField *field)
+{
+    flowField = field;
+}
+
+bool NPC::isChasingPlayer() const
+{
+    return goals.empty();
+}
+
+void NPC::setLimbsAnimated(bool animated)
+{
+    limbsAnimated = animated;
+}
+
+bool NPC::isOnGround() const
+{
+    return onGround;
 }
 
 
 /**
- * @brief traverseSceneGraph
- * @param node
+ * @brief NPC::drawParts
+ *  Only the nodes changed since the last frame (the limbs, as they swing)
+ *  are recomputed; the root's transform is applied to the cached rest.
+ * @param shader
  * @param transform
  */
-void NPC::traverseSceneGraph(ShaderProgram *shader, const uPtr<Node> &node, glm::mat4 transform)
+void NPC::drawParts(ShaderProgram *shader, const glm::mat4 &transform)
+{
+    flatSceneGraph.update(root.get());
+
+    const FlatSceneGraph::Palette &palette = flatSceneGraph.getPalette();
+    const FlatSceneGraph::Parts &parts = flatSceneGraph.getParts();
+    for (size_t i = 0; i < parts.size(); i++)
+    {
+        shader->setModelMatrix(transform * palette[i]);
+        shader->drawInterleaved(*parts[i]);
+    }
+}
+
+/**
+ * @brief NPC::collectParts
+ *  The same transforms as draw, but only the root's is worked out here:
+ *  the rigs go to the batch on the first call, and from then on the
+ *  scene graph is left alone and the limb angle does the rest.
+ * @param pose
+ * @param batch
+ */
+void NPC::collectParts(const NPCPose &pose, NPCPartBatch &batch)
 {
-    glm::mat4 nodeTransform = node->computeTransform(transform);
+    glm::mat4 transform = glm::mat4(glm::vec4(pose.right, 0.f),
+                                    glm::vec4(pose.up, 0.f),
+                                    glm::vec4(pose.forward, 0.f),
+                                    glm::vec4(pose.position, 1));
+    collectParts(transform, pose.limbDeg, batch);
+}
 
-    if (node->block != nullptr)
+void NPC::collectParts(const glm::mat4 &transform, float limbDeg, NPCPartBatch &batch)
+{
+    if (rigIndex < 0)
     {
-        shader->setModelMatrix(nodeTransform);
-        shader->drawInterleaved(*(node->block));
+        flatSceneGraph.update(root.get());
+        std::vector<glm::vec4> texels;
+        flatSceneGraph.buildRig(limbRotNodes, texels);
+        rigIndex = batch.addRigs(texels);
     }
 
-    // visit children
-    for (const uPtr<Node> &subNode : node->getChildren())
+    const FlatSceneGraph::Parts &parts = flatSceneGraph.getParts();
+    for (size_t i = 0; i < parts.size(); i++)
     {
-        traverseSceneGraph(shader, subNode, nodeTransform);
+        batch.add(npcTexture, parts[i], transform, limbDeg, rigIndex + static_cast<int>(i));
+    }
+}
+
+int NPC::getRigIndex() const
+{
+    return rigIndex;
+}
+
+/**
+ * @brief NPC::getPartBounds
+ *  Each part is a unit cube about its origin, so the box is that of the
+ *  cubes' corners through the palette, as the first collectParts left
+ *  it: the scene graph is not touched again.
+ * @param min
+ * @param max
+ */
+void NPC::getPartBounds(glm::vec3 &min, glm::vec3 &max) const
+{
+    const FlatSceneGraph::Palette &palette = flatSceneGraph.getPalette();
+    min = glm::vec3(0.f);
+    max = glm::vec3(0.f);
+    for (size_t i = 0; i < palette.size(); i++)
+    {
+        for (int corner = 0; corner < 8; corner++)
+        {
+            glm::vec4 local((corner & 1) ? 0.5f : -0.5f, (corner & 2) ? 0.5f : -0.5f,
+                            (corner & 4) ? 0.5f : -0.5f, 1.f);
+            glm::vec3 p = glm::vec3(palette[i] * local);
+            if (i == 0 && corner == 0)
+            {
+                min = max = p;
+            }
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
     }
 }
 
@@ -130,7 +294,7 @@ glm::vec3 NPC::getCurrentGoal()
     // current bottom center
     glm::vec3 currBottom = getBottomCenter();
 
-    glm::vec3 currGoal = goals.empty() ? player->mcr_position : goals[goalPtr];
+    glm::vec3 currGoal = goals.empty() ? playerPosition : goals[goalPtr];
 
     // see if this current goal is reached
     // if reached, use the next goal depending on the ptr direction
@@ -213,12 +377,13 @@ bool NPC::isStuck()
         stuckPos = m_position;
     }
 
-    if (!mcr_terrain->hasBlockAt(blockPos))
+    std::optional<BlockType> blockType = mcr_terrain->tryGetBlockAt(blockPos);
+    if (!blockType)
     {
         return false;
     }
 
-    if (mcr_terrain->getBlockAt(blockPos) == EMPTY && mcr_terrain->getBlockAt(top) == EMPTY)
+    if (*blockType == EMPTY && mcr_terrain->getBlockAt(top) == EMPTY)
     {
         stuck = false;
     }
@@ -229,13 +394,147 @@ bool NPC::isStuck()
 void NPC::replanIfNeeded(glm::vec3 goal)
 {
     // either timeout or stuck
-    if ((actionTimer >= actionTimeout) && (actions.size() == nToDoActions))
+    if ((actionTimer >= actionTimeout) && (actions.size() == nToDoActions) && pathRequest == 0)
     {
         // std::cout << "Replan ..." << std::endl;
-        actions = pathFinder.searchPathToward(m_position,
-                                              goal);
+        requestPath(goal);
+    }
+}
+
+/**
+ * @brief NPC::repairPath
+ *  Most edits leave a path's head alone: the actions up to the first one
+ *  ending where the NPC can no longer stand are kept, and the way on from
+ *  the last of them is searched, a smaller search than from scratch. A
+ *  goal moved a few blocks extends the path the same way; moved farther,
+ *  or with nothing left to keep, the whole path is searched again.
+ *  A path from the flow field is short and followed anew anyway.
+ * @param goal
+ */
+void NPC::repairPath(glm::vec3 goal)
+{
+    uint64_t changeCount = mcr_terrain->getBlockChangeCount();
+    glm::ivec3 goalBlock = glm::ivec3(glm::floor(goal));
+    if (actions.empty() || pathRequest != 0 || (changeCount == pathChangeCount && goalBlock == pathGoal))
+    {
+        return;
+    }
+    if (isChasingPlayer() && flowField != nullptr)
+    {
+        return;
+    }
+    glm::ivec3 goalMove = glm::abs(goalBlock - pathGoal);
+    if (std::max(goalMove.x, std::max(goalMove.y, goalMove.z)) > repairGoalDistance)
+    {
+        requestPath(goal);
+        return;
+    }
+
+    std::vector<NPCAction> path;
+    path.reserve(actions.size());
+    while (!actions.empty())
+    {
+        path.push_back(actions.front());
+        actions.pop();
+    }
+    size_t valid = changeCount == pathChangeCount ? path.size() : pathFinder.countValidPrefix(path);
+    for (size_t i = 0; i < valid; i++)
+    {
+        actions.push(path[i]);
+    }
+    nToDoActions = actions.size();
+    pathChangeCount = changeCount;
+    if (valid == 0)
+    {
+        requestPath(goal);
+        return;
+    }
+    if (valid == path.size() && goalBlock == pathGoal)
+    {
+        return;
+    }
+
+    pathGoal = goalBlock;
+    glm::vec3 from = path[valid - 1].dest;
+    if (pathfinding == nullptr)
+    {
+        std::queue<NPCAction> tail = pathFinder.searchPathToward(from, goal);
+        for (; !tail.empty(); tail.pop())
+        {
+            actions.push(tail.front());
+        }
+        nToDoActions = actions.size();
+        return;
+    }
+    pathRequest = pathfinding->request(pathFinder, from, goal);
+    pathTailRequest = true;
+}
+
+/**
+ * @brief NPC::requestPath
+ *  Chasing the player, the path comes from the flow field where it
+ *  reaches; else without a service the path is searched right away.
+ * @param goal
+ */
+void NPC::requestPath(glm::vec3 goal)
+{
+    actionTimer = 0.f;
+    pathChangeCount = mcr_terrain->getBlockChangeCount();
+    pathGoal = glm::ivec3(glm::floor(goal));
+    pathTailRequest = false;
+    if (isChasingPlayer() && flowField != nullptr && flowField->follow(m_position, flowFieldSteps, actions))
+    {
+        nToDoActions = actions.size();
+        if (pathRequest != 0)
+        {
+            pathfinding->cancel(pathRequest);
+            pathRequest = 0;
+        }
+        return;
+    }
+    if (pathfinding == nullptr)
+    {
+        actions = pathFinder.searchPathToward(m_position, goal);
+        nToDoActions = actions.size();
+        return;
+    }
+    if (pathRequest != 0)
+    {
+        pathfinding->cancel(pathRequest);
+    }
+    pathRequest = pathfinding->request(pathFinder, m_position, goal);
+}
+
+/**
+ * @brief NPC::collectPath
+ *  A repair's path goes on from the actions kept; any other replaces them.
+ */
+void NPC::collectPath()
+{
+    if (pathRequest == 0)
+    {
+        return;
+    }
+    if (!pathTailRequest)
+    {
+        if (pathfinding->takeResult(pathRequest, actions))
+        {
+            pathRequest = 0;
+            nToDoActions = actions.size();
+            actionTimer = 0.f;
+        }
+        return;
+    }
+    std::queue<NPCAction> tail;
+    if (pathfinding->takeResult(pathRequest, tail))
+    {
+        pathRequest = 0;
+        pathTailRequest = false;
+        for (; !tail.empty(); tail.pop())
+        {
+            actions.push(tail.front());
+        }
         nToDoActions = actions.size();
-        actionTimer = 0.f;
     }
 }
 
@@ -249,6 +548,13 @@ void NPC::npcRestart()
     goalDir = 1;
     actionTimer = 0.f;
     actions = std::queue<NPCAction>();
+    // a path from where it was stuck
+    if (pathRequest != 0)
+    {
+        pathfinding->cancel(pathRequest);
+        pathRequest = 0;
+    }
+    pathTailRequest = false;
     resetHorizontalSpeed();
     m_velocity[1] = 0.f;
     m_acceleration = glm::vec3(0.f);
@@ -258,29 +564,51 @@ void NPC::npcRestart()
 
 /**
  * @brief NPC::tick
+ *  One NPC's step on its own; NPCSimulation steps many at once
  * @param dT
  */
 void NPC::tick(float dT)
 {
+    think(dT);
+    NPCKinematics kinematics;
+    size_t i = beginStep(kinematics, dT);
+    kinematics.integrate();
+    endStep(kinematics, i);
+    react(dT);
+}
+
+/**
+ * @brief NPC::think
+ *  Follow the path: on the ground, walk or jump to the next action's
+ *  destination; in the air, keep on a jump, or fall without a path.
+ * @param dT
+ */
+void NPC::think(float dT)
+{
+    motion = NPCMotion::none;
+
     // check goals
-    glm::vec3 currGoal = getCurrentGoal();
+    thinkGoal = getCurrentGoal();
 
     // check action
     checkActionIsDone();
 
+    thoughtOnGround = onGround;
     if (onGround)
     {
         // reset horizontal speed
         resetHorizontalSpeed();
 
+        // a path asked for earlier replaces the current one
+        collectPath();
+        // edits around the path, or a goal that moved, cut its tail
+        repairPath(thinkGoal);
+
         // check if need to find a path
-        if (actions.empty())
+        if (actions.empty() && pathRequest == 0)
         {
             // update the path
-            actions = pathFinder.searchPathToward(m_position,
-                                                  currGoal);
-            nToDoActions = actions.size();
-            actionTimer = 0.f;
+            requestPath(thinkGoal);
         }
 
         // perform the next action
@@ -290,34 +618,50 @@ void NPC::tick(float dT)
             switch (actions.front().action)
             {
                 case WALK:
-                    tryMoveToward(dT, actions.front().dest);
+                    moveToward(actions.front().dest);
                     break;
                 case JUMP:
-                    tryJumpToward(dT, actions.front().dest);
+                    jumpToward(actions.front().dest);
                     break;
                 default:
                     break;
             }
         }
-
-        // replan if needed
-        actionTimer += dT;
-        replanIfNeeded(currGoal);
     }
 
     // particular for the state during the jump
-    else if ((!onGround) && (!actions.empty()) && (actions.front().action == JUMP))
+    else if ((!actions.empty()) && (actions.front().action == JUMP))
     {
         // continue the jump
         // finish the jump until it gets back to the ground
-        tryJumpToward(dT, actions.front().dest);
-        actionTimer += dT;
+        jumpToward(actions.front().dest);
     }
 
-    else if (!onGround && actions.empty())
+    else if (actions.empty())
+    {
+        motion = NPCMotion::free;
+    }
+}
 
+/**
+ * @brief NPC::react
+ *  After the step moved the NPC
+ * @param dT
+ */
+void NPC::react(float dT)
+{
+    if (thoughtOnGround)
     {
-        tryMove(dT);
+        // make room for the NPCs and the player around
+        separate(dT);
+
+        // replan if needed
+        actionTimer += dT;
+        replanIfNeeded(thinkGoal);
+    }
+    else if (motion == NPCMotion::jump)
+    {
+        actionTimer += dT;
     }
 
     // do limb rotations
@@ -329,6 +673,8 @@ void NPC::tick(float dT)
     {
         npcRestart();
     }
+
+    placeInGrid();
 }
 
 
@@ -337,6 +683,13 @@ void NPC::tick(float dT)
  */
 void NPC::updateLimbRotations()
 {
+    if (!limbsAnimated)
+    {
+        prev_m_position = m_position;
+        limbDeg = 0.f;
+        return;
+    }
+
     walkingDistCycle += glm::length(m_position - prev_m_position);
     prev_m_position = m_position;
 
@@ -352,7 +705,16 @@ void NPC::updateLimbRotations()
         limbRotationSpeed = limbRotationSpeedOffGround;
     }
 
-    float deg = glm::sin(walkingDistCycle * limbRotationSpeed) * maxLimbDeg;
+    limbDeg = glm::sin(walkingDistCycle * limbRotationSpeed) * maxLimbDeg;
+}
+
+/**
+ * @brief NPC::applyLimbRotations
+ *  Pose the limb nodes of the scene graph
+ * @param deg
+ */
+void NPC::applyLimbRotations(float deg)
+{
     for (Node *p : limbRotNodes)
     {
         RotateNode *rot = dynamic_cast<RotateNode *>(p);
@@ -375,6 +737,89 @@ glm::vec3 NPC::getBottomCenter() const
     return bottomCenter;
 }
 
+glm::vec3 NPC::getBoundsCenter() const
+{
+    return m_position + glm::vec3(0.f, (rootToTop - rootToGround) / 2.f, 0.f);
+}
+
+/**
+ * @brief NPC::getHalfExtents
+ *  As wide as the farthest side from the root both ways, so turning
+ *  never takes the body out of the box
+ * @return
+ */
+glm::vec3 NPC::getHalfExtents() const
+{
+    float reach = glm::max(glm::max(rootToFront, rootToBack), glm::max(rootToLeft, rootToRight));
+    return glm::vec3(reach, (rootToTop + rootToGround) / 2.f, reach);
+}
+
+void NPC::placeInGrid()
+{
+    mcr_terrain->getEntityGrid().place(this, getBoundsCenter(), getHalfExtents());
+}
+
+/**
+ * @brief NPC::separate
+ *  Out of each overlapping box along the axis it overlaps least, away
+ *  from it, at most separationSpeed; an axis the terrain blocks at the
+ *  feet or the root is not moved along. The others are read as last
+ *  placed, which may be this step or the last.
+ * @param dT
+ */
+void NPC::separate(float dT)
+{
+    glm::vec3 center = getBoundsCenter();
+    glm::vec3 half = getHalfExtents();
+    std::vector<EntityGrid::Hit> hits;
+    mcr_terrain->getEntityGrid().queryRadius(center, glm::length(half), hits);
+
+    glm::vec3 disp(0.f);
+    for (const EntityGrid::Hit &hit : hits)
+    {
+        if (hit.entity == this)
+        {
+            continue;
+        }
+        glm::vec3 d = center - hit.position;
+        glm::vec3 overlap = half + hit.halfExtents - glm::abs(d);
+        if (overlap.x <= 0.f || overlap.y <= 0.f || overlap.z <= 0.f)
+        {
+            continue;
+        }
+        int idx = overlap.x < overlap.z ? 0 : 2;
+        // two NPCs at the same spot go opposite ways
+        float away = d[idx] != 0.f ? glm::sign(d[idx]) : (this < hit.entity ? 1.f : -1.f);
+        disp[idx] += away * overlap[idx];
+    }
+
+    float length = glm::length(disp);
+    if (length == 0.f)
+    {
+        return;
+    }
+    disp *= glm::min(1.f, separationSpeed * dT / length);
+
+    glm::vec3 feet = getBottomCenter() + glm::vec3(0.f, 0.1f, 0.f);
+    for (int idx : {0, 2})
+    {
+        if (disp[idx] == 0.f)
+        {
+            continue;
+        }
+        glm::vec3 rayDirection(0.f);
+        rayDirection[idx] = disp[idx] + glm::sign(disp[idx]) * half[idx];
+        float out_dist = 0.f;
+        glm::ivec3 out_blockHit(0);
+        if (gridMarch(feet, rayDirection, *mcr_terrain, &out_dist, &out_blockHit)
+                || gridMarch(m_position, rayDirection, *mcr_terrain, &out_dist, &out_blockHit))
+        {
+            disp[idx] = 0.f;
+        }
+    }
+    moveAlongVector(disp);
+}
+
 void NPC::setupGoals(std::vector<glm::vec3> targetPositions)
 {
     goals = targetPositions;
@@ -471,214 +916,82 @@ void NPC::faceSlowlyTowardTangent(float dT, glm::vec3 center)
 
 
 /**
- * @brief NPC::tryMoveToward
- *  Make the NPC to move to the specified target.
- *  Usually, the target is the destination of an action.
+ * @brief NPC::beginStep
+ *  Only a falling NPC looks at the terrain.
+ * @param kinematics
  * @param dT
- * @param target
+ * @return its index in kinematics
  */
-void NPC::tryMoveToward(float dT, glm::vec3 target)
+size_t NPC::beginStep(NPCKinematics &kinematics, float dT)
 {
-    // apply current acceleration & gravity
-    m_velocity[1] += dT * (m_gravity[1]);
-
-    // prevent NPCs from penetraing the terrain
-    m_velocity[1] = glm::max(maxFallingSpeed, m_velocity[1]);
-
-    // m_forward: current forward direction
-    glm::vec3 currVelocity = m_velocity;
-    glm::vec3 currBottom = getBottomCenter();
-    currVelocity[0] = (target[0] - currBottom[0]) * m_velocity[0];
-    currVelocity[2] = (target[2] - currBottom[2]) * m_velocity[2];
-
-    // add horizontal displacement
-    glm::vec3 disp = dT * currVelocity;
-
-    if (checkYCollision())
-    {
-        // collide against the ground
-        disp[1] = 0.f;
-        // remove the gravity effect
-        resetHorizontalSpeed();
-        m_acceleration[1] = 0.f;
-        onGround = true;
-    }
-
-    if (checkXZCollision(0))
+    size_t i = kinematics.add();
+    kinematics.dT[i] = dT;
+    kinematics.px[i] = m_position.x;
+    kinematics.py[i] = m_position.y;
+    kinematics.pz[i] = m_position.z;
+    kinematics.vx[i] = m_velocity.x;
+    kinematics.vy[i] = m_velocity.y;
+    kinematics.vz[i] = m_velocity.z;
+    kinematics.ay[i] = m_acceleration.y;
+    kinematics.gy[i] = m_gravity.y;
+    kinematics.minVy[i] = maxFallingSpeed;
+    kinematics.defaultVx[i] = m_default_velocity.x;
+    kinematics.defaultVz[i] = m_default_velocity.z;
+    kinematics.tx[i] = motionTarget.x;
+    kinematics.ty[i] = motionTarget.y;
+    kinematics.tz[i] = motionTarget.z;
+    kinematics.motion[i] = motion;
+    kinematics.onGround[i] = onGround;
+    if (motion == NPCMotion::free || motion == NPCMotion::toward || motion == NPCMotion::jump)
     {
-        disp[0] = 0.f;
+        kinematics.blockedY[i] = checkYCollision();
+        kinematics.blockedX[i] = checkXZCollision(0);
+        kinematics.blockedZ[i] = checkXZCollision(2);
     }
+    return i;
+}
 
-    if (checkXZCollision(2))
+void NPC::endStep(const NPCKinematics &kinematics, size_t i)
+{
+    if (motion == NPCMotion::none)
     {
-        disp[2] = 0.f;
+        return;
     }
-
-    // set the previous m_position
     prev_m_position = m_position;
-
-    // this changes m_position
-    moveAlongVector(disp);
+    m_position = glm::vec3(kinematics.px[i], kinematics.py[i], kinematics.pz[i]);
+    m_velocity = glm::vec3(kinematics.vx[i], kinematics.vy[i], kinematics.vz[i]);
+    m_acceleration.y = kinematics.ay[i];
+    onGround = kinematics.onGround[i];
 }
 
-
 /**
- * @brief NPC::tryJumpToward
- * @param dT
+ * @brief NPC::moveToward
+ *  Walk to the target, usually the destination of an action.
  * @param target
  */
-void NPC::tryJumpToward(float dT, glm::vec3 target)
+void NPC::moveToward(glm::vec3 target)
 {
-    if (onGround)
-    {
-        // acceleration might be based on the y
-        float yDiff = target[1] - getBottomCenter()[1];
-        m_acceleration[1] = 100.f + yDiff * 10.f;
-        // onGround to false
-        onGround = false;
-    }
-
-    // apply current acceleration & gravity
-    m_velocity[1] += dT * (m_gravity[1] + m_acceleration[1]);
-
-    // set upper bound
-    m_velocity[1] = glm::min(6.f, m_velocity[1]);
-
-    // prevent NPCs from penetraing the terrain
-    m_velocity[1] = glm::max(maxFallingSpeed, m_velocity[1]);
-
-
-    // acceleration fade out
-    if (m_acceleration[1] > 0.f)
-    {
-        m_acceleration[1] += m_gravity[1];
-        m_acceleration[1] = glm::max(0.f, m_acceleration[1]);
-    }
-
-    // m_forward: current forward direction
-    glm::vec3 currVelocity = m_velocity;
-    currVelocity[0] = (target[0] - getBottomCenter()[0]) * m_velocity[0];
-    currVelocity[2] = (target[2] - getBottomCenter()[2]) * m_velocity[2];
-
-    glm::vec3 disp = dT * currVelocity;
-
-    if (checkYCollision() && ((m_acceleration[1] + m_gravity[1] <= 0.f) || m_velocity[1] <= 0.f))
-    {
-        // collide against the ground
-        disp[1] = 0.f;
-        // remove the gravity effect
-        resetHorizontalSpeed();
-        m_acceleration[1] = 0.f;
-        onGround = true;
-    }
-
-    if (checkXZCollision(0))
-    {
-        disp[0] = 0.f;
-    }
-
-    if (checkXZCollision(2))
-    {
-        disp[2] = 0.f;
-    }
-
-    // set the previous m_position
-    prev_m_position = m_position;
-
-    // this changes m_position
-    moveAlongVector(disp);
+    glm::vec3 bottom = getBottomCenter();
+    motion = NPCMotion::toward;
+    motionTarget = glm::vec3(target.x - bottom.x, 0.f, target.z - bottom.z);
 }
 
 /**
- * @brief NPC::tryMove
- *  Basically, follow the current forward direction,
- *  check the collision (X, Y, Z) before applying the displacement
- *  to the position.
- * @param dT
+ * @brief NPC::jumpToward
+ *  Take off from the ground pushed harder the higher the target, or
+ *  keep on the jump in the air.
+ * @param target
  */
-void NPC::tryMove(float dT)
+void NPC::jumpToward(glm::vec3 target)
 {
-    // apply current acceleration & gravity
-    m_velocity[1] += dT * (m_gravity[1]);
-
-    // prevent NPCs from penetraing the terrain
-    m_velocity[1] = glm::max(maxFallingSpeed, m_velocity[1]);
-
-    // m_forward: current forward direction
-    glm::vec3 currVelocity = m_velocity;
-
-    // add horizontal displacement
-    glm::vec3 disp = dT * currVelocity;
-
-    if (checkYCollision())
-    {
-        // collide against the ground
-        disp[1] = 0.f;
-        // remove the gravity effect
-        resetHorizontalSpeed();
-        m_acceleration[1] = 0.f;
-        onGround = true;
-    }
-
-    if (checkXZCollision(0))
-    {
-        disp[0] = 0.f;
-    }
-
-    if (checkXZCollision(2))
-    {
-        disp[2] = 0.f;
-    }
-
-    // set the previous m_position
-    prev_m_position = m_position;
-
-    // this changes m_position
-    moveAlongVector(disp);
-
-}
-
-void NPC::fall(float dT)
-{
-    // apply current acceleration & gravity
-    m_velocity[1] += dT * (m_gravity[1]);
-
-    // prevent NPCs from penetraing the terrain
-    m_velocity[1] = glm::max(maxFallingSpeed, m_velocity[1]);
-
-    // m_forward: current forward direction
-    glm::vec3 currVelocity = m_velocity;
-
-    // add horizontal displacement
-    glm::vec3 disp = glm::vec3(0.f);
-    // add vertical displacement
-    disp[1] += (dT * currVelocity[1]);
-
-    if (checkYCollision())
-    {
-        // collide against the ground
-        disp[1] = 0.f;
-        // remove the gravity effect
-        m_velocity[1] = 0.f;
-        m_acceleration[1] = 0.f;
-        onGround = true;
-    }
-
-    if (checkXZCollision(0))
-    {
-        disp[0] = 0.f;
-    }
-
-    if (checkXZCollision(2))
+    glm::vec3 bottom = getBottomCenter();
+    if (onGround)
     {
-        disp[2] = 0.f;
+        m_acceleration[1] = 100.f + (target[1] - bottom[1]) * 10.f;
+        onGround = false;
     }
-
-    // set the previous m_position
-    prev_m_position = m_position;
-
-    // this changes m_position
-    moveAlongVector(disp);
+    motion = NPCMotion::jump;
+    motionTarget = glm::vec3(target.x - bottom.x, 0.f, target.z - bottom.z);
 }
 
 /**
@@ -788,6 +1101,7 @@ bool NPC::checkYCollision()
 
 /**
  * @brief NPC::gridMarch
+ *  Terrain::raycast, as the collision checks read it
  * @param rayOrigin
  * @param rayDirection
  * @param terrain
@@ -796,117 +1110,51 @@ bool NPC::checkYCollision()
  * @return
  */
 bool NPC::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &terrain, float *out_dist, glm::ivec3 *out_blockHit) {
-
-    float maxLen = glm::length(rayDirection); // Farthest we search
-    glm::ivec3 currCell = glm::ivec3(glm::floor(rayOrigin));
-    rayDirection = glm::normalize(rayDirection); // Now all t values represent world dist.
-    float curr_t = 0.f;
-
-    while(curr_t < maxLen) {
-        float min_t = glm::sqrt(3.f);
-        float interfaceAxis = -1; // Track axis for which t is smallest
-        for(int i = 0; i < 3; ++i) { // Iterate over the three axes
-            if(rayDirection[i] != 0) { // Is ray parallel to axis i?
-                float offset = glm::max(0.f, glm::sign(rayDirection[i])); // See slide 5
-                // If the player is *exactly* on an interface then
-                // they'll never move if they're looking in a negative direction
-                if(currCell[i] == rayOrigin[i] && offset == 0.f) {
-                    offset = -1.f;
-                }
-                int nextIntercept = currCell[i] + offset;
-                float axis_t = (nextIntercept - rayOrigin[i]) / rayDirection[i];
-                axis_t = glm::min(axis_t, maxLen); // Clamp to max len to avoid super out of bounds errors
-                if(axis_t < min_t) {
-                    min_t = axis_t;
-                    interfaceAxis = i;
-                }
-            }
-        }
-
-        if(interfaceAxis == -1) {
-            throw std::out_of_range("interfaceAxis was -1 after the for loop in gridMarch!");
-        }
-
-        curr_t += min_t; // min_t is declared in slide 7 algorithm
-        rayOrigin += rayDirection * min_t;
-        glm::ivec3 offset(0);
-        // Sets it to 0 if sign is +, -1 if sign is -
-        offset[interfaceAxis] = glm::min(0.f, glm::sign(rayDirection[interfaceAxis]));
-        currCell = glm::ivec3(glm::floor(rayOrigin)) + offset;
-        // If currCell contains something other than EMPTY, return
-        // curr_t
-        if (!terrain.hasBlockAt(glm::vec3(currCell.x, currCell.y, currCell.z)))
-        {
-            // no block here => treat as hit
-            *out_blockHit = currCell;
-            *out_dist = glm::min(maxLen, curr_t);
-            return true;
-        }
-        BlockType cellType = terrain.getBlockAt(currCell.x, currCell.y, currCell.z);
-        if(cellType != EMPTY) {
-            *out_blockHit = currCell;
-            *out_dist = glm::min(maxLen, curr_t);
-            return true;
-        }
+    TerrainRayHit rayHit = terrain.raycast(rayOrigin, rayDirection);
+    *out_dist = rayHit.distance;
+    if (rayHit.hit) {
+        *out_blockHit = rayHit.block;
     }
-    *out_dist = glm::min(maxLen, curr_t);
-    return false;
+    return rayHit.hit;
 }
 
 
 /**
  * @brief NPC::~NPC
  */
-NPC::~NPC(){}
+NPC::~NPC()
+{
+    mcr_terrain->getEntityGrid().remove(this);
+}
 
 
 NPCBlock::NPCBlock(OpenGLContext *context, BlockType type)
-    : Drawable(context), type(type)
+    : Drawable(context), type(type), mp_mesh(nullptr)
 {}
 
-
-void NPCBlock::createVBOdata()
+BlockType NPCBlock::getType() const
 {
-    int nVert = 0;
-    std::vector<GLuint> indices = std::vector<GLuint>();
-    std::vector<float> buffer = std::vector<float>();
-    std::vector<GLuint> faceIndices = {0, 1, 2, 0, 2, 3};
-    // draw the cube
-    // loop through 6 faces
-    // XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
-    // interleaved VBO
-    // pos, nor, uvs
-    for (const BlockFace &face : Block::BlockCollection[type])
-    {
-        for (const VertexData &vert : face.vertices)
-        {
-            // make vert.pos centered at the center of the block
-            pushVec4ToBuffer(buffer, vert.pos - glm::vec4(0.5, 0.5, 0.5, 0.));
-            pushVec4ToBuffer(buffer, face.normal);
-            pushVec2ToBuffer(buffer, vert.uv);
-            pushVec2ToBuffer(buffer, Block::getAnimatableFlag(type));
-        }
-        // add indices for each face
-        for (int index : faceIndices)
-        {
-            indices.push_back(nVert + index);
-        }
-        nVert += 4;
-    }
+    return type;
+}
 
-    // to gpu
-    m_count = indices.size();
-    int bufferSize = buffer.size();
 
-    generateIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+/**
+ * @brief NPCBlock::createVBOdata
+ *  The vertices come from the shared mesh of the type
+ */
+void NPCBlock::createVBOdata()
+{
+    mp_mesh = NPCMeshCache::acquire(mp_context, type);
+    m_count = mp_mesh->elemCount();
+}
 
-    generatePos();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufPos);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, bufferSize * sizeof(float), buffer.data(), GL_STATIC_DRAW);
+bool NPCBlock::bindIdx()
+{
+    return mp_mesh != nullptr && mp_mesh->bindIdx();
+}
 
-    // TODO: at some point, need to delete vbo?
-    return;
+bool NPCBlock::bindPos()
+{
+    return mp_mesh != nullptr && mp_mesh->bindPos();
 }
 
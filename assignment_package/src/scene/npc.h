@@ -2,12 +2,32 @@
 #include "entity.h"
 #include "player.h"
 #include "drawable.h"
+#include "scene/flatscenegraph.h"
 #include "scene/node.h"
+#include "scene/npckinematics.h"
 #include "scene/pathfinder.h"
+#include "scene/pathfindingservice.h"
 #include "texture.h"
 
 
 class Node;
+class FlowField;
+class NPCPartBatch;
+
+// What drawing an NPC needs of its state, so the renderer can draw
+// between two simulation steps (see NPCSimulation)
+struct NPCPose
+{
+    glm::vec3 position;
+    glm::vec3 forward;
+    glm::vec3 right;
+    glm::vec3 up;
+    // the swing of the limbs (see updateLimbRotations)
+    float limbDeg;
+
+    // the pose a fraction t of the way from a to b
+    static NPCPose interpolate(const NPCPose &a, const NPCPose &b, float t);
+};
 
 class NPC : public Drawable, public Entity
 {
@@ -18,6 +38,13 @@ protected:
 
     // scene graph
     uPtr<Node> root;
+    // root's transforms, kept from frame to frame; built on the first draw
+    FlatSceneGraph flatSceneGraph;
+    // the first part's rig in the NPCPartBatch collected into, -1 before
+    int rigIndex;
+
+    // draw every part with the root at transform, from flatSceneGraph
+    void drawParts(ShaderProgram *shader, const glm::mat4 &transform);
 
     Terrain *mcr_terrain;
 
@@ -28,14 +55,34 @@ protected:
 
     // path finder related
     PathFinder pathFinder;
+    // searches for pathFinder when set, else it searches in tick
+    PathfindingService *pathfinding;
+    // the way to the player, shared by every NPC chasing it; can be null
+    const FlowField *flowField;
+    // the path asked for and not arrived yet
+    PathRequestId pathRequest;
     std::queue<NPCAction> actions;
     float actionTimer;
     float actionTimeout;
     uint nToDoActions;
+    // what the path was found for: Terrain's block change count, the goal's
+    // block, and whether the request pending is to extend the actions
+    uint64_t pathChangeCount;
+    glm::ivec3 pathGoal;
+    bool pathTailRequest;
 
     bool isStuck();
     void replanIfNeeded(glm::vec3 goal);
+    // keep the part of the path the edits or the goal's move left valid,
+    // and search again only for the rest
+    void repairPath(glm::vec3 goal);
+    // ask for a path to goal, to replace the actions once it arrives
+    void requestPath(glm::vec3 goal);
+    // take the path asked for, if it has arrived
+    void collectPath();
     void npcRestart();
+    // move out of the entities overlapping it, as far as the terrain lets
+    void separate(float dT);
 
     // especially for stuck
     glm::vec3 stuckPos;
@@ -65,11 +112,26 @@ protected:
     float maxFallingSpeed;
     bool onGround;
 
+    // the step think() decided on (see NPCKinematics)
+    NPCMotion motion;
+    glm::vec3 motionTarget;
+    // the goal and ground think() saw, for react()
+    glm::vec3 thinkGoal;
+    bool thoughtOnGround;
+    // the motions toward target
+    void moveToward(glm::vec3 target);
+    void jumpToward(glm::vec3 target);
+
     // a variable to accumulate traveled distance (do % 360)
     float walkingDistCycle;
+    // off: the limbs rest, e.g. far from the player (see NPCSimulation)
+    bool limbsAnimated;
 
     // keep a collection of rotation nodes (for walking movements)
     std::vector<Node*> limbRotNodes;
+    // their angle as of the last tick; only drawing sets it on the nodes
+    float limbDeg;
+    void applyLimbRotations(float deg);
     float limbRotationSpeedOnGround;
     float limbRotationSpeedOffGround;
     float maxLimbDegOnGround;
@@ -86,6 +148,9 @@ protected:
     // main player status
     // can be null
     Player *player;
+    // where the player was when this tick began; the simulation threads
+    // read this, never the player itself
+    glm::vec3 playerPosition;
 
 public:
 
@@ -120,18 +185,33 @@ public:
     virtual void initSceneGraph() = 0;
 
     virtual void draw(ShaderProgram *shader);
-
-    virtual void traverseSceneGraph(ShaderProgram *shader, const uPtr<Node> &node, glm::mat4 transform);
+    // draw at the given pose rather than the current one; main thread
+    virtual void draw(ShaderProgram *shader, const NPCPose &pose);
+
+    // add the parts at the given pose to batch rather than drawing them,
+    // the limbs posed on the GPU; main thread
+    void collectParts(const NPCPose &pose, NPCPartBatch &batch);
+    // the same with the root at root, as NPCImpostors bakes the sprites
+    void collectParts(const glm::mat4 &root, float limbDeg, NPCPartBatch &batch);
+    // the first part's rig in the batch, -1 before the first collectParts
+    int getRigIndex() const;
+    // the box around the parts at rest, relative to the root; only once
+    // getRigIndex() is set
+    void getPartBounds(glm::vec3 &min, glm::vec3 &max) const;
 
     // override tick
     virtual void tick(float dT, InputBundle &input) override;
+    // think(), the step, then react(), for this NPC alone
     virtual void tick(float dT);
 
-    // move
-    virtual void tryMove(float dT);
-    virtual void tryMoveToward(float dT, glm::vec3 target);
-    virtual void tryJumpToward(float dT, glm::vec3 target);
-    virtual void fall(float dT);
+    // A step in three parts, so the physics of many NPCs runs in a batch:
+    // the behaviour decides the motion; the NPC's physics state goes into
+    // the batch, which integrates it, and comes back; the behaviour takes
+    // in where the NPC got to (see NPCSimulation)
+    virtual void think(float dT);
+    size_t beginStep(NPCKinematics &kinematics, float dT);
+    void endStep(const NPCKinematics &kinematics, size_t i);
+    virtual void react(float dT);
 
     // helpers for NPC's movement
     // face toward the target
@@ -146,6 +226,24 @@ public:
 
     // get bottom center
     virtual glm::vec3 getBottomCenter() const;
+    // the box around the body, whichever way it faces
+    glm::vec3 getBoundsCenter() const;
+    glm::vec3 getHalfExtents() const;
+    // update the NPC's box in the terrain's EntityGrid
+    void placeInGrid();
+
+    // the state to draw as of the last tick
+    NPCPose getPose() const;
+    // set before each tick off the main thread
+    void setPlayerPosition(glm::vec3 position);
+    // search paths through the service rather than in tick; null: in tick
+    void setPathfindingService(PathfindingService *service);
+    // set before each tick off the main thread, with the player's position
+    void setFlowField(const FlowField *field);
+    // without goals of its own, an NPC heads for the player
+    bool isChasingPlayer() const;
+    void setLimbsAnimated(bool animated);
+    bool isOnGround() const;
 
     // set up the goals (explicitly)
     virtual void setupGoals(std::vector<glm::vec3> targetPositions);
@@ -159,15 +257,25 @@ public:
 };
 
 
+class NPCMesh;
+
 class NPCBlock : public Drawable
 {
 private:
 
     BlockType type;
+    // shared with every part of the type (see NPCMeshCache)
+    NPCMesh *mp_mesh;
 
 public:
     // constructors
     NPCBlock(OpenGLContext *context, BlockType type);
-    // for Drawable
+    // for Drawable; looks up the mesh rather than uploading one
     virtual void createVBOdata();
+    // both bind the shared mesh's buffers
+    bool bindIdx() override;
+    bool bindPos() override;
+
+    // the vertices only depend on it
+    BlockType getType() const;
 };
@@ -0,0 +1,236 @@
+#include "npcimpostors.h"
+#include "npc.h"
+#include <algorithm>
+
+// the camera's distance from the box, and the depth left around it
+static const float bakeMargin = 1.f;
+
+NPCImpostorQuad::NPCImpostorQuad(OpenGLContext *context)
+    : Drawable(context)
+{}
+
+void NPCImpostorQuad::createVBOdata()
+{
+    static const GLuint indices[6] = {0, 1, 2, 0, 2, 3};
+    static const glm::vec2 corners[4] = {glm::vec2(0.f, 0.f), glm::vec2(1.f, 0.f),
+                                         glm::vec2(1.f, 1.f), glm::vec2(0.f, 1.f)};
+    // interleaved as NPCMesh: pos, nor, uv, animatable flag
+    std::vector<float> buffer;
+    for (const glm::vec2 &uv : corners) {
+        pushVec4ToBuffer(buffer, glm::vec4(uv * 2.f - 1.f, 0.f, 1.f));
+        pushVec4ToBuffer(buffer, glm::vec4(0.f, 0.f, 1.f, 0.f));
+        pushVec2ToBuffer(buffer, uv);
+        pushVec2ToBuffer(buffer, glm::vec2(0.f));
+    }
+    m_count = 6;
+
+    generateIdx();
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), indices, GL_STATIC_DRAW);
+
+    generatePos();
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, buffer.size() * sizeof(float), buffer.data(), GL_STATIC_DRAW);
+}
+
+NPCImpostors::NPCImpostors(OpenGLContext *context)
+    : mp_context(context), m_atlas(context, atlasSize, atlasSize, 1), m_quad(context), m_created(false),
+      m_sprites(), m_bakesLeft(maxBakesPerFrame), m_instances(), m_instanceBuffer(0), m_bufferGenerated(false)
+{}
+
+bool NPCImpostors::create()
+{
+    m_atlas.create();
+    if (mp_context->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        m_atlas.destroy();
+        return false;
+    }
+    // no sprite until baked: every cell clear
+    GLfloat clearColor[4];
+    mp_context->glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    mp_context->glViewport(0, 0, atlasSize, atlasSize);
+    mp_context->glClearColor(0.f, 0.f, 0.f, 0.f);
+    mp_context->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    mp_context->glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, mp_context->defaultFramebufferObject());
+
+    m_quad.createVBOdata();
+    m_created = true;
+    return true;
+}
+
+void NPCImpostors::destroy()
+{
+    if (m_created) {
+        m_atlas.destroy();
+        m_quad.destroyVBOdata();
+        m_created = false;
+    }
+    if (m_bufferGenerated) {
+        mp_context->glDeleteBuffers(1, &m_instanceBuffer);
+        m_bufferGenerated = false;
+    }
+    // their cells are gone with the atlas
+    m_sprites.clear();
+}
+
+uint32_t NPCImpostors::spriteKey(const NPC &npc)
+{
+    return (static_cast<uint32_t>(npc.getRigIndex()) << 8) | static_cast<uint32_t>(npc.npcTexture);
+}
+
+glm::vec4 NPCImpostors::cellRect(int cell)
+{
+    // half a texel in from the edges, so the filtering never reaches
+    // the next cell
+    float texel = 1.f / atlasSize;
+    return glm::vec4((cell % cellsPerRow) * cellSize * texel + 0.5f * texel,
+                     (cell / cellsPerRow) * cellSize * texel + 0.5f * texel,
+                     (cellSize - 1) * texel, (cellSize - 1) * texel);
+}
+
+glm::mat4 NPCImpostors::cellTransform(int cell)
+{
+    float size = 2.f * cellSize / atlasSize;
+    glm::vec3 center(-1.f + size * (cell % cellsPerRow + 0.5f), -1.f + size * (cell / cellsPerRow + 0.5f), 0.f);
+    return glm::scale(glm::translate(glm::mat4(), center), glm::vec3(0.5f * size, 0.5f * size, 1.f));
+}
+
+void NPCImpostors::clear()
+{
+    m_instances.clear();
+    m_bakesLeft = maxBakesPerFrame;
+}
+
+bool NPCImpostors::needsBake(const NPC &npc) const
+{
+    return m_created && m_bakesLeft > 0 && npc.getRigIndex() >= 0
+            && static_cast<int>(m_sprites.size()) < maxSprites
+            && m_sprites.find(spriteKey(npc)) == m_sprites.end();
+}
+
+/**
+ * @brief NPCImpostors::bake
+ *  Every view is one more root for the batch: the box's camera around
+ *  the up axis, its orthographic fit, then the cell's place in the
+ *  atlas, so the views are one draw into the whole atlas. Only the
+ *  sprite's cells are cleared, under the scissor.
+ */
+bool NPCImpostors::bake(NPC &npc, NPCPartBatch &batch, ShaderProgram &prog, TextureArray &skins)
+{
+    if (!needsBake(npc) || skins.getSlot() < 0) {
+        return false;
+    }
+    m_bakesLeft--;
+    glm::vec3 min, max;
+    npc.getPartBounds(min, max);
+    Sprite sprite;
+    sprite.center = 0.5f * (min + max);
+    sprite.halfWidth = 0.5f * glm::length(glm::vec2(max.x - min.x, max.z - min.z));
+    sprite.halfHeight = 0.5f * (max.y - min.y);
+    sprite.firstCell = static_cast<int>(m_sprites.size()) * views;
+
+    GLint frameBuffer;
+    GLint viewport[4];
+    GLfloat clearColor[4];
+    mp_context->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &frameBuffer);
+    mp_context->glGetIntegerv(GL_VIEWPORT, viewport);
+    mp_context->glGetFloatv(GL_COLOR_CLEAR_VALUE, clearColor);
+    GLboolean blend = mp_context->glIsEnabled(GL_BLEND);
+
+    m_atlas.bindFrameBuffer();
+    mp_context->glViewport(0, 0, atlasSize, atlasSize);
+    mp_context->glDisable(GL_BLEND);
+    mp_context->glEnable(GL_SCISSOR_TEST);
+    mp_context->glScissor((sprite.firstCell % cellsPerRow) * cellSize, (sprite.firstCell / cellsPerRow) * cellSize,
+                          views * cellSize, cellSize);
+    mp_context->glClearColor(0.f, 0.f, 0.f, 0.f);
+    mp_context->glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    mp_context->glDisable(GL_SCISSOR_TEST);
+
+    float distance = sprite.halfWidth + bakeMargin;
+    glm::mat4 projection = glm::ortho(-sprite.halfWidth, sprite.halfWidth, -sprite.halfHeight, sprite.halfHeight,
+                                      0.5f * bakeMargin, distance + sprite.halfWidth + bakeMargin);
+    batch.clear();
+    for (int view = 0; view < views; view++) {
+        float angle = 2.f * glm::pi<float>() * view / views;
+        glm::vec3 eye = sprite.center + distance * glm::vec3(std::sin(angle), 0.f, std::cos(angle));
+        glm::mat4 camera = glm::lookAt(eye, sprite.center, glm::vec3(0.f, 1.f, 0.f));
+        npc.collectParts(cellTransform(sprite.firstCell + view) * projection * camera, 0.f, batch);
+    }
+    batch.draw(prog, skins);
+    batch.clear();
+
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, frameBuffer);
+    mp_context->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    mp_context->glClearColor(clearColor[0], clearColor[1], clearColor[2], clearColor[3]);
+    if (blend) {
+        mp_context->glEnable(GL_BLEND);
+    }
+    m_sprites[spriteKey(npc)] = sprite;
+    return true;
+}
+
+/**
+ * @brief NPCImpostors::add
+ *  The quad's width runs along the view's screen right, carried back
+ *  to the world through the NPC's frame (see NPC::collectParts), at the
+ *  camera's exact angle: only the sprite is snapped to a view.
+ */
+bool NPCImpostors::add(const NPC &npc, const NPCPose &pose, glm::vec3 camera)
+{
+    if (npc.getRigIndex() < 0) {
+        return false;
+    }
+    auto it = m_sprites.find(spriteKey(npc));
+    if (it == m_sprites.end()) {
+        return false;
+    }
+    const Sprite &sprite = it->second;
+    glm::vec3 center = pose.position + sprite.center.x * pose.right + sprite.center.y * pose.up
+            + sprite.center.z * pose.forward;
+    glm::vec3 toCamera = camera - center;
+    float angle = std::atan2(glm::dot(toCamera, pose.right), glm::dot(toCamera, pose.forward));
+    int view = static_cast<int>(std::floor(angle / (2.f * glm::pi<float>()) * views + 0.5f));
+    view = ((view % views) + views) % views;
+
+    glm::vec3 right = std::cos(angle) * pose.right - std::sin(angle) * pose.forward;
+    glm::vec3 facing = glm::cross(right, pose.up);
+    glm::mat4 model(glm::vec4(sprite.halfWidth * right, 0.f), glm::vec4(sprite.halfHeight * pose.up, 0.f),
+                    glm::vec4(facing, 0.f), glm::vec4(center, 1.f));
+    m_instances.push_back(Instance{model, cellRect(sprite.firstCell + view)});
+    return true;
+}
+
+/**
+ * @brief NPCImpostors::draw
+ *  The buffer is orphaned before the upload, as NPCPartBatch's is.
+ */
+void NPCImpostors::draw(ShaderProgram &prog)
+{
+    if (m_instances.empty()) {
+        return;
+    }
+    if (!m_bufferGenerated) {
+        mp_context->glGenBuffers(1, &m_instanceBuffer);
+        m_bufferGenerated = true;
+    }
+    GLsizeiptr bytes = m_instances.size() * sizeof(Instance);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_instances.data());
+
+    m_atlas.bindToTextureSlot(atlasTextureSlot);
+    prog.setTexture(atlasTextureSlot);
+    prog.drawInterleavedInstanced(m_quad, m_instanceBuffer, 0, static_cast<int>(m_instances.size()));
+}
+
+size_t NPCImpostors::getSpriteCount() const
+{
+    return m_sprites.size();
+}
+
+size_t NPCImpostors::getInstanceCount() const
+{
+    return m_instances.size();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "drawable.h"
+#include "framebuffer.h"
+#include "glm_includes.h"
+#include "npcpartbatch.h"
+#include "shaderprogram.h"
+#include "texture.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class NPC;
+struct NPCPose;
+
+/**
+ * @brief The NPCImpostorQuad class
+ *  The unit quad an impostor is drawn on: xy in [-1, 1], uv in [0, 1],
+ *  laid out as the NPC parts' vertices for drawInterleavedInstanced.
+ */
+class NPCImpostorQuad : public Drawable
+{
+public:
+    explicit NPCImpostorQuad(OpenGLContext *context);
+
+    void createVBOdata() override;
+};
+
+/**
+ * @brief The NPCImpostors class
+ *  The far NPCs, as camera-facing quads textured from a sprite atlas.
+ *  A sprite is an NPC shape (its rig in the NPCPartBatch) with a texture,
+ *  rendered at rest from `views` directions around its up axis into a row
+ *  of cells of the atlas, orthographic and fitted to the parts' box. It
+ *  is baked through the batch and program the NPCs are drawn with, the
+ *  first frame an NPC of its kind is far and already has its rig; until
+ *  then the NPC is drawn whole. A far NPC is then one instance: the view
+ *  nearest the camera's direction in its frame, on a quad turned to the
+ *  camera about its up axis.
+ *  Main thread only, with the context current.
+ */
+class NPCImpostors
+{
+public:
+    // the atlas' side and a cell's, in pixels
+    static const int atlasSize = 1024;
+    static const int cellSize = 64;
+    // the directions a sprite is seen from, a cell each
+    static const int views = 8;
+    static const int cellsPerRow = atlasSize / cellSize;
+    static const int maxSprites = cellsPerRow * cellsPerRow / views;
+    // the sprites baked in a frame at most
+    static const int maxBakesPerFrame = 2;
+    // past it, an NPC with a sprite is drawn as one
+    static constexpr float impostorDistance = 48.f;
+    // past it, an NPC is not drawn at all
+    static constexpr float drawDistance = 192.f;
+    // the atlas' slot, past the NPC skins and the player's
+    static const int atlasTextureSlot = 5;
+
+private:
+    struct Sprite
+    {
+        // the box's center and half size relative to the NPC's root; the
+        // width is across the box's diagonal, the same from every view
+        glm::vec3 center;
+        float halfWidth;
+        float halfHeight;
+        // the cell of the first view
+        int firstCell;
+    };
+
+    // as vs_ModelInstanced and vs_AnimationInstanced read it
+    struct Instance
+    {
+        glm::mat4 model;
+        // the view's cell in the atlas: uv of its corner, then its size
+        glm::vec4 rect;
+    };
+
+    OpenGLContext *mp_context;
+    FrameBuffer m_atlas;
+    NPCImpostorQuad m_quad;
+    bool m_created;
+    // by (rig << 8) | texture
+    std::unordered_map<uint32_t, Sprite> m_sprites;
+    int m_bakesLeft;
+    std::vector<Instance> m_instances;
+    GLuint m_instanceBuffer;
+    bool m_bufferGenerated;
+
+    static uint32_t spriteKey(const NPC &npc);
+    static glm::vec4 cellRect(int cell);
+    // the clip space of the atlas' cell to the whole atlas'
+    static glm::mat4 cellTransform(int cell);
+
+public:
+    explicit NPCImpostors(OpenGLContext *context);
+
+    NPCImpostors(const NPCImpostors&) = delete;
+    NPCImpostors &operator=(const NPCImpostors&) = delete;
+
+    // Make the atlas and the quad; false if the atlas is incomplete, and
+    // every NPC is then drawn whole
+    bool create();
+    void destroy();
+
+    // drop the instances of the last frame and renew the bakes' budget
+    void clear();
+    // Whether npc would be baked: it has its rig but no sprite yet, and
+    // there are room and budget for one
+    bool needsBake(const NPC &npc) const;
+    // Bake npc's sprite with batch and prog, the frame uniforms' view-
+    // projection set to the identity. The batch is left empty, and the
+    // frame buffer, viewport, blending and clear color as they were.
+    // False if the skins are not loaded yet
+    bool bake(NPC &npc, NPCPartBatch &batch, ShaderProgram &prog, TextureArray &skins);
+    // Add npc at pose as seen from camera; false if it has no sprite
+    bool add(const NPC &npc, const NPCPose &pose, glm::vec3 camera);
+    // upload the instances and draw them with prog
+    void draw(ShaderProgram &prog);
+
+    size_t getSpriteCount() const;
+    size_t getInstanceCount() const;
+};
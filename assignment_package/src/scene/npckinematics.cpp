@@ -0,0 +1,92 @@
+#include "npckinematics.h"
+#include <algorithm>
+
+NPCKinematics::NPCKinematics()
+    : dT(), px(), py(), pz(), vx(), vy(), vz(), ay(), gy(), minVy(),
+      defaultVx(), defaultVz(), tx(), ty(), tz(), motion(),
+      blockedY(), blockedX(), blockedZ(), onGround()
+{}
+
+void NPCKinematics::clear()
+{
+    for (std::vector<float> *column : {&dT, &px, &py, &pz, &vx, &vy, &vz, &ay, &gy, &minVy,
+                                       &defaultVx, &defaultVz, &tx, &ty, &tz}) {
+        column->clear();
+    }
+    motion.clear();
+    for (std::vector<uint8_t> *column : {&blockedY, &blockedX, &blockedZ, &onGround}) {
+        column->clear();
+    }
+}
+
+size_t NPCKinematics::add()
+{
+    size_t index = size();
+    for (std::vector<float> *column : {&dT, &px, &py, &pz, &vx, &vy, &vz, &ay, &gy, &minVy,
+                                       &defaultVx, &defaultVz, &tx, &ty, &tz}) {
+        column->push_back(0.f);
+    }
+    motion.push_back(NPCMotion::none);
+    for (std::vector<uint8_t> *column : {&blockedY, &blockedX, &blockedZ, &onGround}) {
+        column->push_back(0);
+    }
+    return index;
+}
+
+size_t NPCKinematics::size() const
+{
+    return motion.size();
+}
+
+/**
+ * @brief NPCKinematics::integrate
+ *  Gravity and a jump's acceleration first, then the step's velocity and
+ *  what the terrain takes of it. A falling NPC lands on terrain under it
+ *  unless it is still being pushed up, getting its horizontal velocity
+ *  back; terrain ahead along an axis stops the move along it.
+ */
+void NPCKinematics::integrate()
+{
+    size_t count = size();
+    // everything loaded up front and picked by selects, with bitwise
+    // tests, so the body has next to no branches
+    for (size_t i = 0; i < count; i++) {
+        NPCMotion m = motion[i];
+        bool frees = m == NPCMotion::free;
+        bool walks = (m == NPCMotion::toward) | (m == NPCMotion::jump);
+        bool jumps = m == NPCMotion::jump;
+        bool flies = m == NPCMotion::fly;
+        bool falls = frees | walks;
+        float t = dT[i];
+        float g = gy[i];
+        float velX = vx[i], velY = vy[i], velZ = vz[i];
+        float pushY = ay[i];
+        float targetX = tx[i], targetY = ty[i], targetZ = tz[i];
+
+        float a = jumps ? pushY : 0.f;
+        float v = velY + t * (g + a);
+        v = jumps ? std::min(maxJumpSpeed, v) : v;
+        v = std::max(minVy[i], v);
+        v = falls ? v : velY;
+        // a jump's push fades out by gravity
+        float fadedA = jumps & (a > 0.f) ? std::max(0.f, a + g) : pushY;
+
+        float sx = flies ? targetX : walks ? targetX * velX : frees ? velX : 0.f;
+        float sy = flies ? targetY : falls ? v : 0.f;
+        float sz = flies ? targetZ : walks ? targetZ * velZ : frees ? velZ : 0.f;
+
+        bool lands = falls & (blockedY[i] != 0) & (!jumps | (fadedA + g <= 0.f) | (v <= 0.f));
+        sy = lands ? 0.f : sy;
+        sx = falls & (blockedX[i] != 0) ? 0.f : sx;
+        sz = falls & (blockedZ[i] != 0) ? 0.f : sz;
+
+        px[i] += t * sx;
+        py[i] += t * sy;
+        pz[i] += t * sz;
+        vx[i] = lands ? defaultVx[i] : velX;
+        vy[i] = v;
+        vz[i] = lands ? defaultVz[i] : velZ;
+        ay[i] = lands ? 0.f : fadedA;
+        onGround[i] = lands ? 1 : onGround[i];
+    }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// how an NPC moves in a step, as its behaviour decided (see NPC::think)
+enum class NPCMotion : uint8_t
+{
+    // stays put, without gravity either, as while it waits for a path
+    none,
+    // carried by its velocity, falling
+    free,
+    // toward a target, its velocity per block off it, falling
+    toward,
+    // toward, and pushed up by the acceleration of a jump
+    jump,
+    // at a given velocity, through anything
+    fly
+};
+
+/**
+ * @brief The NPCKinematics struct
+ *  The physics of a step for a batch of NPCs, an array per quantity:
+ *  each NPC adds its state, how it wants to move and where the terrain
+ *  stops it (see NPC::beginStep), integrate() moves them all in one
+ *  flat loop down the arrays, without a virtual call or a pointer to
+ *  chase, and each NPC takes its result back (NPC::endStep).
+ *  The terrain is tested per NPC before the integration, as the NPC's
+ *  own rays already did: they depend on where it is, not how it moves.
+ */
+struct NPCKinematics
+{
+    // the fastest a jump lifts an NPC, in blocks per second
+    static constexpr float maxJumpSpeed = 6.f;
+
+    std::vector<float> dT;
+    std::vector<float> px, py, pz;
+    std::vector<float> vx, vy, vz;
+    // the vertical acceleration of a jump, gravity, and the fastest fall
+    std::vector<float> ay, gy, minVy;
+    // the horizontal velocity restored on landing
+    std::vector<float> defaultVx, defaultVz;
+    // toward, jump: the target off the bottom; fly: the velocity
+    std::vector<float> tx, ty, tz;
+    std::vector<NPCMotion> motion;
+    // whether the terrain is under the NPC / ahead of it along x, z
+    std::vector<uint8_t> blockedY, blockedX, blockedZ;
+    std::vector<uint8_t> onGround;
+
+    NPCKinematics();
+
+    // drop the NPCs, keeping the room
+    void clear();
+    // room for one more NPC; its index
+    size_t add();
+    size_t size() const;
+
+    // step every NPC by its dT
+    void integrate();
+};
@@ -0,0 +1,70 @@
+#include "npcmeshcache.h"
+
+std::unordered_map<BlockType, uPtr<NPCMesh>> NPCMeshCache::meshes;
+
+NPCMesh::NPCMesh(OpenGLContext *context, BlockType type)
+    : Drawable(context), type(type)
+{}
+
+void NPCMesh::createVBOdata()
+{
+    int nVert = 0;
+    static const GLuint faceIndices[6] = {0, 1, 2, 0, 2, 3};
+    // 6 faces * (4 vertices * 12 floats, 6 indices)
+    std::vector<GLuint> indices;
+    std::vector<float> buffer;
+    indices.reserve(36);
+    buffer.reserve(288);
+    // draw the cube
+    // loop through 6 faces
+    // XPOS, XNEG, YPOS, YNEG, ZPOS, ZNEG
+    // interleaved VBO
+    // pos, nor, uvs
+    for (const BlockFace &face : Block::getFaces(type))
+    {
+        for (const VertexData &vert : face.vertices)
+        {
+            // make vert.pos centered at the center of the block
+            pushVec4ToBuffer(buffer, vert.pos - glm::vec4(0.5, 0.5, 0.5, 0.));
+            pushVec4ToBuffer(buffer, face.normal);
+            pushVec2ToBuffer(buffer, vert.uv);
+            pushVec2ToBuffer(buffer, Block::getAnimatableFlag(type));
+        }
+        // add indices for each face
+        for (GLuint index : faceIndices)
+        {
+            indices.push_back(nVert + index);
+        }
+        nVert += 4;
+    }
+
+    // to gpu
+    m_count = indices.size();
+    int bufferSize = buffer.size();
+
+    generateIdx();
+    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
+    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+
+    generatePos();
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, bufferSize * sizeof(float), buffer.data(), GL_STATIC_DRAW);
+}
+
+NPCMesh *NPCMeshCache::acquire(OpenGLContext *context, BlockType type)
+{
+    auto it = meshes.find(type);
+    if (it == meshes.end()) {
+        it = meshes.emplace(type, mkU<NPCMesh>(context, type)).first;
+        it->second->createVBOdata();
+    }
+    return it->second.get();
+}
+
+void NPCMeshCache::destroy()
+{
+    for (auto &mesh : meshes) {
+        mesh.second->destroyVBOdata();
+    }
+    meshes.clear();
+}
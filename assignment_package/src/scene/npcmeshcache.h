@@ -0,0 +1,41 @@
+#pragma once
+
+#include "block.h"
+#include "drawable.h"
+#include "smartpointerhelp.h"
+#include <unordered_map>
+
+/**
+ * @brief The NPCMesh class
+ *  The cube of an NPC body part: centered at the origin, with the faces
+ *  and UVs of its block type. Owned by NPCMeshCache.
+ */
+class NPCMesh : public Drawable
+{
+private:
+    BlockType type;
+
+public:
+    NPCMesh(OpenGLContext *context, BlockType type);
+
+    void createVBOdata() override;
+};
+
+/**
+ * @brief The NPCMeshCache class
+ *  One NPCMesh per block type, uploaded on first use; the body parts of
+ *  every NPC draw from it (see NPCBlock), so a part's mesh is on the GPU
+ *  once however many NPCs have it.
+ *  Main thread only, with the context current.
+ */
+class NPCMeshCache
+{
+private:
+    static std::unordered_map<BlockType, uPtr<NPCMesh>> meshes;
+
+public:
+    // the mesh of type, uploaded the first time it is asked for
+    static NPCMesh *acquire(OpenGLContext *context, BlockType type);
+    // free every mesh; the parts drawing them must not be drawn after
+    static void destroy();
+};
@@ -0,0 +1,144 @@
+#include "npcpartbatch.h"
+#include "npc.h"
+#include "flatscenegraph.h"
+#include <algorithm>
+
+NPCPartBatch::NPCPartBatch(OpenGLContext *context)
+    : mp_context(context), m_groups(), m_groupIndex(), m_instances(),
+      m_instanceBuffer(0), m_bufferGenerated(false),
+      m_rigTexels(), m_rigRanges(), m_rigTexture(0), m_rigTextureGenerated(false),
+      m_rigsChanged(false)
+{}
+
+/**
+ * @brief NPCPartBatch::addRigs
+ *  NPCs of a kind build the same scene graph, so their rigs are looked
+ *  up first and the texture only grows with the kinds.
+ * @param texels
+ * @return the index of the first part's rig
+ */
+int NPCPartBatch::addRigs(const std::vector<glm::vec4> &texels)
+{
+    int count = static_cast<int>(texels.size()) / FlatSceneGraph::rigTexels;
+    for (const RigRange &range : m_rigRanges) {
+        if (range.count == count
+            && std::equal(texels.begin(), texels.end(),
+                          m_rigTexels.begin() + range.first * FlatSceneGraph::rigTexels)) {
+            return range.first;
+        }
+    }
+    int first = static_cast<int>(m_rigTexels.size()) / FlatSceneGraph::rigTexels;
+    m_rigTexels.insert(m_rigTexels.end(), texels.begin(), texels.end());
+    m_rigRanges.push_back(RigRange{first, count});
+    m_rigsChanged = true;
+    return first;
+}
+
+void NPCPartBatch::clear()
+{
+    for (Group &group : m_groups) {
+        group.instances.clear();
+    }
+}
+
+void NPCPartBatch::add(NPCTexture texture, NPCBlock *part, const glm::mat4 &root, float limbDeg, int rig)
+{
+    auto it = m_groupIndex.find(part->getType());
+    if (it == m_groupIndex.end()) {
+        it = m_groupIndex.emplace(part->getType(), m_groups.size()).first;
+        m_groups.push_back(Group{part, {}});
+    }
+    Group &group = m_groups[it->second];
+    group.mesh = part;
+    group.instances.push_back(Instance{root, glm::vec4(limbDeg, static_cast<float>(rig),
+                                                       static_cast<float>(texture), 0.f)});
+}
+
+/**
+ * @brief NPCPartBatch::uploadRigs
+ *  Rows of rigTextureWidth texels, so no rig spans two rows and the
+ *  texture stays far under the size limit. Only when rigs were added,
+ *  so the last row is padded in a copy.
+ */
+void NPCPartBatch::uploadRigs()
+{
+    if (!m_rigTextureGenerated) {
+        mp_context->glGenTextures(1, &m_rigTexture);
+        m_rigTextureGenerated = true;
+    }
+    int rows = (static_cast<int>(m_rigTexels.size()) + rigTextureWidth - 1) / rigTextureWidth;
+    std::vector<glm::vec4> texels(m_rigTexels);
+    texels.resize(rows * rigTextureWidth, glm::vec4(0.f));
+
+    mp_context->glActiveTexture(GL_TEXTURE0 + rigTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_rigTexture);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    mp_context->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, rigTextureWidth, rows,
+                             0, GL_RGBA, GL_FLOAT, texels.data());
+    m_rigsChanged = false;
+}
+
+/**
+ * @brief NPCPartBatch::draw
+ *  The skins are bound once for every group. The buffer is orphaned
+ *  before the upload, so this frame never waits on the draws of the
+ *  last.
+ * @param prog
+ * @param skins
+ */
+void NPCPartBatch::draw(ShaderProgram &prog, TextureArray &skins)
+{
+    if (skins.getSlot() < 0) {
+        return;
+    }
+    m_instances.clear();
+    for (const Group &group : m_groups) {
+        m_instances.insert(m_instances.end(), group.instances.begin(), group.instances.end());
+    }
+    if (m_instances.empty()) {
+        return;
+    }
+    if (!m_bufferGenerated) {
+        mp_context->glGenBuffers(1, &m_instanceBuffer);
+        m_bufferGenerated = true;
+    }
+    GLsizeiptr bytes = m_instances.size() * sizeof(Instance);
+    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    mp_context->glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    mp_context->glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, m_instances.data());
+
+    if (m_rigsChanged) {
+        uploadRigs();
+    }
+    mp_context->glActiveTexture(GL_TEXTURE0 + rigTextureSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_rigTexture);
+    prog.setRigTexture(rigTextureSlot);
+    skins.bind(skins.getSlot());
+    prog.setTexture(skins.getSlot());
+
+    int firstInstance = 0;
+    for (Group &group : m_groups) {
+        int count = static_cast<int>(group.instances.size());
+        if (count > 0) {
+            prog.drawInterleavedInstanced(*group.mesh, m_instanceBuffer, firstInstance, count);
+        }
+        firstInstance += count;
+    }
+}
+
+void NPCPartBatch::destroy()
+{
+    if (m_bufferGenerated) {
+        mp_context->glDeleteBuffers(1, &m_instanceBuffer);
+        m_bufferGenerated = false;
+    }
+    if (m_rigTextureGenerated) {
+        mp_context->glDeleteTextures(1, &m_rigTexture);
+        m_rigTextureGenerated = false;
+        // the texels stay, for a texture made again
+        m_rigsChanged = true;
+    }
+}
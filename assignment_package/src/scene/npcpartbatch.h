@@ -0,0 +1,95 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include "openglcontext.h"
+#include "shaderprogram.h"
+#include "texture.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+class NPCBlock;
+
+/**
+ * @brief The NPCPartBatch class
+ *  A frame's NPC body parts, grouped by block type so each group is one
+ *  instanced draw: parts of one type share their geometry (see NPCBlock)
+ *  and differ only by transform and skin. The skins are the layers of
+ *  one texture array, bound once, the layer an instance's; the instances
+ *  of every group go up in one buffer per frame, so the draw calls grow
+ *  with the kinds of parts rather than with the NPCs or their textures.
+ *  A part's transform below the NPC's root is its rig (see
+ *  FlatSceneGraph::buildRig), registered once and kept in a float
+ *  texture; an instance is only the root's matrix, the limb angle and
+ *  the rig, and the vertex shader swings the limbs.
+ *  Main thread only, with the context current.
+ */
+class NPCPartBatch
+{
+private:
+    // as vs_ModelInstanced and vs_AnimationInstanced read it
+    struct Instance
+    {
+        glm::mat4 root;
+        // x: the limb angle in degrees, y: the rig, z: the skin's layer
+        // (the NPCTexture), w unused
+        glm::vec4 animation;
+    };
+
+    struct Group
+    {
+        // any of the parts; all of a type have the same vertices
+        NPCBlock *mesh;
+        std::vector<Instance> instances;
+    };
+
+    // a registered run of rigs, one per part
+    struct RigRange
+    {
+        int first;
+        int count;
+    };
+
+    OpenGLContext *mp_context;
+    // kept over frames, emptied by clear()
+    std::vector<Group> m_groups;
+    // by block type
+    std::unordered_map<BlockType, size_t> m_groupIndex;
+    // the groups' instances back to back, as uploaded
+    std::vector<Instance> m_instances;
+    GLuint m_instanceBuffer;
+    bool m_bufferGenerated;
+
+    // every rig registered, FlatSceneGraph::rigTexels each
+    std::vector<glm::vec4> m_rigTexels;
+    std::vector<RigRange> m_rigRanges;
+    GLuint m_rigTexture;
+    bool m_rigTextureGenerated;
+    // the texels changed since the last upload
+    bool m_rigsChanged;
+
+    void uploadRigs();
+
+public:
+    // the rig texture's slot, past the textures MyGL loads
+    static const int rigTextureSlot = 14;
+    // texels per row of the rig texture; a multiple of rigTexels
+    static const int rigTextureWidth = 1022;
+
+    explicit NPCPartBatch(OpenGLContext *context);
+
+    // Register the rigs of one NPC, rigTexels per part, and return the
+    // first's index; an NPC of the same shape gets the same rigs back
+    int addRigs(const std::vector<glm::vec4> &texels);
+    // drop the parts of the last frame
+    void clear();
+    // a part of an NPC drawn with texture, its root at root and its limbs
+    // at limbDeg, posed by the given rig
+    void add(NPCTexture texture, NPCBlock *part, const glm::mat4 &root, float limbDeg, int rig);
+    // Upload the instances and draw every group with prog, skinned from
+    // skins by NPCTexture; nothing is drawn before skins is loaded
+    void draw(ShaderProgram &prog, TextureArray &skins);
+    // free the buffer and the rig texture; the context must be current
+    void destroy();
+};
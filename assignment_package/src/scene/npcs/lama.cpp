@@ -137,13 +137,13 @@ void Lama::initSceneGraph()
     rootToRight = bodyScale.x / 2.f;
 }
 
-void Lama::tick(float dT)
+void Lama::think(float dT)
 {
     // turn to the player's direction
     // faceToward(player->mcr_position);
 
-    // tick
-    NPC::tick(dT);
+    // think
+    NPC::think(dT);
 }
 
 void Lama::createVBOdata()
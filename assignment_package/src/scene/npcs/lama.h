@@ -37,8 +37,8 @@ public:
     virtual void createVBOdata() override;
     virtual void initSceneGraph() override;
 
-    // override tick
-    virtual void tick(float dT) override;
+    // override think
+    virtual void think(float dT) override;
 
     virtual ~Lama();
 };
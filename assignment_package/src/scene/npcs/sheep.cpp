@@ -113,13 +113,13 @@ void Sheep::initSceneGraph()
     rootToRight = bodyScale.x / 2.f;
 }
 
-void Sheep::tick(float dT)
+void Sheep::think(float dT)
 {
     // turn to the player's direction
     // faceToward(player->mcr_position);
 
-    // tick
-    NPC::tick(dT);
+    // think
+    NPC::think(dT);
 }
 
 /**
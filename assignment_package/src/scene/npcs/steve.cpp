@@ -145,9 +145,8 @@ void Steve::tick(float dT, InputBundle &inputs)
     // arm movement when mouse pressed
     if (inputs.leftMouseButtonPressed || inputs.rightMouseButtonPressed)
     {
-        // try move right upper limb
+        // try move right upper limb (posed in draw)
         rULRotCycle += dT;
-        rotateRUL();
     }
     else
     {
@@ -169,8 +168,15 @@ void Steve::rotateRUL()
  */
 void Steve::draw(ShaderProgram *shader)
 {
-    // based on player's position
-    glm::vec3 rootPos = m_position;
+    applyLimbRotations(limbDeg);
+    // the swinging arm overrides its walking swing
+    if (rULRotCycle > 0.f)
+    {
+        rotateRUL();
+    }
+
+    // based on player's drawn position
+    glm::vec3 rootPos = m_position + player->getRenderOffset();
     rootPos[1] += rootToGround;
 
     rootPos -= rootToFront * m_forward;
@@ -180,7 +186,7 @@ void Steve::draw(ShaderProgram *shader)
                                     glm::vec4(m_up, 0.f),
                                     glm::vec4(m_forward, 0.f),
                                     glm::vec4(rootPos, 1));
-    traverseSceneGraph(shader, root, transform);
+    drawParts(shader, transform);
 }
 
 /**
@@ -122,23 +122,26 @@ void ZombieDragon::initSceneGraph()
 
 
 /**
- * @brief ZombieDragon::tick
- *  If player's in flight mode, follow the player.
- *  If player's not in flight mode, change to hovering mode
+ * @brief ZombieDragon::think
+ *  Circle around the goal, flying along the forward
  * @param dT
  */
-void ZombieDragon::tick(float dT)
+void ZombieDragon::think(float dT)
 {
     // change the facing direction
     faceSlowlyTowardTangent(dT, goal);
 
     // move along the forward
-    glm::vec3 disp = dT * m_velocity * m_forward;
-    prev_m_position = mcr_position;
-    moveAlongVector(disp);
+    motion = NPCMotion::fly;
+    motionTarget = m_velocity * m_forward;
+}
 
+void ZombieDragon::react(float)
+{
     walkingDistCycle += glm::length(mcr_position - prev_m_position);
     updateLimbRotations();
+
+    placeInGrid();
 }
 
 /**
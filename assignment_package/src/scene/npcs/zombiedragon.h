@@ -27,8 +27,9 @@ public:
     virtual void createVBOdata() override;
     virtual void initSceneGraph() override;
 
-    // override tick
-    virtual void tick(float dT) override;
+    // fly around the goal, whatever is in the way
+    virtual void think(float dT) override;
+    virtual void react(float dT) override;
 
     virtual ~ZombieDragon();
 };
@@ -0,0 +1,375 @@
+#include "npcsimulation.h"
+#include "profiler.h"
+#include "threadaffinity.h"
+#include <algorithm>
+#include <climits>
+#include <unordered_map>
+
+NPCSimulation::NPCSimulation(int threadCount)
+    : m_npcs(), m_pathfinding(), m_stepPoses(), m_publishedPoses(), m_levels(),
+      m_accumulator(0.f), m_publishedAlpha(0.f), m_pendingAlpha(0.f),
+      m_searchesPerTick(PathfindingService::defaultBudget), m_lodScale(1.f), m_batchLodScale(1.f),
+      mcr_terrain(nullptr), m_chasers(0), m_flowFields(), m_publishedFlowField(0),
+      m_flowFieldBlock(INT_MIN), m_flowFieldBatch(0), m_flowFieldDue(false), m_flowFieldRefreshed(false),
+      m_lock(), m_batchStarted(), m_batchFinished(),
+      m_batch(0), m_batchSteps(0), m_batchPlayerPosition(0.f),
+      m_nextNPC(0), m_busyThreads(0), m_times{0, 0, 0}, m_batchRunning(false), m_stopping(false),
+      m_threads(), m_cores()
+{
+    startThreads(threadCount);
+}
+
+void NPCSimulation::startThreads(int threadCount)
+{
+    if (threadCount <= 0) {
+        threadCount = 2;
+    }
+    for (int i = 0; i < threadCount; i++) {
+        m_threads.push_back(uPtr<QThread>(QThread::create([this]() { workerLoop(); })));
+        m_threads.back()->start();
+    }
+}
+
+// no batch may be running
+void NPCSimulation::stopThreads()
+{
+    m_lock.lock();
+    m_stopping = true;
+    m_lock.unlock();
+    m_batchStarted.wakeAll();
+    for (uPtr<QThread> &thread : m_threads) {
+        thread->wait();
+    }
+    m_threads.clear();
+    m_stopping = false;
+}
+
+NPCSimulation::~NPCSimulation()
+{
+    stop();
+}
+
+/**
+ * @brief NPCSimulation::setNPCs
+ *  The NPCs it had already keep their poses and levels, so a spawn or a
+ *  despawn does not make the others jump (see NPCSpawner).
+ */
+void NPCSimulation::setNPCs(const std::vector<uPtr<NPC>> &npcs, const Terrain &terrain)
+{
+    finish();
+    mcr_terrain = &terrain;
+    std::unordered_map<const NPC*, size_t> previous;
+    for (size_t i = 0; i < m_npcs.size(); i++) {
+        previous[m_npcs[i]] = i;
+    }
+    std::vector<StepPoses> stepPoses;
+    std::vector<StepPoses> publishedPoses;
+    std::vector<NPCLevel> levels;
+    m_npcs.clear();
+    m_chasers = 0;
+    for (const uPtr<NPC> &npc : npcs) {
+        m_npcs.push_back(npc.get());
+        if (npc->isChasingPlayer()) {
+            m_chasers++;
+        }
+        auto kept = previous.find(npc.get());
+        if (kept != previous.end()) {
+            stepPoses.push_back(m_stepPoses[kept->second]);
+            publishedPoses.push_back(m_publishedPoses[kept->second]);
+            levels.push_back(m_levels[kept->second]);
+            continue;
+        }
+        npc->setPathfindingService(&m_pathfinding);
+        // seen by the others and the renderer before its first step
+        npc->placeInGrid();
+        NPCPose pose = npc->getPose();
+        stepPoses.push_back({pose, pose});
+        publishedPoses.push_back({pose, pose});
+        levels.push_back(NPCLevel{SimulationLevel::full, 0});
+    }
+    m_stepPoses.swap(stepPoses);
+    m_publishedPoses.swap(publishedPoses);
+    m_levels.swap(levels);
+}
+
+/**
+ * @brief NPCSimulation::begin
+ *  Without a whole step due, only the interpolation moves on.
+ * @param dT : seconds since the last begin()
+ * @param playerPosition
+ */
+void NPCSimulation::begin(float dT, glm::vec3 playerPosition)
+{
+    finish();
+
+    m_accumulator += dT;
+    int steps = static_cast<int>(m_accumulator / stepSeconds);
+    if (steps > maxStepsPerTick) {
+        steps = maxStepsPerTick;
+        m_accumulator = steps * stepSeconds;
+    }
+    m_accumulator -= steps * stepSeconds;
+    m_pendingAlpha = glm::clamp(m_accumulator / stepSeconds, 0.f, 1.f);
+
+    if (steps == 0 || m_npcs.empty() || m_threads.empty()) {
+        m_publishedAlpha = m_pendingAlpha;
+        return;
+    }
+
+    m_lock.lock();
+    m_batch++;
+    m_batchSteps = steps;
+    m_batchPlayerPosition = playerPosition;
+    m_batchLodScale = m_lodScale;
+    glm::ivec3 playerBlock = glm::ivec3(glm::floor(playerPosition));
+    if (m_chasers > 0 && (playerBlock != m_flowFieldBlock || m_batch - m_flowFieldBatch >= flowFieldBatches)) {
+        m_flowFieldBlock = playerBlock;
+        m_flowFieldBatch = m_batch;
+        m_flowFieldDue.store(true);
+    }
+    m_nextNPC.store(0);
+    m_busyThreads = static_cast<int>(m_threads.size());
+    m_batchRunning = true;
+    m_lock.unlock();
+    m_pathfinding.setBudget(m_searchesPerTick);
+    m_batchStarted.wakeAll();
+}
+
+void NPCSimulation::finish()
+{
+    m_lock.lock();
+    bool ran = m_batchRunning;
+    while (m_busyThreads > 0) {
+        m_batchFinished.wait(&m_lock);
+    }
+    m_batchRunning = false;
+    m_lock.unlock();
+
+    if (ran) {
+        publish();
+    }
+}
+
+void NPCSimulation::publish()
+{
+    m_publishedPoses = m_stepPoses;
+    m_publishedAlpha = m_pendingAlpha;
+    if (m_flowFieldRefreshed) {
+        m_publishedFlowField = 1 - m_publishedFlowField;
+        m_flowFieldRefreshed = false;
+    }
+}
+
+void NPCSimulation::stop()
+{
+    finish();
+    stopThreads();
+}
+
+void NPCSimulation::setThreadCount(int threadCount)
+{
+    finish();
+    stopThreads();
+    startThreads(threadCount);
+}
+
+int NPCSimulation::getThreadCount() const
+{
+    return static_cast<int>(m_threads.size());
+}
+
+void NPCSimulation::setCores(std::vector<int> cores)
+{
+    int threadCount = getThreadCount();
+    finish();
+    stopThreads();
+    m_cores = std::move(cores);
+    startThreads(threadCount);
+}
+
+void NPCSimulation::setSearchesPerTick(int searches)
+{
+    m_searchesPerTick = searches > 0 ? searches : PathfindingService::defaultBudget;
+}
+
+int NPCSimulation::getSearchesPerTick() const
+{
+    return m_searchesPerTick;
+}
+
+void NPCSimulation::setLodScale(float scale)
+{
+    m_lodScale = scale;
+}
+
+float NPCSimulation::getLodScale() const
+{
+    return m_lodScale;
+}
+
+/**
+ * @brief NPCSimulation::levelOf
+ *  A sleeping NPC wakes closer than an awake one falls asleep, so one at
+ *  the edge does not toggle every batch.
+ * @param npc
+ * @param playerPosition
+ * @param current
+ * @return
+ */
+NPCSimulation::SimulationLevel NPCSimulation::levelOf(const NPC &npc, glm::vec3 playerPosition,
+                                                      SimulationLevel current) const
+{
+    glm::vec3 position = npc.mcr_position;
+    float distance = glm::length(glm::vec2(position.x - playerPosition.x, position.z - playerPosition.z));
+    float sleepAt = (current == SimulationLevel::asleep ? wakeRadius : sleepRadius) * m_batchLodScale;
+    if (distance > sleepAt
+            || !mcr_terrain->hasChunkAt(static_cast<int>(glm::floor(position.x)),
+                                        static_cast<int>(glm::floor(position.z)))) {
+        return SimulationLevel::asleep;
+    }
+    return distance > fullRadius * m_batchLodScale ? SimulationLevel::reduced : SimulationLevel::full;
+}
+
+/**
+ * @brief NPCSimulation::workerLoop
+ *  Every thread joins every batch, if only to find no NPC left, so the
+ *  next batch cannot start while one is still on the last. A thread
+ *  takes npcsPerRun NPCs at a time and steps them together, their
+ *  physics in one NPCKinematics per step. The phases are timed per run
+ *  and step rather than per NPC, so the clock stays out of the loops.
+ */
+void NPCSimulation::workerLoop()
+{
+    // none: every core, whatever the main thread is pinned to
+    pinCurrentThread(m_cores);
+
+    m_lock.lock();
+    // a restarted thread waits for the next batch
+    uint64_t seen = m_batch;
+    // the physics of the NPCs stepping, and which they are; kept over
+    // batches for the room
+    NPCKinematics kinematics;
+    std::vector<size_t> stepping;
+    std::vector<float> deltas;
+    QElapsedTimer clock;
+    clock.start();
+    while (true) {
+        while (!m_stopping && m_batch == seen) {
+            m_batchStarted.wait(&m_lock);
+        }
+        if (m_stopping) {
+            break;
+        }
+        seen = m_batch;
+        int steps = m_batchSteps;
+        glm::vec3 playerPosition = m_batchPlayerPosition;
+        const FlowField *flowField = &m_flowFields[m_publishedFlowField];
+        m_lock.unlock();
+        NPCSimulationTimes times = {0, 0, 0};
+
+        // a zone per thread and batch, like the times
+        ProfileZone stepZone("NPC steps");
+        for (size_t first = m_nextNPC.fetch_add(npcsPerRun); first < m_npcs.size();
+             first = m_nextNPC.fetch_add(npcsPerRun)) {
+            size_t last = std::min(first + npcsPerRun, m_npcs.size());
+            for (size_t i = first; i < last; i++) {
+                NPC *npc = m_npcs[i];
+                NPCLevel &level = m_levels[i];
+                level.level = levelOf(*npc, playerPosition, level.level);
+                npc->setPlayerPosition(playerPosition);
+                npc->setFlowField(flowField);
+                npc->setLimbsAnimated(level.level == SimulationLevel::full);
+                m_stepPoses[i].previous = npc->getPose();
+                if (level.level == SimulationLevel::asleep) {
+                    // no time passes for a sleeper
+                    level.steps = 0;
+                }
+            }
+            for (int s = 0; s < steps; s++) {
+                qint64 started = clock.nsecsElapsed();
+                kinematics.clear();
+                stepping.clear();
+                deltas.clear();
+                for (size_t i = first; i < last; i++) {
+                    NPC *npc = m_npcs[i];
+                    NPCLevel &level = m_levels[i];
+                    if (level.level == SimulationLevel::asleep) {
+                        continue;
+                    }
+                    level.steps++;
+                    // a falling NPC ticks every step, or it could fall
+                    // through the ground between two
+                    if (level.level == SimulationLevel::reduced && level.steps < reducedStride && npc->isOnGround()) {
+                        continue;
+                    }
+                    float dT = level.steps * stepSeconds;
+                    level.steps = 0;
+                    m_stepPoses[i].previous = npc->getPose();
+                    npc->think(dT);
+                    stepping.push_back(i);
+                    deltas.push_back(dT);
+                }
+                qint64 thought = clock.nsecsElapsed();
+                for (size_t k = 0; k < stepping.size(); k++) {
+                    m_npcs[stepping[k]]->beginStep(kinematics, deltas[k]);
+                }
+                kinematics.integrate();
+                for (size_t k = 0; k < stepping.size(); k++) {
+                    m_npcs[stepping[k]]->endStep(kinematics, k);
+                }
+                qint64 moved = clock.nsecsElapsed();
+                for (size_t k = 0; k < stepping.size(); k++) {
+                    m_npcs[stepping[k]]->react(deltas[k]);
+                }
+                times.behaviour += (thought - started) + (clock.nsecsElapsed() - moved);
+                times.physics += moved - thought;
+            }
+            for (size_t i = first; i < last; i++) {
+                m_stepPoses[i].current = m_npcs[i]->getPose();
+            }
+        }
+        stepZone.end();
+        // the field the next batch's chasers read
+        ProfileZone searchZone("NPC searches");
+        qint64 searching = clock.nsecsElapsed();
+        bool refreshed = false;
+        if (m_flowFieldDue.exchange(false)) {
+            m_flowFields[1 - m_publishedFlowField].compute(*mcr_terrain, playerPosition);
+            refreshed = true;
+        }
+        // the searches the steps asked for, answered by the next batch
+        m_pathfinding.runSearches();
+        times.pathfind += clock.nsecsElapsed() - searching;
+        searchZone.end();
+
+        m_lock.lock();
+        m_flowFieldRefreshed = m_flowFieldRefreshed || refreshed;
+        m_times.pathfind += times.pathfind;
+        m_times.behaviour += times.behaviour;
+        m_times.physics += times.physics;
+        if (--m_busyThreads == 0) {
+            m_batchFinished.wakeAll();
+        }
+    }
+    m_lock.unlock();
+}
+
+NPCPose NPCSimulation::getDrawPose(size_t i) const
+{
+    const StepPoses &poses = m_publishedPoses[i];
+    return NPCPose::interpolate(poses.previous, poses.current, m_publishedAlpha);
+}
+
+size_t NPCSimulation::getNPCCount() const
+{
+    return m_npcs.size();
+}
+
+NPCSimulationTimes NPCSimulation::takeTimes()
+{
+    m_lock.lock();
+    NPCSimulationTimes times = m_times;
+    m_times = {0, 0, 0};
+    m_lock.unlock();
+    return times;
+}
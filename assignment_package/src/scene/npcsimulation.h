@@ -0,0 +1,187 @@
+#pragma once
+
+#include "npc.h"
+#include "flowfield.h"
+#include "pathfindingservice.h"
+#include "smartpointerhelp.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+// The thread time the batches spent per phase of the NPCs' steps, in ns,
+// summed over the threads (see NPCSimulation::takeTimes)
+struct NPCSimulationTimes
+{
+    // the path searches and the flow field refreshes
+    qint64 pathfind;
+    // NPC::think and NPC::react
+    qint64 behaviour;
+    // NPC::beginStep, NPCKinematics::integrate and NPC::endStep
+    qint64 physics;
+};
+
+/**
+ * @brief The NPCSimulation class
+ *  Ticks the NPCs at a fixed step on threads of its own, so pathfinding
+ *  and physics stay off the render thread. MyGL::tick starts a batch of
+ *  the steps its frame time covers once its terrain work is done, and
+ *  waits for it at the start of the next tick, before the terrain may
+ *  add or drop chunks; in between the NPCs read the terrain while the
+ *  main thread only renders and edits blocks (see Chunk).
+ *  Each NPC is stepped by one thread through the whole batch, the NPCs
+ *  spread over the threads in runs whose physics is integrated together
+ *  (see NPCKinematics); an NPC reads the others only as they last
+ *  placed themselves in the terrain's EntityGrid. The renderer draws
+ *  the poses of the last finished batch, interpolated between its last
+ *  two steps by the time left over, never the NPCs themselves.
+ *  The NPCs' path searches run on the same threads after the steps, a
+ *  few per batch (see PathfindingService). The NPCs chasing the player
+ *  share a FlowField toward it instead: one thread refreshes a second
+ *  field after its steps whenever the player reaches another block, and
+ *  the next batch reads it.
+ *  The NPCs far from the player tick at half the rate and do not swing
+ *  their limbs; the ones farther still, or in a chunk not loaded, sleep
+ *  without ticking until the player comes near again.
+ *  All public functions are main thread only.
+ */
+class NPCSimulation
+{
+public:
+    static constexpr float stepSeconds = 1.f / 60.f;
+    // the steps a tick may run at most; a longer frame slows the NPCs down
+    static const int maxStepsPerTick = 5;
+    // the batches a flow field serves at most, so it sees block edits
+    static const int flowFieldBatches = 30;
+    // farther than this horizontally, an NPC ticks every reducedStride
+    // steps, without limb animation
+    static constexpr float fullRadius = 48.f;
+    static const int reducedStride = 2;
+    // farther than sleepRadius, or in a chunk not loaded, an NPC sleeps
+    // until it is within wakeRadius in a loaded chunk
+    static constexpr float sleepRadius = 128.f;
+    static constexpr float wakeRadius = 112.f;
+    // the NPCs a thread takes at a time and integrates together
+    static constexpr size_t npcsPerRun = 32;
+
+private:
+    enum class SimulationLevel { full, reduced, asleep };
+
+    struct NPCLevel
+    {
+        SimulationLevel level;
+        // the steps since the NPC last ticked
+        int steps;
+    };
+
+    // the poses before and after the last step of a batch
+    struct StepPoses
+    {
+        NPCPose previous;
+        NPCPose current;
+    };
+
+    std::vector<NPC*> m_npcs;
+    // the NPCs' searches, run by the threads once the NPCs are stepped
+    PathfindingService m_pathfinding;
+    // written by the thread stepping each NPC while a batch runs
+    std::vector<StepPoses> m_stepPoses;
+    // the last finished batch's, which the renderer draws
+    std::vector<StepPoses> m_publishedPoses;
+    // written by the thread stepping each NPC, like m_stepPoses
+    std::vector<NPCLevel> m_levels;
+    // simulated time not yet stepped, in seconds
+    float m_accumulator;
+    // how far past the published step the renderer is, in steps
+    float m_publishedAlpha;
+    float m_pendingAlpha;
+    // the A* searches a tick may run, so many NPCs replanning at once
+    // spread over several ticks
+    int m_searchesPerTick;
+    // what fullRadius, sleepRadius and wakeRadius are scaled by: as set,
+    // and for the running batch
+    float m_lodScale;
+    float m_batchLodScale;
+
+    const Terrain *mcr_terrain;
+    // the NPCs without goals of their own, which chase the player
+    int m_chasers;
+    // the field the NPCs read, and the other one, which a thread may
+    // refresh while a batch runs
+    FlowField m_flowFields[2];
+    int m_publishedFlowField;
+    // the player's block and the batch of the last refresh
+    glm::ivec3 m_flowFieldBlock;
+    uint64_t m_flowFieldBatch;
+    // a thread is yet to refresh the field this batch / one has
+    std::atomic<bool> m_flowFieldDue;
+    bool m_flowFieldRefreshed;
+
+    QMutex m_lock;
+    QWaitCondition m_batchStarted;
+    QWaitCondition m_batchFinished;
+    // bumped by each batch
+    uint64_t m_batch;
+    int m_batchSteps;
+    glm::vec3 m_batchPlayerPosition;
+    // the first NPC of the next run a thread takes
+    std::atomic<size_t> m_nextNPC;
+    // threads that have not finished the running batch
+    int m_busyThreads;
+    // added by each thread at the end of its batch
+    NPCSimulationTimes m_times;
+    bool m_batchRunning;
+    bool m_stopping;
+
+    std::vector<uPtr<QThread>> m_threads;
+    // the cores the threads run on; none: any
+    std::vector<int> m_cores;
+
+    SimulationLevel levelOf(const NPC &npc, glm::vec3 playerPosition, SimulationLevel current) const;
+    void workerLoop();
+    void publish();
+    void startThreads(int threadCount);
+    void stopThreads();
+
+public:
+    // threadCount <= 0: two threads
+    explicit NPCSimulation(int threadCount = 0);
+    ~NPCSimulation();
+
+    NPCSimulation(const NPCSimulation&) = delete;
+    NPCSimulation &operator=(const NPCSimulation&) = delete;
+
+    // the NPCs to tick and their terrain, outliving the simulation; the
+    // running batch is finished first. NPCs it had before may be dropped
+    // once this returns, after their setPathfindingService(nullptr)
+    void setNPCs(const std::vector<uPtr<NPC>> &npcs, const Terrain &terrain);
+
+    // start ticking the NPCs by dT seconds' worth of steps
+    void begin(float dT, glm::vec3 playerPosition);
+    // wait for the batch begin() started and publish its poses
+    void finish();
+    // finish the running batch and end the threads
+    void stop();
+
+    // Finish the running batch and restart the threads: as many, or
+    // pinned to the cores (none: any); threadCount <= 0: two
+    void setThreadCount(int threadCount);
+    int getThreadCount() const;
+    void setCores(std::vector<int> cores);
+    // the path searches per tick; searches <= 0: PathfindingService's default
+    void setSearchesPerTick(int searches);
+    int getSearchesPerTick() const;
+    // Scale the radii past which the NPCs tick at the reduced rate and
+    // sleep, from the next batch on (see QualityController)
+    void setLodScale(float scale);
+    float getLodScale() const;
+
+    // the pose to draw NPC i (of setNPCs) at
+    NPCPose getDrawPose(size_t i) const;
+    size_t getNPCCount() const;
+    // the phase times since the last call, after finish()
+    NPCSimulationTimes takeTimes();
+};
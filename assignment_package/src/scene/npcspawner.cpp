@@ -0,0 +1,288 @@
+#include "npcspawner.h"
+#include "npcs/lama.h"
+#include "npcs/sheep.h"
+#include "npcs/zombiedragon.h"
+#include "random.h"
+#include "terrain.h"
+#include <algorithm>
+
+// below the chunks' own generation and meshing
+static const int npcBuildPriority = -1;
+// sets the spawn rolls apart from the chunk's other streams
+static const uint64_t spawnSalt = 0x6e7063737061776eull;
+// where the biome masks tip to mountains and to water (see Noise::getHeight)
+static const float mountainNoise = 0.55f;
+static const float waterNoise = 0.825f;
+// how far from its spawn an animal's goals are, per axis
+static const int goalReach = 16;
+
+NPCSpawner::NPCSpawner(OpenGLContext *context, Terrain &terrain, Player &player)
+    : mp_context(context), mcr_terrain(&terrain), mcr_player(&player),
+      m_chunks(), m_populated(), m_spawned(), m_built(), m_building(0), m_accumulator(scanSeconds)
+{}
+
+int64_t NPCSpawner::chunkKeyAt(glm::vec3 pos)
+{
+    int x = static_cast<int>(glm::floor(pos.x));
+    int z = static_cast<int>(glm::floor(pos.z));
+    return toKey(x & ~15, z & ~15);
+}
+
+void NPCSpawner::addRecord(NPCRecord record)
+{
+    int64_t key = chunkKeyAt(record.position);
+    m_chunks[key].records.push_back(std::move(record));
+    m_populated.erase(key);
+}
+
+/**
+ * @brief NPCSpawner::create
+ *  The NPCs of a kind are made as MyGL::setupNPCs makes them.
+ */
+uPtr<NPC> NPCSpawner::create(const NPCRecord &record)
+{
+    switch (record.kind) {
+    case NPCKind::lama:
+        if (record.goals.empty()) {
+            return mkU<Lama>(mp_context, record.position, *mcr_terrain, *mcr_player, record.texture);
+        }
+        return mkU<Lama>(mp_context, record.position, *mcr_terrain, *mcr_player, record.texture,
+                         record.goals, glm::vec3(3.f, 0.f, 3.f), 2.f, 1.f, 7);
+    case NPCKind::zombieDragon:
+        if (record.goals.empty()) {
+            return mkU<ZombieDragon>(mp_context, record.position, *mcr_terrain, *mcr_player, record.texture);
+        }
+        return mkU<ZombieDragon>(mp_context, record.position, *mcr_terrain, *mcr_player, record.texture,
+                                 record.goals.front());
+    case NPCKind::sheep:
+    default:
+        if (record.goals.empty()) {
+            return mkU<Sheep>(mp_context, record.position, *mcr_terrain, *mcr_player, record.texture);
+        }
+        return mkU<Sheep>(mp_context, record.position, *mcr_terrain, *mcr_player, record.texture,
+                          record.goals, glm::vec3(1.f, 0.f, 1.f), 2.f, 2.f, 5);
+    }
+}
+
+/**
+ * @brief NPCSpawner::roll
+ *  The roll is on the world seed and the chunk alone, so a world's
+ *  chunks roll the same NPCs every session. The group stands at one
+ *  column of the chunk, on its top block as the chunk holds it; the
+ *  goals around it are on the height map, as their chunks may not be
+ *  loaded.
+ */
+void NPCSpawner::roll(ChunkNPCs &chunk, int xCorner, int zCorner)
+{
+    chunk.rolled = true;
+    Random rng(mcr_terrain->getWorldSeed() ^ spawnSalt, xCorner, zCorner);
+    if (rng.nextUInt() % chunksPerGroup != 0) {
+        return;
+    }
+    int x = xCorner + 2 + static_cast<int>(rng.nextUInt() % 12);
+    int z = zCorner + 2 + static_cast<int>(rng.nextUInt() % 12);
+    int top = mcr_terrain->getColumnTop(x, z);
+    if (top <= 0) {
+        return;
+    }
+    BlockType ground = mcr_terrain->getBlockAt(x, top - 1, z);
+    glm::vec2 biome = mcr_terrain->getBiomeNoise(x, z);
+    glm::vec3 spawn(x + 0.5f, static_cast<float>(top) + 1.f, z + 0.5f);
+
+    if (Block::isLiquid(ground)) {
+        if (biome[1] >= waterNoise && rng.nextUInt() % 4 == 0) {
+            const NPCTexture dragons[] = {ZDRAGON1, ZDRAGON2, ZDRAGON3, ZDRAGON4};
+            spawn.y += 24.f;
+            chunk.records.push_back(NPCRecord{NPCKind::zombieDragon, dragons[rng.nextUInt() % 4], spawn,
+                                              {spawn + glm::vec3(10.f, 0.f, -10.f)}});
+        }
+        return;
+    }
+
+    auto goalAround = [this, &rng, x, z]() {
+        int gx = x + static_cast<int>(rng.nextUInt() % (2 * goalReach + 1)) - goalReach;
+        int gz = z + static_cast<int>(rng.nextUInt() % (2 * goalReach + 1)) - goalReach;
+        return glm::vec3(gx, mcr_terrain->getSurfaceHeight(gx, gz) + 1, gz);
+    };
+    bool mountain = biome[0] >= mountainNoise;
+    int count = mountain ? 1 + static_cast<int>(rng.nextUInt() % 2) : 2 + static_cast<int>(rng.nextUInt() % 3);
+    for (int i = 0; i < count; i++) {
+        NPCRecord record{mountain ? NPCKind::lama : NPCKind::sheep, SHEEP,
+                         spawn + glm::vec3(1.5f * i, 0.f, 0.f), {}};
+        if (mountain) {
+            const NPCTexture lamas[] = {GLAMA, WLAMA, BLAMA};
+            record.texture = lamas[rng.nextUInt() % 3];
+        } else {
+            record.texture = rng.nextUInt() % 4 == 0 ? BEAR : SHEEP;
+        }
+        for (int goal = mountain ? 2 : 3; goal > 0; goal--) {
+            record.goals.push_back(goalAround());
+        }
+        chunk.records.push_back(std::move(record));
+    }
+}
+
+/**
+ * @brief NPCSpawner::populate
+ *  The NPCs are constructed here and built on the terrain's threads.
+ */
+bool NPCSpawner::populate(ChunkNPCs &chunk)
+{
+    while (!chunk.records.empty()) {
+        if (static_cast<int>(m_spawned.size()) + m_building >= maxNPCs) {
+            return false;
+        }
+        NPCRecord record = std::move(chunk.records.back());
+        chunk.records.pop_back();
+        uPtr<NPC> npc = create(record);
+        mcr_terrain->getJobSystem().submit<NPCBuildWorker>(TerrainJobQueue::generation, npcBuildPriority,
+                                                           std::move(npc), std::move(record), &m_built);
+        m_building++;
+    }
+    return true;
+}
+
+/**
+ * @brief NPCSpawner::collectBuilt
+ *  One whose chunk was unloaded while it was built goes back to its
+ *  records.
+ */
+bool NPCSpawner::collectBuilt(std::vector<uPtr<NPC>> &npcs)
+{
+    std::vector<BuiltNPC> built;
+    m_built.takeAll(built);
+    bool added = false;
+    for (BuiltNPC &result : built) {
+        m_building--;
+        glm::vec3 pos = result.record.position;
+        if (!mcr_terrain->hasChunkAt(static_cast<int>(glm::floor(pos.x)), static_cast<int>(glm::floor(pos.z)))) {
+            m_chunks[chunkKeyAt(pos)].records.push_back(std::move(result.record));
+            continue;
+        }
+        // the shared meshes of its parts, uploaded on first use
+        result.npc->createVBOdata();
+        m_spawned[result.npc.get()] = std::move(result.record);
+        npcs.push_back(std::move(result.npc));
+        added = true;
+    }
+    return added;
+}
+
+/**
+ * @brief NPCSpawner::despawnUnloaded
+ *  An NPC is kept where it went, with the goals it was given; the ones
+ *  MyGL did not spawn through us are left alone.
+ */
+bool NPCSpawner::despawnUnloaded(std::vector<uPtr<NPC>> &npcs)
+{
+    for (auto it = m_populated.begin(); it != m_populated.end();) {
+        glm::ivec2 corner = toCoords(*it);
+        if (!mcr_terrain->hasChunkAt(corner[0], corner[1])) {
+            it = m_populated.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < npcs.size(); i++) {
+        auto spawned = m_spawned.find(npcs[i].get());
+        if (spawned != m_spawned.end()) {
+            glm::vec3 pos = npcs[i]->mcr_position;
+            int64_t key = chunkKeyAt(pos);
+            if (!mcr_terrain->hasChunkAt(static_cast<int>(glm::floor(pos.x)), static_cast<int>(glm::floor(pos.z)))) {
+                NPCRecord record = std::move(spawned->second);
+                record.position = pos;
+                m_chunks[key].records.push_back(std::move(record));
+                m_populated.erase(key);
+                m_spawned.erase(spawned);
+                // its path search holds on to it
+                npcs[i]->setPathfindingService(nullptr);
+                npcs[i].reset();
+                continue;
+            }
+        }
+        if (kept != i) {
+            npcs[kept] = std::move(npcs[i]);
+        }
+        kept++;
+    }
+    bool removed = kept != npcs.size();
+    npcs.resize(kept);
+    return removed;
+}
+
+/**
+ * @brief NPCSpawner::update
+ *  A chunk the cap left records in is tried again on the next scan.
+ */
+bool NPCSpawner::update(std::vector<uPtr<NPC>> &npcs, float dT, glm::vec3 viewer)
+{
+    bool changed = collectBuilt(npcs);
+    m_accumulator += dT;
+    if (m_accumulator < scanSeconds) {
+        return changed;
+    }
+    m_accumulator = 0.f;
+    changed = despawnUnloaded(npcs) || changed;
+
+    int viewerX = static_cast<int>(glm::floor(viewer.x / 16.f));
+    int viewerZ = static_cast<int>(glm::floor(viewer.z / 16.f));
+    for (int dz = -spawnRadius; dz <= spawnRadius; dz++) {
+        for (int dx = -spawnRadius; dx <= spawnRadius; dx++) {
+            int x = 16 * (viewerX + dx);
+            int z = 16 * (viewerZ + dz);
+            int64_t key = toKey(x, z);
+            if (m_populated.count(key) != 0) {
+                continue;
+            }
+            const Chunk *loaded = mcr_terrain->findChunk(x, z);
+            if (loaded == nullptr || loaded->getGenerationStage() != GenerationStage::decorated) {
+                continue;
+            }
+            ChunkNPCs &chunk = m_chunks[key];
+            if (!chunk.rolled) {
+                roll(chunk, x, z);
+            }
+            if (populate(chunk)) {
+                m_populated.insert(key);
+            }
+        }
+    }
+    return changed;
+}
+
+size_t NPCSpawner::getSpawnedCount() const
+{
+    return m_spawned.size();
+}
+
+int NPCSpawner::getBuildingCount() const
+{
+    return m_building;
+}
+
+size_t NPCSpawner::getRecordCount() const
+{
+    size_t count = 0;
+    for (const std::pair<const int64_t, ChunkNPCs> &chunk : m_chunks) {
+        count += chunk.second.records.size();
+    }
+    return count;
+}
+
+NPCBuildWorker::NPCBuildWorker(uPtr<NPC> npc, NPCRecord record, MPSCQueue<NPCSpawner::BuiltNPC> *built)
+    : npc(std::move(npc)), record(std::move(record)), built(built)
+{}
+
+void NPCBuildWorker::run()
+{
+    npc->initSceneGraph();
+    built->push(NPCSpawner::BuiltNPC{std::move(npc), std::move(record)});
+}
+
+bool NPCBuildWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(record.position.x, record.position.z);
+    return true;
+}
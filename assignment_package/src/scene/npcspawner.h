@@ -0,0 +1,135 @@
+#pragma once
+
+#include "npc.h"
+#include "mpscqueue.h"
+#include "smartpointerhelp.h"
+#include "terrainjobs.h"
+#include "texture.h"
+#include "glm_includes.h"
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+class Player;
+
+enum class NPCKind : unsigned char
+{
+    sheep, lama, zombieDragon
+};
+
+/**
+ * @brief The NPCRecord struct
+ *  What an NPC is made from, and what is kept of it while its chunk is
+ *  not loaded.
+ */
+struct NPCRecord
+{
+    NPCKind kind;
+    NPCTexture texture;
+    glm::vec3 position;
+    // the goals it goes between, none to chase the player; the first is
+    // the point a zombie dragon circles
+    std::vector<glm::vec3> goals;
+};
+
+/**
+ * @brief The NPCSpawner class
+ *  The NPCs of the loaded chunks only. Each chunk near the viewer is
+ *  populated once it is decorated: with the NPCs it held when it was
+ *  last unloaded, or, the first time, with the ones its biome and
+ *  surface make it roll (sheep and bears on the grassland, lamas on the
+ *  mountains, now and then a zombie dragon over water). An NPC whose
+ *  chunk is unloaded is despawned into that chunk's records, so the NPCs
+ *  cost what the loaded area holds, never more than maxNPCs.
+ *  An NPC is constructed on the main thread, its scene graph built by a
+ *  job on the terrain's threads, and its parts' meshes (shared, see
+ *  NPCMeshCache) bound once it is back; it joins the NPCs then.
+ *  Main thread only, between the NPC simulation's batches.
+ */
+class NPCSpawner
+{
+public:
+    // the NPCs spawned and being built at most
+    static const int maxNPCs = 48;
+    // the chunks around the viewer's populated as they load, per side
+    static const int spawnRadius = 6;
+    // seconds between two scans of the chunks for spawns and despawns
+    static constexpr float scanSeconds = 0.5f;
+    // one chunk in so many rolls NPCs of its own
+    static const int chunksPerGroup = 6;
+
+private:
+    struct ChunkNPCs
+    {
+        // the chunk rolled its own NPCs already
+        bool rolled;
+        // the NPCs waiting for it to be loaded
+        std::vector<NPCRecord> records;
+    };
+
+    struct BuiltNPC
+    {
+        uPtr<NPC> npc;
+        NPCRecord record;
+    };
+    friend class NPCBuildWorker;
+
+    OpenGLContext *mp_context;
+    Terrain *mcr_terrain;
+    Player *mcr_player;
+    // by toKey of the chunk's corner, the chunks ever seen or given records
+    std::unordered_map<int64_t, ChunkNPCs> m_chunks;
+    // the loaded chunks whose NPCs are spawned
+    std::unordered_set<int64_t> m_populated;
+    // the record each spawned NPC was made from
+    std::unordered_map<const NPC*, NPCRecord> m_spawned;
+    // the NPCs the jobs built, and the jobs still building
+    MPSCQueue<BuiltNPC> m_built;
+    int m_building;
+    float m_accumulator;
+
+    static int64_t chunkKeyAt(glm::vec3 pos);
+    uPtr<NPC> create(const NPCRecord &record);
+    // roll the NPCs of the chunk with this corner into its records
+    void roll(ChunkNPCs &chunk, int xCorner, int zCorner);
+    // spawn the chunk's records; false if maxNPCs left some
+    bool populate(ChunkNPCs &chunk);
+    bool collectBuilt(std::vector<uPtr<NPC>> &npcs);
+    bool despawnUnloaded(std::vector<uPtr<NPC>> &npcs);
+
+public:
+    NPCSpawner(OpenGLContext *context, Terrain &terrain, Player &player);
+
+    NPCSpawner(const NPCSpawner&) = delete;
+    NPCSpawner &operator=(const NPCSpawner&) = delete;
+
+    // an NPC for the chunk holding its position, as if it had been
+    // there when the chunk was last unloaded
+    void addRecord(NPCRecord record);
+
+    // Add the NPCs built since to npcs, then, every scanSeconds, despawn
+    // the ones of unloaded chunks and populate the loaded chunks around
+    // viewer. True if npcs changed (see NPCSimulation::setNPCs)
+    bool update(std::vector<uPtr<NPC>> &npcs, float dT, glm::vec3 viewer);
+
+    size_t getSpawnedCount() const;
+    int getBuildingCount() const;
+    // the NPCs in the records of the chunks not populated
+    size_t getRecordCount() const;
+};
+
+// Worker to build one spawned NPC's scene graph
+class NPCBuildWorker : public TerrainJob
+{
+private:
+    uPtr<NPC> npc;
+    NPCRecord record;
+    MPSCQueue<NPCSpawner::BuiltNPC> *built;
+
+public:
+    NPCBuildWorker(uPtr<NPC> npc, NPCRecord record, MPSCQueue<NPCSpawner::BuiltNPC> *built);
+
+    void run() override;
+    bool getFocus(glm::vec2 &xz) const override;
+};
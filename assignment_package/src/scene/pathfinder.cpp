@@ -1,6 +1,9 @@
 #include "pathfinder.h"
+#include "lineararena.h"
+#include <algorithm>
 
-std::unordered_set<BlockType> PathFinder::validBlocks = {GRASS, DIRT, STONE, SNOW, GWOOD, WOOD};
+// the obstacle checks look one block past the search grid
+static const int searchMargin = 1;
 
 PathFinder::PathFinder(int radius, Terrain &terrain)
     : radius(radius), mcr_terrain(&terrain)
@@ -24,6 +27,11 @@ int PathFinder::getRadius() const
     return radius;
 }
 
+const Terrain &PathFinder::getTerrain() const
+{
+    return *mcr_terrain;
+}
+
 glm::vec3 PathFinder::getBlockAt(glm::vec3 pos)
 {
     glm::vec3 blockPos = glm::vec3(glm::floor(pos.x),
@@ -39,17 +47,27 @@ glm::vec3 PathFinder::getBlockTopAt(glm::vec3 pos)
     return blockPos;
 }
 
-glm::vec3 PathFinder::getBlockRightBelow(glm::vec3 pos)
+/**
+ * @brief PathFinder::getBlockRightBelow
+ *  The highest block at or below pos, but no deeper than 127
+ * @param view : holding pos
+ * @param pos
+ * @return
+ */
+glm::vec3 PathFinder::getBlockRightBelow(const NavigationView &view, glm::vec3 pos)
 {
     glm::vec3 blockPos = getBlockAt(pos);
-    if (!mcr_terrain->hasBlockAt(blockPos))
+    int x = static_cast<int>(blockPos.x);
+    int z = static_cast<int>(blockPos.z);
+    if (!view.hasColumn(x, z))
     {
         blockPos[1] -= 1.f;
         return blockPos;
     }
-    while (blockPos[1] >= 128.f && mcr_terrain->getBlockAt(blockPos) == EMPTY)
+    if (blockPos[1] >= 128.f)
     {
-        blockPos[1] -= 1.f;
+        int below = view.highestOccupiedAtOrBelow(x, static_cast<int>(blockPos.y), z);
+        blockPos[1] = static_cast<float>(std::max(below, 127));
     }
     return blockPos;
 }
@@ -95,12 +113,12 @@ float PathFinder::getHorizontalDistance(glm::vec3 currPos, glm::vec3 targetPos)
  * @param pos
  * @return
  */
-glm::vec3 PathFinder::getStableStartPoint(glm::vec3 pos)
+glm::vec3 PathFinder::getStableStartPoint(const NavigationView &view, glm::vec3 pos)
 {
     glm::vec3 npcPos = getBlockAt(pos);
 
     // current bottom
-    glm::vec3 startPos = getBlockRightBelow(pos);
+    glm::vec3 startPos = getBlockRightBelow(view, pos);
     if (glm::abs(startPos[1] - npcPos[1]) >= 3.f)
     {
         startPos = npcPos;
@@ -124,10 +142,17 @@ glm::vec3 PathFinder::getStableStartPoint(glm::vec3 pos)
 std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
                                                    glm::vec3 targetPos)
 {
+    // before the arena's containers, so they are gone before it rewinds
+    LinearArena::Scope searchScratch(LinearArena::local());
+    // the search stays within a few chunks: resolve them once
+    NavigationView view(*mcr_terrain, startPos, radius + searchMargin);
+    // the target may be farther off
+    NavigationView targetView(*mcr_terrain, targetPos, 0);
+
     // align the startPos & targetPos with the grid (of the world)
     // the block right below the npc
-    startPos = getStableStartPoint(startPos);
-    targetPos = getBlockRightBelow(targetPos);
+    startPos = getStableStartPoint(view, startPos);
+    targetPos = getBlockRightBelow(targetView, targetPos);
 
     // std::cout << "Start from: " << glm::to_string(startPos) << std::endl;
     // std::cout << "Target to: " << glm::to_string(targetPos) << std::endl;
@@ -141,43 +166,75 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
     zMin = -radius;
     zMax = radius + 1;
 
-    // set of visited positions (for each state)
-    // currently, there are only two states (walk & jump)
-    std::unordered_set<int> walkVisited = {};
-    std::unordered_set<int> jumpVisited = {};
+    // a target off the search grid is headed for along the navigation
+    // graph's route: the farthest block of its first leg on the grid
+    glm::vec3 offset = targetPos - startPos;
+    if (glm::abs(offset.x) > radius || glm::abs(offset.z) > radius || offset.y < yMin || offset.y >= yMax)
+    {
+        std::vector<glm::ivec3> leg;
+        glm::ivec3 start = glm::ivec3(startPos);
+        if (mcr_terrain->getNavigationGraph().planFirstLeg(*mcr_terrain, start, glm::ivec3(targetPos), leg))
+        {
+            for (auto it = leg.rbegin(); it != leg.rend(); ++it)
+            {
+                glm::ivec3 d = *it - start;
+                if (glm::abs(d.x) <= radius && glm::abs(d.z) <= radius && d.y >= yMin && d.y < yMax)
+                {
+                    targetPos = glm::vec3(*it);
+                    break;
+                }
+            }
+        }
+    }
+
+    // assume only walk & each walk takes 1 block
+    // able to explore 8 directions with y (+-1)
+    // TODO: so, basically, 3 x 3 cube
+    int sideLen = 1 + 2 * radius;
 
-    // heap (costSoFar, pos)
-    std::priority_queue<Path, std::vector<Path>, CompareStep> pathsToExplore;
-    Path initialPath = Path({NPCAction(startPos, REST)}, 0.f, getHorizontalDistance(startPos, targetPos), 0, 0, 0);
-    pathsToExplore.push(initialPath);
+    // visited positions (for each state), by the id below
+    // currently, there are only two states (walk & jump)
+    // note: the id multiplies where it should combine, so some positions
+    // share one; the paths NPCs walk depend on it
+    size_t visitedSize = 25 * static_cast<size_t>(sideLen) * sideLen;
+    // all the search's scratch is in the thread's arena, given back as it ends
+    ArenaVector<bool> walkVisited(visitedSize, false);
+    ArenaVector<bool> jumpVisited(visitedSize, false);
+
+    // every reached node; the heaps refer to them by index
+    ArenaVector<PathNode> nodes;
+    nodes.reserve(256);
+    nodes.push_back(PathNode{startPos, REST, -1, 0, 0, 0, 0});
+
+    // heap (costSoFar, node)
+    std::priority_queue<PathEntry, ArenaVector<PathEntry>, CompareStep> pathsToExplore;
+    pathsToExplore.push(PathEntry{getHorizontalDistance(startPos, targetPos), 0});
 
     bool foundDestination = false;
-    Path minPath = initialPath;
+    int minNode = 0;
 
     // keep top 10 paths for random sampling (if no destination is found)
-    std::priority_queue<Path, std::vector<Path>, CompareStepMaxHeap> minCostPathHeap;
-    int nToKeep = 10;
+    std::priority_queue<PathEntry, ArenaVector<PathEntry>, CompareStepMaxHeap> minCostPathHeap;
+    size_t nToKeep = 10;
 
-    // assume only walk & each walk takes 1 block
-    // able to explore 8 directions with y (+-1)
-    // TODO: so, basically, 3 x 3 cube
-    int sideLen = 1 + 2 * radius;
     while (!pathsToExplore.empty())
     {
         // get the top
-        Path currPath = pathsToExplore.top();
+        PathEntry currEntry = pathsToExplore.top();
         // pop the top
         pathsToExplore.pop();
+        // a copy: pushing nodes may move the pool
+        PathNode currPath = nodes[currEntry.node];
 
         // reach the goal or not
         if (currPath.dest == targetPos)
         {
-            minPath = currPath;
+            minNode = currEntry.node;
             foundDestination = true;
             break;
         }
 
-        minCostPathHeap.push(currPath);
+        minCostPathHeap.push(currEntry);
         if (minCostPathHeap.size() > nToKeep)
         {
             // this will pop out the max cost in the heap so far
@@ -212,30 +269,19 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
                     // y from [-2, 2)
                     int id = (y + 3) * 5 * ((x + radius) * sideLen + (z + radius));
 
-                    if (walkVisited.find(id) != walkVisited.end())
+                    if (walkVisited[id])
                     {
                         continue;
                     }
 
-                    walkVisited.insert(id);
+                    walkVisited[id] = true;
 
                     // explore this action
                     glm::vec3 nextDest = currPath.dest + glm::vec3(dx, dy, dz);
 
-                    glm::vec3 nextDestTop = glm::vec3(nextDest.x, nextDest.y + 1.f, nextDest.z);
-
-                    if (!mcr_terrain->hasBlockAt(nextDest))
-                    {
-                        // no block here
-                        continue;
-                    }
-
-                    if (mcr_terrain->getBlockAt(nextDestTop) != EMPTY)
-                    {
-                        continue;
-                    }
-
-                    if (validBlocks.find(mcr_terrain->getBlockAt(nextDest)) == validBlocks.end())
+                    // a block to stand on with nothing above
+                    if (!view.isWalkable(static_cast<int>(nextDest.x), static_cast<int>(nextDest.y),
+                                         static_cast<int>(nextDest.z)))
                     {
                         continue;
                     }
@@ -244,11 +290,8 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
 
                     float nextCost = getHorizontalDistance(nextDest, targetPos) + (float) nextNSteps;
 
-                    std::vector<NPCAction> nextActions = currPath.actions;
-
-                    nextActions.push_back(NPCAction(nextDest, WALK));
-                    Path nextPath = Path(nextActions, nextNSteps, nextCost, x, y, z);
-                    pathsToExplore.push(nextPath);
+                    nodes.push_back(PathNode{nextDest, WALK, currEntry.node, nextNSteps, x, y, z});
+                    pathsToExplore.push(PathEntry{nextCost, static_cast<int>(nodes.size()) - 1});
 
                 }
             }
@@ -272,15 +315,17 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
                     continue;
                 }
                 glm::vec3 neighbor = currPath.dest + glm::vec3(dx, 0, dz);
+                int nx = static_cast<int>(neighbor.x);
+                int ny = static_cast<int>(neighbor.y);
+                int nz = static_cast<int>(neighbor.z);
 
-                if (!mcr_terrain->hasBlockAt(neighbor))
+                if (!view.hasColumn(nx, nz))
                 {
                     // no such block
                     continue;
                 }
 
-                glm::vec3 neighborTop = glm::vec3(neighbor.x, neighbor.y + 1.f, neighbor.z);
-                if (mcr_terrain->getBlockAt(neighborTop) != EMPTY)
+                if (view.isOccupied(nx, ny + 1, nz))
                 {
                     hasObstacles = true;
                 }
@@ -289,8 +334,7 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
                 bool allEmpty = true;
                 for (int i = 0; i < nToCheck; i++)
                 {
-                    glm::vec3 neighborDown = glm::vec3(neighbor.x, neighbor.y - (float)i, neighbor.z);
-                    if (mcr_terrain->getBlockAt(neighborDown) != EMPTY)
+                    if (view.isOccupied(nx, ny - i, nz))
                     {
                         allEmpty = false;
                     }
@@ -322,39 +366,28 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
                         int y = currPath.currY + dy;
                         int z = currPath.currZ + dz;
 
-                        // y from [-2, 2)
-                        int id = (y + 3) * 5 * ((x + radius) * sideLen + (z + radius));
-
                         // out of search grid
                         if (x < xMin || x >= xMax || y < yMin || y >= yMax || z < zMin || z >= zMax )
                         {
                             continue;
                         }
 
-                        if (jumpVisited.find(id) != jumpVisited.end())
+                        // y from [-2, 2)
+                        int id = (y + 3) * 5 * ((x + radius) * sideLen + (z + radius));
+
+                        if (jumpVisited[id])
                         {
                             continue;
                         }
 
-                        jumpVisited.insert(id);
+                        jumpVisited[id] = true;
 
                         // explore this action
                         glm::vec3 nextDest = currPath.dest + glm::vec3(dx, dy, dz);
 
-                        if (!mcr_terrain->hasBlockAt(nextDest))
-                        {
-                            // no such block
-                            continue;
-                        }
-
-                        glm::vec3 nextDestTop = glm::vec3(nextDest.x, nextDest.y + 1.f, nextDest.z);
-
-                        if (mcr_terrain->getBlockAt(nextDestTop) != EMPTY)
-                        {
-                            continue;
-                        }
-
-                        if (validBlocks.find(mcr_terrain->getBlockAt(nextDest)) == validBlocks.end())
+                        // a block to stand on with nothing above
+                        if (!view.isWalkable(static_cast<int>(nextDest.x), static_cast<int>(nextDest.y),
+                                             static_cast<int>(nextDest.z)))
                         {
                             continue;
                         }
@@ -365,12 +398,8 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
                         // additional cost for farther jump
                         float nextCost = getHorizontalDistance(nextDest, targetPos) + (float) nextNSteps + (float)(maxD);
 
-                        std::vector<NPCAction> nextActions = currPath.actions;
-
-                        nextActions.push_back(NPCAction(nextDest, JUMP));
-
-                        Path nextPath = Path(nextActions, nextNSteps, nextCost, x, y, z);
-                        pathsToExplore.push(nextPath);
+                        nodes.push_back(PathNode{nextDest, JUMP, currEntry.node, nextNSteps, x, y, z});
+                        pathsToExplore.push(PathEntry{nextCost, static_cast<int>(nodes.size()) - 1});
 
                     }
                 }
@@ -379,36 +408,71 @@ std::queue<NPCAction> PathFinder::searchPathToward(glm::vec3 startPos,
 
     }
 
-    // if found destination => use minPath
+    // if found destination => use minNode
     // if not explore options
-    Path finalPath = minPath;
+    int finalNode = minNode;
     if (!foundDestination)
     {
-        int selectID =  rand() % minCostPathHeap.size();
-        // std::cout << "Random path : " << selectID << " out of " << minCostPathHeap.size() << std::endl;
+        // the same search picks the same, on whichever thread and in
+        // whatever order the searches run (see Random)
+        uint64_t key = 0;
+        for (float v : {startPos.x, startPos.y, startPos.z, targetPos.x, targetPos.y, targetPos.z})
+        {
+            key = Random::mix(key ^ static_cast<uint32_t>(static_cast<int>(glm::floor(v))));
+        }
+        int selectID = static_cast<int>(Random(key).nextUInt() % minCostPathHeap.size());
         while (selectID > 0)
         {
             minCostPathHeap.pop();
             selectID -= 1;
         }
-        finalPath = minCostPathHeap.top();
+        finalNode = minCostPathHeap.top().node;
 
     }
 
+    // follow the parents back, the start excluded
+    std::vector<NPCAction> actions;
+    for (int n = finalNode; nodes[n].parent >= 0; n = nodes[n].parent)
+    {
+        actions.push_back(NPCAction(getBlockTopAt(nodes[n].dest), nodes[n].lastAct));
+    }
+
     // update the actions
     std::queue<NPCAction> npcPath = std::queue<NPCAction>();
-    // std::cout << "Plan" << std::endl;
-    for (int i = 0; i < finalPath.actions.size(); i++)
+    for (auto it = actions.rbegin(); it != actions.rend(); ++it)
     {
-        if (i == 0)
-        {
-            continue;
-        }
-
-        glm::vec3 blockTopCenter = getBlockTopAt(finalPath.actions[i].dest);
-        npcPath.push(NPCAction(blockTopCenter, finalPath.actions[i].action));
-        // std::cout << "finalPath act: " << (finalPath.actions[i].action == JUMP) << std::endl;
+        npcPath.push(*it);
     }
 
     return npcPath;
 }
+
+/**
+ * @brief PathFinder::countValidPrefix
+ *  What the edits since a path was found left of it: the actions up to
+ *  the first whose end is no longer walkable. A jump whose way got
+ *  blocked but whose end still is walkable is kept; the NPC's stuck
+ *  check catches it
+ * @param path
+ * @return
+ */
+size_t PathFinder::countValidPrefix(const std::vector<NPCAction> &path)
+{
+    if (path.empty())
+    {
+        return 0;
+    }
+    // paths stay within the search radius of where they were found
+    NavigationView view(*mcr_terrain, path.front().dest, 2 * radius + searchMargin);
+    for (size_t i = 0; i < path.size(); i++)
+    {
+        glm::vec3 block = getBlockAt(path[i].dest);
+        int x = static_cast<int>(block.x);
+        int z = static_cast<int>(block.z);
+        if (view.hasColumn(x, z) && !view.isWalkable(x, static_cast<int>(block.y) - 1, z))
+        {
+            return i;
+        }
+    }
+    return path.size();
+}
@@ -1,10 +1,12 @@
 #pragma once
 #include "block.h"
 #include "terrain.h"
+#include "chunknavigation.h"
 #include <glm_includes.h>
 #include <deque>
 #include <unordered_set>
 #include <queue>
+#include <vector>
 #include <iostream>
 
 enum Action : unsigned char
@@ -26,31 +28,32 @@ struct NPCAction
 };
 
 /**
- * @brief The Path class
- *  Mainly used for A* search
+ * @brief The PathNode struct
+ *  A block an A* search reached and the action that reached it. The path
+ *  to it follows the parents back to the start, so no node copies the
+ *  path before it; the path is put together once, at the end
  */
-struct Path
+struct PathNode
 {
-    // the last action in the path indicates the endpoint of this path so far
-    std::vector<NPCAction> actions;
-
     glm::vec3 dest;
     Action lastAct;
+    // index in the search's node pool of the node before, -1 at the start
+    int parent;
 
     // the number of steps taken to get the endpoint
-    float nStepsSoFar;
-    // the overall cost of this path
-    float costSoFar;
+    int nStepsSoFar;
     // used to check the point is visited or not
     int currX, currY, currZ;
+};
 
-    Path(std::vector<NPCAction>actions, float nSteps, float totalCost, int x, int y, int z)
-        : actions(actions), nStepsSoFar(nSteps), costSoFar(totalCost), currX(x), currY(y), currZ(z)
-    {
-        dest = actions[actions.size() - 1].dest;
-        lastAct = actions[actions.size() - 1].action;
-    }
-
+/**
+ * @brief The PathEntry struct
+ *  A node in the search's heaps, with the overall cost of its path
+ */
+struct PathEntry
+{
+    float costSoFar;
+    int node;
 };
 
 /**
@@ -59,7 +62,7 @@ struct Path
  */
 struct CompareStep
 {
-    bool operator() (const Path &p1, const Path &p2)
+    bool operator() (const PathEntry &p1, const PathEntry &p2) const
     {
         return p1.costSoFar > p2.costSoFar;
     }
@@ -67,7 +70,7 @@ struct CompareStep
 
 struct CompareStepMaxHeap
 {
-    bool operator() (const Path &p1, const Path &p2)
+    bool operator() (const PathEntry &p1, const PathEntry &p2) const
     {
         return p1.costSoFar < p2.costSoFar;
     }
@@ -76,22 +79,20 @@ struct CompareStepMaxHeap
 /**
  * @brief The PathFinder class
  *  Help the npc to find a path toward a target.
- *  Basically, use A* search
+ *  Basically, use A* search, over the chunks' navigation layers
+ *  (see ChunkNavigation) rather than their blocks
  */
 class PathFinder
 {
     // radius of the grid
     int radius;
 
-    // blocks to consider
-    static std::unordered_set<BlockType> validBlocks;
-
     Terrain *mcr_terrain;
 
     glm::vec3 getBlockAt(glm::vec3 pos);
     glm::vec3 getBlockTopAt(glm::vec3 pos);
-    glm::vec3 getBlockRightBelow(glm::vec3 pos);
-    glm::vec3 getStableStartPoint(glm::vec3 pos);
+    glm::vec3 getBlockRightBelow(const NavigationView &view, glm::vec3 pos);
+    glm::vec3 getStableStartPoint(const NavigationView &view, glm::vec3 pos);
 
     // manhattan
     float estimate(glm::vec3 currPos, glm::vec3 targetPos);
@@ -110,9 +111,14 @@ public:
     std::queue<NPCAction> searchPathToward(glm::vec3 startPos,
                                           glm::vec3 targetPos);
 
+    // how many of a path's actions, from the first, still end on a block
+    // to stand on with nothing above; ends in unloaded chunks count as fine
+    size_t countValidPrefix(const std::vector<NPCAction> &path);
+
     // getters & setters
     void setRadius(int radius);
     int getRadius() const;
+    const Terrain &getTerrain() const;
 
 };
 
@@ -0,0 +1,214 @@
+#include "pathfindingservice.h"
+#include "chunk.h"
+#include <algorithm>
+
+size_t PathfindingService::SearchKeyHash::operator()(const SearchKey &key) const
+{
+    size_t h = static_cast<size_t>(key.radius);
+    for (int c : {key.start.x, key.start.y, key.start.z, key.goal.x, key.goal.y, key.goal.z}) {
+        h = h * 0x9E3779B97F4A7C15ull + static_cast<uint32_t>(c);
+    }
+    return h;
+}
+
+PathfindingService::PathfindingService()
+    : m_lock(), m_searches(), m_queue(), m_requestKeys(), m_results(),
+      m_nextRequest(1), m_budget(defaultBudget), m_cache(), m_cacheClock(0)
+{}
+
+/**
+ * @brief PathfindingService::request
+ * @param finder : the requester's, for its radius and terrain
+ * @param start
+ * @param goal
+ * @return
+ */
+PathRequestId PathfindingService::request(const PathFinder &finder, glm::vec3 start, glm::vec3 goal)
+{
+    SearchKey key = {finder.getRadius(), glm::ivec3(glm::floor(start)), glm::ivec3(glm::floor(goal))};
+
+    m_lock.lock();
+    PathRequestId id = m_nextRequest++;
+    auto it = m_searches.find(key);
+    if (it == m_searches.end()) {
+        it = m_searches.emplace(key, mkU<Search>(Search{finder, start, goal, {}})).first;
+        m_queue.push_back(key);
+    }
+    it->second->waiting.push_back(id);
+    m_requestKeys.emplace(id, key);
+    m_lock.unlock();
+    return id;
+}
+
+/**
+ * @brief PathfindingService::cancel
+ *  A queued search nobody waits on any more is skipped when its turn comes.
+ * @param id
+ */
+void PathfindingService::cancel(PathRequestId id)
+{
+    m_lock.lock();
+    auto key = m_requestKeys.find(id);
+    if (key != m_requestKeys.end()) {
+        std::vector<PathRequestId> &waiting = m_searches.at(key->second)->waiting;
+        waiting.erase(std::remove(waiting.begin(), waiting.end(), id), waiting.end());
+        m_requestKeys.erase(key);
+    } else {
+        m_results.erase(id);
+    }
+    m_lock.unlock();
+}
+
+bool PathfindingService::takeResult(PathRequestId id, std::queue<NPCAction> &actions)
+{
+    m_lock.lock();
+    auto result = m_results.find(id);
+    bool done = result != m_results.end();
+    if (done) {
+        actions = std::move(result->second);
+        m_results.erase(result);
+    }
+    m_lock.unlock();
+    return done;
+}
+
+void PathfindingService::setBudget(int searches)
+{
+    m_lock.lock();
+    m_budget = std::max(0, searches);
+    m_lock.unlock();
+}
+
+bool PathfindingService::isCurrent(const Terrain &terrain, const CachedPath &path)
+{
+    for (const std::pair<glm::ivec2, uint64_t> &chunkStamp : path.chunkStamps) {
+        const Chunk *chunk = terrain.findChunk(chunkStamp.first.x, chunkStamp.first.y);
+        if (chunk == nullptr || !chunk->getNavigation().isBuilt()
+                || chunk->getNavigation().getStamp() != chunkStamp.second) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief PathfindingService::stampChunks
+ *  A chunk changed while the search ran may have been read either way, so
+ *  its path is not kept.
+ */
+bool PathfindingService::stampChunks(const Terrain &terrain, glm::vec3 start, const std::queue<NPCAction> &actions,
+                                     uint64_t stampsBefore, CachedPath &path)
+{
+    path.chunkStamps.clear();
+    auto stamp = [&](glm::vec3 pos) {
+        glm::ivec2 corner(16 * glm::ivec2(glm::floor(glm::vec2(pos.x, pos.z) / 16.f)));
+        for (const std::pair<glm::ivec2, uint64_t> &chunkStamp : path.chunkStamps) {
+            if (chunkStamp.first == corner) {
+                return true;
+            }
+        }
+        const Chunk *chunk = terrain.findChunk(corner.x, corner.y);
+        if (chunk == nullptr || !chunk->getNavigation().isBuilt()
+                || chunk->getNavigation().getStamp() > stampsBefore) {
+            return false;
+        }
+        path.chunkStamps.emplace_back(corner, chunk->getNavigation().getStamp());
+        return true;
+    };
+    if (!stamp(start)) {
+        return false;
+    }
+    // a copy to walk: a queue has no iterators
+    std::queue<NPCAction> rest = actions;
+    for (; !rest.empty(); rest.pop()) {
+        if (!stamp(rest.front().dest)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void PathfindingService::cachePath(const SearchKey &key, CachedPath path)
+{
+    path.lastUsed = ++m_cacheClock;
+    m_cache[key] = std::move(path);
+    if (m_cache.size() > static_cast<size_t>(maxCachedPaths)) {
+        auto oldest = m_cache.begin();
+        for (auto it = m_cache.begin(); it != m_cache.end(); ++it) {
+            if (it->second.lastUsed < oldest->second.lastUsed) {
+                oldest = it;
+            }
+        }
+        m_cache.erase(oldest);
+    }
+}
+
+/**
+ * @brief PathfindingService::runSearches
+ *  Requests for the same key may still join a search while it runs. A
+ *  search takes its budget before its cached path is checked, outside the
+ *  lock, and gives it back if the path is current.
+ */
+void PathfindingService::runSearches()
+{
+    m_lock.lock();
+    while (m_budget > 0 && !m_queue.empty()) {
+        SearchKey key = m_queue.front();
+        m_queue.pop_front();
+        Search *search = m_searches.at(key).get();
+        if (search->waiting.empty()) {
+            m_searches.erase(key);
+            continue;
+        }
+        m_budget--;
+        auto cached = m_cache.find(key);
+        bool hasCached = cached != m_cache.end();
+        CachedPath path;
+        if (hasCached) {
+            path = cached->second;
+        }
+        m_lock.unlock();
+
+        const Terrain &terrain = search->finder.getTerrain();
+        bool hit = hasCached && isCurrent(terrain, path);
+        bool cacheable = false;
+        std::queue<NPCAction> actions;
+        if (hit) {
+            actions = path.actions;
+        } else {
+            uint64_t stampsBefore = ChunkNavigation::getLatestStamp();
+            actions = search->finder.searchPathToward(search->start, search->goal);
+            cacheable = !actions.empty() && stampChunks(terrain, search->start, actions, stampsBefore, path);
+            if (cacheable) {
+                path.actions = actions;
+            }
+        }
+
+        m_lock.lock();
+        if (hit) {
+            m_budget++;
+            cached = m_cache.find(key);
+            if (cached != m_cache.end()) {
+                cached->second.lastUsed = ++m_cacheClock;
+            }
+        } else if (cacheable) {
+            cachePath(key, std::move(path));
+        } else if (hasCached) {
+            m_cache.erase(key);
+        }
+        for (PathRequestId id : search->waiting) {
+            m_results[id] = actions;
+            m_requestKeys.erase(id);
+        }
+        m_searches.erase(key);
+    }
+    m_lock.unlock();
+}
+
+int PathfindingService::getQueuedCount()
+{
+    m_lock.lock();
+    int count = static_cast<int>(m_queue.size());
+    m_lock.unlock();
+    return count;
+}
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "pathfinder.h"
+#include "smartpointerhelp.h"
+#include <QMutex>
+#include <cstdint>
+#include <deque>
+#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// identifies a path request; 0 is no request
+typedef uint64_t PathRequestId;
+
+/**
+ * @brief The PathfindingService class
+ *  A* searches for the NPCs, run a budgeted number per tick instead of
+ *  one each time an NPC asks. An NPC requests a path and carries on with
+ *  the one it has until the result arrives. Requests between the same
+ *  start and goal blocks with the same search radius share one search,
+ *  whether it is queued or already running.
+ *  The paths found are cached by that key too, so the NPCs patrolling
+ *  between fixed goals pay for each leg's search once, whichever of them
+ *  asks: a cached path is taken as long as no chunk it crosses changed
+ *  its navigation (see ChunkNavigation::getStamp), and costs no budget.
+ *  Searches read the terrain, so runSearches() may only run where NPC
+ *  ticks may (see NPCSimulation); every other function is safe from any
+ *  thread.
+ */
+class PathfindingService
+{
+public:
+    // the searches a tick runs unless setBudget says otherwise
+    static const int defaultBudget = 4;
+    // the paths kept, the least recently taken going past it
+    static const int maxCachedPaths = 512;
+
+private:
+    struct SearchKey
+    {
+        int radius;
+        glm::ivec3 start;
+        glm::ivec3 goal;
+
+        bool operator==(const SearchKey &other) const {
+            return radius == other.radius && start == other.start && goal == other.goal;
+        }
+    };
+    struct SearchKeyHash
+    {
+        size_t operator()(const SearchKey &key) const;
+    };
+
+    struct Search
+    {
+        // a copy: the requester may be gone by the time it runs
+        PathFinder finder;
+        glm::vec3 start;
+        glm::vec3 goal;
+        // requests still interested in the result
+        std::vector<PathRequestId> waiting;
+    };
+
+    // A path found, and the navigation stamp of each chunk it crosses, by
+    // the chunks' corners, as of before its search
+    struct CachedPath
+    {
+        std::queue<NPCAction> actions;
+        std::vector<std::pair<glm::ivec2, uint64_t>> chunkStamps;
+        // m_cacheClock when it was last found or taken
+        uint64_t lastUsed;
+    };
+
+    // Whether the path's chunks are all there with the stamps it has
+    static bool isCurrent(const Terrain &terrain, const CachedPath &path);
+    // The stamps of the chunks actions cross, from start; false if one
+    // is missing or changed after the stamp stampsBefore
+    static bool stampChunks(const Terrain &terrain, glm::vec3 start, const std::queue<NPCAction> &actions,
+                            uint64_t stampsBefore, CachedPath &path);
+    // keep path for key, dropping the least recently used past the limit;
+    // with m_lock held
+    void cachePath(const SearchKey &key, CachedPath path);
+
+    QMutex m_lock;
+    // queued and running searches
+    std::unordered_map<SearchKey, uPtr<Search>, SearchKeyHash> m_searches;
+    // the queued ones, oldest first
+    std::deque<SearchKey> m_queue;
+    // the search each unanswered request waits on
+    std::unordered_map<PathRequestId, SearchKey> m_requestKeys;
+    std::unordered_map<PathRequestId, std::queue<NPCAction>> m_results;
+    PathRequestId m_nextRequest;
+    // searches runSearches may still start this tick
+    int m_budget;
+    std::unordered_map<SearchKey, CachedPath, SearchKeyHash> m_cache;
+    uint64_t m_cacheClock;
+
+public:
+    PathfindingService();
+
+    PathfindingService(const PathfindingService&) = delete;
+    PathfindingService &operator=(const PathfindingService&) = delete;
+
+    // queue a search of finder from start toward goal
+    PathRequestId request(const PathFinder &finder, glm::vec3 start, glm::vec3 goal);
+    // drop a request and its result, if any
+    void cancel(PathRequestId id);
+    // move the finished request's path into actions; false if it is not done
+    bool takeResult(PathRequestId id, std::queue<NPCAction> &actions);
+
+    // allow this many more searches until the next call
+    void setBudget(int searches);
+    // run queued searches while the budget lasts; any number of threads
+    void runSearches();
+
+    // searches queued and not started
+    int getQueuedCount();
+};
@@ -1,5 +1,9 @@
 #include "player.h"
+#include "blockcursor.h"
+#include "voxelsweep.h"
+#include "blockicons.h"
 #include <QString>
+#include <cstdio>
 #include <iostream>
 
 Player::Player(glm::vec3 pos, Terrain &terrain)
@@ -7,26 +11,31 @@ Player::Player(glm::vec3 pos, Terrain &terrain)
       m_camera(pos + glm::vec3(0, 1.5f, 0)), m_tpv_camera(pos + glm::vec3(0, 1.5f, 0), -8.f, 30.f, 190.f),
       mcr_terrain(terrain),
       flight_velocity_max(15.f), non_flight_velocity_max(10.f), m_velocity_val(flight_velocity_max),
-      m_acceleration_val(40.f), cameraBlockDist(3.f), flightMode(true), containerMode(false),
+      m_acceleration_val(40.f), cameraBlockDist(3.f), flightMode(true), m_environment(), m_groundBlock(0), containerMode(false),
       destroyBufferTime(0.f), creationBufferTime(0.f), minWaitTime(0.5f),
       selectedBlockOnHandPtr(0), hp(100.f), hp_max(100.f), mcr_camera(m_camera), mcr_tpv_camera(m_tpv_camera), hp_top_left_pos(glm::vec2(-0.95, 0.95)),
-      tpv(false)
+      tpv(false), m_renderOffset(0.f), m_brokenBlocks()
 {}
 
 Player::~Player()
-{}
+{
+    mcr_terrain.getEntityGrid().remove(this);
+}
 
 void Player::tick(float dT, InputBundle &input) {
     destroyBufferTime += dT;
     creationBufferTime += dT;
     destroyBlock(input, mcr_terrain);
+    collectExplosionDrops(mcr_terrain);
     placeBlock(input, mcr_terrain);
     widgetInteraction();
-    stateOperation(input);
+    stateOperation();
     selectBlockOnHand(input);
     drawInventoryItem();
     processInputs(input);
     computePhysics(dT, mcr_terrain, input);
+    // one block wide and two tall, from the feet up
+    mcr_terrain.getEntityGrid().place(this, m_position + glm::vec3(0.f, 1.f, 0.f), glm::vec3(0.5f, 1.f, 0.5f));
 }
 
 void Player::processInputs(InputBundle &inputs) {
@@ -105,30 +114,34 @@ void Player::computePhysics(float dT, const Terrain &terrain, InputBundle &input
         break;
     }
 
-    if (!checkXZCollision(0, terrain)) {
-        m_velocity[0] = 0.f;
-    }
-    if (!checkXZCollision(2, terrain)) {
-        m_velocity[2] = 0.f;
-    }
-    if (!checkYCollision(terrain)) {
-        if (m_velocity[1] <= -9.5) {
-            hpChange(-30);
-        }
-        m_velocity[1] = 0.f;
+    // the flight mode passes through blocks
+    glm::vec3 boxMin = m_position - glm::vec3(boxHalfWidth, 0.f, boxHalfWidth);
+    glm::vec3 boxMax = m_position + glm::vec3(boxHalfWidth, boxHeight, boxHalfWidth);
+    VoxelSweep sweep(terrain);
+    if (!flightMode) {
+        // every block the player may touch this tick, read once: jumping
+        // and the liquids change the velocity by far less than a block
+        displacement = m_velocity * dampingFactor * dT;
+        sweep.gather(boxMin, boxMax, displacement + glm::vec3(1.f));
+        applyContact(sweep.sweep(boxMin, boxMax, displacement));
     }
 
     if (inputs.spacePressed) {
-        implementJumping(terrain, inputs);
+        implementJumping();
     }
 
-    if (!flightMode && (isUnderLava(terrain, inputs) || isUnderWater(terrain, inputs))) {
+    // in the liquids the last tick ended in
+    if (!flightMode && (m_environment.underLava || m_environment.underWater)) {
         liquidFactor = 2.f/3.f;
     }
     m_velocity = liquidFactor * m_velocity;
     displacement = m_velocity * dampingFactor * dT;
+    if (!flightMode) {
+        displacement = sweep.sweep(boxMin, boxMax, displacement).displacement;
+    }
     moveAlongVector(displacement);
 
+    senseEnvironment(sweep);
 }
 
 void Player::setCameraWidthHeight(unsigned int w, unsigned int h) {
@@ -136,6 +149,11 @@ void Player::setCameraWidthHeight(unsigned int w, unsigned int h) {
     m_tpv_camera.setWidthHeight(w, h);
 }
 
+void Player::setCameraJitter(glm::vec2 offset) {
+    m_camera.setJitter(offset);
+    m_tpv_camera.setJitter(offset);
+}
+
 void Player::moveAlongVector(glm::vec3 dir) {
     Entity::moveAlongVector(dir);
     m_camera.moveAlongVector(dir);
@@ -198,21 +216,27 @@ void Player::rotateOnUpGlobal(float degrees) {
     m_tpv_camera.update(m_camera.mcr_position);
 }
 
+// to the hundredth, so the info window sees no change while the player
+// stands still
+static QString vec3AsQString(const glm::vec3 &v) {
+    return QString("( %1, %2, %3 )").arg(v.x, 0, 'f', 2).arg(v.y, 0, 'f', 2).arg(v.z, 0, 'f', 2);
+}
+
 QString Player::posAsQString() const {
-    std::string str("( " + std::to_string(m_position.x) + ", " + std::to_string(m_position.y) + ", " + std::to_string(m_position.z) + ")");
-    return QString::fromStdString(str);
+    return vec3AsQString(m_position);
 }
 QString Player::velAsQString() const {
-    std::string str("( " + std::to_string(m_velocity.x) + ", " + std::to_string(m_velocity.y) + ", " + std::to_string(m_velocity.z) + ")");
-    return QString::fromStdString(str);
+    return vec3AsQString(m_velocity);
 }
 QString Player::accAsQString() const {
-    std::string str("( " + std::to_string(m_acceleration.x) + ", " + std::to_string(m_acceleration.y) + ", " + std::to_string(m_acceleration.z) + ")");
-    return QString::fromStdString(str);
+    return vec3AsQString(m_acceleration);
 }
 QString Player::lookAsQString() const {
-    std::string str("( " + std::to_string(m_forward.x) + ", " + std::to_string(m_forward.y) + ", " + std::to_string(m_forward.z) + ")");
-    return QString::fromStdString(str);
+    return vec3AsQString(m_forward);
+}
+
+glm::vec3 Player::getLook() const {
+    return m_forward;
 }
 
 /**
@@ -227,7 +251,8 @@ void Player::toggleFlightMode() {
     } else {
         flightMode = true;
         m_velocity_val = flight_velocity_max;
-        blockTouchingPlayer = EMPTY;
+        m_environment.onGround = false;
+        m_environment.ground = EMPTY;
     }
 }
 
@@ -348,131 +373,7 @@ void Player::rotateCameraView(float thetaChange, float phiChange) {
     rotateOnUpGlobal(-thetaChange * scalar);
 }
 
-/**
- * @brief Player::gridMarch
- *  Find the hit block given ray direction and position
- * @param rayOrigin : glm::vec3, coordinate of start point
- * @param rayDirection : glm::vec3, direction of the ray, and the length is the farthest length we search
- * @param terrain : Terrain, terrain storing block data
- * @param out_dist : float, distance between ray origin and colliding surface
- * @param out_blockHit : glm::ivec3, coordinate of hit block
- */
-bool Player::gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &terrain, float *out_dist, glm::ivec3 *out_blockHit) {
-    float maxLen = glm::length(rayDirection); // Farthest we search
-    glm::ivec3 currCell = glm::ivec3(glm::floor(rayOrigin));
-    rayDirection = glm::normalize(rayDirection); // Now all t values represent world dist.
-    float curr_t = 0.f;
-
-    while(curr_t < maxLen) {
-        float min_t = glm::sqrt(3.f);
-        float interfaceAxis = -1; // Track axis for which t is smallest
-        for(int i = 0; i < 3; ++i) { // Iterate over the three axes
-            if(rayDirection[i] != 0) { // Is ray parallel to axis i?
-                float offset = glm::max(0.f, glm::sign(rayDirection[i])); // See slide 5
-                // If the player is *exactly* on an interface then
-                // they'll never move if they're looking in a negative direction
-                if(currCell[i] == rayOrigin[i] && offset == 0.f) {
-                    offset = -1.f;
-                }
-                int nextIntercept = currCell[i] + offset;
-                float axis_t = (nextIntercept - rayOrigin[i]) / rayDirection[i];
-                axis_t = glm::min(axis_t, maxLen); // Clamp to max len to avoid super out of bounds errors
-                if(axis_t < min_t) {
-                    min_t = axis_t;
-                    interfaceAxis = i;
-                }
-            }
-        }
-
-        if(interfaceAxis == -1) {
-            throw std::out_of_range("interfaceAxis was -1 after the for loop in gridMarch!");
-        }
-        curr_t += min_t; // min_t is declared in slide 7 algorithm
-        rayOrigin += rayDirection * min_t;
-        glm::ivec3 offset(0);
-        // Sets it to 0 if sign is +, -1 if sign is -
-        offset[interfaceAxis] = glm::min(0.f, glm::sign(rayDirection[interfaceAxis]));
-        currCell = glm::ivec3(glm::floor(rayOrigin)) + offset;
-        // If currCell contains something other than EMPTY, return
-        // curr_t
-        BlockType cellType = terrain.getBlockAt(currCell.x, currCell.y, currCell.z);
-//        blockTouchingPlayer = cellType;
-        if(cellType != EMPTY) {
-            *out_blockHit = currCell;
-            *out_dist = glm::min(maxLen, curr_t);
-            return true;
-        }
-    }
-    *out_dist = glm::min(maxLen, curr_t);
-    return false;
-}
-
-/**
- * @brief Player::gridMarchPrevBlock
- *  Find the hit block and adjacent empty block given ray direction and position
- * @param rayOrigin : glm::vec3, coordinate of start point
- * @param rayDirection : glm::vec3, direction of the ray, and the length is the farthest length we search
- * @param terrain : Terrain, terrain storing block data
- * @param out_prevBlock : glm::ivec3, coordinate of empty block adjacent to hit block
- * @param out_blockHit : glm::ivec3, coordinate of hit block
- */
-bool Player::gridMarchPrevBlock(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &terrain, glm::ivec3 *out_prevBlock, glm::ivec3 *out_blockHit) {
-
-    float maxLen = glm::length(rayDirection); // Farthest we search
-    glm::ivec3 currCell = glm::ivec3(glm::floor(rayOrigin));
-    rayDirection = glm::normalize(rayDirection); // Now all t values represent world dist.
-    float curr_t = 0.f;
-
-    while(curr_t < maxLen) {
-        float min_t = glm::sqrt(3.f);
-        float interfaceAxis = -1; // Track axis for which t is smallest
-        for(int i = 0; i < 3; ++i) { // Iterate over the three axes
-            if(rayDirection[i] != 0) { // Is ray parallel to axis i?
-                float offset = glm::max(0.f, glm::sign(rayDirection[i])); // See slide 5
-                // If the player is *exactly* on an interface then
-                // they'll never move if they're looking in a negative direction
-                if(currCell[i] == rayOrigin[i] && offset == 0.f) {
-                    offset = -1.f;
-                }
-                int nextIntercept = currCell[i] + offset;
-                float axis_t = (nextIntercept - rayOrigin[i]) / rayDirection[i];
-                axis_t = glm::min(axis_t, maxLen); // Clamp to max len to avoid super out of bounds errors
-                if(axis_t < min_t) {
-                    min_t = axis_t;
-                    interfaceAxis = i;
-                }
-            }
-        }
-
-        if(interfaceAxis == -1) {
-            throw std::out_of_range("interfaceAxis was -1 after the for loop in gridMarch!");
-        }
-        curr_t += min_t; // min_t is declared in slide 7 algorithm
-        rayOrigin += rayDirection * min_t;
-        glm::ivec3 offset(0);
-        // Sets it to 0 if sign is +, -1 if sign is -
-        offset[interfaceAxis] = glm::min(0.f, glm::sign(rayDirection[interfaceAxis]));
-
-        glm::ivec3 prevOffset(0);
-        prevOffset[interfaceAxis] = glm::sign(rayDirection[interfaceAxis]);
-
-        currCell = glm::ivec3(glm::floor(rayOrigin)) + offset;
-        // If currCell contains something other than EMPTY, return
-        // curr_t
-        BlockType cellType = terrain.getBlockAt(currCell.x, currCell.y, currCell.z);
-//        blockTouchingPlayer = cellType;
-        if(cellType != EMPTY) {
-            *out_blockHit = currCell;
-            *out_prevBlock = currCell - prevOffset;
-            BlockType prevCellType = terrain.getBlockAt((*out_prevBlock).x, (*out_prevBlock).y, (*out_prevBlock).z);
-            return (prevCellType == EMPTY);
-        }
-    }
-    return false;
-
-}
-
-bool Player::isWalking(){
+bool Player::isWalking() const {
     if(m_velocity.x != 0 || m_velocity.z != 0)
         return true;
     else
@@ -481,100 +382,64 @@ bool Player::isWalking(){
 
 
 /**
- * @brief Player::checkXZCollision
- *  This helper is used to check if the player collides on x or z axis
- * @param idx : int, axis that check the collision (0: x axis, 2: z axis)
- * @param terrain : Terrain, terrain storing block data
+ * @brief Player::applyContact
+ *  Zero the velocity on each axis the player ran into a block on,
+ *  hurting it for landing too fast, and note where it stands.
+ * @param contact : SweepContact, of the player's box moved by this tick's velocity
  */
-bool Player::checkXZCollision(int idx, const Terrain &terrain) {
-
-    if (idx != 0 && idx != 2) {
-        return true;
-    }
-
-    if (flightMode) {
-        return true;
-    }
-
-    glm::ivec3 out_blockHit(0);
-    float out_dist = 0.f;
-
-    glm::vec3 currForward(0.f);
-    if (m_forward[idx] > 0.f) {
-        currForward[idx] = 0.5f;
-    } else if (m_forward[idx] < 0.f) {
-        currForward[idx] = -0.5f;
-    } else {
-        return false;
-    }
-
-    float horizontalDistTolerance = 0.13f; // 0.5 * 0.707 = 0.35 -> 0.5 - 0.35 = 0.15
-    std::array<glm::vec3, 3> cornerArr;
-
-    // 4 corners: 45, 135, 225, 315
-    for (int i = 0; i < 4; ++i) {
-        float currDeg = 45.f + i * 90.f;
-        float currRad = glm::radians(currDeg);
-        float fowardDir = (currDeg >= 90.f && currDeg <= 270.f) ? -1.f : 1.f; // the orientation of player and velocity is same or opposite
-        glm::vec3 forwardDeg = glm::vec3(glm::rotate(glm::mat4(), currRad, glm::vec3(0,1,0)) * glm::vec4(currForward, 0.f));
-        // each angle has three points: up, middle and down
-        glm::vec3 cameraCorner = m_camera.getCurrentPos() + forwardDeg + glm::vec3(0.f, 0.5f, 0.f);
-        glm::vec3 middleCorner(cameraCorner - glm::vec3(0.f, 1.f, 0.f));
-        glm::vec3 playerCorner(cameraCorner - glm::vec3(0.f, 2.f, 0.f));
-        cornerArr[0] = cameraCorner;
-        cornerArr[1] = middleCorner;
-        cornerArr[2] = playerCorner;
-
-        for (auto& corner: cornerArr) {
-            bool cornerHit = gridMarch(corner, fowardDir*currForward, terrain, &out_dist, &out_blockHit);
-            if (cornerHit && out_dist < horizontalDistTolerance && m_velocity[idx] * forwardDeg[idx] >= 0 && !isLiquid(terrain, &out_blockHit)) {
-                return false;
-            }
+void Player::applyContact(const SweepContact &contact) {
+    for (int i = 0; i < 3; ++i) {
+        if (contact.blocked[i] == 0) {
+            continue;
         }
+        if (i == 1 && contact.blocked[i] < 0 && m_velocity[1] <= -9.5) {
+            hpChange(-30);
+        }
+        m_velocity[i] = 0.f;
     }
 
-    return true;
-
+    m_environment.onGround = contact.blocked[1] < 0;
+    m_groundBlock = contact.blockHit[1];
 }
 
 /**
- * @brief Player::checkYCollision
- *  This helper is used to check if the player collides on y axis
- * @param terrain : Terrain, terrain storing block data
+ * @brief Player::senseEnvironment
+ *  Read the blocks m_environment holds, mostly from those the sweep
+ *  gathered for this tick. In flight mode the sweep gathered nothing,
+ *  and reads them through its cursor.
+ * @param sweep : VoxelSweep, of this tick's physics
  */
-bool Player::checkYCollision(const Terrain &terrain) {
-    if (flightMode) {
-        return true;
+void Player::senseEnvironment(VoxelSweep &sweep) {
+    // a missing chunk touches nothing
+    m_environment.ground = EMPTY;
+    if (m_environment.onGround) {
+        m_environment.ground = sweep.getBlockAt(m_groundBlock.x, m_groundBlock.y, m_groundBlock.z).value_or(EMPTY);
     }
 
-    glm::ivec3 out_blockHit_ground(0);
-    glm::ivec3 out_blockHit_ceiling(0);
-    float out_dist_neg_y = 0.f;
-    float out_dist_pos_y = 0.f;
-
-    // check if the player touches the ground
-    float negYTolerance = 0.4f; // (specifically for gravity) max velocity: 10, average dt: 0.016 > displacement: 10 * 0.016 = 0.16
-    float posYTolerance = 0.4f;
-    bool playerGroundHit = gridMarch(m_position, glm::vec3(0.f, -1.f, 0.f), terrain, &out_dist_neg_y, &out_blockHit_ground);
-    bool playerCeilingHit = gridMarch(m_camera.getCurrentPos(), glm::vec3(0.f, 1.f, 0.f), terrain, &out_dist_pos_y, &out_blockHit_ceiling);
-    blockTouchingPlayer = terrain.getBlockAt(out_blockHit_ground.x, out_blockHit_ground.y, out_blockHit_ground.z);
-    if (playerGroundHit && out_dist_neg_y < negYTolerance && m_velocity[1] <= 0 && !isLiquid(terrain, &out_blockHit_ground)) {
-        return false;
-    }
-    if (playerCeilingHit && out_dist_pos_y < posYTolerance && m_velocity[1] >= 0 && !isLiquid(terrain, &out_blockHit_ceiling)) {
-        return false;
+    // the four blocks around the head; a missing chunk holds no liquid
+    m_environment.underWater = false;
+    m_environment.underLava = false;
+    glm::vec3 topLeftVertex = this->m_position + glm::vec3(0.5f, 1.5f, 0.5f);
+    for (int x = 0; x <= 1; x++) {
+        for (int z = 0; z <= 1; z++) {
+            std::optional<BlockType> t = sweep.getBlockAt(static_cast<int>(floor(topLeftVertex.x)) + x,
+                                                          static_cast<int>(floor(topLeftVertex.y - 0.005f)),
+                                                          static_cast<int>(floor(topLeftVertex.z)) + z);
+            if (t == WATER) {
+                m_environment.underWater = true;
+            } else if (t == LAVA) {
+                m_environment.underLava = true;
+            }
+        }
     }
-
-    return true;
-
 }
 
 /**
  * @brief Player::implementJumping
  *  Assign initial velocity in +y direction for player to jump
  */
-void Player::implementJumping(const Terrain &terrain, InputBundle &inputs) {
-    if (isUnderLava(terrain, inputs) || isUnderWater(terrain, inputs)) {
+void Player::implementJumping() {
+    if (m_environment.underLava || m_environment.underWater) {
         m_velocity[1] = 5.f;
         return;
     }
@@ -586,75 +451,26 @@ void Player::implementJumping(const Terrain &terrain, InputBundle &inputs) {
     m_velocity[1] = 5.f;
 }
 
-/**
- * @brief Player::isOnGround
- * Check if player is on ground
- * @param terrain
- * @param input
- */
-bool Player::isOnGround(const Terrain &terrain, InputBundle &input) {
-    glm::vec3 bottomLeftVertex = this->m_position - glm::vec3(0.5f, 0, 0.5f);
-    for (int x = 0; x <= 1; x++) {
-        for (int z = 0; z <= 1; z++) {
-            glm::vec3 p = glm::vec3(floor(bottomLeftVertex.x) + x, floor(bottomLeftVertex.y - 0.005f),
-                          floor(bottomLeftVertex.z) + z);
-            if (terrain.getBlockAt(p) != EMPTY
-                    && terrain.getBlockAt(p) != WATER
-                    && terrain.getBlockAt(p) != LAVA) {
-                input.onGround = true;
-            } else {
-                input.onGround = false;
-            }
-        }
-    }
-    return input.onGround;
+const PlayerEnvironment &Player::getEnvironment() const {
+    return m_environment;
 }
 
-/**
- * @brief Player::isUnderWater
- * Check if Player is under water
- * @param terrain
- * @param input
- */
-bool Player::isUnderWater(const Terrain &terrain, InputBundle &input) {
-    input.underWater = false;
-    glm::vec3 topLeftVertex = this->m_position + glm::vec3(0.5f, 1.5f, 0.5f);
-    for (int x = 0; x <= 1; x++) {
-        for (int z = 0; z <= 1; z++) {
-            if(terrain.hasChunkAt(x,z)){
-                glm::vec3 p = glm::vec3(floor(topLeftVertex.x) + x, floor(topLeftVertex.y - 0.005f),
-                              floor(topLeftVertex.z) + z);
-                if (terrain.getBlockAt(p) == WATER) {
-                    input.underWater = true;
-                }
-            }
-        }
-    }
-    return input.underWater;
+void Player::takeBrokenBlocks(std::vector<BlockEdit> &blocks) {
+    blocks.clear();
+    std::swap(blocks, m_brokenBlocks);
 }
 
 /**
- * @brief Player::isUnderLava
- * Check if Player is under lava
- * @param terrain
- * @param input
+ * @brief Player::collectExplosionDrops
+ *  Store what the explosions blasted since the last call, a type at a time
+ * @param terrain : Terrain, terrain storing block data
  */
-bool Player::isUnderLava(const Terrain &terrain, InputBundle &input) {
-    input.underLava = false;
-    glm::vec3 topLeftVertex = this->m_position + glm::vec3(0.5f, 1.5f, 0.5f);
-    for (int x = 0; x <= 1; x++) {
-        for (int z = 0; z <= 1; z++) {
-            if(terrain.hasChunkAt(x,z)){
-                glm::vec3 p = glm::vec3(floor(topLeftVertex.x) + x, floor(topLeftVertex.y - 0.005f),
-                              floor(topLeftVertex.z) + z);
-                if (terrain.getBlockAt(p) == LAVA) {
-                    input.underLava = true;
-                }
-            }
-
-        }
+void Player::collectExplosionDrops(Terrain &terrain) {
+    BlockDrops drops;
+    terrain.takeExplosionDrops(drops);
+    for (const std::pair<const BlockType, int> &drop : drops) {
+        inventory.storeBlocks(drop.first, drop.second);
     }
-    return input.underLava;
 }
 
 /**
@@ -673,26 +489,31 @@ void Player::destroyBlock(InputBundle &inputs, Terrain &terrain) {
         return;
     }
 
-    glm::ivec3 out_blockHit(0);
-    float out_dist_camera = 0.f;
     glm::vec3 cameraRay(cameraBlockDist * m_camera.getForward());
+    TerrainRayHit cameraHit = terrain.raycast(m_camera.getCurrentPos(), cameraRay);
 
-    bool cameraHit = gridMarch(m_camera.getCurrentPos(), cameraRay, terrain, &out_dist_camera, &out_blockHit);
+    // no chunk to edit
+    if (!cameraHit.hit || !cameraHit.type) {
+        return;
+    }
 
-    if (!cameraHit) {
+    const glm::ivec3 &blockHit = cameraHit.block;
+    destroyBufferTime = 0.f;
+
+    // TNT is lit rather than taken; what it blasts comes back through
+    // collectExplosionDrops
+    if (*cameraHit.type == TNT) {
+        terrain.ignite(blockHit);
         return;
     }
 
     // add destroyed block to inventory
-    BlockType destroyedBlockType = terrain.getBlockAt(glm::vec3(out_blockHit));
-    destroyedBlockType = Block::getDestroyedBlockType(destroyedBlockType);
+    BlockType destroyedBlockType = Block::getDestroyedBlockType(*cameraHit.type);
     inventory.storeBlock(destroyedBlockType);
 
     // remove hit block
-    terrain.placeBlockAt(out_blockHit[0], out_blockHit[1], out_blockHit[2], EMPTY);
-
-    // reset the buffer time
-    destroyBufferTime = 0.f;
+    terrain.placeBlockAt(blockHit.x, blockHit.y, blockHit.z, EMPTY);
+    m_brokenBlocks.push_back(BlockEdit{blockHit, *cameraHit.type});
 
     return;
 
@@ -714,13 +535,14 @@ void Player::placeBlock(InputBundle &inputs, Terrain &terrain) {
         return;
     }
 
-    glm::ivec3 out_blockHit(0);
-    glm::ivec3 out_blockHitPrev(0);
     glm::vec3 cameraRay(cameraBlockDist * m_camera.getForward());
+    TerrainRayHit cameraHit = terrain.raycast(m_camera.getCurrentPos(), cameraRay);
 
-    bool newBlockHit = gridMarchPrevBlock(m_camera.getCurrentPos(), cameraRay, terrain, &out_blockHitPrev, &out_blockHit);
-
-    if (!newBlockHit) {
+    // no chunk to edit; the new block goes on the face the ray entered
+    // the hit block through, unless the camera's own block is in the way
+    const glm::ivec3 &newBlock = cameraHit.prevBlock;
+    if (!cameraHit.hit || !cameraHit.type
+            || terrain.tryGetBlockAt(newBlock.x, newBlock.y, newBlock.z) != EMPTY) {
         return;
     }
 
@@ -730,7 +552,7 @@ void Player::placeBlock(InputBundle &inputs, Terrain &terrain) {
         return;
     }
 
-    terrain.placeBlockAt(out_blockHitPrev.x, out_blockHitPrev.y, out_blockHitPrev.z, placeBlockType);
+    terrain.placeBlockAt(newBlock.x, newBlock.y, newBlock.z, placeBlockType);
 
     // reset the buffer time
     creationBufferTime = 0.f;
@@ -806,23 +628,24 @@ void Player::drawInventoryItem() {
  *   pass all items in inventory on hand to widget object for further rendering
  */
 void Player::drawInventoryItemOnHand() {
-    std::vector<std::pair<BlockType, int>> blocksInInventory;
-    inventory.getItemInfo(&blocksInInventory);
+    const std::vector<std::pair<BlockType, int>> &blocksInInventory = inventory.getItems();
 
     for (int i=0; i<inventory.getBlocksOnHandSize(); ++i) {
         if (Block::isEmpty(blocksInInventory[i].first)) {
             continue;
         }
-        std::array<std::array<glm::vec2, 4>, 3> uvCoords;
-        Block::getUVCoords(blocksInInventory[i].first, &uvCoords);
-        // draw the items in widget
+        std::array<glm::vec2, 4> uvCoords;
+        BlockIcons::getUVCoords(blocksInInventory[i].first, &uvCoords);
+        // draw the items in widget, one quad of its icon each
         inventoryItemOnHand->addItem(i, uvCoords);
         // draw the count of items in widget
         // the coordinate is hard-coded in widget.cpp (relative to the block position)
         glm::vec2 top_left_pos;
         float height;
         inventoryItemOnHand->getWidgetItemNumberInfo(i, &top_left_pos, &height);
-        textOnScreen->addText(std::to_string(blocksInInventory[i].second), top_left_pos, height);
+        char count[12];
+        std::snprintf(count, sizeof(count), "%d", blocksInInventory[i].second);
+        textOnScreen->addText(count, top_left_pos, height);
     }
 }
 
@@ -831,8 +654,7 @@ void Player::drawInventoryItemOnHand() {
  *   pass all items in inventory in container to widget object for further rendering
  */
 void Player::drawInventoryItemInContainer() {
-    std::vector<std::pair<BlockType, int>> blocksInInventory;
-    inventory.getItemInfo(&blocksInInventory);
+    const std::vector<std::pair<BlockType, int>> &blocksInInventory = inventory.getItems();
 
     for (int i=0; i<inventory.getBlocksInInventorySize(); ++i) {
         if (Block::isEmpty(blocksInInventory[i].first)) {
@@ -842,18 +664,21 @@ void Player::drawInventoryItemInContainer() {
         if (i < inventory.getBlocksOnHandSize()) {
             index += inventory.getBlocksInInventorySize();
         }
-        std::array<std::array<glm::vec2, 4>, 3> uvCoords;
-        Block::getUVCoords(blocksInInventory[i].first, &uvCoords);
+        std::array<glm::vec2, 4> uvCoords;
+        BlockIcons::getUVCoords(blocksInInventory[i].first, &uvCoords);
         inventoryItemInContainer->addItem(index, uvCoords);
         glm::vec2 top_left_pos;
         float height;
         inventoryItemInContainer->getWidgetItemNumberInfo(index, &top_left_pos, &height);
-        textOnScreen->addText(std::to_string(blocksInInventory[i].second), top_left_pos, height);
+        char count[12];
+        std::snprintf(count, sizeof(count), "%d", blocksInInventory[i].second);
+        textOnScreen->addText(count, top_left_pos, height);
     }
 }
 
 bool Player::isLiquid(const Terrain &terrain, glm::ivec3* pos) {
-    BlockType blockType = terrain.getBlockAt((*pos).x, (*pos).y, (*pos).z);
+    // a missing chunk is solid (see Terrain::raycast)
+    BlockType blockType = terrain.tryGetBlockAt((*pos).x, (*pos).y, (*pos).z).value_or(EMPTY);
     return Block::isLiquid(blockType);
 }
 
@@ -994,6 +819,11 @@ glm::vec3 Player::getCurrForward() const
     return m_forward;
 }
 
+glm::vec3 Player::getVelocity() const
+{
+    return m_velocity;
+}
+
 glm::vec3 Player::getCurrRight() const
 {
     return m_right;
@@ -1005,13 +835,13 @@ bool Player::isFlightMode() const
     return flightMode;
 }
 
-void Player::stateOperation(InputBundle &input) {
-    computePlayerState(input);
+void Player::stateOperation() {
+    computePlayerState();
     drawPlayerState();
 }
 
-void Player::computePlayerState(InputBundle &input) {
-    if (isUnderLava(mcr_terrain, input)) {
+void Player::computePlayerState() {
+    if (m_environment.underLava) {
         hpChange(-0.2);
     }
 }
@@ -1024,15 +854,18 @@ void Player::hpChange(float amount) {
 void Player::drawPlayerState() {
     int full_heart_count;
     double res = std::remquo(hp, 10.f, &full_heart_count);
-    std::string heart = "";
+    // built in place every frame: no heap
+    char heart[64];
+    int length = 0;
 
-    for (int i=0; i<full_heart_count; ++i) {
-        heart += "[";
+    for (int i=0; i<full_heart_count && length + 2 < static_cast<int>(sizeof(heart)); ++i) {
+        heart[length++] = '[';
     }
 
     if (res >= 5.f) {
-        heart += "]";
+        heart[length++] = ']';
     }
+    heart[length] = '\0';
 
     textOnScreen->addText(heart, hp_top_left_pos, hp_text_height);
 }
@@ -1055,7 +888,23 @@ void Player::switchCameraView()
  */
 glm::mat4 Player::getCameraViewProj() const
 {
-    return tpv ? m_tpv_camera.getViewProj() : m_camera.getViewProj();
+    glm::mat4 viewProj = tpv ? m_tpv_camera.getViewProj() : m_camera.getViewProj();
+    return glm::translate(viewProj, -m_renderOffset);
+}
+
+glm::vec3 Player::getCameraPosition() const
+{
+    return (tpv ? m_tpv_camera.mcr_position : m_camera.mcr_position) + m_renderOffset;
+}
+
+void Player::setRenderOffset(glm::vec3 offset)
+{
+    m_renderOffset = offset;
+}
+
+glm::vec3 Player::getRenderOffset() const
+{
+    return m_renderOffset;
 }
 
 void Player::setPos(glm::vec3 pos) {
@@ -6,11 +6,34 @@
 #include "widget.h"
 #include "blockinwidget.h"
 #include "text.h"
+#include "voxelsweep.h"
 #include <iostream>
 #include <set>
 
 enum class VelocityCond {stop, max, move};
 
+/**
+ * @brief The PlayerEnvironment struct
+ *  What is around the player, read once a tick after its physics (see
+ *  Player::senseEnvironment). The HP, the next tick's physics, the
+ *  post-process shaders and the walking sounds all read this rather than
+ *  the terrain.
+ */
+struct PlayerEnvironment
+{
+    // liquid in the blocks around the player's head, at the camera's height
+    bool underWater;
+    bool underLava;
+    // the sweep stopped the player moving down
+    bool onGround;
+    // the block the player stands on; EMPTY when not on one
+    BlockType ground;
+
+    PlayerEnvironment()
+        : underWater(false), underLava(false), onGround(false), ground(EMPTY)
+    {}
+};
+
 class Player : public Entity {
 private:
     glm::vec3 m_velocity, m_acceleration;
@@ -23,6 +46,8 @@ private:
     float m_velocity_val, m_acceleration_val; // length of the vector
     float cameraBlockDist; // max distance from the camera while using ray tracing
     bool flightMode; // determine the current moving mode
+    PlayerEnvironment m_environment; // as of the end of the last tick
+    glm::ivec3 m_groundBlock; // where m_environment.onGround stands
     bool containerMode; // determine if the player opens the container or not
     double destroyBufferTime; // compute the passing time (s) starting from last destroy
     double creationBufferTime; // compute the passing time (s) starting from last block creation
@@ -39,10 +64,17 @@ private:
     BlockInWidget *inventoryItemInContainer;
     Text* textOnScreen;
 
-    bool checkXZCollision(int idx, const Terrain &terrain); // determine if current movement collide in X or Z axis (with idx 0 and 2)
-    bool checkYCollision(const Terrain &terrain); // determine if current movement collide in Y axis (specifically for the ground)
-    void implementJumping(const Terrain &terrain, InputBundle &inputs);
+    // the box the player collides with: boxHalfWidth around its position
+    // on x and z, boxHeight up from its feet
+    static constexpr float boxHalfWidth = 0.4f;
+    static constexpr float boxHeight = 1.9f;
+    // stop the velocity on the axes the contact was blocked on
+    void applyContact(const SweepContact &contact);
+    // read m_environment where the physics left the player
+    void senseEnvironment(VoxelSweep &sweep);
+    void implementJumping();
     void destroyBlock(InputBundle &inputs, Terrain &terrain); // destroy the block within 3 unit from camera pos when left mouse button is pressed
+    void collectExplosionDrops(Terrain &terrain); // store the blocks the explosions blasted in the inventory
     void placeBlock(InputBundle &inputs, Terrain &terrain);
 
     // interaction in widget in container
@@ -65,13 +97,19 @@ private:
     float hp_max;
     glm::vec2 hp_top_left_pos;
     float hp_text_height = 0.1;
-    void computePlayerState(InputBundle &input);
+    void computePlayerState();
     void hpChange(float amount);
     void drawPlayerState();
 
     // third person view
     bool tpv;
 
+    // from the last simulated position to the drawn one
+    glm::vec3 m_renderOffset;
+
+    // the blocks destroyBlock broke since takeBrokenBlocks, as they were
+    std::vector<BlockEdit> m_brokenBlocks;
+
 public:
     // Readonly public reference to our camera
     // for easy access from MyGL
@@ -80,13 +118,20 @@ public:
 
     void setPos(glm::vec3 pos);
 
-    BlockType blockTouchingPlayer;
-
     Player(glm::vec3 pos, Terrain &terrain);
     virtual ~Player() override;
 
     void setCameraWidthHeight(unsigned int w, unsigned int h);
+    // see Camera::setJitter; for both cameras
+    void setCameraJitter(glm::vec2 offset);
     glm::mat4 getCameraViewProj() const;
+    // the eye of the camera getCameraViewProj() views from
+    glm::vec3 getCameraPosition() const;
+    // Draw the player and view from this far off its position, to
+    // interpolate between two fixed simulation steps; the rest of the
+    // game still sees mcr_position
+    void setRenderOffset(glm::vec3 offset);
+    glm::vec3 getRenderOffset() const;
 
     void tick(float dT, InputBundle &input) override;
 
@@ -113,6 +158,8 @@ public:
     QString velAsQString() const;
     QString accAsQString() const;
     QString lookAsQString() const;
+    // the direction the player faces
+    glm::vec3 getLook() const;
 
     // toggle current flight mode
     void toggleFlightMode();
@@ -130,21 +177,22 @@ public:
     // check the effect of acceleration on current velocity
     VelocityCond currVelocityCond(float dT, InputBundle &inputs);
 
-    bool isOnGround(const Terrain &terrain, InputBundle &inputs);
-    bool isUnderWater(const Terrain &terrain, InputBundle &inputs);
-    bool isUnderLava(const Terrain &terrain, InputBundle &inputs);
+    // as of the last tick (see PlayerEnvironment)
+    const PlayerEnvironment &getEnvironment() const;
+    // the blocks broken since the last call, each with the type it had
+    // (e.g. for their crumbs, see ParticleSystem)
+    void takeBrokenBlocks(std::vector<BlockEdit> &blocks);
 
     // check if the given position is liquid or not
     bool isLiquid(const Terrain &terrain, glm::ivec3* pos);
 
-    bool gridMarch(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &terrain, float *out_dist, glm::ivec3 *out_blockHit);
-    bool gridMarchPrevBlock(glm::vec3 rayOrigin, glm::vec3 rayDirection, const Terrain &terrain, glm::ivec3 *out_prevBlock, glm::ivec3 *out_blockHit);
 
     void setBlocksHold();
 
     // helper method to determine the current facing of the player
     glm::vec3 getCurrUp() const;
     glm::vec3 getCurrForward() const;
+    glm::vec3 getVelocity() const;
     glm::vec3 getCurrRight() const;
     bool isFlightMode() const;
 
@@ -178,12 +226,12 @@ public:
     void fillAllBlocks();
 
     // set and draw the state of the player (e.g. HP)
-    void stateOperation(InputBundle &input);
+    void stateOperation();
 
     // switch between player's view third-person view
     void switchCameraView();
 
     // Check if the player is walking
-    bool isWalking();
+    bool isWalking() const;
 };
 
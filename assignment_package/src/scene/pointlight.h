@@ -0,0 +1,14 @@
+#pragma once
+#include "glm_includes.h"
+
+// A light the terrain gives off, in world space: one per cell of emissive
+// blocks of a section (see Chunk::collectSectionLights), drawn by
+// ClusteredLights
+struct PointLight
+{
+    glm::vec3 position;
+    // how far it reaches, in blocks; it fades to nothing there
+    float radius;
+    // linear, at the light itself
+    glm::vec3 color;
+};
@@ -17,15 +17,7 @@ void Quad::createVBOdata(){
 
     m_count = 6;
 
-    generateIdx();
-    bindIdx();
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * sizeof(GLuint), idx, GL_STATIC_DRAW);
-
-    generatePos();
-    bindPos();
-    mp_context->glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(glm::vec4), vert_pos, GL_STATIC_DRAW);
-
-    generateUV();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufUV);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, 4 * sizeof(glm::vec2), vert_UV, GL_STATIC_DRAW);
+    fillBuffer(m_bufIdx, m_idxGenerated, GL_ELEMENT_ARRAY_BUFFER, 6 * sizeof(GLuint), idx);
+    fillBuffer(m_bufPos, m_posGenerated, GL_ARRAY_BUFFER, 4 * sizeof(glm::vec4), vert_pos);
+    fillBuffer(m_bufUV, m_uvGenerated, GL_ARRAY_BUFFER, 4 * sizeof(glm::vec2), vert_UV);
 }
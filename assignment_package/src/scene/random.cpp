@@ -0,0 +1,42 @@
+#include "random.h"
+
+Random::Random(uint64_t seed)
+    : key(mix(seed)), counter(0)
+{}
+
+Random::Random(uint64_t worldSeed, int x, int z)
+    : key(mix(worldSeed
+              ^ mix(static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32
+                    | static_cast<uint32_t>(z)))),
+      counter(0)
+{}
+
+/**
+ * @brief Random::mix
+ *  The splitmix64 output function, a bijective 64-bit avalanche hash.
+ * @param v
+ * @return
+ */
+uint64_t Random::mix(uint64_t v)
+{
+    v += 0x9E3779B97F4A7C15ull;
+    v = (v ^ (v >> 30)) * 0xBF58476D1CE4E5B9ull;
+    v = (v ^ (v >> 27)) * 0x94D049BB133111EBull;
+    return v ^ (v >> 31);
+}
+
+uint64_t Random::nextUInt()
+{
+    return mix(key + counter++);
+}
+
+float Random::nextFloat()
+{
+    // top 24 bits => exactly representable floats in [0, 1)
+    return static_cast<float>(nextUInt() >> 40) * (1.f / 16777216.f);
+}
+
+float Random::floatAt(uint64_t i) const
+{
+    return static_cast<float>(mix(key + i) >> 40) * (1.f / 16777216.f);
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @brief The Random class
+ *  Counter-based random stream: the n-th value is a pure hash of
+ *  (key, n), so it holds no shared state and needs no locking.
+ *  Keying a stream by (world seed, chunk corner) makes the values a chunk
+ *  sees independent of which thread fills it, or when.
+ */
+class Random {
+private:
+    uint64_t key;
+    uint64_t counter;
+
+public:
+    explicit Random(uint64_t seed);
+    // stream for the chunk / structure whose corner is at (x, z)
+    Random(uint64_t worldSeed, int x, int z);
+
+    // next value of the stream
+    uint64_t nextUInt();
+    // next value in [0, 1)
+    float nextFloat();
+
+    // stateless access to the i-th value in [0, 1)
+    float floatAt(uint64_t i) const;
+
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t v);
+};
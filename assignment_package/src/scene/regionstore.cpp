@@ -0,0 +1,517 @@
+#include "regionstore.h"
+#include "memorystats.h"
+#include "terrain.h"
+#include <QByteArray>
+#include <QDir>
+#include <algorithm>
+#include <iostream>
+#ifdef Q_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+static const char regionMagic[4] = {'M', 'M', 'R', 'G'};
+static const qint64 tableOffset = 8;
+static const qint64 headerSize = tableOffset + 8 * RegionStore::regionChunks * RegionStore::regionChunks;
+
+// floor(a / b) for b > 0
+static int floorDiv(int a, int b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+// region of the chunk with corner (x, z), and the chunk's index in it
+static void regionLocation(int x, int z, int &rx, int &rz, int &local)
+{
+    int cx = floorDiv(x, 16);
+    int cz = floorDiv(z, 16);
+    rx = floorDiv(cx, RegionStore::regionChunks);
+    rz = floorDiv(cz, RegionStore::regionChunks);
+    local = (cx - rx * RegionStore::regionChunks) + RegionStore::regionChunks * (cz - rz * RegionStore::regionChunks);
+}
+
+static void putUInt32(char *out, uint32_t v)
+{
+    for (int b = 0; b < 4; b++) {
+        out[b] = static_cast<char>((v >> (8 * b)) & 0xFF);
+    }
+}
+
+static uint32_t getUInt32(const char *in)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < 4; b++) {
+        v |= static_cast<uint32_t>(static_cast<unsigned char>(in[b])) << (8 * b);
+    }
+    return v;
+}
+
+//--------------------------
+// I/O tasks
+//--------------------------
+class RegionStore::WriteTask : public TerrainJob
+{
+private:
+    RegionStore *store;
+    int x;
+    int z;
+    std::vector<uint8_t> blocks;
+
+public:
+    WriteTask(RegionStore *store, int x, int z, std::vector<uint8_t> blocks)
+        : store(store), x(x), z(z), blocks(std::move(blocks))
+    {}
+
+    void run() override
+    {
+        if (!store->writeRegionChunk(x, z, blocks)) {
+            std::cout << "Failed to store chunk " << x << ", " << z
+                      << " in " << store->m_directory.toStdString() << std::endl;
+        }
+    }
+};
+
+class RegionStore::ReadTask : public TerrainJob
+{
+private:
+    RegionStore *store;
+    int xCorner;
+    int zCorner;
+
+public:
+    ReadTask(RegionStore *store, int xCorner, int zCorner)
+        : store(store), xCorner(xCorner), zCorner(zCorner)
+    {}
+
+    void run() override
+    {
+        uPtr<StoredZone> zone = mkU<StoredZone>();
+        zone->xCorner = xCorner;
+        zone->zCorner = zCorner;
+        for (int x = xCorner; x < xCorner + 64; x += 16) {
+            for (int z = zCorner; z < zCorner + 64; z += 16) {
+                StoredChunkData data = store->takeColdChunk(x, z);
+                if (data == nullptr) {
+                    data = store->readRegionChunk(x, z);
+                }
+                if (data != nullptr) {
+                    zone->chunks[toKey(x, z)] = data;
+                }
+            }
+        }
+
+        store->m_finishedZonesLock.lock();
+        store->m_finishedZones.push_back(std::move(zone));
+        store->m_finishedZonesLock.unlock();
+    }
+};
+
+class RegionStore::PrefetchTask : public TerrainJob
+{
+private:
+    RegionStore *store;
+    int rx;
+    int rz;
+
+public:
+    PrefetchTask(RegionStore *store, int rx, int rz)
+        : store(store), rx(rx), rz(rz)
+    {}
+
+    void run() override
+    {
+        const MappedRegion *region = store->mapRegion(rx, rz);
+#ifdef Q_OS_UNIX
+        // the mapping starts at offset 0, so it is page aligned
+        if (region != nullptr) {
+            madvise(const_cast<uchar*>(region->data), region->size, MADV_WILLNEED);
+        }
+#else
+        Q_UNUSED(region);
+#endif
+    }
+};
+
+class RegionStore::CompressTask : public TerrainJob
+{
+private:
+    RegionStore *store;
+    int x;
+    int z;
+    std::vector<uint8_t> blocks;
+
+public:
+    CompressTask(RegionStore *store, int x, int z, std::vector<uint8_t> blocks)
+        : store(store), x(x), z(z), blocks(std::move(blocks))
+    {}
+
+    void run() override
+    {
+        // the fastest level: the tier is for speed, the files for space
+        QByteArray compressed = qCompress(reinterpret_cast<const uchar*>(blocks.data()),
+                                          static_cast<int>(blocks.size()), 1);
+        ColdChunk &cold = store->m_coldChunks[toKey(x, z)];
+        if (cold.compressed.isEmpty()) {
+            store->m_coldCount.fetch_add(1, std::memory_order_relaxed);
+        }
+        int64_t bytes = compressed.size() - cold.compressed.size();
+        cold.compressed = std::move(compressed);
+        cold.sequence = store->m_coldSequence++;
+        store->m_coldOrder.push_back(std::make_pair(toKey(x, z), cold.sequence));
+        store->m_coldBytes += bytes;
+        MemoryStats::add(MemoryCategory::coldChunks, bytes);
+        store->spillColdChunks();
+    }
+};
+
+//--------------------------
+// RegionStore
+//--------------------------
+RegionStore::RegionStore(const QString &directory, TerrainJobSystem &jobs)
+    : m_coldChunks(), m_coldOrder(), m_coldSequence(0), m_coldBytes(0), m_coldCount(0),
+      m_mappedRegions(), m_directory(directory), m_tables(),
+      m_storedChunks(), m_cachedChunks(), m_storedRegions(),
+      m_finishedZones(), m_finishedZonesLock(), mp_jobs(&jobs)
+{
+    if (MemoryStats::getBudget(MemoryCategory::coldChunks) == 0) {
+        MemoryStats::setBudget(MemoryCategory::coldChunks, defaultColdBudget);
+    }
+    QDir dir(m_directory);
+    for (const QString &name : dir.entryList(QStringList("r.*.*.mmr"), QDir::Files)) {
+        QStringList parts = name.split('.');
+        bool xOk = false;
+        bool zOk = false;
+        int rx = parts.size() == 4 ? parts[1].toInt(&xOk) : 0;
+        int rz = parts.size() == 4 ? parts[2].toInt(&zOk) : 0;
+        if (xOk && zOk) {
+            readTable(rx, rz);
+        }
+    }
+}
+
+RegionStore::~RegionStore()
+{
+    flush();
+    MemoryStats::sub(MemoryCategory::coldChunks, m_coldBytes);
+}
+
+const QString &RegionStore::getDirectory() const
+{
+    return m_directory;
+}
+
+QString RegionStore::regionFilePath(int rx, int rz) const
+{
+    return QDir(m_directory).filePath(QString("r.%1.%2.mmr").arg(rx).arg(rz));
+}
+
+/**
+ * @brief RegionStore::readTable
+ *  Load the offset table of an existing region file; a file with a bad
+ *  header is ignored (and overwritten by the next write to the region).
+ * @param rx
+ * @param rz
+ */
+void RegionStore::readTable(int rx, int rz)
+{
+    QFile file(regionFilePath(rx, rz));
+    if (!file.open(QFile::ReadOnly)) {
+        return;
+    }
+    QByteArray header = file.read(headerSize);
+    if (header.size() != headerSize || !header.startsWith(QByteArray(regionMagic, 4))
+            || getUInt32(header.constData() + 4) != formatVersion) {
+        std::cout << "Ignoring region file " << file.fileName().toStdString() << std::endl;
+        return;
+    }
+
+    std::vector<RegionEntry> table(regionChunks * regionChunks);
+    for (int i = 0; i < regionChunks * regionChunks; i++) {
+        const char *entry = header.constData() + tableOffset + 8 * i;
+        table[i] = {getUInt32(entry), getUInt32(entry + 4)};
+        if (table[i].size != 0) {
+            int cx = rx * regionChunks + i % regionChunks;
+            int cz = rz * regionChunks + i / regionChunks;
+            m_storedChunks.insert(toKey(cx * 16, cz * 16));
+            m_storedRegions.insert(toKey(rx, rz));
+        }
+    }
+    m_tables[toKey(rx, rz)] = table;
+}
+
+bool RegionStore::hasChunk(int x, int z) const
+{
+    return m_storedChunks.count(toKey(x, z)) != 0 || m_cachedChunks.count(toKey(x, z)) != 0;
+}
+
+bool RegionStore::hasZoneChunks(int xCorner, int zCorner) const
+{
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            if (hasChunk(x, z)) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief RegionStore::writeChunk
+ * @param x      : corner of the chunk
+ * @param z
+ * @param blocks : Chunk::serializeBlocks output; serialized on the caller's
+ *                 thread, compressed and written by an I/O job
+ */
+void RegionStore::writeChunk(int x, int z, std::vector<uint8_t> blocks)
+{
+    int rx, rz, local;
+    regionLocation(x, z, rx, rz, local);
+    m_storedChunks.insert(toKey(x, z));
+    m_storedRegions.insert(toKey(rx, rz));
+    mp_jobs->submit<WriteTask>(TerrainJobQueue::io, 0, this, x, z, std::move(blocks));
+}
+
+/**
+ * @brief RegionStore::cacheChunk
+ * @param x      : corner of the chunk
+ * @param z
+ * @param blocks : Chunk::serializeBlocks output
+ */
+void RegionStore::cacheChunk(int x, int z, std::vector<uint8_t> blocks)
+{
+    m_cachedChunks.insert(toKey(x, z));
+    mp_jobs->submit<CompressTask>(TerrainJobQueue::io, 0, this, x, z, std::move(blocks));
+}
+
+/**
+ * @brief RegionStore::requestZone
+ *  The read takes the zone's chunks out of the cold tier: they are
+ *  resident again.
+ * @param xCorner
+ * @param zCorner
+ */
+void RegionStore::requestZone(int xCorner, int zCorner)
+{
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            m_cachedChunks.erase(toKey(x, z));
+        }
+    }
+    mp_jobs->submit<ReadTask>(TerrainJobQueue::io, 0, this, xCorner, zCorner);
+}
+
+void RegionStore::collectFinishedZones(std::vector<uPtr<StoredZone>> &out)
+{
+    m_finishedZonesLock.lock();
+    for (uPtr<StoredZone> &zone : m_finishedZones) {
+        out.push_back(std::move(zone));
+    }
+    m_finishedZones.clear();
+    m_finishedZonesLock.unlock();
+}
+
+/**
+ * @brief RegionStore::prefetchRegion
+ * @param x : any world column of the region
+ * @param z
+ */
+void RegionStore::prefetchRegion(int x, int z)
+{
+    int rx, rz, local;
+    regionLocation(x, z, rx, rz, local);
+    if (m_storedRegions.count(toKey(rx, rz)) != 0) {
+        mp_jobs->submit<PrefetchTask>(TerrainJobQueue::io, 0, this, rx, rz);
+    }
+}
+
+void RegionStore::flush()
+{
+    mp_jobs->waitForDone(TerrainJobQueue::io);
+}
+
+size_t RegionStore::getColdChunkCount() const
+{
+    return m_coldCount.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief RegionStore::spillColdChunks
+ *  Oldest first; the pair of a chunk cached again since, or taken, is
+ *  only dropped from the order.
+ */
+void RegionStore::spillColdChunks()
+{
+    int64_t budget = MemoryStats::getBudget(MemoryCategory::coldChunks);
+    while (budget > 0 && m_coldBytes > budget && !m_coldOrder.empty()) {
+        std::pair<int64_t, uint64_t> oldest = m_coldOrder.front();
+        m_coldOrder.pop_front();
+        auto cold = m_coldChunks.find(oldest.first);
+        if (cold != m_coldChunks.end() && cold->second.sequence == oldest.second) {
+            m_coldBytes -= cold->second.compressed.size();
+            MemoryStats::sub(MemoryCategory::coldChunks, cold->second.compressed.size());
+            m_coldChunks.erase(cold);
+            m_coldCount.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+    // the stale pairs of chunks taken back would pile up under the budget
+    if (m_coldOrder.size() > 2 * m_coldChunks.size() + 64) {
+        std::deque<std::pair<int64_t, uint64_t>> live;
+        for (const std::pair<int64_t, uint64_t> &entry : m_coldOrder) {
+            auto cold = m_coldChunks.find(entry.first);
+            if (cold != m_coldChunks.end() && cold->second.sequence == entry.second) {
+                live.push_back(entry);
+            }
+        }
+        m_coldOrder.swap(live);
+    }
+}
+
+StoredChunkData RegionStore::takeColdChunk(int x, int z)
+{
+    auto cold = m_coldChunks.find(toKey(x, z));
+    if (cold == m_coldChunks.end()) {
+        return nullptr;
+    }
+    StoredChunkData blocks = mkS<const QByteArray>(qUncompress(cold->second.compressed));
+    m_coldBytes -= cold->second.compressed.size();
+    MemoryStats::sub(MemoryCategory::coldChunks, cold->second.compressed.size());
+    m_coldChunks.erase(cold);
+    m_coldCount.fetch_sub(1, std::memory_order_relaxed);
+    return blocks->isEmpty() ? nullptr : blocks;
+}
+
+/**
+ * @brief RegionStore::writeRegionChunk
+ * @param x
+ * @param z
+ * @param blocks
+ * @return
+ */
+bool RegionStore::writeRegionChunk(int x, int z, const std::vector<uint8_t> &blocks)
+{
+    int rx, rz, local;
+    regionLocation(x, z, rx, rz, local);
+    // the file may grow past the mapping: map it again on the next read
+    unmapRegion(toKey(rx, rz));
+
+    QByteArray payload = qCompress(reinterpret_cast<const uchar*>(blocks.data()),
+                                   static_cast<int>(blocks.size()));
+
+    if (!QDir().mkpath(m_directory)) {
+        return false;
+    }
+    QFile file(regionFilePath(rx, rz));
+    if (!file.open(QFile::ReadWrite)) {
+        return false;
+    }
+
+    std::vector<RegionEntry> &table = m_tables[toKey(rx, rz)];
+    if (table.empty() || file.size() < headerSize) {
+        // new (or unreadable) region: start from an empty table
+        table.assign(regionChunks * regionChunks, {0, 0});
+        QByteArray header(headerSize, '\0');
+        std::copy(regionMagic, regionMagic + 4, header.data());
+        putUInt32(header.data() + 4, formatVersion);
+        if (!file.resize(0) || file.write(header) != headerSize) {
+            return false;
+        }
+    }
+
+    RegionEntry entry = table[local];
+    if (entry.size == 0 || static_cast<uint32_t>(payload.size()) > entry.size) {
+        entry.offset = static_cast<uint32_t>(file.size());
+    }
+    entry.size = static_cast<uint32_t>(payload.size());
+
+    if (!file.seek(entry.offset) || file.write(payload) != payload.size() || !file.flush()) {
+        return false;
+    }
+
+    // the entry goes last, so an interrupted append leaves the old chunk readable
+    char raw[8];
+    putUInt32(raw, entry.offset);
+    putUInt32(raw + 4, entry.size);
+    if (!file.seek(tableOffset + 8 * local) || file.write(raw, 8) != 8) {
+        return false;
+    }
+    table[local] = entry;
+    return true;
+}
+
+/**
+ * @brief RegionStore::mapRegion
+ * @param rx
+ * @param rz
+ * @return
+ */
+const RegionStore::MappedRegion *RegionStore::mapRegion(int rx, int rz)
+{
+    int64_t regionKey = toKey(rx, rz);
+    auto mapped = m_mappedRegions.find(regionKey);
+    if (mapped != m_mappedRegions.end()) {
+        return &mapped->second;
+    }
+
+    uPtr<QFile> file = mkU<QFile>(regionFilePath(rx, rz));
+    if (!file->open(QFile::ReadOnly) || file->size() < headerSize) {
+        return nullptr;
+    }
+    const uchar *data = file->map(0, file->size());
+    if (data == nullptr) {
+        return nullptr;
+    }
+
+    // the regions are visited in bursts; dropping them all is simpler than
+    // tracking the least recently used one and rarely costs a remap
+    if (m_mappedRegions.size() >= maxMappedRegions) {
+        m_mappedRegions.clear();
+    }
+    qint64 size = file->size();
+    MappedRegion &region = m_mappedRegions[regionKey];
+    region.file = std::move(file);
+    region.data = data;
+    region.size = size;
+    return &region;
+}
+
+void RegionStore::unmapRegion(int64_t regionKey)
+{
+    // closing the file unmaps it
+    m_mappedRegions.erase(regionKey);
+}
+
+/**
+ * @brief RegionStore::readRegionChunk
+ *  Inflate the chunk straight from the region's mapping
+ * @param x
+ * @param z
+ * @return the chunk's serialized blocks, or null if it is not stored
+ */
+StoredChunkData RegionStore::readRegionChunk(int x, int z)
+{
+    int rx, rz, local;
+    regionLocation(x, z, rx, rz, local);
+
+    auto table = m_tables.find(toKey(rx, rz));
+    if (table == m_tables.end() || table->second[local].size == 0) {
+        return nullptr;
+    }
+    RegionEntry entry = table->second[local];
+
+    const MappedRegion *region = mapRegion(rx, rz);
+    if (region == nullptr) {
+        return nullptr;
+    }
+    if (static_cast<qint64>(entry.offset) + entry.size > region->size) {
+        std::cout << "Corrupt stored chunk " << x << ", " << z << std::endl;
+        return nullptr;
+    }
+
+    StoredChunkData blocks = mkS<const QByteArray>(qUncompress(region->data + entry.offset,
+                                                                static_cast<int>(entry.size)));
+    if (blocks->isEmpty()) {
+        std::cout << "Corrupt stored chunk " << x << ", " << z << std::endl;
+        return nullptr;
+    }
+    return blocks;
+}
@@ -0,0 +1,174 @@
+#pragma once
+
+#include "smartpointerhelp.h"
+#include "terrainjobs.h"
+#include <QByteArray>
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// The blocks of one stored chunk in Chunk::serializeBlocks' encoding
+typedef sPtr<const QByteArray> StoredChunkData;
+
+// The stored chunks of one zone, read back for RegionStore::requestZone
+struct StoredZone
+{
+    int xCorner;
+    int zCorner;
+    // keyed by toKey of the chunk's corner; a chunk that failed to read is missing
+    std::unordered_map<int64_t, StoredChunkData> chunks;
+};
+
+/**
+ * @brief The RegionStore class
+ *  On-disk store of the chunks the player modified. The world is split in
+ *  regions of 32 x 32 chunks, one file each (r.<rx>.<rz>.mmr):
+ *
+ *   [0, 4)        magic "MMRG"
+ *   [4, 8)        format version
+ *   [8, 8200)     offset table: per chunk (cx + 32 * cz in the region)
+ *                 a uint32 offset and a uint32 size, size 0 if absent
+ *   [8200, ...)   the chunks, zlib-compressed (qCompress)
+ *
+ *  All integers are little endian. A rewritten chunk reuses its old slot
+ *  when it fits and is appended otherwise; the table entry is written last.
+ *  Slots left behind by appends are not reclaimed.
+ *
+ *  Every file access runs as a job of the terrain's I/O queue, one at a
+ *  time in submission order, so a read requested after a write sees the
+ *  written chunk.
+ *  The public interface is main thread only.
+ *
+ *  Reads go through memory mappings of the region files: a chunk is
+ *  inflated straight from the mapped pages, and prefetchRegion() asks the
+ *  OS (madvise) to page a region in before the player reaches it.
+ *
+ *  In front of the files is the cold tier: the evicted chunks, modified
+ *  or not, kept compressed in memory (cacheChunk) so a return visit
+ *  neither generates nor reads them. They are compressed by I/O jobs too,
+ *  so a zone's read always follows its chunks' caching, and counted as
+ *  MemoryCategory::coldChunks; past its budget the oldest are spilled:
+ *  dropped, since a modified chunk is written to its region as it is
+ *  evicted, and the others regenerate.
+ */
+class RegionStore
+{
+public:
+    static const int regionChunks = 32;
+    static const uint32_t formatVersion = 1;
+
+private:
+    struct RegionEntry
+    {
+        uint32_t offset;
+        uint32_t size;
+    };
+
+    class WriteTask;
+    class ReadTask;
+    class PrefetchTask;
+    class CompressTask;
+
+    struct ColdChunk
+    {
+        QByteArray compressed;
+        // its place in m_coldOrder
+        uint64_t sequence;
+    };
+    // the cold tier, keyed by the chunk's corner (I/O jobs only)
+    std::unordered_map<int64_t, ColdChunk> m_coldChunks;
+    // (key, sequence) in caching order, for the spills; a chunk cached
+    // again leaves a stale pair behind
+    std::deque<std::pair<int64_t, uint64_t>> m_coldOrder;
+    uint64_t m_coldSequence;
+    int64_t m_coldBytes;
+    std::atomic<size_t> m_coldCount;
+    void spillColdChunks();
+    // the chunk's blocks, out of the cold tier; null if it is not there
+    StoredChunkData takeColdChunk(int x, int z);
+
+    struct MappedRegion
+    {
+        uPtr<QFile> file;
+        const uchar *data;
+        qint64 size;
+    };
+    // at most maxMappedRegions mapped at once (I/O jobs only)
+    static const size_t maxMappedRegions = 16;
+    std::unordered_map<int64_t, MappedRegion> m_mappedRegions;
+
+    QString m_directory;
+
+    // offset tables of the region files, keyed by toKey(rx, rz) (I/O jobs
+    // only once the constructor has returned)
+    std::unordered_map<int64_t, std::vector<RegionEntry>> m_tables;
+
+    // chunks on disk or queued for writing, keyed by the chunk's corner (main thread)
+    std::unordered_set<int64_t> m_storedChunks;
+    // chunks cached since they were last requested, the same way (main thread)
+    std::unordered_set<int64_t> m_cachedChunks;
+    // regions holding any of them, keyed by toKey(rx, rz) (main thread)
+    std::unordered_set<int64_t> m_storedRegions;
+
+    // zones read back, waiting for collectFinishedZones
+    std::vector<uPtr<StoredZone>> m_finishedZones;
+    QMutex m_finishedZonesLock;
+
+    // runs the tasks on its I/O queue, one at a time in order
+    TerrainJobSystem *mp_jobs;
+
+    QString regionFilePath(int rx, int rz) const;
+    void readTable(int rx, int rz);
+
+    // I/O jobs
+    bool writeRegionChunk(int x, int z, const std::vector<uint8_t> &blocks);
+    StoredChunkData readRegionChunk(int x, int z);
+    // the region's mapping, mapped on first use; null if it has no file
+    const MappedRegion *mapRegion(int rx, int rz);
+    void unmapRegion(int64_t regionKey);
+
+public:
+    // Open (or create) the store in `directory`, reading every region's
+    // offset table; the file accesses run on the I/O queue of `jobs`
+    RegionStore(const QString &directory, TerrainJobSystem &jobs);
+    // waits for the queued writes
+    ~RegionStore();
+
+    RegionStore(const RegionStore&) = delete;
+    RegionStore &operator=(const RegionStore&) = delete;
+
+    const QString &getDirectory() const;
+
+    // the cold tier's budget unless one is set before the first store
+    static const int64_t defaultColdBudget = 128ll << 20;
+
+    // does the chunk with this corner have stored blocks, on disk or cold?
+    bool hasChunk(int x, int z) const;
+    // does any chunk of the 64 x 64 zone have stored blocks?
+    bool hasZoneChunks(int xCorner, int zCorner) const;
+
+    // queue the chunk's serialized blocks for writing
+    void writeChunk(int x, int z, std::vector<uint8_t> blocks);
+    // queue the evicted chunk's serialized blocks for compression into the
+    // cold tier; only writeChunk puts them on disk
+    void cacheChunk(int x, int z, std::vector<uint8_t> blocks);
+    // queue a read of the zone's stored chunks, the cold ones first; the
+    // result comes back through collectFinishedZones
+    void requestZone(int xCorner, int zCorner);
+    // append the zones read back since the last call; never blocks
+    void collectFinishedZones(std::vector<uPtr<StoredZone>> &out);
+    // queue paging in the region holding the world column (x, z), if it stores chunks
+    void prefetchRegion(int x, int z);
+
+    // block until every queued I/O job is done
+    void flush();
+
+    // the chunks in the cold tier now
+    size_t getColdChunkCount() const;
+};
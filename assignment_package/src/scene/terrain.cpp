@@ -1,19 +1,617 @@
 #include "terrain.h"
+#include "blockcursor.h"
+#include "memorystats.h"
 #include "noise.h"
+#include "profiler.h"
 #include <algorithm>
+#include <cstdlib>
 #include <stdexcept>
 #include <iostream>
 #include <unordered_map>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QStandardPaths>
+
+// The caves span y in [1, caveTop); the cave floor up to lavaLevel is lava
+static const int caveTop = 125;
+static const int lavaLevel = 30;
+// Deferred caves are carved within caveRadius chunks of a viewer, or of
+// an edit, less than caveApproach blocks above caveTop
+static const int caveApproach = 8;
+static const int caveRadius = 2;
+// decorated chunks stamped with the structure blocks they got, per tick
+static const int structureChunksPerTick = 4;
+// trees a chunk tries to plant
+
+/**
+ * @brief viewerCost
+ *  The distance from the viewer to the target in the x-z plane,
+ *  scaled from 1x straight ahead to 2x straight behind.
+ * @param target : x-z world position
+ * @param viewer : x-z position of the viewer
+ * @param forward : normalized x-z direction of the viewer, or 0
+ * @return lower is more urgent
+ */
+float viewerCost(glm::vec2 target, glm::vec2 viewer, glm::vec2 forward)
+{
+    glm::vec2 toTarget = target - viewer;
+    float distance = glm::length(toTarget);
+    if (distance < 1e-3f) {
+        return 0.f;
+    }
+    float facing = glm::dot(toTarget / distance, forward);
+    return distance * (1.5f - 0.5f * facing);
+}
 
 Terrain::Terrain(OpenGLContext *context)
-    : m_chunks(),
-      m_chunksWithBlocks(), m_chunksWithBlocksLock(),
-      m_chunksWithVBOs(), m_chunksWithVBOsLock(),
-      m_generatedTerrain(), m_prevBorderZones(), m_initialTerrainLoaded(false),
-      mp_context(context)
+    : Terrain(context, 0x476F6C64656E4F72ull)
 {}
 
-Terrain::~Terrain() {}
+Terrain::Terrain(OpenGLContext *context, uint64_t worldSeed, GradientHash gradientHash,
+                 sPtr<TerrainJobPool> jobPool)
+    : m_jobs(jobPool != nullptr ? std::move(jobPool) : mkS<TerrainJobPool>()), m_chunks(), m_chunkPool(64),
+      m_chunksWithBlocks(),
+      m_chunksWithVBOs(), m_editedChunkVBOs(),
+      m_pendingUploads(), m_viewerPos(0.f), m_viewerForward(0.f, 0.f, -1.f), m_viewerVelocity(0.f),
+      m_uploadByteBudget(4u << 20), m_uploadTimeBudgetUs(4000),
+      m_chunkRequestedAt(), m_pipelineClock(), m_pipelineStats{0, 0, 0, 0, 0, 0, 0.f, -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0},
+      m_frameActivity{false, 0, 0, 0, 0, 0},
+      m_scheduledViewer(0.f), m_scheduledForward(0.f, -1.f),
+      m_chunksRemeshing(), m_chunksToRemesh(),
+      m_editDepth(0), m_editedChunks(), m_editedNeighbors(), m_blockChangeCount(0),
+      m_trackEdits(false), m_blockEdits(), m_liquids(), m_blockTicks(worldSeed),
+      m_explosions(), m_explosionClock(0.f), m_explosionDrops(), m_receivedChunks(),
+      m_generatedTerrain(), m_prevBorderZones(), m_expandZone(0), m_expandHalfGridSize(-1),
+      m_viewRadius(0), m_viewCenter(0.f),
+      m_loadingRings(false), m_ringCenter(0), m_ringRadius(0), m_currentRing(0), m_initialTerrainLoaded(false),
+      mp_context(context), m_pooledZones(), m_meshPoolBudget(64u << 20), m_budgetEvictedZones(),
+      m_computeBackend(), m_computeMesher(), m_meshArena(), m_bufferPool(context),
+      m_multiDraw(), m_multiDrawCommands(), m_multiDrawOrigins(),
+      m_frustumCulling(false), m_cullFrustum(glm::mat4(1.f)), m_cullEye(0.f),
+      m_visibleSections(), m_sectionsOccluded(false),
+      m_visibleSectionsBounds(0), m_visibleSectionsValid(false), m_drawRuns(),
+      m_eyeSection(-1), m_sectionOrder(), m_unsortedTransparency(false), m_drawOrder(), m_cullStats(),
+      m_trackMeshChanges(false), m_meshChanges(),
+      m_computeZoneChunks(), m_zoneCaveDensities(),
+      m_deferCaves(false), m_uncarvedChunks(), m_chunksCarving(), m_carvedCaves(),
+      m_hotChunks(), m_chunksRelaying(), m_relaidChunks(),
+      m_residentRadius(3), m_maxResidentZones(81),
+      m_residencyClock(0), m_zoneLastUsed(),
+      m_zoneShapeJobs(), m_zoneMeshJobs(), m_cancelledZones(),
+      m_regionStore(mkU<RegionStore>(QDir(QStandardPaths::writableLocation(QStandardPaths::AppLocalDataLocation))
+                    .filePath("world-" + QString::number(worldSeed, 16)
+                              + (gradientHash == GradientHash::legacy ? "-legacy" : "")), m_jobs)),
+      m_editJournal(mkU<EditJournal>(m_regionStore->getDirectory(), m_jobs)),
+      m_meshCache(mkU<MeshCache>(m_regionStore->getDirectory(), m_jobs)),
+      m_zonesAwaitingStorage(), m_computeZoneStoredChunks(),
+      m_prevExpandPosition(0.f), m_lastPrefetchedRegion(toKey(INT_MIN, INT_MIN)), m_prefetchPosition(0.f),
+      m_speculativeGeneration(true),
+      m_worldSeed(worldSeed), m_gradientHash(gradientHash), m_navigationGraph(),
+      m_entityGrid()
+{
+    m_jobs.setUrgency([this](glm::vec2 xz) {
+        return -viewerCost(xz, m_scheduledViewer, m_scheduledForward);
+    });
+    m_pipelineClock.start();
+}
+
+Terrain::~Terrain()
+{
+    stopWorkers();
+    // the store's destructor waits for the writes
+    saveModifiedChunks();
+}
+
+TerrainJobSystem &Terrain::getJobSystem()
+{
+    return m_jobs;
+}
+
+const TerrainJobSystem &Terrain::getJobSystem() const
+{
+    return m_jobs;
+}
+
+NavigationGraph &Terrain::getNavigationGraph()
+{
+    return m_navigationGraph;
+}
+
+EntityGrid &Terrain::getEntityGrid()
+{
+    return m_entityGrid;
+}
+
+void Terrain::cancelWorkers()
+{
+    m_jobs.cancelAll(TerrainJobQueue::generation);
+    m_jobs.cancelAll(TerrainJobQueue::meshing);
+}
+
+void Terrain::stopWorkers()
+{
+    cancelWorkers();
+    m_jobs.waitForDone(TerrainJobQueue::generation);
+    m_jobs.waitForDone(TerrainJobQueue::meshing);
+}
+
+/**
+ * @brief Terrain::enableComputeBackend
+ * @return whether zones are generated on the GPU from now on
+ */
+bool Terrain::enableComputeBackend()
+{
+    uPtr<TerrainComputeBackend> backend = mkU<TerrainComputeBackend>(mp_context);
+    if (!backend->create(Noise(m_worldSeed, m_gradientHash))) {
+        return false;
+    }
+    m_computeBackend = std::move(backend);
+    return true;
+}
+
+void Terrain::destroyComputeBackend()
+{
+    if (m_computeBackend) {
+        m_computeBackend->destroy();
+        m_computeBackend = nullptr;
+    }
+}
+
+/**
+ * @brief Terrain::enableComputeMeshing
+ *  The meshes already submitted to VBO workers still arrive from them.
+ * @return whether chunks are meshed on the GPU from now on
+ */
+bool Terrain::enableComputeMeshing()
+{
+    uPtr<ChunkComputeMesher> mesher = mkU<ChunkComputeMesher>(mp_context);
+    if (!mesher->create(m_meshArena.get())) {
+        return false;
+    }
+    m_computeMesher = std::move(mesher);
+    return true;
+}
+
+void Terrain::destroyComputeMeshing()
+{
+    if (m_computeMesher) {
+        m_computeMesher->destroy();
+        m_computeMesher = nullptr;
+    }
+}
+
+/**
+ * @brief Terrain::enableMeshArena
+ *  Chunks already uploaded keep their own buffers until they are remeshed.
+ * @param bytes
+ * @return
+ */
+bool Terrain::enableMeshArena(size_t bytes)
+{
+    uPtr<ChunkMeshArena> arena = mkU<ChunkMeshArena>(mp_context);
+    if (!arena->create(bytes)) {
+        return false;
+    }
+    m_meshArena = std::move(arena);
+    return true;
+}
+
+void Terrain::destroyMeshArena()
+{
+    if (!m_meshArena) {
+        return;
+    }
+    destroyComputeMeshing();
+    destroyMultiDraw();
+    for (const auto &entry : m_chunkDrawables) {
+        entry.second->destroyVBOdata();
+        noteMeshChange(entry.first);
+    }
+    m_chunkDrawables.clear();
+    m_renderList.clear();
+    m_pooledZones.clear();
+    m_pipelineStats.pooledZones = 0;
+    m_pipelineStats.pooledMeshBytes = 0;
+    m_budgetEvictedZones.clear();
+    m_pipelineStats.budgetEvictedZones = 0;
+    for (ChunkVBOdata &vbo : m_pendingUploads) {
+        vbo.discardStaged();
+    }
+    m_pendingUploads.clear();
+    m_meshArena->destroy();
+    m_meshArena = nullptr;
+}
+
+void Terrain::destroyBufferPool()
+{
+    m_bufferPool.destroy();
+}
+
+/**
+ * @brief Terrain::enableMultiDraw
+ *  Chunks outside the arena (it was full) are still drawn one by one.
+ * @return
+ */
+bool Terrain::enableMultiDraw()
+{
+    if (!m_meshArena) {
+        return false;
+    }
+    uPtr<ChunkMultiDraw> multiDraw = mkU<ChunkMultiDraw>(mp_context);
+    if (!multiDraw->create(m_meshArena->getBuffer())) {
+        return false;
+    }
+    m_multiDraw = std::move(multiDraw);
+    return true;
+}
+
+void Terrain::destroyMultiDraw()
+{
+    if (m_multiDraw) {
+        m_multiDraw->destroy();
+        m_multiDraw = nullptr;
+    }
+}
+
+void Terrain::setResidency(int residentRadius, int maxResidentZones)
+{
+    m_residentRadius = residentRadius;
+    m_maxResidentZones = maxResidentZones;
+}
+
+void Terrain::setViewRadius(int chunks)
+{
+    m_viewRadius = std::max(chunks, 0);
+}
+
+int Terrain::getViewRadius() const
+{
+    return m_viewRadius;
+}
+
+void Terrain::setSpeculativeGeneration(bool enabled)
+{
+    m_speculativeGeneration = enabled;
+}
+
+/**
+ * @brief Terrain::halfGridForRadius
+ *  From the last chunk of the player's zone, the radius reaches
+ *  (3 + chunks) / 4 zones further.
+ * @param chunks
+ * @return
+ */
+int Terrain::halfGridForRadius(int chunks)
+{
+    return (chunks + 3) / 4;
+}
+
+float Terrain::zoneRadius(int halfGridSize) const
+{
+    if (m_viewRadius == 0) {
+        return 0.f;
+    }
+    return m_viewRadius * 16.f + (halfGridSize - halfGridForRadius(m_viewRadius)) * 64.f;
+}
+
+glm::ivec2 Terrain::expandCell(float playerX, float playerZ) const
+{
+    float cell = m_viewRadius > 0 ? 16.f : 64.f;
+    return glm::ivec2(static_cast<int>(glm::floor(playerX / cell)) * cell,
+                      static_cast<int>(glm::floor(playerZ / cell)) * cell);
+}
+
+void Terrain::setRegionDirectory(const QString &directory)
+{
+    m_editJournal.reset();
+    m_regionStore->flush();
+    m_regionStore = mkU<RegionStore>(directory, m_jobs);
+    m_editJournal = mkU<EditJournal>(directory, m_jobs);
+    if (m_meshCache) {
+        setMeshCaching(false);
+        setMeshCaching(true);
+    }
+}
+
+/**
+ * @brief Terrain::setMeshCaching
+ *  The meshing jobs queued and running hold the old cache, so they are
+ *  waited for first; call it before the terrain is streamed in.
+ * @param enabled
+ */
+void Terrain::setMeshCaching(bool enabled)
+{
+    if (enabled == (m_meshCache != nullptr)) {
+        return;
+    }
+    m_jobs.waitForDone(TerrainJobQueue::meshing);
+    m_meshCache = enabled ? mkU<MeshCache>(m_regionStore->getDirectory(), m_jobs) : nullptr;
+}
+
+void Terrain::saveModifiedChunks()
+{
+    m_chunks.forEach([this](Chunk *chunk) {
+        if (chunk->isModified()) {
+            std::vector<uint8_t> blocks;
+            chunk->serializeBlocks(blocks);
+            glm::ivec2 corner = chunk->getCorner();
+            m_regionStore->writeChunk(corner[0], corner[1], std::move(blocks));
+            chunk->setModified(false);
+        }
+    });
+    // a batch still open has edits its chunks are not marked for yet
+    if (m_editDepth == 0) {
+        m_editJournal->checkpoint();
+    } else {
+        m_editJournal->sync();
+    }
+}
+
+/**
+ * @brief Terrain::setGreedyMeshing
+ *  Every chunk is marked dirty, so the ones drawn now are remeshed in the
+ *  new mode and the others will be when they are next meshed.
+ * @param enabled
+ */
+void Terrain::setGreedyMeshing(bool enabled)
+{
+    if (Chunk::isGreedyMeshing() == enabled) {
+        return;
+    }
+    Chunk::setGreedyMeshing(enabled);
+    m_chunks.forEach([this](Chunk *chunk) {
+        chunk->markAllSectionsDirty();
+        if (hasMesh(chunk)) {
+            spawnVBOWorker(chunk);
+        }
+    });
+}
+
+void Terrain::setDeferredCaves(bool enabled)
+{
+    m_deferCaves = enabled;
+}
+
+size_t Terrain::getResidentZoneCount() const
+{
+    return m_generatedTerrain.size();
+}
+
+size_t Terrain::getHotChunkCount() const
+{
+    return m_hotChunks.size();
+}
+
+size_t Terrain::getColdChunkCount() const
+{
+    return m_regionStore->getColdChunkCount();
+}
+
+uint64_t Terrain::getWorldSeed() const
+{
+    return m_worldSeed;
+}
+
+GradientHash Terrain::getGradientHash() const
+{
+    return m_gradientHash;
+}
+
+bool Terrain::isHeadless() const
+{
+    return mp_context == nullptr;
+}
+
+bool Terrain::hasMesh(const Chunk *chunk) const
+{
+    return m_chunkDrawables.count(chunk) != 0;
+}
+
+ChunkDrawable *Terrain::findDrawable(const Chunk *chunk) const
+{
+    auto it = m_chunkDrawables.find(chunk);
+    return it != m_chunkDrawables.end() ? it->second.get() : nullptr;
+}
+
+size_t Terrain::uploadMesh(ChunkVBOdata &vbo)
+{
+    uPtr<ChunkDrawable> &drawable = m_chunkDrawables[vbo.mp_chunk];
+    if (!drawable) {
+        drawable = mkU<ChunkDrawable>(mp_context, vbo.mp_chunk, &m_bufferPool);
+        drawable->setRenderIndex(m_renderList.size());
+        m_renderList.push_back(RenderEntry{vbo.mp_chunk, drawable.get()});
+    }
+    size_t bytes = drawable->createVBOdata(vbo, m_meshArena.get());
+    noteMeshChange(vbo.mp_chunk);
+    return bytes;
+}
+
+void Terrain::destroyMesh(const Chunk *chunk)
+{
+    auto it = m_chunkDrawables.find(chunk);
+    if (it != m_chunkDrawables.end()) {
+        // the last entry takes its place in the render list
+        size_t index = it->second->getRenderIndex();
+        m_renderList[index] = m_renderList.back();
+        m_renderList[index].mesh->setRenderIndex(index);
+        m_renderList.pop_back();
+        it->second->destroyVBOdata();
+        m_chunkDrawables.erase(it);
+        noteMeshChange(chunk);
+    }
+}
+
+size_t Terrain::getZoneMeshBytes(int xCorner, int zCorner) const
+{
+    size_t bytes = 0;
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            const Chunk *chunk = findChunk(x, z);
+            ChunkDrawable *drawable = chunk != nullptr ? findDrawable(chunk) : nullptr;
+            if (drawable != nullptr) {
+                bytes += drawable->getGpuBytes();
+            }
+        }
+    }
+    return bytes;
+}
+
+void Terrain::poolZoneMeshes(int xCorner, int zCorner)
+{
+    size_t bytes = getZoneMeshBytes(xCorner, zCorner);
+    int64_t zoneKey = toKey(xCorner, zCorner);
+    unpoolZone(zoneKey);
+    m_pooledZones[zoneKey] = PooledZone{m_residencyClock, bytes};
+    m_pipelineStats.pooledZones++;
+    m_pipelineStats.pooledMeshBytes += bytes;
+    trimMeshPool();
+}
+
+bool Terrain::unpoolZone(int64_t zoneKey)
+{
+    auto it = m_pooledZones.find(zoneKey);
+    if (it == m_pooledZones.end()) {
+        return false;
+    }
+    m_pipelineStats.pooledZones--;
+    m_pipelineStats.pooledMeshBytes -= it->second.bytes;
+    m_pooledZones.erase(it);
+    return true;
+}
+
+/**
+ * @brief Terrain::trimMeshPool
+ *  Destroy the meshes of the zones pooled longest ago until the pool fits
+ *  its budget. Their chunks keep their section faces (see
+ *  Chunk::generateVBOdata), so coming back only expands those again.
+ */
+void Terrain::trimMeshPool()
+{
+    while (m_pipelineStats.pooledMeshBytes > m_meshPoolBudget && trimOldestPooledZone()) {}
+}
+
+bool Terrain::trimOldestPooledZone()
+{
+    if (m_pooledZones.empty()) {
+        return false;
+    }
+    auto oldest = m_pooledZones.begin();
+    for (auto it = m_pooledZones.begin(); it != m_pooledZones.end(); ++it) {
+        if (it->second.pooledAt < oldest->second.pooledAt) {
+            oldest = it;
+        }
+    }
+    glm::ivec2 coord = toCoords(oldest->first);
+    unpoolZone(oldest->first);
+    destroyZoneVBOs(coord[0], coord[1]);
+    return true;
+}
+
+// the zones around the player's whose meshes the GPU budget never takes
+static const int budgetKeptZones = 1;
+// zones the GPU budget evicts per expand(), bounding the frame time
+static const int budgetEvictionsPerCall = 2;
+// an evicted zone comes back once its meshes fit under this share of the
+// budget, so it does not go again as soon as it is drawn
+static const float budgetRestoreShare = 0.9f;
+
+/**
+ * @brief Terrain::fitGpuBudget
+ *  Over the budget, trim the pool, then evict the meshes of the farthest
+ *  kept zones, a few per call; under it, restore the nearest evicted zone
+ *  whose meshes fit again. A zone that leaves the kept ring is no longer
+ *  tracked: entering the grid again remeshes it anyway.
+ * @param playerX
+ * @param playerZ
+ */
+void Terrain::fitGpuBudget(float playerX, float playerZ)
+{
+    for (auto it = m_budgetEvictedZones.begin(); it != m_budgetEvictedZones.end();) {
+        if (m_prevBorderZones.count(it->first) == 0) {
+            it = m_budgetEvictedZones.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    int playerZoneX = static_cast<int>(glm::floor(playerX / 64.f));
+    int playerZoneZ = static_cast<int>(glm::floor(playerZ / 64.f));
+    auto zoneDistance = [&](int64_t zoneKey) {
+        glm::ivec2 coord = toCoords(zoneKey);
+        return std::max(std::abs(static_cast<int>(glm::floor(coord[0] / 64.f)) - playerZoneX),
+                        std::abs(static_cast<int>(glm::floor(coord[1] / 64.f)) - playerZoneZ));
+    };
+
+    if (MemoryStats::isOverBudget(MemoryCategory::gpuMeshes)) {
+        // nobody draws the pooled meshes
+        while (MemoryStats::isOverBudget(MemoryCategory::gpuMeshes) && trimOldestPooledZone()) {}
+
+        // (distance, zone key), farthest first
+        std::vector<std::pair<int, int64_t>> candidates;
+        for (int64_t zoneKey : m_prevBorderZones) {
+            int distance = zoneDistance(zoneKey);
+            if (distance > budgetKeptZones && m_budgetEvictedZones.count(zoneKey) == 0) {
+                candidates.push_back(std::make_pair(distance, zoneKey));
+            }
+        }
+        std::sort(candidates.rbegin(), candidates.rend());
+
+        int evicted = 0;
+        for (const std::pair<int, int64_t> &candidate : candidates) {
+            if (!MemoryStats::isOverBudget(MemoryCategory::gpuMeshes) || evicted == budgetEvictionsPerCall) {
+                break;
+            }
+            glm::ivec2 coord = toCoords(candidate.second);
+            size_t bytes = getZoneMeshBytes(coord[0], coord[1]);
+            if (bytes == 0) {
+                continue;
+            }
+            destroyZoneVBOs(coord[0], coord[1]);
+            m_budgetEvictedZones[candidate.second] = bytes;
+            m_pipelineStats.budgetEvictions++;
+            evicted++;
+        }
+    } else if (!m_budgetEvictedZones.empty()) {
+        auto nearest = m_budgetEvictedZones.begin();
+        for (auto it = m_budgetEvictedZones.begin(); it != m_budgetEvictedZones.end(); ++it) {
+            if (zoneDistance(it->first) < zoneDistance(nearest->first)) {
+                nearest = it;
+            }
+        }
+        int64_t budget = MemoryStats::getBudget(MemoryCategory::gpuMeshes);
+        if (budget <= 0 || MemoryStats::getBytes(MemoryCategory::gpuMeshes) + static_cast<int64_t>(nearest->second)
+                <= static_cast<int64_t>(budget * budgetRestoreShare)) {
+            glm::ivec2 coord = toCoords(nearest->first);
+            m_budgetEvictedZones.erase(nearest);
+            restoreZoneMeshes(coord[0], coord[1]);
+        }
+    }
+    m_pipelineStats.budgetEvictedZones = static_cast<int>(m_budgetEvictedZones.size());
+}
+
+void Terrain::restoreZoneMeshes(int xCorner, int zCorner)
+{
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            Chunk *chunk = getChunkAt(x, z).get();
+            if (chunk->getGenerationStage() != GenerationStage::decorated
+                    || m_chunkDrawables.count(chunk) != 0) {
+                continue;
+            }
+            if (chunk->isMeshCurrent()) {
+                spawnVBOWorker(chunk, false, true);
+            } else {
+                m_chunksAwaitingMesh.insert(chunk);
+            }
+        }
+    }
+}
+
+void Terrain::setMeshPoolBudget(size_t bytes)
+{
+    m_meshPoolBudget = bytes;
+    trimMeshPool();
+}
 
 // Combine two 32-bit ints into one 64-bit int
 // where the upper 32 bits are X and the lower 32 bits are Z
@@ -111,30 +709,54 @@ void setZoneMinMaxXZ(float playerX,
     maxZ = (zFloor + (halfGridSize + 1)) * 64;
 }
 
+glm::vec2 viewCircleCenter(float x, float z)
+{
+    return glm::vec2(glm::floor(x / 16.f) * 16.f + 8.f, glm::floor(z / 16.f) * 16.f + 8.f);
+}
+
+/**
+ * @brief isZoneInCircle
+ *  From a chunk center, the zone's nearest point clamped into the square
+ *  of its chunk centers is one of them.
+ */
+bool isZoneInCircle(int xCorner, int zCorner, glm::vec2 center, float radius)
+{
+    glm::vec2 nearest = glm::clamp(center, glm::vec2(xCorner + 8.f, zCorner + 8.f),
+                                   glm::vec2(xCorner + 56.f, zCorner + 56.f));
+    return glm::dot(nearest - center, nearest - center) <= radius * radius;
+}
+
 /**
  * @brief getZoneKeys
  *  The helper to generate (1 + 2 * halfRridSize) x (1 + 2 * halfRridSize) zones keys,
  *  centered at the zone where the player (playerX, playerZ) is.
+ *  In the calling thread's arena: the caller holds a LinearArena::Scope.
  *  Note: zone size => 64 x 256 x 64
  * @param playerX
  * @param playerZ
  * @param halfGridSize
+ * @param radius : blocks; keep only the zones in this circle around the
+ *  player's chunk (see isZoneInCircle), 0 for all of them
  * @return
  */
-std::unordered_set<int64_t> getZoneKeys(float playerX, float playerZ, int halfGridSize)
+ArenaSet<int64_t> getZoneKeys(float playerX, float playerZ, int halfGridSize, float radius = 0.f)
 {
 
     // init the output set
-    std::unordered_set<int64_t> zoneKeys = std::unordered_set<int64_t>();
+    ArenaSet<int64_t> zoneKeys;
+    zoneKeys.reserve((1 + 2 * halfGridSize) * (1 + 2 * halfGridSize));
 
     // get the current zone
     int minX, maxX, minZ, maxZ;
     setZoneMinMaxXZ(playerX, playerZ, halfGridSize, minX, maxX, minZ, maxZ);
 
     // iterate through the grid
+    glm::vec2 center = viewCircleCenter(playerX, playerZ);
     for (int x = minX; x < maxX; x += 64) {
         for (int z = minZ; z < maxZ; z += 64) {
-            zoneKeys.insert(toKey(x, z));
+            if (radius <= 0.f || isZoneInCircle(x, z, center, radius)) {
+                zoneKeys.insert(toKey(x, z));
+            }
         }
     }
 
@@ -178,27 +800,59 @@ std::unordered_set<int64_t> getBorderZoneKeys(float playerX, float playerZ, int
     return borderZoneKeys;
 }
 
-// Surround calls to this with try-catch if you don't know whether
-// the coordinates at x, y, z have a corresponding Chunk
-BlockType Terrain::getBlockAt(int x, int y, int z) const
+/**
+ * @brief Terrain::tryGetBlockAt
+ *  The block at a world-space coordinate, or std::nullopt if no resident
+ *  Chunk holds it. Heights outside [0, 256) read as EMPTY.
+ * @param x
+ * @param y
+ * @param z
+ * @return
+ */
+std::optional<BlockType> Terrain::tryGetBlockAt(int x, int y, int z) const
 {
-    if(hasChunkAt(x, z)) {
-        // Just disallow action below or above min/max height,
-        // but don't crash the game over it.
-        if(y < 0 || y >= 256) {
-            return EMPTY;
-        }
-        const uPtr<Chunk> &c = getChunkAt(x, z);
-        glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        return c->getBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
-                             static_cast<unsigned int>(y),
-                             static_cast<unsigned int>(z - chunkOrigin.y));
+    const Chunk *c = m_chunks.find(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (c == nullptr) {
+        return std::nullopt;
     }
-    else {
-        throw std::out_of_range("Coordinates " + std::to_string(x) +
+    // Just disallow action below or above min/max height,
+    // but don't crash the game over it.
+    if (y < 0 || y >= 256) {
+        return EMPTY;
+    }
+    // x & 15 is x minus the chunk's corner
+    return c->getBlockAtUnchecked(static_cast<unsigned int>(x & 15),
+                                  static_cast<unsigned int>(y),
+                                  static_cast<unsigned int>(z & 15));
+}
+
+std::optional<BlockType> Terrain::tryGetBlockAt(glm::vec3 p) const
+{
+    return tryGetBlockAt(p.x, p.y, p.z);
+}
+
+TerrainRayHit Terrain::raycast(glm::vec3 origin, glm::vec3 direction) const
+{
+    BlockCursor cursor(*this);
+    return castRay(cursor, TerrainRay(origin, direction));
+}
+
+void Terrain::raycast(const std::vector<TerrainRay> &rays, std::vector<TerrainRayHit> &hits)
+{
+    castRays(*this, m_jobs, rays, hits);
+}
+
+// Throws if the coordinates at x, y, z have no corresponding Chunk;
+// use tryGetBlockAt when that is not known in advance
+BlockType Terrain::getBlockAt(int x, int y, int z) const
+{
+    std::optional<BlockType> t = tryGetBlockAt(x, y, z);
+    if (!t) {
+        throw std::out_of_range("Coordinates " + std::to_string(x) +
                                 " " + std::to_string(y) + " " +
                                 std::to_string(z) + " have no Chunk!");
     }
+    return *t;
 }
 
 BlockType Terrain::getBlockAt(glm::vec3 p) const {
@@ -207,58 +861,101 @@ BlockType Terrain::getBlockAt(glm::vec3 p) const {
 
 /**
  * @brief Terrain::hasBlockAt
- *  Catch the error and return false if not exist
+ *  Whether a resident Chunk holds the coordinates
  * @param p
  * @return
  */
 bool Terrain::hasBlockAt(glm::vec3 p) const
 {
-    try
-    {
-        getBlockAt(p);
+    return tryGetBlockAt(p).has_value();
+}
+
+sPtr<const ZoneHeightMap> Terrain::findZoneHeightMap(int x, int z) const
+{
+    int zoneX = static_cast<int>(glm::floor(x / 64.f)) * 64;
+    int zoneZ = static_cast<int>(glm::floor(z / 64.f)) * 64;
+
+    m_zoneHeightMapsLock.lock();
+    auto it = m_zoneHeightMaps.find(toKey(zoneX, zoneZ));
+    sPtr<const ZoneHeightMap> heightMap = (it != m_zoneHeightMaps.end()) ? it->second : nullptr;
+    m_zoneHeightMapsLock.unlock();
+
+    if (heightMap != nullptr && heightMap->hasTile(x, z)) {
+        return heightMap;
     }
-    catch (...)
-    {
-        return false;
+    return nullptr;
+}
+
+/**
+ * @brief Terrain::getSurfaceHeight
+ * @param x
+ * @param z
+ * @return the terrain height of the column (x, z)
+ */
+int Terrain::getSurfaceHeight(int x, int z) const
+{
+    sPtr<const ZoneHeightMap> heightMap = findZoneHeightMap(x, z);
+    if (heightMap != nullptr) {
+        return heightMap->getHeight(x, z);
     }
-    return true;
+
+    // column not shaped yet
+    Noise noise(m_worldSeed, m_gradientHash);
+    return noise.getHeight(x, z);
+}
+
+glm::vec2 Terrain::getBiomeNoise(int x, int z) const
+{
+    sPtr<const ZoneHeightMap> heightMap = findZoneHeightMap(x, z);
+    if (heightMap != nullptr) {
+        return heightMap->getBiomeNoise(x, z);
+    }
+    Noise noise(m_worldSeed, m_gradientHash);
+    return noise.getBiomeNoise(x, z);
 }
 
 bool Terrain::hasChunkAt(int x, int z) const {
-    // Map x and z to their nearest Chunk corner
-    // By flooring x and z, then multiplying by 16,
-    // we clamp (x, z) to its nearest Chunk-space corner,
-    // then scale back to a world-space location.
-    // Note that floor() lets us handle negative numbers
-    // correctly, as floor(-1 / 16.f) gives us -1, as
+    // Map x and z to the coordinates of their Chunk.
+    // The arithmetic shift floors negative numbers
+    // correctly: -1 >> 4 gives us -1, as
     // opposed to (int)(-1 / 16.f) giving us 0 (incorrect!).
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks.find(toKey(16 * xFloor, 16 * zFloor)) != m_chunks.end();
+    return m_chunks.find(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z)) != nullptr;
+}
+
+const Chunk* Terrain::findChunk(int x, int z) const {
+    return m_chunks.find(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+}
+
+int Terrain::getColumnTop(int x, int z) const {
+    const Chunk *chunk = findChunk(x, z);
+    return chunk != nullptr ? chunk->getColumnTop(x & 15, z & 15) : -1;
 }
 
 
 uPtr<Chunk>& Terrain::getChunkAt(int x, int z) {
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks[toKey(16 * xFloor, 16 * zFloor)];
+    uPtr<Chunk> *chunk = m_chunks.findOwner(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (chunk == nullptr) {
+        throw std::out_of_range("Coordinates " + std::to_string(x) + " " + std::to_string(z) + " have no Chunk!");
+    }
+    return *chunk;
 }
 
 
 const uPtr<Chunk>& Terrain::getChunkAt(int x, int z) const {
-    int xFloor = static_cast<int>(glm::floor(x / 16.f));
-    int zFloor = static_cast<int>(glm::floor(z / 16.f));
-    return m_chunks.at(toKey(16 * xFloor, 16 * zFloor));
+    const uPtr<Chunk> *chunk = m_chunks.findOwner(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (chunk == nullptr) {
+        throw std::out_of_range("Coordinates " + std::to_string(x) + " " + std::to_string(z) + " have no Chunk!");
+    }
+    return *chunk;
 }
 
 void Terrain::setBlockAt(int x, int y, int z, BlockType t)
 {
-    if(hasChunkAt(x, z)) {
-        uPtr<Chunk> &c = getChunkAt(x, z);
-        glm::vec2 chunkOrigin = glm::vec2(floor(x / 16.f) * 16, floor(z / 16.f) * 16);
-        c->setBlockAt(static_cast<unsigned int>(x - chunkOrigin.x),
+    Chunk *c = m_chunks.find(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if(c != nullptr) {
+        c->setBlockAt(static_cast<unsigned int>(x & 15),
                       static_cast<unsigned int>(y),
-                      static_cast<unsigned int>(z - chunkOrigin.y),
+                      static_cast<unsigned int>(z & 15),
                       t);
     }
     else {
@@ -270,24 +967,24 @@ void Terrain::setBlockAt(int x, int y, int z, BlockType t)
 
 Chunk* Terrain::instantiateChunkAt(int x, int z) {
     // each instantiated chunk is a drawable item
-    uPtr<Chunk> chunk = mkU<Chunk>(this->mp_context);
+    uPtr<Chunk> chunk = m_chunkPool.acquire(x, z);
     Chunk *cPtr = chunk.get();
-    m_chunks[toKey(x, z)] = move(chunk);
+    m_chunks.insert(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z), move(chunk));
     // Set the neighbor pointers of itself and its neighbors
     if(hasChunkAt(x, z + 16)) {
-        auto &chunkNorth = m_chunks[toKey(x, z + 16)];
+        auto &chunkNorth = getChunkAt(x, z + 16);
         cPtr->linkNeighbor(chunkNorth, ZPOS);
     }
     if(hasChunkAt(x, z - 16)) {
-        auto &chunkSouth = m_chunks[toKey(x, z - 16)];
+        auto &chunkSouth = getChunkAt(x, z - 16);
         cPtr->linkNeighbor(chunkSouth, ZNEG);
     }
     if(hasChunkAt(x + 16, z)) {
-        auto &chunkEast = m_chunks[toKey(x + 16, z)];
+        auto &chunkEast = getChunkAt(x + 16, z);
         cPtr->linkNeighbor(chunkEast, XPOS);
     }
     if(hasChunkAt(x - 16, z)) {
-        auto &chunkWest = m_chunks[toKey(x - 16, z)];
+        auto &chunkWest = getChunkAt(x - 16, z);
         cPtr->linkNeighbor(chunkWest, XNEG);
     }
     return cPtr;
@@ -300,7 +997,8 @@ Chunk* Terrain::instantiateChunkAt(int x, int z) {
  * @param halfGridSize
  * @param shaderProgram
  */
-void Terrain::draw(float playerX, float playerZ, int halfGridSize, ShaderProgram *shaderProgram, TerrainDrawType drawType)
+void Terrain::draw(float playerX, float playerZ, int halfGridSize, ShaderProgram *shaderProgram, TerrainDrawType drawType,
+                   ShaderProgram *animatedProgram)
 {
     // get the grid of minX, maxX, minZ, maxZ by (playerX, playerZ)
     // MS2: set to Zone's min max
@@ -315,7 +1013,7 @@ void Terrain::draw(float playerX, float playerZ, int halfGridSize, ShaderProgram
                     maxZ);
 
     // use the original terrain::draw
-    draw(minX, maxX, minZ, maxZ, shaderProgram, drawType);
+    draw(minX, maxX, minZ, maxZ, shaderProgram, drawType, animatedProgram);
 
 }
 
@@ -325,765 +1023,3124 @@ void Terrain::draw(float playerX, float playerZ, int halfGridSize, ShaderProgram
 // Note: minX, maxX, minZ, maxZ should already be the origins of each chunk
 // USse Terrain::draw(float playerX, float playerZ, ShaderProgram*) in MyGL
 // to ensure the region around the player is drawn.
-void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram, TerrainDrawType drawType) {
-
-    // - Iterate through each chunk
-    // - Set the model matrix based on new X, Z
-    // - Let each chunk draw itself
-    for (int x = minX; x < maxX; x += 16) {
-        for (int z = minZ; z < maxZ; z += 16) {
-
-            // check has a chunk or not
-            if (!hasChunkAt(x, z)) {
-                // do nothing if no chunk at (x, z)
-                continue;
-            }
-
-            // get the pointer of the chunk at (x, z)
-            const uPtr<Chunk> &chunk = getChunkAt(x, z);
-
-            // only draw the chunk with vbo loaded
-            // skip if not loaded yet
-            if (!chunk->isVBOLoaded()) {
-                continue;
-            }
-
-            // set model matrix
-            glm::mat4 translation = glm::mat4(1.f);
-            translation[3] = glm::vec4(x, 0, z, 1);
-
-            shaderProgram->setModelMatrix(translation);
-            // use drawInterleavedTerrainDrawType to draw the interleaved buffer data given specific terrain draw type
-            shaderProgram->drawInterleavedTerrainDrawType(*chunk, drawType);
-        }
+void Terrain::draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram, TerrainDrawType drawType,
+                   ShaderProgram *animatedProgram) {
+    TerrainCullStats &stats = m_cullStats[drawType == TerrainDrawType::opaque ? 0 : 1];
+    stats = TerrainCullStats{0, 0, 0, 0, 0};
+    if (!m_visibleSectionsValid || m_visibleSectionsBounds != glm::ivec4(minX, maxX, minZ, maxZ)) {
+        findVisibleSections(minX, maxX, minZ, maxZ);
     }
+    drawChunks(minX, maxX, minZ, maxZ, shaderProgram, animatedProgram, drawType,
+               m_frustumCulling ? &m_cullFrustum : nullptr, m_sectionsOccluded, stats);
 }
 
-
 /**
- * @brief Terrain::checkThreadResults
+ * @brief Terrain::drawShadowCasters
+ *  The opaque pass alone, culled to the light's frustum. What the camera
+ *  cannot see still casts shadows into view, so nothing is occluded.
  */
-void Terrain::checkThreadResults()
+void Terrain::drawShadowCasters(float playerX, float playerZ, int halfGridSize,
+                                const glm::mat4 &lightViewProj, ShaderProgram *shaderProgram)
 {
-    // Send the result from FillBlocksWorkers to VBOWorkers
-    m_chunksWithBlocksLock.lock();
-    spawnVBOWorkers(m_chunksWithBlocks);
-    m_chunksWithBlocks.clear();
-    m_chunksWithBlocksLock.unlock();
-
-    // send to gpu
-    m_chunksWithVBOsLock.lock();
-    for (ChunkVBOdata &vbo : m_chunksWithVBOs) {
-        vbo.mp_chunk->createVBOdata(vbo);
-    }
-    m_chunksWithVBOs.clear();
-    m_chunksWithVBOsLock.unlock();
+    int minX, maxX, minZ, maxZ;
+    setZoneMinMaxXZ(playerX, playerZ, halfGridSize, minX, maxX, minZ, maxZ);
+    Frustum lightFrustum(lightViewProj);
+    TerrainCullStats stats{0, 0, 0, 0, 0};
+    drawChunks(minX, maxX, minZ, maxZ, shaderProgram, nullptr, TerrainDrawType::opaque, &lightFrustum, false, stats);
 }
 
-void Terrain::loadInitialTerrain(float playerX, float playerZ, int halfGridSize)
+/**
+ * @brief Terrain::drawChunks
+ * @param minX, maxX, minZ, maxZ : the chunks to draw
+ * @param shaderProgram
+ * @param animatedProgram : draws the chunks with animated faces in the
+ *  pass, after the others (which keeps the transparent pass sorted only
+ *  within each group); null: shaderProgram draws them all
+ * @param drawType
+ * @param frustum  : the sections outside it are skipped; null: none are
+ * @param occluded : skip the sections findVisibleSections did not reach
+ * @param stats    : counts what was drawn and culled
+ */
+void Terrain::drawChunks(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram,
+                         ShaderProgram *animatedProgram, TerrainDrawType drawType, const Frustum *frustum,
+                         bool occluded, TerrainCullStats &stats)
 {
-    // generate the zones around the player
-    std::unordered_set<int64_t> currZones = getZoneKeys(playerX, playerZ, halfGridSize);
-
-    // this is the initial terrain loader
-    // basically, no other terrain is created at this moment
-    // - iterate through zones, add each one to spawnFillBlocksWorker
-
-    for (int64_t currZoneKey : currZones) {
-
-        glm::ivec2 coord = toCoords(currZoneKey);
+    // - Bind the program once
+    // - Sort the drawable chunks by distance to the eye
+    // - Iterate through each chunk, keeping its sections in the frustum
+    // - Queue the chunks in the arena for one multi-draw, if enabled
+    // - Set the chunk origin based on new X, Z
+    // - Draw the others from their VAO, set up at upload
+    shaderProgram->useMe();
+    GLint defaultVao = 0;
+    mp_context->glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &defaultVao);
+    bool multiDraw = m_multiDraw != nullptr;
+    m_multiDrawCommands.clear();
+    m_multiDrawOrigins.clear();
+
+    // front to back for the early depth test, back to front for blending
+    m_drawOrder.clear();
+    for (const RenderEntry &entry : m_renderList) {
+        // skip the pooled meshes out of the box, and those with nothing
+        // for this pass
+        glm::ivec2 corner = entry.chunk->getCorner();
+        if (corner[0] < minX || corner[0] >= maxX || corner[1] < minZ || corner[1] >= maxZ) {
+            continue;
+        }
+        // and, with a view radius, the kept meshes of the box's corners
+        if (m_viewRadius > 0 && !isZoneInCircle(static_cast<int>(glm::floor(corner[0] / 64.f)) * 64,
+                                                static_cast<int>(glm::floor(corner[1] / 64.f)) * 64,
+                                                m_viewCenter, m_viewRadius * 16.f)) {
+            continue;
+        }
+        ChunkDrawable *mesh = entry.mesh;
+        int elemCount = drawType == TerrainDrawType::opaque ? mesh->elemCount() : mesh->transparentElemCount();
+        if (elemCount == 0) {
+            continue;
+        }
+        glm::vec2 toCenter = glm::vec2(corner[0] + 8.f, corner[1] + 8.f) - glm::vec2(m_cullEye.x, m_cullEye.z);
+        m_drawOrder.push_back(DrawEntry{glm::dot(toCenter, toCenter), entry.chunk, mesh});
+    }
+    if (drawType == TerrainDrawType::opaque) {
+        std::sort(m_drawOrder.begin(), m_drawOrder.end(),
+                  [](const DrawEntry &a, const DrawEntry &b) { return a.distance < b.distance; });
+    } else if (!m_unsortedTransparency) {
+        std::sort(m_drawOrder.begin(), m_drawOrder.end(),
+                  [](const DrawEntry &a, const DrawEntry &b) { return a.distance > b.distance; });
+    }
+    // the static chunks first, each group in the order above
+    size_t firstAnimated = m_drawOrder.size();
+    if (animatedProgram != nullptr) {
+        firstAnimated = std::stable_partition(m_drawOrder.begin(), m_drawOrder.end(), [drawType](const DrawEntry &entry) {
+            return !entry.mesh->hasAnimatedFaces(drawType);
+        }) - m_drawOrder.begin();
+    }
 
-        spawnFillBlocksWorker(coord[0], coord[1]);
-        m_generatedTerrain.insert(currZoneKey);
+    for (size_t i = 0; i < m_drawOrder.size(); i++) {
+        if (i == firstAnimated) {
+            // the static chunks' multi-draw goes with their program
+            mp_context->glBindVertexArray(defaultVao);
+            flushMultiDraw();
+            animatedProgram->useMe();
+        }
+        const DrawEntry &entry = m_drawOrder[i];
+        ChunkDrawable *mesh = entry.mesh;
+        if (!collectVisibleRuns(*entry.chunk, *mesh, drawType, frustum, occluded, stats)) {
+            continue;
+        }
+        glm::ivec2 corner = entry.chunk->getCorner();
+
+        if (multiDraw && mesh->isInArena()) {
+            size_t offset = drawType == TerrainDrawType::opaque ? mesh->posOffset() : mesh->transparentDataOffset();
+            // 8 bytes per vertex; arena ranges are aligned far past that
+            GLint baseVertex = static_cast<GLint>(offset / (2 * sizeof(GLuint)));
+            for (const glm::uvec2 &run : m_drawRuns) {
+                GLuint instance = static_cast<GLuint>(m_multiDrawCommands.size());
+                m_multiDrawCommands.push_back({run[1] * 6, 1, run[0] * 6, baseVertex, instance});
+                m_multiDrawOrigins.push_back(corner);
+            }
+            continue;
+        }
 
+        // the chunk's origin, read by every vertex of its draws: the
+        // chunk VAOs leave vs_ChunkOrigin's array disabled
+        mp_context->glVertexAttribI2i(ShaderProgram::chunkOriginAttribLocation, corner[0], corner[1]);
+        if (mesh->bindVAO(drawType)) {
+            ShaderProgram *program = i < firstAnimated ? shaderProgram : animatedProgram;
+            for (const glm::uvec2 &run : m_drawRuns) {
+                program->drawBoundElements(*mesh, run[0] * 6, run[1] * 6);
+            }
+        }
     }
 
-    // update the border zone
-    m_prevBorderZones = currZones;
-    m_initialTerrainLoaded = true;
+    mp_context->glBindVertexArray(defaultVao);
+    flushMultiDraw();
+    mp_context->printGLErrorLog();
 }
 
-/**
- * @brief Terrain::destroyZoneVBOs
- *  Destroy all the vbos of the chunks in the zone
- *  Note: zone 64 x 256 x 64
- */
-void Terrain::destroyZoneVBOs(int xCorner, int zCorner)
+void Terrain::flushMultiDraw()
 {
-    for (int x = xCorner; x < xCorner + 64; x += 16) {
-        for (int z = zCorner; z < zCorner + 64; z += 16) {
-            // find the chunk =>
-            if (hasChunkAt(x, z)) {
-                Chunk *chunk = getChunkAt(x, z).get();
-                // only deload the vbo when it is loaded
-                if (chunk->isVBOLoaded()) {
-                    chunk->destroyVBOdata();
-                }
-            }
-        }
+    if (!m_multiDrawCommands.empty()) {
+        m_multiDraw->draw(m_multiDrawCommands, m_multiDrawOrigins, ChunkDrawable::getQuadIndexBuffer());
     }
+    m_multiDrawCommands.clear();
+    m_multiDrawOrigins.clear();
 }
 
 /**
- * @brief Terrain::expand
- *  For MS1: 3 x 3 chunk
- *  For MS2: 5 x 5 zones
- * @param playerX
- * @param playerZ
- * @param halfGridSize
+ * @brief Terrain::collectVisibleRuns
+ *  The chunk's box, trimmed to its sections with quads, is tested first;
+ *  only a chunk in view has its sections tested, against the frustum and
+ *  then against the sections findVisibleSections reached. The visible
+ *  sections are emitted in m_sectionOrder; those that follow each other
+ *  in the buffer as well (the empty ones between them included) form one
+ *  run.
+ * @param chunk
+ * @param mesh     : the chunk's uploaded mesh
+ * @param drawType
+ * @param frustum  : null: every section is visible
+ * @param occluded : also test the sections against m_visibleSections
+ * @param stats : counts the chunks and non-empty sections
+ * @return false if nothing of the chunk is visible
  */
-void Terrain::expand(float playerX, float playerZ, int halfGridSize)
+bool Terrain::collectVisibleRuns(const Chunk &chunk, const ChunkDrawable &mesh, TerrainDrawType drawType,
+                                 const Frustum *frustum, bool occluded, TerrainCullStats &stats)
 {
-    // get the border zones to start
-    std::unordered_set<int64_t> currZones = getZoneKeys(playerX, playerZ, halfGridSize);
-    std::unordered_set<int64_t> currBorderZones = getBorderZoneKeys(playerX, playerZ, halfGridSize);
+    m_drawRuns.clear();
+    const std::array<uint32_t, 17> &starts = mesh.getSectionQuadStarts(drawType);
 
-    // destroy VBOs if in m_loadedZones but not in currZones
-    for (int64_t prevZoneKey : m_prevBorderZones) {
-        if (currZones.find(prevZoneKey) == currZones.end()) {
-            // no such key => not the current border (destroy VBOs)
-            glm::ivec2 coord = toCoords(prevZoneKey);
-            destroyZoneVBOs(coord[0], coord[1]);
-        }
+    if (frustum == nullptr) {
+        stats.visibleChunks++;
+        m_drawRuns.push_back(glm::uvec2(0, starts[16]));
+        return true;
     }
 
-    // check current border zones
-    for (int64_t currZoneKey : currZones) {
+    int lowest = 0;
+    while (lowest < 16 && starts[lowest + 1] == starts[lowest]) {
+        lowest++;
+    }
+    int highest = 15;
+    while (highest > lowest && starts[highest + 1] == starts[highest]) {
+        highest--;
+    }
+    int sections = 0;
+    for (int sy = lowest; sy <= highest; sy++) {
+        sections += starts[sy + 1] > starts[sy] ? 1 : 0;
+    }
 
-        glm::ivec2 coord = toCoords(currZoneKey);
+    glm::ivec2 corner = chunk.getCorner();
+    glm::vec3 min(corner[0], lowest * 16, corner[1]);
+    glm::vec3 max(corner[0] + 16, (highest + 1) * 16, corner[1] + 16);
+    if (lowest == 16 || !frustum->intersectsBox(min, max)) {
+        stats.culledChunks++;
+        stats.culledSections += sections;
+        return false;
+    }
 
-        if (m_generatedTerrain.find(currZoneKey) == m_generatedTerrain.end()) {
-            // the zone hasn't been created yet
-            spawnFillBlocksWorker(coord[0], coord[1]);
-            m_generatedTerrain.insert(currZoneKey);
-        }
+    uint16_t reached = 0xFFFF;
+    if (occluded) {
+        auto it = m_visibleSections.find(&chunk);
+        reached = it != m_visibleSections.end() ? it->second : 0;
+    }
 
-        else if (m_prevBorderZones.find(currZoneKey) == m_prevBorderZones.end())
-        {
-            // zone has been created
-            // but this zone is not in the previous frame
-            // re-create the vbo
-            for (int x = coord[0]; x < coord[0] + 64; x += 16) {
-                for (int z = coord[1]; z < coord[1] + 64; z += 16) {
-                    Chunk *chunk = getChunkAt(x, z).get();
-                    spawnVBOWorker(chunk);
-                }
-            }
+    uint16_t visible = 0;
+    for (int sy = lowest; sy <= highest; sy++) {
+        uint32_t quads = starts[sy + 1] - starts[sy];
+        if (quads == 0) {
+            continue;
+        }
+        min.y = sy * 16;
+        max.y = (sy + 1) * 16;
+        if (!frustum->intersectsBox(min, max)) {
+            stats.culledSections++;
+            continue;
+        }
+        if (!(reached & (1u << sy))) {
+            stats.occludedSections++;
+            continue;
+        }
+        stats.visibleSections++;
+        visible |= 1u << sy;
+    }
 
+    // a section right after the run in the buffer (the empty ones
+    // between them included) extends it
+    static const std::array<int, 16> bottomUp = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+    const std::array<int, 16> &order = drawType == TerrainDrawType::opaque ? m_sectionOrder[0]
+            : m_unsortedTransparency ? bottomUp : m_sectionOrder[1];
+    for (int sy : order) {
+        if (!(visible & (1u << sy))) {
+            continue;
+        }
+        uint32_t quads = starts[sy + 1] - starts[sy];
+        if (!m_drawRuns.empty() && m_drawRuns.back()[0] + m_drawRuns.back()[1] == starts[sy]) {
+            m_drawRuns.back()[1] += quads;
+        } else {
+            m_drawRuns.push_back(glm::uvec2(starts[sy], quads));
         }
     }
 
-    // update the loaded zone
-    m_prevBorderZones = currZones;
+    if (m_drawRuns.empty()) {
+        stats.culledChunks++;
+        return false;
+    }
+    stats.visibleChunks++;
+    return true;
+}
 
+void Terrain::setUnsortedTransparency(bool unsorted)
+{
+    m_unsortedTransparency = unsorted;
 }
 
+void Terrain::setCullingView(const glm::mat4 &viewProj, const glm::vec3 &eye)
+{
+    m_frustumCulling = true;
+    m_cullFrustum = Frustum(viewProj);
+    m_cullEye = eye;
+    m_visibleSectionsValid = false;
+    int eyeSection = glm::clamp(static_cast<int>(glm::floor(eye.y / 16.f)), 0, 15);
+    if (eyeSection != m_eyeSection) {
+        updateSectionOrder(eyeSection);
+    }
+}
 
 /**
- * @brief Terrain::instantiateChunkAndFillBlocks
- *  This helper is used to fill the blocks in the chunk
- * @param chunkX : int, the chunk's origin X
- * @param chunkZ : int, the chunk's origin Z
+ * @brief Terrain::updateSectionOrder
+ *  Back to front, for the transparent pass: the sections below the eye's
+ *  layer bottom up, those above it top down, then the eye's own layer;
+ *  the sections on either side barely overlap on screen. The opaque pass
+ *  takes the reverse, front to back. Ascending below the eye (opaque:
+ *  above it), so those sections still merge into one run.
+ * @param eyeSection
  */
-void Terrain::instantiateChunkAndfillBlocks(int chunkX, int chunkZ)
+void Terrain::updateSectionOrder(int eyeSection)
 {
-    // instantiate the chunk
-    instantiateChunkAt(chunkX, chunkZ);
-
-    Noise terrainHeightMap;
+    m_eyeSection = eyeSection;
+    std::array<int, 16> &transparent = m_sectionOrder[1];
+    int i = 0;
+    for (int sy = 0; sy < eyeSection; sy++) {
+        transparent[i++] = sy;
+    }
+    for (int sy = 15; sy > eyeSection; sy--) {
+        transparent[i++] = sy;
+    }
+    transparent[i] = eyeSection;
 
-    for (int x = chunkX; x < chunkX + 16; x++) {
+    std::array<int, 16> &opaque = m_sectionOrder[0];
+    i = 0;
+    opaque[i++] = eyeSection;
+    for (int sy = eyeSection + 1; sy < 16; sy++) {
+        opaque[i++] = sy;
+    }
+    for (int sy = eyeSection - 1; sy >= 0; sy--) {
+        opaque[i++] = sy;
+    }
+}
 
-        for (int z = chunkZ; z < chunkZ + 16; z++) {
+/**
+ * @brief Terrain::findVisibleSections
+ *  Breadth-first from the eye's section over the sections in the frustum:
+ *  a section entered through one face is left only through faces its
+ *  non-opaque blocks connect to that one (ChunkDrawable::canSeeThrough), and never
+ *  back against a direction already taken, so the search cannot bend
+ *  around towards the eye. Chunks without a mesh yet are seen through.
+ *  Without a drawn chunk at the eye (or outside the world's height)
+ *  nothing is occluded.
+ * @param minX, maxX, minZ, maxZ : the drawn chunks
+ */
+void Terrain::findVisibleSections(int minX, int maxX, int minZ, int maxZ)
+{
+    m_visibleSections.clear();
+    m_sectionsOccluded = false;
+    m_visibleSectionsBounds = glm::ivec4(minX, maxX, minZ, maxZ);
+    m_visibleSectionsValid = true;
+    if (!m_frustumCulling) {
+        return;
+    }
 
-            // TODO: wrap up the logics later
-            double y = terrainHeightMap.getHeight(x,z);
+    glm::ivec3 eye = glm::ivec3(glm::floor(m_cullEye));
+    if (eye.y < 0 || eye.y >= 256 || !hasChunkAt(eye.x, eye.z)) {
+        return;
+    }
+    Chunk *start = getChunkAt(eye.x, eye.z).get();
+    glm::ivec2 corner = start->getCorner();
+    if (corner[0] < minX || corner[0] >= maxX || corner[1] < minZ || corner[1] >= maxZ) {
+        return;
+    }
 
-            if( y < 136){
-                setBlockAt(x, y, z, WATER);
-                for(int y_dirt=128; y_dirt<y; y_dirt++){
-                    setBlockAt(x, y_dirt, z, WATER);
-                }
+    struct Step
+    {
+        Chunk *chunk;
+        // its uploaded mesh, or null
+        const ChunkDrawable *mesh;
+        int sy;
+        // the face it was entered through, or -1 at the eye
+        int from;
+        // bit per Direction taken to get here
+        unsigned int traveled;
+    };
+    std::vector<Step> queue;
+    queue.push_back(Step{start, findDrawable(start), eye.y >> 4, -1, 0});
+    m_visibleSections[start] = static_cast<uint16_t>(1u << (eye.y >> 4));
+
+    for (size_t head = 0; head < queue.size(); head++) {
+        Step step = queue[head];
+        for (int d = 0; d < 6; d++) {
+            Direction dir = static_cast<Direction>(d);
+            // Direction pairs each axis' positive and negative side
+            int opposite = d ^ 1;
+            if (step.traveled & (1u << opposite)) {
+                continue;
             }
-            else if( y < 142){
-                setBlockAt(x, y, z, GRASS);
-                for(int y_dirt=128; y_dirt<y; y_dirt++){
-                    setBlockAt(x, y_dirt, z, DIRT);
-                }
+            if (step.from >= 0 && step.mesh != nullptr
+                    && !step.mesh->canSeeThrough(step.sy, static_cast<Direction>(step.from), dir)) {
+                continue;
             }
-            else if (y > 190){
-                setBlockAt(x, y, z, SNOW);
-                for(int y_stone=128; y_stone<y; y_stone++){
-                    setBlockAt(x, y_stone, z, STONE);
-                }
+
+            Chunk *next = step.chunk;
+            int sy = step.sy;
+            if (dir == YPOS || dir == YNEG) {
+                sy += dir == YPOS ? 1 : -1;
+            } else {
+                next = step.chunk->getNeighbor(dir);
             }
-            else{
-                setBlockAt(x, y, z, STONE);
-                for(int y_dirt=128; y_dirt<y; y_dirt++){
-                    setBlockAt(x, y_dirt, z, DIRT);
-                }
+            if (sy < 0 || sy >= 16 || next == nullptr) {
+                continue;
             }
-
-            // Set DIRT from 0-128 height values
-            for(int y_underground=0; y_underground<128;y_underground++){
-                setBlockAt(x, y_underground, z, STONE);
+            glm::ivec2 c = next->getCorner();
+            if (c[0] < minX || c[0] >= maxX || c[1] < minZ || c[1] >= maxZ) {
+                continue;
             }
 
+            uint16_t &reached = m_visibleSections[next];
+            if (reached & (1u << sy)) {
+                continue;
+            }
+            if (!m_cullFrustum.intersectsBox(glm::vec3(c[0], sy * 16, c[1]),
+                                             glm::vec3(c[0] + 16, sy * 16 + 16, c[1] + 16))) {
+                continue;
+            }
+            reached |= static_cast<uint16_t>(1u << sy);
+            const ChunkDrawable *nextMesh = next == step.chunk ? step.mesh : findDrawable(next);
+            queue.push_back(Step{next, nextMesh, sy, opposite, step.traveled | (1u << d)});
         }
-
     }
+    m_sectionsOccluded = true;
 }
 
+void Terrain::cull(float playerX, float playerZ, int halfGridSize)
+{
+    int minX, maxX, minZ, maxZ;
+    setZoneMinMaxXZ(playerX, playerZ, halfGridSize, minX, maxX, minZ, maxZ);
+    findVisibleSections(minX, maxX, minZ, maxZ);
+}
 
 /**
- * @brief Terrain::putBlockAt
- *  Set the block at (x, y, z) as a block t,
- *  then destroy the chunk's VBO containing this block (to reload).
- * @param x
- * @param y
- * @param z
- * @param t
+ * @brief Terrain::collectLights
+ *  Walks the render list rather than the grid: the meshes pooled past it
+ *  are too far to count anyway.
+ * @param range : in blocks from the eye, the light's own reach added
+ * @param lights
  */
-void Terrain::placeBlockAt(int x, int y, int z, BlockType t)
+void Terrain::collectLights(float range, std::vector<PointLight> &lights) const
 {
-    // set to block type t
-    setBlockAt(x, y, z, t);
-
-    // find the corresponding chunk origin with block's (x, z)
-    int chunkX = static_cast<int>(glm::floor(x / 16.f)) * 16;
-    int chunkZ = static_cast<int>(glm::floor(z / 16.f)) * 16;
-
-    if (!hasChunkAt(chunkX, chunkZ)) {
-        // no chunk at this place
-        // not allow to place any block where there's no chunk.
-        return;
+    lights.clear();
+    for (const RenderEntry &entry : m_renderList) {
+        const std::vector<PointLight> &chunkLights = entry.mesh->getLights();
+        if (chunkLights.empty()) {
+            continue;
+        }
+        // within range of the chunk, its center off by half a diagonal and
+        // a light reaching at most 15 blocks (the brightest emission)
+        glm::ivec2 corner = entry.chunk->getCorner();
+        glm::vec2 center = glm::vec2(corner) + 8.f - glm::vec2(m_cullEye.x, m_cullEye.z);
+        if (glm::length(center) > range + 12.f + 15.f) {
+            continue;
+        }
+        for (const PointLight &light : chunkLights) {
+            if (glm::distance(light.position, m_cullEye) > range + light.radius) {
+                continue;
+            }
+            if (m_frustumCulling
+                && !m_cullFrustum.intersectsBox(light.position - light.radius, light.position + light.radius)) {
+                continue;
+            }
+            lights.push_back(light);
+        }
     }
+}
 
-    // create the VBO again
-    const uPtr<Chunk> &chunk = getChunkAt(chunkX, chunkZ);
-    ChunkVBOdata vbo = chunk->generateVBOdata();
-    // update the one in the map
-    vbo.mp_chunk->createVBOdata(vbo);
-    // m_chunkVBOs[chunk.get()] = vbo;
-    // chunk->createVBOdata(vbo);
-
+TerrainCullStats Terrain::getCullStats(TerrainDrawType drawType) const
+{
+    return m_cullStats[drawType == TerrainDrawType::opaque ? 0 : 1];
 }
 
 /**
- * @brief Terrain::spawnFillBlocksWorker
- * @param xCorner : int, the xCorner of a zone
- * @param zCorner : int, the zCorner of a zone
+ * @brief Terrain::getChunkDebugInfo
+ *  A section counts as visible as collectVisibleRuns would find it: in
+ *  the drawn box, in the frustum and, while the sections are occluded,
+ *  reached from the eye. Only what is already kept is read, so this costs
+ *  nothing when no debug view asks.
+ * @param chunks
  */
-void Terrain::spawnFillBlocksWorker(int xCorner, int zCorner)
+void Terrain::getChunkDebugInfo(std::vector<ChunkDebugInfo> &chunks) const
 {
-    // collect all the chunks in this zone
-    std::unordered_map<int64_t, Chunk*> chunks = std::unordered_map<int64_t, Chunk*>();
+    chunks.clear();
+    bool occluded = m_visibleSectionsValid && m_sectionsOccluded;
+    m_chunks.forEach([&](Chunk *chunk) {
+        ChunkDebugInfo info;
+        info.corner = chunk->getCorner();
+        info.top = chunk->getOccupiedTop();
+        info.sectionTriangles.fill(0);
+        info.visibleSections = 0;
+        info.meshNs = 0;
+        info.meshings = 0;
+
+        const ChunkDrawable *mesh = findDrawable(chunk);
+        if (m_chunksAwaitingStage.count(chunk) != 0 || m_chunksAwaitingMesh.count(chunk) != 0) {
+            info.state = ChunkDebugState::queued;
+        } else if (chunk->getGenerationStage() != GenerationStage::decorated) {
+            info.state = ChunkDebugState::generating;
+        } else if (mesh == nullptr || m_chunksRemeshing.count(chunk) != 0) {
+            info.state = ChunkDebugState::meshing;
+        } else {
+            info.state = ChunkDebugState::uploaded;
+        }
 
-    for (int x = xCorner; x < xCorner + 64; x += 16) {
-        for (int z = zCorner; z < zCorner + 64; z += 16) {
-            Chunk *chunk = instantiateChunkAt(x, z);
-            chunks[toKey(x, z)] = chunk;
+        if (mesh != nullptr) {
+            const std::array<uint32_t, 17> &opaque = mesh->getSectionQuadStarts(TerrainDrawType::opaque);
+            const std::array<uint32_t, 17> &transparent = mesh->getSectionQuadStarts(TerrainDrawType::transparent);
+            info.meshNs = mesh->getMeshNs();
+            info.meshings = mesh->getUploadCount();
+
+            glm::ivec2 corner = info.corner;
+            bool inBox = !m_visibleSectionsValid
+                    || (corner[0] >= m_visibleSectionsBounds[0] && corner[0] < m_visibleSectionsBounds[1]
+                        && corner[1] >= m_visibleSectionsBounds[2] && corner[1] < m_visibleSectionsBounds[3]);
+            bool drawn = false;
+            uint16_t reached = 0xFFFF;
+            if (occluded) {
+                auto it = m_visibleSections.find(chunk);
+                reached = it != m_visibleSections.end() ? it->second : 0;
+            }
+            for (int sy = 0; sy < 16; sy++) {
+                uint32_t quads = opaque[sy + 1] - opaque[sy] + transparent[sy + 1] - transparent[sy];
+                info.sectionTriangles[sy] = 2 * quads;
+                drawn = drawn || quads != 0;
+                glm::vec3 min(corner[0], sy * 16, corner[1]);
+                glm::vec3 max(corner[0] + 16, (sy + 1) * 16, corner[1] + 16);
+                if (quads != 0 && inBox && (reached & (1u << sy))
+                        && (!m_frustumCulling || m_cullFrustum.intersectsBox(min, max))) {
+                    info.visibleSections |= 1u << sy;
+                }
+            }
+            if (info.state == ChunkDebugState::uploaded && drawn && info.visibleSections == 0) {
+                info.state = ChunkDebugState::culled;
+            }
         }
-    }
+        chunks.push_back(info);
+    });
+}
 
-    FillBlocksWorker *worker = new FillBlocksWorker(xCorner, zCorner,
-                                                    chunks,
-                                                    &m_chunksWithBlocks,
-                                                    &m_chunksWithBlocksLock);
-    QThreadPool::globalInstance()->start(worker);
+void Terrain::setMeshChangeTracking(bool enabled)
+{
+    m_trackMeshChanges = enabled;
+    m_meshChanges.clear();
 }
 
+void Terrain::takeMeshChanges(std::vector<glm::ivec2> &corners)
+{
+    corners.clear();
+    std::swap(corners, m_meshChanges);
+}
 
-/**
- * @brief Terrain::spawnVBOWorker
- * @param mp_chunk
- */
-void Terrain::spawnVBOWorker(Chunk* mp_chunk)
+void Terrain::noteMeshChange(const Chunk *chunk)
 {
-    VBOWorker *worker = new VBOWorker(mp_chunk,
-                                      &m_chunksWithVBOs,
-                                      &m_chunksWithVBOsLock);
-    QThreadPool::globalInstance()->start(worker);
+    if (m_trackMeshChanges) {
+        m_meshChanges.push_back(chunk->getCorner());
+    }
 }
 
 
+// the weight of the newest call in TerrainPipelineStats::averageUploadBytes
+static const float uploadAverageWeight = 0.05f;
+
 /**
- * @brief Terrain::spawnVBOWorkers
- * @param completedChunksWithBlocks
+ * @brief Terrain::checkThreadResults
  */
-void Terrain::spawnVBOWorkers(const std::unordered_set<Chunk*> &completedChunksWithBlocks)
+void Terrain::checkThreadResults()
 {
-    for (Chunk *ck : completedChunksWithBlocks) {
-        spawnVBOWorker(ck);
+    ProfileZone zone("Terrain::checkThreadResults");
+    m_pipelineStats.lastUploadBytes = 0;
+    uint64_t uploadsBefore = m_pipelineStats.uploads;
+    // uploads and dropped chunks change what is in view
+    m_visibleSectionsValid = false;
+    // the edits buffered while the last journal commit was in flight
+    m_editJournal->commit();
+    if (m_meshCache) {
+        m_meshCache->submitWrites();
     }
-}
-
-//--------------------------
-// Thread Workers
-//--------------------------
-FillBlocksWorker::FillBlocksWorker(int x,
-                                   int z,
-                                   std::unordered_map<int64_t, Chunk*> chunks,
-                                   std::unordered_set<Chunk*> *completedChunks,
-                                   QMutex *completedChunksLock)
-    : xCorner(x), zCorner(z),
-      chunks(chunks),
-      completedChunks(completedChunks), completedChunksLock(completedChunksLock)
-{}
+    collectStoredZones();
+    collectComputedZones();
+    collectComputedMeshes();
 
-void FillBlocksWorker::setFloatingTerrain(Chunk *chunk, int chunkCornerX, int x, int chunkCornerZ, int z, int height){
+    // Collect the chunks that finished a generation stage
+    collectReportedChunks();
 
-    int xBound = chunkCornerX + x;
-    int zBound = chunkCornerZ + z;
-
-    if(xBound >= 200 & zBound >= 250){
-        for(int y=height; y<=height+10; y++){
-            if (y > height + 4){
-                chunk->setBlockAt(x, y, z, DIAMOND);
+    // Move each chunk on to its next stage once its neighbors allow it;
+    // decorated chunks (and their loaded neighbors) wait to be meshed
+    std::unordered_set<Chunk*> chunksWithBlocks = std::unordered_set<Chunk*>();
+    for (auto it = m_chunksAwaitingStage.begin(); it != m_chunksAwaitingStage.end();) {
+        Chunk *chunk = *it;
+        GenerationStage stage = chunk->getGenerationStage();
+
+        if (stage == GenerationStage::decorated) {
+            int64_t key = toKey(chunk->getCorner()[0], chunk->getCorner()[1]);
+            // one loaded from the region store holds its structure blocks
+            m_structureWritesApplied.emplace(key, getStructureWriteCount(key));
+            auto received = m_receivedChunks.find(key);
+            if (received != m_receivedChunks.end()) {
+                applyReceivedChunk(chunk, received->second);
+                m_receivedChunks.erase(received);
             }
-            else{
-                chunk->setBlockAt(x, y, z, COBBLESTONE);
+            applyReplayedEdits(chunk);
+            chunksWithBlocks.insert(chunk);
+            for (Chunk *neighbor : chunk->getNeighborhood()) {
+                if (neighbor != nullptr && hasMesh(neighbor)) {
+                    // its border faces and light depend on this chunk
+                    neighbor->markAllSectionsDirty();
+                    chunksWithBlocks.insert(neighbor);
+                }
             }
+            it = m_chunksAwaitingStage.erase(it);
+            continue;
         }
-    }
-}
-
-
-void FillBlocksWorker::setSurfaceTerrain(Chunk *chunk, int chunkCornerX, int x, int chunkCornerZ,int z, int height){
 
-    if( height < 136){
-        for(int y_dirt=128; y_dirt<136; y_dirt++){
-            chunk->setBlockAt(x, y_dirt, z, WATER);
+        GenerationStage next = static_cast<GenerationStage>(static_cast<int>(stage) + 1);
+        if (isReadyForStage(chunk, next)) {
+            spawnStageWorker(chunk, next);
+            it = m_chunksAwaitingStage.erase(it);
+        } else {
+            ++it;
         }
-
     }
 
-    else if( height < 142){
-        chunk->setBlockAt(x, height, z, GRASS);
-        for(int y_dirt=128; y_dirt<height; y_dirt++){
-            chunk->setBlockAt(x, y_dirt, z, DIRT);
+    m_chunksAwaitingMesh.insert(chunksWithBlocks.begin(), chunksWithBlocks.end());
+    // before the first meshes, so a chunk stamped now is meshed with its share
+    collectStructureSpills();
+    stampStructureWrites();
+    spawnReadyVBOWorkers();
+    advanceRings();
+    applyCarvedCaves();
+    carveNearbyCaves();
+    applyRelaidChunks();
+
+    reclaimChunkSections();
+
+    // send to gpu: the generated chunks within the upload budget, then
+    // every edit, which supersedes the chunk's pending generated mesh;
+    // the workers keep pushing meanwhile, nothing here blocks them
+    collectFinishedVBOs();
+    uploadPending();
+
+    std::vector<ChunkVBOdata> editedChunkVBOs;
+    m_editedChunkVBOs.takeAll(editedChunkVBOs);
+
+    if (!editedChunkVBOs.empty()) {
+        std::unordered_set<Chunk*> editedChunks;
+        for (ChunkVBOdata &vbo : editedChunkVBOs) {
+            requestNeighborRelight(vbo);
+            noteUpload(vbo, uploadMesh(vbo));
+            m_chunksRemeshing.erase(vbo.mp_chunk);
+            editedChunks.insert(vbo.mp_chunk);
+        }
+        for (auto it = m_pendingUploads.begin(); it != m_pendingUploads.end();) {
+            if (editedChunks.count(it->mp_chunk) != 0) {
+                it->discardStaged();
+                it = m_pendingUploads.erase(it);
+            } else {
+                ++it;
+            }
         }
-    }
 
-    else if (height > 180){
-        chunk->setBlockAt(x, height, z, SNOW);
-        for(int y_stone=128; y_stone<height; y_stone++){
-            chunk->setBlockAt(x, y_stone, z, STONE);
+        // edits made while their chunk was being remeshed
+        std::unordered_set<Chunk*> chunksToRemesh;
+        chunksToRemesh.swap(m_chunksToRemesh);
+        for (Chunk *chunk : chunksToRemesh) {
+            requestEditRemesh(chunk);
         }
     }
-    else{
-        chunk->setBlockAt(x, height, z, STONE);
-        for(int y_dirt=128; y_dirt<height; y_dirt++){
-            chunk->setBlockAt(x, y_dirt, z, DIRT);
-        }
+
+    // reuse the mesh ranges the GPU is done with
+    if (m_meshArena) {
+        m_meshArena->recycle();
+    }
+    // and delete, a few at a time, the departed zones' buffers the pool
+    // had no room for
+    m_bufferPool.recycle();
+
+    m_pipelineStats.averageUploadBytes += (m_pipelineStats.lastUploadBytes - m_pipelineStats.averageUploadBytes)
+            * uploadAverageWeight;
+    m_frameActivity.uploads = m_pipelineStats.uploads - uploadsBefore;
+    m_frameActivity.uploadBytes = m_pipelineStats.lastUploadBytes;
+}
+
+void Terrain::collectReportedChunks()
+{
+    std::vector<Chunk*> reported;
+    m_chunksWithBlocks.takeAll(reported);
+    m_chunksAwaitingStage.insert(reported.begin(), reported.end());
+    m_chunksToReclaim.insert(reported.begin(), reported.end());
+}
+
+void Terrain::collectFinishedVBOs()
+{
+    std::vector<ChunkVBOdata> finished;
+    m_chunksWithVBOs.takeAll(finished);
+    for (const ChunkVBOdata &vbo : finished) {
+        requestNeighborRelight(vbo);
+    }
+    queueUploads(finished);
+}
+
+/**
+ * @brief Terrain::queueUploads
+ *  A result replaces the pending one of its chunk: it was meshed later.
+ * @param vbos : emptied
+ */
+void Terrain::queueUploads(std::vector<ChunkVBOdata> &vbos)
+{
+    if (vbos.empty()) {
+        return;
+    }
+    std::unordered_map<Chunk*, size_t> pendingIndex;
+    for (size_t i = 0; i < m_pendingUploads.size(); i++) {
+        pendingIndex[m_pendingUploads[i].mp_chunk] = i;
+    }
+    for (ChunkVBOdata &vbo : vbos) {
+        auto it = pendingIndex.find(vbo.mp_chunk);
+        if (it != pendingIndex.end()) {
+            m_pendingUploads[it->second].discardStaged();
+            m_pendingUploads[it->second] = std::move(vbo);
+        } else {
+            pendingIndex[vbo.mp_chunk] = m_pendingUploads.size();
+            m_pendingUploads.push_back(std::move(vbo));
+        }
+    }
+    vbos.clear();
+}
+
+static float uploadPriority(const Chunk *chunk, glm::vec2 viewer, glm::vec2 forward)
+{
+    return viewerCost(glm::vec2(chunk->getCorner()) + glm::vec2(8.f), viewer, forward);
+}
+
+/**
+ * @brief Terrain::uploadPending
+ *  Only the bytes copied on this thread count: meshes a worker already
+ *  staged in the mapped arena cost little more than the bookkeeping,
+ *  which the time budget bounds.
+ */
+void Terrain::uploadPending()
+{
+    if (m_pendingUploads.empty()) {
+        return;
+    }
+
+    glm::vec2 viewer(m_viewerPos.x, m_viewerPos.z);
+    glm::vec2 forward = getViewerDirection();
+
+    // the most urgent last, so uploads pop from the back
+    std::sort(m_pendingUploads.begin(), m_pendingUploads.end(),
+              [&](const ChunkVBOdata &a, const ChunkVBOdata &b) {
+        return uploadPriority(a.mp_chunk, viewer, forward) > uploadPriority(b.mp_chunk, viewer, forward);
+    });
+
+    QElapsedTimer timer;
+    timer.start();
+    size_t bytes = 0;
+    bool first = true;
+    while (!m_pendingUploads.empty()) {
+        ChunkVBOdata &vbo = m_pendingUploads.back();
+        size_t vboBytes = vbo.uploadBytes();
+        if (!first && (bytes + vboBytes > m_uploadByteBudget
+                       || timer.nsecsElapsed() >= static_cast<qint64>(m_uploadTimeBudgetUs) * 1000)) {
+            break;
+        }
+        noteUpload(vbo, uploadMesh(vbo));
+        m_pendingUploads.pop_back();
+        bytes += vboBytes;
+        first = false;
+    }
+}
+
+// seconds of the viewer's velocity the scheduling looks ahead, and the
+// blocks that look-ahead is capped at
+static const float schedulingLeadSeconds = 1.f;
+static const float schedulingMaxLead = 32.f;
+// how far the viewer moves (in blocks) or turns (the cosine of the angle)
+// before the queued jobs are ranked again
+static const float reprioritizeDistance = 8.f;
+static const float reprioritizeCosAngle = 0.985f;
+
+glm::vec2 Terrain::getViewerLead() const
+{
+    glm::vec2 lead = glm::vec2(m_viewerVelocity.x, m_viewerVelocity.z) * schedulingLeadSeconds;
+    float length = glm::length(lead);
+    if (length > schedulingMaxLead) {
+        lead *= schedulingMaxLead / length;
+    }
+    return glm::vec2(m_viewerPos.x, m_viewerPos.z) + lead;
+}
+
+glm::vec2 Terrain::getViewerDirection() const
+{
+    glm::vec2 forward(m_viewerForward.x, m_viewerForward.z);
+    return glm::length(forward) > 1e-3f ? glm::normalize(forward) : glm::vec2(0.f);
+}
+
+/**
+ * @brief Terrain::orderZones
+ *  Spawned in this order, the zones in front of the viewer are shaped and
+ *  read from the region store first even where the queue cannot rank them
+ *  (the store's reads, the compute backend's batches).
+ * @param zones
+ * @return
+ */
+ArenaVector<int64_t> Terrain::orderZones(const ArenaSet<int64_t> &zones) const
+{
+    glm::vec2 viewer = getViewerLead();
+    glm::vec2 forward = getViewerDirection();
+    ArenaVector<std::pair<float, int64_t>> ranked;
+    ranked.reserve(zones.size());
+    for (int64_t key : zones) {
+        ranked.push_back({viewerCost(glm::vec2(toCoords(key)) + glm::vec2(32.f), viewer, forward), key});
+    }
+    std::sort(ranked.begin(), ranked.end());
+
+    ArenaVector<int64_t> ordered;
+    ordered.reserve(ranked.size());
+    for (const std::pair<float, int64_t> &p : ranked) {
+        ordered.push_back(p.second);
+    }
+    return ordered;
+}
+
+/**
+ * @brief Terrain::setViewer
+ *  Re-ranks the queued jobs once the viewer's lead position moved or its
+ *  direction turned far enough since they were last ranked, so turning
+ *  around brings the chunks now in view to the front of the queue.
+ * @param pos
+ * @param forward
+ * @param velocity : blocks per second
+ */
+void Terrain::setViewer(glm::vec3 pos, glm::vec3 forward, glm::vec3 velocity)
+{
+    m_viewerPos = pos;
+    m_viewerForward = forward;
+    m_viewerVelocity = velocity;
+
+    glm::vec2 viewer = getViewerLead();
+    glm::vec2 direction = getViewerDirection();
+    bool moved = glm::distance(viewer, m_scheduledViewer) > reprioritizeDistance;
+    bool turned = direction != m_scheduledForward
+            && glm::dot(direction, m_scheduledForward) < reprioritizeCosAngle;
+    if (moved || turned) {
+        m_scheduledViewer = viewer;
+        m_scheduledForward = direction;
+        m_jobs.reprioritize();
+    }
+}
+
+void Terrain::setUploadBudget(size_t bytes, int micros)
+{
+    m_uploadByteBudget = bytes;
+    m_uploadTimeBudgetUs = micros;
+}
+
+size_t Terrain::getPendingUploadCount() const
+{
+    return m_pendingUploads.size();
+}
+
+TerrainFrameActivity Terrain::getFrameActivity() const
+{
+    TerrainFrameActivity activity = m_frameActivity;
+    activity.chunksAwaitingStage = m_chunksAwaitingStage.size();
+    activity.chunksAwaitingMesh = m_chunksAwaitingMesh.size();
+    activity.pendingUploads = m_pendingUploads.size();
+    return activity;
+}
+
+TerrainPipelineStats Terrain::getPipelineStats() const
+{
+    TerrainPipelineStats stats = m_pipelineStats;
+    stats.pooledChunks = m_chunkPool.getFreeCount();
+    stats.chunksReused = m_chunkPool.getReusedCount();
+    stats.chunksCreated = m_chunkPool.getCreatedCount();
+    stats.meshCacheHits = m_meshCache ? m_meshCache->getHitCount() : 0;
+    stats.meshCacheMisses = m_meshCache ? m_meshCache->getMissCount() : 0;
+    return stats;
+}
+
+/**
+ * @brief Terrain::noteUpload
+ *  A chunk is shown by its first upload after its request; its later
+ *  remeshes and edits only count as uploads.
+ * @param vbo
+ * @param bytes
+ */
+void Terrain::noteUpload(const ChunkVBOdata &vbo, size_t bytes)
+{
+    m_pipelineStats.uploads++;
+    m_pipelineStats.uploadBytes += bytes;
+    m_pipelineStats.lastUploadBytes += bytes;
+
+    auto requested = m_chunkRequestedAt.find(toKey(vbo.mp_chunk->getCorner().x, vbo.mp_chunk->getCorner().y));
+    if (requested != m_chunkRequestedAt.end()) {
+        qint64 latency = m_pipelineClock.nsecsElapsed() - requested->second;
+        m_pipelineStats.chunksShown++;
+        m_pipelineStats.showLatencyNs += latency;
+        m_pipelineStats.maxShowLatencyNs = std::max(m_pipelineStats.maxShowLatencyNs, latency);
+        if (m_pipelineStats.firstShownNs < 0) {
+            m_pipelineStats.firstShownNs = m_pipelineClock.nsecsElapsed();
+        }
+        m_chunkRequestedAt.erase(requested);
+    }
+}
+
+/**
+ * @brief Terrain::loadInitialTerrain
+ *  Only the player's zone is generated at once; checkThreadResults adds
+ *  the rings of zones around it (see m_loadingRings).
+ * @param playerX
+ * @param playerZ
+ * @param halfGridSize
+ */
+void Terrain::loadInitialTerrain(float playerX, float playerZ, int halfGridSize)
+{
+    LinearArena::Scope scratch(LinearArena::local());
+    // generate the zones around the player
+    ArenaSet<int64_t> currZones = getZoneKeys(playerX, playerZ, halfGridSize, zoneRadius(halfGridSize));
+
+    // this is the initial terrain loader
+    // basically, no other terrain is created at this moment
+    m_ringCenter = glm::ivec2(static_cast<int>(glm::floor(playerX / 64.f)) * 64,
+                              static_cast<int>(glm::floor(playerZ / 64.f)) * 64);
+    m_ringRadius = halfGridSize;
+    m_viewCenter = viewCircleCenter(playerX, playerZ);
+    m_currentRing = 0;
+    m_loadingRings = true;
+    spawnRing(0);
+
+    // update the border zone
+    m_prevBorderZones = std::unordered_set<int64_t>(currZones.begin(), currZones.end());
+    m_expandZone = expandCell(playerX, playerZ);
+    m_expandHalfGridSize = halfGridSize;
+    touchZones(currZones);
+    m_prevExpandPosition = glm::vec2(playerX, playerZ);
+    m_initialTerrainLoaded = true;
+}
+
+void Terrain::spawnRing(int ring)
+{
+    LinearArena::Scope scratch(LinearArena::local());
+    ArenaSet<int64_t> zones;
+    for (int dx = -ring; dx <= ring; dx++) {
+        for (int dz = -ring; dz <= ring; dz++) {
+            if (std::max(std::abs(dx), std::abs(dz)) != ring) {
+                continue;
+            }
+            int xCorner = m_ringCenter[0] + dx * 64, zCorner = m_ringCenter[1] + dz * 64;
+            if (m_viewRadius > 0 && !isZoneInCircle(xCorner, zCorner, m_viewCenter, zoneRadius(m_ringRadius))) {
+                continue;
+            }
+            int64_t key = toKey(xCorner, zCorner);
+            if (m_generatedTerrain.count(key) == 0) {
+                zones.insert(key);
+            }
+        }
+    }
+    for (int64_t zoneKey : orderZones(zones)) {
+        glm::ivec2 coord = toCoords(zoneKey);
+        spawnFillBlocksWorker(coord[0], coord[1]);
+        m_generatedTerrain.insert(zoneKey);
+    }
+}
+
+bool Terrain::isRingDecorated(int ring) const
+{
+    for (int dx = -ring; dx <= ring; dx++) {
+        for (int dz = -ring; dz <= ring; dz++) {
+            if (std::max(std::abs(dx), std::abs(dz)) != ring) {
+                continue;
+            }
+            int xCorner = m_ringCenter[0] + dx * 64, zCorner = m_ringCenter[1] + dz * 64;
+            if (m_viewRadius > 0 && !isZoneInCircle(xCorner, zCorner, m_viewCenter, zoneRadius(m_ringRadius))) {
+                continue;
+            }
+            for (int x = xCorner; x < xCorner + 64; x += 16) {
+                for (int z = zCorner; z < zCorner + 64; z += 16) {
+                    const Chunk *chunk = findChunk(x, z);
+                    if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+                        return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Terrain::advanceRings
+ *  The next ring starts once the current one is decorated, rather than
+ *  shaped: its zones' chunks would otherwise hold back the decoration of
+ *  the ring's border chunks (see isReadyForStage).
+ */
+void Terrain::advanceRings()
+{
+    while (m_loadingRings && isRingDecorated(m_currentRing)) {
+        if (m_currentRing == m_ringRadius) {
+            m_loadingRings = false;
+            return;
+        }
+        spawnRing(++m_currentRing);
+    }
+}
+
+/**
+ * @brief Terrain::destroyZoneVBOs
+ *  Destroy all the vbos of the chunks in the zone
+ *  Note: zone 64 x 256 x 64
+ */
+void Terrain::destroyZoneVBOs(int xCorner, int zCorner)
+{
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            // find the chunk =>
+            if (hasChunkAt(x, z)) {
+                Chunk *chunk = getChunkAt(x, z).get();
+                // only deload the vbo when it is loaded
+                destroyMesh(chunk);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Terrain::expand
+ *  For MS1: 3 x 3 chunk
+ *  For MS2: 5 x 5 zones
+ * @param playerX
+ * @param playerZ
+ * @param halfGridSize
+ */
+void Terrain::expand(float playerX, float playerZ, int halfGridSize)
+{
+    ProfileZone zone("Terrain::expand");
+    // the zone sets below and in the calls it makes
+    LinearArena::Scope scratch(LinearArena::local());
+    glm::ivec2 playerZone(static_cast<int>(glm::floor(playerX / 64.f)) * 64,
+                          static_cast<int>(glm::floor(playerZ / 64.f)) * 64);
+    // the initial rings go on while the player stays in the spawn zone
+    if (m_loadingRings) {
+        if (playerZone == m_ringCenter && halfGridSize == m_ringRadius) {
+            m_frameActivity.zoneSetsUpdated = false;
+            return;
+        }
+        m_loadingRings = false;
+    }
+    // the zone sets only change as the player enters another zone (or
+    // chunk, the circle's center)
+    glm::ivec2 cell = expandCell(playerX, playerZ);
+    m_frameActivity.zoneSetsUpdated = cell != m_expandZone || halfGridSize != m_expandHalfGridSize;
+    if (m_frameActivity.zoneSetsUpdated) {
+        m_expandZone = cell;
+        m_expandHalfGridSize = halfGridSize;
+        updateZoneSets(playerX, playerZ, halfGridSize);
+    }
+    ArenaSet<int64_t> currZones = getZoneKeys(playerX, playerZ, halfGridSize, zoneRadius(halfGridSize));
+    touchZones(currZones);
+
+    if (m_speculativeGeneration) {
+        m_prefetchPosition = getPrefetchPosition(playerX, playerZ);
+        prefetchZones(currZones, halfGridSize);
+    } else {
+        m_prefetchPosition = glm::vec2(playerX, playerZ);
+    }
+    cancelStaleZones(playerX, playerZ, halfGridSize);
+    dropCancelledZones();
+    evictZones(playerX, playerZ, halfGridSize);
+    fitGpuBudget(playerX, playerZ);
+    if (m_speculativeGeneration) {
+        prefetchAlongHeading(playerX, playerZ);
+    }
+    updateStorageTiers(playerX, playerZ);
+}
+
+// the rings of zones past the drawn grid whose meshes are kept
+static const int meshMarginZones = 1;
+
+/**
+ * @brief Terrain::updateZoneSets
+ *  The zones of the new grid not generated yet are spawned, and those
+ *  entering it without meshes are remeshed; the zones farther than
+ *  meshMarginZones from it lose their meshes.
+ * @param playerX
+ * @param playerZ
+ * @param halfGridSize
+ */
+void Terrain::updateZoneSets(float playerX, float playerZ, int halfGridSize)
+{
+    ArenaSet<int64_t> currZones = getZoneKeys(playerX, playerZ, halfGridSize, zoneRadius(halfGridSize));
+    ArenaSet<int64_t> keptZones = getZoneKeys(playerX, playerZ, halfGridSize + meshMarginZones,
+                                              zoneRadius(halfGridSize + meshMarginZones));
+    m_viewCenter = viewCircleCenter(playerX, playerZ);
+
+    // destroy VBOs if in m_loadedZones but past the margin
+    std::unordered_set<int64_t> meshedZones;
+    for (int64_t prevZoneKey : m_prevBorderZones) {
+        if (keptZones.find(prevZoneKey) == keptZones.end()) {
+            // no such key => not the current border (pool its VBOs)
+            glm::ivec2 coord = toCoords(prevZoneKey);
+            poolZoneMeshes(coord[0], coord[1]);
+        } else {
+            meshedZones.insert(prevZoneKey);
+        }
+    }
+
+    // check current border zones, the ones in view first
+    for (int64_t currZoneKey : orderZones(currZones)) {
+
+        glm::ivec2 coord = toCoords(currZoneKey);
+
+        if (m_generatedTerrain.find(currZoneKey) == m_generatedTerrain.end()) {
+            // the zone hasn't been created yet (or its shaping was dropped)
+            spawnFillBlocksWorker(coord[0], coord[1]);
+            m_generatedTerrain.insert(currZoneKey);
+            m_cancelledZones.erase(currZoneKey);
+        }
+
+        else if (m_prevBorderZones.find(currZoneKey) == m_prevBorderZones.end())
+        {
+            // zone has been created
+            // but this zone is not in the previous frame
+            // re-create the vbo; the chunks still generating are meshed
+            // once decorated, and those pooled or prefetched may have theirs
+            if (unpoolZone(currZoneKey)) {
+                m_pipelineStats.pooledZonesRestored++;
+            }
+            restoreZoneMeshes(coord[0], coord[1]);
+
+        }
+    }
+
+    // update the loaded zone
+    meshedZones.insert(currZones.begin(), currZones.end());
+    m_prevBorderZones = std::move(meshedZones);
+}
+
+/**
+ * @brief Terrain::cancelStaleZones
+ *  Drop the queued work of the zones past the ring around the drawn grid;
+ *  the ring keeps a zone on the grid's edge from dropping and respawning
+ *  its work as the player moves back and forth. A zone that lost its
+ *  FillBlocksWorkers is generated again when it comes back into range, and
+ *  one that lost VBOWorkers is remeshed by the re-entry in expand().
+ * @param playerX
+ * @param playerZ
+ * @param halfGridSize
+ */
+void Terrain::cancelStaleZones(float playerX, float playerZ, int halfGridSize)
+{
+    ArenaSet<int64_t> keptZones = getZoneKeys(playerX, playerZ, halfGridSize + 1, zoneRadius(halfGridSize + 1));
+    ArenaSet<int64_t> prefetchedZones = getZoneKeys(m_prefetchPosition.x, m_prefetchPosition.y,
+                                                    halfGridSize + 1, zoneRadius(halfGridSize + 1));
+    keptZones.insert(prefetchedZones.begin(), prefetchedZones.end());
+
+    for (auto it = m_zoneShapeJobs.begin(); it != m_zoneShapeJobs.end();) {
+        if (keptZones.count(it->first) != 0) {
+            ++it;
+            continue;
+        }
+        // a zone is shaped whole or not at all
+        if (m_jobs.cancelGroup(it->second)) {
+            m_generatedTerrain.erase(it->first);
+            m_cancelledZones.insert(it->first);
+        }
+        it = m_zoneShapeJobs.erase(it);
+    }
+
+    for (auto it = m_zoneMeshJobs.begin(); it != m_zoneMeshJobs.end();) {
+        if (keptZones.count(it->first) != 0) {
+            ++it;
+            continue;
+        }
+        for (TerrainJobId id : it->second) {
+            m_jobs.cancel(id);
+        }
+        it = m_zoneMeshJobs.erase(it);
+    }
+}
+
+/**
+ * @brief Terrain::dropCancelledZones
+ *  Delete the unshaped chunks of the zones whose shaping was dropped, so
+ *  they neither hold memory nor hold back their neighbors' stages.
+ */
+void Terrain::dropCancelledZones()
+{
+    std::vector<int64_t> droppable;
+    for (int64_t zoneKey : m_cancelledZones) {
+        glm::ivec2 coord = toCoords(zoneKey);
+        if (canEvictZone(coord[0], coord[1])) {
+            droppable.push_back(zoneKey);
+        }
+    }
+    for (int64_t zoneKey : droppable) {
+        glm::ivec2 coord = toCoords(zoneKey);
+        evictZone(coord[0], coord[1]);
+        m_cancelledZones.erase(zoneKey);
+    }
+}
+
+/**
+ * @brief Terrain::prefetchAlongHeading
+ *  The zones in view are requested as they appear; this warms the page
+ *  cache for the region the player is heading into, so flying into it
+ *  reads mapped pages instead of waiting on the disk.
+ * @param playerX
+ * @param playerZ
+ */
+void Terrain::prefetchAlongHeading(float playerX, float playerZ)
+{
+    const float regionSize = RegionStore::regionChunks * 16.f;
+
+    glm::vec2 position(playerX, playerZ);
+    glm::vec2 heading = position - m_prevExpandPosition;
+    m_prevExpandPosition = position;
+    if (glm::length(heading) < 0.01f) {
+        return;
+    }
+
+    glm::vec2 ahead = position + glm::normalize(heading) * regionSize;
+    int aheadX = static_cast<int>(glm::floor(ahead.x));
+    int aheadZ = static_cast<int>(glm::floor(ahead.y));
+    int64_t regionKey = toKey(static_cast<int>(glm::floor(ahead.x / regionSize)),
+                              static_cast<int>(glm::floor(ahead.y / regionSize)));
+    if (regionKey != m_lastPrefetchedRegion) {
+        m_lastPrefetchedRegion = regionKey;
+        m_regionStore->prefetchRegion(aheadX, aheadZ);
+    }
+}
+
+// the lead of the prefetch: the average time from a chunk's request to
+// its upload so far, clamped, and at most prefetchMaxZones zones
+static const float prefetchMinLatencySeconds = 0.5f;
+static const float prefetchMaxLatencySeconds = 4.f;
+static const int prefetchMaxZones = 2;
+// zones prefetched per expand(), and the chunks of the drawn grid that may
+// still be generating for it to prefetch at all
+static const int prefetchZonesPerCall = 2;
+static const int prefetchMaxPendingChunks = 16;
+
+glm::vec2 Terrain::getPrefetchPosition(float playerX, float playerZ) const
+{
+    glm::vec2 position(playerX, playerZ);
+    glm::vec2 velocity(m_viewerVelocity.x, m_viewerVelocity.z);
+    float speed = glm::length(velocity);
+    if (speed < 1e-3f) {
+        return position;
+    }
+    float latency = m_pipelineStats.chunksShown > 0
+            ? static_cast<float>(m_pipelineStats.showLatencyNs / 1e9 / m_pipelineStats.chunksShown) : 1.f;
+    latency = glm::clamp(latency, prefetchMinLatencySeconds, prefetchMaxLatencySeconds);
+    float lead = std::min(speed * latency, prefetchMaxZones * 64.f);
+    return position + velocity / speed * lead;
+}
+
+/**
+ * @brief Terrain::prefetchZones
+ *  Spawn the zones of the grid around m_prefetchPosition that are not
+ *  generated yet, the most urgent first. The prefetched zones are shaped
+ *  at the same priority as the grid's, so they wait until the grid is
+ *  nearly decorated rather than take the threads from it.
+ * @param currZones : the drawn grid
+ * @param halfGridSize
+ */
+void Terrain::prefetchZones(const ArenaSet<int64_t> &currZones, int halfGridSize)
+{
+    int pending = 0;
+    for (int64_t zoneKey : currZones) {
+        glm::ivec2 coord = toCoords(zoneKey);
+        for (int x = coord[0]; x < coord[0] + 64; x += 16) {
+            for (int z = coord[1]; z < coord[1] + 64; z += 16) {
+                const Chunk *chunk = findChunk(x, z);
+                if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+                    pending++;
+                }
+            }
+        }
+    }
+    if (pending > prefetchMaxPendingChunks) {
+        return;
+    }
+
+    ArenaSet<int64_t> aheadZones;
+    for (int64_t zoneKey : getZoneKeys(m_prefetchPosition.x, m_prefetchPosition.y, halfGridSize,
+                                       zoneRadius(halfGridSize))) {
+        if (currZones.count(zoneKey) == 0 && m_generatedTerrain.count(zoneKey) == 0) {
+            aheadZones.insert(zoneKey);
+        }
+    }
+    int spawned = 0;
+    for (int64_t zoneKey : orderZones(aheadZones)) {
+        if (spawned++ == prefetchZonesPerCall) {
+            break;
+        }
+        glm::ivec2 coord = toCoords(zoneKey);
+        spawnFillBlocksWorker(coord[0], coord[1]);
+        m_generatedTerrain.insert(zoneKey);
+        m_cancelledZones.erase(zoneKey);
+        // as recently used as the grid, so eviction keeps them
+        m_zoneLastUsed[zoneKey] = m_residencyClock;
+    }
+}
+
+/**
+ * @brief Terrain::touchZones
+ *  Mark the zones as used by the current expand()
+ * @param zones
+ */
+void Terrain::touchZones(const ArenaSet<int64_t> &zones)
+{
+    m_residencyClock++;
+    for (int64_t zoneKey : zones) {
+        m_zoneLastUsed[zoneKey] = m_residencyClock;
+    }
+}
+
+/**
+ * @brief Terrain::evictZones
+ *  Evict the least recently used zones outside the residency radius until
+ *  at most m_maxResidentZones are left. A zone still busy is skipped and
+ *  retried on the next call.
+ * @param playerX
+ * @param playerZ
+ * @param halfGridSize : the drawn grid, always kept resident
+ */
+void Terrain::evictZones(float playerX, float playerZ, int halfGridSize)
+{
+    // bounds the frame time spent on deletes and serializing
+    const int maxEvictionsPerCall = 4;
+
+    if (static_cast<int>(m_generatedTerrain.size()) <= m_maxResidentZones) {
+        return;
+    }
+
+    int playerZoneX = static_cast<int>(glm::floor(playerX / 64.f));
+    int playerZoneZ = static_cast<int>(glm::floor(playerZ / 64.f));
+    int radius = std::max(m_residentRadius, halfGridSize);
+
+    // (last used, zone key), oldest first
+    std::vector<std::pair<uint64_t, int64_t>> candidates;
+    for (int64_t zoneKey : m_generatedTerrain) {
+        glm::ivec2 coord = toCoords(zoneKey);
+        int distance = std::max(std::abs(static_cast<int>(glm::floor(coord[0] / 64.f)) - playerZoneX),
+                                std::abs(static_cast<int>(glm::floor(coord[1] / 64.f)) - playerZoneZ));
+        if (distance > radius) {
+            candidates.push_back(std::make_pair(m_zoneLastUsed[zoneKey], zoneKey));
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+
+    int evicted = 0;
+    for (const std::pair<uint64_t, int64_t> &candidate : candidates) {
+        if (static_cast<int>(m_generatedTerrain.size()) <= m_maxResidentZones
+                || evicted == maxEvictionsPerCall) {
+            break;
+        }
+        glm::ivec2 coord = toCoords(candidate.second);
+        if (canEvictZone(coord[0], coord[1])) {
+            evictZone(coord[0], coord[1]);
+            evicted++;
+        }
+    }
+}
+
+/**
+ * @brief Terrain::canEvictZone
+ *  Workers pin their chunks (and a VBOWorker the neighbors it reads) from
+ *  their spawn on the main thread until after they report, so an unpinned
+ *  chunk that is in no result set has no worker left. The neighbors must
+ *  be unpinned too since unlinking writes to their neighbor maps.
+ * @param xCorner
+ * @param zCorner
+ * @return
+ */
+bool Terrain::canEvictZone(int xCorner, int zCorner)
+{
+    if (m_computeZoneChunks.count(toKey(xCorner, zCorner)) != 0
+            || m_zonesAwaitingStorage.count(toKey(xCorner, zCorner)) != 0) {
+        return false;
+    }
+
+    // the chunks of a zone whose shaping was dropped never leave none
+    GenerationStage settled = m_cancelledZones.count(toKey(xCorner, zCorner)) != 0
+            ? GenerationStage::none : GenerationStage::decorated;
+
+    std::unordered_set<Chunk*> zoneChunks;
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            if (!hasChunkAt(x, z)) {
+                continue;
+            }
+            Chunk *chunk = getChunkAt(x, z).get();
+            if (chunk->getGenerationStage() != settled
+                    || chunk->isPinned()
+                    || m_chunksAwaitingStage.count(chunk) != 0) {
+                return false;
+            }
+            for (Chunk *neighbor : chunk->getNeighbors()) {
+                if (neighbor != nullptr && neighbor->isPinned()) {
+                    return false;
+                }
+            }
+            zoneChunks.insert(chunk);
+        }
+    }
+
+    // drained after the pins were checked: a worker reports before it
+    // unpins, so every result of the zone's finished workers is in
+    // m_chunksAwaitingStage or m_pendingUploads now
+    collectReportedChunks();
+    collectFinishedVBOs();
+    bool reported = false;
+    for (Chunk *chunk : zoneChunks) {
+        reported = reported || m_chunksAwaitingStage.count(chunk) != 0;
+    }
+    for (const ChunkVBOdata &vbo : m_pendingUploads) {
+        reported = reported || zoneChunks.count(vbo.mp_chunk) != 0;
+    }
+
+    // an edit remesh is pending until its result is uploaded
+    for (Chunk *chunk : zoneChunks) {
+        reported = reported || m_chunksRemeshing.count(chunk) != 0;
+    }
+
+    return !reported;
+}
+
+/**
+ * @brief Terrain::evictZone
+ *  Delete the zone's chunks, queueing the modified ones for the region
+ *  store, and forget the zone so that expand() generates it again.
+ * @param xCorner
+ * @param zCorner
+ */
+void Terrain::evictZone(int xCorner, int zCorner)
+{
+    // resident neighbors whose border faces are now exposed
+    std::unordered_set<Chunk*> remeshChunks;
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            if (!hasChunkAt(x, z)) {
+                continue;
+            }
+            Chunk *chunk = getChunkAt(x, z).get();
+
+            // a chunk with deferred caves would come back without them
+            bool cold = chunk->getGenerationStage() == GenerationStage::decorated
+                    && m_uncarvedChunks.count(toKey(x, z)) == 0;
+            if (chunk->isModified() || cold) {
+                std::vector<uint8_t> blocks;
+                chunk->serializeBlocks(blocks);
+                if (chunk->isModified()) {
+                    // the chunk's edits go to the journal ahead of it
+                    m_editJournal->sync();
+                    m_regionStore->writeChunk(x, z, cold ? blocks : std::move(blocks));
+                }
+                if (cold) {
+                    m_regionStore->cacheChunk(x, z, std::move(blocks));
+                }
+            }
+            m_hotChunks.erase(chunk);
+            destroyMesh(chunk);
+            m_liquids.dropChunk(x, z);
+            m_blockTicks.dropChunk(x, z);
+            if (m_computeMesher && m_computeMesher->cancelChunk(chunk)) {
+                // no result is coming for an edit to wait on
+                m_chunksRemeshing.erase(chunk);
+            }
+            for (Chunk *neighbor : chunk->getNeighborhood()) {
+                if (neighbor != nullptr && hasMesh(neighbor)) {
+                    remeshChunks.insert(neighbor);
+                }
+            }
+            chunk->unlinkNeighbors();
+
+            remeshChunks.erase(chunk);
+            m_chunksAwaitingMesh.erase(chunk);
+            m_structureWritesApplied.erase(toKey(x, z));
+            m_chunksToReclaim.erase(chunk);
+            m_chunkRequestedAt.erase(toKey(x, z));
+            m_uncarvedChunks.erase(toKey(x, z));
+            m_chunkPool.release(m_chunks.take(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z)));
+        }
+    }
+    spawnVBOWorkers(remeshChunks);
+
+    int64_t zoneKey = toKey(xCorner, zCorner);
+    unpoolZone(zoneKey);
+    m_generatedTerrain.erase(zoneKey);
+    m_zoneLastUsed.erase(zoneKey);
+    m_zoneShapeJobs.erase(zoneKey);
+    m_zoneMeshJobs.erase(zoneKey);
+    m_zoneCaveDensities.erase(zoneKey);
+    m_zoneHeightMapsLock.lock();
+    m_zoneHeightMaps.erase(zoneKey);
+    m_zoneHeightMapsLock.unlock();
+    m_zoneFeatures.erase(zoneKey);
+}
+
+/**
+ * @brief Terrain::placeBlockAt
+ *  Set the block at (x, y, z) as a block t, then remesh the chunk holding
+ *  it (and the neighbor facing it, on a border) when the edit commits.
+ *  Not allowed where there is no chunk, or where it is still generating
+ *  (its stage worker is its only writer until then).
+ * @param x
+ * @param y
+ * @param z
+ * @param t
+ */
+void Terrain::placeBlockAt(int x, int y, int z, BlockType t)
+{
+    Chunk *chunk = findEditableChunk(x, z);
+    if (chunk == nullptr || y < 0 || y >= 256) {
+        return;
+    }
+
+    // a single edit is a batch of one
+    beginEdit();
+    glm::ivec3 pos(x, y, z);
+    setBlockInBatch(chunk, pos, t);
+    noteChunkBoxEdited(chunk, pos, pos);
+    commitEdit();
+}
+
+Chunk *Terrain::findEditableChunk(int x, int z)
+{
+    Chunk *chunk = m_chunks.find(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (chunk == nullptr || chunk->getGenerationStage() != GenerationStage::decorated) {
+        return nullptr;
+    }
+    return chunk;
+}
+
+void Terrain::setBlockInBatch(Chunk *chunk, glm::ivec3 pos, BlockType t)
+{
+    if (m_trackEdits) {
+        m_blockEdits.push_back(BlockEdit{pos, t});
+    }
+    m_editJournal->append(pos, chunk->getBlockAt(static_cast<unsigned int>(pos.x & 15),
+                                                 static_cast<unsigned int>(pos.y),
+                                                 static_cast<unsigned int>(pos.z & 15)), t);
+    // the chunk's snapshots wait out the whole batch
+    if (m_editedChunks.insert(chunk).second) {
+        chunk->beginWrite();
+    }
+    chunk->setBlockAt(static_cast<unsigned int>(pos.x & 15), static_cast<unsigned int>(pos.y),
+                      static_cast<unsigned int>(pos.z & 15), t);
+    m_liquids.noteEdit(pos);
+    m_blockTicks.noteEdit(pos);
+}
+
+/**
+ * @brief Terrain::noteChunkBoxEdited
+ *  What an edit's blocks change beyond their chunk's own dirty sections,
+ *  done once for all of them.
+ * @param chunk
+ * @param low, high : the inclusive world box of chunk the edits fell in
+ */
+void Terrain::noteChunkBoxEdited(Chunk *chunk, glm::ivec3 low, glm::ivec3 high)
+{
+    // digging toward deferred caves: carve them before they are reached
+    if (low.y < caveTop + caveApproach && !m_uncarvedChunks.empty()) {
+        for (int dz = -1; dz <= 1; dz++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                const Chunk *near = findChunk(low.x + 16 * dx, low.z + 16 * dz);
+                if (near != nullptr) {
+                    requestCaves(near);
+                }
+            }
+        }
+    }
+
+    // a border block also changes the facing section of the neighbor chunk
+    std::vector<Chunk*> borderNeighbors;
+    if ((low.x & 15) == 0)   borderNeighbors.push_back(chunk->getNeighbor(XNEG));
+    if ((high.x & 15) == 15) borderNeighbors.push_back(chunk->getNeighbor(XPOS));
+    if ((low.z & 15) == 0)   borderNeighbors.push_back(chunk->getNeighbor(ZNEG));
+    if ((high.z & 15) == 15) borderNeighbors.push_back(chunk->getNeighbor(ZPOS));
+    for (Chunk *neighbor : borderNeighbors) {
+        if (neighbor != nullptr && hasMesh(neighbor)) {
+            for (int sy = low.y >> 4; sy <= high.y >> 4; sy++) {
+                neighbor->markSectionDirty(static_cast<unsigned int>(sy * 16));
+            }
+            m_editedNeighbors.insert(neighbor);
+        }
+    }
+}
+
+void Terrain::beginEdit()
+{
+    m_editDepth++;
+}
+
+/**
+ * @brief Terrain::commitEdit
+ *  Close a beginEdit() batch. The outermost one hands every touched chunk
+ *  to the fast-lane remesh once, however many of its blocks changed; its
+ *  dirty sections already name the parts to remesh.
+ *  The single place where edits become modified (stored) chunks.
+ */
+void Terrain::commitEdit()
+{
+    if (m_editDepth == 0) {
+        throw std::logic_error("Terrain::commitEdit without beginEdit!");
+    }
+    if (--m_editDepth > 0) {
+        return;
+    }
+
+    if (!m_editedChunks.empty()) {
+        m_blockChangeCount++;
+    }
+    for (Chunk *chunk : m_editedChunks) {
+        chunk->endWrite();
+        chunk->setModified(true);
+        m_chunksToReclaim.insert(chunk);
+        requestEditRemesh(chunk);
+        m_editedNeighbors.erase(chunk);
+    }
+    for (Chunk *neighbor : m_editedNeighbors) {
+        requestEditRemesh(neighbor);
+    }
+    m_editedChunks.clear();
+    m_editedNeighbors.clear();
+
+    m_editJournal->commit();
+    if (m_editJournal->getRecordCount() >= journalCheckpointEdits) {
+        saveModifiedChunks();
+    }
+}
+
+/**
+ * @brief Terrain::editArea
+ *  Walks each chunk the area spans once, like writeRegion, but decides
+ *  every block from the one it replaces.
+ * @param center
+ * @param halfExtents : the box's half size on each axis
+ * @param shape
+ * @param t
+ * @param drops
+ * @param ignited
+ * @return
+ */
+size_t Terrain::editArea(glm::vec3 center, glm::vec3 halfExtents, AreaShape shape, BlockType t,
+                         BlockDrops *drops, std::vector<glm::ivec3> *ignited)
+{
+    glm::ivec3 low(glm::floor(center - halfExtents));
+    glm::ivec3 high = glm::ivec3(glm::ceil(center + halfExtents)) - glm::ivec3(1);
+    low.y = std::max(low.y, 0);
+    high.y = std::min(high.y, 255);
+    if (glm::any(glm::greaterThan(low, high))) {
+        return 0;
+    }
+    glm::vec3 inverseExtents = 1.f / glm::max(halfExtents, glm::vec3(1e-3f));
+
+    size_t changed = 0;
+    beginEdit();
+    for (int cornerZ = low.z & ~15; cornerZ <= high.z; cornerZ += 16) {
+        for (int cornerX = low.x & ~15; cornerX <= high.x; cornerX += 16) {
+            Chunk *chunk = findEditableChunk(cornerX, cornerZ);
+            if (chunk == nullptr) {
+                continue;
+            }
+            glm::ivec3 from(std::max(low.x, cornerX), low.y, std::max(low.z, cornerZ));
+            glm::ivec3 to(std::min(high.x, cornerX + 15), high.y, std::min(high.z, cornerZ + 15));
+            bool touched = false;
+            for (int z = from.z; z <= to.z; z++) {
+                for (int x = from.x; x <= to.x; x++) {
+                    for (int y = from.y; y <= to.y; y++) {
+                        if (shape == AreaShape::sphere) {
+                            glm::vec3 offset = (glm::vec3(x, y, z) + 0.5f - center) * inverseExtents;
+                            if (glm::dot(offset, offset) > 1.f) {
+                                continue;
+                            }
+                        }
+                        BlockType old = chunk->getBlockAtUnchecked(static_cast<unsigned int>(x - cornerX),
+                                                                   static_cast<unsigned int>(y),
+                                                                   static_cast<unsigned int>(z - cornerZ));
+                        if (old == t || old == BEDROCK) {
+                            continue;
+                        }
+                        if (old == TNT && ignited != nullptr) {
+                            ignited->push_back(glm::ivec3(x, y, z));
+                        } else if (drops != nullptr && !Block::isEmpty(old) && !Block::isLiquid(old)) {
+                            (*drops)[Block::getDestroyedBlockType(old)]++;
+                        }
+                        setBlockInBatch(chunk, glm::ivec3(x, y, z), t);
+                        touched = true;
+                        changed++;
+                    }
+                }
+            }
+            if (touched) {
+                noteChunkBoxEdited(chunk, from, to);
+            }
+        }
+    }
+    commitEdit();
+    return changed;
+}
+
+/**
+ * @brief Terrain::readRegion
+ *  Each chunk is looked up once, and each of its columns copied as one
+ *  run per section it spans (see Chunk::copyColumn).
+ * @param region
+ * @param out : region.volume() blocks
+ * @param missing : what the blocks of chunks not resident read as
+ */
+void Terrain::readRegion(const BlockRegion &region, BlockType *out, BlockType missing) const
+{
+    if (region.volume() == 0) {
+        return;
+    }
+    glm::ivec3 size = region.size();
+    // the blocks of a column below and above the world, which read as EMPTY
+    int below = glm::clamp(-region.min.y, 0, size.y);
+    int above = glm::clamp(region.max.y - 255, 0, size.y - below);
+    int inside = size.y - below - above;
+    for (int cornerZ = region.min.z & ~15; cornerZ <= region.max.z; cornerZ += 16) {
+        for (int cornerX = region.min.x & ~15; cornerX <= region.max.x; cornerX += 16) {
+            const Chunk *chunk = findChunk(cornerX, cornerZ);
+            int xEnd = std::min(region.max.x, cornerX + 15);
+            int zEnd = std::min(region.max.z, cornerZ + 15);
+            for (int z = std::max(region.min.z, cornerZ); z <= zEnd; z++) {
+                for (int x = std::max(region.min.x, cornerX); x <= xEnd; x++) {
+                    BlockType *column = out + region.index(glm::ivec3(x, region.min.y, z));
+                    if (chunk == nullptr) {
+                        std::fill(column, column + size.y, missing);
+                        continue;
+                    }
+                    std::fill(column, column + below, EMPTY);
+                    if (inside > 0) {
+                        chunk->copyColumn(static_cast<unsigned int>(x - cornerX), static_cast<unsigned int>(z - cornerZ),
+                                          static_cast<unsigned int>(region.min.y + below),
+                                          static_cast<unsigned int>(region.min.y + below + inside), column + below);
+                    }
+                    std::fill(column + below + inside, column + size.y, EMPTY);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * @brief Terrain::writeRegion
+ *  Each column of a chunk is read as one run first, so only the blocks
+ *  that differ are set.
+ * @param region
+ * @param blocks : region.volume() blocks
+ * @param mask : null, or region.volume() flags
+ * @return
+ */
+size_t Terrain::writeRegion(const BlockRegion &region, const BlockType *blocks, const uint8_t *mask)
+{
+    int yBegin = std::max(region.min.y, 0);
+    int yEnd = std::min(region.max.y, 255) + 1;
+    if (region.volume() == 0 || yBegin >= yEnd) {
+        return 0;
+    }
+    size_t changed = 0;
+    std::array<BlockType, 256> current;
+    beginEdit();
+    for (int cornerZ = region.min.z & ~15; cornerZ <= region.max.z; cornerZ += 16) {
+        for (int cornerX = region.min.x & ~15; cornerX <= region.max.x; cornerX += 16) {
+            Chunk *chunk = findEditableChunk(cornerX, cornerZ);
+            if (chunk == nullptr) {
+                continue;
+            }
+            glm::ivec3 from(std::max(region.min.x, cornerX), yBegin, std::max(region.min.z, cornerZ));
+            glm::ivec3 to(std::min(region.max.x, cornerX + 15), yEnd - 1, std::min(region.max.z, cornerZ + 15));
+            bool touched = false;
+            for (int z = from.z; z <= to.z; z++) {
+                for (int x = from.x; x <= to.x; x++) {
+                    size_t column = region.index(glm::ivec3(x, yBegin, z));
+                    chunk->copyColumn(static_cast<unsigned int>(x - cornerX), static_cast<unsigned int>(z - cornerZ),
+                                      static_cast<unsigned int>(yBegin), static_cast<unsigned int>(yEnd), current.data());
+                    for (int y = yBegin; y < yEnd; y++) {
+                        size_t i = column + static_cast<size_t>(y - yBegin);
+                        if ((mask != nullptr && mask[i] == 0) || blocks[i] == current[y - yBegin]) {
+                            continue;
+                        }
+                        setBlockInBatch(chunk, glm::ivec3(x, y, z), blocks[i]);
+                        touched = true;
+                        changed++;
+                    }
+                }
+            }
+            if (touched) {
+                noteChunkBoxEdited(chunk, from, to);
+            }
+        }
+    }
+    commitEdit();
+    return changed;
+}
+
+void Terrain::ignite(glm::ivec3 pos, float fuse, float radius)
+{
+    // TNT lit by an explosion was already carved
+    if (tryGetBlockAt(pos.x, pos.y, pos.z) == std::optional<BlockType>(TNT)) {
+        placeBlockAt(pos.x, pos.y, pos.z, EMPTY);
+    }
+    Explosion explosion{pos, radius, m_explosionClock + fuse};
+    // fuses differ, so keep the queue by due time
+    auto at = std::upper_bound(m_explosions.begin(), m_explosions.end(), explosion,
+                               [](const Explosion &a, const Explosion &b) { return a.due < b.due; });
+    m_explosions.insert(at, explosion);
+}
+
+/**
+ * @brief Terrain::updateExplosions
+ *  All the explosions of an update are one batch, so chunks hit by
+ *  several remesh once. The TNT they reach is lit, not dropped.
+ * @param dT
+ */
+void Terrain::updateExplosions(float dT)
+{
+    m_explosionClock += dT;
+    if (m_explosions.empty() || m_explosions.front().due > m_explosionClock) {
+        return;
+    }
+    std::vector<glm::ivec3> ignited;
+    beginEdit();
+    for (int i = 0; i < maxExplosionsPerUpdate && !m_explosions.empty()
+         && m_explosions.front().due <= m_explosionClock; i++) {
+        Explosion explosion = m_explosions.front();
+        m_explosions.pop_front();
+        editArea(glm::vec3(explosion.center) + 0.5f, glm::vec3(explosion.radius), AreaShape::sphere, EMPTY,
+                 &m_explosionDrops, &ignited);
+        for (const glm::ivec3 &pos : ignited) {
+            ignite(pos, chainFuse, explosion.radius);
+        }
+        ignited.clear();
+    }
+    commitEdit();
+}
+
+size_t Terrain::getPendingExplosionCount() const
+{
+    return m_explosions.size();
+}
+
+void Terrain::takeExplosionDrops(BlockDrops &drops)
+{
+    drops.clear();
+    std::swap(drops, m_explosionDrops);
+}
+
+void Terrain::setEditTracking(bool enabled)
+{
+    m_trackEdits = enabled;
+    m_blockEdits.clear();
+}
+
+void Terrain::takeBlockEdits(std::vector<BlockEdit> &edits)
+{
+    edits.clear();
+    std::swap(edits, m_blockEdits);
+}
+
+void Terrain::updateLiquids(float dT)
+{
+    bool tracking = m_trackEdits;
+    m_trackEdits = false;
+    m_liquids.update(*this, dT);
+    m_trackEdits = tracking;
+}
+
+const LiquidSimulation &Terrain::getLiquids() const
+{
+    return m_liquids;
+}
+
+void Terrain::updateBlockTicks(float dT, glm::vec3 viewer)
+{
+    m_blockTicks.update(*this, dT, viewer);
+}
+
+const BlockTicks &Terrain::getBlockTicks() const
+{
+    return m_blockTicks;
+}
+
+uint64_t Terrain::getBlockChangeCount() const
+{
+    return m_blockChangeCount;
+}
+
+void Terrain::applyRemoteEdits(const std::vector<BlockEdit> &edits)
+{
+    bool tracking = m_trackEdits;
+    m_trackEdits = false;
+    beginEdit();
+    for (const BlockEdit &edit : edits) {
+        placeBlockAt(edit.pos.x, edit.pos.y, edit.pos.z, edit.type);
+    }
+    commitEdit();
+    m_trackEdits = tracking;
+}
+
+/**
+ * @brief Terrain::receiveChunk
+ *  A chunk not resident yet is shaped from the blocks like a stored one
+ *  (see spawnFillBlocksWorkers); one still generating gets them once it
+ *  is decorated, replacing what its stages made.
+ * @param x
+ * @param z
+ * @param blocks
+ */
+void Terrain::receiveChunk(int x, int z, StoredChunkData blocks)
+{
+    Chunk *chunk = m_chunks.find(ChunkMap::toChunkCoord(x), ChunkMap::toChunkCoord(z));
+    if (chunk != nullptr && chunk->getGenerationStage() == GenerationStage::decorated) {
+        applyReceivedChunk(chunk, blocks);
+        return;
+    }
+    m_receivedChunks[toKey(x, z)] = blocks;
+}
+
+/**
+ * @brief Terrain::applyReplayedEdits
+ *  The journal's edits of a chunk just decorated, over whatever it was
+ *  generated or stored with; it is meshed with them as it is, and stored
+ *  at the next save.
+ * @param chunk
+ */
+void Terrain::applyReplayedEdits(Chunk *chunk)
+{
+    glm::ivec2 corner = chunk->getCorner();
+    std::vector<JournalEdit> edits;
+    if (!m_editJournal->takeReplayedEdits(corner[0], corner[1], edits)) {
+        return;
+    }
+    chunk->beginWrite();
+    for (const JournalEdit &edit : edits) {
+        if (edit.pos.y >= 0 && edit.pos.y < 256) {
+            chunk->setBlockAt(static_cast<unsigned int>(edit.pos.x & 15), static_cast<unsigned int>(edit.pos.y),
+                              static_cast<unsigned int>(edit.pos.z & 15), edit.after);
+        }
     }
+    chunk->endWrite();
+    chunk->setModified(true);
+    m_chunksToReclaim.insert(chunk);
+    m_blockChangeCount++;
+}
+
+void Terrain::applyReceivedChunk(Chunk *chunk, const StoredChunkData &blocks)
+{
+    chunk->beginWrite();
+    bool loaded = chunk->deserializeBlocks(reinterpret_cast<const uint8_t*>(blocks->constData()), blocks->size());
+    chunk->endWrite();
+    if (!loaded) {
+        glm::ivec2 corner = chunk->getCorner();
+        std::cout << "Received an unreadable chunk " << corner[0] << ", " << corner[1] << std::endl;
+    }
+    chunk->setModified(true);
+    m_chunksToReclaim.insert(chunk);
+    m_blockChangeCount++;
+    glm::ivec2 corner = chunk->getCorner();
+    m_liquids.dropChunk(corner[0], corner[1]);
+    // the sender's blocks hold the structures
+    int64_t key = toKey(corner[0], corner[1]);
+    m_structureWritesApplied[key] = getStructureWriteCount(key);
+    // one still waiting for its first mesh is meshed from the new blocks
+    if (m_chunksAwaitingMesh.count(chunk) == 0) {
+        requestEditRemesh(chunk);
+    }
+    for (Chunk *neighbor : chunk->getNeighborhood()) {
+        if (neighbor != nullptr && hasMesh(neighbor)) {
+            neighbor->markAllSectionsDirty();
+            requestEditRemesh(neighbor);
+        }
+    }
+}
+
+/**
+ * @brief Terrain::requestEditRemesh
+ *  Start a fast-lane VBOWorker for the edited chunk, or, while one is
+ *  still in flight, remember to remesh it again once that one is uploaded
+ *  (the dirty sections it missed stay dirty until then).
+ * @param chunk
+ */
+void Terrain::requestEditRemesh(Chunk *chunk)
+{
+    if (isHeadless()) {
+        return;
+    }
+    if (m_chunksRemeshing.count(chunk) != 0) {
+        m_chunksToRemesh.insert(chunk);
+        return;
+    }
+    m_chunksRemeshing.insert(chunk);
+    spawnVBOWorker(chunk, true);
+}
+
+/**
+ * @brief Terrain::requestNeighborRelight
+ *  The mesher already marked the sections whose light changed; a chunk
+ *  still waiting for its first mesh picks them up then.
+ * @param vbo
+ */
+void Terrain::requestNeighborRelight(const ChunkVBOdata &vbo)
+{
+    if (!vbo.relightsNeighbors) {
+        return;
+    }
+    for (Chunk *neighbor : vbo.mp_chunk->getNeighborhood()) {
+        if (neighbor != nullptr && hasMesh(neighbor)) {
+            requestEditRemesh(neighbor);
+        }
+    }
+}
+
+/**
+ * @brief Terrain::reclaimChunkSections
+ *  Free the section data replaced by writes of the chunks no worker pins.
+ *  Workers pin on construction (main thread), so an unpinned chunk here
+ *  has no reader or writer until the next spawn.
+ */
+void Terrain::reclaimChunkSections()
+{
+    for (auto it = m_chunksToReclaim.begin(); it != m_chunksToReclaim.end();) {
+        Chunk *chunk = *it;
+        if (chunk->isPinned()) {
+            ++it;
+            continue;
+        }
+        chunk->reclaimRetiredSections();
+        it = m_chunksToReclaim.erase(it);
+    }
+}
+
+/**
+ * @brief Terrain::spawnFillBlocksWorker
+ * @param xCorner : int, the xCorner of a zone
+ * @param zCorner : int, the zCorner of a zone
+ */
+void Terrain::spawnFillBlocksWorker(int xCorner, int zCorner)
+{
+    // collect all the chunks in this zone
+    std::unordered_map<int64_t, Chunk*> chunks = std::unordered_map<int64_t, Chunk*>();
+
+    // a zone whose shaping was dropped still has its (empty) chunks
+    qint64 now = m_pipelineClock.nsecsElapsed();
+    for (int x = xCorner; x < xCorner + 64; x += 16) {
+        for (int z = zCorner; z < zCorner + 64; z += 16) {
+            Chunk *chunk = hasChunkAt(x, z) ? getChunkAt(x, z).get() : instantiateChunkAt(x, z);
+            chunks[toKey(x, z)] = chunk;
+            if (!isHeadless() && !hasMesh(chunk)) {
+                m_chunkRequestedAt[toKey(x, z)] = now;
+            }
+        }
+    }
+
+    // the stored chunks come back through collectStoredZones
+    if (m_regionStore->hasZoneChunks(xCorner, zCorner)) {
+        m_zonesAwaitingStorage[toKey(xCorner, zCorner)] = chunks;
+        m_regionStore->requestZone(xCorner, zCorner);
+        return;
+    }
+
+    shapeZone(xCorner, zCorner, chunks, {});
+}
+
+/**
+ * @brief Terrain::shapeZone
+ * @param xCorner
+ * @param zCorner
+ *  The chunks received meanwhile (see receiveChunk) count as stored.
+ * @param chunks       : the zone's 16 chunks
+ * @param storedChunks : the blocks of its chunks in the region store
+ */
+void Terrain::shapeZone(int xCorner, int zCorner, const std::unordered_map<int64_t, Chunk*> &chunks,
+                        std::unordered_map<int64_t, StoredChunkData> storedChunks)
+{
+    if (!m_receivedChunks.empty()) {
+        for (const std::pair<const int64_t, Chunk*> &p : chunks) {
+            auto received = m_receivedChunks.find(p.first);
+            if (received != m_receivedChunks.end()) {
+                // newer than the region store's
+                storedChunks[p.first] = received->second;
+                p.second->setModified(true);
+                m_receivedChunks.erase(received);
+            }
+        }
+    }
+
+    // the backend's results come back through collectComputedZones
+    if (m_computeBackend) {
+        m_computeZoneChunks[toKey(xCorner, zCorner)] = chunks;
+        if (!storedChunks.empty()) {
+            m_computeZoneStoredChunks[toKey(xCorner, zCorner)] = storedChunks;
+        }
+        m_computeBackend->submitZone(xCorner, zCorner);
+        return;
+    }
+
+    spawnFillBlocksWorkers(xCorner, zCorner, chunks, nullptr, storedChunks);
+}
+
+/**
+ * @brief Terrain::spawnFillBlocksWorkers
+ *  The map is published right away: the later stages of a chunk only read
+ *  its tile, once the chunk reported, and getSurfaceHeight checks hasTile.
+ * @param xCorner
+ * @param zCorner
+ * @param chunks             : the zone's 16 chunks
+ * @param precomputedHeights : from the compute backend, or null
+ * @param storedChunks       : the blocks of its chunks in the region store
+ */
+void Terrain::spawnFillBlocksWorkers(int xCorner, int zCorner, const std::unordered_map<int64_t, Chunk*> &chunks,
+                                     sPtr<const std::vector<int>> precomputedHeights,
+                                     const std::unordered_map<int64_t, StoredChunkData> &storedChunks)
+{
+    int64_t zoneKey = toKey(xCorner, zCorner);
+    sPtr<ZoneHeightMap> zoneHeightMap = mkS<ZoneHeightMap>(xCorner, zCorner);
+    m_zoneHeightMapsLock.lock();
+    m_zoneHeightMaps[zoneKey] = zoneHeightMap;
+    m_zoneHeightMapsLock.unlock();
+    m_zoneFeatures[zoneKey] = mkS<const ZoneFeatureIndex>(xCorner, zCorner, m_worldSeed);
+
+    std::vector<TerrainJobId> &ids = m_zoneShapeJobs[zoneKey];
+    ids.clear();
+    for (const std::pair<const int64_t, Chunk*> &p : chunks) {
+        auto stored = storedChunks.find(p.first);
+        ids.push_back(m_jobs.submit<FillBlocksWorker>(TerrainJobQueue::generation,
+                                                      generationStagePriority(GenerationStage::shaped),
+                                                      p.second, zoneHeightMap,
+                                                      &m_chunksWithBlocks,
+                                                      m_worldSeed,
+                                                      m_gradientHash,
+                                                      precomputedHeights,
+                                                      stored != storedChunks.end() ? stored->second : nullptr));
+    }
+}
+
+/**
+ * @brief Terrain::collectStoredZones
+ */
+void Terrain::collectStoredZones()
+{
+    std::vector<uPtr<StoredZone>> zones;
+    m_regionStore->collectFinishedZones(zones);
+
+    for (uPtr<StoredZone> &zone : zones) {
+        int64_t zoneKey = toKey(zone->xCorner, zone->zCorner);
+        shapeZone(zone->xCorner, zone->zCorner, m_zonesAwaitingStorage.at(zoneKey), zone->chunks);
+        m_zonesAwaitingStorage.erase(zoneKey);
+    }
+}
+
+/**
+ * @brief Terrain::collectComputedMeshes
+ *  The compute meshes never relight their neighbors: they are not lit.
+ */
+void Terrain::collectComputedMeshes()
+{
+    if (!m_computeMesher || !m_computeMesher->hasPendingChunks()) {
+        return;
+    }
+
+    std::vector<ComputedChunkMesh> meshes;
+    m_computeMesher->collectFinishedChunks(meshes);
+    for (ComputedChunkMesh &mesh : meshes) {
+        if (mesh.vbo.mp_arena == nullptr) {
+            submitVBOWorker(mesh.vbo.mp_chunk, mesh.edit, false);
+        } else if (mesh.edit) {
+            m_editedChunkVBOs.push(std::move(mesh.vbo));
+        } else {
+            m_chunksWithVBOs.push(std::move(mesh.vbo));
+        }
+    }
+}
+
+/**
+ * @brief Terrain::collectComputedZones
+ *  Shape the zones whose compute results are ready; their caves are
+ *  carved later from the read-back densities
+ */
+void Terrain::collectComputedZones()
+{
+    if (!m_computeBackend || !m_computeBackend->hasPendingZones()) {
+        return;
+    }
+
+    std::vector<uPtr<ZoneComputeResult>> results;
+    m_computeBackend->collectFinishedZones(results);
+
+    for (uPtr<ZoneComputeResult> &result : results) {
+        int64_t zoneKey = toKey(result->xCorner, result->zCorner);
+
+        // stored chunks are never carved
+        std::unordered_map<int64_t, StoredChunkData> storedChunks;
+        auto stored = m_computeZoneStoredChunks.find(zoneKey);
+        if (stored != m_computeZoneStoredChunks.end()) {
+            storedChunks = std::move(stored->second);
+            m_computeZoneStoredChunks.erase(stored);
+        }
+
+        ZoneCaveDensities caves;
+        caves.densities = mkS<const std::vector<float>>(std::move(result->caveDensities));
+        caves.chunksRemaining = 16 - static_cast<int>(storedChunks.size());
+        if (caves.chunksRemaining > 0) {
+            m_zoneCaveDensities[zoneKey] = caves;
+        }
+
+        spawnFillBlocksWorkers(result->xCorner, result->zCorner, m_computeZoneChunks.at(zoneKey),
+                               mkS<const std::vector<int>>(std::move(result->heights)),
+                               storedChunks);
+        m_computeZoneChunks.erase(zoneKey);
+    }
+}
+
+// above every generation stage: an edit is remeshed before any queued work
+static const int editRemeshPriority = 4;
+// a chunk back in range whose cached faces are current only has them
+// expanded, as cheap as an edit's remesh: ahead of every generation stage
+static const int restoreMeshPriority = editRemeshPriority;
+
+/**
+ * @brief generationStagePriority
+ * @param stage
+ * @return the job priority of the stage's workers
+ */
+int generationStagePriority(GenerationStage stage)
+{
+    switch (stage) {
+    case GenerationStage::shaped:
+        return 3;
+    case GenerationStage::carved:
+        return 2;
+    case GenerationStage::featured:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/**
+ * @brief Terrain::isReadyForStage
+ *  Dependencies of the later stages:
+ *  - carved    : the chunk itself is shaped
+ *  - featured  : every existing neighbor is shaped (features may read across the border)
+ *  - decorated : every existing neighbor is featured (no feature writes still pending)
+ *  A neighbor that does not exist yet belongs to a zone nobody asked for,
+ *  so it does not hold the chunk back.
+ * @param chunk
+ * @param stage : the stage to run next
+ * @return
+ */
+bool Terrain::isReadyForStage(const Chunk *chunk, GenerationStage stage) const
+{
+    GenerationStage required;
+    switch (stage) {
+    case GenerationStage::featured:
+        required = GenerationStage::shaped;
+        break;
+    case GenerationStage::decorated:
+        required = GenerationStage::featured;
+        break;
+    default:
+        return true;
+    }
+
+    for (Chunk *neighbor : chunk->getNeighbors()) {
+        if (neighbor != nullptr && neighbor->getGenerationStage() < required) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Terrain::spawnStageWorker
+ * @param chunk
+ * @param stage
+ */
+void Terrain::spawnStageWorker(Chunk *chunk, GenerationStage stage)
+{
+    glm::ivec2 corner = chunk->getCorner();
+    int zoneX = static_cast<int>(glm::floor(corner[0] / 64.f)) * 64;
+    int zoneZ = static_cast<int>(glm::floor(corner[1] / 64.f)) * 64;
+
+    // published when the zone was queued; the chunk's tile is filled since
+    // its FillBlocksWorker reported
+    m_zoneHeightMapsLock.lock();
+    sPtr<const ZoneHeightMap> zoneHeightMap = m_zoneHeightMaps.at(toKey(zoneX, zoneZ));
+    m_zoneHeightMapsLock.unlock();
+    sPtr<const ZoneFeatureIndex> zoneFeatures = m_zoneFeatures.at(toKey(zoneX, zoneZ));
+
+    sPtr<const std::vector<float>> zoneCaveDensities = nullptr;
+    bool deferCaves = stage == GenerationStage::carved && m_deferCaves;
+    if (stage == GenerationStage::carved) {
+        auto caves = m_zoneCaveDensities.find(toKey(zoneX, zoneZ));
+        if (caves != m_zoneCaveDensities.end()) {
+            // deferred, a CaveWorker computes the chunk's own later
+            zoneCaveDensities = deferCaves ? nullptr : caves->second.densities;
+            if (--caves->second.chunksRemaining == 0) {
+                m_zoneCaveDensities.erase(caves);
+            }
+        }
+    }
+    if (deferCaves) {
+        m_uncarvedChunks.insert(toKey(corner[0], corner[1]));
+    }
+
+    // the worker stamps the structure blocks added so far, later ones wait
+    // for stampStructureWrites
+    sPtr<const std::vector<StructureBlock>> structureBlocks = nullptr;
+    if (stage == GenerationStage::decorated) {
+        int64_t key = toKey(corner[0], corner[1]);
+        auto writes = m_structureWrites.find(key);
+        if (writes != m_structureWrites.end()) {
+            structureBlocks = writes->second;
+        }
+        m_structureWritesApplied[key] = structureBlocks ? structureBlocks->size() : 0;
+    }
+
+    m_jobs.submit<ChunkStageWorker>(TerrainJobQueue::generation, generationStagePriority(stage),
+                                    chunk, stage, m_worldSeed, m_gradientHash, zoneHeightMap, zoneFeatures,
+                                    &m_chunksWithBlocks,
+                                    zoneCaveDensities, deferCaves, &m_structureSpills, structureBlocks);
+}
+
+
+/**
+ * @brief Terrain::requestCaves
+ *  Only once the chunk is decorated: until then its stage workers write it.
+ * @param chunk
+ */
+void Terrain::requestCaves(const Chunk *chunk)
+{
+    glm::ivec2 corner = chunk->getCorner();
+    int64_t key = toKey(corner[0], corner[1]);
+    if (chunk->getGenerationStage() != GenerationStage::decorated
+            || m_uncarvedChunks.count(key) == 0 || !m_chunksCarving.insert(key).second) {
+        return;
+    }
+    m_jobs.submit<CaveWorker>(TerrainJobQueue::generation, generationStagePriority(GenerationStage::carved),
+                              corner, m_worldSeed, m_gradientHash, &m_carvedCaves);
+}
+
+/**
+ * @brief Terrain::carveNearbyCaves
+ *  With deferred caves off, every chunk still uncarved is.
+ */
+void Terrain::carveNearbyCaves()
+{
+    if (m_uncarvedChunks.empty()) {
+        return;
+    }
+    if (!m_deferCaves) {
+        std::vector<int64_t> uncarved(m_uncarvedChunks.begin(), m_uncarvedChunks.end());
+        for (int64_t key : uncarved) {
+            glm::ivec2 corner = toCoords(key);
+            const Chunk *chunk = findChunk(corner[0], corner[1]);
+            if (chunk != nullptr) {
+                requestCaves(chunk);
+            }
+        }
+        return;
+    }
+    if (m_viewerPos.y >= caveTop + caveApproach) {
+        return;
+    }
+    int viewerX = static_cast<int>(glm::floor(m_viewerPos.x));
+    int viewerZ = static_cast<int>(glm::floor(m_viewerPos.z));
+    for (int dz = -caveRadius; dz <= caveRadius; dz++) {
+        for (int dx = -caveRadius; dx <= caveRadius; dx++) {
+            const Chunk *chunk = findChunk(viewerX + 16 * dx, viewerZ + 16 * dz);
+            if (chunk != nullptr) {
+                requestCaves(chunk);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Terrain::applyCarvedCaves
+ *  Only stone is carved: whatever an edit put in the band meanwhile, or
+ *  dug out of it, stays. The chunk is remeshed like an edited one, and
+ *  so are the lower sections of its neighbors, whose border faces it
+ *  exposes.
+ */
+void Terrain::applyCarvedCaves()
+{
+    std::vector<CarvedCaves> carved;
+    m_carvedCaves.takeAll(carved);
+    for (const CarvedCaves &caves : carved) {
+        int64_t key = toKey(caves.corner[0], caves.corner[1]);
+        m_chunksCarving.erase(key);
+        Chunk *chunk = m_chunks.find(ChunkMap::toChunkCoord(caves.corner[0]), ChunkMap::toChunkCoord(caves.corner[1]));
+        // cancelled, or the chunk was evicted meanwhile
+        if (caves.cells.empty() || chunk == nullptr || m_uncarvedChunks.count(key) == 0) {
+            continue;
+        }
+
+        chunk->beginWrite();
+        for (unsigned int z = 0; z < 16; z++) {
+            for (unsigned int y = 1; y < caveTop; y++) {
+                for (unsigned int x = 0; x < 16; x++) {
+                    size_t cell = x + 16 * (y - 1) + 16 * (caveTop - 1) * z;
+                    if ((caves.cells[cell >> 6] >> (cell & 63)) & 1
+                            && chunk->getBlockAtUnchecked(x, y, z) == STONE) {
+                        chunk->setBlockAt(x, y, z, static_cast<int>(y) <= lavaLevel ? LAVA : EMPTY);
+                    }
+                }
+            }
+        }
+        chunk->endWrite();
+        m_uncarvedChunks.erase(key);
+        m_chunksToReclaim.insert(chunk);
+        m_blockChangeCount++;
+
+        // the sections the caves span, and the one above for their light
+        uint32_t caveSections = (1u << ((caveTop >> 4) + 1)) - 1;
+        if (m_chunksAwaitingMesh.count(chunk) == 0) {
+            requestEditRemesh(chunk);
+        }
+        for (Chunk *neighbor : chunk->getNeighbors()) {
+            if (neighbor != nullptr && hasMesh(neighbor)) {
+                neighbor->markSectionsDirty(caveSections);
+                requestEditRemesh(neighbor);
+            }
+        }
+    }
+}
+
+void Terrain::relayChunk(Chunk *chunk, bool flat)
+{
+    chunk->pin();
+    m_chunksRelaying.insert(chunk);
+    // below the generation stages
+    m_jobs.submit<TierWorker>(TerrainJobQueue::generation, -1, chunk, flat, &m_relaidChunks);
+}
+
+/**
+ * @brief Terrain::updateStorageTiers
+ *  Demotions go first, so a budget overrun is undone before more hot
+ *  chunks are made; at most maxTierJobs relayouts are in flight.
+ * @param playerX
+ * @param playerZ
+ */
+void Terrain::updateStorageTiers(float playerX, float playerZ)
+{
+    bool overBudget = MemoryStats::isOverBudget(MemoryCategory::blocks);
+    int playerX16 = static_cast<int>(glm::floor(playerX / 16.f));
+    int playerZ16 = static_cast<int>(glm::floor(playerZ / 16.f));
+    auto inRange = [playerX16, playerZ16](const Chunk *chunk) {
+        glm::ivec2 corner = chunk->getCorner();
+        return std::max(std::abs(ChunkMap::toChunkCoord(corner[0]) - playerX16),
+                        std::abs(ChunkMap::toChunkCoord(corner[1]) - playerZ16)) <= hotChunkRadius;
+    };
+
+    for (auto it = m_hotChunks.begin(); it != m_hotChunks.end();) {
+        if (static_cast<int>(m_chunksRelaying.size()) >= maxTierJobs) {
+            return;
+        }
+        Chunk *chunk = *it;
+        if ((overBudget || !inRange(chunk)) && m_chunksRelaying.count(chunk) == 0) {
+            relayChunk(chunk, false);
+            it = m_hotChunks.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (overBudget) {
+        return;
+    }
+
+    for (int dz = -hotChunkRadius; dz <= hotChunkRadius; dz++) {
+        for (int dx = -hotChunkRadius; dx <= hotChunkRadius; dx++) {
+            if (static_cast<int>(m_chunksRelaying.size()) >= maxTierJobs) {
+                return;
+            }
+            Chunk *chunk = m_chunks.find(playerX16 + dx, playerZ16 + dz);
+            if (chunk != nullptr && chunk->getGenerationStage() == GenerationStage::decorated
+                    && m_hotChunks.count(chunk) == 0 && m_chunksRelaying.count(chunk) == 0) {
+                relayChunk(chunk, true);
+                m_hotChunks.insert(chunk);
+            }
+        }
+    }
+}
+
+/**
+ * @brief Terrain::applyRelaidChunks
+ *  A section written since the worker's snapshot keeps its data (see
+ *  BlockSection::replace); the blocks are the same either way, so nothing
+ *  is remeshed.
+ */
+void Terrain::applyRelaidChunks()
+{
+    std::vector<RelaidChunk> relaid;
+    m_relaidChunks.takeAll(relaid);
+    for (const RelaidChunk &result : relaid) {
+        Chunk *chunk = result.chunk;
+        chunk->beginWrite();
+        if (chunk->replaceSections(result.from, result.to) > 0) {
+            m_chunksToReclaim.insert(chunk);
+        }
+        chunk->endWrite();
+        chunk->unpin();
+        m_chunksRelaying.erase(chunk);
+    }
+}
+
+/**
+ * @brief Terrain::spawnVBOWorker
+ * @param mp_chunk
+ * @param fastLane : a block edit; jumps ahead of the generation work
+ *                   and reports to m_editedChunkVBOs
+ */
+void Terrain::spawnVBOWorker(Chunk* mp_chunk, bool fastLane, bool restore)
+{
+    // headless: nothing is ever drawn
+    if (isHeadless()) {
+        return;
+    }
+    if (m_computeMesher) {
+        m_computeMesher->submitChunk(mp_chunk, fastLane);
+        return;
+    }
+    submitVBOWorker(mp_chunk, fastLane, restore);
+}
+
+void Terrain::submitVBOWorker(Chunk* mp_chunk, bool fastLane, bool restore)
+{
+    // only a mapped arena can be written from the worker
+    ChunkMeshArena *arena = (m_meshArena && m_meshArena->isMapped()) ? m_meshArena.get() : nullptr;
+    int priority = fastLane ? editRemeshPriority : (restore ? restoreMeshPriority : 0);
+    TerrainJobId id = m_jobs.submit<VBOWorker>(TerrainJobQueue::meshing, priority,
+                                               mp_chunk,
+                                               fastLane ? &m_editedChunkVBOs : &m_chunksWithVBOs,
+                                               arena, m_meshCache.get());
+    if (fastLane) {
+        // an edit is never dropped: m_chunksRemeshing waits for its result
+        return;
+    }
+
+    // cancelStaleZones may drop it
+    glm::ivec2 corner = mp_chunk->getCorner();
+    int64_t zoneKey = toKey(static_cast<int>(glm::floor(corner[0] / 64.f)) * 64,
+                            static_cast<int>(glm::floor(corner[1] / 64.f)) * 64);
+    std::vector<TerrainJobId> &ids = m_zoneMeshJobs[zoneKey];
+    if (ids.size() >= 64) {
+        ids.erase(std::remove_if(ids.begin(), ids.end(),
+                                 [this](TerrainJobId queued) { return !m_jobs.isQueued(queued); }),
+                  ids.end());
+    }
+    ids.push_back(id);
+}
+
+
+/**
+ * @brief Terrain::isNeighborhoodReady
+ *  A neighbor's chunks are all instantiated when its zone is queued, so a
+ *  missing one is not coming; an existing one must be decorated.
+ * @param chunk
+ * @return
+ */
+bool Terrain::isNeighborhoodReady(const Chunk *chunk) const
+{
+    for (const Chunk *neighbor : chunk->getNeighborhood()) {
+        if (neighbor != nullptr && neighbor->getGenerationStage() != GenerationStage::decorated) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Terrain::spawnReadyVBOWorkers()
+{
+    for (auto it = m_chunksAwaitingMesh.begin(); it != m_chunksAwaitingMesh.end();) {
+        if (isNeighborhoodReady(*it)) {
+            spawnVBOWorker(*it);
+            it = m_chunksAwaitingMesh.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+/**
+ * @brief Terrain::spawnVBOWorkers
+ * @param completedChunksWithBlocks
+ */
+void Terrain::spawnVBOWorkers(const std::unordered_set<Chunk*> &completedChunksWithBlocks)
+{
+    for (Chunk *ck : completedChunksWithBlocks) {
+        spawnVBOWorker(ck);
+    }
+}
+
+//--------------------------
+// Thread Workers
+//--------------------------
+FillBlocksWorker::FillBlocksWorker(Chunk *chunk,
+                                   sPtr<ZoneHeightMap> zoneHeightMap,
+                                   MPSCQueue<Chunk*> *completedChunks,
+                                   uint64_t worldSeed,
+                                   GradientHash gradientHash,
+                                   sPtr<const std::vector<int>> precomputedHeights,
+                                   StoredChunkData storedBlocks)
+    : chunk(chunk), zoneHeightMap(zoneHeightMap),
+      completedChunks(completedChunks),
+      worldSeed(worldSeed), gradientHash(gradientHash),
+      precomputedHeights(precomputedHeights),
+      storedBlocks(storedBlocks)
+{
+    chunk->pin();
 }
 
-void Terrain::drawErdtree(const glm::ivec2 pos){
-
-    if(hasChunkAt(pos[0], pos[1])) {
+// a column of the floating islands' footprint (see ZoneFeatureIndex)
+void ChunkStageWorker::setFloatingTerrain(int x, int z, int height){
+    chunk->fillColumn(x, z, height, height + 5, COBBLESTONE);
+    chunk->fillColumn(x, z, height + 5, height + 11, DIAMOND);
+}
 
-        int rootHeight = 128;
 
-        Tree tree = Tree(glm::vec2(0.5f, 0.5f), 3.0f);
-        Tree *tr = &tree;
+void FillBlocksWorker::setSurfaceTerrain(Chunk *chunk, int chunkCornerX, int x, int chunkCornerZ,int z, int height){
 
-        tr->generatePath(2, "FX", 1);
-        tr->populateOps();
+    if( height < 136){
+        chunk->fillColumn(x, z, 128, 136, WATER);
+    }
 
-        // draw the tree trunk
-        int height = 45 + (int)(4.0f * (static_cast <float> (rand()) / static_cast <float> (RAND_MAX)));
+    else if( height < 142){
+        chunk->setBlockAt(x, height, z, GRASS);
+        chunk->fillColumn(x, z, 128, height, DIRT);
+    }
 
-        int thickness = 4;
+    else if (height > 180){
+        chunk->setBlockAt(x, height, z, SNOW);
+        chunk->fillColumn(x, z, 128, height, STONE);
+    }
+    else{
+        chunk->setBlockAt(x, height, z, STONE);
+        chunk->fillColumn(x, z, 128, height, DIRT);
+    }
+}
 
-        for(int x=pos[0]-thickness; x<=pos[0]+thickness; x++){
-            for(int z=pos[1]-thickness; z<=pos[1]+thickness; z++){
-                for(int i = 1; i <= height; ++i){
-                    setBlockAt(x, rootHeight + i, z, GWOOD);
-                }
+/**
+ * @brief stampStructureBlocks
+ *  Apply blocks[begin, end) to the chunk they fall in, by the StructureBlock rules
+ * @param chunk
+ * @param blocks
+ * @param begin
+ */
+static void stampStructureBlocks(Chunk *chunk, const std::vector<StructureBlock> &blocks, size_t begin)
+{
+    glm::ivec2 corner = chunk->getCorner();
+    for (size_t i = begin; i < blocks.size(); i++) {
+        const StructureBlock &b = blocks[i];
+        unsigned int x = static_cast<unsigned int>(b.pos.x - corner[0]);
+        unsigned int y = static_cast<unsigned int>(b.pos.y);
+        unsigned int z = static_cast<unsigned int>(b.pos.z - corner[1]);
+        if (!b.force) {
+            BlockType t = chunk->getBlockAtUnchecked(x, y, z);
+            if (t != EMPTY && t != b.alsoReplaces) {
+                continue;
             }
         }
+        chunk->setBlockAt(x, y, z, b.type);
+    }
+}
 
-        glm::vec2 turtlePos;
-        int yPos;
-
-        // loop over LSystem string path
-        for(int i = 0; i < tr->path.length(); ++i){
-
-            // dereference function pointer mapped to path character
-            (tr->*(tr->charToDrawingOperation[tr->path[i]]))();
-
-            // if turtle moves forward, draw a leaf block
-            if (tr->path[i] == 'F'){
-
-                turtlePos           = tr->activeTurtle.position;
-                yPos                = floor(turtlePos[1]);
-                glm::vec2 leafDir   = glm::vec2(turtlePos[0], 0.0f);
-                float angle         = 0.0f;
-
-                for(int j = 0; j < 8; ++j){
-                    angle       = 11.25f;
-                    leafDir     = glm::vec2(leafDir[0] * cosf(angle) - leafDir[1] * sinf(angle),
-                                            leafDir[0] * sinf(angle) + leafDir[1] * cosf(angle));
-
-                    int xpos    = leafDir[0] + pos[0];
-                    int ypos    = rootHeight + height - 3 + yPos;
-                    int zpos    = leafDir[1] + pos[1];
-
-                    BlockType t = getBlockAt(xpos, ypos, zpos);
-                    if (t == EMPTY){
-                        setBlockAt(xpos, ypos, zpos, GLEAF);
-                    }
-                }
-            }
+/**
+ * @brief Terrain::addErdtree
+ *  Generate the Erdtree rooted at pos once and add it as a structure.
+ * @param pos : (x, z) of the trunk's center
+ */
+void Terrain::addErdtree(const glm::ivec2 pos){
 
-            else if (tr->path[i] == '+'){
+    int rootHeight = 128;
 
-                turtlePos           = tr->activeTurtle.position;
-                yPos                = floor(turtlePos[1]);
-                glm::vec2 leafDir   = glm::vec2(turtlePos[0], 0.0f);
-                float angle         = 0.0f;
+    Random rng(m_worldSeed, pos[0], pos[1]);
+    const TreeTemplate &tree = TreeTemplateCache::get(TreeKind::erdtree, 2, rng.nextUInt());
 
-                for(int j = 0; j < 8; ++j){
-                    angle       = 11.25f;
-                    leafDir     = glm::vec2(leafDir[0] * cosf(angle) - leafDir[1] * sinf(angle),
-                                            leafDir[0] * sinf(angle) + leafDir[1] * cosf(angle));
+    std::vector<StructureBlock> erdtree;
+    for (const TreeTemplateBlock &b : tree.blocks) {
+        int x = b.xz[0] + pos[0];
+        int y = rootHeight + b.y;
+        int z = b.xz[1] + pos[1];
+        if (y < 0 || y >= 256) {
+            continue;
+        }
+        erdtree.push_back({glm::ivec3(x, y, z), b.type, b.force, b.alsoReplaces});
+    }
 
-                    int xpos    = leafDir[0] + pos[0];
-                    int ypos    = rootHeight + height + yPos;
-                    int zpos    = leafDir[1] + pos[1];
+    addStructure(erdtree);
+}
 
-                    BlockType t = getBlockAt(xpos, ypos, zpos);
-                    if (t == EMPTY || t == GLEAF){
-                        setBlockAt(xpos, ypos, zpos, GWOOD);
-                    }
-                }
-            }
+/**
+ * @brief Terrain::addStructure
+ *  Blocks outside [0, 256) in y are dropped.
+ * @param blocks
+ */
+void Terrain::addStructure(const std::vector<StructureBlock> &blocks)
+{
+    std::unordered_map<int64_t, std::vector<StructureBlock>> perChunk;
+    for (const StructureBlock &b : blocks) {
+        if (b.pos.y >= 0 && b.pos.y < 256) {
+            perChunk[toKey(b.pos.x & ~15, b.pos.z & ~15)].push_back(b);
+        }
+    }
+    for (std::pair<const int64_t, std::vector<StructureBlock>> &share : perChunk) {
+        sPtr<const std::vector<StructureBlock>> &writes = m_structureWrites[share.first];
+        sPtr<std::vector<StructureBlock>> grown = writes ? mkS<std::vector<StructureBlock>>(*writes)
+                                                         : mkS<std::vector<StructureBlock>>();
+        grown->insert(grown->end(), share.second.begin(), share.second.end());
+        writes = grown;
+        // its decorated stage has run, or runs, without them
+        if (m_structureWritesApplied.count(share.first) > 0) {
+            m_chunksToStamp.insert(share.first);
         }
     }
 }
 
-void FillBlocksWorker::drawTree(Chunk* chunk, const glm::ivec2 pos){
+size_t Terrain::getStructureWriteCount(int64_t key) const
+{
+    auto writes = m_structureWrites.find(key);
+    return writes != m_structureWrites.end() ? writes->second->size() : 0;
+}
 
-        int rootHeight = 137;
-        BlockType baseBlock = chunk->getBlockAt(pos[0], rootHeight, pos[1]);
-        if (baseBlock != GRASS){
-            return;
+void Terrain::collectStructureSpills()
+{
+    std::vector<StructureSpill> spills;
+    m_structureSpills.takeAll(spills);
+    for (const StructureSpill &spill : spills) {
+        if (m_spilledChunks.insert(toKey(spill.corner[0], spill.corner[1])).second) {
+            addStructure(spill.blocks);
         }
+    }
+}
 
-        Tree tree = Tree(glm::vec2(0.5f, 0.5f), 0.3f);
-        Tree *tr = &tree;
-
-        tr->generatePath(2, "FX", 1);
-        tr->populateOps();
-
-        // draw the tree trunk
-        int height = 7 + (int)(4.0f * (static_cast <float> (rand()) / static_cast <float> (RAND_MAX)));
-
-        int thickness = 0;
+/**
+ * @brief Terrain::stampStructureWrites
+ *  A chunk whose decorated stage worker still runs waits for it; an
+ *  evicted one gets every block from the worker of its next generation.
+ *  Stamped like applyCarvedCaves: the chunk is remeshed like an edited
+ *  one, and so are its neighbors, whose border faces it may cover.
+ */
+void Terrain::stampStructureWrites()
+{
+    int stamped = 0;
+    for (auto it = m_chunksToStamp.begin(); it != m_chunksToStamp.end() && stamped < structureChunksPerTick;) {
+        glm::ivec2 corner = toCoords(*it);
+        Chunk *chunk = m_chunks.find(ChunkMap::toChunkCoord(corner[0]), ChunkMap::toChunkCoord(corner[1]));
+        auto applied = m_structureWritesApplied.find(*it);
+        if (chunk == nullptr || applied == m_structureWritesApplied.end()) {
+            it = m_chunksToStamp.erase(it);
+            continue;
+        }
+        if (chunk->getGenerationStage() != GenerationStage::decorated) {
+            ++it;
+            continue;
+        }
 
-        for(int x=pos[0]-thickness; x<=pos[0]+thickness; x++){
-            for(int z=pos[1]-thickness; z<=pos[1]+thickness; z++){
-                for(int i = 1; i <= height; ++i){
-                    chunk->setBlockAt(glm::max(x, 0), rootHeight + i, glm::max(z, 0), WOOD);
-                }
+        const std::vector<StructureBlock> &writes = *m_structureWrites.at(*it);
+        chunk->beginWrite();
+        stampStructureBlocks(chunk, writes, applied->second);
+        chunk->endWrite();
+        applied->second = writes.size();
+        m_chunksToReclaim.insert(chunk);
+        m_blockChangeCount++;
+        if (m_chunksAwaitingMesh.count(chunk) == 0) {
+            requestEditRemesh(chunk);
+        }
+        for (Chunk *neighbor : chunk->getNeighbors()) {
+            if (neighbor != nullptr && hasMesh(neighbor)) {
+                neighbor->markAllSectionsDirty();
+                requestEditRemesh(neighbor);
             }
         }
+        it = m_chunksToStamp.erase(it);
+        stamped++;
+    }
+}
 
-        glm::vec2 turtlePos;
-        int yPos;
-
-        // loop over LSystem string path
-        for(int i = 0; i < tr->path.length(); ++i){
-
-            // dereference function pointer mapped to path character
-            (tr->*(tr->charToDrawingOperation[tr->path[i]]))();
-
-            // if turtle moves forward, draw a leaf block
-            if (tr->path[i] == 'F'){
+/**
+ * @brief ChunkStageWorker::drawTree
+ *  The neighbors may be featured at the same time, so the blocks past
+ *  this chunk are not written here but reported.
+ * @param root : the GRASS block the tree stands on
+ * @param variant : of the shared oaks
+ * @param spill
+ */
+void ChunkStageWorker::drawTree(glm::ivec3 root, uint32_t variant, std::vector<StructureBlock> &spill){
 
-                turtlePos           = tr->activeTurtle.position;
-                yPos                = floor(turtlePos[1]);
-                glm::vec2 leafDir   = glm::vec2(turtlePos[0], 0.0f);
-                float angle         = 0.0f;
+    glm::ivec2 corner = chunk->getCorner();
 
-                for(int j = 0; j < 8; ++j){
-                    angle       = 11.25f;
-                    leafDir     = glm::vec2(leafDir[0] * cosf(angle) - leafDir[1] * sinf(angle),
-                                            leafDir[0] * sinf(angle) + leafDir[1] * cosf(angle));
+    // stamp one of the shared oak variants
+    const TreeTemplate &tree = TreeTemplateCache::get(TreeKind::oak, 2, variant);
 
-                    int xpos    = glm::max(leafDir[0] + pos[0], 0.f);
-                    int ypos    = rootHeight + height - 3 + yPos;
-                    int zpos    = glm::max(leafDir[1] + pos[1], 0.f);
+    for (const TreeTemplateBlock &b : tree.blocks) {
+        glm::ivec3 pos(glm::floor(b.xz[0] + root.x), root.y + b.y, glm::floor(b.xz[1] + root.z));
+        if (pos.y < 0 || pos.y >= 256) {
+            continue;
+        }
+        int x = pos.x - corner[0];
+        int z = pos.z - corner[1];
+        if (x < 0 || x >= 16 || z < 0 || z >= 16) {
+            spill.push_back({pos, b.type, b.force, b.alsoReplaces});
+            continue;
+        }
 
-                    BlockType t = chunk->getBlockAt(xpos, ypos, zpos);
-                    if (t == EMPTY){
-                        chunk->setBlockAt(xpos, ypos, zpos, LEAF);
-                    }
-                }
+        if (!b.force) {
+            BlockType t = chunk->getBlockAt(x, pos.y, z);
+            if (t != EMPTY && t != b.alsoReplaces) {
+                continue;
             }
+        }
+        chunk->setBlockAt(x, pos.y, z, b.type);
+    }
+}
 
-            else if (tr->path[i] == '+'){
-
-                turtlePos           = tr->activeTurtle.position;
-                yPos                = floor(turtlePos[1]);
-                glm::vec2 leafDir   = glm::vec2(turtlePos[0], 0.0f);
-                float angle         = 0.0f;
-
-                for(int j = 0; j < 8; ++j){
-                    angle       = 11.25f;
-                    leafDir     = glm::vec2(leafDir[0] * cosf(angle) - leafDir[1] * sinf(angle),
-                                            leafDir[0] * sinf(angle) + leafDir[1] * cosf(angle));
-
-                    int xpos    = glm::max(leafDir[0] + pos[0], 0.f);
-                    int ypos    = rootHeight + height + yPos;
-                    int zpos    =  glm::max(leafDir[1] + pos[1], 0.f);
 
-                    BlockType t = chunk->getBlockAt(xpos, ypos, zpos);
-                    if (t == EMPTY){
-                        chunk->setBlockAt(xpos, ypos, zpos, LEAF);
-                    }
+/**
+ * @brief ChunkStageWorker::stampJumpStage
+ *  The boxes clipped to the chunk, in order
+ * @param boxes
+ */
+void ChunkStageWorker::stampJumpStage(const std::vector<ZoneFeatureIndex::StageBox> &boxes)
+{
+    glm::ivec2 corner = chunk->getCorner();
+    for (const ZoneFeatureIndex::StageBox &box : boxes) {
+        for (int x = std::max(box.min.x - corner[0], 0); x < std::min(box.max.x - corner[0], 16); x++) {
+            for (int z = std::max(box.min.z - corner[1], 0); z < std::min(box.max.z - corner[1], 16); z++) {
+                for (int y = box.min.y; y < box.max.y; y++) {
+                    chunk->setBlockAt(x, y, z, box.type);
                 }
             }
         }
+    }
 }
 
-
 /**
- * @brief addNPCJumpStages
- *  Helper to hard code the jump stages for fornite lama(s)
+ * @brief FillBlocksWorker::setBlocks
+ *  The shaping stage of a given chunk: surface columns, the dirt band and bedrock
  * @param chunk
  * @param chunkXCorner
  * @param chunkZCorner
+ * @param zoneHeightMap : heights of the chunk's zone
  */
-void addNPCJumpStages(Chunk *chunk, int chunkXCorner, int chunkZCorner)
+void FillBlocksWorker::setBlocks(Chunk *chunk, int chunkXCorner, int chunkZCorner, const ZoneHeightMap &zoneHeightMap)
 {
-    // a large platform
-    // (16, 32
+    for (int x = 0; x < 16; x++) {
+        for (int z = 0; z < 16; z++) {
 
-    if (chunkXCorner == 32 && chunkZCorner == 64)
-    {
+            // Make Surface Terrain
+            int y = zoneHeightMap.getHeight(chunkXCorner + x, chunkZCorner + z);
+            setSurfaceTerrain(chunk, chunkXCorner, x, chunkZCorner, z, y);
 
-        for (int x = 0; x < 6; x++)
-        {
-            for (int z = 0; z < 6; z++)
-            {
+            chunk->fillColumn(x, z, 125, 128, DIRT);
 
-                chunk->setBlockAt(x, 145, 15 - z, GWOOD);
-            }
+            chunk->setBlockAt(x, 0, z, BEDROCK);
         }
+    }
 
-        chunk->setBlockAt(1, 146, 14, WOOD);
+    chunk->setGenerationStage(GenerationStage::shaped);
+}
 
-        for (int x = 2; x < 4; x++)
-        {
-            for (int z = 2; z < 4; z++)
-            {
-                chunk->setBlockAt(x, 145, 15 - z, EMPTY);
-            }
-        }
+/**
+ * @brief FillBlocksWorker::run
+ *  The run() to shape the blocks of a given chunk
+ */
+void FillBlocksWorker::run()
+{
+    glm::ivec2 corner = chunk->getCorner();
+
+    // this chunk's tile of the zone's heights; the zone's other chunks
+    // fill theirs in parallel
+    Noise terrainHeightMap(worldSeed, gradientHash);
+    if (precomputedHeights) {
+        zoneHeightMap->fillTile(corner[0], corner[1], terrainHeightMap, *precomputedHeights);
+    } else {
+        zoneHeightMap->fillTile(corner[0], corner[1], terrainHeightMap);
+    }
 
-        for (int x = 8; x < 16; x++)
-        {
-            for (int z = 4; z < 12; z++)
-            {
-                chunk->setBlockAt(x, 146, 15 - z, GWOOD);
-            }
-        }
-        for (int x = 10; x < 14; x++)
-        {
-            for (int z = 6; z < 10; z++)
-            {
-                chunk->setBlockAt(x, 146, 15 - z, EMPTY);
-            }
+    bool loaded = false;
+    if (storedBlocks) {
+        // fully generated and edited before: straight to meshing
+        const QByteArray &blocks = *storedBlocks;
+        loaded = chunk->deserializeBlocks(reinterpret_cast<const uint8_t*>(blocks.constData()), blocks.size());
+        if (loaded) {
+            chunk->setGenerationStage(GenerationStage::decorated);
+        } else {
+            std::cout << "Regenerating unreadable stored chunk "
+                      << corner[0] << ", " << corner[1] << std::endl;
         }
+    }
+    if (!loaded) {
+        setBlocks(chunk, corner[0], corner[1], *zoneHeightMap);
+    }
 
-        for (int x = 13; x < 16; x++)
-        {
-            for (int z = 13; z < 16; z++)
-            {
-                chunk->setBlockAt(x, 147, 15 - z, GWOOD);
-            }
-        }
+    completedChunks->push(chunk);
+    chunk->unpin();
+}
 
-    }
+/**
+ * @brief FillBlocksWorker::cancel
+ *  The chunk stays unshaped; only the pin is released.
+ */
+void FillBlocksWorker::cancel()
+{
+    chunk->unpin();
+}
 
-    if (chunkXCorner == 48 && chunkZCorner == 64)
-    {
-        // x = 0
-        for (int z = 11; z < 16; z++)
-        {
-            chunk->setBlockAt(0, 147, 15 - z, GWOOD);
-            chunk->setBlockAt(1, 147, 15 - z, GWOOD);
-            chunk->setBlockAt(2, 147, 15 - z, GWOOD);
-        }
-    }
+bool FillBlocksWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(chunk->getCorner()) + glm::vec2(8.f);
+    return true;
+}
 
-    if (chunkXCorner == 48 && chunkZCorner == 48)
-    {
-        for (int x = 1; x < 6; x++)
-        {
-            for (int z = 1; z < 6; z++)
-            {
 
-                chunk->setBlockAt(x, 149, 15 - z, GWOOD);
-            }
-        }
+ChunkStageWorker::ChunkStageWorker(Chunk *chunk,
+                                   GenerationStage stage,
+                                   uint64_t worldSeed,
+                                   GradientHash gradientHash,
+                                   sPtr<const ZoneHeightMap> zoneHeightMap,
+                                   sPtr<const ZoneFeatureIndex> zoneFeatures,
+                                   MPSCQueue<Chunk*> *completedChunks,
+                                   sPtr<const std::vector<float>> zoneCaveDensities,
+                                   bool deferCaves,
+                                   MPSCQueue<StructureSpill> *structureSpills,
+                                   sPtr<const std::vector<StructureBlock>> structureBlocks)
+    : chunk(chunk), stage(stage), worldSeed(worldSeed), gradientHash(gradientHash),
+      zoneHeightMap(zoneHeightMap), zoneFeatures(zoneFeatures), zoneCaveDensities(zoneCaveDensities),
+      completedChunks(completedChunks), deferCaves(deferCaves),
+      structureSpills(structureSpills), structureBlocks(structureBlocks)
+{
+    chunk->pin();
+}
 
-        for (int x = 2; x < 4; x++)
-        {
-            for (int z = 2; z < 4; z++)
-            {
-                chunk->setBlockAt(x, 149, 15 - z, EMPTY);
+/**
+ * @brief ChunkStageWorker::carveCaves
+ *  Caves below the dirt band; the cave floor up to lavaLevel fills with
+ *  lava. Deferred, the band is all stone until a CaveWorker carves it.
+ */
+void ChunkStageWorker::carveCaves()
+{
+    if (deferCaves) {
+        for (unsigned int x = 0; x < 16; x++) {
+            for (unsigned int z = 0; z < 16; z++) {
+                chunk->fillColumn(x, z, 1, caveTop, STONE);
             }
         }
+        return;
+    }
 
-        for (int x = 8; x < 11; x++)
-        {
-            for (int z = 8; z < 11; z++)
-            {
-
-                chunk->setBlockAt(x, 150, 15 - z, GWOOD);
+    glm::ivec2 corner = chunk->getCorner();
+    Noise terrainHeightMap(worldSeed, gradientHash);
+
+    // cave densities for y in [1, 125)
+    std::vector<float> caveDensities;
+    if (zoneCaveDensities) {
+        // slice the chunk out of the zone's [x + 64 * (y - 1) + 64 * 124 * z] layout
+        int zoneX = static_cast<int>(glm::floor(corner[0] / 64.f)) * 64;
+        int zoneZ = static_cast<int>(glm::floor(corner[1] / 64.f)) * 64;
+        int offsetX = corner[0] - zoneX;
+        int offsetZ = corner[1] - zoneZ;
+        caveDensities.resize(16 * 124 * 16);
+        for (int z = 0; z < 16; z++) {
+            for (int y = 0; y < 124; y++) {
+                const float *src = &(*zoneCaveDensities)[offsetX + 64 * y + 64 * 124 * (offsetZ + z)];
+                std::copy(src, src + 16, &caveDensities[16 * y + 16 * 124 * z]);
             }
         }
+    } else {
+        terrainHeightMap.getCaveDensities(corner[0], corner[1], 1, 125, caveDensities);
+    }
 
-
-        for (int x = 12; x < 15; x++)
-        {
-            for (int z = 12; z < 15; z++)
-            {
-
-                chunk->setBlockAt(x, 151, 15 - z, GWOOD);
+    for (int x = 0; x < 16; x++) {
+        for (int z = 0; z < 16; z++) {
+            for(int y_underground=1; y_underground<caveTop;y_underground++){
+                float h = caveDensities[x + 16 * (y_underground - 1) + 16 * 124 * z];
+                if(h > 0.f){
+                    if(y_underground <= lavaLevel){
+                        chunk->setBlockAtUnchecked(x, y_underground, z, LAVA);
+                    }
+                    else{
+                        chunk->setBlockAtUnchecked(x, y_underground, z, EMPTY);
+                    }
+                } else {
+                    chunk->setBlockAtUnchecked(x, y_underground, z, STONE);
+                }
             }
         }
-
     }
+}
 
-    if (chunkXCorner == 64 && chunkZCorner == 32)
-    {
-        for (int x = 0; x < 6; x++)
-        {
-            for (int z = 0; z < 6; z++)
-            {
-
-                chunk->setBlockAt(x, 151, 15 - z, GWOOD);
-            }
+/**
+ * @brief ChunkStageWorker::plantTrees
+ */
+void ChunkStageWorker::plantTrees()
+{
+    glm::ivec2 corner = chunk->getCorner();
+
+    std::vector<StructureBlock> spill;
+    const ChunkFeature *begin, *end;
+    zoneFeatures->getChunkFeatures(corner[0], corner[1], begin, end);
+    for (const ChunkFeature *feature = begin; feature != end; feature++) {
+        if (feature->feature->kind != FeatureKind::tree) {
+            continue;
         }
-        for (int x = 2; x < 4; x++)
-        {
-            for (int z = 2; z < 4; z++)
-            {
-                chunk->setBlockAt(x, 151, 15 - z, EMPTY);
-            }
+        int x = feature->min.x;
+        int z = feature->min.y;
+        float treePosNoiseVal = zoneHeightMap->getTreeProbability(corner[0] + x, corner[1] + z);
+        if (treePosNoiseVal <= 0.5 || treePosNoiseVal >= 1.2) {
+            continue;
         }
-
-        for (int x = 8; x < 16; x++)
-        {
-            for (int z = 4; z < 12; z++)
-            {
-                chunk->setBlockAt(x, 151, 15 - z, GWOOD);
-            }
+        int height = zoneHeightMap->getHeight(corner[0] + x, corner[1] + z);
+        if (height < 0 || height >= 256 || chunk->getBlockAt(x, height, z) != GRASS) {
+            continue;
         }
-
-        chunk->setBlockAt(12, 152, 8, WOOD);
+        drawTree(glm::ivec3(corner[0] + x, height, corner[1] + z), feature->feature->variant, spill);
+    }
+    // reported before the chunk, so the neighbors' decorated stage finds it
+    if (!spill.empty()) {
+        structureSpills->push(StructureSpill{corner, std::move(spill)});
     }
 }
 
 /**
- * @brief FillBlocksWorker::setBlocks
- *  The private helper to set all the blocks of a given chunk
- * @param chunk
- * @param chunkXCorner
- * @param chunkZCorner
+ * @brief ChunkStageWorker::decorate
+ *  Floating islands over the water, and the test terrain's NPC jump stages
  */
-void FillBlocksWorker::setBlocks(Chunk *chunk, int chunkXCorner, int chunkZCorner)
+void ChunkStageWorker::decorate()
 {
-
-    Noise terrainHeightMap;
-
-
-    for (int x = 0; x < 16; x++) {
-        for (int z = 0; z < 16; z++) {
-
-            // Make Surface Terrain
-            double y = terrainHeightMap.getHeight(chunkXCorner + x , chunkZCorner + z);
-
-            double r = ((double) rand() / (RAND_MAX));
-            if (r > 0.5){
-                float treePosNoiseVal = terrainHeightMap.getTreeProbability(chunkXCorner + x , chunkZCorner + z);
-                if(treePosNoiseVal > 0.5 && treePosNoiseVal < 1.2){
-                    drawTree(chunk, glm::ivec2(11, 11));
-                    drawTree(chunk, glm::ivec2(5, 5));
+    glm::ivec2 corner = chunk->getCorner();
+    Noise terrainHeightMap(worldSeed, gradientHash);
+
+    const ChunkFeature *begin, *end;
+    zoneFeatures->getChunkFeatures(corner[0], corner[1], begin, end);
+    for (const ChunkFeature *feature = begin; feature != end; feature++) {
+        if (feature->feature->kind == FeatureKind::floatingIslands) {
+            for (int x = feature->min.x; x < feature->max.x; x++) {
+                for (int z = feature->min.y; z < feature->max.y; z++) {
+                    if (zoneHeightMap->getHeight(corner[0] + x, corner[1] + z) < 136) {
+                        // Make Floating Terrain if above water
+                        int floatIslandHeight = terrainHeightMap.getFloatingRockHeight(corner[0] + x, corner[1] + z);
+                        setFloatingTerrain(x, z, floatIslandHeight);
+                    }
                 }
             }
+        } else if (feature->feature->kind == FeatureKind::jumpStage) {
+            // explicitly for test terrain
+            stampJumpStage(ZoneFeatureIndex::getStageBoxes(feature->feature->variant));
+        }
+    }
+}
 
-            setSurfaceTerrain(chunk, chunkXCorner, x, chunkZCorner, z, y);
+/**
+ * @brief ChunkStageWorker::run
+ */
+void ChunkStageWorker::run()
+{
+    switch (stage) {
+    case GenerationStage::carved:
+        carveCaves();
+        break;
+    case GenerationStage::featured:
+        plantTrees();
+        break;
+    case GenerationStage::decorated:
+        decorate();
+        if (structureBlocks) {
+            stampStructureBlocks(chunk, *structureBlocks, 0);
+        }
+        // the blocks are settled: drop the palette entries generation left unused
+        chunk->compactSections();
+        break;
+    default:
+        break;
+    }
 
-            if(y < 136){
-                // Make Floating Terrain if above water
-                int floatIslandHeight = terrainHeightMap.getFloatingRockHeight(chunkXCorner + x , chunkZCorner + z);
-                setFloatingTerrain(chunk, chunkXCorner, x, chunkZCorner, z, floatIslandHeight);
+    chunk->setGenerationStage(stage);
 
-            }
+    completedChunks->push(chunk);
 
-            for(int y_underground=125; y_underground<128; y_underground++){
-                chunk->setBlockAt(x, y_underground, z, DIRT);
-            }
+    chunk->unpin();
+}
 
-            chunk->setBlockAt(x, 0, z, BEDROCK);
+void ChunkStageWorker::cancel()
+{
+    chunk->unpin();
+}
 
-            int lavaLevel = 30;
+bool ChunkStageWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(chunk->getCorner()) + glm::vec2(8.f);
+    return true;
+}
 
-            // Make Caves
-            for(int y_underground=1; y_underground<125;y_underground++){
-                float h = terrainHeightMap.getCaveHeight(chunkXCorner + x, y_underground, chunkZCorner + z);
-                if(h > 0.f){
-                    if(y_underground <= lavaLevel){
-                        chunk->setBlockAt(x, y_underground, z, LAVA);
-                    }
-                    else{
-                        chunk->setBlockAt(x, y_underground, z, EMPTY);
-                    }
-                } else {
-                    chunk->setBlockAt(x, y_underground, z, STONE);
-                }
 
-            }
+CaveWorker::CaveWorker(glm::ivec2 corner, uint64_t worldSeed, GradientHash gradientHash,
+                       MPSCQueue<CarvedCaves> *carvedCaves)
+    : corner(corner), worldSeed(worldSeed), gradientHash(gradientHash), carvedCaves(carvedCaves)
+{}
 
+/**
+ * @brief CaveWorker::run
+ *  The same densities as ChunkStageWorker::carveCaves, kept as bits.
+ */
+void CaveWorker::run()
+{
+    std::vector<float> densities;
+    Noise(worldSeed, gradientHash).getCaveDensities(corner[0], corner[1], 1, caveTop, densities);
+    CarvedCaves caves{corner, std::vector<uint64_t>((densities.size() + 63) / 64, 0)};
+    for (size_t cell = 0; cell < densities.size(); cell++) {
+        if (densities[cell] > 0.f) {
+            caves.cells[cell >> 6] |= 1ull << (cell & 63);
         }
     }
+    carvedCaves->push(std::move(caves));
+}
 
-    // explicitly for test terrain
-    // 48.f, 148.f, 32.f
-    // 48.f, 32.f
-    addNPCJumpStages(chunk, chunkXCorner, chunkZCorner);
+// reported without cells, so the chunk may be asked for again
+void CaveWorker::cancel()
+{
+    carvedCaves->push(CarvedCaves{corner, {}});
+}
 
+bool CaveWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(corner) + glm::vec2(8.f);
+    return true;
 }
 
-/**
- * @brief FillBlocksWorker::run
- *  The run() to fill the blocks of a given region
- */
-void FillBlocksWorker::run()
+
+TierWorker::TierWorker(Chunk *chunk, bool flat, MPSCQueue<RelaidChunk> *relaidChunks)
+    : chunk(chunk), flat(flat), relaidChunks(relaidChunks)
+{}
+
+void TierWorker::run()
 {
-    // TODO: iterate through each chunks in the zone
-    std::unordered_set<Chunk*> chunksWithBlocks = std::unordered_set<Chunk*>();
-    for (std::pair<int64_t, Chunk*> p : chunks) {
-        glm::ivec2 coord = toCoords(p.first);
-        setBlocks(p.second, coord[0], coord[1]);
-        chunksWithBlocks.insert(p.second);
-        for (const std::pair<Direction, Chunk*> pp : p.second->getNeighbors()) {
-            if (pp.second != nullptr && pp.second->isVBOLoaded()) {
-                chunksWithBlocks.insert(pp.second);
-            }
-        }
+    RelaidChunk result{chunk, chunk->snapshotBlocks(), ChunkBlocks()};
+    for (int sy = 0; sy < 16; sy++) {
+        result.to.sections[sy] = BlockSection::relayout(result.from.sections[sy], flat);
     }
+    relaidChunks->push(std::move(result));
+}
 
-    completedChunksLock->lock();
-    for (Chunk *chunk : chunksWithBlocks) {
-        completedChunks->insert(chunk);
-    }
-    completedChunksLock->unlock();
+void TierWorker::cancel()
+{
+    relaidChunks->push(RelaidChunk{chunk, ChunkBlocks(), ChunkBlocks()});
+}
+
+bool TierWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(chunk->getCorner()) + glm::vec2(8.f);
+    return true;
 }
 
 
@@ -1091,15 +4148,26 @@ void FillBlocksWorker::run()
  * @brief VBOWorker::VBOWorker
  * @param chunkWithoutVBO
  * @param completedChunkVBOs
- * @param completedChunkVBOsLock
+ * @param meshArena : a mapped arena, or null
+ * @param meshCache : or null
  */
 VBOWorker::VBOWorker(Chunk *chunkWithoutVBO,
-                     std::vector<ChunkVBOdata> *completedChunkVBOs,
-                     QMutex *completedChunkVBOsLock)
+                     MPSCQueue<ChunkVBOdata> *completedChunkVBOs,
+                     ChunkMeshArena *meshArena, MeshCache *meshCache)
     : chunkWithoutVBO(chunkWithoutVBO),
       completedChunkVBOs(completedChunkVBOs),
-      completedChunkVBOsLock(completedChunkVBOsLock)
-{}
+      meshArena(meshArena), meshCache(meshCache),
+      pinnedChunks{chunkWithoutVBO}
+{
+    for (Chunk *neighbor : chunkWithoutVBO->getNeighborhood()) {
+        if (neighbor != nullptr) {
+            pinnedChunks.push_back(neighbor);
+        }
+    }
+    for (Chunk *chunk : pinnedChunks) {
+        chunk->pin();
+    }
+}
 
 
 /**
@@ -1108,8 +4176,27 @@ VBOWorker::VBOWorker(Chunk *chunkWithoutVBO,
 void VBOWorker::run()
 {
     // create vbo
-    ChunkVBOdata vbo = chunkWithoutVBO->generateVBOdata();
-    completedChunkVBOsLock->lock();
-    completedChunkVBOs->push_back(vbo);
-    completedChunkVBOsLock->unlock();
+    ChunkVBOdata vbo = chunkWithoutVBO->generateVBOdata(meshCache);
+    // the main thread then only publishes the ranges
+    if (meshArena != nullptr) {
+        vbo.stage(*meshArena);
+    }
+    completedChunkVBOs->push(std::move(vbo));
+
+    for (Chunk *chunk : pinnedChunks) {
+        chunk->unpin();
+    }
+}
+
+void VBOWorker::cancel()
+{
+    for (Chunk *chunk : pinnedChunks) {
+        chunk->unpin();
+    }
+}
+
+bool VBOWorker::getFocus(glm::vec2 &xz) const
+{
+    xz = glm::vec2(chunkWithoutVBO->getCorner()) + glm::vec2(8.f);
+    return true;
 }
@@ -3,15 +3,41 @@
 #include "smartpointerhelp.h"
 #include "glm_includes.h"
 #include "chunk.h"
+#include "chunkdrawable.h"
+#include "chunkmap.h"
+#include "chunkpool.h"
+#include "lineararena.h"
+#include "mpscqueue.h"
 #include <array>
+#include <climits>
+#include <deque>
+#include <optional>
 #include <unordered_map>
 #include <unordered_set>
 #include "shaderprogram.h"
 #include "cube.h"
 #include "utils.h"
+#include <QElapsedTimer>
 #include <QMutex>
-#include <QThreadPool>
+#include <QString>
 #include "lsystems.h"
+#include "random.h"
+#include "treetemplate.h"
+#include "zoneheightmap.h"
+#include "zonefeatures.h"
+#include "terraincompute.h"
+#include "chunkcomputemesher.h"
+#include "terrainjobs.h"
+#include "chunkmultidraw.h"
+#include "entitygrid.h"
+#include "frustum.h"
+#include "regionstore.h"
+#include "meshcache.h"
+#include "editjournal.h"
+#include "navigationgraph.h"
+#include "terrainraycast.h"
+#include "liquidsimulation.h"
+#include "blockticks.h"
 
 
 //using namespace std;
@@ -19,37 +45,355 @@
 // Helper functions to convert (x, z) to and from hash map key
 int64_t toKey(int x, int z);
 glm::ivec2 toCoords(int64_t k);
+// The viewer's x-z distance to target, scaled from 1x straight ahead to
+// 2x straight behind (forward: normalized x-z direction, or 0); lower is
+// more urgent
+float viewerCost(glm::vec2 target, glm::vec2 viewer, glm::vec2 forward);
+// The center of the chunk holding (x, z): a view circle's center
+glm::vec2 viewCircleCenter(float x, float z);
+// Is one of the zone's chunk centers within radius blocks of center?
+bool isZoneInCircle(int xCorner, int zCorner, glm::vec2 center, float radius);
+
+// One block write of a structure (the Erdtree, a tree past its chunk's
+// border). Unless forced, the write only lands on EMPTY or on alsoReplaces.
+struct StructureBlock
+{
+    glm::ivec3 pos;
+    BlockType type;
+    bool force;
+    BlockType alsoReplaces;
+};
+
+// One placeBlockAt, as Terrain::setEditTracking records it
+struct BlockEdit
+{
+    glm::ivec3 pos;
+    BlockType type;
+};
+
+// An inclusive box of world blocks, and the layout of the arrays
+// Terrain::readRegion and writeRegion take: y fastest, then x, then z,
+// as a chunk section stores its blocks, so every column is one run
+struct BlockRegion
+{
+    glm::ivec3 min;
+    glm::ivec3 max;
+
+    glm::ivec3 size() const {
+        return max - min + glm::ivec3(1);
+    }
+    size_t volume() const {
+        glm::ivec3 s = size();
+        return glm::any(glm::lessThanEqual(s, glm::ivec3(0))) ? 0 : static_cast<size_t>(s.x) * s.y * s.z;
+    }
+    // the position of pos, inside the box, in the arrays
+    size_t index(glm::ivec3 pos) const {
+        glm::ivec3 s = size();
+        glm::ivec3 local = pos - min;
+        return local.y + static_cast<size_t>(s.y) * (local.x + static_cast<size_t>(s.x) * local.z);
+    }
+};
+
+// The blocks an area edit covers (see Terrain::editArea)
+enum class AreaShape : unsigned char
+{
+    box,
+    // the ellipsoid inscribed in the box
+    sphere
+};
+
+// The blocks an area edit destroyed, counted by the type they drop
+// (see Block::getDestroyedBlockType)
+using BlockDrops = std::unordered_map<BlockType, int>;
+
+// Ignited TNT waiting for its fuse (see Terrain::ignite)
+struct Explosion
+{
+    glm::ivec3 center;
+    float radius;
+    // the explosion clock's time it goes off at
+    float due;
+};
+
+// The blocks of the trees a chunk planted that fall in other chunks, as
+// its featured stage reports them (see Terrain::addStructure)
+struct StructureSpill
+{
+    glm::ivec2 corner;
+    std::vector<StructureBlock> blocks;
+};
+
+// What one Terrain::draw pass drew and culled. Sections only count when
+// they hold quads of the pass.
+struct TerrainCullStats
+{
+    int visibleChunks;
+    int culledChunks;
+    int visibleSections;
+    // outside the frustum / inside it but hidden behind opaque blocks
+    int culledSections;
+    int occludedSections;
+};
+
+// Where a chunk is in the streaming pipeline (see Terrain::getChunkDebugInfo)
+enum class ChunkDebugState : unsigned char
+{
+    queued,      // waiting on its neighbors for a generation stage or a mesh
+    generating,  // in its generation stages
+    meshing,     // generated, its mesh not uploaded yet, or an edit's remesh in flight
+    uploaded,    // drawn, as of the last culling
+    culled       // uploaded, but out of the drawn box or the frustum, or hidden
+};
+
+// A chunk's state and what its mesh costs, for the debug views
+struct ChunkDebugInfo
+{
+    glm::ivec2 corner;
+    ChunkDebugState state;
+    // 1 + the highest non-empty block, 0 if none
+    int top;
+    // per section, of both passes; 0 until uploaded
+    std::array<uint32_t, 16> sectionTriangles;
+    // the sections with triangles the last culling kept
+    uint16_t visibleSections;
+    // how long the uploaded mesh took to make, and the meshes uploaded
+    // since the chunk was first drawn
+    qint64 meshNs;
+    uint32_t meshings;
+};
+
+// The way of the chunks from their zone's request to the screen, since
+// the Terrain started (see Terrain::getPipelineStats)
+struct TerrainPipelineStats
+{
+    // chunks uploaded for the first time since spawnFillBlocksWorker
+    // requested them, and the time in between
+    uint64_t chunksShown;
+    qint64 showLatencyNs;
+    qint64 maxShowLatencyNs;
+    // meshes uploaded and the bytes copied for them, generated and edited
+    // alike (an edit updated in place copies only its sections)
+    uint64_t uploads;
+    uint64_t uploadBytes;
+    // by the last checkThreadResults, and per call, averaged like
+    // FrameProfile's phases
+    size_t lastUploadBytes;
+    float averageUploadBytes;
+    // when the first chunk was shown, since the Terrain started; -1 before
+    qint64 firstShownNs;
+    // the zones out of range whose meshes are pooled, and their bytes as
+    // of when they left (see Terrain::setMeshPoolBudget)
+    int pooledZones;
+    size_t pooledMeshBytes;
+    // zones drawn again from the pool, without a VBOWorker
+    uint64_t pooledZonesRestored;
+    // the kept zones whose meshes are destroyed to fit the GPU mesh
+    // budget, and the times one was (see Terrain::fitGpuBudget)
+    int budgetEvictedZones;
+    uint64_t budgetEvictions;
+    // evicted chunks kept for the next zones, and the chunks instantiated
+    // from them rather than constructed (see ChunkPool)
+    size_t pooledChunks;
+    uint64_t chunksReused;
+    uint64_t chunksCreated;
+    // whole-chunk meshings read from the mesh cache, and those that were
+    // not there and were made (see Terrain::setMeshCaching)
+    uint64_t meshCacheHits;
+    uint64_t meshCacheMisses;
+};
+
+// What the last expand() and checkThreadResults() did (see
+// Terrain::getFrameActivity), for the trace of a long frame
+struct TerrainFrameActivity
+{
+    // the last expand() found the player in another zone cell and
+    // rebuilt the zone sets
+    bool zoneSetsUpdated;
+    // the meshes the last checkThreadResults uploaded, generated and
+    // edited alike, and the bytes copied for them
+    uint64_t uploads;
+    size_t uploadBytes;
+    // the chunks now waiting on their neighbors for a generation stage or
+    // a mesh, and the finished meshes waiting for upload budget
+    size_t chunksAwaitingStage;
+    size_t chunksAwaitingMesh;
+    size_t pendingUploads;
+};
+
+// A chunk's caves as a CaveWorker found them: bit x + 16 * (y - 1) +
+// 16 * 124 * z of cells is set where a cave is, for y in [1, 125); no
+// cells: the worker was cancelled
+struct CarvedCaves
+{
+    glm::ivec2 corner;
+    std::vector<uint64_t> cells;
+};
+
+// A chunk's blocks in another layout, as a TierWorker made them: `to`
+// for the sections of `from` nothing was written to since; both empty
+// if the worker was cancelled
+struct RelaidChunk
+{
+    Chunk *chunk;
+    ChunkBlocks from;
+    ChunkBlocks to;
+};
 
 // The container class for all of the Chunks in the game.
-// Ultimately, while Terrain will always store all Chunks,
-// not all Chunks will be drawn at any given time as the world
-// expands.
+// Only the zones near the player are kept resident: once too many zones
+// are generated, the least recently visited ones outside the residency
+// radius are evicted (see evictZones), and generated again from the seed
+// when the player returns.
+// Chunks are stored in tiers: hot (flat sections) near the player, warm
+// (packed sections) elsewhere in the resident zones, and cold (compressed
+// in memory, see RegionStore) once evicted.
+// Not all resident Chunks are drawn at any given time.
 class Terrain {
 private:
-    // Stores every Chunk according to the location of its lower-left corner
-    // in world space.
-    // We combine the X and Z coordinates of the Chunk's corner into one 64-bit int
-    // so that we can use them as a key for the map, as objects like std::pairs or
-    // glm::ivec2s are not hashable by default, so they cannot be used as keys.
-    std::unordered_map<int64_t, uPtr<Chunk>> m_chunks;
-
-    // Keep a collection of the to-do tasks for creating the vbos of the chunks
-    // Note: the chunks in this collection must be filled with the blocks
-    std::unordered_set<Chunk*> m_chunksWithBlocks;
-    // the lock for the read / write to the m_chunksWithBlocks
-    QMutex m_chunksWithBlocksLock;
+    // The world's share of the threads every terrain worker runs on.
+    // Declared first so it goes last; ~Terrain still waits for the workers
+    // before anything else goes.
+    TerrainJobSystem m_jobs;
+
+    // Stores every resident Chunk according to the location of its lower-left
+    // corner in world space, divided by 16 (see ChunkMap::toChunkCoord).
+    ChunkMap m_chunks;
+    // the chunks of evicted zones, taken by instantiateChunkAt before the
+    // heap is (four zones' worth)
+    ChunkPool m_chunkPool;
+
+    // Chunks that just finished a generation stage (FillBlocksWorker / ChunkStageWorker).
+    // checkThreadResults moves them on to their next stage, or to a VBOWorker once decorated.
+    MPSCQueue<Chunk*> m_chunksWithBlocks;
+
+    // Chunks waiting for their next generation stage to become ready (main thread only)
+    std::unordered_set<Chunk*> m_chunksAwaitingStage;
+
+    // Chunks waiting for their neighborhood before they are meshed (main
+    // thread only): every existing neighbor, diagonal ones included, must
+    // be decorated too, so that a chunk is meshed once its border faces and
+    // light are final rather than again as each neighbor completes. A missing neighbor belongs to a zone
+    // nobody asked for and does not hold it back.
+    std::unordered_set<Chunk*> m_chunksAwaitingMesh;
+    bool isNeighborhoodReady(const Chunk *chunk) const;
+    // mesh the waiting chunks whose neighborhood is ready
+    void spawnReadyVBOWorkers();
+
+    // Chunks whose sections may hold retired data, freed once no worker
+    // pins them (main thread only)
+    std::unordered_set<Chunk*> m_chunksToReclaim;
+    void reclaimChunkSections();
 
     // Keep a collection of the to-do tasks for sending vbos to gpu
-    std::vector<ChunkVBOdata> m_chunksWithVBOs;
-    // the lock for the read / write to the m_chunksWithVBOs
-    QMutex m_chunksWithVBOsLock;
+    MPSCQueue<ChunkVBOdata> m_chunksWithVBOs;
+    // the VBOs remeshed for block edits (the fast lane), uploaded after
+    // m_chunksWithVBOs
+    MPSCQueue<ChunkVBOdata> m_editedChunkVBOs;
+
+    // drain m_chunksWithBlocks into m_chunksAwaitingStage, and
+    // m_chunksWithVBOs into m_pendingUploads (main thread only)
+    void collectReportedChunks();
+    void collectFinishedVBOs();
+
+    // Finished VBOs moved out of m_chunksWithVBOs, waiting for their upload
+    // (main thread only), at most one per chunk: the newest. Each tick
+    // uploads the ones nearest the viewer first, favoring those in front of
+    // it, until m_uploadByteBudget bytes are copied or m_uploadTimeBudgetUs
+    // microseconds are spent, so a burst of meshes is spread over frames.
+    std::vector<ChunkVBOdata> m_pendingUploads;
+    glm::vec3 m_viewerPos;
+    glm::vec3 m_viewerForward;
+    glm::vec3 m_viewerVelocity;
+    size_t m_uploadByteBudget;
+    int m_uploadTimeBudgetUs;
+    void queueUploads(std::vector<ChunkVBOdata> &vbos);
+    void uploadPending();
+
+    // when each chunk waiting for its first mesh was requested, by toKey
+    // of its corner, in ns of m_pipelineClock (main thread only)
+    std::unordered_map<int64_t, qint64> m_chunkRequestedAt;
+    QElapsedTimer m_pipelineClock;
+    TerrainPipelineStats m_pipelineStats;
+    TerrainFrameActivity m_frameActivity;
+    // count a mesh just uploaded in m_pipelineStats, which copied `bytes`
+    void noteUpload(const ChunkVBOdata &vbo, size_t bytes);
+
+    // The queued generation and meshing jobs rank the chunks nearest the
+    // viewer's lead position (where its velocity takes it within
+    // schedulingLeadSeconds) first, favoring those in front of it. The
+    // position and direction below are the ones the queue was last ranked
+    // with; once the viewer moved or turned far enough from them, the
+    // queue is ranked again (see setViewer).
+    glm::vec2 m_scheduledViewer;
+    glm::vec2 m_scheduledForward;
+    glm::vec2 getViewerLead() const;
+    glm::vec2 getViewerDirection() const;
+    // the zones, the most urgent first
+    ArenaVector<int64_t> orderZones(const ArenaSet<int64_t> &zones) const;
+
+    // Block edits are remeshed by fast-lane VBOWorkers, at most one per
+    // chunk at a time so their uploads cannot arrive out of order
+    // (main thread only):
+    // chunks with a fast-lane worker in flight or a result not uploaded yet
+    std::unordered_set<Chunk*> m_chunksRemeshing;
+    // chunks edited again meanwhile, remeshed once their result is uploaded
+    std::unordered_set<Chunk*> m_chunksToRemesh;
+    void requestEditRemesh(Chunk *chunk);
+    // remesh the neighborhood whose light a meshed chunk's edits changed
+    // (see ChunkVBOdata::relightsNeighbors)
+    void requestNeighborRelight(const ChunkVBOdata &vbo);
+
+    // the open beginEdit() batches and what they touched (main thread only):
+    // chunks whose blocks changed, and resident neighbors facing an edited border
+    int m_editDepth;
+    std::unordered_set<Chunk*> m_editedChunks;
+    std::unordered_set<Chunk*> m_editedNeighbors;
+    // bumped whenever resident blocks change (see getBlockChangeCount)
+    uint64_t m_blockChangeCount;
+    // the placeBlockAt calls since the last takeBlockEdits, while tracked
+    bool m_trackEdits;
+    std::vector<BlockEdit> m_blockEdits;
+    // the flowing WATER and LAVA, woken by every placeBlockAt
+    LiquidSimulation m_liquids;
+    // the scheduled updates and random ticks, scheduled by every placeBlockAt
+    BlockTicks m_blockTicks;
+    // the chunk holding world (x, z) if edits may change it: resident and
+    // decorated (its stage worker is its only writer until then)
+    Chunk *findEditableChunk(int x, int z);
+    // set one block of an open batch: remembered if tracked, and woken for
+    // the liquids and block ticks
+    void setBlockInBatch(Chunk *chunk, glm::ivec3 pos, BlockType t);
+    // once the batch set blocks of chunk in the box [low, high]: deferred
+    // caves near them are carved, and neighbors facing its borders remeshed
+    void noteChunkBoxEdited(Chunk *chunk, glm::ivec3 low, glm::ivec3 high);
+    // ignited TNT, soonest first, and what the explosions destroyed since
+    // the last takeExplosionDrops
+    std::deque<Explosion> m_explosions;
+    float m_explosionClock;
+    BlockDrops m_explosionDrops;
+
+    // chunks given to receiveChunk that were not decorated yet, by toKey
+    // of the corner: handed to their zone's shaping as stored chunks, or
+    // applied once they are decorated
+    std::unordered_map<int64_t, StoredChunkData> m_receivedChunks;
+    // replace a decorated chunk's blocks and remesh it and its neighbors
+    void applyReceivedChunk(Chunk *chunk, const StoredChunkData &blocks);
 
     // private helpers for workers
     // Note: (x, z) is zone's (xCorner, zCorner)
     void spawnFillBlocksWorker(int x, int z);
-    void spawnVBOWorker(Chunk* mp_chunk);
+    // restore: the chunk's cached faces are current (see Chunk::isMeshCurrent),
+    // so the cheap job goes ahead of generation
+    // (to m_computeMesher instead, when it is on)
+    void spawnVBOWorker(Chunk* mp_chunk, bool fastLane = false, bool restore = false);
+    // the CPU meshing job itself
+    void submitVBOWorker(Chunk* mp_chunk, bool fastLane, bool restore);
     void spawnVBOWorkers(const std::unordered_set<Chunk*> &completedChunksWithBlocks);
 
+    // staged generation: can `chunk` run `stage` given its neighbors' progress?
+    bool isReadyForStage(const Chunk *chunk, GenerationStage stage) const;
+    void spawnStageWorker(Chunk *chunk, GenerationStage stage);
+
     // We will designate every 64 x 64 area of the world's x-z plane
     // as one "terrain generation zone". Every time the player moves
     // near a portion of the world that has not yet been generated
@@ -61,21 +405,418 @@ private:
     // When milestone 1 has been implemented, the Player can move around the
     // world to add more "terrain generation zone" IDs to this set.
     // While only the 3 x 3 collection of terrain generation zones
-    // surrounding the Player should be rendered, the Chunks
-    // in the Terrain will never be deleted until the program is terminated.
+    // surrounding the Player should be rendered, the Chunks of a zone
+    // stay in the Terrain until the zone is evicted.
     std::unordered_set<int64_t> m_generatedTerrain;
 
-    // this set represents the currently loaded 5 x 5 zones
+    // the zones whose meshes are kept: the 5 x 5 zones drawn, and those
+    // left within meshMarginZones of them, so a player going back and
+    // forth over a zone edge does not destroy and rebuild them
     std::unordered_set<int64_t> m_prevBorderZones;
+    // the zone the player was in at the last expand() (its chunk, with a
+    // view radius), and its grid size: the sets above only change when
+    // either does
+    glm::ivec2 m_expandZone;
+    int m_expandHalfGridSize;
+    glm::ivec2 expandCell(float playerX, float playerZ) const;
+    // The view radius in chunks (see setViewRadius), 0 for the square grid,
+    // and the circle's center as of the last zone sets
+    int m_viewRadius;
+    glm::vec2 m_viewCenter;
+    // the radius in blocks of the circle a grid of halfGridSize stands for
+    // (the view's, plus a zone per extra ring), or 0 for the whole square
+    float zoneRadius(int halfGridSize) const;
+    // go over the zones as the player entered a new zone
+    void updateZoneSets(float playerX, float playerZ, int halfGridSize);
+
+    // loadInitialTerrain's zones go out a ring at a time around the spawn
+    // zone, each ring once the one inside it is decorated: queued all at
+    // once, every zone is shaped before any is carved (see
+    // generationStagePriority), so nothing shows until nearly all are
+    // done. expand() takes over once the player leaves the spawn zone.
+    bool m_loadingRings;
+    // the spawn zone's corner, the last ring and the ring generating
+    glm::ivec2 m_ringCenter;
+    int m_ringRadius;
+    int m_currentRing;
+    void spawnRing(int ring);
+    bool isRingDecorated(int ring) const;
+    // spawn the next ring once the current one is decorated
+    void advanceRings();
 
     void destroyZoneVBOs(int xCorner, int zCorner);
 
+    // height maps of the zones being shaped or shaped, published when their
+    // FillBlocksWorkers are queued; each fills its chunk's tile
+    std::unordered_map<int64_t, sPtr<const ZoneHeightMap>> m_zoneHeightMaps;
+    mutable QMutex m_zoneHeightMapsLock;
+    // the height map holding the column (x, z), if its tile is filled
+    sPtr<const ZoneHeightMap> findZoneHeightMap(int x, int z) const;
+    // the features of the same zones, built with their height maps (main
+    // thread only; the stage workers hold their zone's)
+    std::unordered_map<int64_t, sPtr<const ZoneFeatureIndex>> m_zoneFeatures;
+
+    // The structure blocks of each chunk, by toKey of its corner, in the
+    // order they were added. Kept for the whole session: a chunk evicted
+    // and generated again needs them again. Replaced, never changed, when
+    // blocks are added, so a stage worker may hold one.
+    std::unordered_map<int64_t, sPtr<const std::vector<StructureBlock>>> m_structureWrites;
+    // how many of its structure blocks each chunk holds, once its decorated
+    // stage worker was given them (or it came decorated, with them)
+    std::unordered_map<int64_t, size_t> m_structureWritesApplied;
+    // the chunks that got structure blocks since, stamped a few per tick
+    std::unordered_set<int64_t> m_chunksToStamp;
+    // the chunks whose tree spill was added, so one generated again does
+    // not add it twice
+    std::unordered_set<int64_t> m_spilledChunks;
+    MPSCQueue<StructureSpill> m_structureSpills;
+    size_t getStructureWriteCount(int64_t key) const;
+    // add the spills the featured stage workers reported
+    void collectStructureSpills();
+    // stamp the decorated chunks of m_chunksToStamp, at most
+    // structureChunksPerTick of them
+    void stampStructureWrites();
+
+    // null: headless (see isHeadless)
     OpenGLContext* mp_context;
 
+    // The uploaded meshes, by chunk: a chunk has one from its first upload
+    // until its mesh is destroyed, and none while headless (main thread only)
+    std::unordered_map<const Chunk*, uPtr<ChunkDrawable>> m_chunkDrawables;
+    ChunkDrawable *findDrawable(const Chunk *chunk) const;
+    // upload the mesh into its chunk's drawable, created by the first;
+    // returns the bytes copied (see ChunkDrawable::createVBOdata)
+    size_t uploadMesh(ChunkVBOdata &vbo);
+    // destroy the chunk's mesh, if it has one
+    void destroyMesh(const Chunk *chunk);
+    // Every chunk with a mesh, in no order, kept by uploadMesh and
+    // destroyMesh as meshes come and go, so a pass walks the meshes there
+    // are instead of looking up each chunk of the square it draws
+    struct RenderEntry
+    {
+        Chunk *chunk;
+        ChunkDrawable *mesh;
+    };
+    std::vector<RenderEntry> m_renderList;
+
+    // The meshes of the zones left past the kept ring stay uploaded, not
+    // drawn, until m_meshPoolBudget bytes of them are pooled; the zones
+    // left longest ago lose theirs first. A zone coming back into the
+    // grid is drawn again as it is (main thread only).
+    struct PooledZone
+    {
+        uint64_t pooledAt; // m_residencyClock when it left
+        size_t bytes;
+    };
+    std::unordered_map<int64_t, PooledZone> m_pooledZones;
+    size_t m_meshPoolBudget;
+    void poolZoneMeshes(int xCorner, int zCorner);
+    // forget the zone's pooling, its meshes kept; true if it was pooled
+    bool unpoolZone(int64_t zoneKey);
+    void trimMeshPool();
+    // destroy the meshes of the zone pooled longest ago; false if none is
+    bool trimOldestPooledZone();
+    size_t getZoneMeshBytes(int xCorner, int zCorner) const;
+
+    // Past MemoryStats' budget for the GPU meshes, the pool goes first,
+    // then the meshes of the kept zones, farthest from the player first;
+    // each comes back, from its chunks' cached faces, once it fits again
+    // (main thread only). The bytes each zone had when it lost them.
+    std::unordered_map<int64_t, size_t> m_budgetEvictedZones;
+    void fitGpuBudget(float playerX, float playerZ);
+    // mesh the zone's decorated chunks that have no mesh, from their
+    // cached faces where those are current
+    void restoreZoneMeshes(int xCorner, int zCorner);
+
+    // optional GPU backend for the height map and cave density (main thread only)
+    uPtr<TerrainComputeBackend> m_computeBackend;
+    // optional GPU backend for the chunk meshes, into m_meshArena (main thread only)
+    uPtr<ChunkComputeMesher> m_computeMesher;
+    // the vertex buffer chunk meshes are sub-allocated from, or null
+    uPtr<ChunkMeshArena> m_meshArena;
+    // the own buffers and VAOs of the chunk meshes, recycled across zones
+    // (main thread only)
+    ChunkBufferPool m_bufferPool;
+    // draws the chunks in m_meshArena with one call per pass, or null
+    uPtr<ChunkMultiDraw> m_multiDraw;
+    // the commands and origins of the current pass, kept to reuse their memory
+    std::vector<ChunkMultiDraw::Command> m_multiDrawCommands;
+    std::vector<glm::ivec2> m_multiDrawOrigins;
+
+    // Frustum and occlusion culling of chunks and their sections, from the
+    // first setCullingView on (main thread only)
+    bool m_frustumCulling;
+    Frustum m_cullFrustum;
+    glm::vec3 m_cullEye;
+    // The sections a line of sight from the eye may reach, as a bit per
+    // section of each reached chunk; only valid while m_sectionsOccluded
+    // (the eye is in a drawn chunk)
+    std::unordered_map<const Chunk*, uint16_t> m_visibleSections;
+    bool m_sectionsOccluded;
+    // the drawn chunks (minX, maxX, minZ, maxZ) m_visibleSections was
+    // searched over; a new view or new meshes invalidate it
+    glm::ivec4 m_visibleSectionsBounds;
+    bool m_visibleSectionsValid;
+    void findVisibleSections(int minX, int maxX, int minZ, int maxZ);
+    // the visible quad ranges (first, count) of the chunk being drawn
+    std::vector<glm::uvec2> m_drawRuns;
+    // the section layer of the eye, and per pass (opaque, transparent) the
+    // order a chunk's sections are drawn in, rebuilt when it changes
+    int m_eyeSection;
+    std::array<std::array<int, 16>, 2> m_sectionOrder;
+    void updateSectionOrder(int eyeSection);
+    // see setUnsortedTransparency
+    bool m_unsortedTransparency;
+    // the drawable chunks of the current pass by squared distance to the eye
+    struct DrawEntry
+    {
+        float distance;
+        Chunk *chunk;
+        ChunkDrawable *mesh;
+    };
+    std::vector<DrawEntry> m_drawOrder;
+    // of the last draw of each type: opaque, transparent
+    std::array<TerrainCullStats, 2> m_cullStats;
+    bool collectVisibleRuns(const Chunk &chunk, const ChunkDrawable &mesh, TerrainDrawType drawType,
+                            const Frustum *frustum, bool occluded, TerrainCullStats &stats);
+    // the pass of the chunks in the box, culled to frustum if any
+    void drawChunks(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram,
+                    ShaderProgram *animatedProgram, TerrainDrawType drawType, const Frustum *frustum,
+                    bool occluded, TerrainCullStats &stats);
+    // issue the multi-draw of the commands queued so far, and clear them
+    void flushMultiDraw();
+    // the corners of the chunks whose mesh changed since the last
+    // takeMeshChanges, while tracked (main thread only)
+    bool m_trackMeshChanges;
+    std::vector<glm::ivec2> m_meshChanges;
+    void noteMeshChange(const Chunk *chunk);
+    // chunks of the zones dispatched to the backend, keyed by zone
+    std::unordered_map<int64_t, std::unordered_map<int64_t, Chunk*>> m_computeZoneChunks;
+    // cave densities read back per zone, dropped once all 16 chunks are carved
+    struct ZoneCaveDensities
+    {
+        sPtr<const std::vector<float>> densities;
+        int chunksRemaining;
+    };
+    std::unordered_map<int64_t, ZoneCaveDensities> m_zoneCaveDensities;
+    // hand the finished backend zones to FillBlocksWorkers
+    void collectComputedZones();
+    // hand the finished compute meshes to the upload queues, as if a
+    // VBOWorker had pushed them, and the ones the arena had no room for
+    // to VBOWorkers
+    void collectComputedMeshes();
+
+    // Deferred caves (see setDeferredCaves): the carved stage only fills
+    // the underground with stone, and the caves of a decorated chunk are
+    // carved once the viewer nears their depth or digs toward them
+    // (main thread only)
+    bool m_deferCaves;
+    // corner keys of the chunks whose caves are still to carve, and of
+    // those a CaveWorker is carving
+    std::unordered_set<int64_t> m_uncarvedChunks;
+    std::unordered_set<int64_t> m_chunksCarving;
+    MPSCQueue<CarvedCaves> m_carvedCaves;
+    // start a CaveWorker for the chunk, if its caves are still to carve
+    void requestCaves(const Chunk *chunk);
+    // the uncarved chunks around the viewer, once it nears cave depth
+    void carveNearbyCaves();
+    // carve the caves the workers found into their chunks, and remesh
+    void applyCarvedCaves();
+
+    // Storage tiers of the resident chunks: the decorated ones within
+    // hotChunkRadius chunks of the player (the block ticks' range) get flat
+    // sections while the blocks are under their budget, and go back to
+    // packed ones past it or once the player leaves; TierWorkers build the
+    // new layouts (main thread only)
+    static const int hotChunkRadius = BlockTicks::randomTickRadius;
+    static const int maxTierJobs = 8;
+    std::unordered_set<Chunk*> m_hotChunks;
+    // the chunks a TierWorker is relaying, pinned until its result is applied
+    std::unordered_set<Chunk*> m_chunksRelaying;
+    MPSCQueue<RelaidChunk> m_relaidChunks;
+    void relayChunk(Chunk *chunk, bool flat);
+    void updateStorageTiers(float playerX, float playerZ);
+    void applyRelaidChunks();
+
+    // Residency: zones farther than m_residentRadius zones from the player are
+    // evicted, least recently used first, while more than m_maxResidentZones
+    // are generated (main thread only)
+    int m_residentRadius;
+    int m_maxResidentZones;
+    uint64_t m_residencyClock;
+    // m_residencyClock of the last expand() that had the zone in view
+    std::unordered_map<int64_t, uint64_t> m_zoneLastUsed;
+    void touchZones(const ArenaSet<int64_t> &zones);
+    void evictZones(float playerX, float playerZ, int halfGridSize);
+    // no worker, pending result or neighbor link still needs the zone's chunks
+    bool canEvictZone(int xCorner, int zCorner);
+    void evictZone(int xCorner, int zCorner);
+
+    // Stale work: a zone more than one ring past the drawn grid drops its
+    // queued FillBlocksWorkers and generated-mesh VBOWorkers, so fast
+    // flight does not spend the threads on terrain nobody sees (main
+    // thread only). The ids of jobs that already ran are harmless and are
+    // pruned as the lists grow.
+    std::unordered_map<int64_t, std::vector<TerrainJobId>> m_zoneShapeJobs;
+    std::unordered_map<int64_t, std::vector<TerrainJobId>> m_zoneMeshJobs;
+    // zones whose FillBlocksWorkers were dropped: no longer generated, and
+    // their unshaped chunks are deleted once nothing pins them, unless the
+    // zone comes back into range first and reuses them
+    std::unordered_set<int64_t> m_cancelledZones;
+    void cancelStaleZones(float playerX, float playerZ, int halfGridSize);
+    void dropCancelledZones();
+
+    // Modified chunks are written to the region store when their zone is
+    // evicted and on exit; a zone with stored chunks is read back before it
+    // is shaped, and its stored chunks skip the generation stages
+    uPtr<RegionStore> m_regionStore;
+    // Every block edit is journaled next to the region files; past
+    // journalCheckpointEdits of them the modified chunks are saved and the
+    // journal emptied. The edits it held at startup are replayed into their
+    // chunks once decorated
+    uPtr<EditJournal> m_editJournal;
+    static const size_t journalCheckpointEdits = 1 << 16;
+    // The VBOWorkers' meshes of whole chunks, cached next to the region
+    // files so a chunk meshed in a past session is not meshed again until
+    // its neighborhood changes; null while off (see setMeshCaching)
+    uPtr<MeshCache> m_meshCache;
+    void applyReplayedEdits(Chunk *chunk);
+    // chunks of the zones waiting for their stored chunks, keyed by zone
+    std::unordered_map<int64_t, std::unordered_map<int64_t, Chunk*>> m_zonesAwaitingStorage;
+    // stored chunks of the zones dispatched to the compute backend, keyed by zone
+    std::unordered_map<int64_t, std::unordered_map<int64_t, StoredChunkData>> m_computeZoneStoredChunks;
+    // hand the zones read back by the region store to shapeZone
+    void collectStoredZones();
+    // page in the region one region ahead of the player's heading
+    glm::vec2 m_prevExpandPosition;
+    int64_t m_lastPrefetchedRegion;
+    void prefetchAlongHeading(float playerX, float playerZ);
+    // Zones ahead of a fast viewer are generated before they reach the
+    // drawn grid: the grid's square is also requested around the point the
+    // viewer's velocity reaches while a chunk takes to be shown, a few
+    // zones per expand() and only while the grid itself is nearly done
+    // (see prefetchZones). That square is kept from cancelStaleZones too.
+    glm::vec2 m_prefetchPosition;
+    // off while the game idles in the background: no zone or region is
+    // prefetched, and m_prefetchPosition stays on the player
+    bool m_speculativeGeneration;
+    glm::vec2 getPrefetchPosition(float playerX, float playerZ) const;
+    void prefetchZones(const ArenaSet<int64_t> &currZones, int halfGridSize);
+    // start the first generation stage of a zone whose chunks are instantiated
+    void shapeZone(int xCorner, int zCorner, const std::unordered_map<int64_t, Chunk*> &chunks,
+                   std::unordered_map<int64_t, StoredChunkData> storedChunks);
+    // publish a fresh height map for the zone and queue a FillBlocksWorker
+    // per chunk to fill it
+    void spawnFillBlocksWorkers(int xCorner, int zCorner, const std::unordered_map<int64_t, Chunk*> &chunks,
+                                sPtr<const std::vector<int>> precomputedHeights,
+                                const std::unordered_map<int64_t, StoredChunkData> &storedChunks);
+
+    // seed of every random stream used by world generation
+    uint64_t m_worldSeed;
+    // gradient hash of every Noise used by world generation
+    GradientHash m_gradientHash;
+
+    // the NPCs' long routes over the chunks' navigation
+    NavigationGraph m_navigationGraph;
+    // the NPCs and the player, by chunk column
+    EntityGrid m_entityGrid;
+
 public:
     Terrain(OpenGLContext *context);
+    // jobPool: the threads to share with the other worlds on it; null for
+    // threads of its own
+    Terrain(OpenGLContext *context, uint64_t worldSeed,
+            GradientHash gradientHash = GradientHash::permutation, sPtr<TerrainJobPool> jobPool = nullptr);
+
+    uint64_t getWorldSeed() const;
+    GradientHash getGradientHash() const;
+
+    // Made without a context: the chunks are generated, edited and stored
+    // but never meshed, and nothing may be drawn (e.g. the world server)
+    bool isHeadless() const;
+    // whether the chunk's mesh is uploaded (main thread only)
+    bool hasMesh(const Chunk *chunk) const;
+
+    // the terrain's jobs, shared with the distant terrain
+    TerrainJobSystem &getJobSystem();
+    const TerrainJobSystem &getJobSystem() const;
+    // where NPC ticks may run (see NavigationGraph)
+    NavigationGraph &getNavigationGraph();
+    // any thread (see EntityGrid)
+    EntityGrid &getEntityGrid();
+    // Drop the queued generation and meshing jobs without waiting for the
+    // running ones, e.g. when quitting
+    void cancelWorkers();
+    // cancelWorkers() and wait for the running jobs; the I/O queue keeps
+    // going, so no write is lost
+    void stopWorkers();
+
+    // Switch zone generation to the compute backend. Needs a current
+    // GL 4.3 context; returns false and keeps the CPU path otherwise.
+    bool enableComputeBackend();
+    // release the backend's GPU objects (the context must be current)
+    void destroyComputeBackend();
+
+    // Mesh the chunks in a compute shader from now on. Needs the mesh
+    // arena and a current GL 4.3 context; returns false and keeps the VBO
+    // workers otherwise. Destroyed with the arena.
+    bool enableComputeMeshing();
+    void destroyComputeMeshing();
+
+    // Upload chunk meshes into one arena of `bytes` from now on (chunks
+    // fall back to their own buffers when it is full). Needs a current
+    // context; returns false and keeps per-chunk buffers otherwise.
+    bool enableMeshArena(size_t bytes);
+    // no VBO worker may be running (the context must be current)
+    void destroyMeshArena();
+    // delete the buffers recycled for the chunk meshes kept out of the
+    // arena, and those waiting to be (the context must be current)
+    void destroyBufferPool();
+    // Draw the chunks in the mesh arena with glMultiDrawElementsIndirect.
+    // Needs the arena and a current GL 4.3 context; returns false and
+    // keeps one draw per chunk otherwise. Destroyed with the arena.
+    bool enableMultiDraw();
+    void destroyMultiDraw();
     ~Terrain();
 
+    // Keep every zone within residentRadius zones of the player (never less
+    // than the drawn grid), and evict older zones beyond maxResidentZones
+    void setResidency(int residentRadius, int maxResidentZones);
+    // Stream and draw the zones with a chunk within `chunks` chunks of the
+    // player's chunk, rather than the whole square grid, which the calls
+    // taking a halfGridSize then get as halfGridForRadius(chunks); 0 (the
+    // default) goes back to the square
+    void setViewRadius(int chunks);
+    int getViewRadius() const;
+    static int halfGridForRadius(int chunks);
+    // Generate ahead of the player (see prefetchZones and
+    // prefetchAlongHeading), on by default; the grid itself is generated
+    // either way
+    void setSpeculativeGeneration(bool enabled);
+    size_t getResidentZoneCount() const;
+    // the chunks with flat sections, and the evicted ones kept compressed
+    size_t getHotChunkCount() const;
+    size_t getColdChunkCount() const;
+
+    // Switch the chunk mesher between one quad per face and greedy quads
+    // (see Chunk::setGreedyMeshing), remeshing every drawn chunk
+    void setGreedyMeshing(bool enabled);
+
+    // Generate the underground solid at first and carve the caves of a
+    // chunk only once the viewer comes near their depth or an edit digs
+    // toward them; off again, the chunks left solid are carved
+    void setDeferredCaves(bool enabled);
+
+    // Store modified chunks in `directory` from now on (the previous store
+    // is flushed first). Defaults to a per-seed folder of the app data.
+    void setRegionDirectory(const QString &directory);
+    // Keep the chunk meshes in the region directory across sessions (see
+    // MeshCache), on by default; waits for the queued meshing jobs
+    void setMeshCaching(bool enabled);
+    // queue every resident modified chunk for writing, then empty the
+    // edit journal they make redundant
+    void saveModifiedChunks();
+
     // Instantiates a new Chunk and stores it in
     // our chunk map at the given coordinates.
     // Returns a pointer to the created Chunk.
@@ -83,6 +824,11 @@ public:
     // Do these world-space coordinates lie within
     // a Chunk that exists?
     bool hasChunkAt(int x, int z) const;
+    // The Chunk holding these world-space coordinates, or null
+    const Chunk* findChunk(int x, int z) const;
+    // 1 + the highest non-empty block of the column as its Chunk holds it
+    // now (see Chunk::getColumnTop), or -1 if no Chunk holds it
+    int getColumnTop(int x, int z) const;
     // Assuming a Chunk exists at these coords,
     // return a mutable reference to it
     uPtr<Chunk>& getChunkAt(int x, int z);
@@ -91,8 +837,21 @@ public:
     const uPtr<Chunk>& getChunkAt(int x, int z) const;
     // Given a world-space coordinate (which may have negative
     // values) return the block stored at that point in space.
+    // Throws std::out_of_range if no Chunk holds the coordinates:
+    // only for callers that know the Chunk is there.
     BlockType getBlockAt(int x, int y, int z) const;
     BlockType getBlockAt(glm::vec3 p) const;
+    // Same lookup without the exception: std::nullopt if no Chunk
+    // holds the coordinates. Use this wherever the Chunk may be missing.
+    std::optional<BlockType> tryGetBlockAt(int x, int y, int z) const;
+    std::optional<BlockType> tryGetBlockAt(glm::vec3 p) const;
+    // Where a ray from origin, as far as direction is long, stops in a
+    // block other than EMPTY or a missing chunk (see castRay). Wherever
+    // blocks may be read.
+    TerrainRayHit raycast(glm::vec3 origin, glm::vec3 direction) const;
+    // hits[i] for rays[i], cast on the job threads too (see castRays).
+    // Main thread only.
+    void raycast(const std::vector<TerrainRay> &rays, std::vector<TerrainRayHit> &hits);
     // Given a world-space coordinate (which may have negative
     // values) set the block at that point in space to the
     // given type.
@@ -101,22 +860,69 @@ public:
     // add additional helper to check whether the block exist or not
     bool hasBlockAt(glm::vec3 p) const;
 
+    // Surface height of the world column (x, z): read from the zone's
+    // cached height map when the zone is filled, otherwise computed
+    int getSurfaceHeight(int x, int z) const;
+    // The biome masks of the column (x, z), read or computed the same
+    // way (see Noise::getBiomeNoise)
+    glm::vec2 getBiomeNoise(int x, int z) const;
+
     // Draws every Chunk that falls within the bounding box
     // described by the min and max coords, using the provided
-    // ShaderProgram
-    void draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram, TerrainDrawType drawType);
+    // ShaderProgram; given an animatedProgram, the chunks with faces of
+    // animatable blocks in the pass (see ChunkDrawable::hasAnimatedFaces)
+    // are drawn with it instead, after the others
+    void draw(int minX, int maxX, int minZ, int maxZ, ShaderProgram *shaderProgram, TerrainDrawType drawType,
+              ShaderProgram *animatedProgram = nullptr);
     // custom draw to
     // draw the chunks around the player at (playerX, playerZ)
     // with a defined halfGridSize
     // the side of the grid is (1 + 2 * halfGridSize) chunks
-    void draw(float playerX, float playerZ, int halfGridSize, ShaderProgram *shaderProgram, TerrainDrawType drawType);
+    void draw(float playerX, float playerZ, int halfGridSize, ShaderProgram *shaderProgram, TerrainDrawType drawType,
+              ShaderProgram *animatedProgram = nullptr);
+    // Skip the chunks and sections outside this view projection's frustum,
+    // or hidden from the eye behind opaque blocks, in the following draws
+    void setCullingView(const glm::mat4 &viewProj, const glm::vec3 &eye);
+    // Find the sections in view of the chunks draw(playerX, ...) draws,
+    // for both passes; a draw without it searches on its own
+    void cull(float playerX, float playerZ, int halfGridSize);
+    // The lights of the uploaded meshes' emissive blocks within range of
+    // the eye of setCullingView, and that reach into its frustum, into
+    // lights (cleared first)
+    void collectLights(float range, std::vector<PointLight> &lights) const;
+    // what the last draw of the type drew and culled
+    TerrainCullStats getCullStats(TerrainDrawType drawType) const;
+    // every resident chunk's state and mesh costs into chunks (cleared
+    // first), culled as the last draw was
+    void getChunkDebugInfo(std::vector<ChunkDebugInfo> &chunks) const;
+    // The transparent pass blends in any order (see TransparencyBuffer):
+    // draw its chunks unsorted and its sections bottom up, which merges
+    // each chunk's visible sections into the fewest runs
+    void setUnsortedTransparency(bool unsorted);
+    // Draw the opaque pass of the chunks draw(playerX, ...) draws, as seen
+    // by a light, into its shadow map (see ShadowMap); leaves the camera's
+    // culling alone
+    void drawShadowCasters(float playerX, float playerZ, int halfGridSize,
+                           const glm::mat4 &lightViewProj, ShaderProgram *shaderProgram);
+
+    // Remember the corners of the chunks whose mesh is uploaded or
+    // destroyed from now on, for takeMeshChanges; off by default
+    void setMeshChangeTracking(bool enabled);
+    // the corners remembered since the last call, possibly repeated
+    void takeMeshChanges(std::vector<glm::ivec2> &corners);
 
     // Initializes the Chunks that store the 64 x 256 x 64 block scene you
     // see when the base code is run.
     void CreateTestScene();
     void CreateTestGrassScene();
 
-    void drawErdtree(const glm::ivec2);
+    // place the Erdtree rooted at (x, z) (see addStructure)
+    void addErdtree(const glm::ivec2);
+    // Place blocks anywhere in the world, split per chunk: a chunk not
+    // decorated yet gets its share from its decorated stage worker, one
+    // already decorated a few ticks later (see stampStructureWrites), and
+    // one not generated yet once it is. Nothing waits on the others.
+    void addStructure(const std::vector<StructureBlock> &blocks);
 
     // Terrain expansion that instantiate the Chunks (including the blocks inside)
     // around the player.
@@ -128,65 +934,268 @@ public:
     void loadInitialTerrain(float playerX, float playerZ, int halfGridSize);
 
     // check thread result
-    // send the result from FillBlocksWorkers to VBOWorkers
+    // advance chunks through the generation stages,
+    // send the decorated ones to VBOWorkers and upload finished VBOs
     void checkThreadResults();
 
+    // Where the player stands, looks and moves, to order the pending
+    // uploads and the queued jobs
+    void setViewer(glm::vec3 pos, glm::vec3 forward, glm::vec3 velocity);
+    // Per tick, stop uploading once `bytes` were copied or `micros` spent;
+    // one VBO is uploaded per tick whatever its cost, and edits bypass it
+    void setUploadBudget(size_t bytes, int micros);
+    // finished VBOs not uploaded yet
+    size_t getPendingUploadCount() const;
+    TerrainPipelineStats getPipelineStats() const;
+    TerrainFrameActivity getFrameActivity() const;
+    // Keep up to `bytes` of the meshes of the zones out of range uploaded,
+    // so going back there draws them at once; 0: destroy them on leaving
+    void setMeshPoolBudget(size_t bytes);
 
 
-    // for player to destroy & add blocks
+
+    // for player to destroy & add blocks; within beginEdit() / commitEdit()
+    // the remesh is deferred to the commit
     void placeBlockAt(int x, int y, int z, BlockType t);
+
+    // Batch many placeBlockAt calls (e.g. an explosion): the edits only
+    // dirty their sections, and commitEdit() marks every edited chunk
+    // modified and remeshes each affected chunk once. Batches nest; only
+    // the outermost commit applies them. Never keep one open across
+    // expand(), which may evict the edited chunks.
+    void beginEdit();
+    void commitEdit();
+
+    // Copy the blocks of region into out, region.volume() of them in
+    // BlockRegion::index order: a run per chunk section column instead of a
+    // lookup per block. Blocks of chunks not resident read as missing,
+    // those above and below the world as EMPTY. Main thread only.
+    void readRegion(const BlockRegion &region, BlockType *out, BlockType missing = EMPTY) const;
+    // Set the blocks of region to blocks (laid out as readRegion's), or
+    // only those whose mask entry is not 0 when mask is given, in one
+    // batch. Only the blocks that differ are written, as by placeBlockAt;
+    // chunks it would not edit are skipped. Returns the blocks changed.
+    size_t writeRegion(const BlockRegion &region, const BlockType *blocks, const uint8_t *mask = nullptr);
+
+    // how far TNT blasts, the seconds it burns once lit by the player or by
+    // another explosion, and the explosions carved per update at most
+    static constexpr float tntRadius = 4.f;
+    static constexpr float tntFuse = 1.5f;
+    static constexpr float chainFuse = 0.25f;
+    static const int maxExplosionsPerUpdate = 8;
+
+    // Set every block of the area centered at center to t, in one batch:
+    // the chunks it spans are walked once each (see writeRegion), and
+    // each remeshes the sections it dirtied once. BEDROCK stays; so do blocks of chunks
+    // placeBlockAt would not edit. The replaced blocks drop into drops, if
+    // given, except EMPTY and liquids, and TNT when ignited is given, which
+    // gets its position instead. Returns the blocks changed.
+    size_t editArea(glm::vec3 center, glm::vec3 halfExtents, AreaShape shape, BlockType t,
+                    BlockDrops *drops = nullptr, std::vector<glm::ivec3> *ignited = nullptr);
+
+    // The TNT block at pos is lit: it is removed now, if still there, and
+    // a sphere of radius blocks around it is carved once its fuse burns
+    // out. TNT the sphere reaches is lit in turn with a chainFuse, so
+    // chains spread breadth-first, a ring per fuse.
+    void ignite(glm::ivec3 pos, float fuse = tntFuse, float radius = tntRadius);
+    // Carve the explosions due after dT more seconds, at most
+    // maxExplosionsPerUpdate; the rest wait for the next call
+    void updateExplosions(float dT);
+    size_t getPendingExplosionCount() const;
+    // what the explosions destroyed since the last call, for the Inventory
+    void takeExplosionDrops(BlockDrops &drops);
+
+    // Remember every placeBlockAt from now on, for takeBlockEdits (e.g. to
+    // send them over a connection, see NetClient); off by default
+    void setEditTracking(bool enabled);
+    // the edits remembered since the last call, in order
+    void takeBlockEdits(std::vector<BlockEdit> &edits);
+    // placeBlockAt each edit made elsewhere, in one batch, without
+    // remembering them
+    void applyRemoteEdits(const std::vector<BlockEdit> &edits);
+    // Let the liquids the edits woke flow (see LiquidSimulation), once per
+    // tick. Their writes are not remembered for takeBlockEdits: every peer
+    // flows the same edits on its own.
+    void updateLiquids(float dT);
+    const LiquidSimulation &getLiquids() const;
+    // Run the block ticks due (see BlockTicks), once per tick, the random
+    // ones around viewer. Their writes are remembered like any edit: only
+    // the server ticks when there is one, and sends them.
+    void updateBlockTicks(float dT, glm::vec3 viewer);
+    const BlockTicks &getBlockTicks() const;
+    // Counts the changes to resident blocks: edit batches, caves, structures
+    // and received chunks. Whatever was computed from the blocks at one
+    // count may be stale at another (see NPC::repairPath)
+    uint64_t getBlockChangeCount() const;
+    // Take blocks (a Chunk::serializeBlocks encoding) as the chunk with
+    // this corner instead of generating it: at once if it is decorated,
+    // otherwise when its zone is shaped or it is decorated. The chunk is
+    // marked modified, so the region store keeps it.
+    void receiveChunk(int x, int z, StoredChunkData blocks);
 };
 
 
-// Worker to fill the blocks
-class FillBlocksWorker : public QRunnable
+// Pool priority of each generation stage (higher runs first),
+// so the visible surface of new zones is shaped before anything else
+int generationStagePriority(GenerationStage stage);
+
+// Worker to shape a chunk: the first generation stage. The 16 chunks of a
+// zone are shaped in parallel, each filling its own tile of the zone's
+// shared height map.
+class FillBlocksWorker : public TerrainJob
 {
 private:
     // TODO: other biome attrubites can be added here
     // TODO: zone attributes
     // TODO: wrap the height mapping logic in setBlocks
-    int xCorner;
-    int zCorner;
-    std::unordered_map<int64_t, Chunk*> chunks;
-    std::unordered_set<Chunk*> *completedChunks;
-    QMutex *completedChunksLock;
+    Chunk *chunk;
+    sPtr<ZoneHeightMap> zoneHeightMap;
+    MPSCQueue<Chunk*> *completedChunks;
+    uint64_t worldSeed;
+    GradientHash gradientHash;
+    // the zone's heights read back from the compute backend, or null to
+    // compute them here
+    sPtr<const std::vector<int>> precomputedHeights;
+    // the chunk's blocks loaded from the region store, which skip every
+    // stage, or null
+    StoredChunkData storedBlocks;
 
     // helper to set the blocks of each chunk
     void setSurfaceTerrain(Chunk *chunk, int chunkCornerX, int x, int chunkCornerZ, int z, int height);
-    void setFloatingTerrain(Chunk *chunk, int chunkCornerX, int x, int chunkCornerZ, int z, int height);
-    void setBlocks(Chunk *chunk, int chunkXCorner, int chunkZCorner);
-
-    void drawTree(Chunk* chunk, const glm::ivec2);
+    void setBlocks(Chunk *chunk, int chunkXCorner, int chunkZCorner, const ZoneHeightMap &zoneHeightMap);
 
 public:
     // constructor
     // Note: completedChunks == m_chunksWithBlocks (in terrain)
-    FillBlocksWorker(int x,
-                     int z,
-                     std::unordered_map<int64_t, Chunk*> chunks,
-                     std::unordered_set<Chunk*> *completedChunks,
-                     QMutex *completedChunksLock);
+    FillBlocksWorker(Chunk *chunk,
+                     sPtr<ZoneHeightMap> zoneHeightMap,
+                     MPSCQueue<Chunk*> *completedChunks,
+                     uint64_t worldSeed,
+                     GradientHash gradientHash,
+                     sPtr<const std::vector<int>> precomputedHeights = nullptr,
+                     StoredChunkData storedBlocks = nullptr);
 
     // run()
     void run() override;
+    void cancel() override;
+    bool getFocus(glm::vec2 &xz) const override;
 };
 
 
+// Worker to run one of the later generation stages (carved, featured, decorated) on a chunk.
+// Spawned by Terrain::checkThreadResults once the stage's neighbor dependencies hold.
+class ChunkStageWorker : public TerrainJob
+{
+private:
+    Chunk *chunk;
+    GenerationStage stage;
+    uint64_t worldSeed;
+    GradientHash gradientHash;
+    sPtr<const ZoneHeightMap> zoneHeightMap;
+    // featured, decorated: what to place in the chunk
+    sPtr<const ZoneFeatureIndex> zoneFeatures;
+    // the zone's cave densities from the compute backend, or null to compute them here
+    sPtr<const std::vector<float>> zoneCaveDensities;
+    MPSCQueue<Chunk*> *completedChunks;
+    // carved: fill the underground with stone and leave the caves to a CaveWorker
+    bool deferCaves;
+    // featured: where the blocks of trees past the chunk go
+    MPSCQueue<StructureSpill> *structureSpills;
+    // decorated: the chunk's structure blocks, or null
+    sPtr<const std::vector<StructureBlock>> structureBlocks;
+
+    // the stages
+    void carveCaves();
+    void plantTrees();
+    void decorate();
+
+    // the tree rooted on the world block root; its blocks past the chunk go to spill
+    void drawTree(glm::ivec3 root, uint32_t variant, std::vector<StructureBlock> &spill);
+    void setFloatingTerrain(int x, int z, int height);
+    // the blocks of a jump stage within the chunk
+    void stampJumpStage(const std::vector<ZoneFeatureIndex::StageBox> &boxes);
+
+public:
+    // Note: completedChunks == m_chunksWithBlocks (in terrain)
+    ChunkStageWorker(Chunk *chunk,
+                     GenerationStage stage,
+                     uint64_t worldSeed,
+                     GradientHash gradientHash,
+                     sPtr<const ZoneHeightMap> zoneHeightMap,
+                     sPtr<const ZoneFeatureIndex> zoneFeatures,
+                     MPSCQueue<Chunk*> *completedChunks,
+                     sPtr<const std::vector<float>> zoneCaveDensities = nullptr,
+                     bool deferCaves = false,
+                     MPSCQueue<StructureSpill> *structureSpills = nullptr,
+                     sPtr<const std::vector<StructureBlock>> structureBlocks = nullptr);
+
+    // run()
+    void run() override;
+    void cancel() override;
+    bool getFocus(glm::vec2 &xz) const override;
+};
+
+
+// Worker to find a chunk's deferred caves (see Terrain::setDeferredCaves).
+// It reads no block: the main thread carves what it finds, so the chunk
+// keeps one writer, and may be evicted (and generated again) meanwhile.
+class CaveWorker : public TerrainJob
+{
+private:
+    glm::ivec2 corner;
+    uint64_t worldSeed;
+    GradientHash gradientHash;
+    MPSCQueue<CarvedCaves> *carvedCaves;
+
+public:
+    CaveWorker(glm::ivec2 corner, uint64_t worldSeed, GradientHash gradientHash,
+               MPSCQueue<CarvedCaves> *carvedCaves);
+
+    void run() override;
+    void cancel() override;
+    bool getFocus(glm::vec2 &xz) const override;
+};
+
+
+// Worker to lay a chunk's sections out flat or packed (see
+// BlockSection::relayout), from a snapshot of them
+class TierWorker : public TerrainJob
+{
+private:
+    Chunk *chunk;
+    bool flat;
+    MPSCQueue<RelaidChunk> *relaidChunks;
+
+public:
+    TierWorker(Chunk *chunk, bool flat, MPSCQueue<RelaidChunk> *relaidChunks);
+
+    void run() override;
+    void cancel() override;
+    bool getFocus(glm::vec2 &xz) const override;
+};
+
 // Worker to create vbo
-class VBOWorker : public QRunnable
+class VBOWorker : public TerrainJob
 {
 private:
     Chunk *chunkWithoutVBO;
-    std::vector<ChunkVBOdata> *completedChunkVBOs;
-    QMutex *completedChunkVBOsLock;
+    MPSCQueue<ChunkVBOdata> *completedChunkVBOs;
+    // a mapped arena to copy the mesh into, or null
+    ChunkMeshArena *meshArena;
+    // where a meshing of the whole chunk is looked up and stored, or null
+    MeshCache *meshCache;
+    // the chunk and the neighborhood it reads, pinned for the run
+    std::vector<Chunk*> pinnedChunks;
 
 public:
     // constructor
     // Note: completedChunksVBOs == m_chunksWithVBOs (in terrain);
     VBOWorker(Chunk *chunkWithoutVBO,
-              std::vector<ChunkVBOdata> *completedChunkVBOs,
-              QMutex *completedChunkVBOsLock);
+              MPSCQueue<ChunkVBOdata> *completedChunkVBOs,
+              ChunkMeshArena *meshArena, MeshCache *meshCache);
 
     // run()
     void run() override;
+    void cancel() override;
+    bool getFocus(glm::vec2 &xz) const override;
 };
@@ -0,0 +1,221 @@
+#include "terrainraycast.h"
+#include "blockcursor.h"
+#include "terrain.h"
+#include "terrainjobs.h"
+#include "smartpointerhelp.h"
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <limits>
+
+namespace {
+
+// the rays a thread takes at a time
+const size_t raysPerRun = 64;
+// ahead of all terrain work: the main thread waits on it
+const int raycastPriority = 8;
+
+/**
+ * @brief The RaycastBatch struct
+ *  One castRays call, shared with its jobs: it outlives the call for as
+ *  long as a job still holds it.
+ */
+struct RaycastBatch
+{
+    const Terrain *terrain;
+    const std::vector<TerrainRay> *rays;
+    std::vector<TerrainRayHit> *hits;
+    // the first ray no thread took yet
+    std::atomic<size_t> nextRay;
+
+    QMutex lock;
+    QWaitCondition jobFinished;
+    // jobs run or cancelled; guarded by lock
+    int finishedJobs;
+
+    RaycastBatch(const Terrain *terrain, const std::vector<TerrainRay> *rays, std::vector<TerrainRayHit> *hits)
+        : terrain(terrain), rays(rays), hits(hits), nextRay(0), lock(), jobFinished(), finishedJobs(0)
+    {}
+
+    // cast runs of rays until none is left
+    void castRuns()
+    {
+        BlockCursor cursor(*terrain);
+        size_t count = rays->size();
+        for (size_t start = nextRay.fetch_add(raysPerRun); start < count; start = nextRay.fetch_add(raysPerRun)) {
+            size_t end = std::min(start + raysPerRun, count);
+            for (size_t i = start; i < end; ++i) {
+                (*hits)[i] = castRay(cursor, (*rays)[i]);
+            }
+        }
+    }
+
+    void finishJob()
+    {
+        QMutexLocker locker(&lock);
+        ++finishedJobs;
+        jobFinished.wakeAll();
+    }
+};
+
+class RaycastWorker : public TerrainJob
+{
+private:
+    sPtr<RaycastBatch> m_batch;
+
+public:
+    RaycastWorker(sPtr<RaycastBatch> batch)
+        : m_batch(std::move(batch))
+    {}
+
+    void run() override
+    {
+        m_batch->castRuns();
+        m_batch->finishJob();
+    }
+
+    void cancel() override
+    {
+        m_batch->finishJob();
+    }
+};
+
+/**
+ * @brief skipEmptyCube
+ *  Move the march to the last block of the empty cube of side span
+ *  around cell the ray goes through, so the next step leaves the cube.
+ *  The blocks are recomputed from where the ray leaves, and kept between
+ *  cell and the cube's far side, so the march never goes back.
+ * @return false, moving nothing, if the ray ends inside the cube
+ */
+bool skipEmptyCube(const TerrainRay &ray, glm::vec3 dir, glm::ivec3 step, float maxLen, int span,
+                   glm::ivec3 &cell, glm::vec3 &tMax)
+{
+    // the cube's corner: span is a power of two
+    glm::ivec3 corner = cell & glm::ivec3(~(span - 1));
+    int axis = -1;
+    float tExit = std::numeric_limits<float>::infinity();
+    for (int i = 0; i < 3; ++i) {
+        if (step[i] != 0) {
+            int bound = step[i] > 0 ? corner[i] + span : corner[i];
+            float t = (bound - ray.origin[i]) / dir[i];
+            if (t < tExit) {
+                tExit = t;
+                axis = i;
+            }
+        }
+    }
+    if (axis < 0 || !(tExit <= maxLen)) {
+        return false;
+    }
+
+    glm::vec3 exit = ray.origin + dir * tExit;
+    for (int i = 0; i < 3; ++i) {
+        if (step[i] == 0) {
+            continue;
+        }
+        int last = step[i] > 0 ? corner[i] + span - 1 : corner[i];
+        int block = i == axis ? last : static_cast<int>(glm::floor(exit[i]));
+        cell[i] = step[i] > 0 ? glm::clamp(block, cell[i], last) : glm::clamp(block, last, cell[i]);
+        tMax[i] = (step[i] > 0 ? cell[i] + 1 - ray.origin[i] : cell[i] - ray.origin[i]) / dir[i];
+    }
+    return true;
+}
+
+}
+
+TerrainRayHit castRay(BlockCursor &cursor, const TerrainRay &ray)
+{
+    TerrainRayHit result;
+    glm::ivec3 cell = glm::ivec3(glm::floor(ray.origin));
+    result.block = cell;
+    result.prevBlock = cell;
+
+    float maxLen = glm::length(ray.direction); // Farthest we search
+    if (!(maxLen > 0.f) || glm::any(glm::isnan(ray.origin))) {
+        return result;
+    }
+    glm::vec3 dir = ray.direction / maxLen; // Now all t values represent world dist.
+
+    // per axis: the step to the next cell, the t of the next cell
+    // boundary, and the t between two boundaries
+    glm::ivec3 step(0);
+    glm::vec3 tMax(std::numeric_limits<float>::infinity());
+    glm::vec3 tDelta(std::numeric_limits<float>::infinity());
+    for (int i = 0; i < 3; ++i) {
+        if (dir[i] > 0.f) {
+            step[i] = 1;
+            tMax[i] = (cell[i] + 1 - ray.origin[i]) / dir[i];
+            tDelta[i] = 1.f / dir[i];
+        } else if (dir[i] < 0.f) {
+            // a ray starting on a boundary crosses it at once
+            step[i] = -1;
+            tMax[i] = (cell[i] - ray.origin[i]) / dir[i];
+            tDelta[i] = -1.f / dir[i];
+        }
+    }
+
+    // how far the empty space around cell reaches (see BlockCursor::getEmptySpan)
+    int span = cursor.getEmptySpan(cell.x, cell.y, cell.z);
+    while (true) {
+        if (span > 1) {
+            skipEmptyCube(ray, dir, step, maxLen, span, cell, tMax);
+        }
+
+        int axis = 0;
+        if (tMax[1] < tMax[axis]) {
+            axis = 1;
+        }
+        if (tMax[2] < tMax[axis]) {
+            axis = 2;
+        }
+        float t = tMax[axis];
+        if (!(t <= maxLen)) {
+            break;
+        }
+
+        result.prevBlock = cell;
+        cell[axis] += step[axis];
+        tMax[axis] += tDelta[axis];
+
+        span = cursor.getEmptySpan(cell.x, cell.y, cell.z);
+        if (span == 0) {
+            result.hit = true;
+            result.type = cursor.tryGetBlockAt(cell.x, cell.y, cell.z);
+            result.distance = t;
+            result.block = cell;
+            return result;
+        }
+    }
+
+    result.distance = maxLen;
+    result.block = cell;
+    return result;
+}
+
+void castRays(const Terrain &terrain, TerrainJobSystem &jobs,
+              const std::vector<TerrainRay> &rays, std::vector<TerrainRayHit> &hits)
+{
+    hits.resize(rays.size());
+
+    // the runs the calling thread leaves for the others
+    int helpers = std::min(jobs.threadCount(), static_cast<int>((rays.size() + raysPerRun - 1) / raysPerRun) - 1);
+    sPtr<RaycastBatch> batch = mkS<RaycastBatch>(&terrain, &rays, &hits);
+    std::vector<TerrainJobId> ids;
+    for (int i = 0; i < helpers; ++i) {
+        ids.push_back(jobs.submit<RaycastWorker>(TerrainJobQueue::meshing, raycastPriority, batch));
+    }
+
+    batch->castRuns();
+
+    // the jobs still queued have nothing left to cast
+    for (TerrainJobId id : ids) {
+        jobs.cancel(id);
+    }
+    QMutexLocker locker(&batch->lock);
+    while (batch->finishedJobs < helpers) {
+        batch->jobFinished.wait(&batch->lock);
+    }
+}
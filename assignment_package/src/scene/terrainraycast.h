@@ -0,0 +1,69 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include <optional>
+#include <vector>
+
+class BlockCursor;
+class Terrain;
+class TerrainJobSystem;
+
+// A ray through the terrain: from origin along direction, as far as
+// direction is long
+struct TerrainRay
+{
+    glm::vec3 origin;
+    glm::vec3 direction;
+
+    TerrainRay()
+        : origin(0.f), direction(0.f)
+    {}
+    TerrainRay(glm::vec3 origin, glm::vec3 direction)
+        : origin(origin), direction(direction)
+    {}
+};
+
+// Where a TerrainRay stopped
+struct TerrainRayHit
+{
+    // a block other than EMPTY, or a missing chunk, stopped the ray
+    bool hit;
+    // what stopped it; std::nullopt for a missing chunk
+    std::optional<BlockType> type;
+    // how far along the ray it stopped, or went
+    float distance;
+    // the block it stopped in, or the last it went through
+    glm::ivec3 block;
+    // the block it went through before `block`: the face it entered
+    // `block` through is between the two
+    glm::ivec3 prevBlock;
+
+    TerrainRayHit()
+        : hit(false), type(std::nullopt), distance(0.f), block(0), prevBlock(0)
+    {}
+};
+
+/**
+ * @brief castRay
+ *  March the ray block by block with Amanatides and Woo's DDA, reading
+ *  through the cursor, so the steps inside a chunk or across to its
+ *  neighbors cost no chunk lookup. An empty brick or section (see
+ *  BlockSection::getOccupiedBricks) is crossed in one step, so a ray
+ *  through the sky costs a step per section. The block the ray starts
+ *  in is not tested. Never throws: a ray of no length, or not a number, goes
+ *  nowhere and hits nothing.
+ */
+TerrainRayHit castRay(BlockCursor &cursor, const TerrainRay &ray);
+
+/**
+ * @brief castRays
+ *  hits[i] for rays[i], the rays split into runs taken by the job
+ *  system's threads and the calling thread alike. Returns once every
+ *  ray is cast: the runs no thread started are cancelled once the
+ *  calling thread ran out of them.
+ *  Main thread only, like TerrainJobSystem::submit, at a time the jobs
+ *  may read the terrain (no chunk is added or dropped meanwhile).
+ */
+void castRays(const Terrain &terrain, TerrainJobSystem &jobs,
+              const std::vector<TerrainRay> &rays, std::vector<TerrainRayHit> &hits);
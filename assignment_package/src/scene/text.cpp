@@ -1,12 +1,20 @@
 #include "text.h"
+#include <algorithm>
+#include <cmath>
+
+// the font is a grid of fontCells x fontCells glyph cells, and its distance
+// field reaches spread pixels from an outline either way
+static const int fontCells = 16;
+static const int spread = 2;
 
 Text::Text(OpenGLContext *context, float width, float height)
-    : Drawable(context), width_height_len(glm::vec2(12.f/256.f, 16.f/256.f)), width_height_screen_ratio(width/height)
+    : HudDrawable(context), width_height_len(glm::vec2(12.f/256.f, 16.f/256.f)), width_height_screen_ratio(width/height)
 {}
 
 Text::~Text() {};
 
 void Text::insertNewInfo(std::string currText, glm::vec2 currCoord) {
+    glyphRuns.clear();
     if (currText == "textWidthHeight") {
         width_height_len = currCoord;
         return;
@@ -68,91 +76,126 @@ bool Text::loadUVCoordFromText(const char* text_path) {
 
 void Text::resizeDimension(float width, float height) {
     width_height_screen_ratio = width/height;
+    glyphRuns.clear();
     return;
 }
 
 /**
  * @brief Text::addText
- *  store text info in text object for further drawing
- * @param text : string, the text itself
+ *  store text info in text object for further drawing; a label added
+ *  before at this height reuses its run
+ * @param text : the text itself, null-terminated
  * @param
  * @return
  */
 // draw the text given text info and the top-left coordinate, and the height of the text
 // -1 <= pos.x, pos.y < 1
 // 0 < height < 2, associated with the height of the screen
-bool Text::addText(std::string text, glm::vec2 pos, float height) {
-    float width = height * (width_height_len[0]/width_height_len[1]) / width_height_screen_ratio;
-    int shiftX = 0;
-
-    for (char c : text) {
-        std::array<TextData, 4> textData;
-        std::array<glm::vec2, 4> positions;
-        glm::vec2 top_left_pos(pos + glm::vec2(shiftX * width, 0));
-        positions[0] = top_left_pos + glm::vec2(0, -height);
-        positions[1] = top_left_pos + glm::vec2(width, -height);
-        positions[2] = top_left_pos + glm::vec2(width, 0);
-        positions[3] = top_left_pos;
-
-        for (int i=0; i<4; ++i) {
-            TextData charData(positions[i], TextCollection[c][i]);
-            textData[i] = charData;
+bool Text::addText(const char *text, glm::vec2 pos, float height) {
+    GlyphRun &run = glyphRuns[std::make_pair(std::string(text), height)];
+    if (run.pos.empty()) {
+        float width = height * (width_height_len[0]/width_height_len[1]) / width_height_screen_ratio;
+        int shiftX = 0;
+
+        for (; *text != '\0'; text++) {
+            const std::array<glm::vec2, 4> &uvs = TextCollection[*text];
+            std::array<glm::vec2, 4> positions;
+            glm::vec2 top_left_pos(shiftX * width, 0.f);
+            positions[0] = top_left_pos + glm::vec2(0, -height);
+            positions[1] = top_left_pos + glm::vec2(width, -height);
+            positions[2] = top_left_pos + glm::vec2(width, 0);
+            positions[3] = top_left_pos;
+
+            for (int i=0; i<4; ++i) {
+                pushVec4ToBuffer(run.pos, glm::vec4(positions[i], 0.999999f, 1.f));
+                pushVec2ToBuffer(run.uv, uvs[i]);
+            }
+            shiftX += 1;
         }
-        texts.push_back(textData);
-        shiftX += 1;
     }
-
-//    for (auto& text : texts) {
-//        std::cout << "======" << std::endl;
-//        for (auto& textData : text) {
-//            std::cout << textData.pos[0] << " " <<textData.pos[1] << std::endl;
-//            std::cout << textData.uv[0] << " " <<textData.uv[1] << std::endl;
-//            std::cout << "------" << std::endl;
-//        }
-
-//        std::cout << "======" << std::endl;
-//    }
-
+    run.used = true;
+    texts.push_back(PlacedRun{&run, pos});
     return true;
 }
 
 void Text::createVBOdata() {
 
-    std::vector<GLuint> indices;
-    std::vector<GLuint> faceIndices = {0, 1, 2, 0, 2, 3};
-    std::vector<float> buffer_pos;
-    std::vector<float> buffer_uv;
-    int nVert = 0;
-
-    for (auto& text : texts) {
+    ArenaVector<float> buffer_pos;
+    ArenaVector<float> buffer_uv;
 
-        for (int i=0; i<4; ++i) {
-            pushVec4ToBuffer(buffer_pos, text[i].pos);
-            pushVec2ToBuffer(buffer_uv, text[i].uv);
+    for (const PlacedRun &text : texts) {
+        const std::vector<float> &pos = text.run->pos;
+        for (size_t i = 0; i < pos.size(); i += 4) {
+            buffer_pos.push_back(pos[i] + text.pos.x);
+            buffer_pos.push_back(pos[i + 1] + text.pos.y);
+            buffer_pos.push_back(pos[i + 2]);
+            buffer_pos.push_back(pos[i + 3]);
         }
-
-        // add indices for each face (4 vertices)
-        for (int index : faceIndices) {
-            indices.push_back(nVert + index);
-        }
-        // move the offset for indices
-        nVert += 4;
+        buffer_uv.insert(buffer_uv.end(), text.run->uv.begin(), text.run->uv.end());
     }
 
-    m_count = indices.size();
-
-    generateIdx();
-    bindIdx();
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
-
-    generatePos();
-    bindPos();
-    mp_context->glBufferData(GL_ARRAY_BUFFER, buffer_pos.size() * sizeof(float), buffer_pos.data(), GL_STATIC_DRAW);
-
-    generateUV();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufUV);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, buffer_uv.size() * sizeof(float), buffer_uv.data(), GL_STATIC_DRAW);
+    // drawn with the rest of the HUD (see HudBatch)
+    addQuads(buffer_pos, buffer_uv);
 
     texts.clear();
+    for (auto it = glyphRuns.begin(); it != glyphRuns.end();) {
+        if (it->second.used) {
+            it->second.used = false;
+            ++it;
+        } else {
+            it = glyphRuns.erase(it);
+        }
+    }
     return;
 }
+
+/**
+ * @brief Text::bakeDistanceField
+ *  A pixel is ink at alpha >= 128; its distance to the outline is the one
+ *  from its center to the nearest pixel of the other kind, less half a
+ *  pixel, searched in its own glyph cell only so a glyph never picks up
+ *  its neighbor's. The color is the nearest ink's, so the filtered edge
+ *  keeps the glyph's color.
+ * @param font
+ * @return
+ */
+QImage Text::bakeDistanceField(const QImage &font) {
+    QImage bitmap = font.convertToFormat(QImage::Format_ARGB32);
+    QImage field(bitmap.width(), bitmap.height(), QImage::Format_ARGB32);
+    int cellWidth = std::max(bitmap.width() / fontCells, 1);
+    int cellHeight = std::max(bitmap.height() / fontCells, 1);
+    int radius = spread + 1;
+
+    for (int y = 0; y < bitmap.height(); y++) {
+        for (int x = 0; x < bitmap.width(); x++) {
+            QRgb pixel = bitmap.pixel(x, y);
+            bool ink = qAlpha(pixel) >= 128;
+            int cellX = x - x % cellWidth;
+            int cellY = y - y % cellHeight;
+            int nearest = radius * radius * 2 + 1;
+            int nearestInk = nearest;
+            QRgb color = pixel;
+
+            for (int sy = std::max(y - radius, cellY); sy <= std::min(y + radius, cellY + cellHeight - 1); sy++) {
+                for (int sx = std::max(x - radius, cellX); sx <= std::min(x + radius, cellX + cellWidth - 1); sx++) {
+                    QRgb other = bitmap.pixel(sx, sy);
+                    bool otherInk = qAlpha(other) >= 128;
+                    int d2 = (sx - x) * (sx - x) + (sy - y) * (sy - y);
+                    if (otherInk != ink) {
+                        nearest = std::min(nearest, d2);
+                    }
+                    if (!ink && otherInk && d2 < nearestInk) {
+                        nearestInk = d2;
+                        color = other;
+                    }
+                }
+            }
+
+            float distance = std::min(std::sqrt(static_cast<float>(nearest)) - 0.5f, static_cast<float>(spread));
+            float alpha = 0.5f + (ink ? distance : -distance) / (2.f * spread);
+            int a = static_cast<int>(std::round(255.f * std::min(std::max(alpha, 0.f), 1.f)));
+            field.setPixel(x, y, qRgba(qRed(color), qGreen(color), qBlue(color), a));
+        }
+    }
+    return field;
+}
@@ -1,28 +1,40 @@
 #pragma once
-#include "drawable.h"
+#include "huddrawable.h"
 #include <unordered_map>
+#include <QImage>
 #include <QApplication>
 #include <QFile>
 #include <iostream>
 #ifndef TEXT_H
 #define TEXT_H
 
-// helper function for storing all vbo related data for text
-struct TextData
+// a label's quads as addText lays them out, with its top-left corner at
+// the origin: 4 vec4 positions and 4 vec2 uvs per glyph
+struct GlyphRun
 {
-    // each TextData contains a vertex position and a UV coord
-    glm::vec4 pos;
-    // later, the uv coordinate is manually set
-    glm::vec2 uv;
+    std::vector<float> pos;
+    std::vector<float> uv;
+    // added since the last createVBOdata; the runs that were not are dropped
+    bool used;
+};
 
-    TextData(glm::vec2 p, glm::vec2 u)
-        : pos(glm::vec4(p, 0.999999f, 1.f)), uv(u) {}
-    TextData()
-        : pos(), uv() {}
+// the key of a run: its string and its height
+struct GlyphRunKeyHash
+{
+    size_t operator()(const std::pair<std::string, float> &key) const
+    {
+        return std::hash<std::string>()(key.first) ^ (std::hash<float>()(key.second) * 31);
+    }
+};
 
+// a run to draw this frame, and where
+struct PlacedRun
+{
+    const GlyphRun *run;
+    glm::vec2 pos;
 };
 
-class Text : public Drawable
+class Text : public HudDrawable
 {
 protected:
     // for computing width pos based on the height
@@ -30,8 +42,12 @@ protected:
     // determine the width relative to height loaded from text file
     glm::vec2 width_height_len;
 
+    // the runs of the labels drawn lately, so a label redrawn as it was
+    // (the counts, the HP) is copied rather than laid out again; cleared
+    // whenever the layout changes
+    std::unordered_map<std::pair<std::string, float>, GlyphRun, GlyphRunKeyHash> glyphRuns;
     // all texts drawn on the screen
-    std::vector<std::array<TextData, 4>> texts;
+    std::vector<PlacedRun> texts;
 
     // compute the uv in 4 coordinates based on uv on top-left and width_height_text_ratio
     void insertNewInfo(std::string text, glm::vec2 uv_topleft);
@@ -50,10 +66,16 @@ public:
     // draw the text given text info and the top-left coordinate, and the height of the text
     // -1 <= pos.x, pos.y < 1
     // 0 < height < 2, associated with the height of the screen
-    bool addText(std::string text, glm::vec2 pos, float height);
+    bool addText(const char *text, glm::vec2 pos, float height);
 
     void resizeDimension(float width, float height);
 
+    // The font's layer of the HUD's texture array as a signed distance
+    // field, from the bitmap font: alpha 0.5 on the glyphs' outlines, up
+    // inside, down outside, so the HUD shader cuts the outline sharp at any
+    // height. As large as the bitmap, so it fits the HUD's other layers
+    static QImage bakeDistanceField(const QImage &font);
+
     virtual void createVBOdata();
 };
 
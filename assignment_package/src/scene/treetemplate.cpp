@@ -0,0 +1,113 @@
+#include "treetemplate.h"
+#include "lsystems.h"
+#include "random.h"
+
+QMutex TreeTemplateCache::lock;
+std::unordered_map<uint64_t, uPtr<TreeTemplate>> TreeTemplateCache::templates;
+
+// Per-kind shape parameters of the trees
+struct TreeStyle
+{
+    float fDistance;
+    int minHeight;
+    int thickness;
+    BlockType trunk;
+    // block drawn on 'F' (only over EMPTY)
+    BlockType leaf;
+    // block drawn on '+' (over EMPTY or branchAlsoReplaces)
+    BlockType branch;
+    BlockType branchAlsoReplaces;
+};
+
+static const TreeStyle oakStyle     = {0.3f, 7, 0, WOOD, LEAF, LEAF, EMPTY};
+static const TreeStyle erdtreeStyle = {3.0f, 45, 4, GWOOD, GLEAF, GWOOD, GLEAF};
+
+/**
+ * @brief TreeTemplateCache::get
+ *  Return the tree grown from (kind, iterations, seed), growing it on first use.
+ * @param kind
+ * @param iterations : L-system rewriting steps
+ * @param seed
+ * @return
+ */
+const TreeTemplate& TreeTemplateCache::get(TreeKind kind, int iterations, uint64_t seed)
+{
+    uint64_t key = Random::mix(Random::mix(seed) ^ (static_cast<uint64_t>(kind) << 8 | static_cast<uint64_t>(iterations)));
+
+    lock.lock();
+    auto it = templates.find(key);
+    if (it == templates.end()) {
+        it = templates.emplace(key, grow(kind, iterations, seed)).first;
+    }
+    const TreeTemplate &tree = *(it->second);
+    lock.unlock();
+
+    return tree;
+}
+
+/**
+ * @brief TreeTemplateCache::grow
+ *  Run the L-system once and record the blocks the turtle leaves behind.
+ * @param kind
+ * @param iterations
+ * @param seed
+ * @return
+ */
+uPtr<TreeTemplate> TreeTemplateCache::grow(TreeKind kind, int iterations, uint64_t seed)
+{
+    const TreeStyle &style = (kind == TreeKind::erdtree) ? erdtreeStyle : oakStyle;
+    uPtr<TreeTemplate> tree = mkU<TreeTemplate>();
+
+    Random rng(seed);
+
+    Tree lsystem = Tree(glm::vec2(0.5f, 0.5f), style.fDistance, rng.nextUInt());
+    Tree *tr = &lsystem;
+
+    tr->generatePath(iterations, "FX", 1);
+    tr->populateOps();
+
+    // the tree trunk
+    int height = style.minHeight + (int)(4.0f * rng.nextFloat());
+
+    for(int x = -style.thickness; x <= style.thickness; x++){
+        for(int z = -style.thickness; z <= style.thickness; z++){
+            for(int i = 1; i <= height; ++i){
+                tree->blocks.push_back({glm::vec2(x, z), i, style.trunk, true, EMPTY});
+            }
+        }
+    }
+
+    glm::vec2 turtlePos;
+    int yPos;
+
+    // loop over LSystem string path
+    for(int i = 0; i < tr->path.length(); ++i){
+
+        // dereference function pointer mapped to path character
+        (tr->*(tr->charToDrawingOperation[tr->path[i]]))();
+
+        bool isLeaf = (tr->path[i] == 'F');
+        if (!isLeaf && tr->path[i] != '+') {
+            continue;
+        }
+
+        turtlePos           = tr->activeTurtle.position;
+        yPos                = floor(turtlePos[1]);
+        glm::vec2 leafDir   = glm::vec2(turtlePos[0], 0.0f);
+        float angle         = 11.25f;
+
+        for(int j = 0; j < 8; ++j){
+            leafDir     = glm::vec2(leafDir[0] * cosf(angle) - leafDir[1] * sinf(angle),
+                                    leafDir[0] * sinf(angle) + leafDir[1] * cosf(angle));
+
+            if (isLeaf) {
+                // leaves hang just below the turtle
+                tree->blocks.push_back({leafDir, height - 3 + yPos, style.leaf, false, EMPTY});
+            } else {
+                tree->blocks.push_back({leafDir, height + yPos, style.branch, false, style.branchAlsoReplaces});
+            }
+        }
+    }
+
+    return tree;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "glm_includes.h"
+#include "block.h"
+#include "smartpointerhelp.h"
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+#include <QMutex>
+
+// The L-system trees the terrain knows how to grow
+enum class TreeKind : unsigned char
+{
+    oak, erdtree
+};
+
+// One block of a tree template, relative to the tree's root
+struct TreeTemplateBlock
+{
+    // x-z offset, kept as float since stamping truncates after adding the root
+    glm::vec2 xz;
+    // y offset above the root
+    int y;
+    BlockType type;
+    // trunk blocks overwrite anything; others only land on EMPTY or alsoReplaces
+    bool force;
+    BlockType alsoReplaces;
+};
+
+// The voxels of one grown tree, in the order they are written
+struct TreeTemplate
+{
+    std::vector<TreeTemplateBlock> blocks;
+};
+
+/**
+ * @brief The TreeTemplateCache class
+ *  Shared cache of grown trees keyed by (kind, iterations, seed).
+ *  Templates are immutable once built, so the returned references can be
+ *  read from any worker without holding the lock.
+ */
+class TreeTemplateCache
+{
+private:
+    static QMutex lock;
+    static std::unordered_map<uint64_t, uPtr<TreeTemplate>> templates;
+
+    static uPtr<TreeTemplate> grow(TreeKind kind, int iterations, uint64_t seed);
+
+public:
+    // number of distinct oak variants sampled by the fill workers
+    static const int oakVariants = 16;
+
+    static const TreeTemplate& get(TreeKind kind, int iterations, uint64_t seed);
+};
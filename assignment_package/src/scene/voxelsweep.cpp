@@ -0,0 +1,129 @@
+#include "voxelsweep.h"
+#include "terrain.h"
+
+namespace {
+// how far inside a block face still counts as on it
+const float faceTolerance = 0.0001f;
+}
+
+VoxelSweep::VoxelSweep(const Terrain &terrain)
+    : m_cursor(terrain), m_min(0), m_size(0), m_blocks()
+{}
+
+/**
+ * @brief VoxelSweep::gather
+ *  The box may move along any axis by up to reach, so the blocks read
+ *  are those of the box grown by reach on every side.
+ * @param boxMin
+ * @param boxMax
+ * @param reach
+ */
+void VoxelSweep::gather(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 reach)
+{
+    reach = glm::abs(reach);
+    m_min = glm::ivec3(glm::floor(boxMin - reach));
+    glm::ivec3 max = glm::ivec3(glm::floor(boxMax + reach));
+    m_size = glm::max(max - m_min + glm::ivec3(1), glm::ivec3(0));
+
+    m_blocks.assign(static_cast<size_t>(m_size.x) * m_size.y * m_size.z, std::nullopt);
+    size_t i = 0;
+    for (int y = 0; y < m_size.y; ++y) {
+        for (int z = 0; z < m_size.z; ++z) {
+            for (int x = 0; x < m_size.x; ++x) {
+                m_blocks[i++] = m_cursor.tryGetBlockAt(m_min.x + x, m_min.y + y, m_min.z + z);
+            }
+        }
+    }
+}
+
+std::optional<BlockType> VoxelSweep::getBlockAt(int x, int y, int z)
+{
+    glm::ivec3 local = glm::ivec3(x, y, z) - m_min;
+    if (local.x >= 0 && local.y >= 0 && local.z >= 0
+            && local.x < m_size.x && local.y < m_size.y && local.z < m_size.z) {
+        return m_blocks[(static_cast<size_t>(local.y) * m_size.z + local.z) * m_size.x + local.x];
+    }
+    return m_cursor.tryGetBlockAt(x, y, z);
+}
+
+bool VoxelSweep::isSolid(int x, int y, int z)
+{
+    std::optional<BlockType> t = getBlockAt(x, y, z);
+    // a missing chunk stops the box like a solid block
+    return !t || (*t != EMPTY && !Block::isLiquid(*t));
+}
+
+std::optional<glm::ivec3> VoxelSweep::findSolid(int axis, int layer, glm::ivec3 lo, glm::ivec3 hi)
+{
+    lo[axis] = layer;
+    hi[axis] = layer;
+    for (int y = lo.y; y <= hi.y; ++y) {
+        for (int z = lo.z; z <= hi.z; ++z) {
+            for (int x = lo.x; x <= hi.x; ++x) {
+                if (isSolid(x, y, z)) {
+                    return glm::ivec3(x, y, z);
+                }
+            }
+        }
+    }
+    return std::nullopt;
+}
+
+/**
+ * @brief VoxelSweep::sweep
+ *  Along each axis, the layers of blocks the box's leading face enters
+ *  are checked nearest first, over the cells the box covers on the other
+ *  two axes; the first holding a solid block stops the box on its face.
+ *  A box already overlapping a block is not pushed out, only kept from
+ *  going deeper.
+ *  Y goes first so a box on the ground slides along it, rather than the
+ *  ground's top blocks stopping it on x or z.
+ * @param boxMin
+ * @param boxMax
+ * @param displacement
+ * @return
+ */
+SweepContact VoxelSweep::sweep(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 displacement)
+{
+    SweepContact contact;
+    for (int axis : {1, 0, 2}) {
+        float d = displacement[axis];
+        if (d == 0.f) {
+            continue;
+        }
+        // the cells the box covers, faces on a block boundary not included
+        glm::ivec3 lo = glm::ivec3(glm::floor(boxMin + faceTolerance));
+        glm::ivec3 hi = glm::ivec3(glm::ceil(boxMax - faceTolerance)) - glm::ivec3(1);
+
+        if (d > 0.f) {
+            int first = static_cast<int>(glm::ceil(boxMax[axis] - faceTolerance));
+            int last = static_cast<int>(glm::floor(boxMax[axis] + d - faceTolerance));
+            for (int layer = first; layer <= last; ++layer) {
+                std::optional<glm::ivec3> hit = findSolid(axis, layer, lo, hi);
+                if (hit) {
+                    d = glm::max(0.f, layer - boxMax[axis]);
+                    contact.blocked[axis] = 1;
+                    contact.blockHit[axis] = *hit;
+                    break;
+                }
+            }
+        } else {
+            int first = static_cast<int>(glm::floor(boxMin[axis] + faceTolerance)) - 1;
+            int last = static_cast<int>(glm::floor(boxMin[axis] + d + faceTolerance));
+            for (int layer = first; layer >= last; --layer) {
+                std::optional<glm::ivec3> hit = findSolid(axis, layer, lo, hi);
+                if (hit) {
+                    d = glm::min(0.f, layer + 1 - boxMin[axis]);
+                    contact.blocked[axis] = -1;
+                    contact.blockHit[axis] = *hit;
+                    break;
+                }
+            }
+        }
+
+        boxMin[axis] += d;
+        boxMax[axis] += d;
+        contact.displacement[axis] = d;
+    }
+    return contact;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "blockcursor.h"
+#include "glm_includes.h"
+#include <array>
+#include <optional>
+#include <vector>
+
+class Terrain;
+
+/**
+ * @brief The SweepContact struct
+ *  What VoxelSweep::sweep ran into, per axis (0: x, 1: y, 2: z)
+ */
+struct SweepContact
+{
+    // the part of the displacement the box can make
+    glm::vec3 displacement;
+    // -1 or 1: the box was stopped moving down or up this axis; 0: it was not
+    glm::ivec3 blocked;
+    // the first block that stopped it, on the blocked axes
+    std::array<glm::ivec3, 3> blockHit;
+
+    SweepContact()
+        : displacement(0.f), blocked(0), blockHit()
+    {}
+};
+
+/**
+ * @brief The VoxelSweep class
+ *  Moves an axis-aligned box through the block grid and stops it at the
+ *  first solid block on each axis, in place of ray marches from a few of
+ *  its points. gather reads every block the box may touch this tick once,
+ *  through a BlockCursor; sweep and getBlockAt then read those, and only
+ *  go back to the cursor outside them.
+ *  Liquids and EMPTY let the box through; a missing chunk stops it, as it
+ *  stops a gridMarch. Like the BlockCursor it holds, keep one on the
+ *  stack for a tick, on the main thread.
+ */
+class VoxelSweep
+{
+private:
+    BlockCursor m_cursor;
+    // the gathered blocks: m_size.x * m_size.y * m_size.z of them from
+    // m_min, x fastest; std::nullopt where no chunk holds them
+    glm::ivec3 m_min;
+    glm::ivec3 m_size;
+    std::vector<std::optional<BlockType>> m_blocks;
+
+    bool isSolid(int x, int y, int z);
+    // the solid block of the cells [lo, hi] of the two axes other than
+    // axis at layer along it, if any
+    std::optional<glm::ivec3> findSolid(int axis, int layer, glm::ivec3 lo, glm::ivec3 hi);
+
+public:
+    VoxelSweep(const Terrain &terrain);
+
+    // Read every block the box [boxMin, boxMax] touches, moving up to
+    // reach along each axis in either direction
+    void gather(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 reach);
+    // Move the box [boxMin, boxMax] by displacement: along y, then x,
+    // then z, each axis from where the last one left the box
+    SweepContact sweep(glm::vec3 boxMin, glm::vec3 boxMax, glm::vec3 displacement);
+
+    // the block at (x, y, z), as gathered if it was
+    std::optional<BlockType> getBlockAt(int x, int y, int z);
+};
@@ -2,7 +2,7 @@
 #include <math.h>
 
 Widget::Widget(OpenGLContext *context)
-    : Drawable(context)
+    : HudDrawable(context)
 {
     setWidgetInfo();
 }
@@ -248,26 +248,12 @@ void Widget::setWidgetInfo() {
 /**
  * @brief Widget::createVBOdata
  *  inherited from Drawable
- *  store the data into vbo
+ *  store the data into vbo (see HudDrawable)
  */
 void Widget::createVBOdata(){
 
-    int loadWidgetCount = 1 + drawItems.size();
-
-    std::vector<GLuint> indices;
-    std::vector<GLuint> faceIndices = {0, 1, 2, 0, 2, 3};
-    std::vector<float> buffer_pos;
-    std::vector<float> buffer_uv;
-    int nVert = 0;
-
-    for (int i = 0; i < loadWidgetCount; ++i) {
-        // add indices for each face (4 vertices)
-        for (int index : faceIndices) {
-            indices.push_back(nVert + index);
-        }
-        // move the offset for indices
-        nVert += 4;
-    }
+    ArenaVector<float> buffer_pos;
+    ArenaVector<float> buffer_uv;
 
     // position of widget
     glm::vec2 topLeftPos = widgetInfoMap["widgetScreen"].first[0];
@@ -298,20 +284,8 @@ void Widget::createVBOdata(){
         }
     }
 
-    m_count = indices.size();
-
-    generateIdx();
-    bindIdx();
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_count * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
-
-    generatePos();
-    bindPos();
-    mp_context->glBufferData(GL_ARRAY_BUFFER, buffer_pos.size() * sizeof(float), buffer_pos.data(), GL_STATIC_DRAW);
-
-    generateUV();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufUV);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, buffer_uv.size() * sizeof(float), buffer_uv.data(), GL_STATIC_DRAW);
-
+    // drawn with the rest of the HUD (see HudBatch)
+    addQuads(buffer_pos, buffer_uv);
 
     drawItems.clear();
 }
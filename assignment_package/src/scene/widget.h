@@ -1,6 +1,6 @@
 #pragma once
 #include <unordered_map>
-#include "drawable.h"
+#include "huddrawable.h"
 #include "utils.h"
 #include <QOpenGLContext>
 #include <QOpenGLBuffer>
@@ -51,7 +51,7 @@ struct RecRegion
 
 };
 
-class Widget : public Drawable
+class Widget : public HudDrawable
 {
 protected:
     // top-left and bottom-right uv coordinate of widget
@@ -16,15 +16,9 @@ void WorldAxes::createVBOdata()
 
     m_count = 6;
 
-    generateIdx();
-    mp_context->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_bufIdx);
-    mp_context->glBufferData(GL_ELEMENT_ARRAY_BUFFER, 6 * sizeof(GLuint), idx, GL_STATIC_DRAW);
-    generatePos();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufPos);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(glm::vec4), pos, GL_STATIC_DRAW);
-    generateCol();
-    mp_context->glBindBuffer(GL_ARRAY_BUFFER, m_bufCol);
-    mp_context->glBufferData(GL_ARRAY_BUFFER, 6 * sizeof(glm::vec4), col, GL_STATIC_DRAW);
+    fillBuffer(m_bufIdx, m_idxGenerated, GL_ELEMENT_ARRAY_BUFFER, 6 * sizeof(GLuint), idx);
+    fillBuffer(m_bufPos, m_posGenerated, GL_ARRAY_BUFFER, 6 * sizeof(glm::vec4), pos);
+    fillBuffer(m_bufCol, m_colGenerated, GL_ARRAY_BUFFER, 6 * sizeof(glm::vec4), col);
 }
 
 GLenum WorldAxes::drawMode()
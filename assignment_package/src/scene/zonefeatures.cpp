@@ -0,0 +1,133 @@
+#include "zonefeatures.h"
+#include "random.h"
+#include "treetemplate.h"
+#include <algorithm>
+#include <climits>
+
+// the floating islands cover the water columns from this corner on
+static const glm::ivec2 floatingIslandsCorner(200, 250);
+
+// The NPC jump platforms of the test terrain, each within one chunk
+static const std::vector<std::vector<ZoneFeatureIndex::StageBox>> jumpStages = {
+    {
+        // a large platform in chunk (32, 64)
+        {glm::ivec3(32, 145, 74), glm::ivec3(38, 146, 80), GWOOD},
+        {glm::ivec3(33, 146, 78), glm::ivec3(34, 147, 79), WOOD},
+        {glm::ivec3(34, 145, 76), glm::ivec3(36, 146, 78), EMPTY},
+        {glm::ivec3(40, 146, 68), glm::ivec3(48, 147, 76), GWOOD},
+        {glm::ivec3(42, 146, 70), glm::ivec3(46, 147, 74), EMPTY},
+        {glm::ivec3(45, 147, 64), glm::ivec3(48, 148, 67), GWOOD}
+    },
+    {
+        // chunk (48, 64)
+        {glm::ivec3(48, 147, 64), glm::ivec3(51, 148, 69), GWOOD}
+    },
+    {
+        // chunk (48, 48)
+        {glm::ivec3(49, 149, 58), glm::ivec3(54, 150, 63), GWOOD},
+        {glm::ivec3(50, 149, 60), glm::ivec3(52, 150, 62), EMPTY},
+        {glm::ivec3(56, 150, 53), glm::ivec3(59, 151, 56), GWOOD},
+        {glm::ivec3(60, 151, 49), glm::ivec3(63, 152, 52), GWOOD}
+    },
+    {
+        // chunk (64, 32)
+        {glm::ivec3(64, 151, 42), glm::ivec3(70, 152, 48), GWOOD},
+        {glm::ivec3(66, 151, 44), glm::ivec3(68, 152, 46), EMPTY},
+        {glm::ivec3(72, 151, 36), glm::ivec3(80, 152, 44), GWOOD},
+        {glm::ivec3(76, 152, 40), glm::ivec3(77, 153, 41), WOOD}
+    }
+};
+
+/**
+ * @brief ZoneFeatureIndex::ZoneFeatureIndex
+ *  Each chunk's tree candidates come from its own stream (see Random),
+ *  three values apiece: the root's x and z in the chunk, then the
+ *  variant, whether or not the tree is planted.
+ * @param xCorner
+ * @param zCorner
+ * @param worldSeed
+ */
+ZoneFeatureIndex::ZoneFeatureIndex(int xCorner, int zCorner, uint64_t worldSeed)
+    : xCorner(xCorner), zCorner(zCorner), m_features(), m_chunkFeatures(), m_chunkStarts()
+{
+    for (int cz = zCorner; cz < zCorner + zoneSize; cz += 16) {
+        for (int cx = xCorner; cx < xCorner + zoneSize; cx += 16) {
+            Random rng(worldSeed, cx, cz);
+            for (int i = 0; i < treesPerChunk; i++) {
+                int x = cx + static_cast<int>(rng.nextUInt() % 16);
+                int z = cz + static_cast<int>(rng.nextUInt() % 16);
+                uint32_t variant = static_cast<uint32_t>(rng.nextUInt() % TreeTemplateCache::oakVariants);
+                addFeature(FeatureKind::tree, glm::ivec2(x, z), glm::ivec2(x + 1, z + 1), variant);
+            }
+        }
+    }
+
+    addFeature(FeatureKind::floatingIslands, floatingIslandsCorner, glm::ivec2(INT_MAX), 0);
+
+    for (size_t i = 0; i < jumpStages.size(); i++) {
+        glm::ivec2 min(INT_MAX);
+        glm::ivec2 max(INT_MIN);
+        for (const StageBox &box : jumpStages[i]) {
+            min = glm::min(min, glm::ivec2(box.min.x, box.min.z));
+            max = glm::max(max, glm::ivec2(box.max.x, box.max.z));
+        }
+        addFeature(FeatureKind::jumpStage, min, max, static_cast<uint32_t>(i));
+    }
+
+    // group by chunk, keeping the placement order within each
+    std::vector<int> tiles;
+    for (const PlacedFeature &feature : m_features) {
+        for (int cz = 0; cz < chunksPerSide; cz++) {
+            for (int cx = 0; cx < chunksPerSide; cx++) {
+                glm::ivec2 chunkMin(xCorner + 16 * cx, zCorner + 16 * cz);
+                glm::ivec2 min = glm::max(feature.min, chunkMin);
+                glm::ivec2 max = glm::min(feature.max, chunkMin + 16);
+                if (min.x < max.x && min.y < max.y) {
+                    m_chunkFeatures.push_back(ChunkFeature{&feature, min - chunkMin, max - chunkMin});
+                    tiles.push_back(cx + chunksPerSide * cz);
+                }
+            }
+        }
+    }
+    std::vector<ChunkFeature> sorted(m_chunkFeatures.size());
+    m_chunkStarts.fill(0);
+    for (int tile : tiles) {
+        m_chunkStarts[tile + 1]++;
+    }
+    for (size_t t = 1; t < m_chunkStarts.size(); t++) {
+        m_chunkStarts[t] += m_chunkStarts[t - 1];
+    }
+    std::array<uint32_t, chunksPerSide * chunksPerSide + 1> next = m_chunkStarts;
+    for (size_t i = 0; i < m_chunkFeatures.size(); i++) {
+        sorted[next[tiles[i]]++] = m_chunkFeatures[i];
+    }
+    m_chunkFeatures.swap(sorted);
+}
+
+// clipped to the zone; m_chunkFeatures points into m_features, so only
+// before it is built
+void ZoneFeatureIndex::addFeature(FeatureKind kind, glm::ivec2 min, glm::ivec2 max, uint32_t variant)
+{
+    min = glm::max(min, glm::ivec2(xCorner, zCorner));
+    max = glm::min(max, glm::ivec2(xCorner, zCorner) + zoneSize);
+    if (min.x < max.x && min.y < max.y) {
+        m_features.push_back(PlacedFeature{kind, min, max, variant});
+    }
+}
+
+void ZoneFeatureIndex::getChunkFeatures(int x, int z, const ChunkFeature *&begin, const ChunkFeature *&end) const
+{
+    int tile = (x - xCorner) / 16 + chunksPerSide * ((z - zCorner) / 16);
+    begin = m_chunkFeatures.data() + m_chunkStarts[tile];
+    end = m_chunkFeatures.data() + m_chunkStarts[tile + 1];
+}
+
+const std::vector<PlacedFeature> &ZoneFeatureIndex::getFeatures() const
+{
+    return m_features;
+}
+
+const std::vector<ZoneFeatureIndex::StageBox> &ZoneFeatureIndex::getStageBoxes(uint32_t stage)
+{
+    return jumpStages[stage];
+}
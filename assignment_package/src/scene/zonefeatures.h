@@ -0,0 +1,88 @@
+#pragma once
+
+#include "block.h"
+#include "glm_includes.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+// What a PlacedFeature is
+enum class FeatureKind : unsigned char
+{
+    tree,             // an oak rooted on its column, if that is GRASS by then
+    floatingIslands,  // the region whose water columns get a floating rock
+    jumpStage         // one of the test terrain's NPC jump platforms
+};
+
+struct PlacedFeature
+{
+    FeatureKind kind;
+    // world-space footprint: x in [min.x, max.x), z in [min.y, max.y)
+    glm::ivec2 min;
+    glm::ivec2 max;
+    // tree: the oak variant (see TreeTemplateCache); jumpStage: its index
+    // in the stage table (see ZoneFeatureIndex::getStageBoxes)
+    uint32_t variant;
+};
+
+// A feature's footprint in one chunk, chunk-local
+struct ChunkFeature
+{
+    const PlacedFeature *feature;
+    glm::ivec2 min;
+    glm::ivec2 max;
+};
+
+/**
+ * @brief The ZoneFeatureIndex class
+ *  Where the features of one 64 x 64 generation zone go, from the seed
+ *  alone, so the featured and decorated stages of a chunk only visit the
+ *  features meeting it rather than test every column against them. Built
+ *  on the main thread when the zone is queued, read-only after.
+ *  Trees are candidates: the stage still checks the tree probability and
+ *  the GRASS under the root. A tree's footprint is its root column, as
+ *  the chunk it is rooted in plants it; the blocks past that chunk go to
+ *  the neighbors through the structure spill. The other footprints are
+ *  clipped to the zone.
+ */
+class ZoneFeatureIndex
+{
+public:
+    static const int zoneSize = 64;
+    static const int chunksPerSide = zoneSize / 16;
+    // tree candidates per chunk
+    static const int treesPerChunk = 2;
+
+    // blocks of one type a jump stage sets, world space, max exclusive
+    struct StageBox
+    {
+        glm::ivec3 min;
+        glm::ivec3 max;
+        BlockType type;
+    };
+
+private:
+    int xCorner;
+    int zCorner;
+
+    // every feature of the zone, in the order they are placed
+    std::vector<PlacedFeature> m_features;
+    // a feature per chunk it meets, grouped by the chunk's tile
+    // (x + chunksPerSide * z), each group in placement order: the tile's
+    // features are [m_chunkStarts[tile], m_chunkStarts[tile + 1])
+    std::vector<ChunkFeature> m_chunkFeatures;
+    std::array<uint32_t, chunksPerSide * chunksPerSide + 1> m_chunkStarts;
+
+    void addFeature(FeatureKind kind, glm::ivec2 min, glm::ivec2 max, uint32_t variant);
+
+public:
+    ZoneFeatureIndex(int xCorner, int zCorner, uint64_t worldSeed);
+
+    // The features meeting the chunk whose corner is (x, z), in this zone,
+    // in placement order, as [begin, end)
+    void getChunkFeatures(int x, int z, const ChunkFeature *&begin, const ChunkFeature *&end) const;
+    const std::vector<PlacedFeature> &getFeatures() const;
+
+    // the boxes of jump stage i, a later one over an earlier one
+    static const std::vector<StageBox> &getStageBoxes(uint32_t stage);
+};
@@ -0,0 +1,159 @@
+#include "zoneheightmap.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+/**
+ * @brief ZoneHeightMap::ZoneHeightMap
+ * @param xCorner : x of the zone's corner
+ * @param zCorner : z of the zone's corner
+ */
+ZoneHeightMap::ZoneHeightMap(int xCorner, int zCorner)
+    : xCorner(xCorner), zCorner(zCorner),
+      biomeLattice(), heights(), treeProbabilities(), tilesFilled()
+{
+    for (std::atomic<bool> &filled : tilesFilled) {
+        filled.store(false, std::memory_order_relaxed);
+    }
+}
+
+int ZoneHeightMap::tileIndex(int lx, int lz)
+{
+    return lx / tileSize + tilesPerSide * (lz / tileSize);
+}
+
+void ZoneHeightMap::fillBiomeLattice(int tile, int tileX, int tileZ, Noise &noise)
+{
+    glm::vec2 *lattice = &biomeLattice[tile * tileSamples * tileSamples];
+    for (int k = 0; k < tileSamples; k++) {
+        for (int i = 0; i < tileSamples; i++) {
+            lattice[i + tileSamples * k] = noise.getBiomeNoise(tileX + i * biomeStride,
+                                                               tileZ + k * biomeStride);
+        }
+    }
+}
+
+/**
+ * @brief ZoneHeightMap::fillTile
+ * @param chunkX : x of the chunk's corner, in this zone
+ * @param chunkZ : z of the chunk's corner, in this zone
+ * @param noise  : the caller's (per worker) Noise
+ */
+void ZoneHeightMap::fillTile(int chunkX, int chunkZ, Noise &noise)
+{
+    if (!contains(chunkX, chunkZ)) {
+        throw std::out_of_range("Chunk (" + std::to_string(chunkX) + ", " + std::to_string(chunkZ)
+                                + ") is outside the zone at (" + std::to_string(xCorner) + ", "
+                                + std::to_string(zCorner) + ")");
+    }
+
+    int tile = tileIndex(chunkX - xCorner, chunkZ - zCorner);
+    fillBiomeLattice(tile, chunkX, chunkZ, noise);
+
+    for (int z = chunkZ - zCorner; z < chunkZ - zCorner + tileSize; z++) {
+        for (int x = chunkX - xCorner; x < chunkX - xCorner + tileSize; x++) {
+            int wx = xCorner + x;
+            int wz = zCorner + z;
+            heights[x + zoneSize * z]           = noise.getHeight(wx, wz, getBiomeNoise(wx, wz));
+            treeProbabilities[x + zoneSize * z] = noise.getTreeProbability(wx, wz);
+        }
+    }
+    tilesFilled[tile].store(true, std::memory_order_release);
+}
+
+/**
+ * @brief ZoneHeightMap::fillTile
+ *  Only the biome lattice and the tree probabilities are computed here.
+ * @param chunkX             : x of the chunk's corner, in this zone
+ * @param chunkZ             : z of the chunk's corner, in this zone
+ * @param noise              : the caller's (per worker) Noise
+ * @param precomputedHeights : zoneSize * zoneSize heights, [x + zoneSize * z]
+ */
+void ZoneHeightMap::fillTile(int chunkX, int chunkZ, Noise &noise, const std::vector<int> &precomputedHeights)
+{
+    if (precomputedHeights.size() != heights.size()) {
+        throw std::out_of_range("Zone at (" + std::to_string(xCorner) + ", " + std::to_string(zCorner)
+                                + ") got " + std::to_string(precomputedHeights.size()) + " heights");
+    }
+    if (!contains(chunkX, chunkZ)) {
+        throw std::out_of_range("Chunk (" + std::to_string(chunkX) + ", " + std::to_string(chunkZ)
+                                + ") is outside the zone at (" + std::to_string(xCorner) + ", "
+                                + std::to_string(zCorner) + ")");
+    }
+
+    int tile = tileIndex(chunkX - xCorner, chunkZ - zCorner);
+    fillBiomeLattice(tile, chunkX, chunkZ, noise);
+
+    for (int z = chunkZ - zCorner; z < chunkZ - zCorner + tileSize; z++) {
+        for (int x = chunkX - xCorner; x < chunkX - xCorner + tileSize; x++) {
+            heights[x + zoneSize * z]           = precomputedHeights[x + zoneSize * z];
+            treeProbabilities[x + zoneSize * z] = noise.getTreeProbability(xCorner + x, zCorner + z);
+        }
+    }
+    tilesFilled[tile].store(true, std::memory_order_release);
+}
+
+bool ZoneHeightMap::contains(int x, int z) const
+{
+    return x >= xCorner && x < xCorner + zoneSize && z >= zCorner && z < zCorner + zoneSize;
+}
+
+bool ZoneHeightMap::hasTile(int x, int z) const
+{
+    return contains(x, z)
+            && tilesFilled[tileIndex(x - xCorner, z - zCorner)].load(std::memory_order_acquire);
+}
+
+/**
+ * @brief ZoneHeightMap::getBiomeNoise
+ *  Bilinear interpolation of the biome lattice of the column's tile.
+ * @param x
+ * @param z
+ * @return
+ */
+glm::vec2 ZoneHeightMap::getBiomeNoise(int x, int z) const
+{
+    if (!contains(x, z)) {
+        throw std::out_of_range("Column (" + std::to_string(x) + ", " + std::to_string(z)
+                                + ") is outside the zone at (" + std::to_string(xCorner) + ", "
+                                + std::to_string(zCorner) + ")");
+    }
+
+    int lx = x - xCorner;
+    int lz = z - zCorner;
+    const glm::vec2 *lattice = &biomeLattice[tileIndex(lx, lz) * tileSamples * tileSamples];
+    // relative to the tile
+    int tx0 = lx % tileSize;
+    int tz0 = lz % tileSize;
+    int i = tx0 / biomeStride;
+    int k = tz0 / biomeStride;
+    float tx = (tx0 - i * biomeStride) / static_cast<float>(biomeStride);
+    float tz = (tz0 - k * biomeStride) / static_cast<float>(biomeStride);
+
+    const glm::vec2 &b00 = lattice[i     + tileSamples * k];
+    const glm::vec2 &b10 = lattice[i + 1 + tileSamples * k];
+    const glm::vec2 &b01 = lattice[i     + tileSamples * (k + 1)];
+    const glm::vec2 &b11 = lattice[i + 1 + tileSamples * (k + 1)];
+
+    return glm::mix(glm::mix(b00, b10, tx), glm::mix(b01, b11, tx), tz);
+}
+
+int ZoneHeightMap::getHeight(int x, int z) const
+{
+    if (!contains(x, z)) {
+        throw std::out_of_range("Column (" + std::to_string(x) + ", " + std::to_string(z)
+                                + ") is outside the zone at (" + std::to_string(xCorner) + ", "
+                                + std::to_string(zCorner) + ")");
+    }
+    return heights[(x - xCorner) + zoneSize * (z - zCorner)];
+}
+
+float ZoneHeightMap::getTreeProbability(int x, int z) const
+{
+    if (!contains(x, z)) {
+        throw std::out_of_range("Column (" + std::to_string(x) + ", " + std::to_string(z)
+                                + ") is outside the zone at (" + std::to_string(xCorner) + ", "
+                                + std::to_string(zCorner) + ")");
+    }
+    return treeProbabilities[(x - xCorner) + zoneSize * (z - zCorner)];
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "noise.h"
+#include <array>
+#include <atomic>
+#include <vector>
+
+/**
+ * @brief The ZoneHeightMap class
+ *  Surface heights and tree probabilities of one 64 x 64 terrain
+ *  generation zone, filled one 16 x 16 chunk tile at a time by the
+ *  FillBlocksWorker shaping that chunk, so a zone's chunks are shaped in
+ *  parallel. The low-frequency biome masks are sampled every biomeStride
+ *  blocks and bilinearly interpolated; the detail layers are exact per
+ *  column. Each tile keeps its own corner samples (the ones on a tile
+ *  border are evaluated by both tiles, to the same values), so no two
+ *  fills write the same memory. A tile is written once, then read-only:
+ *  readers on other threads check hasTile first, or only read the tile
+ *  of a chunk reported as shaped.
+ */
+class ZoneHeightMap
+{
+public:
+    static const int zoneSize       = 64;
+    static const int tileSize       = 16;
+    static const int tilesPerSide   = zoneSize / tileSize;
+    static const int biomeStride    = 8;
+    static const int tileSamples    = tileSize / biomeStride + 1;
+
+private:
+    int xCorner;
+    int zCorner;
+
+    // biome noise lattice per tile, [tile * tileSamples^2 + i + tileSamples * k]
+    // at (tile corner x + i * stride, tile corner z + k * stride)
+    std::array<glm::vec2, tilesPerSide * tilesPerSide * tileSamples * tileSamples> biomeLattice;
+    // per column, [x + zoneSize * z] relative to the corner
+    std::array<int, zoneSize * zoneSize> heights;
+    std::array<float, zoneSize * zoneSize> treeProbabilities;
+    // set (release) once the tile is written
+    std::array<std::atomic<bool>, tilesPerSide * tilesPerSide> tilesFilled;
+
+    // index of the tile holding the zone-relative column (lx, lz)
+    static int tileIndex(int lx, int lz);
+    void fillBiomeLattice(int tile, int tileX, int tileZ, Noise &noise);
+
+public:
+    // no tile filled yet
+    ZoneHeightMap(int xCorner, int zCorner);
+
+    // Fill the tile of the chunk whose corner is (chunkX, chunkZ), once
+    void fillTile(int chunkX, int chunkZ, Noise &noise);
+    // with heights evaluated elsewhere (the compute backend): the whole
+    // zone's, [x + zoneSize * z]
+    void fillTile(int chunkX, int chunkZ, Noise &noise, const std::vector<int> &precomputedHeights);
+
+    // does the world column (x, z) lie in this zone?
+    bool contains(int x, int z) const;
+    // is the tile holding the world column (x, z) filled?
+    bool hasTile(int x, int z) const;
+
+    // world-space queries; (x, z) must lie in a filled tile of this zone
+    glm::vec2 getBiomeNoise(int x, int z) const;
+    int getHeight(int x, int z) const;
+    float getTreeProbability(int x, int z) const;
+};
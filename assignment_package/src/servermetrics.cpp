@@ -0,0 +1,204 @@
+#include "servermetrics.h"
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+const std::array<double, ServerMetrics::tickBucketCount> ServerMetrics::tickBucketMs = {
+    1.0, 2.0, 5.0, 10.0, 16.0, 25.0, 50.0, 100.0, 250.0
+};
+
+// how long the exporter waits for a connection before it checks whether
+// to stop, and for a client to send its request or take the answer
+static const int pollMs = 200;
+static const int clientTimeoutMs = 2000;
+// a request's headers past this are not read
+static const int maxRequestBytes = 8192;
+
+// the names of TerrainJobQueue, as labels
+static const char *const jobQueueNames[3] = {"generation", "meshing", "io"};
+
+ServerMetrics::ServerMetrics()
+    : m_tickBuckets(), m_tickNs(0), m_pathfindNs(0), m_queuedJobs(), m_runningJobs(), m_generationJobs(0),
+      m_chunksAwaitingStage(0), m_chunksAwaitingMesh(0), m_pendingUploads(0), m_npcs(0), m_clients(0),
+      m_thread(), m_stopping(false)
+{
+    for (std::atomic<uint64_t> &bucket : m_tickBuckets) {
+        bucket.store(0);
+    }
+    for (int q = 0; q < 3; q++) {
+        m_queuedJobs[q].store(0);
+        m_runningJobs[q].store(0);
+    }
+}
+
+ServerMetrics::~ServerMetrics()
+{
+    stop();
+}
+
+/**
+ * @brief ServerMetrics::start
+ *  Waits for the exporter thread to listen, or fail to.
+ */
+bool ServerMetrics::start(quint16 port)
+{
+    stop();
+    m_stopping.store(false);
+    std::promise<bool> listening;
+    std::future<bool> listened = listening.get_future();
+    m_thread = uPtr<QThread>(QThread::create([this, port, &listening]() { serve(port, listening); }));
+    m_thread->start(QThread::LowestPriority);
+    if (!listened.get()) {
+        m_thread->wait();
+        m_thread.reset();
+        return false;
+    }
+    return true;
+}
+
+void ServerMetrics::stop()
+{
+    if (m_thread) {
+        m_stopping.store(true);
+        m_thread->wait();
+        m_thread.reset();
+    }
+}
+
+void ServerMetrics::addTick(qint64 ns)
+{
+    double ms = ns / 1e6;
+    int bucket = 0;
+    while (bucket < tickBucketCount && ms > tickBucketMs[bucket]) {
+        bucket++;
+    }
+    m_tickBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    m_tickNs.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+}
+
+void ServerMetrics::addPathfinding(qint64 ns)
+{
+    m_pathfindNs.fetch_add(static_cast<uint64_t>(ns), std::memory_order_relaxed);
+}
+
+void ServerMetrics::publish(const ServerGauges &gauges)
+{
+    for (int q = 0; q < 3; q++) {
+        m_queuedJobs[q].store(gauges.queuedJobs[q], std::memory_order_relaxed);
+        m_runningJobs[q].store(gauges.runningJobs[q], std::memory_order_relaxed);
+    }
+    m_generationJobs.store(gauges.generationJobs, std::memory_order_relaxed);
+    m_chunksAwaitingStage.store(gauges.chunksAwaitingStage, std::memory_order_relaxed);
+    m_chunksAwaitingMesh.store(gauges.chunksAwaitingMesh, std::memory_order_relaxed);
+    m_pendingUploads.store(gauges.pendingUploads, std::memory_order_relaxed);
+    m_npcs.store(gauges.npcs, std::memory_order_relaxed);
+    m_clients.store(gauges.clients, std::memory_order_relaxed);
+}
+
+// a metric's HELP and TYPE lines
+static void describe(QByteArray &out, const char *name, const char *type, const char *help)
+{
+    out += QByteArray("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+}
+
+/**
+ * @brief ServerMetrics::toPrometheusText
+ *  The histogram's buckets are cumulative, as Prometheus counts them; the
+ *  ns counters go out in seconds.
+ */
+QByteArray ServerMetrics::toPrometheusText() const
+{
+    QByteArray out;
+    describe(out, "worldserver_tick_seconds", "histogram", "The server loop's tick time.");
+    uint64_t ticks = 0;
+    for (int i = 0; i <= tickBucketCount; i++) {
+        ticks += m_tickBuckets[i].load(std::memory_order_relaxed);
+        QByteArray bound = i < tickBucketCount ? QByteArray::number(tickBucketMs[i] / 1e3) : QByteArray("+Inf");
+        out += "worldserver_tick_seconds_bucket{le=\"" + bound + "\"} "
+                + QByteArray::number(static_cast<qulonglong>(ticks)) + "\n";
+    }
+    out += "worldserver_tick_seconds_sum " + QByteArray::number(m_tickNs.load(std::memory_order_relaxed) / 1e9, 'f', 6)
+            + "\nworldserver_tick_seconds_count " + QByteArray::number(static_cast<qulonglong>(ticks)) + "\n";
+
+    describe(out, "worldserver_npc_pathfinding_seconds_total", "counter",
+             "The NPCs' path searches and flow field refreshes, in thread time.");
+    out += "worldserver_npc_pathfinding_seconds_total "
+            + QByteArray::number(m_pathfindNs.load(std::memory_order_relaxed) / 1e9, 'f', 6) + "\n";
+
+    describe(out, "worldserver_terrain_jobs_queued", "gauge", "The terrain jobs waiting for a thread.");
+    for (int q = 0; q < 3; q++) {
+        out += QByteArray("worldserver_terrain_jobs_queued{queue=\"") + jobQueueNames[q] + "\"} "
+                + QByteArray::number(m_queuedJobs[q].load(std::memory_order_relaxed)) + "\n";
+    }
+    describe(out, "worldserver_terrain_jobs_running", "gauge", "The terrain jobs on a thread.");
+    for (int q = 0; q < 3; q++) {
+        out += QByteArray("worldserver_terrain_jobs_running{queue=\"") + jobQueueNames[q] + "\"} "
+                + QByteArray::number(m_runningJobs[q].load(std::memory_order_relaxed)) + "\n";
+    }
+    describe(out, "worldserver_terrain_generation_jobs_total", "counter",
+             "The chunk generation stages completed.");
+    out += "worldserver_terrain_generation_jobs_total "
+            + QByteArray::number(static_cast<qulonglong>(m_generationJobs.load(std::memory_order_relaxed))) + "\n";
+    describe(out, "worldserver_chunks_awaiting", "gauge",
+             "The chunks waiting on their neighbors for their next generation stage or a mesh.");
+    out += "worldserver_chunks_awaiting{for=\"stage\"} "
+            + QByteArray::number(static_cast<qulonglong>(m_chunksAwaitingStage.load(std::memory_order_relaxed)))
+            + "\nworldserver_chunks_awaiting{for=\"mesh\"} "
+            + QByteArray::number(static_cast<qulonglong>(m_chunksAwaitingMesh.load(std::memory_order_relaxed)))
+            + "\n";
+    describe(out, "worldserver_mesh_uploads_pending", "gauge", "The finished meshes waiting to upload.");
+    out += "worldserver_mesh_uploads_pending "
+            + QByteArray::number(static_cast<qulonglong>(m_pendingUploads.load(std::memory_order_relaxed))) + "\n";
+
+    describe(out, "worldserver_npcs", "gauge", "The NPCs simulated.");
+    out += "worldserver_npcs " + QByteArray::number(m_npcs.load(std::memory_order_relaxed)) + "\n";
+    describe(out, "worldserver_clients", "gauge", "The games connected.");
+    out += "worldserver_clients " + QByteArray::number(m_clients.load(std::memory_order_relaxed)) + "\n";
+
+    describe(out, "worldserver_memory_bytes", "gauge", "The bytes MemoryStats tracks, per category.");
+    for (int i = 0; i < MemoryStats::categoryCount; i++) {
+        MemoryCategory category = static_cast<MemoryCategory>(i);
+        out += QByteArray("worldserver_memory_bytes{category=\"") + MemoryStats::getName(category) + "\"} "
+                + QByteArray::number(static_cast<qlonglong>(MemoryStats::getBytes(category))) + "\n";
+    }
+    return out;
+}
+
+/**
+ * @brief ServerMetrics::serve
+ *  One client at a time, each answered and closed: a scrape is a single
+ *  short GET, and a client that stalls is dropped after clientTimeoutMs.
+ */
+void ServerMetrics::serve(quint16 port, std::promise<bool> &listening)
+{
+    QTcpServer server;
+    if (!server.listen(QHostAddress::Any, port)) {
+        listening.set_value(false);
+        return;
+    }
+    listening.set_value(true);
+    while (!m_stopping.load()) {
+        if (!server.waitForNewConnection(pollMs)) {
+            continue;
+        }
+        uPtr<QTcpSocket> socket(server.nextPendingConnection());
+        QByteArray request;
+        while (!request.contains("\r\n\r\n") && request.size() < maxRequestBytes
+               && socket->waitForReadyRead(clientTimeoutMs)) {
+            request += socket->readAll();
+        }
+        QByteArray status("200 OK"), body;
+        if (request.startsWith("GET /metrics ") || request.startsWith("GET / ")) {
+            body = toPrometheusText();
+        } else {
+            status = "404 Not Found";
+        }
+        socket->write("HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: " + QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+        socket->waitForBytesWritten(clientTimeoutMs);
+        socket->disconnectFromHost();
+        if (socket->state() != QAbstractSocket::UnconnectedState) {
+            socket->waitForDisconnected(clientTimeoutMs);
+        }
+    }
+}
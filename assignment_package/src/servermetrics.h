@@ -0,0 +1,91 @@
+#pragma once
+#include "memorystats.h"
+#include "smartpointerhelp.h"
+#include <QByteArray>
+#include <QThread>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <future>
+
+// What the world server publishes to ServerMetrics once a second, as
+// gauges, besides the ticks
+struct ServerGauges
+{
+    // the terrain jobs queued and running, by TerrainJobQueue
+    std::array<int, 3> queuedJobs;
+    std::array<int, 3> runningJobs;
+    // the generation jobs done since the start, for the generation rate
+    uint64_t generationJobs;
+    // the chunks waiting on their neighbors for a stage or a mesh, and
+    // the meshes waiting to upload (see TerrainFrameActivity)
+    size_t chunksAwaitingStage;
+    size_t chunksAwaitingMesh;
+    size_t pendingUploads;
+    int npcs;
+    int clients;
+};
+
+/**
+ * @brief The ServerMetrics class
+ *  The world server's counters for a fleet's monitoring, served in the
+ *  Prometheus text format at http://host:port/metrics: the tick time
+ *  histogram, the NPCs' path search time, the terrain's queues and rate,
+ *  the clients and NPCs, and MemoryStats per category.
+ *  The server loop only stores to atomics, relaxed: a tick costs a few
+ *  adds, with no lock the scrapes could hold it on. The scrapes are
+ *  answered by a thread of the lowest priority with blocking sockets, so
+ *  neither an event loop nor a slow client touches the loop; the values
+ *  a scrape reads may be a tick apart from each other.
+ */
+class ServerMetrics
+{
+public:
+    // the tick time histogram's upper bounds, in ms; a last bucket takes
+    // the ticks past them
+    static const int tickBucketCount = 9;
+    static const std::array<double, tickBucketCount> tickBucketMs;
+
+private:
+    std::array<std::atomic<uint64_t>, tickBucketCount + 1> m_tickBuckets;
+    std::atomic<uint64_t> m_tickNs;
+    std::atomic<uint64_t> m_pathfindNs;
+
+    std::array<std::atomic<int>, 3> m_queuedJobs;
+    std::array<std::atomic<int>, 3> m_runningJobs;
+    std::atomic<uint64_t> m_generationJobs;
+    std::atomic<uint64_t> m_chunksAwaitingStage;
+    std::atomic<uint64_t> m_chunksAwaitingMesh;
+    std::atomic<uint64_t> m_pendingUploads;
+    std::atomic<int> m_npcs;
+    std::atomic<int> m_clients;
+
+    uPtr<QThread> m_thread;
+    std::atomic<bool> m_stopping;
+
+    // the exporter thread: answer scrapes on port until m_stopping, once
+    // listening is told whether it could listen
+    void serve(quint16 port, std::promise<bool> &listening);
+
+public:
+    ServerMetrics();
+    ~ServerMetrics();
+
+    ServerMetrics(const ServerMetrics&) = delete;
+    ServerMetrics &operator=(const ServerMetrics&) = delete;
+
+    // Serve the metrics on the TCP port; false if it is taken
+    bool start(quint16 port);
+    void stop();
+
+    // Server loop only.
+    // a tick's time, in ns
+    void addTick(qint64 ns);
+    // the NPCs' path searches and flow fields, in thread ns
+    void addPathfinding(qint64 ns);
+    void publish(const ServerGauges &gauges);
+
+    // Any thread.
+    // everything, in the Prometheus text exposition format
+    QByteArray toPrometheusText() const;
+};
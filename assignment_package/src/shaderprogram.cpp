@@ -1,92 +1,393 @@
 #include "shaderprogram.h"
+#include "clusteredlights.h"
+#include "renderbackend.h"
+#include <QCryptographicHash>
+#include <QDir>
 #include <QFile>
+#include <QOpenGLContext>
+#include <QSaveFile>
 #include <QStringBuilder>
 #include <QTextStream>
 #include <QDebug>
 #include <stdexcept>
+#include <algorithm>
 #include <iostream>
+#include <vector>
 
 
+QString ShaderProgram::s_cacheDirectory;
+QByteArray ShaderProgram::s_driverIdentity;
+
 ShaderProgram::ShaderProgram(OpenGLContext *context)
     : vertShader(), fragShader(), prog(),
-      attrPos(-1), attrNor(-1), attrCol(-1), attrUV(-1), attrAnimatableFlag(-1),
-      unifModel(-1), unifModelInvTr(-1), unifViewProj(-1), unifColor(-1), unifTexture(-1),
-      unifTime(-1), unifDimensions(-1), context(context)
+      attrPos(-1), attrNor(-1), attrCol(-1), attrUV(-1), attrAnimatableFlag(-1), attrPacked(-1),
+      attrPosOffset(-1), attrModelInstanced(-1), attrAnimationInstanced(-1),
+      unifModel(-1), unifModelInvTr(-1), unifColor(-1), unifTexture(-1),
+      unifMorphCenter(-1), unifMorphRange(-1), unifRigs(-1), unifLightViewProj(-1), unifShadowCascades(-1),
+      unifShadowViewProj(-1), unifShadowNormalOffset(-1), unifShadowMap(-1), unifFrameBlock(-1),
+      m_vertSource(), m_fragSource(), m_cachePath(), m_fromCache(false), m_feedbackVaryings(),
+      m_uniforms(), m_attribs(), m_uniformBlocks(),
+      m_model(), m_color(), m_texture(), m_rigs(), m_morphCenter(), m_morphRange(),
+      m_lightViewProj(), m_shadowViewProjs(), m_shadowNormalOffset(), m_shadowMap(),
+      context(context)
 {}
 
-void ShaderProgram::create(const char *vertfile, const char *fragfile)
+void ShaderProgram::setUpCompilation(OpenGLContext *context, const QString &cacheDirectory)
+{
+    QOpenGLContext *ctx = context->context();
+    // 0xFFFFFFFF: as many threads as the driver likes
+    typedef void (QOPENGLF_APIENTRYP MaxShaderCompilerThreadsFunc)(GLuint count);
+    MaxShaderCompilerThreadsFunc maxThreads = nullptr;
+    if (ctx->hasExtension(QByteArrayLiteral("GL_KHR_parallel_shader_compile"))) {
+        maxThreads = reinterpret_cast<MaxShaderCompilerThreadsFunc>(ctx->getProcAddress("glMaxShaderCompilerThreadsKHR"));
+    } else if (ctx->hasExtension(QByteArrayLiteral("GL_ARB_parallel_shader_compile"))) {
+        maxThreads = reinterpret_cast<MaxShaderCompilerThreadsFunc>(ctx->getProcAddress("glMaxShaderCompilerThreadsARB"));
+    }
+    if (maxThreads != nullptr) {
+        maxThreads(0xFFFFFFFFu);
+    }
+
+    // a driver with no binary format can't cache
+    GLint formats = 0;
+    context->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    s_cacheDirectory.clear();
+    if (formats > 0 && !cacheDirectory.isEmpty() && QDir().mkpath(cacheDirectory)) {
+        s_cacheDirectory = cacheDirectory;
+    }
+    // the driver's identity is part of every cache key: a new driver
+    // compiles anew
+    s_driverIdentity = QByteArray(reinterpret_cast<const char*>(context->glGetString(GL_VENDOR))) + '\n'
+            + reinterpret_cast<const char*>(context->glGetString(GL_RENDERER)) + '\n'
+            + reinterpret_cast<const char*>(context->glGetString(GL_VERSION));
+}
+
+void ShaderProgram::create(const char *vertfile, const char *fragfile, const QStringList &defines)
+{
+    startCreate(vertfile, fragfile, defines);
+    finishCreate();
+}
+
+/**
+ * @brief addDefines
+ *  After the #version line, which must come first; #line puts the lines
+ *  after it back at their number in the file, for the compiler's messages.
+ * @param source
+ * @param defines
+ * @return
+ */
+static QByteArray addDefines(const QByteArray &source, const QStringList &defines)
+{
+    if (defines.isEmpty()) {
+        return source;
+    }
+    int version = source.indexOf("#version");
+    int lineEnd = version < 0 ? -1 : source.indexOf('\n', version);
+    if (lineEnd < 0) {
+        return source;
+    }
+    QByteArray lines;
+    for (const QString &define : defines) {
+        lines += "#define " + define.toUtf8() + "\n";
+    }
+    int versionLine = source.left(lineEnd).count('\n') + 1;
+    lines += "#line " + QByteArray::number(versionLine + 1) + "\n";
+    QByteArray result = source;
+    return result.insert(lineEnd + 1, lines);
+}
+
+void ShaderProgram::startCreate(const char *vertfile, const char *fragfile, const QStringList &defines)
 {
-    // Allocate space on our GPU for a vertex shader and a fragment shader and a shader program to manage the two
-    vertShader = context->glCreateShader(GL_VERTEX_SHADER);
-    fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
-    prog = context->glCreateProgram();
     // Get the body of text stored in our two .glsl files
-    QString qVertSource = qTextFileRead(vertfile);
-    QString qFragSource = qTextFileRead(fragfile);
+    m_vertSource = addDefines(qTextFileRead(vertfile).toUtf8(), defines);
+    m_fragSource = addDefines(qTextFileRead(fragfile).toUtf8(), defines);
+
+    m_cachePath.clear();
+    if (!s_cacheDirectory.isEmpty()) {
+        // the sources, what create() adds to them and the driver
+        QCryptographicHash hash(QCryptographicHash::Sha1);
+        hash.addData(m_vertSource);
+        hash.addData(m_fragSource);
+        hash.addData(QByteArray::number(packedAttribLocation) + "vs_Packed" + QByteArray::number(chunkOriginAttribLocation) + "vs_ChunkOrigin");
+        for (const std::string &varying : m_feedbackVaryings) {
+            hash.addData(QByteArray(varying.c_str()));
+        }
+        hash.addData(s_driverIdentity);
+        m_cachePath = QDir(s_cacheDirectory).filePath(QString::fromLatin1(hash.result().toHex()) + ".bin");
+    }
 
-    char* vertSource = new char[qVertSource.size()+1];
-    strcpy(vertSource, qVertSource.toStdString().c_str());
-    char* fragSource = new char[qFragSource.size()+1];
-    strcpy(fragSource, qFragSource.toStdString().c_str());
+    prog = context->glCreateProgram();
+    vertShader = 0;
+    fragShader = 0;
+    m_fromCache = loadBinary();
+    if (!m_fromCache) {
+        compileAndLink();
+    }
+}
 
+void ShaderProgram::compileAndLink()
+{
+    // Allocate space on our GPU for a vertex shader and a fragment shader
+    vertShader = context->glCreateShader(GL_VERTEX_SHADER);
+    fragShader = context->glCreateShader(GL_FRAGMENT_SHADER);
 
     // Send the shader text to OpenGL and store it in the shaders specified by the handles vertShader and fragShader
-    context->glShaderSource(vertShader, 1, (const char**)&vertSource, 0);
-    context->glShaderSource(fragShader, 1, (const char**)&fragSource, 0);
-    // Tell OpenGL to compile the shader text stored above
+    const char *vertSource = m_vertSource.constData();
+    const char *fragSource = m_fragSource.constData();
+    context->glShaderSource(vertShader, 1, &vertSource, 0);
+    context->glShaderSource(fragShader, 1, &fragSource, 0);
+    // Tell OpenGL to compile the shader text stored above; finishCreate
+    // checks that everything compiled OK, so the driver needn't finish now
     context->glCompileShader(vertShader);
     context->glCompileShader(fragShader);
-    // Check if everything compiled OK
-    GLint compiled;
-    context->glGetShaderiv(vertShader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        printShaderInfoLog(vertShader);
-    }
-    context->glGetShaderiv(fragShader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        printShaderInfoLog(fragShader);
-    }
 
     // Tell prog that it manages these particular vertex and fragment shaders
     context->glAttachShader(prog, vertShader);
     context->glAttachShader(prog, fragShader);
+    // ignored by the programs without it
+    context->glBindAttribLocation(prog, packedAttribLocation, "vs_Packed");
+    context->glBindAttribLocation(prog, chunkOriginAttribLocation, "vs_ChunkOrigin");
+    if (!m_feedbackVaryings.empty()) {
+        std::vector<const char*> names;
+        for (const std::string &varying : m_feedbackVaryings) {
+            names.push_back(varying.c_str());
+        }
+        context->glTransformFeedbackVaryings(prog, static_cast<GLsizei>(names.size()), names.data(),
+                                             GL_INTERLEAVED_ATTRIBS);
+    }
+    if (!m_cachePath.isEmpty()) {
+        context->glProgramParameteri(prog, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     context->glLinkProgram(prog);
+}
+
+void ShaderProgram::setFeedbackVaryings(const std::vector<std::string> &names)
+{
+    m_feedbackVaryings = names;
+}
+
+/**
+ * @brief ShaderProgram::loadBinary
+ *  The cache file holds the binary format, then the binary. The program
+ *  may still fail to link from it (finishCreate tells), if the driver
+ *  changed in a way its identity doesn't show.
+ * @return whether prog was given a cached binary
+ */
+bool ShaderProgram::loadBinary()
+{
+    if (m_cachePath.isEmpty()) {
+        return false;
+    }
+    QFile file(m_cachePath);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    QByteArray data = file.readAll();
+    if (data.size() <= static_cast<int>(sizeof(GLenum))) {
+        return false;
+    }
+    GLenum format;
+    memcpy(&format, data.constData(), sizeof(GLenum));
+    context->glProgramBinary(prog, format, data.constData() + sizeof(GLenum), data.size() - static_cast<int>(sizeof(GLenum)));
+    // a format the driver no longer takes is an error, not a crash
+    while (context->glGetError() != GL_NO_ERROR) {}
+    return true;
+}
+
+void ShaderProgram::saveBinary()
+{
+    GLint length = 0;
+    context->glGetProgramiv(prog, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    QByteArray data(static_cast<int>(sizeof(GLenum)) + length, Qt::Uninitialized);
+    GLenum format = 0;
+    context->glGetProgramBinary(prog, length, nullptr, &format, data.data() + sizeof(GLenum));
+    memcpy(data.data(), &format, sizeof(GLenum));
+    // written aside and renamed, so a crash never leaves half a binary
+    QSaveFile file(m_cachePath);
+    if (file.open(QFile::WriteOnly)) {
+        file.write(data);
+        file.commit();
+    }
+}
 
-    // Check for linking success
+void ShaderProgram::finishCreate()
+{
+    // Check for linking success; the first query waits on the driver
     GLint linked;
     context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    if (!linked && m_fromCache) {
+        // a stale binary: drop it and compile after all
+        QFile::remove(m_cachePath);
+        context->glDeleteProgram(prog);
+        prog = context->glCreateProgram();
+        m_fromCache = false;
+        compileAndLink();
+        context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    }
     if (!linked) {
+        // Check if everything compiled OK
+        GLint compiled;
+        context->glGetShaderiv(vertShader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            printShaderInfoLog(vertShader);
+        }
+        context->glGetShaderiv(fragShader, GL_COMPILE_STATUS, &compiled);
+        if (!compiled) {
+            printShaderInfoLog(fragShader);
+        }
         printLinkInfoLog(prog);
+    } else if (!m_fromCache && !m_cachePath.isEmpty()) {
+        saveBinary();
     }
+    m_vertSource.clear();
+    m_fragSource.clear();
+
+    // What the linked program actually has, looked up by name from here on
+    reflect();
 
     // Get the handles to the variables stored in our shaders
     // See shaderprogram.h for more information about these variables
 
-    attrPos = context->glGetAttribLocation(prog, "vs_Pos");
-    attrNor = context->glGetAttribLocation(prog, "vs_Nor");
-    attrCol = context->glGetAttribLocation(prog, "vs_Col");
-    attrUV  = context->glGetAttribLocation(prog, "vs_UV");
-    if(attrCol == -1) attrCol = context->glGetAttribLocation(prog, "vs_ColInstanced");
-    attrPosOffset = context->glGetAttribLocation(prog, "vs_OffsetInstanced");
-    attrAnimatableFlag = context->glGetAttribLocation(prog, "vs_AnimatableFlag");
+    attrPos = attribLocation("vs_Pos");
+    attrNor = attribLocation("vs_Nor");
+    attrCol = attribLocation("vs_Col");
+    attrUV  = attribLocation("vs_UV");
+    if(attrCol == -1) attrCol = attribLocation("vs_ColInstanced");
+    attrPosOffset = attribLocation("vs_OffsetInstanced");
+    attrAnimatableFlag = attribLocation("vs_AnimatableFlag");
+    attrPacked = attribLocation("vs_Packed");
+    attrModelInstanced = attribLocation("vs_ModelInstanced");
+    attrAnimationInstanced = attribLocation("vs_AnimationInstanced");
+
+    unifModel      = uniformLocation("u_Model");
+    unifModelInvTr = uniformLocation("u_ModelInvTr");
+    unifColor      = uniformLocation("u_Color");
+    unifTexture    = uniformLocation("u_Texture");
+    unifMorphCenter = uniformLocation("u_MorphCenter");
+    unifMorphRange  = uniformLocation("u_MorphRange");
+    unifRigs        = uniformLocation("u_Rigs");
+    unifLightViewProj  = uniformLocation("u_LightViewProj");
+    unifShadowCascades = uniformLocation("u_ShadowCascades");
+    unifShadowViewProj = uniformLocation("u_ShadowViewProj");
+    unifShadowNormalOffset = uniformLocation("u_ShadowNormalOffset");
+    unifShadowMap      = uniformLocation("u_ShadowMap");
+
+    // The per-frame uniforms come from the buffer at FrameUniforms' binding point
+    unifFrameBlock = bindUniformBlock(FrameUniforms::blockName, FrameUniforms::bindingPoint) ?
+                     m_uniformBlocks[FrameUniforms::blockName] : -1;
+    // and the terrain's point lights from ClusteredLights'
+    bindUniformBlock(ClusteredLights::blockName, ClusteredLights::bindingPoint);
+
+    // A new program holds none of the values sent to the last one
+    m_model = UniformCache<glm::mat4>();
+    m_color = UniformCache<glm::vec4>();
+    m_texture = UniformCache<int>();
+    m_rigs = UniformCache<int>();
+    m_morphCenter = UniformCache<glm::vec2>();
+    m_morphRange = UniformCache<glm::vec2>();
+    m_lightViewProj = UniformCache<glm::mat4>();
+    m_shadowViewProjs = UniformCache<std::vector<glm::mat4>>();
+    m_shadowNormalOffset = UniformCache<glm::vec3>();
+    m_shadowMap = UniformCache<int>();
+}
+
+/**
+ * @brief ShaderProgram::reflect
+ *  Fill the uniform, attribute and uniform block tables with every active
+ *  one of the linked program. Array names are stored without their "[0]",
+ *  as the shaders spell them.
+ */
+void ShaderProgram::reflect()
+{
+    m_uniforms.clear();
+    m_attribs.clear();
+    m_uniformBlocks.clear();
+
+    auto baseName = [](const std::vector<GLchar> &buffer, GLsizei length) {
+        std::string name(buffer.data(), length);
+        size_t bracket = name.find('[');
+        return bracket == std::string::npos ? name : name.substr(0, bracket);
+    };
+
+    GLint count = 0;
+    GLint maxLength = 0;
+    GLsizei length = 0;
+    GLint size = 0;
+    GLenum type = 0;
+
+    context->glGetProgramiv(prog, GL_ACTIVE_UNIFORMS, &count);
+    context->glGetProgramiv(prog, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+    std::vector<GLchar> buffer(std::max(maxLength, 1));
+    for (GLint i = 0; i < count; ++i) {
+        context->glGetActiveUniform(prog, i, maxLength, &length, &size, &type, buffer.data());
+        // -1 for the members of a uniform block: they have no location
+        int location = context->glGetUniformLocation(prog, buffer.data());
+        if (location != -1) {
+            m_uniforms[baseName(buffer, length)] = location;
+        }
+    }
+
+    context->glGetProgramiv(prog, GL_ACTIVE_ATTRIBUTES, &count);
+    context->glGetProgramiv(prog, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+    buffer.assign(std::max(maxLength, 1), 0);
+    for (GLint i = 0; i < count; ++i) {
+        context->glGetActiveAttrib(prog, i, maxLength, &length, &size, &type, buffer.data());
+        int location = context->glGetAttribLocation(prog, buffer.data());
+        if (location != -1) {
+            m_attribs[baseName(buffer, length)] = location;
+        }
+    }
+
+    context->glGetProgramiv(prog, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+    context->glGetProgramiv(prog, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+    buffer.assign(std::max(maxLength, 1), 0);
+    for (GLint i = 0; i < count; ++i) {
+        context->glGetActiveUniformBlockName(prog, i, maxLength, &length, buffer.data());
+        m_uniformBlocks[std::string(buffer.data(), length)] = i;
+    }
+}
+
+int ShaderProgram::uniformLocation(const std::string &name) const
+{
+    auto it = m_uniforms.find(name);
+    return it == m_uniforms.end() ? -1 : it->second;
+}
+
+int ShaderProgram::attribLocation(const std::string &name) const
+{
+    auto it = m_attribs.find(name);
+    return it == m_attribs.end() ? -1 : it->second;
+}
 
-    unifModel      = context->glGetUniformLocation(prog, "u_Model");
-    unifModelInvTr = context->glGetUniformLocation(prog, "u_ModelInvTr");
-    unifViewProj   = context->glGetUniformLocation(prog, "u_ViewProj");
-    unifColor      = context->glGetUniformLocation(prog, "u_Color");
-    unifTexture    = context->glGetUniformLocation(prog, "u_Texture");
-    unifTime       = context->glGetUniformLocation(prog, "u_Time");
-    unifDimensions = context->glGetUniformLocation(prog, "u_Dimensions");
+bool ShaderProgram::bindUniformBlock(const std::string &name, GLuint bindingPoint)
+{
+    auto it = m_uniformBlocks.find(name);
+    if (it == m_uniformBlocks.end()) {
+        return false;
+    }
+    context->glUniformBlockBinding(prog, static_cast<GLuint>(it->second), bindingPoint);
+    return true;
 }
 
 void ShaderProgram::useMe()
 {
-    context->glUseProgram(prog);
+    context->useProgram(prog);
 }
 
 void ShaderProgram::setModelMatrix(const glm::mat4 &model)
 {
     useMe();
+    setModelMatrixInUse(model);
+}
+
+void ShaderProgram::setModelMatrixInUse(const glm::mat4 &model)
+{
+    // unchanged: skip the upload, and the inverse transpose with it
+    if ((unifModel == -1 && unifModelInvTr == -1) || !m_model.update(model)) {
+        return;
+    }
 
     if (unifModel != -1) {
         // Pass a 4x4 matrix into a uniform variable in our shader
@@ -114,29 +415,11 @@ void ShaderProgram::setModelMatrix(const glm::mat4 &model)
     }
 }
 
-void ShaderProgram::setViewProjMatrix(const glm::mat4 &vp)
-{
-    // Tell OpenGL to use this shader program for subsequent function calls
-    useMe();
-
-    if(unifViewProj != -1) {
-    // Pass a 4x4 matrix into a uniform variable in our shader
-                    // Handle to the matrix variable on the GPU
-    context->glUniformMatrix4fv(unifViewProj,
-                    // How many matrices to pass
-                       1,
-                    // Transpose the matrix? OpenGL uses column-major, so no.
-                       GL_FALSE,
-                    // Pointer to the first element of the matrix
-                       &vp[0][0]);
-    }
-}
-
 void ShaderProgram::setGeometryColor(glm::vec4 color)
 {
     useMe();
 
-    if(unifColor != -1)
+    if(unifColor != -1 && m_color.update(color))
     {
         context->glUniform4fv(unifColor, 1, &color[0]);
     }
@@ -247,21 +530,108 @@ void ShaderProgram::drawInterleaved(Drawable &d)
     context->printGLErrorLog();
 }
 
+/**
+ * @brief ShaderProgram::drawInterleavedInstanced
+ *  The vertices are read as in drawInterleaved; vs_ModelInstanced takes
+ *  four locations, a column each, and vs_AnimationInstanced one, all
+ *  stepping once per instance. The divisors go back to 0 after, since
+ *  the one VAO keeps them for every program.
+ * @param d
+ * @param instanceBuffer : per instance a glm::mat4 then a glm::vec4
+ * @param firstInstance
+ * @param instanceCount
+ */
+void ShaderProgram::drawInterleavedInstanced(Drawable &d, GLuint instanceBuffer, int firstInstance, int instanceCount)
+{
+    useMe();
+
+    if(d.elemCount() < 0) {
+        throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCount()) + "!");
+    }
+
+    int size = 2 * sizeof(glm::vec4) + 2 * sizeof(glm::vec2);
+
+    if (attrPos != -1 && d.bindPos()) {
+        context->glEnableVertexAttribArray(attrPos);
+        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, size, (void*)0);
+    }
+
+    if (attrNor != -1 && d.bindPos()) {
+        context->glEnableVertexAttribArray(attrNor);
+        context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, size, (void*)sizeof(glm::vec4));
+    }
+
+    if (attrUV  != -1 && d.bindPos())  {
+        context->glEnableVertexAttribArray(attrUV);
+        context->glVertexAttribPointer(attrUV, 2, GL_FLOAT, false, size, (void*)(2 * sizeof(glm::vec4)));
+    }
+
+    if (attrAnimatableFlag != -1 && d.bindPos()) {
+        context->glEnableVertexAttribArray(attrAnimatableFlag);
+        context->glVertexAttribPointer(attrAnimatableFlag, 2, GL_FLOAT, false, size, (void*)(2 * sizeof(glm::vec4) + sizeof(glm::vec2)));
+    }
+
+    int instanceSize = sizeof(glm::mat4) + sizeof(glm::vec4);
+    size_t instanceOffset = static_cast<size_t>(firstInstance) * instanceSize;
+
+    if (attrModelInstanced != -1) {
+        context->glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (int column = 0; column < 4; column++) {
+            GLuint location = attrModelInstanced + column;
+            size_t offset = instanceOffset + column * sizeof(glm::vec4);
+            context->glEnableVertexAttribArray(location);
+            context->glVertexAttribPointer(location, 4, GL_FLOAT, false, instanceSize, (void*)offset);
+            context->glVertexAttribDivisor(location, 1);
+        }
+    }
+
+    if (attrAnimationInstanced != -1) {
+        context->glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        size_t offset = instanceOffset + sizeof(glm::mat4);
+        context->glEnableVertexAttribArray(attrAnimationInstanced);
+        context->glVertexAttribPointer(attrAnimationInstanced, 4, GL_FLOAT, false, instanceSize, (void*)offset);
+        context->glVertexAttribDivisor(attrAnimationInstanced, 1);
+    }
+
+    d.bindIdx();
+    context->glDrawElementsInstanced(d.drawMode(), d.elemCount(), GL_UNSIGNED_INT, 0, instanceCount);
+
+    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
+    if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
+    if (attrUV != -1) context->glDisableVertexAttribArray(attrUV);
+    if (attrAnimatableFlag != -1) context->glDisableVertexAttribArray(attrAnimatableFlag);
+    if (attrModelInstanced != -1) {
+        for (int column = 0; column < 4; column++) {
+            context->glVertexAttribDivisor(attrModelInstanced + column, 0);
+            context->glDisableVertexAttribArray(attrModelInstanced + column);
+        }
+    }
+    if (attrAnimationInstanced != -1) {
+        context->glVertexAttribDivisor(attrAnimationInstanced, 0);
+        context->glDisableVertexAttribArray(attrAnimationInstanced);
+    }
+
+    context->printGLErrorLog();
+}
+
 void ShaderProgram::drawInterleavedTerrainDrawType(Drawable &d, TerrainDrawType drawType)
 {
     useMe();
 
     int elemCount;
     bool bindData;
+    size_t dataOffset;
 
     switch (drawType) {
     case (TerrainDrawType::opaque):
         elemCount = d.elemCount();
         bindData = d.bindPos();
+        dataOffset = d.posOffset();
         break;
     case (TerrainDrawType::transparent):
         elemCount = d.transparentElemCount();
         bindData = d.bindTransparentData();
+        dataOffset = d.transparentDataOffset();
         break;
     }
 
@@ -269,36 +639,21 @@ void ShaderProgram::drawInterleavedTerrainDrawType(Drawable &d, TerrainDrawType
         throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(elemCount) + "!");
     }
 
-    // Each of the following blocks checks that:
-    //   * This shader has this attribute, and
-    //   * This Drawable has a vertex buffer for this attribute.
-    // If so, it binds the appropriate buffers to each attribute.
-
-    // Remember, by calling bindPos(), we call
-    // glBindBuffer on the Drawable's VBO for vertex position,
-    // meaning that glVertexAttribPointer associates vs_Pos
-    // (referred to by attrPos) with that VBO
-
-    int size = 2 * sizeof(glm::vec4) + 2 * sizeof(glm::vec2);
-
-    if (attrPos != -1 && bindData) {
-        context->glEnableVertexAttribArray(attrPos);
-        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, size, (void*)0);
-    }
-
-    if (attrNor != -1 && bindData) {
-        context->glEnableVertexAttribArray(attrNor);
-        context->glVertexAttribPointer(attrNor, 4, GL_FLOAT, false, size, (void*)sizeof(glm::vec4));
-    }
+    // The following block checks that:
+    //   * This shader has the packed attribute, and
+    //   * This Drawable has a vertex buffer for the draw type.
+    // If so, it binds that buffer to the attribute.
 
-    if (attrUV  != -1 && bindData)  {
-        context->glEnableVertexAttribArray(attrUV);
-        context->glVertexAttribPointer(attrUV, 2, GL_FLOAT, false, size, (void*)(2 * sizeof(glm::vec4)));
-    }
+    // Remember, by calling bindPos() or bindTransparentData(), we call
+    // glBindBuffer on the Drawable's VBO for that draw type,
+    // meaning that glVertexAttribIPointer associates vs_Packed
+    // (referred to by attrPacked) with that VBO
 
-    if (attrAnimatableFlag != -1 && bindData) {
-        context->glEnableVertexAttribArray(attrAnimatableFlag);
-        context->glVertexAttribPointer(attrAnimatableFlag, 2, GL_FLOAT, false, size, (void*)(2 * sizeof(glm::vec4) + sizeof(glm::vec2)));
+    // two 32-bit words per vertex, see packVertex in chunk.cpp;
+    // the I variant keeps them integers instead of converting to float
+    if (attrPacked != -1 && bindData) {
+        context->glEnableVertexAttribArray(attrPacked);
+        context->glVertexAttribIPointer(attrPacked, 2, GL_UNSIGNED_INT, 2 * sizeof(GLuint), (void*)dataOffset);
     }
 
     // Bind the index buffer and then draw shapes from it.
@@ -314,14 +669,27 @@ void ShaderProgram::drawInterleavedTerrainDrawType(Drawable &d, TerrainDrawType
 
     context->glDrawElements(d.drawMode(), elemCount, GL_UNSIGNED_INT, 0);
 
-    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
-    if (attrNor != -1) context->glDisableVertexAttribArray(attrNor);
-    if (attrUV != -1) context->glDisableVertexAttribArray(attrUV);
-    if (attrAnimatableFlag != -1) context->glDisableVertexAttribArray(attrAnimatableFlag);
+    if (attrPacked != -1) context->glDisableVertexAttribArray(attrPacked);
 
     context->printGLErrorLog();
 }
 
+/**
+ * @brief ShaderProgram::drawBoundElements
+ *  The VAO holds the vertex attribute and the element buffer, see
+ *  Chunk::bindVAO. GL errors are left to the caller to check once per pass.
+ * @param d
+ * @param firstElem : in indices, not bytes
+ * @param elemCount
+ */
+void ShaderProgram::drawBoundElements(Drawable &d, int firstElem, int elemCount)
+{
+    if (elemCount < 0) {
+        throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(elemCount) + "!");
+    }
+    context->renderBackend().drawIndexed(d.drawMode(), elemCount, static_cast<size_t>(firstElem));
+}
+
 void ShaderProgram::drawInstanced(InstancedDrawable &d)
 {
     useMe();
@@ -448,6 +816,38 @@ void ShaderProgram::drawTexture(Drawable &d) {
 
 }
 
+/**
+ * @brief ShaderProgram::drawHud
+ *  As drawTexture, with vec4 uvs: the layer and the blending ride along
+ *  (see HudBatch).
+ * @param d
+ */
+void ShaderProgram::drawHud(Drawable &d) {
+    useMe();
+
+    if(d.elemCount() < 0) {
+        throw std::out_of_range("Attempting to draw a drawable with m_count of " + std::to_string(d.elemCount()) + "!");
+    }
+
+    if (attrPos != -1 && d.bindPos()) {
+        context->glEnableVertexAttribArray(attrPos);
+        context->glVertexAttribPointer(attrPos, 4, GL_FLOAT, false, 0, NULL);
+    }
+
+    if (attrUV != -1 && d.bindUV()) {
+        context->glEnableVertexAttribArray(attrUV);
+        context->glVertexAttribPointer(attrUV, 4, GL_FLOAT, false, 0, NULL);
+    }
+
+    d.bindIdx();
+    context->glDrawElements(d.drawMode(), d.elemCount(), GL_UNSIGNED_INT, 0);
+
+    if (attrPos != -1) context->glDisableVertexAttribArray(attrPos);
+    if (attrUV != -1) context->glDisableVertexAttribArray(attrUV);
+
+    context->printGLErrorLog();
+}
+
 char* ShaderProgram::textFileRead(const char* fileName) {
     char* text;
 
@@ -527,26 +927,56 @@ void ShaderProgram::printLinkInfoLog(int prog)
 void ShaderProgram::setTexture(int textureSlot) {
     useMe();
 
-    if (unifTexture != -1) {
+    if (unifTexture != -1 && m_texture.update(textureSlot)) {
         context->glUniform1i(unifTexture, textureSlot);
     }
 }
 
-void ShaderProgram::setTime(int time) {
+void ShaderProgram::setRigTexture(int textureSlot) {
+    useMe();
+
+    if (unifRigs != -1 && m_rigs.update(textureSlot)) {
+        context->glUniform1i(unifRigs, textureSlot);
+    }
+}
+
+void ShaderProgram::setMorph(glm::vec2 center, glm::vec2 range) {
     useMe();
 
-    if(unifTime != -1)
+    if(unifMorphCenter != -1 && m_morphCenter.update(center))
+    {
+        context->glUniform2f(unifMorphCenter, center.x, center.y);
+    }
+    if(unifMorphRange != -1 && m_morphRange.update(range))
     {
-        context->glUniform1i(unifTime, time);
+        context->glUniform2f(unifMorphRange, range.x, range.y);
     }
 }
 
+void ShaderProgram::setLightViewProj(const glm::mat4 &viewProj) {
+    useMe();
+
+    if (unifLightViewProj != -1 && m_lightViewProj.update(viewProj)) {
+        context->glUniformMatrix4fv(unifLightViewProj, 1, GL_FALSE, &viewProj[0][0]);
+    }
+}
 
-void ShaderProgram::setDimensions(glm::ivec2 dims) {
+void ShaderProgram::setShadowCascades(const std::vector<glm::mat4> &viewProjs, glm::vec3 normalOffsets, int textureSlot) {
     useMe();
 
-    if(unifDimensions != -1)
-    {
-        context->glUniform2i(unifDimensions, dims.x, dims.y);
+    if (m_shadowViewProjs.update(viewProjs)) {
+        if (unifShadowCascades != -1) {
+            context->glUniform1i(unifShadowCascades, static_cast<GLint>(viewProjs.size()));
+        }
+        if (unifShadowViewProj != -1 && !viewProjs.empty()) {
+            context->glUniformMatrix4fv(unifShadowViewProj, static_cast<GLsizei>(viewProjs.size()), GL_FALSE,
+                                        &viewProjs[0][0][0]);
+        }
+    }
+    if (unifShadowNormalOffset != -1 && m_shadowNormalOffset.update(normalOffsets)) {
+        context->glUniform3f(unifShadowNormalOffset, normalOffsets.x, normalOffsets.y, normalOffsets.z);
+    }
+    if (unifShadowMap != -1 && m_shadowMap.update(textureSlot)) {
+        context->glUniform1i(unifShadowMap, textureSlot);
     }
 }
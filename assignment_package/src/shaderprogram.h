@@ -6,7 +6,12 @@
 #include <glm/glm.hpp>
 
 #include "drawable.h"
+#include "frameuniforms.h"
 #include "utils.h"
+#include <QStringList>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 
 class ShaderProgram
@@ -21,48 +26,104 @@ public:
     int attrCol; // A handle for the "in" vec4 representing vertex color in the vertex shader
     int attrUV;  // A handle for the "in" vec4 representing vertex uv in the vertex shader
     int attrAnimatableFlag; // A handle for the "in" vec4 representing float animatable flag in the vertex shader
+    int attrPacked; // A handle for the "in" uvec2 representing a packed chunk vertex in the terrain vertex shader
     int attrPosOffset; // A handle for a vec3 used only in the instanced rendering shader
+    int attrModelInstanced; // A handle for the per-instance mat4 of the instanced NPC shader (four locations)
+    int attrAnimationInstanced; // A handle for the per-instance vec4 (limb angle, rig) of the instanced NPC shader
 
     int unifModel; // A handle for the "uniform" mat4 representing model matrix in the vertex shader
     int unifModelInvTr; // A handle for the "uniform" mat4 representing inverse transpose of the model matrix in the vertex shader
-    int unifViewProj; // A handle for the "uniform" mat4 representing combined projection and view matrices in the vertex shader
     int unifColor; // A handle for the "uniform" vec4 representing color of geometry in the vertex shader
     int unifTexture; // A handle for the "uniform" sampler2D that will be used to read the texture containing the scene render
-    int unifTime; // A handle for the "uniform" int representing current time (actually is number of frames)
-    int unifDimensions; // A handle for the "uniform" vec2 u_Dimensions
+    int unifFrameBlock; // A handle for the FrameUniforms block (u_ViewProj, u_Dimensions, u_Time), see FrameUniforms
+    int unifMorphCenter; // A handle for the "uniform" vec2 u_MorphCenter of the distant terrain shader
+    int unifMorphRange; // A handle for the "uniform" vec2 u_MorphRange of the distant terrain shader
+    int unifRigs; // A handle for the "uniform" sampler2D u_Rigs of the instanced NPC shader (see NPCPartBatch)
+    int unifLightViewProj; // A handle for the "uniform" mat4 u_LightViewProj of the shadow depth shader
+    int unifShadowCascades; // A handle for the "uniform" int u_ShadowCascades: how many of the cascades below are drawn
+    int unifShadowViewProj; // A handle for the "uniform" mat4[] u_ShadowViewProj, each cascade's light view-projection
+    int unifShadowNormalOffset; // A handle for the "uniform" vec3 u_ShadowNormalOffset, each cascade's depth bias along the normal
+    int unifShadowMap; // A handle for the "uniform" sampler2DArrayShadow u_ShadowMap (see ShadowMap)
+
+    // vs_Packed is bound here in every program, so the chunk VAOs
+    // (configured once per upload) fit whichever program draws them
+    static const GLuint packedAttribLocation = 0;
+    // vs_ChunkOrigin: the chunk's (x, z), per instance in the multi-draw
+    // path and a constant attribute value in the per-chunk draws
+    static const GLuint chunkOriginAttribLocation = 1;
 
 public:
     ShaderProgram(OpenGLContext* context);
-    // Sets up the requisite GL data and shaders from the given .glsl files
-    void create(const char *vertfile, const char *fragfile);
+    // Let the driver compile on threads of its own where it can
+    // (KHR/ARB_parallel_shader_compile), and keep the linked programs in
+    // cacheDirectory, where warm starts load them without compiling (an
+    // empty string: no cache). Once, with the context current, before
+    // the first create.
+    static void setUpCompilation(OpenGLContext *context, const QString &cacheDirectory);
+    // Sets up the requisite GL data and shaders from the given .glsl files,
+    // each with the given names #defined after its #version line: one
+    // file, compiled with different defines, yields the permutations of a
+    // shader without branching on what they share at run time
+    void create(const char *vertfile, const char *fragfile, const QStringList &defines = QStringList());
+    // create() in two halves: startCreate hands the sources (or the cached
+    // binary) to the driver, finishCreate waits on it and checks, caches
+    // and reflects the program. Starting every program before finishing
+    // any lets the driver compile them all at once.
+    void startCreate(const char *vertfile, const char *fragfile, const QStringList &defines = QStringList());
+    void finishCreate();
+    // The vertex shader outputs a transform feedback captures, interleaved
+    // in this order into one buffer (see ParticleSystem); before create
+    void setFeedbackVaryings(const std::vector<std::string> &names);
     // Tells our OpenGL context to use this shader to draw things
     void useMe();
+    // The location of the named uniform, -1 if the program has no such
+    // active uniform (or it is in a uniform block)
+    int uniformLocation(const std::string &name) const;
+    // The location of the named "in" variable of the vertex shader, -1 if none
+    int attribLocation(const std::string &name) const;
+    // Read the named std140 uniform block from the buffer bound (with
+    // glBindBufferBase) to bindingPoint; false if the program has no such block
+    bool bindUniformBlock(const std::string &name, GLuint bindingPoint);
     // Pass the given texture map to this shader on the GPU
     void setTexture();
     // Pass the given texture map to this shader on the GPU
     void setTexture(int textureSlot);
-    // Pass current time (frame count) to this shader on the GPU
-    void setTime(int time);
     // Pass the given model matrix to this shader on the GPU
     void setModelMatrix(const glm::mat4 &model);
-    // Pass the given Projection * View matrix to this shader on the GPU
-    void setViewProjMatrix(const glm::mat4 &vp);
+    // Same, for the program already in use (no glUseProgram)
+    void setModelMatrixInUse(const glm::mat4 &model);
     // Pass the given color to this shader on the GPU
     void setGeometryColor(glm::vec4 color);
-    // Set dimension
-    void setDimensions(glm::ivec2 dims);
+    // Pass the texture slot of the NPC rigs to this shader on the GPU
+    void setRigTexture(int textureSlot);
+    // Pass the distant terrain's morph center and distance range to this shader on the GPU
+    void setMorph(glm::vec2 center, glm::vec2 range);
+    // Pass the view-projection of the light a shadow map is drawn from to this shader on the GPU
+    void setLightViewProj(const glm::mat4 &viewProj);
+    // Pass the shadow cascades (see ShadowMap) to this shader on the GPU:
+    // their view-projections, the offsets along the normal, one per
+    // cascade, and the texture slot of their depth; no view-projections
+    // turn the shadows off
+    void setShadowCascades(const std::vector<glm::mat4> &viewProjs, glm::vec3 normalOffsets, int textureSlot);
     // Draw the given object to our screen using this ShaderProgram's shaders
     void draw(Drawable &d);
     // Draw the given object to our screen multiple times using instanced rendering
     void drawInstanced(InstancedDrawable &d);
     // Draw the given object with interleaved buffer data
     void drawInterleaved(Drawable &d);
+    // Same, once per instance of instanceBuffer (a mat4 and a vec4) from firstInstance on
+    void drawInterleavedInstanced(Drawable &d, GLuint instanceBuffer, int firstInstance, int instanceCount);
     // Draw the given object with interleaved buffer data based on TerrainDrawType
     void drawInterleavedTerrainDrawType(Drawable &d, TerrainDrawType drawType);
+    // Draw elemCount indices from firstElem with the Drawable's VAO already
+    // bound and this program in use, so only the draw call is issued
+    void drawBoundElements(Drawable &d, int firstElem, int elemCount);
     // Draw Overlay
     void drawOverlay(Drawable &d);
     // Draw Texture
     void drawTexture(Drawable &d);
+    // Draw the HUD batch, uvs with layer and blending (see HudBatch)
+    void drawHud(Drawable &d);
     // Utility function used in create()
     char* textFileRead(const char*);
     // Utility function that prints any shader compilation errors to the console
@@ -73,6 +134,59 @@ public:
     QString qTextFileRead(const char*);
 
 private:
+    // Build the tables below from the linked program
+    void reflect();
+    // The halves of startCreate: from m_vertSource and m_fragSource, or
+    // from m_cachePath
+    void compileAndLink();
+    bool loadBinary();
+    void saveBinary();
+
+    static QString s_cacheDirectory;
+    static QByteArray s_driverIdentity;
+    // between startCreate and finishCreate
+    QByteArray m_vertSource;
+    QByteArray m_fragSource;
+    QString m_cachePath;
+    bool m_fromCache;
+    std::vector<std::string> m_feedbackVaryings;
+
+    // Every active uniform, attribute and uniform block of the program,
+    // by name: locations for the first two, block indices for the last
+    std::unordered_map<std::string, int> m_uniforms;
+    std::unordered_map<std::string, int> m_attribs;
+    std::unordered_map<std::string, int> m_uniformBlocks;
+
+    // The last value sent to a uniform of this program: setting it again
+    // sends nothing
+    template <typename T>
+    struct UniformCache {
+        bool valid;
+        T value;
+
+        UniformCache() : valid(false), value() {}
+        // Whether v must be sent, remembering it if so
+        bool update(const T &v) {
+            if (valid && value == v) {
+                return false;
+            }
+            valid = true;
+            value = v;
+            return true;
+        }
+    };
+
+    UniformCache<glm::mat4> m_model;
+    UniformCache<glm::vec4> m_color;
+    UniformCache<int> m_texture;
+    UniformCache<int> m_rigs;
+    UniformCache<glm::vec2> m_morphCenter;
+    UniformCache<glm::vec2> m_morphRange;
+    UniformCache<glm::mat4> m_lightViewProj;
+    UniformCache<std::vector<glm::mat4>> m_shadowViewProjs;
+    UniformCache<glm::vec3> m_shadowNormalOffset;
+    UniformCache<int> m_shadowMap;
+
     OpenGLContext* context;   // Since Qt's OpenGL support is done through classes like QOpenGLFunctions_3_2_Core,
                             // we need to pass our OpenGL context to the Drawable in order to call GL functions
                             // from within this class.
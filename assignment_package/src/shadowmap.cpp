@@ -0,0 +1,217 @@
+#include "shadowmap.h"
+#include "scene/frustum.h"
+#include "scene/terrain.h"
+#include <algorithm>
+#include <iostream>
+
+// Per cascade, finest first: the sphere around the eye it covers, and how
+// far the eye moves before it is redrawn. The widest reaches past the
+// chunks drawn around the player.
+static const float cascadeRadii[ShadowMap::cascadeCount] = {20.f, 56.f, 160.f};
+static const float cascadeMargins[ShadowMap::cascadeCount] = {2.f, 8.f, 24.f};
+
+// The height blocks reach, which bounds how far toward the sun a caster can be
+static const float worldHeight = 256.f;
+
+ShadowMap::ShadowMap(OpenGLContext *context)
+    : mp_context(context), m_frameBuffer(0), m_depthTexture(0), m_resolution(2048), m_created(false),
+      m_cascades(), m_sunDirection(glm::normalize(glm::vec3(0.5f, 1.f, 0.75f))), m_updates(0), m_lastRedraws(0)
+{
+    for (int i = 0; i < cascadeCount; i++) {
+        m_cascades[i] = Cascade{cascadeRadii[i], cascadeMargins[i], glm::vec3(0.f), m_sunDirection,
+                                glm::mat4(1.f), 0, false};
+    }
+}
+
+void ShadowMap::setResolution(int resolution) {
+    m_resolution = resolution;
+}
+
+int ShadowMap::getResolution() const {
+    return m_resolution;
+}
+
+void ShadowMap::create() {
+    mp_context->glGenTextures(1, &m_depthTexture);
+    mp_context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture);
+    mp_context->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, m_resolution, m_resolution, cascadeCount,
+                             0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    // Read as a shadow sampler: each lookup compares against the stored
+    // depth, and linear filtering blends the four nearest comparisons
+    mp_context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    mp_context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    mp_context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    mp_context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    mp_context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+    // Depth only: no color buffer to draw to or read from
+    mp_context->glGenFramebuffers(1, &m_frameBuffer);
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+    GLenum none = GL_NONE;
+    mp_context->glDrawBuffers(1, &none);
+    mp_context->glReadBuffer(GL_NONE);
+
+    m_created = true;
+    for (int i = 0; i < cascadeCount; i++) {
+        mp_context->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0, i);
+        if (mp_context->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            m_created = false;
+            std::cout << "Shadow map did not initialize correctly..." << std::endl;
+            mp_context->printGLErrorLog();
+            break;
+        }
+        // nothing drawn yet: no shadow anywhere
+        mp_context->glClear(GL_DEPTH_BUFFER_BIT);
+        m_cascades[i].valid = false;
+    }
+    if (!m_created) {
+        mp_context->glDeleteFramebuffers(1, &m_frameBuffer);
+        mp_context->glDeleteTextures(1, &m_depthTexture);
+    }
+}
+
+void ShadowMap::destroy() {
+    if (m_created) {
+        m_created = false;
+        mp_context->glDeleteFramebuffers(1, &m_frameBuffer);
+        mp_context->glDeleteTextures(1, &m_depthTexture);
+    }
+}
+
+bool ShadowMap::isCreated() const {
+    return m_created;
+}
+
+void ShadowMap::setSunDirection(glm::vec3 direction) {
+    m_sunDirection = glm::normalize(direction);
+}
+
+void ShadowMap::invalidateChunks(const std::vector<glm::ivec2> &corners) {
+    if (corners.empty()) {
+        return;
+    }
+    for (Cascade &cascade : m_cascades) {
+        if (!cascade.valid) {
+            continue;
+        }
+        Frustum frustum(cascade.viewProj);
+        for (const glm::ivec2 &corner : corners) {
+            if (frustum.intersectsBox(glm::vec3(corner[0], 0.f, corner[1]),
+                                      glm::vec3(corner[0] + 16, worldHeight, corner[1] + 16))) {
+                cascade.valid = false;
+                break;
+            }
+        }
+    }
+}
+
+/**
+ * @brief ShadowMap::computeViewProj
+ *  An orthographic projection along the sun, radius + margin to each side
+ *  of the eye. Its near plane is pulled toward the sun far enough to hold
+ *  every block that can shade the sphere, up to the world's top.
+ * @param cascade
+ * @param eye
+ * @return
+ */
+glm::mat4 ShadowMap::computeViewProj(const Cascade &cascade, glm::vec3 eye) const {
+    glm::vec3 up = std::abs(m_sunDirection.y) > 0.99f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.f), -m_sunDirection, up);
+
+    float halfWidth = cascade.radius + cascade.margin;
+    float texel = 2.f * halfWidth / m_resolution;
+    glm::vec3 center = glm::vec3(lightView * glm::vec4(eye, 1.f));
+    center.x = glm::floor(center.x / texel) * texel;
+    center.y = glm::floor(center.y / texel) * texel;
+
+    float towardSun = halfWidth + worldHeight / std::max(m_sunDirection.y, 0.25f);
+    glm::mat4 proj = glm::ortho(center.x - halfWidth, center.x + halfWidth, center.y - halfWidth, center.y + halfWidth,
+                                -center.z - towardSun, -center.z + halfWidth);
+    return proj * lightView;
+}
+
+/**
+ * @brief ShadowMap::update
+ *  A cascade needs redrawing once a chunk in it changed, the eye left its
+ *  margin or the sun turned. Of the cascades past the finest, the one
+ *  drawn longest ago goes first, so none starves while another keeps
+ *  changing.
+ */
+void ShadowMap::update(Terrain &terrain, ShaderProgram &depthProgram, glm::vec3 eye,
+                       float playerX, float playerZ, int halfGridSize) {
+    m_lastRedraws = 0;
+    if (!m_created) {
+        return;
+    }
+    m_updates++;
+
+    std::vector<int> redraws;
+    int cached = -1;
+    for (int i = 0; i < cascadeCount; i++) {
+        const Cascade &cascade = m_cascades[i];
+        bool stale = !cascade.valid || glm::distance(eye, cascade.eye) > cascade.margin
+                || glm::dot(cascade.sunDirection, m_sunDirection) < sunTolerance;
+        if (!stale) {
+            continue;
+        }
+        if (i == 0) {
+            redraws.push_back(i);
+        } else if (cached < 0 || cascade.drawnAt < m_cascades[cached].drawnAt) {
+            cached = i;
+        }
+    }
+    if (cached >= 0) {
+        redraws.push_back(cached);
+    }
+    if (redraws.empty()) {
+        return;
+    }
+
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+    mp_context->glViewport(0, 0, m_resolution, m_resolution);
+    // slope-scaled bias, on top of the normal offset of the lookups
+    mp_context->glEnable(GL_POLYGON_OFFSET_FILL);
+    mp_context->glPolygonOffset(2.f, 4.f);
+    for (int i : redraws) {
+        Cascade &cascade = m_cascades[i];
+        cascade.viewProj = computeViewProj(cascade, eye);
+        cascade.eye = eye;
+        cascade.sunDirection = m_sunDirection;
+        cascade.drawnAt = m_updates;
+        cascade.valid = true;
+
+        mp_context->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture, 0, i);
+        mp_context->glClear(GL_DEPTH_BUFFER_BIT);
+        depthProgram.setLightViewProj(cascade.viewProj);
+        terrain.drawShadowCasters(playerX, playerZ, halfGridSize, cascade.viewProj, &depthProgram);
+    }
+    mp_context->glDisable(GL_POLYGON_OFFSET_FILL);
+    m_lastRedraws = static_cast<int>(redraws.size());
+}
+
+int ShadowMap::getLastRedraws() const {
+    return m_lastRedraws;
+}
+
+void ShadowMap::bindToTextureSlot(unsigned int slot) {
+    mp_context->glActiveTexture(GL_TEXTURE0 + slot);
+    mp_context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture);
+}
+
+/**
+ * @brief ShadowMap::setCascades
+ *  Each lookup is pushed a texel and a half of its cascade off its face,
+ *  so a face does not shadow itself. Without a map the shadows are off.
+ */
+void ShadowMap::setCascades(ShaderProgram &program, int textureSlot) const {
+    std::vector<glm::mat4> viewProjs;
+    glm::vec3 normalOffsets(0.f);
+    if (m_created) {
+        for (int i = 0; i < cascadeCount; i++) {
+            viewProjs.push_back(m_cascades[i].viewProj);
+            normalOffsets[i] = 1.5f * 2.f * (m_cascades[i].radius + m_cascades[i].margin) / m_resolution;
+        }
+    }
+    program.setShadowCascades(viewProjs, normalOffsets, textureSlot);
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include "openglcontext.h"
+#include "glm_includes.h"
+#include "shaderprogram.h"
+#include <array>
+#include <cstdint>
+#include <vector>
+
+class Terrain;
+
+// The sun's shadows over the terrain, as cascaded shadow maps: a depth
+// texture array with a layer per cascade, each cascade covering a sphere
+// around the eye of its own radius, the finest first. A cascade is drawn
+// with Terrain::drawShadowCasters (the opaque chunks, culled to its light
+// frustum) and kept until the eye moves farther than its margin from where
+// it was drawn, the sun turns, or a chunk in it gets a new mesh; so the
+// wide cascades are redrawn far less often than the fine one. A cascade
+// that needs it but would exceed the frame's redraws keeps its old
+// contents, which still match the matrices it hands out.
+// Read the maps with setCascades on a program that samples them (see
+// terrain.vert.glsl and lambert.frag.glsl).
+class ShadowMap {
+public:
+    static const int cascadeCount = 3;
+
+private:
+    struct Cascade
+    {
+        // the sphere around the eye it must cover, and how far the eye may
+        // move before it is redrawn; it is drawn radius + margin wide
+        float radius;
+        float margin;
+        // where the eye and the sun were when it was last drawn
+        glm::vec3 eye;
+        glm::vec3 sunDirection;
+        glm::mat4 viewProj;
+        // the update that drew it
+        uint64_t drawnAt;
+        // its contents match viewProj and the chunks' meshes
+        bool valid;
+    };
+
+    OpenGLContext *mp_context;
+    GLuint m_frameBuffer;
+    GLuint m_depthTexture;
+    int m_resolution;
+    bool m_created;
+
+    std::array<Cascade, cascadeCount> m_cascades;
+    // toward the sun
+    glm::vec3 m_sunDirection;
+    // the updates so far, and the cascades drawn by the last one
+    uint64_t m_updates;
+    int m_lastRedraws;
+
+    // the cascade's view-projection around eye, snapped to whole texels
+    // of the map so its edges do not shimmer as the eye moves
+    glm::mat4 computeViewProj(const Cascade &cascade, glm::vec3 eye) const;
+
+public:
+    // the cos of the angle the sun may turn before the cascades are redrawn
+    static constexpr float sunTolerance = 0.99996f;
+
+    ShadowMap(OpenGLContext *context);
+
+    // The size in texels of every cascade; applies from the next create()
+    void setResolution(int resolution);
+    int getResolution() const;
+    // Initialize the depth texture, cleared to no shadow, and its frame buffer
+    void create();
+    // Deallocate all GPU-side data
+    void destroy();
+    bool isCreated() const;
+
+    // The direction toward the sun, normalized by the map
+    void setSunDirection(glm::vec3 direction);
+    // Redraw the cascades holding any of the chunks at these corners
+    void invalidateChunks(const std::vector<glm::ivec2> &corners);
+    // Redraw the cascades around the eye that need it: the finest whenever
+    // it does, one of the others at most, with the depth-only chunk
+    // program. Leaves the frame buffer and viewport to the caller.
+    void update(Terrain &terrain, ShaderProgram &depthProgram, glm::vec3 eye,
+                float playerX, float playerZ, int halfGridSize);
+    int getLastRedraws() const;
+
+    // Associate the depth texture with the indicated texture slot, and
+    // pass the cascades to the program that reads them
+    void bindToTextureSlot(unsigned int slot);
+    void setCascades(ShaderProgram &program, int textureSlot) const;
+};
@@ -2,73 +2,213 @@ INCLUDEPATH += $$PWD
 DEPENDPATH += $$PWD
 
 SOURCES += \
+    $$PWD/audiomanager.cpp \
+    $$PWD/clusteredlights.cpp \
     $$PWD/framebuffer.cpp \
+    $$PWD/frameuniforms.cpp \
+    $$PWD/framecapture.cpp \
+    $$PWD/framewatchdog.cpp \
+    $$PWD/frameprofile.cpp \
+    $$PWD/gputimers.cpp \
+    $$PWD/imagedecoder.cpp \
+    $$PWD/inputlog.cpp \
     $$PWD/main.cpp \
     $$PWD/mainwindow.cpp \
     $$PWD/mygl.cpp \
+    $$PWD/npcbenchmark.cpp \
     $$PWD/scene/lsystems.cpp \
+    $$PWD/scene/blockcursor.cpp \
+    $$PWD/scene/blockicons.cpp \
     $$PWD/scene/blockinwidget.cpp \
+    $$PWD/scene/blockticks.cpp \
+    $$PWD/scene/blocksection.cpp \
+    $$PWD/scene/chunkmap.cpp \
+    $$PWD/scene/chunkpool.cpp \
+    $$PWD/scene/chunknavigation.cpp \
+    $$PWD/scene/flatscenegraph.cpp \
+    $$PWD/scene/flowfield.cpp \
+    $$PWD/scene/hudbatch.cpp \
+    $$PWD/scene/huddrawable.cpp \
     $$PWD/scene/inventory.cpp \
+    $$PWD/scene/lightvolume.cpp \
+    $$PWD/scene/liquidsimulation.cpp \
+    $$PWD/scene/meshcache.cpp \
+    $$PWD/scene/navigationgraph.cpp \
     $$PWD/scene/noise.cpp \
     $$PWD/scene/block.cpp \
     $$PWD/scene/npc.cpp \
+    $$PWD/scene/npcimpostors.cpp \
+    $$PWD/scene/npckinematics.cpp \
+    $$PWD/scene/npcmeshcache.cpp \
+    $$PWD/scene/npcpartbatch.cpp \
+    $$PWD/scene/npcsimulation.cpp \
+    $$PWD/scene/npcspawner.cpp \
     $$PWD/scene/npcs/lama.cpp \
     $$PWD/scene/npcs/sheep.cpp \
     $$PWD/scene/node.cpp \
     $$PWD/scene/npcs/steve.cpp \
     $$PWD/scene/npcs/zombiedragon.cpp \
     $$PWD/scene/pathfinder.cpp \
+    $$PWD/scene/pathfindingservice.cpp \
     $$PWD/scene/quad.cpp \
+    $$PWD/scene/random.cpp \
+    $$PWD/scene/regionstore.cpp \
     $$PWD/scene/text.cpp \
+    $$PWD/scene/voxelsweep.cpp \
+    $$PWD/scene/treetemplate.cpp \
     $$PWD/scene/widget.cpp \
+    $$PWD/scene/zoneheightmap.cpp \
+    $$PWD/scene/zonefeatures.cpp \
     $$PWD/shaderprogram.cpp \
+    $$PWD/particlesystem.cpp \
+    $$PWD/postnoise.cpp \
+    $$PWD/shadowmap.cpp \
+    $$PWD/transparencybuffer.cpp \
+    $$PWD/temporalupsampler.cpp \
     $$PWD/drawable.cpp \
+    $$PWD/farfield.cpp \
     $$PWD/cameracontrolshelp.cpp \
+    $$PWD/chunkbufferpool.cpp \
+    $$PWD/chunkmesharena.cpp \
+    $$PWD/chunkmultidraw.cpp \
+    $$PWD/chunkcomputemesher.cpp \
     $$PWD/scene/cube.cpp \
+    $$PWD/scene/distantterrain.cpp \
     $$PWD/openglcontext.cpp \
+    $$PWD/renderbackend.cpp \
     $$PWD/scene/terrain.cpp \
+    $$PWD/scene/terrainraycast.cpp \
+    $$PWD/terraincompute.cpp \
+    $$PWD/terrainjobs.cpp \
+    $$PWD/threadaffinity.cpp \
+    $$PWD/threadconfig.cpp \
     $$PWD/scene/worldaxes.cpp \
+    $$PWD/scene/editjournal.cpp \
     $$PWD/scene/entity.cpp \
+    $$PWD/scene/entitygrid.cpp \
+    $$PWD/scene/frustum.cpp \
     $$PWD/scene/player.cpp \
     $$PWD/scene/camera.cpp \
     $$PWD/playerinfo.cpp \
+    $$PWD/lineararena.cpp \
+    $$PWD/memorystats.cpp \
+    $$PWD/profiler.cpp \
+    $$PWD/qualitycontroller.cpp \
     $$PWD/scene/chunk.cpp \
+    $$PWD/scene/chunkdrawable.cpp \
+    $$PWD/scene/chunkheatmap.cpp \
+    $$PWD/scene/chunkstreamer.cpp \
+    $$PWD/netprotocol.cpp \
+    $$PWD/netserver.cpp \
+    $$PWD/servermetrics.cpp \
+    $$PWD/netclient.cpp \
     $$PWD/texture.cpp
 
 HEADERS += \
+    $$PWD/audiomanager.h \
+    $$PWD/clusteredlights.h \
     $$PWD/framebuffer.h \
+    $$PWD/frameuniforms.h \
+    $$PWD/framecapture.h \
+    $$PWD/framewatchdog.h \
+    $$PWD/frameprofile.h \
+    $$PWD/gputimers.h \
+    $$PWD/imagedecoder.h \
+    $$PWD/inputlog.h \
     $$PWD/la.h \
     $$PWD/mainwindow.h \
+    $$PWD/mpscqueue.h \
     $$PWD/mygl.h \
+    $$PWD/npcbenchmark.h \
     $$PWD/scene/lsystems.h \
+    $$PWD/scene/blockcursor.h \
+    $$PWD/scene/blockicons.h \
     $$PWD/scene/blockinwidget.h \
+    $$PWD/scene/blockticks.h \
+    $$PWD/scene/blocksection.h \
+    $$PWD/scene/chunkmap.h \
+    $$PWD/scene/chunkpool.h \
+    $$PWD/scene/chunknavigation.h \
+    $$PWD/scene/flatscenegraph.h \
+    $$PWD/scene/flowfield.h \
+    $$PWD/scene/hudbatch.h \
+    $$PWD/scene/huddrawable.h \
     $$PWD/scene/inventory.h \
+    $$PWD/scene/lightvolume.h \
+    $$PWD/scene/pointlight.h \
+    $$PWD/scene/liquidsimulation.h \
+    $$PWD/scene/meshcache.h \
+    $$PWD/scene/navigationgraph.h \
     $$PWD/scene/noise.h \
     $$PWD/scene/block.h \
     $$PWD/scene/npc.h \
+    $$PWD/scene/npcimpostors.h \
+    $$PWD/scene/npckinematics.h \
+    $$PWD/scene/npcmeshcache.h \
+    $$PWD/scene/npcpartbatch.h \
     $$PWD/scene/node.h \
+    $$PWD/scene/npcsimulation.h \
+    $$PWD/scene/npcspawner.h \
     $$PWD/scene/npcs/lama.h \
     $$PWD/scene/npcs/sheep.h \
     $$PWD/scene/npcs/steve.h \
     $$PWD/scene/npcs/zombiedragon.h \
     $$PWD/scene/pathfinder.h \
+    $$PWD/scene/pathfindingservice.h \
     $$PWD/scene/quad.h \
+    $$PWD/scene/random.h \
+    $$PWD/scene/regionstore.h \
     $$PWD/scene/text.h \
+    $$PWD/scene/voxelsweep.h \
+    $$PWD/scene/treetemplate.h \
     $$PWD/scene/widget.h \
+    $$PWD/scene/zoneheightmap.h \
+    $$PWD/scene/zonefeatures.h \
     $$PWD/shaderprogram.h \
+    $$PWD/particlesystem.h \
+    $$PWD/postnoise.h \
+    $$PWD/shadowmap.h \
+    $$PWD/transparencybuffer.h \
+    $$PWD/temporalupsampler.h \
     $$PWD/drawable.h \
+    $$PWD/farfield.h \
     $$PWD/cameracontrolshelp.h \
+    $$PWD/chunkbufferpool.h \
+    $$PWD/chunkmesharena.h \
+    $$PWD/chunkmultidraw.h \
+    $$PWD/chunkcomputemesher.h \
     $$PWD/scene/cube.h \
+    $$PWD/scene/distantterrain.h \
     $$PWD/openglcontext.h \
+    $$PWD/renderbackend.h \
     $$PWD/scene/terrain.h \
+    $$PWD/scene/terrainraycast.h \
+    $$PWD/terraincompute.h \
+    $$PWD/terrainjobs.h \
+    $$PWD/threadaffinity.h \
+    $$PWD/threadconfig.h \
     $$PWD/scene/worldaxes.h \
     $$PWD/smartpointerhelp.h \
     $$PWD/glm_includes.h \
+    $$PWD/scene/editjournal.h \
     $$PWD/scene/entity.h \
+    $$PWD/scene/entitygrid.h \
+    $$PWD/scene/frustum.h \
     $$PWD/scene/player.h \
     $$PWD/scene/camera.h \
     $$PWD/playerinfo.h \
+    $$PWD/lineararena.h \
+    $$PWD/memorystats.h \
+    $$PWD/profiler.h \
+    $$PWD/qualitycontroller.h \
     $$PWD/scene/chunk.h \
+    $$PWD/scene/chunkdrawable.h \
+    $$PWD/scene/chunkheatmap.h \
+    $$PWD/scene/chunkstreamer.h \
+    $$PWD/netprotocol.h \
+    $$PWD/netserver.h \
+    $$PWD/servermetrics.h \
+    $$PWD/netclient.h \
     $$PWD/texture.h \
     $$PWD/utils.h
 
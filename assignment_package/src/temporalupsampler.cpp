@@ -0,0 +1,113 @@
+#include "temporalupsampler.h"
+#include <algorithm>
+
+TemporalUpsampler::TemporalUpsampler(OpenGLContext *context)
+    : mp_context(context), m_history{{FrameBuffer(context, 1, 1, 1), FrameBuffer(context, 1, 1, 1)}},
+      m_current(0), m_historyValid(false), m_lastViewProj(1.f), m_jitterPixels(0.f), m_jitterClip(0.f),
+      m_frame(0), m_created(false)
+{
+    for (FrameBuffer &history : m_history) {
+        history.setDepth(false);
+    }
+}
+
+void TemporalUpsampler::create(unsigned int width, unsigned int height, unsigned int devicePixelRatio)
+{
+    destroy();
+    m_created = true;
+    for (FrameBuffer &history : m_history) {
+        history.resize(width, height, devicePixelRatio);
+        history.create();
+        m_created = m_created && history.isCreated();
+    }
+    if (!m_created) {
+        destroy();
+    }
+}
+
+void TemporalUpsampler::destroy()
+{
+    for (FrameBuffer &history : m_history) {
+        history.destroy();
+    }
+    m_created = false;
+    m_historyValid = false;
+}
+
+bool TemporalUpsampler::isCreated() const
+{
+    return m_created;
+}
+
+void TemporalUpsampler::invalidate()
+{
+    m_historyValid = false;
+}
+
+// The radical inverse of i in the given base, in [0, 1)
+static float halton(unsigned int i, unsigned int base)
+{
+    float result = 0.f;
+    float fraction = 1.f / base;
+    for (; i > 0; i /= base) {
+        result += fraction * (i % base);
+        fraction /= base;
+    }
+    return result;
+}
+
+/**
+ * @brief TemporalUpsampler::beginFrame
+ *  The offsets follow the Halton (2, 3) sequence, which covers a pixel
+ *  evenly however many of them are taken. A screen pixel is 1 / scale of
+ *  a scaled one across, so each screen pixel gets a sample near its
+ *  center once in about 1 / scale^2 frames: the cycle is 8 times that.
+ */
+glm::vec2 TemporalUpsampler::beginFrame(unsigned int targetWidth, unsigned int targetHeight)
+{
+    const FrameBuffer &output = m_history[m_current];
+    float scale = std::min(1.f, static_cast<float>(targetWidth) / output.pixelWidth());
+    int phases = std::min(maxPhases, static_cast<int>(8.f / (scale * scale) + 0.5f));
+    // 1-based: index 0 of the sequence is the corner
+    unsigned int phase = m_frame++ % phases + 1;
+    m_jitterPixels = glm::vec2(halton(phase, 2), halton(phase, 3)) - 0.5f;
+    m_jitterClip = 2.f * m_jitterPixels / glm::vec2(targetWidth, targetHeight);
+    return m_jitterClip;
+}
+
+/**
+ * @brief TemporalUpsampler::resolve
+ *  The output pixels reproject by their own center, unjittered, and the
+ *  depth of the nearest new sample; the last view-projection is kept
+ *  unjittered to match.
+ */
+void TemporalUpsampler::resolve(FrameBuffer &scene, ShaderProgram &program, Drawable &quad, const glm::mat4 &viewProj,
+                                unsigned int resultSlot)
+{
+    glm::mat4 unjitter(1.f);
+    unjitter[3][0] = -m_jitterClip.x;
+    unjitter[3][1] = -m_jitterClip.y;
+    glm::mat4 unjittered = unjitter * viewProj;
+
+    FrameBuffer &output = m_history[m_current];
+    FrameBuffer &last = m_history[1 - m_current];
+    output.bindFrameBuffer();
+    mp_context->glViewport(0, 0, output.pixelWidth(), output.pixelHeight());
+    scene.bindToTextureSlot(resultSlot);
+    scene.bindDepthToTextureSlot(depthTextureSlot);
+    last.bindToTextureSlot(historyTextureSlot);
+
+    program.setTexture(resultSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_Depth"), depthTextureSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_History"), historyTextureSlot);
+    mp_context->glUniform1i(program.uniformLocation("u_HistoryValid"), m_historyValid ? 1 : 0);
+    mp_context->glUniform2f(program.uniformLocation("u_Jitter"), m_jitterPixels.x, m_jitterPixels.y);
+    glm::mat4 reproject = m_lastViewProj * glm::inverse(unjittered);
+    mp_context->glUniformMatrix4fv(program.uniformLocation("u_Reproject"), 1, GL_FALSE, &reproject[0][0]);
+    program.drawOverlay(quad);
+
+    output.bindToTextureSlot(resultSlot);
+    m_lastViewProj = unjittered;
+    m_historyValid = true;
+    m_current = 1 - m_current;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include "drawable.h"
+#include "framebuffer.h"
+#include "glm_includes.h"
+#include "openglcontext.h"
+#include "shaderprogram.h"
+#include <array>
+
+// Upsamples the scene from its render scale to the screen by accumulating
+// frames rather than filtering one: every frame the camera is shifted by
+// a different subpixel offset (Camera::setJitter), so over a few frames
+// the scaled buffer samples many spots of each screen pixel. The resolve
+// (glsl/post/temporal.frag.glsl) reprojects the last output through the
+// scene's depth and the last view-projection, clamps it to the colors
+// around the new sample to drop what moved or came into view, and blends
+// in the new sample by how close it fell to the pixel's center. The
+// output is kept at the screen's size in one of two FrameBuffers, the
+// other holding the last frame's.
+// Main thread only, with the context current.
+class TemporalUpsampler {
+public:
+    // the texture units the resolve reads the history and the scene's depth from
+    static const int historyTextureSlot = 7;
+    static const int depthTextureSlot = 16;
+    // the jitter offsets cycled through, at most; fewer at scales near 1
+    static const int maxPhases = 32;
+
+private:
+    OpenGLContext *mp_context;
+    std::array<FrameBuffer, 2> m_history;
+    // the one the next resolve writes; the other holds the last output
+    int m_current;
+    // whether the other one holds an output to reproject
+    bool m_historyValid;
+    // the view-projection the last output was resolved with, unjittered
+    glm::mat4 m_lastViewProj;
+    // this frame's offset, in pixels of the scaled buffer and in clip space
+    glm::vec2 m_jitterPixels;
+    glm::vec2 m_jitterClip;
+    unsigned int m_frame;
+    bool m_created;
+
+public:
+    explicit TemporalUpsampler(OpenGLContext *context);
+
+    TemporalUpsampler(const TemporalUpsampler&) = delete;
+    TemporalUpsampler &operator=(const TemporalUpsampler&) = delete;
+
+    // (Re)create the history at the screen's size, dropping what it held
+    void create(unsigned int width, unsigned int height, unsigned int devicePixelRatio);
+    void destroy();
+    bool isCreated() const;
+    // Forget the history, for a cut the reprojection cannot follow; the
+    // next resolve shows the new frame alone
+    void invalidate();
+
+    // The offset of the next frame rendered at targetWidth x targetHeight
+    // pixels, for Camera::setJitter
+    glm::vec2 beginFrame(unsigned int targetWidth, unsigned int targetHeight);
+    // Resolve the scene, rendered with viewProj (jittered by the offset
+    // beginFrame gave) into scene, with program; the output is left bound
+    // to resultSlot, which the scene is read from too
+    void resolve(FrameBuffer &scene, ShaderProgram &program, Drawable &quad, const glm::mat4 &viewProj,
+                 unsigned int resultSlot);
+};
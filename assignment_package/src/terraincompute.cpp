@@ -0,0 +1,221 @@
+#include "terraincompute.h"
+#include <QFile>
+#include <QTextStream>
+#include <QOpenGLContext>
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iostream>
+
+TerrainComputeBackend::TerrainComputeBackend(OpenGLContext *context)
+    : mp_context(context),
+      m_heightProgram(0), m_caveProgram(0),
+      m_unifHeightZoneCorner(-1), m_unifCaveZoneCorner(-1),
+      m_created(false), m_pendingZones()
+{}
+
+TerrainComputeBackend::~TerrainComputeBackend()
+{}
+
+/**
+ * @brief TerrainComputeBackend::create
+ * @param noise : its gradient hash and permutation table are uploaded
+ * @return whether the backend can be used
+ */
+bool TerrainComputeBackend::create(const Noise &noise)
+{
+    QSurfaceFormat format = mp_context->context()->format();
+    if (format.version() < qMakePair(4, 3)) {
+        std::cout << "Compute terrain backend needs GL 4.3, context is "
+                  << format.majorVersion() << "." << format.minorVersion() << std::endl;
+        return false;
+    }
+
+    QString source;
+    QFile file(":/glsl/terraingen.comp.glsl");
+    if (file.open(QFile::ReadOnly)) {
+        QTextStream in(&file);
+        source = in.readAll();
+    }
+    if (source.isEmpty()) {
+        return false;
+    }
+
+    m_heightProgram = compileProgram(source, "");
+    m_caveProgram   = compileProgram(source, "#define TERRAINGEN_CAVES\n");
+    if (m_heightProgram == 0 || m_caveProgram == 0) {
+        destroy();
+        return false;
+    }
+
+    m_unifHeightZoneCorner = mp_context->glGetUniformLocation(m_heightProgram, "u_ZoneCorner");
+    m_unifCaveZoneCorner   = mp_context->glGetUniformLocation(m_caveProgram, "u_ZoneCorner");
+
+    // the height pass is the only one using the 2D gradients
+    std::array<GLint, 512> permutation;
+    std::copy(noise.getPermutation().begin(), noise.getPermutation().end(), permutation.begin());
+    mp_context->useProgram(m_heightProgram);
+    mp_context->glUniform1i(mp_context->glGetUniformLocation(m_heightProgram, "u_GradientHash"),
+                            noise.getGradientHash() == GradientHash::permutation ? 1 : 0);
+    mp_context->glUniform1iv(mp_context->glGetUniformLocation(m_heightProgram, "u_Permutation"),
+                             512, permutation.data());
+    mp_context->useProgram(0);
+
+    m_created = true;
+    return true;
+}
+
+/**
+ * @brief TerrainComputeBackend::compileProgram
+ * @param source  : the shader text, starting with its #version line
+ * @param defines : inserted right after the #version line
+ * @return the linked program, or 0 on failure
+ */
+GLuint TerrainComputeBackend::compileProgram(const QString &source, const char *defines)
+{
+    int versionEnd = source.indexOf('\n') + 1;
+    std::string text = (source.left(versionEnd) + defines + source.mid(versionEnd)).toStdString();
+    const char *textPtr = text.c_str();
+
+    GLuint shader = mp_context->glCreateShader(GL_COMPUTE_SHADER);
+    mp_context->glShaderSource(shader, 1, &textPtr, 0);
+    mp_context->glCompileShader(shader);
+
+    GLint compiled;
+    mp_context->glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        mp_context->printShaderInfoLog(shader);
+        mp_context->glDeleteShader(shader);
+        return 0;
+    }
+
+    GLuint prog = mp_context->glCreateProgram();
+    mp_context->glAttachShader(prog, shader);
+    mp_context->glLinkProgram(prog);
+    // the program keeps the compiled code
+    mp_context->glDeleteShader(shader);
+
+    GLint linked;
+    mp_context->glGetProgramiv(prog, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        mp_context->printLinkInfoLog(prog);
+        mp_context->glDeleteProgram(prog);
+        return 0;
+    }
+    return prog;
+}
+
+void TerrainComputeBackend::destroy()
+{
+    for (PendingZone &zone : m_pendingZones) {
+        mp_context->glDeleteSync(zone.fence);
+        mp_context->glDeleteBuffers(1, &zone.heightBuffer);
+        mp_context->glDeleteBuffers(1, &zone.caveBuffer);
+    }
+    m_pendingZones.clear();
+
+    if (m_heightProgram != 0) {
+        mp_context->glDeleteProgram(m_heightProgram);
+        m_heightProgram = 0;
+    }
+    if (m_caveProgram != 0) {
+        mp_context->glDeleteProgram(m_caveProgram);
+        m_caveProgram = 0;
+    }
+    m_created = false;
+}
+
+bool TerrainComputeBackend::isCreated() const
+{
+    return m_created;
+}
+
+bool TerrainComputeBackend::hasPendingZones() const
+{
+    return !m_pendingZones.empty();
+}
+
+/**
+ * @brief TerrainComputeBackend::submitZone
+ * @param xCorner
+ * @param zCorner
+ */
+void TerrainComputeBackend::submitZone(int xCorner, int zCorner)
+{
+    PendingZone zone;
+    zone.xCorner = xCorner;
+    zone.zCorner = zCorner;
+
+    int caveHeight = caveMaxY - caveMinY;
+
+    mp_context->glGenBuffers(1, &zone.heightBuffer);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, zone.heightBuffer);
+    mp_context->glBufferData(GL_SHADER_STORAGE_BUFFER, zoneSize * zoneSize * sizeof(GLint),
+                             nullptr, GL_STREAM_READ);
+
+    mp_context->glGenBuffers(1, &zone.caveBuffer);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, zone.caveBuffer);
+    mp_context->glBufferData(GL_SHADER_STORAGE_BUFFER, zoneSize * caveHeight * zoneSize * sizeof(GLfloat),
+                             nullptr, GL_STREAM_READ);
+
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, zone.heightBuffer);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, zone.caveBuffer);
+
+    // work groups are 8 x 4 x 8 invocations
+    mp_context->useProgram(m_heightProgram);
+    mp_context->glUniform2i(m_unifHeightZoneCorner, xCorner, zCorner);
+    mp_context->glDispatchCompute(zoneSize / 8, 1, zoneSize / 8);
+
+    mp_context->useProgram(m_caveProgram);
+    mp_context->glUniform2i(m_unifCaveZoneCorner, xCorner, zCorner);
+    mp_context->glDispatchCompute(zoneSize / 8, (caveHeight + 3) / 4, zoneSize / 8);
+
+    mp_context->glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    zone.fence = mp_context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0);
+    mp_context->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, 0);
+    mp_context->useProgram(0);
+
+    m_pendingZones.push_back(zone);
+}
+
+template <typename T>
+void TerrainComputeBackend::readBuffer(GLuint buffer, std::vector<T> &out, int count)
+{
+    out.resize(count);
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    void *data = mp_context->glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(T), GL_MAP_READ_BIT);
+    if (data != nullptr) {
+        std::memcpy(out.data(), data, count * sizeof(T));
+        mp_context->glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    mp_context->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+/**
+ * @brief TerrainComputeBackend::collectFinishedZones
+ * @param out : the finished zones are appended here
+ */
+void TerrainComputeBackend::collectFinishedZones(std::vector<uPtr<ZoneComputeResult>> &out)
+{
+    for (auto it = m_pendingZones.begin(); it != m_pendingZones.end();) {
+        GLenum status = mp_context->glClientWaitSync(it->fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            ++it;
+            continue;
+        }
+
+        uPtr<ZoneComputeResult> result = mkU<ZoneComputeResult>();
+        result->xCorner = it->xCorner;
+        result->zCorner = it->zCorner;
+        readBuffer(it->heightBuffer, result->heights, zoneSize * zoneSize);
+        readBuffer(it->caveBuffer, result->caveDensities, zoneSize * (caveMaxY - caveMinY) * zoneSize);
+        out.push_back(std::move(result));
+
+        mp_context->glDeleteSync(it->fence);
+        mp_context->glDeleteBuffers(1, &it->heightBuffer);
+        mp_context->glDeleteBuffers(1, &it->caveBuffer);
+        it = m_pendingZones.erase(it);
+    }
+}
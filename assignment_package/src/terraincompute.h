@@ -0,0 +1,69 @@
+#pragma once
+#include "openglcontext.h"
+#include "smartpointerhelp.h"
+#include "scene/noise.h"
+#include <vector>
+
+// Output of the compute backend for one terrain generation zone
+struct ZoneComputeResult
+{
+    int xCorner;
+    int zCorner;
+    // surface heights, [x + 64 * z] relative to the corner
+    std::vector<int> heights;
+    // cave densities for y in [1, 125), [x + 64 * (y - 1) + 64 * 124 * z]
+    std::vector<float> caveDensities;
+};
+
+// An optional generation backend that evaluates the surface height blend
+// and the cave density of whole zones in a compute shader (glsl/terraingen.comp.glsl).
+// It needs a GL 4.3 context, so it lives on the main thread: zones are
+// dispatched by submitZone() and read back by collectFinishedZones() once
+// their fence has signaled, so the frame never stalls on the GPU.
+// The GPU's float sin() and cos() differ from the CPU's, so a world generated with
+// this backend is deterministic per device but not identical to the CPU path.
+class TerrainComputeBackend {
+private:
+    // a dispatched zone waiting for its results
+    struct PendingZone
+    {
+        int xCorner;
+        int zCorner;
+        GLuint heightBuffer;
+        GLuint caveBuffer;
+        GLsync fence;
+    };
+
+    OpenGLContext *mp_context;
+    GLuint m_heightProgram;
+    GLuint m_caveProgram;
+    GLint m_unifHeightZoneCorner;
+    GLint m_unifCaveZoneCorner;
+    bool m_created;
+
+    std::vector<PendingZone> m_pendingZones;
+
+    GLuint compileProgram(const QString &source, const char *defines);
+    template <typename T>
+    void readBuffer(GLuint buffer, std::vector<T> &out, int count);
+
+public:
+    static const int zoneSize   = 64;
+    static const int caveMinY   = 1;
+    static const int caveMaxY   = 125;
+
+    TerrainComputeBackend(OpenGLContext *context);
+    ~TerrainComputeBackend();
+
+    // Compile the compute programs for the gradients of `noise`. Returns false
+    // (and stays unusable) when the context is older than GL 4.3 or compilation fails.
+    bool create(const Noise &noise);
+    void destroy();
+    bool isCreated() const;
+
+    // dispatch both passes for the zone whose corner is (xCorner, zCorner)
+    void submitZone(int xCorner, int zCorner);
+    // append the zones whose results are ready; never blocks
+    void collectFinishedZones(std::vector<uPtr<ZoneComputeResult>> &out);
+    bool hasPendingZones() const;
+};
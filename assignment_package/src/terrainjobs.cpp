@@ -0,0 +1,582 @@
+#include "terrainjobs.h"
+#include "lineararena.h"
+#include "threadaffinity.h"
+#include <algorithm>
+#ifdef Q_OS_LINUX
+#include <time.h>
+#endif
+
+TerrainJob::~TerrainJob()
+{}
+
+void TerrainJob::cancel()
+{}
+
+bool TerrainJob::getFocus(glm::vec2&) const
+{
+    return false;
+}
+
+/**
+ * @brief threadCpuNs
+ *  Where the system has no per-thread CPU clock, a job's wall time stands
+ *  in for its CPU time.
+ * @param wallClock
+ * @return the calling thread's CPU time in ns
+ */
+static qint64 threadCpuNs(const QElapsedTimer &wallClock)
+{
+#ifdef Q_OS_LINUX
+    timespec time;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+        return static_cast<qint64>(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+#endif
+    return wallClock.nsecsElapsed();
+}
+
+TerrainJobPool::TerrainJobPool(int threadCount)
+    : m_lock(), m_workAvailable(), m_jobFinished(),
+      m_slotBlocks(), m_freeSlots(),
+      m_clients(), m_runningCounts(), m_clock(),
+      m_threadLimits(), m_nextSequence(1), m_nextServed(1),
+      m_threads(), m_threadTarget(0), m_cores(), m_coresVersion(0)
+{
+    m_runningCounts.fill(0);
+    m_clock.start();
+    m_threadLimits.fill(0);
+    if (threadCount <= 0) {
+        threadCount = std::max(1, QThread::idealThreadCount() - 1);
+    }
+    setThreadCount(threadCount);
+}
+
+TerrainJobPool::~TerrainJobPool()
+{
+    setThreadCount(0);
+}
+
+TerrainJobPool::Client *TerrainJobPool::addClient()
+{
+    uPtr<Client> client = mkU<Client>();
+    client->queuedCounts.fill(0);
+    client->runningCounts.fill(0);
+    client->stats.fill(TerrainJobStats{0, 0, 0, 0, 0, 0, 0});
+    client->lastServed = 0;
+    m_lock.lock();
+    m_clients.push_back(std::move(client));
+    Client *added = m_clients.back().get();
+    m_lock.unlock();
+    return added;
+}
+
+void TerrainJobPool::removeClient(Client *client)
+{
+    m_lock.lock();
+    m_clients.erase(std::find_if(m_clients.begin(), m_clients.end(),
+                                 [client](const uPtr<Client> &owned) { return owned.get() == client; }));
+    m_lock.unlock();
+}
+
+/**
+ * @brief TerrainJobPool::acquireSlot
+ *  A free slot, growing the pool by a block when there is none.
+ * @return
+ */
+TerrainJobPool::Slot *TerrainJobPool::acquireSlot()
+{
+    m_lock.lock();
+    if (m_freeSlots.empty()) {
+        uint32_t first = static_cast<uint32_t>(m_slotBlocks.size() * slotsPerBlock);
+        m_slotBlocks.push_back(uPtr<Slot[]>(new Slot[slotsPerBlock]));
+        Slot *block = m_slotBlocks.back().get();
+        // handed out from the back, lowest index first
+        for (size_t i = slotsPerBlock; i-- > 0;) {
+            block[i].job = nullptr;
+            block[i].generation = 0;
+            block[i].index = first + static_cast<uint32_t>(i);
+            block[i].state = SlotState::free;
+            block[i].queue = TerrainJobQueue::generation;
+            block[i].client = nullptr;
+            block[i].queuedAt = 0;
+            m_freeSlots.push_back(&block[i]);
+        }
+    }
+    Slot *slot = m_freeSlots.back();
+    m_freeSlots.pop_back();
+    m_lock.unlock();
+    return slot;
+}
+
+float TerrainJobPool::urgencyOf(const Client *client, const TerrainJob *job)
+{
+    glm::vec2 focus;
+    if (!client->urgency || !job->getFocus(focus)) {
+        return 0.f;
+    }
+    return client->urgency(focus);
+}
+
+/**
+ * @brief TerrainJobPool::enqueue
+ *  The urgency is taken outside the lock: only the client's own thread
+ *  sets it.
+ * @param client
+ * @param slot : holding the constructed job
+ * @param queue
+ * @param priority
+ * @return the job's id: the slot's index and generation
+ */
+TerrainJobId TerrainJobPool::enqueue(Client *client, Slot *slot, TerrainJobQueue queue, int priority)
+{
+    int q = static_cast<int>(queue);
+    bool io = queue == TerrainJobQueue::io;
+    // the I/O queue stays in submission order
+    float urgency = io ? 0.f : urgencyOf(client, slot->job);
+    m_lock.lock();
+    slot->state = SlotState::queued;
+    slot->queue = queue;
+    slot->client = client;
+    slot->queuedAt = m_clock.nsecsElapsed();
+    std::vector<QueuedJob> &heap = client->queues[q];
+    heap.push_back({io ? 0 : priority, urgency, m_nextSequence++, slot});
+    std::push_heap(heap.begin(), heap.end(), isLowerPriority);
+    client->queuedCounts[q]++;
+    TerrainJobId id = (static_cast<uint64_t>(slot->generation) << 32) | slot->index;
+    m_lock.unlock();
+    m_workAvailable.wakeOne();
+    return id + 1;
+}
+
+bool TerrainJobPool::isLowerPriority(const QueuedJob &a, const QueuedJob &b)
+{
+    if (a.priority != b.priority) {
+        return a.priority < b.priority;
+    }
+    if (a.urgency != b.urgency) {
+        return a.urgency < b.urgency;
+    }
+    return a.sequence > b.sequence;
+}
+
+void TerrainJobPool::pruneQueue(std::vector<QueuedJob> &heap)
+{
+    while (!heap.empty() && heap.front().slot->state == SlotState::cancelled) {
+        Slot *slot = heap.front().slot;
+        std::pop_heap(heap.begin(), heap.end(), isLowerPriority);
+        heap.pop_back();
+        releaseSlot(slot);
+    }
+}
+
+int TerrainJobPool::bestQueue(const Client *client) const
+{
+    int best = -1;
+    for (TerrainJobQueue queue : {TerrainJobQueue::generation, TerrainJobQueue::meshing}) {
+        int q = static_cast<int>(queue);
+        bool atLimit = m_threadLimits[q] > 0 && m_runningCounts[q] >= m_threadLimits[q];
+        if (!client->queues[q].empty() && !atLimit
+                && (best == -1 || isLowerPriority(client->queues[best].front(), client->queues[q].front()))) {
+            best = q;
+        }
+    }
+    return best;
+}
+
+TerrainJobPool::Slot *TerrainJobPool::popQueue(Client *client, int queue)
+{
+    std::vector<QueuedJob> &heap = client->queues[queue];
+    Slot *slot = heap.front().slot;
+    std::pop_heap(heap.begin(), heap.end(), isLowerPriority);
+    heap.pop_back();
+    slot->state = SlotState::running;
+    client->queuedCounts[queue]--;
+    client->runningCounts[queue]++;
+    client->lastServed = m_nextServed++;
+    m_runningCounts[queue]++;
+    return slot;
+}
+
+/**
+ * @brief TerrainJobPool::takeNext
+ *  The oldest I/O job of the worlds running none first; then the best
+ *  generation or meshing job of the world with the fewest of them
+ *  running, the one served longest ago among equals.
+ * @return
+ */
+TerrainJobPool::Slot *TerrainJobPool::takeNext()
+{
+    int io = static_cast<int>(TerrainJobQueue::io);
+    Client *ioClient = nullptr;
+    Client *fairest = nullptr;
+    int fairestQueue = -1, fairestRunning = 0;
+    for (const uPtr<Client> &owned : m_clients) {
+        Client *client = owned.get();
+        for (std::vector<QueuedJob> &heap : client->queues) {
+            pruneQueue(heap);
+        }
+        const std::vector<QueuedJob> &ioHeap = client->queues[io];
+        if (!ioHeap.empty() && client->runningCounts[io] == 0
+                && (ioClient == nullptr || ioHeap.front().sequence < ioClient->queues[io].front().sequence)) {
+            ioClient = client;
+        }
+        int q = bestQueue(client);
+        if (q == -1) {
+            continue;
+        }
+        int running = client->runningCounts[static_cast<int>(TerrainJobQueue::generation)]
+                + client->runningCounts[static_cast<int>(TerrainJobQueue::meshing)];
+        if (fairest == nullptr || running < fairestRunning
+                || (running == fairestRunning && client->lastServed < fairest->lastServed)) {
+            fairest = client;
+            fairestQueue = q;
+            fairestRunning = running;
+        }
+    }
+    if (ioClient != nullptr) {
+        return popQueue(ioClient, io);
+    }
+    if (fairest != nullptr) {
+        return popQueue(fairest, fairestQueue);
+    }
+    return nullptr;
+}
+
+void TerrainJobPool::cancelSlot(Slot *slot)
+{
+    slot->job->cancel();
+    slot->job->~TerrainJob();
+    slot->job = nullptr;
+    slot->state = SlotState::cancelled;
+    slot->client->queuedCounts[static_cast<int>(slot->queue)]--;
+    slot->client->stats[static_cast<int>(slot->queue)].cancelled++;
+}
+
+void TerrainJobPool::releaseSlot(Slot *slot)
+{
+    slot->job = nullptr;
+    slot->client = nullptr;
+    slot->generation++;
+    slot->state = SlotState::free;
+    m_freeSlots.push_back(slot);
+}
+
+TerrainJobPool::Slot *TerrainJobPool::findSlot(TerrainJobId id)
+{
+    if (id == 0) {
+        return nullptr;
+    }
+    id -= 1;
+    size_t index = static_cast<size_t>(id & 0xFFFFFFFFu);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index >= m_slotBlocks.size() * slotsPerBlock) {
+        return nullptr;
+    }
+    Slot *slot = &m_slotBlocks[index / slotsPerBlock][index % slotsPerBlock];
+    return slot->generation == generation ? slot : nullptr;
+}
+
+/**
+ * @brief TerrainJobPool::workerLoop
+ * @param index : of the thread in m_threads
+ */
+void TerrainJobPool::workerLoop(int index)
+{
+    uint64_t coresVersion = 0;
+    m_lock.lock();
+    while (index < m_threadTarget) {
+        if (coresVersion != m_coresVersion) {
+            coresVersion = m_coresVersion;
+            pinCurrentThread(m_cores);
+        }
+        Slot *slot = takeNext();
+        if (slot == nullptr) {
+            m_workAvailable.wait(&m_lock);
+            continue;
+        }
+        qint64 waited = m_clock.nsecsElapsed() - slot->queuedAt;
+        m_lock.unlock();
+
+        qint64 started = threadCpuNs(m_clock);
+        {
+            // the job's temporaries, given back as it ends
+            LinearArena::Scope jobScratch(LinearArena::local());
+            slot->job->run();
+            slot->job->~TerrainJob();
+        }
+        qint64 cpu = threadCpuNs(m_clock) - started;
+
+        m_lock.lock();
+        int q = static_cast<int>(slot->queue);
+        Client *client = slot->client;
+        client->runningCounts[q]--;
+        m_runningCounts[q]--;
+        TerrainJobStats &stats = client->stats[q];
+        stats.completed++;
+        stats.waitNs += waited;
+        stats.cpuNs += cpu;
+        stats.maxCpuNs = std::max(stats.maxCpuNs, cpu);
+        // the next I/O job, or one of a queue that was at its limit, may run now
+        bool limited = slot->queue == TerrainJobQueue::io || m_threadLimits[q] > 0;
+        releaseSlot(slot);
+        m_jobFinished.wakeAll();
+        if (limited) {
+            m_workAvailable.wakeOne();
+        }
+    }
+    m_lock.unlock();
+}
+
+void TerrainJobPool::setThreadCount(int threadCount)
+{
+    threadCount = std::max(0, threadCount);
+    int current = static_cast<int>(m_threads.size());
+
+    m_lock.lock();
+    m_threadTarget = threadCount;
+    m_lock.unlock();
+
+    if (threadCount > current) {
+        for (int i = current; i < threadCount; i++) {
+            m_threads.push_back(uPtr<QThread>(QThread::create([this, i]() { workerLoop(i); })));
+            m_threads.back()->start();
+        }
+        return;
+    }
+
+    m_workAvailable.wakeAll();
+    for (int i = threadCount; i < current; i++) {
+        m_threads[i]->wait();
+    }
+    m_threads.resize(threadCount);
+}
+
+int TerrainJobPool::threadCount() const
+{
+    return static_cast<int>(m_threads.size());
+}
+
+void TerrainJobPool::setThreadLimit(TerrainJobQueue queue, int threads)
+{
+    m_lock.lock();
+    if (queue != TerrainJobQueue::io) {
+        m_threadLimits[static_cast<int>(queue)] = std::max(0, threads);
+    }
+    m_lock.unlock();
+    // a raised limit frees queued jobs
+    m_workAvailable.wakeAll();
+}
+
+int TerrainJobPool::threadLimit(TerrainJobQueue queue)
+{
+    m_lock.lock();
+    int limit = queue == TerrainJobQueue::io ? 1 : m_threadLimits[static_cast<int>(queue)];
+    m_lock.unlock();
+    return limit;
+}
+
+/**
+ * @brief TerrainJobPool::setCores
+ *  A thread waiting for work is woken to pin itself; a busy one pins
+ *  before taking its next job.
+ * @param cores
+ */
+void TerrainJobPool::setCores(std::vector<int> cores)
+{
+    m_lock.lock();
+    m_cores = std::move(cores);
+    m_coresVersion++;
+    m_lock.unlock();
+    m_workAvailable.wakeAll();
+}
+
+int TerrainJobPool::clientCount() const
+{
+    m_lock.lock();
+    int count = static_cast<int>(m_clients.size());
+    m_lock.unlock();
+    return count;
+}
+
+TerrainJobSystem::TerrainJobSystem(int threadCount)
+    : TerrainJobSystem(mkS<TerrainJobPool>(threadCount))
+{}
+
+TerrainJobSystem::TerrainJobSystem(sPtr<TerrainJobPool> pool)
+    : m_pool(std::move(pool)), mp_client(m_pool->addClient())
+{}
+
+TerrainJobSystem::~TerrainJobSystem()
+{
+    for (int q = 0; q < queueCount; q++) {
+        cancelAll(static_cast<TerrainJobQueue>(q));
+    }
+    waitForDone();
+    m_pool->removeClient(mp_client);
+}
+
+/**
+ * @brief TerrainJobSystem::cancel
+ *  An id of another world's job, its slot reused, is not this world's to
+ *  cancel.
+ */
+bool TerrainJobSystem::cancel(TerrainJobId id)
+{
+    TerrainJobPool &pool = *m_pool;
+    pool.m_lock.lock();
+    TerrainJobPool::Slot *slot = pool.findSlot(id);
+    bool cancelled = slot != nullptr && slot->state == TerrainJobPool::SlotState::queued
+            && slot->client == mp_client;
+    if (cancelled) {
+        pool.cancelSlot(slot);
+    }
+    pool.m_lock.unlock();
+    if (cancelled) {
+        pool.m_jobFinished.wakeAll();
+    }
+    return cancelled;
+}
+
+bool TerrainJobSystem::cancelGroup(const std::vector<TerrainJobId> &ids)
+{
+    TerrainJobPool &pool = *m_pool;
+    pool.m_lock.lock();
+    bool allQueued = !ids.empty();
+    for (TerrainJobId id : ids) {
+        TerrainJobPool::Slot *slot = pool.findSlot(id);
+        allQueued = allQueued && slot != nullptr && slot->state == TerrainJobPool::SlotState::queued
+                && slot->client == mp_client;
+    }
+    if (allQueued) {
+        for (TerrainJobId id : ids) {
+            pool.cancelSlot(pool.findSlot(id));
+        }
+    }
+    pool.m_lock.unlock();
+    if (allQueued) {
+        pool.m_jobFinished.wakeAll();
+    }
+    return allQueued;
+}
+
+bool TerrainJobSystem::isQueued(TerrainJobId id)
+{
+    TerrainJobPool &pool = *m_pool;
+    pool.m_lock.lock();
+    TerrainJobPool::Slot *slot = pool.findSlot(id);
+    bool queued = slot != nullptr && slot->state == TerrainJobPool::SlotState::queued && slot->client == mp_client;
+    pool.m_lock.unlock();
+    return queued;
+}
+
+void TerrainJobSystem::cancelAll(TerrainJobQueue queue)
+{
+    TerrainJobPool &pool = *m_pool;
+    std::vector<TerrainJobPool::QueuedJob> &heap = mp_client->queues[static_cast<int>(queue)];
+    pool.m_lock.lock();
+    for (const TerrainJobPool::QueuedJob &queued : heap) {
+        if (queued.slot->state == TerrainJobPool::SlotState::queued) {
+            pool.cancelSlot(queued.slot);
+        }
+        pool.releaseSlot(queued.slot);
+    }
+    heap.clear();
+    pool.m_lock.unlock();
+    pool.m_jobFinished.wakeAll();
+}
+
+void TerrainJobSystem::setUrgency(std::function<float(glm::vec2)> urgency)
+{
+    m_pool->m_lock.lock();
+    mp_client->urgency = std::move(urgency);
+    m_pool->m_lock.unlock();
+    reprioritize();
+}
+
+void TerrainJobSystem::reprioritize()
+{
+    m_pool->m_lock.lock();
+    for (TerrainJobQueue queue : {TerrainJobQueue::generation, TerrainJobQueue::meshing}) {
+        std::vector<TerrainJobPool::QueuedJob> &heap = mp_client->queues[static_cast<int>(queue)];
+        for (TerrainJobPool::QueuedJob &queued : heap) {
+            if (queued.slot->state == TerrainJobPool::SlotState::queued) {
+                queued.urgency = TerrainJobPool::urgencyOf(mp_client, queued.slot->job);
+            }
+        }
+        std::make_heap(heap.begin(), heap.end(), TerrainJobPool::isLowerPriority);
+    }
+    m_pool->m_lock.unlock();
+}
+
+void TerrainJobSystem::waitForDone(TerrainJobQueue queue)
+{
+    int q = static_cast<int>(queue);
+    TerrainJobPool &pool = *m_pool;
+    pool.m_lock.lock();
+    while (mp_client->queuedCounts[q] > 0 || mp_client->runningCounts[q] > 0) {
+        pool.m_jobFinished.wait(&pool.m_lock);
+    }
+    pool.m_lock.unlock();
+}
+
+void TerrainJobSystem::waitForDone()
+{
+    for (int q = 0; q < queueCount; q++) {
+        waitForDone(static_cast<TerrainJobQueue>(q));
+    }
+}
+
+void TerrainJobSystem::setThreadCount(int threadCount)
+{
+    m_pool->setThreadCount(threadCount);
+}
+
+int TerrainJobSystem::threadCount() const
+{
+    return m_pool->threadCount();
+}
+
+void TerrainJobSystem::setThreadLimit(TerrainJobQueue queue, int threads)
+{
+    m_pool->setThreadLimit(queue, threads);
+}
+
+int TerrainJobSystem::threadLimit(TerrainJobQueue queue)
+{
+    return m_pool->threadLimit(queue);
+}
+
+void TerrainJobSystem::setCores(std::vector<int> cores)
+{
+    m_pool->setCores(std::move(cores));
+}
+
+const sPtr<TerrainJobPool> &TerrainJobSystem::getPool() const
+{
+    return m_pool;
+}
+
+int TerrainJobSystem::pendingCount(TerrainJobQueue queue)
+{
+    m_pool->m_lock.lock();
+    int count = mp_client->queuedCounts[static_cast<int>(queue)];
+    m_pool->m_lock.unlock();
+    return count;
+}
+
+TerrainJobStats TerrainJobSystem::getStats(TerrainJobQueue queue) const
+{
+    int q = static_cast<int>(queue);
+    m_pool->m_lock.lock();
+    TerrainJobStats stats = mp_client->stats[q];
+    stats.queued = mp_client->queuedCounts[q];
+    stats.running = mp_client->runningCounts[q];
+    m_pool->m_lock.unlock();
+    return stats;
+}
+
+const char *TerrainJobSystem::getName(TerrainJobQueue queue)
+{
+    static const char *const names[queueCount] = {"generation", "meshing", "I/O"};
+    return names[static_cast<int>(queue)];
+}
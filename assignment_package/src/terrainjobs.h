@@ -0,0 +1,276 @@
+#pragma once
+#include "glm_includes.h"
+#include "smartpointerhelp.h"
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QThread>
+#include <QWaitCondition>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <utility>
+#include <vector>
+
+// A unit of terrain work: run() on a job thread, or cancel() on the
+// thread that cancels it if it is dropped before it started
+class TerrainJob
+{
+public:
+    virtual ~TerrainJob();
+    virtual void run() = 0;
+    // undo what the constructor did on the submitting thread (e.g. pins)
+    virtual void cancel();
+    // the x-z world position the job works on, if any, to rank it among
+    // the jobs of its priority; see TerrainJobSystem::setUrgency
+    virtual bool getFocus(glm::vec2 &xz) const;
+};
+
+// The kinds of terrain work, each with its own queue
+enum class TerrainJobQueue : unsigned char {
+    generation, meshing, io
+};
+
+// identifies a submitted job to cancel it; 0 is no job
+typedef uint64_t TerrainJobId;
+
+// A queue's jobs right now, and since the job system started
+struct TerrainJobStats
+{
+    int queued;
+    int running;
+    uint64_t completed;
+    uint64_t cancelled;
+    // summed over the completed jobs: the time from submit to the job
+    // starting, and the CPU time its run() took on its thread
+    qint64 waitNs;
+    qint64 cpuNs;
+    qint64 maxCpuNs;
+};
+
+class TerrainJobSystem;
+
+/**
+ * @brief The TerrainJobPool class
+ *  The threads terrain work runs on, and the slots its jobs live in, for
+ *  one world or shared by several (e.g. a server hosting a world per
+ *  seed): each world submits through a TerrainJobSystem of its own, and
+ *  only sees, cancels and waits for its own jobs.
+ *  The worlds get the threads in turn: the next thread goes to the world
+ *  running the fewest generation and meshing jobs, the one served longest
+ *  ago among equals, and only then to that world's best job; a world's
+ *  priorities and urgencies never rank it against another's. Each world's
+ *  I/O queue runs one job at a time, in submission order, ahead of the
+ *  rest.
+ *  Jobs are constructed in slots that only grow, so a job costs no
+ *  allocation of its own once the pool is warm.
+ *  setThreadCount, setThreadLimit and setCores apply to every world.
+ */
+class TerrainJobPool
+{
+public:
+    // bytes of a pool slot; every job type must fit
+    static const size_t slotSize = 256;
+    static const size_t slotsPerBlock = 64;
+    static const int queueCount = 3;
+
+private:
+    friend class TerrainJobSystem;
+
+    enum class SlotState : unsigned char {
+        free, queued, running, cancelled
+    };
+
+    struct Client;
+
+    struct Slot
+    {
+        alignas(std::max_align_t) unsigned char storage[slotSize];
+        TerrainJob *job;
+        // bumped on each reuse, so a stale id cannot cancel the next job
+        uint32_t generation;
+        uint32_t index;
+        SlotState state;
+        TerrainJobQueue queue;
+        // the world that submitted it
+        Client *client;
+        // m_clock's ns when it was submitted
+        qint64 queuedAt;
+    };
+
+    struct QueuedJob
+    {
+        int priority;
+        float urgency;
+        uint64_t sequence;
+        Slot *slot;
+    };
+
+    // One world's jobs
+    struct Client
+    {
+        // binary heaps, see isLowerPriority; cancelled jobs are skipped on pop
+        std::array<std::vector<QueuedJob>, queueCount> queues;
+        std::array<int, queueCount> queuedCounts;
+        std::array<int, queueCount> runningCounts;
+        // the counters getStats reports, but for the two above
+        std::array<TerrainJobStats, queueCount> stats;
+        // maps a job's focus to its urgency; jobs without either rank 0
+        std::function<float(glm::vec2)> urgency;
+        // m_nextServed when a thread last took one of its jobs
+        uint64_t lastServed;
+    };
+
+    // guards everything below
+    mutable QMutex m_lock;
+    QWaitCondition m_workAvailable;
+    QWaitCondition m_jobFinished;
+
+    std::vector<uPtr<Slot[]>> m_slotBlocks;
+    std::vector<Slot*> m_freeSlots;
+
+    std::vector<uPtr<Client>> m_clients;
+    // the jobs of each queue running, over every world
+    std::array<int, queueCount> m_runningCounts;
+    // times the jobs' waits
+    QElapsedTimer m_clock;
+    // threads that may run a queue's jobs at once; 0: no limit
+    std::array<int, queueCount> m_threadLimits;
+    uint64_t m_nextSequence;
+    uint64_t m_nextServed;
+
+    std::vector<uPtr<QThread>> m_threads;
+    // threads with an index at or past it exit after their current job
+    int m_threadTarget;
+    // the cores the threads run on (none: any), bumped version on change
+    std::vector<int> m_cores;
+    uint64_t m_coresVersion;
+
+    Client *addClient();
+    // its jobs must be done or cancelled
+    void removeClient(Client *client);
+
+    Slot *acquireSlot();
+    static float urgencyOf(const Client *client, const TerrainJob *job);
+    TerrainJobId enqueue(Client *client, Slot *slot, TerrainJobQueue queue, int priority);
+    // the next job to run, or null; m_lock held
+    Slot *takeNext();
+    // the better of the client's generation and meshing tops that may run
+    // now, or -1; m_lock held
+    int bestQueue(const Client *client) const;
+    Slot *popQueue(Client *client, int queue);
+    // drop the cancelled jobs off the top of the queue; m_lock held
+    void pruneQueue(std::vector<QueuedJob> &heap);
+    // the slot still holding the job, or null; m_lock held
+    Slot *findSlot(TerrainJobId id);
+    // m_lock held
+    void cancelSlot(Slot *slot);
+    void releaseSlot(Slot *slot);
+    void workerLoop(int index);
+
+    static bool isLowerPriority(const QueuedJob &a, const QueuedJob &b);
+
+public:
+    // 0 threads: one per core but the one the render thread runs on
+    explicit TerrainJobPool(int threadCount = 0);
+    // joins the threads; every TerrainJobSystem on it is gone by then
+    ~TerrainJobPool();
+
+    TerrainJobPool(const TerrainJobPool&) = delete;
+    TerrainJobPool &operator=(const TerrainJobPool&) = delete;
+
+    // grows at once; shrinking waits for the surplus threads' current jobs
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+    // Let at most `threads` threads run the queue's jobs at once, over all
+    // the worlds, so the others stay free for the other queues; 0 lifts
+    // the limit. The I/O queue is limited to one per world.
+    void setThreadLimit(TerrainJobQueue queue, int threads);
+    int threadLimit(TerrainJobQueue queue);
+    // pin the threads to the cores (none: any), each before its next job
+    void setCores(std::vector<int> cores);
+    // the worlds submitting to it
+    int clientCount() const;
+};
+
+/**
+ * @brief The TerrainJobSystem class
+ *  A world's terrain work: the Terrain owns one, on a TerrainJobPool of
+ *  its own or shared with other worlds. Generation and meshing jobs are
+ *  taken highest priority first across both queues, then most urgent
+ *  first (see setUrgency), then oldest first. The I/O queue runs one job
+ *  at a time in submission order and goes ahead of the others, as the
+ *  region store's own thread used to.
+ *  Everything but the thread settings concerns this world's jobs only.
+ *  submit, cancel, setUrgency, reprioritize and setThreadCount are main
+ *  thread only: the thread that runs this world.
+ */
+class TerrainJobSystem
+{
+public:
+    static const size_t slotSize = TerrainJobPool::slotSize;
+    static const int queueCount = TerrainJobPool::queueCount;
+
+private:
+    sPtr<TerrainJobPool> m_pool;
+    TerrainJobPool::Client *mp_client;
+
+public:
+    // on a pool of its own; 0 threads: one per core but the one the
+    // render thread runs on
+    explicit TerrainJobSystem(int threadCount = 0);
+    // on the pool, shared with the other worlds on it
+    explicit TerrainJobSystem(sPtr<TerrainJobPool> pool);
+    // cancels the queued jobs and waits for the running ones
+    ~TerrainJobSystem();
+
+    TerrainJobSystem(const TerrainJobSystem&) = delete;
+    TerrainJobSystem &operator=(const TerrainJobSystem&) = delete;
+
+    // Construct a T from args in a pool slot and queue it. Higher priorities
+    // run first; the I/O queue ignores them.
+    template <typename T, typename... Args>
+    TerrainJobId submit(TerrainJobQueue queue, int priority, Args&&... args)
+    {
+        static_assert(sizeof(T) <= slotSize, "terrain job too large for a pool slot");
+        TerrainJobPool::Slot *slot = m_pool->acquireSlot();
+        slot->job = new (slot->storage) T(std::forward<Args>(args)...);
+        return m_pool->enqueue(mp_client, slot, queue, priority);
+    }
+
+    // Drop the job if it has not started yet: its cancel() runs here.
+    // Returns false if it is running or done.
+    bool cancel(TerrainJobId id);
+    // Drop all of the jobs if none of them has started yet, else none
+    bool cancelGroup(const std::vector<TerrainJobId> &ids);
+    void cancelAll(TerrainJobQueue queue);
+    // the job has not started yet
+    bool isQueued(TerrainJobId id);
+
+    // Rank the jobs of equal priority by urgency(focus), highest first. The
+    // urgency is taken when a job is queued; reprioritize() takes it again
+    // for every queued generation and meshing job, e.g. once the viewer
+    // turned. urgency is only called on the main thread, from submit and
+    // reprioritize.
+    void setUrgency(std::function<float(glm::vec2)> urgency);
+    void reprioritize();
+
+    // block until the queue has no queued or running job
+    void waitForDone(TerrainJobQueue queue);
+    void waitForDone();
+
+    // the pool's, see TerrainJobPool
+    void setThreadCount(int threadCount);
+    int threadCount() const;
+    void setThreadLimit(TerrainJobQueue queue, int threads);
+    int threadLimit(TerrainJobQueue queue);
+    void setCores(std::vector<int> cores);
+    const sPtr<TerrainJobPool> &getPool() const;
+
+    // queued, not counting the running ones
+    int pendingCount(TerrainJobQueue queue);
+    // any thread
+    TerrainJobStats getStats(TerrainJobQueue queue) const;
+    static const char *getName(TerrainJobQueue queue);
+};
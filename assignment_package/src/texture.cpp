@@ -1,21 +1,38 @@
 #include "texture.h"
+#include "memorystats.h"
 
 #include <QImage>
+#include <QOpenGLContext>
 #include <QOpenGLWidget>
+#include <algorithm>
+#include <chrono>
+
+// EXT_texture_filter_anisotropic and EXT_texture_compression_s3tc, in
+// case the headers Qt wraps lack them
+#ifndef GL_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_TEXTURE_MAX_ANISOTROPY_EXT 0x84FE
+#endif
+#ifndef GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT
+#define GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT 0x84FF
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
 
 Texture::Texture(OpenGLContext *context)
-    : context(context), m_textureHandle(-1), m_textureImage(nullptr), slot(-1)
+    : context(context), m_textureHandle(-1), m_textureImage(nullptr), slot(-1), m_gpuBytes(0)
 {}
 
 Texture::Texture()
-    : context(), m_textureHandle(-1), m_textureImage(nullptr), slot(-1)
+    : context(), m_textureHandle(-1), m_textureImage(nullptr), slot(-1), m_gpuBytes(0)
 {}
 
+// the copy shares the texture, which stays counted once
 Texture::Texture(const Texture &texture)
     : context(texture.context),
       m_textureHandle(texture.m_textureHandle),
       m_textureImage(texture.m_textureImage),
-      slot(texture.slot)
+      slot(texture.slot), m_gpuBytes(0)
 {}
 
 Texture::~Texture()
@@ -34,6 +51,16 @@ void Texture::create(const char *texturePath)
     context->printGLErrorLog();
 }
 
+void Texture::create(const QImage &image)
+{
+    context->printGLErrorLog();
+
+    m_textureImage = std::make_shared<QImage>(image);
+    context->glGenTextures(1, &m_textureHandle);
+
+    context->printGLErrorLog();
+}
+
 void Texture::load(int texSlot = 0)
 {
     slot = texSlot;
@@ -54,6 +81,10 @@ void Texture::load(int texSlot = 0)
                           m_textureImage->width(), m_textureImage->height(),
                           0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, m_textureImage->bits());
     context->printGLErrorLog();
+
+    MemoryStats::sub(MemoryCategory::textures, m_gpuBytes);
+    m_gpuBytes = static_cast<size_t>(m_textureImage->width()) * m_textureImage->height() * 4;
+    MemoryStats::add(MemoryCategory::textures, m_gpuBytes);
 }
 
 
@@ -72,3 +103,381 @@ int Texture::getSlot() const
 {
     return slot;
 }
+
+TextureArray::TextureArray(OpenGLContext *context)
+    : context(context), m_textureHandle(0), m_textureGenerated(false), m_images(), slot(-1),
+      m_repeat(false), m_mipmaps(false), m_anisotropy(1.f), m_compressed(false), m_gpuBytes(0),
+      m_loadStarted(false), m_uploadCompressed(false), m_pixelBuffer(0), m_staging(), m_pendingLevels(0),
+      m_pendingLayers(0), m_uploadFence(nullptr)
+{}
+
+void TextureArray::create(const std::vector<const char*> &texturePaths)
+{
+    std::vector<QImage> images;
+    for (const char *path : texturePaths) {
+        QImage img(path);
+        images.push_back(img.convertToFormat(QImage::Format_ARGB32).mirrored());
+    }
+    create(images);
+}
+
+void TextureArray::create(const std::vector<QImage> &images)
+{
+    context->printGLErrorLog();
+
+    m_images = images;
+    m_repeat = false;
+    m_loadStarted = false;
+    if (!m_textureGenerated) {
+        context->glGenTextures(1, &m_textureHandle);
+        m_textureGenerated = true;
+    }
+
+    context->printGLErrorLog();
+}
+
+void TextureArray::createFromTiles(const char *texturePath, int tiles)
+{
+    // mirrored, as GL reads it: the first rows are the bottom ones
+    createFromTiles(QImage(texturePath).convertToFormat(QImage::Format_ARGB32).mirrored(), tiles);
+}
+
+void TextureArray::createFromTiles(const QImage &atlas, int tiles)
+{
+    context->printGLErrorLog();
+
+    int tileWidth = atlas.width() / tiles;
+    int tileHeight = atlas.height() / tiles;
+    m_images.clear();
+    for (int v = 0; v < tiles; v++) {
+        for (int u = 0; u < tiles; u++) {
+            m_images.push_back(atlas.copy(u * tileWidth, v * tileHeight, tileWidth, tileHeight));
+        }
+    }
+    m_repeat = true;
+    m_loadStarted = false;
+    if (!m_textureGenerated) {
+        context->glGenTextures(1, &m_textureHandle);
+        m_textureGenerated = true;
+    }
+
+    context->printGLErrorLog();
+}
+
+void TextureArray::setSampling(bool mipmaps, float anisotropy, bool compressed)
+{
+    m_mipmaps = mipmaps;
+    m_anisotropy = anisotropy;
+    m_compressed = compressed;
+}
+
+// the levels load() uploads: the whole chain if mipmapped
+static int levelCount(int width, int height, bool mipmaps)
+{
+    int levels = 1;
+    if (mipmaps) {
+        while ((std::max(width, height) >> levels) > 0) {
+            levels++;
+        }
+    }
+    return levels;
+}
+
+static size_t layerBytes(int width, int height, int level)
+{
+    return static_cast<size_t>(std::max(1, width >> level)) * std::max(1, height >> level) * 4;
+}
+
+/**
+ * @brief copyLevels
+ *  Every level of the layers, one after the other, each level's layers
+ *  one after the other, into out. The mipmaps are made here, each layer
+ *  halved on its own, rather than by glGenerateMipmap, which can't fill a
+ *  compressed texture. Reads nothing but its arguments, so it runs on any
+ *  thread.
+ * @param layers : all width x height
+ * @param width
+ * @param height
+ * @param levels
+ * @param out    : the bytes of every level's layers
+ */
+static void copyLevels(std::vector<QImage> layers, int width, int height, int levels, uchar *out)
+{
+    for (int l = 0; l < levels; l++) {
+        int levelWidth = std::max(1, width >> l);
+        int levelHeight = std::max(1, height >> l);
+        size_t bytes = layerBytes(width, height, l);
+        for (QImage &layer : layers) {
+            if (l > 0) {
+                // smooth scaling comes back premultiplied
+                layer = layer.scaled(levelWidth, levelHeight, Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+                             .convertToFormat(QImage::Format_ARGB32);
+            }
+            std::copy(layer.constBits(), layer.constBits() + bytes, out);
+            out += bytes;
+        }
+    }
+}
+
+/**
+ * @brief TextureArray::prepareLoad
+ *  Filtered as Texture::load does, per layer, unless setSampling asked
+ *  for more; every level is uploaded whole, for the driver to compress.
+ *  The layers not of the first one's size are left empty.
+ * @param texSlot
+ * @param levels : out, the levels the texture will have
+ * @return the layers to upload, all of the first one's size
+ */
+std::vector<QImage> TextureArray::prepareLoad(int texSlot, int *levels)
+{
+    slot = texSlot;
+    m_loadStarted = true;
+    context->printGLErrorLog();
+
+    context->glActiveTexture(GL_TEXTURE0 + texSlot);
+    context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureHandle);
+
+    QOpenGLContext *ctx = context->context();
+    int width = m_images[0].width();
+    int height = m_images[0].height();
+    *levels = levelCount(width, height, m_mipmaps);
+    m_uploadCompressed = m_compressed && ctx->hasExtension(QByteArrayLiteral("GL_EXT_texture_compression_s3tc"));
+
+    // up close the tiles stay crisp; far off the mipmaps are blended
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, m_mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_NEAREST);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, m_repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, m_repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    if (m_anisotropy > 1.f && (ctx->hasExtension(QByteArrayLiteral("GL_EXT_texture_filter_anisotropic"))
+                               || ctx->hasExtension(QByteArrayLiteral("GL_ARB_texture_filter_anisotropic")))) {
+        GLfloat maxAnisotropy = 1.f;
+        context->glGetFloatv(GL_MAX_TEXTURE_MAX_ANISOTROPY_EXT, &maxAnisotropy);
+        context->glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_ANISOTROPY_EXT, std::min(m_anisotropy, maxAnisotropy));
+    }
+
+    std::vector<QImage> layers;
+    for (size_t layer = 0; layer < m_images.size(); layer++) {
+        const QImage &img = m_images[layer];
+        if (img.width() != width || img.height() != height) {
+            qWarning("Texture array layer %d is %dx%d, not %dx%d; left empty",
+                     static_cast<int>(layer), img.width(), img.height(), width, height);
+            QImage empty(width, height, QImage::Format_ARGB32);
+            empty.fill(Qt::transparent);
+            layers.push_back(empty);
+        } else {
+            layers.push_back(img);
+        }
+    }
+    return layers;
+}
+
+/**
+ * @brief TextureArray::uploadLevels
+ *  The texture bound, from the levels copyLevels made at pixels: in
+ *  client memory, or, if null, from the start of the bound pixel unpack
+ *  buffer.
+ * @param levels
+ * @param layers
+ * @param pixels
+ */
+void TextureArray::uploadLevels(int levels, size_t layers, const uchar *pixels)
+{
+    int width = m_images[0].width();
+    int height = m_images[0].height();
+    GLenum internalFormat = m_uploadCompressed ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_RGBA;
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+
+    size_t gpuBytes = 0;
+    size_t offset = 0;
+    for (int l = 0; l < levels; l++) {
+        int levelWidth = std::max(1, width >> l);
+        int levelHeight = std::max(1, height >> l);
+        // BC3: 16 bytes per 4 x 4 block
+        gpuBytes += layers * (m_uploadCompressed ? static_cast<size_t>((levelWidth + 3) / 4) * ((levelHeight + 3) / 4) * 16
+                                                 : layerBytes(width, height, l));
+        const void *data = pixels != nullptr ? static_cast<const void*>(pixels + offset)
+                                             : reinterpret_cast<const void*>(offset);
+        context->glTexImage3D(GL_TEXTURE_2D_ARRAY, l, internalFormat, levelWidth, levelHeight,
+                              static_cast<GLsizei>(layers), 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, data);
+        offset += layers * layerBytes(width, height, l);
+    }
+    context->printGLErrorLog();
+
+    MemoryStats::sub(MemoryCategory::textures, m_gpuBytes);
+    m_gpuBytes = gpuBytes;
+    MemoryStats::add(MemoryCategory::textures, m_gpuBytes);
+}
+
+void TextureArray::load(int texSlot)
+{
+    if (m_images.empty()) {
+        slot = texSlot;
+        return;
+    }
+    int levels;
+    std::vector<QImage> layers = prepareLoad(texSlot, &levels);
+    int width = m_images[0].width();
+    int height = m_images[0].height();
+    size_t bytes = 0;
+    for (int l = 0; l < levels; l++) {
+        bytes += layers.size() * layerBytes(width, height, l);
+    }
+    std::vector<uchar> pixels(bytes);
+    size_t layerCount = layers.size();
+    copyLevels(std::move(layers), width, height, levels, pixels.data());
+    uploadLevels(levels, layerCount, pixels.data());
+}
+
+/**
+ * @brief TextureArray::loadAsync
+ *  The pixel buffer is mapped here and filled by the worker; the texture
+ *  keeps what it held (see loadPlaceholder) until pollUpload() sends it.
+ * @param texSlot
+ */
+void TextureArray::loadAsync(int texSlot)
+{
+    if (m_images.empty()) {
+        slot = texSlot;
+        return;
+    }
+    int levels;
+    std::vector<QImage> layers = prepareLoad(texSlot, &levels);
+    int width = m_images[0].width();
+    int height = m_images[0].height();
+    size_t bytes = 0;
+    for (int l = 0; l < levels; l++) {
+        bytes += layers.size() * layerBytes(width, height, l);
+    }
+
+    context->glGenBuffers(1, &m_pixelBuffer);
+    context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+    context->glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+    uchar *mapped = static_cast<uchar*>(context->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes,
+                                                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (mapped == nullptr) {
+        // the driver would not map it: copied and sent now, as load() does
+        context->glDeleteBuffers(1, &m_pixelBuffer);
+        m_pixelBuffer = 0;
+        std::vector<uchar> pixels(bytes);
+        size_t layerCount = layers.size();
+        copyLevels(std::move(layers), width, height, levels, pixels.data());
+        uploadLevels(levels, layerCount, pixels.data());
+        return;
+    }
+    m_pendingLevels = levels;
+    m_pendingLayers = layers.size();
+    m_staging = std::async(std::launch::async, copyLevels, std::move(layers), width, height, levels, mapped);
+}
+
+/**
+ * @brief TextureArray::pollUpload
+ *  Once the worker has filled the pixel buffer, the levels are specified
+ *  from it: the driver copies them on its own time, and draws see them
+ *  from then on. The buffer is deleted once the fence after them says
+ *  the GPU has read it.
+ * @return true if nothing of a loadAsync() is in flight
+ */
+bool TextureArray::pollUpload()
+{
+    if (m_staging.valid()) {
+        if (m_staging.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return false;
+        }
+        m_staging.get();
+        context->glActiveTexture(GL_TEXTURE0 + slot);
+        context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureHandle);
+        context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+        if (context->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER) == GL_TRUE) {
+            uploadLevels(m_pendingLevels, m_pendingLayers, nullptr);
+        } else {
+            // the buffer's contents were lost while mapped (a mode switch, say)
+            context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            context->glDeleteBuffers(1, &m_pixelBuffer);
+            m_pixelBuffer = 0;
+            load(slot);
+            return true;
+        }
+        context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        m_uploadFence = context->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        return false;
+    }
+    if (m_uploadFence != nullptr) {
+        GLenum status = context->glClientWaitSync(m_uploadFence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return false;
+        }
+        context->glDeleteSync(m_uploadFence);
+        m_uploadFence = nullptr;
+        context->glDeleteBuffers(1, &m_pixelBuffer);
+        m_pixelBuffer = 0;
+    }
+    return true;
+}
+
+bool TextureArray::isLoadStarted() const
+{
+    return m_loadStarted;
+}
+
+/**
+ * @brief TextureArray::loadPlaceholder
+ *  One layer of one texel: a layer past the last reads the last, so any
+ *  layer a draw asks for is color.
+ * @param texSlot
+ * @param color
+ */
+void TextureArray::loadPlaceholder(int texSlot, QRgb color)
+{
+    slot = texSlot;
+    if (!m_textureGenerated) {
+        context->glGenTextures(1, &m_textureHandle);
+        m_textureGenerated = true;
+    }
+    context->glActiveTexture(GL_TEXTURE0 + texSlot);
+    context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureHandle);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+    context->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+    context->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA, 1, 1, 1, 0, GL_BGRA, GL_UNSIGNED_INT_8_8_8_8_REV, &color);
+    context->printGLErrorLog();
+}
+
+void TextureArray::bind(int texSlot)
+{
+    context->glActiveTexture(GL_TEXTURE0 + texSlot);
+    context->glBindTexture(GL_TEXTURE_2D_ARRAY, m_textureHandle);
+}
+
+void TextureArray::destroy()
+{
+    // the worker may still be writing into the mapped buffer
+    if (m_staging.valid()) {
+        m_staging.wait();
+        m_staging = std::future<void>();
+        context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+        context->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        context->glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    if (m_uploadFence != nullptr) {
+        context->glDeleteSync(m_uploadFence);
+        m_uploadFence = nullptr;
+    }
+    if (m_pixelBuffer != 0) {
+        context->glDeleteBuffers(1, &m_pixelBuffer);
+        m_pixelBuffer = 0;
+    }
+    if (m_textureGenerated) {
+        context->glDeleteTextures(1, &m_textureHandle);
+        m_textureGenerated = false;
+    }
+    MemoryStats::sub(MemoryCategory::textures, m_gpuBytes);
+    m_gpuBytes = 0;
+}
+
+int TextureArray::getSlot() const
+{
+    return slot;
+}
@@ -5,7 +5,10 @@
 
 #include <openglcontext.h>
 #include <la.h>
+#include <QImage>
+#include <future>
 #include <memory>
+#include <vector>
 
 /**
  * @brief The NPCTexture enum
@@ -27,6 +30,8 @@ public:
     Texture(const Texture &texture);
 
     void create(const char *texturePath);
+    // Same, from an image decoded already (see ImageDecoder)
+    void create(const QImage &image);
     void load(int texSlot);
     void bind(int texSlot);
 
@@ -39,7 +44,80 @@ private:
     std::shared_ptr<QImage> m_textureImage;
     // the textSlot being loaded
     int slot;
+    // the bytes load() uploaded, counted in MemoryCategory::textures
+    size_t m_gpuBytes;
 };
 
+/**
+ * @brief The TextureArray class
+ *  Images of one size as the layers of a GL_TEXTURE_2D_ARRAY, so what
+ *  would be several textures binds, and draws, as one (see HudBatch).
+ */
+class TextureArray
+{
+public:
+    TextureArray(OpenGLContext* context);
+
+    // one layer per image, in order; they must all be the same size
+    void create(const std::vector<const char*> &texturePaths);
+    // Same, from images decoded already (see ImageDecoder)
+    void create(const std::vector<QImage> &images);
+    // one layer per tile of an atlas of tiles x tiles tiles, row by row
+    // from the bottom left one (the tile at uv column u, row v is layer
+    // v * tiles + u); the layers repeat, for faces spanning several tiles
+    void createFromTiles(const char *texturePath, int tiles);
+    void createFromTiles(const QImage &atlas, int tiles);
+    // From the next load() on: mipmaps, filtered within each layer so no
+    // tile bleeds into another; anisotropic filtering of up to anisotropy
+    // samples where the driver has it (1: none); S3TC (BC3) compression
+    // where the driver has it. Off by default, as the HUD wants.
+    void setSampling(bool mipmaps, float anisotropy, bool compressed);
+    void load(int texSlot);
+    // Same, but the mipmaps are made and copied into a pixel buffer on a
+    // worker, and the texture only specified from it by pollUpload()
+    void loadAsync(int texSlot);
+    // Call every frame after loadAsync(); true once nothing of it is in
+    // flight, the pixel buffer freed
+    bool pollUpload();
+    // load() or loadAsync() was called since the last create*()
+    bool isLoadStarted() const;
+    // one texel of color in every layer, for the draws until the images
+    // are loaded
+    void loadPlaceholder(int texSlot, QRgb color);
+    void bind(int texSlot);
+    void destroy();
+
+    int getSlot() const;
+
+private:
+    OpenGLContext* context;
+    GLuint m_textureHandle;
+    bool m_textureGenerated;
+    std::vector<QImage> m_images;
+    int slot;
+
+    bool m_repeat;
+    bool m_mipmaps;
+    float m_anisotropy;
+    bool m_compressed;
+    // the bytes of every level load() uploaded, counted in
+    // MemoryCategory::textures until destroy()
+    size_t m_gpuBytes;
+
+    bool m_loadStarted;
+    // S3TC asked for and available, as the levels being loaded are
+    bool m_uploadCompressed;
+    // loadAsync()'s levels: the worker copying them into the mapped
+    // m_pixelBuffer, then the fence after they were specified from it
+    GLuint m_pixelBuffer;
+    std::future<void> m_staging;
+    int m_pendingLevels;
+    size_t m_pendingLayers;
+    GLsync m_uploadFence;
+
+    // bind the texture and set its sampling for the images' levels
+    std::vector<QImage> prepareLoad(int texSlot, int *levels);
+    void uploadLevels(int levels, size_t layers, const uchar *pixels);
+};
 
 #endif // TEXTURE_H
@@ -0,0 +1,29 @@
+#include "threadaffinity.h"
+#include <QtGlobal>
+
+#ifdef Q_OS_LINUX
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+bool pinCurrentThread(const std::vector<int> &cores)
+{
+#ifdef Q_OS_LINUX
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (cores.empty()) {
+        for (int core = 0; core < CPU_SETSIZE; core++) {
+            CPU_SET(core, &set);
+        }
+    }
+    for (int core : cores) {
+        if (core < 0 || core >= CPU_SETSIZE) {
+            return false;
+        }
+        CPU_SET(core, &set);
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    return cores.empty();
+#endif
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <vector>
+
+// Restrict the calling thread to the given cores, or let it run on any
+// core again if there are none. False where the platform does not
+// support it (only Linux does) or the cores are invalid.
+bool pinCurrentThread(const std::vector<int> &cores);
@@ -0,0 +1,138 @@
+#include "threadconfig.h"
+#include <QFileInfo>
+#include <QSettings>
+#include <QStringList>
+
+// the keys / options: name, value name, help
+static const char *const countKeys[][3] = {
+    {"terrain-threads", "count", "Threads of the terrain job system (0: one per core but one)."},
+    {"generation-threads", "count", "Terrain threads that may run generation at once (0: all)."},
+    {"meshing-threads", "count", "Terrain threads that may run meshing at once (0: all)."},
+    {"npc-threads", "count", "Threads stepping the NPCs and running their path searches (0: two)."},
+    {"path-searches", "count", "NPC path searches per tick (0: the default budget)."}
+};
+static const char *const coreKeys[][3] = {
+    {"terrain-cores", "cores", "Cores the terrain threads run on, e.g. 0-3,6."},
+    {"npc-cores", "cores", "Cores the NPC threads run on."}
+};
+
+/**
+ * @brief parseCores
+ *  A comma-separated list of cores and inclusive ranges, e.g. 0-3,6
+ * @param text
+ * @param cores : replaced on success
+ * @return
+ */
+static bool parseCores(const QString &text, std::vector<int> &cores)
+{
+    std::vector<int> parsed;
+    for (const QString &part : text.split(',', Qt::SkipEmptyParts)) {
+        QStringList range = part.trimmed().split('-');
+        bool okFirst = false, okLast = false;
+        int first = range[0].toInt(&okFirst);
+        int last = range.size() == 2 ? range[1].toInt(&okLast) : first;
+        if (range.size() > 2 || !okFirst || (range.size() == 2 && !okLast)
+                || first < 0 || last < first) {
+            return false;
+        }
+        for (int core = first; core <= last; core++) {
+            parsed.push_back(core);
+        }
+    }
+    cores = parsed;
+    return true;
+}
+
+ThreadConfig::ThreadConfig()
+    : terrainThreads(0), generationThreads(0), meshingThreads(0), terrainCores(),
+      npcThreads(0), pathSearchesPerTick(0), npcCores()
+{}
+
+ThreadConfig &ThreadConfig::global()
+{
+    static ThreadConfig config;
+    return config;
+}
+
+void ThreadConfig::addOptions(QCommandLineParser &parser)
+{
+    parser.addOption(QCommandLineOption("config", "INI file with a [threads] section of the options below.", "file"));
+    for (const auto &key : countKeys) {
+        parser.addOption(QCommandLineOption(key[0], key[2], key[1]));
+    }
+    for (const auto &key : coreKeys) {
+        parser.addOption(QCommandLineOption(key[0], key[2], key[1]));
+    }
+}
+
+/**
+ * @brief ThreadConfig::load
+ * @param parser : processed, with addOptions' options
+ * @param error
+ * @return
+ */
+bool ThreadConfig::load(const QCommandLineParser &parser, QString &error)
+{
+    // the file's values first, then the command line's over them
+    QStringList names;
+    std::vector<QString> values;
+    if (parser.isSet("config")) {
+        QString path = parser.value("config");
+        if (!QFileInfo::exists(path)) {
+            error = "No config file " + path;
+            return false;
+        }
+        QSettings settings(path, QSettings::IniFormat);
+        settings.beginGroup("threads");
+        for (const QString &key : settings.childKeys()) {
+            names.push_back(key);
+            values.push_back(settings.value(key).toString());
+        }
+        settings.endGroup();
+    }
+    // only the options addOptions added; the parser may hold others
+    for (const auto &key : countKeys) {
+        if (parser.isSet(key[0])) {
+            names.push_back(key[0]);
+            values.push_back(parser.value(key[0]));
+        }
+    }
+    for (const auto &key : coreKeys) {
+        if (parser.isSet(key[0])) {
+            names.push_back(key[0]);
+            values.push_back(parser.value(key[0]));
+        }
+    }
+
+    int *counts[] = {&terrainThreads, &generationThreads, &meshingThreads, &npcThreads, &pathSearchesPerTick};
+    std::vector<int> *cores[] = {&terrainCores, &npcCores};
+    for (int i = 0; i < names.size(); i++) {
+        bool known = false;
+        for (size_t k = 0; k < sizeof(countKeys) / sizeof(countKeys[0]); k++) {
+            if (names[i] == countKeys[k][0]) {
+                bool ok = false;
+                int count = values[i].toInt(&ok);
+                if (!ok || count < 0) {
+                    error = "Bad " + names[i] + ": " + values[i];
+                    return false;
+                }
+                *counts[k] = count;
+                known = true;
+            }
+        }
+        for (size_t k = 0; k < sizeof(coreKeys) / sizeof(coreKeys[0]); k++) {
+            if (names[i] == coreKeys[k][0]) {
+                if (!parseCores(values[i], *cores[k])) {
+                    error = "Bad " + names[i] + ": " + values[i];
+                    return false;
+                }
+                known = true;
+            }
+        }
+        if (!known) {
+            error = "Unknown thread setting " + names[i];
+            return false;
+        }
+    }
+    return true;
+}
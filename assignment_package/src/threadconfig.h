@@ -0,0 +1,40 @@
+#pragma once
+#include <QCommandLineParser>
+#include <QString>
+#include <vector>
+
+/**
+ * @brief The ThreadConfig struct
+ *  How many threads each subsystem runs and the cores they may run on,
+ *  read once in main() from an optional INI file (section [threads])
+ *  and the command line, which wins. A count of 0 keeps the subsystem's
+ *  default; no cores leaves its threads unpinned.
+ *  The keys and options share names, e.g. terrain-threads=3 in the file
+ *  or --terrain-threads 3; cores are lists such as 0-3,6.
+ */
+struct ThreadConfig
+{
+    // The TerrainJobSystem's threads, which generation, meshing and I/O
+    // share, and how many of them may run generation / meshing at once
+    int terrainThreads;
+    int generationThreads;
+    int meshingThreads;
+    std::vector<int> terrainCores;
+
+    // The NPCSimulation's threads, which also run the path searches, and
+    // the searches it may run per tick
+    int npcThreads;
+    int pathSearchesPerTick;
+    std::vector<int> npcCores;
+
+    ThreadConfig();
+
+    // register the options on the parser
+    static void addOptions(QCommandLineParser &parser);
+    // Read the --config file, if given, then the options over it.
+    // False, with a message in error, if a value is malformed.
+    bool load(const QCommandLineParser &parser, QString &error);
+
+    // the config main() read, for the subsystems to apply
+    static ThreadConfig &global();
+};
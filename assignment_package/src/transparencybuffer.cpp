@@ -0,0 +1,73 @@
+#include "transparencybuffer.h"
+#include <iostream>
+
+TransparencyBuffer::TransparencyBuffer(OpenGLContext *context)
+    : mp_context(context), m_frameBuffer(-1), m_accumTexture(-1), m_revealageTexture(-1), m_created(false)
+{}
+
+bool TransparencyBuffer::create(unsigned int pixelWidth, unsigned int pixelHeight, GLuint depthTexture) {
+    mp_context->glGenFramebuffers(1, &m_frameBuffer);
+    mp_context->glGenTextures(1, &m_accumTexture);
+    mp_context->glGenTextures(1, &m_revealageTexture);
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+
+    // read texel for texel by the composite: no filtering
+    auto createTarget = [&](GLuint texture, GLint internalFormat, GLenum format, GLenum type, GLenum attachment) {
+        mp_context->glBindTexture(GL_TEXTURE_2D, texture);
+        mp_context->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, pixelWidth, pixelHeight, 0, format, type, (void*)0);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        mp_context->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        mp_context->glFramebufferTexture(GL_FRAMEBUFFER, attachment, texture, 0);
+    };
+    createTarget(m_accumTexture, GL_RGBA16F, GL_RGBA, GL_HALF_FLOAT, GL_COLOR_ATTACHMENT0);
+    createTarget(m_revealageTexture, GL_R8, GL_RED, GL_UNSIGNED_BYTE, GL_COLOR_ATTACHMENT1);
+    mp_context->glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0);
+
+    GLenum drawBuffers[2] = {GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1};
+    mp_context->glDrawBuffers(2, drawBuffers);
+
+    m_created = true;
+    if(mp_context->glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cout << "Transparency buffer did not initialize correctly..." << std::endl;
+        mp_context->printGLErrorLog();
+        destroy();
+    }
+    return m_created;
+}
+
+void TransparencyBuffer::destroy() {
+    if(m_frameBuffer != static_cast<GLuint>(-1)) {
+        mp_context->glDeleteFramebuffers(1, &m_frameBuffer);
+        mp_context->glDeleteTextures(1, &m_accumTexture);
+        mp_context->glDeleteTextures(1, &m_revealageTexture);
+        m_frameBuffer = m_accumTexture = m_revealageTexture = -1;
+    }
+    m_created = false;
+}
+
+bool TransparencyBuffer::isCreated() const {
+    return m_created;
+}
+
+void TransparencyBuffer::begin() {
+    mp_context->glBindFramebuffer(GL_FRAMEBUFFER, m_frameBuffer);
+    const GLfloat noColor[4] = {0.f, 0.f, 0.f, 0.f};
+    const GLfloat revealed[4] = {1.f, 0.f, 0.f, 0.f};
+    mp_context->glClearBufferfv(GL_COLOR, 0, noColor);
+    mp_context->glClearBufferfv(GL_COLOR, 1, revealed);
+
+    // sums of the weighted colors; the product of the 1 - alphas
+    mp_context->glEnable(GL_BLEND);
+    mp_context->glBlendFunci(0, GL_ONE, GL_ONE);
+    mp_context->glBlendFunci(1, GL_ZERO, GL_ONE_MINUS_SRC_COLOR);
+}
+
+void TransparencyBuffer::bindToTextureSlots(unsigned int accumSlot, unsigned int revealageSlot) {
+    mp_context->glActiveTexture(GL_TEXTURE0 + accumSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_accumTexture);
+    mp_context->glActiveTexture(GL_TEXTURE0 + revealageSlot);
+    mp_context->glBindTexture(GL_TEXTURE_2D, m_revealageTexture);
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include "openglcontext.h"
+
+// The targets of weighted blended order-independent transparency: the
+// transparent pass adds its fragments, weighted by depth and alpha, into
+// an accumulation texture (RGBA16F: the weighted color, and the weights
+// in alpha) and multiplies their 1 - alpha into a revealage texture (R8:
+// how much of the scene behind shows through). Drawn in any order, the
+// two resolve to the same average, which MyGL::renderTransparencyBuffer
+// lays over the scene.
+// The depth test reads the scene's depth buffer, attached as is, so the
+// opaque pass must be drawn to a FrameBuffer of the same size.
+class TransparencyBuffer {
+private:
+    OpenGLContext *mp_context;
+    GLuint m_frameBuffer;
+    GLuint m_accumTexture;
+    GLuint m_revealageTexture;
+    bool m_created;
+
+public:
+    TransparencyBuffer(OpenGLContext *context);
+    // Initialize the targets at the given size in pixels, sharing the
+    // given depth texture; false if the driver cannot render to them
+    bool create(unsigned int pixelWidth, unsigned int pixelHeight, GLuint depthTexture);
+    // Deallocate all GPU-side data
+    void destroy();
+    bool isCreated() const;
+    // Bind the targets and clear them (no color, all revealed), with the
+    // blending each one accumulates with; depth writes are left to the caller
+    void begin();
+    // Associate the accumulation and revealage textures with the given slots
+    void bindToTextureSlots(unsigned int accumSlot, unsigned int revealageSlot);
+};
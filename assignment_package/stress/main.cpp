@@ -0,0 +1,374 @@
+// Concurrency stress harness for the terrain pipeline.
+// Runs the generation jobs, meshing jobs (VBOWorkers, as the game submits
+// them) and main-thread edits over the same chunks on a headless terrain
+// (see Terrain::isHeadless), as fast as they go, on more job threads than
+// cores by default. The player teleports every few hundred ms, often back
+// to where it was, so zones are cancelled mid-generation, evicted with
+// their edits and read back from the region files. The edits land on the
+// chunks' border columns, where a write also dirties the neighbor a
+// meshing job may be reading.
+//
+// Checked as it runs, and reported as failures:
+//  - a block placed reads back at once;
+//  - the edits made high above the terrain (where neither generation nor
+//    the neighbors' trees reach) survive eviction and reload;
+//  - neighbor links are symmetric and match the chunks' corners;
+//  - each mesh is consistent: its quad counts, section ranges and
+//    buffers agree;
+//  - once the jobs stop, every meshing job submitted ran or was
+//    cancelled, and no chunk is left pinned.
+// Reports the throughput of each job queue, the meshes and the edits.
+// Exits with 1 if any check failed. Build with CONFIG+=thread_sanitizer
+// (see stress.pro) to run it under ThreadSanitizer.
+//
+// usage: TerrainStress [--seconds 30] [--seed s] [--half-grid 2]
+//                      [--teleport-ms 250] [--teleport-range 4096]
+//                      [--edits 32] [--meshes 16] [--region-dir dir]
+//                      [--terrain-threads n] ...
+
+#include "scene/terrain.h"
+#include "scene/random.h"
+#include "threadconfig.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <QThread>
+#include <algorithm>
+#include <cstdio>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// the block types the edits place: solid, transparent and air
+static const BlockType editTypes[] = {STONE, DIRT, BRICK, GLASS, EMPTY};
+// the edits at or above it are checked again after eviction
+static const int skyEditY = 252;
+// failures printed in full; the rest are only counted
+static const int maxPrintedFailures = 32;
+
+struct StressStats
+{
+    uint64_t ticks = 0;
+    uint64_t teleports = 0;
+    uint64_t edits = 0;
+    uint64_t skyEditsChecked = 0;
+    uint64_t meshesSubmitted = 0;
+    uint64_t meshesReceived = 0;
+    uint64_t quadsReceived = 0;
+    uint64_t linksChecked = 0;
+    uint64_t failures = 0;
+};
+
+static StressStats stats;
+
+static void fail(const char *what, int x, int y, int z)
+{
+    if (stats.failures++ < maxPrintedFailures) {
+        printf("FAILED: %s at %d, %d, %d\n", what, x, y, z);
+        fflush(stdout);
+    }
+}
+
+static bool isDecorated(const Chunk *chunk)
+{
+    return chunk != nullptr && chunk->getGenerationStage() == GenerationStage::decorated;
+}
+
+// the chunk and every neighbor it has are decorated, as a VBOWorker needs
+static bool isNeighborhoodDecorated(const Chunk *chunk)
+{
+    if (!isDecorated(chunk)) {
+        return false;
+    }
+    for (const Chunk *neighbor : chunk->getNeighborhood()) {
+        if (neighbor != nullptr && !isDecorated(neighbor)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void checkLinks(const Chunk *chunk)
+{
+    static const Direction directions[4] = {XPOS, XNEG, ZPOS, ZNEG};
+    static const Direction opposites[4] = {XNEG, XPOS, ZNEG, ZPOS};
+    static const glm::ivec2 offsets[4] = {glm::ivec2(16, 0), glm::ivec2(-16, 0),
+                                          glm::ivec2(0, 16), glm::ivec2(0, -16)};
+    glm::ivec2 corner = chunk->getCorner();
+    for (int d = 0; d < 4; d++) {
+        const Chunk *neighbor = chunk->getNeighbors()[Chunk::neighborIndex(directions[d])];
+        if (neighbor == nullptr) {
+            continue;
+        }
+        stats.linksChecked++;
+        if (neighbor->getCorner() != corner + offsets[d]) {
+            fail("neighbor link to the wrong corner", corner[0], 0, corner[1]);
+        }
+        if (neighbor->getNeighbors()[Chunk::neighborIndex(opposites[d])] != chunk) {
+            fail("one-way neighbor link", corner[0], 0, corner[1]);
+        }
+    }
+}
+
+static void checkMesh(const ChunkVBOdata &vbo, glm::ivec2 corner)
+{
+    bool consistent = vbo.buffer.size() == vbo.quads * 8
+            && vbo.transparentBuffer.size() == vbo.transparentQuads * 8
+            && vbo.sectionQuadStarts[0] == 0 && vbo.sectionQuadStarts[16] == vbo.quads
+            && vbo.transparentSectionQuadStarts[0] == 0
+            && vbo.transparentSectionQuadStarts[16] == vbo.transparentQuads;
+    for (int sy = 0; sy < 16; sy++) {
+        consistent = consistent && vbo.sectionQuadStarts[sy] <= vbo.sectionQuadStarts[sy + 1]
+                && vbo.transparentSectionQuadStarts[sy] <= vbo.transparentSectionQuadStarts[sy + 1];
+    }
+    if (!consistent) {
+        fail("inconsistent mesh", corner[0], 0, corner[1]);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.addOption(QCommandLineOption("seconds", "How long to run.", "seconds", "30"));
+    parser.addOption(QCommandLineOption("seed", "The world seed; the run's choices follow from it too.", "seed",
+                                        "0x476F6C64656E4F72"));
+    parser.addOption(QCommandLineOption("half-grid", "Zones on each side of the player's zone streamed in.",
+                                        "zones", "2"));
+    parser.addOption(QCommandLineOption("teleport-ms", "The time between two teleports.", "ms", "250"));
+    parser.addOption(QCommandLineOption("teleport-range", "How far from the origin, in blocks, a teleport may "
+                                        "land on each axis.", "blocks", "4096"));
+    parser.addOption(QCommandLineOption("edits", "Border blocks placed per tick.", "edits", "32"));
+    parser.addOption(QCommandLineOption("meshes", "Meshing jobs submitted per tick at most.", "jobs", "16"));
+    parser.addOption(QCommandLineOption("region-dir", "Store the evicted edits here rather than in a "
+                                        "temporary directory.", "dir"));
+    ThreadConfig::addOptions(parser);
+    parser.process(app);
+
+    bool okSeconds = false, okSeed = false, okGrid = false, okTeleport = false, okRange = false;
+    bool okEdits = false, okMeshes = false;
+    double seconds = parser.value("seconds").toDouble(&okSeconds);
+    uint64_t worldSeed = parser.value("seed").toULongLong(&okSeed, 0);
+    int halfGrid = parser.value("half-grid").toInt(&okGrid);
+    int teleportMs = parser.value("teleport-ms").toInt(&okTeleport);
+    int teleportRange = parser.value("teleport-range").toInt(&okRange);
+    int editsPerTick = parser.value("edits").toInt(&okEdits);
+    int meshesPerTick = parser.value("meshes").toInt(&okMeshes);
+    if (!okSeconds || seconds <= 0.0 || !okSeed || !okGrid || halfGrid < 0 || !okTeleport || teleportMs < 1
+            || !okRange || teleportRange < 0 || !okEdits || editsPerTick < 0 || !okMeshes || meshesPerTick < 0) {
+        fprintf(stderr, "The seconds and teleport time must be positive, the seed a number and the rest "
+                        "not negative\n");
+        return 1;
+    }
+    QString configError;
+    if (!ThreadConfig::global().load(parser, configError)) {
+        fprintf(stderr, "%s\n", qPrintable(configError));
+        return 1;
+    }
+    QTemporaryDir temporaryDir;
+    QString regionDir = parser.isSet("region-dir") ? parser.value("region-dir") : temporaryDir.path();
+
+    uPtr<Terrain> terrain = mkU<Terrain>(nullptr, worldSeed);
+    const ThreadConfig &config = ThreadConfig::global();
+    TerrainJobSystem &jobs = terrain->getJobSystem();
+    // more threads than cores, so the jobs preempt each other mid-run
+    jobs.setThreadCount(config.terrainThreads > 0 ? config.terrainThreads : 2 * QThread::idealThreadCount());
+    jobs.setThreadLimit(TerrainJobQueue::generation, config.generationThreads);
+    jobs.setThreadLimit(TerrainJobQueue::meshing, config.meshingThreads);
+    if (!config.terrainCores.empty()) {
+        jobs.setCores(config.terrainCores);
+    }
+    terrain->setRegionDirectory(regionDir);
+    // little beyond the grid stays resident, so the teleports evict
+    terrain->setResidency(halfGrid + 1, (2 * halfGrid + 3) * (2 * halfGrid + 3));
+    printf("stressing for %.0f s on %d threads: %d x %d zones, a teleport every %d ms, %d edits and up to %d "
+           "meshes per tick\n", seconds, jobs.threadCount(), 2 * halfGrid + 1, 2 * halfGrid + 1, teleportMs,
+           editsPerTick, meshesPerTick);
+    fflush(stdout);
+
+    Random random(worldSeed);
+    auto randomInt = [&random](int lo, int hi) {
+        return lo + static_cast<int>(random.nextUInt() % static_cast<uint64_t>(hi - lo + 1));
+    };
+
+    MPSCQueue<ChunkVBOdata> meshes;
+    // the chunks with a meshing job queued or running, and their corners:
+    // a finished mesh's chunk may be gone by the time it is taken
+    std::unordered_map<Chunk*, glm::ivec2> meshing;
+    std::vector<ChunkVBOdata> finished;
+    // the sky edits, by position, as last placed
+    std::unordered_map<int64_t, std::pair<glm::ivec3, BlockType>> skyEdits;
+    std::vector<int64_t> skyEditOrder;
+    size_t nextSkyEdit = 0;
+    std::vector<glm::vec2> visited;
+
+    glm::vec2 player(32.f);
+    QElapsedTimer timer, teleportTimer;
+    timer.start();
+    teleportTimer.start();
+    while (timer.nsecsElapsed() < seconds * 1e9) {
+        stats.ticks++;
+        if (teleportTimer.elapsed() >= teleportMs) {
+            teleportTimer.restart();
+            visited.push_back(player);
+            // back to a place it left a quarter of the time, to read its edits back
+            if (randomInt(0, 3) == 0) {
+                player = visited[randomInt(0, static_cast<int>(visited.size()) - 1)];
+            } else {
+                player = glm::vec2(randomInt(-teleportRange, teleportRange), randomInt(-teleportRange, teleportRange));
+            }
+            stats.teleports++;
+        }
+        terrain->setViewer(glm::vec3(player[0], 200.f, player[1]), glm::vec3(1.f, 0.f, 0.f), glm::vec3(0.f));
+        terrain->expand(player[0], player[1], halfGrid);
+        terrain->checkThreadResults();
+
+        finished.clear();
+        meshes.takeAll(finished);
+        for (ChunkVBOdata &vbo : finished) {
+            auto it = meshing.find(vbo.mp_chunk);
+            if (it == meshing.end()) {
+                fail("mesh of a chunk with no meshing job", 0, 0, 0);
+                continue;
+            }
+            checkMesh(vbo, it->second);
+            stats.meshesReceived++;
+            stats.quadsReceived += vbo.quads + vbo.transparentQuads;
+            meshing.erase(it);
+        }
+
+        // within the zones around the player
+        int spread = 64 * halfGrid + 32;
+        for (int i = 0; i < meshesPerTick; i++) {
+            int x = static_cast<int>(player[0]) + randomInt(-spread, spread);
+            int z = static_cast<int>(player[1]) + randomInt(-spread, spread);
+            if (!terrain->hasChunkAt(x, z)) {
+                continue;
+            }
+            Chunk *chunk = terrain->getChunkAt(x, z).get();
+            checkLinks(chunk);
+            if (meshing.count(chunk) != 0 || !isNeighborhoodDecorated(chunk)) {
+                continue;
+            }
+            meshing[chunk] = chunk->getCorner();
+            jobs.submit<VBOWorker>(TerrainJobQueue::meshing, 0, chunk, &meshes, nullptr, nullptr);
+            stats.meshesSubmitted++;
+        }
+
+        for (int i = 0; i < editsPerTick; i++) {
+            int x = static_cast<int>(player[0]) + randomInt(-spread, spread);
+            int z = static_cast<int>(player[1]) + randomInt(-spread, spread);
+            const Chunk *chunk = terrain->findChunk(x, z);
+            if (!isDecorated(chunk)) {
+                continue;
+            }
+            // onto a border column of the chunk
+            glm::ivec2 corner = chunk->getCorner();
+            if (randomInt(0, 1) == 0) {
+                x = corner[0] + (randomInt(0, 1) == 0 ? 0 : 15);
+            } else {
+                z = corner[1] + (randomInt(0, 1) == 0 ? 0 : 15);
+            }
+            // a quarter of them above the terrain
+            int y = randomInt(0, 3) == 0 ? randomInt(skyEditY, 255)
+                        : glm::clamp(terrain->getColumnTop(x, z) + randomInt(-4, 4), 1, 255);
+            BlockType t = editTypes[randomInt(0, sizeof(editTypes) / sizeof(editTypes[0]) - 1)];
+            terrain->placeBlockAt(x, y, z, t);
+            stats.edits++;
+            if (terrain->getBlockAt(x, y, z) != t) {
+                fail("placed block not read back", x, y, z);
+            }
+            if (y < skyEditY) {
+                continue;
+            }
+            // only once no neighbor is left to stamp its trees here
+            int64_t key = toKey(x, z) * 256 + y;
+            if (!isNeighborhoodDecorated(chunk)) {
+                skyEdits.erase(key);
+            } else {
+                if (skyEdits.count(key) == 0) {
+                    skyEditOrder.push_back(key);
+                }
+                skyEdits[key] = std::make_pair(glm::ivec3(x, y, z), t);
+            }
+        }
+
+        // a few sky edits a tick, round robin, wherever they are resident
+        for (int i = 0; i < 8 && !skyEditOrder.empty(); i++) {
+            nextSkyEdit = (nextSkyEdit + 1) % skyEditOrder.size();
+            auto edit = skyEdits.find(skyEditOrder[nextSkyEdit]);
+            if (edit == skyEdits.end()) {
+                continue;
+            }
+            glm::ivec3 p = edit->second.first;
+            if (!isDecorated(terrain->findChunk(p.x, p.z))) {
+                continue;
+            }
+            stats.skyEditsChecked++;
+            if (terrain->getBlockAt(p.x, p.y, p.z) != edit->second.second) {
+                fail("edit lost", p.x, p.y, p.z);
+            }
+        }
+    }
+    double elapsed = timer.nsecsElapsed() / 1e9;
+
+    terrain->stopWorkers();
+    finished.clear();
+    meshes.takeAll(finished);
+    for (ChunkVBOdata &vbo : finished) {
+        if (meshing.erase(vbo.mp_chunk) != 0) {
+            stats.meshesReceived++;
+        }
+    }
+    TerrainJobStats meshingStats = jobs.getStats(TerrainJobQueue::meshing);
+    // the terrain itself meshes nothing without a context: every meshing job is ours
+    if (stats.meshesReceived + meshingStats.cancelled != stats.meshesSubmitted) {
+        fail("meshing jobs neither run nor cancelled", 0, 0, 0);
+    }
+    for (std::pair<Chunk* const, glm::ivec2> &job : meshing) {
+        const Chunk *chunk = terrain->findChunk(job.second[0], job.second[1]);
+        if (chunk != nullptr && chunk->isPinned()) {
+            fail("chunk left pinned", job.second[0], 0, job.second[1]);
+        }
+    }
+    int spread = 64 * halfGrid + 32;
+    for (int x = static_cast<int>(player[0]) - spread; x <= player[0] + spread; x += 16) {
+        for (int z = static_cast<int>(player[1]) - spread; z <= player[1] + spread; z += 16) {
+            const Chunk *chunk = terrain->findChunk(x, z);
+            if (chunk != nullptr && chunk->isPinned()) {
+                fail("chunk left pinned", x, 0, z);
+            }
+        }
+    }
+
+    printf("%llu ticks in %.2f s (%.0f/s), %llu teleports\n", static_cast<unsigned long long>(stats.ticks), elapsed,
+           stats.ticks / elapsed, static_cast<unsigned long long>(stats.teleports));
+    for (TerrainJobQueue queue : {TerrainJobQueue::generation, TerrainJobQueue::meshing, TerrainJobQueue::io}) {
+        TerrainJobStats queueStats = jobs.getStats(queue);
+        double done = std::max<double>(1.0, queueStats.completed);
+        printf("%-10s %8llu jobs (%.0f/s), %llu cancelled, %.2f ms wait, %.2f ms cpu (max %.2f)\n",
+               TerrainJobSystem::getName(queue), static_cast<unsigned long long>(queueStats.completed),
+               queueStats.completed / elapsed, static_cast<unsigned long long>(queueStats.cancelled),
+               queueStats.waitNs / done / 1e6, queueStats.cpuNs / done / 1e6, queueStats.maxCpuNs / 1e6);
+    }
+    printf("meshes     %8llu received (%.0f/s), %.0f quads each\n",
+           static_cast<unsigned long long>(stats.meshesReceived), stats.meshesReceived / elapsed,
+           stats.quadsReceived / std::max<double>(1.0, stats.meshesReceived));
+    printf("edits      %8llu placed (%.0f/s), %zu above the terrain, checked %llu times after\n",
+           static_cast<unsigned long long>(stats.edits), stats.edits / elapsed, skyEdits.size(),
+           static_cast<unsigned long long>(stats.skyEditsChecked));
+    printf("links      %8llu checked\n", static_cast<unsigned long long>(stats.linksChecked));
+
+    // the region store's destructor waits for the writes
+    terrain = nullptr;
+    if (stats.failures != 0) {
+        printf("%llu checks FAILED\n", static_cast<unsigned long long>(stats.failures));
+        return 1;
+    }
+    printf("all checks passed\n");
+    return 0;
+}
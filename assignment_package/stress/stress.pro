@@ -0,0 +1,56 @@
+# Concurrency stress harness for the terrain pipeline: generation jobs,
+# meshing jobs and main-thread edits on the same chunks, with the player
+# teleporting so zones are cancelled and evicted all along. The terrain
+# is made without a context, so no GL call is ever made; the GL-facing
+# classes are only linked for the scene code that uses them.
+# Build it next to miniMinecraft.pro, e.g.
+#   qmake stress/stress.pro && make && ./TerrainStress --seconds 60
+# and under ThreadSanitizer with
+#   qmake "CONFIG+=thread_sanitizer" stress/stress.pro
+
+QT += core gui widgets openglwidgets network
+
+TARGET = TerrainStress
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+CONFIG += c++1z
+CONFIG += release
+win32 {
+    LIBS += -lopengl32
+}
+
+INCLUDEPATH += $$PWD/../include
+
+include($$PWD/../src/src.pri)
+
+# everything but the game's main(), its windows, renderer and audio
+SRC_DIR = $$clean_path($$PWD/../src)
+SOURCES -= \
+    $$SRC_DIR/main.cpp \
+    $$SRC_DIR/mainwindow.cpp \
+    $$SRC_DIR/cameracontrolshelp.cpp \
+    $$SRC_DIR/playerinfo.cpp \
+    $$SRC_DIR/mygl.cpp \
+    $$SRC_DIR/audiomanager.cpp
+HEADERS -= \
+    $$SRC_DIR/mainwindow.h \
+    $$SRC_DIR/cameracontrolshelp.h \
+    $$SRC_DIR/playerinfo.h \
+    $$SRC_DIR/mygl.h \
+    $$SRC_DIR/audiomanager.h
+
+SOURCES += \
+    $$PWD/main.cpp
+
+RESOURCES += \
+    $$PWD/../glsl.qrc
+
+# with debug info, and optimized enough to reach the races in a run
+thread_sanitizer {
+    message("Enabling Thread Sanitizer")
+    CONFIG -= release
+    CONFIG += debug
+    QMAKE_CXXFLAGS += -fsanitize=thread -O1 -fno-omit-frame-pointer
+    QMAKE_LFLAGS += -fsanitize=thread
+}